@@ -11,8 +11,14 @@ InitAudio = function()
     -- #define FMOD_STUDIO_LOAD_BANK_DECOMPRESS_SAMPLES            0x00000002
     -- #define FMOD_STUDIO_LOAD_BANK_UNENCRYPTED                   0x00000004
 
-    audio_load_bank("data/assets/audio/fmod/Build/Desktop/Master.bank", 0)
-    audio_load_bank("data/assets/audio/fmod/Build/Desktop/Master.strings.bank", 0)
+    -- bank 在 FMOD 的线程上加载 与之后的贴图 字体 材料初始化同时进行 事件在 InitAudioEvents 中查找
+    audio_load_bank("data/assets/audio/fmod/Build/Desktop/Master.bank", 1)
+    audio_load_bank("data/assets/audio/fmod/Build/Desktop/Master.strings.bank", 1)
+
+end
+
+-- 第一次查找事件时等待 bank 加载完成 尽量晚调用
+InitAudioEvents = function()
 
     local audio_event = {
         "event:/Music/Background1",
@@ -34,7 +40,6 @@ InitAudio = function()
     audio_play_event("event:/Player/Fly")
     audio_play_event("event:/Player/Wind")
     audio_play_event("event:/World/Sand")
-    audio_play_event("event:/World/WaterFlow")
 
 end
 
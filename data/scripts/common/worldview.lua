@@ -0,0 +1,69 @@
+-- Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+-- 世界平面的零拷贝 ffi 视图
+-- 指针指向存储位置 逻辑下标 x + y * width 经 origin 环形偏移 用 index / bg_index 换算
+-- 世界平移后 origin 和指针都会变 每帧重新取视图
+--
+-- local wv = require("common.worldview")
+-- local v = wv.view()
+-- if v then
+--     local i = wv.index(v, x, y)
+--     local id, temp = v.ids[i], v.temperatures[i]
+-- end
+
+local ffi = require("ffi")
+local core = require("_ME_worldview")
+
+ffi.cdef(core.cdef)
+
+local worldview = {
+    CHUNK_W = core.CHUNK_W,
+    CHUNK_H = core.CHUNK_H,
+}
+
+-- 只读视图 没有世界时返回 nil
+function worldview.view()
+    local p = core.view()
+    return p and ffi.cast("const ME_WorldView *", p)
+end
+
+-- 可写视图 写完后必须调用 commit(x, y, w, h, background) 交给引擎检查材料id 标记修改和唤醒
+function worldview.write_view()
+    local p = core.write_view()
+    return p and ffi.cast("ME_WorldViewMut *", p)
+end
+
+worldview.commit = core.commit
+
+-- 已加载区块的元数据 下标从 0 到 count - 1
+function worldview.chunks()
+    local p, count = core.chunks()
+    return ffi.cast("const ME_ChunkInfo *", p), count
+end
+
+-- 附近的实体 id 数组 坐标与 WorldEntity 相同 加上 v.loadX v.loadY 才是视图坐标
+worldview.entities_in_radius = core.entities_in_radius
+worldview.entities_in_rect = core.entities_in_rect
+-- x, y, w, h 或 nil
+worldview.entity_bounds = core.entity_bounds
+
+-- 关注区域 (旁观镜头等) 坐标与视图相同 区域内的区块每 interval 个 tick 模拟一次
+-- 有关注区域时 没有被覆盖的区块按 interest_background_interval 模拟 所以主镜头也要登记一个区域
+-- add_interest 返回 id 没有世界时返回 nil
+worldview.add_interest = core.add_interest
+worldview.set_interest = core.set_interest
+worldview.remove_interest = core.remove_interest
+
+function worldview.index(v, x, y)
+    local i = x + y * v.width + v.tilesOrigin
+    if i >= v.count then i = i - v.count end
+    return i
+end
+
+function worldview.bg_index(v, x, y)
+    local i = x + y * v.width + v.backgroundOrigin
+    if i >= v.count then i = i - v.count end
+    return i
+end
+
+return worldview
@@ -1,145 +1,176 @@
 -- Copyright(c) 2022-2023, KaoruXun All rights reserved.
 
+-- 实体和组件存在引擎的原生存储里 (_ME_ecs) 过滤在 C++ 中完成
+-- define 声明的组件是 ffi 结构 同一原型的实体排成连续数组 each_chunk 直接遍历
+-- 其余的组件值留在 Lua 表里 原生存储只记录有无
+-- 遍历时不要增删实体和组件 chunk 里的指针在下一次结构变化后失效
+--
+-- mgr:define("position", "struct { float x, y; }")
+-- mgr:each_chunk(filter.all("position", "velocity"), function(chunk)
+--     local pos, vel = mgr:column(chunk, "position"), mgr:column(chunk, "velocity")
+--     for i = 0, chunk.count - 1 do
+--         pos[i].x = pos[i].x + vel[i].x
+--     end
+-- end)
+
 local class = require("common.class")
+local ffi = require("ffi")
+local core = require("_ME_ecs")
+
+ffi.cdef(core.cdef)
 
 local mt = class("entity_mgr")
 
+local MAX_ALIGN = 16
+
 function mt:on_new()
+    self.store = core.new()
+    -- 组件 id -> 元素指针类型 只有 define 声明的组件有
+    self.ptr_types = {}
+    -- 组件 id -> { [e] = 值 }
+    self.values = {}
     self.archetypes = {}
-    self.e_to_arche_map = {}
-    self.eid = 0
+    -- 过滤条件按表缓存编译结果 条件表应该创建一次反复使用
+    self.queries = setmetatable({}, { __mode = "k" })
+    self.name_queries = {}
 end
 
-function mt:foreach(filter, cb)
-    local chunks = self:get_chunks_by_filter(filter)
-    for _, chunk in ipairs(chunks) do
-        for _, e_data in pairs(chunk) do
-            --CAT_TODO:应该要返回一个中间table，防止在cb里访问不存在的component
-            cb(e_data)
-        end
+-- ctype 为 C 类型的字符串 像 "struct { float x, y; }" 或者 ffi.cdef 声明过的名字
+function mt:define(com_name, ctype)
+    local size = ffi.sizeof(ctype)
+    assert(ffi.alignof(ctype) <= MAX_ALIGN, "component alignment too large: " .. com_name)
+    local id = self.store:define(com_name, size)
+    if size > 0 then
+        self.ptr_types[id] = ffi.typeof(ctype .. " *")
     end
+    return id
 end
 
+function mt:__id(com_name)
+    local id = self.store:component(com_name)
+    if not id then
+        id = self.store:define(com_name)
+    end
+    if not self.ptr_types[id] and not self.values[id] then
+        self.values[id] = {}
+    end
+    return id
+end
+
+function mt:__query(filter)
+    local cache = type(filter) == "table" and self.queries or self.name_queries
+    local q = cache[filter]
+    if not q then
+        q = self.store:compile(filter)
+        cache[filter] = q
+    end
+    return q
+end
+
+-- 匹配的非空原型 ME_EcsChunk 数组 下标从 0 到 count - 1
 function mt:get_chunks_by_filter(filter)
-    local ret = {}
-    for archetype_name, v in pairs(self.archetypes) do
-        local archetype = self.archetypes[archetype_name]
-        if self:is_match(archetype.com_names_map, filter) then
-            ret[#ret + 1] = v.chunk
+    local p, count = self.store:chunks(self:__query(filter))
+    return ffi.cast("const ME_EcsChunk *", p), count
+end
+
+function mt:each_chunk(filter, cb)
+    local chunks, count = self:get_chunks_by_filter(filter)
+    for i = 0, count - 1 do
+        cb(chunks[i])
+    end
+end
+
+-- define 声明的组件在 chunk 中的数组 下标与 chunk.entities 相同
+function mt:column(chunk, com_name)
+    local id = self.store:component(com_name)
+    local ptr_type = id and self.ptr_types[id]
+    assert(ptr_type, "not a native component: " .. tostring(com_name))
+    return ffi.cast(ptr_type, chunk.columns[id])
+end
+
+local view_mt = {
+    __index = function(t, k)
+        return t.__mgr:get_component(t.entity, k)
+    end,
+}
+
+-- 逐个实体回调 e_data.entity 为实体 其余字段按组件名读取
+-- 比 each_chunk 慢 每个实体创建一个表
+function mt:foreach(filter, cb)
+    local chunks, count = self:get_chunks_by_filter(filter)
+    local entities = {}
+    for i = 0, count - 1 do
+        local chunk = chunks[i]
+        for j = 0, chunk.count - 1 do
+            entities[#entities + 1] = chunk.entities[j]
         end
     end
-    return ret
-end
-
-function mt:is_match(com_names_map, filter)
-    if type(filter) == "string" then
-        return com_names_map[filter]
-    else
-        if filter.type == "all" then
-            for _, com_name_or_filter in ipairs(filter.com_name_or_filters) do
-                if not self:is_match(com_names_map, com_name_or_filter) then
-                    return false
-                end
-            end
-            return true
-        elseif filter.type == "any" then
-            for _, com_name_or_filter in ipairs(filter.com_name_or_filters) do
-                if self:is_match(com_names_map, com_name_or_filter) then
-                    return true
-                end
-            end
-            return false
-        elseif filter.type == "no" then
-            for _, com_name_or_filter in ipairs(filter.com_name_or_filters) do
-                if self:is_match(com_names_map, com_name_or_filter) then
-                    return false
-                end
-            end
-            return true
+    -- 先取出实体 回调里可以增删组件
+    for _, e in ipairs(entities) do
+        if self.store:alive(e) then
+            cb(setmetatable({ entity = e, __mgr = self }, view_mt))
         end
     end
-    return false
 end
 
 function mt:create_entity(...)
-    local com_names = { ... }
-    local archetype = self:get_archetype_by_list(com_names)
+    local archetype = self:get_archetype_by_list({ ... })
     return self:create_entity_by_archetype(archetype)
 end
 
 function mt:create_entity_by_archetype(archetype)
-    self.eid = self.eid + 1
-    local e = self.eid
-    self:__add_to_archetype(e, archetype)
-    return e
+    return self.store:create(table.unpack(archetype.ids))
 end
 
 function mt:destroy_entity(e)
-    local archetype = self.e_to_arche_map[e]
-    archetype.chunk[e] = nil
-    self.e_to_arche_map[e] = nil
-end
-
-function mt:__add_to_archetype(e, archetype)
-    local last_archetype = self.e_to_arche_map[e]
-    if last_archetype then
-        archetype.chunk[e] = last_archetype.chunk[e]
-        last_archetype.chunk[e] = nil
-    else
-        archetype.chunk[e] = {
-            entity = e,
-        }
+    for _, values in pairs(self.values) do
+        values[e] = nil
     end
-    self.e_to_arche_map[e] = archetype
+    self.store:destroy(e)
 end
 
 function mt:get_component(e, com_name)
-    local archetype = self.e_to_arche_map[e]
-    if archetype then
-        return archetype.chunk[e][com_name]
+    local id = self.store:component(com_name)
+    if not id or not self.store:has(e, id) then
+        return nil
+    end
+    local ptr_type = self.ptr_types[id]
+    if ptr_type then
+        return ffi.cast(ptr_type, self.store:get(e, id))
     end
-    return nil
+    return self.values[id][e]
 end
 
+-- define 声明的组件可以传同类型的 cdata 或逐字段赋值的表
 function mt:set_component(e, com_name, com_val)
-    local already_has_com = self:has_component(e, com_name)
-    local archetype = self.e_to_arche_map[e]
-    if already_has_com then
-        archetype.chunk[e][com_name] = com_val
-    else
-        local new_com_names = {}
-        for name, v in pairs(archetype.com_names_map) do
-            new_com_names[#new_com_names + 1] = name
+    local id = self:__id(com_name)
+    self.store:add(e, id)
+    local ptr_type = self.ptr_types[id]
+    if not ptr_type then
+        self.values[id][e] = com_val
+    elseif type(com_val) == "table" then
+        local p = ffi.cast(ptr_type, self.store:get(e, id))
+        for k, v in pairs(com_val) do
+            p[k] = v
         end
-        new_com_names[#new_com_names + 1] = com_name
-        local new_archetype = self:get_archetype_by_list(new_com_names)
-        self:__add_to_archetype(e, new_archetype)
-        new_archetype.chunk[e][com_name] = com_val
+    elseif com_val ~= nil then
+        ffi.cast(ptr_type, self.store:get(e, id))[0] = com_val
     end
 end
 
 function mt:remove_component(e, com_name)
-    local already_has_com = self:has_component(e, com_name)
-    if already_has_com then
-        local archetype = self.e_to_arche_map[e]
-        local new_com_names = {}
-        for name, v in pairs(archetype.com_names_map) do
-            if name ~= com_name then
-                new_com_names[#new_com_names + 1] = name
-            end
+    local id = self.store:component(com_name)
+    if id then
+        self.store:remove(e, id)
+        if self.values[id] then
+            self.values[id][e] = nil
         end
-        local new_archetype = self:get_archetype_by_list(new_com_names)
-        self:__add_to_archetype(e, new_archetype)
-        new_archetype.chunk[e][com_name] = nil
     end
 end
 
 function mt:has_component(e, com_name)
-    local archetype = self.e_to_arche_map[e]
-    if archetype.com_names_map[com_name] then
-        return true
-    end
-    return false
+    local id = self.store:component(com_name)
+    return id ~= nil and self.store:has(e, id)
 end
 
 function mt:get_archetype_by_list(com_names)
@@ -147,16 +178,17 @@ function mt:get_archetype_by_list(com_names)
     local str = table.concat(com_names, "$")
 
     if not self.archetypes[str] then
-        self.archetypes[str] = {
-            com_names_map = nil,
-            type_name = str,
-            chunk = {}
-        }
         local com_names_map = {}
+        local ids = {}
         for _, name in ipairs(com_names) do
             com_names_map[name] = true
+            ids[#ids + 1] = self:__id(name)
         end
-        self.archetypes[str].com_names_map = com_names_map
+        self.archetypes[str] = {
+            com_names_map = com_names_map,
+            type_name = str,
+            ids = ids,
+        }
     end
     return self.archetypes[str]
 end
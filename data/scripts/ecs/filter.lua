@@ -1,5 +1,7 @@
 -- Copyright(c) 2022-2023, KaoruXun All rights reserved.
 
+-- 参数为组件名或嵌套的过滤条件
+-- entity_mgr 按表缓存编译好的查询 条件应该创建一次保存起来 不要每帧新建
 local mt = {}
 
 function mt.all(...)
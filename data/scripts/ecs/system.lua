@@ -13,6 +13,15 @@ function mt:foreach(filter, cb)
     self.world.entity_mgr:foreach(filter, cb)
 end
 
+function mt:each_chunk(filter, cb)
+    assert(self.world, "has not add to world!")
+    self.world.entity_mgr:each_chunk(filter, cb)
+end
+
+function mt:column(chunk, com_name)
+    return self.world.entity_mgr:column(chunk, com_name)
+end
+
 function mt:on_update()
     --override me
 end
@@ -56,8 +56,8 @@ local cubeMesh = { { 0.0, 0.0, 0.0,
                      1.0, 1.0, 1.0, 15 }  }
 
 OnGameEngineLoad = function()
-    InitGraphics()
     InitAudio()
+    InitGraphics()
     InitECS()
     InitFont()
     controls_init()
@@ -66,6 +66,7 @@ OnGameEngineLoad = function()
     materials_push()
     
     OnEntitiesTypeLoad()
+    InitAudioEvents()
 end
 
 OnGameLoad = function(game)
@@ -84,6 +85,20 @@ OnGameLoad = function(game)
     create_biome("PLAINS", 9)
     create_biome("MOUNTAINS", 10)
     create_biome("FOREST", 11)
+
+    -- Scripted World 的节点图 引擎编译后在生成线程上按区块批量求值 不会逐像素回调脚本
+    worldgen_clear()
+    local depth = worldgen_gradient_y(400, 600)
+    local hills = worldgen_remap(worldgen_noise_x(15, 0.5), -1, 1, -0.4, 0.4)
+    local ground = worldgen_add(depth, hills)
+    local cave = worldgen_noise(2960, 4, 4)
+    local air = worldgen_const(material_id("GENERIC_AIR"))
+    local dirt = worldgen_const(material_id("SOFT_DIRT"))
+    local stone = worldgen_const(material_id("SMOOTH_STONE"))
+    local rock = worldgen_select(ground, 0.6, dirt, stone)
+    local solid = worldgen_select(cave, -0.3, air, rock)
+    worldgen_output(worldgen_select(ground, 0, air, solid))
+    worldgen_compile()
 end
 
 -- function OnImGuiUpdate() {
@@ -104,6 +119,26 @@ OnGameTickUpdate = function()
     -- world:update()
 end
 
+-- 脚本材料每个区块一批 cells 为 ME_ScriptCell 数组 修改 material color temperature 后由引擎写回
+-- 定义了这个函数才会扫描脚本材料
+-- local ffi = require("ffi")
+-- ffi.cdef(ME_SCRIPT_CELL_CDEF)
+-- local test_sand = material_id("TEST_SAND")
+-- OnMaterialBatch = function(cells, count, cx, cy)
+--     local c = ffi.cast("ME_ScriptCell *", cells)
+--     for i = 0, count - 1 do
+--         if c[i].material == test_sand and c[i].temperature > 100 then
+--             c[i].color = 0xffff4000
+--         end
+--     end
+-- end
+
+-- worker 状态上运行的纯函数 参数和返回值只能是纯数据
+-- workers.load(METADOT_RESLOC("data/scripts/npc_think.lua"))
+-- async.spawn(function()
+--     local action, err = async.worker("npc_think", {x = 10, y = 20, hp = 5})
+-- end)
+
 OnUpdate = function()
     -- world:update()
 end
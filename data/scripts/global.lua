@@ -13,6 +13,7 @@ global_def.draw_b2d_aabb = false
 global_def.draw_b2d_pair = false
 global_def.draw_b2d_centerMass = true
 global_def.draw_chunk_state = false
+global_def.draw_chunk_cost = false
 global_def.draw_debug_stats = false
 global_def.draw_material_info = true
 global_def.draw_detailed_material_info = true
@@ -27,14 +28,53 @@ global_def.water_showFlow = false
 global_def.water_pixelated = false
 global_def.lightingQuality = 0.5
 global_def.draw_light_overlay = false
+global_def.lighting_scale = 1
 global_def.simpleLighting = false
 global_def.lightingEmission = true
 global_def.lightingDithering = false
+global_def.dynamic_resolution_ms = 0
 
 global_def.tick_world = true
 global_def.tick_box2d = true
+global_def.tick_box2d_parallel = true
+global_def.physics_lod_dist = 600
+global_def.physics_step_rate = 30
+global_def.physics_max_steps = 4
+global_def.physics_interpolate = true
+global_def.physics_far_dist = 0
+global_def.physics_far_interval = 2
+global_def.physics_grid_terrain = true
+global_def.tick_liquid_particles = false
+global_def.liquid_particle_min_cells = 1500
+global_def.liquid_level_solver = true
 global_def.tick_temperature = true
 global_def.hd_objects = false
+global_def.streaming_uploads = true
+global_def.gpu_world_pixels = false
+global_def.gpu_cell_sim = false
+global_def.merge_budget_us = 2000
+global_def.populate_budget_us = 4000
+global_def.npc_think_budget_us = 1000
+global_def.npc_sleep_ticks = 30
+global_def.interest_background_interval = 4
+global_def.pregen_radius = 0
+global_def.chunk_cache_mb = 64
+global_def.memory_budget_mb = 2048
+global_def.lua_gc_generational = false
+global_def.lua_gc_budget_us = 500
+global_def.lua_hot_reload = true
+global_def.lua_profiler = false
+global_def.lua_profiler_interval = 1000
+global_def.spike_threshold_ms = 100
+global_def.tick_checksum = false
+global_def.autosave_interval = 300
+global_def.vsync_mode = 0
+global_def.max_fps = 0
+global_def.late_latch = true
+global_def.audio_thread = false
+global_def.job_hybrid_placement = true
+global_def.job_pin_workers = false
+global_def.job_thread_priorities = true
 
 global_def.hd_objects_size = 3
 
@@ -43,6 +83,7 @@ global_def.draw_imgui_debug =false
 global_def.draw_profiler = false
 global_def.draw_console = false
 global_def.draw_pack_editor = false
+global_def.imgui_skip_hidden = true
 
 global_def.cell_iter = 3
 global_def.brush_size = 5
\ No newline at end of file
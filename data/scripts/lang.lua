@@ -75,6 +75,22 @@ i18n.load(lang_pack)
 
 function translate(str) return i18n.translate(str) end
 
+-- 当前语言的所有译文 用于预先缓存字形
+function lang_strings()
+    local out = {}
+    local function collect(t)
+        for _, v in pairs(t) do
+            if type(v) == "table" then
+                collect(v)
+            elseif type(v) == "string" then
+                out[#out + 1] = v
+            end
+        end
+    end
+    collect(lang_pack[i18n.getLocale()] or {})
+    return table.concat(out)
+end
+
 function setlocale(loc)
     i18n.setLocale(loc)
     i18n_ex:set_namespace(loc)
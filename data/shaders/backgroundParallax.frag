@@ -0,0 +1,48 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#version 330
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// 一次绘制所有视差背景层
+// 各层在图集中上下排列 横向无限平铺 纵向只有一块 从后往前按 alpha 混合
+
+#define MAX_LAYERS 8
+
+uniform sampler2D tex;  // 背景层图集
+in vec2 texCoord;       // GLSL 330
+
+uniform vec2 screenSize;
+uniform vec2 uvMax;
+uniform int layerCount;
+uniform vec4 placement[MAX_LAYERS];  // 屏幕上第一块的 x y 宽 高
+uniform vec4 source[MAX_LAYERS];     // 图集中的 x y 宽 高
+
+// GLSL 330
+out vec4 fragColor;
+
+void main() {
+    vec2 p = texCoord / uvMax * screenSize;
+    vec2 atlasSize = vec2(textureSize(tex, 0));
+
+    // 预乘 alpha 累加 输出时还原 与逐层 R_BLEND_NORMAL 绘制结果相同
+    vec4 acc = vec4(0.0);
+    for (int i = 0; i < layerCount; i++) {
+        vec4 pl = placement[i];
+        vec4 src = source[i];
+
+        float ly = p.y - pl.y;
+        if (ly < 0.0 || ly >= pl.w) continue;
+        float lx = mod(p.x - pl.x, pl.z);
+
+        vec2 a = src.xy + vec2(lx, ly) * src.zw / pl.zw;
+        vec4 c = texture(tex, (floor(a) + 0.5) / atlasSize);
+
+        acc.rgb = c.rgb * c.a + acc.rgb * (1.0 - c.a);
+        acc.a = c.a + acc.a * (1.0 - c.a);
+    }
+
+    fragColor = acc.a > 0.0 ? vec4(acc.rgb / acc.a, acc.a) : vec4(0.0);
+}
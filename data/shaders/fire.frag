@@ -64,6 +64,12 @@ void main(){
         num += intensity;
     }
     
+    // 自己和相邻像素都没有火焰时输出透明 否则 0.1 的初值会在整个画面上留下一层灰
+    if(num < 0.2) {
+        gl_FragColor = vec4(0);
+        return;
+    }
+    
     sum.r /= num;
     sum.g /= num;
     sum.b /= num;
@@ -0,0 +1,44 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#version 330
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// 把低分辨率的光照结果放大到世界分辨率
+// 双线性的四个邻居中 与当前像素不在同一侧 (实心/空气) 的权重接近 0 避免光照越过地形边缘
+
+uniform sampler2D tex;       // 低分辨率光照
+in vec2 texCoord;            // GLSL 330
+
+uniform sampler2D worldTex;  // 世界纹理 alpha > 0 为实心
+
+// GLSL 330
+out vec4 fragColor;
+
+void main() {
+    vec2 lowSize = vec2(textureSize(tex, 0));
+    vec2 pos = texCoord * lowSize - 0.5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+
+    bool solid = texture(worldTex, texCoord).a > 0.0;
+
+    vec4 sum = vec4(0.0);
+    float wsum = 0.0;
+    for (int dy = 0; dy <= 1; dy++) {
+        for (int dx = 0; dx <= 1; dx++) {
+            vec2 t = clamp(base + vec2(dx, dy), vec2(0.0), lowSize - 1.0);
+            vec2 uv = (t + 0.5) / lowSize;
+
+            float w = (dx == 0 ? 1.0 - f.x : f.x) * (dy == 0 ? 1.0 - f.y : f.y);
+            if ((texture(worldTex, uv).a > 0.0) != solid) w *= 0.001;
+
+            sum += texture(tex, uv) * w;
+            wsum += w;
+        }
+    }
+
+    fragColor = vec4((sum / max(wsum, 1e-6)).rgb, 1.0);
+}
@@ -0,0 +1,40 @@
+// Copyright(c) 2022-2023, KaoruXun
+
+#version 330
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// 由世界温度平面 (CellStore 的 i16 温度 按存储位置排列) 生成温度图
+// tex 是 R_FORMAT_RG 纹理 r 为低字节 g 为高字节
+
+uniform sampler2D tex;  // 温度平面
+in vec2 texCoord;       // GLSL 330
+
+// 世界宽高 环形存储的起点 逻辑下标 i 在 (i + origin) mod (width * height) 处
+uniform int width;
+uniform int height;
+uniform int origin;
+
+// GLSL 330
+out vec4 fragColor;
+
+// -1024 冷 (蓝) 0 常温 (透明) 1024 以上热 (红 -> 黄 -> 白)
+vec4 colormap(float t) {
+    float c = clamp(t / 1024.0, -1.0, 1.0);
+    if (c < 0.0) return vec4(mix(vec3(0.3, 0.6, 1.0), vec3(0.0, 0.1, 0.8), -c), mix(0.25, 0.94, -c));
+    vec3 hot = c < 0.5 ? mix(vec3(0.6, 0.0, 0.0), vec3(1.0, 0.3, 0.0), c * 2.0) : mix(vec3(1.0, 0.3, 0.0), vec3(1.0, 1.0, 0.8), c * 2.0 - 1.0);
+    return vec4(hot, mix(0.25, 0.94, c));
+}
+
+void main() {
+    ivec2 pos = ivec2(texCoord * vec2(textureSize(tex, 0)));
+    int p = (pos.x + pos.y * width + origin) % (width * height);
+
+    vec2 bytes = texelFetch(tex, ivec2(p % width, p / width), 0).rg * 255.0 + 0.5;
+    int t = int(bytes.r) + int(bytes.g) * 256;
+    if (t >= 32768) t -= 65536;
+
+    fragColor = t == 0 ? vec4(0.0) : colormap(float(t));
+}
@@ -0,0 +1,35 @@
+// Copyright(c) 2022-2023, KaoruXun
+
+#version 330
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// 一次采样所有世界图层合成到 worldTexture
+// 结果与逐层 R_BLEND_NORMAL 叠加到清空的目标上相同 所以输出时使用 R_BLEND_SET
+
+uniform sampler2D tex;  // 世界像素 (最底层)
+in vec2 texCoord;       // GLSL 330
+
+uniform sampler2D objectsTex;
+uniform sampler2D objectsLQTex;
+uniform sampler2D cellsTex;
+uniform sampler2D entitiesLQTex;
+uniform sampler2D entitiesTex;
+
+// GLSL 330
+out vec4 fragColor;
+
+// R_BLEND_NORMAL: 颜色和透明度都是 src * src.a + dst * (1 - src.a)
+vec4 blendNormal(vec4 dst, vec4 src) { return src * src.a + dst * (1.0 - src.a); }
+
+void main() {
+    vec4 c = blendNormal(vec4(0.0), texture(tex, texCoord));
+    c = blendNormal(c, texture(objectsTex, texCoord));
+    c = blendNormal(c, texture(objectsLQTex, texCoord));
+    c = blendNormal(c, texture(cellsTex, texCoord));
+    c = blendNormal(c, texture(entitiesLQTex, texCoord));
+    c = blendNormal(c, texture(entitiesTex, texCoord));
+    fragColor = c;
+}
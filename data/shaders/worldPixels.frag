@@ -0,0 +1,34 @@
+// Copyright(c) 2022-2023, KaoruXun
+
+#version 330
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// 由打包的世界像素 (r g b + 材料下标) 推出世界颜色或发光纹理
+// 与 CellPixelConverter::convert 的结果相同
+
+uniform sampler2D tex;  // 打包像素
+in vec2 texCoord;       // GLSL 330
+
+// 材料属性 第 0 行 (颜色掩码, 0, 0, alpha) 第 1 行发光色
+uniform sampler2D materials;
+
+// 0 输出颜色 1 输出发光色
+uniform int outputMode = 0;
+
+// GLSL 330
+out vec4 fragColor;
+
+void main() {
+    vec4 packed = texture(tex, texCoord);
+    int id = int(packed.a * 255.0 + 0.5);
+
+    if (outputMode == 1) {
+        fragColor = texelFetch(materials, ivec2(id, 1), 0);
+    } else {
+        vec4 props = texelFetch(materials, ivec2(id, 0), 0);
+        fragColor = vec4(packed.rgb * props.r, props.a);
+    }
+}
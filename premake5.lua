@@ -110,3 +110,47 @@ do
 
     links {"external", "SDL2", "ffi", "fmod_vc", "fmodstudio_vc", win32_libs}
 end
+
+-- 无窗口的世界模拟基准 见 source/tests/bench_world.cpp
+project "WorldBench"
+do
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "output"
+    debugdir "output/../"
+
+    files {"source/engine/**.cpp", "source/engine/**.c", "source/engine/**.h", "source/engine/**.hpp"}
+    files {"source/game/**.cpp", "source/game/**.c", "source/game/**.h", "source/game/**.hpp"}
+    files {"source/tests/bench_world.cpp", "source/tests/bench_common.hpp"}
+    removefiles {"source/engine/main.cpp"}
+
+    vpaths {
+        ["engine/*"] = {"source/engine"},
+        ["game/*"] = {"source/game"},
+        ["bench/*"] = {"source/tests"}
+    }
+
+    links {"external", "SDL2", "ffi", "fmod_vc", "fmodstudio_vc", win32_libs}
+end
+
+-- 引擎热点路径的微基准 输出 JSON 见 source/tests/bench_hotpaths.cpp
+project "HotPathBench"
+do
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "output"
+    debugdir "output/../"
+
+    files {"source/engine/**.cpp", "source/engine/**.c", "source/engine/**.h", "source/engine/**.hpp"}
+    files {"source/game/**.cpp", "source/game/**.c", "source/game/**.h", "source/game/**.hpp"}
+    files {"source/tests/bench_hotpaths.cpp", "source/tests/bench_common.hpp"}
+    removefiles {"source/engine/main.cpp"}
+
+    vpaths {
+        ["engine/*"] = {"source/engine"},
+        ["game/*"] = {"source/game"},
+        ["bench/*"] = {"source/tests"}
+    }
+
+    links {"external", "SDL2", "ffi", "fmod_vc", "fmodstudio_vc", win32_libs}
+end
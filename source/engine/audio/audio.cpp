@@ -2,6 +2,9 @@
 
 #include "audio.h"
 
+#include <algorithm>
+#include <chrono>
+
 namespace ME {
 
 void event_instance::start() { assert(false && "Unimpl"); }
@@ -95,6 +98,11 @@ Implementation::~Implementation() {
 }
 
 void Implementation::Update() {
+    UpdateChannels();
+    Audio::ErrorCheck(get_fmod_system()->update());
+}
+
+void Implementation::UpdateChannels() {
     std::vector<ChannelMap::iterator> pStoppedChannels;
     for (auto it = mChannels.begin(), itEnd = mChannels.end(); it != itEnd; ++it) {
         bool bIsPlaying = false;
@@ -106,14 +114,87 @@ void Implementation::Update() {
     for (auto &it : pStoppedChannels) {
         mChannels.erase(it);
     }
-    Audio::ErrorCheck(get_fmod_system()->update());
 }
 
 Implementation *sgpImplementation = nullptr;
 
+namespace {
+
+void execute(const Implementation::Command &c) {
+    switch (c.op) {
+        case Implementation::Command::START:
+            c.instance->start();
+            break;
+        case Implementation::Command::STOP:
+            c.instance->stop(FMOD_STUDIO_STOP_ALLOWFADEOUT);
+            break;
+        case Implementation::Command::STOP_IMMEDIATE:
+            c.instance->stop(FMOD_STUDIO_STOP_IMMEDIATE);
+            break;
+        case Implementation::Command::SET_PARAMETER:
+            Audio::ErrorCheck(c.instance->setParameterByID(c.parameter, c.value));
+            break;
+        case Implementation::Command::SET_VOLUME:
+            c.instance->setVolume(c.value);
+            break;
+    }
+}
+
+// 音频线程没有运行时直接执行
+// 队列满时等音频线程腾出位置 不能绕过队列 否则会跑到还在排队的 STOP 前面
+void submit(const Implementation::Command &c) {
+    Implementation &impl = *sgpImplementation;
+    if (!impl.mThreadRunning.load(std::memory_order_relaxed)) {
+        execute(c);
+        return;
+    }
+    const u32 tail = impl.mCommandTail.load(std::memory_order_relaxed);
+    while (tail - impl.mCommandHead.load(std::memory_order_acquire) >= Implementation::COMMAND_QUEUE_SIZE) std::this_thread::yield();
+    impl.mCommands[tail & (Implementation::COMMAND_QUEUE_SIZE - 1)] = c;
+    impl.mCommandTail.store(tail + 1, std::memory_order_release);
+}
+
+void drain_commands(Implementation &impl) {
+    const u32 tail = impl.mCommandTail.load(std::memory_order_acquire);
+    u32 head = impl.mCommandHead.load(std::memory_order_relaxed);
+    for (; head != tail; head++) execute(impl.mCommands[head & (Implementation::COMMAND_QUEUE_SIZE - 1)]);
+    impl.mCommandHead.store(head, std::memory_order_release);
+}
+
+}  // namespace
+
 void Audio::Init() { sgpImplementation = new Implementation; }
 
-void Audio::Update() { sgpImplementation->Update(); }
+void Audio::Update() {
+    if (Threaded()) {
+        sgpImplementation->UpdateChannels();
+        return;
+    }
+    sgpImplementation->Update();
+}
+
+void Audio::StartThread() {
+    Implementation &impl = *sgpImplementation;
+    if (impl.mThreadRunning.load()) return;
+    impl.mThreadRunning.store(true);
+    impl.mThread = std::thread([&impl]() {
+        while (impl.mThreadRunning.load(std::memory_order_acquire)) {
+            drain_commands(impl);
+            Audio::ErrorCheck(get_fmod_system()->update());
+            std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_THREAD_PERIOD_MS));
+        }
+        drain_commands(impl);
+    });
+}
+
+void Audio::StopThread() {
+    Implementation &impl = *sgpImplementation;
+    if (!impl.mThreadRunning.load()) return;
+    impl.mThreadRunning.store(false, std::memory_order_release);
+    impl.mThread.join();
+}
+
+bool Audio::Threaded() { return sgpImplementation && sgpImplementation->mThreadRunning.load(std::memory_order_relaxed); }
 
 void Audio::LoadSound(const std::string &strSoundName, bool b3d, bool bLooping, bool bStream) {
     auto tFoundIt = sgpImplementation->mSounds.find(strSoundName);
@@ -184,14 +265,23 @@ void Audio::LoadBank(const std::string &strBankName, FMOD_STUDIO_LOAD_BANK_FLAGS
     Audio::ErrorCheck(get_fmod_system()->loadBankFile(strBankName.c_str(), flags, &pBank));
     if (pBank) {
         sgpImplementation->mBanks[strBankName] = pBank;
+        if (flags & FMOD_STUDIO_LOAD_BANK_NONBLOCKING) sgpImplementation->mBanksLoading = true;
     }
 }
 
+void Audio::WaitForBanks() {
+    if (!sgpImplementation->mBanksLoading) return;
+    sgpImplementation->mBanksLoading = false;
+    // 阻塞到所有异步命令和非阻塞的 bank 加载完成
+    Audio::ErrorCheck(get_fmod_system()->flushCommands());
+}
+
 FMOD::Studio::Bank *Audio::GetBank(const std::string &strBankName) { return sgpImplementation->mBanks[strBankName]; }
 
 void Audio::LoadEvent(const std::string &strEventName) {
     auto tFoundit = sgpImplementation->mEvents.find(strEventName);
     if (tFoundit != sgpImplementation->mEvents.end()) return;
+    WaitForBanks();
     FMOD::Studio::EventDescription *pEventDescription = NULL;
     Audio::ErrorCheck(get_fmod_system()->getEvent(strEventName.c_str(), &pEventDescription));
     if (pEventDescription) {
@@ -255,6 +345,223 @@ void Audio::SetEventParameter(const std::string &strEventName, const std::string
     Audio::ErrorCheck(tFoundIt->second->setParameterByName(strParameterName.c_str(), fValue));
 }
 
+AudioEvent Audio::ResolveEvent(const std::string &strEventName) {
+    FMOD::Studio::EventInstance *instance = GetEvent(strEventName);
+    if (!instance) return AudioEvent::NONE;
+    auto tFoundIt = sgpImplementation->mEventIds.find(instance);
+    if (tFoundIt != sgpImplementation->mEventIds.end()) return tFoundIt->second;
+
+    const AudioEvent event = (AudioEvent)sgpImplementation->mEventHandles.size();
+    sgpImplementation->mEventHandles.push_back(instance);
+    sgpImplementation->mEventIds[instance] = event;
+    return event;
+}
+
+AudioParameter Audio::ResolveEventParameter(AudioEvent event, const std::string &strParameterName) {
+    if ((u32)event >= sgpImplementation->mEventHandles.size()) return AudioParameter::NONE;
+    FMOD::Studio::EventInstance *instance = sgpImplementation->mEventHandles[(u32)event];
+    if (!instance) return AudioParameter::NONE;
+
+    FMOD::Studio::EventDescription *description = NULL;
+    FMOD_STUDIO_PARAMETER_DESCRIPTION parameter;
+    if (Audio::ErrorCheck(instance->getDescription(&description)) != METADOT_OK || !description) return AudioParameter::NONE;
+    if (Audio::ErrorCheck(description->getParameterDescriptionByName(strParameterName.c_str(), &parameter)) != METADOT_OK) return AudioParameter::NONE;
+
+    // 同一参数重复解析时复用
+    for (u32 i = 1; i < sgpImplementation->mParameterHandles.size(); i++) {
+        const Implementation::ParameterHandle &h = sgpImplementation->mParameterHandles[i];
+        if (h.instance == instance && h.id.data1 == parameter.id.data1 && h.id.data2 == parameter.id.data2) return (AudioParameter)i;
+    }
+    sgpImplementation->mParameterHandles.push_back({instance, parameter.id});
+    return (AudioParameter)(sgpImplementation->mParameterHandles.size() - 1);
+}
+
+void Audio::PlayEvent(AudioEvent event) {
+    if ((u32)event >= sgpImplementation->mEventHandles.size()) return;
+    if (FMOD::Studio::EventInstance *instance = sgpImplementation->mEventHandles[(u32)event]) submit({Implementation::Command::START, instance, {}, 0.0f});
+}
+
+void Audio::StopEvent(AudioEvent event, bool bImmediate) {
+    if ((u32)event >= sgpImplementation->mEventHandles.size()) return;
+    FMOD::Studio::EventInstance *instance = sgpImplementation->mEventHandles[(u32)event];
+    if (instance) submit({bImmediate ? Implementation::Command::STOP_IMMEDIATE : Implementation::Command::STOP, instance, {}, 0.0f});
+}
+
+bool Audio::IsEventPlaying(AudioEvent event) const {
+    if ((u32)event >= sgpImplementation->mEventHandles.size()) return false;
+    FMOD::Studio::EventInstance *instance = sgpImplementation->mEventHandles[(u32)event];
+    FMOD_STUDIO_PLAYBACK_STATE state = FMOD_STUDIO_PLAYBACK_STOPPED;
+    return instance && instance->getPlaybackState(&state) == FMOD_OK && state == FMOD_STUDIO_PLAYBACK_PLAYING;
+}
+
+void Audio::SetEventParameter(AudioParameter parameter, float fValue) {
+    if ((u32)parameter == 0 || (u32)parameter >= sgpImplementation->mParameterHandles.size()) return;
+    const Implementation::ParameterHandle &h = sgpImplementation->mParameterHandles[(u32)parameter];
+    submit({Implementation::Command::SET_PARAMETER, h.instance, h.id, fValue});
+}
+
+void Audio::PlayEventAt(AudioEvent event, f32 x, f32 y, f32 priority) {
+    if (event == AudioEvent::NONE || (u32)event >= sgpImplementation->mEventHandles.size()) return;
+
+    const u64 region = ((u64)(u32)event << 40) ^ ((u64)(u32)((i32)x >> VOICE_REGION_SHIFT) << 20) ^ (u64)(u32)((i32)y >> VOICE_REGION_SHIFT);
+    auto [it, inserted] = sgpImplementation->mVoiceRegions.try_emplace(region, (u32)sgpImplementation->mVoiceRequests.size());
+    if (inserted) {
+        sgpImplementation->mVoiceRequests.push_back({event, x, y, priority, 1});
+        return;
+    }
+
+    Implementation::VoiceRequest &r = sgpImplementation->mVoiceRequests[it->second];
+    r.priority = std::max(r.priority, priority);
+    r.count++;
+}
+
+void Audio::UpdateVoices(f32 listenerX, f32 listenerY) {
+    Implementation &impl = *sgpImplementation;
+
+    for (auto &[id, pool] : impl.mVoicePools) {
+        for (Implementation::Voice &v : pool.voices) v.score *= VOICE_SCORE_DECAY;
+    }
+    if (impl.mVoiceRequests.empty()) return;
+
+    struct candidate {
+        u32 request;
+        f32 gain;
+        f32 score;
+    };
+    std::vector<candidate> candidates;
+    candidates.reserve(impl.mVoiceRequests.size());
+    for (u32 i = 0; i < impl.mVoiceRequests.size(); i++) {
+        const Implementation::VoiceRequest &r = impl.mVoiceRequests[i];
+        const f32 dx = r.x - listenerX, dy = r.y - listenerY;
+        const f32 gain = 1.0f - sqrtf(dx * dx + dy * dy) / VOICE_MAX_DISTANCE;
+        if (gain > 0.0f) candidates.push_back({i, gain, r.priority * gain});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const candidate &a, const candidate &b) { return a.score > b.score; });
+
+    for (const candidate &c : candidates) {
+        const Implementation::VoiceRequest &r = impl.mVoiceRequests[c.request];
+        Implementation::VoicePool &pool = impl.mVoicePools[(u32)r.event];
+        if (!pool.description && impl.mEventHandles[(u32)r.event]->getDescription(&pool.description) != FMOD_OK) continue;
+
+        // 空闲的实例 池未满时新建 否则抢占得分最低的
+        Implementation::Voice *voice = nullptr;
+        Implementation::Voice *weakest = nullptr;
+        for (Implementation::Voice &v : pool.voices) {
+            FMOD_STUDIO_PLAYBACK_STATE state = FMOD_STUDIO_PLAYBACK_STOPPED;
+            v.instance->getPlaybackState(&state);
+            if (state == FMOD_STUDIO_PLAYBACK_STOPPED) {
+                voice = &v;
+                break;
+            }
+            if (!weakest || v.score < weakest->score) weakest = &v;
+        }
+        if (!voice && pool.voices.size() < VOICES_PER_EVENT) {
+            FMOD::Studio::EventInstance *instance = NULL;
+            if (Audio::ErrorCheck(pool.description->createInstance(&instance)) != METADOT_OK || !instance) continue;
+            voice = &pool.voices.emplace_back(Implementation::Voice{instance, 0.0f});
+        }
+        if (!voice) {
+            if (!weakest || weakest->score >= c.score) continue;
+            voice = weakest;
+            submit({Implementation::Command::STOP_IMMEDIATE, voice->instance, {}, 0.0f});
+        }
+
+        voice->score = c.score;
+        submit({Implementation::Command::SET_VOLUME, voice->instance, {}, c.gain * std::min(1.0f + 0.25f * (f32)(r.count - 1), 2.0f)});
+        submit({Implementation::Command::START, voice->instance, {}, 0.0f});
+    }
+
+    impl.mVoiceRequests.clear();
+    impl.mVoiceRegions.clear();
+}
+
+AudioAmbient Audio::ResolveAmbient(AudioEvent event, const std::string &strParameterName) {
+    if ((u32)event >= sgpImplementation->mEventHandles.size()) return AudioAmbient::NONE;
+    FMOD::Studio::EventInstance *instance = sgpImplementation->mEventHandles[(u32)event];
+    if (!instance) return AudioAmbient::NONE;
+
+    Implementation::AmbientPool pool;
+    FMOD_STUDIO_PARAMETER_DESCRIPTION parameter;
+    if (Audio::ErrorCheck(instance->getDescription(&pool.description)) != METADOT_OK || !pool.description) return AudioAmbient::NONE;
+    if (Audio::ErrorCheck(pool.description->getParameterDescriptionByName(strParameterName.c_str(), &parameter)) != METADOT_OK) return AudioAmbient::NONE;
+    pool.parameter = parameter.id;
+    sgpImplementation->mAmbients.push_back(std::move(pool));
+    return (AudioAmbient)(sgpImplementation->mAmbients.size() - 1);
+}
+
+void Audio::SetAmbient(AudioAmbient ambient, const AmbientSource *sources, u32 count, f32 listenerX, f32 listenerY) {
+    if ((u32)ambient == 0 || (u32)ambient >= sgpImplementation->mAmbients.size()) return;
+    Implementation::AmbientPool &pool = sgpImplementation->mAmbients[(u32)ambient];
+
+    struct candidate {
+        u32 source;
+        f32 gain;
+        f32 score;
+    };
+    candidate chosen[AMBIENT_VOICES];
+    u32 numChosen = 0;
+    for (u32 i = 0; i < count; i++) {
+        const AmbientSource &src = sources[i];
+        if (src.intensity <= 0.0f) continue;
+        const f32 dx = src.x - listenerX, dy = src.y - listenerY;
+        const f32 gain = 1.0f - sqrtf(dx * dx + dy * dy) / VOICE_MAX_DISTANCE;
+        if (gain <= 0.0f) continue;
+
+        // 保持 chosen 按得分从高到低
+        const f32 score = src.intensity * gain;
+        u32 at = numChosen;
+        while (at > 0 && chosen[at - 1].score < score) at--;
+        if (at >= AMBIENT_VOICES) continue;
+        if (numChosen < AMBIENT_VOICES) numChosen++;
+        for (u32 j = numChosen - 1; j > at; j--) chosen[j] = chosen[j - 1];
+        chosen[at] = {i, gain, score};
+    }
+
+    // 先让跟随同一区域的实例继续播放 其余入选区域再分到空出来的实例
+    bool matched[AMBIENT_VOICES] = {};
+    bool kept[AMBIENT_VOICES] = {};
+    for (u32 c = 0; c < numChosen; c++) {
+        const AmbientSource &src = sources[chosen[c].source];
+        for (u32 v = 0; v < pool.voices.size(); v++) {
+            if (!kept[v] && pool.voices[v].active && pool.voices[v].x == src.x && pool.voices[v].y == src.y) {
+                kept[v] = matched[c] = true;
+                break;
+            }
+        }
+    }
+    for (u32 c = 0; c < numChosen; c++) {
+        if (matched[c]) continue;
+        u32 v = 0;
+        while (v < pool.voices.size() && kept[v]) v++;
+        if (v == pool.voices.size()) {
+            FMOD::Studio::EventInstance *instance = NULL;
+            if (Audio::ErrorCheck(pool.description->createInstance(&instance)) != METADOT_OK || !instance) continue;
+            pool.voices.push_back({instance, 0.0f, 0.0f, false});
+        }
+        kept[v] = true;
+        pool.voices[v].x = sources[chosen[c].source].x;
+        pool.voices[v].y = sources[chosen[c].source].y;
+    }
+
+    for (u32 v = 0; v < pool.voices.size(); v++) {
+        Implementation::AmbientVoice &voice = pool.voices[v];
+        if (!kept[v]) {
+            if (voice.active) submit({Implementation::Command::STOP, voice.instance, {}, 0.0f});
+            voice.active = false;
+            continue;
+        }
+        for (u32 c = 0; c < numChosen; c++) {
+            const AmbientSource &src = sources[chosen[c].source];
+            if (src.x != voice.x || src.y != voice.y) continue;
+            submit({Implementation::Command::SET_PARAMETER, voice.instance, pool.parameter, src.intensity});
+            submit({Implementation::Command::SET_VOLUME, voice.instance, {}, chosen[c].gain});
+            break;
+        }
+        if (!voice.active) submit({Implementation::Command::START, voice.instance, {}, 0.0f});
+        voice.active = true;
+    }
+}
+
 void Audio::SetGlobalParameter(const std::string &strParameterName, float fValue) { get_fmod_system()->setParameterByName(strParameterName.c_str(), fValue); }
 
 void Audio::GetGlobalParameter(const std::string &strParameterName, float *parameter) { get_fmod_system()->getParameterByName(strParameterName.c_str(), parameter); }
@@ -280,7 +587,10 @@ float Audio::dbToVolume(float dB) { return powf(10.0f, 0.05f * dB); }
 
 float Audio::VolumeTodB(float volume) { return 20.0f * log10f(volume); }
 
-void Audio::Shutdown() { delete sgpImplementation; }
+void Audio::Shutdown() {
+    StopThread();
+    delete sgpImplementation;
+}
 
 void AudioEngineInit() {}
 
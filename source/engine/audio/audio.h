@@ -5,9 +5,12 @@
 
 #include <math.h>
 
+#include <array>
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -100,11 +103,20 @@ inline void check_err(FMOD_RESULT res) {
 
 #pragma endregion FMODWrapper
 
+// 预先解析的事件和事件参数 每帧或每次爆炸调用的地方用它们代替按名字的接口 不再构造字符串和查表
+// 值是 Implementation 中句柄表的下标 NONE (名字不存在) 传给下面的接口时什么也不做 Audio::Shutdown 之前一直有效
+// 脚本也用整数形式 audio_event / audio_parameter 取一次 之后调用 audio_play / audio_set_parameter
+enum class AudioEvent : u32 { NONE = 0 };
+enum class AudioParameter : u32 { NONE = 0 };
+enum class AudioAmbient : u32 { NONE = 0 };
+
 struct Implementation {
     Implementation();
     ~Implementation();
 
     void Update();
+    // 清理播放完的 channel 只在主线程调用
+    void UpdateChannels();
 
     int mnNextChannelId;
 
@@ -114,9 +126,70 @@ struct Implementation {
     typedef std::map<std::string, FMOD::Studio::Bank *> BankMap;
 
     BankMap mBanks;
+    // 有 FMOD_STUDIO_LOAD_BANK_NONBLOCKING 加载的 bank 还没确认加载完成
+    bool mBanksLoading = false;
     EventMap mEvents;
     SoundMap mSounds;
     ChannelMap mChannels;
+
+    struct ParameterHandle {
+        FMOD::Studio::EventInstance *instance;
+        FMOD_STUDIO_PARAMETER_ID id;
+    };
+    // 下标 0 是 NONE
+    std::vector<FMOD::Studio::EventInstance *> mEventHandles{nullptr};
+    std::vector<ParameterHandle> mParameterHandles{ParameterHandle{}};
+    std::unordered_map<FMOD::Studio::EventInstance *, AudioEvent> mEventIds;
+
+    // PlayEventAt 的实例池 每个事件最多 Audio::VOICES_PER_EVENT 个实例 与 mEventHandles 中的实例无关
+    struct Voice {
+        FMOD::Studio::EventInstance *instance;
+        f32 score;
+    };
+    struct VoicePool {
+        FMOD::Studio::EventDescription *description = nullptr;
+        std::vector<Voice> voices;
+    };
+    struct VoiceRequest {
+        AudioEvent event;
+        f32 x, y;
+        f32 priority;
+        u32 count;
+    };
+    std::unordered_map<u32, VoicePool> mVoicePools;
+    std::vector<VoiceRequest> mVoiceRequests;
+    // {事件, 区域} -> mVoiceRequests 下标 UpdateVoices 时清空
+    std::unordered_map<u64, u32> mVoiceRegions;
+
+    // SetAmbient 的循环实例 每个 AudioAmbient 最多 Audio::AMBIENT_VOICES 个 x y 是实例当前跟随的发声区域
+    struct AmbientVoice {
+        FMOD::Studio::EventInstance *instance;
+        f32 x, y;
+        bool active;
+    };
+    struct AmbientPool {
+        FMOD::Studio::EventDescription *description = nullptr;
+        FMOD_STUDIO_PARAMETER_ID parameter{};
+        std::vector<AmbientVoice> voices;
+    };
+    // 下标 0 是 NONE
+    std::vector<AmbientPool> mAmbients{AmbientPool{}};
+
+    // Audio::StartThread 之后对事件实例的操作写进这个环形队列 主线程是唯一的写者 音频线程是唯一的读者
+    struct Command {
+        enum kind : u8 { START, STOP, STOP_IMMEDIATE, SET_PARAMETER, SET_VOLUME };
+        kind op;
+        FMOD::Studio::EventInstance *instance;
+        FMOD_STUDIO_PARAMETER_ID parameter;
+        f32 value;
+    };
+    static constexpr u32 COMMAND_QUEUE_SIZE = 4096;
+    static_assert((COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) == 0);
+    std::array<Command, COMMAND_QUEUE_SIZE> mCommands;
+    std::atomic<u32> mCommandHead{0};
+    std::atomic<u32> mCommandTail{0};
+    std::thread mThread;
+    std::atomic<bool> mThreadRunning{false};
 };
 
 class Audio {
@@ -124,9 +197,20 @@ public:
     static void Init();
     static void Update();
     static void Shutdown();
+
+    // 音频线程 (audio_thread) 每 AUDIO_THREAD_PERIOD_MS 执行一次 FMOD 的 update
+    // 之后句柄接口 (PlayEvent(AudioEvent) SetEventParameter(AudioParameter) 等) 和 UpdateVoices SetAmbient 对实例的操作只写命令队列 由音频线程执行
+    // 这些接口只能在主线程调用 队列满时等音频线程取走命令 保持提交的顺序 FMOD Studio 的接口本身是线程安全的 按名字的接口仍在调用的线程上执行
+    // 启动之后 Update 只清理 channel 不再调用 FMOD 的 update
+    static constexpr u32 AUDIO_THREAD_PERIOD_MS = 10;
+    static void StartThread();
+    static void StopThread();
+    static bool Threaded();
     static int ErrorCheck(FMOD_RESULT result);
 
+    // flags 带 FMOD_STUDIO_LOAD_BANK_NONBLOCKING 时在 FMOD 的加载线程上读取 第一次查找事件前等待完成
     void LoadBank(const std::string &strBankName, FMOD_STUDIO_LOAD_BANK_FLAGS flags);
+    void WaitForBanks();
     FMOD::Studio::Bank *GetBank(const std::string &strBankName);
     void LoadEvent(const std::string &strEventName);
     void LoadSound(const std::string &strSoundName, bool b3d = true, bool bLooping = false, bool bStream = false);
@@ -141,6 +225,38 @@ public:
     void SetEventParameter(const std::string &strEventName, const std::string &strParameterName, float fValue);
     void SetGlobalParameter(const std::string &strParameterName, float fValue);
     void GetGlobalParameter(const std::string &strEventParameter, float *parameter);
+
+    // 需要时加载事件 (LoadEvent) 同一个事件总是返回同一个句柄
+    AudioEvent ResolveEvent(const std::string &strEventName);
+    AudioParameter ResolveEventParameter(AudioEvent event, const std::string &strParameterName);
+    void PlayEvent(AudioEvent event);
+    void StopEvent(AudioEvent event, bool bImmediate = false);
+    bool IsEventPlaying(AudioEvent event) const;
+    void SetEventParameter(AudioParameter parameter, float fValue);
+
+    // 世界里高频的一次性音效 (爆炸 火 碎块) 用实例池播放 x y 为世界像素坐标
+    // 同一帧内同一事件落在同一个 (1 << VOICE_REGION_SHIFT) 见方区域的请求合并成一个 音量随合并的个数略微增大
+    // UpdateVoices 按 优先级 x 距离衰减 从高到低分配实例 池满时抢占得分最低且低于新请求的实例 其余请求丢弃
+    // 播放中实例的得分每次 UpdateVoices 乘以 VOICE_SCORE_DECAY 快结束的声音更容易被抢占
+    static constexpr u32 VOICES_PER_EVENT = 8;
+    static constexpr int VOICE_REGION_SHIFT = 5;
+    static constexpr f32 VOICE_MAX_DISTANCE = 600.0f;
+    static constexpr f32 VOICE_SCORE_DECAY = 0.9f;
+
+    void PlayEventAt(AudioEvent event, f32 x, f32 y, f32 priority = 1.0f);
+    // 每个 tick 调用一次 listener 为听者 (屏幕中心) 的世界像素坐标
+    void UpdateVoices(f32 listenerX, f32 listenerY);
+
+    // 持续的环境声 (流水 岩浆 火) 每个发声区域给出位置和强度 强度写入事件的 strParameterName 参数
+    // SetAmbient 每个 tick 传入这一事件的全部发声区域 取 强度 x 距离衰减 最高的 AMBIENT_VOICES 个各用一个循环实例播放
+    // 位置不变的区域保留原来的实例只更新参数和音量 不再入选的实例淡出
+    static constexpr u32 AMBIENT_VOICES = 4;
+    struct AmbientSource {
+        f32 x, y;
+        f32 intensity;
+    };
+    AudioAmbient ResolveAmbient(AudioEvent event, const std::string &strParameterName);
+    void SetAmbient(AudioAmbient ambient, const AmbientSource *sources, u32 count, f32 listenerX, f32 listenerY);
     void StopAllChannels();
     void SetChannel3dPosition(int nChannelId, const MEvec3 &vPosition);
     void SetChannelVolume(int nChannelId, float fVolumedB);
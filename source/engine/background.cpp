@@ -11,16 +11,61 @@
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "game.hpp"
+#include "game_shaders.hpp"
 #include "textures.hpp"
 
 namespace ME {
 
 BackgroundObject::~BackgroundObject() {
+    freeAtlas();
     for (size_t i = 0; i < layers.size(); i++) {
         layers[i].reset();
     }
 }
 
+bool BackgroundObject::buildAtlas(int scale) {
+    if (atlas && atlasScale == scale) return true;
+    freeAtlas();
+
+    if (layers.empty() || layers.size() > BackgroundParallaxShader::MAX_LAYERS) return false;
+
+    int w = 0, h = 0;
+    for (auto &layer : layers) {
+        C_Surface *s = layer->surface[scale - 1];
+        w = std::max(w, s->w);
+        h += s->h;
+    }
+
+    constexpr int MAX_ATLAS_SIZE = 8192;
+    if (w > MAX_ATLAS_SIZE || h > MAX_ATLAS_SIZE) return false;
+
+    atlas = R_CreateImage(w, h, R_FormatEnum::R_FORMAT_RGBA);
+    if (!atlas) return false;
+    R_SetImageFilter(atlas, R_FILTER_NEAREST);
+
+    // 只上传一次 之后每帧只更新着色器参数
+    int y = 0;
+    for (auto &layer : layers) {
+        C_Surface *s = layer->surface[scale - 1];
+        MErect dst = {0, (f32)y, (f32)s->w, (f32)s->h};
+        MErect src = {0, 0, (f32)s->w, (f32)s->h};
+        R_UpdateImage(atlas, &dst, s, &src);
+
+        atlasSource.insert(atlasSource.end(), {0.0f, (f32)y, (f32)s->w, (f32)s->h});
+        y += s->h;
+    }
+
+    atlasScale = scale;
+    return true;
+}
+
+void BackgroundObject::freeAtlas() {
+    if (atlas) R_FreeImage(atlas);
+    atlas = nullptr;
+    atlasScale = 0;
+    atlasSource.clear();
+}
+
 void BackgroundObject::Init() {
     // for (size_t i = 0; i < layers.size(); i++) {
     //     InitBackgroundLayer(layers[i]);
@@ -97,6 +142,42 @@ void BackgroundSystem::draw() {
 
         R_SetShapeBlendMode(R_BLEND_NORMAL);
 
+        // 所有层一次绘制 只需要每层第一块的位置
+        BackgroundParallaxShader *parallax = global.game->Iso.shaderworker->backgroundParallaxShader;
+        if (parallax && parallax->shader && global.game->bg->buildAtlas(the<engine>().eng()->render_scale)) {
+            const int count = (int)global.game->bg->layers.size();
+            f32 placement[BackgroundParallaxShader::MAX_LAYERS * 4];
+
+            for (int i = 0; i < count; i++) {
+                BackgroundLayerRef bglayer = global.game->bg->layers[i];
+                C_Surface *texture = bglayer->surface[(size_t)the<engine>().eng()->render_scale - 1];
+                f32 tw = (f32)texture->w;
+                f32 th = (f32)texture->h;
+
+                // 与下面逐层绘制 n = 0 时相同 横向平铺由着色器完成
+                f32 x = (((GAME()->ofsX + GAME()->camX) + global.game->Iso.world->loadZone.x * the<engine>().eng()->render_scale)) * bglayer->parralaxX +
+                        global.game->Iso.world->width / 2.0f * the<engine>().eng()->render_scale - tw / 2.0f;
+                f32 y = ((GAME()->ofsY + GAME()->camY) + global.game->Iso.world->loadZone.y * the<engine>().eng()->render_scale) * bglayer->parralaxY +
+                        global.game->Iso.world->height / 2.0f * the<engine>().eng()->render_scale - th / 2.0f - the<engine>().eng()->windowHeight / 3.0f * (the<engine>().eng()->render_scale - 1);
+                x += (f32)(the<engine>().eng()->render_scale * fmod(bglayer->moveX * time, tw));
+
+                placement[i * 4 + 0] = x;
+                placement[i * 4 + 1] = y;
+                placement[i * 4 + 2] = tw;
+                placement[i * 4 + 3] = th;
+            }
+
+            R_Image *atlas = global.game->bg->atlas;
+            MErect full = {0, 0, (f32)the<engine>().eng()->windowWidth, (f32)the<engine>().eng()->windowHeight};
+
+            parallax->activate();
+            parallax->Update(full.w, full.h, atlas->w / (f32)atlas->texture_w, atlas->h / (f32)atlas->texture_h, count, placement, global.game->bg->atlasSource.data());
+            R_SetBlendMode(atlas, R_BLEND_NORMAL);
+            R_BlitRect(atlas, NULL, the<engine>().eng()->target, &full);
+            R_ActivateShaderProgram(0, NULL);
+            return;
+        }
+
         for (size_t i = 0; i < global.game->bg->layers.size(); i++) {
             BackgroundLayerRef bglayer = global.game->bg->layers[i];
 
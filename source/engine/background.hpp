@@ -49,6 +49,16 @@ public:
     //  BackgroundObject(BackgroundObject &) = default;
     ~BackgroundObject();
     void Init();
+
+    // 所有层上下排列的图集 供 BackgroundParallaxShader 一次绘制
+    // 第一次绘制时按 render_scale 对应的 surface 创建 render_scale 改变时重建
+    R_Image *atlas = nullptr;
+    int atlasScale = 0;
+    std::vector<f32> atlasSource;  // 每层 4 个值: 图集中的 x y 宽 高
+
+    // 失败 (层数或尺寸超出限制) 时返回 false 由调用者逐层绘制
+    bool buildAtlas(int scale);
+    void freeAtlas();
 };
 
 class BackgroundSystem : public IGameSystem {
@@ -0,0 +1,124 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "background_atlas.hpp"
+
+#include <algorithm>
+
+#include "engine/core/profiler.hpp"
+
+namespace ME {
+
+void BackgroundAtlas::init(int sx, int sy) {
+    free();
+    slotsX = std::max(sx, 1);
+    slotsY = std::max(sy, 1);
+    image = R_CreateImage((u16)(slotsX * CHUNK_W), (u16)(slotsY * CHUNK_H), R_FormatEnum::R_FORMAT_RGBA);
+    if (!image) return;
+    R_SetImageFilter(image, R_FILTER_NEAREST);
+    R_SetBlendMode(image, R_BLEND_NORMAL);
+    slots.assign((size_t)slotsX * slotsY, Slot{});
+    reset();
+}
+
+void BackgroundAtlas::free() {
+    if (image) R_FreeImage(image);
+    image = nullptr;
+    slots.clear();
+    freeSlots.clear();
+    index.clear();
+}
+
+void BackgroundAtlas::reset() {
+    index.clear();
+    freeSlots.clear();
+    for (int i = (int)slots.size() - 1; i >= 0; i--) {
+        slots[i].live = false;
+        freeSlots.push_back(i);
+    }
+}
+
+bool BackgroundAtlas::overlaps(int cx, int cy, int loadX, int loadY, int bufW, int bufH) {
+    const int bx = cx * CHUNK_W + loadX;
+    const int by = cy * CHUNK_H + loadY;
+    return bx < bufW && bx + CHUNK_W > 0 && by < bufH && by + CHUNK_H > 0;
+}
+
+void BackgroundAtlas::release(int cx, int cy) {
+    auto it = index.find(key(cx, cy));
+    if (it == index.end()) return;
+    slots[it->second].live = false;
+    freeSlots.push_back(it->second);
+    index.erase(it);
+}
+
+void BackgroundAtlas::upload(int cx, int cy, const u32 *argb, int loadX, int loadY, int bufW, int bufH) {
+    if (!image) return;
+
+    staging.resize((size_t)CHUNK_W * CHUNK_H * 4);
+    bool any = false;
+    for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
+        const u32 color = argb[i];
+        staging[i * 4 + 0] = (color >> 16) & 0xff;  // r
+        staging[i * 4 + 1] = (color >> 8) & 0xff;   // g
+        staging[i * 4 + 2] = (color >> 0) & 0xff;   // b
+        staging[i * 4 + 3] = (color >> 24) & 0xff;  // a
+        any |= (color >> 24) != 0;
+    }
+
+    // 全透明的区块不需要绘制
+    if (!any) {
+        release(cx, cy);
+        return;
+    }
+
+    int s = -1;
+    auto it = index.find(key(cx, cy));
+    if (it != index.end()) {
+        s = it->second;
+    } else {
+        if (freeSlots.empty()) {
+            // 回收已经完全移出像素缓冲的区块
+            for (auto jt = index.begin(); jt != index.end(); ++jt) {
+                const Slot &old = slots[jt->second];
+                if (overlaps(old.cx, old.cy, loadX, loadY, bufW, bufH)) continue;
+                slots[jt->second].live = false;
+                freeSlots.push_back(jt->second);
+                index.erase(jt);
+                break;
+            }
+        }
+        if (freeSlots.empty()) return;
+        s = freeSlots.back();
+        freeSlots.pop_back();
+        slots[s] = {cx, cy, true};
+        index[key(cx, cy)] = s;
+    }
+
+    const MErect rect = {(f32)((s % slotsX) * CHUNK_W), (f32)((s / slotsX) * CHUNK_H), (f32)CHUNK_W, (f32)CHUNK_H};
+    R_UpdateImageBytes(image, &rect, staging.data(), CHUNK_W * 4);
+}
+
+void BackgroundAtlas::draw(R_Target *target, const MErect &dest, int loadX, int loadY, int bufW, int bufH) {
+    if (!image || index.empty() || bufW <= 0 || bufH <= 0) return;
+
+    const f32 sx = dest.w / (f32)bufW;
+    const f32 sy = dest.h / (f32)bufH;
+    u32 drawn = 0;
+    for (const auto &[k, s] : index) {
+        const Slot &slot = slots[s];
+        const int bx = slot.cx * CHUNK_W + loadX;
+        const int by = slot.cy * CHUNK_H + loadY;
+        // 裁剪到像素缓冲 与原来整张背景纹理覆盖的范围相同
+        const int x0 = std::max(bx, 0), x1 = std::min(bx + CHUNK_W, bufW);
+        const int y0 = std::max(by, 0), y1 = std::min(by + CHUNK_H, bufH);
+        if (x0 >= x1 || y0 >= y1) continue;
+
+        MErect src = {(f32)((s % slotsX) * CHUNK_W + (x0 - bx)), (f32)((s / slotsX) * CHUNK_H + (y0 - by)), (f32)(x1 - x0), (f32)(y1 - y0)};
+        MErect dst = {dest.x + x0 * sx, dest.y + y0 * sy, (x1 - x0) * sx, (y1 - y0) * sy};
+        R_BlitRect(image, &src, target, &dst);
+        drawn++;
+    }
+    ME_profiler_count("background chunks drawn", drawn);
+}
+
+}  // namespace ME
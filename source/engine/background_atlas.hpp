@@ -0,0 +1,66 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_BACKGROUND_ATLAS_HPP
+#define ME_BACKGROUND_ATLAS_HPP
+
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/renderer/renderer_gpu.h"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+// 世界背景按区块存放的图集
+// 每个区块占一个 CHUNK_W x CHUNK_H 的位置 区块合并进世界时上传一次 绘制时按区块位置直接从图集采样
+// 全透明的区块不占位置 位置用完时回收完全移出像素缓冲的区块
+// world::background 仍保留在 CPU 上 供脚本 光照和存档使用
+class BackgroundAtlas {
+public:
+    BackgroundAtlas() = default;
+    ~BackgroundAtlas() { free(); }
+
+    BackgroundAtlas(const BackgroundAtlas &) = delete;
+    BackgroundAtlas &operator=(const BackgroundAtlas &) = delete;
+
+    // 可以同时容纳 slotsX x slotsY 个区块 已有的位置全部丢弃
+    void init(int slotsX, int slotsY);
+    void free();
+    // 丢弃所有位置 图集保留
+    void reset();
+
+    // argb 为区块的 CHUNK_W x CHUNK_H 个像素 (与 world::background 相同的 ARGB)
+    // loadX loadY 为 world::loadZone 的位置 bufW bufH 为像素缓冲大小 用来挑选可以回收的位置
+    void upload(int cx, int cy, const u32 *argb, int loadX, int loadY, int bufW, int bufH);
+    void release(int cx, int cy);
+
+    // dest 为整个像素缓冲在 target 上的位置 只绘制与像素缓冲重叠的部分
+    void draw(R_Target *target, const MErect &dest, int loadX, int loadY, int bufW, int bufH);
+
+    size_t live_count() const { return index.size(); }
+    // 图集纹理的大小
+    size_t memory_bytes() const { return image ? (size_t)slots.size() * CHUNK_W * CHUNK_H * 4 : 0; }
+
+private:
+    struct Slot {
+        int cx = 0;
+        int cy = 0;
+        bool live = false;
+    };
+
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+    static bool overlaps(int cx, int cy, int loadX, int loadY, int bufW, int bufH);
+
+    R_Image *image = nullptr;
+    int slotsX = 0;
+    int slotsY = 0;
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    phmap::flat_hash_map<u64, int> index;
+    std::vector<u8> staging;
+};
+
+}  // namespace ME
+
+#endif
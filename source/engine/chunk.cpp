@@ -2,342 +2,237 @@
 
 #include "chunk.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "chunk_codec.hpp"
 #include "engine/core/core.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/platform.h"
-#include "libs/lz4/lz4.h"
+#include "engine/core/profiler.hpp"
 
 namespace ME {
 
-void Chunk::ChunkInit(int x, int y, const std::string &worldName) {
+std::mutex ChunkStoragePool::lock;
+std::vector<MaterialInstance *> ChunkStoragePool::freeTiles;
+std::vector<u32 *> ChunkStoragePool::freeBackgrounds;
+std::vector<Chunk *> ChunkStoragePool::freeChunks;
+
+MaterialInstance *ChunkStoragePool::alloc_tiles(bool reset) {
+    MaterialInstance *tiles = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!freeTiles.empty()) {
+            tiles = freeTiles.back();
+            freeTiles.pop_back();
+        }
+    }
+    if (!tiles) return new MaterialInstance[CHUNK_W * CHUNK_H];
+    if (reset) std::fill(tiles, tiles + CHUNK_W * CHUNK_H, MaterialInstance());
+    return tiles;
+}
+
+u32 *ChunkStoragePool::alloc_background() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!freeBackgrounds.empty()) {
+            u32 *background = freeBackgrounds.back();
+            freeBackgrounds.pop_back();
+            return background;
+        }
+    }
+    return new u32[CHUNK_W * CHUNK_H];
+}
+
+void ChunkStoragePool::free_tiles(MaterialInstance *tiles) {
+    if (!tiles) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (freeTiles.size() < MAX_FREE) {
+            freeTiles.push_back(tiles);
+            return;
+        }
+    }
+    delete[] tiles;
+}
+
+void ChunkStoragePool::free_background(u32 *background) {
+    if (!background) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (freeBackgrounds.size() < MAX_FREE) {
+            freeBackgrounds.push_back(background);
+            return;
+        }
+    }
+    delete[] background;
+}
+
+Chunk *ChunkStoragePool::alloc_chunk() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!freeChunks.empty()) {
+            Chunk *ch = freeChunks.back();
+            freeChunks.pop_back();
+            return ch;
+        }
+    }
+    return new Chunk;
+}
+
+void ChunkStoragePool::free_chunk(Chunk *ch) {
+    if (!ch) return;
+    ch->ChunkDelete();
+    *ch = Chunk();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (freeChunks.size() < MAX_FREE_CHUNKS) {
+            freeChunks.push_back(ch);
+            return;
+        }
+    }
+    delete ch;
+}
+
+void Chunk::ChunkInit(int x, int y, const std::string &worldName, RegionStore *regions) {
     this->x = x;
     this->y = y;
+    this->regions = regions;
     pack_filename = std::string(worldName + "/chunks/c_" + std::to_string(x) + "_" + std::to_string(y) + ".pack");
 }
 
 void Chunk::ChunkDelete() {
-    if (this->tiles) delete[] this->tiles;
-    if (this->layer2) delete[] this->layer2;
-    if (this->background) delete[] this->background;
+    // 数组归还到复用池 指针必须清空 否则残留的指针会写到其他区块的数据里
+    ChunkStoragePool::free_tiles(this->tiles);
+    ChunkStoragePool::free_background(this->background);
+    this->tiles = nullptr;
+    this->background = nullptr;
+    this->layer2.clear();
+    this->hasTileCache = false;
 
     // 清空群系索引
     this->biomes_id.clear();
 }
 
 void Chunk::ChunkLoadMeta() {
-    // datapack_node *dp;
-    // char *s;
-    // char *s1;
-
-    // datapack_bin leveldata;
-    // datapack_bin leveldata2;
-
-    // int x, y, phase;
-
-    // int src_size;
-    // int compressed_size;
-    // int src_size2;
-    // int compressed_size2;
-
-    // dp = datapack_map(CHUNK_DATABASE_FORMAT, &s, &s1, &phase, &x, &y, &src_size, &compressed_size, &src_size2, &compressed_size2, &leveldata, &leveldata2);
-    // datapack_load(dp, DATAPACK_FILE, this->pack_filename.c_str());
-    // datapack_unpack(dp, 0);
-
-    // if (dp) {
-    //     this->generationPhase = phase;
-    //     this->hasMeta = true;
-    //     datapack_free(dp);
-    // } else {
-    // }
-
-    // if (s) free(s);
-    // if (s1) free(s1);
-    // if (leveldata.addr) free(leveldata.addr);
-    // if (leveldata2.addr) free(leveldata2.addr);
-
-    std::string line;
-    std::ifstream myfile(this->pack_filename);
-    if (myfile.is_open()) {
-        getline(myfile, line, '\n');
-
-        int phase = stoi(line);
-        this->generationPhase = phase;
-        this->hasMeta = true;
-    }
+    DataView view;
+    if (ChunkMapData(view) && ChunkCodec::read_phase(view.data, view.size, this->generationPhase)) this->hasMeta = true;
 }
 
-void Chunk::ChunkRead() {
-    MaterialInstance *tiles = new MaterialInstance[CHUNK_W * CHUNK_H];
-    if (tiles == NULL) throw std::runtime_error("Failed to allocate memory for Chunk tiles array.");
-    MaterialInstance *layer2 = new MaterialInstance[CHUNK_W * CHUNK_H];
-    if (layer2 == NULL) throw std::runtime_error("Failed to allocate memory for Chunk layer2 array.");
-    u32 *background = new u32[CHUNK_W * CHUNK_H];
-
-    std::string line;
-    std::ifstream myfile(this->pack_filename, std::ios::binary);
-
-    if (myfile.is_open()) {
-        int state = 0;
+bool Chunk::ChunkMapData(DataView &out) {
+    if (regions && regions->view(this->x, this->y, out.region)) {
+        out.data = out.region.data();
+        out.size = out.region.size();
+        return true;
+    }
 
-        myfile.read((char *)&this->generationPhase, sizeof(i8));
+    if (!ME_fs_map_file(this->pack_filename.c_str(), out.file)) return false;
+    out.data = out.file.data;
+    out.size = out.file.size;
+    return true;
+}
 
+void Chunk::ChunkRead() {
+    constexpr int N = CHUNK_W * CHUNK_H;
+
+    // 读取的数据会覆盖全部内容 不需要重置
+    MaterialInstance *tiles = ChunkStoragePool::alloc_tiles(false);
+    Layer2Bricks layer2;
+    u32 *background = ChunkStoragePool::alloc_background();
+
+    auto fail = [&]() {
+        std::fill(tiles, tiles + N, MaterialInstance());
+        layer2.clear();
+        memset(background, 0, N * sizeof(u32));
+        this->biomes_id.clear();
+        this->extras.clear();
+    };
+
+    DataView view;
+
+    if (ChunkMapData(view)) {
+        bool ok;
+        try {
+            ok = ChunkCodec::decode(view.data, view.size, this->generationPhase, tiles, layer2, background, this->biomes_id, &this->extras);
+            ME_profiler_count("chunk loads", 1);
+            ME_profiler_count("chunk load bytes", view.size);
+        } catch (const std::runtime_error &e) {
+            ChunkStoragePool::free_tiles(tiles);
+            ChunkStoragePool::free_background(background);
+            throw std::runtime_error(std::string(e.what()) + " @ " + std::to_string(this->x) + "," + std::to_string(this->y));
+        }
         this->hasMeta = true;
-        state = 1;
-
-        // METADOT_BUG(std::format("Datapack test result: {0} {1} {2} {3}", leveldata.sz, compressed_size, leveldata2.sz, compressed_size2).c_str());
-
-        // 验证区块位置
-        // if (x != this->x || y != this->y)
-        //     throw std::runtime_error("Wrong region block read sequence (" + std::to_string(x) + "," + std::to_string(y) + " should be " + std::to_string(this->x) + "," + std::to_string(this->y) +
-        //                              ")");
-
-        // if (leveldata.sz != compressed_size || leveldata2.sz != compressed_size2) throw std::runtime_error("Unexpected block compression data");
-
-        // this->hasMeta = true;
-        // state = 1;
-
-        // unsigned int content;
-        // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-        //  myfile.read((char*)&content, sizeof(unsigned int));
-        //  int id = content;
-        //  myfile.read((char*)&content, sizeof(unsigned int));
-        //  u32 color = content;
-        //  tiles[i] = MaterialInstance(GAME()->materials_container[id], color);
-        // }
-        // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-        //  myfile.read((char*)&content, sizeof(unsigned int));
-        //  int id = content;
-        //  myfile.read((char*)&content, sizeof(unsigned int));
-        //  u32 color = content;
-        //  layer2[i] = MaterialInstance(GAME()->materials_container[id], color);
-        // }
-        // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-        //  myfile.read((char*)&content, sizeof(unsigned int));
-        //  background[i] = content;
-        // }
-
-        int src_size;
-        myfile.read((char *)&src_size, sizeof(int));
-
-        // 两层MaterialInstanceData包括tiles[]和layer2[]
-        if (src_size != CHUNK_W * CHUNK_H * 2 * sizeof(MaterialInstanceData))
-            throw std::runtime_error("Chunk src_size was different from expected: " + std::to_string(src_size) + " vs " + std::to_string(CHUNK_W * CHUNK_H * 2 * sizeof(MaterialInstanceData)));
-
-        int compressed_size;
-        myfile.read((char *)&compressed_size, sizeof(int));
-
-        int src_size2;
-        myfile.read((char *)&src_size2, sizeof(int));
-
-        int desSize = CHUNK_W * CHUNK_H * sizeof(unsigned int);
-
-        if (src_size2 != desSize) throw std::runtime_error("Chunk src_size2 was different from expected: " + std::to_string(src_size2) + " vs " + std::to_string(desSize));
-
-        int compressed_size2;
-        myfile.read((char *)&compressed_size2, sizeof(int));
-
-        MaterialInstanceData *readBuf = (MaterialInstanceData *)malloc(src_size);
-        if (readBuf == NULL) throw std::runtime_error("Failed to allocate memory for Chunk readBuf.");
-
-        char *compressed_data = (char *)malloc(compressed_size);
 
-        myfile.read((char *)compressed_data, compressed_size);
-
-        const int decompressed_size = LZ4_decompress_safe((char *)compressed_data, (char *)readBuf, compressed_size, src_size);
-
-        free(compressed_data);
-
-        // 基本上，如果触发这两个检查中的任何一个，块都是不可读的，要么是因为写错了，要么是因为损坏。
+        // 基本上，如果解压失败，块都是不可读的，要么是因为写错了，要么是因为损坏。
         // TODO：让区块在损坏时重新生成(可能还会保存损坏区块的副本？)
-        if (decompressed_size < 0) {
-            METADOT_ERROR(std::format("Error decompressing chunk tile data @ {0},{1} (err {2}).", this->x, this->y, decompressed_size).c_str());
-        } else if (decompressed_size != src_size) {
-            METADOT_ERROR(std::format("Decompressed chunk tile data is corrupt! @ {0},{1} (was {2}, expected {3}).", this->x, this->y, decompressed_size, src_size).c_str());
-        }
-
-        // copy everything but the material pointer
-        // memcpy(tiles, readBuf, CHUNK_W * CHUNK_H * sizeof(MaterialInstance));
-        // memcpy(layer2, &readBuf[CHUNK_W * CHUNK_H], CHUNK_W * CHUNK_H * sizeof(MaterialInstance));
-
-        // copy the material pointer
-        for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-            // twice as fast to set fields instead of making new ones
-            tiles[i].color = readBuf[i].color;
-            tiles[i].temperature = readBuf[i].temperature;
-            tiles[i].mat = GAME()->materials_array[readBuf[i].index];
-            // tiles[i].id = MaterialInstance::_curID++;
-            // tiles[i].color = readBuf[i].color;
-            // tiles[i].temperature = readBuf[i].temperature;
-            // tiles[i] = MaterialInstance(Materials::MATERIALS_ARRAY[buf[i].index], buf[i].color, buf[i].temperature);
-
-            layer2[i].color = readBuf[i + CHUNK_W * CHUNK_H].color;
-            layer2[i].temperature = readBuf[i + CHUNK_W * CHUNK_H].temperature;
-            layer2[i].mat = GAME()->materials_array[readBuf[CHUNK_W * CHUNK_H + i].index];
-            // layer2[i].id = MaterialInstance::_curID++;
-            // layer2[i].color = readBuf[CHUNK_W * CHUNK_H + i].color;
-            // layer2[i].temperature = readBuf[CHUNK_W * CHUNK_H + i].temperature;
-            // layer2[i] = MaterialInstance(Materials::MATERIALS_ARRAY[buf[CHUNK_W * CHUNK_H + i].index], buf[CHUNK_W * CHUNK_H + i].color, buf[CHUNK_W * CHUNK_H + i].temperature);
-        }
-
-        char *compressed_data2 = (char *)malloc(compressed_size2);
-
-        myfile.read((char *)compressed_data2, compressed_size2);
-
-        const int decompressed_size2 = LZ4_decompress_safe((char *)compressed_data2, (char *)background, compressed_size2, src_size2);
-
-        free(compressed_data2);
-
-        if (decompressed_size2 < 0) {
-            METADOT_ERROR(std::format("Error decompressing chunk background data @ {0},{1} (err {2}).", this->x, this->y, decompressed_size2).c_str());
-        } else if (decompressed_size2 != src_size2) {
-            METADOT_ERROR(std::format("Decompressed chunk background data is corrupt! @ {0},{1} (was {2}, expected {3}).", this->x, this->y, decompressed_size2, src_size2).c_str());
+        if (!ok) {
+            METADOT_ERROR(std::format("Chunk data is corrupt @ {0},{1}", this->x, this->y).c_str());
+            fail();
         }
-
-        free(readBuf);
-
-        myfile.close();
     } else {
         METADOT_ERROR(std::format("Read chunk {0},{1} faild", this->x, this->y).c_str());
+        fail();
     }
 
-    // if (s) free(s);
-    // if (s1) free(s1);
-    // if (leveldata.addr) free(leveldata.addr);
-    // if (leveldata2.addr) free(leveldata2.addr);
-
     this->tiles = tiles;
-    this->layer2 = layer2;
+    this->layer2 = std::move(layer2);
     this->background = background;
     this->hasTileCache = true;
+    this->extrasHash = this->extras.empty() ? 0 : metadot_fnv1a(this->extras.data(), (int)this->extras.size());
 }
 
-void Chunk::ChunkWrite(MaterialInstance *tiles, MaterialInstance *layer2, u32 *background) {
+void Chunk::ChunkWrite(MaterialInstance *tiles, u32 *background, const std::vector<u8> *extras) {
     this->tiles = tiles;
-    this->layer2 = layer2;
     this->background = background;
-    if (this->tiles == NULL || this->layer2 == NULL || this->background == NULL) return;
+    if (this->tiles == NULL || this->background == NULL) return;
     this->hasTileCache = true;
 
-    // TODO: make these loops faster
-    // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-    //     myfile.write((char *)&tiles[i].mat.id, sizeof(unsigned int));
-    //     myfile.write((char *)&tiles[i].color, sizeof(unsigned int));
-    // }
-    // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-    //     myfile.write((char *)&layer2[i].mat.id, sizeof(unsigned int));
-    //     myfile.write((char *)&layer2[i].color, sizeof(unsigned int));
-    // }
-    // for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-    //     myfile.write((char *)&background[i], sizeof(unsigned int));
-    // }
-
-    MaterialInstanceData *buf = new MaterialInstanceData[CHUNK_W * CHUNK_H * 2];
-    for (int i = 0; i < CHUNK_W * CHUNK_H; i++) {
-        buf[i] = {(u16)tiles[i].mat->id, tiles[i].color, tiles[i].temperature};
-        buf[CHUNK_W * CHUNK_H + i] = {(u16)layer2[i].mat->id, layer2[i].color, layer2[i].temperature};
+    std::vector<char> payload;
+    try {
+        ChunkCodec::encode(this->generationPhase, tiles, layer2, background, biomes_id.size() == CHUNK_W * CHUNK_H ? biomes_id.data() : nullptr, payload,
+                           extras ? extras->data() : nullptr, extras ? extras->size() : 0);
+    } catch (const std::runtime_error &e) {
+        METADOT_ERROR(std::format("{0} @ {1},{2}", e.what(), this->x, this->y).c_str());
+        return;
     }
-
-    const char *const src = (char *)buf;
-    const int src_size = (int)(CHUNK_W * CHUNK_H * 2 * sizeof(MaterialInstanceData));
-    const int max_dst_size = LZ4_compressBound(src_size);
-
-    char *compressed_data = (char *)malloc((size_t)max_dst_size);
-
-    const int compressed_data_size = LZ4_compress_fast(src, compressed_data, src_size, max_dst_size, 10);
-
-    if (compressed_data_size <= 0) {
-        METADOT_ERROR(std::format("Failed to compress chunk tile data @ {0},{1} (err {2})", this->x, this->y, compressed_data_size).c_str());
-    }
-
-    // if(compressed_data_size > 0){
-    //     METADOT_BUG("Compression data1 ratio: %f", (f32)compressed_data_size / src_size * 100);
-    // }
-
-    char *n_compressed_data = (char *)realloc(compressed_data, compressed_data_size);
-    if (n_compressed_data == NULL) throw std::runtime_error("Failed to realloc memory for Chunk::write compressed_data.");
-    compressed_data = n_compressed_data;
-
-    // bg compress
-
-    const char *const src2 = (char *)background;
-    const int src_size2 = (int)(CHUNK_W * CHUNK_H * sizeof(unsigned int));
-    const int max_dst_size2 = LZ4_compressBound(src_size2);
-
-    char *compressed_data2 = (char *)malloc((size_t)max_dst_size2);
-
-    const int compressed_data_size2 = LZ4_compress_fast(src2, compressed_data2, src_size2, max_dst_size2, 10);
-
-    if (compressed_data_size2 <= 0) {
-        METADOT_ERROR(std::format("Failed to compress chunk tile data @ {0},{1} (err {2})", this->x, this->y, compressed_data_size2).c_str());
+    this->savedGeneration = this->generation;
+    this->extrasHash = (extras && !extras->empty()) ? metadot_fnv1a(extras->data(), (int)extras->size()) : 0;
+    ME_profiler_count("chunk writes", 1);
+    ME_profiler_count("chunk write bytes", payload.size());
+
+    if (regions && regions->is_open()) {
+        // 由区域文件的后台任务写盘
+        regions->write(this->x, this->y, std::move(payload));
+    } else {
+        // 没有区域文件时写旧版单区块文件 新世界不再预先创建 chunks 目录
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(this->pack_filename).parent_path(), ec);
+        if (!ME_fs_write_file_atomic(this->pack_filename, payload.data(), payload.size())) {
+            METADOT_ERROR(std::format("Failed to write chunk {0},{1} to {2}", this->x, this->y, this->pack_filename).c_str());
+        }
     }
-
-    // if(compressed_data_size2 > 0){
-    //     METADOT_BUG("Compression data2 ratio: %f", (f32)compressed_data_size2 / src_size2 * 100);
-    // }
-
-    char *n_compressed_data2 = (char *)realloc(compressed_data2, (size_t)compressed_data_size2);
-    if (n_compressed_data2 == NULL) throw std::runtime_error("Failed to realloc memory for Chunk::write compressed_data2.");
-    compressed_data2 = n_compressed_data2;
-
-    // datapack_node *dp;
-
-    // datapack_bin leveldata;
-    // datapack_bin leveldata2;
-
-    // const char *s = "Is man one of God's blunders? Or is God one of man's blunders?";
-
-    // const char *filename = this->pack_filename.c_str();
-    // dp = datapack_map(CHUNK_DATABASE_FORMAT, &s, &filename, &this->generationPhase, &this->x, &this->y, &src_size, &compressed_data_size, &src_size2, &compressed_data_size2, &leveldata,
-    // &leveldata2);
-
-    // leveldata.sz = compressed_data_size;
-    // leveldata.addr = compressed_data;
-    // leveldata2.sz = compressed_data_size2;
-    // leveldata2.addr = compressed_data2;
-
-    // datapack_pack(dp, 0);
-    // datapack_dump(dp, DATAPACK_FILE, this->pack_filename.c_str());
-    // datapack_free(dp);
-
-    // free(compressed_data);
-    // free(compressed_data2);
-
-    // delete[] buf;
-
-    std::ofstream myfile;
-    myfile.open(this->pack_filename, std::ios::binary);
-    myfile.write((char *)&this->generationPhase, sizeof(int8_t));
-
-    myfile.write((char *)&src_size, sizeof(int));
-    myfile.write((char *)&compressed_data_size, sizeof(int));
-    myfile.write((char *)&src_size2, sizeof(int));
-    myfile.write((char *)&compressed_data_size2, sizeof(int));
-
-    myfile.write((char *)compressed_data, compressed_data_size);
-    myfile.write((char *)compressed_data2, compressed_data_size2);
-
-    free(compressed_data);
-    free(compressed_data2);
-
-    delete[] buf;
-
-    myfile.close();
 }
 
 bool Chunk::ChunkHasFile() {
+    if (regions && regions->contains(this->x, this->y)) return true;
     struct stat buffer;
     return (stat(this->pack_filename.c_str(), &buffer) == 0);
 }
 
+bool Chunk::ChunkReadSummary(int level, u32 *out) {
+    DataView view;
+    return ChunkMapData(view) && ChunkCodec::read_summary(view.data, view.size, level, out);
+}
+
 u64 Chunk::get_chunk_size() {
 
     // size_t biomes_vectorSize = sizeof(biomes_id);
-    size_t biomes_elementSize = sizeof(int);
+    size_t biomes_elementSize = sizeof(u8);
     size_t biomes_elementCount = biomes_id.size();
     size_t biomes_totalSize = /*biomes_vectorSize +*/ biomes_elementSize * biomes_elementCount;
 
@@ -346,7 +241,7 @@ u64 Chunk::get_chunk_size() {
     size_t polys_elementCount = polys.size();
     size_t polys_totalSize = /*polys_vectorSize +*/ polys_elementSize * polys_elementCount;
 
-    size_t total = sizeof(MaterialInstance) * CHUNK_W * CHUNK_H * 2;
+    size_t total = sizeof(MaterialInstance) * CHUNK_W * CHUNK_H + layer2.memory_bytes();
 
     total += sizeof(u32) * CHUNK_W * CHUNK_H;
     total += biomes_totalSize + polys_totalSize;
@@ -5,8 +5,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "engine/core/const.h"
 #include "engine/core/core.hpp"
@@ -16,7 +18,9 @@
 #include "game/player.hpp"
 #include "game_basic.hpp"
 #include "game_datastruct.hpp"
+#include "layer2_bricks.hpp"
 #include "reflectionflat.hpp"
+#include "world_region.hpp"
 
 namespace ME {
 
@@ -39,9 +43,37 @@ struct meta::static_refl::TypeInfo<MaterialInstanceData> : TypeInfoBase<Material
     };
 };
 
+struct Chunk;
+
+// 区块对象以及 tiles/background 数组的复用池
+// 区块不断加载卸载 每次都 new/delete 三个大数组很浪费 卸载时归还 加载时优先取回
+// reset 为 false 时取回的数组内容未定义 调用者负责全部写入
+class ChunkStoragePool {
+public:
+    static constexpr size_t MAX_FREE = 64;
+    static constexpr size_t MAX_FREE_CHUNKS = 256;
+
+    static MaterialInstance *alloc_tiles(bool reset = true);
+    static u32 *alloc_background();
+    static void free_tiles(MaterialInstance *tiles);
+    static void free_background(u32 *background);
+
+    // 取回的区块与 new Chunk 相同 归还时同时归还它的数组
+    static Chunk *alloc_chunk();
+    static void free_chunk(Chunk *ch);
+
+private:
+    static std::mutex lock;
+    static std::vector<MaterialInstance *> freeTiles;
+    static std::vector<u32 *> freeBackgrounds;
+    static std::vector<Chunk *> freeChunks;
+};
+
 // Chunk data structure
 struct Chunk {
+    // 旧版单区块存档文件 只在区域文件中没有该区块时读取
     std::string pack_filename;
+    RegionStore *regions = nullptr;
 
     int x = 0;
     int y = 0;
@@ -51,20 +83,50 @@ struct Chunk {
     i8 generationPhase = 0;
     bool pleaseDelete = false;
 
+    // 内容每次改变 generation 加一 写入存档时记下 savedGeneration 两者相同时不需要重写
+    u32 generation = 0;
+    u32 savedGeneration = 0;
+    bool ChunkNeedsSave() const { return generation != savedGeneration; }
+
     bool hasTileCache = false;
     MaterialInstance *tiles = nullptr;
-    MaterialInstance *layer2 = nullptr;
+    // 大多数区块的第二层是空的 按块懒分配
+    Layer2Bricks layer2{};
 
-    // TODO: 23/7/22 我在思考是否可以把区块的background数据换成一个整体的位图来存储，那样效率应该会更高
+    // 区块合并进世界后整块上传到 BackgroundAtlas 绘制时不再逐像素转换
     u32 *background = nullptr;
 
-    // 区块群系优化为id查表
-    std::vector<int> biomes_id{};
+    // 每个像素的群系 ID (群系 ID 不超过 255) 生成时填写 随存档保存读取
+    // 为空表示还没有计算 例如读取的是更早的存档
+    std::vector<u8> biomes_id{};
     std::vector<b2PolygonShape> polys{};
     RigidBody *rb = nullptr;
+    // 生成 polys 时 SOLID 掩码的哈希 没变时 updateChunkMesh 只移动刚体
+    u64 meshHash = 0;
+    bool meshValid = false;
+    // physics_grid_terrain 时区块刚体上的 b2GridShape 直接读取的 SOLID 位图 四周各多一格邻居
+    std::vector<u8> gridCells{};
+    // meshHash 是网格位图的哈希
+    bool meshGrid = false;
+    // 碰撞网格重新生成的次数 world::tickChunkCosts 取走后清零
+    u32 remeshes = 0;
+
+    // 区块在 tickZone 里时每个 tick 的模拟开销 按指数平均 (约最近 16 个 tick) 用于 draw_chunk_cost 热力图和调试窗口
+    struct TickCost {
+        f32 ms = 0;         // 区块任务的耗时 各遍各阶段之和
+        f32 cells = 0;      // 处理的像素数
+        f32 particles = 0;  // 生成的 CellData
+        f32 remesh = 0;     // 碰撞网格重新生成的次数
+    };
+    TickCost tickCost{};
+
+    // 从存档读出但还没放回世界的结构和实体 (ChunkExtras 编码) 区块合并进世界后由 world::restoreChunkExtras 取出
+    std::vector<u8> extras{};
+    // 上次写入或读取的附加数据的哈希 没变时卸载不需要重写
+    u64 extrasHash = 0;
 
     // Initialize a chunk
-    void ChunkInit(int x, int y, const std::string &worldName);
+    void ChunkInit(int x, int y, const std::string &worldName, RegionStore *regions = nullptr);
     // Uninitialize a chunk
     void ChunkDelete();
     // Check chunk's meta data
@@ -72,8 +134,23 @@ struct Chunk {
 
     // static MaterialInstanceData* readBuf;
     void ChunkRead();
-    void ChunkWrite(MaterialInstance *tiles, MaterialInstance *layer2, u32 *background);
+    // 同时写入区块自己的 layer2 extras 为 ChunkExtras 编码后的数据 为 nullptr 或者为空时不写附加数据
+    void ChunkWrite(MaterialInstance *tiles, u32 *background, const std::vector<u8> *extras = nullptr);
     bool ChunkHasFile();
+    // 从存档读取第 level 级缩略图 (见 ChunkCodec::summarize) 不读取也不解压区块本身
+    bool ChunkReadSummary(int level, u32 *out);
+
+    // 存档数据的只读视图 指向区域文件或旧版 pack 文件的内存映射 析构时释放
+    struct DataView {
+        RegionStore::View region;
+        ME_fs_mapped_file file;
+        const char *data = nullptr;
+        size_t size = 0;
+
+        ~DataView() { ME_fs_unmap_file(file); }
+    };
+    // 映射存档数据 优先区域文件 其次旧版 pack 文件
+    bool ChunkMapData(DataView &out);
 
     // 粗略计算区块占用内存字节
     u64 get_chunk_size();
@@ -107,7 +184,6 @@ struct ME::meta::static_refl::TypeInfo<ME::Chunk> : TypeInfoBase<Chunk> {
             Field{TSTR("pleaseDelete"), &Type::pleaseDelete},
             Field{TSTR("hasTileCache"), &Chunk::hasTileCache},
             Field{TSTR("tiles"), &Chunk::tiles},
-            Field{TSTR("layer2"), &Chunk::layer2},
             Field{TSTR("background"), &Type::background},
             Field{TSTR("biomes_id"), &Chunk::biomes_id},
             Field{TSTR("polys"), &Chunk::polys},
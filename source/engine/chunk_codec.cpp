@@ -0,0 +1,691 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "chunk_codec.hpp"
+
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "chunk.hpp"
+#include "engine/core/global.hpp"
+#include "engine/utils/utility.hpp"
+#include "libs/lz4/lz4.h"
+#include "libs/lz4/lz4hc.h"
+#include "libs/lz4/xxhash.h"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+namespace {
+
+constexpr int N = CHUNK_W * CHUNK_H;
+
+struct CodecHeader {
+    char magic[4];
+    u8 version;
+    i8 generationPhase;
+    u8 flags;
+    u8 reserved;
+    u32 rawSize;
+    u32 compressedSize;
+};
+static_assert(sizeof(CodecHeader) == 16);
+
+struct DeltaHeader {
+    char magic[4];
+    u8 version;
+    u8 flags;
+    u16 reserved;
+    u64 bricks;
+    u32 rawSize;
+    u32 compressedSize;
+};
+static_assert(sizeof(DeltaHeader) == 24);
+
+constexpr u8 FLAG_WIDE_MATERIALS = 1 << 0;  // 材料下标为 u16
+constexpr u8 FLAG_RAW_COLORS = 1 << 1;      // 颜色不用调色板 直接存 u32
+constexpr u8 FLAG_BIOMES = 1 << 2;          // 末尾有群系平面
+constexpr u8 FLAG_SUMMARY = 1 << 3;         // LZ4 数据之后有缩略图
+constexpr u8 FLAG_CHECKSUM = 1 << 4;        // 末尾是之前所有字节的 XXH32
+constexpr u8 FLAG_EXTRAS = 1 << 5;          // 缩略图之后有附加数据 (u32 长度 + 内容)
+
+constexpr int SUMMARY_PIXELS = ChunkCodec::summary_size(0) + ChunkCodec::summary_size(1);
+
+// 按通道平均 count 个 0xAARRGGBB 颜色
+struct ColorSum {
+    u32 a = 0, r = 0, g = 0, b = 0;
+
+    void add(u32 c) {
+        a += c >> 24;
+        r += (c >> 16) & 0xff;
+        g += (c >> 8) & 0xff;
+        b += c & 0xff;
+    }
+    u32 average(u32 count) const { return ((a / count) << 24) | ((r / count) << 16) | ((g / count) << 8) | (b / count); }
+};
+
+// 解压后的数据不会超过这个大小 防止损坏的格式头申请过多内存
+constexpr u32 MAX_RAW_SIZE = sizeof(u64) + 2 * sizeof(u16) + 2 * N * sizeof(u16) + sizeof(u32) + 3 * N * sizeof(u32) + 2 * N * sizeof(u16) + 2 * N * sizeof(u16) + N * sizeof(u32) + N * sizeof(u8);
+
+// 有界读取 越界时抛出
+struct Reader {
+    const char *data;
+    size_t size;
+    size_t cursor = 0;
+
+    const char *take(size_t n) {
+        if (n > size - cursor) throw std::runtime_error("Chunk data is truncated");
+        const char *p = data + cursor;
+        cursor += n;
+        return p;
+    }
+
+    template <typename T>
+    T get() {
+        T v;
+        memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+};
+
+template <typename T>
+void put(std::vector<char> &out, const T &v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const char *p = (const char *)&v;
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+// 按存档中的顺序排列的一段连续像素 tiles 整块一段 layer2 每个分配的块一段
+struct PixelSpan {
+    const MaterialInstance *p;
+    int n;
+};
+
+// 返回 tiles 之后 layer2 的第一段
+int collect_spans(const MaterialInstance *tiles, const Layer2Bricks &layer2, PixelSpan *spans) {
+    spans[0] = {tiles, N};
+    int count = 1;
+    for (int b = 0; b < Layer2Bricks::BRICK_COUNT; b++) {
+        if (const MaterialInstance *p = layer2.brick(b)) spans[count++] = {p, Layer2Bricks::BRICK_PIXELS};
+    }
+    return count;
+}
+
+// 背景颜色的一段 与 PixelSpan 对应
+struct ColorSpan {
+    const u32 *p;
+    int n;
+};
+
+// 按首次出现的顺序建立调色板 写入解压后的调色板和各平面 layer2Mask 写在颜色调色板之后
+// spans 中从 layer2From 开始的段属于 layer2 温度差值从头算起 返回 FLAG_WIDE_MATERIALS 和 FLAG_RAW_COLORS
+u8 write_planes(const PixelSpan *spans, int spanCount, int layer2From, const ColorSpan *background, int backgroundCount, u64 layer2Mask, std::vector<char> &raw) {
+    phmap::flat_hash_map<u16, u16> matIndex;
+    std::vector<u16> mats;
+    phmap::flat_hash_map<u32, u32> colorIndex;
+    std::vector<u32> colors;
+
+    auto color_slot = [&](u32 color) {
+        auto [it, inserted] = colorIndex.try_emplace(color, (u32)colors.size());
+        if (inserted) colors.push_back(color);
+        return it->second;
+    };
+
+    for (int s = 0; s < spanCount; s++) {
+        for (int i = 0; i < spans[s].n; i++) {
+            const MaterialInstance &m = spans[s].p[i];
+            auto [it, inserted] = matIndex.try_emplace((u16)m.mat->id, (u16)mats.size());
+            if (inserted) mats.push_back((u16)m.mat->id);
+            color_slot(m.color);
+        }
+    }
+    for (int s = 0; s < backgroundCount; s++) {
+        for (int i = 0; i < background[s].n; i++) color_slot(background[s].p[i]);
+    }
+
+    u8 flags = 0;
+    if (mats.size() > 256) flags |= FLAG_WIDE_MATERIALS;
+    if (colors.size() > 65536) flags |= FLAG_RAW_COLORS;
+
+    put(raw, (u16)mats.size());
+    for (u16 m : mats) put(raw, m);
+
+    const u32 colorCount = (flags & FLAG_RAW_COLORS) ? 0 : (u32)colors.size();
+    put(raw, colorCount);
+    for (u32 c = 0; c < colorCount; c++) put(raw, colors[c]);
+
+    put(raw, layer2Mask);
+
+    for (int s = 0; s < spanCount; s++) {
+        for (int i = 0; i < spans[s].n; i++) {
+            u16 m = matIndex[(u16)spans[s].p[i].mat->id];
+            if (flags & FLAG_WIDE_MATERIALS) {
+                put(raw, m);
+            } else {
+                put(raw, (u8)m);
+            }
+        }
+    }
+
+    auto put_color = [&](u32 color) {
+        if (flags & FLAG_RAW_COLORS) {
+            put(raw, color);
+        } else {
+            put(raw, (u16)colorIndex[color]);
+        }
+    };
+
+    for (int s = 0; s < spanCount; s++) {
+        for (int i = 0; i < spans[s].n; i++) put_color(spans[s].p[i].color);
+    }
+
+    // 温度大多是 0 或者缓慢变化 存差值 layer2 的各块接着前一块
+    u16 prev = 0;
+    for (int s = 0; s < spanCount; s++) {
+        if (s == layer2From) prev = 0;
+        for (int i = 0; i < spans[s].n; i++) {
+            u16 t = (u16)spans[s].p[i].temperature;
+            put(raw, (u16)(t - prev));
+            prev = t;
+        }
+    }
+
+    for (int s = 0; s < backgroundCount; s++) {
+        for (int i = 0; i < background[s].n; i++) put_color(background[s].p[i]);
+    }
+    return flags;
+}
+
+// 按 write_planes 的顺序读取调色板和各平面 下标越界时 ok 为 false
+struct PlaneReader {
+    bool wideMats = false;
+    bool rawColors = false;
+    u16 matCount = 0;
+    u32 colorCount = 0;
+    const char *colors = nullptr;
+    const char *matPlane = nullptr;
+    const char *colorPlane = nullptr;
+    const char *tempPlane = nullptr;
+    const char *backgroundPlane = nullptr;
+    u16 temperature = 0;
+    bool ok = true;
+
+    // 材料 ID 无效时记录错误并返回 false 调色板太大时抛出
+    bool read_palettes(Reader &raw, u8 flags) {
+        wideMats = flags & FLAG_WIDE_MATERIALS;
+        rawColors = flags & FLAG_RAW_COLORS;
+
+        const size_t materialCount = GAME()->materials_container.size();
+        Material **materials = GAME()->materials_array;
+
+        matCount = raw.get<u16>();
+        mats().resize(matCount);
+        for (u16 m = 0; m < matCount; m++) {
+            u16 id = raw.get<u16>();
+            if (id >= materialCount) {
+                METADOT_ERROR(std::format("Chunk refers to unknown material {0}.", id).c_str());
+                return false;
+            }
+            mats()[m] = materials[id];
+        }
+
+        colorCount = raw.get<u32>();
+        if (colorCount > 65536) throw std::runtime_error("Chunk color palette is too large: " + std::to_string(colorCount));
+        colors = raw.take((size_t)colorCount * sizeof(u32));
+        return true;
+    }
+
+    void read_planes(Reader &raw, size_t pixels, size_t backgroundPixels) {
+        matPlane = raw.take(pixels * (wideMats ? sizeof(u16) : sizeof(u8)));
+        colorPlane = raw.take(pixels * (rawColors ? sizeof(u32) : sizeof(u16)));
+        tempPlane = raw.take(pixels * sizeof(u16));
+        backgroundPlane = raw.take(backgroundPixels * (rawColors ? sizeof(u32) : sizeof(u16)));
+    }
+
+    u32 color_at(const char *plane, size_t i) {
+        u32 c;
+        if (rawColors) {
+            memcpy(&c, plane + i * sizeof(u32), sizeof(u32));
+            return c;
+        }
+        u16 index;
+        memcpy(&index, plane + i * sizeof(u16), sizeof(u16));
+        if (index >= colorCount) {
+            ok = false;
+            return 0;
+        }
+        memcpy(&c, colors + (size_t)index * sizeof(u32), sizeof(u32));
+        return c;
+    }
+
+    u32 background_at(size_t i) { return color_at(backgroundPlane, i); }
+
+    // 温度按读取顺序累加 layer2 开始前把 temperature 清零
+    MaterialInstance pixel_at(size_t p) {
+        u16 m;
+        if (wideMats) {
+            memcpy(&m, matPlane + p * sizeof(u16), sizeof(u16));
+        } else {
+            m = (u8)matPlane[p];
+        }
+        if (m >= matCount) {
+            ok = false;
+            m = 0;
+        }
+
+        u16 delta;
+        memcpy(&delta, tempPlane + p * sizeof(u16), sizeof(u16));
+        temperature = (u16)(temperature + delta);
+
+        return MaterialInstance(mats()[m], color_at(colorPlane, p), (mat_temperature)temperature);
+    }
+
+    // 每个线程复用
+    static std::vector<Material *> &mats() {
+        thread_local std::vector<Material *> list;
+        return list;
+    }
+};
+
+}  // namespace
+
+void ChunkCodec::encode(i8 generationPhase, const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, const u8 *biomes, std::vector<char> &out, const u8 *extras,
+                        size_t extrasSize, Compression compression) {
+    PixelSpan spans[1 + Layer2Bricks::BRICK_COUNT];
+    const int spanCount = collect_spans(tiles, layer2, spans);
+    const ColorSpan backgroundSpan{background, N};
+
+    std::vector<char> raw;
+    raw.reserve(MAX_RAW_SIZE);
+    u8 flags = write_planes(spans, spanCount, 1, &backgroundSpan, 1, layer2.brick_mask(), raw);
+    if (biomes) {
+        flags |= FLAG_BIOMES;
+        raw.insert(raw.end(), (const char *)biomes, (const char *)biomes + N);
+    }
+
+    const int bound = LZ4_compressBound((int)raw.size());
+    out.resize(sizeof(CodecHeader) + bound);
+    char *dst = out.data() + sizeof(CodecHeader);
+    const int compressed = compression == Compression::high ? LZ4_compress_HC(raw.data(), dst, (int)raw.size(), bound, LZ4HC_CLEVEL_DEFAULT)
+                                                            : LZ4_compress_default(raw.data(), dst, (int)raw.size(), bound);
+    if (compressed <= 0) throw std::runtime_error("Failed to compress chunk data (err " + std::to_string(compressed) + ")");
+    out.resize(sizeof(CodecHeader) + compressed);
+
+    CodecHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.generationPhase = generationPhase;
+    header.flags = flags;
+    header.rawSize = (u32)raw.size();
+    header.compressedSize = (u32)compressed;
+
+    header.flags |= FLAG_SUMMARY;
+    const size_t summaryAt = out.size();
+    out.resize(summaryAt + SUMMARY_PIXELS * sizeof(u32));
+    u32 summary[SUMMARY_PIXELS];
+    summarize(tiles, layer2, background, summary);
+    memcpy(out.data() + summaryAt, summary, sizeof(summary));
+
+    if (extras && extrasSize > 0) {
+        header.flags |= FLAG_EXTRAS;
+        const u32 length = (u32)extrasSize;
+        const size_t extrasAt = out.size();
+        out.resize(extrasAt + sizeof(length) + extrasSize);
+        memcpy(out.data() + extrasAt, &length, sizeof(length));
+        memcpy(out.data() + extrasAt + sizeof(length), extras, extrasSize);
+    }
+
+    header.flags |= FLAG_CHECKSUM;
+    memcpy(out.data(), &header, sizeof(header));
+
+    const u32 checksum = XXH32(out.data(), out.size(), 0);
+    const size_t checksumAt = out.size();
+    out.resize(checksumAt + sizeof(checksum));
+    memcpy(out.data() + checksumAt, &checksum, sizeof(checksum));
+}
+
+void ChunkCodec::summarize(const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, u32 *out) {
+    const int air = GAME()->materials_list.GENERIC_AIR.id;
+    constexpr int s0 = SUMMARY_SCALE[0], w0 = summary_width(0), h0 = summary_height(0);
+
+    for (int by = 0; by < h0; by++) {
+        for (int bx = 0; bx < w0; bx++) {
+            ColorSum sum;
+            for (int y = by * s0; y < (by + 1) * s0; y++) {
+                for (int x = bx * s0; x < (bx + 1) * s0; x++) {
+                    const int i = x + y * CHUNK_W;
+                    if (tiles[i].mat->id != air) {
+                        sum.add(0xff000000 | (tiles[i].color & 0xffffff));
+                    } else if (const MaterialInstance l2 = layer2.get(x, y); l2.mat->id != air) {
+                        sum.add(0xff000000 | (l2.color & 0xffffff));
+                    } else {
+                        sum.add(background[i]);
+                    }
+                }
+            }
+            out[bx + by * w0] = sum.average(s0 * s0);
+        }
+    }
+
+    // 第 1 级由第 0 级再平均
+    constexpr int k = SUMMARY_SCALE[1] / SUMMARY_SCALE[0], w1 = summary_width(1), h1 = summary_height(1);
+    u32 *level1 = out + summary_size(0);
+    for (int by = 0; by < h1; by++) {
+        for (int bx = 0; bx < w1; bx++) {
+            ColorSum sum;
+            for (int y = by * k; y < (by + 1) * k; y++) {
+                for (int x = bx * k; x < (bx + 1) * k; x++) sum.add(out[x + y * w0]);
+            }
+            level1[bx + by * w1] = sum.average(k * k);
+        }
+    }
+}
+
+bool ChunkCodec::read_summary(const char *data, size_t size, int level, u32 *out) {
+    if (level < 0 || level >= SUMMARY_LEVELS) return false;
+    if (size < sizeof(CodecHeader) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) return false;
+
+    CodecHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (!(header.flags & FLAG_SUMMARY)) return false;
+
+    size_t offset = sizeof(CodecHeader) + header.compressedSize;
+    for (int l = 0; l < level; l++) offset += summary_size(l) * sizeof(u32);
+    const size_t bytes = summary_size(level) * sizeof(u32);
+    if (offset > size || bytes > size - offset) return false;
+
+    memcpy(out, data + offset, bytes);
+    return true;
+}
+
+bool ChunkCodec::verify(const char *data, size_t size) {
+    if (size < sizeof(CodecHeader) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) return true;
+
+    CodecHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (!(header.flags & FLAG_CHECKSUM)) return true;
+    if (size < sizeof(CodecHeader) + sizeof(u32)) return false;
+
+    u32 checksum;
+    memcpy(&checksum, data + size - sizeof(checksum), sizeof(checksum));
+    return XXH32(data, size - sizeof(checksum), 0) == checksum;
+}
+
+bool ChunkCodec::read_extras(const char *data, size_t size, std::vector<u8> &out) {
+    out.clear();
+    if (size < sizeof(CodecHeader) || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) return true;
+
+    CodecHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (!(header.flags & FLAG_EXTRAS)) return true;
+
+    size_t offset = sizeof(CodecHeader) + header.compressedSize;
+    if (header.flags & FLAG_SUMMARY) offset += SUMMARY_PIXELS * sizeof(u32);
+    u32 length;
+    if (offset > size || size - offset < sizeof(length)) return false;
+    memcpy(&length, data + offset, sizeof(length));
+    offset += sizeof(length);
+    if (length > size - offset) return false;
+
+    out.assign((const u8 *)data + offset, (const u8 *)data + offset + length);
+    return true;
+}
+
+bool ChunkCodec::read_phase(const char *data, size_t size, i8 &phase) {
+    if (size >= sizeof(CodecHeader) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0) {
+        CodecHeader header;
+        memcpy(&header, data, sizeof(header));
+        phase = header.generationPhase;
+        return true;
+    }
+    if (size < 1) return false;
+    phase = (i8)data[0];
+    return true;
+}
+
+bool ChunkCodec::decode(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background, std::vector<u8> &biomes,
+                        std::vector<u8> *extras) {
+    if (extras) extras->clear();
+    layer2.clear();
+    if (size >= sizeof(CodecHeader) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0) {
+        if (!verify(data, size)) {
+            METADOT_ERROR("Chunk data checksum mismatch");
+            return false;
+        }
+        if (!decode_v2(data, size, generationPhase, tiles, layer2, background, biomes)) return false;
+        return !extras || read_extras(data, size, *extras);
+    }
+    biomes.clear();
+    return decode_v1(data, size, generationPhase, tiles, layer2, background);
+}
+
+// 解压缓冲直接使用 tiles 数组自身的内存 两层 MaterialInstanceData 必须放得下
+static_assert(std::is_trivially_copyable_v<MaterialInstance>);
+static_assert(2 * sizeof(MaterialInstanceData) <= sizeof(MaterialInstance));
+
+bool ChunkCodec::decode_v1(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background) {
+    Reader in{data, size};
+
+    generationPhase = in.get<i8>();
+
+    // 两层MaterialInstanceData包括tiles[]和layer2[]
+    const int src_size = in.get<int>();
+    if (src_size != N * 2 * sizeof(MaterialInstanceData))
+        throw std::runtime_error("Chunk src_size was different from expected: " + std::to_string(src_size) + " vs " + std::to_string(N * 2 * sizeof(MaterialInstanceData)));
+
+    const int compressed_size = in.get<int>();
+
+    const int src_size2 = in.get<int>();
+    const int desSize = N * sizeof(unsigned int);
+    if (src_size2 != desSize) throw std::runtime_error("Chunk src_size2 was different from expected: " + std::to_string(src_size2) + " vs " + std::to_string(desSize));
+
+    const int compressed_size2 = in.get<int>();
+    if (compressed_size < 0 || compressed_size2 < 0) throw std::runtime_error("Chunk compressed size is negative");
+
+    // 直接从映射解压到 tiles 数组的前 2N 个 MaterialInstanceData 大小的位置
+    char *raw = (char *)tiles;
+    const int decompressed_size = LZ4_decompress_safe(in.take(compressed_size), raw, compressed_size, src_size);
+
+    // 基本上，如果触发这两个检查中的任何一个，块都是不可读的，要么是因为写错了，要么是因为损坏。
+    if (decompressed_size < 0) {
+        METADOT_ERROR(std::format("Error decompressing chunk tile data (err {0}).", decompressed_size).c_str());
+        return false;
+    } else if (decompressed_size != src_size) {
+        METADOT_ERROR(std::format("Decompressed chunk tile data is corrupt! (was {0}, expected {1}).", decompressed_size, src_size).c_str());
+        return false;
+    }
+
+    Material **materials = GAME()->materials_array;
+    MaterialInstanceData d;
+
+    // layer2 的数据在后半段 先展开到 layer2
+    for (int i = 0; i < N; i++) {
+        memcpy(&d, raw + (size_t)(N + i) * sizeof(MaterialInstanceData), sizeof(d));
+        layer2.set(i % CHUNK_W, i / CHUNK_W, MaterialInstance(materials[d.index], d.color, d.temperature));
+    }
+
+    // tiles 原地展开 目标 i 总在源 i 之后 倒序处理不会覆盖尚未读取的源数据
+    for (int i = N - 1; i >= 0; i--) {
+        memcpy(&d, raw + (size_t)i * sizeof(MaterialInstanceData), sizeof(d));
+        tiles[i] = MaterialInstance(materials[d.index], d.color, d.temperature);
+    }
+
+    const int decompressed_size2 = LZ4_decompress_safe(in.take(compressed_size2), (char *)background, compressed_size2, src_size2);
+
+    if (decompressed_size2 < 0) {
+        METADOT_ERROR(std::format("Error decompressing chunk background data (err {0}).", decompressed_size2).c_str());
+        return false;
+    } else if (decompressed_size2 != src_size2) {
+        METADOT_ERROR(std::format("Decompressed chunk background data is corrupt! (was {0}, expected {1}).", decompressed_size2, src_size2).c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ChunkCodec::decode_v2(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background, std::vector<u8> &biomes) {
+    Reader in{data, size};
+
+    const CodecHeader header = in.get<CodecHeader>();
+    if (header.version != 2 && header.version != VERSION) throw std::runtime_error("Unknown chunk format version " + std::to_string(header.version));
+    if (header.rawSize > MAX_RAW_SIZE) throw std::runtime_error("Chunk raw size is too large: " + std::to_string(header.rawSize));
+    generationPhase = header.generationPhase;
+
+    // 每个线程复用同一个解压缓冲
+    thread_local std::vector<char> scratch;
+    if (scratch.size() < header.rawSize) scratch.resize(header.rawSize);
+
+    const int decompressed = LZ4_decompress_safe(in.take(header.compressedSize), scratch.data(), (int)header.compressedSize, (int)header.rawSize);
+    if (decompressed != (int)header.rawSize) {
+        METADOT_ERROR(std::format("Error decompressing chunk data (was {0}, expected {1}).", decompressed, header.rawSize).c_str());
+        return false;
+    }
+
+    Reader raw{scratch.data(), header.rawSize};
+    PlaneReader planes;
+    if (!planes.read_palettes(raw, header.flags)) return false;
+
+    // 版本 2 的 layer2 是完整的 N 个像素 读取时丢掉空气像素
+    static_assert(Layer2Bricks::BRICK_COUNT == 64);
+    const u64 brickMask = header.version == 2 ? 0 : raw.get<u64>();
+    const size_t layer2Pixels = header.version == 2 ? (size_t)N : (size_t)std::popcount(brickMask) * Layer2Bricks::BRICK_PIXELS;
+    planes.read_planes(raw, N + layer2Pixels, N);
+
+    if (header.flags & FLAG_BIOMES) {
+        const u8 *biomePlane = (const u8 *)raw.take(N);
+        biomes.assign(biomePlane, biomePlane + N);
+    } else {
+        biomes.clear();
+    }
+
+    for (int i = 0; i < N; i++) tiles[i] = planes.pixel_at(i);
+
+    planes.temperature = 0;
+    if (header.version == 2) {
+        for (int i = 0; i < N; i++) layer2.set(i % CHUNK_W, i / CHUNK_W, planes.pixel_at((size_t)N + i));
+    } else {
+        size_t p = N;
+        for (int b = 0; b < Layer2Bricks::BRICK_COUNT; b++) {
+            if (!(brickMask >> b & 1)) continue;
+            MaterialInstance *brick = layer2.alloc_brick(b);
+            for (int i = 0; i < Layer2Bricks::BRICK_PIXELS; i++) brick[i] = planes.pixel_at(p++);
+        }
+    }
+
+    for (int i = 0; i < N; i++) background[i] = planes.background_at(i);
+
+    if (!planes.ok || planes.matCount == 0) {
+        METADOT_ERROR("Chunk palette index out of range.");
+        return false;
+    }
+    return true;
+}
+
+void ChunkCodec::encode_delta(u64 bricks, const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, std::vector<char> &out) {
+    constexpr int B = Layer2Bricks::BRICK;
+
+    // tiles 和背景的块按行分段 layer2 整块一段
+    thread_local std::vector<PixelSpan> spans;
+    thread_local std::vector<ColorSpan> rows;
+    spans.clear();
+    rows.clear();
+    for (u64 m = bricks; m; m &= m - 1) {
+        const int b = std::countr_zero(m);
+        const int x = (b % Layer2Bricks::BRICKS_X) * B, y = (b / Layer2Bricks::BRICKS_X) * B;
+        for (int r = 0; r < B; r++) {
+            spans.push_back({tiles + x + (y + r) * CHUNK_W, B});
+            rows.push_back({background + x + (y + r) * CHUNK_W, B});
+        }
+    }
+    const int layer2From = (int)spans.size();
+    const u64 layer2Mask = bricks & layer2.brick_mask();
+    for (u64 m = layer2Mask; m; m &= m - 1) spans.push_back({layer2.brick(std::countr_zero(m)), Layer2Bricks::BRICK_PIXELS});
+
+    thread_local std::vector<char> raw;
+    raw.clear();
+    const u8 flags = write_planes(spans.data(), (int)spans.size(), layer2From, rows.data(), (int)rows.size(), layer2Mask, raw);
+
+    // 每 tick 都要编码 用快速压缩而不是 HC
+    const int bound = LZ4_compressBound((int)raw.size());
+    out.resize(sizeof(DeltaHeader) + bound);
+    const int compressed = LZ4_compress_default(raw.data(), out.data() + sizeof(DeltaHeader), (int)raw.size(), bound);
+    if (compressed <= 0) throw std::runtime_error("Failed to compress chunk delta (err " + std::to_string(compressed) + ")");
+    out.resize(sizeof(DeltaHeader) + compressed);
+
+    DeltaHeader header{};
+    memcpy(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC));
+    header.version = DELTA_VERSION;
+    header.flags = flags;
+    header.bricks = bricks;
+    header.rawSize = (u32)raw.size();
+    header.compressedSize = (u32)compressed;
+    memcpy(out.data(), &header, sizeof(header));
+}
+
+bool ChunkCodec::decode_delta(const char *data, size_t size, u64 &bricks, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background) {
+    constexpr int B = Layer2Bricks::BRICK;
+    Reader in{data, size};
+
+    const DeltaHeader header = in.get<DeltaHeader>();
+    if (memcmp(header.magic, DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0) throw std::runtime_error("Not a chunk delta");
+    if (header.version != DELTA_VERSION) throw std::runtime_error("Unknown chunk delta version " + std::to_string(header.version));
+    if (header.rawSize > MAX_RAW_SIZE) throw std::runtime_error("Chunk delta raw size is too large: " + std::to_string(header.rawSize));
+    bricks = header.bricks;
+
+    thread_local std::vector<char> scratch;
+    if (scratch.size() < header.rawSize) scratch.resize(header.rawSize);
+
+    const int decompressed = LZ4_decompress_safe(in.take(header.compressedSize), scratch.data(), (int)header.compressedSize, (int)header.rawSize);
+    if (decompressed != (int)header.rawSize) {
+        METADOT_ERROR(std::format("Error decompressing chunk delta (was {0}, expected {1}).", decompressed, header.rawSize).c_str());
+        return false;
+    }
+
+    Reader raw{scratch.data(), header.rawSize};
+    PlaneReader planes;
+    if (!planes.read_palettes(raw, header.flags)) return false;
+
+    const u64 layer2Mask = raw.get<u64>();
+    if (layer2Mask & ~bricks) throw std::runtime_error("Chunk delta has layer2 bricks outside its mask");
+    const size_t tilePixels = (size_t)std::popcount(bricks) * Layer2Bricks::BRICK_PIXELS;
+    planes.read_planes(raw, tilePixels + (size_t)std::popcount(layer2Mask) * Layer2Bricks::BRICK_PIXELS, tilePixels);
+
+    size_t p = 0;
+    for (u64 m = bricks; m; m &= m - 1) {
+        const int b = std::countr_zero(m);
+        const int x = (b % Layer2Bricks::BRICKS_X) * B, y = (b / Layer2Bricks::BRICKS_X) * B;
+        for (int r = 0; r < B; r++) {
+            for (int i = 0; i < B; i++, p++) tiles[x + i + (y + r) * CHUNK_W] = planes.pixel_at(p);
+        }
+    }
+
+    // 增量里没有的 layer2 块是空气 已经分配的块要清掉
+    planes.temperature = 0;
+    for (u64 m = bricks; m; m &= m - 1) {
+        const int b = std::countr_zero(m);
+        if (!(layer2Mask >> b & 1)) {
+            if (layer2.brick(b)) std::fill_n(layer2.alloc_brick(b), Layer2Bricks::BRICK_PIXELS, Tiles_NOTHING);
+            continue;
+        }
+        MaterialInstance *brick = layer2.alloc_brick(b);
+        for (int i = 0; i < Layer2Bricks::BRICK_PIXELS; i++) brick[i] = planes.pixel_at(p++);
+    }
+
+    size_t q = 0;
+    for (u64 m = bricks; m; m &= m - 1) {
+        const int b = std::countr_zero(m);
+        const int x = (b % Layer2Bricks::BRICKS_X) * B, y = (b / Layer2Bricks::BRICKS_X) * B;
+        for (int r = 0; r < B; r++) {
+            for (int i = 0; i < B; i++) background[x + i + (y + r) * CHUNK_W] = planes.background_at(q++);
+        }
+    }
+
+    if (!planes.ok || (bricks && planes.matCount == 0)) {
+        METADOT_ERROR("Chunk delta palette index out of range.");
+        return false;
+    }
+    return true;
+}
+
+}  // namespace ME
@@ -0,0 +1,88 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_CHUNK_CODEC_HPP
+#define ME_CHUNK_CODEC_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "game_datastruct.hpp"
+#include "layer2_bricks.hpp"
+
+namespace ME {
+
+// 区块存档编码
+// 旧格式 (版本 1) 没有格式头 第一个字节就是 generationPhase 之后是两段 LZ4 数据
+// 版本 2 以 MAGIC 开头 格式头之后是一段 LZ4 数据 (用 LZ4 或 LZ4HC 压缩 解压方式相同) 解压后按平面存放:
+//   材料调色板 + 每个像素的调色板下标 (u8 或 u16)
+//   颜色调色板 + 每个像素的调色板下标 (u16) 颜色太多时直接存 u32 背景与两层共用颜色调色板
+//   温度与前一个像素的差值 (i16)
+// 版本 3 在颜色调色板之后多一个 u64 的 layer2 块掩码 (见 Layer2Bricks) 各平面中 layer2 只有已分配的块 按块的顺序存放
+// 版本 2 的 layer2 是完整的一层 读取时转换成块
+//   FLAG_BIOMES 时最后是每个像素的群系 ID (u8) 更早的存档没有这一段
+// FLAG_SUMMARY 时 LZ4 数据之后是不压缩的缩略图 各级依次存放 读取缩略图只需要映射文件末尾 不用解压
+// FLAG_EXTRAS 时缩略图之后是 u32 长度和附加数据 (区块上的结构和实体 见 ChunkExtras) 内容由调用者解释
+// FLAG_CHECKSUM 时最后 4 字节是之前所有字节 (包括格式头) 的 XXH32 旧程序读取时忽略它
+// 同一区块的材料只有几十种 颜色大多来自材质贴图 调色板下标比原始数据小得多也更容易压缩
+// 网络同步用的增量 (encode_delta) 以 DELTA_MAGIC 开头 只含部分 Layer2Bricks::BRICK 见方的块
+//   格式头记录块掩码 之后是一段 LZ4 数据 调色板和平面的排列与存档相同 tiles 和背景按块逐行存放 layer2 只有非空的块
+//   没有缩略图 群系 附加数据和校验和
+class ChunkCodec {
+public:
+    static constexpr char MAGIC[4] = {'M', 'E', 'C', 'K'};
+    static constexpr u8 VERSION = 3;
+    static constexpr char DELTA_MAGIC[4] = {'M', 'E', 'C', 'D'};
+    static constexpr u8 DELTA_VERSION = 1;
+
+    // 缩略图 第 0 级 1/8 (16x16) 第 1 级 1/32 (4x4) 每个像素是对应区域可见颜色的平均值 0xAARRGGBB
+    // 可见颜色依次取 tiles layer2 中不是空气的像素 都是空气时取背景
+    static constexpr int SUMMARY_LEVELS = 2;
+    static constexpr int SUMMARY_SCALE[SUMMARY_LEVELS] = {8, 32};
+    static constexpr int summary_width(int level) { return CHUNK_W / SUMMARY_SCALE[level]; }
+    static constexpr int summary_height(int level) { return CHUNK_H / SUMMARY_SCALE[level]; }
+    static constexpr int summary_size(int level) { return summary_width(level) * summary_height(level); }
+
+    // fast 用 LZ4 给主线程上的同步写盘 (卸载区块) high 用 LZ4HC 只在后台存档时用
+    enum class Compression { fast, high };
+
+    // 写入当前版本
+    // biomes 为 nullptr 时不写群系 extrasSize 为 0 时不写附加数据
+    static void encode(i8 generationPhase, const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, const u8 *biomes, std::vector<char> &out,
+                       const u8 *extras = nullptr, size_t extrasSize = 0, Compression compression = Compression::fast);
+
+    // 计算所有级别的缩略图 out 依次存放各级 共 summary_size(0) + summary_size(1) 个像素
+    static void summarize(const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, u32 *out);
+
+    // 读取第 level 级缩略图 旧存档或者没有缩略图时返回 false
+    static bool read_summary(const char *data, size_t size, int level, u32 *out);
+
+    // 只校验不解压 有校验和且不符时返回 false 没有校验和的旧存档总是返回 true
+    static bool verify(const char *data, size_t size);
+
+    // 只读取附加数据 没有时 out 为空 数据截断时返回 false
+    static bool read_extras(const char *data, size_t size, std::vector<u8> &out);
+
+    // 只读取 generationPhase 两种版本都支持
+    static bool read_phase(const char *data, size_t size, i8 &phase);
+
+    // 格式损坏 (截断 大小不符) 时抛出 std::runtime_error
+    // 校验和不符或者解压失败时记录错误并返回 false 此时数组内容未定义
+    // 存档里没有群系时 biomes 为空 extras 不为 nullptr 时同时取出附加数据
+    static bool decode(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background, std::vector<u8> &biomes,
+                       std::vector<u8> *extras = nullptr);
+
+    // 只编码 bricks 中的块 第 b 位与 Layer2Bricks::brick(b) 是同一块 每 tick 都会调用 压缩比存档快
+    static void encode_delta(u64 bricks, const MaterialInstance *tiles, const Layer2Bricks &layer2, const u32 *background, std::vector<char> &out);
+
+    // 只写入增量中的块 bricks 返回块掩码 这些块中增量里没有的 layer2 像素写成 Tiles_NOTHING
+    // 格式损坏时抛出 std::runtime_error 解压失败或下标越界时记录错误并返回 false
+    static bool decode_delta(const char *data, size_t size, u64 &bricks, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background);
+
+private:
+    static bool decode_v1(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background);
+    static bool decode_v2(const char *data, size_t size, i8 &generationPhase, MaterialInstance *tiles, Layer2Bricks &layer2, u32 *background, std::vector<u8> &biomes);
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,135 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "chunk_extras.hpp"
+
+#include <algorithm>
+
+#include "engine/utils/nbt.hpp"
+
+namespace ME {
+
+void ChunkExtras::clear() {
+    structures.clear();
+    entities.clear();
+    bodies.clear();
+}
+
+void ChunkExtras::encode(std::vector<u8> &out) const {
+    out.clear();
+    if (empty()) return;
+
+    nbt::stream_writer w(out);
+    w.begin_compound("chunk");
+    w.write_int(VERSION, "version");
+
+    w.begin_list(nbt::TAG::Compound, (i32)structures.size(), "structures");
+    for (const Structure &s : structures) {
+        w.begin_compound();
+        w.write_int(s.x, "x");
+        w.write_int(s.y, "y");
+        w.write_int(s.w, "w");
+        w.write_int(s.h, "h");
+        w.end_compound();
+    }
+    w.end_list();
+
+    w.begin_list(nbt::TAG::Compound, (i32)entities.size(), "entities");
+    for (const Entity &e : entities) {
+        w.begin_compound();
+        w.write_string(e.name, "name");
+        w.write_float(e.x, "x");
+        w.write_float(e.y, "y");
+        w.write_float(e.vx, "vx");
+        w.write_float(e.vy, "vy");
+        w.write_int(e.hw, "hw");
+        w.write_int(e.hh, "hh");
+        w.write_int(e.bot, "bot");
+        w.end_compound();
+    }
+    w.end_list();
+
+    w.begin_list(nbt::TAG::Compound, (i32)bodies.size(), "bodies");
+    for (const Body &b : bodies) {
+        w.begin_compound();
+        w.write_string(b.name, "name");
+        w.write_float(b.x, "x");
+        w.write_float(b.y, "y");
+        w.write_float(b.angle, "angle");
+        w.write_float(b.vx, "vx");
+        w.write_float(b.vy, "vy");
+        w.write_float(b.angularVelocity, "angularVelocity");
+        w.write_int(b.w, "w");
+        w.write_int(b.h, "h");
+        w.write_int_array(b.materials.data(), (i32)b.materials.size(), "materials");
+        w.write_int_array(b.colors.data(), (i32)b.colors.size(), "colors");
+        w.write_int_array(b.temperatures.data(), (i32)b.temperatures.size(), "temperatures");
+        w.end_compound();
+    }
+    w.end_list();
+
+    w.end_compound();
+}
+
+bool ChunkExtras::decode(const u8 *data, size_t size) {
+    clear();
+    if (size == 0) return true;
+
+    nbt::stream_reader in(data, size);
+    if (!in.enter_root()) return false;
+
+    // 不认识的标签直接跳过 以后加字段不影响旧数据
+    while (in.next()) {
+        const std::string_view list = in.name();
+        if (in.type() != nbt::TAG::List || !in.enter()) continue;
+
+        while (in.next()) {
+            if (in.type() != nbt::TAG::Compound || !in.enter()) continue;
+
+            if (list == "structures") {
+                Structure &s = structures.emplace_back();
+                while (in.next()) {
+                    if (in.name() == "x") s.x = in.read_int();
+                    else if (in.name() == "y") s.y = in.read_int();
+                    else if (in.name() == "w") s.w = in.read_int();
+                    else if (in.name() == "h") s.h = in.read_int();
+                }
+            } else if (list == "entities") {
+                Entity &e = entities.emplace_back();
+                while (in.next()) {
+                    if (in.name() == "name") e.name = in.read_string();
+                    else if (in.name() == "x") e.x = in.read_float();
+                    else if (in.name() == "y") e.y = in.read_float();
+                    else if (in.name() == "vx") e.vx = in.read_float();
+                    else if (in.name() == "vy") e.vy = in.read_float();
+                    else if (in.name() == "hw") e.hw = in.read_int();
+                    else if (in.name() == "hh") e.hh = in.read_int();
+                    else if (in.name() == "bot") e.bot = in.read_int();
+                }
+            } else if (list == "bodies") {
+                Body &b = bodies.emplace_back();
+                while (in.next()) {
+                    if (in.name() == "name") b.name = in.read_string();
+                    else if (in.name() == "x") b.x = in.read_float();
+                    else if (in.name() == "y") b.y = in.read_float();
+                    else if (in.name() == "angle") b.angle = in.read_float();
+                    else if (in.name() == "vx") b.vx = in.read_float();
+                    else if (in.name() == "vy") b.vy = in.read_float();
+                    else if (in.name() == "angularVelocity") b.angularVelocity = in.read_float();
+                    else if (in.name() == "w") b.w = in.read_int();
+                    else if (in.name() == "h") b.h = in.read_int();
+                    else if (in.name() == "materials") in.read_int_array(b.materials);
+                    else if (in.name() == "colors") in.read_int_array(b.colors);
+                    else if (in.name() == "temperatures") in.read_int_array(b.temperatures);
+                }
+                // 像素数对不上的刚体无法恢复
+                const size_t n = (size_t)std::max(b.w, 0) * (size_t)std::max(b.h, 0);
+                if (n == 0 || b.materials.size() != n || b.colors.size() != n || b.temperatures.size() != n) bodies.pop_back();
+            } else {
+                in.leave();
+            }
+        }
+    }
+    return in.ok();
+}
+
+}  // namespace ME
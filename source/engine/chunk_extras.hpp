@@ -0,0 +1,57 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_CHUNK_EXTRAS_HPP
+#define ME_CHUNK_EXTRAS_HPP
+
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 区块上的结构和实体 卸载时从世界中取出 随区块存档保存 (ChunkCodec FLAG_EXTRAS)
+// 编码为二进制 NBT 读取时用 nbt::stream_reader 顺序解析 不经过 JSON 也不建立标签树
+// 坐标都是不随 loadZone 变化的世界坐标 (区块 cx 覆盖 [cx * CHUNK_W, (cx + 1) * CHUNK_W))
+struct ChunkExtras {
+    static constexpr i32 VERSION = 1;
+
+    struct Structure {
+        i32 x = 0, y = 0, w = 0, h = 0;
+    };
+
+    // 非玩家的 WorldEntity bot 为 Bot::ID 没有 Bot 组件时为 -1
+    struct Entity {
+        std::string name;
+        f32 x = 0, y = 0, vx = 0, vy = 0;
+        i32 hw = 0, hh = 0;
+        i32 bot = -1;
+    };
+
+    // 不在手里的动态刚体 x y 为 b2Body 原点 angle 为弧度 materials/colors/temperatures 为 w * h 个像素
+    struct Body {
+        std::string name;
+        f32 x = 0, y = 0, angle = 0;
+        f32 vx = 0, vy = 0, angularVelocity = 0;
+        i32 w = 0, h = 0;
+        std::vector<i32> materials;
+        std::vector<i32> colors;
+        std::vector<i32> temperatures;
+    };
+
+    std::vector<Structure> structures;
+    std::vector<Entity> entities;
+    std::vector<Body> bodies;
+
+    bool empty() const { return structures.empty() && entities.empty() && bodies.empty(); }
+    void clear();
+
+    // 为空时 out 也为空
+    void encode(std::vector<u8> &out) const;
+    // 数据损坏时返回 false 已经解析出的记录保留
+    bool decode(const u8 *data, size_t size);
+};
+
+}  // namespace ME
+
+#endif
@@ -1,10 +1,13 @@
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <csetjmp>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #include "engine/core/io/filesystem.h"
 #include "engine/utils/utility.hpp"
@@ -12,14 +15,6 @@
 
 namespace ME {
 
-allocation_metrics g_allocation_metrics = {.total_allocated = 0, .total_free = 0};
-
-u64 ME_mem_current_usage_bytes() { return g_allocation_metrics.total_allocated - g_allocation_metrics.total_free; }
-f32 ME_mem_current_usage_mb() {
-    u64 bytes = ME_mem_current_usage_bytes();
-    return (f32)(bytes / 1048576.0f);
-}
-
 struct ME_mem_alloc_stack_t {
     void* memory;
     size_t capacity;
@@ -88,163 +83,314 @@ void ME_mem_alloc_frame_free(ME_mem_alloc_frame_t* frame) {
     frame->bytes_left = frame->capacity;
 }
 
-typedef struct ME_mem_alloc_heap_header_t {
-    struct ME_mem_alloc_heap_header_t* next;
-    struct ME_mem_alloc_heap_header_t* prev;
-    size_t size;
-} ME_mem_alloc_heap_header_t;
+#if defined(ME_LEAK_TEST)
 
-typedef struct ME_mem_alloc_alloc_info_t ME_mem_alloc_alloc_info_t;
-struct ME_mem_alloc_alloc_info_t {
-    const char* file;
-    size_t size;
-    int line;
+int const MY_SIZE = 1024 * 512;
 
-    struct ME_mem_alloc_alloc_info_t* next;
-    struct ME_mem_alloc_alloc_info_t* prev;
+static std::array<void*, MY_SIZE> myAlloc{
+        nullptr,
 };
 
-static ME_mem_alloc_alloc_info_t* ME_mem_alloc_alloc_head() {
-    static ME_mem_alloc_alloc_info_t info;
-    static int init;
+void* operator new(std::size_t sz) {
+    static int counter{};
+    void* ptr = std::malloc(sz);
+    myAlloc.at(counter++) = ptr;
+    // std::cout << "new." << counter << ".addr.: " << ptr << " size: " << sz << std::endl;
+    return ptr;
+}
 
-    if (!init) {
-        info.next = &info;
-        info.prev = &info;
-        init = 1;
-    }
+void operator delete(void* ptr) noexcept {
+    auto ind = std::distance(myAlloc.begin(), std::find(myAlloc.begin(), myAlloc.end(), ptr));
+    myAlloc[ind] = nullptr;
+    std::free(ptr);
+}
+
+void ME_get_memory_leak() {
 
-    return &info;
+    std::cout << std::endl;
+    std::cout << "Not deallocated: " << std::endl;
+    for (auto i : myAlloc) {
+        if (i != nullptr) std::cout << " " << i << std::endl;
+    }
+    std::cout << std::endl;
 }
 
-#if 1
-void* ME_mem_alloc_leak_check_alloc(size_t size, const char* file, int line, size_t* statistics) {
-    ME_mem_alloc_alloc_info_t* mem = (ME_mem_alloc_alloc_info_t*)ME_MALLOC_FUNC(sizeof(ME_mem_alloc_alloc_info_t) + size);
+#endif
 
-    if (!mem) return 0;
+namespace {
 
-    mem->file = file;
-    mem->line = line;
-    mem->size = size;
-    ME_mem_alloc_alloc_info_t* head = ME_mem_alloc_alloc_head();
-    mem->prev = head;
-    mem->next = head->next;
-    head->next->prev = mem;
-    head->next = mem;
+constexpr size_t POOL_CLASSES = ME_MEM_POOL_MAX / ME_MEM_POOL_GRANULE;
 
-    g_allocation_metrics.total_allocated += size;
-    if (NULL != statistics) *statistics += size;
+// 计数按线程分片 线程第一次分配时按顺序取一个分片 线程多于分片数时共用
+// 每个分片独占缓存行 用 relaxed 原子操作 读取时把所有分片加起来
+constexpr size_t COUNTER_SHARDS = 64;
 
-    return mem + 1;
+struct alignas(64) counter_shard {
+    std::atomic<u64> allocated{0};  // ME_MALLOC 计数 调用者请求的字节数
+    std::atomic<u64> freed{0};
+    std::atomic<u64> pool_allocs{0};
+    std::atomic<u64> pool_frees{0};
+    std::atomic<u64> large_allocs{0};
+    std::atomic<i64> pool_bytes{0};
+};
+
+counter_shard g_shards[COUNTER_SHARDS];
+std::atomic<u32> g_next_shard{0};
+std::atomic<u64> g_pool_reserved{0};
+
+counter_shard& local_shard() {
+    thread_local counter_shard* shard = &g_shards[g_next_shard.fetch_add(1, std::memory_order_relaxed) % COUNTER_SHARDS];
+    return *shard;
 }
 
-void* ME_mem_alloc_leak_check_calloc(size_t count, size_t element_size, const char* file, int line, size_t* statistics) {
-    size_t size = count * element_size;
-    void* mem = ME_mem_alloc_leak_check_alloc(size, file, line, statistics);
-    std::memset(mem, 0, size);
-    return mem;
+template <typename F>
+u64 sum_shards(F&& f) {
+    u64 n = 0;
+    for (counter_shard& s : g_shards) n += (u64)f(s);
+    return n;
 }
 
-void ME_mem_alloc_leak_check_free(void* mem, size_t* statistics) {
-    if (!mem) return;
+// 空闲块的前 8 字节存放链表指针
+struct pool_free_block {
+    pool_free_block* next;
+};
+
+struct pool_thread_cache {
+    pool_free_block* free[POOL_CLASSES] = {};
+    // 当前页中尚未切分的部分 只服务于同一级 换级时剩余部分切给原来的级
+    char* bump[POOL_CLASSES] = {};
+    char* bump_end[POOL_CLASSES] = {};
+};
 
-    ME_mem_alloc_alloc_info_t* info = (ME_mem_alloc_alloc_info_t*)mem - 1;
-    info->prev->next = info->next;
-    info->next->prev = info->prev;
+thread_local pool_thread_cache g_pool_cache;
 
-    g_allocation_metrics.total_free += info->size;
-    if (NULL != statistics) *statistics -= info->size;
+inline size_t pool_class(size_t size) { return (size + ME_MEM_POOL_GRANULE - 1) / ME_MEM_POOL_GRANULE - 1; }
 
-    ME_FREE_FUNC(info);
+void* pool_refill(size_t c) {
+    const size_t block = (c + 1) * ME_MEM_POOL_GRANULE;
+    char* page = (char*)ME_MALLOC_FUNC(ME_MEM_POOL_PAGE);
+    if (!page) return nullptr;
+    g_pool_reserved.fetch_add(ME_MEM_POOL_PAGE, std::memory_order_relaxed);
+    g_pool_cache.bump[c] = page + block;
+    g_pool_cache.bump_end[c] = page + ME_MEM_POOL_PAGE - (ME_MEM_POOL_PAGE % block);
+    return page;
 }
 
-int ME_mem_check_leaks(bool detailed) {
-    ME_mem_alloc_alloc_info_t* head = ME_mem_alloc_alloc_head();
-    ME_mem_alloc_alloc_info_t* next = head->next;
-    int leaks = 0;
+}  // namespace
 
-    std::size_t leaks_size = 0;
+void* ME_mem_pool_alloc(size_t size) {
+    if (size == 0) size = 1;
+    counter_shard& shard = local_shard();
+    shard.pool_allocs.fetch_add(1, std::memory_order_relaxed);
+    shard.pool_bytes.fetch_add((i64)size, std::memory_order_relaxed);
 
-    while (next != head) {
-        if (detailed) {
-            METADOT_WARN(std::format("[Mem] LEAKED {0} bytes from file \"{1}\" at line {2} from address {3}.", next->size, ME::ME_fs_get_filename(next->file), next->line, (void*)(next + 1)).c_str());
-        }
-        leaks_size += next->size;
-        next = next->next;
-        leaks = 1;
+    if (size > ME_MEM_POOL_MAX) {
+        shard.large_allocs.fetch_add(1, std::memory_order_relaxed);
+        return ME_MALLOC_FUNC(size);
     }
 
-    if (leaks && detailed) {
-        METADOT_INFO("[Mem] Memory leaks detected (see above).");
-    } else if (leaks) {
-        double megabytes = static_cast<double>(leaks_size) / 1048576;
-        METADOT_INFO(std::format("[Mem] Memory leaks detected with {0} bytes equal to {1:.4f} MB.", leaks_size, megabytes).c_str());
-    } else {
-        METADOT_BUG("[Mem] No memory leaks detected.");
+    const size_t c = pool_class(size);
+    pool_thread_cache& cache = g_pool_cache;
+    if (pool_free_block* b = cache.free[c]) {
+        cache.free[c] = b->next;
+        return b;
     }
-    return leaks;
+    const size_t block = (c + 1) * ME_MEM_POOL_GRANULE;
+    if (cache.bump[c] && cache.bump[c] + block <= cache.bump_end[c]) {
+        void* p = cache.bump[c];
+        cache.bump[c] += block;
+        return p;
+    }
+    return pool_refill(c);
 }
 
-int ME_mem_bytes_inuse() {
-    ME_mem_alloc_alloc_info_t* head = ME_mem_alloc_alloc_head();
-    ME_mem_alloc_alloc_info_t* next = head->next;
-    int bytes = 0;
+void ME_mem_pool_free(void* ptr, size_t size) {
+    if (!ptr) return;
+    if (size == 0) size = 1;
+    counter_shard& shard = local_shard();
+    shard.pool_frees.fetch_add(1, std::memory_order_relaxed);
+    shard.pool_bytes.fetch_sub((i64)size, std::memory_order_relaxed);
 
-    while (next != head) {
-        bytes += (int)next->size;
-        next = next->next;
+    if (size > ME_MEM_POOL_MAX) {
+        ME_FREE_FUNC(ptr);
+        return;
     }
 
-    return bytes;
+    const size_t c = pool_class(size);
+    pool_free_block* b = (pool_free_block*)ptr;
+    b->next = g_pool_cache.free[c];
+    g_pool_cache.free[c] = b;
 }
 
-#else
+void* ME_mem_pool_realloc(void* ptr, size_t osize, size_t nsize) {
+    if (!ptr) return ME_mem_pool_alloc(nsize);
+    if (nsize == 0) {
+        ME_mem_pool_free(ptr, osize);
+        return nullptr;
+    }
 
-inline void* ME_mem_alloc_leak_check_alloc(size_t size, char* file, int line) { return ME_MALLOC_FUNC(size); }
+    // 两边都是大块时交给 realloc
+    if (osize > ME_MEM_POOL_MAX && nsize > ME_MEM_POOL_MAX) {
+        void* p = realloc(ptr, nsize);
+        if (p) local_shard().pool_bytes.fetch_add((i64)nsize - (i64)osize, std::memory_order_relaxed);
+        return p;
+    }
+    // 同一级内不用移动
+    if (osize <= ME_MEM_POOL_MAX && nsize <= ME_MEM_POOL_MAX && pool_class(osize ? osize : 1) == pool_class(nsize)) {
+        local_shard().pool_bytes.fetch_add((i64)nsize - (i64)osize, std::memory_order_relaxed);
+        return ptr;
+    }
 
-void* ME_mem_alloc_leak_check_calloc(size_t count, size_t element_size, char* file, int line) { return ME_CALLOC_FUNC(count, size); }
+    void* p = ME_mem_pool_alloc(nsize);
+    if (!p) return nullptr;
+    memcpy(p, ptr, osize < nsize ? osize : nsize);
+    ME_mem_pool_free(ptr, osize);
+    return p;
+}
 
-inline void ME_mem_alloc_leak_check_free(void* mem) { return ME_FREE_FUNC(mem); }
+ME_mem_pool_stats ME_mem_pool_get_stats() {
+    ME_mem_pool_stats s;
+    s.allocs = sum_shards([](counter_shard& c) { return c.pool_allocs.load(std::memory_order_relaxed); });
+    s.frees = sum_shards([](counter_shard& c) { return c.pool_frees.load(std::memory_order_relaxed); });
+    s.large_allocs = sum_shards([](counter_shard& c) { return c.large_allocs.load(std::memory_order_relaxed); });
+    // 块可以在别的线程释放 单个分片可能为负 只有总和有意义
+    const i64 inUse = (i64)sum_shards([](counter_shard& c) { return c.pool_bytes.load(std::memory_order_relaxed); });
+    s.bytes_in_use = inUse > 0 ? (u64)inUse : 0;
+    s.pool_reserved = g_pool_reserved.load(std::memory_order_relaxed);
+    return s;
+}
 
-inline int ME_CHECK_FOR_LEAKS() { return 0; }
-inline int ME_BYTES_IN_USE() { return 0; }
+namespace {
 
-#endif
+// ME_MALLOC 块前的头 大小是 16 字节的倍数 保持 malloc 的对齐
+struct alloc_header {
+    u64 size;
+    u32 sampled;  // 是否登记在抽样表中
+    u32 magic;
+};
+static_assert(sizeof(alloc_header) == ME_MEM_HEADER, "ME_MEM_HEADER must match alloc_header");
 
-#if defined(ME_LEAK_TEST)
+constexpr u32 ALLOC_MAGIC = 0x4d454d41;
 
-int const MY_SIZE = 1024 * 512;
+#if ME_MEM_LEAK_SAMPLE > 0
+struct sample_info {
+    const char* file;
+    int line;
+    size_t size;
+};
 
-static std::array<void*, MY_SIZE> myAlloc{
-        nullptr,
+// 抽样表本身用 std 的分配 不经过 ME_MALLOC 第一次使用时构造 静态初始化期间也可以用
+struct sample_table {
+    std::mutex lock;
+    std::unordered_map<void*, sample_info> live;
 };
 
-void* operator new(std::size_t sz) {
-    static int counter{};
-    void* ptr = std::malloc(sz);
-    myAlloc.at(counter++) = ptr;
-    // std::cout << "new." << counter << ".addr.: " << ptr << " size: " << sz << std::endl;
-    return ptr;
+sample_table& samples() {
+    static sample_table* t = new sample_table;
+    return *t;
 }
 
-void operator delete(void* ptr) noexcept {
-    auto ind = std::distance(myAlloc.begin(), std::find(myAlloc.begin(), myAlloc.end(), ptr));
-    myAlloc[ind] = nullptr;
-    std::free(ptr);
+// 每个线程各自倒数 起点错开 避免所有线程在同样的调用点上抽样
+thread_local u32 t_sample_countdown = 1 + (u32)(reinterpret_cast<uintptr_t>(&g_pool_cache) >> 6) % ME_MEM_LEAK_SAMPLE;
+#endif
+
+}  // namespace
+
+void* ME_mem_alloc(size_t size, const char* file, int line) {
+    if (size > SIZE_MAX - ME_MEM_HEADER) return nullptr;
+    alloc_header* h = (alloc_header*)ME_mem_pool_alloc(size + ME_MEM_HEADER);
+    if (!h) return nullptr;
+    h->size = size;
+    h->sampled = 0;
+    h->magic = ALLOC_MAGIC;
+    local_shard().allocated.fetch_add(size, std::memory_order_relaxed);
+
+#if ME_MEM_LEAK_SAMPLE > 0
+    if (--t_sample_countdown == 0) {
+        t_sample_countdown = ME_MEM_LEAK_SAMPLE;
+        h->sampled = 1;
+        sample_table& t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        t.live[h + 1] = {file, line, size};
+    }
+#else
+    (void)file;
+    (void)line;
+#endif
+    return h + 1;
 }
 
-void ME_get_memory_leak() {
+void* ME_mem_calloc(size_t count, size_t element_size, const char* file, int line) {
+    if (element_size && count > SIZE_MAX / element_size) return nullptr;
+    const size_t size = count * element_size;
+    void* mem = ME_mem_alloc(size, file, line);
+    if (mem) std::memset(mem, 0, size);
+    return mem;
+}
 
-    std::cout << std::endl;
-    std::cout << "Not deallocated: " << std::endl;
-    for (auto i : myAlloc) {
-        if (i != nullptr) std::cout << " " << i << std::endl;
+void ME_mem_free(void* mem) {
+    if (!mem) return;
+
+    alloc_header* h = (alloc_header*)mem - 1;
+    ME_ASSERT(h->magic == ALLOC_MAGIC && "ME_FREE on memory not allocated by ME_MALLOC");
+    h->magic = 0;
+    const size_t size = (size_t)h->size;
+    local_shard().freed.fetch_add(size, std::memory_order_relaxed);
+
+#if ME_MEM_LEAK_SAMPLE > 0
+    if (h->sampled) {
+        sample_table& t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        t.live.erase(mem);
     }
-    std::cout << std::endl;
+#endif
+    ME_mem_pool_free(h, size + ME_MEM_HEADER);
+}
+
+allocation_metrics ME_mem_get_metrics() {
+    allocation_metrics m;
+    m.total_allocated = sum_shards([](counter_shard& c) { return c.allocated.load(std::memory_order_relaxed); });
+    m.total_free = sum_shards([](counter_shard& c) { return c.freed.load(std::memory_order_relaxed); });
+    return m;
+}
+
+u64 ME_mem_current_usage_bytes() {
+    const allocation_metrics m = ME_mem_get_metrics();
+    return m.total_allocated > m.total_free ? m.total_allocated - m.total_free : 0;
+}
+
+f32 ME_mem_current_usage_mb() {
+    u64 bytes = ME_mem_current_usage_bytes();
+    return (f32)(bytes / 1048576.0f);
 }
 
+int ME_mem_bytes_inuse() { return (int)std::min<u64>(ME_mem_current_usage_bytes(), INT32_MAX); }
+
+int ME_mem_check_leaks(bool detailed) {
+    const u64 leaks_size = ME_mem_current_usage_bytes();
+    const int leaks = leaks_size > 0 ? 1 : 0;
+
+#if ME_MEM_LEAK_SAMPLE > 0
+    if (detailed) {
+        sample_table& t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        for (const auto& [ptr, info] : t.live) {
+            METADOT_WARN(std::format("[Mem] LEAKED {0} bytes from file \"{1}\" at line {2} from address {3} (sampled 1/{4}).", info.size, ME::ME_fs_get_filename(info.file), info.line, ptr,
+                                     ME_MEM_LEAK_SAMPLE)
+                                 .c_str());
+        }
+    }
 #endif
 
+    if (leaks) {
+        double megabytes = static_cast<double>(leaks_size) / 1048576;
+        METADOT_INFO(std::format("[Mem] Memory leaks detected with {0} bytes equal to {1:.4f} MB.", leaks_size, megabytes).c_str());
+    } else {
+        METADOT_BUG("[Mem] No memory leaks detected.");
+    }
+    return leaks;
+}
+
 void ME_mem_init(int argc, char* argv[]) {}
 
 void ME_mem_end() { ME_mem_check_leaks(false); }
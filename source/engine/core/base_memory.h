@@ -28,30 +28,34 @@ void ME_mem_alloc_frame_free(ME_mem_alloc_frame_t* frame);
 
 // define these to your own user definition as necessary
 
-#if 0
-
-#ifndef ME_MALLOC
-#define ME_MALLOC ME_MALLOC_FUNC
+// ME_MALLOC ME_CALLOC ME_FREE 默认走 ME_mem_alloc
+// 块前有 ME_MEM_HEADER 字节的头记录大小 整块从 ME_mem_pool 的线程缓存中分配 计数按线程分片 都不加锁
+// ME_MEM_LEAK_SAMPLE 大于 0 时每个线程每这么多次分配抽样登记一次来源 ME_mem_check_leaks(true) 列出仍未释放的抽样块
+// 调试构建默认 64 其余构建默认关闭
+#ifndef ME_MEM_LEAK_SAMPLE
+#if defined(_DEBUG)
+#define ME_MEM_LEAK_SAMPLE 64
+#else
+#define ME_MEM_LEAK_SAMPLE 0
 #endif
-
-#ifndef ME_FREE
-#define ME_FREE ME_FREE_FUNC
 #endif
 
-#else
+constexpr size_t ME_MEM_HEADER = 16;
+
+void* ME_mem_alloc(size_t size, const char* file, int line);
+void* ME_mem_calloc(size_t count, size_t element_size, const char* file, int line);
+void ME_mem_free(void* mem);
 
 #ifndef ME_MALLOC
-#define ME_MALLOC(size) ::ME::ME_mem_alloc_leak_check_alloc((size), (char*)__FILE__, __LINE__)
+#define ME_MALLOC(size) ::ME::ME_mem_alloc((size), __FILE__, __LINE__)
 #endif
 
 #ifndef ME_FREE
-#define ME_FREE(mem) ::ME::ME_mem_alloc_leak_check_free(mem)
+#define ME_FREE(mem) ::ME::ME_mem_free(mem)
 #endif
 
 #ifndef ME_CALLOC
-#define ME_CALLOC(count, element_size) ::ME::ME_mem_alloc_leak_check_calloc(count, element_size, (char*)__FILE__, __LINE__)
-#endif
-
+#define ME_CALLOC(count, element_size) ::ME::ME_mem_calloc((count), (element_size), __FILE__, __LINE__)
 #endif
 
 #ifndef ME_NEW
@@ -79,9 +83,6 @@ struct alloc {
     }
 #endif
 
-void* ME_mem_alloc_leak_check_alloc(size_t size, const char* file, int line, size_t* statistics = NULL);
-void* ME_mem_alloc_leak_check_calloc(size_t count, size_t element_size, const char* file, int line, size_t* statistics = NULL);
-void ME_mem_alloc_leak_check_free(void* mem, size_t* statistics = NULL);
 int ME_mem_check_leaks(bool detailed);
 int ME_mem_bytes_inuse();
 
@@ -90,11 +91,34 @@ typedef struct allocation_metrics {
     u64 total_free;
 } allocation_metrics;
 
-extern allocation_metrics g_allocation_metrics;
+// ME_MALLOC 分配和释放的累计字节数 各线程分片之和
+allocation_metrics ME_mem_get_metrics();
 
 u64 ME_mem_current_usage_bytes();
 f32 ME_mem_current_usage_mb();
 
+// 按大小分级的小块内存池
+// 不超过 ME_MEM_POOL_MAX 字节的分配按 ME_MEM_POOL_GRANULE 字节分级 从 ME_MEM_POOL_PAGE 大小的页中切分
+// 每个线程有自己的空闲链表 分配和释放不加锁 块可以在别的线程释放 之后归入释放线程的链表 统计按线程分片
+// 页只增不减 更大的分配直接走 malloc 释放时需要传入分配时的大小
+constexpr size_t ME_MEM_POOL_GRANULE = 16;
+constexpr size_t ME_MEM_POOL_MAX = 512;
+constexpr size_t ME_MEM_POOL_PAGE = 64 * 1024;
+
+void* ME_mem_pool_alloc(size_t size);
+void ME_mem_pool_free(void* ptr, size_t size);
+void* ME_mem_pool_realloc(void* ptr, size_t osize, size_t nsize);
+
+typedef struct ME_mem_pool_stats {
+    u64 allocs;
+    u64 frees;
+    u64 large_allocs;   // 超过 ME_MEM_POOL_MAX 的分配次数
+    u64 bytes_in_use;   // 调用者请求的字节数
+    u64 pool_reserved;  // 已申请的页
+} ME_mem_pool_stats;
+
+ME_mem_pool_stats ME_mem_pool_get_stats();
+
 void ME_mem_init(int argc, char* argv[]);
 void ME_mem_end();
 void ME_mem_rungc();
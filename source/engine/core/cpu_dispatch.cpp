@@ -0,0 +1,182 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "cpu_dispatch.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(ME_SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+namespace ME::cpu {
+
+namespace {
+
+#if defined(ME_SIMD_X86)
+void cpuid(u32 leaf, u32 sub, u32 r[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int out[4];
+    __cpuidex(out, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; i++) r[i] = (u32)out[i];
+#else
+    if (!__get_cpuid_count(leaf, sub, &r[0], &r[1], &r[2], &r[3])) r[0] = r[1] = r[2] = r[3] = 0;
+#endif
+}
+
+u64 xgetbv0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    u32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((u64)hi << 32) | lo;
+#endif
+}
+#endif
+
+cpu_features detect() {
+    cpu_features f;
+#if defined(ME_SIMD_X86)
+    u32 r[4];
+    cpuid(0, 0, r);
+    const u32 maxLeaf = r[0];
+    cpuid(1, 0, r);
+    f.sse2 = (r[3] >> 26) & 1;
+    f.sse41 = (r[2] >> 19) & 1;
+    const bool osxsave = (r[2] >> 27) & 1;
+    const bool avx = (r[2] >> 28) & 1;
+    const bool fma = (r[2] >> 12) & 1;
+    // The OS must save the YMM (and ZMM) state, otherwise the instructions fault even if the CPU has them
+    const u64 xcr0 = osxsave ? xgetbv0() : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, r);
+        f.avx2 = avx && ymm && ((r[1] >> 5) & 1);
+        f.avx512 = f.avx2 && zmm && ((r[1] >> 16) & 1) && ((r[1] >> 30) & 1) && ((r[1] >> 31) & 1);
+    }
+    f.fma = fma && ymm;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    f.neon = true;
+#elif defined(__arm__) && defined(__linux__)
+    // HWCAP_NEON
+    f.neon = (getauxval(AT_HWCAP) >> 12) & 1;
+#endif
+    return f;
+}
+
+const cpu_features &detected() {
+    static const cpu_features f = detect();
+    return f;
+}
+
+simd_level best_of(const cpu_features &f) {
+#if defined(ME_SIMD_X86)
+    if (f.avx512) return simd_level::avx512;
+    if (f.avx2) return simd_level::avx2;
+    if (f.sse2) return simd_level::sse2;
+#elif defined(ME_SIMD_NEON)
+    if (f.neon) return simd_level::neon;
+#endif
+    (void)f;
+    return simd_level::scalar;
+}
+
+std::atomic<u8> g_max{(u8)simd_level::avx512};
+std::atomic<u8> g_level{0xff};
+std::atomic<u32> g_generation{1};
+
+simd_level clamp(simd_level max) {
+    const simd_level b = best();
+    if (max == simd_level::scalar || b == simd_level::scalar) return simd_level::scalar;
+    // x86 levels mean nothing on ARM and the other way around, treat them as no cap
+    if (b == simd_level::neon || max == simd_level::neon) return b;
+    return (u8)max < (u8)b ? max : b;
+}
+
+}  // namespace
+
+const cpu_features &features() { return detected(); }
+
+simd_level best() {
+    static const simd_level b = best_of(detected());
+    return b;
+}
+
+simd_level level() {
+    u8 l = g_level.load(std::memory_order_relaxed);
+    if (l == 0xff) {
+        l = (u8)clamp((simd_level)g_max.load(std::memory_order_relaxed));
+        g_level.store(l, std::memory_order_relaxed);
+    }
+    return (simd_level)l;
+}
+
+simd_level set_max_level(simd_level max) {
+    g_max.store((u8)max, std::memory_order_relaxed);
+    const simd_level l = clamp(max);
+    if ((u8)l != g_level.exchange((u8)l, std::memory_order_relaxed)) g_generation.fetch_add(1, std::memory_order_release);
+    return l;
+}
+
+bool allows(simd_level l) {
+    if (l == simd_level::scalar) return true;
+    const simd_level cur = level();
+    if (cur == simd_level::neon || l == simd_level::neon) return cur == l;
+    return cur != simd_level::scalar && (u8)l <= (u8)cur;
+}
+
+u32 generation() { return g_generation.load(std::memory_order_acquire); }
+
+const char *name(simd_level l) {
+    switch (l) {
+        case simd_level::sse2:
+            return "sse2";
+        case simd_level::avx2:
+            return "avx2";
+        case simd_level::avx512:
+            return "avx512";
+        case simd_level::neon:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+bool parse(const char *text, simd_level &out) {
+    if (!strcmp(text, "best")) {
+        out = best();
+        return true;
+    }
+    for (u8 l = (u8)simd_level::scalar; l <= (u8)simd_level::neon; l++) {
+        if (!strcmp(text, name((simd_level)l))) {
+            out = (simd_level)l;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *describe() {
+    static char buf[128];
+    const cpu_features &f = detected();
+    snprintf(buf, sizeof(buf), "%s (%s%s%s%s%s%s)", name(level()), f.sse2 ? "sse2 " : "", f.sse41 ? "sse4.1 " : "", f.avx2 ? "avx2 " : "", f.fma ? "fma " : "", f.avx512 ? "avx512 " : "",
+             f.neon ? "neon " : "");
+    // Drop the trailing space
+    char *close = strrchr(buf, ')');
+    if (close && close > buf && close[-1] == ' ') {
+        close[-1] = ')';
+        close[0] = '\0';
+    }
+    return buf;
+}
+
+}  // namespace ME::cpu
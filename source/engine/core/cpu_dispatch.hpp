@@ -0,0 +1,106 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_CPU_DISPATCH_HPP
+#define ME_CPU_DISPATCH_HPP
+
+#include <atomic>
+
+#include "engine/core/core.hpp"
+
+// Kernels for wider instruction sets are compiled in every build with a per-function target
+// and picked at run time, so one binary runs on any x86-64 (SSE2 baseline) or ARM CPU.
+// ME_TARGET_AVX2 / ME_TARGET_AVX512 mark such functions. Lambdas do not inherit the target,
+// so intrinsics of the wider sets may only appear directly in the marked function body.
+#if defined(__x86_64__) || defined(_M_X64)
+#define ME_SIMD_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ME_TARGET_AVX2
+#define ME_TARGET_AVX512
+#else
+#define ME_TARGET_AVX2 __attribute__((target("avx2")))
+#define ME_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw,avx512vl")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+// NEON kernels need the compiler to target NEON (always true on AArch64)
+#define ME_SIMD_NEON 1
+#endif
+
+namespace ME {
+
+// Instruction set a kernel variant is written for. sse2 < avx2 < avx512 on x86, neon on ARM.
+enum class simd_level : u8 { scalar = 0, sse2, avx2, avx512, neon };
+
+struct cpu_features {
+    bool sse2 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+    bool fma = false;
+    // F, BW and VL, with the OS saving the ZMM state
+    bool avx512 = false;
+    bool neon = false;
+};
+
+namespace cpu {
+
+// Detected once on first use (cpuid / xgetbv on x86, HWCAP on 32-bit ARM)
+const cpu_features &features();
+
+// Highest level that is both compiled in and supported by this CPU
+simd_level best();
+
+// Level the kernels dispatch on: best() capped by set_max_level()
+simd_level level();
+
+// Caps the dispatch level, scalar forces every kernel onto its scalar path to validate the vector ones.
+// Levels above best() are clamped. Returns the resulting level(). Safe to call while kernels run:
+// a kernel may finish its current call on the previous variant.
+simd_level set_max_level(simd_level max);
+
+// True if kernels written for l may run: l is scalar, or on the same family and not above level()
+bool allows(simd_level l);
+
+// Changes whenever set_max_level() changes level(), simd_kernel uses it to refresh its cached pointer
+u32 generation();
+
+const char *name(simd_level l);
+// Accepts the names returned by name(); "best" selects best()
+bool parse(const char *text, simd_level &out);
+
+// "avx2 (sse2 sse4.1 avx2 fma)" style summary for the log
+const char *describe();
+
+}  // namespace cpu
+
+// A kernel with one function per instruction set.
+// select(level) returns the variant to use for that level, falling back to narrower ones
+// for levels it was not written for. The chosen pointer is cached until cpu::set_max_level() changes the level.
+//
+//   static row_fn select_row(simd_level l) { switch (l) { case simd_level::avx2: return row_avx2; ... default: return row_scalar; } }
+//   static simd_kernel<row_fn> Row{select_row};
+//   Row.get()(src, dst, n);
+template <typename Fn>
+class simd_kernel {
+public:
+    using select_fn = Fn (*)(simd_level);
+
+    explicit simd_kernel(select_fn select) : select(select) {}
+
+    Fn get() {
+        const u32 gen = cpu::generation();
+        if (cachedGen.load(std::memory_order_acquire) != gen) {
+            fn.store(select(cpu::level()), std::memory_order_relaxed);
+            cachedGen.store(gen, std::memory_order_release);
+        }
+        return fn.load(std::memory_order_relaxed);
+    }
+
+private:
+    select_fn select;
+    std::atomic<Fn> fn{nullptr};
+    // 0 is never a generation, the first get() always selects
+    std::atomic<u32> cachedGen{0};
+};
+
+}  // namespace ME
+
+#endif
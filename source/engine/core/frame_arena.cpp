@@ -0,0 +1,146 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+namespace ME {
+
+static std::atomic<uint64_t> g_frame_epoch{1};
+static std::atomic<size_t> g_frame_reserved{0};
+
+frame_arena::~frame_arena() {
+    for (block &b : blocks) {
+        g_frame_reserved.fetch_sub(b.size, std::memory_order_relaxed);
+        std::free(b.data);
+    }
+}
+
+frame_arena &frame_arena::local() {
+    thread_local frame_arena arena;
+    return arena;
+}
+
+void frame_arena::next_frame() { g_frame_epoch.fetch_add(1, std::memory_order_relaxed); }
+
+size_t frame_arena::total_reserved() { return g_frame_reserved.load(std::memory_order_relaxed); }
+
+frame_arena::scope::scope() : arena(frame_arena::local()) {
+    arena.begin_use();
+    mark = arena.get_marker();
+    arena.depth++;
+}
+
+frame_arena::scope::~scope() {
+    assert(arena.depth > 0);
+    arena.depth--;
+    arena.rewind(mark);
+}
+
+void frame_arena::begin_use() {
+    if (depth > 0) return;
+    const uint64_t now = g_frame_epoch.load(std::memory_order_relaxed);
+    if (epoch == now) return;
+    epoch = now;
+    reset();
+}
+
+void frame_arena::reset() {
+    // The last frame needed more than one block: replace them with a single block of the total size
+    if (blocks.size() > 1) {
+        size_t total = 0;
+        for (block &b : blocks) {
+            total += b.size;
+            std::free(b.data);
+        }
+        char *data = static_cast<char *>(std::malloc(total));
+        if (!data) {
+            g_frame_reserved.fetch_sub(total, std::memory_order_relaxed);
+            blocks.clear();
+        } else {
+            blocks.assign(1, block{data, total});
+        }
+    }
+    current = 0;
+    offset = 0;
+    last = nullptr;
+}
+
+static size_t align_offset(const char *base, size_t offset, size_t align) {
+    const uintptr_t p = reinterpret_cast<uintptr_t>(base) + offset;
+    return offset + ((align - (p & (align - 1))) & (align - 1));
+}
+
+void *frame_arena::alloc(size_t size, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+    begin_use();
+    if (size == 0) size = 1;
+
+    if (!blocks.empty()) {
+        block &b = blocks[current];
+        const size_t start = align_offset(b.data, offset, align);
+        if (start + size <= b.size) {
+            offset = start + size;
+            last = b.data + start;
+            return last;
+        }
+    }
+    return grow(size, align);
+}
+
+char *frame_arena::grow(size_t size, size_t align) {
+    // Blocks after the current one are free (left over from a rewind), use the first that fits
+    const size_t first = blocks.empty() ? 0 : current + 1;
+    for (size_t i = first; i < blocks.size(); i++) {
+        const size_t start = align_offset(blocks[i].data, 0, align);
+        if (start + size > blocks[i].size) continue;
+        // Keep the skipped blocks behind the one we take so a rewind can still reach them
+        std::rotate(blocks.begin() + first, blocks.begin() + i, blocks.begin() + i + 1);
+        current = first;
+        offset = start + size;
+        last = blocks[current].data + start;
+        return last;
+    }
+
+    const size_t bytes = std::max(BLOCK_SIZE, size + align);
+    char *data = static_cast<char *>(std::malloc(bytes));
+    if (!data) throw std::bad_alloc();
+    g_frame_reserved.fetch_add(bytes, std::memory_order_relaxed);
+    blocks.insert(blocks.begin() + first, block{data, bytes});
+
+    current = first;
+    const size_t start = align_offset(data, 0, align);
+    offset = start + size;
+    last = data + start;
+    return last;
+}
+
+void frame_arena::free_last(void *p, size_t size) {
+    if (!p || p != last || blocks.empty()) return;
+    block &b = blocks[current];
+    if (last + std::max<size_t>(size, 1) != b.data + offset) return;
+    offset = static_cast<size_t>(last - b.data);
+    last = nullptr;
+}
+
+void frame_arena::rewind(const marker &m) {
+    current = m.block;
+    offset = m.offset;
+    last = nullptr;
+}
+
+size_t frame_arena::used() const {
+    size_t total = offset;
+    for (size_t i = 0; i < current && i < blocks.size(); i++) total += blocks[i].size;
+    return total;
+}
+
+size_t frame_arena::reserved() const {
+    size_t total = 0;
+    for (const block &b : blocks) total += b.size;
+    return total;
+}
+
+}  // namespace ME
@@ -0,0 +1,120 @@
+#ifndef ME_FRAME_ARENA_HPP
+#define ME_FRAME_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ME {
+
+// Per-thread linear arena for memory that does not outlive the frame
+// (scratch arrays of a tick or a render pass). Allocation bumps a pointer, nothing is freed one by one.
+// Every thread (job workers, the main thread, loader threads) has its own arena, so there is no locking.
+//
+// A frame_arena::scope rewinds the arena to where it was when the scope was opened; scopes nest like a stack.
+// Memory taken outside of any scope lives until the next frame: engine::update_post calls next_frame(),
+// and each thread resets its arena the next time it allocates or opens a scope with no scope open.
+//
+// Memory is only valid on the thread that owns the arena, until one of the points above.
+// Never hand it to a job that may still be running after the scope or the frame ends.
+class frame_arena {
+public:
+    static constexpr size_t BLOCK_SIZE = 256 * 1024;
+
+    struct marker {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+
+    // Rewinds the arena of the calling thread on destruction
+    class scope {
+    public:
+        scope();
+        ~scope();
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+    private:
+        frame_arena &arena;
+        marker mark;
+    };
+
+    frame_arena() = default;
+    ~frame_arena();
+    frame_arena(const frame_arena &) = delete;
+    frame_arena &operator=(const frame_arena &) = delete;
+
+    // Arena of the calling thread
+    static frame_arena &local();
+
+    // Start a new frame. Called once per frame on the main thread.
+    static void next_frame();
+
+    // Bytes reserved by the arenas of all threads
+    static size_t total_reserved();
+
+    void *alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+    template <typename T>
+    T *alloc_array(size_t count) {
+        return static_cast<T *>(alloc(count * sizeof(T), alignof(T)));
+    }
+
+    // Give back p if it is the most recent allocation, otherwise nothing happens.
+    // Scratch buffers freed in reverse order of allocation are reused before the scope ends.
+    void free_last(void *p, size_t size);
+
+    marker get_marker() const { return {current, offset}; }
+    void rewind(const marker &m);
+
+    size_t used() const;
+    size_t reserved() const;
+
+private:
+    struct block {
+        char *data;
+        size_t size;
+    };
+
+    void reset();
+    void begin_use();
+    char *grow(size_t size, size_t align);
+
+    std::vector<block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    char *last = nullptr;  // start of the most recent allocation
+    uint32_t depth = 0;    // open scopes
+    uint64_t epoch = 0;
+};
+
+// STL allocator on the calling thread's frame_arena
+// All instances compare equal. deallocate only gives memory back when it is the arena's last allocation.
+template <typename T>
+struct frame_allocator {
+    using value_type = T;
+
+    frame_allocator() noexcept = default;
+    template <typename U>
+    frame_allocator(const frame_allocator<U> &) noexcept {}
+
+    T *allocate(size_t n) { return frame_arena::local().alloc_array<T>(n); }
+    void deallocate(T *p, size_t n) noexcept { frame_arena::local().free_last(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const frame_allocator<U> &) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const frame_allocator<U> &) const noexcept {
+        return false;
+    }
+};
+
+template <typename T>
+using frame_vector = std::vector<T, frame_allocator<T>>;
+
+}  // namespace ME
+
+#endif
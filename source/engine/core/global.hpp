@@ -27,6 +27,8 @@ struct I18N {
     void Init();
     void Load(std::string lang);
     std::string Get(std::string text);
+    // 当前语言的所有译文连在一起 用来预先缓存字形
+    std::string Strings();
 };
 
 struct Global {
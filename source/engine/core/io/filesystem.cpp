@@ -6,15 +6,46 @@
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <deque>
 #include <fstream>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include "engine/core/base_memory.h"
 #include "engine/core/core.hpp"
 #include "engine/core/platform.h"
 #include "engine/engine.hpp"
 
+#if !defined(ME_PLATFORM_WINDOWS)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace ME {
 
+namespace {
+
+struct path_hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+// ME_fs_resolve 的驻留表 strings 只增不减 元素的地址不变
+struct path_table {
+    std::shared_mutex lock;
+    std::deque<std::string> strings;
+    std::unordered_map<std::string, const char *, path_hash, std::equal_to<>> resolved;
+};
+
+path_table &g_paths() {
+    static path_table table;
+    return table;
+}
+
+}  // namespace
+
 bool ME_fs_init() {
 
     auto currentDir = std::filesystem::path(std::filesystem::current_path());
@@ -25,7 +56,12 @@ bool ME_fs_init() {
 
     for (int i = 0; i < 3; ++i) {
         if (std::filesystem::exists(currentDir / "Data")) {
-            the<engine>().eng()->gamepath = ME_fs_normalize_path_s(currentDir.string()).c_str();
+            {
+                // 之前解析的路径基于旧的 gamepath
+                std::unique_lock guard(g_paths().lock);
+                the<engine>().eng()->gamepath = ME_fs_normalize_path_s(currentDir.string()).c_str();
+                g_paths().resolved.clear();
+            }
             METADOT_INFO(std::format("Game data path detected: {0} (Base: {1})", the<engine>().eng()->gamepath, std::filesystem::current_path().string().c_str()).c_str());
             return METADOT_OK;
         }
@@ -36,17 +72,29 @@ bool ME_fs_init() {
     return METADOT_FAILED;
 }
 
-std::string ME_fs_get_path(std::string path) {
-    if (the<engine>().eng()->gamepath.empty()) {
-        ME_ASSERT(the<engine>().eng()->gamepath.empty(), "gamepath not detected");
-        return {path};
-    } else {
-        std::string get_path{the<engine>().eng()->gamepath};
-        get_path.append(path);
-        return get_path;
+const char *ME_fs_resolve(std::string_view path) {
+    path_table &table = g_paths();
+    {
+        std::shared_lock guard(table.lock);
+        auto it = table.resolved.find(path);
+        if (it != table.resolved.end()) return it->second;
     }
+
+    std::unique_lock guard(table.lock);
+    auto it = table.resolved.find(path);
+    if (it != table.resolved.end()) return it->second;
+
+    // ME_fs_init 之前 gamepath 为空 原样返回 path
+    const std::string &gamepath = the<engine>().eng()->gamepath;
+    std::string &get_path = table.strings.emplace_back();
+    get_path.reserve(gamepath.size() + path.size());
+    get_path.append(gamepath);
+    get_path.append(path);
+    return table.resolved.emplace(std::string(path), get_path.c_str()).first->second;
 }
 
+std::string ME_fs_get_path(std::string_view path) { return ME_fs_resolve(path); }
+
 #define ME_FILE_SYSTEM_BUFFERED_IO_SIZE (2 * ME_MB)
 
 std::vector<char> ME_fs_read_file_to_vec(const char *path, size_t &size) {
@@ -146,15 +194,121 @@ std::string ME_fs_normalize_path(const std::string &messyPath) {
 }
 
 std::string ME_fs_readfile(const std::string &filename) {
-    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    std::string data;
+    ME_fs_read(filename.c_str(), data);
+    return data;
+}
+
+bool ME_fs_read(const char *path, std::string &out) {
+    out.clear();
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+
+    bool ok = fseek(fp, 0L, SEEK_END) == 0;
+    const long size = ok ? ftell(fp) : -1;
+    ok = size >= 0 && fseek(fp, 0L, SEEK_SET) == 0;
+    if (ok && size > 0) {
+        out.resize((size_t)size);
+        ok = fread(out.data(), 1, (size_t)size, fp) == (size_t)size;
+    }
+    fclose(fp);
+    if (!ok) out.clear();
+    return ok;
+}
+
+bool ME_fs_write_file_atomic(const std::string &path, const char *data, size_t size) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(data, size);
+        if (!file) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+    return !ec;
+}
+
+bool ME_fs_map_file(const char *path, ME_fs_mapped_file &out) {
+    out = {};
+#if defined(ME_PLATFORM_WINDOWS)
+    // 允许其他句柄同时写入 区域文件在映射期间仍会被追加
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return false;
 
-    std::ifstream::pos_type fileSize = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
+    out.data = (const char *)view;
+    out.size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
 
-    std::vector<char> bytes(fileSize);
-    ifs.read(bytes.data(), fileSize);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+
+    out.data = (const char *)view;
+    out.size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void ME_fs_unmap_file(ME_fs_mapped_file &file) {
+    if (file.data) {
+#if defined(ME_PLATFORM_WINDOWS)
+        UnmapViewOfFile(file.data);
+#else
+        munmap((void *)file.data, file.size);
+#endif
+    }
+    file = {};
+}
+
+void ME_fs_read_async(job_counter &counter, std::string path, std::function<void(ME_fs_read_result &)> done) {
+    job::execute_background(counter, [path = std::move(path), done = std::move(done)]() mutable {
+        ME_fs_read_result result;
+        result.ok = ME_fs_read(path.c_str(), result.data);
+        result.path = std::move(path);
+        if (done) done(result);
+    });
+}
 
-    return std::string(bytes.data(), fileSize);
+job_future<ME_fs_read_result> ME_fs_read_async(std::string path) {
+    return job::async(
+            [path = std::move(path)]() mutable {
+                ME_fs_read_result result;
+                result.ok = ME_fs_read(path.c_str(), result.data);
+                result.path = std::move(path);
+                return result;
+            },
+            nullptr, job_class::io);
 }
 
-}  // namespace ME
\ No newline at end of file
+}  // namespace ME
@@ -6,9 +6,12 @@
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <string>
 #include <string_view>
 
 #include "engine/core/core.hpp"
+#include "engine/core/job.h"
 #include "engine/core/macros.hpp"
 #include "engine/core/platform.h"
 
@@ -17,12 +20,15 @@
 //                    ("%s", std::format("FILE: {0} does not exist", stringPath)))
 
 #define FUTIL_ASSERT_EXIST(stringPath)
-#define METADOT_RESLOC(x) ::ME::ME_fs_get_path(x).c_str()
+#define METADOT_RESLOC(x) ::ME::ME_fs_resolve(x)
 
 namespace ME {
 
 bool ME_fs_init();
-std::string ME_fs_get_path(std::string path);
+// gamepath + path 的结果按 path 驻留在全局表中 同一个 path 第二次起只查一次哈希表 不再分配
+// 返回的指针一直有效 (ME_fs_init 重新设置 gamepath 之后旧的指针仍然可读 只是不再返回) 可以在 job 线程上调用
+const char* ME_fs_resolve(std::string_view path);
+std::string ME_fs_get_path(std::string_view path);
 std::vector<char> ME_fs_read_file_to_vec(const char* path, size_t& size);
 std::string ME_fs_normalize_path_s(const std::string& path, char delimiter = '/');
 
@@ -51,6 +57,33 @@ std::string ME_fs_normalize_path(const std::string& messyPath);
 bool ME_fs_directory_exists(const std::filesystem::path& path, std::filesystem::file_status status = std::filesystem::file_status{});
 void ME_fs_create_directory(const std::string& directory_name);
 std::string ME_fs_readfile(const std::string& filename);
+// 一次分配读入整个文件 文件不存在或读取失败时返回 false 并清空 out
+bool ME_fs_read(const char* path, std::string& out);
+// 先写 path.tmp 再改名替换 中途失败时原文件不变
+bool ME_fs_write_file_atomic(const std::string& path, const char* data, size_t size);
+
+// 只读内存映射 映射建立后文件句柄即关闭 空文件映射成功但 data 为 nullptr
+struct ME_fs_mapped_file {
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+bool ME_fs_map_file(const char* path, ME_fs_mapped_file& out);
+void ME_fs_unmap_file(ME_fs_mapped_file& file);
+
+// 异步读取的结果 ok 为 false 时 data 为空
+struct ME_fs_read_result {
+    std::string path;
+    std::string data;
+    bool ok = false;
+};
+
+// 在 job 的后台线程上 (execute_background) 读取整个文件 读完后在同一个线程上调用 done
+// done 返回后 counter 才发出信号 主线程用 job::wait(counter) 等待或每帧检查 counter.done()
+// done 可以再次调用 ME_fs_read_async 或 job::execute 把解析之类的工作继续留在 job 线程上
+void ME_fs_read_async(job_counter& counter, std::string path, std::function<void(ME_fs_read_result&)> done);
+// 结果留在 future 中 可以作为 job::execute_after / job::async 的依赖
+job_future<ME_fs_read_result> ME_fs_read_async(std::string path);
 
 }  // namespace ME
 
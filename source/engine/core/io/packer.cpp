@@ -1,94 +1,202 @@
 
 #include "packer.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
 
 #include "engine/core/core.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/core/job.h"
 #include "engine/core/platform.h"
 #include "engine/utils/utility.hpp"
 #include "libs/lz4/lz4.h"
 
 namespace ME {
 
-typedef struct pack_item {
-    pack_iteminfo info;
-    char *path;
-} pack_item;
+// 0.1 起的格式 头部之后是 itemCount 和索引的偏移 索引放在所有条目之后
+//     u64 slotCount (2 的幂 至少是条目数的两倍)
+//     pack_index_entry entries[itemCount] (与条目的顺序相同 按路径排序)
+//     u32 slots[slotCount] (条目下标 + 1 0 为空 线性探测)
+//     char paths[] (以 0 结尾)
+// 条目本身 (pack_iteminfo 路径 数据) 与 0.0 相同 ME_unpack_files 和旧的读取方式不受影响
+#define PACK_LEGACY_VERSION_MINOR 0
+#define PACK_INDEX_OFFSET_POSITION (PACK_HEADER_SIZE + sizeof(u64))
+
+typedef struct pack_index_entry {
+    u64 hash;
+    u64 dataOffset;
+    u32 zipSize;
+    u32 dataSize;
+    u32 pathOffset;
+    u32 pathSize;
+} pack_index_entry;
+
+static_assert(sizeof(pack_index_entry) == 32, "pack_index_entry is part of the file format");
 
 struct ME_packreader_t {
-    FILE *file;
+    ME_fs_mapped_file file;
     u64 itemCount;
-    pack_item *items;
+    const pack_index_entry *entries;
+    const u32 *slots;
+    u64 slotMask;
+    const char *paths;
+    void *ownedIndex;  // 旧格式的包在打开时建立的索引
     u8 *dataBuffer;
-    u8 *zipBuffer;
     u32 dataSize;
-    u32 zipSize;
-    pack_item searchItem;
 };
 
-ME_PRIVATE(void) destroy_pack_items(u64 itemCount, pack_item *items) {
-    ME_ASSERT(itemCount == 0 || (itemCount > 0 && items));
+// FNV-1a 写在包里 换算法要升级版本
+ME_PRIVATE(u64) pack_path_hash(const char *path, size_t size) {
+    u64 hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (u8)path[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
-    for (u64 i = 0; i < itemCount; i++) free(items[i].path);
-    free(items);
+ME_PRIVATE(u64) pack_slot_count(u64 itemCount) {
+    u64 slotCount = 1;
+    while (slotCount < itemCount * 2) slotCount <<= 1;
+    return slotCount;
 }
 
-ME_PRIVATE(ME_pack_result) create_pack_items(FILE *packFile, u64 itemCount, pack_item **_items) {
-    ME_ASSERT(packFile);
-    ME_ASSERT(itemCount > 0);
-    ME_ASSERT(_items);
+ME_PRIVATE(void) pack_fill_slots(const pack_index_entry *entries, u64 itemCount, u32 *slots, u64 slotCount) {
+    memset(slots, 0, slotCount * sizeof(u32));
+    const u64 mask = slotCount - 1;
+    for (u64 i = 0; i < itemCount; i++) {
+        u64 slot = entries[i].hash & mask;
+        while (slots[slot]) slot = (slot + 1) & mask;
+        slots[slot] = (u32)(i + 1);
+    }
+}
 
-    pack_item *items = (pack_item *)malloc(itemCount * sizeof(pack_item));
+// 0.0 的包没有索引 顺着映射走一遍条目在内存里建立
+ME_PRIVATE(ME_pack_result) build_legacy_pack_index(ME_pack_reader pack) {
+    const u8 *base = (const u8 *)pack->file.data;
+    const u64 fileSize = pack->file.size;
+    const u64 itemCount = pack->itemCount;
 
-    if (!items) return FAILED_TO_ALLOCATE_PACK_RESULT;
+    u64 pathsSize = 0;
+    u64 offset = PACK_INDEX_OFFSET_POSITION;
 
     for (u64 i = 0; i < itemCount; i++) {
         pack_iteminfo info;
 
-        size_t result = fread(&info, sizeof(pack_iteminfo), 1, packFile);
+        if (fileSize - offset < sizeof(pack_iteminfo)) return FAILED_TO_READ_FILE_PACK_RESULT;
+        memcpy(&info, base + offset, sizeof(pack_iteminfo));
 
-        if (result != 1) {
-            destroy_pack_items(i, items);
-            return FAILED_TO_READ_FILE_PACK_RESULT;
-        }
+        if (info.dataSize == 0 || info.pathSize == 0) return BAD_DATA_SIZE_PACK_RESULT;
 
-        if (info.dataSize == 0 || info.pathSize == 0) {
-            destroy_pack_items(i, items);
-            return BAD_DATA_SIZE_PACK_RESULT;
-        }
+        const u64 itemSize = sizeof(pack_iteminfo) + info.pathSize + (info.zipSize > 0 ? info.zipSize : info.dataSize);
 
-        char *path = (char *)malloc((info.pathSize + 1) * sizeof(char));
+        if (fileSize - offset < itemSize) return FAILED_TO_READ_FILE_PACK_RESULT;
 
-        if (!path) {
-            destroy_pack_items(i, items);
-            return FAILED_TO_ALLOCATE_PACK_RESULT;
-        }
+        offset += itemSize;
+        pathsSize += info.pathSize + 1;
+    }
 
-        result = fread(path, sizeof(char), info.pathSize, packFile);
+    const u64 slotCount = pack_slot_count(itemCount);
+    const u64 indexSize = itemCount * sizeof(pack_index_entry) + slotCount * sizeof(u32) + pathsSize;
 
-        path[info.pathSize] = 0;
+    if (pathsSize > UINT32_MAX) return BAD_DATA_SIZE_PACK_RESULT;
 
-        if (result != info.pathSize) {
-            destroy_pack_items(i, items);
-            return FAILED_TO_READ_FILE_PACK_RESULT;
-        }
+    u8 *index = (u8 *)malloc(indexSize);
 
-        int64_t fileOffset = info.zipSize > 0 ? info.zipSize : info.dataSize;
+    if (!index) return FAILED_TO_ALLOCATE_PACK_RESULT;
 
-        int seekResult = seekFile(packFile, fileOffset, SEEK_CUR);
+    pack_index_entry *entries = (pack_index_entry *)index;
+    u32 *slots = (u32 *)(index + itemCount * sizeof(pack_index_entry));
+    char *paths = (char *)(slots + slotCount);
 
-        if (seekResult != 0) {
-            destroy_pack_items(i, items);
-            return FAILED_TO_SEEK_FILE_PACK_RESULT;
-        }
+    u32 pathOffset = 0;
+    offset = PACK_INDEX_OFFSET_POSITION;
 
-        pack_item *item = &items[i];
-        item->info = info;
-        item->path = path;
+    for (u64 i = 0; i < itemCount; i++) {
+        pack_iteminfo info;
+        memcpy(&info, base + offset, sizeof(pack_iteminfo));
+
+        const char *path = (const char *)base + offset + sizeof(pack_iteminfo);
+        memcpy(paths + pathOffset, path, info.pathSize);
+        paths[pathOffset + info.pathSize] = 0;
+
+        pack_index_entry *entry = &entries[i];
+        entry->hash = pack_path_hash(path, info.pathSize);
+        entry->dataOffset = offset + sizeof(pack_iteminfo) + info.pathSize;
+        entry->zipSize = info.zipSize;
+        entry->dataSize = info.dataSize;
+        entry->pathOffset = pathOffset;
+        entry->pathSize = info.pathSize;
+
+        offset = entry->dataOffset + (info.zipSize > 0 ? info.zipSize : info.dataSize);
+        pathOffset += info.pathSize + 1;
     }
 
-    *_items = items;
+    pack_fill_slots(entries, itemCount, slots, slotCount);
+
+    pack->ownedIndex = index;
+    pack->entries = entries;
+    pack->slots = slots;
+    pack->slotMask = slotCount - 1;
+    pack->paths = paths;
+    return SUCCESS_PACK_RESULT;
+}
+
+// 包里的索引直接指向映射 只检查偏移都在文件内 不复制
+ME_PRIVATE(ME_pack_result) map_pack_index(ME_pack_reader pack) {
+    const u8 *base = (const u8 *)pack->file.data;
+    const u64 fileSize = pack->file.size;
+    const u64 itemCount = pack->itemCount;
+
+    if (fileSize < PACK_INDEX_OFFSET_POSITION + sizeof(u64)) return FAILED_TO_READ_FILE_PACK_RESULT;
+
+    u64 indexOffset;
+    memcpy(&indexOffset, base + PACK_INDEX_OFFSET_POSITION, sizeof(u64));
+
+    if (indexOffset % sizeof(u64) != 0 || indexOffset < PACK_INDEX_OFFSET_POSITION + sizeof(u64) || indexOffset > fileSize - sizeof(u64)) return BAD_DATA_SIZE_PACK_RESULT;
+
+    u64 slotCount;
+    memcpy(&slotCount, base + indexOffset, sizeof(u64));
+
+    if (slotCount <= itemCount || (slotCount & (slotCount - 1)) != 0) return BAD_DATA_SIZE_PACK_RESULT;
+
+    const u64 entriesOffset = indexOffset + sizeof(u64);
+    const u64 available = fileSize - entriesOffset;
+
+    if (available / sizeof(pack_index_entry) < itemCount) return FAILED_TO_READ_FILE_PACK_RESULT;
+
+    const u64 slotsOffset = entriesOffset + itemCount * sizeof(pack_index_entry);
+
+    if ((fileSize - slotsOffset) / sizeof(u32) < slotCount) return FAILED_TO_READ_FILE_PACK_RESULT;
+
+    const u64 pathsOffset = slotsOffset + slotCount * sizeof(u32);
+    const u64 pathsSize = fileSize - pathsOffset;
+
+    const pack_index_entry *entries = (const pack_index_entry *)(base + entriesOffset);
+    const u32 *slots = (const u32 *)(base + slotsOffset);
+    const char *paths = (const char *)(base + pathsOffset);
+
+    for (u64 i = 0; i < itemCount; i++) {
+        const pack_index_entry *entry = &entries[i];
+        const u64 storedSize = entry->zipSize > 0 ? entry->zipSize : entry->dataSize;
+
+        if (entry->dataSize == 0 || entry->pathSize == 0 || entry->pathSize > UINT8_MAX) return BAD_DATA_SIZE_PACK_RESULT;
+        if (entry->dataOffset > indexOffset || indexOffset - entry->dataOffset < storedSize) return BAD_DATA_SIZE_PACK_RESULT;
+        if ((u64)entry->pathOffset + entry->pathSize >= pathsSize || paths[entry->pathOffset + entry->pathSize] != 0) return BAD_DATA_SIZE_PACK_RESULT;
+    }
+
+    for (u64 i = 0; i < slotCount; i++) {
+        if (slots[i] > itemCount) return BAD_DATA_SIZE_PACK_RESULT;
+    }
+
+    pack->entries = entries;
+    pack->slots = slots;
+    pack->slotMask = slotCount - 1;
+    pack->paths = paths;
     return SUCCESS_PACK_RESULT;
 }
 
@@ -100,27 +208,14 @@ ME_pack_result ME_create_file_pack_reader(const char *filePath, u32 dataBufferCa
 
     if (!pack) return FAILED_TO_ALLOCATE_PACK_RESULT;
 
-    pack->zipBuffer = NULL;
-    pack->zipSize = 0;
-
-    char *path;
-
-    path = (char *)filePath;
-
-    FILE *file = openFile(path, "rb");
-
-    if (!file) {
+    if (!ME_fs_map_file(filePath, pack->file)) {
         ME_destroy_pack_reader(pack);
         return FAILED_TO_OPEN_FILE_PACK_RESULT;
     }
 
-    pack->file = file;
+    const char *header = pack->file.data;
 
-    char header[PACK_HEADER_SIZE];
-
-    size_t result = fread(header, sizeof(char), PACK_HEADER_SIZE, file);
-
-    if (result != PACK_HEADER_SIZE) {
+    if (!header || pack->file.size < PACK_INDEX_OFFSET_POSITION) {
         ME_destroy_pack_reader(pack);
         return FAILED_TO_READ_FILE_PACK_RESULT;
     }
@@ -130,7 +225,7 @@ ME_pack_result ME_create_file_pack_reader(const char *filePath, u32 dataBufferCa
         return BAD_FILE_TYPE_PACK_RESULT;
     }
 
-    if (header[4] != PACK_VERSION_MAJOR || header[5] != PACK_VERSION_MINOR) {
+    if (header[4] != PACK_VERSION_MAJOR || (header[5] != PACK_VERSION_MINOR && header[5] != PACK_LEGACY_VERSION_MINOR)) {
         ME_destroy_pack_reader(pack);
         return BAD_FILE_VERSION_PACK_RESULT;
     }
@@ -143,32 +238,23 @@ ME_pack_result ME_create_file_pack_reader(const char *filePath, u32 dataBufferCa
     }
 
     u64 itemCount;
+    memcpy(&itemCount, header + PACK_HEADER_SIZE, sizeof(u64));
 
-    result = fread(&itemCount, sizeof(u64), 1, file);
-
-    if (result != 1) {
-        ME_destroy_pack_reader(pack);
-        return FAILED_TO_READ_FILE_PACK_RESULT;
-    }
-
-    if (itemCount == 0) {
+    // 槽位存的是 u32 下标
+    if (itemCount == 0 || itemCount >= UINT32_MAX) {
         ME_destroy_pack_reader(pack);
         return BAD_DATA_SIZE_PACK_RESULT;
     }
 
-    pack_item *items;
+    pack->itemCount = itemCount;
 
-    ME_pack_result packResult = create_pack_items(file, itemCount, &items);
+    ME_pack_result packResult = header[5] == PACK_LEGACY_VERSION_MINOR ? build_legacy_pack_index(pack) : map_pack_index(pack);
 
     if (packResult != SUCCESS_PACK_RESULT) {
         ME_destroy_pack_reader(pack);
-        ;
         return packResult;
     }
 
-    pack->itemCount = itemCount;
-    pack->items = items;
-
     u8 *dataBuffer;
 
     if (dataBufferCapacity > 0) {
@@ -192,9 +278,8 @@ void ME_destroy_pack_reader(ME_pack_reader pack_reader) {
     if (!pack_reader) return;
 
     free(pack_reader->dataBuffer);
-    free(pack_reader->zipBuffer);
-    destroy_pack_items(pack_reader->itemCount, pack_reader->items);
-    if (pack_reader->file) closeFile(pack_reader->file);
+    free(pack_reader->ownedIndex);
+    ME_fs_unmap_file(pack_reader->file);
     free(pack_reader);
 }
 
@@ -203,128 +288,114 @@ u64 ME_get_pack_item_count(ME_pack_reader pack_reader) {
     return pack_reader->itemCount;
 }
 
-ME_PRIVATE(int) ME_compare_pack_items(const void *_a, const void *_b) {
-    // NOTE: a and b should not be NULL!
-    // Skipping here ME_ASSERTions for debug build speed.
-
-    const pack_item *a = (pack_item *)_a;
-    const pack_item *b = (pack_item *)_b;
-
-    int difference = (int)a->info.pathSize - (int)b->info.pathSize;
-
-    if (difference != 0) return difference;
-
-    return memcmp(a->path, b->path, a->info.pathSize * sizeof(char));
-}
-
 bool ME_get_pack_item_index(ME_pack_reader pack_reader, const char *path, u64 *index) {
     ME_ASSERT(pack_reader);
     ME_ASSERT(path);
     ME_ASSERT(index);
     ME_ASSERT(strlen(path) <= UINT8_MAX);
 
-    pack_item *searchItem = &pack_reader->searchItem;
+    const size_t pathSize = strlen(path);
+    const u64 hash = pack_path_hash(path, pathSize);
+    const u64 mask = pack_reader->slotMask;
 
-    searchItem->info.pathSize = (u8)strlen(path);
-    searchItem->path = (char *)path;
+    // 装载率不超过一半 一定能碰到空槽
+    for (u64 slot = hash & mask;; slot = (slot + 1) & mask) {
+        const u32 item = pack_reader->slots[slot];
 
-    pack_item *item = (pack_item *)bsearch(searchItem, pack_reader->items, pack_reader->itemCount, sizeof(pack_item), ME_compare_pack_items);
+        if (item == 0) return false;
 
-    if (!item) return false;
+        const pack_index_entry *entry = &pack_reader->entries[item - 1];
 
-    *index = item - pack_reader->items;
-    return true;
+        if (entry->hash == hash && entry->pathSize == pathSize && memcmp(pack_reader->paths + entry->pathOffset, path, pathSize) == 0) {
+            *index = item - 1;
+            return true;
+        }
+    }
 }
 
 u32 ME_get_pack_item_data_size(ME_pack_reader pack_reader, u64 index) {
     ME_ASSERT(pack_reader);
     ME_ASSERT(index < pack_reader->itemCount);
-    return pack_reader->items[index].info.dataSize;
+    return pack_reader->entries[index].dataSize;
+}
+
+bool ME_is_pack_item_compressed(ME_pack_reader pack_reader, u64 index) {
+    ME_ASSERT(pack_reader);
+    ME_ASSERT(index < pack_reader->itemCount);
+    return pack_reader->entries[index].zipSize > 0;
 }
 
 const char *ME_get_pack_item_path(ME_pack_reader pack_reader, u64 index) {
     ME_ASSERT(pack_reader);
     ME_ASSERT(index < pack_reader->itemCount);
-    return pack_reader->items[index].path;
+    return pack_reader->paths + pack_reader->entries[index].pathOffset;
 }
 
-ME_pack_result ME_read_pack_item_data(ME_pack_reader pack_reader, u64 index, const u8 **data, u32 *size) {
+ME_pack_result ME_get_pack_item_view(ME_pack_reader pack_reader, u64 index, const u8 **data, u32 *size) {
     ME_ASSERT(pack_reader);
     ME_ASSERT(index < pack_reader->itemCount);
     ME_ASSERT(data);
     ME_ASSERT(size);
 
-    pack_iteminfo info = pack_reader->items[index].info;
-    u8 *dataBuffer = pack_reader->dataBuffer;
-
-    if (dataBuffer) {
-        if (info.dataSize > pack_reader->dataSize) {
-            dataBuffer = (u8 *)realloc(dataBuffer, info.dataSize * sizeof(u8));
+    const pack_index_entry *entry = &pack_reader->entries[index];
 
-            if (!dataBuffer) return FAILED_TO_ALLOCATE_PACK_RESULT;
+    if (entry->zipSize > 0) return ITEM_IS_COMPRESSED_PACK_RESULT;
 
-            pack_reader->dataBuffer = dataBuffer;
-            pack_reader->dataSize = info.dataSize;
-        }
-    } else {
-        dataBuffer = (u8 *)malloc(info.dataSize * sizeof(u8));
-
-        if (!dataBuffer) return FAILED_TO_ALLOCATE_PACK_RESULT;
-
-        pack_reader->dataBuffer = dataBuffer;
-        pack_reader->dataSize = info.dataSize;
-    }
-
-    u8 *zipBuffer = pack_reader->zipBuffer;
+    *data = (const u8 *)pack_reader->file.data + entry->dataOffset;
+    *size = entry->dataSize;
+    return SUCCESS_PACK_RESULT;
+}
 
-    if (zipBuffer) {
-        if (info.zipSize > pack_reader->zipSize) {
-            zipBuffer = (u8 *)realloc(zipBuffer, info.zipSize * sizeof(u8));
+ME_pack_result ME_decompress_pack_item(ME_pack_reader pack_reader, u64 index, u8 *buffer, u32 capacity) {
+    ME_ASSERT(pack_reader);
+    ME_ASSERT(index < pack_reader->itemCount);
+    ME_ASSERT(buffer);
 
-            if (!zipBuffer) return FAILED_TO_ALLOCATE_PACK_RESULT;
+    const pack_index_entry *entry = &pack_reader->entries[index];
 
-            pack_reader->zipBuffer = zipBuffer;
-            pack_reader->zipSize = info.zipSize;
-        }
-    } else {
-        if (info.zipSize > 0) {
-            zipBuffer = (u8 *)malloc(info.zipSize * sizeof(u8));
+    if (capacity < entry->dataSize) return BAD_DATA_SIZE_PACK_RESULT;
 
-            if (!zipBuffer) return FAILED_TO_ALLOCATE_PACK_RESULT;
+    const char *source = pack_reader->file.data + entry->dataOffset;
 
-            pack_reader->zipBuffer = zipBuffer;
-            pack_reader->zipSize = info.zipSize;
-        }
+    if (entry->zipSize == 0) {
+        memcpy(buffer, source, entry->dataSize);
+        return SUCCESS_PACK_RESULT;
     }
 
-    FILE *file = pack_reader->file;
+    int result = LZ4_decompress_safe(source, (char *)buffer, (int)entry->zipSize, (int)entry->dataSize);
 
-    int64_t fileOffset = (int64_t)(info.fileOffset + sizeof(pack_iteminfo) + info.pathSize);
+    if (result < 0 || (u32)result != entry->dataSize) return FAILED_TO_DECOMPRESS_PACK_RESULT;
 
-    int seekResult = seekFile(file, fileOffset, SEEK_SET);
+    return SUCCESS_PACK_RESULT;
+}
 
-    if (seekResult != 0) return FAILED_TO_SEEK_FILE_PACK_RESULT;
+ME_pack_result ME_read_pack_item_data(ME_pack_reader pack_reader, u64 index, const u8 **data, u32 *size) {
+    ME_ASSERT(pack_reader);
+    ME_ASSERT(index < pack_reader->itemCount);
+    ME_ASSERT(data);
+    ME_ASSERT(size);
 
-    if (info.zipSize > 0) {
-        size_t result = fread(zipBuffer, sizeof(u8), info.zipSize, file);
+    const pack_index_entry *entry = &pack_reader->entries[index];
 
-        if (result != info.zipSize) return FAILED_TO_READ_FILE_PACK_RESULT;
+    if (entry->zipSize == 0) return ME_get_pack_item_view(pack_reader, index, data, size);
 
-        result = LZ4_decompress_safe((char *)zipBuffer, (char *)dataBuffer, info.zipSize, info.dataSize);
+    u8 *dataBuffer = pack_reader->dataBuffer;
 
-        METADOT_BUG("[Assets] LZ4_decompress_safe ", result, " ", info.dataSize);
+    if (!dataBuffer || entry->dataSize > pack_reader->dataSize) {
+        dataBuffer = (u8 *)realloc(dataBuffer, entry->dataSize * sizeof(u8));
 
-        if (result < 0 || result != info.dataSize) {
-            return FAILED_TO_DECOMPRESS_PACK_RESULT;
-        }
-    } else {
-        size_t result = fread(dataBuffer, sizeof(u8), info.dataSize, file);
+        if (!dataBuffer) return FAILED_TO_ALLOCATE_PACK_RESULT;
 
-        if (result != info.dataSize) return FAILED_TO_READ_FILE_PACK_RESULT;
+        pack_reader->dataBuffer = dataBuffer;
+        pack_reader->dataSize = entry->dataSize;
     }
 
+    ME_pack_result packResult = ME_decompress_pack_item(pack_reader, index, dataBuffer, pack_reader->dataSize);
+
+    if (packResult != SUCCESS_PACK_RESULT) return packResult;
+
     *data = dataBuffer;
-    *size = info.dataSize;
+    *size = entry->dataSize;
     return SUCCESS_PACK_RESULT;
 }
 
@@ -347,15 +418,12 @@ ME_pack_result ME_read_pack_path_item_data(ME_pack_reader pack_reader, const cha
 void ME_free_pack_reader_buffers(ME_pack_reader pack_reader) {
     ME_ASSERT(pack_reader);
     free(pack_reader->dataBuffer);
-    free(pack_reader->zipBuffer);
     pack_reader->dataBuffer = NULL;
-    pack_reader->zipBuffer = NULL;
+    pack_reader->dataSize = 0;
 }
 
-ME_PRIVATE(void) ME_removePackItemFiles(u64 itemCount, pack_item *packItems) {
-    ME_ASSERT(itemCount == 0 || (itemCount > 0 && packItems));
-
-    for (u64 i = 0; i < itemCount; i++) remove(packItems[i].path);
+ME_PRIVATE(void) ME_removePackItemFiles(ME_pack_reader pack_reader, u64 itemCount) {
+    for (u64 i = 0; i < itemCount; i++) remove(ME_get_pack_item_path(pack_reader, i));
 }
 
 ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
@@ -370,13 +438,13 @@ ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
     u64 totalRawSize = 0, totalZipSize = 0;
 
     u64 itemCount = pack_reader->itemCount;
-    pack_item *items = pack_reader->items;
 
     for (u64 i = 0; i < itemCount; i++) {
-        pack_item *item = &items[i];
+        const pack_index_entry *entry = &pack_reader->entries[i];
+        const char *path = ME_get_pack_item_path(pack_reader, i);
 
         if (printProgress) {
-            METADOT_BUG("Unpacking ", item->path);
+            METADOT_BUG("Unpacking ", path);
         }
 
         const u8 *dataBuffer;
@@ -385,16 +453,16 @@ ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
         packResult = ME_read_pack_item_data(pack_reader, i, &dataBuffer, &dataSize);
 
         if (packResult != SUCCESS_PACK_RESULT) {
-            ME_removePackItemFiles(i, items);
+            ME_removePackItemFiles(pack_reader, i);
             ME_destroy_pack_reader(pack_reader);
             return packResult;
         }
 
-        u8 pathSize = item->info.pathSize;
+        u8 pathSize = (u8)entry->pathSize;
 
         char itemPath[UINT8_MAX + 1];
 
-        memcpy(itemPath, item->path, pathSize * sizeof(char));
+        memcpy(itemPath, path, pathSize * sizeof(char));
         itemPath[pathSize] = 0;
 
         for (u8 j = 0; j < pathSize; j++) {
@@ -406,7 +474,7 @@ ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
         FILE *itemFile = openFile(itemPath, "wb");
 
         if (!itemFile) {
-            ME_removePackItemFiles(i, items);
+            ME_removePackItemFiles(pack_reader, i);
             ME_destroy_pack_reader(pack_reader);
             return FAILED_TO_OPEN_FILE_PACK_RESULT;
         }
@@ -416,14 +484,14 @@ ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
         closeFile(itemFile);
 
         if (result != dataSize) {
-            ME_removePackItemFiles(i, items);
+            ME_removePackItemFiles(pack_reader, i);
             ME_destroy_pack_reader(pack_reader);
             return FAILED_TO_OPEN_FILE_PACK_RESULT;
         }
 
         if (printProgress) {
-            u32 rawFileSize = item->info.dataSize;
-            u32 zipFileSize = item->info.zipSize > 0 ? item->info.zipSize : item->info.dataSize;
+            u32 rawFileSize = entry->dataSize;
+            u32 zipFileSize = entry->zipSize > 0 ? entry->zipSize : entry->dataSize;
 
             totalRawSize += rawFileSize;
             totalZipSize += zipFileSize;
@@ -444,186 +512,227 @@ ME_pack_result ME_unpack_files(const char *filePath, bool printProgress) {
     return SUCCESS_PACK_RESULT;
 }
 
-ME_PRIVATE(ME_pack_result) ME_write_pack_items(FILE *packFile, u64 itemCount, char **itemPaths, bool printProgress) {
-    ME_ASSERT(packFile);
-    ME_ASSERT(itemCount > 0);
-    ME_ASSERT(itemPaths);
+ME_PRIVATE(ME_pack_result) ME_unpack_item_to(ME_pack_reader pack_reader, u64 index, const std::filesystem::path &directory) {
+    const pack_index_entry *entry = &pack_reader->entries[index];
+    const std::string path(ME_get_pack_item_path(pack_reader, index), entry->pathSize);
 
-    u32 bufferSize = 1;
+    // 只接受包内的相对路径 不能写到 directory 之外
+    const std::filesystem::path relative = std::filesystem::path(path).lexically_normal();
+    if (path.empty() || relative.is_absolute() || relative.has_root_name() || *relative.begin() == "..") return FAILED_TO_GET_ITEM_PACK_RESULT;
 
-    u8 *itemData = (u8 *)malloc(sizeof(u8));
+    std::vector<u8> data(entry->dataSize);
+    ME_pack_result result = ME_decompress_pack_item(pack_reader, index, data.data(), (u32)data.size());
+    if (result != SUCCESS_PACK_RESULT) return result;
 
-    if (!itemData) return FAILED_TO_ALLOCATE_PACK_RESULT;
+    const std::filesystem::path itemPath = directory / relative;
+    std::error_code ec;
+    std::filesystem::create_directories(itemPath.parent_path(), ec);
 
-    u8 *zipData = (u8 *)malloc(sizeof(u8));
+    FILE *itemFile = openFile(itemPath.string().c_str(), "wb");
 
-    if (!zipData) {
-        free(itemData);
-        return FAILED_TO_ALLOCATE_PACK_RESULT;
-    }
+    if (!itemFile) return FAILED_TO_OPEN_FILE_PACK_RESULT;
 
-    u64 totalZipSize = 0, totalRawSize = 0;
+    const size_t written = fwrite(data.data(), sizeof(u8), data.size(), itemFile);
 
-    for (u64 i = 0; i < itemCount; i++) {
-        char *itemPath = itemPaths[i];
+    closeFile(itemFile);
 
-        if (printProgress) {
-            printf("Packing \"%s\" file. ", itemPath);
-            fflush(stdout);
-        }
+    return written == data.size() ? SUCCESS_PACK_RESULT : FAILED_TO_WRITE_FILE_PACK_RESULT;
+}
 
-        size_t pathSize = strlen(itemPath);
+ME_pack_result ME_unpack_files_to(const char *filePath, const char *directory, bool printProgress) {
+    ME_ASSERT(filePath);
+    ME_ASSERT(directory);
 
-        if (pathSize > UINT8_MAX) {
-            free(zipData);
-            free(itemData);
-            return BAD_DATA_SIZE_PACK_RESULT;
-        }
+    ME_pack_reader pack_reader;
 
-        FILE *itemFile = openFile(itemPath, "rb");
+    ME_pack_result packResult = ME_create_file_pack_reader(filePath, 0, false, &pack_reader);
 
-        if (!itemFile) {
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_OPEN_FILE_PACK_RESULT;
-        }
+    if (packResult != SUCCESS_PACK_RESULT) return packResult;
 
-        int seekResult = seekFile(itemFile, 0, SEEK_END);
+    const u64 itemCount = pack_reader->itemCount;
 
-        if (seekResult != 0) {
-            closeFile(itemFile);
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_SEEK_FILE_PACK_RESULT;
-        }
+    if (itemCount >= UINT32_MAX) {
+        ME_destroy_pack_reader(pack_reader);
+        return BAD_DATA_SIZE_PACK_RESULT;
+    }
 
-        u64 itemSize = (u64)tellFile(itemFile);
+    // 解压只读映射和索引 条目之间互不相关 全部并行
+    std::vector<ME_pack_result> results(itemCount, SUCCESS_PACK_RESULT);
+    const std::filesystem::path base(directory);
 
-        if (itemSize == 0 || itemSize > UINT32_MAX) {
-            closeFile(itemFile);
-            free(zipData);
-            free(itemData);
-            return BAD_DATA_SIZE_PACK_RESULT;
-        }
+    job::parallel_for((u32)itemCount, 1, [&](u32 i) { results[i] = ME_unpack_item_to(pack_reader, i, base); });
 
-        seekResult = seekFile(itemFile, 0, SEEK_SET);
+    u64 totalRawSize = 0;
 
-        if (seekResult != 0) {
-            closeFile(itemFile);
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_SEEK_FILE_PACK_RESULT;
+    for (u64 i = 0; i < itemCount; i++) {
+        if (results[i] != SUCCESS_PACK_RESULT) {
+            if (printProgress) printf("Failed to unpack \"%s\": %s.\n", ME_get_pack_item_path(pack_reader, i), pack_result_to_string(results[i]));
+            packResult = results[i];
+            break;
         }
+        totalRawSize += pack_reader->entries[i].dataSize;
+    }
 
-        if (itemSize > bufferSize) {
-            u8 *newBuffer = (u8 *)realloc(itemData, itemSize * sizeof(u8));
+    ME_destroy_pack_reader(pack_reader);
 
-            if (!newBuffer) {
-                closeFile(itemFile);
-                free(zipData);
-                free(itemData);
-                return FAILED_TO_ALLOCATE_PACK_RESULT;
-            }
+    if (printProgress && packResult == SUCCESS_PACK_RESULT) {
+        printf("Unpacked %llu files to %s. (%llu bytes)\n", (long long unsigned int)itemCount, directory, (long long unsigned int)totalRawSize);
+    }
 
-            itemData = newBuffer;
+    return packResult;
+}
 
-            newBuffer = (u8 *)realloc(zipData, itemSize * sizeof(u8));
+// 一批条目在 job 线程上并行读取和压缩 再按顺序写进包里 包的内容与逐个处理时相同
+#define PACK_WRITE_BATCH_ITEMS 64
 
-            if (!newBuffer) {
-                closeFile(itemFile);
-                free(zipData);
-                free(itemData);
-                return FAILED_TO_ALLOCATE_PACK_RESULT;
-            }
+typedef struct pack_write_item {
+    std::vector<u8> data;
+    std::vector<u8> zip;  // 为空时原样存储
+    ME_pack_result result;
+} pack_write_item;
 
-            zipData = newBuffer;
-        }
+ME_PRIVATE(void) ME_load_pack_item(const char *baseDirectory, const char *itemPath, pack_write_item *item) {
+    item->data.clear();
+    item->zip.clear();
 
-        size_t result = fread(itemData, sizeof(u8), itemSize, itemFile);
+    if (strlen(itemPath) > UINT8_MAX) {
+        item->result = BAD_DATA_SIZE_PACK_RESULT;
+        return;
+    }
+
+    std::string fullPath;
+    if (baseDirectory) {
+        fullPath = baseDirectory;
+        fullPath += '/';
+    }
+    fullPath += itemPath;
+
+    FILE *itemFile = openFile(fullPath.c_str(), "rb");
+
+    if (!itemFile) {
+        item->result = FAILED_TO_OPEN_FILE_PACK_RESULT;
+        return;
+    }
 
+    if (seekFile(itemFile, 0, SEEK_END) != 0) {
         closeFile(itemFile);
+        item->result = FAILED_TO_SEEK_FILE_PACK_RESULT;
+        return;
+    }
 
-        if (result != itemSize) {
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_READ_FILE_PACK_RESULT;
-        }
+    u64 itemSize = (u64)tellFile(itemFile);
 
-        size_t zipSize;
+    if (itemSize == 0 || itemSize > UINT32_MAX) {
+        closeFile(itemFile);
+        item->result = BAD_DATA_SIZE_PACK_RESULT;
+        return;
+    }
 
-        if (itemSize > 1) {
+    if (seekFile(itemFile, 0, SEEK_SET) != 0) {
+        closeFile(itemFile);
+        item->result = FAILED_TO_SEEK_FILE_PACK_RESULT;
+        return;
+    }
 
-            const int max_dst_size = LZ4_compressBound(itemSize);
+    item->data.resize(itemSize);
 
-            zipSize = LZ4_compress_fast((char *)itemData, (char *)zipData, itemSize, max_dst_size, 10);
+    size_t result = fread(item->data.data(), sizeof(u8), itemSize, itemFile);
 
-            if (zipSize <= 0 || zipSize >= itemSize) {
-                zipSize = 0;
-            }
-        } else {
-            zipSize = 0;
-        }
+    closeFile(itemFile);
 
-        int64_t fileOffset = tellFile(packFile);
+    if (result != itemSize) {
+        item->result = FAILED_TO_READ_FILE_PACK_RESULT;
+        return;
+    }
 
-        pack_iteminfo info = {
-                (u32)zipSize,
-                (u32)itemSize,
-                (u64)fileOffset,
-                (u8)pathSize,
-        };
+    if (itemSize > 1) {
+        // zip 只有 itemSize - 1 大 压缩后不比原文件小就不压缩 放不下时 LZ4 返回 0
+        const int max_dst_size = (int)itemSize - 1;
+        item->zip.resize(max_dst_size);
 
-        result = fwrite(&info, sizeof(pack_iteminfo), 1, packFile);
+        int zipSize = LZ4_compress_fast((char *)item->data.data(), (char *)item->zip.data(), (int)itemSize, max_dst_size, 10);
 
-        if (result != 1) {
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_WRITE_FILE_PACK_RESULT;
-        }
+        if (zipSize <= 0 || (u64)zipSize >= itemSize) zipSize = 0;
+        item->zip.resize(zipSize);
+    }
 
-        result = fwrite(itemPath, sizeof(char), info.pathSize, packFile);
+    item->result = SUCCESS_PACK_RESULT;
+}
 
-        if (result != info.pathSize) {
-            free(zipData);
-            free(itemData);
-            return FAILED_TO_WRITE_FILE_PACK_RESULT;
-        }
+ME_PRIVATE(ME_pack_result) ME_write_pack_items(FILE *packFile, const char *baseDirectory, u64 itemCount, char **itemPaths, pack_index_entry *entries, bool printProgress) {
+    ME_ASSERT(packFile);
+    ME_ASSERT(itemCount > 0);
+    ME_ASSERT(itemPaths);
+    ME_ASSERT(entries);
 
-        if (zipSize > 0) {
-            result = fwrite(zipData, sizeof(u8), zipSize, packFile);
+    u32 pathOffset = 0;
 
-            if (result != zipSize) {
-                free(zipData);
-                free(itemData);
-                return FAILED_TO_WRITE_FILE_PACK_RESULT;
-            }
-        } else {
-            result = fwrite(itemData, sizeof(u8), itemSize, packFile);
+    u64 totalZipSize = 0, totalRawSize = 0;
+
+    std::vector<pack_write_item> batch(std::min<u64>(itemCount, PACK_WRITE_BATCH_ITEMS));
+
+    for (u64 first = 0; first < itemCount; first += batch.size()) {
+        const u64 count = std::min<u64>(batch.size(), itemCount - first);
 
-            if (result != itemSize) {
-                free(zipData);
-                free(itemData);
-                return FAILED_TO_WRITE_FILE_PACK_RESULT;
+        job::parallel_for((u32)count, 1, [&](u32 i) { ME_load_pack_item(baseDirectory, itemPaths[first + i], &batch[i]); });
+
+        for (u64 b = 0; b < count; b++) {
+            const u64 i = first + b;
+            char *itemPath = itemPaths[i];
+            pack_write_item *item = &batch[b];
+
+            if (printProgress) {
+                printf("Packing \"%s\" file. ", itemPath);
+                fflush(stdout);
             }
-        }
 
-        if (printProgress) {
-            u32 zipFileSize = zipSize > 0 ? (u32)zipSize : (u32)itemSize;
-            u32 rawFileSize = (u32)itemSize;
+            if (item->result != SUCCESS_PACK_RESULT) return item->result;
 
-            totalZipSize += zipFileSize;
-            totalRawSize += rawFileSize;
+            const size_t pathSize = strlen(itemPath);
+            const size_t itemSize = item->data.size();
+            const size_t zipSize = item->zip.size();
 
-            int progress = (int)(((float)(i + 1) / (float)itemCount) * 100.0f);
+            int64_t fileOffset = tellFile(packFile);
 
-            printf("(%u/%u bytes) [%d%%]\n", zipFileSize, rawFileSize, progress);
-            fflush(stdout);
+            pack_iteminfo info = {
+                    (u32)zipSize,
+                    (u32)itemSize,
+                    (u64)fileOffset,
+                    (u8)pathSize,
+            };
+
+            if (fwrite(&info, sizeof(pack_iteminfo), 1, packFile) != 1) return FAILED_TO_WRITE_FILE_PACK_RESULT;
+
+            if (fwrite(itemPath, sizeof(char), info.pathSize, packFile) != info.pathSize) return FAILED_TO_WRITE_FILE_PACK_RESULT;
+
+            const std::vector<u8> &stored = zipSize > 0 ? item->zip : item->data;
+
+            if (fwrite(stored.data(), sizeof(u8), stored.size(), packFile) != stored.size()) return FAILED_TO_WRITE_FILE_PACK_RESULT;
+
+            pack_index_entry *entry = &entries[i];
+            entry->hash = pack_path_hash(itemPath, pathSize);
+            entry->dataOffset = info.fileOffset + sizeof(pack_iteminfo) + info.pathSize;
+            entry->zipSize = info.zipSize;
+            entry->dataSize = info.dataSize;
+            entry->pathOffset = pathOffset;
+            entry->pathSize = info.pathSize;
+            pathOffset += info.pathSize + 1;
+
+            if (printProgress) {
+                u32 zipFileSize = zipSize > 0 ? (u32)zipSize : (u32)itemSize;
+                u32 rawFileSize = (u32)itemSize;
+
+                totalZipSize += zipFileSize;
+                totalRawSize += rawFileSize;
+
+                int progress = (int)(((float)(i + 1) / (float)itemCount) * 100.0f);
+
+                printf("(%u/%u bytes) [%d%%]\n", zipFileSize, rawFileSize, progress);
+                fflush(stdout);
+            }
         }
     }
 
-    free(zipData);
-    free(itemData);
-
     if (printProgress) {
         int compression = (int)((1.0 - (double)(totalZipSize) / (double)totalRawSize) * 100.0);
         printf("Packed %llu files. (%llu/%llu bytes, %d%% saved)\n", (long long unsigned int)itemCount, (long long unsigned int)totalZipSize, (long long unsigned int)totalRawSize, compression);
@@ -632,6 +741,39 @@ ME_PRIVATE(ME_pack_result) ME_write_pack_items(FILE *packFile, u64 itemCount, ch
     return SUCCESS_PACK_RESULT;
 }
 
+// 写在所有条目之后 再回到头部填上偏移
+ME_PRIVATE(ME_pack_result) ME_write_pack_index(FILE *packFile, u64 itemCount, char **itemPaths, const pack_index_entry *entries) {
+    const u64 slotCount = pack_slot_count(itemCount);
+
+    u32 *slots = (u32 *)malloc(slotCount * sizeof(u32));
+
+    if (!slots) return FAILED_TO_ALLOCATE_PACK_RESULT;
+
+    pack_fill_slots(entries, itemCount, slots, slotCount);
+
+    int64_t end = tellFile(packFile);
+    const char padding[sizeof(u64)] = {0};
+    const size_t paddingSize = (sizeof(u64) - (size_t)end % sizeof(u64)) % sizeof(u64);
+    const u64 indexOffset = (u64)end + paddingSize;
+
+    bool written = fwrite(padding, sizeof(char), paddingSize, packFile) == paddingSize && fwrite(&slotCount, sizeof(u64), 1, packFile) == 1 &&
+                   fwrite(entries, sizeof(pack_index_entry), itemCount, packFile) == itemCount && fwrite(slots, sizeof(u32), slotCount, packFile) == slotCount;
+
+    free(slots);
+
+    for (u64 i = 0; written && i < itemCount; i++) {
+        written = fwrite(itemPaths[i], sizeof(char), entries[i].pathSize + 1, packFile) == entries[i].pathSize + 1;
+    }
+
+    if (!written) return FAILED_TO_WRITE_FILE_PACK_RESULT;
+
+    if (seekFile(packFile, (int64_t)PACK_INDEX_OFFSET_POSITION, SEEK_SET) != 0) return FAILED_TO_SEEK_FILE_PACK_RESULT;
+
+    if (fwrite(&indexOffset, sizeof(u64), 1, packFile) != 1) return FAILED_TO_WRITE_FILE_PACK_RESULT;
+
+    return SUCCESS_PACK_RESULT;
+}
+
 ME_PRIVATE(int) ME_comparePackItemPaths(const void *_a, const void *_b) {
     // NOTE: a and b should not be NULL!
     // Skipping here ME_ASSERTions for debug build speed.
@@ -648,7 +790,9 @@ ME_PRIVATE(int) ME_comparePackItemPaths(const void *_a, const void *_b) {
     return memcmp(a, b, al * sizeof(u8));
 }
 
-ME_pack_result ME_pack_files(const char *filePath, u64 fileCount, const char **filePaths, bool printProgress) {
+ME_pack_result ME_pack_files(const char *filePath, u64 fileCount, const char **filePaths, bool printProgress) { return ME_pack_files_in(filePath, NULL, fileCount, filePaths, printProgress); }
+
+ME_pack_result ME_pack_files_in(const char *filePath, const char *baseDirectory, u64 fileCount, const char **filePaths, bool printProgress) {
     ME_ASSERT(filePath);
     ME_ASSERT(fileCount > 0);
     ME_ASSERT(filePaths);
@@ -671,9 +815,22 @@ ME_pack_result ME_pack_files(const char *filePath, u64 fileCount, const char **f
 
     qsort(itemPaths, itemCount, sizeof(char *), ME_comparePackItemPaths);
 
+    if (itemCount >= UINT32_MAX) {
+        free(itemPaths);
+        return BAD_DATA_SIZE_PACK_RESULT;
+    }
+
+    pack_index_entry *entries = (pack_index_entry *)malloc(itemCount * sizeof(pack_index_entry));
+
+    if (!entries) {
+        free(itemPaths);
+        return FAILED_TO_ALLOCATE_PACK_RESULT;
+    }
+
     FILE *packFile = openFile(filePath, "wb");
 
     if (!packFile) {
+        free(entries);
         free(itemPaths);
         return FAILED_TO_CREATE_FILE_PACK_RESULT;
     }
@@ -685,23 +842,29 @@ ME_pack_result ME_pack_files(const char *filePath, u64 fileCount, const char **f
     size_t writeResult = fwrite(header, sizeof(char), PACK_HEADER_SIZE, packFile);
 
     if (writeResult != PACK_HEADER_SIZE) {
+        free(entries);
         free(itemPaths);
         closeFile(packFile);
         remove(filePath);
         return FAILED_TO_WRITE_FILE_PACK_RESULT;
     }
 
-    writeResult = fwrite(&itemCount, sizeof(u64), 1, packFile);
+    // 索引的偏移先写 0 条目写完后回填
+    const u64 indexOffset = 0;
 
-    if (writeResult != 1) {
+    if (fwrite(&itemCount, sizeof(u64), 1, packFile) != 1 || fwrite(&indexOffset, sizeof(u64), 1, packFile) != 1) {
+        free(entries);
         free(itemPaths);
         closeFile(packFile);
         remove(filePath);
         return FAILED_TO_WRITE_FILE_PACK_RESULT;
     }
 
-    ME_pack_result packResult = ME_write_pack_items(packFile, itemCount, itemPaths, printProgress);
+    ME_pack_result packResult = ME_write_pack_items(packFile, baseDirectory, itemCount, itemPaths, entries, printProgress);
+
+    if (packResult == SUCCESS_PACK_RESULT) packResult = ME_write_pack_index(packFile, itemCount, itemPaths, entries);
 
+    free(entries);
     free(itemPaths);
     closeFile(packFile);
 
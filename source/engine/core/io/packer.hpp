@@ -29,7 +29,8 @@ typedef enum ME_packresult_t {
     BAD_FILE_TYPE_PACK_RESULT = 12,
     BAD_FILE_VERSION_PACK_RESULT = 13,
     BAD_FILE_ENDIANNESS_PACK_RESULT = 14,
-    PACK_RESULT_COUNT = 15,
+    ITEM_IS_COMPRESSED_PACK_RESULT = 15,
+    PACK_RESULT_COUNT = 16,
 } ME_packresult_t;
 
 typedef u8 ME_pack_result;
@@ -58,6 +59,7 @@ pack_result_strings[PACK_RESULT_COUNT] = {
         "Bad file type",
         "Bad file version",
         "Bad file endianness",
+        "Item is compressed",
 };
 
 inline static const char *pack_result_to_string(ME_pack_result result) {
@@ -68,17 +70,32 @@ inline static const char *pack_result_to_string(ME_pack_result result) {
 typedef struct ME_packreader_t ME_packreader_t;
 typedef ME_packreader_t *ME_pack_reader;
 
+// 读取器把整个包映射到内存 路径索引 (开放寻址的哈希表) 存在包里 打开和查找都不需要读文件
+// 查找 view 和 decompress 只读映射和索引 可以在多个线程上同时调用
+// read 系列函数解压到读取器自己的缓冲区 同一个读取器不能在多个线程上同时 read
 ME_pack_result ME_create_file_pack_reader(const char *filePath, u32 dataBufferCapacity, bool isResourcesDirectory, ME_pack_reader *pack_reader);
 void ME_destroy_pack_reader(ME_pack_reader pack_reader);
 u64 ME_get_pack_item_count(ME_pack_reader pack_reader);
 bool ME_get_pack_item_index(ME_pack_reader pack_reader, const char *path, u64 *index);
 u32 ME_get_pack_item_data_size(ME_pack_reader pack_reader, u64 index);
+bool ME_is_pack_item_compressed(ME_pack_reader pack_reader, u64 index);
 const char *ME_get_pack_item_path(ME_pack_reader pack_reader, u64 index);
+// 未压缩的条目直接返回映射中的数据 在读取器销毁前有效 压缩的条目返回 ITEM_IS_COMPRESSED_PACK_RESULT
+ME_pack_result ME_get_pack_item_view(ME_pack_reader pack_reader, u64 index, const u8 **data, u32 *size);
+// 解压 (或复制未压缩的条目) 到调用者的缓冲区 capacity 不能小于 ME_get_pack_item_data_size
+ME_pack_result ME_decompress_pack_item(ME_pack_reader pack_reader, u64 index, u8 *buffer, u32 capacity);
+// 未压缩的条目同 view 压缩的条目解压到读取器的缓冲区 下一次 read 之前有效
 ME_pack_result ME_read_pack_item_data(ME_pack_reader pack_reader, u64 index, const u8 **data, u32 *size);
 ME_pack_result ME_read_pack_path_item_data(ME_pack_reader pack_reader, const char *path, const u8 **data, u32 *size);
 void ME_free_pack_reader_buffers(ME_pack_reader pack_reader);
 ME_pack_result ME_unpack_files(const char *filePath, bool printProgress);
 ME_pack_result ME_pack_files(const char *packPath, u64 fileCount, const char **filePaths, bool printProgress);
+// 条目的读取和压缩在 job 线程上分批并行 写入仍按路径排序 包的内容与不并行时相同
+// filePaths 相对 baseDirectory (为 NULL 时相对当前目录) 包中记录的是 filePaths 本身
+ME_pack_result ME_pack_files_in(const char *packPath, const char *baseDirectory, u64 fileCount, const char **filePaths, bool printProgress);
+// 与 ME_unpack_files 不同 保留条目的子目录 解压到 directory 下 条目在 job 线程上并行解压
+// 条目路径是绝对路径或指向 directory 之外时失败
+ME_pack_result ME_unpack_files_to(const char *filePath, const char *directory, bool printProgress);
 
 void ME_get_pack_library_version(u8 *majorVersion, u8 *minorVersion, u8 *patchVersion);
 ME_pack_result ME_get_pack_info(const char *filePath, u8 *majorVersion, u8 *minorVersion, u8 *patchVersion, bool *isLittleEndian, u64 *itemCount);
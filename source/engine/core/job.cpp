@@ -3,11 +3,15 @@
 #include <assert.h>
 
 #include <algorithm>           // std::max
-#include <atomic>              // to use std::atomic<uint64_t>
 #include <condition_variable>  // to use std::condition_variable
+#include <deque>
 #include <sstream>
+#include <string>
 #include <thread>  // to use std::thread
 
+#include "engine/core/profiler.hpp"
+#include "engine/core/thread_topology.hpp"
+
 #ifdef _WIN32
 #define NOMINMAX
 #include <Windows.h>
@@ -15,97 +19,376 @@
 
 namespace ME {
 
-// Fixed size very simple thread safe ring buffer
-template <typename T, size_t capacity>
-class ThreadSafeRingBuffer {
+// Every job is a job_task, run() executes it, signals its counter and frees it
+struct job_task {
+    void (*run)(job_task *task);
+    job_counter *counter;
+    job_class cls;
+};
+
+struct job_function_task : job_task {
+    std::function<void()> func;
+};
+
+// Lock-free work-stealing deque (Chase-Lev, with the C11 orderings from Le et al. 2013)
+// Only the owner calls push() / pop(), any thread may call steal().
+// Fixed capacity, push() fails when full and the job goes to the global queue instead.
+class job_deque {
 public:
-    // Push an item to the end if there is free space
-    //  Returns true if succesful
-    //  Returns false if there is not enough space
-    inline bool push_back(const T& item) {
-        bool result = false;
-        lock.lock();
-        size_t next = (head + 1) % capacity;
-        if (next != tail) {
-            data[head] = item;
-            head = next;
-            result = true;
+    static constexpr int64_t CAPACITY = 4096;
+
+    bool push(job_task *task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY) return false;
+        buffer[b & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    job_task *pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
         }
-        lock.unlock();
-        return result;
-    }
-
-    // Get an item if there are any
-    //  Returns true if succesful
-    //  Returns false if there are no items
-    inline bool pop_front(T& item) {
-        bool result = false;
-        lock.lock();
-        if (tail != head) {
-            item = data[tail];
-            tail = (tail + 1) % capacity;
-            result = true;
+
+        job_task *task = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // last job, race against thieves
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) task = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
         }
-        lock.unlock();
-        return result;
+        return task;
+    }
+
+    job_task *steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        job_task *task = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+        return task;
     }
 
 private:
-    T data[capacity];
-    size_t head = 0;
-    size_t tail = 0;
-    std::mutex lock;  // this just works better than a spinlock here (on windows)
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<job_task *> buffer[CAPACITY];
+};
+
+// parallel_for() state, lives on the stack of the calling thread
+struct job_range {
+    void (*fn)(void *, uint32_t);
+    void *ctx;
+    uint32_t count;
+    uint32_t grain;
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint32_t> helpers{0};  // helper jobs that may still touch this struct
+};
+
+struct job_range_task : job_task {
+    job_range *range;
+};
+
+// execute_after_all() 每个依赖一个 依赖完成时计数减一 最后一个把真正的任务放进队列
+struct job_join {
+    std::atomic<size_t> remaining;
+    job_task *task;
 };
 
-uint32_t numThreads = 0;                                   // number of worker threads, it will be initialized in the Initialize() function
-ThreadSafeRingBuffer<std::function<void()>, 256> jobPool;  // a thread safe queue to put pending jobs onto the end (with a capacity of 256 jobs). A worker thread can grab a job from the beginning
-std::condition_variable wakeCondition;                     // used in conjunction with the wakeMutex below. Worker threads just sleep when there is no job, and the main thread can wake them up
-std::mutex wakeMutex;                                      // used in conjunction with the wakeCondition above
-uint64_t currentLabel = 0;                                 // tracks the state of execution of the main thread
-std::atomic<uint64_t> finishedLabel;                       // track the state of execution across background worker threads
+struct job_join_task : job_task {
+    std::shared_ptr<job_join> join;
+};
+
+// job_counter internals for the helpers below
+struct job_detail {
+    static void add(job_counter &counter) { counter.pending.fetch_add(1, std::memory_order_relaxed); }
+    static void finish(job_counter &counter) { counter.finish(); }
+};
+
+namespace {
+
+uint32_t numThreads = 0;  // number of workers including the main thread, it will be initialized in the init() function
+std::unique_ptr<job_deque[]> deques;
+std::vector<std::thread> workers;
+
+std::mutex globalQueueMutex;  // jobs pushed from threads outside of the job system or from full deques
+std::deque<job_task *> globalQueue;
+// render jobs, taken after every tick job that is already queued
+std::deque<job_task *> renderQueue;
+
+// 长时间的后台任务 (区块加载等) 只由空闲的 worker 执行
+// 等待中的线程不会去拿 否则主线程可能在帧中间卡在一次磁盘读取上
+// 按 generation io save 的顺序 每类一个队列
+constexpr int BACKGROUND_CLASSES = 3;
+std::mutex backgroundQueueMutex;
+std::deque<job_task *> backgroundQueues[BACKGROUND_CLASSES];
+
+std::atomic<int> queuedJobs{0};  // jobs that are pushed but not taken yet, sleeping workers wait for it
+std::atomic<uint32_t> sleepingWorkers{0};
+std::atomic<bool> quitWorkers{false};
+std::condition_variable wakeCondition;  // used in conjunction with the wakeMutex below. Worker threads just sleep when there is no job, and the main thread can wake them up
+std::mutex wakeMutex;                   // used in conjunction with the wakeCondition above
+
+// set_active_workers() 之外的 worker 在 parkCondition 上等待 不与 wakeCondition 共用 否则会吞掉 push_task 的唤醒
+std::atomic<uint32_t> activeLimit{0};
+std::condition_variable parkCondition;
+
+job_counter defaultCounter;  // tracks execute(job) and dispatch()
+
+// set_placement() 的设置 每个 worker 看到世代变化时在自己的线程上应用
+std::mutex placementMutex;
+job_placement currentPlacement;
+std::atomic<uint32_t> placementGeneration{0};
+std::atomic<job_class> workerClasses[job::MAX_WORKERS];
+
+thread_local uint32_t workerIndex = ~0u;
+thread_local uint32_t stealSeed = 0x9e3779b9u;
+thread_local uint32_t appliedPlacement = 0;
+// 效率核上的 worker 为 generation 先拿后台任务
+thread_local job_class workerClass = job_class::tick;
+
+bool is_background(job_class cls) { return cls >= job_class::generation; }
+
+void push_task(job_task *task) {
+    queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+    uint32_t self = workerIndex;
+    if (is_background(task->cls)) {
+        std::lock_guard<std::mutex> guard(backgroundQueueMutex);
+        backgroundQueues[(int)task->cls - (int)job_class::generation].push_back(task);
+    } else if (task->cls == job_class::render) {
+        std::lock_guard<std::mutex> guard(globalQueueMutex);
+        renderQueue.push_back(task);
+    } else if (self >= numThreads || !deques[self].push(task)) {
+        std::lock_guard<std::mutex> guard(globalQueueMutex);
+        globalQueue.push_back(task);
+    }
+
+    if (sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> guard(wakeMutex);
+        wakeCondition.notify_one();
+    }
+}
+
+job_task *take_background() {
+    std::lock_guard<std::mutex> guard(backgroundQueueMutex);
+    for (std::deque<job_task *> &queue : backgroundQueues) {
+        if (!queue.empty()) {
+            job_task *task = queue.front();
+            queue.pop_front();
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+job_task *take_task(uint32_t self, bool allowBackground) {
+    job_task *task = nullptr;
+
+    const bool backgroundFirst = allowBackground && workerClass != job_class::tick;
+    if (backgroundFirst) task = take_background();
+
+    if (!task && self < numThreads) task = deques[self].pop();
+
+    if (!task && numThreads > 1) {
+        // xorshift 随机选择开始窃取的对象 避免所有线程都盯着同一个
+        stealSeed ^= stealSeed << 13;
+        stealSeed ^= stealSeed >> 17;
+        stealSeed ^= stealSeed << 5;
+        uint32_t start = stealSeed % numThreads;
+        for (uint32_t i = 0; i < numThreads && !task; i++) {
+            uint32_t victim = (start + i) % numThreads;
+            if (victim != self) task = deques[victim].steal();
+        }
+    }
+
+    if (!task) {
+        std::lock_guard<std::mutex> guard(globalQueueMutex);
+        std::deque<job_task *> &queue = !globalQueue.empty() ? globalQueue : renderQueue;
+        if (!queue.empty()) {
+            task = queue.front();
+            queue.pop_front();
+        }
+    }
+
+    if (!task && allowBackground && !backgroundFirst) task = take_background();
+
+    if (task) queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+void run_range_task(job_task *task);
+
+// This little helper function lets a waiting thread do useful work instead of being deadlocked
+bool run_one(uint32_t self, bool allowBackground = false) {
+    job_task *task = take_task(self, allowBackground);
+    if (!task) return false;
+    // 任务执行完可能已经释放 名字先取出来 分析器的 trace 里按这些名字显示 worker 上的任务
+    static const char *const names[] = {"Job", "Job.Render", "Job.Generation", "Job.IO", "Job.Save"};
+    const char *name = task->run == run_range_task ? "Job.ParallelFor" : names[(int)task->cls];
+    ME_profiler_scope_auto(name);
+    task->run(task);
+    return true;
+}
+
+void run_function_task(job_task *task) {
+    job_function_task *ft = static_cast<job_function_task *>(task);
+    ft->func();
+    job_detail::finish(*ft->counter);
+    delete ft;
+}
+
+void run_range(job_range *range) {
+    while (true) {
+        uint32_t begin = range->next.fetch_add(range->grain, std::memory_order_relaxed);
+        if (begin >= range->count) break;
+        uint32_t end = std::min(begin + range->grain, range->count);
+        for (uint32_t i = begin; i < end; i++) range->fn(range->ctx, i);
+    }
+}
+
+void run_range_task(job_task *task) {
+    job_range *range = static_cast<job_range_task *>(task)->range;
+    run_range(range);
+    // 最后一次访问 之后 range 和 task 所在的栈帧可能已经释放
+    range->helpers.fetch_sub(1, std::memory_order_release);
+}
+
+// 在 index 号 worker 自己的线程上调用
+void apply_placement(uint32_t index) {
+    job_placement p;
+    {
+        std::lock_guard<std::mutex> guard(placementMutex);
+        p = currentPlacement;
+        appliedPlacement = placementGeneration.load(std::memory_order_relaxed);
+    }
+
+    // 性能核的逻辑 CPU 在前 worker 按下标依次对应 多出来的 worker 不限制
+    const cpu_topology &t = thread_topology::cpus();
+    const bool hybrid = p.hybrid && t.hybrid();
+    job_class cls = job_class::tick;
+    std::vector<u32> cpus;
+    if (hybrid && index < t.performance.size()) {
+        cpus = t.performance;
+    } else if (hybrid && index < t.logical()) {
+        cls = job_class::generation;
+        cpus = t.efficiency;
+    }
+    if (p.pin && index > 0 && index < t.logical()) {
+        cpus = {index < t.performance.size() ? t.performance[index] : t.efficiency[index - t.performance.size()]};
+    }
+
+    thread_topology::set_affinity(cpus);
+    // render 是普通优先级 关闭时回到普通
+    thread_topology::set_priority(p.priorities ? cls : job_class::render);
+    workerClass = cls;
+    workerClasses[index].store(cls, std::memory_order_relaxed);
+}
+
+void worker_loop(uint32_t index) {
+    workerIndex = index;
+    stealSeed += index * 0x85ebca6bu;
+    ME_profiler_register_thread(("Job worker " + std::to_string(index)).c_str());
+
+    auto parked = [index] {
+        const uint32_t limit = activeLimit.load(std::memory_order_relaxed);
+        return limit != 0 && index >= limit;
+    };
+
+    auto stale = [] { return appliedPlacement != placementGeneration.load(std::memory_order_relaxed); };
+
+    int idle = 0;
+    while (!quitWorkers.load(std::memory_order_relaxed)) {
+        if (stale()) apply_placement(index);
+
+        if (parked()) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            parkCondition.wait(lock, [&] { return !parked() || stale() || quitWorkers.load(std::memory_order_relaxed); });
+            idle = 0;
+            continue;
+        }
+
+        if (run_one(index, true)) {
+            idle = 0;
+            continue;
+        }
+
+        // 短暂自旋后再睡眠 帧内的任务通常一个接一个到来
+        if (++idle < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        wakeCondition.wait(lock, [&] { return queuedJobs.load(std::memory_order_seq_cst) > 0 || stale() || quitWorkers.load(std::memory_order_relaxed); });
+        sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+job_function_task *make_function_task(job_counter &counter, std::function<void()> &&func, job_class cls) {
+    job_function_task *task = new job_function_task;
+    task->run = run_function_task;
+    task->counter = &counter;
+    task->cls = cls;
+    task->func = std::move(func);
+    job_detail::add(counter);
+    return task;
+}
+
+void arrive(job_join &join) {
+    if (join.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) push_task(join.task);
+}
+
+void run_join_task(job_task *task) {
+    job_join_task *jt = static_cast<job_join_task *>(task);
+    arrive(*jt->join);
+    delete jt;
+}
+
+}  // namespace
+
+void job_counter::finish() {
+    std::vector<job_task *> ready;
+    {
+        // 持锁递减 保证 wait() 返回后不会再有线程访问这个计数器
+        std::lock_guard<std::mutex> guard(lock);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        ready.swap(continuations);
+    }
+    for (job_task *task : ready) push_task(task);
+}
 
 void job::init() {
-    // Initialize the worker execution state to 0:
-    finishedLabel.store(0);
+    if (numThreads) return;
 
     // Retrieve the number of hardware threads in this system:
     auto numCores = std::thread::hardware_concurrency();
 
     // Calculate the actual number of worker threads we want:
-    numThreads = std::max(1u, numCores);
-
-    // Create all our worker threads while immediately starting them:
-    for (uint32_t threadID = 0; threadID < numThreads; ++threadID) {
-        std::thread worker([] {
-            std::function<void()> job;  // the current job for the thread, it's empty at start.
-
-            // This is the infinite loop that a worker thread will do
-            while (true) {
-                if (jobPool.pop_front(job))  // try to grab a job from the jobPool queue
-                {
-                    // It found a job, execute it:
-                    job();                       // execute job
-                    finishedLabel.fetch_add(1);  // update worker label state
-                } else {
-                    // no job, put thread to sleep
-                    std::unique_lock<std::mutex> lock(wakeMutex);
-                    wakeCondition.wait(lock);
-                }
-            }
-        });
+    numThreads = std::clamp(numCores, 1u, MAX_WORKERS);
 
-#ifdef _WIN32
-        // Do Windows-specific thread setup:
-        HANDLE handle = (HANDLE)worker.native_handle();
+    deques = std::make_unique<job_deque[]>(numThreads);
+    quitWorkers.store(false);
 
-        // Put each thread on to dedicated core
-        DWORD_PTR affinityMask = 1ull << threadID;
-        DWORD_PTR affinity_result = SetThreadAffinityMask(handle, affinityMask);
-        assert(affinity_result > 0);
+    // The calling thread is worker 0, create all other worker threads while immediately starting them:
+    workerIndex = 0;
+    for (uint32_t threadID = 1; threadID < numThreads; ++threadID) {
+        workers.emplace_back(worker_loop, threadID);
 
-        //// Increase thread priority:
-        BOOL priority_result = SetThreadPriority(handle, THREAD_PRIORITY_HIGHEST);
-        assert(priority_result != 0);
+#ifdef _WIN32
+        // Do Windows-specific thread setup:
+        HANDLE handle = (HANDLE)workers.back().native_handle();
 
         // Name the thread:
         std::wstringstream wss;
@@ -113,41 +396,163 @@ void job::init() {
         HRESULT hr = SetThreadDescription(handle, wss.str().c_str());
         assert(SUCCEEDED(hr));
 #endif  // _WIN32
+    }
+}
+
+void job::shutdown() {
+    if (!numThreads) return;
+
+    wait();
+
+    {
+        std::lock_guard<std::mutex> guard(wakeMutex);
+        quitWorkers.store(true);
+        wakeCondition.notify_all();
+        parkCondition.notify_all();
+    }
+    for (auto &worker : workers) worker.join();
+    workers.clear();
+
+    deques.reset();
+    numThreads = 0;
+    workerIndex = ~0u;
+}
+
+uint32_t job::worker_count() { return std::max(numThreads, 1u); }
+
+uint32_t job::worker_index() { return workerIndex; }
+
+void job::set_active_workers(uint32_t limit) {
+    // 主线程总是在内
+    if (limit >= numThreads) limit = 0;
+    std::lock_guard<std::mutex> guard(wakeMutex);
+    activeLimit.store(limit, std::memory_order_relaxed);
+    parkCondition.notify_all();
+}
+
+uint32_t job::active_workers() {
+    const uint32_t limit = activeLimit.load(std::memory_order_relaxed);
+    return limit == 0 ? worker_count() : limit;
+}
+
+void job::set_placement(const job_placement &placement) {
+    {
+        std::lock_guard<std::mutex> guard(placementMutex);
+        currentPlacement = placement;
+        placementGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (workerIndex == 0) apply_placement(0);
+
+    // 睡眠和暂停的 worker 醒来应用之后继续等待
+    std::lock_guard<std::mutex> guard(wakeMutex);
+    wakeCondition.notify_all();
+    parkCondition.notify_all();
+}
 
-        worker.detach();  // forget about this thread, let it do it's job in the infinite loop that we created above
+job_placement job::placement() {
+    std::lock_guard<std::mutex> guard(placementMutex);
+    return currentPlacement;
+}
+
+job_class job::worker_class(uint32_t index) { return index < MAX_WORKERS ? workerClasses[index].load(std::memory_order_relaxed) : job_class::tick; }
+
+void job::execute(const std::function<void()> &job) { execute(defaultCounter, job); }
+
+void job::execute(job_counter &counter, std::function<void()> job, job_class cls) {
+    if (!numThreads) {
+        // job system is not running, execute in place
+        job();
+        return;
     }
+    push_task(make_function_task(counter, std::move(job), cls));
 }
 
-// This little helper function will not let the system to be deadlocked while the main thread is waiting for something
-inline void poll() {
-    wakeCondition.notify_one();  // wake one worker thread
-    std::this_thread::yield();   // allow this thread to be rescheduled
+void job::execute_background(job_counter &counter, std::function<void()> job, job_class cls) {
+    assert(is_background(cls) && "execute_background needs generation, io or save");
+    execute(counter, std::move(job), cls);
+}
+
+void job::execute_after(job_counter &dependency, job_counter &counter, std::function<void()> job, job_class cls) {
+    if (!numThreads) {
+        job();
+        return;
+    }
+
+    job_function_task *task = make_function_task(counter, std::move(job), cls);
+    {
+        std::lock_guard<std::mutex> guard(dependency.lock);
+        if (dependency.pending.load(std::memory_order_acquire) != 0) {
+            dependency.continuations.push_back(task);
+            return;
+        }
+    }
+    push_task(task);
 }
 
-void job::execute(const std::function<void()>& job) {
-    // The main thread label state is updated:
-    currentLabel += 1;
+void job::execute_after_all(job_counter *const *dependencies, size_t count, job_counter &counter, std::function<void()> job, job_class cls) {
+    if (!numThreads) {
+        job();
+        return;
+    }
 
-    // Try to push a new job until it is pushed successfully:
-    while (!jobPool.push_back(job)) {
-        poll();
+    // 多算一个 全部登记完之前不会启动
+    auto join = std::make_shared<job_join>();
+    join->remaining.store(count + 1, std::memory_order_relaxed);
+    join->task = make_function_task(counter, std::move(job), cls);
+    for (size_t i = 0; i < count; i++) {
+        job_counter &dependency = *dependencies[i];
+        std::lock_guard<std::mutex> guard(dependency.lock);
+        if (dependency.pending.load(std::memory_order_acquire) != 0) {
+            job_join_task *jt = new job_join_task;
+            jt->run = run_join_task;
+            jt->counter = nullptr;
+            jt->cls = job_class::tick;
+            jt->join = join;
+            dependency.continuations.push_back(jt);
+        } else {
+            join->remaining.fetch_sub(1, std::memory_order_relaxed);
+        }
     }
+    arrive(*join);
+}
 
-    wakeCondition.notify_one();  // wake one thread
+job_inbox::~job_inbox() { wait(); }
+
+void job_inbox::post(std::function<void()> f) {
+    outstanding.fetch_add(1, std::memory_order_relaxed);
+    enqueue(std::move(f));
 }
 
-bool job::is_busy() {
-    // Whenever the main thread label is not reached by the workers, it indicates that some worker is still alive
-    return finishedLabel.load() < currentLabel;
+void job_inbox::enqueue(std::function<void()> f) {
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push_back(std::move(f));
 }
 
-void job::wait() {
-    while (is_busy()) {
-        poll();
+uint32_t job_inbox::run(uint32_t max) {
+    uint32_t ran = 0;
+    while (ran < max) {
+        std::function<void()> f;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (queue.empty()) break;
+            f = std::move(queue.front());
+            queue.pop_front();
+        }
+        f();
+        outstanding.fetch_sub(1, std::memory_order_release);
+        ran++;
     }
+    return ran;
 }
 
-void job::dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(job_dispatch_args)>& job) {
+void job_inbox::wait() { job::wait(posting); }
+
+job_inbox &job::main_inbox() {
+    static job_inbox inbox;
+    return inbox;
+}
+
+void job::dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(job_dispatch_args)> &job) {
     if (jobCount == 0 || groupSize == 0) {
         return;
     }
@@ -155,12 +560,9 @@ void job::dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<vo
     // Calculate the amount of job groups to dispatch (overestimate, or "ceil"):
     const uint32_t groupCount = (jobCount + groupSize - 1) / groupSize;
 
-    // The main thread label state is updated:
-    currentLabel += groupCount;
-
     for (uint32_t groupIndex = 0; groupIndex < groupCount; ++groupIndex) {
         // For each group, generate one real job:
-        const auto& jobGroup = [jobCount, groupSize, job, groupIndex]() {
+        execute(defaultCounter, [jobCount, groupSize, job, groupIndex]() {
             // Calculate the current group's offset into the jobs:
             const uint32_t groupJobOffset = groupIndex * groupSize;
             const uint32_t groupJobEnd = std::min(groupJobOffset + groupSize, jobCount);
@@ -173,14 +575,53 @@ void job::dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<vo
                 args.jobIndex = i;
                 job(args);
             }
-        };
+        });
+    }
+}
 
-        // Try to push a new job until it is pushed successfully:
-        while (!jobPool.push_back(jobGroup)) {
-            poll();
-        }
+void job::parallel_for_impl(uint32_t count, uint32_t grain, void (*fn)(void *, uint32_t), void *ctx) {
+    if (count == 0) return;
+    grain = std::max(grain, 1u);
+
+    job_range range;
+    range.fn = fn;
+    range.ctx = ctx;
+    range.count = count;
+    range.grain = grain;
+
+    // 只为其他线程各准备一个帮手任务 它们从 range 中自行领取下标
+    uint32_t blocks = (count + grain - 1) / grain;
+    uint32_t numHelpers = numThreads ? std::min(active_workers() - 1, blocks - 1) : 0;
+    job_range_task helpers[MAX_WORKERS];
+    range.helpers.store(numHelpers, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < numHelpers; i++) {
+        helpers[i].run = run_range_task;
+        helpers[i].counter = nullptr;
+        helpers[i].cls = job_class::tick;
+        helpers[i].range = &range;
+        push_task(&helpers[i]);
+    }
 
-        wakeCondition.notify_one();  // wake one thread
+    run_range(&range);
+
+    // 没被领走的帮手任务还在队列里 边等边执行其他任务
+    while (range.helpers.load(std::memory_order_acquire) != 0) {
+        if (!run_one(workerIndex)) std::this_thread::yield();
+    }
+}
+
+void job::wait(job_counter &counter) {
+    // 只有一个线程 (或只有主线程在工作) 时没有空闲 worker 能执行后台任务 只能自己来
+    while (!counter.done()) {
+        if (!run_one(workerIndex, active_workers() <= 1)) std::this_thread::yield();
     }
+
+    // finish() 可能刚递减完还持有锁
+    std::lock_guard<std::mutex> guard(counter.lock);
 }
-}  // namespace ME
\ No newline at end of file
+
+bool job::is_busy() { return !defaultCounter.done(); }
+
+void job::wait() { wait(defaultCounter); }
+
+}  // namespace ME
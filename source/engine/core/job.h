@@ -1,12 +1,40 @@
-
 #ifndef ME_JOB_H
 #define ME_JOB_H
 
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
 
 namespace ME {
 
-// https://turanszkij.wordpress.com/2018/11/24/simple-job-system-using-standard-c/
+// Engine-wide work-stealing job system
+// One worker per hardware thread, the thread that calls init() is worker 0.
+// Every worker owns a lock-free deque (Chase-Lev): it pushes and pops jobs at the bottom,
+// idle workers steal from the top of the others. Threads waiting on a job_counter keep
+// executing jobs instead of blocking, so waits can be nested inside jobs.
+
+// Scheduling class of a job, highest priority first.
+// tick and render jobs are foreground work: render ones are taken only when no tick job is queued.
+// generation, io and save are background work, taken in that order by idle workers and never by waiting threads.
+enum class job_class : uint8_t { tick = 0, render, generation, io, save };
+
+// Where the workers run, see job::set_placement()
+struct job_placement {
+    // On hybrid CPUs keep one worker per performance CPU on the performance cores for tick work,
+    // the rest on the efficiency cores where they take background work first
+    bool hybrid = true;
+    // Pin every worker to a single logical CPU instead of a core kind. The main thread is never pinned to one CPU.
+    bool pin = false;
+    // OS priority from the worker's class: tick workers above normal, background-first ones below
+    bool priorities = true;
+};
 
 // A Dispatched job will receive this as function argument:
 struct job_dispatch_args {
@@ -14,27 +42,291 @@ struct job_dispatch_args {
     uint32_t groupIndex;
 };
 
+struct job_task;
+struct job_detail;
+class job_inbox;
+
+// Counts outstanding jobs. It is also the edge type of the task graph:
+// jobs queued with execute_after() are started once the counter drops to zero.
+class job_counter {
+public:
+    job_counter() = default;
+    ~job_counter() = default;
+
+    job_counter(const job_counter &) = delete;
+    job_counter &operator=(const job_counter &) = delete;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class job;
+    friend struct job_detail;
+
+    void finish();
+
+    std::atomic<uint32_t> pending{0};
+    std::mutex lock;
+    std::vector<job_task *> continuations;
+};
+
+// Result of job::async(), the job_system analogue of std::future
+template <typename R>
+class job_future {
+public:
+    job_future() = default;
+
+    bool valid() const { return state != nullptr; }
+    bool ready() const { return state->counter.done(); }
+    void wait() const;
+    R get();
+
+    // Use as dependency of job::execute_after() / job::async()
+    job_counter &counter() { return state->counter; }
+
+    // Continuations. The value is moved into f, get() must not be called afterwards and only one continuation may be attached.
+    // then(): run f(value) as a job once this future is ready, returns the future of its result
+    template <typename F>
+    auto then(F &&f, job_class cls = job_class::tick) -> job_future<decltype(f(std::declval<R>()))>;
+
+    // then_on(): queue f(value) on inbox once this future is ready, f runs on the thread that calls inbox.run()
+    template <typename F>
+    void then_on(job_inbox &inbox, F &&f);
+
+    // then_main(): then_on() the main thread inbox, drained once per frame
+    template <typename F>
+    void then_main(F &&f);
+
+private:
+    friend class job;
+
+    struct shared {
+        job_counter counter;
+        std::optional<R> value;
+    };
+    std::shared_ptr<shared> state;
+};
+
+// Continuations waiting to run on one particular thread, usually the main thread
+// Jobs post into it (job_future::then_on() or post()) without blocking, the owner executes them in posting order with run().
+// Polling every pending future each frame becomes one run() call that only touches finished work.
+// Destroying an inbox waits for posts that are still on their way, queued continuations are dropped without running.
+class job_inbox {
+public:
+    job_inbox() = default;
+    ~job_inbox();
+
+    job_inbox(const job_inbox &) = delete;
+    job_inbox &operator=(const job_inbox &) = delete;
+
+    // Thread safe
+    void post(std::function<void()> f);
+
+    // Run at most max queued continuations on the calling thread, returns how many ran.
+    // Continuations may attach new ones to this inbox.
+    uint32_t run(uint32_t max = ~0u);
+
+    // Block until every continuation attached with then_on() is queued, run() them afterwards to finish the work
+    void wait();
+
+    // Continuations attached or posted but not run yet
+    uint32_t pending() const { return outstanding.load(std::memory_order_acquire); }
+
+private:
+    template <typename R>
+    friend class job_future;
+
+    // post() without counting, then_on() counted when attaching
+    void enqueue(std::function<void()> f);
+
+    std::mutex lock;
+    std::deque<std::function<void()>> queue;
+    // then_on() jobs that did not post yet
+    job_counter posting;
+    std::atomic<uint32_t> outstanding{0};
+};
+
 class job {
 public:
-    // Create the internal resources such as worker threads, etc. Call it once when initializing the application.
+    static constexpr uint32_t MAX_WORKERS = 64;
+
+    // Create the worker threads. Call it once when initializing the application.
     static void init();
 
-    // Add a job to execute asynchronously. Any idle thread will execute this job.
-    static void execute(const std::function<void()>& job);
+    // Join the worker threads. All pending jobs must have been waited for.
+    static void shutdown();
+
+    // Number of workers including the main thread
+    static uint32_t worker_count();
+
+    // Index of the calling thread in [0, worker_count()), ~0u for threads outside of the job system
+    static uint32_t worker_index();
+
+    // Let only workers [0, limit) take jobs, for perf experiments. 0 means all workers.
+    // The other workers sleep until the limit is raised, jobs already in their deques are stolen.
+    // worker_count() is not affected.
+    static void set_active_workers(uint32_t limit);
+    static uint32_t active_workers();
+
+    // Place the workers on the CPU topology (thread_topology.hpp) and set their OS priority.
+    // Nothing is changed before the first call. Call it from the main thread, which applies it to itself right away,
+    // the other workers before their next job.
+    static void set_placement(const job_placement &placement);
+    static job_placement placement();
+
+    // Class worker index was placed for: tick, or generation for background-first workers on efficiency cores
+    static job_class worker_class(uint32_t index);
+
+    // Add a job to execute asynchronously. Tracked by is_busy() / wait().
+    static void execute(const std::function<void()> &job);
+
+    // Add a job to execute asynchronously, counter is signaled when it finished
+    static void execute(job_counter &counter, std::function<void()> job, job_class cls = job_class::tick);
+
+    // Long running job (disk io, generation, saving). Only picked up by idle workers, never by waiting threads.
+    static void execute_background(job_counter &counter, std::function<void()> job, job_class cls = job_class::io);
+
+    // Same as execute() but the job is started only after dependency is signaled
+    static void execute_after(job_counter &dependency, job_counter &counter, std::function<void()> job, job_class cls = job_class::tick);
+
+    // Run a job asynchronously and keep its result, optionally after another job (task graph edge)
+    template <typename F>
+    static auto async(F &&f, job_counter *after = nullptr, job_class cls = job_class::tick) -> job_future<decltype(f())>;
+
+    // Same as execute_after() but started once all count dependencies are signaled
+    static void execute_after_all(job_counter *const *dependencies, size_t count, job_counter &counter, std::function<void()> job, job_class cls = job_class::tick);
+
+    // Future of all results in input order, ready once every input is. The inputs are consumed like job_future::then().
+    template <typename R>
+    static auto when_all(std::vector<job_future<R>> futures, job_class cls = job_class::tick) -> job_future<std::vector<R>>;
+
+    // Continuations for the main thread, the game loop runs them once per frame
+    static job_inbox &main_inbox();
 
     // Divide a job onto multiple jobs and execute in parallel.
     //  jobCount    : how many jobs to generate for this task.
     //  groupSize   : how many jobs to execute per thread. Jobs inside a group execute serially. It might be worth to increase for small jobs
     //  func        : receives a JobDispatchArgs as parameter
-    static void dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(job_dispatch_args)>& job);
+    static void dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(job_dispatch_args)> &job);
+
+    // Call f(i) for every i in [0, count) on all workers and return when all are done.
+    // Indices are handed out in blocks of grain, the calling thread takes part. Does not allocate.
+    template <typename F>
+    static void parallel_for(uint32_t count, uint32_t grain, F &&f);
 
-    // Check if any threads are working currently or not
+    // Execute other jobs until counter is signaled
+    static void wait(job_counter &counter);
+
+    // Check if any job added by execute(job) / dispatch() is not finished yet
     static bool is_busy();
 
-    // Wait until all threads become idle
+    // Wait until all jobs added by execute(job) / dispatch() are finished
     static void wait();
+
+private:
+    static void parallel_for_impl(uint32_t count, uint32_t grain, void (*fn)(void *, uint32_t), void *ctx);
 };
 
+// One slot per worker, padded to a cache line
+// Output buffers for parallel_for(): every job appends to local() without locking and the
+// caller merges the slots with for_each() after the barrier. Buffers keep their capacity.
+// Threads outside of the job system share one extra slot, only one of them may use it at a time.
+template <typename T>
+class job_worker_local {
+public:
+    T &local() {
+        const uint32_t i = job::worker_index();
+        return slots[i < job::MAX_WORKERS ? i : job::MAX_WORKERS].value;
+    }
+
+    template <typename F>
+    void for_each(F &&f) {
+        for (uint32_t i = 0, n = job::worker_count(); i < n; i++) f(slots[i].value);
+        f(slots[job::MAX_WORKERS].value);
+    }
+
+private:
+    struct alignas(64) slot {
+        T value;
+    };
+    slot slots[job::MAX_WORKERS + 1];
+};
+
+template <typename R>
+void job_future<R>::wait() const {
+    job::wait(state->counter);
+}
+
+template <typename R>
+R job_future<R>::get() {
+    job::wait(state->counter);
+    return std::move(*state->value);
+}
+
+template <typename F>
+auto job::async(F &&f, job_counter *after, job_class cls) -> job_future<decltype(f())> {
+    using R = decltype(f());
+    static_assert(!std::is_void_v<R>, "use job::execute(counter, job) for jobs without result");
+
+    job_future<R> future;
+    future.state = std::make_shared<typename job_future<R>::shared>();
+
+    // the job keeps the shared state alive until the counter is signaled
+    auto run = [state = future.state, f = std::forward<F>(f)]() mutable { state->value.emplace(f()); };
+    if (after) {
+        execute_after(*after, future.state->counter, std::move(run), cls);
+    } else {
+        execute(future.state->counter, std::move(run), cls);
+    }
+    return future;
+}
+
+template <typename R>
+template <typename F>
+auto job_future<R>::then(F &&f, job_class cls) -> job_future<decltype(f(std::declval<R>()))> {
+    return job::async([state = state, f = std::forward<F>(f)]() mutable { return f(std::move(*state->value)); }, &state->counter, cls);
+}
+
+template <typename R>
+template <typename F>
+void job_future<R>::then_on(job_inbox &inbox, F &&f) {
+    inbox.outstanding.fetch_add(1, std::memory_order_relaxed);
+    job::execute_after(state->counter, inbox.posting, [&inbox, state = state, f = std::forward<F>(f)]() mutable {
+        inbox.enqueue([state, f = std::move(f)]() mutable { f(std::move(*state->value)); });
+    });
+}
+
+template <typename R>
+template <typename F>
+void job_future<R>::then_main(F &&f) {
+    then_on(job::main_inbox(), std::forward<F>(f));
+}
+
+template <typename R>
+auto job::when_all(std::vector<job_future<R>> futures, job_class cls) -> job_future<std::vector<R>> {
+    job_future<std::vector<R>> all;
+    all.state = std::make_shared<typename job_future<std::vector<R>>::shared>();
+
+    std::vector<job_counter *> dependencies;
+    dependencies.reserve(futures.size());
+    for (auto &f : futures) dependencies.push_back(&f.counter());
+
+    auto gather = [state = all.state, futures = std::move(futures)]() mutable {
+        std::vector<R> values;
+        values.reserve(futures.size());
+        for (auto &f : futures) values.push_back(std::move(*f.state->value));
+        state->value.emplace(std::move(values));
+    };
+    execute_after_all(dependencies.data(), dependencies.size(), all.state->counter, std::move(gather), cls);
+    return all;
+}
+
+template <typename F>
+void job::parallel_for(uint32_t count, uint32_t grain, F &&f) {
+    using Fn = std::remove_reference_t<F>;
+    auto thunk = [](void *ctx, uint32_t i) { (*static_cast<Fn *>(ctx))(i); };
+    parallel_for_impl(count, grain, thunk, (void *)&f);
+}
+
 }  // namespace ME
 
 #endif  // !ME_JOB_H
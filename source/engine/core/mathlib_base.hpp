@@ -16,11 +16,18 @@
 #include <vector>
 
 #include "engine/core/basic_types.h"
+#include "engine/core/cpu_dispatch.hpp"
 #include "engine/core/macros.hpp"
 
-// if you wish NOT to use SSE3 SIMD intrinsics, simply change the
-// #define to 0
+// if you wish NOT to use SSE3 SIMD intrinsics, define MATH_USE_SSE to 0
+// off on non-x86 targets (ARM), the runtime-dispatched kernels live in cpu_dispatch.hpp
+#ifndef MATH_USE_SSE
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
 #define MATH_USE_SSE 1
+#else
+#define MATH_USE_SSE 0
+#endif
+#endif
 #if MATH_USE_SSE
 #include <pmmintrin.h>
 #include <xmmintrin.h>
@@ -764,6 +771,202 @@ MATH_INLINE MEvec4 MATH_PREFIX(vec4_max)(MEvec4 v1, MEvec4 v2) {
     return result;
 }
 
+//----------------------------------------------------------------------//
+// BATCH VECTOR FUNCTIONS:
+
+// these work on arrays of MEvec2 (x0, y0, x1, y1, ...), with MATH_USE_SSE
+// two points are processed per register. in and out may be the same array.
+// the SSE loops follow cpu::level(), perf_kernel scalar runs only the scalar loops
+
+// transform: out[i] = (rot.x * x - rot.y * y, rot.y * x + rot.x * y) + offset
+// where rot = (cos, sin) of the angle
+
+MATH_INLINE void MATH_PREFIX(vec2_transform_batch)(const MEvec2 *in, MEvec2 *out, size_t count, MEvec2 rot, MEvec2 offset) {
+    size_t i = 0;
+
+#if MATH_USE_SSE
+
+    if (cpu::allows(simd_level::sse2)) {
+        const __m128 c = _mm_set1_ps(rot.x);
+        const __m128 s = _mm_setr_ps(-rot.y, rot.y, -rot.y, rot.y);
+        const __m128 t = _mm_setr_ps(offset.x, offset.y, offset.x, offset.y);
+        for (; i + 2 <= count; i += 2) {
+            __m128 p = _mm_loadu_ps(&in[i].x);
+            __m128 swapped = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1));
+            _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, c), _mm_mul_ps(swapped, s)), t));
+        }
+    }
+
+#endif
+
+    for (; i < count; i++) {
+        const float x = in[i].x, y = in[i].y;
+        out[i].x = (x * rot.x + y * -rot.y) + offset.x;
+        out[i].y = (y * rot.x + x * rot.y) + offset.y;
+    }
+}
+
+// bounds: lower and upper corner of the points, count must not be zero
+
+MATH_INLINE void MATH_PREFIX(vec2_aabb_batch)(const MEvec2 *in, size_t count, MEvec2 *lower, MEvec2 *upper) {
+    MEvec2 lo = in[0], hi = in[0];
+    size_t i = 0;
+
+#if MATH_USE_SSE
+
+    if (count >= 2 && cpu::allows(simd_level::sse2)) {
+        __m128 vlo = _mm_loadu_ps(&in[0].x);
+        __m128 vhi = vlo;
+        for (i = 2; i + 2 <= count; i += 2) {
+            __m128 p = _mm_loadu_ps(&in[i].x);
+            vlo = _mm_min_ps(vlo, p);
+            vhi = _mm_max_ps(vhi, p);
+        }
+        vlo = _mm_min_ps(vlo, _mm_movehl_ps(vlo, vlo));
+        vhi = _mm_max_ps(vhi, _mm_movehl_ps(vhi, vhi));
+        _mm_storel_pi((__m64 *)&lo.x, vlo);
+        _mm_storel_pi((__m64 *)&hi.x, vhi);
+    }
+
+#endif
+
+    for (; i < count; i++) {
+        lo = MATH_PREFIX(vec2_min)(lo, in[i]);
+        hi = MATH_PREFIX(vec2_max)(hi, in[i]);
+    }
+
+    *lower = lo;
+    *upper = hi;
+}
+
+// distance to segment: index of the point furthest from segment ab, the first one on ties.
+// the distance is written to *distance. a zero length segment measures from a
+
+MATH_INLINE size_t MATH_PREFIX(vec2_furthest_from_segment_batch)(const MEvec2 *in, size_t count, MEvec2 a, MEvec2 b, float *distance) {
+    const float cx = b.x - a.x;
+    const float cy = b.y - a.y;
+    const float lenSq = cx * cx + cy * cy;
+
+    float best = -1.0f;
+    size_t bestIndex = 0;
+    size_t i = 0;
+
+#if MATH_USE_SSE
+
+    if (count >= 4 && cpu::allows(simd_level::sse2)) {
+        const __m128 ax = _mm_set1_ps(a.x), ay = _mm_set1_ps(a.y);
+        const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy);
+        const __m128 vlen = _mm_set1_ps(lenSq);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 valid = _mm_cmpneq_ps(vlen, zero);
+
+        __m128 vbest = _mm_set1_ps(-1.0f);
+        __m128i vbestIndex = _mm_setzero_si128();
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i step = _mm_set1_epi32(4);
+
+        for (; i + 4 <= count; i += 4) {
+            __m128 p0 = _mm_loadu_ps(&in[i].x);
+            __m128 p1 = _mm_loadu_ps(&in[i + 2].x);
+            __m128 px = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 py = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+
+            __m128 dx = _mm_sub_ps(px, ax);
+            __m128 dy = _mm_sub_ps(py, ay);
+            __m128 param = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, vcx), _mm_mul_ps(dy, vcy)), vlen);
+            param = _mm_and_ps(_mm_min_ps(_mm_max_ps(param, zero), one), valid);
+            dx = _mm_sub_ps(dx, _mm_mul_ps(param, vcx));
+            dy = _mm_sub_ps(dy, _mm_mul_ps(param, vcy));
+            __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+            __m128 better = _mm_cmpgt_ps(d, vbest);
+            vbest = _mm_or_ps(_mm_and_ps(better, d), _mm_andnot_ps(better, vbest));
+            __m128i betteri = _mm_castps_si128(better);
+            vbestIndex = _mm_or_si128(_mm_and_si128(betteri, index), _mm_andnot_si128(betteri, vbestIndex));
+            index = _mm_add_epi32(index, step);
+        }
+
+        float lanes[4];
+        int32_t lanesIndex[4];
+        _mm_storeu_ps(lanes, vbest);
+        _mm_storeu_si128((__m128i *)lanesIndex, vbestIndex);
+        for (int l = 0; l < 4; l++) {
+            if (lanes[l] > best || (lanes[l] == best && (size_t)lanesIndex[l] < bestIndex)) {
+                best = lanes[l];
+                bestIndex = (size_t)lanesIndex[l];
+            }
+        }
+    }
+
+#endif
+
+    for (; i < count; i++) {
+        float dx = in[i].x - a.x;
+        float dy = in[i].y - a.y;
+        float param = 0.0f;
+        if (lenSq != 0.0f) param = MATH_MIN(MATH_MAX((dx * cx + dy * cy) / lenSq, 0.0f), 1.0f);
+        dx -= param * cx;
+        dy -= param * cy;
+        const float d = dx * dx + dy * dy;
+        if (d > best) {
+            best = d;
+            bestIndex = i;
+        }
+    }
+
+    *distance = best < 0.0f ? 0.0f : MATH_SQRTF(best);
+    return bestIndex;
+}
+
+// steering for struct-of-arrays particles: where force[i] is not zero, v[i] += normalize(target[i] - p[i]) * force[i],
+// then v[i] *= damping if the target is closer than nearDistance
+
+MATH_INLINE void MATH_PREFIX(vec2_steer_soa)(float *vx, float *vy, const float *px, const float *py, const float *tx, const float *ty, const float *force, size_t count, float nearDistance,
+                                             float damping) {
+    size_t i = 0;
+
+#if MATH_USE_SSE
+
+    if (cpu::allows(simd_level::sse2)) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 vnear = _mm_set1_ps(nearDistance);
+        const __m128 vdamping = _mm_set1_ps(damping);
+        for (; i + 4 <= count; i += 4) {
+            __m128 f = _mm_loadu_ps(force + i);
+            __m128 active = _mm_cmpneq_ps(f, zero);
+            if (_mm_movemask_ps(active) == 0) continue;
+
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(tx + i), _mm_loadu_ps(px + i));
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(ty + i), _mm_loadu_ps(py + i));
+            __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+            __m128 nvx = _mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(_mm_div_ps(dx, len), f));
+            __m128 nvy = _mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(_mm_div_ps(dy, len), f));
+            __m128 close = _mm_cmplt_ps(len, vnear);
+            nvx = _mm_or_ps(_mm_and_ps(close, _mm_mul_ps(nvx, vdamping)), _mm_andnot_ps(close, nvx));
+            nvy = _mm_or_ps(_mm_and_ps(close, _mm_mul_ps(nvy, vdamping)), _mm_andnot_ps(close, nvy));
+
+            _mm_storeu_ps(vx + i, _mm_or_ps(_mm_and_ps(active, nvx), _mm_andnot_ps(active, _mm_loadu_ps(vx + i))));
+            _mm_storeu_ps(vy + i, _mm_or_ps(_mm_and_ps(active, nvy), _mm_andnot_ps(active, _mm_loadu_ps(vy + i))));
+        }
+    }
+
+#endif
+
+    for (; i < count; i++) {
+        if (force[i] == 0.0f) continue;
+        const float dx = tx[i] - px[i];
+        const float dy = ty[i] - py[i];
+        const float len = MATH_SQRTF(dx * dx + dy * dy);
+        vx[i] += dx / len * force[i];
+        vy[i] += dy / len * force[i];
+        if (len < nearDistance) {
+            vx[i] *= damping;
+            vy[i] *= damping;
+        }
+    }
+}
+
 //----------------------------------------------------------------------//
 // MATRIX FUNCTIONS:
 
@@ -14,6 +14,7 @@
 #include "engine/core/sdl_wrapper.h"
 #include "engine/engine.hpp"
 #include "engine/renderer/renderer_gpu.h"
+#include "engine/world_archive.hpp"
 #include "game/player.hpp"
 #include "libs/glad/glad.h"
 
@@ -53,6 +54,17 @@ int ParseRunArgs(int argc, char *argv[]) {
                 }
                 return RUNNER_EXIT;
 
+            } else if (!strcmp(v1, "exportworld") || !strcmp(v1, "importworld")) {
+                if (argc != 4) {
+                    printf("Incorrect parameters\n");
+                    return METADOT_FAILED;
+                }
+
+                // exportworld <世界目录> <包> importworld <包> <世界目录>
+                const bool ok = !strcmp(v1, "exportworld") ? WorldArchive::export_world(argv[2], argv[3], true) : WorldArchive::import_world(argv[2], argv[3], true);
+
+                return ok ? RUNNER_EXIT : METADOT_FAILED;
+
             } else if (!strcmp(v1, "packinfo")) {
                 if (argc != 3) {
                     printf("Incorrect parameters\n");
@@ -332,10 +344,12 @@ void ME_win_set_windowflash(E_WindowFlashaction action, int count, int period) {
 }
 
 void ME_set_vsync(bool vsync) {
-    SDL_GL_SetSwapInterval(vsync ? 1 : 0);
+    ME_set_swap_interval(vsync ? 1 : 0);
     // GameUI::OptionsUI::vsync = vsync;
 }
 
+bool ME_set_swap_interval(int interval) { return SDL_GL_SetSwapInterval(interval) == 0; }
+
 void ME_win_set_minimize_onlostfocus(bool minimize) { SDL_SetHint(SDL_HINT_VIDEO_MINIMIZE_ON_FOCUS_LOSS, minimize ? "1" : "0"); }
 
 void ME_win_set_windowtitle(const char *title) { SDL_SetWindowTitle(the<engine>().eng()->window, title); }
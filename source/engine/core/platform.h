@@ -180,6 +180,8 @@ void ME_endwindow();
 void ME_win_set_displaymode(E_DisplayMode mode);
 void ME_win_set_windowflash(E_WindowFlashaction action, int count, int period);
 void ME_set_vsync(bool vsync);
+// interval 为 -1 时是自适应垂直同步 (赶不上刷新时直接交换) 驱动不支持时返回 false
+bool ME_set_swap_interval(int interval);
 void ME_win_set_minimize_onlostfocus(bool minimize);
 void ME_win_set_windowtitle(const char* title);
 char* ME_clipboard_get();
@@ -3,9 +3,12 @@
 
 // #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -83,9 +86,182 @@ struct string_store {
 
 ME::profiler::profiler_context *g_context = 0;
 
-void ME_profiler_init() { g_context = new ME::profiler::profiler_context(); }
+// GPU 时间戳查询
+// 每个范围在开始和结束各写一个 GL_TIMESTAMP 嵌套的范围互不影响
+// 查询按 GPU_QUERY_COUNT 帧轮换 读取时结果通常已经可用 还没有可用就放弃那一帧 不等待 GPU
+struct profiler_gpu_context {
+    struct frame {
+        GLuint m_queries[GPU_SCOPES_MAX * 2];
+        const char *m_names[GPU_SCOPES_MAX];
+        u32 m_levels[GPU_SCOPES_MAX];
+        u32 m_numScopes = 0;
+        bool m_pending = false;
+    };
+
+    bool m_initialized = false;
+    bool m_supported = false;
+    bool m_enabled = false;
+    bool m_recording = false;
+    u32 m_current = 0;
+    u32 m_level = 0;
+    frame m_frames[GPU_QUERY_COUNT];
+
+    profiler_gpu_scope m_display[GPU_SCOPES_MAX];
+    u32 m_numDisplay = 0;
+
+    // 世界渲染的总耗时 一直记录 与是否显示分析器无关
+    // 只用一个 GL_TIME_ELAPSED 查询 不需要像范围那样每段都 flush
+    GLuint m_renderQueries[GPU_QUERY_COUNT];
+    bool m_renderPending[GPU_QUERY_COUNT] = {};
+    u32 m_renderCurrent = 0;
+    bool m_renderOpen = false;
+    f32 m_renderTime = -1.0f;
+
+    void init() {
+        m_initialized = true;
+        // GL_TIMESTAMP 和 GL_TIME_ELAPSED 是 3.3 核心功能
+        m_supported = GLAD_GL_VERSION_3_3 != 0;
+        if (!m_supported) return;
+        for (frame &f : m_frames) glGenQueries(GPU_SCOPES_MAX * 2, f.m_queries);
+        glGenQueries(GPU_QUERY_COUNT, m_renderQueries);
+    }
+
+    void shutdown() {
+        if (m_supported) {
+            for (frame &f : m_frames) glDeleteQueries(GPU_SCOPES_MAX * 2, f.m_queries);
+            glDeleteQueries(GPU_QUERY_COUNT, m_renderQueries);
+        }
+        m_initialized = m_supported = false;
+        m_renderOpen = false;
+        m_renderTime = -1.0f;
+        for (bool &p : m_renderPending) p = false;
+    }
+
+    void render_begin() {
+        if (!m_initialized) init();
+        if (!m_supported || m_renderOpen) return;
+
+        // 轮到的查询是最早发出的那个 还没有结果就不记录这一帧
+        const u32 index = m_renderCurrent;
+        if (m_renderPending[index]) {
+            GLint available = 0;
+            glGetQueryObjectiv(m_renderQueries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) return;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(m_renderQueries[index], GL_QUERY_RESULT, &elapsed);
+            m_renderTime = (f32)((f64)elapsed / 1000000.0);
+            m_renderPending[index] = false;
+        }
+
+        R_FlushBlitBuffer();
+        glBeginQuery(GL_TIME_ELAPSED, m_renderQueries[index]);
+        m_renderOpen = true;
+    }
+
+    void render_end() {
+        if (!m_renderOpen) return;
+
+        R_FlushBlitBuffer();
+        glEndQuery(GL_TIME_ELAPSED);
+        m_renderPending[m_renderCurrent] = true;
+        m_renderCurrent = (m_renderCurrent + 1) % GPU_QUERY_COUNT;
+        m_renderOpen = false;
+    }
+
+    // 读取 f 的结果 还没有完成时返回 false
+    bool resolve(frame &f, bool publish) {
+        if (!f.m_pending) return true;
+
+        GLint available = 0;
+        glGetQueryObjectiv(f.m_queries[f.m_numScopes * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+
+        if (publish) {
+            GLuint64 first = 0;
+            glGetQueryObjectui64v(f.m_queries[0], GL_QUERY_RESULT, &first);
+            for (u32 i = 0; i < f.m_numScopes; ++i) {
+                GLuint64 start = 0, end = 0;
+                glGetQueryObjectui64v(f.m_queries[i * 2], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(f.m_queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+                profiler_gpu_scope &scope = m_display[i];
+                scope.m_name = f.m_names[i];
+                scope.m_level = f.m_levels[i];
+                scope.m_start = (f32)((f64)(start - first) / 1000000.0);
+                scope.m_time = (f32)((f64)(end - start) / 1000000.0);
+            }
+            m_numDisplay = f.m_numScopes;
+        }
+
+        f.m_pending = false;
+        return true;
+    }
+
+    void begin_frame(bool publish) {
+        if (!m_initialized) init();
+        if (!m_supported) return;
+
+        frame &prev = m_frames[m_current];
+        if (m_recording && prev.m_numScopes > 0) prev.m_pending = true;
+
+        m_current = (m_current + 1) % GPU_QUERY_COUNT;
+        m_level = 0;
+
+        if (!m_enabled) {
+            m_recording = false;
+            m_numDisplay = 0;
+            return;
+        }
+
+        frame &f = m_frames[m_current];
+        m_recording = resolve(f, publish);
+        if (m_recording) f.m_numScopes = 0;
+    }
+
+    uintptr_t begin_scope(const char *_name) {
+        if (!m_recording) return 0;
+        frame &f = m_frames[m_current];
+        if (f.m_numScopes == GPU_SCOPES_MAX) return 0;
+
+        // 之前提交的绘制不算在这个范围里
+        R_FlushBlitBuffer();
+
+        u32 index = f.m_numScopes++;
+        f.m_names[index] = _name;
+        f.m_levels[index] = m_level++;
+        glQueryCounter(f.m_queries[index * 2], GL_TIMESTAMP);
+        // 没有结束的范围 结束时间先用开始时间
+        glQueryCounter(f.m_queries[index * 2 + 1], GL_TIMESTAMP);
+        return index + 1;
+    }
+
+    void end_scope(uintptr_t _scopeHandle) {
+        if (!_scopeHandle || !m_recording) return;
+
+        R_FlushBlitBuffer();
+
+        frame &f = m_frames[m_current];
+        glQueryCounter(f.m_queries[(_scopeHandle - 1) * 2 + 1], GL_TIMESTAMP);
+        --m_level;
+    }
+};
+
+static profiler_gpu_context g_gpu_context;
+
+// 分析器初始化之前注册的线程 (job 的工作线程先于分析器启动)
+static std::mutex g_pendingThreadsMutex;
+static std::map<u64, std::string> g_pendingThreads;
+
+void ME_profiler_init() {
+    g_context = new ME::profiler::profiler_context();
+
+    std::lock_guard<std::mutex> guard(g_pendingThreadsMutex);
+    for (auto &[id, name] : g_pendingThreads) g_context->register_thread(id, name.c_str());
+    g_pendingThreads.clear();
+}
 
 void ME_profiler_shutdown() {
+    g_gpu_context.shutdown();
     delete g_context;
     g_context = 0;
 }
@@ -95,16 +271,159 @@ void ME_profiler_set_threshold(f32 _ms, int _level) { g_context->set_threshold(_
 void ME_profiler_register_thread(const char *_name, u64 _threadID) {
     if (_threadID == 0) _threadID = ME_get_thread_id();
 
+    if (!g_context) {
+        std::lock_guard<std::mutex> guard(g_pendingThreadsMutex);
+        g_pendingThreads[_threadID] = _name;
+        return;
+    }
     g_context->register_thread(_threadID, _name);
 }
 
-void ME_profiler_unregister_thread(u64 _threadID) { g_context->unregister_thread(_threadID); }
+void ME_profiler_unregister_thread(u64 _threadID) {
+    if (g_context) g_context->unregister_thread(_threadID);
+}
+
+static void stats_flush();
+
+void ME_profiler_begin_frame() {
+    stats_flush();
+    g_context->begin_frame();
+}
+
+// 没有初始化分析器时 (例如无窗口的基准) 作用域什么也不做
+uintptr_t ME_profiler_begin_scope(const char *_file, int _line, const char *_name) { return g_context ? g_context->begin_scope(_file, _line, _name) : 0; }
+
+void ME_profiler_end_scope(uintptr_t _scopeHandle) {
+    if (g_context) g_context->end_scope(_scopeHandle);
+}
+
+u64 ME_profiler_dropped_scopes() { return g_context ? g_context->dropped_scopes() : 0; }
+
+void ME_profiler_gpu_set_enabled(bool _enabled) { g_gpu_context.m_enabled = _enabled; }
+
+void ME_profiler_gpu_begin_frame() { g_gpu_context.begin_frame(!g_context->is_paused()); }
+
+uintptr_t ME_profiler_gpu_begin_scope(const char *_name) { return g_gpu_context.begin_scope(_name); }
 
-void ME_profiler_begin_frame() { g_context->begin_frame(); }
+void ME_profiler_gpu_end_scope(uintptr_t _scopeHandle) { g_gpu_context.end_scope(_scopeHandle); }
 
-uintptr_t ME_profiler_begin_scope(const char *_file, int _line, const char *_name) { return (uintptr_t)g_context->begin_ccope(_file, _line, _name); }
+void ME_profiler_gpu_render_begin() { g_gpu_context.render_begin(); }
 
-void ME_profiler_end_scope(uintptr_t _scopeHandle) { g_context->end_scope((profiler_scope *)_scopeHandle); }
+void ME_profiler_gpu_render_end() { g_gpu_context.render_end(); }
+
+f32 ME_profiler_gpu_render_time() { return g_gpu_context.m_renderTime; }
+
+static profiler_counter g_counters[ME_COUNTERS_MAX];
+static u32 g_numCounters = 0;
+static std::unordered_map<std::string, u32> g_counterIndex;
+
+void ME_profiler_counter(const char *_name, f64 _value) {
+    // trace 的连续捕获不受暂停影响
+    if (g_context) g_context->trace_counter(_name, _value);
+    if (g_context && g_context->is_paused()) return;
+
+    u32 index;
+    auto it = g_counterIndex.find(_name);
+    if (it != g_counterIndex.end()) {
+        index = it->second;
+    } else {
+        if (g_numCounters == ME_COUNTERS_MAX) return;
+        index = g_numCounters++;
+        profiler_counter &c = g_counters[index];
+        strncpy(c.m_name, _name, sizeof(c.m_name) - 1);
+        c.m_name[sizeof(c.m_name) - 1] = 0;
+        c.m_head = 0;
+        c.m_count = 0;
+        g_counterIndex.emplace(_name, index);
+    }
+
+    profiler_counter &c = g_counters[index];
+    c.m_values[c.m_head] = (f32)_value;
+    c.m_head = (c.m_head + 1) % ME_COUNTER_HISTORY;
+    if (c.m_count < ME_COUNTER_HISTORY) c.m_count++;
+}
+
+u32 ME_profiler_get_counters(const profiler_counter **_counters) {
+    *_counters = g_counters;
+    return g_numCounters;
+}
+
+void ME_profiler_reset_counters() {
+    for (u32 i = 0; i < g_numCounters; ++i) {
+        g_counters[i].m_head = 0;
+        g_counters[i].m_count = 0;
+    }
+}
+
+// 统计值分片存放 每个线程固定写一个分片 不同分片不共享缓存行
+#define ME_STAT_SHARDS 64
+
+struct alignas(64) stat_shard {
+    std::atomic<i64> m_values[ME_STATS_MAX];
+};
+
+static stat_shard g_statShards[ME_STAT_SHARDS];
+static std::atomic<i64> g_statGauges[ME_STATS_MAX];
+static std::string g_statNames[ME_STATS_MAX];
+static bool g_statIsGauge[ME_STATS_MAX];
+static std::atomic<u32> g_numStats{0};
+static std::mutex g_statsMutex;
+
+static stat_shard &local_stat_shard() {
+    static std::atomic<u32> next{0};
+    thread_local stat_shard *shard = &g_statShards[next.fetch_add(1, std::memory_order_relaxed) % ME_STAT_SHARDS];
+    return *shard;
+}
+
+u32 ME_profiler_stat_register(const char *_name, bool _gauge) {
+    std::lock_guard<std::mutex> guard(g_statsMutex);
+    const u32 count = g_numStats.load(std::memory_order_relaxed);
+    for (u32 i = 0; i < count; ++i) {
+        if (g_statNames[i] == _name) return i;
+    }
+    if (count == ME_STATS_MAX) return ~0u;
+    g_statNames[count] = _name;
+    g_statIsGauge[count] = _gauge;
+    // 名字写好之后才对 stats_flush 可见
+    g_numStats.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+void ME_profiler_stat_add(u32 _stat, i64 _delta) {
+    if (_stat < ME_STATS_MAX) local_stat_shard().m_values[_stat].fetch_add(_delta, std::memory_order_relaxed);
+}
+
+void ME_profiler_stat_set(u32 _stat, i64 _value) {
+    if (_stat < ME_STATS_MAX) g_statGauges[_stat].store(_value, std::memory_order_relaxed);
+}
+
+static void stats_flush() {
+    const u32 count = g_numStats.load(std::memory_order_acquire);
+    for (u32 i = 0; i < count; ++i) {
+        i64 value;
+        if (g_statIsGauge[i]) {
+            value = g_statGauges[i].load(std::memory_order_relaxed);
+        } else {
+            value = 0;
+            for (stat_shard &shard : g_statShards) value += shard.m_values[i].exchange(0, std::memory_order_relaxed);
+        }
+        ME_profiler_counter(g_statNames[i].c_str(), (f64)value);
+    }
+}
+
+void ME_profiler_trace_set_enabled(bool _enabled) {
+    if (g_context) g_context->trace_set_enabled(_enabled);
+}
+
+bool ME_profiler_trace_is_enabled() { return g_context && g_context->trace_is_enabled(); }
+
+u32 ME_profiler_trace_size() { return g_context ? g_context->trace_size() : 0; }
+
+void ME_profiler_trace_clear() {
+    if (g_context) g_context->trace_clear();
+}
+
+bool ME_profiler_trace_export(const char *_path) { return g_context && g_context->trace_export(_path); }
 
 int ME_profiler_is_paused() { return g_context->is_paused() ? 1 : 0; }
 
@@ -112,10 +431,8 @@ int ME_profiler_was_threshold_crossed() { return g_context->was_threshold_crosse
 
 void ME_profiler_set_paused(int _paused) { return g_context->set_paused(_paused != 0); }
 
-void ME_profiler_get_frame(profiler_frame *_data) {
-    g_context->get_frame_data(_data);
-
-    // clamp scopes crossing frame boundary
+// clamp scopes crossing frame boundary
+static void clamp_open_scopes(profiler_frame *_data) {
     const u32 numScopes = _data->m_numScopes;
     for (u32 i = 0; i < numScopes; ++i) {
         profiler_scope &cs = _data->m_scopes[i];
@@ -127,6 +444,16 @@ void ME_profiler_get_frame(profiler_frame *_data) {
     }
 }
 
+void ME_profiler_get_frame(profiler_frame *_data) {
+    g_context->get_frame_data(_data);
+    clamp_open_scopes(_data);
+}
+
+void ME_profiler_get_last_frame(profiler_frame *_data) {
+    g_context->get_last_frame_data(_data);
+    clamp_open_scopes(_data);
+}
+
 int ME_profiler_save(profiler_frame *_data, void *_buffer, size_t _bufferSize) {
     // fill string data
     string_store strStore;
@@ -213,6 +540,9 @@ void ME_profiler_load(profiler_frame *_data, void *_buffer, size_t _bufferSize)
     _data->m_scopes = new profiler_scope[_data->m_numScopes * 2];  // extra space for viewer - m_scopesStats
     _data->m_scopesStats = &_data->m_scopes[_data->m_numScopes];
     _data->m_scopeStatsInfo = new profiler_scope_stats[_data->m_numScopes * 2];
+    // 存档中没有 GPU 数据
+    _data->m_numGPUScopes = 0;
+    _data->m_gpuScopes = 0;
 
     for (u32 i = 0; i < _data->m_numScopes * 2; ++i) _data->m_scopes[i].m_stats = &_data->m_scopeStatsInfo[i];
 
@@ -247,7 +577,7 @@ void ME_profiler_load(profiler_frame *_data, void *_buffer, size_t _bufferSize)
     u32 numStrings;
     read_var(buffer, numStrings);
 
-    const char *strings[ME_SCOPES_MAX];
+    std::vector<const char *> strings(numStrings);
     for (u32 i = 0; i < numStrings; ++i) strings[i] = read_string(buffer);
 
     for (u32 i = 0; i < _data->m_numScopes; ++i) {
@@ -461,12 +791,58 @@ int ME_profiler_free_list_check_ptr(profiler_free_list_t *_freeList, void *_ptr)
 
 namespace profiler {
 
-profiler_context::profiler_context()
-    : m_scopesOpen(0), m_displayScopes(0), m_frameStartTime(0), m_frameEndTime(0), m_thresholdCrossed(false), m_timeThreshold(0.0f), m_levelThreshold(0), m_pauseProfiling(false) {
+// 线程自己的缓冲 只有所属线程写 m_records 和 m_stack m_write 由它发布
+// begin_frame 读到 m_write 为止 然后推进 m_read 两个下标只增不减 按容量取模
+struct thread_buffer {
+    struct record {
+        u64 m_start;
+        u64 m_end;
+        const char *m_name;
+        const char *m_file;
+        u32 m_line;
+        u32 m_level;
+    };
+
+    struct open_scope {
+        u64 m_start;
+        const char *m_name;
+        const char *m_file;
+        u32 m_line;
+    };
+
+    alignas(64) std::atomic<u32> m_write{0};
+    alignas(64) std::atomic<u32> m_read{0};
+    std::atomic<u64> m_dropped{0};
+    // 线程退出后置位 合并完剩下的记录后释放
+    std::atomic<bool> m_retired{false};
+
+    u64 m_threadID = 0;
+    u32 m_depth = 0;
+    open_scope m_stack[ME_SCOPE_DEPTH_MAX];
+    record m_records[ME_THREAD_SCOPES_MAX];
+};
+
+static_assert((ME_THREAD_SCOPES_MAX & (ME_THREAD_SCOPES_MAX - 1)) == 0, "ME_THREAD_SCOPES_MAX must be a power of two");
+
+// 线程退出时标记缓冲 分析器已经重新创建或关闭时缓冲已随旧的 profiler_context 释放
+struct thread_buffer_ref {
+    profiler_context *m_context = nullptr;
+    thread_buffer *m_buffer = nullptr;
+
+    ~thread_buffer_ref() {
+        if (m_buffer && m_context == g_context) m_buffer->m_retired.store(true, std::memory_order_release);
+    }
+};
 
-    m_tlsLevel = ME_tls_allocate();
+static thread_local thread_buffer_ref t_buffer;
 
-    ME_profiler_free_list_create(sizeof(profiler_scope), ME_SCOPES_MAX, &m_scopesAllocator);
+profiler_context::profiler_context()
+    : m_displayScopes(0), m_frameStartTime(0), m_frameEndTime(0), m_lastScopes(0), m_lastFrameStartTime(0), m_lastFrameEndTime(0), m_thresholdCrossed(false), m_timeThreshold(0.0f), m_levelThreshold(0), m_pauseProfiling(false), m_droppedScopes(0),
+      m_traceEnabled(false),
+      m_traceHead(0),
+      m_traceCount(0),
+      m_traceCounterHead(0),
+      m_traceCounterCount(0) {
 
     for (int i = 0; i < buffer_use::Count; ++i) {
         m_namesSize[i] = 0;
@@ -475,8 +851,7 @@ profiler_context::profiler_context()
 }
 
 profiler_context::~profiler_context() {
-    ME_profiler_free_list_destroy(&m_scopesAllocator);
-    ME_tls_free(m_tlsLevel);
+    for (thread_buffer *tb : m_threadBuffers) delete tb;
 }
 
 void profiler_context::set_threshold(f32 _ms, int _levelThreshold) {
@@ -490,9 +865,16 @@ bool profiler_context::was_threshold_crossed() { return !m_pauseProfiling && m_t
 
 void profiler_context::set_paused(bool _paused) { m_pauseProfiling = _paused; }
 
-void profiler_context::register_thread(u64 _threadID, const char *_name) { m_threadNames[_threadID] = _name; }
+// 工作线程在启动时注册 与 get_frame_data 同时进行
+void profiler_context::register_thread(u64 _threadID, const char *_name) {
+    scoped_mutex_locker lock(m_mutex);
+    m_threadNames[_threadID] = _name;
+}
 
-void profiler_context::unregister_thread(u64 _threadID) { m_threadNames.erase(_threadID); }
+void profiler_context::unregister_thread(u64 _threadID) {
+    scoped_mutex_locker lock(m_mutex);
+    m_threadNames.erase(_threadID);
+}
 
 void profiler_context::begin_frame() {
     scoped_mutex_locker lock(m_mutex);
@@ -503,110 +885,155 @@ void profiler_context::begin_frame() {
     frameEndTime = ME_profiler_get_clock();
     beginPrevFrameTime = frameEndTime;
 
-    static u64 frameTime = frameEndTime - frameBeginTime;
-
     m_thresholdCrossed = false;
 
-    int level = (int)m_levelThreshold - 1;
-
-    u32 scopesToRestart = 0;
-
-    m_namesSize[buffer_use::Open] = 0;
+    const int level = (int)m_levelThreshold - 1;
+    const f64 toMs = 1000.0 / (f64)profiler_get_clock_frequency();
 
-    static profiler_scope scopesDisplay[ME_SCOPES_MAX];
-    for (u32 i = 0; i < m_scopesOpen; ++i) {
-        profiler_scope *scope = m_scopesCapture[i];
-
-        if (scope->m_start == scope->m_end) scope->m_name = add_string(scope->m_name, buffer_use::Open);
+    m_namesSize[buffer_use::Capture] = 0;
+    u32 numScopes = 0;
 
-        scopesDisplay[i] = *scope;
+    auto add_scope = [&](u64 _start, u64 _end, u64 _threadID, const char *_name, const char *_file, u32 _line, u32 _level) {
+        // did scope cross threshold?
+        if (level == (int)_level) {
+            const u64 scopeEnd = _start == _end ? frameEndTime : _end;
+            if (m_timeThreshold <= (f32)((f64)(scopeEnd - _start) * toMs)) m_thresholdCrossed = true;
+        }
 
-        // scope that was not closed, spans frame boundary
-        // keep it for next frame
-        if (scope->m_start == scope->m_end)
-            m_scopesCapture[scopesToRestart++] = scope;
-        else {
-            ME_profiler_free_list_free(&m_scopesAllocator, scope);
-            scope = &scopesDisplay[i];
+        if (numScopes == ME_SCOPES_MAX) {
+            m_droppedScopes++;
+            return;
+        }
+        profiler_scope &scope = m_scopesFrame[numScopes++];
+        scope.m_start = _start;
+        scope.m_end = _end;
+        scope.m_threadID = _threadID;
+        scope.m_name = add_string(_name, buffer_use::Capture);
+        scope.m_file = _file;
+        scope.m_line = _line;
+        scope.m_level = _level;
+        scope.m_stats = nullptr;
+    };
+
+    for (size_t i = 0; i < m_threadBuffers.size();) {
+        thread_buffer *tb = m_threadBuffers[i];
+
+        // 先读 m_retired 之后读到的 m_write 包含线程退出前写的所有记录
+        const bool retired = tb->m_retired.load(std::memory_order_acquire);
+        const u32 write = tb->m_write.load(std::memory_order_acquire);
+        const u32 first = numScopes;
+        for (u32 r = tb->m_read.load(std::memory_order_relaxed); r != write; ++r) {
+            const thread_buffer::record &rec = tb->m_records[r & (ME_THREAD_SCOPES_MAX - 1)];
+            if (m_traceEnabled) trace_push(rec.m_start, rec.m_end, tb->m_threadID, rec.m_name, rec.m_level);
+            add_scope(rec.m_start, rec.m_end, tb->m_threadID, rec.m_name, rec.m_file, rec.m_line, rec.m_level);
+        }
+        tb->m_read.store(write, std::memory_order_release);
+        m_droppedScopes += tb->m_dropped.exchange(0, std::memory_order_relaxed);
+
+        // 调用 begin_frame 的线程上还没有结束的范围 (比如包住整个主循环的) 按开始时间显示到帧末
+        if (tb == t_buffer.m_buffer && t_buffer.m_context == this) {
+            for (u32 d = 0; d < tb->m_depth && d < ME_SCOPE_DEPTH_MAX; ++d) {
+                const thread_buffer::open_scope &o = tb->m_stack[d];
+                add_scope(o.m_start, o.m_start, tb->m_threadID, o.m_name, o.m_file, o.m_line, d);
+            }
         }
 
-        // did scope cross threshold?
-        if (level == (int)scope->m_level) {
-            u64 scopeEnd = scope->m_end;
-            if (scope->m_start == scope->m_end) scopeEnd = frameEndTime;
+        // 记录按结束的顺序写入 显示时同一线程按开始时间排列
+        std::sort(m_scopesFrame + first, m_scopesFrame + numScopes, [](const profiler_scope &a, const profiler_scope &b) { return a.m_start != b.m_start ? a.m_start < b.m_start : a.m_level < b.m_level; });
 
-            if (m_timeThreshold <= profiler_clock2ms(scopeEnd - scope->m_start, profiler_get_clock_frequency())) m_thresholdCrossed = true;
+        if (retired) {
+            delete tb;
+            m_threadBuffers[i] = m_threadBuffers.back();
+            m_threadBuffers.pop_back();
+        } else {
+            ++i;
         }
     }
 
     // did frame cross threshold ?
-    f32 prevFrameTime = profiler_clock2ms(frameEndTime - frameBeginTime, profiler_get_clock_frequency());
+    f32 prevFrameTime = (f32)((f64)(frameEndTime - frameBeginTime) * toMs);
     if ((level == -1) && (m_timeThreshold <= prevFrameTime)) m_thresholdCrossed = true;
 
     if (m_thresholdCrossed && !m_pauseProfiling) {
         std::swap(m_namesData[buffer_use::Capture], m_namesData[buffer_use::Display]);
 
-        memcpy(m_scopesDisplay, scopesDisplay, sizeof(profiler_scope) * m_scopesOpen);
+        memcpy(m_scopesDisplay, m_scopesFrame, sizeof(profiler_scope) * numScopes);
 
-        m_displayScopes = m_scopesOpen;
+        m_displayScopes = numScopes;
         m_frameStartTime = frameBeginTime;
         m_frameEndTime = frameEndTime;
     }
 
-    m_namesSize[buffer_use::Capture] = 0;
-    for (u32 i = 0; i < scopesToRestart; ++i) m_scopesCapture[i]->m_name = add_string(m_scopesCapture[i]->m_name, buffer_use::Capture);
-
-    m_scopesOpen = scopesToRestart;
-    frameTime = frameEndTime - frameBeginTime;
-}
+    m_lastScopes = numScopes;
+    m_lastFrameStartTime = frameBeginTime;
+    m_lastFrameEndTime = frameEndTime;
 
-int profiler_context::inc_level() {
-    // may be a first call on this thread
-    void *tl = ME_tls_get_value(m_tlsLevel);
-    if (!tl) {
-        // we'd like to start with -1 but then the ++ operator below
-        // would result in NULL value for tls so we offset by 2
-        tl = (void *)1;
-        ME_tls_set_value(m_tlsLevel, tl);
-    }
-    intptr_t threadLevel = (intptr_t)tl - 1;
-    ME_tls_set_value(m_tlsLevel, (void *)(threadLevel + 2));
-    return (int)threadLevel;
+    // 帧放在线程号 0 的单独一行
+    if (m_traceEnabled) trace_push(frameBeginTime, frameEndTime, 0, "Frame", 0);
 }
 
-void profiler_context::dec_level() {
-    intptr_t threadLevel = (intptr_t)ME_tls_get_value(m_tlsLevel);
-    --threadLevel;
-    ME_tls_set_value(m_tlsLevel, (void *)threadLevel);
-}
+thread_buffer *profiler_context::local_buffer() {
+    if (t_buffer.m_context == this) return t_buffer.m_buffer;
 
-profiler_scope *profiler_context::begin_ccope(const char *_file, int _line, const char *_name) {
-    profiler_scope *scope = 0;
+    // 每个线程只在第一次记录时加锁一次
+    thread_buffer *tb = new thread_buffer;
+    tb->m_threadID = ME_get_thread_id();
     {
         scoped_mutex_locker lock(m_mutex);
-        if (m_scopesOpen == ME_SCOPES_MAX) return 0;
-
-        scope = (profiler_scope *)ME_profiler_free_list_alloc(&m_scopesAllocator);
-        m_scopesCapture[m_scopesOpen++] = scope;
+        m_threadBuffers.push_back(tb);
+    }
+    t_buffer.m_context = this;
+    t_buffer.m_buffer = tb;
+    return tb;
+}
 
-        scope->m_name = add_string(_name, buffer_use::Capture);
-        scope->m_start = ME_profiler_get_clock();
-        scope->m_end = scope->m_start;
+uintptr_t profiler_context::begin_scope(const char *_file, int _line, const char *_name) {
+    thread_buffer *tb = local_buffer();
+
+    // 过深的范围不记录 但仍然计入深度 保证 end_scope 配对
+    const u32 depth = tb->m_depth++;
+    if (depth < ME_SCOPE_DEPTH_MAX) {
+        thread_buffer::open_scope &o = tb->m_stack[depth];
+        o.m_name = _name;
+        o.m_file = _file;
+        o.m_line = (u32)_line;
+        o.m_start = ME_profiler_get_clock();
     }
+    return (uintptr_t)depth + 1;
+}
 
-    scope->m_threadID = ME_get_thread_id();
-    scope->m_file = _file;
-    scope->m_line = _line;
-    scope->m_level = inc_level();
+void profiler_context::end_scope(uintptr_t _scopeHandle) {
+    if (!_scopeHandle) return;
+    const u64 end = ME_profiler_get_clock();
+
+    thread_buffer *tb = local_buffer();
+    const u32 depth = (u32)(_scopeHandle - 1);
+    if (depth >= tb->m_depth) return;
+    // 内层没有配对结束的范围一起丢掉
+    tb->m_depth = depth;
+    if (depth >= ME_SCOPE_DEPTH_MAX) return;
+
+    const u32 write = tb->m_write.load(std::memory_order_relaxed);
+    if (write - tb->m_read.load(std::memory_order_acquire) >= ME_THREAD_SCOPES_MAX) {
+        tb->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
-    return scope;
+    const thread_buffer::open_scope &o = tb->m_stack[depth];
+    thread_buffer::record &rec = tb->m_records[write & (ME_THREAD_SCOPES_MAX - 1)];
+    rec.m_start = o.m_start;
+    // 和开始时间相同的范围会被当成没有结束
+    rec.m_end = end > o.m_start ? end : o.m_start + 1;
+    rec.m_name = o.m_name;
+    rec.m_file = o.m_file;
+    rec.m_line = o.m_line;
+    rec.m_level = depth;
+    tb->m_write.store(write + 1, std::memory_order_release);
 }
 
-void profiler_context::end_scope(profiler_scope *_scope) {
-    if (!_scope) return;
-
-    _scope->m_end = ME_profiler_get_clock();
-    dec_level();
+u64 profiler_context::dropped_scopes() {
+    scoped_mutex_locker lock(m_mutex);
+    return m_droppedScopes;
 }
 
 const char *profiler_context::add_string(const char *_name, buffer_use _buffer) {
@@ -626,22 +1053,33 @@ const char *profiler_context::add_string(const char *_name, buffer_use _buffer)
 
 void profiler_context::get_frame_data(profiler_frame *_data) {
     scoped_mutex_locker lock(m_mutex);
+    fill_frame_data(_data, m_scopesDisplay, m_displayScopes, m_frameStartTime, m_frameEndTime);
+}
+
+// 名字在 Capture 缓冲里 或者越过阈值时已经换成 Display 缓冲 两者都要到下一次 begin_frame 才会被改写
+void profiler_context::get_last_frame_data(profiler_frame *_data) {
+    scoped_mutex_locker lock(m_mutex);
+    fill_frame_data(_data, m_scopesFrame, m_lastScopes, m_lastFrameStartTime, m_lastFrameEndTime);
+}
 
+void profiler_context::fill_frame_data(profiler_frame *_data, profiler_scope *_scopes, u32 _numScopes, u64 _startTime, u64 _endTime) {
     static profiler_thread threadData[ME_DRAW_THREADS_MAX];
 
     u32 numThreads = (u32)m_threadNames.size();
     if (numThreads > ME_DRAW_THREADS_MAX) numThreads = ME_DRAW_THREADS_MAX;
 
-    _data->m_numScopes = m_displayScopes;
-    _data->m_scopes = m_scopesDisplay;
+    _data->m_numScopes = _numScopes;
+    _data->m_scopes = _scopes;
     _data->m_numThreads = numThreads;
     _data->m_threads = threadData;
-    _data->m_startTime = m_frameStartTime;
-    _data->m_endtime = m_frameEndTime;
-    _data->m_prevFrameTime = m_frameEndTime - m_frameStartTime;
+    _data->m_startTime = _startTime;
+    _data->m_endtime = _endTime;
+    _data->m_prevFrameTime = _endTime - _startTime;
     _data->m_CPUFrequency = profiler_get_clock_frequency();
     _data->m_timeThreshold = m_timeThreshold;
     _data->m_levelThreshold = m_levelThreshold;
+    _data->m_numGPUScopes = g_gpu_context.m_numDisplay;
+    _data->m_gpuScopes = g_gpu_context.m_display;
 
     std::map<u64, std::string>::iterator it = m_threadNames.begin();
     for (u32 i = 0; i < numThreads; ++i) {
@@ -651,8 +1089,198 @@ void profiler_context::get_frame_data(profiler_frame *_data) {
     }
 }
 
+u32 profiler_context::trace_name(const char *_name) {
+    auto [it, inserted] = m_traceNameIndex.try_emplace(_name, (u32)m_traceNames.size());
+    if (inserted) m_traceNames.emplace_back(_name);
+    return it->second;
+}
+
+void profiler_context::trace_push(u64 _start, u64 _end, u64 _threadID, const char *_name, u32 _level) {
+    profiler_trace_event &e = m_trace[m_traceHead];
+    e.m_start = _start;
+    e.m_end = _end;
+    e.m_threadID = _threadID;
+    e.m_name = trace_name(_name);
+    e.m_level = _level;
+
+    m_traceHead = (m_traceHead + 1) % ME_TRACE_EVENTS_MAX;
+    if (m_traceCount < ME_TRACE_EVENTS_MAX) m_traceCount++;
+}
+
+void profiler_context::trace_counter(const char *_name, f64 _value) {
+    if (!m_traceEnabled) return;
+    scoped_mutex_locker lock(m_mutex);
+
+    counter_sample &c = m_traceCounters[m_traceCounterHead];
+    c.m_time = ME_profiler_get_clock();
+    c.m_name = trace_name(_name);
+    c.m_value = (f32)_value;
+
+    m_traceCounterHead = (m_traceCounterHead + 1) % ME_TRACE_COUNTERS_MAX;
+    if (m_traceCounterCount < ME_TRACE_COUNTERS_MAX) m_traceCounterCount++;
+}
+
+void profiler_context::trace_set_enabled(bool _enabled) {
+    scoped_mutex_locker lock(m_mutex);
+    // 第一次开启时才分配环形缓冲
+    if (_enabled && m_trace.empty()) {
+        m_trace.resize(ME_TRACE_EVENTS_MAX);
+        m_traceCounters.resize(ME_TRACE_COUNTERS_MAX);
+    }
+    m_traceEnabled = _enabled;
+}
+
+bool profiler_context::trace_is_enabled() { return m_traceEnabled; }
+
+u32 profiler_context::trace_size() {
+    scoped_mutex_locker lock(m_mutex);
+    return m_traceCount;
+}
+
+void profiler_context::trace_clear() {
+    scoped_mutex_locker lock(m_mutex);
+    m_traceHead = 0;
+    m_traceCount = 0;
+    m_traceCounterHead = 0;
+    m_traceCounterCount = 0;
+}
+
+static void write_json_string(FILE *_file, const char *_str) {
+    fputc('"', _file);
+    for (const char *c = _str; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            fprintf(_file, "\\%c", *c);
+        else if ((u8)*c < 0x20)
+            fprintf(_file, "\\u%04x", (u32)(u8)*c);
+        else
+            fputc(*c, _file);
+    }
+    fputc('"', _file);
+}
+
+bool profiler_context::trace_export(const char *_path) {
+    // 复制出来再写文件 不在写文件时挡住 begin_frame
+    std::vector<profiler_trace_event> events;
+    std::vector<counter_sample> counters;
+    std::vector<std::string> names;
+    std::map<u64, std::string> threads;
+    {
+        scoped_mutex_locker lock(m_mutex);
+        events.reserve(m_traceCount);
+        const u32 first = (m_traceHead + ME_TRACE_EVENTS_MAX - m_traceCount) % ME_TRACE_EVENTS_MAX;
+        for (u32 i = 0; i < m_traceCount; ++i) events.push_back(m_trace[(first + i) % ME_TRACE_EVENTS_MAX]);
+        counters.reserve(m_traceCounterCount);
+        const u32 firstCounter = (m_traceCounterHead + ME_TRACE_COUNTERS_MAX - m_traceCounterCount) % ME_TRACE_COUNTERS_MAX;
+        for (u32 i = 0; i < m_traceCounterCount; ++i) counters.push_back(m_traceCounters[(firstCounter + i) % ME_TRACE_COUNTERS_MAX]);
+        names = m_traceNames;
+        threads = m_threadNames;
+    }
+
+    FILE *file = fopen(_path, "wb");
+    if (!file) return false;
+
+    u64 base = ~0ull;
+    for (const profiler_trace_event &e : events) base = std::min(base, e.m_start);
+    for (const counter_sample &c : counters) base = std::min(base, c.m_time);
+    const f64 toMicros = 1000000.0 / (f64)profiler_get_clock_frequency();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"MetaDot\"}}");
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}");
+    for (auto &[id, name] : threads) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":", (unsigned long long)id);
+        write_json_string(file, name.c_str());
+        fprintf(file, "}}");
+    }
+
+    for (const profiler_trace_event &e : events) {
+        fprintf(file, ",\n{\"name\":");
+        write_json_string(file, names[e.m_name].c_str());
+        fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"level\":%u}}", (unsigned long long)e.m_threadID, (f64)(e.m_start - base) * toMicros,
+                (f64)(e.m_end - e.m_start) * toMicros, e.m_level);
+    }
+
+    // 计数器在 trace 工具里显示为进程下的折线
+    for (const counter_sample &c : counters) {
+        fprintf(file, ",\n{\"name\":");
+        write_json_string(file, names[c.m_name].c_str());
+        fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%g}}", (f64)(c.m_time - base) * toMicros, (f64)c.m_value);
+    }
+
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
 }  // namespace profiler
 
+bool ME_profiler_write_frame(const profiler_frame *_data, const char *_path, const char *_metadata) {
+    FILE *file = fopen(_path, "wb");
+    if (!file) return false;
+
+    const u64 base = _data->m_startTime;
+    const f64 toMicros = 1000000.0 / (f64)_data->m_CPUFrequency;
+    const f64 frameMicros = (f64)(_data->m_endtime - _data->m_startTime) * toMicros;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"MetaDot\"}}");
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}");
+    for (u32 i = 0; i < _data->m_numThreads; ++i) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":", (unsigned long long)_data->m_threads[i].m_threadID);
+        profiler::write_json_string(file, _data->m_threads[i].m_name);
+        fprintf(file, "}}");
+    }
+
+    fprintf(file, ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":0,\"dur\":%.3f,\"args\":{\"level\":0}}", frameMicros);
+    for (u32 i = 0; i < _data->m_numScopes; ++i) {
+        const profiler_scope &cs = _data->m_scopes[i];
+        // 开始于上一帧的范围已经截到帧首
+        const u64 start = std::max(cs.m_start, base);
+        const u64 end = std::max(cs.m_end, start);
+        fprintf(file, ",\n{\"name\":");
+        profiler::write_json_string(file, cs.m_name);
+        fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"level\":%u,\"file\":", (unsigned long long)cs.m_threadID,
+                (f64)(start - base) * toMicros, (f64)(end - start) * toMicros, cs.m_level);
+        profiler::write_json_string(file, cs.m_file ? cs.m_file : "");
+        fprintf(file, ",\"line\":%u}}", cs.m_line);
+    }
+
+    // 计数器的最新值 画成贯穿整帧的一段
+    for (u32 i = 0; i < g_numCounters; ++i) {
+        const profiler_counter &c = g_counters[i];
+        if (c.m_count == 0) continue;
+        const f32 value = c.m_values[(c.m_head + ME_COUNTER_HISTORY - 1) % ME_COUNTER_HISTORY];
+        for (f64 ts : {0.0, frameMicros}) {
+            fprintf(file, ",\n{\"name\":");
+            profiler::write_json_string(file, c.m_name);
+            fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%g}}", ts, (f64)value);
+        }
+    }
+    fprintf(file, "\n]");
+
+    // 完整的计数器历史 从旧到新 看得出尖峰之前的走势
+    fprintf(file, ",\n\"counterHistory\":{");
+    bool first = true;
+    for (u32 i = 0; i < g_numCounters; ++i) {
+        const profiler_counter &c = g_counters[i];
+        if (c.m_count == 0) continue;
+        fprintf(file, first ? "\n" : ",\n");
+        first = false;
+        profiler::write_json_string(file, c.m_name);
+        fputc(':', file);
+        fputc('[', file);
+        for (u32 j = 0; j < c.m_count; ++j) {
+            const u32 index = (c.m_head + ME_COUNTER_HISTORY - c.m_count + j) % ME_COUNTER_HISTORY;
+            fprintf(file, j ? ",%g" : "%g", (f64)c.m_values[index]);
+        }
+        fputc(']', file);
+    }
+    fprintf(file, "}");
+
+    if (_metadata && *_metadata) fprintf(file, ",\n\"otherData\":%s", _metadata);
+    fprintf(file, "\n}\n");
+    return fclose(file) == 0;
+}
+
 void ME_profiler_graph_init(profiler_graph *fps, int style, const char *name) {
     memset(fps, 0, sizeof(profiler_graph));
     fps->style = style;
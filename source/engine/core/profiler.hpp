@@ -2,12 +2,22 @@
 #ifndef ME_PROFILER_HPP
 #define ME_PROFILER_HPP
 
-#define ME_SCOPES_MAX (16 * 1024)
+#define ME_SCOPES_MAX (64 * 1024)
 #define ME_TEXT_MAX (1024 * 1024)
-#define ME_DRAW_THREADS_MAX (16)
+#define ME_DRAW_THREADS_MAX (80)
+// 每个线程的环形缓冲能放下的已结束范围 一帧内超出的丢弃 容量必须是 2 的幂
+#define ME_THREAD_SCOPES_MAX (8 * 1024)
+#define ME_SCOPE_DEPTH_MAX (64)
+#define ME_COUNTERS_MAX (256)
+#define ME_COUNTER_HISTORY (240)
+#define ME_TRACE_EVENTS_MAX (256 * 1024)
+#define ME_TRACE_COUNTERS_MAX (64 * 1024)
+#define ME_STATS_MAX (64)
 
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "engine/core/basic_types.h"
 #include "engine/core/const.h"
@@ -46,6 +56,34 @@ typedef struct profiler_thread {
 
 } profiler_thread;
 
+// GPU 时间戳查询得到的一段时间 m_start 相对于这一帧第一段的开始 单位 ms
+typedef struct profiler_gpu_scope_t {
+    const char *m_name;
+    u32 m_level;
+    f32 m_start;
+    f32 m_time;
+
+} profiler_gpu_scope;
+
+// 按名字记录的数值序列 每次 ME_profiler_counter 追加一个值 保留最近 ME_COUNTER_HISTORY 个
+typedef struct profiler_counter_t {
+    char m_name[64];
+    f32 m_values[ME_COUNTER_HISTORY];
+    u32 m_head;   // 下一个值写入的位置
+    u32 m_count;  // 已有的值个数
+
+} profiler_counter;
+
+// 连续捕获的一段时间 m_name 是 trace 名字表的下标
+typedef struct profiler_trace_event_t {
+    u64 m_start;
+    u64 m_end;
+    u64 m_threadID;
+    u32 m_name;
+    u32 m_level;
+
+} profiler_trace_event;
+
 typedef struct profiler_frame_t {
     u32 m_numScopes;
     profiler_scope *m_scopes;
@@ -60,6 +98,9 @@ typedef struct profiler_frame_t {
     u32 m_numScopesStats;
     profiler_scope *m_scopesStats;
     profiler_scope_stats *m_scopeStatsInfo;
+    // 若干帧之前的 GPU 数据 不支持时间戳查询或没有开启时为 0
+    u32 m_numGPUScopes;
+    profiler_gpu_scope *m_gpuScopes;
 
 } profiler_frame;
 
@@ -86,10 +127,10 @@ void ME_profiler_unregister_thread(u64 _threadID);
 // Must be called once per frame at the frame start
 void ME_profiler_begin_frame();
 
-// Begins a profiling scope/block.
+// Begins a profiling scope/block. Lock free, writes only to the calling thread's buffer.
 //_file - name of source file
 //_line - line of source file
-//_name - name of the scope
+//_name - name of the scope, must stay valid until the next ME_profiler_begin_frame (use string literals)
 // Returns: scope handle
 uintptr_t ME_profiler_begin_scope(const char *_file, int _line, const char *_name);
 
@@ -97,6 +138,9 @@ uintptr_t ME_profiler_begin_scope(const char *_file, int _line, const char *_nam
 //_scopeHandle  - handle of the scope to be closed
 void ME_profiler_end_scope(uintptr_t _scopeHandle);
 
+// Returns: number of scopes dropped so far because a thread buffer or the merged frame was full
+u64 ME_profiler_dropped_scopes();
+
 // Returns non zero value if profiling is paused.
 int ME_profiler_is_paused();
 
@@ -109,6 +153,15 @@ void ME_profiler_set_paused(int _paused);
 // Fetches data of the last saved frame (either threshold exceeded or profiling is paused).
 void ME_profiler_get_frame(profiler_frame *_data);
 
+// Fetches the frame merged by the latest ME_profiler_begin_frame, whatever the threshold and pause state.
+// The data is valid until the next ME_profiler_begin_frame.
+void ME_profiler_get_last_frame(profiler_frame *_data);
+
+// Writes a single frame as Chrome Trace Event JSON, with the current value and history of every counter.
+//_metadata - JSON object text stored as "otherData", may be null
+// Returns: false if the file could not be written
+bool ME_profiler_write_frame(const profiler_frame *_data, const char *_path, const char *_metadata);
+
 // Saves profiler data to a binary buffer.
 //_data       - profiler data / single frame capture
 //_buffer     - buffer to store data to
@@ -132,6 +185,63 @@ void ME_profiler_load_time_only(f32 *_time, void *_buffer, size_t _bufferSize);
 //_data       - data to be released
 void ME_profiler_release(profiler_frame *_data);
 
+// Enables GPU timestamp queries. Scopes flush the blit buffer, so keep this off unless the data is displayed.
+void ME_profiler_gpu_set_enabled(bool _enabled);
+
+// Must be called once per frame on the render thread, resolves queries issued GPU_QUERY_COUNT - 1 frames ago.
+void ME_profiler_gpu_begin_frame();
+
+// Begins a GPU scope. _name must outlive the capture (use string literals).
+// Returns: scope handle, 0 if GPU profiling is disabled or unsupported
+uintptr_t ME_profiler_gpu_begin_scope(const char *_name);
+
+// Stops a GPU scope.
+void ME_profiler_gpu_end_scope(uintptr_t _scopeHandle);
+
+// Measures the world render passes with a single GL_TIME_ELAPSED query, independent of ME_profiler_gpu_set_enabled.
+// Call once per frame around the passes. Must not be nested.
+void ME_profiler_gpu_render_begin();
+void ME_profiler_gpu_render_end();
+
+// Returns: GPU time of the render passes in ms, from GPU_QUERY_COUNT frames ago. Negative if no result is available yet or queries are unsupported
+f32 ME_profiler_gpu_render_time();
+
+// Appends a value to counter _name, creating it on first use. Ignored while paused or after ME_COUNTERS_MAX counters.
+// Counters are recorded and read on the main thread only. Values also go to the trace while continuous capture is on.
+void ME_profiler_counter(const char *_name, f64 _value);
+
+// Returns: number of counters, *_counters points to the internal array
+u32 ME_profiler_get_counters(const profiler_counter **_counters);
+
+// Clears the history of all counters.
+void ME_profiler_reset_counters();
+
+// Workload statistics that any thread may update without locking (sharded atomics, summed on the main thread).
+// Once per frame ME_profiler_begin_frame turns every statistic into a value of the counter with the same name:
+// summed statistics report what was added during the frame and restart from 0, gauges report their last value.
+// Returns: index of the statistic, the same name always gives the same index. ~0u after ME_STATS_MAX statistics.
+u32 ME_profiler_stat_register(const char *_name, bool _gauge = false);
+
+// Adds _delta to a summed statistic.
+void ME_profiler_stat_add(u32 _stat, i64 _delta);
+
+// Sets the value of a gauge.
+void ME_profiler_stat_set(u32 _stat, i64 _value);
+
+// Continuous capture: every closed scope of every frame goes into a ring buffer of ME_TRACE_EVENTS_MAX events,
+// independent of the threshold and pause state. Frames are recorded on a separate "Frames" track.
+void ME_profiler_trace_set_enabled(bool _enabled);
+bool ME_profiler_trace_is_enabled();
+
+// Returns: number of events in the ring buffer
+u32 ME_profiler_trace_size();
+
+void ME_profiler_trace_clear();
+
+// Writes the ring buffer as Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev).
+// Returns: false if the file could not be written
+bool ME_profiler_trace_export(const char *_path);
+
 // Returns CPU clock.
 u64 ME_profiler_get_clock();
 
@@ -149,6 +259,14 @@ struct profiler_scoped {
     ~profiler_scoped() { ME_profiler_end_scope(m_scope); }
 };
 
+struct profiler_gpu_scoped {
+    uintptr_t m_scope;
+
+    profiler_gpu_scoped(const char *_name) { m_scope = ME_profiler_gpu_begin_scope(_name); }
+
+    ~profiler_gpu_scoped() { ME_profiler_gpu_end_scope(m_scope); }
+};
+
 // Macro used to profile on a scope basis
 #ifndef ME_DISABLE_PROFILING
 
@@ -158,6 +276,18 @@ struct profiler_scoped {
     uintptr_t profileid_##n;            \
     profileid_##n = ProfilerBeginScope(__FILE__, __LINE__, #n);
 #define ME_profiler_scope_end(n) ProfilerEndScope(profileid_##n);
+#define ME_profiler_gpu_scope_auto(x) profiler_gpu_scoped ME_CONCAT(profileGPUScope, __LINE__)(x)
+// name must be a constant for the call site, the statistic is registered once
+#define ME_profiler_count(name, delta)                                                       \
+    do {                                                                                     \
+        static const u32 ME_CONCAT(profileStat, __LINE__) = ME_profiler_stat_register(name); \
+        ME_profiler_stat_add(ME_CONCAT(profileStat, __LINE__), (i64)(delta));                \
+    } while (0)
+#define ME_profiler_gauge(name, value)                                                             \
+    do {                                                                                           \
+        static const u32 ME_CONCAT(profileStat, __LINE__) = ME_profiler_stat_register(name, true); \
+        ME_profiler_stat_set(ME_CONCAT(profileStat, __LINE__), (i64)(value));                      \
+    } while (0)
 #define ME_profiler_begin() ME_profiler_begin_frame()
 #define ME_profiler_thread(n) ME_profiler_register_thread(n)
 #define ME_profiler_shutdown() ME_profiler_shutdown()
@@ -166,6 +296,9 @@ struct profiler_scoped {
 #define ME_profiler_begin() void()
 #define ME_profiler_thread(n) void()
 #define ME_profiler_shutdown() void()
+#define ME_profiler_gpu_scope_auto(x) void()
+#define ME_profiler_count(name, delta) void()
+#define ME_profiler_gauge(name, value) void()
 #endif  // ME_DISABLE_PROFILING
 
 struct profiler_free_list_t {
@@ -185,23 +318,29 @@ int ME_profiler_free_list_check_ptr(profiler_free_list_t *_freeList, void *_ptr)
 
 namespace profiler {
 
+struct thread_buffer;
+
+// 每个线程把结束的范围写进自己的单生产者单消费者环形缓冲 记录时不加锁也不分配
+// begin_frame 在主线程上把所有线程的缓冲合并成一帧 跨帧没有结束的范围只有调用 begin_frame 的线程会显示
 class profiler_context {
     enum buffer_use {
         Capture,
         Display,
-        Open,
 
         Count
     };
 
     pthread_mutex m_mutex;
-    profiler_free_list_t m_scopesAllocator;
-    u32 m_scopesOpen;
-    profiler_scope *m_scopesCapture[ME_SCOPES_MAX];
+    std::vector<thread_buffer *> m_threadBuffers;
+    profiler_scope m_scopesFrame[ME_SCOPES_MAX];
     profiler_scope m_scopesDisplay[ME_SCOPES_MAX];
     u32 m_displayScopes;
     u64 m_frameStartTime;
     u64 m_frameEndTime;
+    // m_scopesFrame 里最近合并的一帧
+    u32 m_lastScopes;
+    u64 m_lastFrameStartTime;
+    u64 m_lastFrameEndTime;
     bool m_thresholdCrossed;
     f32 m_timeThreshold;
     u32 m_levelThreshold;
@@ -209,10 +348,31 @@ class profiler_context {
     char m_namesDataBuffers[buffer_use::Count][ME_TEXT_MAX];
     char *m_namesData[buffer_use::Count];
     int m_namesSize[buffer_use::Count];
-    u32 m_tlsLevel;
+    u64 m_droppedScopes;
 
     std::map<u64, std::string> m_threadNames;
 
+    bool m_traceEnabled;
+    std::vector<profiler_trace_event> m_trace;
+    u32 m_traceHead;
+    u32 m_traceCount;
+    std::unordered_map<std::string, u32> m_traceNameIndex;
+    std::vector<std::string> m_traceNames;
+
+    struct counter_sample {
+        u64 m_time;
+        u32 m_name;
+        f32 m_value;
+    };
+    std::vector<counter_sample> m_traceCounters;
+    u32 m_traceCounterHead;
+    u32 m_traceCounterCount;
+
+    u32 trace_name(const char *_name);
+    void trace_push(u64 _start, u64 _end, u64 _threadID, const char *_name, u32 _level);
+    thread_buffer *local_buffer();
+    void fill_frame_data(profiler_frame *_data, profiler_scope *_scopes, u32 _numScopes, u64 _startTime, u64 _endTime);
+
 public:
     profiler_context();
     ~profiler_context();
@@ -224,17 +384,28 @@ public:
     void register_thread(u64 _threadID, const char *_name);
     void unregister_thread(u64 _threadID);
     void begin_frame();
-    int inc_level();
-    void dec_level();
-    profiler_scope *begin_ccope(const char *_file, int _line, const char *_name);
-    void end_scope(profiler_scope *_scope);
+    uintptr_t begin_scope(const char *_file, int _line, const char *_name);
+    void end_scope(uintptr_t _scopeHandle);
+    // 缓冲满了被丢弃的范围总数
+    u64 dropped_scopes();
     const char *add_string(const char *_name, buffer_use _buffer);
     void get_frame_data(profiler_frame *_data);
+    void get_last_frame_data(profiler_frame *_data);
+
+    // 计数器的值 只在主线程上调用
+    void trace_counter(const char *_name, f64 _value);
+    void trace_set_enabled(bool _enabled);
+    bool trace_is_enabled();
+    u32 trace_size();
+    void trace_clear();
+    bool trace_export(const char *_path);
 };
 
 }  // namespace profiler
 
+// GPU 查询的帧数 结果在 GPU_QUERY_COUNT - 1 帧之后读取 避免等待 GPU
 #define GPU_QUERY_COUNT 5
+#define GPU_SCOPES_MAX 128
 
 enum GraphrenderStyle {
     GRAPH_RENDER_FPS,
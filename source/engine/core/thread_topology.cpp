@@ -0,0 +1,241 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "thread_topology.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ME::thread_topology {
+
+namespace {
+
+#if defined(__linux__)
+// Parses the sysfs cpulist format, "0-3,8,10-11"
+std::vector<u32> read_cpulist(const char *path) {
+    std::vector<u32> out;
+    FILE *f = fopen(path, "r");
+    if (!f) return out;
+    char buf[1024];
+    const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    const char *p = buf;
+    while (*p) {
+        char *end;
+        const unsigned long first = strtoul(p, &end, 10);
+        if (end == p) break;
+        unsigned long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtoul(p + 1, &end, 10);
+            if (end == p + 1) break;
+            p = end;
+        }
+        for (unsigned long c = first; c <= last && c < 4096; c++) out.push_back((u32)c);
+        if (*p != ',') break;
+        p++;
+    }
+    return out;
+}
+
+bool read_u32(const char *path, u32 &out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    unsigned v;
+    const bool ok = fscanf(f, "%u", &v) == 1;
+    fclose(f);
+    if (ok) out = v;
+    return ok;
+}
+#endif
+
+cpu_topology detect() {
+    cpu_topology t;
+#if defined(__linux__)
+    std::vector<u32> online = read_cpulist("/sys/devices/system/cpu/online");
+    if (online.empty()) {
+        for (u32 c = 0, n = std::max(std::thread::hardware_concurrency(), 1u); c < n; c++) online.push_back(c);
+    }
+    // taskset or a container may have given us fewer CPUs
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        std::erase_if(online, [&](u32 c) { return c >= CPU_SETSIZE || !CPU_ISSET(c, &allowed); });
+    }
+
+    // Intel hybrid parts register one PMU per core kind
+    const std::vector<u32> atom = read_cpulist("/sys/devices/cpu_atom/cpus");
+    if (!atom.empty() && !read_cpulist("/sys/devices/cpu_core/cpus").empty()) {
+        for (u32 c : online) (std::find(atom.begin(), atom.end(), c) != atom.end() ? t.efficiency : t.performance).push_back(c);
+        return t;
+    }
+
+    // ARM big.LITTLE reports a relative capacity per CPU, the little cores are well below half of the biggest
+    std::vector<u32> capacity(online.size(), 0);
+    u32 maxCapacity = 0;
+    bool capacities = !online.empty();
+    for (size_t i = 0; i < online.size() && capacities; i++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", online[i]);
+        capacities = read_u32(path, capacity[i]);
+        maxCapacity = std::max(maxCapacity, capacity[i]);
+    }
+    for (size_t i = 0; i < online.size(); i++) {
+        const bool little = capacities && capacity[i] * 2 <= maxCapacity;
+        (little ? t.efficiency : t.performance).push_back(online[i]);
+    }
+#elif defined(_WIN32)
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) processMask = ~(DWORD_PTR)0;
+
+    // Only processor group 0, the workers are never spread over more than 64 CPUs
+    ULONG size = 0;
+    GetSystemCpuSetInformation(nullptr, 0, &size, GetCurrentProcess(), 0);
+    std::vector<char> buf(size);
+    std::vector<std::pair<u32, u8>> found;
+    u8 maxClass = 0;
+    if (size && GetSystemCpuSetInformation((PSYSTEM_CPU_SET_INFORMATION)buf.data(), size, &size, GetCurrentProcess(), 0)) {
+        for (ULONG off = 0; off < size;) {
+            const SYSTEM_CPU_SET_INFORMATION *info = (const SYSTEM_CPU_SET_INFORMATION *)(buf.data() + off);
+            if (info->Size == 0) break;
+            off += info->Size;
+            if (info->Type != CpuSetInformation || info->CpuSet.Group != 0) continue;
+            const u32 c = info->CpuSet.LogicalProcessorIndex;
+            if (c >= 64 || !((processMask >> c) & 1)) continue;
+            // higher EfficiencyClass means faster cores
+            found.push_back({c, info->CpuSet.EfficiencyClass});
+            maxClass = std::max(maxClass, (u8)info->CpuSet.EfficiencyClass);
+        }
+    }
+    for (auto [c, cls] : found) (cls == maxClass ? t.performance : t.efficiency).push_back(c);
+    if (found.empty()) {
+        for (u32 c = 0; c < 64; c++) {
+            if ((processMask >> c) & 1) t.performance.push_back(c);
+        }
+    }
+#elif defined(__APPLE__)
+    auto sysctl_u32 = [](const char *key, u32 fallback) {
+        int v = 0;
+        size_t len = sizeof(v);
+        return sysctlbyname(key, &v, &len, nullptr, 0) == 0 && v > 0 ? (u32)v : fallback;
+    };
+    u32 p = sysctl_u32("hw.logicalcpu", std::max(std::thread::hardware_concurrency(), 1u)), e = 0;
+    if (sysctl_u32("hw.nperflevels", 1) >= 2) {
+        p = sysctl_u32("hw.perflevel0.logicalcpu", p);
+        e = sysctl_u32("hw.perflevel1.logicalcpu", 0);
+    }
+    for (u32 c = 0; c < p + e; c++) (c < p ? t.performance : t.efficiency).push_back(c);
+#else
+    for (u32 c = 0, n = std::max(std::thread::hardware_concurrency(), 1u); c < n; c++) t.performance.push_back(c);
+#endif
+    if (t.performance.empty()) t.performance.swap(t.efficiency);
+    return t;
+}
+
+}  // namespace
+
+const cpu_topology &cpus() {
+    static const cpu_topology t = detect();
+    return t;
+}
+
+bool set_priority(job_class c) {
+#if defined(_WIN32)
+    static const int priorities[] = {THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_LOWEST};
+    const bool ok = SetThreadPriority(GetCurrentThread(), priorities[(int)c]) != 0;
+#if defined(THREAD_POWER_THROTTLING_CURRENT_VERSION)
+    // EcoQoS for io and save keeps them on efficiency cores, the others opt out of throttling
+    THREAD_POWER_THROTTLING_STATE state{};
+    state.Version = THREAD_POWER_THROTTLING_CURRENT_VERSION;
+    state.ControlMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+    state.StateMask = c >= job_class::io ? THREAD_POWER_THROTTLING_EXECUTION_SPEED : 0;
+    SetThreadInformation(GetCurrentThread(), ThreadPowerThrottling, &state, sizeof(state));
+#endif
+    return ok;
+#elif defined(__APPLE__)
+    static const qos_class_t classes[] = {QOS_CLASS_USER_INTERACTIVE, QOS_CLASS_USER_INTERACTIVE, QOS_CLASS_USER_INITIATED, QOS_CLASS_UTILITY, QOS_CLASS_UTILITY};
+    return pthread_set_qos_class_self_np(classes[(int)c], 0) == 0;
+#elif defined(__linux__)
+    // nice is per thread on Linux, setpriority with the thread id changes only the calling thread
+    static const int nice[] = {-2, 0, 2, 5, 8};
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice[(int)c]) == 0;
+#else
+    (void)c;
+    return false;
+#endif
+}
+
+bool set_affinity(const std::vector<u32> &list) {
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (u32 c : list) {
+        if (c < 64) mask |= (DWORD_PTR)1 << c;
+    }
+    if (!mask) {
+        DWORD_PTR systemMask = 0;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &systemMask)) return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+    const cpu_topology &t = cpus();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    auto add = [&](u32 c) {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    };
+    if (list.empty()) {
+        for (u32 c : t.performance) add(c);
+        for (u32 c : t.efficiency) add(c);
+    } else {
+        for (u32 c : list) add(c);
+    }
+    if (!CPU_COUNT(&set)) return false;
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)list;
+    return false;
+#endif
+}
+
+const char *name(job_class c) {
+    switch (c) {
+        case job_class::tick:
+            return "tick";
+        case job_class::render:
+            return "render";
+        case job_class::generation:
+            return "generation";
+        case job_class::io:
+            return "io";
+        default:
+            return "save";
+    }
+}
+
+const char *describe() {
+    static char buf[64];
+    const cpu_topology &t = cpus();
+    if (t.hybrid()) {
+        snprintf(buf, sizeof(buf), "%u logical %uP+%uE", t.logical(), (u32)t.performance.size(), (u32)t.efficiency.size());
+    } else {
+        snprintf(buf, sizeof(buf), "%u logical", t.logical());
+    }
+    return buf;
+}
+
+}  // namespace ME::thread_topology
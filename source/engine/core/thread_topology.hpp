@@ -0,0 +1,48 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_THREAD_TOPOLOGY_HPP
+#define ME_THREAD_TOPOLOGY_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+
+namespace ME {
+
+// Logical CPUs the process may run on, split by core kind.
+// On CPUs with a single core kind (or when the OS does not tell) every CPU is in performance.
+// Ids are the OS logical processor numbers. macOS does not expose them, there the lists only give the counts.
+struct cpu_topology {
+    std::vector<u32> performance;
+    std::vector<u32> efficiency;
+
+    u32 logical() const { return (u32)(performance.size() + efficiency.size()); }
+    bool hybrid() const { return !performance.empty() && !efficiency.empty(); }
+};
+
+namespace thread_topology {
+
+// Detected once on first use (sysfs on Linux, CPU sets on Windows, perflevel sysctls on macOS)
+const cpu_topology &cpus();
+
+// Set the OS priority of the calling thread for threads that mostly run jobs of class c:
+// tick above normal, render normal, generation / io / save below normal in that order.
+// Raising above normal may need privileges (Linux nice < 0), returns false when the OS refused.
+// On macOS this sets the QoS class, which also steers the thread between performance and efficiency cores.
+bool set_priority(job_class c);
+
+// Restrict the calling thread to the given logical CPUs, an empty list allows every CPU again.
+// Returns false where threads cannot be pinned (macOS) or the OS refused.
+bool set_affinity(const std::vector<u32> &cpus);
+
+const char *name(job_class c);
+
+// "16 logical 8P+8E" style summary for the log
+const char *describe();
+
+}  // namespace thread_topology
+
+}  // namespace ME
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "cvar.hpp"
 
+#include "engine/core/io/filesystem.h"
+#include "engine/meta/static_serializer.hpp"
 #include "engine/scripting/scripting.hpp"
 #include "game_ui.hpp"
 
@@ -23,6 +25,7 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
             .member_("draw_b2d_pair", &GlobalDEF::draw_b2d_pair, {.metadata{{"info", ""s}}})
             .member_("draw_b2d_centerMass", &GlobalDEF::draw_b2d_centerMass, {.metadata{{"info", ""s}}})
             .member_("draw_chunk_state", &GlobalDEF::draw_chunk_state, {.metadata{{"info", "是否显示区块状态"s}}})
+            .member_("draw_chunk_cost", &GlobalDEF::draw_chunk_cost, {.metadata{{"info", "是否显示区块模拟开销热力图"s}}})
             .member_("draw_debug_stats", &GlobalDEF::draw_debug_stats, {.metadata{{"info", "是否显示调试信息"s}}})
             .member_("draw_material_info", &GlobalDEF::draw_material_info, {.metadata{{"info", "是否显示材质信息"s}}})
             .member_("draw_detailed_material_info", &GlobalDEF::draw_detailed_material_info, {.metadata{{"info", "是否显示材质详细信息"s}}})
@@ -36,13 +39,52 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
             .member_("water_pixelated", &GlobalDEF::water_pixelated, {.metadata{{"info", "启用水渲染像素化"s}}})
             .member_("lightingQuality", &GlobalDEF::lightingQuality, {.metadata{{"info", "光照质量"s}, {"imgui", "float_range"s}, {"max", 1.0f}, {"min", 0.0f}}})
             .member_("draw_light_overlay", &GlobalDEF::draw_light_overlay, {.metadata{{"info", "是否启用光照覆盖"s}}})
+            .member_("lighting_scale", &GlobalDEF::lighting_scale, {.metadata{{"info", "光照计算的分辨率缩小倍数 1/2/4"s}}})
             .member_("simpleLighting", &GlobalDEF::simpleLighting, {.metadata{{"info", "是否启用光照简单采样"s}}})
             .member_("lightingEmission", &GlobalDEF::lightingEmission, {.metadata{{"info", "是否启用光照放射"s}}})
             .member_("lightingDithering", &GlobalDEF::lightingDithering, {.metadata{{"info", "是否启用光照抖动"s}}})
+            .member_("dynamic_resolution_ms", &GlobalDEF::dynamic_resolution_ms, {.metadata{{"info", "世界渲染的 GPU 耗时目标(毫秒) 超过时逐级降低光照分辨率和质量 小于等于0不调整"s}}})
             .member_("tick_world", &GlobalDEF::tick_world, {.metadata{{"info", "是否启用世界更新"s}}})
             .member_("tick_box2d", &GlobalDEF::tick_box2d, {.metadata{{"info", "是否启用刚体物理更新"s}}})
+            .member_("tick_box2d_parallel", &GlobalDEF::tick_box2d_parallel, {.metadata{{"info", "是否在任务系统上并行求解刚体岛和窄相碰撞"s}}})
+            .member_("physics_lod_dist", &GlobalDEF::physics_lod_dist, {.metadata{{"info", "刚体离玩家超过该距离(像素)并且休眠时冻结到世界像素中 小于等于0不冻结"s}}})
+            .member_("physics_step_rate", &GlobalDEF::physics_step_rate, {.metadata{{"info", "刚体物理每秒的步数 与世界的 tick 无关 负载高时可以调低"s}}})
+            .member_("physics_max_steps", &GlobalDEF::physics_max_steps, {.metadata{{"info", "一个 tick 内最多补多少步物理 超出的时间丢弃"s}}})
+            .member_("physics_interpolate", &GlobalDEF::physics_interpolate, {.metadata{{"info", "刚体在两个物理步之间按帧插值绘制"s}}})
+            .member_("physics_far_dist", &GlobalDEF::physics_far_dist, {.metadata{{"info", "离玩家超过该距离(像素)的运动刚体降低物理频率 小于等于0不降低"s}}})
+            .member_("physics_far_interval", &GlobalDEF::physics_far_interval, {.metadata{{"info", "远处的刚体每隔多少个物理步才求解一次 每次求解的时间步相应加长"s}}})
+            .member_("physics_grid_terrain", &GlobalDEF::physics_grid_terrain, {.metadata{{"info", "区块地形用 b2GridShape 直接按 SOLID 位图碰撞 地形变化时不再重新三角化"s}}})
+            .member_("tick_liquid_particles", &GlobalDEF::tick_liquid_particles, {.metadata{{"info", "大片流动的液体转换为 LiquidFun 粒子模拟 静止后写回像素"s}}})
+            .member_("liquid_particle_min_cells", &GlobalDEF::liquid_particle_min_cells, {.metadata{{"info", "连通液体至少有多少像素才转换为粒子"s}}})
+            .member_("liquid_level_solver", &GlobalDEF::liquid_level_solver, {.metadata{{"info", "连通的液体按液面高度整体整平 SOUP 的逐像素规则只跑很少的遍数"s}}})
             .member_("tick_temperature", &GlobalDEF::tick_temperature, {.metadata{{"info", "是否启用世界温度更新"s}}})
             .member_("hd_objects", &GlobalDEF::hd_objects, {.metadata{{"info", ""s}}})
+            .member_("streaming_uploads", &GlobalDEF::streaming_uploads, {.metadata{{"info", "是否启用PBO异步纹理上传"s}}})
+            .member_("gpu_world_pixels", &GlobalDEF::gpu_world_pixels, {.metadata{{"info", "是否只上传打包的世界像素 由着色器生成颜色和发光纹理"s}}})
+            .member_("gpu_cell_sim", &GlobalDEF::gpu_cell_sim, {.metadata{{"info", "没有交互和反应的 SAND/SOUP/GAS 像素用计算着色器模拟 需要 OpenGL 4.3"s}}})
+            .member_("merge_budget_us", &GlobalDEF::merge_budget_us, {.metadata{{"info", "每帧合并区块的时间预算(微秒) 小于等于0不限制"s}}})
+            .member_("populate_budget_us", &GlobalDEF::populate_budget_us, {.metadata{{"info", "每帧执行区块填充(Populator)的时间预算(微秒) 小于等于0不限制"s}}})
+            .member_("npc_think_budget_us", &GlobalDEF::npc_think_budget_us, {.metadata{{"info", "每个 tick 执行 NPC 思考的时间预算(微秒) 小于等于0不限制"s}}})
+            .member_("npc_sleep_ticks", &GlobalDEF::npc_sleep_ticks, {.metadata{{"info", "模拟区域外的 NPC 每隔多少个 tick 思考一次"s}}})
+            .member_("interest_background_interval", &GlobalDEF::interest_background_interval, {.metadata{{"info", "有关注区域时 不被任何区域覆盖的区块每隔多少个 tick 模拟一次 0 表示不模拟"s}}})
+            .member_("pregen_radius", &GlobalDEF::pregen_radius, {.metadata{{"info", "新建世界时预先生成并写盘的区块半径 小于等于0不预生成 命令行 --pregen 覆盖"s}}})
+            .member_("chunk_cache_mb", &GlobalDEF::chunk_cache_mb, {.metadata{{"info", "在内存中保留最近卸载的区块存档数据 (已经是 LZ4 压缩的) 的预算(MB) 重新加载时不读文件 小于等于0不保留"s}}})
+            .member_("memory_budget_mb", &GlobalDEF::memory_budget_mb, {.metadata{{"info", "各子系统估计的内存总量的预算(MB) 超出时依次缩小区块缓存 清空渲染目标池 回收 Lua 卸载远处的区块 小于等于0只统计"s}}})
+            .member_("lua_gc_generational", &GlobalDEF::lua_gc_generational, {.metadata{{"info", "Lua 使用分代回收 否则使用增量回收"s}}})
+            .member_("lua_gc_budget_us", &GlobalDEF::lua_gc_budget_us, {.metadata{{"info", "每帧渲染之后用于 Lua 垃圾回收的时间预算(微秒) 小于等于0交给 Lua 自动回收"s}}})
+            .member_("lua_hot_reload", &GlobalDEF::lua_hot_reload, {.metadata{{"info", "每秒检查 require 过的 Lua 模块 文件修改后就地重载 保留运行状态"s}}})
+            .member_("lua_profiler", &GlobalDEF::lua_profiler, {.metadata{{"info", "对 Lua 采样 调用栈写入分析器的帧和 trace 按函数统计的时间在调试界面的 Lua 页"s}}})
+            .member_("lua_profiler_interval", &GlobalDEF::lua_profiler_interval, {.metadata{{"info", "Lua 采样的间隔(指令数) 越小越准确 开销也越大"s}}})
+            .member_("spike_threshold_ms", &GlobalDEF::spike_threshold_ms, {.metadata{{"info", "帧时间超过多少毫秒时把这一帧的分析数据和世界概况写到 spikes 目录 小于等于0不记录"s}}})
+            .member_("tick_checksum", &GlobalDEF::tick_checksum, {.metadata{{"info", "每个 tick 结束后计算世界像素的哈希 用来验证模拟结果与参考实现逐位一致 录制和回放时总是打开"s}}})
+            .member_("autosave_interval", &GlobalDEF::autosave_interval, {.metadata{{"info", "游戏中每隔多少秒在后台自动存档 小于等于0不自动存档"s}}})
+            .member_("vsync_mode", &GlobalDEF::vsync_mode, {.metadata{{"info", "垂直同步 0 关 1 开 2 自适应 (赶不上刷新时不等待 不支持时按开处理)"s}}})
+            .member_("max_fps", &GlobalDEF::max_fps, {.metadata{{"info", "帧率上限 小于等于0不限制"s}}})
+            .member_("late_latch", &GlobalDEF::late_latch, {.metadata{{"info", "tick 之后渲染之前重新读取鼠标和时间 再更新镜头 降低输入延迟"s}}})
+            .member_("audio_thread", &GlobalDEF::audio_thread, {.metadata{{"info", "FMOD 的 update 和事件的播放/参数在单独的音频线程上执行 主线程只写命令队列 重启后生效"s}}})
+            .member_("job_hybrid_placement", &GlobalDEF::job_hybrid_placement, {.metadata{{"info", "大小核 CPU 上 tick 的 worker 放在性能核 其余放在效率核并优先执行区块生成 读写和存档"s}}})
+            .member_("job_pin_workers", &GlobalDEF::job_pin_workers, {.metadata{{"info", "每个 worker 固定在一个逻辑 CPU 上 主线程不固定"s}}})
+            .member_("job_thread_priorities", &GlobalDEF::job_thread_priorities, {.metadata{{"info", "按 worker 的类别设置线程优先级 tick 高于普通 后台低于普通"s}}})
             .member_("hd_objects_size", &GlobalDEF::hd_objects_size, {.metadata{{"info", ""s}}})
             .member_("draw_ui_debug", &GlobalDEF::draw_ui_debug, {.metadata{{"info", ""s}}})
             .member_("draw_imgui_debug", &GlobalDEF::draw_imgui_debug, {.metadata{{"info", "是否显示IMGUI示例窗口"s}}})
@@ -50,6 +92,7 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
             .member_("draw_console", &GlobalDEF::draw_console, {.metadata{{"info", "是否显示控制台"s}}})
             .member_("draw_pack_editor", &GlobalDEF::draw_pack_editor, {.metadata{{"info", "是否显示包编辑器"s}}})
             .member_("draw_code_editor", &GlobalDEF::draw_code_editor, {.metadata{{"info", "是否显示脚本编辑器"s}}})
+            .member_("imgui_skip_hidden", &GlobalDEF::imgui_skip_hidden, {.metadata{{"info", "没有可见的 ImGui 窗口时跳过整帧 ImGui (NewFrame 和 Render)"s}}})
             .member_("cell_iter", &GlobalDEF::cell_iter, {.metadata{{"info", "Cell迭代次数"s}}})
             .member_("brush_size", &GlobalDEF::brush_size, {.metadata{{"info", "编辑器笔刷大小"s}}})
             .member_("debug_entities_test", &GlobalDEF::debug_entities_test, {.metadata{{"info", "是否启用实体调试"s}}});
@@ -68,6 +111,7 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
         s->draw_b2d_pair = GlobalDEF["draw_b2d_pair"].get<decltype(s->draw_b2d_pair)>();
         s->draw_b2d_centerMass = GlobalDEF["draw_b2d_centerMass"].get<decltype(s->draw_b2d_centerMass)>();
         s->draw_chunk_state = GlobalDEF["draw_chunk_state"].get<decltype(s->draw_chunk_state)>();
+        s->draw_chunk_cost = GlobalDEF["draw_chunk_cost"].get<decltype(s->draw_chunk_cost)>();
         s->draw_debug_stats = GlobalDEF["draw_debug_stats"].get<decltype(s->draw_debug_stats)>();
         s->draw_material_info = GlobalDEF["draw_material_info"].get<decltype(s->draw_material_info)>();
         s->draw_detailed_material_info = GlobalDEF["draw_detailed_material_info"].get<decltype(s->draw_detailed_material_info)>();
@@ -81,19 +125,59 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
         s->water_pixelated = GlobalDEF["water_pixelated"].get<decltype(s->water_pixelated)>();
         s->lightingQuality = GlobalDEF["lightingQuality"].get<decltype(s->lightingQuality)>();
         s->draw_light_overlay = GlobalDEF["draw_light_overlay"].get<decltype(s->draw_light_overlay)>();
+        s->lighting_scale = GlobalDEF["lighting_scale"].get<decltype(s->lighting_scale)>();
         s->simpleLighting = GlobalDEF["simpleLighting"].get<decltype(s->simpleLighting)>();
         s->lightingEmission = GlobalDEF["lightingEmission"].get<decltype(s->lightingEmission)>();
         s->lightingDithering = GlobalDEF["lightingDithering"].get<decltype(s->lightingDithering)>();
+        s->dynamic_resolution_ms = GlobalDEF["dynamic_resolution_ms"].get<decltype(s->dynamic_resolution_ms)>();
         s->tick_world = GlobalDEF["tick_world"].get<decltype(s->tick_world)>();
         s->tick_box2d = GlobalDEF["tick_box2d"].get<decltype(s->tick_box2d)>();
+        s->tick_box2d_parallel = GlobalDEF["tick_box2d_parallel"].get<decltype(s->tick_box2d_parallel)>();
+        s->physics_lod_dist = GlobalDEF["physics_lod_dist"].get<decltype(s->physics_lod_dist)>();
+        s->physics_step_rate = GlobalDEF["physics_step_rate"].get<decltype(s->physics_step_rate)>();
+        s->physics_max_steps = GlobalDEF["physics_max_steps"].get<decltype(s->physics_max_steps)>();
+        s->physics_interpolate = GlobalDEF["physics_interpolate"].get<decltype(s->physics_interpolate)>();
+        s->physics_far_dist = GlobalDEF["physics_far_dist"].get<decltype(s->physics_far_dist)>();
+        s->physics_far_interval = GlobalDEF["physics_far_interval"].get<decltype(s->physics_far_interval)>();
+        s->physics_grid_terrain = GlobalDEF["physics_grid_terrain"].get<decltype(s->physics_grid_terrain)>();
+        s->tick_liquid_particles = GlobalDEF["tick_liquid_particles"].get<decltype(s->tick_liquid_particles)>();
+        s->liquid_particle_min_cells = GlobalDEF["liquid_particle_min_cells"].get<decltype(s->liquid_particle_min_cells)>();
+        s->liquid_level_solver = GlobalDEF["liquid_level_solver"].get<decltype(s->liquid_level_solver)>();
         s->tick_temperature = GlobalDEF["tick_temperature"].get<decltype(s->tick_temperature)>();
         s->hd_objects = GlobalDEF["hd_objects"].get<decltype(s->hd_objects)>();
+        s->streaming_uploads = GlobalDEF["streaming_uploads"].get<decltype(s->streaming_uploads)>();
+        s->gpu_world_pixels = GlobalDEF["gpu_world_pixels"].get<decltype(s->gpu_world_pixels)>();
+        s->gpu_cell_sim = GlobalDEF["gpu_cell_sim"].get<decltype(s->gpu_cell_sim)>();
+        s->merge_budget_us = GlobalDEF["merge_budget_us"].get<decltype(s->merge_budget_us)>();
+        s->populate_budget_us = GlobalDEF["populate_budget_us"].get<decltype(s->populate_budget_us)>();
+        s->npc_think_budget_us = GlobalDEF["npc_think_budget_us"].get<decltype(s->npc_think_budget_us)>();
+        s->npc_sleep_ticks = GlobalDEF["npc_sleep_ticks"].get<decltype(s->npc_sleep_ticks)>();
+        s->interest_background_interval = GlobalDEF["interest_background_interval"].get<decltype(s->interest_background_interval)>();
+        s->pregen_radius = GlobalDEF["pregen_radius"].get<decltype(s->pregen_radius)>();
+        s->chunk_cache_mb = GlobalDEF["chunk_cache_mb"].get<decltype(s->chunk_cache_mb)>();
+        s->memory_budget_mb = GlobalDEF["memory_budget_mb"].get<decltype(s->memory_budget_mb)>();
+        s->lua_gc_generational = GlobalDEF["lua_gc_generational"].get<decltype(s->lua_gc_generational)>();
+        s->lua_gc_budget_us = GlobalDEF["lua_gc_budget_us"].get<decltype(s->lua_gc_budget_us)>();
+        s->lua_hot_reload = GlobalDEF["lua_hot_reload"].get<decltype(s->lua_hot_reload)>();
+        s->lua_profiler = GlobalDEF["lua_profiler"].get<decltype(s->lua_profiler)>();
+        s->lua_profiler_interval = GlobalDEF["lua_profiler_interval"].get<decltype(s->lua_profiler_interval)>();
+        s->spike_threshold_ms = GlobalDEF["spike_threshold_ms"].get<decltype(s->spike_threshold_ms)>();
+        s->tick_checksum = GlobalDEF["tick_checksum"].get<decltype(s->tick_checksum)>();
+        s->autosave_interval = GlobalDEF["autosave_interval"].get<decltype(s->autosave_interval)>();
+        s->vsync_mode = GlobalDEF["vsync_mode"].get<decltype(s->vsync_mode)>();
+        s->max_fps = GlobalDEF["max_fps"].get<decltype(s->max_fps)>();
+        s->late_latch = GlobalDEF["late_latch"].get<decltype(s->late_latch)>();
+        s->audio_thread = GlobalDEF["audio_thread"].get<decltype(s->audio_thread)>();
+        s->job_hybrid_placement = GlobalDEF["job_hybrid_placement"].get<decltype(s->job_hybrid_placement)>();
+        s->job_pin_workers = GlobalDEF["job_pin_workers"].get<decltype(s->job_pin_workers)>();
+        s->job_thread_priorities = GlobalDEF["job_thread_priorities"].get<decltype(s->job_thread_priorities)>();
         s->hd_objects_size = GlobalDEF["hd_objects_size"].get<decltype(s->hd_objects_size)>();
         s->draw_ui_debug = GlobalDEF["draw_ui_debug"].get<decltype(s->draw_ui_debug)>();
         s->draw_imgui_debug = GlobalDEF["draw_imgui_debug"].get<decltype(s->draw_imgui_debug)>();
         s->draw_profiler = GlobalDEF["draw_profiler"].get<decltype(s->draw_profiler)>();
         s->draw_console = GlobalDEF["draw_console"].get<decltype(s->draw_console)>();
         s->draw_pack_editor = GlobalDEF["draw_pack_editor"].get<decltype(s->draw_pack_editor)>();
+        s->imgui_skip_hidden = GlobalDEF["imgui_skip_hidden"].get<decltype(s->imgui_skip_hidden)>();
 
         s->cell_iter = GlobalDEF["cell_iter"].get<int>();
         s->brush_size = GlobalDEF["brush_size"].get<int>();
@@ -102,6 +186,11 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
         METADOT_ERROR("Load GlobalDEF failed");
     }
 
+    // 选项菜单保存的设置覆盖 global.lua 中的默认值
+    // 之后菜单中的改动也记在这里
+    if (LoadUserSettings(gameUI.OptionsUI__settings, ME_fs_get_path(GLOBALDEF_SETTINGS_FILE))) gameUI.OptionsUI__settings.apply(s);
+    gameUI.OptionsUI__vsync = s->vsync_mode != 0;
+
     gameUI.visible_debugdraw = open_debugui;
     s->draw_frame_graph = open_debugui;
     if (!open_debugui) {
@@ -110,22 +199,202 @@ void InitGlobalDEF(GlobalDEF* s, bool open_debugui) {
         s->draw_load_zones = false;
         s->draw_physics_debug = false;
         s->draw_chunk_state = false;
+        s->draw_chunk_cost = false;
         s->draw_debug_stats = false;
         s->draw_detailed_material_info = false;
         s->draw_temperature_map = false;
+#ifdef ME_RELEASE
+        // 发布版本默认没有任何调试窗口 ImGui 整帧都会被跳过
+        s->draw_material_info = false;
+#endif
     }
 
     METADOT_INFO("GlobalDEF loaded");
 }
 
-void LoadGlobalDEF(std::string globaldef_src) {}
+namespace {
+
+// LoadGlobalDEF / SaveGlobalDEF 的文件 头部之后每一项为 u8 名字长度 + 名字 + u8 类型 + 4 字节的值
+// 按名字匹配 增删 GlobalDEF 的字段不影响已有的文件
+constexpr char SETTINGS_MAGIC[4] = {'M', 'E', 'S', 'T'};
+constexpr u32 SETTINGS_VERSION = 1;
+
+enum class setting_type : u8 { Bool = 0, Int = 1, Float = 2 };
+
+// 不是 CVAR_TYPES 的成员返回 false
+bool setting_type_of(const meta::r::member &member, setting_type &out) {
+    const meta::r::any_type value_type = member.get_type().get_value_type();
+    if (value_type == meta::r::resolve_type<bool>())
+        out = setting_type::Bool;
+    else if (value_type == meta::r::resolve_type<int>())
+        out = setting_type::Int;
+    else if (value_type == meta::r::resolve_type<float>())
+        out = setting_type::Float;
+    else
+        return false;
+    return true;
+}
+
+// 对 InitGlobalDEF 注册的每个 CVAR_TYPES 成员调用 f(member, type)
+template <typename F>
+void for_each_setting(F &&f) {
+    const meta::r::class_type &type = meta::r::resolve_type<GlobalDEF>();
+    for (const meta::r::member &member : type.get_members()) {
+        setting_type t;
+        if (setting_type_of(member, t)) f(member, t);
+    }
+}
+
+template <typename T>
+void put(std::string &out, const T &v) {
+    out.append((const char *)&v, sizeof(T));
+}
+
+// GLOBALDEF_SETTINGS_FILE 的头部 之后是 static_serializer 写出的 UserSettings
+constexpr char USER_SETTINGS_MAGIC[4] = {'M', 'E', 'U', 'S'};
+
+}  // namespace
+
+void UserSettings::capture(const GlobalDEF &s) {
+    if (changed & DRAW_MATERIAL_INFO) draw_material_info = s.draw_material_info;
+    if (changed & VSYNC_MODE) vsync_mode = s.vsync_mode;
+    if (changed & HD_OBJECTS) hd_objects = s.hd_objects;
+    if (changed & LIGHTING_QUALITY) lightingQuality = s.lightingQuality;
+    if (changed & SIMPLE_LIGHTING) simpleLighting = s.simpleLighting;
+    if (changed & LIGHTING_DITHERING) lightingDithering = s.lightingDithering;
+}
+
+void UserSettings::apply(GlobalDEF *s) const {
+    if (changed & DRAW_MATERIAL_INFO) s->draw_material_info = draw_material_info;
+    if (changed & VSYNC_MODE) s->vsync_mode = vsync_mode;
+    if (changed & HD_OBJECTS) s->hd_objects = hd_objects;
+    if (changed & LIGHTING_QUALITY) s->lightingQuality = lightingQuality;
+    if (changed & SIMPLE_LIGHTING) s->simpleLighting = simpleLighting;
+    if (changed & LIGHTING_DITHERING) s->lightingDithering = lightingDithering;
+}
+
+bool LoadUserSettings(UserSettings &u, const std::string &path) {
+    if (!ME_fs_exists(path)) return false;
+    const std::string data = ME_fs_readfile(path);
+
+    UserSettings read;
+    if (data.size() < sizeof(USER_SETTINGS_MAGIC) || memcmp(data.data(), USER_SETTINGS_MAGIC, sizeof(USER_SETTINGS_MAGIC)) != 0 ||
+        !meta::static_refl::Deserialize(read, (const u8 *)data.data() + sizeof(USER_SETTINGS_MAGIC), data.size() - sizeof(USER_SETTINGS_MAGIC))) {
+        METADOT_WARN(std::format("Settings file {0} is not valid", path).c_str());
+        return false;
+    }
+    u = read;
+    return true;
+}
+
+bool SaveUserSettings(const UserSettings &u, const std::string &path) {
+    std::vector<u8> out(USER_SETTINGS_MAGIC, USER_SETTINGS_MAGIC + sizeof(USER_SETTINGS_MAGIC));
+    meta::static_refl::Serialize(u, out);
+    return ME_fs_write_file_atomic(path, (const char *)out.data(), out.size());
+}
+
+bool LoadGlobalDEF(GlobalDEF *s, const std::string &path) {
+    if (!ME_fs_exists(path)) return false;
+    const std::string data = ME_fs_readfile(path);
+
+    size_t at = 0;
+    auto take = [&](void *dst, size_t size) {
+        if (size > data.size() - at) return false;
+        memcpy(dst, data.data() + at, size);
+        at += size;
+        return true;
+    };
+
+    char magic[4];
+    u32 version = 0, count = 0;
+    if (!take(magic, sizeof(magic)) || memcmp(magic, SETTINGS_MAGIC, sizeof(magic)) != 0 || !take(&version, sizeof(version)) || version != SETTINGS_VERSION || !take(&count, sizeof(count))) {
+        METADOT_WARN(std::format("Settings file {0} is not valid", path).c_str());
+        return false;
+    }
+
+    const meta::r::class_type &type = meta::r::resolve_type<GlobalDEF>();
+    u32 applied = 0;
+    for (u32 i = 0; i < count; i++) {
+        u8 len = 0;
+        char name[256];
+        setting_type tag;
+        char value[4];
+        if (!take(&len, sizeof(len)) || !take(name, len) || !take(&tag, sizeof(tag)) || !take(value, sizeof(value))) {
+            METADOT_WARN(std::format("Settings file {0} is truncated", path).c_str());
+            break;
+        }
+
+        // 已经删掉或者改了类型的设置忽略 保留 global.lua 中的默认值
+        const meta::r::member member = type.get_member(std::string_view(name, len));
+        setting_type t;
+        if (!member || !setting_type_of(member, t) || t != tag) continue;
+
+        meta::r::uresult result;
+        if (t == setting_type::Bool) {
+            result = member.try_set(*s, value[0] != 0);
+        } else if (t == setting_type::Int) {
+            int v;
+            memcpy(&v, value, sizeof(v));
+            result = member.try_set(*s, v);
+        } else {
+            float v;
+            memcpy(&v, value, sizeof(v));
+            result = member.try_set(*s, v);
+        }
+        if (!result.has_error()) applied++;
+    }
+
+    METADOT_INFO(std::format("Loaded {0} settings from {1}", applied, path).c_str());
+    return true;
+}
+
+bool SaveGlobalDEF(const GlobalDEF &s, const std::string &path) {
+    std::string out;
+    out.append(SETTINGS_MAGIC, sizeof(SETTINGS_MAGIC));
+    put(out, SETTINGS_VERSION);
+    const size_t countAt = out.size();
+    put(out, (u32)0);
+
+    u32 count = 0;
+    for_each_setting([&](const meta::r::member &member, setting_type t) {
+        const std::string &name = member.get_name();
+        if (name.size() > 255) return;
+        const meta::r::uvalue v = member.get(s);
+
+        char value[4] = {};
+        if (t == setting_type::Bool) {
+            value[0] = v.as<bool>() ? 1 : 0;
+        } else if (t == setting_type::Int) {
+            const int i = v.as<int>();
+            memcpy(value, &i, sizeof(i));
+        } else {
+            const float f = v.as<float>();
+            memcpy(value, &f, sizeof(f));
+        }
+
+        put(out, (u8)name.size());
+        out += name;
+        put(out, t);
+        out.append(value, sizeof(value));
+        count++;
+    });
+    memcpy(out.data() + countAt, &count, sizeof(count));
+
+    return ME_fs_write_file_atomic(path, out.data(), out.size());
+}
 
-void SaveGlobalDEF(std::string globaldef_src) {
-    // std::string settings_data = "GetSettingsData = function()\nsettings_data = {}\n";
-    // SaveLuaConfig(*s, "settings_data", settings_data);
-    // settings_data += "return settings_data\nend";
-    // std::ofstream o(globaldef_src);
-    // o << settings_data;
+bool ExportGlobalDEF(const GlobalDEF &s, const std::string &path) {
+    std::string out = "-- Copyright(c) 2022-2023, KaoruXun All rights reserved.\n\nglobal_def = {}\n\n";
+    for_each_setting([&](const meta::r::member &member, setting_type t) {
+        const meta::r::uvalue v = member.get(s);
+        if (t == setting_type::Bool)
+            struct_as(out, "global_def", member.get_name().c_str(), v.as<bool>() ? "true" : "false");
+        else if (t == setting_type::Int)
+            struct_as(out, "global_def", member.get_name().c_str(), v.as<int>());
+        else
+            struct_as(out, "global_def", member.get_name().c_str(), v.as<float>());
+    });
+    return ME_fs_write_file_atomic(path, out.data(), out.size());
 }
 
 template <>
@@ -26,6 +26,7 @@
 #include "engine/game_utils/jsonwarp.h"
 #include "engine/meta/meta.hpp"
 #include "engine/meta/reflection.hpp"
+#include "engine/meta/static_relfection.hpp"
 #include "engine/utils/type.hpp"
 #include "libs/parallel_hashmap/phmap.h"
 
@@ -47,6 +48,7 @@ struct GlobalDEF {
     bool draw_b2d_pair;
     bool draw_b2d_centerMass;
     bool draw_chunk_state;
+    bool draw_chunk_cost;
     bool draw_debug_stats;
     bool draw_material_info;
     bool draw_detailed_material_info;
@@ -62,14 +64,53 @@ struct GlobalDEF {
     bool water_pixelated;
     float lightingQuality;
     bool draw_light_overlay;
+    int lighting_scale;
     bool simpleLighting;
     bool lightingEmission;
     bool lightingDithering;
+    float dynamic_resolution_ms;
 
     bool tick_world;
     bool tick_box2d;
+    bool tick_box2d_parallel;
+    int physics_lod_dist;
+    int physics_step_rate;
+    int physics_max_steps;
+    bool physics_interpolate;
+    int physics_far_dist;
+    int physics_far_interval;
+    bool physics_grid_terrain;
+    bool tick_liquid_particles;
+    int liquid_particle_min_cells;
+    bool liquid_level_solver;
     bool tick_temperature;
     bool hd_objects;
+    bool streaming_uploads;
+    bool gpu_world_pixels;
+    bool gpu_cell_sim;
+    int merge_budget_us;
+    int populate_budget_us;
+    int npc_think_budget_us;
+    int npc_sleep_ticks;
+    int interest_background_interval;
+    int pregen_radius;
+    int chunk_cache_mb;
+    int memory_budget_mb;
+    bool lua_gc_generational;
+    int lua_gc_budget_us;
+    bool lua_hot_reload;
+    bool lua_profiler;
+    int lua_profiler_interval;
+    int spike_threshold_ms;
+    bool tick_checksum;
+    int autosave_interval;
+    int vsync_mode;
+    int max_fps;
+    bool late_latch;
+    bool audio_thread;
+    bool job_hybrid_placement;
+    bool job_pin_workers;
+    bool job_thread_priorities;
 
     int hd_objects_size;
 
@@ -79,6 +120,7 @@ struct GlobalDEF {
     bool draw_console;
     bool draw_pack_editor;
     bool draw_code_editor;
+    bool imgui_skip_hidden;
 
     int cell_iter;
     int brush_size;
@@ -86,9 +128,65 @@ struct GlobalDEF {
     bool debug_entities_test;
 };
 
+// 选项菜单修改后保存的设置 (相对 ME_fs_get_path)
+#define GLOBALDEF_SETTINGS_FILE "settings.bin"
+
+// 玩家在选项菜单中改过的设置 以 static_serializer 写入 GLOBALDEF_SETTINGS_FILE
+// 只有 changed 中的项覆盖 global.lua 的默认值 没改过的项随 global.lua 变化
+// 新增设置时在末尾加字段和位 字段标上 Serialize::Since 并把 Serialize::Version 加一 旧文件照常读入
+struct UserSettings {
+    // changed 的位 与下面的字段一一对应
+    enum : u32 {
+        DRAW_MATERIAL_INFO = 1 << 0,
+        VSYNC_MODE = 1 << 1,
+        HD_OBJECTS = 1 << 2,
+        LIGHTING_QUALITY = 1 << 3,
+        SIMPLE_LIGHTING = 1 << 4,
+        LIGHTING_DITHERING = 1 << 5,
+    };
+
+    u32 changed = 0;
+    bool draw_material_info = false;
+    int vsync_mode = 0;
+    bool hd_objects = false;
+    float lightingQuality = 0.0f;
+    bool simpleLighting = false;
+    bool lightingDithering = false;
+
+    // 记下玩家改了哪几项 值在 capture 时取
+    void mark(u32 bits) { changed |= bits; }
+    // 从 s 取出 changed 中各项的当前值
+    void capture(const GlobalDEF& s);
+    // changed 中的项写回 s
+    void apply(GlobalDEF* s) const;
+};
+
+template <>
+struct meta::static_refl::TypeInfo<UserSettings> : TypeInfoBase<UserSettings> {
+    static constexpr AttrList attrs = {Attr{TSTR("Serialize::Version"), 1}};
+    static constexpr FieldList fields = {
+            Field{TSTR("changed"), &Type::changed},
+            Field{TSTR("draw_material_info"), &Type::draw_material_info},
+            Field{TSTR("vsync_mode"), &Type::vsync_mode},
+            Field{TSTR("hd_objects"), &Type::hd_objects},
+            Field{TSTR("lightingQuality"), &Type::lightingQuality},
+            Field{TSTR("simpleLighting"), &Type::simpleLighting},
+            Field{TSTR("lightingDithering"), &Type::lightingDithering},
+    };
+};
+
+// 文件不存在或者无效时返回 false u 不变
+bool LoadUserSettings(UserSettings& u, const std::string& path);
+bool SaveUserSettings(const UserSettings& u, const std::string& path);
+
+// 先读 global.lua 中的默认值 再读 GLOBALDEF_SETTINGS_FILE
 void InitGlobalDEF(GlobalDEF* s, bool openDebugUIs);
-void LoadGlobalDEF(std::string globaldef_src);
-void SaveGlobalDEF(std::string globaldef_src);
+// InitGlobalDEF 注册的 bool/int/float 成员按名字存成二进制 不经过 Lua 解释器
+// 录像用它保存录制时的全部设置 文件不存在或者无效时返回 false s 不变
+bool LoadGlobalDEF(GlobalDEF* s, const std::string& path);
+bool SaveGlobalDEF(const GlobalDEF& s, const std::string& path);
+// 导出为与 global.lua 相同格式的 Lua 文本 方便查看和修改
+bool ExportGlobalDEF(const GlobalDEF& s, const std::string& path);
 
 namespace cvar {
 
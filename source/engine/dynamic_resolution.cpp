@@ -0,0 +1,40 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "dynamic_resolution.hpp"
+
+#include "engine/core/profiler.hpp"
+
+namespace ME {
+
+void DynamicResolution::update(f32 gpuMs, f32 targetMs) {
+    if (targetMs <= 0.0f) {
+        current = cooldown = below = 0;
+        smoothed = -1.0f;
+        return;
+    }
+    if (gpuMs < 0.0f) return;
+
+    // 单帧的尖峰 (加载区块 重建贴图) 不应该让画质掉下来
+    smoothed = smoothed < 0.0f ? gpuMs : smoothed + (gpuMs - smoothed) * 0.1f;
+    if (cooldown > 0) cooldown--;
+
+    if (smoothed > targetMs) {
+        below = 0;
+        if (cooldown == 0 && current + 1 < STEP_COUNT) {
+            current++;
+            cooldown = COOLDOWN_FRAMES;
+        }
+    } else if (smoothed < targetMs * RAISE_RATIO) {
+        if (++below >= RAISE_FRAMES && cooldown == 0 && current > 0) {
+            current--;
+            cooldown = COOLDOWN_FRAMES;
+            below = 0;
+        }
+    } else {
+        below = 0;
+    }
+
+    ME_profiler_gauge("dynamic resolution level", current);
+}
+
+}  // namespace ME
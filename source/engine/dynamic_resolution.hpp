@@ -0,0 +1,50 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_DYNAMIC_RESOLUTION_HPP
+#define ME_DYNAMIC_RESOLUTION_HPP
+
+#include <algorithm>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 动态分辨率 game::dynres
+// 按 GPU 渲染世界的耗时 (ME_profiler_gpu_render_time) 逐级降低光照的计算分辨率和质量 让帧时间保持在目标以内
+// render_scale 是镜头缩放 世界纹理按格子大小渲染 都不参与调整 光照是渲染中最贵的一步
+class DynamicResolution {
+public:
+    struct step {
+        f32 quality;         // 乘在 lightingQuality 上
+        int lighting_scale;  // 与 lighting_scale 取较大的
+    };
+
+    static constexpr step STEPS[] = {{1.0f, 1}, {0.75f, 1}, {0.75f, 2}, {0.5f, 2}, {0.5f, 4}, {0.25f, 4}};
+    static constexpr u32 STEP_COUNT = sizeof(STEPS) / sizeof(STEPS[0]);
+
+    // 换一级之后至少等的帧数 查询结果要几帧之后才回来 光照也要重新算
+    static constexpr u32 COOLDOWN_FRAMES = 30;
+    // 连续这么多帧低于目标的 RAISE_RATIO 才升一级 升级比降级谨慎 避免来回跳
+    static constexpr u32 RAISE_FRAMES = 120;
+    static constexpr f32 RAISE_RATIO = 0.7f;
+
+    // gpuMs 小于 0 (还没有结果或不支持查询) 时保持当前一级 targetMs 小于等于 0 时回到最高一级
+    void update(f32 gpuMs, f32 targetMs);
+
+    // 实际使用的光照质量和缩小倍数 不会高于玩家的设置
+    f32 lighting_quality(f32 setting) const { return setting * STEPS[current].quality; }
+    int lighting_scale(int setting) const { return std::max(setting, STEPS[current].lighting_scale); }
+
+    u32 level() const { return current; }
+    f32 smoothed_ms() const { return smoothed; }
+
+private:
+    u32 current = 0;
+    u32 cooldown = 0;
+    u32 below = 0;
+    f32 smoothed = -1.0f;
+};
+
+}  // namespace ME
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -366,10 +367,64 @@ public:
 // -----------------------------------------------------------------------------
 
 namespace ME::ecs {
+// 系统读写的组件或资源类型 同一事件的系统互不冲突时由 feature::process_event 并行执行
+// 没有声明的系统与所有系统冲突 保持注册顺序串行执行
+// 并行的系统不能创建销毁实体或增删组件
+class system_access final {
+public:
+    template <typename... Ts>
+    system_access& read() {
+        (reads_.push_back(detail::type_family<Ts>::id()), ...);
+        declared_ = true;
+        return *this;
+    }
+
+    template <typename... Ts>
+    system_access& write() {
+        (writes_.push_back(detail::type_family<Ts>::id()), ...);
+        declared_ = true;
+        return *this;
+    }
+
+    // 必须在调用 process_event 的线程上执行 例如提交渲染
+    system_access& main_thread() noexcept {
+        main_thread_ = true;
+        return *this;
+    }
+
+    bool is_declared() const noexcept { return declared_; }
+    bool is_main_thread() const noexcept { return main_thread_; }
+
+    bool conflicts_with(const system_access& other) const noexcept {
+        if (!declared_ || !other.declared_) {
+            return true;
+        }
+        return intersects_(writes_, other.writes_) || intersects_(writes_, other.reads_) || intersects_(reads_, other.writes_);
+    }
+
+private:
+    static bool intersects_(const std::vector<family_id>& l, const std::vector<family_id>& r) noexcept {
+        for (const family_id id : l) {
+            if (std::find(r.begin(), r.end(), id) != r.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool declared_{false};
+    bool main_thread_{false};
+    std::vector<family_id> reads_;
+    std::vector<family_id> writes_;
+};
+
 template <>
 class system<> {
 public:
     virtual ~system() = default;
+
+    // 在 add_system 时调用一次
+    virtual void declare(system_access& access) const { (void)access; }
 };
 
 template <typename E>
@@ -389,6 +444,16 @@ class system<E, Es...> : public system<E>, public system<Es...> {};
 // -----------------------------------------------------------------------------
 
 namespace ME::ecs {
+// 系统的执行时间 由 feature::process_event 记录 单位微秒
+struct system_stats {
+    const char* name{nullptr};  // typeid 的名字 依编译器而定
+    std::uint64_t calls{0u};
+    double last_us{0.0};    // 最近一次 process 的耗时
+    double max_us{0.0};     // 单次 process 的最大耗时
+    double window_us{0.0};  // 上次 begin_stats_window 之后的累计耗时
+    double total_us{0.0};
+};
+
 class feature final {
 public:
     feature() = default;
@@ -416,9 +481,29 @@ public:
     template <typename Event>
     feature& process_event(registry& owner, const Event& event);
 
+    // 与 add_system 的顺序相同 每个系统一项
+    const std::vector<system_stats>& stats() const noexcept;
+    void begin_stats_window() noexcept;
+    void reset_stats() noexcept;
+
 private:
+    template <typename System>
+    struct handler_ {
+        System* system;
+        const system_access* access;
+        system_stats* stats;
+    };
+
+    template <typename System, typename Event>
+    static void process_timed_(System& s, registry& owner, const Event& event, system_stats& stats);
+
+    template <typename System, typename Event>
+    static void process_scheduled_(registry& owner, const Event& event, const std::vector<handler_<System>>& handlers);
+
     bool disabled_{false};
     std::vector<std::unique_ptr<system<>>> systems_;
+    std::vector<system_access> accesses_;
+    std::vector<system_stats> stats_;
     mutable detail::incremental_locker systems_locker_;
 };
 }  // namespace ME::ecs
@@ -557,6 +642,20 @@ public:
     template <typename... Ts, typename F, typename... Opts>
     void for_joined_components(F&& f, Opts&&... opts) const;
 
+    // 与 for_joined_components 相同 但按 grain 分块在 job 的所有 worker 上执行 f
+    // f 只能修改传入的组件 不能创建销毁实体或增删组件
+    template <typename... Ts, typename F, typename... Opts>
+    void parallel_for_joined_components(std::uint32_t grain, F&& f, Opts&&... opts);
+
+    // 为 Ts 建立拥有组 之后 for_joined_components 和 parallel_for_joined_components 在组件集合恰好是 Ts (顺序任意) 时
+    // 只线性扫描组内实体 增删这些组件时多几次交换
+    // 一个组件类型最多属于一个组 已经属于别的组时抛出 std::logic_error
+    template <typename... Ts>
+    void group_components();
+
+    template <typename T, typename... Ts>
+    bool has_group() const noexcept;
+
     template <typename Tag, typename... Args>
     feature& assign_feature(Args&&... args);
 
@@ -581,6 +680,16 @@ public:
     };
     memory_usage_info memory_usage() const noexcept;
 
+    // 对每个组件类型的存储调用 f(const detail::storage_info&)
+    template <typename F>
+    void for_each_storage_info(F&& f) const;
+
+    // 对每个 feature 调用 f(feature&) 用于读取系统的执行时间
+    template <typename F>
+    void for_each_feature(F&& f);
+    template <typename F>
+    void for_each_feature(F&& f) const;
+
     template <typename T>
     std::size_t component_memory_usage() const noexcept;
 
@@ -594,6 +703,9 @@ private:
     template <typename T>
     detail::component_storage<T>& get_or_create_storage_();
 
+    template <typename T, typename... Ts>
+    static bool is_grouped_(const detail::component_storage<T>* storage) noexcept;
+
     template <typename F, typename... Opts>
     void for_joined_components_impl_(std::index_sequence<>, F&& f, Opts&&... opts);
 
@@ -606,6 +718,9 @@ private:
     template <typename T, typename... Ts, typename F, typename... Opts, std::size_t I, std::size_t... Is>
     void for_joined_components_impl_(std::index_sequence<I, Is...>, F&& f, Opts&&... opts) const;
 
+    template <typename T, typename... Ts, typename F, typename... Opts, std::size_t I, std::size_t... Is>
+    void parallel_for_joined_components_impl_(std::index_sequence<I, Is...>, std::uint32_t grain, F&& f, Opts&&... opts);
+
     template <typename T, typename... Ts, typename F, typename Ss, typename... Cs>
     void for_joined_components_impl_(const uentity& e, const F& f, const Ss& ss, Cs&... cs);
 
@@ -628,6 +743,9 @@ private:
     using storage_uptr = std::unique_ptr<detail::component_storage_base>;
     detail::sparse_map<family_id, storage_uptr> storages_;
 
+    using group_uptr = std::unique_ptr<detail::group_base>;
+    std::vector<group_uptr> groups_;
+
     mutable detail::incremental_locker features_locker_;
     detail::sparse_map<family_id, feature> features_;
 };
@@ -1321,7 +1439,14 @@ inline bool feature::is_disabled() const noexcept { return disabled_; }
 template <typename T, typename... Args>
 feature& feature::add_system(Args&&... args) & {
     assert(!systems_locker_.is_locked());
-    systems_.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+    auto s = std::make_unique<T>(std::forward<Args>(args)...);
+    system_access access;
+    s->declare(access);
+    system_stats stats;
+    stats.name = typeid(T).name();
+    accesses_.push_back(std::move(access));
+    stats_.push_back(stats);
+    systems_.push_back(std::move(s));
     return *this;
 }
 
@@ -1336,20 +1461,106 @@ feature& feature::process_event(registry& owner, const Event& event) {
     detail::incremental_lock_guard lock(systems_locker_);
 
     const auto fire_event = [this, &owner](const auto& wrapped_event) {
-        for (const auto& base_system : systems_) {
-            using system_type = system<std::decay_t<decltype(wrapped_event)>>;
-            if (auto event_system = dynamic_cast<system_type*>(base_system.get())) {
-                event_system->process(owner, wrapped_event);
+        using system_type = system<std::decay_t<decltype(wrapped_event)>>;
+
+        // 少于两个可以放到 worker 上的系统时没有可并行的 按注册顺序直接执行
+        std::size_t parallel = 0;
+        for (std::size_t i = 0; i < systems_.size(); ++i) {
+            if (accesses_[i].is_declared() && !accesses_[i].is_main_thread() && dynamic_cast<system_type*>(systems_[i].get())) {
+                ++parallel;
+            }
+        }
+        if (parallel < 2u) {
+            for (std::size_t i = 0; i < systems_.size(); ++i) {
+                if (auto event_system = dynamic_cast<system_type*>(systems_[i].get())) {
+                    process_timed_(*event_system, owner, wrapped_event, stats_[i]);
+                }
+            }
+            return;
+        }
+
+        std::vector<handler_<system_type>> handlers;
+        for (std::size_t i = 0; i < systems_.size(); ++i) {
+            if (auto event_system = dynamic_cast<system_type*>(systems_[i].get())) {
+                handlers.push_back({event_system, &accesses_[i], &stats_[i]});
             }
         }
+        process_scheduled_(owner, wrapped_event, handlers);
     };
 
+    // before<E> E after<E> 三个阶段依次执行 只在阶段内部并行
     fire_event(before<Event>{event});
     fire_event(event);
     fire_event(after<Event>{event});
 
     return *this;
 }
+
+inline const std::vector<system_stats>& feature::stats() const noexcept { return stats_; }
+
+inline void feature::begin_stats_window() noexcept {
+    for (system_stats& stats : stats_) {
+        stats.window_us = 0.0;
+    }
+}
+
+inline void feature::reset_stats() noexcept {
+    for (system_stats& stats : stats_) {
+        const char* name = stats.name;
+        stats = system_stats{};
+        stats.name = name;
+    }
+}
+
+template <typename System, typename Event>
+void feature::process_timed_(System& s, registry& owner, const Event& event, system_stats& stats) {
+    const auto start = std::chrono::steady_clock::now();
+    s.process(owner, event);
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    ++stats.calls;
+    stats.last_us = us;
+    stats.window_us += us;
+    stats.total_us += us;
+    stats.max_us = std::max(stats.max_us, us);
+}
+
+template <typename System, typename Event>
+void feature::process_scheduled_(registry& owner, const Event& event, const std::vector<handler_<System>>& handlers) {
+    // 依赖图: 每个系统依赖注册在它之前且与它冲突的系统
+    // 层级为所有依赖的最大层级加一 同一层的系统互不冲突 可以同时执行
+    const std::size_t count = handlers.size();
+    std::vector<std::size_t> levels(count, 0u);
+    std::size_t level_count = 0u;
+    for (std::size_t j = 0; j < count; ++j) {
+        for (std::size_t i = 0; i < j; ++i) {
+            if (handlers[i].access->conflicts_with(*handlers[j].access)) {
+                levels[j] = std::max(levels[j], levels[i] + 1u);
+            }
+        }
+        level_count = std::max(level_count, levels[j] + 1u);
+    }
+
+    for (std::size_t level = 0; level < level_count; ++level) {
+        std::size_t in_level = 0;
+        for (std::size_t j = 0; j < count; ++j) {
+            in_level += levels[j] == level;
+        }
+
+        job_counter counter;
+        for (std::size_t j = 0; j < count; ++j) {
+            if (levels[j] != level) {
+                continue;
+            }
+            const handler_<System>& h = handlers[j];
+            if (in_level == 1u || h.access->is_main_thread()) {
+                process_timed_(*h.system, owner, event, *h.stats);
+            } else {
+                job::execute(counter, [h, &owner, &event]() { process_timed_(*h.system, owner, event, *h.stats); });
+            }
+        }
+        job::wait(counter);
+    }
+}
 }  // namespace ME::ecs
 
 // -----------------------------------------------------------------------------
@@ -1668,6 +1879,33 @@ void registry::for_joined_components(F&& f, Opts&&... opts) const {
     for_joined_components_impl_<Ts...>(std::make_index_sequence<sizeof...(Ts)>(), std::forward<F>(f), std::forward<Opts>(opts)...);
 }
 
+template <typename... Ts, typename F, typename... Opts>
+void registry::parallel_for_joined_components(std::uint32_t grain, F&& f, Opts&&... opts) {
+    static_assert(sizeof...(Ts) > 0u, "ME::ecs (parallel_for_joined_components needs at least one component type)");
+    parallel_for_joined_components_impl_<Ts...>(std::make_index_sequence<sizeof...(Ts)>(), grain, std::forward<F>(f), std::forward<Opts>(opts)...);
+}
+
+template <typename... Ts>
+void registry::group_components() {
+    static_assert(sizeof...(Ts) > 1u, "ME::ecs (group_components needs at least two component types)");
+    const auto ss = std::make_tuple(&get_or_create_storage_<Ts>()...);
+    if (is_grouped_<Ts...>(std::get<0>(ss))) {
+        return;
+    }
+    if (std::apply([](const auto*... s) { return (... || s->group()); }, ss)) {
+        throw std::logic_error("ME::ecs::registry (component already owned by another group)");
+    }
+    groups_.push_back(std::apply([](auto*... s) { return std::make_unique<detail::owning_group<Ts...>>(*s...); }, ss));
+    auto* group = static_cast<detail::owning_group<Ts...>*>(groups_.back().get());
+    std::apply([group](auto*... s) { (..., s->set_group(group)); }, ss);
+    group->refresh();
+}
+
+template <typename T, typename... Ts>
+bool registry::has_group() const noexcept {
+    return is_grouped_<T, Ts...>(find_storage_<T>());
+}
+
 template <typename Tag, typename... Args>
 feature& registry::assign_feature(Args&&... args) {
     const auto feature_id = detail::type_family<Tag>::id();
@@ -1733,6 +1971,29 @@ inline registry::memory_usage_info registry::memory_usage() const noexcept {
     return info;
 }
 
+template <typename F>
+void registry::for_each_storage_info(F&& f) const {
+    for (const auto family : storages_) {
+        f(storages_.get(family)->info());
+    }
+}
+
+template <typename F>
+void registry::for_each_feature(F&& f) {
+    detail::incremental_lock_guard lock(features_locker_);
+    for (const auto family : features_) {
+        f(features_.get(family));
+    }
+}
+
+template <typename F>
+void registry::for_each_feature(F&& f) const {
+    detail::incremental_lock_guard lock(features_locker_);
+    for (const auto family : features_) {
+        f(features_.get(family));
+    }
+}
+
 template <typename T>
 std::size_t registry::component_memory_usage() const noexcept {
     const detail::component_storage<T>* storage = find_storage_<T>();
@@ -1765,6 +2026,12 @@ detail::component_storage<T>& registry::get_or_create_storage_() {
     return *static_cast<detail::component_storage<T>*>(storages_.get(family).get());
 }
 
+template <typename T, typename... Ts>
+bool registry::is_grouped_(const detail::component_storage<T>* storage) noexcept {
+    const detail::group_base* group = storage ? storage->group() : nullptr;
+    return group && group->owns_exactly<T, Ts...>();
+}
+
 template <typename F, typename... Opts>
 void registry::for_joined_components_impl_(std::index_sequence<>, F&& f, Opts&&... opts) {
     for_each_entity(std::forward<F>(f), std::forward<Opts>(opts)...);
@@ -1781,6 +2048,14 @@ void registry::for_joined_components_impl_(std::index_sequence<I, Is...>, F&& f,
     if (detail::tuple_contains(ss, nullptr)) {
         return;
     }
+    if (detail::component_storage<T>* storage = find_storage_<T>(); is_grouped_<T, Ts...>(storage)) {
+        storage->for_each_dense(storage->group()->size(), [this, storage, &f, &ss, &opts...](std::size_t i) {
+            if (uentity ent{*this, storage->dense_id(i)}; (... && opts(ent))) {
+                std::apply([&f, &ent, storage, i](auto*... s) { f(ent, storage->dense_component(i), s->dense_component(i)...); }, ss);
+            }
+        });
+        return;
+    }
     for_each_component<T>([this, &f, &ss](const uentity& e, T& t) { for_joined_components_impl_<Ts...>(e, f, ss, t); }, std::forward<Opts>(opts)...);
 }
 
@@ -1790,9 +2065,42 @@ void registry::for_joined_components_impl_(std::index_sequence<I, Is...>, F&& f,
     if (detail::tuple_contains(ss, nullptr)) {
         return;
     }
+    if (const detail::component_storage<T>* storage = find_storage_<T>(); is_grouped_<T, Ts...>(storage)) {
+        storage->for_each_dense(storage->group()->size(), [this, storage, &f, &ss, &opts...](std::size_t i) {
+            if (const_uentity ent{*this, storage->dense_id(i)}; (... && opts(ent))) {
+                std::apply([&f, &ent, storage, i](const auto*... s) { f(ent, storage->dense_component(i), s->dense_component(i)...); }, ss);
+            }
+        });
+        return;
+    }
     for_each_component<T>([this, &f, &ss](const const_uentity& e, const T& t) { std::as_const(*this).for_joined_components_impl_<Ts...>(e, f, ss, t); }, std::forward<Opts>(opts)...);
 }
 
+template <typename T, typename... Ts, typename F, typename... Opts, std::size_t I, std::size_t... Is>
+void registry::parallel_for_joined_components_impl_(std::index_sequence<I, Is...>, std::uint32_t grain, F&& f, Opts&&... opts) {
+    const auto ss = std::make_tuple(find_storage_<Ts>()...);
+    if (detail::tuple_contains(ss, nullptr)) {
+        return;
+    }
+    detail::component_storage<T>* storage = find_storage_<T>();
+    if (!storage) {
+        return;
+    }
+    if (is_grouped_<T, Ts...>(storage)) {
+        storage->for_each_dense_parallel(storage->group()->size(), grain, [this, storage, &f, &ss, &opts...](std::size_t i) {
+            if (uentity ent{*this, storage->dense_id(i)}; (... && opts(ent))) {
+                std::apply([&f, &ent, storage, i](auto*... s) { f(ent, storage->dense_component(i), s->dense_component(i)...); }, ss);
+            }
+        });
+    } else {
+        storage->for_each_component_parallel(grain, [this, &f, &ss, &opts...](const entity_id e, T& t) {
+            if (uentity ent{*this, e}; (... && opts(ent))) {
+                for_joined_components_impl_<Ts...>(ent, f, ss, t);
+            }
+        });
+    }
+}
+
 template <typename T, typename... Ts, typename F, typename Ss, typename... Cs>
 void registry::for_joined_components_impl_(const uentity& e, const F& f, const Ss& ss, Cs&... cs) {
     if (T* c = std::get<0>(ss)->find(e)) {
@@ -18,6 +18,7 @@ class after;
 template <typename E>
 class before;
 
+class system_access;
 template <typename... Es>
 class system;
 class feature;
@@ -1,10 +1,13 @@
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <tuple>
+#include <typeinfo>
 #include <vector>
 
 #include "ecs_fwd.hpp"
+#include "engine/core/job.h"
 
 namespace ME::ecs {
 namespace detail {
@@ -117,8 +120,9 @@ public:
     incremental_locker() = default;
     ~incremental_locker() noexcept = default;
 
-    incremental_locker(incremental_locker&& other) noexcept = default;
-    incremental_locker(const incremental_locker& other) noexcept = default;
+    // 并行的系统和 parallel_for_joined_components 会在多个线程上同时加锁 计数必须是原子的
+    incremental_locker(incremental_locker&& other) noexcept { (void)other; }
+    incremental_locker(const incremental_locker& other) noexcept { (void)other; }
 
     incremental_locker& operator=(incremental_locker&& other) noexcept {
         assert(!is_locked());
@@ -132,17 +136,17 @@ public:
         return *this;
     }
 
-    void lock() noexcept { ++lock_count_; }
+    void lock() noexcept { lock_count_.fetch_add(1u, std::memory_order_relaxed); }
 
     void unlock() noexcept {
-        assert(lock_count_);
-        --lock_count_;
+        assert(lock_count_.load(std::memory_order_relaxed));
+        lock_count_.fetch_sub(1u, std::memory_order_relaxed);
     }
 
-    bool is_locked() const noexcept { return !!lock_count_; }
+    bool is_locked() const noexcept { return !!lock_count_.load(std::memory_order_relaxed); }
 
 private:
-    std::size_t lock_count_{0u};
+    std::atomic<std::size_t> lock_count_{0u};
 };
 
 class incremental_lock_guard final {
@@ -221,6 +225,20 @@ public:
         return true;
     }
 
+    // 交换两个位置上的值 拥有组靠它把组内实体排到最前面
+    void swap_dense(std::size_t l, std::size_t r) noexcept {
+        assert(l < dense_.size() && r < dense_.size());
+        if (l == r) {
+            return;
+        }
+        using std::swap;
+        swap(dense_[l], dense_[r]);
+        sparse_[indexer_(dense_[l])] = l;
+        sparse_[indexer_(dense_[r])] = r;
+    }
+
+    const T& dense_at(std::size_t i) const noexcept { return dense_[i]; }
+
     void clear() noexcept { dense_.clear(); }
 
     bool has(const T& v) const noexcept {
@@ -246,6 +264,9 @@ public:
 
     std::size_t memory_usage() const noexcept { return dense_.capacity() * sizeof(dense_[0]) + sparse_.capacity() * sizeof(sparse_[0]); }
 
+    // 存放现有元素实际需要的字节 与 memory_usage 的差是预留的容量和稀疏数组的空洞
+    std::size_t used_memory() const noexcept { return dense_.size() * (sizeof(dense_[0]) + sizeof(sparse_[0])); }
+
 private:
     Indexer indexer_;
     std::vector<T> dense_;
@@ -336,6 +357,23 @@ public:
         return true;
     }
 
+    void swap_dense(std::size_t l, std::size_t r) noexcept {
+        if (l == r) {
+            return;
+        }
+        using std::swap;
+        swap(values_[l], values_[r]);
+        keys_.swap_dense(l, r);
+    }
+
+    const K& key_at(std::size_t i) const noexcept { return keys_.dense_at(i); }
+
+    T& value_at(std::size_t i) noexcept { return values_[i]; }
+
+    const T& value_at(std::size_t i) const noexcept { return values_[i]; }
+
+    std::pair<std::size_t, bool> find_dense_index(const K& k) const noexcept { return keys_.find_dense_index(k); }
+
     void clear() noexcept {
         keys_.clear();
         values_.clear();
@@ -363,6 +401,8 @@ public:
 
     std::size_t memory_usage() const noexcept { return keys_.memory_usage() + values_.capacity() * sizeof(values_[0]); }
 
+    std::size_t used_memory() const noexcept { return keys_.used_memory() + values_.size() * sizeof(values_[0]); }
+
 private:
     sparse_set<K, Indexer> keys_;
     std::vector<T> values_;
@@ -377,6 +417,46 @@ struct entity_id_indexer final {
     std::size_t operator()(entity_id id) const noexcept { return entity_id_index(id); }
 };
 
+//
+// group_base
+//
+
+// 拥有组 每个被拥有的存储里 同时有全部组件的实体按相同顺序排在前 size() 个位置
+// 联合遍历这些组件时只需要线性扫描 不用逐个实体去别的存储里查找
+class group_base {
+public:
+    virtual ~group_base() = default;
+    // 实体刚得到一个被拥有的组件 组件已经在存储里
+    virtual void on_insert(entity_id id) noexcept = 0;
+    // 实体将要失去一个被拥有的组件 组件还在存储里
+    virtual void on_remove(entity_id id) noexcept = 0;
+    virtual bool owns(family_id family) const noexcept = 0;
+    virtual std::size_t type_count() const noexcept = 0;
+
+    // 某个被拥有的存储被清空 其余存储的前缀不再对应完整的实体
+    void on_clear() noexcept { size_ = 0u; }
+
+    std::size_t size() const noexcept { return size_; }
+
+    template <typename... Ts>
+    bool owns_exactly() const noexcept {
+        return type_count() == sizeof...(Ts) && (... && owns(type_family<Ts>::id()));
+    }
+
+protected:
+    std::size_t size_{0u};
+};
+
+// 一个组件类型的存储统计 给调试界面和分析器计数器使用
+struct storage_info {
+    family_id family{0u};
+    const char* name{nullptr};    // typeid 的名字 依编译器而定
+    std::size_t count{0u};        // 组件个数
+    std::size_t memory{0u};       // 已分配的字节
+    std::size_t used_memory{0u};  // 现有组件实际需要的字节
+    std::size_t grouped{0u};      // 在拥有组前缀里的组件个数
+};
+
 class component_storage_base {
 public:
     virtual ~component_storage_base() = default;
@@ -384,6 +464,14 @@ public:
     virtual bool has(entity_id id) const noexcept = 0;
     virtual void clone(entity_id from, entity_id to) = 0;
     virtual std::size_t memory_usage() const noexcept = 0;
+    virtual storage_info info() const noexcept = 0;
+
+    // 一个存储最多属于一个拥有组
+    group_base* group() const noexcept { return group_; }
+    void set_group(group_base* group) noexcept { group_ = group; }
+
+protected:
+    group_base* group_{nullptr};
 };
 
 template <typename T, bool E = std::is_empty_v<T>>
@@ -398,7 +486,12 @@ public:
             return *value;
         }
         assert(!components_locker_.is_locked());
-        return *components_.insert(id, T{std::forward<Args>(args)...}).first;
+        T* value = components_.insert(id, T{std::forward<Args>(args)...}).first;
+        if (group_) {
+            group_->on_insert(id);
+            value = components_.find(id);
+        }
+        return *value;
     }
 
     template <typename... Args>
@@ -407,13 +500,21 @@ public:
             return *value;
         }
         assert(!components_locker_.is_locked());
-        return *components_.insert(id, T{std::forward<Args>(args)...}).first;
+        T* value = components_.insert(id, T{std::forward<Args>(args)...}).first;
+        if (group_) {
+            group_->on_insert(id);
+            value = components_.find(id);
+        }
+        return *value;
     }
 
     bool exists(entity_id id) const noexcept { return components_.has(id); }
 
     bool remove(entity_id id) noexcept override {
         assert(!components_locker_.is_locked());
+        if (group_ && components_.has(id)) {
+            group_->on_remove(id);
+        }
         return components_.unordered_erase(id);
     }
 
@@ -421,6 +522,9 @@ public:
         assert(!components_locker_.is_locked());
         const std::size_t count = components_.size();
         components_.clear();
+        if (group_) {
+            group_->on_clear();
+        }
         return count;
     }
 
@@ -454,8 +558,58 @@ public:
         }
     }
 
+    // 在 job 的所有 worker 上按 grain 分块调用 f 调用期间不能增删这个类型的组件
+    template <typename F>
+    void for_each_component_parallel(std::uint32_t grain, F&& f) {
+        detail::incremental_lock_guard lock(components_locker_);
+        job::parallel_for(static_cast<std::uint32_t>(components_.size()), grain, [this, &f](std::uint32_t i) {
+            const entity_id id = *(components_.begin() + i);
+            f(id, components_.get(id));
+        });
+    }
+
+    // 按存储内的位置访问 拥有组和组的遍历使用
+    std::size_t dense_index(entity_id id) const noexcept { return components_.find_dense_index(id).first; }
+
+    entity_id dense_id(std::size_t i) const noexcept { return components_.key_at(i); }
+
+    T& dense_component(std::size_t i) noexcept { return components_.value_at(i); }
+
+    const T& dense_component(std::size_t i) const noexcept { return components_.value_at(i); }
+
+    void swap_dense(std::size_t l, std::size_t r) noexcept {
+        assert(!components_locker_.is_locked());
+        components_.swap_dense(l, r);
+    }
+
+    // 对前 count 个位置调用 f(位置) 调用期间不能增删这个类型的组件
+    template <typename F>
+    void for_each_dense(std::size_t count, F&& f) const {
+        detail::incremental_lock_guard lock(components_locker_);
+        for (std::size_t i = 0u; i < count; ++i) {
+            f(i);
+        }
+    }
+
+    template <typename F>
+    void for_each_dense_parallel(std::size_t count, std::uint32_t grain, F&& f) const {
+        detail::incremental_lock_guard lock(components_locker_);
+        job::parallel_for(static_cast<std::uint32_t>(count), grain, [&f](std::uint32_t i) { f(static_cast<std::size_t>(i)); });
+    }
+
     std::size_t memory_usage() const noexcept override { return components_.memory_usage(); }
 
+    storage_info info() const noexcept override {
+        storage_info i;
+        i.family = type_family<T>::id();
+        i.name = typeid(T).name();
+        i.count = components_.size();
+        i.memory = components_.memory_usage();
+        i.used_memory = components_.used_memory();
+        i.grouped = group_ ? group_->size() : 0u;
+        return i;
+    }
+
 private:
     registry& owner_;
     mutable detail::incremental_locker components_locker_;
@@ -474,6 +628,9 @@ public:
         }
         assert(!components_locker_.is_locked());
         components_.insert(id);
+        if (group_) {
+            group_->on_insert(id);
+        }
         return empty_value_;
     }
 
@@ -484,6 +641,9 @@ public:
         }
         assert(!components_locker_.is_locked());
         components_.insert(id);
+        if (group_) {
+            group_->on_insert(id);
+        }
         return empty_value_;
     }
 
@@ -491,6 +651,9 @@ public:
 
     bool remove(entity_id id) noexcept override {
         assert(!components_locker_.is_locked());
+        if (group_ && components_.has(id)) {
+            group_->on_remove(id);
+        }
         return components_.unordered_erase(id);
     }
 
@@ -498,6 +661,9 @@ public:
         assert(!components_locker_.is_locked());
         const std::size_t count = components_.size();
         components_.clear();
+        if (group_) {
+            group_->on_clear();
+        }
         return count;
     }
 
@@ -531,8 +697,53 @@ public:
         }
     }
 
+    template <typename F>
+    void for_each_component_parallel(std::uint32_t grain, F&& f) {
+        detail::incremental_lock_guard lock(components_locker_);
+        job::parallel_for(static_cast<std::uint32_t>(components_.size()), grain, [this, &f](std::uint32_t i) { f(*(components_.begin() + i), empty_value_); });
+    }
+
+    std::size_t dense_index(entity_id id) const noexcept { return components_.find_dense_index(id).first; }
+
+    entity_id dense_id(std::size_t i) const noexcept { return components_.dense_at(i); }
+
+    T& dense_component(std::size_t i) const noexcept {
+        (void)i;
+        return empty_value_;
+    }
+
+    void swap_dense(std::size_t l, std::size_t r) noexcept {
+        assert(!components_locker_.is_locked());
+        components_.swap_dense(l, r);
+    }
+
+    template <typename F>
+    void for_each_dense(std::size_t count, F&& f) const {
+        detail::incremental_lock_guard lock(components_locker_);
+        for (std::size_t i = 0u; i < count; ++i) {
+            f(i);
+        }
+    }
+
+    template <typename F>
+    void for_each_dense_parallel(std::size_t count, std::uint32_t grain, F&& f) const {
+        detail::incremental_lock_guard lock(components_locker_);
+        job::parallel_for(static_cast<std::uint32_t>(count), grain, [&f](std::uint32_t i) { f(static_cast<std::size_t>(i)); });
+    }
+
     std::size_t memory_usage() const noexcept override { return components_.memory_usage(); }
 
+    storage_info info() const noexcept override {
+        storage_info i;
+        i.family = type_family<T>::id();
+        i.name = typeid(T).name();
+        i.count = components_.size();
+        i.memory = components_.memory_usage();
+        i.used_memory = components_.used_memory();
+        i.grouped = group_ ? group_->size() : 0u;
+        return i;
+    }
+
 private:
     registry& owner_;
     static T empty_value_;
@@ -543,6 +754,50 @@ private:
 template <typename T>
 T component_storage<T, true>::empty_value_;
 
+//
+// owning_group
+//
+
+template <typename... Ts>
+class owning_group final : public group_base {
+public:
+    owning_group(component_storage<Ts>&... storages) noexcept : storages_(&storages...) {}
+
+    void on_insert(entity_id id) noexcept override {
+        const bool complete = std::apply([id](const auto*... ss) { return (... && ss->exists(id)); }, storages_);
+        if (!complete || std::get<0>(storages_)->dense_index(id) < size_) {
+            return;
+        }
+        std::apply([this, id](auto*... ss) { (..., ss->swap_dense(ss->dense_index(id), size_)); }, storages_);
+        ++size_;
+    }
+
+    void on_remove(entity_id id) noexcept override {
+        const auto* first = std::get<0>(storages_);
+        if (!first->exists(id) || first->dense_index(id) >= size_) {
+            return;
+        }
+        --size_;
+        std::apply([this, id](auto*... ss) { (..., ss->swap_dense(ss->dense_index(id), size_)); }, storages_);
+    }
+
+    bool owns(family_id family) const noexcept override { return (... || (family == type_family<Ts>::id())); }
+
+    std::size_t type_count() const noexcept override { return sizeof...(Ts); }
+
+    // 把已有的完整实体收进组 创建组时调用一次
+    void refresh() noexcept {
+        size_ = 0u;
+        auto* first = std::get<0>(storages_);
+        for (std::size_t i = 0u; i < first->count(); ++i) {
+            on_insert(first->dense_id(i));
+        }
+    }
+
+private:
+    std::tuple<component_storage<Ts>*...> storages_;
+};
+
 class applier_base;
 using applier_uptr = std::unique_ptr<applier_base>;
 
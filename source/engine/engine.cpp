@@ -6,6 +6,7 @@
 
 #include "engine/core/base_memory.h"
 #include "engine/core/core.hpp"
+#include "engine/core/frame_arena.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
 #include "engine/core/platform.h"
@@ -41,10 +42,14 @@ int engine::init_eng() {
 }
 
 void engine::update_post() {
+    // 上一帧 scope 外分配的帧内存在各线程下一次使用时回收
+    frame_arena::next_frame();
     ME_profiler_begin_frame();
+    ME_profiler_gpu_begin_frame();
 
     // 更新帧时间
     m_eng.time.now = ME_gettime();
+    m_eng.time.frameStart = m_eng.time.now;
     m_eng.time.deltaTime = m_eng.time.now - m_eng.time.lastTime;
 }
 
@@ -156,7 +161,7 @@ void engine::process_tick_time() {
     for (int i = 1; i < TraceTimeNum; i++) {
         m_eng.time.frameTimesTrace[i - 1] = m_eng.time.frameTimesTrace[i];
     }
-    m_eng.time.frameTimesTrace[TraceTimeNum - 1] = (u16)(ME_gettime() - m_eng.time.now);
+    m_eng.time.frameTimesTrace[TraceTimeNum - 1] = (u16)(ME_gettime() - m_eng.time.frameStart);
 
     m_eng.time.lastTime = m_eng.time.now;
 }
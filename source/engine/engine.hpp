@@ -53,7 +53,8 @@ typedef struct engine_data {
         i64 lastCheckTime;                  // 帧信息最后检查时间
         i64 lastTickTime;                   // 最后tick时间
         i64 lastLoadingTick;                // 加载界面最后tick时间
-        i64 now;                            // 当前帧开始时间
+        i64 now;                            // 当前帧开始时间 晚锁存时为锁存的时间
+        i64 frameStart;                     // 当前帧开始时间
         i64 deltaTime;                      // 帧用时
         i32 tickCount;                      // 当前tick次数
         f32 mspt;                           // 目标每tick用时
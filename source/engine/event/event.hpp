@@ -11,8 +11,8 @@ namespace ME {
 
 // Events in ME are currently blocking, meaning when an event occurs it
 // immediately gets dispatched and must be dealt with right then an there.
-// For the future, a better strategy might be to buffer events in an event
-// bus and process them during the "event" part of the update stage.
+// Game events posted from worker threads are buffered in EventBus
+// (event_bus.hpp) and delivered in batches once per frame instead.
 
 enum class EventType {
     None = 0,
@@ -0,0 +1,84 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "event_bus.hpp"
+
+#include <algorithm>
+
+#include "engine/core/profiler.hpp"
+
+namespace ME {
+
+void EventBus::init() {
+    queueCount = std::min(job::worker_count(), job::MAX_WORKERS);
+    for (u32 i = 0; i < queueCount; i++) {
+        if (!queues[i]) queues[i] = std::make_unique<queue>();
+    }
+}
+
+u32 EventBus::subscribe(BusEventType type, Handler handler) {
+    const u32 id = nextId++;
+    if (nextId == 0) nextId = 1;
+    handlers.push_back({id, type, std::move(handler)});
+    interest.fetch_or(1u << (u32)type, std::memory_order_relaxed);
+    return id;
+}
+
+void EventBus::unsubscribe(u32 id) {
+    std::erase_if(handlers, [id](const handler_entry &h) { return h.id == id; });
+    u32 mask = 0;
+    for (const handler_entry &h : handlers) mask |= 1u << (u32)h.type;
+    interest.store(mask, std::memory_order_relaxed);
+}
+
+void EventBus::post(const BusEvent &e) {
+    if (!wanted(e.type)) return;
+
+    const u32 w = job::worker_index();
+    if (w < queueCount) {
+        queue &q = *queues[w];
+        const u32 tail = q.tail.load(std::memory_order_relaxed);
+        if (tail - q.head.load(std::memory_order_acquire) < QUEUE_SIZE) {
+            q.items[tail & (QUEUE_SIZE - 1)] = e;
+            q.tail.store(tail + 1, std::memory_order_release);
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(spillLock);
+    spill.push_back(e);
+    spilledCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EventBus::dispatch() {
+    ME_profiler_scope_auto("EventBus");
+
+    for (auto &b : batches) b.clear();
+    for (u32 i = 0; i < queueCount; i++) {
+        queue &q = *queues[i];
+        u32 head = q.head.load(std::memory_order_relaxed);
+        const u32 tail = q.tail.load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const BusEvent &e = q.items[head & (QUEUE_SIZE - 1)];
+            batches[(int)e.type].push_back(e);
+        }
+        q.head.store(head, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> guard(spillLock);
+        for (const BusEvent &e : spill) batches[(int)e.type].push_back(e);
+        spill.clear();
+    }
+
+    u32 count = 0;
+    for (int t = 0; t < (int)BusEventType::Count; t++) {
+        if (batches[t].empty()) continue;
+        count += (u32)batches[t].size();
+        for (const handler_entry &h : handlers) {
+            if ((int)h.type == t) h.handler(batches[t]);
+        }
+    }
+    deliveredCount += count;
+    ME_profiler_count("bus events", count);
+}
+
+}  // namespace ME
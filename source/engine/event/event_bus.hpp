@@ -0,0 +1,96 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_EVENT_BUS_HPP
+#define ME_EVENT_BUS_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+
+namespace ME {
+
+enum class BusEventType : u8 {
+    // 区块在 worker 上读取或生成完成 尚未合并进世界缓冲 x y 为区块坐标 a 为 1 时是新生成的
+    ChunkLoaded,
+    // 像素因温度反应变成别的材料 x y 与 WorldEntity 坐标相同 a 为原材料 b 为新材料
+    CellReaction,
+    // 刚体被切开 x y 为原刚体的位置 a 为碎片数
+    BodySplit,
+    Count
+};
+
+struct BusEvent {
+    BusEventType type = BusEventType::Count;
+    i32 x = 0, y = 0;
+    u32 a = 0, b = 0;
+};
+
+// 跨线程的游戏事件 game::events
+// 任何线程都可以 post 每个 job worker 有自己的单生产者队列 不加锁 job 系统之外的线程和队列满时写入加锁的溢出缓冲
+// 主线程每帧 dispatch 一次 按类型汇总后每个处理函数收到一批事件
+// 同一线程 post 的同类事件按顺序送达 溢出过的批次内顺序不保证
+// 没有人订阅的类型 post 直接返回 频繁的事件先用 wanted() 判断 省去构造事件
+// subscribe unsubscribe dispatch 只能在主线程上调用 处理函数里不能订阅或退订
+class EventBus {
+public:
+    static constexpr u32 QUEUE_SIZE = 1024;
+    static_assert((QUEUE_SIZE & (QUEUE_SIZE - 1)) == 0, "QUEUE_SIZE must be a power of two");
+
+    using Handler = std::function<void(std::span<const BusEvent>)>;
+
+    EventBus() = default;
+    EventBus(const EventBus &) = delete;
+    EventBus &operator=(const EventBus &) = delete;
+
+    // job::init 之后调用 为每个 worker 分配队列 之前 post 的事件都进溢出缓冲
+    void init();
+
+    // 返回的编号不为 0
+    u32 subscribe(BusEventType type, Handler handler);
+    void unsubscribe(u32 id);
+
+    bool wanted(BusEventType type) const { return (interest.load(std::memory_order_relaxed) >> (u32)type) & 1; }
+    void post(const BusEvent &e);
+
+    void dispatch();
+
+    // 累计送达的事件数和写入溢出缓冲的事件数
+    u64 delivered() const { return deliveredCount; }
+    u64 spilled() const { return spilledCount.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) queue {
+        std::atomic<u32> head{0};  // 只有主线程写
+        alignas(64) std::atomic<u32> tail{0};  // 只有所属的 worker 写
+        BusEvent items[QUEUE_SIZE];
+    };
+
+    struct handler_entry {
+        u32 id;
+        BusEventType type;
+        Handler handler;
+    };
+
+    std::unique_ptr<queue> queues[job::MAX_WORKERS];
+    u32 queueCount = 0;
+    std::atomic<u32> interest{0};
+
+    std::mutex spillLock;
+    std::vector<BusEvent> spill;
+    std::atomic<u64> spilledCount{0};
+
+    std::vector<handler_entry> handlers;
+    std::vector<BusEvent> batches[(int)BusEventType::Count];
+    u32 nextId = 1;
+    u64 deliveredCount = 0;
+};
+
+}  // namespace ME
+
+#endif
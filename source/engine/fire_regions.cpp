@@ -0,0 +1,121 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "fire_regions.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace ME {
+
+void FireRegions::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    tilesX = (width + CHUNK_W - 1) / CHUNK_W;
+    tilesY = (height + CHUNK_H - 1) / CHUNK_H;
+    boxes.assign((size_t)tilesX * tilesY, box{0, 0, 0, 0});
+}
+
+void FireRegions::clear() { std::fill(boxes.begin(), boxes.end(), box{0, 0, 0, 0}); }
+
+void FireRegions::expand(int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    for (int ty = y0 / CHUNK_H; ty <= (y1 - 1) / CHUNK_H; ty++) {
+        for (int tx = x0 / CHUNK_W; tx <= (x1 - 1) / CHUNK_W; tx++) {
+            const int bx0 = std::max(x0, tx * CHUNK_W), bx1 = std::min(x1, (tx + 1) * CHUNK_W);
+            const int by0 = std::max(y0, ty * CHUNK_H), by1 = std::min(y1, (ty + 1) * CHUNK_H);
+            box &b = boxes[tx + ty * tilesX];
+            if (b.empty()) {
+                b = {bx0, by0, bx1, by1};
+            } else {
+                b = {std::min(b.x0, bx0), std::min(b.y0, by0), std::max(b.x1, bx1), std::max(b.y1, by1)};
+            }
+        }
+    }
+}
+
+void FireRegions::add(size_t base, u64 fire) {
+    while (fire) {
+        // 同一行上连续的位一起加入
+        const int k = std::countr_zero(fire);
+        const size_t i = base + k;
+        const int y = (int)(i / width), x = (int)(i - (size_t)y * width);
+        const int run = std::min(std::countr_one(fire >> k), width - x);
+        expand(x, y, x + run, y + 1);
+        fire &= ~(run >= 64 ? ~(u64)0 : (((u64)1 << run) - 1) << k);
+    }
+}
+
+void FireRegions::shift(int dx, int dy) {
+    std::vector<box> old;
+    old.swap(boxes);
+    boxes.assign(old.size(), box{0, 0, 0, 0});
+    for (const box &b : old) {
+        if (!b.empty()) expand(b.x0 + dx, b.y0 + dy, b.x1 + dx, b.y1 + dy);
+    }
+}
+
+void FireRegions::shrink(const u8 *pixels) {
+    for (box &b : boxes) {
+        if (b.empty()) continue;
+        box tight{b.x1, b.y1, b.x0, b.y0};
+        for (int y = b.y0; y < b.y1; y++) {
+            const u8 *row = pixels + ((size_t)y * width) * 4 + 3;
+            int first = b.x0;
+            while (first < b.x1 && !row[first * 4]) first++;
+            if (first == b.x1) continue;
+            int last = b.x1 - 1;
+            while (!row[last * 4]) last--;
+            tight = {std::min(tight.x0, first), std::min(tight.y0, y), std::max(tight.x1, last + 1), y + 1};
+        }
+        b = tight.x0 < tight.x1 ? tight : box{0, 0, 0, 0};
+    }
+}
+
+bool FireRegions::empty() const {
+    return std::all_of(boxes.begin(), boxes.end(), [](const box &b) { return b.empty(); });
+}
+
+void FireRegions::changed(const std::vector<DirtyRect> &dirty, frame_vector<MErect> &out) const {
+    for (const DirtyRect &r : dirty) {
+        const box &b = boxes[(r.x / CHUNK_W) + (r.y / CHUNK_H) * tilesX];
+        if (b.empty()) continue;
+        const int x0 = std::max(r.x, b.x0), x1 = std::min(r.x + r.w, b.x1);
+        const int y0 = std::max(r.y, b.y0), y1 = std::min(r.y + r.h, b.y1);
+        if (x0 < x1 && y0 < y1) out.push_back({(f32)x0, (f32)y0, (f32)(x1 - x0), (f32)(y1 - y0)});
+    }
+}
+
+void FireRegions::rects(int margin, const MErect &view, frame_vector<MErect> &out) const {
+    const int vx0 = std::max((int)std::floor(view.x), 0), vx1 = std::min((int)std::ceil(view.x + view.w), width);
+    const int vy0 = std::max((int)std::floor(view.y), 0), vy1 = std::min((int)std::ceil(view.y + view.h), height);
+
+    // 外扩的部分会落到相邻格 每格收集周围 3x3 格的包围盒
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            const int cx0 = std::max(tx * CHUNK_W, vx0), cx1 = std::min((tx + 1) * CHUNK_W, vx1);
+            const int cy0 = std::max(ty * CHUNK_H, vy0), cy1 = std::min((ty + 1) * CHUNK_H, vy1);
+            if (cx0 >= cx1 || cy0 >= cy1) continue;
+
+            box acc{cx1, cy1, cx0, cy0};
+            for (int ny = std::max(ty - 1, 0); ny <= std::min(ty + 1, tilesY - 1); ny++) {
+                for (int nx = std::max(tx - 1, 0); nx <= std::min(tx + 1, tilesX - 1); nx++) {
+                    const box &b = boxes[nx + ny * tilesX];
+                    if (b.empty()) continue;
+                    const int x0 = std::max(b.x0 - margin, cx0), x1 = std::min(b.x1 + margin, cx1);
+                    const int y0 = std::max(b.y0 - margin, cy0), y1 = std::min(b.y1 + margin, cy1);
+                    if (x0 >= x1 || y0 >= y1) continue;
+                    acc = {std::min(acc.x0, x0), std::min(acc.y0, y0), std::max(acc.x1, x1), std::max(acc.y1, y1)};
+                }
+            }
+            if (acc.x0 < acc.x1) out.push_back({(f32)acc.x0, (f32)acc.y0, (f32)(acc.x1 - acc.x0), (f32)(acc.y1 - acc.y0)});
+        }
+    }
+}
+
+}  // namespace ME
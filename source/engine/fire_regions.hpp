@@ -0,0 +1,57 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_FIRE_REGIONS_HPP
+#define ME_FIRE_REGIONS_HPP
+
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/core/frame_arena.hpp"
+#include "engine/core/mathlib_base.hpp"
+#include "world_dirty.hpp"
+
+namespace ME {
+
+// 火焰缓冲 (TexturePack_t::pixelsFire) 中不透明像素的范围 按 CHUNK_W x CHUNK_H 分格记录包围盒 (世界缓冲坐标)
+// 火焰缓冲只在转换 FIRE 和 AIR 像素时写入 包围盒之外的火焰缓冲都是透明的
+// 转换时 add 新的火焰像素 上传后 shrink 按缓冲内容收紧 只扫描现有的包围盒
+// 只在单个线程中使用
+class FireRegions {
+public:
+    void resize(int width, int height);
+    void clear();
+
+    // base 开始的 64 个像素中 fire 的位是火焰像素
+    void add(size_t base, u64 fire);
+    // 像素缓冲平移 (dx, dy) 之后调用 移出世界的部分丢弃
+    void shift(int dx, int dy);
+    // 按 pixels (r g b a) 的 alpha 重新计算包围盒
+    void shrink(const u8 *pixels);
+
+    bool empty() const;
+
+    // dirty (DirtyMap::rects 每格一个) 与包围盒的交集 火焰缓冲改变的像素都在其中 在 add 之后 shrink 之前调用
+    void changed(const std::vector<DirtyRect> &dirty, frame_vector<MErect> &out) const;
+    // 包围盒外扩 margin 之后裁剪到 view 每格最多一个 互不重叠 margin 不超过一格
+    void rects(int margin, const MErect &view, frame_vector<MErect> &out) const;
+
+private:
+    // [x0, x1) x [y0, y1) x0 >= x1 为空
+    struct box {
+        int x0, y0, x1, y1;
+        bool empty() const { return x0 >= x1; }
+    };
+
+    void expand(int x0, int y0, int x1, int y1);
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<box> boxes;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,108 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "frame_pacer.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include "engine/core/platform.h"
+#include "engine/core/profiler.hpp"
+#include "libs/glad/glad.h"
+
+namespace ME {
+
+f64 FramePacer::now_ms() {
+    using clock = std::chrono::steady_clock;
+    static const clock::time_point origin = clock::now();
+    return std::chrono::duration<f64, std::milli>(clock::now() - origin).count();
+}
+
+void FramePacer::apply_vsync(int vsyncMode) {
+    if (vsyncMode == mode) return;
+    mode = vsyncMode;
+    if (mode == VSYNC_ADAPTIVE && ME_set_swap_interval(-1)) {
+        interval = -1;
+    } else {
+        interval = mode == VSYNC_OFF ? 0 : 1;
+        ME_set_swap_interval(interval);
+    }
+    deadline = 0.0;
+}
+
+void FramePacer::begin_frame(int vsyncMode, int maxFps) {
+    apply_vsync(vsyncMode);
+    resolve();
+
+    waited = 0.0f;
+    f64 now = now_ms();
+    if (maxFps > 0) {
+        const f64 period = 1000.0 / maxFps;
+        // 第一帧或落后超过一帧 (加载 断点) 时从现在重新开始 不连续追帧
+        if (deadline == 0.0 || now - deadline > period) deadline = now;
+
+        if (deadline > now) {
+            ME_profiler_scope_auto("FramePacing");
+            const f64 start = now;
+            // 睡眠的精度只有毫秒级 最后 2 毫秒自旋
+            if (deadline - now > 2.0) std::this_thread::sleep_for(std::chrono::duration<f64, std::milli>(deadline - now - 2.0));
+            while ((now = now_ms()) < deadline) std::this_thread::yield();
+            waited = (f32)(now - start);
+        }
+        deadline += period;
+    } else {
+        deadline = 0.0;
+    }
+
+    latched = now;
+    ME_profiler_gauge("frame pacing wait us", waited * 1000.0f);
+}
+
+void FramePacer::latch() { latched = now_ms(); }
+
+void FramePacer::presented() {
+    if (!queriesInit) {
+        queriesInit = true;
+        // GL_TIMESTAMP 是 3.3 核心功能
+        queriesSupported = GLAD_GL_VERSION_3_3 != 0;
+        if (queriesSupported) glGenQueries(QUERY_COUNT, queries);
+    }
+    if (!queriesSupported) return;
+
+    // 轮到的查询还没有结果 (GPU 落后了 QUERY_COUNT 帧) 不记录这一帧
+    const u32 index = queryCurrent;
+    if (queryPending[index]) return;
+
+    glQueryCounter(queries[index], GL_TIMESTAMP);
+    queryLatch[index] = latched;
+    queryPending[index] = true;
+    queryCurrent = (queryCurrent + 1) % QUERY_COUNT;
+}
+
+void FramePacer::resolve() {
+    if (!queriesSupported) return;
+
+    for (u32 i = 0; i < QUERY_COUNT; i++) {
+        // 从最早发出的开始读
+        const u32 index = (queryCurrent + i) % QUERY_COUNT;
+        if (!queryPending[index]) continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 presentedAt = 0;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &presentedAt);
+        queryPending[index] = false;
+
+        // 同一时刻的 GPU 时钟和 CPU 时钟 把 GPU 时间戳换算成 CPU 时间
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        const f64 cpuNow = now_ms();
+        const f64 presentedMs = cpuNow - (f64)(gpuNow - (GLint64)presentedAt) / 1000000.0;
+
+        latency = (f32)(presentedMs - queryLatch[index]);
+        ME_profiler_gauge("present latency us", latency * 1000.0f);
+    }
+}
+
+}  // namespace ME
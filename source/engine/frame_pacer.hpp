@@ -0,0 +1,64 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_FRAME_PACER_HPP
+#define ME_FRAME_PACER_HPP
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 帧节奏 game::pacer
+// 每帧开始时按 max_fps 等到这一帧的开始时刻 先睡眠再自旋 帧间隔比 ME_gettime 的毫秒精度更均匀
+// 等待放在读取输入之前 输入总是在等待之后才采样 不会因为限帧而变旧
+// 垂直同步的模式改变时重新设置交换间隔 自适应垂直同步不受支持时退回普通垂直同步
+// 延迟: latch 到 R_Flip 之后 GPU 执行到交换的时刻 用 GL_TIMESTAMP 查询 换算到 CPU 时钟
+// 打开垂直同步时交换要等到刷新 所以这个时间就是从锁存输入到画面交给显示器的时间
+class FramePacer {
+public:
+    enum vsync_mode {
+        VSYNC_OFF = 0,
+        VSYNC_ON = 1,
+        VSYNC_ADAPTIVE = 2,
+    };
+
+    // 查询按这么多帧轮换 读取时结果通常已经可用 不等待 GPU
+    static constexpr u32 QUERY_COUNT = 4;
+
+    // 在 update_post 之前调用 maxFps 小于等于 0 时不限帧
+    void begin_frame(int vsyncMode, int maxFps);
+    // 输入和镜头锁存的时刻 begin_frame 结束时也会记一次
+    void latch();
+    // R_Flip 之后调用
+    void presented();
+
+    // 最近一次测到的延迟 还没有结果时小于 0
+    f32 latency_ms() const { return latency; }
+    // 上一帧为了限帧等待的时间
+    f32 wait_ms() const { return waited; }
+    // 当前的交换间隔 -1 为自适应
+    int swap_interval() const { return interval; }
+
+    static f64 now_ms();
+
+private:
+    void apply_vsync(int vsyncMode);
+    void resolve();
+
+    int mode = -1;
+    int interval = 0;
+    f64 deadline = 0.0;
+    f64 latched = 0.0;
+    f32 waited = 0.0f;
+    f32 latency = -1.0f;
+
+    bool queriesInit = false;
+    bool queriesSupported = false;
+    u32 queries[QUERY_COUNT] = {};
+    f64 queryLatch[QUERY_COUNT] = {};
+    bool queryPending[QUERY_COUNT] = {};
+    u32 queryCurrent = 0;
+};
+
+}  // namespace ME
+
+#endif
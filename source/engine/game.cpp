@@ -4,9 +4,11 @@
 
 #include <stdio.h>
 
+#include <array>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <regex>
@@ -17,6 +19,8 @@
 #include "engine/core/base_debug.hpp"
 #include "engine/core/const.h"
 #include "engine/core/core.hpp"
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/core/frame_arena.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
 #include "engine/core/job.h"
@@ -25,6 +29,7 @@
 #include "engine/core/platform.h"
 #include "engine/core/profiler.hpp"
 #include "engine/core/sdl_wrapper.h"
+#include "engine/core/thread_topology.hpp"
 #include "engine/engine.hpp"
 #include "engine/event/applicationevent.hpp"
 #include "engine/game_utils/cells.h"
@@ -33,6 +38,7 @@
 #include "engine/renderer/gpu.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/renderer/shaders.hpp"
+#include "engine/scripting/lua_cache.hpp"
 #include "engine/scripting/scripting.hpp"
 #include "engine/scripting/wrap/wrap_imgui.hpp"
 #include "engine/ui/surface.h"
@@ -47,6 +53,7 @@
 #include "game_ui.hpp"
 #include "libs/glad/glad.h"
 #include "reflectionflat.hpp"
+#include "startup.hpp"
 #include "textures.hpp"
 #include "world_generator.h"
 
@@ -70,6 +77,7 @@ bool game::initialize(int argc, char *argv[]) {
 
     // Job模块
     job::init();
+    events.init();
 
     // 帧检查器
     ME_profiler_init();
@@ -110,10 +118,26 @@ int game::init(int argc, char *argv[]) {
     METADOT_INFO("Starting game...");
 
     // Initialization of ECSSystem and Engine
-    if (the<engine>().init_eng()) return METADOT_FAILED;
+    {
+        StartupPhases::scope phase("Engine");
+        if (the<engine>().init_eng()) return METADOT_FAILED;
+    }
+
+    // 文件系统就绪后 贴图解码和脚本预编译交给 job 线程 主线程继续 只有创建 GL 纹理留给主线程
+    // 预编译会写字节码缓存 在脚本系统初始化之前等它完成 贴图到 InitTexture 时才等待
+    job_counter luaPrecompile;
+    u32 luaPrecompiled = 0;
+    job::execute(luaPrecompile, [&luaPrecompiled]() {
+        StartupPhases::scope phase("Lua precompile", true);
+        luaPrecompiled = ME_lua_cache_prewarm(METADOT_RESLOC("data/scripts"));
+    });
+    PrefetchTextures();
 
     // Load splash screen
-    the<engine>().draw_splash();
+    {
+        StartupPhases::scope phase("Splash");
+        the<engine>().draw_splash();
+    }
 
     setEventCallback(ME_BIND_EVENT_FN(onEvent));
 
@@ -131,16 +155,48 @@ int game::init(int argc, char *argv[]) {
 
     // Initialize scripting system
     METADOT_INFO("Loading Script...");
-    ME::modules::initialize<scripting>();
-    the<scripting>().init();
+    {
+        StartupPhases::scope phase("Scripting");
+        StartupPhases::wait(luaPrecompile, "Lua precompile");
+        if (luaPrecompiled > 0) METADOT_INFO(std::format("Precompiled {0} Lua scripts", luaPrecompiled).c_str());
+        ME::modules::initialize<scripting>();
+        the<scripting>().init();
+    }
+    initMemoryBudget();
 
-    for (auto &s : Iso.systemList) {
-        s->registerLua(the<scripting>().s_lua);
-        s->create();
+    // gameplay::create 运行 game.lua 加载贴图 音频 材料
+    {
+        StartupPhases::scope phase("Systems");
+        for (auto &s : Iso.systemList) {
+            s->registerLua(the<scripting>().s_lua);
+            s->create();
+        }
     }
 
-    ME::modules::initialize<gui>();
-    the<gui>().init();
+    // GlobalDEF 在 gameplay::create 中从 global.lua 读取 命令行 --pregen <半径> 覆盖 pregen_radius
+    // --simd <scalar|sse2|avx2|avx512|neon|best> 限制向量内核的指令集 scalar 用来对照向量版本
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--pregen")) Iso.globaldef.pregen_radius = std::max(atoi(argv[i + 1]), 0);
+        if (!strcmp(argv[i], "--simd")) {
+            simd_level level;
+            if (cpu::parse(argv[i + 1], level)) cpu::set_max_level(level);
+            else METADOT_WARN(std::format("Unknown --simd level {0}", argv[i + 1]).c_str());
+        }
+    }
+    METADOT_INFO(std::format("SIMD kernels: {0}", cpu::describe()).c_str());
+    // worker 在这之前保持系统默认的优先级和亲和性
+    job::set_placement({.hybrid = Iso.globaldef.job_hybrid_placement, .pin = Iso.globaldef.job_pin_workers, .priorities = Iso.globaldef.job_thread_priorities});
+    METADOT_INFO(std::format("Job workers: {0} on {1}", job::worker_count(), thread_topology::describe()).c_str());
+    // --record / --replay 回放时用录制时的设置
+    replay.open(argc, argv, Iso.globaldef, the<engine>().eng()->windowWidth, the<engine>().eng()->windowHeight, the<engine>().eng()->time.maxTps);
+    // --stress 压力场景 --stress-seed 固定世界的种子
+    stress.open(argc, argv);
+
+    {
+        StartupPhases::scope phase("GUI");
+        ME::modules::initialize<gui>();
+        the<gui>().init();
+    }
 
     ME_pack_result pack_result = ME_create_file_pack_reader(METADOT_RESLOC("data/resources.pack"), 0, 0, &this->Iso.pack_reader);
 
@@ -150,31 +206,36 @@ int game::init(int argc, char *argv[]) {
     }
 
     // Initialize the rng seed
-    this->RNG = RNG_Create();
+    this->RNG = RNG_Create(replay.seed(stress.seed((u32)time(NULL))));
     METADOT_INFO(std::format("SeedRNG {0}", RNG->root_seed).c_str());
 
     // register & set up materials
     METADOT_INFO("Setting up materials...");
-    movingTiles = new u16[GAME()->materials_count];
     debugDraw = new ME_debugdraw(the<engine>().eng()->target);
 
+    sounds.title = global.audio.ResolveEvent("event:/Music/Title");
+    sounds.jump = global.audio.ResolveEvent("event:/Player/Jump");
+    sounds.impact = global.audio.ResolveEvent("event:/Player/Impact");
+    sounds.sand = global.audio.ResolveEventParameter(global.audio.ResolveEvent("event:/World/Sand"), "Sand");
+    sounds.fly = global.audio.ResolveEventParameter(global.audio.ResolveEvent("event:/Player/Fly"), "Intensity");
+    sounds.wind = global.audio.ResolveEventParameter(global.audio.ResolveEvent("event:/Player/Wind"), "Wind");
+    sounds.waterFlow = global.audio.ResolveAmbient(global.audio.ResolveEvent("event:/World/WaterFlow"), "FlowIntensity");
+
     // Play sound effects when the game starts
-    global.audio.PlayEvent("event:/Music/Title");
+    global.audio.PlayEvent(sounds.title);
+    if (Iso.globaldef.audio_thread) global.audio.StartThread();
     global.audio.Update();
 
     // Initialize the world
     METADOT_INFO("Initializing world...");
 
-    Timer timer;
-    timer.start();
-
-    Iso.world = create_scope<world>();
-    Iso.world->noSaveLoad = true;
-    Iso.world->init(METADOT_RESLOC("saves/mainMenu"), (int)ceil(WINDOWS_MAX_WIDTH / RENDER_C_TEST / (f64)CHUNK_W) * CHUNK_W + CHUNK_W * RENDER_C_TEST,
-                    (int)ceil(WINDOWS_MAX_HEIGHT / RENDER_C_TEST / (f64)CHUNK_H) * CHUNK_H + CHUNK_H * RENDER_C_TEST, the<engine>().eng()->target, &global.audio);
-
-    timer.stop();
-    METADOT_INFO(std::format("Initializing world done in {0:.4f} ms", timer.get()).c_str());
+    {
+        StartupPhases::scope phase("World");
+        Iso.world = create_scope<world>();
+        Iso.world->noSaveLoad = true;
+        Iso.world->init(METADOT_RESLOC("saves/mainMenu"), (int)ceil(WINDOWS_MAX_WIDTH / RENDER_C_TEST / (f64)CHUNK_W) * CHUNK_W + CHUNK_W * RENDER_C_TEST,
+                        (int)ceil(WINDOWS_MAX_HEIGHT / RENDER_C_TEST / (f64)CHUNK_H) * CHUNK_H + CHUNK_H * RENDER_C_TEST, the<engine>().eng()->target, &global.audio);
+    }
 
     // 确定窗口显示模式
     std::string displayMode = "windowed";
@@ -192,89 +253,76 @@ int game::init(int argc, char *argv[]) {
     R_ResetProjection(the<engine>().eng()->realTarget);
     ResolutionChanged(the<engine>().eng()->windowWidth, the<engine>().eng()->windowHeight);
 
-    ME_set_vsync(false);
+    // 垂直同步由 pacer 按 vsync_mode 设置
     ME_win_set_minimize_onlostfocus(false);
 
-    ME::modules::initialize<fontcache>();
+    // UI 字体预先缓存 ASCII 和当前语言译文的字形 中文菜单第一次打开时不再逐字光栅化
+    // surface 的字体仍在第一次绘制时缓存
+    {
+        StartupPhases::scope phase("Fonts");
+        ME::modules::initialize<fontcache>();
 
-    the<fontcache>().resize({(float)the<engine>().eng()->windowWidth, (float)the<engine>().eng()->windowHeight});
+        the<fontcache>().resize({(float)the<engine>().eng()->windowWidth, (float)the<engine>().eng()->windowHeight});
+
+        the<fontcache>().init();
 
-    the<fontcache>().init();
+        auto ui_font = get_assets(".\\fonts\\fusion-pixel.ttf");
+        basic_font = the<fontcache>().load(ui_font.data, ui_font.size, 24.0f);
 
-    auto ui_font = get_assets(".\\fonts\\fusion-pixel.ttf");
-    basic_font = the<fontcache>().load(ui_font.data, ui_font.size, 24.0f);
+        int warmed = the<fontcache>().warmup_ascii(basic_font);
+        warmed += the<fontcache>().warmup(global.I18N.Strings(), basic_font);
+        METADOT_INFO(std::format("Font glyphs warmed up ({0})", warmed).c_str());
+    }
 
     ME_profiler_graph_init(&this->fps, GRAPH_RENDER_FPS, "Frame Time");
     ME_profiler_graph_init(&this->cpuGraph, GRAPH_RENDER_MS, "CPU Time");
 
-    surface = ME_surface_CreateGL3(ME_SURFACE_ANTIALIAS | ME_SURFACE_STENCIL_STROKES | ME_SURFACE_DEBUG);
+    {
+        StartupPhases::scope phase("Surface");
+        surface = ME_surface_CreateGL3(ME_SURFACE_ANTIALIAS | ME_SURFACE_STENCIL_STROKES | ME_SURFACE_DEBUG | ME_SURFACE_BATCH);
 
-    fontNormal = ME_surface_CreateFont(surface, "fusion-pixel", METADOT_RESLOC("data/assets/fonts/fusion-pixel-12px-monospaced.ttf"));
-    if (fontNormal == -1) {
-        METADOT_ERROR("Could not add font fusion-pixel.");
+        fontNormal = ME_surface_CreateFont(surface, "fusion-pixel", METADOT_RESLOC("data/assets/fonts/fusion-pixel-12px-monospaced.ttf"));
+        if (fontNormal == -1) {
+            METADOT_ERROR("Could not add font fusion-pixel.");
+        }
     }
 
-    // init threadpools
-    Iso.updateDirtyPool = alloc<thread_pool>::safe_malloc(4);
-    Iso.updateDirtyPool2 = alloc<thread_pool>::safe_malloc(4);
+    StartupPhases::report();
 
     return this->run(argc, argv);
 }
 
-void game::deleteTexture() {
-
-    if (TexturePack_.textureLayer2) R_FreeImage(TexturePack_.textureLayer2);
-    if (TexturePack_.textureBackground) R_FreeImage(TexturePack_.textureBackground);
-    if (TexturePack_.textureCells) R_FreeImage(TexturePack_.textureCells);
-    if (TexturePack_.temperatureMap) R_FreeImage(TexturePack_.temperatureMap);
-    if (TexturePack_.texture) R_FreeImage(TexturePack_.texture);
-    if (TexturePack_.emissionTexture) R_FreeImage(TexturePack_.emissionTexture);
-    if (TexturePack_.textureFlow) R_FreeImage(TexturePack_.textureFlow);
-    if (TexturePack_.textureFire) R_FreeImage(TexturePack_.textureFire);
+// createTexture 从渲染目标池中取出的世界大小的图像
+static std::array<R_Image **, 17> pooledImages(TexturePack_t &tp) {
+    return {&tp.texture,      &tp.texturePacked,      &tp.worldTexture,  &tp.lightingTexture, &tp.lightingTextureLow, &tp.emissionTexture,    &tp.textureFlow,
+            &tp.textureFlowSpead, &tp.textureFire,    &tp.textureLayer2, &tp.textureObjects,  &tp.textureObjectsLQ,   &tp.textureObjectsBack, &tp.textureCells,
+            &tp.textureEntities,  &tp.textureEntitiesLQ, &tp.temperatureMap};
+}
 
-    if (TexturePack_.worldTexture) {
-        if (TexturePack_.worldTexture->target) R_FreeTarget(TexturePack_.worldTexture->target);
-        R_FreeImage(TexturePack_.worldTexture);
-    }
-    if (TexturePack_.lightingTexture) {
-        if (TexturePack_.lightingTexture->target) R_FreeTarget(TexturePack_.lightingTexture->target);
-        R_FreeImage(TexturePack_.lightingTexture);
+u64 TexturePack_t::memory_bytes() {
+    u64 bytes = 0;
+    for (R_Image **image : pooledImages(*this)) {
+        if (*image) bytes += (u64)(*image)->texture_w * (*image)->texture_h * (*image)->bytes_per_pixel;
     }
+    if (materialProps) bytes += (u64)materialProps->texture_w * materialProps->texture_h * materialProps->bytes_per_pixel;
+    bytes += backgroundAtlas.memory_bytes();
+    bytes += (u64)objectAtlas.page_count() * SpriteAtlas::PAGE_SIZE * SpriteAtlas::PAGE_SIZE * 4;
+    for (const std::vector<u8> *v : {&pixels, &pixelsLayer2, &pixelsObjects, &pixelsCells, &pixelsFire, &pixelsFlow, &pixelsEmission, &pixelsPacked}) bytes += v->capacity();
+    return bytes;
+}
 
-    if (TexturePack_.textureFlowSpead) {
-        if (TexturePack_.textureFlowSpead->target) R_FreeTarget(TexturePack_.textureFlowSpead->target);
-        R_FreeImage(TexturePack_.textureFlowSpead);
-    }
+void game::deleteTexture() {
 
-    if (TexturePack_.texture2Fire) {
-        if (TexturePack_.texture2Fire->target) R_FreeTarget(TexturePack_.texture2Fire->target);
-        R_FreeImage(TexturePack_.texture2Fire);
+    // 世界大小的图像都还给渲染目标池 createTexture 重新取同样大小的图像时直接复用 纹理和帧缓冲都不用重建
+    for (R_Image **image : pooledImages(TexturePack_)) {
+        R_ReleasePooledImage(*image);
+        *image = nullptr;
     }
 
-    if (TexturePack_.textureObjects) {
-        if (TexturePack_.textureObjects->target) R_FreeTarget(TexturePack_.textureObjects->target);
-        R_FreeImage(TexturePack_.textureObjects);
-    }
-    if (TexturePack_.textureObjectsLQ) {
-        if (TexturePack_.textureObjectsLQ->target) R_FreeTarget(TexturePack_.textureObjectsLQ->target);
-        R_FreeImage(TexturePack_.textureObjectsLQ);
-    }
-    if (TexturePack_.textureObjectsBack) {
-        if (TexturePack_.textureObjectsBack->target) R_FreeTarget(TexturePack_.textureObjectsBack->target);
-        R_FreeImage(TexturePack_.textureObjectsBack);
-    }
-    if (TexturePack_.textureEntities) {
-        if (TexturePack_.textureEntities->target) R_FreeTarget(TexturePack_.textureEntities->target);
-        R_FreeImage(TexturePack_.textureEntities);
-    }
-    if (TexturePack_.textureEntitiesLQ) {
-        if (TexturePack_.textureEntitiesLQ->target) R_FreeTarget(TexturePack_.textureEntitiesLQ->target);
-        R_FreeImage(TexturePack_.textureEntitiesLQ);
-    }
-    if (TexturePack_.backgroundImage) {
-        if (TexturePack_.backgroundImage->target) R_FreeTarget(TexturePack_.backgroundImage->target);
-        R_FreeImage(TexturePack_.backgroundImage);
-    }
+    if (TexturePack_.materialProps) R_FreeImage(TexturePack_.materialProps);
+    TexturePack_.materialProps = nullptr;
+    TexturePack_.packedActive = false;
+    TexturePack_.backgroundAtlas.free();
 }
 
 void game::createTexture() {
@@ -284,8 +332,13 @@ void game::createTexture() {
     Timer timer;
     timer.start();
 
+    // 世界大小变了的话池中的图像都用不上 先释放再创建 避免新旧两套同时占用显存
+    const bool sameSize = TexturePack_.texture && TexturePack_.texture->base_w == Iso.world->width && TexturePack_.texture->base_h == Iso.world->height;
+
     deleteTexture();
 
+    if (!sameSize) R_TrimImagePool(0);
+
     // create textures
     loadingOnColor = 0xFFFFFFFF;
     loadingOffColor = 0x000000FF;
@@ -301,135 +354,119 @@ void game::createTexture() {
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "texture");
 
-                TexturePack_.texture = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.texture = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
 
                 R_SetImageFilter(TexturePack_.texture, R_FILTER_NEAREST);
+
+                // gpu_world_pixels 模式下由着色器绘制
+            },
+            [&]() {
+                METADOT_LOG_SCOPE_F(INFO, "texturePacked");
+
+                TexturePack_.texturePacked = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, false);
+                R_SetImageFilter(TexturePack_.texturePacked, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "worldTexture");
 
-                TexturePack_.worldTexture = R_CreateImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 3),
-                                                          Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 3), R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.worldTexture = R_AcquirePooledImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 3),
+                                                                 Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 3), R_FormatEnum::R_FORMAT_RGBA, true);
 
                 R_SetImageFilter(TexturePack_.worldTexture, R_FILTER_NEAREST);
-
-                R_LoadTarget(TexturePack_.worldTexture);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "lightingTexture");
 
-                TexturePack_.lightingTexture = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.lightingTexture = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.lightingTexture, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.lightingTexture);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "emissionTexture");
 
-                TexturePack_.emissionTexture = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.emissionTexture = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.emissionTexture, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureFlow");
 
-                TexturePack_.textureFlow = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureFlow = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, false);
                 R_SetImageFilter(TexturePack_.textureFlow, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureFlowSpead");
 
-                TexturePack_.textureFlowSpead = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureFlowSpead = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.textureFlowSpead, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.textureFlowSpead);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureFire");
 
-                TexturePack_.textureFire = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureFire = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, false);
                 R_SetImageFilter(TexturePack_.textureFire, R_FILTER_NEAREST);
             },
-            [&]() {
-                METADOT_LOG_SCOPE_F(INFO, "texture2Fire");
-
-                TexturePack_.texture2Fire = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
-                R_SetImageFilter(TexturePack_.texture2Fire, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.texture2Fire);
-            },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureLayer2");
 
-                TexturePack_.textureLayer2 = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureLayer2 = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, false);
                 R_SetImageFilter(TexturePack_.textureLayer2, R_FILTER_NEAREST);
             },
             [&]() {
-                METADOT_LOG_SCOPE_F(INFO, "textureBackground");
+                METADOT_LOG_SCOPE_F(INFO, "backgroundAtlas");
 
-                TexturePack_.textureBackground = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
-                R_SetImageFilter(TexturePack_.textureBackground, R_FILTER_NEAREST);
+                // 与像素缓冲重叠的区块最多 (w / CHUNK_W + 1) x (h / CHUNK_H + 1) 个 多留一圈给还没回收的区块
+                TexturePack_.backgroundAtlas.init(Iso.world->width / CHUNK_W + 2, Iso.world->height / CHUNK_H + 2);
+                Iso.world->queueBackgroundRect(0, 0, Iso.world->width, Iso.world->height);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureObjects");
 
-                TexturePack_.textureObjects = R_CreateImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
-                                                            Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureObjects = R_AcquirePooledImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
+                                                                   Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.textureObjects, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.textureObjects);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureObjectsLQ");
 
-                TexturePack_.textureObjectsLQ = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureObjectsLQ = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.textureObjectsLQ, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.textureObjectsLQ);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureObjectsBack");
 
-                TexturePack_.textureObjectsBack = R_CreateImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
-                                                                Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureObjectsBack = R_AcquirePooledImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
+                                                                       Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA, true);
                 R_SetImageFilter(TexturePack_.textureObjectsBack, R_FILTER_NEAREST);
-                R_LoadTarget(TexturePack_.textureObjectsBack);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureCells");
 
-                TexturePack_.textureCells = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.textureCells = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, false);
 
                 R_SetImageFilter(TexturePack_.textureCells, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureEntities");
 
-                TexturePack_.textureEntities = R_CreateImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
-                                                             Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
-
-                R_LoadTarget(TexturePack_.textureEntities);
+                TexturePack_.textureEntities = R_AcquirePooledImage(Iso.world->width * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1),
+                                                                    Iso.world->height * (Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA, true);
 
                 R_SetImageFilter(TexturePack_.textureEntities, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "textureEntitiesLQ");
 
-                TexturePack_.textureEntitiesLQ = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
-
-                R_LoadTarget(TexturePack_.textureEntitiesLQ);
+                TexturePack_.textureEntitiesLQ = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA, true);
 
                 R_SetImageFilter(TexturePack_.textureEntitiesLQ, R_FILTER_NEAREST);
             },
             [&]() {
                 METADOT_LOG_SCOPE_F(INFO, "temperatureMap");
 
-                TexturePack_.temperatureMap = R_CreateImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+                TexturePack_.temperatureMap = R_AcquirePooledImage(Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RG, false);
+                TexturePack_.temperatureMapStale = true;
 
                 R_SetImageFilter(TexturePack_.temperatureMap, R_FILTER_NEAREST);
             },
-            [&]() {
-                METADOT_LOG_SCOPE_F(INFO, "backgroundImage");
-                TexturePack_.backgroundImage = R_CreateImage(the<engine>().eng()->windowWidth, the<engine>().eng()->windowHeight, R_FormatEnum::R_FORMAT_RGBA);
-
-                R_SetImageFilter(TexturePack_.backgroundImage, R_FILTER_NEAREST);
-
-                R_LoadTarget(TexturePack_.backgroundImage);
-            },
             [&]() {
                 // create texture pixel buffers
                 TexturePack_.pixels = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
@@ -438,32 +475,33 @@ void game::createTexture() {
                 TexturePack_.pixelsLayer2 = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
                 TexturePack_.pixelsLayer2_ar = &TexturePack_.pixelsLayer2[0];
 
-                TexturePack_.pixelsBackground = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
-                TexturePack_.pixelsBackground_ar = &TexturePack_.pixelsBackground[0];
-
                 TexturePack_.pixelsObjects = std::vector<u8>(Iso.world->width * Iso.world->height * 4, ME_ALPHA_TRANSPARENT);
                 TexturePack_.pixelsObjects_ar = &TexturePack_.pixelsObjects[0];
 
-                TexturePack_.pixelsTemp = std::vector<u8>(Iso.world->width * Iso.world->height * 4, ME_ALPHA_TRANSPARENT);
-                TexturePack_.pixelsTemp_ar = &TexturePack_.pixelsTemp[0];
-
                 TexturePack_.pixelsCells = std::vector<u8>(Iso.world->width * Iso.world->height * 4, ME_ALPHA_TRANSPARENT);
                 TexturePack_.pixelsCells_ar = &TexturePack_.pixelsCells[0];
 
                 TexturePack_.pixelsFire = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
                 TexturePack_.pixelsFire_ar = &TexturePack_.pixelsFire[0];
+                TexturePack_.fireRegions.resize(Iso.world->width, Iso.world->height);
 
                 TexturePack_.pixelsFlow = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
                 TexturePack_.pixelsFlow_ar = &TexturePack_.pixelsFlow[0];
 
                 TexturePack_.pixelsEmission = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
                 TexturePack_.pixelsEmission_ar = &TexturePack_.pixelsEmission[0];
+
+                TexturePack_.pixelsPacked = std::vector<u8>(Iso.world->width * Iso.world->height * 4, 0);
+                TexturePack_.pixelsPacked_ar = &TexturePack_.pixelsPacked[0];
             }};
 
     for (auto &f : Funcs) {
         std::invoke(f);
     }
 
+    // 没有被复用的 (窗口大小的背景 旧的高清贴图尺寸) 不再需要
+    R_TrimImagePool(0);
+
     timer.stop();
 
     METADOT_INFO(std::format("Creating world textures done in {0:.4f} ms", timer.get()).c_str());
@@ -508,8 +546,6 @@ int game::run(int argc, char *argv[]) {
     GAME()->ofsX = (GAME()->ofsX - the<engine>().eng()->windowWidth / 2) / 2 * 3 + the<engine>().eng()->windowWidth / 2;
     GAME()->ofsY = (GAME()->ofsY - the<engine>().eng()->windowHeight / 2) / 2 * 3 + the<engine>().eng()->windowHeight / 2;
 
-    objectDelete = new u8[Iso.world->width * Iso.world->height];
-
     fadeInStart = ME_gettime();
     fadeInLength = 250;
     fadeInWaitFrames = 5;
@@ -519,14 +555,51 @@ int game::run(int argc, char *argv[]) {
     // game loop
     while (this->running) {
 
+        // 回放时不限帧 尽快跑完
+        pacer.begin_frame(replay.playing() ? FramePacer::VSYNC_OFF : Iso.globaldef.vsync_mode, replay.playing() ? 0 : Iso.globaldef.max_fps);
+
         the<engine>().update_post();
 
+        // 回放时换成录制的帧时间 tick 次数随之与录制时相同
+        {
+            auto &time = the<engine>().eng()->time;
+            const i64 frameNow = replay.begin_frame(time.now);
+            if (frameNow != time.now) {
+                time.now = time.frameStart = frameNow;
+                time.deltaTime = time.now - time.lastTime;
+            }
+        }
+
+        // 上一帧刚在 update_post 中合并完
+        spikes.update(state == INGAME ? Iso.world.get() : nullptr, Iso.globaldef.spike_threshold_ms);
+        if (state == INGAME) memory.update(ME_gettime(), Iso.globaldef.memory_budget_mb);
+        // 上一帧 worker 和主线程投递的事件
+        events.dispatch();
+        dynres.update(state == INGAME ? ME_profiler_gpu_render_time() : -1.0f, Iso.globaldef.dynamic_resolution_ms);
+
+        // 自动存档 主线程只复制区块快照
+        if (state == INGAME && Iso.globaldef.autosave_interval > 0 && !replay.playing()) {
+            const i64 now = ME_gettime();
+            if (lastAutosave == 0) {
+                lastAutosave = now;
+            } else if (now - lastAutosave >= (i64)Iso.globaldef.autosave_interval * 1000 && Iso.world->saveWorldAsync()) {
+                lastAutosave = now;
+            }
+        } else {
+            lastAutosave = 0;
+        }
+
+        // job_future::then_main 的后续
+        job::main_inbox().run();
+        // 异步加载的贴图解码完后在主线程上创建 image
+        PollTextureLoads();
+
 #pragma region SDL_Input
 
         ME_profiler_scope_auto("Loop");
 
         // handle window events
-        while (SDL_PollEvent(&windowEvent)) {
+        while (replay.poll(windowEvent)) {
 
             // 窗口事件
             if (windowEvent.type == SDL_WINDOWEVENT) {
@@ -536,8 +609,8 @@ int game::run(int argc, char *argv[]) {
                 }
             }
 
-            // ImGui事件
-            ImGui_ImplSDL2_ProcessEvent(&windowEvent);
+            // ImGui事件 跳过 ImGui 帧时不往它的事件队列里堆积
+            if (the<gui>().imgui->FrameActive()) ImGui_ImplSDL2_ProcessEvent(&windowEvent);
 
             if (ImGui::GetIO().WantCaptureMouse && ImGui::GetIO().WantCaptureKeyboard) {
                 if (windowEvent.type == SDL_MOUSEBUTTONDOWN || windowEvent.type == SDL_MOUSEMOTION || windowEvent.type == SDL_MOUSEWHEEL || windowEvent.type == SDL_KEYDOWN ||
@@ -575,7 +648,7 @@ int game::run(int argc, char *argv[]) {
                                 if (lineX + xx < 0 || lineY + yy < 0 || lineX + xx >= Iso.world->width || lineY + yy >= Iso.world->height) continue;
                                 MaterialInstance tp = TilesCreate(gameUI.DebugDrawUI__selectedMaterial->id, lineX + xx, lineY + yy);
                                 Iso.world->real_tiles[(lineX + xx) + (lineY + yy) * Iso.world->width] = tp;
-                                Iso.world->dirty[(lineX + xx) + (lineY + yy) * Iso.world->width] = true;
+                                Iso.world->dirty.mark((lineX + xx) + (lineY + yy) * Iso.world->width);
                             }
                         }
 
@@ -651,6 +724,7 @@ int game::run(int argc, char *argv[]) {
                                         u32 pixel = ME_get_pixel(cur->get_surface(), ntx, nty);
                                         if (((pixel >> 24) & 0xff) != 0x00) {
                                             ME_get_pixel(cur->get_surface(), ntx, nty) = 0x00000000;
+                                            cur->markTexDirty(ntx, nty);
                                             upd = true;
                                         }
                                     }
@@ -659,8 +733,7 @@ int game::run(int argc, char *argv[]) {
 
                             if (upd) {
 
-                                // 更新rigidbody的image
-                                cur->updateImage({});
+                                // 更新rigidbody的image 改动的范围已经由 markTexDirty 记录
                                 // R_FreeImage(cur->get_texture());
                                 // cur->set_texture(R_CopyImageFromSurface(cur->get_surface()));
                                 // R_SetImageFilter(cur->get_texture(), R_FILTER_NEAREST);
@@ -721,7 +794,8 @@ int game::run(int argc, char *argv[]) {
                                 int x = (int)((mx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
                                 int y = (int)((my - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
 
-                                std::vector<RigidBody *> rbs = Iso.world->rigidBodies;  // copy
+                                frame_arena::scope scratch;
+                                frame_vector<RigidBody *> rbs(Iso.world->rigidBodies.begin(), Iso.world->rigidBodies.end());  // copy
                                 for (size_t i = 0; i < rbs.size(); i++) {
                                     RigidBody *cur = rbs[i];
 
@@ -769,17 +843,18 @@ int game::run(int argc, char *argv[]) {
                                 C_Surface *sfc = SDL_CreateRGBSurfaceWithFormat(0, (int)breakSize, (int)breakSize, 32, SDL_PIXELFORMAT_ARGB8888);
 
                                 int n = 0;
-                                for (int xx = 0; xx < breakSize; xx++) {
-                                    for (int yy = 0; yy < breakSize; yy++) {
+                                for (int yy = 0; yy < breakSize; yy++) {
+                                    u32 *row = &ME_get_pixel(sfc, 0, yy);
+                                    for (int xx = 0; xx < breakSize; xx++) {
                                         f32 cx = (f32)((xx / breakSize) - 0.5);
                                         f32 cy = (f32)((yy / breakSize) - 0.5);
 
                                         if (cx * cx + cy * cy > 0.25f) continue;
 
-                                        if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat->physicsType == PhysicsType::SOLID) {
-                                            ME_get_pixel(sfc, xx, yy) = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color;
+                                        if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat()->physicsType == PhysicsType::SOLID) {
+                                            row[xx] = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color();
                                             Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width] = Tiles_NOTHING;
-                                            Iso.world->dirty[(x + xx) + (y + yy) * Iso.world->width] = true;
+                                            Iso.world->dirty.mark((x + xx) + (y + yy) * Iso.world->width);
 
                                             n++;
                                         }
@@ -788,7 +863,7 @@ int game::run(int argc, char *argv[]) {
 
                                 // 物体被镐子破坏后 形成物理掉落物
                                 if (n > 0) {
-                                    global.audio.PlayEvent("event:/Player/Impact");
+                                    global.audio.PlayEvent(sounds.impact);
 
                                     auto tex = create_ref<Texture>(sfc);
 
@@ -874,7 +949,7 @@ int game::run(int argc, char *argv[]) {
                                         bool hitSolidYet = false;
                                         bool broke = false;
                                         Iso.world->forLineCornered(segSx, segSy, segEx, segEy, [&](int index) {
-                                            if (Iso.world->real_tiles[index].mat->physicsType != PhysicsType::SOLID) {
+                                            if (Iso.world->real_tiles[index].mat()->physicsType != PhysicsType::SOLID) {
                                                 if (hitSolidYet && (abs((index % Iso.world->width) - segSx) + (abs((index / Iso.world->width) - segSy)) > 1)) {
                                                     broke = true;
                                                     return true;
@@ -882,8 +957,8 @@ int game::run(int argc, char *argv[]) {
                                                 return false;
                                             }
                                             hitSolidYet = true;
-                                            Iso.world->real_tiles[index] = MaterialInstance(&GAME()->materials_list.GENERIC_SAND, ME_draw_darken_color(Iso.world->real_tiles[index].color, 0.5f));
-                                            Iso.world->dirty[index] = true;
+                                            Iso.world->real_tiles[index] = MaterialInstance(&GAME()->materials_list.GENERIC_SAND, ME_draw_darken_color(Iso.world->real_tiles[index].color(), 0.5f));
+                                            Iso.world->dirty.mark(index);
                                             endInd = index;
                                             nTilesChanged++;
                                             return false;
@@ -898,16 +973,11 @@ int game::run(int argc, char *argv[]) {
                                     int hx = (pl->hammerX + (endInd % Iso.world->width)) / 2;
                                     int hy = (pl->hammerY + (endInd / Iso.world->width)) / 2;
 
-                                    if (Iso.world->getTile((int)(hx + udy * 2), (int)(hy - udx * 2)).mat->physicsType == PhysicsType::SOLID) {
-                                        Iso.world->physicsCheck((int)(hx + udy * 2), (int)(hy - udx * 2));
-                                    }
-
-                                    if (Iso.world->getTile((int)(hx - udy * 2), (int)(hy + udx * 2)).mat->physicsType == PhysicsType::SOLID) {
-                                        Iso.world->physicsCheck((int)(hx - udy * 2), (int)(hy + udx * 2));
-                                    }
+                                    // 锤击两侧 非 SOLID 的点在 physicsCheck 中跳过
+                                    Iso.world->physicsCheck({{(int)(hx + udy * 2), (int)(hy - udx * 2)}, {(int)(hx - udy * 2), (int)(hy + udx * 2)}});
 
                                     if (nTilesChanged > 0) {
-                                        global.audio.PlayEvent("event:/Player/Impact");
+                                        global.audio.PlayEvent(sounds.impact);
                                     }
 
                                     // GameIsolate_.world->setTile((int)(hx), (int)(hy), MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffffffff));
@@ -1001,22 +1071,55 @@ int game::run(int argc, char *argv[]) {
 #pragma endregion SDL_Input
 
 #pragma region GameTick
+        u32 frameTicks = 0;
+        f64 frameTickMs = 0.0;
         {
             ME_profiler_scope_auto("GameTick");
 
             if (Iso.globaldef.tick_world) updateFrameEarly();
 
-            while (the<engine>().eng()->time.now - the<engine>().eng()->time.lastTickTime > (1000.0f / the<engine>().eng()->time.maxTps)) {
+            // 固定步长: tick 时间按周期累加 而不是设为当前帧的时间
+            // 否则每次 tick 都会推迟到周期之后的第一帧 帧率越高 TPS 越偏离 maxTps
+            // 与原来一样每帧最多一次 tick 不补积压
+            const f64 tickPeriod = 1000.0 / the<engine>().eng()->time.maxTps;
+            const f64 now = (f64)the<engine>().eng()->time.now;
+            if (tickClock == 0) tickClock = now - tickPeriod;
+
+            if (Iso.globaldef.lua_hot_reload) the<scripting>().update_hot_reload();
+
+            const f64 tickStart = FramePacer::now_ms();
+            if (now - tickClock > tickPeriod) {
                 the<scripting>().update_tick();
                 the<scripting>().update();
                 if (Iso.globaldef.tick_world) {
+                    const f64 t0 = FramePacer::now_ms();
                     tick();
+                    perfBench.record(FramePacer::now_ms() - t0);
+                    stress.tick(*this);
                 }
                 the<engine>().eng()->target = the<engine>().eng()->realTarget;
-                the<engine>().eng()->time.lastTickTime = the<engine>().eng()->time.now;
+                tickClock += tickPeriod;
+                // 帧率低于 maxTps 或卡顿之后 落后超过一个周期 从当前帧重新计时
+                if (now - tickClock > tickPeriod) tickClock = now;
+                the<engine>().eng()->time.lastTickTime = (i64)tickClock;
                 the<engine>().eng()->time.tickCount++;
+                frameTicks++;
             }
+            frameTickMs = FramePacer::now_ms() - tickStart;
 
+            if (Iso.globaldef.tick_world && !Iso.globaldef.late_latch) updateFrameLate();
+        }
+
+        // 晚锁存 tick 可能用掉大半帧 渲染之前重新取鼠标位置和时间 镜头和实体插值按更接近显示的时刻计算
+        if (Iso.globaldef.late_latch) {
+            int lx, ly;
+            SDL_GetMouseState(&lx, &ly);
+            i64 latchNow = ME_gettime();
+            replay.latch(latchNow, lx, ly);
+            mx = lx;
+            my = ly;
+            the<engine>().eng()->time.now = latchNow;
+            pacer.latch();
             if (Iso.globaldef.tick_world) updateFrameLate();
         }
 
@@ -1029,18 +1132,27 @@ int game::run(int argc, char *argv[]) {
         the<engine>().eng()->target = the<engine>().eng()->realTarget;
         R_Clear(the<engine>().eng()->target);
 
+        // 动态分辨率需要的世界渲染耗时
+        const bool timeRender = Iso.globaldef.dynamic_resolution_ms > 0.0f;
+        if (timeRender) ME_profiler_gpu_render_begin();
+
         {
             ME_profiler_scope_auto("RenderEarly");
+            ME_profiler_gpu_scope_auto("RenderEarly");
             renderEarly();
             the<engine>().eng()->target = the<engine>().eng()->realTarget;
         }
 
-        {
+        // --replay-headless 和 --stress-headless 只跳过世界的绘制 界面仍然要处理回放的输入
+        if (!replay.headless() && !stress.headless()) {
             ME_profiler_scope_auto("RenderLate");
+            ME_profiler_gpu_scope_auto("RenderLate");
             renderLate();
             the<engine>().eng()->target = the<engine>().eng()->realTarget;
         }
 
+        if (timeRender) ME_profiler_gpu_render_end();
+
         the<scripting>().update_render();
 
         // std::string test_text = "hello";
@@ -1083,7 +1195,7 @@ int game::run(int argc, char *argv[]) {
         R_ActivateShaderProgram(0, NULL);
         R_FlushBlitBuffer();
 
-        if (Iso.globaldef.draw_material_info && !ImGui::GetIO().WantCaptureMouse) {
+        if (Iso.globaldef.draw_material_info && the<gui>().imgui->FrameActive() && !ImGui::GetIO().WantCaptureMouse) {
 
             int msx = (int)((mx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
             int msy = (int)((my - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
@@ -1192,22 +1304,34 @@ int game::run(int argc, char *argv[]) {
         //    ImGui.new("Label", Tab1).Text = "Hello world"
         //  end
         //      )"););
-        for (auto &w : lua_bind::windows) {
-            w.render();
+        if (the<gui>().imgui->FrameActive()) {
+            for (auto &w : lua_bind::windows) {
+                w.render();
+            }
         }
 
         the<gui>().render_imgui();
 
         the<fontcache>().drawcmd();
+        // 字体缓存直接改了程序 帧缓冲 混合和视口
+        R_ResetRendererState();
 
         // 渲染屏幕渐进
         renderFade();
 
         R_Flip(the<engine>().eng()->target);
+        pacer.presented();
+
+        the<scripting>().update_gc(Iso.globaldef.lua_gc_generational, Iso.globaldef.lua_gc_budget_us);
+        the<scripting>().profiler.set_enabled(Iso.globaldef.lua_profiler, Iso.globaldef.lua_profiler_interval);
 
 #pragma endregion Render
 
         the<engine>().update_end();
+
+        replay.end_frame(frameTicks, frameTickMs, Iso.world.get());
+        stress.end_frame();
+        if (replay.finished() || stress.finished()) running = false;
     }
 
     R_FreeImage(fbo_simple);
@@ -1219,7 +1343,9 @@ int game::run(int argc, char *argv[]) {
 int game::exit() {
     METADOT_INFO("Shutting down...");
 
-    Iso.world->saveWorld();
+    // 回放不改动存档
+    if (!replay.playing()) Iso.world->saveWorld();
+    replay.finish();
 
     running = false;
 
@@ -1247,19 +1373,15 @@ int game::exit() {
 
     ME_destroy_pack_reader(Iso.pack_reader);
 
-    delete[] objectDelete;
-
     delete debugDraw;
-    delete[] movingTiles;
-
-    ME_DELETE(Iso.updateDirtyPool, thread_pool);
-    ME_DELETE(Iso.updateDirtyPool2, thread_pool);
 
     if (Iso.world.get()) {
         auto *p = Iso.world.release();
         delete p;
     }
 
+    job::shutdown();
+
     the<engine>().end_eng(0);
 
     METADOT_INFO("Clean done...");
@@ -1301,11 +1423,11 @@ void game::updateFrameEarly() {
     if (input::DEBUG_REFRESH->get()) {
         for (int x = 0; x < Iso.world->width; x++) {
             for (int y = 0; y < Iso.world->height; y++) {
-                Iso.world->dirty[x + y * Iso.world->width] = true;
-                Iso.world->layer2Dirty[x + y * Iso.world->width] = true;
-                Iso.world->backgroundDirty[x + y * Iso.world->width] = true;
+                Iso.world->dirty.mark(x + y * Iso.world->width);
+                Iso.world->layer2Dirty.mark(x + y * Iso.world->width);
             }
         }
+        Iso.world->queueBackgroundRect(0, 0, Iso.world->width, Iso.world->height);
     }
 
     if (input::DEBUG_RIGID->get()) {
@@ -1323,24 +1445,24 @@ void game::updateFrameEarly() {
 
                         MaterialInstance tt = cur->tiles[xx + yy * cur->matWidth];
                         if (tt.mat->id != GAME()->materials_list.GENERIC_AIR.id) {
-                            if (Iso.world->real_tiles[tx + ty * Iso.world->width].mat->id == GAME()->materials_list.GENERIC_AIR.id) {
+                            if (Iso.world->real_tiles[tx + ty * Iso.world->width].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
                                 Iso.world->real_tiles[tx + ty * Iso.world->width] = tt;
-                                Iso.world->dirty[tx + ty * Iso.world->width] = true;
-                            } else if (Iso.world->real_tiles[(tx + 1) + ty * Iso.world->width].mat->id == GAME()->materials_list.GENERIC_AIR.id) {
+                                Iso.world->dirty.mark(tx + ty * Iso.world->width);
+                            } else if (Iso.world->real_tiles[(tx + 1) + ty * Iso.world->width].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
                                 Iso.world->real_tiles[(tx + 1) + ty * Iso.world->width] = tt;
-                                Iso.world->dirty[(tx + 1) + ty * Iso.world->width] = true;
-                            } else if (Iso.world->real_tiles[(tx - 1) + ty * Iso.world->width].mat->id == GAME()->materials_list.GENERIC_AIR.id) {
+                                Iso.world->dirty.mark((tx + 1) + ty * Iso.world->width);
+                            } else if (Iso.world->real_tiles[(tx - 1) + ty * Iso.world->width].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
                                 Iso.world->real_tiles[(tx - 1) + ty * Iso.world->width] = tt;
-                                Iso.world->dirty[(tx - 1) + ty * Iso.world->width] = true;
-                            } else if (Iso.world->real_tiles[tx + (ty + 1) * Iso.world->width].mat->id == GAME()->materials_list.GENERIC_AIR.id) {
+                                Iso.world->dirty.mark((tx - 1) + ty * Iso.world->width);
+                            } else if (Iso.world->real_tiles[tx + (ty + 1) * Iso.world->width].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
                                 Iso.world->real_tiles[tx + (ty + 1) * Iso.world->width] = tt;
-                                Iso.world->dirty[tx + (ty + 1) * Iso.world->width] = true;
-                            } else if (Iso.world->real_tiles[tx + (ty - 1) * Iso.world->width].mat->id == GAME()->materials_list.GENERIC_AIR.id) {
+                                Iso.world->dirty.mark(tx + (ty + 1) * Iso.world->width);
+                            } else if (Iso.world->real_tiles[tx + (ty - 1) * Iso.world->width].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
                                 Iso.world->real_tiles[tx + (ty - 1) * Iso.world->width] = tt;
-                                Iso.world->dirty[tx + (ty - 1) * Iso.world->width] = true;
+                                Iso.world->dirty.mark(tx + (ty - 1) * Iso.world->width);
                             } else {
                                 Iso.world->real_tiles[tx + ty * Iso.world->width] = TilesCreateObsidian(tx, ty);
-                                Iso.world->dirty[tx + ty * Iso.world->width] = true;
+                                Iso.world->dirty.mark(tx + ty * Iso.world->width);
                             }
                         }
                     }
@@ -1349,7 +1471,7 @@ void game::updateFrameEarly() {
                 if (upd) {
 
                     // 更新rigidbody的image
-                    cur->updateImage({});
+                    cur->texNeedsUpdate = true;
                     // R_FreeImage(cur->get_texture());
                     // cur->set_texture(R_CopyImageFromSurface(cur->get_surface()));
                     // R_SetImageFilter(cur->get_texture(), R_FILTER_NEAREST);
@@ -1382,13 +1504,14 @@ void game::updateFrameEarly() {
         C_Surface *sfc = SDL_CreateRGBSurfaceWithFormat(0, 32, 32, 32, SDL_PIXELFORMAT_ARGB8888);
 
         int n = 0;
-        for (int xx = 0; xx < 32; xx++) {
-            for (int yy = 0; yy < 32; yy++) {
+        for (int yy = 0; yy < 32; yy++) {
+            u32 *row = &ME_get_pixel(sfc, 0, yy);
+            for (int xx = 0; xx < 32; xx++) {
 
-                if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat->physicsType == PhysicsType::SOLID) {
-                    ME_get_pixel(sfc, xx, yy) = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color;
+                if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat()->physicsType == PhysicsType::SOLID) {
+                    row[xx] = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color();
                     Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width] = Tiles_NOTHING;
-                    Iso.world->dirty[(x + xx) + (y + yy) * Iso.world->width] = true;
+                    Iso.world->dirty.mark((x + xx) + (y + yy) * Iso.world->width);
                     n++;
                 }
             }
@@ -1491,7 +1614,7 @@ void game::updateFrameEarly() {
     if (state == LOADING) {
 
     } else {
-        global.audio.SetEventParameter("event:/World/Sand", "Sand", 0);
+        global.audio.SetEventParameter(sounds.sand, 0);
         if (Iso.world->player) {
 
             auto [pl_we, pl] = Iso.world->getHostPlayer();
@@ -1505,7 +1628,7 @@ void game::updateFrameEarly() {
 
                     MaterialInstance mat = pl->heldItem->carry[pl->heldItem->carry.size() - 1];
                     pl->heldItem->carry.pop_back();
-                    Iso.world->addCell(new CellData(mat, (f32)x, (f32)y, (f32)(pl_we->vx / 2 + (rand() % 10 - 5) / 10.0f + 1.5f * (f32)cos((pl->holdAngle + 180) * 3.1415f / 180.0f)),
+                    Iso.world->addCell(CellData(mat, (f32)x, (f32)y, (f32)(pl_we->vx / 2 + (rand() % 10 - 5) / 10.0f + 1.5f * (f32)cos((pl->holdAngle + 180) * 3.1415f / 180.0f)),
                                                     (f32)(pl_we->vy / 2 + -(rand() % 5 + 5) / 10.0f + 1.5f * (f32)sin((pl->holdAngle + 180) * 3.1415f / 180.0f)), 0, (f32)0.1));
 
                     int i = (int)pl->heldItem->carry.size();
@@ -1515,11 +1638,9 @@ void game::updateFrameEarly() {
                     // TODO: 23/7/18 可能所有ME_get_pixel会导致修改surface的地方都得改
                     //               因为现在TextureRef都指代着默认贴图 而不是运行时动态的
                     ME_get_pixel(pl->heldItem->texture->surface(), pt.x, pt.y) = 0x00;
+                    pl->heldItem->markTexDirty(pt.x, pt.y);
 
-                    pl->heldItem->image = R_CopyImageFromSurface(pl->heldItem->texture->surface());
-                    R_SetImageFilter(pl->heldItem->image, R_FILTER_NEAREST);
-
-                    global.audio.SetEventParameter("event:/World/Sand", "Sand", 1);
+                    global.audio.SetEventParameter(sounds.sand, 1);
 
                 } else {
                     // pick up fluid into container
@@ -1538,21 +1659,19 @@ void game::updateFrameEarly() {
 
                                 if (cx * cx + cy * cy > 0.25f) continue;
 
-                                if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat->physicsType == PhysicsType::SAND ||
-                                    Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat->physicsType == PhysicsType::SOUP) {
+                                if (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat()->physicsType == PhysicsType::SAND ||
+                                    Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat()->physicsType == PhysicsType::SOUP) {
                                     pl->heldItem->carry.push_back(Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width]);
 
                                     int i = (int)pl->heldItem->carry.size() - 1;
                                     i = (int)((i / (f32)pl->heldItem->capacity) * pl->heldItem->fill.size());
                                     U16Point pt = pl->heldItem->fill[i];
-                                    u32 c = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color;
-                                    ME_get_pixel(pl->heldItem->texture->surface(), pt.x, pt.y) = (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat->alpha << 24) + c;
-
-                                    pl->heldItem->image = R_CopyImageFromSurface(pl->heldItem->texture->surface());
-                                    R_SetImageFilter(pl->heldItem->image, R_FILTER_NEAREST);
+                                    u32 c = Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].color();
+                                    ME_get_pixel(pl->heldItem->texture->surface(), pt.x, pt.y) = (Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width].mat()->alpha << 24) + c;
+                                    pl->heldItem->markTexDirty(pt.x, pt.y);
 
                                     Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width] = Tiles_NOTHING;
-                                    Iso.world->dirty[(x + xx) + (y + yy) * Iso.world->width] = true;
+                                    Iso.world->dirty.mark((x + xx) + (y + yy) * Iso.world->width);
                                     n++;
                                 }
                             }
@@ -1560,7 +1679,7 @@ void game::updateFrameEarly() {
                     }
 
                     if (n > 0) {
-                        global.audio.PlayEvent("event:/Player/Impact");
+                        global.audio.PlayEvent(sounds.impact);
                     }
                 }
             }
@@ -1575,7 +1694,8 @@ void game::updateFrameEarly() {
         f32 hoverDelta = 10.0 * the<engine>().eng()->time.deltaTime / 1000.0;
 
         // this copies the vector
-        std::vector<RigidBody *> rbs = Iso.world->rigidBodies;
+        frame_arena::scope scratch;
+        frame_vector<RigidBody *> rbs(Iso.world->rigidBodies.begin(), Iso.world->rigidBodies.end());
         for (size_t i = 0; i < rbs.size(); i++) {
             RigidBody *cur = rbs[i];
 
@@ -1664,7 +1784,7 @@ void game::tick() {
         if (Iso.world) {
             // tick chunkloading
             Iso.world->frame();
-            if (Iso.world->readyToMerge.size() == 0 && fadeOutStart == 0) {
+            if (!Iso.world->mergePending() && fadeOutStart == 0) {
                 fadeOutStart = the<engine>().eng()->time.now;
                 fadeOutLength = 250;
                 fadeOutCallback = [&]() {
@@ -1679,34 +1799,21 @@ void game::tick() {
         }
     } else {
 
-        std::size_t lastReadyToMergeSize = Iso.world->readyToMerge.size();
+        bool lastMergePending = Iso.world->mergePending();
 
         // check chunk loading
         tickChunkLoading();
 
         if (Iso.world->needToTickGeneration) Iso.world->tickChunkGeneration();
 
-        // clear objects
-        R_SetShapeBlendMode(R_BLEND_NORMAL);
-        R_Clear(TexturePack_.textureObjects->target);
-
-        R_SetShapeBlendMode(R_BLEND_NORMAL);
-        R_Clear(TexturePack_.textureObjectsLQ->target);
-
-        R_SetShapeBlendMode(R_BLEND_NORMAL);
-        R_Clear(TexturePack_.textureObjectsBack->target);
-
-        if (Iso.globaldef.tick_world && Iso.world->readyToMerge.size() == 0) {
+        if (Iso.globaldef.tick_world && !Iso.world->mergePending()) {
             Iso.world->tickChunks();
         }
 
-        // render objects
-
-        memset(objectDelete, false, (size_t)Iso.world->width * Iso.world->height * sizeof(bool));
+        // 刚体写进世界像素 贴图在 renderObjects 中每帧按插值的变换绘制
 
-        R_SetBlendMode(TexturePack_.textureObjects, R_BLEND_NORMAL);
-        R_SetBlendMode(TexturePack_.textureObjectsLQ, R_BLEND_NORMAL);
-        R_SetBlendMode(TexturePack_.textureObjectsBack, R_BLEND_NORMAL);
+        objectStamps.clear();
+        Iso.world->clearObjectOwners();
 
         for (size_t i = 0; i < Iso.world->rigidBodies.size(); i++) {
             RigidBody *cur = Iso.world->rigidBodies[i];
@@ -1714,109 +1821,59 @@ void game::tick() {
             if (cur->get_surface() == nullptr) continue;
             if (!cur->body->IsEnabled()) continue;
 
-            auto [x, y] = cur->body->GetPosition();
-
-            // draw
-
-            R_Target *tgt = cur->back ? TexturePack_.textureObjectsBack->target : TexturePack_.textureObjects->target;
-            R_Target *tgtLQ = cur->back ? TexturePack_.textureObjectsBack->target : TexturePack_.textureObjectsLQ->target;
-            int scaleObjTex = Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1;
-
-            MErect r = {x * scaleObjTex, y * scaleObjTex, (f32)cur->get_surface()->w * scaleObjTex, (f32)cur->get_surface()->h * scaleObjTex};
-
-            if (cur->texNeedsUpdate) {
-
-                // 更新rigidbody的image
-                cur->updateImage({});
-
-                // if (cur->get_texture() != nullptr) {
-                //     R_FreeImage(cur->get_texture());
-                // }
-                // cur->set_texture(R_CopyImageFromSurface(cur->get_surface()));
-                // R_SetImageFilter(cur->get_texture(), R_FILTER_NEAREST);
-
-                cur->texNeedsUpdate = false;
-            }
-
-            R_BlitRectX(cur->image(), NULL, tgt, &r, cur->body->GetAngle() * 180 / (f32)M_PI, 0, 0, R_FLIP_NONE);
-
-            // draw outline
-
-            u8 outlineAlpha = (u8)(cur->hover * 255);
-            if (outlineAlpha > 0) {
-                MEcolor col = {0xff, 0xff, 0x80, outlineAlpha};
-                R_SetShapeBlendMode(R_BLEND_NORMAL_FACTOR_ALPHA);
-                for (auto &l : cur->outline) {
-                    MEvec2 *vec = new MEvec2[l.GetNumPoints()];
-                    for (int j = 0; j < l.GetNumPoints(); j++) {
-                        vec[j] = {(f32)l.GetPoint(j).x / the<engine>().eng()->render_scale, (f32)l.GetPoint(j).y / the<engine>().eng()->render_scale};
-                    }
-                    ME_draw_polygon(tgtLQ, col, vec, (int)x, (int)y, the<engine>().eng()->render_scale, l.GetNumPoints(), cur->body->GetAngle(), 0, 0);
-                    delete[] vec;
-                }
-                R_SetShapeBlendMode(R_BLEND_NORMAL);
-            }
-
             // 液体置换
             // 当 rigidBody 碰撞到液体时 会将液体挤开轮廓
 
-            f32 s = std::sin(cur->body->GetAngle());
-            f32 c = std::cos(cur->body->GetAngle());
-
-            std::vector<std::pair<int, int>> checkDirs = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            // 只遍历刚体实际覆盖的世界像素 静止的刚体直接复用上一次的结果
+            // 写入的位置记录在 stamped 中 取回时按它收回
+            static const std::pair<int, int> checkDirs[] = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            const i32 ww = Iso.world->width;
+            const i32 wh = Iso.world->height;
+            cur->stamped.clear();
+            // 第一次写入像素时才登记 见 world::objectOwner
+            u16 owner = 0;
 
-            for (int tx = 0; tx < cur->matWidth; tx++) {
-                for (int ty = 0; ty < cur->matHeight; ty++) {
-                    MaterialInstance rmat = cur->tiles[tx + ty * cur->matWidth];
-                    if (rmat.mat->id == GAME()->materials_list.GENERIC_AIR.id) continue;
+            for (auto [wi, t] : Iso.world->rasterRigidBody(cur)) {
+                MaterialInstance rmat = cur->tiles[t];
+                if (rmat.mat->id == GAME()->materials_list.GENERIC_AIR.id) continue;
 
-                    // rotate point
-                    int wx = (int)(tx * c - (ty + 1) * s + x);
-                    int wy = (int)(tx * s + (ty + 1) * c + y);
+                const int wx = (int)(wi % ww);
+                const int wy = (int)(wi / ww);
 
-                    for (auto &dir : checkDirs) {
-                        int wxd = wx + dir.first;
-                        int wyd = wy + dir.second;
+                for (auto &dir : checkDirs) {
+                    int wxd = wx + dir.first;
+                    int wyd = wy + dir.second;
 
-                        if (wxd < 0 || wyd < 0 || wxd >= Iso.world->width || wyd >= Iso.world->height) continue;
-
-                        // 这里判断三种cell的物理特征
-                        // AIR 与 SAND 和 SOUP
-                        if (Iso.world->real_tiles[wxd + wyd * Iso.world->width].mat->physicsType == PhysicsType::AIR) {
-                            Iso.world->real_tiles[wxd + wyd * Iso.world->width] = rmat;
-                            Iso.world->dirty[wxd + wyd * Iso.world->width] = true;
-                            // objectDelete[wxd + wyd * Iso.world->width] = true;
-                            break;
-                        } else if (Iso.world->real_tiles[wxd + wyd * Iso.world->width].mat->physicsType == PhysicsType::SAND) {
-                            Iso.world->addCell(new CellData(Iso.world->real_tiles[wxd + wyd * Iso.world->width], (f32)wxd, (f32)(wyd - 3), (f32)((rand() % 10 - 5) / 10.0f),
-                                                            (f32)(-(rand() % 5 + 5) / 10.0f), 0, (f32)0.1));
-                            Iso.world->real_tiles[wxd + wyd * Iso.world->width] = rmat;
-                            // objectDelete[wxd + wyd * Iso.world->width] = true;
-                            Iso.world->dirty[wxd + wyd * Iso.world->width] = true;
-
-                            cur->body->SetLinearVelocity({cur->body->GetLinearVelocity().x * (f32)0.99, cur->body->GetLinearVelocity().y * (f32)0.99});
-                            cur->body->SetAngularVelocity(cur->body->GetAngularVelocity() * (f32)0.98);
-                            break;
-                        } else if (Iso.world->real_tiles[wxd + wyd * Iso.world->width].mat->physicsType == PhysicsType::SOUP) {
-                            Iso.world->addCell(new CellData(Iso.world->real_tiles[wxd + wyd * Iso.world->width], (f32)wxd, (f32)(wyd - 3), (f32)((rand() % 10 - 5) / 10.0f),
-                                                            (f32)(-(rand() % 5 + 5) / 10.0f), 0, (f32)0.1));
-                            Iso.world->real_tiles[wxd + wyd * Iso.world->width] = rmat;
-                            // objectDelete[wxd + wyd * Iso.world->width] = true;
-                            Iso.world->dirty[wxd + wyd * Iso.world->width] = true;
+                    if (wxd < 0 || wyd < 0 || wxd >= ww || wyd >= wh) continue;
 
-                            cur->body->SetLinearVelocity({cur->body->GetLinearVelocity().x * (f32)0.998, cur->body->GetLinearVelocity().y * (f32)0.998});
-                            cur->body->SetAngularVelocity(cur->body->GetAngularVelocity() * (f32)0.99);
+                    const u32 idx = wxd + wyd * ww;
 
-                            break;
-                        }
+                    // 这里判断三种cell的物理特征
+                    // AIR 与 SAND 和 SOUP
+                    const PhysicsType pt = Iso.world->displaceCell(idx, rmat, [&](const MaterialInstance &old) {
+                        return CellData(old, (f32)wxd, (f32)(wyd - 3), (f32)((rand() % 10 - 5) / 10.0f), (f32)(-(rand() % 5 + 5) / 10.0f), 0, (f32)0.1);
+                    });
+                    if (pt == PhysicsType::SAND || pt == PhysicsType::SOUP) {
+                        const f32 lin = pt == PhysicsType::SAND ? 0.99f : 0.998f;
+                        const f32 ang = pt == PhysicsType::SAND ? 0.98f : 0.99f;
+                        cur->body->SetLinearVelocity({cur->body->GetLinearVelocity().x * lin, cur->body->GetLinearVelocity().y * lin});
+                        cur->body->SetAngularVelocity(cur->body->GetAngularVelocity() * ang);
+                    } else if (pt != PhysicsType::AIR) {
+                        continue;
                     }
+
+                    Iso.world->dirty.mark(idx);
+                    cur->stamped.emplace_back(idx, t);
+                    if (!owner) owner = Iso.world->addObjectOwner(cur);
+                    if (owner) Iso.world->setObjectOwner(idx, owner);
+                    break;
                 }
             }
         }
 
         // render entities
 
-        if (lastReadyToMergeSize == 0) {
+        if (!lastMergePending) {
             Iso.world->tickEntities(TexturePack_.textureEntities->target);
 
             if (Iso.world->player) {
@@ -1835,7 +1892,7 @@ void game::tick() {
         entity_update_event e{.g = this};
         Iso.world->Reg().process_event(e);
 
-        if ((Iso.globaldef.tick_world && Iso.world->readyToMerge.size() == 0) || input::DEBUG_TICK->get()) {
+        if ((Iso.globaldef.tick_world && !Iso.world->mergePending()) || input::DEBUG_TICK->get()) {
             Iso.world->tick();
         }
 
@@ -1864,18 +1921,17 @@ void game::tick() {
 
         bool hadDirty = false;
         bool hadLayer2Dirty = false;
-        bool hadBackgroundDirty = false;
-        bool hadFire = false;
         bool hadFlow = false;
 
         u8 *dpixels_ar = TexturePack_.pixels_ar;
         u8 *dpixelsFire_ar = TexturePack_.pixelsFire_ar;
         u8 *dpixelsFlow_ar = TexturePack_.pixelsFlow_ar;
         u8 *dpixelsEmission_ar = TexturePack_.pixelsEmission_ar;
+        u8 *dpixelsPacked_ar = TexturePack_.pixelsPacked_ar;
 
-        std::vector<std::future<void>> results = {};
+        job_counter results;
 
-        results.push_back(Iso.updateDirtyPool->push([&](int id) {
+        job::execute(results, [&]() {
             void *cellPixels = TexturePack_.pixelsCells_ar;
 
             // 清空 pixelsCells_ar
@@ -1883,15 +1939,13 @@ void game::tick() {
 
             Iso.world->renderCells((u8 **)&cellPixels);
             Iso.world->tickCells();
-        }));
+        });
 
-        if (Iso.world->readyToMerge.size() == 0) {
-            results.push_back(Iso.updateDirtyPool->push([&](int id) { Iso.world->tickObjectBounds(); }));
+        if (!Iso.world->mergePending()) {
+            job::execute(results, [&]() { Iso.world->tickObjectBounds(); });
         }
 
-        for (int i = 0; i < results.size(); i++) {
-            results[i].get();
-        }
+        job::wait(results);
 
         for (size_t i = 0; i < Iso.world->rigidBodies.size(); i++) {
             RigidBody *cur = Iso.world->rigidBodies[i];
@@ -1899,294 +1953,286 @@ void game::tick() {
             if (cur->get_surface() == nullptr) continue;
             if (!cur->body->IsEnabled()) continue;
 
-            auto [x, y] = cur->body->GetPosition();
-
-            f32 s = std::sin(cur->body->GetAngle());
-            f32 c = std::cos(cur->body->GetAngle());
-
-            std::vector<std::pair<int, int>> checkDirs = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
-            for (int tx = 0; tx < cur->matWidth; tx++) {
-                for (int ty = 0; ty < cur->matHeight; ty++) {
-                    MaterialInstance rmat = cur->tiles[tx + ty * cur->matWidth];
-                    ME_ASSERT(rmat.mat);
-                    if (rmat.mat->id == GAME()->materials_list.GENERIC_AIR.id) continue;
-
-                    // rotate point
-                    int wx = (int)(tx * c - (ty + 1) * s + x);
-                    int wy = (int)(tx * s + (ty + 1) * c + y);
-
-                    bool found = false;
-                    for (auto &dir : checkDirs) {
-                        int wxd = wx + dir.first;
-                        int wyd = wy + dir.second;
-
-                        if (wxd < 0 || wyd < 0 || wxd >= Iso.world->width || wyd >= Iso.world->height) continue;
-                        if (Iso.world->real_tiles[wxd + wyd * Iso.world->width].id == rmat.id) {
-                            cur->tiles[tx + ty * cur->matWidth] = Iso.world->real_tiles[wxd + wyd * Iso.world->width];
-                            Iso.world->real_tiles[wxd + wyd * Iso.world->width] = Tiles_NOTHING;
-                            Iso.world->dirty[wxd + wyd * Iso.world->width] = true;
-                            found = true;
-
-                            for (int dxx = -1; dxx <= 1; dxx++) {
-                                for (int dyy = -1; dyy <= 1; dyy++) {
-                                    if (Iso.world->real_tiles[(wxd + dxx) + (wyd + dyy) * Iso.world->width].mat->physicsType == PhysicsType::SAND ||
-                                        Iso.world->real_tiles[(wxd + dxx) + (wyd + dyy) * Iso.world->width].mat->physicsType == PhysicsType::SOUP) {
-                                        uint32_t color = Iso.world->real_tiles[(wxd + dxx) + (wyd + dyy) * Iso.world->width].color;
-
-                                        unsigned int offset = ((wxd + dxx) + (wyd + dyy) * Iso.world->width) * 4;
-
-                                        dpixels_ar[offset + 2] = ((color >> 0) & 0xff);                                                           // b
-                                        dpixels_ar[offset + 1] = ((color >> 8) & 0xff);                                                           // g
-                                        dpixels_ar[offset + 0] = ((color >> 16) & 0xff);                                                          // r
-                                        dpixels_ar[offset + 3] = Iso.world->real_tiles[(wxd + dxx) + (wyd + dyy) * Iso.world->width].mat->alpha;  // a
-                                    }
-                                }
-                            }
+            // 按写入时的记录取回 不需要重新搜索刚体覆盖的范围
+            const i32 ww = Iso.world->width;
+            const i32 wh = Iso.world->height;
+            bool lost = false;
 
-                            if (!Iso.globaldef.draw_load_zones) {
-                                unsigned int offset = (wxd + wyd * Iso.world->width) * 4;
-                                dpixels_ar[offset + 2] = 0;     // b
-                                dpixels_ar[offset + 1] = 0;     // g
-                                dpixels_ar[offset + 0] = 0xff;  // r
-                                dpixels_ar[offset + 3] = 0xff;  // a
-                            }
+            for (auto [idx, t] : cur->stamped) {
+                MaterialInstance rmat = cur->tiles[t];
+                ME_ASSERT(rmat.mat);
 
-                            break;
-                        }
+                if (Iso.world->real_tiles[idx].id() != rmat.id) {
+                    // 写入的像素被烧掉或挖掉了
+                    if (Iso.world->real_tiles[idx].mat()->id == GAME()->materials_list.GENERIC_AIR.id) {
+                        cur->tiles[t] = Tiles_NOTHING;
+                        lost = true;
                     }
+                    continue;
+                }
 
-                    if (!found && !Iso.world->real_tiles.empty()) {
-                        try {
-                            if (Iso.world->real_tiles.at(wx + wy * Iso.world->width).mat->id == GAME()->materials_list.GENERIC_AIR.id) cur->tiles[tx + ty * cur->matWidth] = Tiles_NOTHING;
-                        } catch (const std::out_of_range &ex) {
-                            METADOT_ERROR(std::format("[Exception] world->tiles[{0}] {1}", wx + wy * Iso.world->width, ex.what()).c_str());
+                cur->tiles[t] = Iso.world->real_tiles[idx];
+                Iso.world->real_tiles[idx] = Tiles_NOTHING;
+                Iso.world->dirty.mark(idx);
+
+                const int wxd = (int)(idx % ww);
+                const int wyd = (int)(idx / ww);
+                for (int dxx = -1; dxx <= 1; dxx++) {
+                    for (int dyy = -1; dyy <= 1; dyy++) {
+                        if (wxd + dxx < 0 || wyd + dyy < 0 || wxd + dxx >= ww || wyd + dyy >= wh) continue;
+                        const u32 ni = (wxd + dxx) + (wyd + dyy) * ww;
+                        if (Iso.world->real_tiles[ni].mat()->physicsType == PhysicsType::SAND || Iso.world->real_tiles[ni].mat()->physicsType == PhysicsType::SOUP) {
+                            uint32_t color = Iso.world->real_tiles[ni].color();
+
+                            unsigned int offset = ni * 4;
+
+                            dpixels_ar[offset + 2] = ((color >> 0) & 0xff);                  // b
+                            dpixels_ar[offset + 1] = ((color >> 8) & 0xff);                  // g
+                            dpixels_ar[offset + 0] = ((color >> 16) & 0xff);                 // r
+                            dpixels_ar[offset + 3] = Iso.world->real_tiles[ni].mat()->alpha;  // a
                         }
                     }
                 }
-            }
 
-            for (int tx = 0; tx < cur->get_surface()->w; tx++) {
-                for (int ty = 0; ty < cur->get_surface()->h; ty++) {
-                    MaterialInstance mat = cur->tiles[tx + ty * cur->get_surface()->w];
-                    if (mat.mat->id == GAME()->materials_list.GENERIC_AIR.id) {
-                        ME_get_pixel(cur->get_surface(), tx, ty) = 0x00000000;
-                    } else {
-                        ME_get_pixel(cur->get_surface(), tx, ty) = (mat.mat->alpha << 24) + (mat.color & 0x00ffffff);
-                    }
+                if (!Iso.globaldef.draw_load_zones) {
+                    unsigned int offset = idx * 4;
+                    dpixels_ar[offset + 2] = 0;     // b
+                    dpixels_ar[offset + 1] = 0;     // g
+                    dpixels_ar[offset + 0] = 0xff;  // r
+                    dpixels_ar[offset + 3] = 0xff;  // a
                 }
             }
 
-            // 更新rigidbody的image
-            cur->updateImage({});
+            // 只有写入过世界的像素可能改变 在 renderObjects 中上传这部分
+            for (auto [idx, t] : cur->stamped) {
+                const int tx = (int)(t % cur->matWidth);
+                const int ty = (int)(t / cur->matWidth);
+                MaterialInstance mat = cur->tiles[t];
+                u32 pixel = (mat.mat->id == GAME()->materials_list.GENERIC_AIR.id) ? 0x00000000 : (mat.mat->alpha << 24) + (mat.color & 0x00ffffff);
+                if (ME_get_pixel(cur->get_surface(), tx, ty) != pixel) {
+                    ME_get_pixel(cur->get_surface(), tx, ty) = pixel;
+                    cur->markTexDirty(tx, ty);
+                }
+            }
+            cur->stamped.clear();
 
-            cur->needsUpdate = true;
+            // 形状没有变化时不需要重建碰撞体 刚体才能休眠
+            if (lost) cur->needsUpdate = true;
         }
 
-        if (Iso.world->readyToMerge.size() == 0) {
-            if (Iso.globaldef.tick_box2d) Iso.world->tickObjects();
+        // 刚体像素已经全部取回
+        Iso.world->applyObjectImpulses();
+        Iso.world->clearObjectOwners();
+
+        if (!Iso.world->mergePending()) {
+            if (Iso.globaldef.tick_box2d) {
+                // 此时刚体像素已经从世界取回 冻结的刚体才能写进世界
+                Iso.world->tickObjectLOD();
+                Iso.world->tickLiquidParticles();
+                Iso.world->tickObjects(the<engine>().eng()->time.mspt);
+            }
         }
 
         if (the<engine>().eng()->time.tickCount % 10 == 0) Iso.world->tickObjectsMesh();
 
-        for (int i = 0; i < GAME()->materials_count; i++) movingTiles[i] = 0;
-
-        results.clear();
-        results.push_back(Iso.updateDirtyPool->push([&](int id) {
-            for (int i = 0; i < Iso.world->width * Iso.world->height; i++) {
-                const unsigned int offset = i * 4;
+        TexturePack_.cellPixels.update_materials();
+
+        WorldPixelsShader *pixelsShader = Iso.shaderworker->worldPixelsShader;
+        const bool packed = Iso.globaldef.gpu_world_pixels && TexturePack_.cellPixels.packed_supported() && pixelsShader && pixelsShader->shader;
+        if (packed != TexturePack_.packedActive) {
+            // 另一种模式的像素缓冲已经过时 整体重新转换一次
+            TexturePack_.packedActive = packed;
+            TexturePack_.needFullUpload = true;
+            Iso.world->dirty.mark_rect(0, 0, Iso.world->width, Iso.world->height);
+        }
+
+        // 只访问各区块格内的脏包围盒
+        Iso.world->dirty.update_rects();
+        Iso.world->layer2Dirty.update_rects();
+        hadDirty = Iso.world->dirty.any();
+        hadLayer2Dirty = Iso.world->layer2Dirty.any();
+
+        job::execute(results, [&]() {
+            const CellPixelConverter &conv = TexturePack_.cellPixels;
+            Iso.world->dirty.for_each_word([&](size_t base, u64 mask) {
+                // 颜色/发光/火焰三张纹理按组转换 其余逐像素处理
+                CellPixelConverter::Result r = packed ? conv.convert_packed(Iso.world->real_tiles, base, mask, dpixelsPacked_ar, dpixelsFire_ar)
+                                                      : conv.convert(Iso.world->real_tiles, base, mask, dpixels_ar, dpixelsEmission_ar, dpixelsFire_ar);
+                if (r.fire) TexturePack_.fireRegions.add(base, r.fire);
+
+                for (u64 m = r.soup; m; m &= m - 1) {
+                    const size_t i = base + std::countr_zero(m);
+                    const unsigned int offset = i * 4;
+                    const int iterations = Iso.world->real_tiles.mat(i)->iterations;
+
+                    f32 newFlowX = Iso.world->prevFlowX[i] + (Iso.world->flowX[i] - Iso.world->prevFlowX[i]) * 0.25;
+                    f32 newFlowY = Iso.world->prevFlowY[i] + (Iso.world->flowY[i] - Iso.world->prevFlowY[i]) * 0.25;
+                    if (newFlowY < 0) newFlowY *= 0.5;
+
+                    f64 a;
+                    // r g b a
+                    dpixelsFlow_ar[offset + 2] = 0;
+                    a = newFlowY * (3.0 / iterations + 0.5) / 4.0 + 0.5;
+                    dpixelsFlow_ar[offset + 1] = std::min(std::max(a, 0.0), 1.0) * 255;
+                    a = newFlowX * (3.0 / iterations + 0.5) / 4.0 + 0.5;
+                    dpixelsFlow_ar[offset + 0] = std::min(std::max(a, 0.0), 1.0) * 255;
+                    dpixelsFlow_ar[offset + 3] = 0xff;
+
+                    hadFlow = true;
+                    Iso.world->prevFlowX[i] = newFlowX;
+                    Iso.world->prevFlowY[i] = newFlowY;
+                }
 
-                if (Iso.world->dirty[i]) {
-                    hadDirty = true;
-                    movingTiles[Iso.world->real_tiles[i].mat->id]++;
-                    if (Iso.world->real_tiles[i].mat->physicsType == PhysicsType::AIR) {
-                        dpixels_ar[offset + 0] = 0;                     // b
-                        dpixels_ar[offset + 1] = 0;                     // g
-                        dpixels_ar[offset + 2] = 0;                     // r
-                        dpixels_ar[offset + 3] = ME_ALPHA_TRANSPARENT;  // a
-
-                        dpixelsFire_ar[offset + 0] = 0;                     // b
-                        dpixelsFire_ar[offset + 1] = 0;                     // g
-                        dpixelsFire_ar[offset + 2] = 0;                     // r
-                        dpixelsFire_ar[offset + 3] = ME_ALPHA_TRANSPARENT;  // a
-
-                        dpixelsEmission_ar[offset + 0] = 0;                     // b
-                        dpixelsEmission_ar[offset + 1] = 0;                     // g
-                        dpixelsEmission_ar[offset + 2] = 0;                     // r
-                        dpixelsEmission_ar[offset + 3] = ME_ALPHA_TRANSPARENT;  // a
-
-                        Iso.world->flowY[i] = 0;
-                        Iso.world->flowX[i] = 0;
-                    } else {
-                        u32 color = Iso.world->real_tiles[i].color;
-                        u32 emit = Iso.world->real_tiles[i].mat->emitColor;
-                        // f32 br = GameIsolate_.world->light[i];
-                        dpixels_ar[offset + 2] = ((color >> 0) & 0xff);                // b
-                        dpixels_ar[offset + 1] = ((color >> 8) & 0xff);                // g
-                        dpixels_ar[offset + 0] = ((color >> 16) & 0xff);               // r
-                        dpixels_ar[offset + 3] = Iso.world->real_tiles[i].mat->alpha;  // a
-
-                        dpixelsEmission_ar[offset + 2] = ((emit >> 0) & 0xff);   // b
-                        dpixelsEmission_ar[offset + 1] = ((emit >> 8) & 0xff);   // g
-                        dpixelsEmission_ar[offset + 0] = ((emit >> 16) & 0xff);  // r
-                        dpixelsEmission_ar[offset + 3] = ((emit >> 24) & 0xff);  // a
-
-                        if (Iso.world->real_tiles[i].mat->id == GAME()->materials_list.FIRE.id) {
-                            dpixelsFire_ar[offset + 2] = ((color >> 0) & 0xff);                // b
-                            dpixelsFire_ar[offset + 1] = ((color >> 8) & 0xff);                // g
-                            dpixelsFire_ar[offset + 0] = ((color >> 16) & 0xff);               // r
-                            dpixelsFire_ar[offset + 3] = Iso.world->real_tiles[i].mat->alpha;  // a
-                            hadFire = true;
-                        }
-                        if (Iso.world->real_tiles[i].mat->physicsType == PhysicsType::SOUP) {
-
-                            f32 newFlowX = Iso.world->prevFlowX[i] + (Iso.world->flowX[i] - Iso.world->prevFlowX[i]) * 0.25;
-                            f32 newFlowY = Iso.world->prevFlowY[i] + (Iso.world->flowY[i] - Iso.world->prevFlowY[i]) * 0.25;
-                            if (newFlowY < 0) newFlowY *= 0.5;
-
-                            f64 a;
-                            // r g b a
-                            dpixelsFlow_ar[offset + 2] = 0;
-                            a = newFlowY * (3.0 / Iso.world->real_tiles[i].mat->iterations + 0.5) / 4.0 + 0.5;
-                            dpixelsFlow_ar[offset + 1] = std::min(std::max(a, 0.0), 1.0) * 255;
-                            a = newFlowX * (3.0 / Iso.world->real_tiles[i].mat->iterations + 0.5) / 4.0 + 0.5;
-                            dpixelsFlow_ar[offset + 0] = std::min(std::max(a, 0.0), 1.0) * 255;
-                            dpixelsFlow_ar[offset + 3] = 0xff;
-
-                            hadFlow = true;
-                            Iso.world->prevFlowX[i] = newFlowX;
-                            Iso.world->prevFlowY[i] = newFlowY;
-                            Iso.world->flowY[i] = 0;
-                            Iso.world->flowX[i] = 0;
-                        } else {
-                            Iso.world->flowY[i] = 0;
-                            Iso.world->flowX[i] = 0;
-                        }
-                    }
+                for (u64 m = mask; m; m &= m - 1) {
+                    const size_t i = base + std::countr_zero(m);
+                    Iso.world->flowY[i] = 0;
+                    Iso.world->flowX[i] = 0;
                 }
-            }
-        }));
+            });
+        });
 
         // void* vdpixelsLayer2_ar = textureLayer2->data;
         // u8* dpixelsLayer2_ar = (u8*)vdpixelsLayer2_ar;
         u8 *dpixelsLayer2_ar = TexturePack_.pixelsLayer2_ar;
-        results.push_back(Iso.updateDirtyPool->push([&](int id) {
-            for (int i = 0; i < Iso.world->width * Iso.world->height; i++) {
-                /*for (int x = 0; x < GameIsolate_.world->width; x++) {
-for (int y = 0; y < GameIsolate_.world->height; y++) {*/
-                // const unsigned int i = x + y * GameIsolate_.world->width;
+        job::execute(results, [&]() {
+            Iso.world->layer2Dirty.for_each([&](size_t i) {
                 const unsigned int offset = i * 4;
-                if (Iso.world->layer2Dirty[i]) {
-                    hadLayer2Dirty = true;
-                    if (Iso.world->real_layer2[i].mat->physicsType == PhysicsType::AIR) {
-                        if (Iso.globaldef.draw_background_grid) {
-                            u32 color = ((i) % 2) == 0 ? 0x888888 : 0x444444;
-                            dpixelsLayer2_ar[offset + 2] = (color >> 0) & 0xff;   // b
-                            dpixelsLayer2_ar[offset + 1] = (color >> 8) & 0xff;   // g
-                            dpixelsLayer2_ar[offset + 0] = (color >> 16) & 0xff;  // r
-                            dpixelsLayer2_ar[offset + 3] = ME_ALPHA_OPAQUE;       // a
-                            continue;
-                        } else {
-                            dpixelsLayer2_ar[offset + 0] = 0;                     // b
-                            dpixelsLayer2_ar[offset + 1] = 0;                     // g
-                            dpixelsLayer2_ar[offset + 2] = 0;                     // r
-                            dpixelsLayer2_ar[offset + 3] = ME_ALPHA_TRANSPARENT;  // a
-                            continue;
-                        }
+                if (Iso.world->real_layer2[i].mat()->physicsType == PhysicsType::AIR) {
+                    if (Iso.globaldef.draw_background_grid) {
+                        u32 color = ((i) % 2) == 0 ? 0x888888 : 0x444444;
+                        dpixelsLayer2_ar[offset + 2] = (color >> 0) & 0xff;   // b
+                        dpixelsLayer2_ar[offset + 1] = (color >> 8) & 0xff;   // g
+                        dpixelsLayer2_ar[offset + 0] = (color >> 16) & 0xff;  // r
+                        dpixelsLayer2_ar[offset + 3] = ME_ALPHA_OPAQUE;       // a
+                        return;
+                    } else {
+                        dpixelsLayer2_ar[offset + 0] = 0;                     // b
+                        dpixelsLayer2_ar[offset + 1] = 0;                     // g
+                        dpixelsLayer2_ar[offset + 2] = 0;                     // r
+                        dpixelsLayer2_ar[offset + 3] = ME_ALPHA_TRANSPARENT;  // a
+                        return;
                     }
-                    u32 color = Iso.world->real_layer2[i].color;
-                    dpixelsLayer2_ar[offset + 2] = (color >> 0) & 0xff;                   // b
-                    dpixelsLayer2_ar[offset + 1] = (color >> 8) & 0xff;                   // g
-                    dpixelsLayer2_ar[offset + 0] = (color >> 16) & 0xff;                  // r
-                    dpixelsLayer2_ar[offset + 3] = Iso.world->real_layer2[i].mat->alpha;  // a
                 }
-            }
-        }));
-
-        // void* vdpixelsBackground_ar = textureBackground->data;
-        // u8* dpixelsBackground_ar = (u8*)vdpixelsBackground_ar;
-        u8 *dpixelsBackground_ar = TexturePack_.pixelsBackground_ar;
-        results.push_back(Iso.updateDirtyPool->push([&](int id) {
-            for (int i = 0; i < Iso.world->width * Iso.world->height; i++) {
-                /*for (int x = 0; x < GameIsolate_.world->width; x++) {
-for (int y = 0; y < GameIsolate_.world->height; y++) {*/
-                // const unsigned int i = x + y * GameIsolate_.world->width;
-                const unsigned int offset = i * 4;
-
-                if (Iso.world->backgroundDirty[i]) {
-                    hadBackgroundDirty = true;
-                    u32 color = Iso.world->background[i];
-                    dpixelsBackground_ar[offset + 2] = (color >> 0) & 0xff;   // b
-                    dpixelsBackground_ar[offset + 1] = (color >> 8) & 0xff;   // g
-                    dpixelsBackground_ar[offset + 0] = (color >> 16) & 0xff;  // r
-                    dpixelsBackground_ar[offset + 3] = (color >> 24) & 0xff;  // a
-                }
-
-                //}
-            }
-        }));
-
-        for (int i = 0; i < Iso.world->width * Iso.world->height; i++) {
-            /*for (int x = 0; x < GameIsolate_.world->width; x++) {
-for (int y = 0; y < GameIsolate_.world->height; y++) {*/
-            // const unsigned int i = x + y * GameIsolate_.world->width;
-            const unsigned int offset = i * 4;
-
-            // 实行 object delete 操作
-            // 将对应 real_tiles 替换为 Tiles_NOTHING
-            if (objectDelete[i]) {
-                Iso.world->real_tiles[i] = Tiles_NOTHING;
-            }
-        }
-
-        // results.push_back(updateDirtyPool->push([&](int id) {
+                u32 color = Iso.world->real_layer2[i].color();
+                dpixelsLayer2_ar[offset + 2] = (color >> 0) & 0xff;                   // b
+                dpixelsLayer2_ar[offset + 1] = (color >> 8) & 0xff;                   // g
+                dpixelsLayer2_ar[offset + 0] = (color >> 16) & 0xff;                  // r
+                dpixelsLayer2_ar[offset + 3] = Iso.world->real_layer2[i].mat()->alpha;  // a
+            });
+        });
 
-        //}));
+        // 实行 object delete 操作
+        // 将实体写入的 real_tiles 替换为 Tiles_NOTHING
+        for (u32 i : objectStamps) Iso.world->real_tiles[i] = Tiles_NOTHING;
+        objectStamps.clear();
 
-        for (int i = 0; i < results.size(); i++) {
-            results[i].get();
-        }
+        job::wait(results);
 
         updateMaterialSounds();
+        Iso.world->updateFluidSummary();
 
         R_UpdateImageBytes(TexturePack_.textureCells, NULL, &TexturePack_.pixelsCells_ar[0], Iso.world->width * 4);
 
-        if (hadDirty) memset(Iso.world->dirty, false, (size_t)Iso.world->width * Iso.world->height);
-        if (hadLayer2Dirty) memset(Iso.world->layer2Dirty, false, (size_t)Iso.world->width * Iso.world->height);
-        if (hadBackgroundDirty) memset(Iso.world->backgroundDirty, false, (size_t)Iso.world->width * Iso.world->height);
+        // 清除前把这一帧的改变记录到休眠区域中
+        Iso.world->collectActiveRegions();
+        if (hadDirty) Iso.world->dirty.clear();
+        if (hadLayer2Dirty) Iso.world->layer2Dirty.clear();
 
+        bool temperatureTicked = false;
         if (Iso.globaldef.tick_temperature && the<engine>().eng()->time.tickCount % GameTick == 2) {
             Iso.world->tickTemperature();
-        }
-        if (Iso.globaldef.draw_temperature_map && the<engine>().eng()->time.tickCount % GameTick == 0) {
-            renderTemperatureMap(Iso.world.get());
-        }
+            temperatureTicked = true;
+        }
+
+        // 只上传各图层的脏矩形 相机平移后像素缓冲整体移动过 需要整张上传
+        bool fullUpload = TexturePack_.needFullUpload;
+        TexturePack_.needFullUpload = false;
+
+        R_SetStreamingUploads(Iso.globaldef.streaming_uploads);
+
+        frame_arena::scope scratch;
+        auto toUpdateRects = [](const DirtyMap &map) {
+            frame_vector<MErect> rects;
+            rects.reserve(map.rects().size());
+            for (const DirtyRect &r : map.rects()) rects.push_back({(f32)r.x, (f32)r.y, (f32)r.w, (f32)r.h});
+            return rects;
+        };
+        auto uploadWorldTexture = [&](R_Image *texture, std::vector<u8> &pixels, const frame_vector<MErect> &rects) {
+            if (fullUpload) {
+                R_UpdateImageBytes(texture, NULL, &pixels[0], Iso.world->width * 4);
+                ME_profiler_count("texture bytes uploaded", (i64)Iso.world->width * Iso.world->height * 4);
+            } else {
+                R_UpdateImageBytesRects(texture, rects.data(), (int)rects.size(), &pixels[0], Iso.world->width * 4);
+                i64 bytes = 0;
+                for (const MErect &r : rects) bytes += (i64)r.w * (i64)r.h * 4;
+                ME_profiler_count("texture bytes uploaded", bytes);
+            }
+        };
 
-        if (hadDirty) {
-            R_UpdateImageBytes(TexturePack_.texture, NULL, &TexturePack_.pixels[0], Iso.world->width * 4);
+        frame_vector<MErect> dirtyRects = toUpdateRects(Iso.world->dirty);
 
-            R_UpdateImageBytes(TexturePack_.emissionTexture, NULL, &TexturePack_.pixelsEmission[0], Iso.world->width * 4);
-        }
+        if ((hadDirty || fullUpload) && packed) {
+            uploadWorldTexture(TexturePack_.texturePacked, TexturePack_.pixelsPacked, dirtyRects);
 
-        if (hadLayer2Dirty) {
-            R_UpdateImageBytes(TexturePack_.textureLayer2, NULL, &TexturePack_.pixelsLayer2[0], Iso.world->width * 4);
+            const CellPixelConverter &conv = TexturePack_.cellPixels;
+            if (!TexturePack_.materialProps || TexturePack_.materialPropsVersion != conv.version()) {
+                std::vector<u8> props;
+                conv.material_props(props);
+                const int count = (int)(props.size() / 8);
+
+                if (TexturePack_.materialProps) R_FreeImage(TexturePack_.materialProps);
+                TexturePack_.materialProps = R_CreateImage(count, 2, R_FormatEnum::R_FORMAT_RGBA);
+                R_SetImageFilter(TexturePack_.materialProps, R_FILTER_NEAREST);
+                R_UpdateImageBytes(TexturePack_.materialProps, NULL, props.data(), count * 4);
+                TexturePack_.materialPropsVersion = conv.version();
+            }
+
+            // 整张重新生成 两次全屏绘制比上传两张纹理的脏矩形便宜
+            ME_profiler_gpu_scope_auto("WorldPixelsShader");
+            R_SetBlendMode(TexturePack_.texturePacked, R_BLEND_SET);
+            pixelsShader->activate();
+            pixelsShader->Update(TexturePack_.materialProps, 0);
+            R_BlitRect(TexturePack_.texturePacked, NULL, TexturePack_.texture->target, NULL);
+            pixelsShader->Update(TexturePack_.materialProps, 1);
+            R_BlitRect(TexturePack_.texturePacked, NULL, TexturePack_.emissionTexture->target, NULL);
+            R_ActivateShaderProgram(0, NULL);
+        } else if (hadDirty || fullUpload) {
+            uploadWorldTexture(TexturePack_.texture, TexturePack_.pixels, dirtyRects);
+
+            uploadWorldTexture(TexturePack_.emissionTexture, TexturePack_.pixelsEmission, dirtyRects);
         }
 
-        if (hadBackgroundDirty) {
-            R_UpdateImageBytes(TexturePack_.textureBackground, NULL, &TexturePack_.pixelsBackground[0], Iso.world->width * 4);
+        if (hadLayer2Dirty || fullUpload) {
+            uploadWorldTexture(TexturePack_.textureLayer2, TexturePack_.pixelsLayer2, toUpdateRects(Iso.world->layer2Dirty));
         }
 
-        if (hadFlow) {
-            R_UpdateImageBytes(TexturePack_.textureFlow, NULL, &TexturePack_.pixelsFlow[0], Iso.world->width * 4);
+        syncBackgroundAtlas();
+
+        if (hadFlow || fullUpload) {
+            uploadWorldTexture(TexturePack_.textureFlow, TexturePack_.pixelsFlow, dirtyRects);
 
             Iso.shaderworker->waterFlowPassShader->dirty = true;
         }
 
-        if (hadFire) {
-            R_UpdateImageBytes(TexturePack_.textureFire, NULL, &TexturePack_.pixelsFire[0], Iso.world->width * 4);
+        // 火焰缓冲只在火焰的包围盒内改变 熄灭的火焰也在上一次的包围盒内
+        frame_vector<MErect> fireRects;
+        TexturePack_.fireRegions.changed(Iso.world->dirty.rects(), fireRects);
+        if (!fireRects.empty() || fullUpload) {
+            uploadWorldTexture(TexturePack_.textureFire, TexturePack_.pixelsFire, fireRects);
         }
+        TexturePack_.fireRegions.shrink(TexturePack_.pixelsFire_ar);
 
+        // 温度随像素移动 也在温度 tick 中改变 两者的区域分别上传
         if (Iso.globaldef.draw_temperature_map) {
-            R_UpdateImageBytes(TexturePack_.temperatureMap, NULL, &TexturePack_.pixelsTemp[0], Iso.world->width * 4);
+            if (fullUpload || TexturePack_.temperatureMapStale) {
+                TexturePack_.temperatureMapStale = true;
+                renderTemperatureMap(Iso.world.get(), {});
+            } else {
+                if (hadDirty) renderTemperatureMap(Iso.world.get(), Iso.world->dirty.rects());
+                if (temperatureTicked) renderTemperatureMap(Iso.world.get(), Iso.world->temperatureChangedRects);
+            }
+        } else {
+            TexturePack_.temperatureMapStale = true;
         }
 
         /*R_UpdateImageBytes(
@@ -2200,61 +2246,117 @@ GameIsolate_.world->width * 4
     }
 }
 
+void game::initMemoryBudget() {
+    memory.set_reporter(MemTag::Allocator, [] { return ME_mem_current_usage_bytes(); });
+    memory.set_reporter(MemTag::WorldPlanes, [this] { return Iso.world ? Iso.world->planeBytes() : 0; });
+    memory.set_reporter(MemTag::Chunks, [this] { return Iso.world ? Iso.world->chunkBytes() : 0; });
+    memory.set_reporter(MemTag::ChunkCache, [this] { return Iso.world ? (u64)Iso.world->regions.cache_bytes() : 0; });
+    memory.set_reporter(MemTag::RigidBodies, [this] { return Iso.world ? Iso.world->rigidBodyBytes() : 0; });
+    memory.set_reporter(MemTag::Particles, [this] { return Iso.world ? Iso.world->particleBytes() : 0; });
+    memory.set_reporter(MemTag::Textures, [this] { return TexturePack_.memory_bytes() + (u64)R_GetImagePoolBytes(); });
+    memory.set_reporter(MemTag::Lua, [] { return (u64)the<scripting>().memory_bytes(); });
+
+    // 代价小 不影响画面的策略在前 卸载区块最后
+    memory.add_policy(
+            "chunk cache",
+            [this](u64 excess) -> u64 {
+                if (!Iso.world) return 0;
+                const u64 before = Iso.world->regions.cache_bytes();
+                if (before == 0) return 0;
+                Iso.world->regions.set_cache_budget(before > excess ? (size_t)(before - excess) : 0);
+                return before - Iso.world->regions.cache_bytes();
+            },
+            [this] {
+                if (Iso.world) Iso.world->regions.set_cache_budget((size_t)std::max(Iso.globaldef.chunk_cache_mb, 0) << 20);
+            });
+    memory.add_policy("image pool", [](u64) -> u64 {
+        const u64 before = R_GetImagePoolBytes();
+        R_TrimImagePool(0);
+        return before - R_GetImagePoolBytes();
+    });
+    memory.add_policy("lua gc", [](u64) -> u64 { return the<scripting>().collect_garbage(); });
+    memory.add_policy("distant chunks", [this](u64 excess) -> u64 { return Iso.world ? Iso.world->trimDistantChunks(excess) : 0; });
+}
+
+void game::syncBackgroundAtlas() {
+    world *w = Iso.world.get();
+    BackgroundAtlas &atlas = TexturePack_.backgroundAtlas;
+    if (w->backgroundReset) {
+        atlas.reset();
+        w->backgroundReset = false;
+    }
+    for (u64 k : w->backgroundReleases) atlas.release((int)(k >> 32), (int)(u32)k);
+    w->backgroundReleases.clear();
+    if (w->backgroundUploads.empty()) return;
+
+    ME_profiler_scope_auto("BackgroundUpload");
+    // 同一个区块在一帧内可能被记下多次
+    std::sort(w->backgroundUploads.begin(), w->backgroundUploads.end());
+    w->backgroundUploads.erase(std::unique(w->backgroundUploads.begin(), w->backgroundUploads.end()), w->backgroundUploads.end());
+    std::vector<u32> chunk(CHUNK_W * CHUNK_H);
+    for (u64 k : w->backgroundUploads) {
+        const int cx = (int)(k >> 32), cy = (int)(u32)k;
+        w->readChunkBackground(cx, cy, chunk.data());
+        atlas.upload(cx, cy, chunk.data(), (int)w->loadZone.x, (int)w->loadZone.y, w->width, w->height);
+    }
+    ME_profiler_count("background chunks uploaded", (u32)w->backgroundUploads.size());
+    w->backgroundUploads.clear();
+}
+
 void game::tickChunkLoading() {
 
     // if need to load chunks
     if ((abs(accLoadX) > CHUNK_W / 2 || abs(accLoadY) > CHUNK_H / 2)) {
-        while (Iso.world->toLoad.size() > 0) {
-            // tick chunkloading
-            Iso.world->frame();
-        }
-
         // iterate
 
-        for (int i = 0; i < Iso.world->width * Iso.world->height; i++) {
-            const unsigned int offset = i * 4;
-
 #define UCH_SET_PIXEL(pix_ar, ofs, c_r, c_g, c_b, c_a) \
     pix_ar[ofs + 0] = c_b;                             \
     pix_ar[ofs + 1] = c_g;                             \
     pix_ar[ofs + 2] = c_r;                             \
     pix_ar[ofs + 3] = c_a;
 
-            if (Iso.world->dirty[i]) {
-                if (Iso.world->real_tiles[i].mat->physicsType == PhysicsType::AIR) {
+        Iso.world->dirty.update_rects();
+        Iso.world->layer2Dirty.update_rects();
+
+        if (TexturePack_.packedActive) {
+            Iso.world->dirty.for_each_word([&](size_t base, u64 mask) {
+                CellPixelConverter::Result r = TexturePack_.cellPixels.convert_packed(Iso.world->real_tiles, base, mask, TexturePack_.pixelsPacked_ar, TexturePack_.pixelsFire_ar);
+                if (r.fire) TexturePack_.fireRegions.add(base, r.fire);
+            });
+        } else {
+            Iso.world->dirty.for_each([&](size_t i) {
+                const unsigned int offset = i * 4;
+                if (Iso.world->real_tiles[i].mat()->physicsType == PhysicsType::AIR) {
                     UCH_SET_PIXEL(TexturePack_.pixels_ar, offset, 0, 0, 0, ME_ALPHA_TRANSPARENT);
                 } else {
-                    u32 color = Iso.world->real_tiles[i].color;
-                    u32 emit = Iso.world->real_tiles[i].mat->emitColor;
-                    UCH_SET_PIXEL(TexturePack_.pixels_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, Iso.world->real_tiles[i].mat->alpha);
+                    u32 color = Iso.world->real_tiles[i].color();
+                    u32 emit = Iso.world->real_tiles[i].mat()->emitColor;
+                    UCH_SET_PIXEL(TexturePack_.pixels_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, Iso.world->real_tiles[i].mat()->alpha);
                     UCH_SET_PIXEL(TexturePack_.pixelsEmission_ar, offset, (emit >> 0) & 0xff, (emit >> 8) & 0xff, (emit >> 16) & 0xff, (emit >> 24) & 0xff);
                 }
-            }
+            });
+        }
 
-            if (Iso.world->layer2Dirty[i]) {
-                if (Iso.world->real_layer2[i].mat->physicsType == PhysicsType::AIR) {
-                    if (Iso.globaldef.draw_background_grid) {
-                        u32 color = ((i) % 2) == 0 ? 0x888888 : 0x444444;
-                        UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, ME_ALPHA_OPAQUE);
-                    } else {
-                        UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, 0, 0, 0, ME_ALPHA_TRANSPARENT);
-                    }
-                    continue;
+        Iso.world->layer2Dirty.for_each([&](size_t i) {
+            const unsigned int offset = i * 4;
+            if (Iso.world->real_layer2[i].mat()->physicsType == PhysicsType::AIR) {
+                if (Iso.globaldef.draw_background_grid) {
+                    u32 color = ((i) % 2) == 0 ? 0x888888 : 0x444444;
+                    UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, ME_ALPHA_OPAQUE);
+                } else {
+                    UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, 0, 0, 0, ME_ALPHA_TRANSPARENT);
                 }
-                u32 color = Iso.world->real_layer2[i].color;
-                UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, Iso.world->real_layer2[i].mat->alpha);
+                return;
             }
+            u32 color = Iso.world->real_layer2[i].color();
+            UCH_SET_PIXEL(TexturePack_.pixelsLayer2_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, Iso.world->real_layer2[i].mat()->alpha);
+        });
 
-            if (Iso.world->backgroundDirty[i]) {
-                u32 color = Iso.world->background[i];
-                UCH_SET_PIXEL(TexturePack_.pixelsBackground_ar, offset, (color >> 0) & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, (color >> 24) & 0xff);
-            }
 #undef UCH_SET_PIXEL
-        }
 
-        memset(Iso.world->dirty, false, (size_t)Iso.world->width * Iso.world->height);
-        memset(Iso.world->layer2Dirty, false, (size_t)Iso.world->width * Iso.world->height);
-        memset(Iso.world->backgroundDirty, false, (size_t)Iso.world->width * Iso.world->height);
+        Iso.world->collectActiveRegions();
+        Iso.world->dirty.clear();
+        Iso.world->layer2Dirty.clear();
 
         while ((abs(accLoadX) > CHUNK_W / 2 || abs(accLoadY) > CHUNK_H / 2)) {
             int subX = std::fmax(std::fmin(accLoadX, CHUNK_W / 2), -CHUNK_W / 2);
@@ -2267,68 +2369,65 @@ void game::tickChunkLoading() {
 
             int delta = 4 * (subX + subY * Iso.world->width);
 
-            std::vector<std::future<void>> results = {};
+            job_counter results;
             if (delta > 0) {
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixels_ar[0]), &(TexturePack_.pixels_ar[Iso.world->width * Iso.world->height * 4]) - delta,
                                 &(TexturePack_.pixels_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixels.begin(), pixels.end() - delta, pixels.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsLayer2_ar[0]), &(TexturePack_.pixelsLayer2_ar[Iso.world->width * Iso.world->height * 4]) - delta,
                                 &(TexturePack_.pixelsLayer2_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsLayer2.begin(), pixelsLayer2.end() - delta, pixelsLayer2.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
-                    std::rotate(&(TexturePack_.pixelsBackground_ar[0]), &(TexturePack_.pixelsBackground_ar[Iso.world->width * Iso.world->height * 4]) - delta,
-                                &(TexturePack_.pixelsBackground_ar[Iso.world->width * Iso.world->height * 4]));
-                    // rotate(pixelsBackground.begin(), pixelsBackground.end() - delta, pixelsBackground.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsFire_ar[0]), &(TexturePack_.pixelsFire_ar[Iso.world->width * Iso.world->height * 4]) - delta,
                                 &(TexturePack_.pixelsFire_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsFire_ar.begin(), pixelsFire_ar.end() - delta, pixelsFire_ar.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsFlow_ar[0]), &(TexturePack_.pixelsFlow_ar[Iso.world->width * Iso.world->height * 4]) - delta,
                                 &(TexturePack_.pixelsFlow_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsFlow_ar.begin(), pixelsFlow_ar.end() - delta, pixelsFlow_ar.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsEmission_ar[0]), &(TexturePack_.pixelsEmission_ar[Iso.world->width * Iso.world->height * 4]) - delta,
                                 &(TexturePack_.pixelsEmission_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsEmission_ar.begin(), pixelsEmission_ar.end() - delta, pixelsEmission_ar.end());
-                }));
+                });
+                job::execute(results, [&]() {
+                    std::rotate(&(TexturePack_.pixelsPacked_ar[0]), &(TexturePack_.pixelsPacked_ar[Iso.world->width * Iso.world->height * 4]) - delta,
+                                &(TexturePack_.pixelsPacked_ar[Iso.world->width * Iso.world->height * 4]));
+                });
             } else if (delta < 0) {
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixels_ar[0]), &(TexturePack_.pixels_ar[0]) - delta, &(TexturePack_.pixels_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixels.begin(), pixels.begin() - delta, pixels.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsLayer2_ar[0]), &(TexturePack_.pixelsLayer2_ar[0]) - delta, &(TexturePack_.pixelsLayer2_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsLayer2.begin(), pixelsLayer2.begin() - delta, pixelsLayer2.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
-                    std::rotate(&(TexturePack_.pixelsBackground_ar[0]), &(TexturePack_.pixelsBackground_ar[0]) - delta, &(TexturePack_.pixelsBackground_ar[Iso.world->width * Iso.world->height * 4]));
-                    // rotate(pixelsBackground.begin(), pixelsBackground.begin() - delta, pixelsBackground.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsFire_ar[0]), &(TexturePack_.pixelsFire_ar[0]) - delta, &(TexturePack_.pixelsFire_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsFire_ar.begin(), pixelsFire_ar.begin() - delta, pixelsFire_ar.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsFlow_ar[0]), &(TexturePack_.pixelsFlow_ar[0]) - delta, &(TexturePack_.pixelsFlow_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsFlow_ar.begin(), pixelsFlow_ar.begin() - delta, pixelsFlow_ar.end());
-                }));
-                results.push_back(Iso.updateDirtyPool->push([&](int id) {
+                });
+                job::execute(results, [&]() {
                     std::rotate(&(TexturePack_.pixelsEmission_ar[0]), &(TexturePack_.pixelsEmission_ar[0]) - delta, &(TexturePack_.pixelsEmission_ar[Iso.world->width * Iso.world->height * 4]));
                     // rotate(pixelsEmission_ar.begin(), pixelsEmission_ar.begin() - delta, pixelsEmission_ar.end());
-                }));
+                });
+                job::execute(results, [&]() {
+                    std::rotate(&(TexturePack_.pixelsPacked_ar[0]), &(TexturePack_.pixelsPacked_ar[0]) - delta, &(TexturePack_.pixelsPacked_ar[Iso.world->width * Iso.world->height * 4]));
+                });
             }
 
-            for (auto &v : results) {
-                v.get();
-            }
+            job::wait(results);
+            TexturePack_.fireRegions.shift(subX, subY);
 
 #define CLEARPIXEL(pixels, ofs)                                 \
     pixels[ofs + 0] = pixels[ofs + 1] = pixels[ofs + 2] = 0xff; \
@@ -2338,10 +2437,10 @@ void game::tickChunkLoading() {
     CLEARPIXEL(TexturePack_.pixels_ar, offset);           \
     CLEARPIXEL(TexturePack_.pixelsLayer2_ar, offset);     \
     CLEARPIXEL(TexturePack_.pixelsObjects_ar, offset);    \
-    CLEARPIXEL(TexturePack_.pixelsBackground_ar, offset); \
     CLEARPIXEL(TexturePack_.pixelsFire_ar, offset);       \
     CLEARPIXEL(TexturePack_.pixelsFlow_ar, offset);       \
-    CLEARPIXEL(TexturePack_.pixelsEmission_ar, offset)
+    CLEARPIXEL(TexturePack_.pixelsEmission_ar, offset);   \
+    CLEARPIXEL(TexturePack_.pixelsPacked_ar, offset)
 
             for (int x = 0; x < abs(subX); x++) {
                 for (int y = 0; y < Iso.world->height; y++) {
@@ -2373,9 +2472,7 @@ void game::tickChunkLoading() {
 
         Iso.world->tickChunks();
         Iso.world->updateWorldMesh();
-        Iso.world->dirty[0] = true;
-        Iso.world->layer2Dirty[0] = true;
-        Iso.world->backgroundDirty[0] = true;
+        TexturePack_.needFullUpload = true;
 
     } else {
         Iso.world->frame();
@@ -2396,29 +2493,28 @@ void game::tickPlayer() {
             // 跳跃起步
             if (pl_we->ground) {
                 pl_we->vy = -4;
-                global.audio.PlayEvent("event:/Player/Jump");
+                global.audio.PlayEvent(sounds.jump);
             }
         }
 
         pl_we->vy += (f32)(((input::PLAYER_UP->get() && !input::DEBUG_DRAW->get()) ? (pl_we->vy > -1 ? -0.8 : -0.35) : 0) + (input::PLAYER_DOWN->get() ? 0.1 : 0));
         if (input::PLAYER_UP->get() && !input::DEBUG_DRAW->get()) {
-            global.audio.SetEventParameter("event:/Player/Fly", "Intensity", 1);
+            global.audio.SetEventParameter(sounds.fly, 1);
             for (int i = 0; i < 4; i++) {
-                CellData *p = new CellData(TilesCreateLava(), (f32)(pl_we->x + Iso.world->loadZone.x + pl_we->hw / 2 + rand() % 5 - 2 + pl_we->vx),
-                                           (f32)(pl_we->y + Iso.world->loadZone.y + pl_we->hh + pl_we->vy), (f32)((rand() % 10 - 5) / 10.0f + pl_we->vx / 2.0f),
-                                           (f32)((rand() % 10) / 10.0f + 1 + pl_we->vy / 2.0f), 0, (f32)0.025);
-                p->temporary = true;
-                p->lifetime = 120;
+                CellData p(TilesCreateLava(), (f32)(pl_we->x + Iso.world->loadZone.x + pl_we->hw / 2 + rand() % 5 - 2 + pl_we->vx), (f32)(pl_we->y + Iso.world->loadZone.y + pl_we->hh + pl_we->vy),
+                           (f32)((rand() % 10 - 5) / 10.0f + pl_we->vx / 2.0f), (f32)((rand() % 10) / 10.0f + 1 + pl_we->vy / 2.0f), 0, (f32)0.025);
+                p.temporary = true;
+                p.lifetime = 120;
                 Iso.world->addCell(p);
             }
         } else {
-            global.audio.SetEventParameter("event:/Player/Fly", "Intensity", 0);
+            global.audio.SetEventParameter(sounds.fly, 0);
         }
 
         if (pl_we->vy > 0) {
-            global.audio.SetEventParameter("event:/Player/Wind", "Wind", (f32)(pl_we->vy / 12.0));
+            global.audio.SetEventParameter(sounds.wind, (f32)(pl_we->vy / 12.0));
         } else {
-            global.audio.SetEventParameter("event:/Player/Wind", "Wind", 0);
+            global.audio.SetEventParameter(sounds.wind, 0);
         }
 
         pl_we->vx += (f32)((input::PLAYER_LEFT->get() ? (pl_we->vx > 0 ? -0.4 : -0.2) : 0) + (input::PLAYER_RIGHT->get() ? (pl_we->vx < 0 ? 0.4 : 0.2) : 0));
@@ -2468,7 +2564,7 @@ void game::tickPlayer() {
                         int sind = -1;
                         bool inObject = true;
                         Iso.world->forLine(wcx, wcy, wmx, wmy, [&](int ind) {
-                            if (Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::OBJECT) {
+                            if (Iso.world->real_tiles[ind].mat()->physicsType == PhysicsType::OBJECT) {
                                 if (!inObject) {
                                     sind = ind;
                                     return true;
@@ -2477,8 +2573,8 @@ void game::tickPlayer() {
                                 inObject = false;
                             }
 
-                            if (Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SOLID || Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SAND ||
-                                Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SOUP) {
+                            if (Iso.world->real_tiles[ind].mat()->physicsType == PhysicsType::SOLID || Iso.world->real_tiles[ind].mat()->physicsType == PhysicsType::SAND ||
+                                Iso.world->real_tiles[ind].mat()->physicsType == PhysicsType::SOUP) {
                                 sind = ind;
                                 return true;
                             }
@@ -2489,36 +2585,21 @@ void game::tickPlayer() {
                         int y = sind == -1 ? wmy : sind / Iso.world->width;
 
                         std::function<void(MaterialInstance, int, int)> makeCell = [&](MaterialInstance tile, int xPos, int yPos) {
-                            CellData *par = new CellData(tile, xPos, yPos, 0, 0, 0, (f32)0.01f);
-                            par->vx = (rand() % 10 - 5) / 5.0f * 1.0f;
-                            par->vy = (rand() % 10 - 5) / 5.0f * 1.0f;
-                            par->ax = -par->vx / 10.0f;
-                            par->ay = -par->vy / 10.0f;
-                            if (par->ay == 0 && par->ax == 0) par->ay = 0.01f;
+                            CellData par(tile, xPos, yPos, 0, 0, 0, (f32)0.01f);
+                            par.vx = (rand() % 10 - 5) / 5.0f * 1.0f;
+                            par.vy = (rand() % 10 - 5) / 5.0f * 1.0f;
+                            par.ax = -par.vx / 10.0f;
+                            par.ay = -par.vy / 10.0f;
+                            if (par.ay == 0 && par.ax == 0) par.ay = 0.01f;
 
                             // par->targetX = pl_we->x + pl_we->hw / 2 + GameIsolate_.world->loadZone.x;
                             // par->targetY = pl_we->y + pl_we->hh / 2 + GameIsolate_.world->loadZone.y;
                             // par->targetForce = 0.35f;
 
-                            par->lifetime = 6;
-
-                            par->phase = true;
-
-                            pl->heldItem->vacuumCells.push_back(par);
+                            par.lifetime = 6;
 
-                            par->killCallback = [&par, this]() {
-                                Player *pl = nullptr;
-                                WorldEntity *pl_we = nullptr;
-
-                                if (Iso.world->player) {
-                                    std::tie(pl_we, pl) = Iso.world->getHostPlayer();
-                                }
-
-                                if (pl->holdtype != EnumPlayerHoldType::HoldTypeNone) {
-                                    auto &v = pl->heldItem->vacuumCells;
-                                    v.erase(std::remove(v.begin(), v.end(), par), v.end());
-                                }
-                            };
+                            par.phase = true;
+                            par.event = CellEvent_Vacuum;
 
                             Iso.world->addCell(par);
                         };
@@ -2538,59 +2619,31 @@ void game::tickPlayer() {
                                     makeCell(tile, x + xx, y + yy);
                                     Iso.world->real_tiles[(x + xx) + (y + yy) * Iso.world->width] = Tiles_NOTHING;
                                     // GameIsolate_.world->tiles[(x + xx) + (y + yy) * GameIsolate_.world->width] = TilesCreateFire();
-                                    Iso.world->dirty[(x + xx) + (y + yy) * Iso.world->width] = true;
+                                    Iso.world->dirty.mark((x + xx) + (y + yy) * Iso.world->width);
                                 }
                             }
                         }
 
-                        auto func = [&](CellData *cur) {
-                            if (cur->targetForce == 0 && !cur->phase) {
-                                int rad = 5;
-                                for (int xx = -rad; xx <= rad; xx++) {
-                                    for (int yy = -rad; yy <= rad; yy++) {
-                                        if ((yy == -rad || yy == rad) && (xx == -rad || x == rad)) continue;
-
-                                        if (((int)(cur->x) == (x + xx)) && ((int)(cur->y) == (y + yy))) {
-
-                                            cur->vx = (rand() % 10 - 5) / 5.0f * 1.0f;
-                                            cur->vy = (rand() % 10 - 5) / 5.0f * 1.0f;
-                                            cur->ax = -cur->vx / 10.0f;
-                                            cur->ay = -cur->vy / 10.0f;
-                                            if (cur->ay == 0 && cur->ax == 0) cur->ay = 0.01f;
-
-                                            // par->targetX = pl_we->x + pl_we->hw / 2 + GameIsolate_.world->loadZone.x;
-                                            // par->targetY = pl_we->y + pl_we->hh / 2 + GameIsolate_.world->loadZone.y;
-                                            // par->targetForce = 0.35f;
-
-                                            cur->lifetime = 6;
-
-                                            cur->phase = true;
-
-                                            pl->heldItem->vacuumCells.push_back(cur);
-
-                                            cur->killCallback = [&cur, this]() {
-                                                Player *pl = nullptr;
-                                                WorldEntity *pl_we = nullptr;
-
-                                                if (Iso.world->player) std::tie(pl_we, pl) = Iso.world->getHostPlayer();
-
-                                                if (NULL == pl) return;
-                                                if (pl->holdtype != EnumPlayerHoldType::HoldTypeNone) {
-                                                    auto &v = pl->heldItem->vacuumCells;
-                                                    std::erase_if(v, [&](CellData *c) { return c == cur; });
-                                                }
-                                            };
-
-                                            return false;
-                                        }
-                                    }
-                                }
-                            }
-
-                            return false;
-                        };
-
-                        std::erase_if(Iso.world->cells, func);
+                        // 已经在飞的 cell 也一起吸起 半径与上面的方框相同
+                        CellParticles &cells = Iso.world->cells;
+                        for (size_t i = 0; i < cells.size(); i++) {
+                            if (cells.targetForce[i] != 0 || cells.phase[i]) continue;
+                            const int cx = (int)cells.x[i] - x;
+                            const int cy = (int)cells.y[i] - y;
+                            if (cx < -rad || cx > rad || cy < -rad || cy > rad) continue;
+                            if ((cy == -rad || cy == rad) && (cx == -rad || cx == rad)) continue;
+
+                            cells.vx[i] = (rand() % 10 - 5) / 5.0f * 1.0f;
+                            cells.vy[i] = (rand() % 10 - 5) / 5.0f * 1.0f;
+                            cells.ax[i] = -cells.vx[i] / 10.0f;
+                            cells.ay[i] = -cells.vy[i] / 10.0f;
+                            if (cells.ay[i] == 0 && cells.ax[i] == 0) cells.ay[i] = 0.01f;
+
+                            cells.lifetime[i] = 6;
+
+                            cells.phase[i] = true;
+                            cells.event[i] = CellEvent_Vacuum;
+                        }
 
                         std::vector<RigidBody *> *rbs = &Iso.world->rigidBodies;
 
@@ -2616,6 +2669,7 @@ void game::tickPlayer() {
                                             u32 pixel = ME_get_pixel(cur->get_surface(), ntx, nty);
                                             if (((pixel >> 24) & 0xff) != 0x00) {
                                                 ME_get_pixel(cur->get_surface(), ntx, nty) = 0x00000000;
+                                                cur->markTexDirty(ntx, nty);
                                                 upd = true;
 
                                                 makeCell(MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, pixel), (x + xx), (y + yy));
@@ -2626,8 +2680,7 @@ void game::tickPlayer() {
 
                                 if (upd) {
 
-                                    // 更新rigidbody的image
-                                    cur->updateImage({});
+                                    // 更新rigidbody的image 改动的范围已经由 markTexDirty 记录
                                     // R_FreeImage(cur->get_texture());
                                     // cur->set_texture(R_CopyImageFromSurface(cur->get_surface()));
                                     // R_SetImageFilter(cur->get_texture(), R_FILTER_NEAREST);
@@ -2639,30 +2692,27 @@ void game::tickPlayer() {
                     }
                 }
 
-                if (pl->heldItem->vacuumCells.size() > 0) {
-                    pl->heldItem->vacuumCells.erase(std::remove_if(pl->heldItem->vacuumCells.begin(), pl->heldItem->vacuumCells.end(),
-                                                                   [&](CellData *cur) {
-                                                                       if (cur->lifetime <= 0) {
-                                                                           cur->targetForce = 0.45f;
-                                                                           cur->targetX = pl_we->x + pl_we->hw / 2.0f + Iso.world->loadZone.x;
-                                                                           cur->targetY = pl_we->y + pl_we->hh / 2.0f + Iso.world->loadZone.y;
-                                                                           cur->ax = 0;
-                                                                           cur->ay = 0.01f;
-                                                                       }
-
-                                                                       f32 tdx = cur->targetX - cur->x;
-                                                                       f32 tdy = cur->targetY - cur->y;
-
-                                                                       if (tdx * tdx + tdy * tdy < 10 * 10) {
-                                                                           cur->temporary = true;
-                                                                           cur->lifetime = 0;
-                                                                           // METADOT_BUG("vacuum {}", cur->tile.mat->name.c_str());
-                                                                           return true;
-                                                                       }
-
-                                                                       return false;
-                                                                   }),
-                                                    pl->heldItem->vacuumCells.end());
+                // 吸起的 cell 被引向玩家 靠近后消失
+                CellParticles &vacuumed = Iso.world->cells;
+                for (size_t i = 0; i < vacuumed.size(); i++) {
+                    if (vacuumed.event[i] != CellEvent_Vacuum) continue;
+
+                    if (vacuumed.lifetime[i] <= 0) {
+                        vacuumed.targetForce[i] = 0.45f;
+                        vacuumed.targetX[i] = pl_we->x + pl_we->hw / 2.0f + Iso.world->loadZone.x;
+                        vacuumed.targetY[i] = pl_we->y + pl_we->hh / 2.0f + Iso.world->loadZone.y;
+                        vacuumed.ax[i] = 0;
+                        vacuumed.ay[i] = 0.01f;
+                    }
+
+                    f32 tdx = vacuumed.targetX[i] - vacuumed.x[i];
+                    f32 tdy = vacuumed.targetY[i] - vacuumed.y[i];
+
+                    if (tdx * tdx + tdy * tdy < 10 * 10) {
+                        vacuumed.temporary[i] = true;
+                        vacuumed.lifetime[i] = 0;
+                        vacuumed.event[i] = CellEvent_None;
+                    }
                 }
             }
         }
@@ -2673,6 +2723,16 @@ void game::tickProfiler() {
     {
         ME_profiler_scope_auto("Profiler");
 
+        // GPU 时间戳只在显示分析器时记录
+        ME_profiler_gpu_set_enabled(Iso.globaldef.draw_profiler);
+
+        // ECS 计数器每秒记录一次 历史足够覆盖几分钟 能看出哪些组件存储在增长
+        static i64 lastECSCounters = 0;
+        if (Iso.world && the<engine>().eng()->time.now - lastECSCounters >= 1000) {
+            lastECSCounters = the<engine>().eng()->time.now;
+            Iso.world->recordECSCounters();
+        }
+
         if (Iso.globaldef.draw_profiler) {
             static profiler_frame frame_data;
             ME_profiler_get_frame(&frame_data);
@@ -2740,12 +2800,102 @@ void game::updateFrameLate() {
 
         GAME()->camX = (f32)(GAME()->camX + (GAME()->desCamX - GAME()->camX) * (the<engine>().eng()->time.now - the<engine>().eng()->time.lastTime) / 250.0f);
         GAME()->camY = (f32)(GAME()->camY + (GAME()->desCamY - GAME()->camY) * (the<engine>().eng()->time.now - the<engine>().eng()->time.lastTime) / 250.0f);
+
+        // 刚体每帧按物理时钟插值绘制 物理步长比 tick 长或者一个 tick 补了几步都不会顿
+        const f32 thruTick = (f32)((the<engine>().eng()->time.now - the<engine>().eng()->time.lastTickTime) / the<engine>().eng()->time.mspt);
+        renderObjects(Iso.world->physicsAlpha(thruTick, the<engine>().eng()->time.mspt));
     }
 }
 
+void game::renderObjects(f32 alpha) {
+    R_SetShapeBlendMode(R_BLEND_NORMAL);
+    R_Clear(TexturePack_.textureObjects->target);
+
+    R_SetShapeBlendMode(R_BLEND_NORMAL);
+    R_Clear(TexturePack_.textureObjectsLQ->target);
+
+    R_SetShapeBlendMode(R_BLEND_NORMAL);
+    R_Clear(TexturePack_.textureObjectsBack->target);
+
+    R_SetBlendMode(TexturePack_.textureObjects, R_BLEND_NORMAL);
+    R_SetBlendMode(TexturePack_.textureObjectsLQ, R_BLEND_NORMAL);
+    R_SetBlendMode(TexturePack_.textureObjectsBack, R_BLEND_NORMAL);
+
+    for (size_t i = 0; i < Iso.world->rigidBodies.size(); i++) {
+        RigidBody *cur = Iso.world->rigidBodies[i];
+        if (cur == nullptr) continue;
+        if (cur->get_surface() == nullptr) continue;
+        if (!cur->body->IsEnabled()) continue;
+
+        b2Vec2 pos;
+        f32 angle;
+        Iso.world->interpolatedTransform(cur, alpha, pos, angle);
+        auto [x, y] = pos;
+
+        // draw
+
+        R_Target *tgt = cur->back ? TexturePack_.textureObjectsBack->target : TexturePack_.textureObjects->target;
+        R_Target *tgtLQ = cur->back ? TexturePack_.textureObjectsBack->target : TexturePack_.textureObjectsLQ->target;
+        int scaleObjTex = Iso.globaldef.hd_objects ? Iso.globaldef.hd_objects_size : 1;
+
+        MErect r = {x * scaleObjTex, y * scaleObjTex, (f32)cur->get_surface()->w * scaleObjTex, (f32)cur->get_surface()->h * scaleObjTex};
+
+        // 能放进图集的刚体合批绘制 贴图改变时只更新图集中的一块
+        SpriteAtlas &atlas = TexturePack_.objectAtlas;
+        if (SpriteAtlas::fits(cur->get_surface()->w, cur->get_surface()->h)) {
+            bool uploaded = atlas.valid(cur->atlasHandle);
+            if (!uploaded) {
+                cur->atlasHandle = atlas.alloc(cur->get_surface()->w, cur->get_surface()->h);
+                atlas.upload(cur->atlasHandle, cur->get_surface());
+                cur->takeTexDirty();
+            } else if (cur->texNeedsUpdate) {
+                MErect dirty = cur->takeTexDirty();
+                atlas.upload(cur->atlasHandle, cur->get_surface(), &dirty);
+            }
+        }
+
+        if (atlas.valid(cur->atlasHandle)) {
+            TexturePack_.objectBatch.add(tgt, atlas.touch(cur->atlasHandle), r, angle);
+        } else {
+            if (!cur->image()) {
+                cur->updateImage({});
+                cur->takeTexDirty();
+            } else if (cur->texNeedsUpdate) {
+                // 更新rigidbody的image 只写入改动的范围
+                cur->updateImageRect(cur->takeTexDirty());
+            }
+
+            R_BlitRectX(cur->image(), NULL, tgt, &r, angle * 180 / (f32)M_PI, 0, 0, R_FLIP_NONE);
+        }
+
+        // draw outline
+
+        u8 outlineAlpha = (u8)(cur->hover * 255);
+        if (outlineAlpha > 0) {
+            // 轮廓要画在刚体上面 同一目标上已经合批的先画出来
+            TexturePack_.objectBatch.flush(tgtLQ);
+
+            MEcolor col = {0xff, 0xff, 0x80, outlineAlpha};
+            R_SetShapeBlendMode(R_BLEND_NORMAL_FACTOR_ALPHA);
+            for (auto &l : cur->outline) {
+                MEvec2 *vec = new MEvec2[l.GetNumPoints()];
+                for (int j = 0; j < l.GetNumPoints(); j++) {
+                    vec[j] = {(f32)l.GetPoint(j).x / the<engine>().eng()->render_scale, (f32)l.GetPoint(j).y / the<engine>().eng()->render_scale};
+                }
+                ME_draw_polygon(tgtLQ, col, vec, (int)x, (int)y, the<engine>().eng()->render_scale, l.GetNumPoints(), angle, 0, 0);
+                delete[] vec;
+            }
+            R_SetShapeBlendMode(R_BLEND_NORMAL);
+        }
+    }
+
+    TexturePack_.objectBatch.flush();
+    TexturePack_.objectAtlas.collect();
+}
+
 void game::renderEarly() {
 
-    the<gui>().render_postupdate();
+    the<gui>().render_postupdate(!lua_bind::windows.empty());
 
     if (state == LOADING) {
         //  render loading screen
@@ -2766,6 +2916,7 @@ void game::renderEarly() {
 
                 move_player_event e{1.0f, thruTick, this};
                 Iso.world->Reg().process_event(e);
+                TexturePack_.entityQueue.flush();
 
                 if (Iso.world->player) {
                     auto [pl_we, pl] = Iso.world->getHostPlayer();
@@ -2822,181 +2973,363 @@ void game::renderEarly() {
 
 void game::renderLate() {
 
-    the<engine>().eng()->target = TexturePack_.backgroundImage->target;
-    R_Clear(the<engine>().eng()->target);
-
-    if (state == LOADING) {
-
-    } else {
-        // 绘制背景贴图
-        Iso.backgrounds->draw();
-
-        MErect r1 = MErect{(f32)(GAME()->ofsX + GAME()->camX), (f32)(GAME()->ofsY + GAME()->camY), (f32)(Iso.world->width * the<engine>().eng()->render_scale),
-                           (f32)(Iso.world->height * the<engine>().eng()->render_scale)};
-        R_SetBlendMode(TexturePack_.textureBackground, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureBackground, NULL, the<engine>().eng()->target, &r1);
-
-        R_SetBlendMode(TexturePack_.textureLayer2, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureLayer2, NULL, the<engine>().eng()->target, &r1);
-
-        R_SetBlendMode(TexturePack_.textureObjectsBack, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureObjectsBack, NULL, the<engine>().eng()->target, &r1);
-
-        // shader
-
-        if (Iso.globaldef.draw_shaders) {
-
-            if (Iso.shaderworker->waterFlowPassShader->dirty && Iso.globaldef.water_showFlow) {
-                Iso.shaderworker->waterFlowPassShader->activate();
-                Iso.shaderworker->waterFlowPassShader->Update(Iso.world->width, Iso.world->height);
-                R_SetBlendMode(TexturePack_.textureFlow, R_BLEND_SET);
-                R_BlitRect(TexturePack_.textureFlow, NULL, TexturePack_.textureFlowSpead->target, NULL);
-
-                Iso.shaderworker->waterFlowPassShader->dirty = false;
-            }
-
-            Iso.shaderworker->waterShader->activate();
-            f32 t = (the<engine>().eng()->time.now - the<engine>().eng()->time.startTime) / 1000.0;
-            Iso.shaderworker->waterShader->Update(t, the<engine>().eng()->target->w * the<engine>().eng()->render_scale, the<engine>().eng()->target->h * the<engine>().eng()->render_scale,
-                                                  TexturePack_.texture, r1.x, r1.y, r1.w, r1.h, the<engine>().eng()->render_scale, TexturePack_.textureFlowSpead, Iso.globaldef.water_overlay,
-                                                  Iso.globaldef.water_showFlow, Iso.globaldef.water_pixelated);
-        }
-
-        the<engine>().eng()->target = the<engine>().eng()->realTarget;
-
-        R_BlitRect(TexturePack_.backgroundImage, NULL, the<engine>().eng()->target, NULL);
-
-        R_SetBlendMode(TexturePack_.texture, R_BLEND_NORMAL);
-        R_ActivateShaderProgram(0, NULL);
-
-        // done shader
-
-        int lmsx = (int)((mx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
-        int lmsy = (int)((my - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
-
-        R_Clear(TexturePack_.worldTexture->target);
-
-        R_BlitRect(TexturePack_.texture, NULL, TexturePack_.worldTexture->target, NULL);
+    if (state == LOADING) return;
 
-        R_SetBlendMode(TexturePack_.textureObjects, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureObjects, NULL, TexturePack_.worldTexture->target, NULL);
-        R_SetBlendMode(TexturePack_.textureObjectsLQ, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureObjectsLQ, NULL, TexturePack_.worldTexture->target, NULL);
+    MErect r1 = MErect{(f32)(GAME()->ofsX + GAME()->camX), (f32)(GAME()->ofsY + GAME()->camY), (f32)(Iso.world->width * the<engine>().eng()->render_scale),
+                       (f32)(Iso.world->height * the<engine>().eng()->render_scale)};
 
-        R_SetBlendMode(TexturePack_.textureCells, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureCells, NULL, TexturePack_.worldTexture->target, NULL);
+    // 屏幕上可见的世界范围 (世界像素) 已加载的世界比屏幕大 世界大小的中间纹理只需要处理这一部分
+    // 外扩 VIEW_MARGIN 给光照采样和缓存的光照平移用
+    constexpr int VIEW_MARGIN = 32;
+    const f32 scale = (f32)the<engine>().eng()->render_scale;
+    const int vx0 = std::clamp((int)std::floor(-r1.x / scale), 0, (int)Iso.world->width);
+    const int vy0 = std::clamp((int)std::floor(-r1.y / scale), 0, (int)Iso.world->height);
+    const int vx1 = std::clamp((int)std::ceil((the<engine>().eng()->windowWidth - r1.x) / scale), vx0, (int)Iso.world->width);
+    const int vy1 = std::clamp((int)std::ceil((the<engine>().eng()->windowHeight - r1.y) / scale), vy0, (int)Iso.world->height);
+    const MErect visible = {(f32)vx0, (f32)vy0, (f32)(vx1 - vx0), (f32)(vy1 - vy0)};
+
+    const int mx0 = std::max(vx0 - VIEW_MARGIN, 0);
+    const int my0 = std::max(vy0 - VIEW_MARGIN, 0);
+    const int mx1 = std::min(vx1 + VIEW_MARGIN, (int)Iso.world->width);
+    const int my1 = std::min(vy1 + VIEW_MARGIN, (int)Iso.world->height);
+    const MErect view = {(f32)mx0, (f32)my0, (f32)(mx1 - mx0), (f32)(my1 - my0)};
+
+    // 把 image 的目标裁剪到 view 目标按世界大小的倍数缩放
+    auto clipToView = [&](R_Image *image) {
+        const f32 sx = image->w / (f32)Iso.world->width;
+        const f32 sy = image->h / (f32)Iso.world->height;
+        R_SetClip(image->target, (i16)(view.x * sx), (i16)(view.y * sy), (u16)std::ceil(view.w * sx), (u16)std::ceil(view.h * sy));
+    };
+
+    using Builder = RenderGraph::Builder;
+    RenderGraph &graph = renderGraph;
+    graph.begin(the<engine>().eng()->realTarget);
+
+    const RenderGraph::Resource screen = graph.screen();
+    const RenderGraph::Resource background = graph.transient("backgroundImage", the<engine>().eng()->windowWidth, the<engine>().eng()->windowHeight, R_FormatEnum::R_FORMAT_RGBA);
+    const RenderGraph::Resource flow = graph.import("textureFlowSpead", TexturePack_.textureFlowSpead);
+    const RenderGraph::Resource worldTex = graph.import("worldTexture", TexturePack_.worldTexture);
+    const RenderGraph::Resource lighting = graph.import("lightingTexture", TexturePack_.lightingTexture);
+    const RenderGraph::Resource fire = graph.transient("texture2Fire", Iso.world->width, Iso.world->height, R_FormatEnum::R_FORMAT_RGBA);
+    const RenderGraph::Resource temperature = graph.import("temperatureMap", TexturePack_.temperatureMap);
+
+    graph.add_pass(
+            "Background", [&](Builder &b) { b.write(background); },
+            [&]() {
+                // 绘制背景贴图
+                Iso.backgrounds->draw();
+
+                // 按区块从背景图集绘制
+                TexturePack_.backgroundAtlas.draw(the<engine>().eng()->target, r1, (int)Iso.world->loadZone.x, (int)Iso.world->loadZone.y, Iso.world->width, Iso.world->height);
+
+                R_SetBlendMode(TexturePack_.textureLayer2, R_BLEND_NORMAL);
+                R_BlitRect(TexturePack_.textureLayer2, NULL, the<engine>().eng()->target, &r1);
+
+                R_SetBlendMode(TexturePack_.textureObjectsBack, R_BLEND_NORMAL);
+                R_BlitRect(TexturePack_.textureObjectsBack, NULL, the<engine>().eng()->target, &r1);
+            });
+
+    // 可见范围内没有液体时两个水面着色器都不需要 流动纹理没有读者 这一帧就不更新 留着 dirty 等下次
+    const world::FluidSummary &fluid = Iso.world->fluidSummary;
+    const bool water = Iso.globaldef.draw_shaders && fluid.count > 0;
+
+    if (Iso.globaldef.draw_shaders && Iso.shaderworker->waterFlowPassShader->dirty && Iso.globaldef.water_showFlow) {
+        graph.add_pass(
+                "WaterFlowPassShader", [&](Builder &b) { b.write(flow); },
+                [&]() {
+                    // 水面着色器只在液体像素上读取流动纹理 只更新液体的包围盒 (外扩几个像素给扩散用)
+                    // 同时限制在可见范围内
+                    constexpr int margin = 4;
+                    const int fx = std::max(fluid.x0 - margin, mx0);
+                    const int fy = std::max(fluid.y0 - margin, my0);
+                    const int fw = std::max(std::min(fluid.x1 + margin + 1, mx1) - fx, 0);
+                    const int fh = std::max(std::min(fluid.y1 + margin + 1, my1) - fy, 0);
+
+                    Iso.shaderworker->waterFlowPassShader->activate();
+                    Iso.shaderworker->waterFlowPassShader->Update(Iso.world->width, Iso.world->height);
+                    R_SetBlendMode(TexturePack_.textureFlow, R_BLEND_SET);
+                    R_SetClip(TexturePack_.textureFlowSpead->target, (i16)fx, (i16)fy, (u16)fw, (u16)fh);
+                    R_BlitRect(TexturePack_.textureFlow, NULL, TexturePack_.textureFlowSpead->target, NULL);
+                    R_UnsetClip(TexturePack_.textureFlowSpead->target);
+                    R_ActivateShaderProgram(0, NULL);
+
+                    Iso.shaderworker->waterFlowPassShader->dirty = false;
+                });
+    }
 
-        R_SetBlendMode(TexturePack_.textureEntitiesLQ, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureEntitiesLQ, NULL, TexturePack_.worldTexture->target, NULL);
-        R_SetBlendMode(TexturePack_.textureEntities, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.textureEntities, NULL, TexturePack_.worldTexture->target, NULL);
+    graph.add_pass(
+            water ? "WaterShader" : "BackgroundBlit",
+            [&](Builder &b) {
+                b.read(background);
+                if (water) b.read(flow);
+                b.write(screen);
+            },
+            [&]() {
+                R_Image *image = graph.image(background);
+                if (water) {
+                    // 水面着色器在绘制 backgroundImage 时生效
+                    Iso.shaderworker->waterShader->activate();
+                    f32 t = (the<engine>().eng()->time.now - the<engine>().eng()->time.startTime) / 1000.0;
+                    Iso.shaderworker->waterShader->Update(t, image->w * the<engine>().eng()->render_scale, image->h * the<engine>().eng()->render_scale, TexturePack_.texture, r1.x, r1.y, r1.w,
+                                                          r1.h, the<engine>().eng()->render_scale, TexturePack_.textureFlowSpead, Iso.globaldef.water_overlay, Iso.globaldef.water_showFlow,
+                                                          Iso.globaldef.water_pixelated);
+                }
 
-        if (Iso.globaldef.draw_shaders) {
-            Iso.shaderworker->newLightingShader->activate();
-            // GameIsolate_.shaderworker->crtShader->Activate();
+                R_BlitRect(image, NULL, the<engine>().eng()->target, NULL);
 
-            // Iso.shaderworker->raylightingShader->activate();
-        }
+                R_SetBlendMode(TexturePack_.texture, R_BLEND_NORMAL);
+                R_ActivateShaderProgram(0, NULL);
+            });
 
-        // GameIsolate_.shaderworker->crtShader->Update(GameIsolate_.world->width, GameIsolate_.world->height);
+    WorldCompositeShader *composite = Iso.shaderworker->worldCompositeShader;
+    const bool compositeShader = composite && composite->shader;
+    graph.add_pass(
+            compositeShader ? "WorldCompositeShader" : "WorldComposite", [&](Builder &b) { b.write(worldTex); },
+            [&]() {
+                // worldTexture 只在可见范围内合成 其余部分不会被显示也不会被光照采样
+                clipToView(TexturePack_.worldTexture);
+
+                if (compositeShader) {
+                    // 一次绘制合成所有图层 输出覆盖整个目标 不需要先清空
+                    composite->activate();
+                    composite->Update(TexturePack_.textureObjects, TexturePack_.textureObjectsLQ, TexturePack_.textureCells, TexturePack_.textureEntitiesLQ, TexturePack_.textureEntities);
+                    R_SetBlendMode(TexturePack_.texture, R_BLEND_SET);
+                    R_BlitRect(TexturePack_.texture, NULL, TexturePack_.worldTexture->target, NULL);
+                    R_SetBlendMode(TexturePack_.texture, R_BLEND_NORMAL);
+                    R_ActivateShaderProgram(0, NULL);
+                } else {
+                    R_Clear(TexturePack_.worldTexture->target);
 
-        // I use this to only rerender the lighting when a parameter changes or N times per second anyway
-        // Doing this massively reduces the GPU load of the shader
-        bool needToRerenderLighting = false;
+                    R_BlitRect(TexturePack_.texture, NULL, TexturePack_.worldTexture->target, NULL);
 
-        static long long lastLightingForceRefresh = 0;
-        long long now = ME_gettime();
-        if (now - lastLightingForceRefresh > 100) {
-            lastLightingForceRefresh = now;
-            needToRerenderLighting = true;
-        }
+                    R_SetBlendMode(TexturePack_.textureObjects, R_BLEND_NORMAL);
+                    R_BlitRect(TexturePack_.textureObjects, NULL, TexturePack_.worldTexture->target, NULL);
+                    R_SetBlendMode(TexturePack_.textureObjectsLQ, R_BLEND_NORMAL);
+                    R_BlitRect(TexturePack_.textureObjectsLQ, NULL, TexturePack_.worldTexture->target, NULL);
 
-        if (Iso.globaldef.draw_shaders && Iso.world) {
-            f32 lightTx;
-            f32 lightTy;
+                    R_SetBlendMode(TexturePack_.textureCells, R_BLEND_NORMAL);
+                    R_BlitRect(TexturePack_.textureCells, NULL, TexturePack_.worldTexture->target, NULL);
 
-            if (Iso.world->player) {
-                auto [pl_we, pl] = Iso.world->getHostPlayer();
+                    R_SetBlendMode(TexturePack_.textureEntitiesLQ, R_BLEND_NORMAL);
+                    R_BlitRect(TexturePack_.textureEntitiesLQ, NULL, TexturePack_.worldTexture->target, NULL);
+                    R_SetBlendMode(TexturePack_.textureEntities, R_BLEND_NORMAL);
+                    R_BlitRect(TexturePack_.textureEntities, NULL, TexturePack_.worldTexture->target, NULL);
+                }
 
-                lightTx = (Iso.world->loadZone.x + pl_we->x + pl_we->hw / 2.0f) / (f32)Iso.world->width;
-                lightTy = (Iso.world->loadZone.y + pl_we->y + pl_we->hh / 2.0f) / (f32)Iso.world->height;
-            } else {
-                lightTx = lmsx / (f32)Iso.world->width;
-                lightTy = lmsy / (f32)Iso.world->height;
-            }
+                R_UnsetClip(TexturePack_.worldTexture->target);
+            });
+
+    if (Iso.globaldef.draw_shaders) {
+        // 光照的参数要在这个 pass 里设置 之前的 pass 会占用着色器的纹理单元
+        graph.add_pass(
+                "NewLightingShader",
+                [&](Builder &b) {
+                    b.read(worldTex);
+                    b.write(lighting);
+                },
+                [&]() {
+                    NewLightingShader *lightingShader = Iso.shaderworker->newLightingShader;
+                    lightingShader->activate();
+
+                    // I use this to only rerender the lighting when a parameter changes or N times per second anyway
+                    // Doing this massively reduces the GPU load of the shader
+                    bool needToRerenderLighting = false;
+
+                    static long long lastLightingForceRefresh = 0;
+                    long long now = ME_gettime();
+                    if (now - lastLightingForceRefresh > 100) {
+                        lastLightingForceRefresh = now;
+                        needToRerenderLighting = true;
+                    }
 
-            if (Iso.shaderworker->newLightingShader->lastLx != lightTx || Iso.shaderworker->newLightingShader->lastLy != lightTy) needToRerenderLighting = true;
-            Iso.shaderworker->newLightingShader->Update(TexturePack_.worldTexture, TexturePack_.emissionTexture, lightTx, lightTy);
+                    f32 lightTx;
+                    f32 lightTy;
 
-            // Iso.shaderworker->raylightingShader->Update(TexturePack_.worldTexture, lightTx, lightTy);
+                    if (Iso.world->player) {
+                        auto [pl_we, pl] = Iso.world->getHostPlayer();
 
-            if (Iso.shaderworker->newLightingShader->lastQuality != Iso.globaldef.lightingQuality) {
-                needToRerenderLighting = true;
-            }
-            Iso.shaderworker->newLightingShader->SetQuality(Iso.globaldef.lightingQuality);
-
-            int nBg = 0;
-            int range = 64;
-            for (int xx = std::max(0, (int)(lightTx * Iso.world->width) - range); xx <= std::min((int)(lightTx * Iso.world->width) + range, Iso.world->width - 1); xx++) {
-                for (int yy = std::max(0, (int)(lightTy * Iso.world->height) - range); yy <= std::min((int)(lightTy * Iso.world->height) + range, Iso.world->height - 1); yy++) {
-                    if (Iso.world->background[xx + yy * Iso.world->width] != 0x00) {
-                        nBg++;
+                        lightTx = (Iso.world->loadZone.x + pl_we->x + pl_we->hw / 2.0f) / (f32)Iso.world->width;
+                        lightTy = (Iso.world->loadZone.y + pl_we->y + pl_we->hh / 2.0f) / (f32)Iso.world->height;
+                    } else {
+                        int lmsx = (int)((mx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
+                        int lmsy = (int)((my - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
+                        lightTx = lmsx / (f32)Iso.world->width;
+                        lightTy = lmsy / (f32)Iso.world->height;
                     }
-                }
-            }
-
-            Iso.shaderworker->newLightingShader->insideDes = std::min(std::max(0.0f, (f32)nBg / ((range * 2) * (range * 2))), 1.0f);
-            Iso.shaderworker->newLightingShader->insideCur +=
-                    (Iso.shaderworker->newLightingShader->insideDes - Iso.shaderworker->newLightingShader->insideCur) / 2.0f * (the<engine>().eng()->time.deltaTime / 1000.0f);
 
-            f32 ins = Iso.shaderworker->newLightingShader->insideCur < 0.05 ? 0.0 : Iso.shaderworker->newLightingShader->insideCur;
-            if (Iso.shaderworker->newLightingShader->lastInside != ins) needToRerenderLighting = true;
-            Iso.shaderworker->newLightingShader->SetInside(ins);
-            Iso.shaderworker->newLightingShader->SetBounds(Iso.world->tickZone.x * Iso.globaldef.hd_objects_size, Iso.world->tickZone.y * Iso.globaldef.hd_objects_size,
-                                                           (Iso.world->tickZone.x + Iso.world->tickZone.w) * Iso.globaldef.hd_objects_size,
-                                                           (Iso.world->tickZone.y + Iso.world->tickZone.h) * Iso.globaldef.hd_objects_size);
+                    if (lightingShader->lastLx != lightTx || lightingShader->lastLy != lightTy) needToRerenderLighting = true;
+                    lightingShader->Update(TexturePack_.worldTexture, TexturePack_.emissionTexture, lightTx, lightTy);
 
-            if (Iso.shaderworker->newLightingShader->lastSimpleMode != Iso.globaldef.simpleLighting) needToRerenderLighting = true;
-            Iso.shaderworker->newLightingShader->SetSimpleMode(Iso.globaldef.simpleLighting);
-
-            if (Iso.shaderworker->newLightingShader->lastEmissionEnabled != Iso.globaldef.lightingEmission) needToRerenderLighting = true;
-            Iso.shaderworker->newLightingShader->SetEmissionEnabled(Iso.globaldef.lightingEmission);
+                    const f32 lightingQuality = dynres.lighting_quality(Iso.globaldef.lightingQuality);
+                    if (lightingShader->lastQuality != lightingQuality) {
+                        needToRerenderLighting = true;
+                    }
+                    lightingShader->SetQuality(lightingQuality);
+
+                    int nBg = 0;
+                    int range = 64;
+                    for (int xx = std::max(0, (int)(lightTx * Iso.world->width) - range); xx <= std::min((int)(lightTx * Iso.world->width) + range, Iso.world->width - 1); xx++) {
+                        for (int yy = std::max(0, (int)(lightTy * Iso.world->height) - range); yy <= std::min((int)(lightTy * Iso.world->height) + range, Iso.world->height - 1); yy++) {
+                            if (Iso.world->background[xx + yy * Iso.world->width] != 0x00) {
+                                nBg++;
+                            }
+                        }
+                    }
 
-            if (Iso.shaderworker->newLightingShader->lastDitheringEnabled != Iso.globaldef.lightingDithering) needToRerenderLighting = true;
-            Iso.shaderworker->newLightingShader->SetDitheringEnabled(Iso.globaldef.lightingDithering);
-        }
+                    lightingShader->insideDes = std::min(std::max(0.0f, (f32)nBg / ((range * 2) * (range * 2))), 1.0f);
+                    lightingShader->insideCur += (lightingShader->insideDes - lightingShader->insideCur) / 2.0f * (the<engine>().eng()->time.deltaTime / 1000.0f);
+
+                    f32 ins = lightingShader->insideCur < 0.05 ? 0.0 : lightingShader->insideCur;
+                    if (lightingShader->lastInside != ins) needToRerenderLighting = true;
+                    lightingShader->SetInside(ins);
+                    lightingShader->SetBounds(Iso.world->tickZone.x * Iso.globaldef.hd_objects_size, Iso.world->tickZone.y * Iso.globaldef.hd_objects_size,
+                                              (Iso.world->tickZone.x + Iso.world->tickZone.w) * Iso.globaldef.hd_objects_size,
+                                              (Iso.world->tickZone.y + Iso.world->tickZone.h) * Iso.globaldef.hd_objects_size);
+
+                    if (lightingShader->lastSimpleMode != Iso.globaldef.simpleLighting) needToRerenderLighting = true;
+                    lightingShader->SetSimpleMode(Iso.globaldef.simpleLighting);
+
+                    if (lightingShader->lastEmissionEnabled != Iso.globaldef.lightingEmission) needToRerenderLighting = true;
+                    lightingShader->SetEmissionEnabled(Iso.globaldef.lightingEmission);
+
+                    if (lightingShader->lastDitheringEnabled != Iso.globaldef.lightingDithering) needToRerenderLighting = true;
+                    lightingShader->SetDitheringEnabled(Iso.globaldef.lightingDithering);
+
+                    // 低分辨率光照 按需要 (重新) 创建目标
+                    const int lightingScale = std::clamp(dynres.lighting_scale(Iso.globaldef.lighting_scale), 1, 4);
+                    LightingUpsampleShader *upsample = Iso.shaderworker->lightingUpsampleShader;
+                    R_Image *lightingLow = nullptr;
+                    if (lightingScale > 1 && upsample && upsample->shader) {
+                        const int lw = std::max(1, Iso.world->width / lightingScale);
+                        const int lh = std::max(1, Iso.world->height / lightingScale);
+                        if (TexturePack_.lightingTextureLow && (TexturePack_.lightingTextureLow->w != lw || TexturePack_.lightingTextureLow->h != lh)) {
+                            R_ReleasePooledImage(TexturePack_.lightingTextureLow);
+                            TexturePack_.lightingTextureLow = nullptr;
+                        }
+                        if (!TexturePack_.lightingTextureLow) {
+                            TexturePack_.lightingTextureLow = R_AcquirePooledImage(lw, lh, R_FormatEnum::R_FORMAT_RGBA, true);
+                            R_SetImageFilter(TexturePack_.lightingTextureLow, R_FILTER_NEAREST);
+                            needToRerenderLighting = true;
+                        }
+                        lightingLow = TexturePack_.lightingTextureLow;
+                    }
 
-        if (Iso.globaldef.draw_shaders && needToRerenderLighting) {
-            R_Clear(TexturePack_.lightingTexture->target);
-            R_BlitRect(TexturePack_.worldTexture, NULL, TexturePack_.lightingTexture->target, NULL);
-        }
-        if (Iso.globaldef.draw_shaders) R_ActivateShaderProgram(0, NULL);
+                    // 缓存的光照平移之后如果不再覆盖可见范围 需要重新计算
+                    const MErect &lv = lightingShader->lastView;
+                    const f32 lvx = lv.x + (Iso.world->loadZone.x - lightingShader->lastZoneX);
+                    const f32 lvy = lv.y + (Iso.world->loadZone.y - lightingShader->lastZoneY);
+                    if (visible.x < lvx || visible.y < lvy || visible.x + visible.w > lvx + lv.w || visible.y + visible.h > lvy + lv.h) needToRerenderLighting = true;
+
+                    if (needToRerenderLighting) {
+                        // 光照着色器的采样与输出分辨率无关 直接画到低分辨率目标上
+                        R_Image *lightingOut = lightingLow ? lightingLow : TexturePack_.lightingTexture;
+                        R_Clear(lightingOut->target);
+                        clipToView(lightingOut);
+                        R_BlitRect(TexturePack_.worldTexture, NULL, lightingOut->target, NULL);
+                        R_UnsetClip(lightingOut->target);
+
+                        if (lightingLow) {
+                            ME_profiler_gpu_scope_auto("LightingUpsampleShader");
+                            upsample->activate();
+                            upsample->Update(TexturePack_.worldTexture);
+                            R_SetBlendMode(lightingLow, R_BLEND_SET);
+                            clipToView(TexturePack_.lightingTexture);
+                            R_BlitRect(lightingLow, NULL, TexturePack_.lightingTexture->target, NULL);
+                            R_UnsetClip(TexturePack_.lightingTexture->target);
+                        }
 
-        R_BlitRect(TexturePack_.worldTexture, NULL, the<engine>().eng()->target, &r1);
+                        lightingShader->lastZoneX = Iso.world->loadZone.x;
+                        lightingShader->lastZoneY = Iso.world->loadZone.y;
+                        lightingShader->lastView = view;
+                    }
+                    R_ActivateShaderProgram(0, NULL);
+                });
+    }
 
-        if (Iso.globaldef.draw_shaders) {
-            R_SetBlendMode(TexturePack_.lightingTexture, Iso.globaldef.draw_light_overlay ? R_BLEND_NORMAL : R_BLEND_MULTIPLY);
-            R_BlitRect(TexturePack_.lightingTexture, NULL, the<engine>().eng()->target, &r1);
-        }
+    graph.add_pass(
+            "WorldBlit",
+            [&](Builder &b) {
+                b.read(worldTex);
+                b.write(screen);
+            },
+            [&]() { R_BlitRect(TexturePack_.worldTexture, NULL, the<engine>().eng()->target, &r1); });
+
+    if (Iso.globaldef.draw_shaders) {
+        graph.add_pass(
+                "LightingBlit",
+                [&](Builder &b) {
+                    b.read(lighting);
+                    b.write(screen);
+                },
+                [&]() {
+                    // 两次重新计算之间世界可能已经平移 按 loadZone 的差值移动缓存的光照
+                    MErect lr = r1;
+                    lr.x += (Iso.world->loadZone.x - Iso.shaderworker->newLightingShader->lastZoneX) * r1.w / Iso.world->width;
+                    lr.y += (Iso.world->loadZone.y - Iso.shaderworker->newLightingShader->lastZoneY) * r1.h / Iso.world->height;
+
+                    R_SetBlendMode(TexturePack_.lightingTexture, Iso.globaldef.draw_light_overlay ? R_BLEND_NORMAL : R_BLEND_MULTIPLY);
+                    R_BlitRect(TexturePack_.lightingTexture, NULL, the<engine>().eng()->target, &lr);
+                });
+    }
 
-        if (Iso.globaldef.draw_shaders) {
-            R_Clear(TexturePack_.texture2Fire->target);
+    // 火焰着色器只处理火焰周围 fire.frag 读取相邻的一个像素 fire2.frag 再读取周围三个像素 更远处两者的输出都是透明的
+    // 每格一个矩形 互不重叠 同一张图像的多个矩形合并成一次绘制
+    frame_arena::scope scratch;
+    frame_vector<MErect> fireRects, fire2Rects;
+    if (Iso.globaldef.draw_shaders && !TexturePack_.fireRegions.empty()) {
+        TexturePack_.fireRegions.rects(1, view, fireRects);
+        TexturePack_.fireRegions.rects(4, view, fire2Rects);
+    }
 
-            Iso.shaderworker->fireShader->activate();
-            Iso.shaderworker->fireShader->Update(TexturePack_.textureFire);
-            R_BlitRect(TexturePack_.textureFire, NULL, TexturePack_.texture2Fire->target, NULL);
-            R_ActivateShaderProgram(0, NULL);
+    if (!fire2Rects.empty()) {
+        graph.add_pass(
+                "FireShader", [&](Builder &b) { b.write(fire); },
+                [&]() {
+                    R_Image *image = graph.image(fire);
+                    Iso.shaderworker->fireShader->activate();
+                    Iso.shaderworker->fireShader->Update(TexturePack_.textureFire);
+                    for (MErect &r : fireRects) R_BlitRect(TexturePack_.textureFire, &r, image->target, &r);
+                    R_ActivateShaderProgram(0, NULL);
+                });
+
+        graph.add_pass(
+                "Fire2Shader",
+                [&](Builder &b) {
+                    b.read(fire);
+                    b.write(screen);
+                },
+                [&]() {
+                    const f32 sx = r1.w / Iso.world->width, sy = r1.h / Iso.world->height;
+                    Iso.shaderworker->fire2Shader->activate();
+                    Iso.shaderworker->fire2Shader->Update(graph.image(fire));
+                    for (MErect &r : fire2Rects) {
+                        MErect dst = {r1.x + r.x * sx, r1.y + r.y * sy, r.w * sx, r.h * sy};
+                        R_BlitRect(graph.image(fire), &r, the<engine>().eng()->target, &dst);
+                    }
+                    R_ActivateShaderProgram(0, NULL);
+                });
+    }
 
-            Iso.shaderworker->fire2Shader->activate();
-            Iso.shaderworker->fire2Shader->Update(TexturePack_.texture2Fire);
-            R_BlitRect(TexturePack_.texture2Fire, NULL, the<engine>().eng()->target, &r1);
-            R_ActivateShaderProgram(0, NULL);
-        }
+    TemperatureMapShader *temperatureShader = Iso.shaderworker->temperatureMapShader;
+    if (Iso.globaldef.draw_temperature_map && temperatureShader && temperatureShader->shader) {
+        graph.add_pass(
+                "TemperatureMapShader",
+                [&](Builder &b) {
+                    b.read(temperature);
+                    b.write(screen);
+                },
+                [&]() {
+                    R_SetBlendMode(TexturePack_.temperatureMap, R_BLEND_NORMAL);
+                    temperatureShader->activate();
+                    temperatureShader->Update(Iso.world->width, Iso.world->height, Iso.world->real_tiles.origin());
+                    R_BlitRect(TexturePack_.temperatureMap, NULL, the<engine>().eng()->target, &r1);
+                    R_ActivateShaderProgram(0, NULL);
+                });
+    }
 
-        // done light
+    graph.add_pass("RenderOverlays", [&](Builder &b) { b.write(screen); }, [&]() { renderOverlays(); });
 
-        renderOverlays();
-    }
+    graph.execute();
 }
 
 void game::renderOverlays() {
@@ -3005,25 +3338,20 @@ void game::renderOverlays() {
     // snprintf(fpsText, sizeof(fpsText), "%.1f ms/frame (%.1f(%d) FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate, the<engine>().eng()->time.feelsLikeFps);
     // ME_draw_text(fpsText, {255, 255, 255, 255}, the<engine>().eng()->windowWidth - ImGui::CalcTextSize(fpsText).x, 0);
 
-    MErect r1 = MErect{(f32)(GAME()->ofsX + GAME()->camX), (f32)(GAME()->ofsY + GAME()->camY), (f32)(Iso.world->width * the<engine>().eng()->render_scale),
-                       (f32)(Iso.world->height * the<engine>().eng()->render_scale)};
     MErect r2 = MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale),
                        (f32)(GAME()->ofsY + GAME()->camY + Iso.world->tickZone.y * the<engine>().eng()->render_scale), (f32)(Iso.world->tickZone.w * the<engine>().eng()->render_scale),
                        (f32)(Iso.world->tickZone.h * the<engine>().eng()->render_scale)};
 
-    if (Iso.globaldef.draw_temperature_map) {
-        R_SetBlendMode(TexturePack_.temperatureMap, R_BLEND_NORMAL);
-        R_BlitRect(TexturePack_.temperatureMap, NULL, the<engine>().eng()->target, &r1);
-    }
-
     if (Iso.globaldef.draw_load_zones) {
         MErect r2m = MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->meshZone.x * the<engine>().eng()->render_scale),
                             (f32)(GAME()->ofsY + GAME()->camY + Iso.world->meshZone.y * the<engine>().eng()->render_scale), (f32)(Iso.world->meshZone.w * the<engine>().eng()->render_scale),
                             (f32)(Iso.world->meshZone.h * the<engine>().eng()->render_scale)};
 
-        R_Rectangle2(the<engine>().eng()->target, r2m, {0x00, 0xff, 0xff, 0xff});
+        overlayDraw.rectangle(the<engine>().eng()->target, r2m, {0x00, 0xff, 0xff, 0xff});
+        overlayDraw.rectangle(the<engine>().eng()->target, r2, {0xff, 0x00, 0x00, 0xff});
+        // 文字是贴图 先把边框画掉 保证文字在边框上面
+        overlayDraw.flush();
         ME_draw_text_plate(the<engine>().eng()->target, CC("刚体物理更新区域"), {255, 255, 255, 255}, r2m.x + 4, r2m.y + 4);
-        R_Rectangle2(the<engine>().eng()->target, r2, {0xff, 0x00, 0x00, 0xff});
     }
 
     if (Iso.globaldef.draw_load_zones) {
@@ -3032,31 +3360,31 @@ void game::renderOverlays() {
         R_SetShapeBlendMode(R_BLEND_NORMAL);
 
         MErect r3 = MErect{(f32)(0), (f32)(0), (f32)((GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale)), (f32)(the<engine>().eng()->windowHeight)};
-        R_Rectangle2(the<engine>().eng()->target, r3, col);
+        overlayDraw.rectangle(the<engine>().eng()->target, r3, col);
 
         MErect r4 = MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale + Iso.world->tickZone.w * the<engine>().eng()->render_scale), (f32)(0),
                            (f32)((the<engine>().eng()->windowWidth) -
                                  (GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale + Iso.world->tickZone.w * the<engine>().eng()->render_scale)),
                            (f32)(the<engine>().eng()->windowHeight)};
-        R_Rectangle2(the<engine>().eng()->target, r4, col);
+        overlayDraw.rectangle(the<engine>().eng()->target, r4, col);
 
         MErect r5 = MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale), (f32)(0), (f32)(Iso.world->tickZone.w * the<engine>().eng()->render_scale),
                            (f32)(GAME()->ofsY + GAME()->camY + Iso.world->tickZone.y * the<engine>().eng()->render_scale)};
-        R_Rectangle2(the<engine>().eng()->target, r5, col);
+        overlayDraw.rectangle(the<engine>().eng()->target, r5, col);
 
         MErect r6 = MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->tickZone.x * the<engine>().eng()->render_scale),
                            (f32)(GAME()->ofsY + GAME()->camY + Iso.world->tickZone.y * the<engine>().eng()->render_scale + Iso.world->tickZone.h * the<engine>().eng()->render_scale),
                            (f32)(Iso.world->tickZone.w * the<engine>().eng()->render_scale),
                            (f32)(the<engine>().eng()->windowHeight -
                                  (GAME()->ofsY + GAME()->camY + Iso.world->tickZone.y * the<engine>().eng()->render_scale + Iso.world->tickZone.h * the<engine>().eng()->render_scale))};
-        R_Rectangle2(the<engine>().eng()->target, r6, col);
+        overlayDraw.rectangle(the<engine>().eng()->target, r6, col);
 
         col = {0x00, 0xff, 0x00, 0xff};
         MErect r7 =
                 MErect{(f32)(GAME()->ofsX + GAME()->camX + Iso.world->width / 2 * the<engine>().eng()->render_scale - (the<engine>().eng()->windowWidth / 3 * the<engine>().eng()->render_scale / 2)),
                        (f32)(GAME()->ofsY + GAME()->camY + Iso.world->height / 2 * the<engine>().eng()->render_scale - (the<engine>().eng()->windowHeight / 3 * the<engine>().eng()->render_scale / 2)),
                        (f32)(the<engine>().eng()->windowWidth / 3 * the<engine>().eng()->render_scale), (f32)(the<engine>().eng()->windowHeight / 3 * the<engine>().eng()->render_scale)};
-        R_Rectangle2(the<engine>().eng()->target, r7, col);
+        overlayDraw.rectangle(the<engine>().eng()->target, r7, col);
     }
 
     if (Iso.globaldef.draw_physics_debug) {
@@ -3167,13 +3495,14 @@ void game::renderOverlays() {
 
         for (int cx = minChX; cx <= maxChX; cx++) {
             for (int cy = minChY; cy <= maxChY; cy++) {
-                Chunk *ch = Iso.world->getChunk(cx, cy);
+                Chunk *ch = Iso.world->peekChunk(cx, cy);
+                if (!ch) continue;
                 SDL_Color col = {255, 0, 0, 255};
 
                 f32 x = ((ch->x * CHUNK_W + Iso.world->loadZone.x) * the<engine>().eng()->render_scale + GAME()->ofsX + GAME()->camX);
                 f32 y = ((ch->y * CHUNK_H + Iso.world->loadZone.y) * the<engine>().eng()->render_scale + GAME()->ofsY + GAME()->camY);
 
-                R_Rectangle(the<engine>().eng()->target, x, y, x + CHUNK_W * the<engine>().eng()->render_scale, y + CHUNK_H * the<engine>().eng()->render_scale, {50, 50, 0, 255});
+                overlayDraw.rectangle(the<engine>().eng()->target, x, y, x + CHUNK_W * the<engine>().eng()->render_scale, y + CHUNK_H * the<engine>().eng()->render_scale, {50, 50, 0, 255});
 
                 // for(int i = 0; i < ch->polys.size(); i++) {
                 //     Drawing::drawPolygon(target, col, ch->polys[i].m_vertices, (int)x, (int)y, the<engine>().eng()->gameScale, ch->polys[i].m_count, 0/* + fmod((ME_gettime() / 1000.0), 360)*/, 0,
@@ -3184,6 +3513,9 @@ void game::renderOverlays() {
 
         // 绘制物理调试信息
 
+        R_SetShapeBlendMode(R_BLEND_NORMAL);
+        overlayDraw.flush();
+
         Iso.world->b2world->SetDebugDraw(debugDraw);
         debugDraw->scale = the<engine>().eng()->render_scale;
         debugDraw->xOfs = GAME()->ofsX + GAME()->camX;
@@ -3195,6 +3527,7 @@ void game::renderOverlays() {
         if (Iso.globaldef.draw_b2d_pair) debugDraw->AppendFlags(ME_debugdraw::e_pairBit);
         if (Iso.globaldef.draw_b2d_centerMass) debugDraw->AppendFlags(ME_debugdraw::e_centerOfMassBit);
         Iso.world->b2world->DebugDraw();
+        debugDraw->batch.flush();
     }
 
     // Drawing::drawText("fps",
@@ -3216,52 +3549,68 @@ void game::renderOverlays() {
         int pchxf = (int)(((f32)pposX / CHUNK_W) * chSize);
         int pchyf = (int)(((f32)pposY / CHUNK_H) * chSize);
 
-        R_Rectangle(the<engine>().eng()->target, centerX - chSize * CHUNK_UNLOAD_DIST + chSize, centerY - chSize * CHUNK_UNLOAD_DIST + chSize, centerX + chSize * CHUNK_UNLOAD_DIST + chSize,
-                    centerY + chSize * CHUNK_UNLOAD_DIST + chSize, {0xcc, 0xcc, 0xcc, 0xff});
+        overlayDraw.rectangle(the<engine>().eng()->target, centerX - chSize * CHUNK_UNLOAD_DIST + chSize, centerY - chSize * CHUNK_UNLOAD_DIST + chSize, centerX + chSize * CHUNK_UNLOAD_DIST + chSize,
+                              centerY + chSize * CHUNK_UNLOAD_DIST + chSize, {0xcc, 0xcc, 0xcc, 0xff});
 
         MErect r = {0, 0, (f32)chSize, (f32)chSize};
 
-        // TODO: 23/7/31 修复 phmap 相关
-        for (auto &p : Iso.world->chunkCache) {
-            if (p.first == INT_MIN) continue;
-            int cx = p.first;
-            for (auto &p2 : p.second) {
-                if (p2.first == INT_MIN) continue;
-                int cy = p2.first;
-                Chunk *m = p2.second;
-                r.x = centerX + m->x * chSize - pchx;
-                r.y = centerY + m->y * chSize - pchy;
-                MEcolor col;
-                if (m->generationPhase == -1) {
-                    col = {0x60, 0x60, 0x60, 0xff};
-                } else if (m->generationPhase == 0) {
-                    col = {0xff, 0x00, 0x00, 0xff};
-                } else if (m->generationPhase == 1) {
-                    col = {0x00, 0xff, 0x00, 0xff};
-                } else if (m->generationPhase == 2) {
-                    col = {0x00, 0x00, 0xff, 0xff};
-                } else if (m->generationPhase == 3) {
-                    col = {0xff, 0xff, 0x00, 0xff};
-                } else if (m->generationPhase == 4) {
-                    col = {0xff, 0x00, 0xff, 0xff};
-                } else if (m->generationPhase == 5) {
-                    col = {0x00, 0xff, 0xff, 0xff};
-                } else {
-                }
-                R_Rectangle2(the<engine>().eng()->target, r, col);
+        Iso.world->chunkCache.for_each([&](Chunk *m) {
+            r.x = centerX + m->x * chSize - pchx;
+            r.y = centerY + m->y * chSize - pchy;
+            MEcolor col;
+            if (m->generationPhase == -1) {
+                col = {0x60, 0x60, 0x60, 0xff};
+            } else if (m->generationPhase == 0) {
+                col = {0xff, 0x00, 0x00, 0xff};
+            } else if (m->generationPhase == 1) {
+                col = {0x00, 0xff, 0x00, 0xff};
+            } else if (m->generationPhase == 2) {
+                col = {0x00, 0x00, 0xff, 0xff};
+            } else if (m->generationPhase == 3) {
+                col = {0xff, 0xff, 0x00, 0xff};
+            } else if (m->generationPhase == 4) {
+                col = {0xff, 0x00, 0xff, 0xff};
+            } else if (m->generationPhase == 5) {
+                col = {0x00, 0xff, 0xff, 0xff};
+            } else {
             }
-        }
+            overlayDraw.rectangle(the<engine>().eng()->target, r, col);
+        });
 
         int loadx = (int)(((f32)-Iso.world->loadZone.x / CHUNK_W) * chSize);
         int loady = (int)(((f32)-Iso.world->loadZone.y / CHUNK_H) * chSize);
 
         int loadx2 = (int)(((f32)(-Iso.world->loadZone.x + Iso.world->loadZone.w) / CHUNK_W) * chSize);
         int loady2 = (int)(((f32)(-Iso.world->loadZone.y + Iso.world->loadZone.h) / CHUNK_H) * chSize);
-        R_Rectangle(the<engine>().eng()->target, centerX - pchx + loadx, centerY - pchy + loady, centerX - pchx + loadx2, centerY - pchy + loady2, {0x00, 0xff, 0xff, 0xff});
+        overlayDraw.rectangle(the<engine>().eng()->target, centerX - pchx + loadx, centerY - pchy + loady, centerX - pchx + loadx2, centerY - pchy + loady2, {0x00, 0xff, 0xff, 0xff});
+
+        overlayDraw.rectangle(the<engine>().eng()->target, centerX - pchx + pchxf, centerY - pchy + pchyf, centerX + 1 - pchx + pchxf, centerY + 1 - pchy + pchyf, {0x00, 0xff, 0x00, 0xff});
+    }
+
+    if (Iso.globaldef.draw_chunk_cost) {
+        // tickZone 内各区块的模拟耗时 以最慢的区块为满值 由蓝经黄到红
+        world *w = Iso.world.get();
+        f32 maxMs = 0.01f;
+        for (size_t i = 0; i < w->tickActivity.size(); i++) {
+            if (Chunk *ch = w->tickActivityChunk(i)) maxMs = std::max(maxMs, ch->tickCost.ms);
+        }
 
-        R_Rectangle(the<engine>().eng()->target, centerX - pchx + pchxf, centerY - pchy + pchyf, centerX + 1 - pchx + pchxf, centerY + 1 - pchy + pchyf, {0x00, 0xff, 0x00, 0xff});
+        const f32 scale = the<engine>().eng()->render_scale;
+        for (size_t i = 0; i < w->tickActivity.size(); i++) {
+            Chunk *ch = w->tickActivityChunk(i);
+            if (!ch || ch->tickCost.ms <= 0.001f) continue;
+
+            const f32 t = std::min(ch->tickCost.ms / maxMs, 1.0f);
+            const MEcolor col = t < 0.5f ? MEcolor{(u8)(t * 2 * 255), (u8)(t * 2 * 255), (u8)((1 - t * 2) * 255), 0x60} : MEcolor{0xff, (u8)((1 - t) * 2 * 255), 0x00, 0x60};
+            const f32 x = (ch->x * CHUNK_W + w->loadZone.x) * scale + GAME()->ofsX + GAME()->camX;
+            const f32 y = (ch->y * CHUNK_H + w->loadZone.y) * scale + GAME()->ofsY + GAME()->camY;
+            overlayDraw.rectangle_filled(the<engine>().eng()->target, x, y, x + CHUNK_W * scale, y + CHUNK_H * scale, col);
+        }
     }
 
+    R_SetShapeBlendMode(R_BLEND_NORMAL);
+    overlayDraw.flush();
+
     if (Iso.globaldef.draw_debug_stats) {
 
         int rbCt = 0;
@@ -3298,7 +3647,8 @@ void game::renderOverlays() {
 
         for (int cx = minChX; cx <= maxChX; cx++) {
             for (int cy = minChY; cy <= maxChY; cy++) {
-                Chunk *ch = Iso.world->getChunk(cx, cy);
+                Chunk *ch = Iso.world->peekChunk(cx, cy);
+                if (!ch) continue;
                 for (int i = 0; i < ch->polys.size(); i++) {
                     rbTriWCt++;
                 }
@@ -3308,16 +3658,10 @@ void game::renderOverlays() {
         int chCt = 0;
         size_t chCt_size = 0;
 
-        // TODO: 23/7/31 修复 phmap 相关
-        for (auto &p : Iso.world->chunkCache) {
-            if (p.first == INT_MIN) continue;
-            int cx = p.first;
-            for (auto &p2 : p.second) {
-                if (p2.first == INT_MIN) continue;
-                chCt++;
-                chCt_size += p2.second->get_chunk_size();
-            }
-        }
+        Iso.world->chunkCache.for_each([&](Chunk *ch) {
+            chCt++;
+            chCt_size += ch->get_chunk_size();
+        });
 
         constexpr const char *buffAsStdStr1 = R"(
 {0} {1}
@@ -3345,7 +3689,21 @@ ReadyToMerge ({17})
 
         auto a = std::format(buffAsStdStr1, win_title_client, METADOT_VERSION_TEXT, GAME()->plPosX, GAME()->plPosY, pl_vx, pl_vy, (int)Iso.world->cells.size(), (int)Iso.world->Reg().entity_count(),
                              rbCt, (int)Iso.world->rigidBodies.size(), (int)Iso.world->worldRigidBodies.size(), rbTriACt, rbTriCt, rbTriWCt, chCt, ((f64)chCt_size / 1048576.0f),
-                             (int)Iso.world->toLoadAsyncList.size(), (int)Iso.world->readyToMerge.size());
+                             (int)Iso.world->chunkLoader.size(), (int)Iso.world->readyToMerge.size());
+
+        // 各 Populator 的调用次数 平均和最长耗时 找出生成卡顿的来源
+        a += "Populators (calls / avg ms / max ms)\n";
+        for (size_t i = 0; i < Iso.world->populators.size(); i++) {
+            const auto &st = Iso.world->populatorStats[i];
+            const u64 calls = st.calls.load(std::memory_order_relaxed);
+            a += std::format("  {0} p{1}: {2} / {3:.3f} / {4:.3f}\n", Iso.world->populators[i]->getName(), Iso.world->populators[i]->getPhase(), calls,
+                             calls ? st.totalUs.load(std::memory_order_relaxed) / 1000.0 / calls : 0.0, st.maxUs.load(std::memory_order_relaxed) / 1000.0);
+        }
+
+        // Lua 分配器的计数 目前只有 Lua 使用 ME_mem_pool
+        const ME_mem_pool_stats pool = ME_mem_pool_get_stats();
+        a += std::format("Lua allocs: {0} live ({1} large) {2:.2f} / {3:.2f} mb\n", pool.allocs - pool.frees, pool.large_allocs, pool.bytes_in_use / 1048576.0,
+                         pool.pool_reserved / 1048576.0);
 
         ME_draw_text(a, {255, 255, 255, 255}, 10, 0, true);
 
@@ -3457,21 +3815,46 @@ Drawing::drawText(target, buffVersion, font16, 4, HEIGHT - 32 + 13, 0xff, 0xff,
 */
 }
 
-void game::renderTemperatureMap(world *world) {
+void game::renderTemperatureMap(world *world, const std::vector<DirtyRect> &rects) {
+    ME_profiler_scope_auto("TemperatureMap");
 
-    for (int x = 0; x < Iso.world->width; x++) {
-        for (int y = 0; y < Iso.world->height; y++) {
-            auto t = Iso.world->real_tiles[x + y * Iso.world->width];
-            mat_temperature temp = t.temperature;
-            u32 color = (u8)((temp + 1024) / 2048.0f * 255);
+    const int w = world->width, h = world->height;
+    const u8 *plane = (const u8 *)world->real_tiles.temperature_data();
 
-            const unsigned int offset = (Iso.world->width * 4 * y) + x * 4;
-            TexturePack_.pixelsTemp_ar[offset + 0] = color;  // b
-            TexturePack_.pixelsTemp_ar[offset + 1] = color;  // g
-            TexturePack_.pixelsTemp_ar[offset + 2] = color;  // r
-            TexturePack_.pixelsTemp_ar[offset + 3] = 0xf0;   // a
-        }
+    if (TexturePack_.temperatureMapStale) {
+        TexturePack_.temperatureMapStale = false;
+        R_UpdateImageBytes(TexturePack_.temperatureMap, NULL, plane, w * 2);
+        ME_profiler_count("texture bytes uploaded", (i64)w * h * 2);
+        return;
     }
+    if (rects.empty()) return;
+
+    // 纹理按存储位置排列 逻辑坐标 (x, y) 在 (x + ox, y + oy) 处
+    // 超出行尾的列绕到下一行的开头 超出最后一行的行绕回第一行 一个矩形最多拆成 4 个
+    const size_t origin = world->real_tiles.origin();
+    const int ox = (int)(origin % w), oy = (int)(origin / w);
+
+    frame_arena::scope scratch;
+    frame_vector<MErect> physical;
+    physical.reserve(rects.size() * 4);
+    auto addRows = [&](int x, int y, int rw, int rh) {
+        if (y >= h) y -= h;
+        const int first = std::min(rh, h - y);
+        physical.push_back({(f32)x, (f32)y, (f32)rw, (f32)first});
+        if (first < rh) physical.push_back({(f32)x, 0.0f, (f32)rw, (f32)(rh - first)});
+    };
+
+    i64 bytes = 0;
+    for (const DirtyRect &r : rects) {
+        const int px = r.x + ox;
+        const int split = std::clamp(w - px, 0, r.w);
+        if (split > 0) addRows(px, r.y + oy, split, r.h);
+        if (split < r.w) addRows(px + split - w, r.y + oy + 1, r.w - split, r.h);
+        bytes += (i64)r.w * r.h * 2;
+    }
+
+    R_UpdateImageBytesRects(TexturePack_.temperatureMap, physical.data(), (int)physical.size(), plane, w * 2);
+    ME_profiler_count("texture bytes uploaded", bytes);
 }
 
 void game::ResolutionChanged(int newWidth, int newHeight) {
@@ -3498,11 +3881,11 @@ void game::ResolutionChanged(int newWidth, int newHeight) {
 
     for (int x = 0; x < Iso.world->width; x++) {
         for (int y = 0; y < Iso.world->height; y++) {
-            Iso.world->dirty[x + y * Iso.world->width] = true;
-            Iso.world->layer2Dirty[x + y * Iso.world->width] = true;
-            Iso.world->backgroundDirty[x + y * Iso.world->width] = true;
+            Iso.world->dirty.mark(x + y * Iso.world->width);
+            Iso.world->layer2Dirty.mark(x + y * Iso.world->width);
         }
     }
+    Iso.world->queueBackgroundRect(0, 0, Iso.world->width, Iso.world->height);
 }
 
 int game::getAimSurface(int dist) {
@@ -3522,15 +3905,9 @@ int game::getAimSurface(int dist) {
     int wmx = (int)((mmx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
     int wmy = (int)((mmy - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
 
+    const world::LineRay ray{wcx, wcy, wmx, wmy};
     int startInd = -1;
-    Iso.world->forLine(wcx, wcy, wmx, wmy, [&](int ind) {
-        if (Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SOLID || Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SAND ||
-            Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SOUP) {
-            startInd = ind;
-            return true;
-        }
-        return false;
-    });
+    Iso.world->traceRays({&ray, 1}, world::physicsBit(PhysicsType::SOLID) | world::physicsBit(PhysicsType::SAND) | world::physicsBit(PhysicsType::SOUP), {&startInd, 1});
 
     return startInd;
 }
@@ -3567,17 +3944,16 @@ void game::quitToMainMenu() {
     }
 
     std::fill(TexturePack_.pixels.begin(), TexturePack_.pixels.end(), 0);
-    std::fill(TexturePack_.pixelsBackground.begin(), TexturePack_.pixelsBackground.end(), 0);
     std::fill(TexturePack_.pixelsLayer2.begin(), TexturePack_.pixelsLayer2.end(), 0);
     std::fill(TexturePack_.pixelsFire.begin(), TexturePack_.pixelsFire.end(), 0);
+    TexturePack_.fireRegions.clear();
     std::fill(TexturePack_.pixelsFlow.begin(), TexturePack_.pixelsFlow.end(), 0);
     std::fill(TexturePack_.pixelsEmission.begin(), TexturePack_.pixelsEmission.end(), 0);
     std::fill(TexturePack_.pixelsCells.begin(), TexturePack_.pixelsCells.end(), 0);
+    std::fill(TexturePack_.pixelsPacked.begin(), TexturePack_.pixelsPacked.end(), 0);
 
     R_UpdateImageBytes(TexturePack_.texture, NULL, &TexturePack_.pixels[0], Iso.world->width * 4);
 
-    R_UpdateImageBytes(TexturePack_.textureBackground, NULL, &TexturePack_.pixelsBackground[0], Iso.world->width * 4);
-
     R_UpdateImageBytes(TexturePack_.textureLayer2, NULL, &TexturePack_.pixelsLayer2[0], Iso.world->width * 4);
 
     R_UpdateImageBytes(TexturePack_.textureFire, NULL, &TexturePack_.pixelsFire[0], Iso.world->width * 4);
@@ -3588,6 +3964,8 @@ void game::quitToMainMenu() {
 
     R_UpdateImageBytes(TexturePack_.textureCells, NULL, &TexturePack_.pixelsCells[0], Iso.world->width * 4);
 
+    R_UpdateImageBytes(TexturePack_.texturePacked, NULL, &TexturePack_.pixelsPacked[0], Iso.world->width * 4);
+
     gameUI.visible_mainmenu = true;
 }
 
@@ -3661,23 +4039,35 @@ int game::getAimSolidSurface(int dist) {
     int wmx = (int)((mmx - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale);
     int wmy = (int)((mmy - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale);
 
+    const world::LineRay ray{wcx, wcy, wmx, wmy};
     int startInd = -1;
-    Iso.world->forLine(wcx, wcy, wmx, wmy, [&](int ind) {
-        if (Iso.world->real_tiles[ind].mat->physicsType == PhysicsType::SOLID) {
-            startInd = ind;
-            return true;
-        }
-        return false;
-    });
+    Iso.world->traceRays({&ray, 1}, world::physicsBit(PhysicsType::SOLID), {&startInd, 1});
 
     return startInd;
 }
 
 void game::updateMaterialSounds() {
-    u16 waterCt = std::min(movingTiles[GAME()->materials_list.WATER.id], (u16)5000);
-    f32 water = (f32)waterCt / 3000;
-    // METADOT_BUG("{} / {} = {}", waterCt, 3000, water);
-    global.audio.SetEventParameter("event:/World/WaterFlow", "FlowIntensity", water);
+    // 听者取屏幕中心
+    const f32 lx = (the<engine>().eng()->windowWidth / 2.0f - GAME()->ofsX - GAME()->camX) / the<engine>().eng()->render_scale;
+    const f32 ly = (the<engine>().eng()->windowHeight / 2.0f - GAME()->ofsY - GAME()->camY) / the<engine>().eng()->render_scale;
+
+    // 流水声跟随这一 tick 流动的水最多的几个区块 每个区块的强度沿用原来全局计数的比例
+    const world *w = Iso.world.get();
+    ambientSources.clear();
+    for (size_t i = 0; i < w->tickActivity.size(); i++) {
+        const u32 water = w->tickActivity[i].water;
+        if (water == 0) continue;
+        const f32 x = w->tickZone.x + (f32)(i % w->tickActivityChunksX) * CHUNK_W + CHUNK_W / 2.0f;
+        const f32 y = w->tickZone.y + (f32)(i / w->tickActivityChunksX) * CHUNK_H + CHUNK_H / 2.0f;
+        ambientSources.push_back({x, y, (f32)std::min(water, 5000u) / 3000});
+    }
+    global.audio.SetAmbient(sounds.waterFlow, ambientSources.data(), (u32)ambientSources.size(), lx, ly);
+
+    // 这一 tick 排队的世界音效 (PlayEventAt)
+    global.audio.UpdateVoices(lx, ly);
+
+    // 音频线程运行时只清理 channel
+    global.audio.Update();
 }
 
 }  // namespace ME
\ No newline at end of file
@@ -16,7 +16,11 @@
 #include <unordered_map>
 
 #include "background.hpp"
+#include "background_atlas.hpp"
 #include "cvar.hpp"
+#include "dynamic_resolution.hpp"
+#include "fire_regions.hpp"
+#include "frame_pacer.hpp"
 #include "engine/audio/audio.h"
 #include "engine/core/base_debug.hpp"
 #include "engine/core/const.h"
@@ -25,11 +29,15 @@
 #include "engine/core/macros.hpp"
 #include "engine/event/applicationevent.hpp"
 #include "engine/event/event.hpp"
+#include "engine/event/event_bus.hpp"
 #include "engine/event/inputevent.hpp"
 #include "engine/game_utils/rng.h"
 #include "engine/meta/reflection.hpp"
 #include "engine/physics/box2d/inc/box2d.h"
+#include "engine/renderer/debug_draw.hpp"
+#include "engine/renderer/render_graph.hpp"
 #include "engine/renderer/renderer_gpu.h"
+#include "engine/renderer/sprite_atlas.hpp"
 #include "engine/scripting/scripting.hpp"
 #include "engine/ui/dbgui.hpp"
 #include "engine/ui/font.hpp"
@@ -37,8 +45,14 @@
 #include "game_basic.hpp"
 #include "game_datastruct.hpp"
 #include "game_shaders.hpp"
+#include "memory_budget.hpp"
+#include "perf_console.hpp"
+#include "replay.hpp"
+#include "spike_recorder.hpp"
+#include "stress_scene.hpp"
 #include "textures.hpp"
 #include "world.hpp"
+#include "world_pixels.hpp"
 
 namespace ME {
 
@@ -66,16 +80,13 @@ struct Iso_t {
     GlobalDEF globaldef;
     scope<world> world;
     TexturePack texturepack;
-
-    thread_pool *updateDirtyPool = nullptr;
-    thread_pool *updateDirtyPool2 = nullptr;
 };
 
 struct TexturePack_t {
-    R_Image *backgroundImage = nullptr;
-
     R_Image *worldTexture = nullptr;
     R_Image *lightingTexture = nullptr;
+    // lighting_scale > 1 时光照先算到这里 再放大到 lightingTexture
+    R_Image *lightingTextureLow = nullptr;
 
     R_Image *emissionTexture = nullptr;
     std::vector<u8> pixelsEmission;
@@ -87,9 +98,8 @@ struct TexturePack_t {
     R_Image *textureLayer2 = nullptr;
     std::vector<u8> pixelsLayer2;
     u8 *pixelsLayer2_ar = nullptr;
-    R_Image *textureBackground = nullptr;
-    std::vector<u8> pixelsBackground;
-    u8 *pixelsBackground_ar = nullptr;
+    // 世界背景按区块存放 不再有世界大小的背景纹理
+    BackgroundAtlas backgroundAtlas;
     R_Image *textureObjects = nullptr;
     R_Image *textureObjectsLQ = nullptr;
     std::vector<u8> pixelsObjects;
@@ -102,18 +112,44 @@ struct TexturePack_t {
     R_Image *textureEntitiesLQ = nullptr;
 
     R_Image *textureFire = nullptr;
-    R_Image *texture2Fire = nullptr;
     std::vector<u8> pixelsFire;
     u8 *pixelsFire_ar = nullptr;
+    // 火焰的上传和着色器只处理这些范围
+    FireRegions fireRegions;
 
     R_Image *textureFlowSpead = nullptr;
     R_Image *textureFlow = nullptr;
     std::vector<u8> pixelsFlow;
     u8 *pixelsFlow_ar = nullptr;
 
+    // R_FORMAT_RG 直接上传世界的温度平面 (按存储位置) 颜色由 TemperatureMapShader 生成
     R_Image *temperatureMap = nullptr;
-    std::vector<u8> pixelsTemp;
-    u8 *pixelsTemp_ar = nullptr;
+    // 温度图关闭过或重新创建后 下一次需要整张上传
+    bool temperatureMapStale = true;
+
+    // 世界像素 -> pixels/pixelsEmission/pixelsFire 的查表转换
+    CellPixelConverter cellPixels;
+
+    // gpu_world_pixels 模式: 只上传打包像素 texture/emissionTexture 由 WorldPixelsShader 生成
+    R_Image *texturePacked = nullptr;
+    std::vector<u8> pixelsPacked;
+    u8 *pixelsPacked_ar = nullptr;
+    R_Image *materialProps = nullptr;
+    u32 materialPropsVersion = 0;
+    // 上一次 tick 是否使用了打包模式 切换时需要整体重新转换
+    bool packedActive = false;
+
+    // 刚体贴图的图集和合批
+    SpriteAtlas objectAtlas;
+    SpriteBatch objectBatch;
+    // Player Bot 的绘制 在 move_player_event 之后统一提交
+    EntityRenderQueue entityQueue;
+
+    // 像素缓冲整体移动后 下一次 tick 需要整张上传而不是只上传脏矩形
+    bool needFullUpload = false;
+
+    // 所有纹理和 CPU 像素缓冲的大小 (不含渲染目标池中空闲的图像)
+    u64 memory_bytes();
 };
 
 class game final : public engine::application {
@@ -129,6 +165,10 @@ public:
     EnumGameState stateAfterLoad = MAIN_MENU;
 
     ME_debugdraw *debugDraw;
+    // renderOverlays 的区域和区块边框 整个 renderOverlays 只 flush 一次
+    DebugDrawBatch overlayDraw;
+    // renderLate 的各个 pass 火焰和背景的中间结果是其中的临时资源
+    RenderGraph renderGraph;
     // fontcache fontcache;
 
     MEsurface_context *surface;
@@ -139,7 +179,18 @@ public:
     i32 ent_prevLoadZoneX = 0;
     i32 ent_prevLoadZoneY = 0;
 
-    u16 *movingTiles;
+    // tick 中用到的音频事件 脚本加载完事件 (InitAudioEvents) 之后在 init 中解析一次
+    struct {
+        AudioEvent title = AudioEvent::NONE;
+        AudioEvent jump = AudioEvent::NONE;
+        AudioEvent impact = AudioEvent::NONE;
+        AudioParameter sand = AudioParameter::NONE;
+        AudioParameter fly = AudioParameter::NONE;
+        AudioParameter wind = AudioParameter::NONE;
+        AudioAmbient waterFlow = AudioAmbient::NONE;
+    } sounds;
+    // updateMaterialSounds 由 world::tickActivity 得到的发声区域
+    std::vector<Audio::AmbientSource> ambientSources;
 
     i32 mx = 0;
     i32 my = 0;
@@ -148,7 +199,8 @@ public:
     i32 lastEraseMX = 0;
     i32 lastEraseMY = 0;
 
-    u8 *objectDelete = nullptr;
+    // 这一 tick 实体写入世界的 Tiles_OBJECT 位置 tick 结束时清除
+    std::vector<u32> objectStamps;
 
     u32 loadingOnColor = 0;
     u32 loadingOffColor = 0;
@@ -161,8 +213,21 @@ public:
     f32 accLoadX = 0;
     f32 accLoadY = 0;
 
+    // 上一次 tick 按计划应当发生的时间 (ms) 每次前进整数个 tick 周期 不受渲染帧率影响
+    f64 tickClock = 0;
+
     // profiler
     profiler_graph fps, cpuGraph;
+    SpikeRecorder spikes;
+    MemoryBudget memory;
+    EventBus events;
+    PerfBench perfBench;
+    DynamicResolution dynres;
+    FramePacer pacer;
+    Replay replay;
+    StressScene stress;
+    // 上一次自动存档的时间 不在游戏中时为 0
+    i64 lastAutosave = 0;
 
     i64 fadeInStart = 0;
     i64 fadeInLength = 0;
@@ -201,16 +266,22 @@ public:
     void setEventCallback(const EventCallbackFn &callback) { EventCallback = callback; }
     void tick();
     void tickChunkLoading();
+    // 取走 world 记下的背景上传和释放 更新 backgroundAtlas
+    void syncBackgroundAtlas();
+    // 注册 memory 的统计和超出预算时的策略
+    void initMemoryBudget();
     void tickPlayer();
     void tickProfiler();
     void updateFrameLate();
+    // 清空并重画 textureObjects textureObjectsLQ textureObjectsBack alpha 见 world::physicsAlpha
+    void renderObjects(f32 alpha);
     void renderOverlays();
     void updateMaterialSounds();
     void createTexture();
     void deleteTexture();
     void renderEarly();
     void renderLate();
-    void renderTemperatureMap(world *world);
+    void renderTemperatureMap(world *world, const std::vector<DirtyRect> &rects);
     void ResolutionChanged(int newWidth, int newHeight);
     int getAimSolidSurface(int dist);
     int getAimSurface(int dist);
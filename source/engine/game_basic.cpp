@@ -9,6 +9,7 @@
 #include "engine/core/core.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
+#include "engine/scripting/lua_ecs.hpp"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/scripting/scripting.hpp"
 #include "game.hpp"
@@ -17,6 +18,8 @@
 #include "game_ui.hpp"
 #include "reflectionflat.hpp"
 #include "textures.hpp"
+#include "world_ffi.hpp"
+#include "world_gen_graph.hpp"
 
 namespace ME {
 
@@ -27,7 +30,12 @@ static void audio_init() { global.audio.Init(); }
 static void audio_load_bank(std::string name, unsigned int type) { global.audio.LoadBank(METADOT_RESLOC(name.c_str()), type); }
 
 static void audio_load_event(std::string event) { global.audio.LoadEvent(event); }
-static void audio_play_event(std::string event) { global.audio.PlayEvent(event); }
+static void audio_play_event(const char *event) { global.audio.PlayEvent(event); }
+static AudioEvent audio_event(const char *event) { return global.audio.ResolveEvent(event); }
+static AudioParameter audio_parameter(AudioEvent event, const char *parameter) { return global.audio.ResolveEventParameter(event, parameter); }
+static void audio_play(AudioEvent event) { global.audio.PlayEvent(event); }
+static void audio_stop(AudioEvent event, bool immediate) { global.audio.StopEvent(event, immediate); }
+static void audio_set_parameter(AudioParameter parameter, f32 value) { global.audio.SetEventParameter(parameter, value); }
 
 static void textures_init() {
     // 贴图初始化
@@ -43,16 +51,19 @@ static void load_lua(std::string luafile) {}
 
 #pragma endregion GameScriptingBind_1
 
-Biome Biome::biomeGet(std::string name) {
-    for (auto t : GAME()->biome_container)
-        if (t.first == name) return t.second;
-    return GAME()->biome_container[0];  // 没有找到指定生物群系则返回默认生物群系
+int Biome::biomeGetID(InternedName name) {
+    int id = GAME()->biome_registry.find(name);
+    if (id != NameRegistry::INVALID) return id;
+
+    // 没有找到指定生物群系则返回默认生物群系
+    id = GAME()->biome_registry.find(NAME_DEFAULT);
+    return id != NameRegistry::INVALID ? id : 0;
 }
 
 void Biome::createBiome(std::string name, int id) {
     METADOT_BUG("[LUA] create_biome ", name, " = ", id);
     // Biome *b = alloc<Biome>::safe_malloc(name, id);
-    GAME()->biome_container.insert(std::make_pair(name, Biome{id}));
+    if (!GAME()->biome_registry.add(name, id)) METADOT_ERROR("[LUA] create_biome ", name, " hash collides with ", GAME()->biome_registry.name(GAME()->biome_registry.find(name)));
 }
 
 void gameplay::create() {
@@ -75,7 +86,7 @@ void gameplay::destory() { the<scripting>().fast_call_func("OnGameEngineUnLoad")
 void gameplay::reload() {}
 
 void gameplay::registerLua(lua_wrapper::State &s_lua) {
-    s_lua["controls_init"] = lua_wrapper::function(controls_init);
+    s_lua["controls_init"] = lua_wrapper::fast_function<&controls_init>();
     s_lua["materials_init"] = lua_wrapper::function(InitMaterials);
     s_lua["materials_register"] = lua_wrapper::function(RegisterMaterial);
     s_lua["materials_push"] = lua_wrapper::function(PushMaterials);
@@ -83,15 +94,33 @@ void gameplay::registerLua(lua_wrapper::State &s_lua) {
     s_lua["textures_init"] = lua_wrapper::function(textures_init);
     s_lua["textures_end"] = lua_wrapper::function(textures_end);
     s_lua["audio_load_event"] = lua_wrapper::function(audio_load_event);
-    s_lua["audio_play_event"] = lua_wrapper::function(audio_play_event);
+    s_lua["audio_play_event"] = lua_wrapper::fast_function<&audio_play_event>();
+    // 按名字的接口每次都查表 频繁调用时先用 audio_event / audio_parameter 取句柄
+    s_lua["audio_event"] = lua_wrapper::fast_function<&audio_event>();
+    s_lua["audio_parameter"] = lua_wrapper::fast_function<&audio_parameter>();
+    s_lua["audio_play"] = lua_wrapper::fast_function<&audio_play>();
+    s_lua["audio_stop"] = lua_wrapper::fast_function<&audio_stop>();
+    s_lua["audio_set_parameter"] = lua_wrapper::fast_function<&audio_set_parameter>();
     s_lua["audio_load_bank"] = lua_wrapper::function(audio_load_bank);
     s_lua["audio_init"] = lua_wrapper::function(audio_init);
     s_lua["create_biome"] = lua_wrapper::function(Biome::createBiome);
+    // 脚本取一次整数 ID 缓存起来 之后不再按名字查找
+    s_lua["biome_id"] = lua_wrapper::function([](std::string name) { return Biome::biomeGetID(name); });
+    s_lua["material_id"] = lua_wrapper::function([](std::string name) { return GAME()->material_registry.find(name); });
+    // 发光材料的光照 0 到 1 坐标与 WorldEntity 相同 见 LightField
+    s_lua["world_light"] = lua_wrapper::fast_function([](f32 x, f32 y) { return global.game->Iso.world ? global.game->Iso.world->light.level(x, y) : 0.0f; });
+    RegisterWorldGenLua(s_lua);
+    // OnMaterialBatch 的 cells 用这个声明 ffi.cast 见 world::ScriptCell
+    s_lua["ME_SCRIPT_CELL_CDEF"] = world::SCRIPT_CELL_CDEF;
+    // 世界平面的 ffi 视图 见 data/scripts/common/worldview.lua
+    ME_preload(s_lua.state(), luaopen_worldview, "_ME_worldview");
+    // data/scripts/ecs 的原生组件存储
+    ME_preload(s_lua.state(), luaopen_ecs_store, "_ME_ecs");
     s_lua["init_ecs"] = lua_wrapper::function(init_ecs);
 
-    s_lua["DrawMainMenuUI"] = lua_wrapper::function(GameUI::MainMenuUI__Draw);
-    s_lua["DrawDebugUI"] = lua_wrapper::function(GameUI::DebugDrawUI__Draw);
-    s_lua["DebugUIEnd"] = lua_wrapper::function(GameUI::DebugDrawUI__End);
+    s_lua["DrawMainMenuUI"] = lua_wrapper::fast_function<&GameUI::MainMenuUI__Draw>();
+    s_lua["DrawDebugUI"] = lua_wrapper::fast_function<&GameUI::DebugDrawUI__Draw>();
+    s_lua["DebugUIEnd"] = lua_wrapper::fast_function<&GameUI::DebugDrawUI__End>();
 
     // ItemBinding::register_class(s_lua.state());
     RigidBodyBinding::register_class(s_lua.state());
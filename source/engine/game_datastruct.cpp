@@ -2,6 +2,7 @@
 
 #include "game_datastruct.hpp"
 
+#include <algorithm>
 #include <string>
 #include <string_view>
 
@@ -18,6 +19,7 @@
 #include "game.hpp"
 #include "game/items.hpp"
 #include "game/player.hpp"
+#include "material_cache.hpp"
 #include "reflectionflat.hpp"
 #include "textures.hpp"
 #include "world.hpp"
@@ -25,9 +27,9 @@
 namespace ME {
 
 void ReleaseGameData() {
-    for (auto b : GAME()->biome_container) {
-        // if (static_cast<bool>(b)) ME_DELETE(b, Biome);
-    }
+    GAME()->biome_registry.clear();
+    GAME()->material_registry.clear();
+    GAME()->materials_cached = false;
 
     for (int j = 0; j < GAME()->materials_container.size(); j++) {
         if (GAME()->materials_container[j]->interactions) delete[] GAME()->materials_container[j]->interactions;
@@ -112,7 +114,9 @@ void test() {
 
 #pragma endregion MATERIALSLIST
 
-#define REGISTER(_m) GAME()->materials_container.insert(GAME()->materials_container.begin() + _m.id, &_m)
+#define REGISTER(_m)                                                                    \
+    GAME()->materials_container.insert(GAME()->materials_container.begin() + _m.id, &_m); \
+    GAME()->material_registry.add(_m.index_name, _m.id)
 
 void InitMaterials() {
 
@@ -169,6 +173,15 @@ void InitMaterials() {
     REGISTER(GAME()->materials_list.FLAT_COBBLE_STONE);
     REGISTER(GAME()->materials_list.FLAT_COBBLE_DIRT);
 
+    // 之后的部分 (随机材料 interaction reaction 测试材料) 在缓存有效时直接从缓存取
+    GAME()->materials_builtin = (u32)GAME()->materials_count;
+    GAME()->materials_cache_key = MaterialCache::source_key();
+    if (MaterialCache::load(ME_fs_get_path(MATERIAL_CACHE_FILE), GAME()->materials_cache_key)) {
+        timer.stop();
+        METADOT_INFO(std::format("[GamePlay] A total of {0} materials are loaded from cache in {1:.4f} ms", GAME()->materials_count, timer.get()).c_str());
+        return;
+    }
+
     Material *randMats = new Material[10];
     for (int i = 0; i < 10; i++) {
         std::string name = std::format("Mat_{0}", i);
@@ -194,6 +207,7 @@ void InitMaterials() {
         GAME()->materials_container[j]->interact = false;
         GAME()->materials_container[j]->interactions = new std::vector<MaterialInteraction>[GAME()->materials_container.size()];
         GAME()->materials_container[j]->nInteractions = new int[GAME()->materials_container.size()];
+        GAME()->materials_container[j]->interactionsSize = (int)GAME()->materials_container.size();
 
         for (int k = 0; k < GAME()->materials_container.size(); k++) {
             GAME()->materials_container[j]->interactions[k] = {};
@@ -238,6 +252,7 @@ void InitMaterials() {
         }
     }
 
+    // 修改下面的 reaction 时需要加大 MaterialCache::MATERIAL_CACHE_VERSION
     /*GAME()->materials_container[WATER.id]->interact = true;
     GAME()->materials_container[WATER.id]->nInteractions[LAVA.id] = 2;
     GAME()->materials_container[WATER.id]->interactions[LAVA.id].push_back({ INTERACT_TRANSFORM_MATERIAL, OBSIDIAN.id, 3, 0, 0 });
@@ -280,6 +295,12 @@ void InitMaterials() {
 }
 
 void RegisterMaterial(int s_id, std::string name, std::string index_name, int physicsType, int slipperyness, u8 alpha, f32 density, int iterations, int emit, u32 emitColor, u32 color) {
+    if (GAME()->materials_cached) {
+        // 缓存里已经有 game.lua 注册的材料 key 包含 game.lua 的内容
+        if (GAME()->materials_list.ScriptableMaterials.count(s_id)) return;
+        // 缓存之外的新材料 PushMaterials 重新构建 materials_table 并更新缓存
+        GAME()->materials_cached = false;
+    }
     GAME()->materials_list.ScriptableMaterials.insert(
             std::make_pair(s_id, Material(GAME()->materials_count++, name, index_name, (PhysicsType)physicsType, slipperyness, alpha, density, iterations, emit, emitColor, color)));
     REGISTER(GAME()->materials_list.ScriptableMaterials[s_id]);
@@ -293,6 +314,10 @@ void PushMaterials() {
         m.is_scriptable = true;
     }
     GAME()->materials_array = GAME()->materials_container.data();
+    if (GAME()->materials_cached) return;
+
+    GAME()->materials_table.build(GAME()->materials_container);
+    MaterialCache::save(ME_fs_get_path(MATERIAL_CACHE_FILE), GAME()->materials_cache_key);
 
     // for (int i = 0; i < GAME()->materials_count; i++) {
     //     GAME()->mat_instance_container.push_back(TilesCreate());
@@ -301,6 +326,58 @@ void PushMaterials() {
 
 #undef REGISTER
 
+void MaterialTable::build(const std::vector<Material *> &materials) {
+    count = (u32)materials.size();
+
+    physicsType.assign(count, PhysicsType::AIR);
+    iterations.assign(count, 0);
+    density.assign(count, 0.0f);
+    alpha.assign(count, 0);
+    emit.assign(count, 0);
+    checks.assign(count, MaterialCheck_None);
+    scriptCount = 0;
+
+    interactionSpans.assign((size_t)count * count, {});
+    interactions.clear();
+    reactionSpans.assign(count, {});
+    reactions.clear();
+
+    for (u32 a = 0; a < count; a++) {
+        const Material *mat = materials[a];
+        ME_ASSERT(mat->id == a);
+
+        physicsType[a] = (u8)mat->physicsType;
+        iterations[a] = mat->iterations;
+        density[a] = mat->density;
+        alpha[a] = mat->alpha;
+        emit[a] = (u8)(mat->emitColor >> 24);
+
+        // 与 tick 中原来的判断一致: interact 标记 + nInteractions 计数 只取计数范围内的
+        if (mat->interact && mat->interactions && mat->nInteractions) {
+            for (int b = 0; b < mat->interactionsSize; b++) {
+                const int n = std::min(mat->nInteractions[b], (int)mat->interactions[b].size());
+                if (n <= 0) continue;
+
+                interactionSpans[(size_t)a * count + b] = {(u32)interactions.size(), (u32)n};
+                interactions.insert(interactions.end(), mat->interactions[b].begin(), mat->interactions[b].begin() + n);
+                checks[a] |= MaterialCheck_Interact;
+            }
+        }
+
+        if (mat->react && mat->nReactions > 0) {
+            const int n = std::min(mat->nReactions, (int)mat->reactions.size());
+            reactionSpans[a] = {(u32)reactions.size(), (u32)n};
+            reactions.insert(reactions.end(), mat->reactions.begin(), mat->reactions.begin() + n);
+            if (n > 0) checks[a] |= MaterialCheck_React;
+        }
+
+        if (mat->is_scriptable) {
+            checks[a] |= MaterialCheck_Script;
+            scriptCount++;
+        }
+    }
+}
+
 MaterialInstance::MaterialInstance(Material *mat, u32 color, mat_temperature temperature) {
     this->id = mat->id;
     this->mat = mat;
@@ -319,7 +396,7 @@ MaterialInstance Tiles_OBJECT = MaterialInstance(&GAME()->materials_list.GENERIC
 
 MaterialInstance TilesCreateTestSand() {
     u32 rgb = 220;
-    rgb = (rgb << 8) + 155 + rand() % 30;
+    rgb = (rgb << 8) + 155 + RNG_Rand() % 30;
     rgb = (rgb << 8) + 100;
     return MaterialInstance(&GAME()->materials_list.ScriptableMaterials[1001], rgb);
 }
@@ -357,13 +434,13 @@ MaterialInstance TilesCreateStone(int x, int y) {
 
 MaterialInstance TilesCreateGrass() {
     u32 rgb = 40;
-    rgb = (rgb << 8) + 120 + rand() % 20;
+    rgb = (rgb << 8) + 120 + RNG_Rand() % 20;
     rgb = (rgb << 8) + 20;
     return MaterialInstance(&GAME()->materials_list.GRASS, rgb);
 }
 
 MaterialInstance TilesCreateDirt() {
-    u32 rgb = 60 + rand() % 10;
+    u32 rgb = 60 + RNG_Rand() % 10;
     rgb = (rgb << 8) + 40;
     rgb = (rgb << 8) + 20;
     return MaterialInstance(&GAME()->materials_list.DIRT, rgb);
@@ -485,7 +562,7 @@ MaterialInstance TilesCreateSteam() { return MaterialInstance(&GAME()->materials
 MaterialInstance TilesCreateFire() {
 
     u32 rgb = 255;
-    rgb = (rgb << 8) + 100 + rand() % 50;
+    rgb = (rgb << 8) + 100 + RNG_Rand() % 50;
     rgb = (rgb << 8) + 50;
 
     return MaterialInstance(&GAME()->materials_list.FIRE, rgb);
@@ -620,8 +697,8 @@ Structure::Structure(C_Surface *texture, Material mat) {
 }
 
 Structure Structures::makeTree(world world, int x, int y) {
-    int w = 50 + rand() % 10;
-    int h = 80 + rand() % 20;
+    int w = 50 + RNG_Rand() % 10;
+    int h = 80 + RNG_Rand() % 20;
     MaterialInstance *tiles = new MaterialInstance[w * h];
 
     for (int tx = 0; tx < w; tx++) {
@@ -630,10 +707,10 @@ Structure Structures::makeTree(world world, int x, int y) {
         }
     }
 
-    int trunk = 3 + rand() % 2;
+    int trunk = 3 + RNG_Rand() % 2;
 
     f32 cx = w / 2;
-    f32 dcx = (((rand() % 10) / 10.0) - 0.5) / 3.0;
+    f32 dcx = (((RNG_Rand() % 10) / 10.0) - 0.5) / 3.0;
     for (int ty = h - 1; ty > 20; ty--) {
         int bw = trunk + std::max((ty - h + 10) / 3, 0);
         for (int xx = -bw; xx <= bw; xx++) {
@@ -654,12 +731,12 @@ Structure Structures::makeTree(world world, int x, int y) {
         }
     }
 
-    int nBranches = rand() % 3;
-    bool side = rand() % 2;  // false = right, true = left
+    int nBranches = RNG_Rand() % 3;
+    bool side = RNG_Rand() % 2;  // false = right, true = left
     for (int i = 0; i < nBranches; i++) {
-        int yPos = 20 + (h - 20) / 3 * (i + 1) + rand() % 10;
-        f32 tilt = ((rand() % 10) / 10.0 - 0.5) * 8;
-        int len = 10 + rand() % 5;
+        int yPos = 20 + (h - 20) / 3 * (i + 1) + RNG_Rand() % 10;
+        f32 tilt = ((RNG_Rand() % 10) / 10.0 - 0.5) * 8;
+        int len = 10 + RNG_Rand() % 5;
         for (int xx = 0; xx < len; xx++) {
             int tx = (int)(w / 2 + dcx * (h - yPos)) + (side ? 1 : -1) * (xx + 2) - (int)(dcx * (h - 30));
             int th = 3 * (1 - (xx / (f32)len));
@@ -678,7 +755,7 @@ Structure Structures::makeTree(world world, int x, int y) {
 
 Structure Structures::makeTree1(world world, int x, int y) {
     char buff[30];
-    snprintf(buff, sizeof(buff), "data/assets/objects/tree%d.png", rand() % 8 + 1);
+    snprintf(buff, sizeof(buff), "data/assets/objects/tree%d.png", RNG_Rand() % 8 + 1);
     std::string buffAsStdStr = buff;
     return Structure(LoadTexture(buffAsStdStr.c_str())->surface(), GAME()->materials_list.GENERIC_PASSABLE);
 }
@@ -830,7 +907,7 @@ PlacedStructure::PlacedStructure(Structure base, int x, int y) {
 //  return structs;
 // }
 
-std::vector<PlacedStructure> TestPhase1Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase1Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff0000);
@@ -840,7 +917,7 @@ std::vector<PlacedStructure> TestPhase1Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase2Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase2Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0x00ff00);
@@ -850,7 +927,7 @@ std::vector<PlacedStructure> TestPhase2Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase3Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase3Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0x0000ff);
@@ -860,7 +937,7 @@ std::vector<PlacedStructure> TestPhase3Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase4Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase4Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffff00);
@@ -870,7 +947,7 @@ std::vector<PlacedStructure> TestPhase4Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase5Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase5Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff00ff);
@@ -880,7 +957,7 @@ std::vector<PlacedStructure> TestPhase5Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase6Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase6Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 0; x < 10; x++) {
         for (int y = 0; y < 10; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0x00ffff);
@@ -890,7 +967,7 @@ std::vector<PlacedStructure> TestPhase6Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> TestPhase0Populator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
+std::vector<PlacedStructure> TestPhase0Populator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world) {
     for (int x = 10; x < 20; x++) {
         for (int y = 10; y < 20; y++) {
             chunk[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffffff);
@@ -900,7 +977,7 @@ std::vector<PlacedStructure> TestPhase0Populator::apply(MaterialInstance *chunk,
     return {};
 }
 
-std::vector<PlacedStructure> CavePopulator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
+std::vector<PlacedStructure> CavePopulator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
 
     if (ch->y < 0) return {};
     for (int x = 0; x < CHUNK_W; x++) {
@@ -915,7 +992,7 @@ std::vector<PlacedStructure> CavePopulator::apply(MaterialInstance *chunk, Mater
                 if (n2 + n + ndetail < std::fmin(0.95, (py) / 1000.0)) {
                     f64 nlav = world->noise.GetPerlin(px / 4.0, py / 4.0, 7018);
                     if (nlav > 0.45) {
-                        chunk[x + y * CHUNK_W] = rand() % 3 == 0 ? (ch->y > 15 ? TilesCreateLava() : TilesCreateWater()) : Tiles_NOTHING;
+                        chunk[x + y * CHUNK_W] = RNG_Rand() % 3 == 0 ? (ch->y > 15 ? TilesCreateLava() : TilesCreateWater()) : Tiles_NOTHING;
                     } else {
                         chunk[x + y * CHUNK_W] = Tiles_NOTHING;
                     }
@@ -931,7 +1008,7 @@ std::vector<PlacedStructure> CavePopulator::apply(MaterialInstance *chunk, Mater
     return {};
 }
 
-std::vector<PlacedStructure> CobblePopulator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
+std::vector<PlacedStructure> CobblePopulator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
 
     if (ch->y < 0) return {};
 
@@ -1018,7 +1095,7 @@ std::vector<PlacedStructure> CobblePopulator::apply(MaterialInstance *chunk, Mat
     return {};
 }
 
-std::vector<PlacedStructure> OrePopulator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
+std::vector<PlacedStructure> OrePopulator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
 
     if (ch->y < 0) return {};
     for (int x = 0; x < CHUNK_W; x++) {
@@ -1042,9 +1119,9 @@ std::vector<PlacedStructure> OrePopulator::apply(MaterialInstance *chunk, Materi
     return {};
 }
 
-std::vector<PlacedStructure> TreePopulator::apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
+std::vector<PlacedStructure> TreePopulator::apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) {
     if (ch->y < 0 || ch->y > 3) return {};
-    int x = (rand() % (CHUNK_W / 2) + (CHUNK_W / 4)) * 1;
+    int x = (RNG_Rand() % (CHUNK_W / 2) + (CHUNK_W / 4)) * 1;
     if (area[1 + 2 * 3]->tiles[x + 0 * CHUNK_W].mat->id == GAME()->materials_list.SOFT_DIRT.id) return {};
 
     for (int y = 0; y < CHUNK_H; y++) {
@@ -1076,7 +1153,7 @@ std::vector<PlacedStructure> TreePopulator::apply(MaterialInstance *chunk, Mater
             // }
 
             char buff[40];
-            snprintf(buff, sizeof(buff), "data/assets/objects/tree%d.png", rand() % 8 + 1);
+            snprintf(buff, sizeof(buff), "data/assets/objects/tree%d.png", RNG_Rand() % 8 + 1);
             TextureRef tree_tex = LoadTexture(buff);
 
             px -= tree_tex->surface()->w / 2;
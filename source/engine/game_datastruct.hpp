@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -15,6 +16,7 @@
 #include "engine/meta/static_relfection.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/scripting/lua_wrapper.hpp"
+#include "engine/utils/intern.hpp"
 #include "engine/utils/type.hpp"
 #include "game_basic.hpp"
 
@@ -23,6 +25,7 @@ struct ImGuiContext;
 namespace ME {
 
 struct Chunk;
+class Layer2Bricks;
 struct Populator;
 struct world;
 struct RigidBody;
@@ -147,6 +150,8 @@ struct Material {
 
     bool interact = false;
     int *nInteractions = nullptr;
+    // interactions/nInteractions 分配时的材料个数 之后注册的材料不在其中
+    int interactionsSize = 0;
 
     std::vector<MaterialInteraction> *interactions = nullptr;
 
@@ -167,6 +172,55 @@ struct Material {
     Material() : Material(0, "Air", "", PhysicsType::AIR, 4, 0, 0) {}
 };
 
+// MaterialTable::checks 的标记 表示 tick 中需要做的检查
+enum MaterialCheck : u8 {
+    MaterialCheck_None = 0,
+    // 与下方像素的材料有 interaction
+    MaterialCheck_Interact = 1 << 0,
+    // 有 reaction (按温度变成其它材料)
+    MaterialCheck_React = 1 << 1,
+    // is_scriptable 材料 每 tick 交给脚本批量处理
+    MaterialCheck_Script = 1 << 2,
+};
+
+// 材料加载完成后 (PushMaterials) 编译出的按材料 id 索引的紧凑表
+// world::tick 每访问一个像素都要读这些属性 直接用 CellStore 里的 id 查表 不再经过 Material*
+struct MaterialTable {
+    struct Span {
+        u32 begin = 0;
+        u32 count = 0;
+    };
+
+    u32 count = 0;
+
+    std::vector<u8> physicsType;
+    std::vector<i32> iterations;
+    std::vector<f32> density;
+    std::vector<u8> alpha;
+    // emitColor 的 alpha 即发光强度
+    std::vector<u8> emit;
+    std::vector<u8> checks;
+    // 有 MaterialCheck_Script 的材料个数 为 0 时 tick 不扫描脚本材料
+    u32 scriptCount = 0;
+
+    // [a * count + b] 为材料 a 落在材料 b 上时的 interaction 在 interactions 中的范围
+    std::vector<Span> interactionSpans;
+    std::vector<MaterialInteraction> interactions;
+    std::vector<Span> reactionSpans;
+    std::vector<MaterialInteraction> reactions;
+
+    void build(const std::vector<Material *> &materials);
+
+    std::span<const MaterialInteraction> interactionsOf(mat_id a, mat_id b) const {
+        const Span &s = interactionSpans[(size_t)a * count + b];
+        return {interactions.data() + s.begin, s.count};
+    }
+    std::span<const MaterialInteraction> reactionsOf(mat_id a) const {
+        const Span &s = reactionSpans[a];
+        return {reactions.data() + s.begin, s.count};
+    }
+};
+
 struct MaterialsList {
     std::unordered_map<int, Material> ScriptableMaterials;
     Material GENERIC_AIR;
@@ -246,11 +300,19 @@ struct GameData {
     f32 freeCamX = 0;
     f32 freeCamY = 0;
 
-    std::map<std::string, Biome> biome_container;
+    // 群系和材料的名字登记 注册时解析成整数 ID
+    NameRegistry biome_registry;
+    NameRegistry material_registry;
 
     std::vector<Material *> materials_container;
     i32 materials_count;
     Material **materials_array;
+    MaterialTable materials_table;
+    // C++ 中定义的内置材料个数 之后的材料来自随机生成或脚本
+    u32 materials_builtin = 0;
+    // 材料和 materials_table 来自 MATERIAL_CACHE_FILE 时为 true PushMaterials 不再重新构建
+    bool materials_cached = false;
+    u64 materials_cache_key = 0;
 
     std::vector<MaterialInstance> mat_instance_container;
     MaterialInstance *mat_instance_array;
@@ -336,8 +398,16 @@ public:
     Biome(const Biome &) = default;
 
 public:
-    static Biome biomeGet(std::string name);
-    static ME_INLINE int biomeGetID(std::string name) { return biomeGet(name).id; }
+    // 内置群系名 ID 由脚本 create_biome 决定 这里只在编译期算好哈希
+    static constexpr InternedName NAME_DEFAULT{"DEFAULT"};
+    static constexpr InternedName NAME_PLAINS{"PLAINS"};
+    static constexpr InternedName NAME_MOUNTAINS{"MOUNTAINS"};
+    static constexpr InternedName NAME_FOREST{"FOREST"};
+
+    // 没有注册的名字返回默认群系
+    static int biomeGetID(InternedName name);
+    static Biome biomeGet(std::string name) { return Biome{biomeGetID(InternedName{name})}; }
+    static ME_INLINE int biomeGetID(std::string name) { return biomeGetID(InternedName{name}); }
     static void createBiome(std::string name, int id);
 };
 
@@ -357,64 +427,77 @@ struct WorldGenerator {
 
 struct Populator {
     virtual int getPhase() = 0;
-    virtual std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) = 0;
+    // 分析器作用域和统计使用的名字 必须是字符串常量
+    virtual const char *getName() { return "Populator"; }
+    virtual std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world) = 0;
 };
 
 #pragma region Populators
 
 struct TestPhase1Populator : public Populator {
     int getPhase() { return 1; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase1Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase2Populator : public Populator {
     int getPhase() { return 2; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase2Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase3Populator : public Populator {
     int getPhase() { return 3; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase3Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase4Populator : public Populator {
     int getPhase() { return 4; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase4Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase5Populator : public Populator {
     int getPhase() { return 5; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase5Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase6Populator : public Populator {
     int getPhase() { return 6; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase6Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct TestPhase0Populator : public Populator {
     int getPhase() { return 0; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
+    const char *getName() { return "TestPhase0Populator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk *area, bool *dirty, int tx, int ty, int tw, int th, Chunk ch, world *world);
 };
 
 struct CavePopulator : public Populator {
     int getPhase() { return 0; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
+    const char *getName() { return "CavePopulator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
 };
 
 struct CobblePopulator : public Populator {
     int getPhase() { return 1; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
+    const char *getName() { return "CobblePopulator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
 };
 
 struct OrePopulator : public Populator {
     int getPhase() { return 0; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
+    const char *getName() { return "OrePopulator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
 };
 
 struct TreePopulator : public Populator {
     int getPhase() { return 1; }
-    std::vector<PlacedStructure> apply(MaterialInstance *chunk, MaterialInstance *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
+    const char *getName() { return "TreePopulator"; }
+    std::vector<PlacedStructure> apply(MaterialInstance *chunk, Layer2Bricks *layer2, Chunk **area, bool *dirty, int tx, int ty, int tw, int th, Chunk *ch, world *world);
 };
 
 #pragma endregion Populators
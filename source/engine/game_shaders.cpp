@@ -125,6 +125,12 @@ void NewLightingShader::Update(R_Image *tex, R_Image *emit, f32 x, f32 y) {
     R_SetShaderImage(emit, emitmap_loc, 2);
 }
 
+void LightingUpsampleShader::Update(R_Image *worldTex) {
+    int worldTex_loc = R_GetUniformLocation(this->shader, "worldTex");
+
+    R_SetShaderImage(worldTex, worldTex_loc, 1);
+}
+
 void FireShader::Update(R_Image *tex) {
     int firemap_loc = R_GetUniformLocation(this->shader, "firemap");
     int txrsize_loc = R_GetUniformLocation(this->shader, "texSize");
@@ -198,6 +204,55 @@ void RayLightingShader::Update(R_Image *img, float x, float y) {
     R_SetShaderImage(img, txrmap_loc, 1);
 }
 
+void BackgroundParallaxShader::Update(f32 screenW, f32 screenH, f32 uvMaxX, f32 uvMaxY, int count, f32 *placement, f32 *source) {
+    int screenSize_loc = R_GetUniformLocation(shader, "screenSize");
+    int uvMax_loc = R_GetUniformLocation(shader, "uvMax");
+    int layerCount_loc = R_GetUniformLocation(shader, "layerCount");
+    int placement_loc = R_GetUniformLocation(shader, "placement");
+    int source_loc = R_GetUniformLocation(shader, "source");
+
+    float screenSize[2] = {screenW, screenH};
+    float uvMax[2] = {uvMaxX, uvMaxY};
+    R_SetUniformfv(screenSize_loc, 2, 1, screenSize);
+    R_SetUniformfv(uvMax_loc, 2, 1, uvMax);
+    R_SetUniformi(layerCount_loc, count);
+    R_SetUniformfv(placement_loc, 4, count, placement);
+    R_SetUniformfv(source_loc, 4, count, source);
+}
+
+void WorldCompositeShader::Update(R_Image *objects, R_Image *objectsLQ, R_Image *cells, R_Image *entitiesLQ, R_Image *entities) {
+    int objects_loc = R_GetUniformLocation(shader, "objectsTex");
+    int objectsLQ_loc = R_GetUniformLocation(shader, "objectsLQTex");
+    int cells_loc = R_GetUniformLocation(shader, "cellsTex");
+    int entitiesLQ_loc = R_GetUniformLocation(shader, "entitiesLQTex");
+    int entities_loc = R_GetUniformLocation(shader, "entitiesTex");
+
+    // 0 号纹理单元是被绘制的 tex
+    R_SetShaderImage(objects, objects_loc, 1);
+    R_SetShaderImage(objectsLQ, objectsLQ_loc, 2);
+    R_SetShaderImage(cells, cells_loc, 3);
+    R_SetShaderImage(entitiesLQ, entitiesLQ_loc, 4);
+    R_SetShaderImage(entities, entities_loc, 5);
+}
+
+void WorldPixelsShader::Update(R_Image *materials, int outputMode) {
+    int materials_loc = R_GetUniformLocation(shader, "materials");
+    int outputMode_loc = R_GetUniformLocation(shader, "outputMode");
+
+    R_SetShaderImage(materials, materials_loc, 1);
+    R_SetUniformi(outputMode_loc, outputMode);
+}
+
+void TemperatureMapShader::Update(int width, int height, size_t origin) {
+    int width_loc = R_GetUniformLocation(shader, "width");
+    int height_loc = R_GetUniformLocation(shader, "height");
+    int origin_loc = R_GetUniformLocation(shader, "origin");
+
+    R_SetUniformi(width_loc, width);
+    R_SetUniformi(height_loc, height);
+    R_SetUniformi(origin_loc, (int)origin);
+}
+
 #pragma endregion Shaders
 
 void shader_worker::create() {
@@ -205,6 +260,9 @@ void shader_worker::create() {
     Timer timer;
     timer.start();
 
+    u32 cacheHits = 0, cacheMisses = 0;
+    ME_Shaders_CacheStats(&cacheHits, &cacheMisses);
+
     this->crtShader = new CrtShader;
     this->waterShader = new WaterShader;
     this->waterFlowPassShader = new WaterFlowPassShader;
@@ -214,6 +272,11 @@ void shader_worker::create() {
     this->blurShader = new BlurShader;
     this->untexturedShader = new UntexturedShader;
     this->raylightingShader = new RayLightingShader;
+    this->worldCompositeShader = new WorldCompositeShader;
+    this->worldPixelsShader = new WorldPixelsShader;
+    this->lightingUpsampleShader = new LightingUpsampleShader;
+    this->backgroundParallaxShader = new BackgroundParallaxShader;
+    this->temperatureMapShader = new TemperatureMapShader;
 
     this->crtShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
     this->crtShader->fragment_shader_file = ME_fs_get_path("data/shaders/crt.frag");
@@ -233,6 +296,16 @@ void shader_worker::create() {
     this->untexturedShader->fragment_shader_file = ME_fs_get_path("data/shaders/untextured.frag");
     this->raylightingShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
     this->raylightingShader->fragment_shader_file = ME_fs_get_path("data/shaders/raylighting.frag");
+    this->worldCompositeShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
+    this->worldCompositeShader->fragment_shader_file = ME_fs_get_path("data/shaders/worldComposite.frag");
+    this->worldPixelsShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
+    this->worldPixelsShader->fragment_shader_file = ME_fs_get_path("data/shaders/worldPixels.frag");
+    this->lightingUpsampleShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
+    this->lightingUpsampleShader->fragment_shader_file = ME_fs_get_path("data/shaders/lightingUpsample.frag");
+    this->backgroundParallaxShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
+    this->backgroundParallaxShader->fragment_shader_file = ME_fs_get_path("data/shaders/backgroundParallax.frag");
+    this->temperatureMapShader->vertex_shader_file = ME_fs_get_path("data/shaders/common.vert");
+    this->temperatureMapShader->fragment_shader_file = ME_fs_get_path("data/shaders/temperatureMap.frag");
 
     this->waterFlowPassShader->dirty = false;
 
@@ -245,6 +318,9 @@ void shader_worker::create() {
     this->newLightingShader->lastDitheringEnabled = false;
     this->newLightingShader->insideCur = 0.0f;
     this->newLightingShader->insideDes = 0.0f;
+    this->newLightingShader->lastZoneX = 0.0f;
+    this->newLightingShader->lastZoneY = 0.0f;
+    this->newLightingShader->lastView = {0, 0, 0, 0};
 
     this->crtShader->enable = true;
 
@@ -258,10 +334,17 @@ void shader_worker::create() {
     this->fire2Shader->init();
     this->blurShader->init();
     this->untexturedShader->init();
+    this->worldCompositeShader->init();
+    this->worldPixelsShader->init();
+    this->lightingUpsampleShader->init();
+    this->backgroundParallaxShader->init();
+    this->temperatureMapShader->init();
 
     timer.stop();
 
-    METADOT_INFO(std::format("ShaderWorker loading done in {0:.4f} ms", timer.get()).c_str());
+    u32 hits = 0, misses = 0;
+    ME_Shaders_CacheStats(&hits, &misses);
+    METADOT_INFO(std::format("ShaderWorker loading done in {0:.4f} ms ({1} cached {2} compiled)", timer.get(), hits - cacheHits, misses - cacheMisses).c_str());
 }
 
 #define SAFEUNLOADSHADER(x) \
@@ -279,6 +362,11 @@ void shader_worker::destory() {
     SAFEUNLOADSHADER(fire2Shader);
     SAFEUNLOADSHADER(blurShader);
     SAFEUNLOADSHADER(untexturedShader);
+    SAFEUNLOADSHADER(worldCompositeShader);
+    SAFEUNLOADSHADER(worldPixelsShader);
+    SAFEUNLOADSHADER(lightingUpsampleShader);
+    SAFEUNLOADSHADER(backgroundParallaxShader);
+    SAFEUNLOADSHADER(temperatureMapShader);
 
     METADOT_BUG("ShaderWorker destroyed");
 }
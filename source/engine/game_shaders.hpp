@@ -47,6 +47,12 @@ public:
     f32 insideDes;
     f32 insideCur;
 
+    // 上次重新计算光照时的 loadZone 之后世界平移时按差值移动缓存的结果
+    f32 lastZoneX;
+    f32 lastZoneY;
+    // 上次计算光照的世界范围 (世界像素 那时的坐标) 只计算了可见范围
+    MErect lastView;
+
     void SetSimpleMode(bool simpleMode);
     void SetEmissionEnabled(bool emissionEnabled);
     void SetDitheringEnabled(bool ditheringEnabled);
@@ -59,6 +65,14 @@ public:
     ShaderBaseDecl();
 };
 
+// 按世界纹理的实心/空气边缘把低分辨率光照放大 (lighting_scale > 1)
+class LightingUpsampleShader : public shader_base {
+public:
+    void Update(R_Image *worldTex);
+
+    ShaderBaseDecl();
+};
+
 class FireShader : public shader_base {
 public:
     void Update(R_Image *tex);
@@ -91,6 +105,45 @@ public:
     ShaderBaseDecl();
 };
 
+// 一次绘制所有视差背景层 各层上下排列在同一张图集 (tex) 中
+// 每层的平铺 裁剪和混合在片段着色器中完成 CPU 只计算每层的起点
+class BackgroundParallaxShader : public shader_base {
+public:
+    static constexpr int MAX_LAYERS = 8;
+
+    // placement: 每层 4 个值 屏幕上第一块的 x y 和一块的宽高 (像素)
+    // source: 每层 4 个值 图集中的 x y 宽高 (像素)
+    // uvMax: 绘制整张图集时 texCoord 的最大值 (w / texture_w, h / texture_h)
+    void Update(f32 screenW, f32 screenH, f32 uvMaxX, f32 uvMaxY, int count, f32 *placement, f32 *source);
+
+    ShaderBaseDecl();
+};
+
+// 把世界像素之上的各图层一次合成到 worldTexture 代替逐层 R_BlitRect
+// 世界像素 (texture) 作为被绘制的图像绑定在 tex 上
+class WorldCompositeShader : public shader_base {
+public:
+    void Update(R_Image *objects, R_Image *objectsLQ, R_Image *cells, R_Image *entitiesLQ, R_Image *entities);
+
+    ShaderBaseDecl();
+};
+
+// 由打包的世界像素和材料属性纹理生成世界颜色 (outputMode 0) 或发光纹理 (outputMode 1)
+class WorldPixelsShader : public shader_base {
+public:
+    void Update(R_Image *materials, int outputMode);
+
+    ShaderBaseDecl();
+};
+
+// 由世界温度平面生成温度图 (draw_temperature_map) 温度平面按存储位置上传 origin 为环形起点
+class TemperatureMapShader : public shader_base {
+public:
+    void Update(int width, int height, size_t origin);
+
+    ShaderBaseDecl();
+};
+
 class RayLightingShader : public shader_base {
 public:
 
@@ -110,6 +163,11 @@ public:
     BlurShader *blurShader = nullptr;
     UntexturedShader *untexturedShader = nullptr;
     RayLightingShader *raylightingShader = nullptr;
+    WorldCompositeShader *worldCompositeShader = nullptr;
+    WorldPixelsShader *worldPixelsShader = nullptr;
+    LightingUpsampleShader *lightingUpsampleShader = nullptr;
+    BackgroundParallaxShader *backgroundParallaxShader = nullptr;
+    TemperatureMapShader *temperatureMapShader = nullptr;
 
     REGISTER_SYSTEM(shader_worker)
 
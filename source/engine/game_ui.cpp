@@ -42,8 +42,20 @@ void I18N::Load(std::string lang) { the<scripting>().s_lua["setlocale"](lang); }
 
 std::string I18N::Get(std::string text) { return the<scripting>().s_lua["translate"](text); }
 
+std::string I18N::Strings() { return the<scripting>().s_lua["lang_strings"](); }
+
 namespace GameUI {
 
+namespace {
+
+// 等没有控件在拖动时写入 GLOBALDEF_SETTINGS_FILE
+void MarkSettingChanged(u32 bit) {
+    gameUI.OptionsUI__settings.mark(bit);
+    gameUI.OptionsUI__settingsDirty = true;
+}
+
+}  // namespace
+
 void OptionsUI__Draw(game *game) {
 
     ImGui::SetCursorPosX(ImGui::GetWindowWidth() / 2 - ImGui::CalcTextSize("选项").x / 2);
@@ -57,7 +69,9 @@ void OptionsUI__Draw(game *game) {
         s["state"] = 0;
     }
     if (ImGui::Button("保存")) {
-        // global.game->GameIsolate_.globaldef.Save(METADOT_RESLOC("data/scripts/settings2.lua"));
+        // 设置改动时已经自动保存 这里另外导出一份可以阅读的 Lua
+        const std::string path = ME_fs_get_path("settings.lua");
+        if (ExportGlobalDEF(global.game->Iso.globaldef, path)) METADOT_INFO(std::format("Settings exported to {0}", path).c_str());
     }
 
     ImGui::Separator();
@@ -109,13 +123,20 @@ void OptionsUI__Draw(game *game) {
         global.audio.PlayEvent("event:/GUI/GUI_Tab");
         prevTab = tab;
     }
+
+    // 拖动滑块时等松开再写
+    if (gameUI.OptionsUI__settingsDirty && !ImGui::IsAnyItemActive()) {
+        gameUI.OptionsUI__settings.capture(global.game->Iso.globaldef);
+        SaveUserSettings(gameUI.OptionsUI__settings, ME_fs_get_path(GLOBALDEF_SETTINGS_FILE));
+        gameUI.OptionsUI__settingsDirty = false;
+    }
 }
 
 void OptionsUI__DrawGeneral(game *game) {
     ImGui::TextColored(ImVec4(1.0, 1.0, 0.8, 1.0), "%s", "游戏内容");
     ImGui::Indent(4);
 
-    ImGui::Checkbox("材质工具提示", &global.game->Iso.globaldef.draw_material_info);
+    if (ImGui::Checkbox("材质工具提示", &global.game->Iso.globaldef.draw_material_info)) MarkSettingChanged(UserSettings::DRAW_MATERIAL_INFO);
 
     ImGui::Unindent(4);
 }
@@ -156,7 +177,9 @@ void OptionsUI__DrawVideo(game *game) {
     }
 
     if (ImGui::Checkbox("VSync", &gameUI.OptionsUI__vsync)) {
-        ME_set_vsync(gameUI.OptionsUI__vsync);
+        // 交换间隔在下一帧开始时由 game::pacer 设置
+        global.game->Iso.globaldef.vsync_mode = gameUI.OptionsUI__vsync ? FramePacer::VSYNC_ON : FramePacer::VSYNC_OFF;
+        MarkSettingChanged(UserSettings::VSYNC_MODE);
     }
 
     if (ImGui::Checkbox("失去焦点后最小化", &gameUI.OptionsUI__minimizeOnFocus)) {
@@ -170,38 +193,30 @@ void OptionsUI__DrawVideo(game *game) {
     ImGui::Indent(4);
 
     if (ImGui::Checkbox("高清贴图", &global.game->Iso.globaldef.hd_objects)) {
-        R_FreeTarget(game->TexturePack_.textureObjects->target);
-        R_FreeImage(game->TexturePack_.textureObjects);
-        R_FreeTarget(game->TexturePack_.textureObjectsBack->target);
-        R_FreeImage(game->TexturePack_.textureObjectsBack);
-        R_FreeTarget(game->TexturePack_.textureEntities->target);
-        R_FreeImage(game->TexturePack_.textureEntities);
-
-        game->TexturePack_.textureObjects =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        MarkSettingChanged(UserSettings::HD_OBJECTS);
+        // 来回切换时两种尺寸都留在池里 不用每次重新分配
+        R_ReleasePooledImage(game->TexturePack_.textureObjects);
+        R_ReleasePooledImage(game->TexturePack_.textureObjectsBack);
+        R_ReleasePooledImage(game->TexturePack_.textureEntities);
+
+        const u16 scale = global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1;
+        const u16 w = game->Iso.world->width * scale;
+        const u16 h = game->Iso.world->height * scale;
+
+        game->TexturePack_.textureObjects = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureObjects, R_FILTER_NEAREST);
 
-        game->TexturePack_.textureObjectsBack =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        game->TexturePack_.textureObjectsBack = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureObjectsBack, R_FILTER_NEAREST);
 
-        R_LoadTarget(game->TexturePack_.textureObjects);
-        R_LoadTarget(game->TexturePack_.textureObjectsBack);
-
-        game->TexturePack_.textureEntities =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        game->TexturePack_.textureEntities = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureEntities, R_FILTER_NEAREST);
-
-        R_LoadTarget(game->TexturePack_.textureEntities);
     }
 
     ImGui::SetNextItemWidth(100);
-    ImGui::SliderFloat("光照质量", &global.game->Iso.globaldef.lightingQuality, 0.0, 1.0, "", 0);
-    ImGui::Checkbox("简单光照", &global.game->Iso.globaldef.simpleLighting);
-    ImGui::Checkbox("抖动光照", &global.game->Iso.globaldef.lightingDithering);
+    if (ImGui::SliderFloat("光照质量", &global.game->Iso.globaldef.lightingQuality, 0.0, 1.0, "", 0)) MarkSettingChanged(UserSettings::LIGHTING_QUALITY);
+    if (ImGui::Checkbox("简单光照", &global.game->Iso.globaldef.simpleLighting)) MarkSettingChanged(UserSettings::SIMPLE_LIGHTING);
+    if (ImGui::Checkbox("抖动光照", &global.game->Iso.globaldef.lightingDithering)) MarkSettingChanged(UserSettings::LIGHTING_DITHERING);
 
     ImGui::Unindent(4);
 }
@@ -247,25 +262,38 @@ void OptionsUI__DrawInput(game *game) {}
 
 void MainMenuUI__RefreshWorlds(game *game) {
 
-    gameUI.MainMenuUI__worlds = {};
-
-    for (auto &p : std::filesystem::directory_iterator(METADOT_RESLOC("saves/"))) {
-        std::string worldName = p.path().filename().generic_string();
-
-        if (worldName == ".DS_Store") continue;
+    gameUI.MainMenuUI__worlds = WorldIndex::load();
 
-        WorldMeta meta = WorldMeta::loadWorldMeta(METADOT_RESLOC(std::format("saves/{0}", worldName).c_str()));
-
-        gameUI.MainMenuUI__worlds.push_back(std::make_tuple(worldName, meta));
+    // 不再用到的缩略图
+    for (auto it = gameUI.MainMenuUI__thumbnails.begin(); it != gameUI.MainMenuUI__thumbnails.end();) {
+        const bool used = std::any_of(gameUI.MainMenuUI__worlds.begin(), gameUI.MainMenuUI__worlds.end(), [&](const WorldIndex::Entry &e) { return e.thumbHash == it->first; });
+        if (used) {
+            ++it;
+        } else {
+            R_FreeImage(it->second);
+            it = gameUI.MainMenuUI__thumbnails.erase(it);
+        }
     }
+}
 
-    auto sortWorlds = [](std::tuple<std::string, WorldMeta> w1, std::tuple<std::string, WorldMeta> w2) {
-        time_t c1 = std::get<1>(w1).lastOpenedTime;
-        time_t c2 = std::get<1>(w2).lastOpenedTime;
-        return (c1 > c2);
-    };
-
-    std::sort(gameUI.MainMenuUI__worlds.begin(), gameUI.MainMenuUI__worlds.end(), sortWorlds);
+static R_Image *MainMenuUI__Thumbnail(const WorldIndex::Entry &e) {
+    if (e.thumbnail.empty()) return nullptr;
+    R_Image *&img = gameUI.MainMenuUI__thumbnails[e.thumbHash];
+    if (img) return img;
+
+    // 0xAARRGGBB 转成 RGBA 字节
+    std::vector<u8> bytes(e.thumbnail.size() * 4);
+    for (size_t i = 0; i < e.thumbnail.size(); i++) {
+        const u32 c = e.thumbnail[i];
+        bytes[i * 4 + 0] = (c >> 16) & 0xff;
+        bytes[i * 4 + 1] = (c >> 8) & 0xff;
+        bytes[i * 4 + 2] = c & 0xff;
+        bytes[i * 4 + 3] = (c >> 24) & 0xff;
+    }
+    img = R_CreateImage((u16)e.thumbWidth, (u16)e.thumbHeight, R_FORMAT_RGBA);
+    R_SetImageFilter(img, R_FILTER_NEAREST);
+    R_UpdateImageBytes(img, NULL, bytes.data(), e.thumbWidth * 4);
+    return img;
 }
 
 void MainMenuUI__Setup() {
@@ -377,7 +405,7 @@ void MainMenuUI__DrawCreateWorldUI(game *game) {
 
     ImGui::Text("%s: %s", LANG("ui_worldname"), gameUI.MainMenuUI__worldFolderLabel.c_str());
 
-    const char *world_types[] = {"Material Test World", "Default World (WIP)"};
+    const char *world_types[] = {"Material Test World", "Default World (WIP)", "Scripted World"};
 
     ImGui::ListBox(LANG("ui_worldgenerator"), &gameUI.MainMenuUI__selIndex, world_types, IM_ARRAYSIZE(world_types), 4);
 
@@ -419,6 +447,8 @@ void MainMenuUI__DrawCreateWorldUI(game *game) {
             generator = new MaterialTestGenerator();
         } else if (gameUI.MainMenuUI__selIndex == 1) {
             generator = new DefaultGenerator();
+        } else if (gameUI.MainMenuUI__selIndex == 2) {
+            generator = new ScriptingWorldGenerator();
         } else {
             generator = new MaterialTestGenerator();
         }
@@ -433,6 +463,11 @@ void MainMenuUI__DrawCreateWorldUI(game *game) {
         game->Iso.world->metadata.lastOpenedVersion = std::to_string(ME_buildnum());
         game->Iso.world->metadata.save(wpStr);
 
+        if (game->Iso.globaldef.pregen_radius > 0) {
+            world *w = game->Iso.world.get();
+            w->pregenerate((-w->loadZone.x + w->loadZone.w / 2) / CHUNK_W, (-w->loadZone.y + w->loadZone.h / 2) / CHUNK_H, game->Iso.globaldef.pregen_radius);
+        }
+
         METADOT_INFO("Queueing chunk loading...");
         for (int x = -CHUNK_W * 4; x < game->Iso.world->width + CHUNK_W * 4; x += CHUNK_W) {
             for (int y = -CHUNK_H * 3; y < game->Iso.world->height + CHUNK_H * 8; y += CHUNK_H) {
@@ -516,54 +551,71 @@ void MainMenuUI__DrawWorldLists(game *game) {
 
     // ImGui::BeginChild("WorldList", ImVec2(0, 200), false);
 
-    int nMainMenuButtons = 0;
-    for (auto &t : gameUI.MainMenuUI__worlds) {
-        std::string worldName = std::get<0>(t);
-
-        WorldMeta meta = std::get<1>(t);
-
-        ImGui::PushID(nMainMenuButtons);
-
-        struct tm *timeinfo = localtime(&meta.lastOpenedTime);
-
-        if (ImGui::Selectable(std::format("{0}\n{1} ({2}-{3:02}-{4:02} {5:02}:{6:02}:{7:02})", meta.worldName, worldName.c_str(), timeinfo->tm_year + 1900, timeinfo->tm_mon + 1, timeinfo->tm_mday,
-                                          timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec)
-                                      .c_str())) {
-            METADOT_INFO("Selected world: ", worldName.c_str());
-
-            gameUI.visible_mainmenu = false;
-            lua_wrapper::LuaRef s = the<scripting>().s_lua["game_datastruct"]["ui"];
-            s["state"] = 5;
-
-            game->fadeOutStart = the<engine>().eng()->time.now;
-            game->fadeOutLength = 250;
-            game->fadeOutCallback = [&, game, worldName]() {
-                game->setGameState(LOADING, INGAME);
-
-                auto w_old = game->Iso.world.release();
-                delete w_old;
-
-                game->Iso.world = create_scope<world>();
-                game->Iso.world->init(METADOT_RESLOC(std::format("saves/{0}", worldName).c_str()), (int)ceil(WINDOWS_MAX_WIDTH / 3 / (f64)CHUNK_W) * CHUNK_W + CHUNK_W * 3,
-                                      (int)ceil(WINDOWS_MAX_HEIGHT / 3 / (f64)CHUNK_H) * CHUNK_H + CHUNK_H * 3, the<engine>().eng()->target, &global.audio);
-                game->Iso.world->metadata.lastOpenedTime = ME_gettime() / 1000;
-                game->Iso.world->metadata.lastOpenedVersion = std::to_string(ME_buildnum());
-                game->Iso.world->metadata.save(game->Iso.world->worldName);
-
-                METADOT_INFO("Queueing chunk loading...");
-                for (int x = -CHUNK_W * 4; x < game->Iso.world->width + CHUNK_W * 4; x += CHUNK_W) {
-                    for (int y = -CHUNK_H * 3; y < game->Iso.world->height + CHUNK_H * 8; y += CHUNK_H) {
-                        game->Iso.world->queueLoadChunk(x / CHUNK_W, y / CHUNK_H, true, true);
+    // 上百个存档时只画可见的几行
+    const f32 thumbW = 64.0f, thumbH = 32.0f;
+    const f32 rowH = std::max(thumbH, ImGui::GetTextLineHeight() * 3);
+    ImGuiListClipper clipper;
+    clipper.Begin((int)gameUI.MainMenuUI__worlds.size(), rowH + ImGui::GetStyle().ItemSpacing.y);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const WorldIndex::Entry &e = gameUI.MainMenuUI__worlds[i];
+            std::string worldName = e.folder;
+            time_t lastOpened = e.meta.lastOpenedTime;
+
+            ImGui::PushID(i);
+
+            struct tm *timeinfo = localtime(&lastOpened);
+
+            const ImVec2 rowPos = ImGui::GetCursorPos();
+            const bool selected = ImGui::Selectable("##world", false, 0, ImVec2(0, rowH));
+            ImGui::SetCursorPos(rowPos);
+            if (R_Image *thumb = MainMenuUI__Thumbnail(e)) {
+                ImGui::Image((ImTextureID)R_GetTextureHandle(thumb), ImVec2(thumbW, thumbH));
+            } else {
+                ImGui::Dummy(ImVec2(thumbW, thumbH));
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s", std::format("{0}\n{1} {2:.1f} MB\n{3}-{4:02}-{5:02} {6:02}:{7:02}", e.meta.worldName, worldName, e.bytes / (1024.0 * 1024.0), timeinfo->tm_year + 1900, timeinfo->tm_mon + 1,
+                                            timeinfo->tm_mday, timeinfo->tm_hour, timeinfo->tm_min)
+                                        .c_str());
+
+            if (selected) {
+                METADOT_INFO("Selected world: ", worldName.c_str());
+
+                gameUI.visible_mainmenu = false;
+                lua_wrapper::LuaRef s = the<scripting>().s_lua["game_datastruct"]["ui"];
+                s["state"] = 5;
+
+                game->fadeOutStart = the<engine>().eng()->time.now;
+                game->fadeOutLength = 250;
+                game->fadeOutCallback = [&, game, worldName]() {
+                    game->setGameState(LOADING, INGAME);
+
+                    auto w_old = game->Iso.world.release();
+                    delete w_old;
+
+                    game->Iso.world = create_scope<world>();
+                    game->Iso.world->init(METADOT_RESLOC(std::format("saves/{0}", worldName).c_str()), (int)ceil(WINDOWS_MAX_WIDTH / 3 / (f64)CHUNK_W) * CHUNK_W + CHUNK_W * 3,
+                                          (int)ceil(WINDOWS_MAX_HEIGHT / 3 / (f64)CHUNK_H) * CHUNK_H + CHUNK_H * 3, the<engine>().eng()->target, &global.audio);
+                    game->Iso.world->metadata.lastOpenedTime = ME_gettime() / 1000;
+                    game->Iso.world->metadata.lastOpenedVersion = std::to_string(ME_buildnum());
+                    game->Iso.world->metadata.save(game->Iso.world->worldName);
+
+                    METADOT_INFO("Queueing chunk loading...");
+                    for (int x = -CHUNK_W * 4; x < game->Iso.world->width + CHUNK_W * 4; x += CHUNK_W) {
+                        for (int y = -CHUNK_H * 3; y < game->Iso.world->height + CHUNK_H * 8; y += CHUNK_H) {
+                            game->Iso.world->queueLoadChunk(x / CHUNK_W, y / CHUNK_H, true, true);
+                        }
                     }
-                }
 
-                game->fadeInStart = the<engine>().eng()->time.now;
-                game->fadeInLength = 250;
-                game->fadeInWaitFrames = 4;
-            };
-        }
+                    game->fadeInStart = the<engine>().eng()->time.now;
+                    game->fadeInLength = 250;
+                    game->fadeInWaitFrames = 4;
+                };
+            }
 
-        ImGui::PopID();
+            ImGui::PopID();
+        }
     }
     // ImGui::EndChild();
 }
@@ -3,14 +3,17 @@
 #ifndef ME_GAMEUI_HPP
 #define ME_GAMEUI_HPP
 
+#include <unordered_map>
 #include <vector>
 
 #include "engine/core/global.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/ui/imgui_impl.hpp"
+#include "cvar.hpp"
 #include "game_datastruct.hpp"
 #include "world.hpp"
+#include "world_index.hpp"
 
 namespace ME {
 
@@ -28,7 +31,9 @@ public:
     bool MainMenuUI__setup = false;
     bool MainMenuUI__connectButtonEnabled = false;
     ImVec2 MainMenuUI__pos = ImVec2(0, 0);
-    std::vector<std::tuple<std::string, WorldMeta>> MainMenuUI__worlds = {};
+    std::vector<WorldIndex::Entry> MainMenuUI__worlds = {};
+    // 按 WorldIndex::Entry::thumbHash 缓存的缩略图纹理 第一次显示时创建
+    std::unordered_map<u64, R_Image *> MainMenuUI__thumbnails = {};
     long long MainMenuUI__lastRefresh = 0;
     char MainMenuUI__worldNameBuf[32] = "";
     bool MainMenuUI__createWorldButtonEnabled = false;
@@ -45,6 +50,10 @@ public:
     int OptionsUI__item_current_idx = 0;
     bool OptionsUI__vsync = false;
     bool OptionsUI__minimizeOnFocus = false;
+    // 玩家改过的设置 启动时从 GLOBALDEF_SETTINGS_FILE 读入
+    UserSettings OptionsUI__settings;
+    // 选项改动过 还没写入 GLOBALDEF_SETTINGS_FILE
+    bool OptionsUI__settingsDirty = false;
 
     std::map<std::string, FMOD::Studio::Bus *> OptionsUI__busMap = {};
 };
@@ -12,6 +12,14 @@
 
 namespace ME {
 
+// CellData::event 标记需要由其它系统处理的 cell 代替每个 cell 一个回调
+enum CellEvent : u8 {
+    CellEvent_None = 0,
+    // 被吸尘器吸起 由 game::tickPlayer 引向玩家
+    CellEvent_Vacuum,
+};
+
+// 生成 cell 的参数 world::addCell 之后复制进 CellParticles
 struct CellData {
 
     MaterialInstance tile{};
@@ -29,10 +37,94 @@ struct CellData {
     int lifetime = 0;
     int fadeTime = 60;
     u8 inObjectState = 0;
-    std::function<void()> killCallback = []() {};
+    u8 event = CellEvent_None;
 
     explicit CellData(MaterialInstance tile, f32 x, f32 y, f32 vx, f32 vy, f32 ax, f32 ay) : tile(std::move(tile)), x(x), y(y), vx(vx), vy(vy), ax(ax), ay(ay) {}
-    CellData(const CellData& part) : tile(part.tile), x(part.x), y(part.y), vx(part.vx), vy(part.vy), ax(part.ax), ay(part.ay) {}
+};
+
+// 飞行中的 cell 按字段分开连续存放 tickCells/renderCells 只读需要的数组
+// 下标在 compact 之后会改变 不要长期保存
+class CellParticles {
+public:
+    std::vector<f32> x, y, vx, vy, ax, ay;
+    std::vector<int> lifetime;
+    std::vector<u8> phase, temporary, inObjectState, event;
+    // renderCells 用 不需要访问 tile.mat
+    std::vector<u32> color;
+    std::vector<u8> alpha;
+
+    // 写回世界时才用到
+    std::vector<MaterialInstance> tile;
+    std::vector<f32> targetX, targetY, targetForce;
+    std::vector<int> fadeTime;
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    void push(const CellData &c) {
+        x.push_back(c.x);
+        y.push_back(c.y);
+        vx.push_back(c.vx);
+        vy.push_back(c.vy);
+        ax.push_back(c.ax);
+        ay.push_back(c.ay);
+        lifetime.push_back(c.lifetime);
+        phase.push_back(c.phase);
+        temporary.push_back(c.temporary);
+        inObjectState.push_back(c.inObjectState);
+        event.push_back(c.event);
+        color.push_back(c.tile.color);
+        alpha.push_back(c.tile.mat->alpha);
+        tile.push_back(c.tile);
+        targetX.push_back(c.targetX);
+        targetY.push_back(c.targetY);
+        targetForce.push_back(c.targetForce);
+        fadeTime.push_back(c.fadeTime);
+    }
+
+    // 删除 dead[i] 非零的 cell 剩下的保持原来的顺序
+    void compact(const std::vector<u8> &dead) {
+        forEachArray([&dead](auto &v) {
+            size_t w = 0;
+            for (size_t i = 0; i < v.size(); i++) {
+                if (dead[i]) continue;
+                if (w != i) v[w] = std::move(v[i]);
+                w++;
+            }
+            v.erase(v.begin() + w, v.end());
+        });
+    }
+
+    void clear() {
+        forEachArray([](auto &v) { v.clear(); });
+    }
+
+    void reserve(size_t n) {
+        forEachArray([n](auto &v) { v.reserve(n); });
+    }
+
+    size_t memory_bytes() const {
+        size_t n = 0;
+        forEachArray([&n](const auto &v) { n += v.capacity() * sizeof(v[0]); });
+        return n;
+    }
+
+private:
+    template <typename F>
+    void forEachArray(F &&f) {
+        forEachArrayOf(*this, f);
+    }
+    template <typename F>
+    void forEachArray(F &&f) const {
+        forEachArrayOf(*this, f);
+    }
+    template <typename Self, typename F>
+    static void forEachArrayOf(Self &s, F &f) {
+        f(s.x), f(s.y), f(s.vx), f(s.vy), f(s.ax), f(s.ay);
+        f(s.lifetime), f(s.phase), f(s.temporary), f(s.inObjectState), f(s.event);
+        f(s.color), f(s.alpha), f(s.tile);
+        f(s.targetX), f(s.targetY), f(s.targetForce), f(s.fadeTime);
+    }
 };
 
 }  // namespace ME
\ No newline at end of file
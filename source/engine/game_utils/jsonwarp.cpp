@@ -2,9 +2,12 @@
 
 #include "jsonwarp.h"
 
+#include <charconv>
 #include <cmath>
 #include <cstring>
 
+#include "engine/core/frame_arena.hpp"
+
 namespace ME::Json {
 
 typedef unsigned char u_char;
@@ -569,4 +572,416 @@ bool Validator::validate(const Json &data, const Json &schema) {
     return true;
 }
 
+void Reader::space() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) p_++;
+}
+
+bool Reader::fail(const char* what) {
+    if (!failed_) {
+        failed_ = true;
+        what_ = what;
+        where_ = (size_t)(p_ - begin_);
+    }
+    return false;
+}
+
+std::string Reader::error() const { return failed_ ? std::string(what_) + " at offset " + std::to_string(where_) : std::string(); }
+
+bool Reader::literal(const char* word) {
+    const size_t n = strlen(word);
+    if ((size_t)(end_ - p_) < n || memcmp(p_, word, n) != 0) return false;
+    p_ += n;
+    return true;
+}
+
+bool Reader::open(char c) {
+    if (failed_) return false;
+    space();
+    if (p_ == end_ || *p_ != c) return fail(c == '{' ? "expected object" : "expected array");
+    p_++;
+    first_.push_back(true);
+    return true;
+}
+
+bool Reader::nextMember(std::string_view& key) {
+    if (failed_) return false;
+    space();
+    if (p_ < end_ && *p_ == '}') {
+        p_++;
+        first_.pop_back();
+        return false;
+    }
+    if (!first_.back()) {
+        if (p_ == end_ || *p_ != ',') return fail("expected ',' or '}'");
+        p_++;
+    }
+    first_.back() = false;
+    if (!string(key)) return false;
+    space();
+    if (p_ == end_ || *p_ != ':') return fail("expected ':'");
+    p_++;
+    return true;
+}
+
+bool Reader::nextElement() {
+    if (failed_) return false;
+    space();
+    if (p_ < end_ && *p_ == ']') {
+        p_++;
+        first_.pop_back();
+        return false;
+    }
+    if (!first_.back()) {
+        if (p_ == end_ || *p_ != ',') return fail("expected ',' or ']'");
+        p_++;
+    }
+    first_.back() = false;
+    return true;
+}
+
+namespace {
+
+int hex4(const char* p) {
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        const char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return v;
+}
+
+char* utf8(char* d, u32 cp) {
+    if (cp < 0x80) {
+        *d++ = (char)cp;
+    } else if (cp < 0x800) {
+        *d++ = (char)(0xc0 | (cp >> 6));
+        *d++ = (char)(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        *d++ = (char)(0xe0 | (cp >> 12));
+        *d++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *d++ = (char)(0x80 | (cp & 0x3f));
+    } else {
+        *d++ = (char)(0xf0 | (cp >> 18));
+        *d++ = (char)(0x80 | ((cp >> 12) & 0x3f));
+        *d++ = (char)(0x80 | ((cp >> 6) & 0x3f));
+        *d++ = (char)(0x80 | (cp & 0x3f));
+    }
+    return d;
+}
+
+}  // namespace
+
+bool Reader::string(std::string_view& out) {
+    if (failed_) return false;
+    space();
+    if (p_ == end_ || *p_ != '"') return fail("expected string");
+    const char* start = p_ + 1;
+
+    // 先找到结尾 没有转义时直接返回输入中的一段
+    bool escaped = false;
+    const char* q = start;
+    while (q < end_ && *q != '"') {
+        if ((u8)*q < 0x20) {
+            p_ = q;
+            return fail("control character in string");
+        }
+        if (*q == '\\') {
+            escaped = true;
+            q++;
+        }
+        q++;
+    }
+    if (q >= end_) return fail("unterminated string");
+    if (!escaped) {
+        out = std::string_view(start, (size_t)(q - start));
+        p_ = q + 1;
+        return true;
+    }
+
+    // 解码后不会比转义前长
+    char* buf = (char*)frame_arena::local().alloc((size_t)(q - start), 1);
+    char* d = buf;
+    for (const char* s = start; s < q;) {
+        if (*s != '\\') {
+            *d++ = *s++;
+            continue;
+        }
+        p_ = s;
+        switch (s[1]) {
+            case '"':
+            case '\\':
+            case '/':
+                *d++ = s[1];
+                s += 2;
+                break;
+            case 'b':
+                *d++ = '\b';
+                s += 2;
+                break;
+            case 'f':
+                *d++ = '\f';
+                s += 2;
+                break;
+            case 'n':
+                *d++ = '\n';
+                s += 2;
+                break;
+            case 'r':
+                *d++ = '\r';
+                s += 2;
+                break;
+            case 't':
+                *d++ = '\t';
+                s += 2;
+                break;
+            case 'u': {
+                int cp = q - s >= 6 ? hex4(s + 2) : -1;
+                if (cp < 0) return fail("bad \\u escape");
+                s += 6;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    // 代理对
+                    const int lo = q - s >= 6 && s[0] == '\\' && s[1] == 'u' ? hex4(s + 2) : -1;
+                    if (lo < 0xdc00 || lo >= 0xe000) return fail("bad surrogate pair");
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    s += 6;
+                }
+                d = utf8(d, (u32)cp);
+                break;
+            }
+            default:
+                return fail("bad escape");
+        }
+    }
+    out = std::string_view(buf, (size_t)(d - buf));
+    p_ = q + 1;
+    return true;
+}
+
+bool Reader::string(std::string& out) {
+    std::string_view s;
+    if (!string(s)) return false;
+    out.assign(s.data(), s.size());
+    return true;
+}
+
+bool Reader::number(double& out) {
+    if (failed_) return false;
+    space();
+    if (p_ == end_ || (*p_ != '-' && (*p_ < '0' || *p_ > '9'))) return fail("expected number");
+    auto [next, ec] = std::from_chars(p_, end_, out);
+    if (ec != std::errc()) return fail("bad number");
+    p_ = next;
+    return true;
+}
+
+bool Reader::number(i64& out) {
+    if (failed_) return false;
+    space();
+    if (p_ == end_ || (*p_ != '-' && (*p_ < '0' || *p_ > '9'))) return fail("expected number");
+    auto [next, ec] = std::from_chars(p_, end_, out);
+    if (ec == std::errc() && (next == end_ || (*next != '.' && *next != 'e' && *next != 'E'))) {
+        p_ = next;
+        return true;
+    }
+    // 小数或者超出范围 按浮点数读取后截断
+    double d;
+    if (!number(d)) return false;
+    out = d >= 9.2e18 ? INT64_MAX : d <= -9.2e18 ? INT64_MIN : (i64)d;
+    return true;
+}
+
+bool Reader::boolean(bool& out) {
+    if (failed_) return false;
+    space();
+    if (literal("true")) {
+        out = true;
+    } else if (literal("false")) {
+        out = false;
+    } else {
+        return fail("expected boolean");
+    }
+    return true;
+}
+
+bool Reader::null() {
+    if (failed_) return false;
+    space();
+    return literal("null");
+}
+
+bool Reader::skip() {
+    if (failed_) return false;
+    space();
+    if (p_ == end_) return fail("expected value");
+    switch (*p_) {
+        case '{':
+            return object([&](std::string_view) { return skip(); });
+        case '[':
+            return array([&]() { return skip(); });
+        case '"': {
+            std::string_view s;
+            return string(s);
+        }
+        case 't':
+        case 'f': {
+            bool b;
+            return boolean(b);
+        }
+        case 'n':
+            return null() || fail("expected value");
+        default: {
+            double d;
+            return number(d);
+        }
+    }
+}
+
+bool Reader::finish() {
+    if (failed_) return false;
+    space();
+    return p_ == end_ || fail("trailing characters");
+}
+
+void Writer::newline() {
+    if (!pretty_) return;
+    out_ += '\n';
+    out_.append(first_.size(), '\t');
+}
+
+void Writer::separate() {
+    if (afterKey_) {
+        afterKey_ = false;
+        return;
+    }
+    if (first_.empty()) return;
+    if (!first_.back()) out_ += ',';
+    first_.back() = false;
+    newline();
+}
+
+void Writer::close(char c) {
+    const bool empty = first_.back();
+    first_.pop_back();
+    if (!empty) newline();
+    out_ += c;
+}
+
+void Writer::quote(std::string_view s) {
+    static const char* digits = "0123456789abcdef";
+    out_ += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"':
+                out_ += "\\\"";
+                break;
+            case '\\':
+                out_ += "\\\\";
+                break;
+            case '\b':
+                out_ += "\\b";
+                break;
+            case '\f':
+                out_ += "\\f";
+                break;
+            case '\n':
+                out_ += "\\n";
+                break;
+            case '\r':
+                out_ += "\\r";
+                break;
+            case '\t':
+                out_ += "\\t";
+                break;
+            default:
+                if ((u8)c < 0x20) {
+                    out_ += "\\u00";
+                    out_ += digits[(u8)c >> 4];
+                    out_ += digits[(u8)c & 0xf];
+                } else {
+                    out_ += c;
+                }
+        }
+    }
+    out_ += '"';
+}
+
+Writer& Writer::beginObject() {
+    separate();
+    out_ += '{';
+    first_.push_back(true);
+    return *this;
+}
+
+Writer& Writer::endObject() {
+    close('}');
+    return *this;
+}
+
+Writer& Writer::beginArray() {
+    separate();
+    out_ += '[';
+    first_.push_back(true);
+    return *this;
+}
+
+Writer& Writer::endArray() {
+    close(']');
+    return *this;
+}
+
+Writer& Writer::key(std::string_view k) {
+    separate();
+    quote(k);
+    out_ += pretty_ ? ":\t" : ":";
+    afterKey_ = true;
+    return *this;
+}
+
+Writer& Writer::value(std::string_view s) {
+    separate();
+    quote(s);
+    return *this;
+}
+
+Writer& Writer::value(double n) {
+    separate();
+    if (!std::isfinite(n)) {
+        out_ += "null";
+        return *this;
+    }
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), n);
+    out_.append(buf, end);
+    return *this;
+}
+
+Writer& Writer::value(i64 n) {
+    separate();
+    char buf[24];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), n);
+    out_.append(buf, end);
+    return *this;
+}
+
+Writer& Writer::value(bool b) {
+    separate();
+    out_ += b ? "true" : "false";
+    return *this;
+}
+
+Writer& Writer::null() {
+    separate();
+    out_ += "null";
+    return *this;
+}
+
 }  // namespace ME::Json
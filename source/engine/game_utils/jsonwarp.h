@@ -5,11 +5,13 @@
 
 #include <iterator>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <functional>
 
 #include "engine/core/const.h"
+#include "engine/core/basic_types.h"
 #include "libs/cJSON.h"
 #include "libs/cJSON_Utils.h"
 
@@ -462,6 +464,111 @@ private:
     std::string error_;
 };
 
+// 流式读取 不建立 DOM 按调用者期望的结构逐个取值
+// 字符串没有转义时直接指向输入 有转义时解码到调用线程的 frame_arena 中 在所在的 frame_arena::scope 结束前有效
+// 任何一步格式不对之后所有调用都返回 false error() 给出位置
+class Reader {
+public:
+    explicit Reader(std::string_view text) : p_(text.data()), begin_(text.data()), end_(text.data() + text.size()) {}
+
+    // member(key) 必须读取或 skip() 这个键的值 返回 false 时停止
+    template <typename F>
+    bool object(F&& member) {
+        if (!open('{')) return false;
+        std::string_view key;
+        while (nextMember(key)) {
+            if (!member(key)) return fail("member rejected");
+        }
+        return !failed_;
+    }
+
+    // element() 必须读取或 skip() 一个元素
+    template <typename F>
+    bool array(F&& element) {
+        if (!open('[')) return false;
+        while (nextElement()) {
+            if (!element()) return fail("element rejected");
+        }
+        return !failed_;
+    }
+
+    bool string(std::string_view& out);
+    bool string(std::string& out);
+    bool number(double& out);
+    bool number(i64& out);
+    bool boolean(bool& out);
+    // 跳过任意一个值
+    bool skip();
+    // 下一个值是 null 时读掉它并返回 true
+    bool null();
+
+    // 值之后只剩空白
+    bool finish();
+
+    bool failed() const { return failed_; }
+    std::string error() const;
+
+private:
+    bool open(char c);
+    bool nextMember(std::string_view& key);
+    bool nextElement();
+    bool fail(const char* what);
+    void space();
+    bool literal(const char* word);
+
+    const char* p_;
+    const char* begin_;
+    const char* end_;
+    // 容器内是否已经读过一项
+    std::vector<bool> first_;
+    bool failed_ = false;
+    const char* what_ = nullptr;
+    size_t where_ = 0;
+};
+
+// 流式写出 直接拼接到一个 std::string 中 pretty 时与 Json::print 一样按 tab 缩进
+class Writer {
+public:
+    explicit Writer(bool pretty = false) : pretty_(pretty) {}
+
+    Writer& beginObject();
+    Writer& endObject();
+    Writer& beginArray();
+    Writer& endArray();
+    // 对象中的下一个键 之后写它的值
+    Writer& key(std::string_view k);
+
+    Writer& value(std::string_view s);
+    Writer& value(const char* s) { return value(std::string_view(s)); }
+    Writer& value(const std::string& s) { return value(std::string_view(s)); }
+    Writer& value(double n);
+    Writer& value(i64 n);
+    Writer& value(int n) { return value((i64)n); }
+    Writer& value(u32 n) { return value((i64)n); }
+    Writer& value(bool b);
+    Writer& null();
+
+    // 对象中的键值对
+    template <typename T>
+    Writer& member(std::string_view k, const T& v) {
+        return key(k).value(v);
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void separate();
+    void newline();
+    void close(char c);
+    void quote(std::string_view s);
+
+    std::string out_;
+    // 每层容器是否已经写过一项
+    std::vector<bool> first_;
+    bool afterKey_ = false;
+    bool pretty_;
+};
+
 }  // namespace ME::Json
 
-#endif
\ No newline at end of file
+#endif
@@ -190,7 +190,11 @@ int MarkdownPlot::text_callback(MD_TEXTTYPE type, const MD_CHAR *wt, MD_SIZE siz
 
 void MarkdownPlot::debug_log_callback(const char * /*msg*/, void * /* userdata */) {}
 
-void MarkdownPlot::parser(std::string test) {
+void MarkdownPlot::parser(const std::string &test) {
+    const size_t hash = std::hash<std::string_view>{}(test);
+    if (parsed && source_size == test.size() && source_hash == hash) return;
+    reset();
+
     unsigned parser_flags = MD_DIALECT_GITHUB;
     unsigned renderer_flags = 0;
 
@@ -205,6 +209,10 @@ void MarkdownPlot::parser(std::string test) {
     UserdataPayload userdata{"userdata payload"};
     MD_RENDER_HTML render = {process_output, (void *)&userdata, renderer_flags};
     int status = md_parse(test.c_str(), test.size(), &renderer, (void *)&render);
+
+    parsed = status == 0;
+    source_hash = hash;
+    source_size = test.size();
 }
 
 plot *MarkdownPlot::check(std::string_view title) {
@@ -218,6 +226,7 @@ void MarkdownPlot::reset() {
     tr = 0;
     td = 0;
     plotmap.clear();
+    parsed = false;
 }
 
 int MarkdownPlot::tr = 0;
@@ -225,6 +234,10 @@ int MarkdownPlot::td = 0;
 
 std::vector<plot> MarkdownPlot::plotmap = {};
 
+bool MarkdownPlot::parsed = false;
+size_t MarkdownPlot::source_hash = 0;
+size_t MarkdownPlot::source_size = 0;
+
 int test_mdplot() {
 
     std::string test = R"(
@@ -40,7 +40,8 @@ private:
     };
 
 public:
-    static void parser(std::string test);
+    // 文本与上次解析的相同时直接使用已有的 plotmap 否则 reset 后重新解析
+    static void parser(const std::string &test);
     static plot *check(std::string_view title);
     static void reset();
 
@@ -49,6 +50,12 @@ public:
     static int td;
 
     static std::vector<plot> plotmap;
+
+private:
+    // plotmap 对应的文本
+    static bool parsed;
+    static size_t source_hash;
+    static size_t source_size;
 };
 
 int test_mdplot();
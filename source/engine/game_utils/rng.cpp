@@ -5,8 +5,10 @@
 #include "engine/core/mathlib.hpp"
 #include "engine/utils/utility.hpp"
 
-RNG* RNG_Create() {
-    srand(time(NULL));
+RNG* RNG_Create() { return RNG_Create((u32)time(NULL)); }
+
+RNG* RNG_Create(u32 seed) {
+    srand(seed);
     RNG* sRNG = new RNG;
     sRNG->root_seed = rand();
     return sRNG;
@@ -17,3 +19,11 @@ void RNG_Delete(RNG* rng) {
 }
 
 u32 RNG_Next(RNG* rng) { return rand(); }
+
+static thread_local RNG_Scope* g_rngScope = nullptr;
+
+RNG_Scope::RNG_Scope(u64 seed) : rng(seed), prev(g_rngScope) { g_rngScope = this; }
+
+RNG_Scope::~RNG_Scope() { g_rngScope = prev; }
+
+int RNG_Rand() { return g_rngScope ? g_rngScope->rng.next() : rand(); }
@@ -1,5 +1,7 @@
 // Copyright(c) 2022-2023, KaoruXun All rights reserved.
 
+#pragma once
+
 #include "engine/core/core.hpp"
 #include "engine/core/mathlib.hpp"
 
@@ -9,5 +11,49 @@ typedef struct RNG {
 } RNG;
 
 RNG* RNG_Create();
+// 用给定的种子重置 rand() 回放时用录制的种子
+RNG* RNG_Create(u32 seed);
 void RNG_Delete(RNG* rng);
-u32 RNG_Next(RNG* rng);
\ No newline at end of file
+u32 RNG_Next(RNG* rng);
+
+// 把若干个整数混合成种子 (splitmix64 的终结函数)
+inline u64 RNG_Mix(u64 x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+inline u64 RNG_Mix(u64 a, u64 b) { return RNG_Mix(a ^ RNG_Mix(b)); }
+
+// 不加锁的 xorshift64* 每个任务各用一个 同样的种子得到同样的序列
+// next() 与 rand() 一样返回 [0, 2^31) 的 int 可以直接替换 rand() % n
+struct FastRNG {
+    u64 state;
+
+    explicit FastRNG(u64 seed) : state(RNG_Mix(seed) | 1) {}
+
+    int next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (int)((state * 0x2545f4914f6cdd1dull) >> 33);
+    }
+};
+
+// 区块生成的种子 只由世界种子 区块坐标和阶段决定 与生成的顺序和线程无关
+inline u64 RNG_Chunk(u64 worldSeed, int cx, int cy, u32 phase) { return RNG_Mix(RNG_Mix(worldSeed, ((u64)(u32)cx << 32) | (u32)cy), phase); }
+
+// 作用域内当前线程的 RNG_Rand 取自 seed 的 FastRNG 作用域外与 rand() 相同
+// 生成器和 Populator 调用的 TilesCreate* 等函数在游戏中也会用到 不改它们的参数
+struct RNG_Scope {
+    explicit RNG_Scope(u64 seed);
+    ~RNG_Scope();
+    RNG_Scope(const RNG_Scope &) = delete;
+    RNG_Scope &operator=(const RNG_Scope &) = delete;
+
+    FastRNG rng;
+    RNG_Scope *prev;
+};
+
+int RNG_Rand();
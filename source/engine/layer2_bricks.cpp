@@ -0,0 +1,100 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "layer2_bricks.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace ME {
+
+Layer2Bricks &Layer2Bricks::operator=(const Layer2Bricks &other) {
+    if (this == &other) return *this;
+    for (int b = 0; b < BRICK_COUNT; b++) {
+        if (!other.bricks[b]) {
+            bricks[b].reset();
+            continue;
+        }
+        if (!bricks[b]) bricks[b] = std::make_unique<MaterialInstance[]>(BRICK_PIXELS);
+        std::copy_n(other.bricks[b].get(), BRICK_PIXELS, bricks[b].get());
+    }
+    mask = other.mask;
+    return *this;
+}
+
+Layer2Bricks &Layer2Bricks::operator=(Layer2Bricks &&other) noexcept {
+    if (this == &other) return *this;
+    for (int b = 0; b < BRICK_COUNT; b++) bricks[b] = std::move(other.bricks[b]);
+    mask = other.mask;
+    other.mask = 0;
+    return *this;
+}
+
+int Layer2Bricks::brick_count() const { return std::popcount(mask); }
+
+MaterialInstance *Layer2Bricks::alloc_brick(int b) {
+    if (!bricks[b]) {
+        bricks[b] = std::make_unique<MaterialInstance[]>(BRICK_PIXELS);
+        std::fill_n(bricks[b].get(), BRICK_PIXELS, Tiles_NOTHING);
+        mask |= (u64)1 << b;
+    }
+    return bricks[b].get();
+}
+
+void Layer2Bricks::set(int x, int y, const MaterialInstance &m) {
+    const int b = brick_of(x, y);
+    if (!bricks[b] && is_empty(m)) return;
+    alloc_brick(b)[x % BRICK + (y % BRICK) * BRICK] = m;
+}
+
+void Layer2Bricks::read_row(int x, int y, int n, MaterialInstance *dst) const {
+    while (n > 0) {
+        const int run = std::min(n, BRICK - x % BRICK);
+        const MaterialInstance *p = bricks[brick_of(x, y)].get();
+        if (p) {
+            std::copy_n(p + x % BRICK + (y % BRICK) * BRICK, run, dst);
+        } else {
+            std::fill_n(dst, run, Tiles_NOTHING);
+        }
+        x += run;
+        dst += run;
+        n -= run;
+    }
+}
+
+void Layer2Bricks::assign(const MaterialInstance *dense) {
+    for (int b = 0; b < BRICK_COUNT; b++) {
+        const int x0 = (b % BRICKS_X) * BRICK, y0 = (b / BRICKS_X) * BRICK;
+        bool any = false;
+        for (int y = 0; y < BRICK && !any; y++) {
+            const MaterialInstance *row = dense + x0 + (y0 + y) * CHUNK_W;
+            any = std::any_of(row, row + BRICK, [](const MaterialInstance &m) { return !is_empty(m); });
+        }
+        if (!any) {
+            bricks[b].reset();
+            mask &= ~((u64)1 << b);
+            continue;
+        }
+        MaterialInstance *p = alloc_brick(b);
+        for (int y = 0; y < BRICK; y++) std::copy_n(dense + x0 + (y0 + y) * CHUNK_W, BRICK, p + y * BRICK);
+    }
+}
+
+void Layer2Bricks::to_dense(MaterialInstance *dst) const {
+    for (int y = 0; y < CHUNK_H; y++) read_row(0, y, CHUNK_W, dst + y * CHUNK_W);
+}
+
+void Layer2Bricks::clear() {
+    for (auto &b : bricks) b.reset();
+    mask = 0;
+}
+
+void Layer2Bricks::compact() {
+    for (int b = 0; b < BRICK_COUNT; b++) {
+        const MaterialInstance *p = bricks[b].get();
+        if (!p || std::any_of(p, p + BRICK_PIXELS, [](const MaterialInstance &m) { return !is_empty(m); })) continue;
+        bricks[b].reset();
+        mask &= ~((u64)1 << b);
+    }
+}
+
+}  // namespace ME
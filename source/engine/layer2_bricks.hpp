@@ -0,0 +1,71 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LAYER2_BRICKS_HPP
+#define ME_LAYER2_BRICKS_HPP
+
+#include <memory>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "game_datastruct.hpp"
+
+namespace ME {
+
+// 区块的第二层像素 按 BRICK x BRICK 的块懒分配
+// 大部分区块的第二层全是空气 没有任何块时 empty() 为 true 不占像素内存
+// 没有分配的块读出来都是 Tiles_NOTHING 写入空气不会分配块
+class Layer2Bricks {
+public:
+    static constexpr int BRICK = 16;
+    static constexpr int BRICKS_X = CHUNK_W / BRICK;
+    static constexpr int BRICKS_Y = CHUNK_H / BRICK;
+    static constexpr int BRICK_COUNT = BRICKS_X * BRICKS_Y;
+    static constexpr int BRICK_PIXELS = BRICK * BRICK;
+    static_assert(CHUNK_W % BRICK == 0 && CHUNK_H % BRICK == 0 && BRICK_COUNT <= 64);
+
+    Layer2Bricks() = default;
+    Layer2Bricks(const Layer2Bricks &other) { *this = other; }
+    Layer2Bricks(Layer2Bricks &&other) noexcept { *this = std::move(other); }
+    Layer2Bricks &operator=(const Layer2Bricks &other);
+    Layer2Bricks &operator=(Layer2Bricks &&other) noexcept;
+
+    // 与 Tiles_NOTHING 相同的材料 存档和块都不需要记录
+    static bool is_empty(const MaterialInstance &m) { return m.mat->id == Tiles_NOTHING.mat->id; }
+    static int brick_of(int x, int y) { return x / BRICK + (y / BRICK) * BRICKS_X; }
+
+    bool empty() const { return mask == 0; }
+    // 第 b 位表示块 b 已经分配 块按行排列
+    u64 brick_mask() const { return mask; }
+    int brick_count() const;
+
+    // 块内 BRICK_PIXELS 个像素按行存放 没有分配时为 nullptr
+    const MaterialInstance *brick(int b) const { return bricks[b].get(); }
+    // 分配块 b 内容为 Tiles_NOTHING 已经分配时直接返回
+    MaterialInstance *alloc_brick(int b);
+
+    MaterialInstance get(int x, int y) const {
+        const MaterialInstance *p = bricks[brick_of(x, y)].get();
+        return p ? p[x % BRICK + (y % BRICK) * BRICK] : Tiles_NOTHING;
+    }
+    void set(int x, int y, const MaterialInstance &m);
+
+    // 读取 (x, y) 开始的 n 个像素 不能越过区块的右边
+    void read_row(int x, int y, int n, MaterialInstance *dst) const;
+
+    // 从 CHUNK_W x CHUNK_H 的数组转换 只分配含有非空像素的块
+    void assign(const MaterialInstance *dense);
+    void to_dense(MaterialInstance *dst) const;
+    void clear();
+    // 释放已经全部变回空气的块
+    void compact();
+
+    size_t memory_bytes() const { return (size_t)brick_count() * BRICK_PIXELS * sizeof(MaterialInstance); }
+
+private:
+    std::unique_ptr<MaterialInstance[]> bricks[BRICK_COUNT];
+    u64 mask = 0;
+};
+
+}  // namespace ME
+
+#endif
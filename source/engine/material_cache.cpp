@@ -0,0 +1,359 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "material_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/io/filesystem.h"
+#include "engine/utils/utility.hpp"
+#include "game.hpp"
+#include "game_datastruct.hpp"
+#include "libs/lz4/xxhash.h"
+
+namespace ME {
+
+namespace MaterialCache {
+
+namespace {
+
+// 文件依次为 header 材料记录 名字 每个材料的标记 原始 interaction / reaction 和 MaterialTable 的数组
+// 只在同一台机器上读写 按本机字节序直接存放
+constexpr char CACHE_MAGIC[4] = {'M', 'E', 'M', 'T'};
+constexpr u32 CACHE_FORMAT = 1;
+
+struct header {
+    char magic[4];
+    u32 format;
+    u64 key;
+    u32 count;
+    // 内置材料个数 这些材料不在记录中
+    u32 builtin;
+    u32 stringBytes;
+    u32 rawInteractions;
+    u32 rawReactions;
+    u32 tableInteractions;
+    u32 tableReactions;
+    u32 scriptCount;
+};
+
+// 内置材料之后注册的材料
+struct record {
+    // ScriptableMaterials 的键 随机生成的材料为 -1
+    i32 scriptId;
+    i32 physicsType;
+    u8 alpha;
+    u8 pad[3];
+    f32 density;
+    i32 iterations;
+    i32 emit;
+    u32 emitColor;
+    u32 color;
+    u32 addTemp;
+    f32 conductionSelf;
+    f32 conductionOther;
+    i32 slipperyness;
+    u32 nameLen;
+    u32 indexNameLen;
+};
+
+// 所有材料的 interact / react 标记
+struct links {
+    u8 interact;
+    u8 react;
+    u8 pad[2];
+    i32 nReactions;
+};
+
+// materials_container[a]->interactions[b] 中的一项 顺序与原来相同
+struct raw_interaction {
+    u32 a;
+    u32 b;
+    MaterialInteraction in;
+};
+
+struct raw_reaction {
+    u32 a;
+    MaterialInteraction in;
+};
+
+static_assert(std::is_trivially_copyable_v<MaterialInteraction>);
+static_assert(std::is_trivially_copyable_v<MaterialTable::Span>);
+
+template <typename T>
+void put(std::string &out, const T &v) {
+    out.append((const char *)&v, sizeof(T));
+}
+
+template <typename T>
+void put_array(std::string &out, const std::vector<T> &v) {
+    if (!v.empty()) out.append((const char *)v.data(), v.size() * sizeof(T));
+}
+
+struct reader {
+    const char *data;
+    size_t size;
+    size_t at = 0;
+
+    bool take(void *dst, size_t n) {
+        if (n > size - at) return false;
+        if (n) memcpy(dst, data + at, n);
+        at += n;
+        return true;
+    }
+
+    template <typename T>
+    bool take_array(std::vector<T> &v, size_t n) {
+        if (n > (size - at) / sizeof(T)) return false;
+        v.resize(n);
+        return take(v.data(), n * sizeof(T));
+    }
+};
+
+bool spans_valid(const std::vector<MaterialTable::Span> &spans, size_t total) {
+    for (const MaterialTable::Span &s : spans) {
+        if (s.begin > total || s.count > total - s.begin) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+u64 source_key() {
+    std::string src;
+    // 材料只在 game.lua 中初始化和注册
+    for (const char *script : {"data/scripts/game.lua", "data/scripts/game_datastruct.lua"}) {
+        const std::string path = ME_fs_get_path(script);
+        if (ME_fs_exists(path)) src += ME_fs_readfile(path);
+        src += '\0';
+    }
+    src += METADOT_VERSION_TEXT;
+    put(src, MATERIAL_CACHE_VERSION);
+    put(src, (u32)sizeof(MaterialInteraction));
+
+    // C++ 中定义的内置材料
+    for (const Material *m : GAME()->materials_container) {
+        src += m->name;
+        src += '\0';
+        src += m->index_name;
+        src += '\0';
+        put(src, m->id);
+        put(src, m->physicsType);
+        put(src, m->alpha);
+        put(src, m->density);
+        put(src, m->iterations);
+        put(src, m->emit);
+        put(src, m->emitColor);
+        put(src, m->color);
+        put(src, m->addTemp);
+        put(src, m->conductionSelf);
+        put(src, m->conductionOther);
+        put(src, m->slipperyness);
+    }
+    return XXH64(src.data(), src.size(), 0);
+}
+
+bool load(const std::string &path, u64 key) {
+    if (!ME_fs_exists(path)) return false;
+
+    ME_fs_mapped_file file;
+    if (!ME_fs_map_file(path.c_str(), file)) return false;
+
+    header h;
+    std::vector<record> records;
+    std::string strings;
+    std::vector<links> flags;
+    std::vector<raw_interaction> rawInteractions;
+    std::vector<raw_reaction> rawReactions;
+    MaterialTable table;
+
+    const u32 builtin = (u32)GAME()->materials_container.size();
+    bool ok = false;
+    {
+        reader r{file.data, file.size};
+        ok = r.take(&h, sizeof(h)) && memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) == 0 && h.format == CACHE_FORMAT && h.key == key && h.builtin == builtin && h.count >= builtin;
+        if (ok) {
+            const size_t count = h.count;
+            strings.resize(h.stringBytes);
+            ok = r.take_array(records, count - builtin) && r.take(strings.data(), strings.size()) && r.take_array(flags, count) && r.take_array(rawInteractions, h.rawInteractions) &&
+                 r.take_array(rawReactions, h.rawReactions) && r.take_array(table.physicsType, count) && r.take_array(table.iterations, count) && r.take_array(table.density, count) &&
+                 r.take_array(table.alpha, count) && r.take_array(table.checks, count) && r.take_array(table.interactionSpans, count * count) &&
+                 r.take_array(table.interactions, h.tableInteractions) && r.take_array(table.reactionSpans, count) && r.take_array(table.reactions, h.tableReactions) && r.at == r.size;
+        }
+    }
+    ME_fs_unmap_file(file);
+    if (!ok) return false;
+
+    // 先检查再注册 失败时不留下半套材料
+    size_t stringsUsed = 0;
+    for (const record &rec : records) {
+        if ((size_t)rec.nameLen + rec.indexNameLen > strings.size() - stringsUsed) return false;
+        stringsUsed += (size_t)rec.nameLen + rec.indexNameLen;
+        if (rec.scriptId >= 0 && GAME()->materials_list.ScriptableMaterials.count(rec.scriptId)) return false;
+    }
+    for (const raw_interaction &in : rawInteractions) {
+        if (in.a >= h.count || in.b >= h.count) return false;
+    }
+    for (const raw_reaction &in : rawReactions) {
+        if (in.a >= h.count) return false;
+    }
+    if (stringsUsed != strings.size() || !spans_valid(table.interactionSpans, table.interactions.size()) || !spans_valid(table.reactionSpans, table.reactions.size())) return false;
+
+    size_t randomCount = 0;
+    for (const record &rec : records) {
+        if (rec.scriptId < 0) randomCount++;
+    }
+    // 与 InitMaterials 中的 randMats 一样 随游戏一直存在
+    Material *randMats = randomCount ? new Material[randomCount] : nullptr;
+
+    size_t at = 0, nextRandom = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const record &rec = records[i];
+        const std::string name = strings.substr(at, rec.nameLen);
+        const std::string index_name = strings.substr(at + rec.nameLen, rec.indexNameLen);
+        at += (size_t)rec.nameLen + rec.indexNameLen;
+
+        Material m((mat_id)(builtin + i), name, index_name, (PhysicsType)rec.physicsType, rec.slipperyness, rec.alpha, rec.density, rec.iterations, rec.emit, rec.emitColor, rec.color);
+        m.addTemp = rec.addTemp;
+        m.conductionSelf = rec.conductionSelf;
+        m.conductionOther = rec.conductionOther;
+
+        Material *mat;
+        if (rec.scriptId >= 0) {
+            mat = &GAME()->materials_list.ScriptableMaterials.insert(std::make_pair((int)rec.scriptId, m)).first->second;
+        } else {
+            randMats[nextRandom] = m;
+            mat = &randMats[nextRandom++];
+        }
+        GAME()->materials_container.push_back(mat);
+        GAME()->material_registry.add(mat->index_name, mat->id);
+    }
+    GAME()->materials_count = (i32)h.count;
+
+    for (u32 a = 0; a < h.count; a++) {
+        Material *mat = GAME()->materials_container[a];
+        mat->interact = flags[a].interact != 0;
+        mat->interactions = new std::vector<MaterialInteraction>[h.count];
+        mat->nInteractions = new int[h.count]();
+        mat->interactionsSize = (int)h.count;
+        mat->react = flags[a].react != 0;
+        mat->nReactions = flags[a].nReactions;
+        mat->reactions.clear();
+    }
+    for (const raw_interaction &in : rawInteractions) {
+        Material *mat = GAME()->materials_container[in.a];
+        mat->interactions[in.b].push_back(in.in);
+        mat->nInteractions[in.b]++;
+    }
+    for (const raw_reaction &in : rawReactions) GAME()->materials_container[in.a]->reactions.push_back(in.in);
+
+    table.count = h.count;
+    table.scriptCount = h.scriptCount;
+    GAME()->materials_table = std::move(table);
+    GAME()->materials_cached = true;
+    return true;
+}
+
+bool save(const std::string &path, u64 key) {
+    const std::vector<Material *> &materials = GAME()->materials_container;
+    const MaterialTable &table = GAME()->materials_table;
+    const u32 count = (u32)materials.size();
+    const u32 builtin = GAME()->materials_builtin;
+    if (table.count != count || builtin > count) return false;
+
+    std::unordered_map<const Material *, int> scriptIds;
+    for (const auto &[id, m] : GAME()->materials_list.ScriptableMaterials) scriptIds[&m] = id;
+
+    std::string recordBytes, strings, flagBytes, interactionBytes, reactionBytes;
+    u32 nInteractions = 0, nReactions = 0;
+    for (u32 a = 0; a < count; a++) {
+        const Material *m = materials[a];
+
+        if (a >= builtin) {
+            record rec{};
+            auto it = scriptIds.find(m);
+            rec.scriptId = it != scriptIds.end() ? it->second : -1;
+            rec.physicsType = m->physicsType;
+            rec.alpha = m->alpha;
+            rec.density = m->density;
+            rec.iterations = m->iterations;
+            rec.emit = m->emit;
+            rec.emitColor = m->emitColor;
+            rec.color = m->color;
+            rec.addTemp = m->addTemp;
+            rec.conductionSelf = m->conductionSelf;
+            rec.conductionOther = m->conductionOther;
+            rec.slipperyness = m->slipperyness;
+            rec.nameLen = (u32)m->name.size();
+            rec.indexNameLen = (u32)m->index_name.size();
+            put(recordBytes, rec);
+            strings += m->name;
+            strings += m->index_name;
+        }
+
+        links l{};
+        l.interact = m->interact;
+        l.react = m->react;
+        l.nReactions = m->nReactions;
+        put(flagBytes, l);
+
+        if (m->interactions && m->nInteractions) {
+            for (int b = 0; b < m->interactionsSize; b++) {
+                const int n = std::min(m->nInteractions[b], (int)m->interactions[b].size());
+                for (int j = 0; j < n; j++) {
+                    put(interactionBytes, raw_interaction{a, (u32)b, m->interactions[b][j]});
+                    nInteractions++;
+                }
+            }
+        }
+        for (const MaterialInteraction &in : m->reactions) {
+            put(reactionBytes, raw_reaction{a, in});
+            nReactions++;
+        }
+    }
+
+    header h{};
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.format = CACHE_FORMAT;
+    h.key = key;
+    h.count = count;
+    h.builtin = builtin;
+    h.stringBytes = (u32)strings.size();
+    h.rawInteractions = nInteractions;
+    h.rawReactions = nReactions;
+    h.tableInteractions = (u32)table.interactions.size();
+    h.tableReactions = (u32)table.reactions.size();
+    h.scriptCount = table.scriptCount;
+
+    std::string out;
+    put(out, h);
+    out += recordBytes;
+    out += strings;
+    out += flagBytes;
+    out += interactionBytes;
+    out += reactionBytes;
+    put_array(out, table.physicsType);
+    put_array(out, table.iterations);
+    put_array(out, table.density);
+    put_array(out, table.alpha);
+    put_array(out, table.checks);
+    put_array(out, table.interactionSpans);
+    put_array(out, table.interactions);
+    put_array(out, table.reactionSpans);
+    put_array(out, table.reactions);
+
+    if (!ME_fs_write_file_atomic(path, out.data(), out.size())) {
+        METADOT_WARN(std::format("Failed to write material cache {0}", path).c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace MaterialCache
+
+}  // namespace ME
@@ -0,0 +1,38 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_MATERIAL_CACHE_HPP
+#define ME_MATERIAL_CACHE_HPP
+
+#include <string>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 材料表缓存 (相对 ME_fs_get_path)
+#define MATERIAL_CACHE_FILE "materials.bin"
+
+// 编译好的材料表缓存
+// 第一次启动 (或来源变化) 时 PushMaterials 把内置材料之后注册的材料 (随机生成的 Mat_* 和脚本材料)
+// 所有材料的 interaction / reaction 以及 MaterialTable 的各个数组写进缓存
+// 之后启动 InitMaterials 只注册 C++ 里的内置材料 其余部分从映射的文件中整块复制 不再随机生成和逐个材料构建
+// key 由 game.lua game_datastruct.lua 的内容 内置材料的属性和 MATERIAL_CACHE_VERSION 算出 任何一项变化都回到原来的加载流程
+// 随机材料因此在多次启动之间保持不变 要重新生成时删掉缓存文件即可
+namespace MaterialCache {
+
+// 修改 InitMaterials 中硬编码的 interaction / reaction 时加一
+constexpr u32 MATERIAL_CACHE_VERSION = 1;
+
+// 在内置材料注册完之后调用
+u64 source_key();
+
+// 成功时材料已注册 materials_table 已填好 GAME()->materials_cached 为 true
+// 失败时不改动任何状态
+bool load(const std::string &path, u64 key);
+bool save(const std::string &path, u64 key);
+
+}  // namespace MaterialCache
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,97 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "memory_budget.hpp"
+
+#include <format>
+#include <string>
+
+#include "engine/core/profiler.hpp"
+#include "engine/utils/utility.hpp"
+
+namespace ME {
+
+const char *MemoryBudget::tag_name(MemTag tag) {
+    switch (tag) {
+        case MemTag::Allocator:
+            return "allocator";
+        case MemTag::WorldPlanes:
+            return "world planes";
+        case MemTag::Chunks:
+            return "chunks";
+        case MemTag::ChunkCache:
+            return "chunk cache";
+        case MemTag::RigidBodies:
+            return "rigid bodies";
+        case MemTag::Particles:
+            return "particles";
+        case MemTag::Textures:
+            return "textures";
+        case MemTag::Lua:
+            return "lua";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryBudget::set_reporter(MemTag tag, Reporter reporter) { reporters[(int)tag] = std::move(reporter); }
+
+void MemoryBudget::add_policy(const char *name, Relieve relieve, Restore restore) { policies.push_back({name, std::move(relieve), std::move(restore)}); }
+
+void MemoryBudget::update(i64 now, int budgetMb) {
+    if (lastUpdate != 0 && now - lastUpdate < INTERVAL_MS) return;
+    lastUpdate = now;
+    ME_profiler_scope_auto("MemoryBudget");
+
+    sum = 0;
+    for (int t = 0; t < (int)MemTag::Count; t++) {
+        usage[t] = reporters[t] ? reporters[t]() : 0;
+        sum += usage[t];
+    }
+
+#ifndef ME_DISABLE_PROFILING
+    static u32 stats[(int)MemTag::Count + 1];
+    static bool registered = false;
+    if (!registered) {
+        static std::string names[(int)MemTag::Count];
+        for (int t = 0; t < (int)MemTag::Count; t++) {
+            names[t] = std::string("mem ") + tag_name((MemTag)t);
+            stats[t] = ME_profiler_stat_register(names[t].c_str(), true);
+        }
+        stats[(int)MemTag::Count] = ME_profiler_stat_register("mem total", true);
+        registered = true;
+    }
+    for (int t = 0; t < (int)MemTag::Count; t++) ME_profiler_stat_set(stats[t], (i64)usage[t]);
+    ME_profiler_stat_set(stats[(int)MemTag::Count], (i64)sum);
+#endif
+
+    limit = budgetMb > 0 ? (u64)budgetMb << 20 : 0;
+    if (limit == 0) return;
+
+    if (sum > limit) {
+        const u64 excess = sum - limit;
+        u64 freed = 0;
+        for (policy &p : policies) {
+            if (freed >= excess) break;
+            const u64 f = p.relieve(excess - freed);
+            if (f == 0) continue;
+            p.active = true;
+            freed += f;
+            METADOT_INFO(std::format("Memory budget: {0} freed about {1:.1f} MB", p.name, f / 1048576.0).c_str());
+        }
+        relieved++;
+        METADOT_WARN(std::format("Memory {0:.1f} MB is over the budget of {1} MB, freed about {2:.1f} MB", sum / 1048576.0, budgetMb, freed / 1048576.0).c_str());
+    } else if ((f64)sum < (f64)limit * RESTORE_RATIO) {
+        // 最后执行的策略最先撤销
+        for (auto it = policies.rbegin(); it != policies.rend(); ++it) {
+            if (!it->active) continue;
+            it->active = false;
+            if (it->restore) {
+                it->restore();
+                METADOT_INFO(std::format("Memory budget: restored {0}", it->name).c_str());
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace ME
@@ -0,0 +1,65 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_MEMORY_BUDGET_HPP
+#define ME_MEMORY_BUDGET_HPP
+
+#include <functional>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 按子系统统计的内存 game::memory
+enum class MemTag : u8 { Allocator, WorldPlanes, Chunks, ChunkCache, RigidBodies, Particles, Textures, Lua, Count };
+
+// 内存预算 (memory_budget_mb)
+// 每个子系统注册一个返回当前字节数的函数 每 INTERVAL_MS 汇总一次 写入同名的分析器计数 ("mem <tag>")
+// 总量超出预算时按注册顺序执行策略 直到估计释放的字节数足够 代价小 容易恢复的策略先注册
+// 总量回到预算的 RESTORE_RATIO 以下时 按相反的顺序撤销执行过的策略 每次只撤销一个
+// 统计的是各子系统自己估计的大小 不是进程的实际占用 ME_MALLOC 之外的分配 (std::vector 等) 只在各子系统的估计中出现
+class MemoryBudget {
+public:
+    static constexpr i64 INTERVAL_MS = 1000;
+    static constexpr f64 RESTORE_RATIO = 0.75;
+
+    using Reporter = std::function<u64()>;
+    // 参数为超出预算的字节数 返回大约释放了多少
+    using Relieve = std::function<u64(u64 excess)>;
+    using Restore = std::function<void()>;
+
+    static const char *tag_name(MemTag tag);
+
+    void set_reporter(MemTag tag, Reporter reporter);
+    // name 必须是字符串常量
+    void add_policy(const char *name, Relieve relieve, Restore restore = {});
+
+    // 每帧调用 budgetMb 小于等于 0 时只统计不执行策略
+    void update(i64 now, int budgetMb);
+
+    u64 bytes(MemTag tag) const { return usage[(int)tag]; }
+    u64 total() const { return sum; }
+    u64 budget() const { return limit; }
+    // 执行过策略的次数
+    u32 relief_count() const { return relieved; }
+
+private:
+    struct policy {
+        const char *name;
+        Relieve relieve;
+        Restore restore;
+        bool active = false;
+    };
+
+    Reporter reporters[(int)MemTag::Count];
+    u64 usage[(int)MemTag::Count] = {};
+    u64 sum = 0;
+    u64 limit = 0;
+    std::vector<policy> policies;
+    i64 lastUpdate = 0;
+    u32 relieved = 0;
+};
+
+}  // namespace ME
+
+#endif
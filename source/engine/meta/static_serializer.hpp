@@ -0,0 +1,394 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_STATIC_SERIALIZER_HPP
+#define ME_STATIC_SERIALIZER_HPP
+
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "engine/meta/static_relfection.hpp"
+
+// 按 static_refl::TypeInfo 的字段列表生成的二进制序列化
+// 走哪条路径在编译期决定 运行时不按名字查找字段 也不经过 JSON
+//
+// 类型属性
+//   Attr{TSTR("Serialize::Version"), 2}    当前版本 默认 1
+// 字段属性
+//   Attr{TSTR("Serialize::Since"), 2}      从第 2 版开始保存 读更早的数据时保留默认值
+//   Attr{TSTR("Serialize::Until"), 3}      只在第 3 版之前保存 写出时跳过 读旧数据时照常读入
+//   Attr{TSTR("Serialize::Transient")}     不保存
+// 指针字段 静态字段和成员函数不保存
+//
+// 格式 (本机字节序 与 ChunkCodec 相同)
+//   对象      u32 版本 + 字段内容
+//   字段内容  先基类 (非虚) 再按 fields 的顺序写每个保存的字段
+//   数值 枚举 原样
+//   string    u32 长度 + 字节
+//   vector    u32 个数 + 元素 元素有 TypeInfo 时个数之后写一次元素类型的版本 元素只写字段内容
+//   数组      逐个元素
+// 平凡可复制 没有填充 字段按内存顺序声明 每个版本都保存全部字段的类型 (IsBlittable)
+// 它的字段内容与内存布局完全相同 数组和 vector 中的这类元素整段 memcpy
+//
+// 不支持的字段类型编译时报错 需要标记 Serialize::Transient
+namespace ME::meta::static_refl {
+
+namespace detail {
+
+template <typename T, typename = void>
+struct HasTypeInfo : std::false_type {};
+template <typename T>
+struct HasTypeInfo<T, std::void_t<decltype(TypeInfo<T>::fields)>> : std::true_type {};
+
+template <typename T>
+struct IsVector : std::false_type {};
+template <typename E, typename A>
+struct IsVector<std::vector<E, A>> : std::true_type {};
+
+template <typename T>
+struct IsStdArray : std::false_type {};
+template <typename E, std::size_t N>
+struct IsStdArray<std::array<E, N>> : std::true_type {};
+
+template <typename>
+inline constexpr bool AlwaysFalse = false;
+
+inline constexpr auto SerializeVersion = TSTR("Serialize::Version");
+inline constexpr auto SerializeSince = TSTR("Serialize::Since");
+inline constexpr auto SerializeUntil = TSTR("Serialize::Until");
+inline constexpr auto SerializeTransient = TSTR("Serialize::Transient");
+
+template <typename AList, typename Name>
+constexpr int AttrIntOr(const AList& attrs, Name name, int fallback) {
+    if constexpr (std::decay_t<AList>::Contains(Name{}))
+        return static_cast<int>(attrs.Find(name).value);
+    else
+        return fallback;
+}
+
+template <typename T, typename Func, std::size_t... Ns>
+constexpr void ForEachFieldIndex(Func&& func, std::index_sequence<Ns...>) {
+    (func(std::integral_constant<std::size_t, Ns>{}), ...);
+}
+
+// 对 TypeInfo<T>::fields 的每一项调用 func(integral_constant<I>) 取字段用 FieldAt<T, I>() 可以在常量表达式里读属性
+template <typename T, typename Func>
+constexpr void ForEachFieldIndex(Func&& func) {
+    ForEachFieldIndex<T>(std::forward<Func>(func), std::make_index_sequence<std::decay_t<decltype(TypeInfo<T>::fields)>::size>{});
+}
+
+template <typename T, std::size_t I>
+constexpr const auto& FieldAt() {
+    return TypeInfo<T>::fields.template Get<I>();
+}
+
+template <typename T, std::size_t I>
+using FieldOf = std::remove_const_t<std::remove_reference_t<decltype(FieldAt<T, I>())>>;
+
+template <typename T, std::size_t I>
+constexpr bool IsDataField() {
+    using Fld = FieldOf<T, I>;
+    return !Fld::is_static && !Fld::is_func;
+}
+
+template <typename T, std::size_t I>
+constexpr bool IsStoredField() {
+    if constexpr (!IsDataField<T, I>())
+        return false;
+    else
+        return !std::decay_t<decltype(FieldAt<T, I>().attrs)>::Contains(SerializeTransient) && !std::is_pointer_v<typename FieldOf<T, I>::value_type>;
+}
+
+template <typename T, std::size_t I>
+constexpr bool IsFieldInVersion(int version) {
+    constexpr int since = AttrIntOr(FieldAt<T, I>().attrs, SerializeSince, 1);
+    constexpr int until = AttrIntOr(FieldAt<T, I>().attrs, SerializeUntil, INT_MAX);
+    return version >= since && version < until;
+}
+
+template <typename T>
+constexpr bool IsBlittable();
+
+// 所有字段每个版本都保存 没有基类 字段之间和末尾没有填充 并且按内存顺序声明
+template <typename T>
+constexpr bool IsPackedInOrder() {
+    if constexpr (std::decay_t<decltype(TypeInfo<T>::bases)>::size != 0 || !std::is_trivially_default_constructible_v<T>) {
+        return false;
+    } else {
+        constexpr T probe{};
+        bool ok = true;
+        std::size_t bytes = 0;
+        const void* last = nullptr;
+        ForEachFieldIndex<T>([&](auto i) {
+            constexpr std::size_t I = decltype(i)::value;
+            if constexpr (IsDataField<T, I>()) {
+                using V = typename FieldOf<T, I>::value_type;
+                if constexpr (!IsStoredField<T, I>() || !IsBlittable<V>()) {
+                    ok = false;
+                } else {
+                    constexpr auto& field = FieldAt<T, I>();
+                    if (!IsFieldInVersion<T, I>(1) || !IsFieldInVersion<T, I>(INT_MAX - 1)) ok = false;
+                    const void* at = &(probe.*(field.value));
+                    if (last && !(last < at)) ok = false;
+                    last = at;
+                    bytes += sizeof(V);
+                }
+            }
+        });
+        return ok && bytes == sizeof(T);
+    }
+}
+
+template <typename T>
+constexpr bool IsBlittable() {
+    if constexpr (std::is_same_v<T, bool>)
+        return false;
+    else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+        return true;
+    else if constexpr (std::is_array_v<T>)
+        return IsBlittable<std::remove_extent_t<T>>();
+    else if constexpr (IsStdArray<T>::value)
+        return IsBlittable<typename T::value_type>() && sizeof(T) == sizeof(typename T::value_type) * std::tuple_size_v<T>;
+    else if constexpr (HasTypeInfo<T>::value && std::is_trivially_copyable_v<T>)
+        return IsPackedInOrder<T>();
+    else
+        return false;
+}
+
+}  // namespace detail
+
+template <typename T>
+constexpr int SerializeVersionOf() {
+    return detail::AttrIntOr(TypeInfo<T>::attrs, detail::SerializeVersion, 1);
+}
+
+template <typename T>
+inline constexpr bool IsBlittable_v = detail::IsBlittable<T>();
+
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::vector<std::uint8_t>& out) : out(out) {}
+
+    template <typename T>
+    void Object(const T& obj) {
+        static_assert(detail::HasTypeInfo<T>::value, "type has no TypeInfo");
+        U32(static_cast<std::uint32_t>(SerializeVersionOf<T>()));
+        Body(obj);
+    }
+
+private:
+    void Raw(const void* data, std::size_t size) {
+        if (size == 0) return;
+        const std::size_t at = out.size();
+        out.resize(at + size);
+        std::memcpy(out.data() + at, data, size);
+    }
+
+    void U32(std::uint32_t v) { Raw(&v, sizeof(v)); }
+
+    template <typename T>
+    void Body(const T& obj) {
+        if constexpr (detail::IsBlittable<T>()) {
+            Raw(&obj, sizeof(T));
+        } else {
+            TypeInfo<T>::bases.ForEach([&](auto base) {
+                static_assert(!base.is_virtual, "virtual bases are not serializable");
+                using B = typename std::decay_t<decltype(base.info)>::Type;
+                Body(static_cast<const B&>(obj));
+            });
+            detail::ForEachFieldIndex<T>([&](auto i) {
+                constexpr std::size_t I = decltype(i)::value;
+                if constexpr (detail::IsStoredField<T, I>()) {
+                    if constexpr (detail::IsFieldInVersion<T, I>(SerializeVersionOf<T>())) Value(obj.*(detail::FieldAt<T, I>().value));
+                }
+            });
+        }
+    }
+
+    template <typename V>
+    void Value(const V& v) {
+        if constexpr (std::is_same_v<V, bool>) {
+            const std::uint8_t b = v ? 1 : 0;
+            Raw(&b, sizeof(b));
+        } else if constexpr (detail::IsBlittable<V>() && !detail::HasTypeInfo<V>::value) {
+            Raw(&v, sizeof(V));
+        } else if constexpr (std::is_same_v<V, std::string>) {
+            U32(static_cast<std::uint32_t>(v.size()));
+            Raw(v.data(), v.size());
+        } else if constexpr (detail::IsVector<V>::value) {
+            using E = typename V::value_type;
+            U32(static_cast<std::uint32_t>(v.size()));
+            if constexpr (detail::HasTypeInfo<E>::value) U32(static_cast<std::uint32_t>(SerializeVersionOf<E>()));
+            if constexpr (detail::IsBlittable<E>()) {
+                Raw(v.data(), v.size() * sizeof(E));
+            } else {
+                for (const auto& e : v) Element(e);
+            }
+        } else if constexpr (std::is_array_v<V> || detail::IsStdArray<V>::value) {
+            for (const auto& e : v) Value(e);
+        } else if constexpr (detail::HasTypeInfo<V>::value) {
+            Object(v);
+        } else {
+            static_assert(detail::AlwaysFalse<V>, "field type is not serializable, mark it Serialize::Transient");
+        }
+    }
+
+    // vector 的元素 版本已经写在个数之后
+    template <typename E>
+    void Element(const E& e) {
+        if constexpr (detail::HasTypeInfo<E>::value)
+            Body(e);
+        else
+            Value(e);
+    }
+
+    std::vector<std::uint8_t>& out;
+};
+
+// 数据截断 版本比当前的新或者个数不合理时 ok() 为 false 已经读出的字段保留
+class BinaryReader {
+public:
+    BinaryReader(const std::uint8_t* data, std::size_t size) : cur(data), end(data + size) {}
+
+    template <typename T>
+    bool Object(T& obj) {
+        static_assert(detail::HasTypeInfo<T>::value, "type has no TypeInfo");
+        const int version = static_cast<int>(U32());
+        if (version < 1 || version > SerializeVersionOf<T>()) failed = true;
+        if (failed) return false;
+        Body(obj, version);
+        return !failed;
+    }
+
+    bool ok() const { return !failed; }
+    std::size_t remaining() const { return static_cast<std::size_t>(end - cur); }
+
+private:
+    bool Raw(void* data, std::size_t size) {
+        if (failed || size > remaining()) {
+            failed = true;
+            return false;
+        }
+        if (size > 0) std::memcpy(data, cur, size);
+        cur += size;
+        return true;
+    }
+
+    std::uint32_t U32() {
+        std::uint32_t v = 0;
+        Raw(&v, sizeof(v));
+        return v;
+    }
+
+    // 每个元素至少一个字节 个数超过剩余字节数的数据一定是坏的 避免按损坏的个数分配
+    bool Count(std::uint32_t& count) {
+        count = U32();
+        if (count > remaining()) failed = true;
+        return !failed;
+    }
+
+    template <typename T>
+    void Body(T& obj, int version) {
+        if constexpr (detail::IsBlittable<T>()) {
+            // 没有按版本增减的字段 布局与版本无关
+            Raw(&obj, sizeof(T));
+        } else {
+            TypeInfo<T>::bases.ForEach([&](auto base) {
+                using B = typename std::decay_t<decltype(base.info)>::Type;
+                Body(static_cast<B&>(obj), version);
+            });
+            detail::ForEachFieldIndex<T>([&](auto i) {
+                constexpr std::size_t I = decltype(i)::value;
+                if constexpr (detail::IsStoredField<T, I>()) {
+                    if (!failed && detail::IsFieldInVersion<T, I>(version)) Value(obj.*(detail::FieldAt<T, I>().value));
+                }
+            });
+        }
+    }
+
+    template <typename V>
+    void Value(V& v) {
+        if constexpr (std::is_same_v<V, bool>) {
+            std::uint8_t b = 0;
+            Raw(&b, sizeof(b));
+            v = b != 0;
+        } else if constexpr (detail::IsBlittable<V>() && !detail::HasTypeInfo<V>::value) {
+            Raw(&v, sizeof(V));
+        } else if constexpr (std::is_same_v<V, std::string>) {
+            std::uint32_t size;
+            if (!Count(size)) return;
+            v.assign(reinterpret_cast<const char*>(cur), size);
+            cur += size;
+        } else if constexpr (detail::IsVector<V>::value) {
+            using E = typename V::value_type;
+            std::uint32_t count;
+            if (!Count(count)) return;
+            int version = 1;
+            if constexpr (detail::HasTypeInfo<E>::value) {
+                version = static_cast<int>(U32());
+                if (version < 1 || version > SerializeVersionOf<E>()) failed = true;
+                if (failed) return;
+            }
+            if constexpr (detail::IsBlittable<E>()) {
+                if ((std::size_t)count * sizeof(E) > remaining()) {
+                    failed = true;
+                    return;
+                }
+                v.resize(count);
+                Raw(v.data(), (std::size_t)count * sizeof(E));
+            } else if constexpr (std::is_same_v<E, bool>) {
+                // vector<bool> 的元素不能取引用
+                v.assign(count, false);
+                for (std::uint32_t n = 0; n < count && !failed; n++) {
+                    bool b = false;
+                    Value(b);
+                    v[n] = b;
+                }
+            } else {
+                v.clear();
+                v.resize(count);
+                for (std::uint32_t n = 0; n < count && !failed; n++) Element(v[n], version);
+            }
+        } else if constexpr (std::is_array_v<V> || detail::IsStdArray<V>::value) {
+            for (auto& e : v) Value(e);
+        } else if constexpr (detail::HasTypeInfo<V>::value) {
+            Object(v);
+        } else {
+            static_assert(detail::AlwaysFalse<V>, "field type is not serializable, mark it Serialize::Transient");
+        }
+    }
+
+    template <typename E>
+    void Element(E& e, int version) {
+        if constexpr (detail::HasTypeInfo<E>::value)
+            Body(e, version);
+        else
+            Value(e);
+    }
+
+    const std::uint8_t* cur;
+    const std::uint8_t* end;
+    bool failed = false;
+};
+
+// 写入 obj 追加到 out 末尾
+template <typename T>
+void Serialize(const T& obj, std::vector<std::uint8_t>& out) {
+    BinaryWriter(out).Object(obj);
+}
+
+// 读出 obj 失败时返回 false obj 中已经读出的字段保留
+template <typename T>
+bool Deserialize(T& obj, const std::uint8_t* data, std::size_t size) {
+    BinaryReader in(data, size);
+    return in.Object(obj);
+}
+
+}  // namespace ME::meta::static_refl
+
+#endif
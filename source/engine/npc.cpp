@@ -1,7 +1,12 @@
 
 #include "npc.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
 #include "engine/core/global.hpp"
+#include "engine/core/profiler.hpp"
 #include "game.hpp"
 #include "game/items.hpp"
 
@@ -15,7 +20,18 @@ bool Bot::tryInterrupt(State _state) {
     return true;
 }
 
+void Bot::navigateTo(world &world, MEvec2 from, MEvec2 to) {
+    if (navTicket) world.nav.cancel(navTicket);
+    navTicket = world.nav.request(from.x, from.y, to.x, to.y);
+}
+
 void Bot::executeTask(world &world) {
+    if (NavPath found; navTicket && world.nav.poll(navTicket, found)) {
+        navTicket = 0;
+        path = {};
+        for (auto it = found.points.rbegin(); it != found.points.rend(); ++it) path.push(*it);
+    }
+
     if (interrupt) {
 
         interrupt = false;
@@ -87,27 +103,30 @@ void Bot::render(WorldEntity *we, R_Target *target, int ofsX, int ofsY) {
     if (heldItem != NULL) {
         int scaleEnt = global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1;
 
-        MErect *ir = new MErect{(f32)(int)(ofsX + we->x + we->hw / 2.0 - heldItem->texture->surface()->w), (f32)(int)(ofsY + we->y + we->hh / 2.0 - heldItem->texture->surface()->h / 2),
-                                (f32)heldItem->texture->surface()->w, (f32)heldItem->texture->surface()->h};
-        f32 fx = (f32)(int)(-ir->x + ofsX + we->x + we->hw / 2.0);
-        f32 fy = (f32)(int)(-ir->y + ofsY + we->y + we->hh / 2.0);
+        MErect ir{(f32)(int)(ofsX + we->x + we->hw / 2.0 - heldItem->texture->surface()->w), (f32)(int)(ofsY + we->y + we->hh / 2.0 - heldItem->texture->surface()->h / 2),
+                  (f32)heldItem->texture->surface()->w, (f32)heldItem->texture->surface()->h};
+        f32 fx = (f32)(int)(-ir.x + ofsX + we->x + we->hw / 2.0);
+        f32 fy = (f32)(int)(-ir.y + ofsY + we->y + we->hh / 2.0);
         fx -= heldItem->pivotX;
-        ir->x += heldItem->pivotX;
+        ir.x += heldItem->pivotX;
         fy -= heldItem->pivotY;
-        ir->y += heldItem->pivotY;
+        ir.y += heldItem->pivotY;
         R_SetShapeBlendMode(R_BlendPresetEnum::R_BLEND_ADD);
         // R_BlitTransformX(heldItem->texture, NULL, target, ir->x, ir->y, fp->x, fp->y, holdAngle, 1, 1);
         // SDL_RenderCopyExF(renderer, heldItem->texture, NULL, ir, holdAngle, fp, abs(holdAngle) > 90 ? SDL_FLIP_VERTICAL : SDL_FLIP_NONE);
-        ir->x *= scaleEnt;
-        ir->y *= scaleEnt;
-        ir->w *= scaleEnt;
-        ir->h *= scaleEnt;
-        R_BlitRectX(heldItem->image, NULL, target, ir, holdAngle, fx, fy, abs(holdAngle) > 90 ? R_FLIP_VERTICAL : R_FLIP_NONE);
-        delete ir;
+        ir.x *= scaleEnt;
+        ir.y *= scaleEnt;
+        ir.w *= scaleEnt;
+        ir.h *= scaleEnt;
+        global.game->TexturePack_.entityQueue.sprite(target, heldItem->syncImage(), ir, holdAngle, fx, fy, abs(holdAngle) > 90 ? R_FLIP_VERTICAL : R_FLIP_NONE);
     }
 }
 
-void Bot::renderLQ(WorldEntity *we, R_Target *target, int ofsX, int ofsY) { R_Rectangle(target, we->x + ofsX, we->y + ofsY, we->x + ofsX + we->hw, we->y + ofsY + we->hh, {0xff, 0x00, 0xff, 0xff}); }
+void Bot::renderLQ(WorldEntity *we, R_Target *target, int ofsX, int ofsY) {
+    global.game->TexturePack_.entityQueue.rectangle(target, we->x + ofsX, we->y + ofsY, we->x + ofsX + we->hw, we->y + ofsY + we->hh, {0xff, 0x00, 0xff, 0xff});
+}
+
+void NpcSystem::declare(ecs::system_access &access) const { access.main_thread().read<WorldEntity, Bot, Controlable>().write<R_Target>(); }
 
 void NpcSystem::process(ecs::registry &world, const move_player_event &evt) {
     world.for_joined_components<WorldEntity, Bot>(
@@ -119,4 +138,56 @@ void NpcSystem::process(ecs::registry &world, const move_player_event &evt) {
             ecs::exists<Bot>{} && ecs::exists<Controlable>{});
 }
 
+// executeTask 可能读写世界 和 WorldEntitySystem 一样不与其他写世界的系统并行
+void NpcThinkSystem::declare(ecs::system_access &access) const { access.read<WorldEntity>().write<Bot, world>(); }
+
+void NpcThinkSystem::process(ecs::registry &reg, const entity_update_event &evt) {
+    ME::world &w = *evt.g->Iso.world;
+    const GlobalDEF &def = evt.g->Iso.globaldef;
+    round++;
+
+    // 距离从玩家中心算 没有玩家时从模拟区域中心算 坐标与 WorldEntity 相同
+    const f32 zoneX = w.tickZone.x - w.loadZone.x;
+    const f32 zoneY = w.tickZone.y - w.loadZone.y;
+    f32 cx = zoneX + w.tickZone.w / 2.0f;
+    f32 cy = zoneY + w.tickZone.h / 2.0f;
+    if (auto [pl_we, pl] = w.getHostPlayer(); pl_we) {
+        cx = pl_we->x + pl_we->hw / 2.0f;
+        cy = pl_we->y + pl_we->hh / 2.0f;
+    }
+
+    due.clear();
+    reg.for_joined_components<WorldEntity, Bot>([&](ecs::entity e, const WorldEntity &we, Bot &bot) {
+        if (bot.dead || bot.nextThink > round) return;
+        const f32 dx = we.x + we.hw / 2.0f - cx;
+        const f32 dy = we.y + we.hh / 2.0f - cy;
+        const bool onScreen = we.x + we.hw >= zoneX && we.x <= zoneX + w.tickZone.w && we.y + we.hh >= zoneY && we.y <= zoneY + w.tickZone.h;
+        due.push_back({e.id(), round - bot.nextThink, dx * dx + dy * dy, onScreen});
+    });
+
+    std::sort(due.begin(), due.end(), [](const candidate &a, const candidate &b) { return a.overdue != b.overdue ? a.overdue > b.overdue : a.dist2 < b.dist2; });
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto budget = std::chrono::microseconds(def.npc_think_budget_us);
+    const u64 sleepTicks = (u64)std::max(def.npc_sleep_ticks, 1);
+    thinks = 0;
+    for (const candidate &c : due) {
+        // 每轮至少执行一个 预算再小也不会全部饿死
+        if (def.npc_think_budget_us > 0 && thinks > 0 && std::chrono::steady_clock::now() - start >= budget) break;
+        // executeTask 可能创建实体 组件的地址会变 每次按 id 重新查找
+        Bot *bot = reg.find_component<Bot>(c.id);
+        if (!bot) continue;
+        bot->executeTask(w);
+        bot->lastThink = round;
+        bot->asleep = !c.onScreen;
+        const u64 interval = c.onScreen ? std::min<u64>(1 + (u64)(std::sqrt(c.dist2) / NEAR_DIST), MAX_INTERVAL) : sleepTicks;
+        bot->nextThink = round + interval;
+        thinks++;
+    }
+    deferred = (u32)due.size() - thinks;
+
+    ME_profiler_counter("npc think", (f64)thinks);
+    ME_profiler_counter("npc deferred", (f64)deferred);
+}
+
 }  // namespace ME
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <deque>
 #include <stack>
+#include <vector>
 
 #include "engine/core/core.hpp"
 #include "game/player.hpp"
@@ -145,6 +146,10 @@ public:
     std::stack<MEvec2> path;          // Movement Path
     void executeTask(world &world);
 
+    // 寻路 navigateTo 向 world::nav 提交请求 executeTask 取回结果放进 path 栈顶是第一个路点
+    u32 navTicket = 0;
+    void navigateTo(world &world, MEvec2 from, MEvec2 to);
+
     // Memories / Brain
     std::deque<Memory> shorterm;   // Shortterm Sensory Memory
     std::deque<Memory> memories;   // Longterm Memory
@@ -153,6 +158,11 @@ public:
     std::deque<Memory> recallMemories(Memory &query, bool all);
     void updateMemory(Memory &query, bool all, Memory &memory);
     inline void addMemory(State &state);
+
+    // 思考调度 由 NpcThinkSystem 维护
+    u64 nextThink = 0;    // 到这一轮之前不调用 executeTask
+    u64 lastThink = 0;    // 上一次调用 executeTask 的轮次
+    bool asleep = false;  // 在模拟区域外 按 npc_sleep_ticks 的间隔思考
 };
 
 // Constructors
@@ -167,9 +177,40 @@ inline Bot::Bot(int _ID) {
 
 class NpcSystem : public ecs::system<move_player_event> {
 public:
+    void declare(ecs::system_access &access) const override;
     void process(ecs::registry &world, const move_player_event &evt) override;
 };
 
+// 把 Bot::executeTask 分摊到多个 tick 每次处理的时间不超过 npc_think_budget_us
+// 离玩家越远思考间隔越长 模拟区域外的 Bot 只按 npc_sleep_ticks 醒来一次 未到期的 Bot 只比较一次轮次
+// 预算用完时剩下的到期 Bot 留到下一轮 按逾期的轮数优先 同样逾期时近的优先 所以远处的 Bot 不会一直排不上
+class NpcThinkSystem : public ecs::system<entity_update_event> {
+public:
+    // 这个距离 (像素) 内每轮都思考 之后每多这么远间隔加一轮
+    static constexpr f32 NEAR_DIST = 256.0f;
+    static constexpr u64 MAX_INTERVAL = 8;
+
+    void declare(ecs::system_access &access) const override;
+    void process(ecs::registry &world, const entity_update_event &evt) override;
+
+    // 上一轮执行和因预算推迟的 Bot 数
+    u32 last_thinks() const { return thinks; }
+    u32 last_deferred() const { return deferred; }
+
+private:
+    struct candidate {
+        ecs::entity_id id;
+        u64 overdue;
+        f32 dist2;
+        bool onScreen;
+    };
+
+    std::vector<candidate> due;
+    u64 round = 0;
+    u32 thinks = 0;
+    u32 deferred = 0;
+};
+
 }  // namespace ME
 
 #endif
\ No newline at end of file
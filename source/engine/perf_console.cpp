@@ -0,0 +1,176 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "perf_console.hpp"
+
+#include <algorithm>
+#include <format>
+#include <string>
+
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/core/global.hpp"
+#include "engine/core/job.h"
+#include "engine/core/profiler.hpp"
+#include "engine/core/thread_topology.hpp"
+#include "engine/renderer/renderer_gpu.h"
+#include "engine/utils/utility.hpp"
+#include "cvar.hpp"
+#include "game.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+// 可以在控制台开关的 tick 子系统和内核
+const struct {
+    const char *name;
+    bool GlobalDEF::*field;
+} PerfToggles[] = {
+        {"tick_world", &GlobalDEF::tick_world},
+        {"tick_box2d", &GlobalDEF::tick_box2d},
+        {"tick_box2d_parallel", &GlobalDEF::tick_box2d_parallel},
+        {"tick_liquid_particles", &GlobalDEF::tick_liquid_particles},
+        {"liquid_level_solver", &GlobalDEF::liquid_level_solver},
+        {"tick_temperature", &GlobalDEF::tick_temperature},
+        {"physics_grid_terrain", &GlobalDEF::physics_grid_terrain},
+        {"streaming_uploads", &GlobalDEF::streaming_uploads},
+        {"gpu_world_pixels", &GlobalDEF::gpu_world_pixels},
+        {"gpu_cell_sim", &GlobalDEF::gpu_cell_sim},
+        {"tick_checksum", &GlobalDEF::tick_checksum},
+        {"late_latch", &GlobalDEF::late_latch},
+};
+
+// 效率核上先拿后台任务的 worker 个数
+std::string PerfPlacement() {
+    const job_placement p = job::placement();
+    u32 background = 0;
+    for (u32 i = 0; i < job::worker_count(); i++) background += job::worker_class(i) != job_class::tick;
+    return std::format("\n  cpus {0} hybrid {1} pin {2} priorities {3} background workers {4}", thread_topology::describe(), (int)p.hybrid, (int)p.pin, (int)p.priorities, background);
+}
+
+std::string PerfStatus() {
+    const GlobalDEF &def = global.game->Iso.globaldef;
+    std::string s = "perf status:";
+    for (const auto &t : PerfToggles) s += std::format("\n  {0} {1}", t.name, (int)(def.*t.field));
+    s += std::format("\n  workers {0}/{1}", job::active_workers(), job::worker_count());
+    s += PerfPlacement();
+    if (global.game->Iso.world) {
+        const ChunkLoader &loader = global.game->Iso.world->chunkLoader;
+        s += std::format("\n  loader readers {0} generators {1}", loader.reader_limit(), loader.generator_limit());
+    }
+    s += std::format("\n  simd {0}", cpu::describe());
+    return s;
+}
+
+}  // namespace
+
+void PerfBench::start(int ticks) {
+    remaining = std::max(ticks, 0);
+    samples.clear();
+    samples.reserve(remaining);
+}
+
+void PerfBench::record(f64 ms) {
+    if (remaining <= 0) return;
+    samples.push_back(ms);
+    if (--remaining == 0) report();
+}
+
+void PerfBench::report() {
+    if (samples.empty()) return;
+    f64 sum = 0;
+    for (f64 v : samples) sum += v;
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](f64 p) { return samples[std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5))]; };
+    METADOT_INFO(std::format("perf bench {0} ticks: avg {1:.3f} ms p50 {2:.3f} p95 {3:.3f} max {4:.3f}", samples.size(), sum / samples.size(), pct(0.5), pct(0.95), samples.back()).c_str());
+    METADOT_INFO(PerfStatus().c_str());
+}
+
+void RegisterPerfCommands(cvar::ConVar &convar) {
+    GlobalDEF &def = global.game->Iso.globaldef;
+    for (const auto &t : PerfToggles) convar.Value(t.name, def.*t.field);
+
+    convar.Command("perf_status", []() { return PerfStatus(); });
+
+    convar.Command("perf_threads", [](int n) {
+        job::set_active_workers((u32)std::max(n, 0));
+        return std::format("workers {0}/{1}", job::active_workers(), job::worker_count());
+    });
+
+    convar.Command("perf_placement", [](int hybrid, int pin, int priorities) {
+        GlobalDEF &def = global.game->Iso.globaldef;
+        def.job_hybrid_placement = hybrid != 0;
+        def.job_pin_workers = pin != 0;
+        def.job_thread_priorities = priorities != 0;
+        job::set_placement({.hybrid = def.job_hybrid_placement, .pin = def.job_pin_workers, .priorities = def.job_thread_priorities});
+        // worker 在下一个任务之前才应用 这里显示的类别可能还是旧的
+        return "perf placement:" + PerfPlacement();
+    });
+
+    convar.Command("perf_loader", [](int readers, int generators) {
+        if (!global.game->Iso.world) return std::string("no world");
+        ChunkLoader &loader = global.game->Iso.world->chunkLoader;
+        loader.set_limits((u32)std::max(readers, 0), (u32)std::max(generators, 0));
+        return std::format("loader readers {0} generators {1}", loader.reader_limit(), loader.generator_limit());
+    });
+
+    convar.Command("perf_kernel", [](std::string name) {
+        GlobalDEF &def = global.game->Iso.globaldef;
+        // simd 和 gpu 使用 CPU 支持的最高指令集
+        simd_level level;
+        if (name == "simd" || name == "gpu") level = cpu::best();
+        else if (!cpu::parse(name.c_str(), level)) return std::string("perf_kernel scalar|sse2|avx2|avx512|neon|best|simd|gpu");
+        cpu::set_max_level(level);
+        def.gpu_cell_sim = def.gpu_world_pixels = name == "gpu";
+        return std::format("simd {0} gpu_cell_sim {1} gpu_world_pixels {2}", cpu::describe(), (int)def.gpu_cell_sim, (int)def.gpu_world_pixels);
+    });
+
+    convar.Command("perf_trace", [](int on) {
+        ME_profiler_trace_set_enabled(on != 0);
+        return std::format("trace {0} events {1}", on != 0 ? "on" : "off", ME_profiler_trace_size());
+    });
+
+    convar.Command("perf_trace_dump", [](std::string path) {
+        if (ME_profiler_trace_size() == 0) return std::string("trace is empty, enable it with perf_trace 1");
+        return ME_profiler_trace_export(path.c_str()) ? std::format("trace written to {0}", path) : std::format("failed to write {0}", path);
+    });
+
+    convar.Command("perf_counters", []() {
+        const profiler_counter *counters = nullptr;
+        const u32 n = ME_profiler_get_counters(&counters);
+        std::string s = std::format("{0} counters:", n);
+        for (u32 i = 0; i < n; i++) {
+            const profiler_counter &c = counters[i];
+            if (c.m_count == 0) continue;
+            f64 sum = 0;
+            for (u32 k = 0; k < c.m_count; k++) sum += c.m_values[(c.m_head + ME_COUNTER_HISTORY - 1 - k) % ME_COUNTER_HISTORY];
+            s += std::format("\n  {0}: {1:.2f} (avg {2:.2f})", c.m_name, c.m_values[(c.m_head + ME_COUNTER_HISTORY - 1) % ME_COUNTER_HISTORY], sum / c.m_count);
+        }
+        return s;
+    });
+
+    convar.Command("perf_gl", []() {
+        const R_StateStats s = R_GetStateStats();
+        return std::format("gl state changes last frame: programs {0} textures {1} framebuffers {2} blend {3} viewports {4} skipped {5}", s.programs, s.textures, s.framebuffers, s.blend, s.viewports,
+                           s.skipped);
+    });
+
+    convar.Command("perf_bench", [](int ticks) {
+        global.game->perfBench.start(ticks);
+        return std::format("measuring the next {0} ticks", std::max(ticks, 0));
+    });
+
+    convar.Command("perf_stress", [](std::string name, int ticks) {
+        const StressScene::kind k = StressScene::from_name(name);
+        if (k == StressScene::NONE) return std::format("perf_stress {0} ticks", StressScene::names());
+        global.game->stress.start(k, ticks > 0 ? (u32)ticks : StressScene::DEFAULT_TICKS, false);
+        return std::format("stress scene {0} starts once chunks settle", name);
+    });
+
+    convar.Command("perf_stress_stop", []() {
+        global.game->stress.stop();
+        return std::string("stress scene stopped");
+    });
+}
+
+}  // namespace ME
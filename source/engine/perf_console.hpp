@@ -0,0 +1,54 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_PERF_CONSOLE_HPP
+#define ME_PERF_CONSOLE_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+namespace cvar {
+class ConVar;
+}
+
+// 统计接下来 N 个 tick 的耗时 game::perfBench
+// 只测量游戏循环本来就要执行的 tick 不额外模拟 结束时把结果和当时的性能设置打印到日志
+class PerfBench {
+public:
+    void start(int ticks);
+    // 每次 game::tick 之后调用 没有开始时直接返回
+    void record(f64 ms);
+
+    bool running() const { return remaining > 0; }
+
+private:
+    void report();
+
+    int remaining = 0;
+    std::vector<f64> samples;
+};
+
+// 控制台的性能实验命令 在 console::init 中注册 不需要重新编译就能在玩家的机器上对比
+//  tick_* 等开关         直接读写 GlobalDEF 的同名字段 例如 tick_temperature 0
+//  perf_status          打印开关 线程数和内核版本
+//  perf_threads N       只让前 N 个 job worker (含主线程) 工作 0 为全部
+//  perf_placement H P R worker 的大小核放置 固定到单个 CPU 线程优先级 (job::set_placement) 1 开 0 关
+//  perf_loader R G      区块读取和生成阶段的并行任务数
+//  perf_kernel NAME     scalar sse2 avx2 avx512 neon 或 best 限制向量内核的指令集 (cpu::set_max_level)
+//                       simd 同 best gpu 另外打开 GPU 模拟/上传
+//                       管到的向量路径 脏像素转换 marching squares 分类 tile 校验和 温度求和 连通分量
+//                       表面行拷贝 MEvec2 批量运算 box2d 宽接触求解 (scalar 时退回逐个求解)
+//                       FastNoise 的 GetPerlinGrid 行
+//  perf_trace 1|0       开关分析器的连续捕获
+//  perf_trace_dump PATH 把连续捕获写成 Chrome Trace JSON
+//  perf_counters        打印分析器计数器的最新值和平均值
+//  perf_bench N         统计接下来 N 个 tick
+//  perf_stress NAME N   在当前世界上运行压力场景 N 个 tick 见 StressScene
+//  perf_stress_stop     中止压力场景 不打印报告
+void RegisterPerfCommands(cvar::ConVar &convar);
+
+}  // namespace ME
+
+#endif
@@ -287,7 +287,7 @@ void b2BroadPhase::Build() {
         m_rootStatic = nullptr;
     } else if (m_rootStatic == nullptr) {
         m_treeAllocator = m_nodes + m_capacity;
-        m_rootStatic = Build(0, staticGroup);
+        m_rootStatic = BuildBinned(0, staticGroup);
     }
 
     m_treeAllocator = m_nodes + m_capacity + staticGroup;
@@ -372,6 +372,108 @@ b2TreeNode* b2BroadPhase::Build(int32 start, int32 end) {
     return cur;
 }
 
+b2TreeNode* b2BroadPhase::BuildBinned(int32 start, int32 end) {
+    int32 count = end - start;
+
+    if (count <= b2_staticTreeMinBinned) {
+        return Build(start, end);
+    }
+
+    b2Vec2 c = GetCenter2(m_links[start]->aabb);
+    float minx = c.x, maxx = minx;
+    float miny = c.y, maxy = miny;
+
+    for (int32 i = start + 1; i < end; i++) {
+        c = GetCenter2(m_links[i]->aabb);
+
+        minx = b2Min(minx, c.x);
+        miny = b2Min(miny, c.y);
+        maxx = b2Max(maxx, c.x);
+        maxy = b2Max(maxy, c.y);
+    }
+
+    bool splitX = (maxx - minx) > (maxy - miny);
+    float lo = splitX ? minx : miny;
+    float extent = splitX ? maxx - minx : maxy - miny;
+
+    if (extent < b2_epsilon) {
+        // All centers coincide, see Build
+        return Build(start, end);
+    }
+
+    struct Bin {
+        b2AABB aabb;
+        int32 count;
+    };
+
+    Bin bins[b2_staticTreeBins];
+    for (int32 b = 0; b < b2_staticTreeBins; b++) {
+        bins[b].aabb.lowerBound = {b2_maxFloat, b2_maxFloat};
+        bins[b].aabb.upperBound = {-b2_maxFloat, -b2_maxFloat};
+        bins[b].count = 0;
+    }
+
+    const float scale = b2_staticTreeBins / extent;
+    auto binOf = [&](const b2AABB& aabb) {
+        c = GetCenter2(aabb);
+        int32 b = (int32)(((splitX ? c.x : c.y) - lo) * scale);
+        return b2Clamp(b, 0, b2_staticTreeBins - 1);
+    };
+
+    for (int32 i = start; i < end; i++) {
+        Bin& bin = bins[binOf(m_links[i]->aabb)];
+        bin.aabb.Combine(m_links[i]->aabb);
+        bin.count++;
+    }
+
+    // Sweep from the right to get the cost of every right side, then from the left
+    // to pick the split with the smallest area weighted leaf count.
+    float rightCost[b2_staticTreeBins];
+    b2AABB box = bins[b2_staticTreeBins - 1].aabb;
+    int32 boxCount = bins[b2_staticTreeBins - 1].count;
+    for (int32 b = b2_staticTreeBins - 1; b > 0; b--) {
+        if (b < b2_staticTreeBins - 1) {
+            box.Combine(bins[b].aabb);
+            boxCount += bins[b].count;
+        }
+        rightCost[b] = boxCount > 0 ? box.GetPerimeter() * boxCount : 0.0f;
+    }
+
+    int32 bestSplit = -1;
+    float bestCost = b2_maxFloat;
+    box = bins[0].aabb;
+    boxCount = bins[0].count;
+    for (int32 b = 1; b < b2_staticTreeBins; b++) {
+        float cost = (boxCount > 0 ? box.GetPerimeter() * boxCount : 0.0f) + rightCost[b];
+        if (boxCount > 0 && boxCount < count && cost < bestCost) {
+            bestCost = cost;
+            bestSplit = b;
+        }
+        box.Combine(bins[b].aabb);
+        boxCount += bins[b].count;
+    }
+
+    int32 group0 = start;
+    if (bestSplit > 0) {
+        for (int32 i = start; i < end; i++) {
+            if (binOf(m_links[i]->aabb) < bestSplit) {
+                b2Swap(m_links[i], m_links[group0++]);
+            }
+        }
+    } else {
+        group0 = (start + end) / 2;
+    }
+
+    b2TreeNode* cur = m_treeAllocator++;
+    cur->left = BuildBinned(start, group0);
+    cur->right = BuildBinned(group0, end);
+    cur->left->parent = cur;
+    cur->right->parent = cur;
+    cur->aabb.Combine(cur->left->aabb, cur->right->aabb);
+
+    return cur;
+}
+
 int32 b2BroadPhase::GetTreeHeight() const { return (m_root != nullptr) ? ComputeHeight(m_root) : 0; }
 
 int32 b2BroadPhase::ComputeHeight(b2TreeNode* node) const {
@@ -0,0 +1,171 @@
+// Metadot physics engine is enhanced based on box2d modification
+// Metadot code Copyright(c) 2022-2023, KaoruXun All rights reserved.
+// Box2d code by Erin Catto licensed under the MIT License
+// https://github.com/erincatto/box2d
+
+// MIT License
+// Copyright (c) 2022-2023 KaoruXun
+// Copyright (c) 2019 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "engine/physics/box2d/inc/b2_circle_shape.h"
+#include "engine/physics/box2d/inc/b2_collision.h"
+#include "engine/physics/box2d/inc/b2_edge_shape.h"
+#include "engine/physics/box2d/inc/b2_grid_shape.h"
+#include "engine/physics/box2d/inc/b2_polygon_shape.h"
+
+// The four cell faces. The tangent t runs along the face so that the outward
+// normal n = (t.y, -t.x) is to its right, matching one-sided edges.
+struct b2GridFace {
+    int32 tx, ty;
+    int32 nx, ny;
+};
+
+static const b2GridFace b2_gridFaces[4] = {
+        {1, 0, 0, -1},
+        {-1, 0, 0, 1},
+        {0, -1, -1, 0},
+        {0, 1, 1, 0},
+};
+
+// Build the one-sided edge for the run of exposed faces from cell (x0, y0) to cell
+// (x1, y1) along the face tangent. The ghost vertices follow the outline past both
+// ends: straight on when the run was cut by the query range, around the corner
+// otherwise.
+static void b2MakeGridEdge(b2EdgeShape* edge, const b2GridShape* grid, const b2GridFace& f, int32 x0, int32 y0, int32 x1, int32 y1) {
+    const b2Vec2 t((float)f.tx, (float)f.ty);
+    const b2Vec2 n((float)f.nx, (float)f.ny);
+
+    const b2Vec2 s = b2Vec2((float)x0 + 0.5f, (float)y0 + 0.5f) + 0.5f * n - 0.5f * t;
+    const b2Vec2 e = b2Vec2((float)x1 + 0.5f, (float)y1 + 0.5f) + 0.5f * n + 0.5f * t;
+
+    b2Vec2 v0, v3;
+
+    const int32 px = x0 - f.tx, py = y0 - f.ty;
+    if (grid->IsSolid(px, py)) {
+        v0 = grid->IsSolid(px + f.nx, py + f.ny) ? s + n : s - t;
+    } else {
+        v0 = s - n;
+    }
+
+    const int32 qx = x1 + f.tx, qy = y1 + f.ty;
+    if (grid->IsSolid(qx, qy)) {
+        v3 = grid->IsSolid(qx + f.nx, qy + f.ny) ? e + n : e + t;
+    } else {
+        v3 = e - n;
+    }
+
+    edge->SetOneSided(v0, s, e, v3);
+}
+
+// Collide shapeB against every run of exposed faces inside its bounds and keep the
+// deepest manifold. A body resting across a flat run gets the usual two point manifold,
+// a body wedged into a corner is pushed out of the deeper face first.
+template <typename TShape, void (*Collide)(b2Manifold*, const b2EdgeShape*, const b2Transform&, const TShape*, const b2Transform&)>
+static void b2CollideGrid(b2Manifold* manifold, const b2GridShape* gridA, const b2Transform& xfA, const TShape* shapeB, const b2Transform& xfB) {
+    manifold->pointCount = 0;
+    if (gridA->m_cells == nullptr) {
+        return;
+    }
+
+    // Bounds of shape B in the grid frame
+    b2AABB aabb;
+    shapeB->ComputeAABB(&aabb, b2MulT(xfA, xfB));
+    const float margin = gridA->m_radius + b2_linearSlop;
+
+    const int32 cx0 = b2Max((int32)floorf(aabb.lowerBound.x - margin), 0);
+    const int32 cy0 = b2Max((int32)floorf(aabb.lowerBound.y - margin), 0);
+    const int32 cx1 = b2Min((int32)floorf(aabb.upperBound.x + margin), gridA->m_width - 1);
+    const int32 cy1 = b2Min((int32)floorf(aabb.upperBound.y + margin), gridA->m_height - 1);
+    if (cx0 > cx1 || cy0 > cy1) {
+        return;
+    }
+
+    b2EdgeShape edge;
+    edge.m_radius = gridA->m_radius;
+    b2Manifold candidate;
+    float deepest = b2_maxFloat;
+
+    auto test = [&](const b2GridFace& f, int32 x0, int32 y0, int32 x1, int32 y1) {
+        b2MakeGridEdge(&edge, gridA, f, x0, y0, x1, y1);
+        Collide(&candidate, &edge, xfA, shapeB, xfB);
+        if (candidate.pointCount == 0) {
+            return;
+        }
+
+        b2WorldManifold wm;
+        wm.Initialize(&candidate, xfA, edge.m_radius, xfB, shapeB->m_radius);
+        float separation = wm.separations[0];
+        for (int32 i = 1; i < candidate.pointCount; ++i) {
+            separation = b2Min(separation, wm.separations[i]);
+        }
+
+        if (separation < deepest) {
+            deepest = separation;
+            *manifold = candidate;
+        }
+    };
+
+    for (const b2GridFace& f : b2_gridFaces) {
+        // Lines of faces run along the tangent, scan them in increasing order and
+        // flip the run ends for tangents that point the other way
+        const bool horizontal = f.ty == 0;
+        const int32 lineBegin = horizontal ? cy0 : cx0;
+        const int32 lineEnd = horizontal ? cy1 : cx1;
+        const int32 runBegin = horizontal ? cx0 : cy0;
+        const int32 runEnd = horizontal ? cx1 : cy1;
+        const bool reversed = (f.tx + f.ty) < 0;
+
+        for (int32 line = lineBegin; line <= lineEnd; ++line) {
+            int32 start = -1;
+            for (int32 i = runBegin; i <= runEnd + 1; ++i) {
+                bool exposed = false;
+                if (i <= runEnd) {
+                    const int32 x = horizontal ? i : line;
+                    const int32 y = horizontal ? line : i;
+                    exposed = gridA->IsSolid(x, y) && !gridA->IsSolid(x + f.nx, y + f.ny);
+                }
+
+                if (exposed && start < 0) {
+                    start = i;
+                } else if (!exposed && start >= 0) {
+                    int32 a = start, b = i - 1;
+                    if (reversed) {
+                        b2Swap(a, b);
+                    }
+                    if (horizontal) {
+                        test(f, a, line, b, line);
+                    } else {
+                        test(f, line, a, line, b);
+                    }
+                    start = -1;
+                }
+            }
+        }
+    }
+}
+
+void b2CollideGridAndCircle(b2Manifold* manifold, const b2GridShape* gridA, const b2Transform& xfA, const b2CircleShape* circleB, const b2Transform& xfB) {
+    b2CollideGrid<b2CircleShape, b2CollideEdgeAndCircle>(manifold, gridA, xfA, circleB, xfB);
+}
+
+void b2CollideGridAndPolygon(b2Manifold* manifold, const b2GridShape* gridA, const b2Transform& xfA, const b2PolygonShape* polygonB, const b2Transform& xfB) {
+    b2CollideGrid<b2PolygonShape, b2CollideEdgeAndPolygon>(manifold, gridA, xfA, polygonB, xfB);
+}
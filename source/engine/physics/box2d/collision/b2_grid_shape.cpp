@@ -0,0 +1,231 @@
+// Metadot physics engine is enhanced based on box2d modification
+// Metadot code Copyright(c) 2022-2023, KaoruXun All rights reserved.
+// Box2d code by Erin Catto licensed under the MIT License
+// https://github.com/erincatto/box2d
+
+// MIT License
+// Copyright (c) 2022-2023 KaoruXun
+// Copyright (c) 2019 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "engine/physics/box2d/inc/b2_grid_shape.h"
+
+#include <new>
+
+#include "engine/physics/box2d/inc/b2_block_allocator.h"
+
+void b2GridShape::Set(const uint8* cells, int32 width, int32 height) {
+    b2Assert(width > 0 && height > 0);
+    m_cells = cells;
+    m_width = width;
+    m_height = height;
+}
+
+b2Shape* b2GridShape::Clone(b2BlockAllocator* allocator) const {
+    void* mem = allocator->Allocate(sizeof(b2GridShape));
+    b2GridShape* clone = new (mem) b2GridShape;
+    *clone = *this;
+    return clone;
+}
+
+bool b2GridShape::TestPoint(const b2Transform& xf, const b2Vec2& p) const {
+    b2Vec2 pLocal = b2MulT(xf, p);
+    int32 x = (int32)floorf(pLocal.x);
+    int32 y = (int32)floorf(pLocal.y);
+    if (x < 0 || y < 0 || x >= m_width || y >= m_height) {
+        return false;
+    }
+    return IsSolid(x, y);
+}
+
+void b2GridShape::ComputeDistance(const b2Transform& xf, const b2Vec2& p, float32* distance, b2Vec2* normal) const {
+    b2Vec2 pLocal = b2MulT(xf, p);
+    int32 x = (int32)floorf(pLocal.x);
+    int32 y = (int32)floorf(pLocal.y);
+
+    if (x >= 0 && y >= 0 && x < m_width && y < m_height && IsSolid(x, y)) {
+        // Inside, the distance to the nearest exposed face of this cell
+        float32 best = -1.0f;
+        b2Vec2 n = b2Vec2_zero;
+        const float32 d[4] = {pLocal.x - (float32)x, (float32)(x + 1) - pLocal.x, pLocal.y - (float32)y, (float32)(y + 1) - pLocal.y};
+        const int32 dx[4] = {-1, 1, 0, 0};
+        const int32 dy[4] = {0, 0, -1, 1};
+        for (int32 i = 0; i < 4; ++i) {
+            if (IsSolid(x + dx[i], y + dy[i])) {
+                continue;
+            }
+            if (best < 0.0f || d[i] < -best) {
+                best = -d[i];
+                n.Set((float32)dx[i], (float32)dy[i]);
+            }
+        }
+        *distance = best;
+        *normal = b2Mul(xf.q, n);
+        return;
+    }
+
+    // Outside, the nearest solid cell around the point
+    float32 best = b2_maxFloat;
+    b2Vec2 delta = b2Vec2_zero;
+    for (int32 cy = y - 1; cy <= y + 1; ++cy) {
+        for (int32 cx = x - 1; cx <= x + 1; ++cx) {
+            if (cx < 0 || cy < 0 || cx >= m_width || cy >= m_height || !IsSolid(cx, cy)) {
+                continue;
+            }
+            b2Vec2 closest(b2Clamp(pLocal.x, (float32)cx, (float32)(cx + 1)), b2Clamp(pLocal.y, (float32)cy, (float32)(cy + 1)));
+            b2Vec2 dv = pLocal - closest;
+            float32 dd = dv.LengthSquared();
+            if (dd < best) {
+                best = dd;
+                delta = dv;
+            }
+        }
+    }
+
+    if (best == b2_maxFloat) {
+        *distance = b2_maxFloat;
+        *normal = b2Vec2_zero;
+        return;
+    }
+
+    float32 length = b2Sqrt(best);
+    *distance = length;
+    *normal = length > 0.0f ? b2Mul(xf.q, (1.0f / length) * delta) : b2Vec2_zero;
+}
+
+// Walk the cells along the ray (Amanatides and Woo) and report the first
+// face where the ray passes from an empty cell into a solid one.
+bool b2GridShape::RayCast(b2RayCastOutput* output, const b2RayCastInput& input, const b2Transform& xf) const {
+    if (m_cells == nullptr) {
+        return false;
+    }
+
+    b2Vec2 p1 = b2MulT(xf.q, input.p1 - xf.p);
+    b2Vec2 p2 = b2MulT(xf.q, input.p2 - xf.p);
+    b2Vec2 d = p2 - p1;
+
+    // Clip the ray to the grid bounds
+    float32 tEnter = 0.0f;
+    float32 tExit = input.maxFraction;
+    b2Vec2 enterNormal = b2Vec2_zero;
+    const float32 lower[2] = {0.0f, 0.0f};
+    const float32 upper[2] = {(float32)m_width, (float32)m_height};
+    for (int32 i = 0; i < 2; ++i) {
+        const float32 origin = i == 0 ? p1.x : p1.y;
+        const float32 dir = i == 0 ? d.x : d.y;
+        if (b2Abs(dir) < b2_epsilon) {
+            if (origin < lower[i] || upper[i] < origin) {
+                return false;
+            }
+            continue;
+        }
+
+        float32 t1 = (lower[i] - origin) / dir;
+        float32 t2 = (upper[i] - origin) / dir;
+        float32 s = -1.0f;
+        if (t1 > t2) {
+            b2Swap(t1, t2);
+            s = 1.0f;
+        }
+
+        if (t1 > tEnter) {
+            tEnter = t1;
+            enterNormal.SetZero();
+            (i == 0 ? enterNormal.x : enterNormal.y) = s;
+        }
+        tExit = b2Min(tExit, t2);
+        if (tEnter > tExit) {
+            return false;
+        }
+    }
+
+    b2Vec2 p = p1 + tEnter * d;
+    int32 x = b2Clamp((int32)floorf(p.x), 0, m_width - 1);
+    int32 y = b2Clamp((int32)floorf(p.y), 0, m_height - 1);
+
+    // A ray that starts outside enters through the grid boundary
+    bool wasEmpty = tEnter > 0.0f || !IsSolid(x, y);
+    if (tEnter > 0.0f && IsSolid(x, y)) {
+        output->fraction = tEnter;
+        output->normal = b2Mul(xf.q, enterNormal);
+        return true;
+    }
+
+    const int32 stepX = d.x > 0.0f ? 1 : -1;
+    const int32 stepY = d.y > 0.0f ? 1 : -1;
+    const float32 tDeltaX = b2Abs(d.x) > b2_epsilon ? 1.0f / b2Abs(d.x) : b2_maxFloat;
+    const float32 tDeltaY = b2Abs(d.y) > b2_epsilon ? 1.0f / b2Abs(d.y) : b2_maxFloat;
+    float32 tMaxX = b2Abs(d.x) > b2_epsilon ? ((float32)(stepX > 0 ? x + 1 : x) - p1.x) / d.x : b2_maxFloat;
+    float32 tMaxY = b2Abs(d.y) > b2_epsilon ? ((float32)(stepY > 0 ? y + 1 : y) - p1.y) / d.y : b2_maxFloat;
+
+    for (;;) {
+        float32 t;
+        b2Vec2 n;
+        if (tMaxX < tMaxY) {
+            t = tMaxX;
+            x += stepX;
+            tMaxX += tDeltaX;
+            n.Set(-(float32)stepX, 0.0f);
+        } else {
+            t = tMaxY;
+            y += stepY;
+            tMaxY += tDeltaY;
+            n.Set(0.0f, -(float32)stepY);
+        }
+
+        if (t > tExit || x < 0 || y < 0 || x >= m_width || y >= m_height) {
+            return false;
+        }
+
+        if (IsSolid(x, y)) {
+            if (wasEmpty) {
+                output->fraction = t;
+                output->normal = b2Mul(xf.q, n);
+                return true;
+            }
+        } else {
+            wasEmpty = true;
+        }
+    }
+}
+
+void b2GridShape::ComputeAABB(b2AABB* aabb, const b2Transform& xf) const {
+    const b2Vec2 corners[4] = {b2Vec2(0.0f, 0.0f), b2Vec2((float)m_width, 0.0f), b2Vec2(0.0f, (float)m_height), b2Vec2((float)m_width, (float)m_height)};
+
+    b2Vec2 lower = b2Mul(xf, corners[0]);
+    b2Vec2 upper = lower;
+    for (int32 i = 1; i < 4; ++i) {
+        b2Vec2 v = b2Mul(xf, corners[i]);
+        lower = b2Min(lower, v);
+        upper = b2Max(upper, v);
+    }
+
+    b2Vec2 r(m_radius, m_radius);
+    aabb->lowerBound = lower - r;
+    aabb->upperBound = upper + r;
+}
+
+void b2GridShape::ComputeMass(b2MassData* massData, float density) const {
+    B2_NOT_USED(density);
+
+    massData->mass = 0.0f;
+    massData->center.Set(0.5f * (float)m_width, 0.5f * (float)m_height);
+    massData->I = 0.0f;
+}
@@ -465,6 +465,11 @@ void b2Body::SetTransform(const b2Vec2& position, float angle) {
 
     UpdateAABBs();
 
+    // The static subtree is only rebuilt when invalidated, several moves before the next step share one rebuild.
+    if (m_type == b2_staticBody) {
+        m_world->m_contactManager.m_broadPhase.InvalidateStaticBodies();
+    }
+
     // Check for new contacts the next step
     m_world->m_newContacts = true;
 }
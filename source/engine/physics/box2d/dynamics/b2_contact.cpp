@@ -31,6 +31,7 @@
 #include "engine/physics/box2d/inc/b2_body.h"
 #include "engine/physics/box2d/inc/b2_collision.h"
 #include "engine/physics/box2d/inc/b2_fixture.h"
+#include "engine/physics/box2d/inc/b2_grid_shape.h"
 #include "engine/physics/box2d/inc/b2_shape.h"
 #include "engine/physics/box2d/inc/b2_time_of_impact.h"
 #include "engine/physics/box2d/inc/b2_world.h"
@@ -43,7 +44,8 @@
 // Create b2EvaluateFunction wrapper functions for the collision functions
 b2CreateCollisionFuncWrapper(b2CollideCircles, b2CircleShape, b2CircleShape) b2CreateCollisionFuncWrapper(b2CollidePolygonAndCircle, b2PolygonShape, b2CircleShape)
         b2CreateCollisionFuncWrapper(b2CollidePolygons, b2PolygonShape, b2PolygonShape) b2CreateCollisionFuncWrapper(b2CollideEdgeAndCircle, b2EdgeShape, b2CircleShape)
-                b2CreateCollisionFuncWrapper(b2CollideEdgeAndPolygon, b2EdgeShape, b2PolygonShape)
+                b2CreateCollisionFuncWrapper(b2CollideEdgeAndPolygon, b2EdgeShape, b2PolygonShape) b2CreateCollisionFuncWrapper(b2CollideGridAndCircle, b2GridShape, b2CircleShape)
+                        b2CreateCollisionFuncWrapper(b2CollideGridAndPolygon, b2GridShape, b2PolygonShape)
 
                         b2EvaluateFunction* b2Contact::functions[b2Shape::e_typeCount][b2Shape::e_typeCount];
 
@@ -53,6 +55,8 @@ bool b2Contact::InitializeRegisters() {
     functions[b2Shape::e_polygon][b2Shape::e_polygon] = &b2CollidePolygonsWrapper;
     functions[b2Shape::e_edge][b2Shape::e_circle] = &b2CollideEdgeAndCircleWrapper;
     functions[b2Shape::e_edge][b2Shape::e_polygon] = &b2CollideEdgeAndPolygonWrapper;
+    functions[b2Shape::e_grid][b2Shape::e_circle] = &b2CollideGridAndCircleWrapper;
+    functions[b2Shape::e_grid][b2Shape::e_polygon] = &b2CollideGridAndPolygonWrapper;
 
     return true;
 }
@@ -123,7 +127,13 @@ b2Contact::b2Contact(b2Fixture* fA, b2Fixture* fB, b2EvaluateFunction* evaluateF
 // Update the contact manifold and touching status.
 // Note: do not assume the fixture AABBs are overlapping or are valid.
 void b2Contact::Update(b2ContactListener* listener) {
-    b2Manifold oldManifold = m_manifold;
+    b2Manifold oldManifold;
+    bool wasTouching = UpdateManifold(&oldManifold);
+    FinishUpdate(listener, wasTouching, &oldManifold);
+}
+
+bool b2Contact::UpdateManifold(b2Manifold* oldManifold) {
+    *oldManifold = m_manifold;
 
     // Re-enable this contact.
     m_flags |= e_enabledFlag;
@@ -144,7 +154,13 @@ void b2Contact::Update(b2ContactListener* listener) {
     if (sensor) {
         const b2Shape* shapeA = m_fixtureA->GetShape();
         const b2Shape* shapeB = m_fixtureB->GetShape();
-        touching = b2TestOverlap(shapeA, shapeB, xfA, xfB);
+        if (shapeA->GetType() == b2Shape::e_grid) {
+            // A grid has no convex proxy, overlap is whether it makes contact points
+            Evaluate(&m_manifold, xfA, xfB);
+            touching = m_manifold.pointCount > 0;
+        } else {
+            touching = b2TestOverlap(shapeA, shapeB, xfA, xfB);
+        }
 
         // Sensors don't generate manifolds.
         m_manifold.pointCount = 0;
@@ -164,8 +180,8 @@ void b2Contact::Update(b2ContactListener* listener) {
 
             b2ContactID id2 = mp2->id;
 
-            for (int32 j = 0; j < oldManifold.pointCount; ++j) {
-                b2ManifoldPoint* mp1 = oldManifold.points + j;
+            for (int32 j = 0; j < oldManifold->pointCount; ++j) {
+                b2ManifoldPoint* mp1 = oldManifold->points + j;
 
                 if (mp1->id.key == id2.key) {
                     mp2->normalImpulse = mp1->normalImpulse;
@@ -178,13 +194,6 @@ void b2Contact::Update(b2ContactListener* listener) {
                 }
             }
         }
-
-#ifdef ENABLE_SLEEPING
-        if (touching != wasTouching) {
-            bodyA->SetAwake(true);
-            bodyB->SetAwake(true);
-        }
-#endif  // ENABLE_SLEEPING
     }
 
     if (touching) {
@@ -193,6 +202,20 @@ void b2Contact::Update(b2ContactListener* listener) {
         m_flags &= ~e_touchingFlag;
     }
 
+    return wasTouching;
+}
+
+void b2Contact::FinishUpdate(b2ContactListener* listener, bool wasTouching, const b2Manifold* oldManifold) {
+    bool touching = IsTouching();
+    bool sensor = m_fixtureA->IsSensor() || m_fixtureB->IsSensor();
+
+#ifdef ENABLE_SLEEPING
+    if (sensor == false && touching != wasTouching) {
+        m_fixtureA->GetBody()->SetAwake(true);
+        m_fixtureB->GetBody()->SetAwake(true);
+    }
+#endif  // ENABLE_SLEEPING
+
     if (listener) {
         if (wasTouching == false && touching == true) {
             listener->BeginContact(this);
@@ -203,7 +226,7 @@ void b2Contact::Update(b2ContactListener* listener) {
         }
 
         if (sensor == false && touching == true) {
-            listener->PreSolve(this, &oldManifold);
+            listener->PreSolve(this, oldManifold);
         }
     }
 }
@@ -217,6 +240,11 @@ float b2Contact::CalculateTOI() {
         return 1.0f;
     }
 
+    // Grids are not convex and have no time of impact.
+    if (fA->GetType() == b2Shape::e_grid || fB->GetType() == b2Shape::e_grid) {
+        return 1.0f;
+    }
+
     b2Body* bA = fA->GetBody();
     b2Body* bB = fB->GetBody();
 
@@ -45,9 +45,21 @@ b2ContactManager::b2ContactManager() {
     m_contactList->m_prev = m_contactList;
     m_contactList->m_fixtureA = nullptr;
     m_contactList->m_fixtureB = nullptr;
+
+    m_updateContacts = nullptr;
+    m_updateManifolds = nullptr;
+    m_updateWasTouching = nullptr;
+    m_updateActive = nullptr;
+    m_updateCapacity = 0;
 }
 
-b2ContactManager::~b2ContactManager() { b2Free(m_contactList); }
+b2ContactManager::~b2ContactManager() {
+    b2Free(m_updateActive);
+    b2Free(m_updateWasTouching);
+    b2Free(m_updateManifolds);
+    b2Free(m_updateContacts);
+    b2Free(m_contactList);
+}
 
 void b2ContactManager::Destroy(b2Contact* c) {
     if (m_contactListener && c->IsTouching()) {
@@ -64,10 +76,47 @@ void b2ContactManager::Destroy(b2Contact* c) {
     --m_contactCount;
 }
 
+// At least one body must be awake and it must be dynamic or kinematic.
+static bool b2IsContactActive(const b2Body* bodyA, const b2Body* bodyB) {
+#ifdef ENABLE_SLEEPING
+    bool activeA = bodyA->IsAwake() && bodyA->GetType() != b2_staticBody;
+    bool activeB = bodyB->IsAwake() && bodyB->GetType() != b2_staticBody;
+    return activeA || activeB;
+#else
+    return (bodyA->GetType() != b2_staticBody) || (bodyB->GetType() != b2_staticBody);
+#endif  // ENABLE_SLEEPING
+}
+
+void b2ContactManager::UpdateContactsTask(void* taskContext, int32 begin, int32 end) {
+    b2ContactManager* manager = (b2ContactManager*)taskContext;
+    for (int32 i = begin; i < end; ++i) {
+        if (manager->m_updateActive[i]) {
+            manager->m_updateWasTouching[i] = manager->m_updateContacts[i]->UpdateManifold(manager->m_updateManifolds + i);
+        }
+    }
+}
+
 // This is the top level collision call for the time step. Here
 // all the narrow phase collision is processed for the world
 // contact list.
-void b2ContactManager::Collide() {
+void b2ContactManager::Collide(b2ParallelForFcn* parallelFor, void* parallelContext) {
+    // Below this many active contacts the narrow phase is not worth splitting.
+    const int32 minParallelContacts = 64;
+
+    if (parallelFor && m_contactCount >= 2 * minParallelContacts && m_updateCapacity < m_contactCount) {
+        b2Free(m_updateActive);
+        b2Free(m_updateWasTouching);
+        b2Free(m_updateManifolds);
+        b2Free(m_updateContacts);
+        m_updateCapacity = 2 * m_contactCount;
+        m_updateContacts = (b2Contact**)b2Alloc(m_updateCapacity * sizeof(b2Contact*));
+        m_updateManifolds = (b2Manifold*)b2Alloc(m_updateCapacity * sizeof(b2Manifold));
+        m_updateWasTouching = (bool*)b2Alloc(m_updateCapacity * sizeof(bool));
+        m_updateActive = (bool*)b2Alloc(m_updateCapacity * sizeof(bool));
+    }
+    bool parallel = parallelFor && m_contactCount >= 2 * minParallelContacts;
+    int32 updateCount = 0;
+
     // Update awake contacts.
     b2Contact* c = Start();
     while (c != End()) {
@@ -100,23 +149,34 @@ void b2ContactManager::Collide() {
         // Clear the filtering flag
         c->m_flags &= ~(b2Contact::e_islandFlag | b2Contact::e_persistFlag | b2Contact::e_filterFlag);
 
-        // TODO this checks can probably be removed with some extra code in b2_body
-#ifdef ENABLE_SLEEPING
-        bool activeA = bodyA->IsAwake() && bodyA->m_type != b2_staticBody;
-        bool activeB = bodyB->IsAwake() && bodyB->m_type != b2_staticBody;
-        bool active = (activeA || activeB);
-#else
-        bool active = (bodyA->m_type != b2_staticBody) || (bodyB->m_type != b2_staticBody);
-#endif  // ENABLE_SLEEPING
-
-        // At least one body must be awake and it must be dynamic or kinematic.
-        if (active) {
+        if (parallel) {
+            // Inactive contacts are kept too, an earlier contact may wake them in the pass below.
+            m_updateActive[updateCount] = b2IsContactActive(bodyA, bodyB);
+            m_updateContacts[updateCount++] = c;
+        } else if (b2IsContactActive(bodyA, bodyB)) {
             // The contact persists.
             c->Update(m_contactListener);
         }
 
         c = c->GetNext();
     }
+
+    if (updateCount == 0) {
+        return;
+    }
+
+    parallelFor(parallelContext, updateCount, minParallelContacts, &UpdateContactsTask, this);
+
+    // Same order as the serial loop, so wake ups and listener calls happen exactly as without
+    // parallelFor. A sleeping contact woken by an earlier one is updated here like it would be there.
+    for (int32 i = 0; i < updateCount; ++i) {
+        b2Contact* contact = m_updateContacts[i];
+        if (m_updateActive[i]) {
+            contact->FinishUpdate(m_contactListener, m_updateWasTouching[i], m_updateManifolds + i);
+        } else if (b2IsContactActive(contact->GetFixtureA()->GetBody(), contact->GetFixtureB()->GetBody())) {
+            contact->Update(m_contactListener);
+        }
+    }
 }
 
 void b2ContactManager::FindNewContacts() {
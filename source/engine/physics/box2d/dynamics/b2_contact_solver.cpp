@@ -37,6 +37,7 @@
 #define B2_DEBUG_SOLVER 0
 
 B2_API bool g_blockSolve = true;
+B2_API bool g_wideSolve = true;
 
 struct b2ContactPositionConstraint {
     b2Vec2 localPoints[b2_maxManifoldPoints];
@@ -55,9 +56,22 @@ struct b2ContactPositionConstraint {
 b2ContactSolver::b2ContactSolver() {
     m_positionConstraints = nullptr;
     m_velocityConstraints = nullptr;
+    m_wideConstraints = nullptr;
+    m_wideCount = 0;
+    m_wideOverflow = nullptr;
+    m_wideOverflowCount = 0;
 }
 
 b2ContactSolver::~b2ContactSolver() {
+    // The wide batches are allocated after the constraints, free them first.
+    if (m_wideOverflow != nullptr) {
+        m_allocator->Free(m_wideOverflow);
+    }
+
+    if (m_wideConstraints != nullptr) {
+        m_allocator->Free(m_wideConstraints);
+    }
+
     if (m_velocityConstraints != nullptr) {
         m_allocator->Free(m_velocityConstraints);
     }
@@ -260,6 +274,8 @@ void b2ContactSolver::InitializeVelocityConstraints() {
             }
         }
     }
+
+    PrepareWideConstraints();
 }
 
 void b2ContactSolver::WarmStart() {
@@ -304,333 +320,347 @@ void b2ContactSolver::WarmStart() {
 }
 
 void b2ContactSolver::SolveVelocityConstraints() {
+    if (m_wideConstraints != nullptr) {
+        SolveWideVelocityConstraints();
+        for (int32 i = 0; i < m_wideOverflowCount; ++i) {
+            SolveVelocityConstraint(m_velocityConstraints + m_wideOverflow[i]);
+        }
+        return;
+    }
+
     for (int32 i = 0; i < m_count; ++i) {
-        b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+        SolveVelocityConstraint(m_velocityConstraints + i);
+    }
+}
 
-        int32 indexA = vc->indexA;
-        int32 indexB = vc->indexB;
-        float mA = vc->invMassA;
-        float iA = vc->invIA;
-        float mB = vc->invMassB;
-        float iB = vc->invIB;
-        int32 pointCount = vc->pointCount;
+void b2ContactSolver::SolveVelocityConstraint(b2ContactVelocityConstraint* vc) {
+    int32 indexA = vc->indexA;
+    int32 indexB = vc->indexB;
+    float mA = vc->invMassA;
+    float iA = vc->invIA;
+    float mB = vc->invMassB;
+    float iB = vc->invIB;
+    int32 pointCount = vc->pointCount;
 
-        b2Vec2 vA = m_velocities[indexA].v;
-        float wA = m_velocities[indexA].w;
-        b2Vec2 vB = m_velocities[indexB].v;
-        float wB = m_velocities[indexB].w;
+    b2Vec2 vA = m_velocities[indexA].v;
+    float wA = m_velocities[indexA].w;
+    b2Vec2 vB = m_velocities[indexB].v;
+    float wB = m_velocities[indexB].w;
 
-        b2Vec2 normal = vc->normal;
+    b2Vec2 normal = vc->normal;
 
-        b2Assert(pointCount == 1 || pointCount == 2);
+    b2Assert(pointCount == 1 || pointCount == 2);
 
 #ifdef ENABLE_FRICTION
-        b2Vec2 tangent = b2Cross(normal, 1.0f);
-        // Solve tangent constraints first because non-penetration is more important
-        // than friction.
+    b2Vec2 tangent = b2Cross(normal, 1.0f);
+    // Solve tangent constraints first because non-penetration is more important
+    // than friction.
+    for (int32 j = 0; j < pointCount; ++j) {
+        b2VelocityConstraintPoint* vcp = vc->points + j;
+
+        // Relative velocity at contact
+        b2Vec2 dv = vB + b2Cross(wB, vcp->rB) - (vA + b2Cross(wA, vcp->rA));
+
+        // Compute tangent force
+        float vt = b2Dot(dv, tangent) - vc->tangentSpeed;
+        float lambda = vcp->tangentMass * (-vt);
+
+        // b2Clamp the accumulated force
+        float maxFriction = vc->friction * vcp->normalImpulse;
+        float newImpulse = b2Clamp(vcp->tangentImpulse + lambda, -maxFriction, maxFriction);
+        lambda = newImpulse - vcp->tangentImpulse;
+        vcp->tangentImpulse = newImpulse;
+
+        // Apply contact impulse
+        b2Vec2 P = lambda * tangent;
+
+        vA -= mA * P;
+        wA -= iA * b2Cross(vcp->rA, P);
+
+        vB += mB * P;
+        wB += iB * b2Cross(vcp->rB, P);
+    }
+#endif  // ENABLE_FRICTION
+
+    // Solve normal constraints
+    if (pointCount == 1 || g_blockSolve == false) {
         for (int32 j = 0; j < pointCount; ++j) {
             b2VelocityConstraintPoint* vcp = vc->points + j;
 
             // Relative velocity at contact
             b2Vec2 dv = vB + b2Cross(wB, vcp->rB) - (vA + b2Cross(wA, vcp->rA));
 
-            // Compute tangent force
-            float vt = b2Dot(dv, tangent) - vc->tangentSpeed;
-            float lambda = vcp->tangentMass * (-vt);
+            // Compute normal impulse
+            float vn = b2Dot(dv, normal);
 
-            // b2Clamp the accumulated force
-            float maxFriction = vc->friction * vcp->normalImpulse;
-            float newImpulse = b2Clamp(vcp->tangentImpulse + lambda, -maxFriction, maxFriction);
-            lambda = newImpulse - vcp->tangentImpulse;
-            vcp->tangentImpulse = newImpulse;
+#ifdef ENABLE_RESTITUTION
+            float lambda = -vcp->normalMass * (vn - vcp->velocityBias);
+#else
+            float lambda = -vcp->normalMass * vn;
+#endif  // ENABLE_RESTITUTION
 
-            // Apply contact impulse
-            b2Vec2 P = lambda * tangent;
+            // b2Clamp the accumulated impulse
+            float newImpulse = b2Max(vcp->normalImpulse + lambda, 0.0f);
+            lambda = newImpulse - vcp->normalImpulse;
+            vcp->normalImpulse = newImpulse;
 
+            // Apply contact impulse
+            b2Vec2 P = lambda * normal;
             vA -= mA * P;
             wA -= iA * b2Cross(vcp->rA, P);
 
             vB += mB * P;
             wB += iB * b2Cross(vcp->rB, P);
         }
-#endif  // ENABLE_FRICTION
-
-        // Solve normal constraints
-        if (pointCount == 1 || g_blockSolve == false) {
-            for (int32 j = 0; j < pointCount; ++j) {
-                b2VelocityConstraintPoint* vcp = vc->points + j;
-
-                // Relative velocity at contact
-                b2Vec2 dv = vB + b2Cross(wB, vcp->rB) - (vA + b2Cross(wA, vcp->rA));
-
-                // Compute normal impulse
-                float vn = b2Dot(dv, normal);
+    } else {
+        // Block solver developed in collaboration with Dirk Gregorius (back in 01/07 on Box2D_Lite).
+        // Build the mini LCP for this contact patch
+        //
+        // vn = A * x + b, vn >= 0, x >= 0 and vn_i * x_i = 0 with i = 1..2
+        //
+        // A = J * W * JT and J = ( -n, -r1 x n, n, r2 x n )
+        // b = vn0 - velocityBias
+        //
+        // The system is solved using the "Total enumeration method" (s. Murty). The complementary constraint vn_i * x_i
+        // implies that we must have in any solution either vn_i = 0 or x_i = 0. So for the 2D contact problem the cases
+        // vn1 = 0 and vn2 = 0, x1 = 0 and x2 = 0, x1 = 0 and vn2 = 0, x2 = 0 and vn1 = 0 need to be tested. The first valid
+        // solution that satisfies the problem is chosen.
+        //
+        // In order to account of the accumulated impulse 'a' (because of the iterative nature of the solver which only requires
+        // that the accumulated impulse is clamped and not the incremental impulse) we change the impulse variable (x_i).
+        //
+        // Substitute:
+        //
+        // x = a + d
+        //
+        // a := old total impulse
+        // x := new total impulse
+        // d := incremental impulse
+        //
+        // For the current iteration we extend the formula for the incremental impulse
+        // to compute the new total impulse:
+        //
+        // vn = A * d + b
+        //    = A * (x - a) + b
+        //    = A * x + b - A * a
+        //    = A * x + b'
+        // b' = b - A * a;
+
+        b2VelocityConstraintPoint* cp1 = vc->points + 0;
+        b2VelocityConstraintPoint* cp2 = vc->points + 1;
+
+        b2Vec2 a(cp1->normalImpulse, cp2->normalImpulse);
+        b2Assert(a.x >= 0.0f && a.y >= 0.0f);
+
+        // Relative velocity at contact
+        b2Vec2 dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
+        b2Vec2 dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
+
+        // Compute normal velocity
+        float vn1 = b2Dot(dv1, normal);
+        float vn2 = b2Dot(dv2, normal);
+
+        b2Vec2 b;
 
 #ifdef ENABLE_RESTITUTION
-                float lambda = -vcp->normalMass * (vn - vcp->velocityBias);
+        b.x = vn1 - cp1->velocityBias;
+        b.y = vn2 - cp2->velocityBias;
 #else
-                float lambda = -vcp->normalMass * vn;
+        b.x = vn1;
+        b.y = vn2;
 #endif  // ENABLE_RESTITUTION
 
-                // b2Clamp the accumulated impulse
-                float newImpulse = b2Max(vcp->normalImpulse + lambda, 0.0f);
-                lambda = newImpulse - vcp->normalImpulse;
-                vcp->normalImpulse = newImpulse;
+        // Compute b'
+        b -= b2Mul(vc->K, a);
 
-                // Apply contact impulse
-                b2Vec2 P = lambda * normal;
-                vA -= mA * P;
-                wA -= iA * b2Cross(vcp->rA, P);
+        const float k_errorTol = 1e-3f;
+        B2_NOT_USED(k_errorTol);
 
-                vB += mB * P;
-                wB += iB * b2Cross(vcp->rB, P);
-            }
-        } else {
-            // Block solver developed in collaboration with Dirk Gregorius (back in 01/07 on Box2D_Lite).
-            // Build the mini LCP for this contact patch
-            //
-            // vn = A * x + b, vn >= 0, x >= 0 and vn_i * x_i = 0 with i = 1..2
-            //
-            // A = J * W * JT and J = ( -n, -r1 x n, n, r2 x n )
-            // b = vn0 - velocityBias
-            //
-            // The system is solved using the "Total enumeration method" (s. Murty). The complementary constraint vn_i * x_i
-            // implies that we must have in any solution either vn_i = 0 or x_i = 0. So for the 2D contact problem the cases
-            // vn1 = 0 and vn2 = 0, x1 = 0 and x2 = 0, x1 = 0 and vn2 = 0, x2 = 0 and vn1 = 0 need to be tested. The first valid
-            // solution that satisfies the problem is chosen.
-            //
-            // In order to account of the accumulated impulse 'a' (because of the iterative nature of the solver which only requires
-            // that the accumulated impulse is clamped and not the incremental impulse) we change the impulse variable (x_i).
+        for (;;) {
             //
-            // Substitute:
+            // Case 1: vn = 0
             //
-            // x = a + d
+            // 0 = A * x + b'
             //
-            // a := old total impulse
-            // x := new total impulse
-            // d := incremental impulse
+            // Solve for x:
             //
-            // For the current iteration we extend the formula for the incremental impulse
-            // to compute the new total impulse:
+            // x = - inv(A) * b'
             //
-            // vn = A * d + b
-            //    = A * (x - a) + b
-            //    = A * x + b - A * a
-            //    = A * x + b'
-            // b' = b - A * a;
+            b2Vec2 x = -b2Mul(vc->normalMass, b);
 
-            b2VelocityConstraintPoint* cp1 = vc->points + 0;
-            b2VelocityConstraintPoint* cp2 = vc->points + 1;
+            if (x.x >= 0.0f && x.y >= 0.0f) {
+                // Get the incremental impulse
+                b2Vec2 d = x - a;
 
-            b2Vec2 a(cp1->normalImpulse, cp2->normalImpulse);
-            b2Assert(a.x >= 0.0f && a.y >= 0.0f);
+                // Apply incremental impulse
+                b2Vec2 P1 = d.x * normal;
+                b2Vec2 P2 = d.y * normal;
+                vA -= mA * (P1 + P2);
+                wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
 
-            // Relative velocity at contact
-            b2Vec2 dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
-            b2Vec2 dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
+                vB += mB * (P1 + P2);
+                wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
+
+                // Accumulate
+                cp1->normalImpulse = x.x;
+                cp2->normalImpulse = x.y;
 
-            // Compute normal velocity
-            float vn1 = b2Dot(dv1, normal);
-            float vn2 = b2Dot(dv2, normal);
+#if B2_DEBUG_SOLVER == 1
+                // Postconditions
+                dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
+                dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
 
-            b2Vec2 b;
+                // Compute normal velocity
+                vn1 = b2Dot(dv1, normal);
+                vn2 = b2Dot(dv2, normal);
 
 #ifdef ENABLE_RESTITUTION
-            b.x = vn1 - cp1->velocityBias;
-            b.y = vn2 - cp2->velocityBias;
+                b2Assert(b2Abs(vn1 - cp1->velocityBias) < k_errorTol);
+                b2Assert(b2Abs(vn2 - cp2->velocityBias) < k_errorTol);
 #else
-            b.x = vn1;
-            b.y = vn2;
+                b2Assert(b2Abs(vn1) < k_errorTol);
+                b2Assert(b2Abs(vn2) < k_errorTol);
 #endif  // ENABLE_RESTITUTION
 
-            // Compute b'
-            b -= b2Mul(vc->K, a);
-
-            const float k_errorTol = 1e-3f;
-            B2_NOT_USED(k_errorTol);
-
-            for (;;) {
-                //
-                // Case 1: vn = 0
-                //
-                // 0 = A * x + b'
-                //
-                // Solve for x:
-                //
-                // x = - inv(A) * b'
-                //
-                b2Vec2 x = -b2Mul(vc->normalMass, b);
-
-                if (x.x >= 0.0f && x.y >= 0.0f) {
-                    // Get the incremental impulse
-                    b2Vec2 d = x - a;
-
-                    // Apply incremental impulse
-                    b2Vec2 P1 = d.x * normal;
-                    b2Vec2 P2 = d.y * normal;
-                    vA -= mA * (P1 + P2);
-                    wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
-
-                    vB += mB * (P1 + P2);
-                    wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
-
-                    // Accumulate
-                    cp1->normalImpulse = x.x;
-                    cp2->normalImpulse = x.y;
+#endif
+                break;
+            }
+
+            //
+            // Case 2: vn1 = 0 and x2 = 0
+            //
+            //   0 = a11 * x1 + a12 * 0 + b1'
+            // vn2 = a21 * x1 + a22 * 0 + b2'
+            //
+            x.x = -cp1->normalMass * b.x;
+            x.y = 0.0f;
+            vn1 = 0.0f;
+            vn2 = vc->K.ex.y * x.x + b.y;
+            if (x.x >= 0.0f && vn2 >= 0.0f) {
+                // Get the incremental impulse
+                b2Vec2 d = x - a;
+
+                // Apply incremental impulse
+                b2Vec2 P1 = d.x * normal;
+                b2Vec2 P2 = d.y * normal;
+                vA -= mA * (P1 + P2);
+                wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
+
+                vB += mB * (P1 + P2);
+                wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
+
+                // Accumulate
+                cp1->normalImpulse = x.x;
+                cp2->normalImpulse = x.y;
 
 #if B2_DEBUG_SOLVER == 1
-                    // Postconditions
-                    dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
-                    dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
+                // Postconditions
+                dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
 
-                    // Compute normal velocity
-                    vn1 = b2Dot(dv1, normal);
-                    vn2 = b2Dot(dv2, normal);
+                // Compute normal velocity
+                vn1 = b2Dot(dv1, normal);
 
 #ifdef ENABLE_RESTITUTION
-                    b2Assert(b2Abs(vn1 - cp1->velocityBias) < k_errorTol);
-                    b2Assert(b2Abs(vn2 - cp2->velocityBias) < k_errorTol);
+                b2Assert(b2Abs(vn1 - cp1->velocityBias) < k_errorTol);
 #else
-                    b2Assert(b2Abs(vn1) < k_errorTol);
-                    b2Assert(b2Abs(vn2) < k_errorTol);
+                b2Assert(b2Abs(vn1) < k_errorTol);
 #endif  // ENABLE_RESTITUTION
 
 #endif
-                    break;
-                }
-
-                //
-                // Case 2: vn1 = 0 and x2 = 0
-                //
-                //   0 = a11 * x1 + a12 * 0 + b1'
-                // vn2 = a21 * x1 + a22 * 0 + b2'
-                //
-                x.x = -cp1->normalMass * b.x;
-                x.y = 0.0f;
-                vn1 = 0.0f;
-                vn2 = vc->K.ex.y * x.x + b.y;
-                if (x.x >= 0.0f && vn2 >= 0.0f) {
-                    // Get the incremental impulse
-                    b2Vec2 d = x - a;
-
-                    // Apply incremental impulse
-                    b2Vec2 P1 = d.x * normal;
-                    b2Vec2 P2 = d.y * normal;
-                    vA -= mA * (P1 + P2);
-                    wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
-
-                    vB += mB * (P1 + P2);
-                    wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
-
-                    // Accumulate
-                    cp1->normalImpulse = x.x;
-                    cp2->normalImpulse = x.y;
+                break;
+            }
 
-#if B2_DEBUG_SOLVER == 1
-                    // Postconditions
-                    dv1 = vB + b2Cross(wB, cp1->rB) - (vA + b2Cross(wA, cp1->rA));
+            //
+            // Case 3: vn2 = 0 and x1 = 0
+            //
+            // vn1 = a11 * 0 + a12 * x2 + b1'
+            //   0 = a21 * 0 + a22 * x2 + b2'
+            //
+            x.x = 0.0f;
+            x.y = -cp2->normalMass * b.y;
+            vn1 = vc->K.ey.x * x.y + b.x;
+            vn2 = 0.0f;
 
-                    // Compute normal velocity
-                    vn1 = b2Dot(dv1, normal);
+            if (x.y >= 0.0f && vn1 >= 0.0f) {
+                // Resubstitute for the incremental impulse
+                b2Vec2 d = x - a;
 
-#ifdef ENABLE_RESTITUTION
-                    b2Assert(b2Abs(vn1 - cp1->velocityBias) < k_errorTol);
-#else
-                    b2Assert(b2Abs(vn1) < k_errorTol);
-#endif  // ENABLE_RESTITUTION
+                // Apply incremental impulse
+                b2Vec2 P1 = d.x * normal;
+                b2Vec2 P2 = d.y * normal;
+                vA -= mA * (P1 + P2);
+                wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
 
-#endif
-                    break;
-                }
-
-                //
-                // Case 3: vn2 = 0 and x1 = 0
-                //
-                // vn1 = a11 * 0 + a12 * x2 + b1'
-                //   0 = a21 * 0 + a22 * x2 + b2'
-                //
-                x.x = 0.0f;
-                x.y = -cp2->normalMass * b.y;
-                vn1 = vc->K.ey.x * x.y + b.x;
-                vn2 = 0.0f;
-
-                if (x.y >= 0.0f && vn1 >= 0.0f) {
-                    // Resubstitute for the incremental impulse
-                    b2Vec2 d = x - a;
-
-                    // Apply incremental impulse
-                    b2Vec2 P1 = d.x * normal;
-                    b2Vec2 P2 = d.y * normal;
-                    vA -= mA * (P1 + P2);
-                    wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
-
-                    vB += mB * (P1 + P2);
-                    wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
-
-                    // Accumulate
-                    cp1->normalImpulse = x.x;
-                    cp2->normalImpulse = x.y;
+                vB += mB * (P1 + P2);
+                wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
+
+                // Accumulate
+                cp1->normalImpulse = x.x;
+                cp2->normalImpulse = x.y;
 
 #if B2_DEBUG_SOLVER == 1
-                    // Postconditions
-                    dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
+                // Postconditions
+                dv2 = vB + b2Cross(wB, cp2->rB) - (vA + b2Cross(wA, cp2->rA));
 
-                    // Compute normal velocity
-                    vn2 = b2Dot(dv2, normal);
+                // Compute normal velocity
+                vn2 = b2Dot(dv2, normal);
 
 #ifdef ENABLE_RESTITUTION
-                    b2Assert(b2Abs(vn2 - cp2->velocityBias) < k_errorTol);
+                b2Assert(b2Abs(vn2 - cp2->velocityBias) < k_errorTol);
 #else
-                    b2Assert(b2Abs(vn2) < k_errorTol);
+                b2Assert(b2Abs(vn2) < k_errorTol);
 #endif  // ENABLE_RESTITUTION
 
 #endif
-                    break;
-                }
-
-                //
-                // Case 4: x1 = 0 and x2 = 0
-                //
-                // vn1 = b1
-                // vn2 = b2;
-                x.x = 0.0f;
-                x.y = 0.0f;
-                vn1 = b.x;
-                vn2 = b.y;
-
-                if (vn1 >= 0.0f && vn2 >= 0.0f) {
-                    // Resubstitute for the incremental impulse
-                    b2Vec2 d = x - a;
-
-                    // Apply incremental impulse
-                    b2Vec2 P1 = d.x * normal;
-                    b2Vec2 P2 = d.y * normal;
-                    vA -= mA * (P1 + P2);
-                    wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
-
-                    vB += mB * (P1 + P2);
-                    wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
-
-                    // Accumulate
-                    cp1->normalImpulse = x.x;
-                    cp2->normalImpulse = x.y;
-
-                    break;
-                }
-
-                // No solution, give up. This is hit sometimes, but it doesn't seem to matter.
                 break;
             }
-        }
 
-        m_velocities[indexA].v = vA;
-        m_velocities[indexA].w = wA;
-        m_velocities[indexB].v = vB;
-        m_velocities[indexB].w = wB;
+            //
+            // Case 4: x1 = 0 and x2 = 0
+            //
+            // vn1 = b1
+            // vn2 = b2;
+            x.x = 0.0f;
+            x.y = 0.0f;
+            vn1 = b.x;
+            vn2 = b.y;
+
+            if (vn1 >= 0.0f && vn2 >= 0.0f) {
+                // Resubstitute for the incremental impulse
+                b2Vec2 d = x - a;
+
+                // Apply incremental impulse
+                b2Vec2 P1 = d.x * normal;
+                b2Vec2 P2 = d.y * normal;
+                vA -= mA * (P1 + P2);
+                wA -= iA * (b2Cross(cp1->rA, P1) + b2Cross(cp2->rA, P2));
+
+                vB += mB * (P1 + P2);
+                wB += iB * (b2Cross(cp1->rB, P1) + b2Cross(cp2->rB, P2));
+
+                // Accumulate
+                cp1->normalImpulse = x.x;
+                cp2->normalImpulse = x.y;
+
+                break;
+            }
+
+            // No solution, give up. This is hit sometimes, but it doesn't seem to matter.
+            break;
+        }
     }
+
+    m_velocities[indexA].v = vA;
+    m_velocities[indexA].w = wA;
+    m_velocities[indexB].v = vB;
+    m_velocities[indexB].w = wB;
 }
 
 void b2ContactSolver::StoreImpulses() {
+    if (m_wideConstraints != nullptr) {
+        StoreWideImpulses();
+    }
+
     for (int32 i = 0; i < m_count; ++i) {
         b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
         b2Manifold* manifold = vc->manifold;
@@ -36,6 +36,10 @@ class b2Contact;
 class b2Body;
 class b2StackAllocator;
 struct b2ContactPositionConstraint;
+struct b2ContactConstraintWide;
+
+/// Solve the velocity constraints of large islands in SIMD batches, see b2_contact_solver_wide.cpp.
+B2_API extern bool g_wideSolve;
 
 struct b2VelocityConstraintPoint {
     b2Vec2 rA;
@@ -110,6 +114,22 @@ public:
     b2ContactPositionConstraint* m_positionConstraints;
     b2ContactVelocityConstraint* m_velocityConstraints;
     int m_count;
+
+    // Wide path. Islands with at least b2_wideMinContacts contacts are graph colored so that no
+    // two lanes of a batch share a non-static body, each color is cut into batches of SIMD width
+    // and solved in structure-of-arrays form. Contacts that don't fit into b2_wideColorCount
+    // colors are left to the one-at-a-time solver.
+    b2ContactConstraintWide* m_wideConstraints;
+    int32 m_wideCount;
+    int32* m_wideOverflow;
+    int32 m_wideOverflowCount;
+
+private:
+    void SolveVelocityConstraint(b2ContactVelocityConstraint* vc);
+
+    void PrepareWideConstraints();
+    void SolveWideVelocityConstraints();
+    void StoreWideImpulses();
 };
 
 #endif
@@ -0,0 +1,424 @@
+// Metadot physics engine is enhanced based on box2d modification
+// Metadot code Copyright(c) 2022-2023, KaoruXun All rights reserved.
+// Box2d code by Erin Catto licensed under the MIT License
+// https://github.com/erincatto/box2d
+
+// MIT License
+// Copyright (c) 2022-2023 KaoruXun
+// Copyright (c) 2019 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Wide contact solver. Large islands (debris piles) are graph colored so that no two contacts
+// in a color share a non-static body, then every color is cut into batches of SIMD width and
+// the velocity constraints of a batch are solved together in structure-of-arrays form.
+//
+// Differences to the one-at-a-time solver:
+// - the order in which contacts are relaxed is color by color instead of island order,
+// - the two points of a manifold are relaxed one after the other, the block solver is not used.
+// Static and kinematic bodies (zero inverse mass and inertia) are not colored. Several lanes
+// may write them back but their velocity never changes.
+// The width is fixed at build time. The wide path only runs while cpu::allows() the instruction set
+// it was built for, so perf_kernel scalar falls back to the one-at-a-time solver as if g_wideSolve were off.
+
+#include <string.h>
+
+#include "b2_contact_solver.h"
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/physics/box2d/inc/b2_stack_allocator.h"
+
+#if defined(__AVX2__)
+#define B2_SIMD_AVX2 1
+#define B2_SIMD_LEVEL ME::simd_level::avx2
+#define B2_SIMD_WIDTH 8
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define B2_SIMD_SSE2 1
+#define B2_SIMD_LEVEL ME::simd_level::sse2
+#define B2_SIMD_WIDTH 4
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define B2_SIMD_NEON 1
+#define B2_SIMD_LEVEL ME::simd_level::neon
+#define B2_SIMD_WIDTH 4
+#include <arm_neon.h>
+#else
+#define B2_SIMD_LEVEL ME::simd_level::scalar
+#define B2_SIMD_WIDTH 4
+#endif
+
+#if defined(B2_SIMD_AVX2)
+
+typedef __m256 b2FloatW;
+
+static inline b2FloatW b2LoadW(const float* p) { return _mm256_loadu_ps(p); }
+static inline void b2StoreW(float* p, b2FloatW a) { _mm256_storeu_ps(p, a); }
+static inline b2FloatW b2ZeroW() { return _mm256_setzero_ps(); }
+static inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return _mm256_add_ps(a, b); }
+static inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return _mm256_sub_ps(a, b); }
+static inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return _mm256_mul_ps(a, b); }
+static inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return _mm256_max_ps(a, b); }
+static inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return _mm256_min_ps(a, b); }
+
+#elif defined(B2_SIMD_SSE2)
+
+typedef __m128 b2FloatW;
+
+static inline b2FloatW b2LoadW(const float* p) { return _mm_loadu_ps(p); }
+static inline void b2StoreW(float* p, b2FloatW a) { _mm_storeu_ps(p, a); }
+static inline b2FloatW b2ZeroW() { return _mm_setzero_ps(); }
+static inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return _mm_add_ps(a, b); }
+static inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return _mm_sub_ps(a, b); }
+static inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return _mm_mul_ps(a, b); }
+static inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return _mm_max_ps(a, b); }
+static inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return _mm_min_ps(a, b); }
+
+#elif defined(B2_SIMD_NEON)
+
+typedef float32x4_t b2FloatW;
+
+static inline b2FloatW b2LoadW(const float* p) { return vld1q_f32(p); }
+static inline void b2StoreW(float* p, b2FloatW a) { vst1q_f32(p, a); }
+static inline b2FloatW b2ZeroW() { return vdupq_n_f32(0.0f); }
+static inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return vaddq_f32(a, b); }
+static inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return vsubq_f32(a, b); }
+static inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return vmulq_f32(a, b); }
+static inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return vmaxq_f32(a, b); }
+static inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return vminq_f32(a, b); }
+
+#else
+
+// Portable fallback, the compiler is free to vectorize the loops.
+struct b2FloatW {
+    float v[B2_SIMD_WIDTH];
+};
+
+static inline b2FloatW b2LoadW(const float* p) {
+    b2FloatW r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+}
+static inline void b2StoreW(float* p, b2FloatW a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline b2FloatW b2ZeroW() {
+    b2FloatW r;
+    for (int i = 0; i < B2_SIMD_WIDTH; ++i) r.v[i] = 0.0f;
+    return r;
+}
+
+#define B2_FLOATW_OP(name, expr)                                          \
+    static inline b2FloatW name(b2FloatW a, b2FloatW b) {                   \
+        b2FloatW r;                                                       \
+        for (int i = 0; i < B2_SIMD_WIDTH; ++i) r.v[i] = expr;            \
+        return r;                                                         \
+    }
+B2_FLOATW_OP(b2AddW, a.v[i] + b.v[i])
+B2_FLOATW_OP(b2SubW, a.v[i] - b.v[i])
+B2_FLOATW_OP(b2MulW, a.v[i] * b.v[i])
+B2_FLOATW_OP(b2MaxW, b2Max(a.v[i], b.v[i]))
+B2_FLOATW_OP(b2MinW, b2Min(a.v[i], b.v[i]))
+#undef B2_FLOATW_OP
+
+#endif
+
+struct b2ContactPointWide {
+    float rAX[B2_SIMD_WIDTH], rAY[B2_SIMD_WIDTH];
+    float rBX[B2_SIMD_WIDTH], rBY[B2_SIMD_WIDTH];
+    float normalMass[B2_SIMD_WIDTH];
+    float tangentMass[B2_SIMD_WIDTH];
+    float velocityBias[B2_SIMD_WIDTH];
+    float normalImpulse[B2_SIMD_WIDTH];
+    float tangentImpulse[B2_SIMD_WIDTH];
+};
+
+// A lane with a single point keeps the second point zeroed, zero masses give zero impulses.
+// An empty lane has constraint == -1 and body indices of -1.
+struct b2ContactConstraintWide {
+    int32 constraint[B2_SIMD_WIDTH];
+    int32 indexA[B2_SIMD_WIDTH];
+    int32 indexB[B2_SIMD_WIDTH];
+    float invMassA[B2_SIMD_WIDTH], invMassB[B2_SIMD_WIDTH];
+    float invIA[B2_SIMD_WIDTH], invIB[B2_SIMD_WIDTH];
+    float normalX[B2_SIMD_WIDTH], normalY[B2_SIMD_WIDTH];
+    float friction[B2_SIMD_WIDTH];
+    float tangentSpeed[B2_SIMD_WIDTH];
+    b2ContactPointWide points[b2_maxManifoldPoints];
+};
+
+#if defined(ENABLE_FRICTION) && defined(ENABLE_RESTITUTION) && defined(ENABLE_TANGENT_SPEED)
+
+static_assert(b2_wideColorCount <= 32, "body colors are kept in a 32 bit mask");
+
+void b2ContactSolver::PrepareWideConstraints() {
+    if (!g_wideSolve || m_wideConstraints != nullptr || m_count < b2_wideMinContacts || !ME::cpu::allows(B2_SIMD_LEVEL)) {
+        return;
+    }
+
+    int32 bodyCount = 0;
+    for (int32 i = 0; i < m_count; ++i) {
+        const b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+        bodyCount = b2Max(bodyCount, b2Max(vc->indexA, vc->indexB) + 1);
+    }
+
+    // Each color wastes at most one partially filled batch.
+    const int32 capacity = m_count / B2_SIMD_WIDTH + b2_wideColorCount + 1;
+    m_wideConstraints = (b2ContactConstraintWide*)m_allocator->Allocate(capacity * sizeof(b2ContactConstraintWide));
+    m_wideOverflow = (int32*)m_allocator->Allocate(m_count * sizeof(int32));
+    int32* colors = (int32*)m_allocator->Allocate(m_count * sizeof(int32));
+    uint32* bodyColors = (uint32*)m_allocator->Allocate(bodyCount * sizeof(uint32));
+    memset(bodyColors, 0, bodyCount * sizeof(uint32));
+
+    // Greedy coloring in island order keeps the result deterministic.
+    int32 colorCounts[b2_wideColorCount] = {};
+    m_wideOverflowCount = 0;
+    for (int32 i = 0; i < m_count; ++i) {
+        const b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+        const bool staticA = vc->invMassA == 0.0f && vc->invIA == 0.0f;
+        const bool staticB = vc->invMassB == 0.0f && vc->invIB == 0.0f;
+        const uint32 used = (staticA ? 0u : bodyColors[vc->indexA]) | (staticB ? 0u : bodyColors[vc->indexB]);
+
+        int32 color = -1;
+        for (int32 c = 0; c < b2_wideColorCount; ++c) {
+            if ((used & (1u << c)) == 0) {
+                color = c;
+                break;
+            }
+        }
+
+        colors[i] = color;
+        if (color < 0) {
+            m_wideOverflow[m_wideOverflowCount++] = i;
+            continue;
+        }
+
+        colorCounts[color]++;
+        if (!staticA) bodyColors[vc->indexA] |= 1u << color;
+        if (!staticB) bodyColors[vc->indexB] |= 1u << color;
+    }
+
+    int32 colorBatch[b2_wideColorCount];
+    int32 colorFill[b2_wideColorCount] = {};
+    m_wideCount = 0;
+    for (int32 c = 0; c < b2_wideColorCount; ++c) {
+        colorBatch[c] = m_wideCount;
+        m_wideCount += (colorCounts[c] + B2_SIMD_WIDTH - 1) / B2_SIMD_WIDTH;
+    }
+    b2Assert(m_wideCount <= capacity);
+
+    memset(m_wideConstraints, 0, m_wideCount * sizeof(b2ContactConstraintWide));
+    for (int32 b = 0; b < m_wideCount; ++b) {
+        for (int32 lane = 0; lane < B2_SIMD_WIDTH; ++lane) {
+            m_wideConstraints[b].constraint[lane] = -1;
+            m_wideConstraints[b].indexA[lane] = -1;
+            m_wideConstraints[b].indexB[lane] = -1;
+        }
+    }
+
+    for (int32 i = 0; i < m_count; ++i) {
+        const int32 color = colors[i];
+        if (color < 0) {
+            continue;
+        }
+
+        const int32 slot = colorFill[color]++;
+        b2ContactConstraintWide* wc = m_wideConstraints + colorBatch[color] + slot / B2_SIMD_WIDTH;
+        const int32 lane = slot % B2_SIMD_WIDTH;
+        const b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+
+        wc->constraint[lane] = i;
+        wc->indexA[lane] = vc->indexA;
+        wc->indexB[lane] = vc->indexB;
+        wc->invMassA[lane] = vc->invMassA;
+        wc->invMassB[lane] = vc->invMassB;
+        wc->invIA[lane] = vc->invIA;
+        wc->invIB[lane] = vc->invIB;
+        wc->normalX[lane] = vc->normal.x;
+        wc->normalY[lane] = vc->normal.y;
+        wc->friction[lane] = vc->friction;
+        wc->tangentSpeed[lane] = vc->tangentSpeed;
+
+        for (int32 j = 0; j < vc->pointCount; ++j) {
+            const b2VelocityConstraintPoint* vcp = vc->points + j;
+            b2ContactPointWide* wp = wc->points + j;
+            wp->rAX[lane] = vcp->rA.x;
+            wp->rAY[lane] = vcp->rA.y;
+            wp->rBX[lane] = vcp->rB.x;
+            wp->rBY[lane] = vcp->rB.y;
+            wp->normalMass[lane] = vcp->normalMass;
+            wp->tangentMass[lane] = vcp->tangentMass;
+            wp->velocityBias[lane] = vcp->velocityBias;
+            wp->normalImpulse[lane] = vcp->normalImpulse;
+            wp->tangentImpulse[lane] = vcp->tangentImpulse;
+        }
+    }
+
+    m_allocator->Free(bodyColors);
+    m_allocator->Free(colors);
+}
+
+void b2ContactSolver::SolveWideVelocityConstraints() {
+    const b2FloatW zero = b2ZeroW();
+
+    for (int32 b = 0; b < m_wideCount; ++b) {
+        b2ContactConstraintWide* wc = m_wideConstraints + b;
+
+        // Gather body velocities, empty lanes read zero.
+        float gvAX[B2_SIMD_WIDTH], gvAY[B2_SIMD_WIDTH], gwA[B2_SIMD_WIDTH];
+        float gvBX[B2_SIMD_WIDTH], gvBY[B2_SIMD_WIDTH], gwB[B2_SIMD_WIDTH];
+        for (int32 lane = 0; lane < B2_SIMD_WIDTH; ++lane) {
+            const int32 indexA = wc->indexA[lane];
+            const int32 indexB = wc->indexB[lane];
+            const b2Velocity velA = indexA >= 0 ? m_velocities[indexA] : b2Velocity{b2Vec2(0.0f, 0.0f), 0.0f};
+            const b2Velocity velB = indexB >= 0 ? m_velocities[indexB] : b2Velocity{b2Vec2(0.0f, 0.0f), 0.0f};
+            gvAX[lane] = velA.v.x;
+            gvAY[lane] = velA.v.y;
+            gwA[lane] = velA.w;
+            gvBX[lane] = velB.v.x;
+            gvBY[lane] = velB.v.y;
+            gwB[lane] = velB.w;
+        }
+
+        b2FloatW vAX = b2LoadW(gvAX), vAY = b2LoadW(gvAY), wA = b2LoadW(gwA);
+        b2FloatW vBX = b2LoadW(gvBX), vBY = b2LoadW(gvBY), wB = b2LoadW(gwB);
+
+        const b2FloatW mA = b2LoadW(wc->invMassA);
+        const b2FloatW mB = b2LoadW(wc->invMassB);
+        const b2FloatW iA = b2LoadW(wc->invIA);
+        const b2FloatW iB = b2LoadW(wc->invIB);
+        const b2FloatW normalX = b2LoadW(wc->normalX);
+        const b2FloatW normalY = b2LoadW(wc->normalY);
+        // tangent = b2Cross(normal, 1.0f)
+        const b2FloatW tangentX = normalY;
+        const b2FloatW tangentY = b2SubW(zero, normalX);
+        const b2FloatW friction = b2LoadW(wc->friction);
+        const b2FloatW tangentSpeed = b2LoadW(wc->tangentSpeed);
+
+        // Solve tangent constraints first because non-penetration is more important than friction.
+        for (int32 j = 0; j < b2_maxManifoldPoints; ++j) {
+            b2ContactPointWide* wp = wc->points + j;
+            const b2FloatW rAX = b2LoadW(wp->rAX), rAY = b2LoadW(wp->rAY);
+            const b2FloatW rBX = b2LoadW(wp->rBX), rBY = b2LoadW(wp->rBY);
+
+            // Relative velocity at contact
+            const b2FloatW dvX = b2SubW(b2SubW(vBX, b2MulW(wB, rBY)), b2SubW(vAX, b2MulW(wA, rAY)));
+            const b2FloatW dvY = b2SubW(b2AddW(vBY, b2MulW(wB, rBX)), b2AddW(vAY, b2MulW(wA, rAX)));
+
+            // Compute tangent force
+            const b2FloatW vt = b2SubW(b2AddW(b2MulW(dvX, tangentX), b2MulW(dvY, tangentY)), tangentSpeed);
+            b2FloatW lambda = b2MulW(b2LoadW(wp->tangentMass), b2SubW(zero, vt));
+
+            // b2Clamp the accumulated force
+            const b2FloatW oldImpulse = b2LoadW(wp->tangentImpulse);
+            const b2FloatW maxFriction = b2MulW(friction, b2LoadW(wp->normalImpulse));
+            const b2FloatW newImpulse = b2MaxW(b2SubW(zero, maxFriction), b2MinW(b2AddW(oldImpulse, lambda), maxFriction));
+            lambda = b2SubW(newImpulse, oldImpulse);
+            b2StoreW(wp->tangentImpulse, newImpulse);
+
+            // Apply contact impulse
+            const b2FloatW PX = b2MulW(lambda, tangentX);
+            const b2FloatW PY = b2MulW(lambda, tangentY);
+
+            vAX = b2SubW(vAX, b2MulW(mA, PX));
+            vAY = b2SubW(vAY, b2MulW(mA, PY));
+            wA = b2SubW(wA, b2MulW(iA, b2SubW(b2MulW(rAX, PY), b2MulW(rAY, PX))));
+
+            vBX = b2AddW(vBX, b2MulW(mB, PX));
+            vBY = b2AddW(vBY, b2MulW(mB, PY));
+            wB = b2AddW(wB, b2MulW(iB, b2SubW(b2MulW(rBX, PY), b2MulW(rBY, PX))));
+        }
+
+        // Solve normal constraints
+        for (int32 j = 0; j < b2_maxManifoldPoints; ++j) {
+            b2ContactPointWide* wp = wc->points + j;
+            const b2FloatW rAX = b2LoadW(wp->rAX), rAY = b2LoadW(wp->rAY);
+            const b2FloatW rBX = b2LoadW(wp->rBX), rBY = b2LoadW(wp->rBY);
+
+            // Relative velocity at contact
+            const b2FloatW dvX = b2SubW(b2SubW(vBX, b2MulW(wB, rBY)), b2SubW(vAX, b2MulW(wA, rAY)));
+            const b2FloatW dvY = b2SubW(b2AddW(vBY, b2MulW(wB, rBX)), b2AddW(vAY, b2MulW(wA, rAX)));
+
+            // Compute normal impulse
+            const b2FloatW vn = b2AddW(b2MulW(dvX, normalX), b2MulW(dvY, normalY));
+            b2FloatW lambda = b2MulW(b2SubW(zero, b2LoadW(wp->normalMass)), b2SubW(vn, b2LoadW(wp->velocityBias)));
+
+            // b2Clamp the accumulated impulse
+            const b2FloatW oldImpulse = b2LoadW(wp->normalImpulse);
+            const b2FloatW newImpulse = b2MaxW(b2AddW(oldImpulse, lambda), zero);
+            lambda = b2SubW(newImpulse, oldImpulse);
+            b2StoreW(wp->normalImpulse, newImpulse);
+
+            // Apply contact impulse
+            const b2FloatW PX = b2MulW(lambda, normalX);
+            const b2FloatW PY = b2MulW(lambda, normalY);
+
+            vAX = b2SubW(vAX, b2MulW(mA, PX));
+            vAY = b2SubW(vAY, b2MulW(mA, PY));
+            wA = b2SubW(wA, b2MulW(iA, b2SubW(b2MulW(rAX, PY), b2MulW(rAY, PX))));
+
+            vBX = b2AddW(vBX, b2MulW(mB, PX));
+            vBY = b2AddW(vBY, b2MulW(mB, PY));
+            wB = b2AddW(wB, b2MulW(iB, b2SubW(b2MulW(rBX, PY), b2MulW(rBY, PX))));
+        }
+
+        b2StoreW(gvAX, vAX);
+        b2StoreW(gvAY, vAY);
+        b2StoreW(gwA, wA);
+        b2StoreW(gvBX, vBX);
+        b2StoreW(gvBY, vBY);
+        b2StoreW(gwB, wB);
+
+        // Scatter. Lanes of a batch never share a non-static body so the order doesn't matter.
+        for (int32 lane = 0; lane < B2_SIMD_WIDTH; ++lane) {
+            if (wc->constraint[lane] < 0) {
+                continue;
+            }
+            b2Velocity* velA = m_velocities + wc->indexA[lane];
+            b2Velocity* velB = m_velocities + wc->indexB[lane];
+            velA->v.Set(gvAX[lane], gvAY[lane]);
+            velA->w = gwA[lane];
+            velB->v.Set(gvBX[lane], gvBY[lane]);
+            velB->w = gwB[lane];
+        }
+    }
+}
+
+void b2ContactSolver::StoreWideImpulses() {
+    for (int32 b = 0; b < m_wideCount; ++b) {
+        const b2ContactConstraintWide* wc = m_wideConstraints + b;
+        for (int32 lane = 0; lane < B2_SIMD_WIDTH; ++lane) {
+            if (wc->constraint[lane] < 0) {
+                continue;
+            }
+            b2ContactVelocityConstraint* vc = m_velocityConstraints + wc->constraint[lane];
+            for (int32 j = 0; j < vc->pointCount; ++j) {
+                vc->points[j].normalImpulse = wc->points[j].normalImpulse[lane];
+                vc->points[j].tangentImpulse = wc->points[j].tangentImpulse[lane];
+            }
+        }
+    }
+}
+
+#else
+
+// The wide constraints carry friction, restitution and tangent speed unconditionally.
+void b2ContactSolver::PrepareWideConstraints() {}
+void b2ContactSolver::SolveWideVelocityConstraints() {}
+void b2ContactSolver::StoreWideImpulses() {}
+
+#endif
@@ -33,6 +33,7 @@
 #include "engine/physics/box2d/inc/b2_collision.h"
 #include "engine/physics/box2d/inc/b2_contact.h"
 #include "engine/physics/box2d/inc/b2_edge_shape.h"
+#include "engine/physics/box2d/inc/b2_grid_shape.h"
 #include "engine/physics/box2d/inc/b2_polygon_shape.h"
 #include "engine/physics/box2d/inc/b2_world.h"
 
@@ -93,6 +94,12 @@ void b2Fixture::Destroy(b2BlockAllocator* allocator) {
             allocator->Free(s, sizeof(b2PolygonShape));
         } break;
 
+        case b2Shape::e_grid: {
+            b2GridShape* s = (b2GridShape*)m_shape;
+            s->~b2GridShape();
+            allocator->Free(s, sizeof(b2GridShape));
+        } break;
+
         default:
             b2Assert(false);
             break;
@@ -226,6 +233,13 @@ void b2Fixture::Dump(int32 bodyIndex) {
             b2Dump("    shape.Set(vs, %d);\n", s->m_count);
         } break;
 
+        case b2Shape::e_grid: {
+            // The cell bitmap belongs to the caller and is not dumped
+            b2GridShape* s = (b2GridShape*)m_shape;
+            b2Dump("    // b2GridShape %d x %d, cells are not dumped\n", s->m_width, s->m_height);
+        }
+            return;
+
             /*
             TODO can e_edge handle chains create from the geometry class?
             case b2Shape::e_chain:
@@ -164,6 +164,7 @@ b2Island::b2Island(int32 bodyCapacity, int32 contactCapacity, int32 jointCapacit
 
     m_allocator = allocator;
     m_listener = listener;
+    m_listenerMutex = nullptr;
 
     m_bodies = (b2Body**)m_allocator->Allocate(bodyCapacity * sizeof(b2Body*));
     m_contacts = (b2Contact**)m_allocator->Allocate(contactCapacity * sizeof(b2Contact*));
@@ -410,6 +411,10 @@ void b2Island::Solve(const b2TimeStep& step, const b2Vec2& gravity, bool allowSl
     // Copy state buffers back to the bodies
     for (int32 i = 0; i < m_bodyCount; ++i) {
         b2Body* body = m_bodies[i];
+        // Static bodies do not move and may be shared with islands solved on other threads.
+        if (body->m_type == b2_staticBody) {
+            continue;
+        }
         body->m_sweep.c = m_positions[i].c;
         body->m_sweep.a = m_positions[i].a;
         body->m_linearVelocity = m_velocities[i].v;
@@ -585,6 +590,11 @@ void b2Island::Report(const b2ContactVelocityConstraint* constraints) {
         return;
     }
 
+    std::unique_lock<std::mutex> lock;
+    if (m_listenerMutex) {
+        lock = std::unique_lock<std::mutex>(*m_listenerMutex);
+    }
+
     for (int32 i = 0; i < m_contactCount; ++i) {
         b2Contact* c = m_contacts[i];
 
@@ -28,6 +28,8 @@
 #ifndef B2_ISLAND_H
 #define B2_ISLAND_H
 
+#include <mutex>
+
 #include "engine/physics/box2d/inc/b2_body.h"
 #include "engine/physics/box2d/inc/b2_math.h"
 #include "engine/physics/box2d/inc/b2_time_step.h"
@@ -52,7 +54,7 @@ public:
     }
 
     void Solve(const b2TimeStep& step, const b2Vec2& gravity, bool allowSleep);
-    void SolveOrphan(b2Body* b, const b2TimeStep& step, const b2Vec2& gravity, bool allowSleep);
+    static void SolveOrphan(b2Body* b, const b2TimeStep& step, const b2Vec2& gravity, bool allowSleep);
 
     void SolveTOI(const b2TimeStep& subStep, int32 toiIndexA, int32 toiIndexB);
 
@@ -63,6 +65,16 @@ public:
         ++m_bodyCount;
     }
 
+    /// Add a static body whose m_islandIndex was already assigned by the caller.
+    /// Used by the parallel solver where several islands share the same static bodies
+    /// and must agree on their index. Static bodies are never written by Solve.
+    void AddShared(b2Body* body) {
+        b2Assert(m_bodyCount < m_bodyCapacity);
+        b2Assert(body->m_islandIndex == m_bodyCount);
+        m_bodies[m_bodyCount] = body;
+        ++m_bodyCount;
+    }
+
     void Add(b2Contact* contact) {
         b2Assert(m_contactCount < m_contactCapacity);
         m_contacts[m_contactCount++] = contact;
@@ -77,6 +89,8 @@ public:
 
     b2StackAllocator* m_allocator;
     b2ContactListener* m_listener;
+    // Guards m_listener when islands are solved on several threads.
+    std::mutex* m_listenerMutex;
 
     b2Body** m_bodies;
     b2Contact** m_contacts;
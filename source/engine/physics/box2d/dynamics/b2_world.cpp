@@ -38,12 +38,35 @@
 #include "engine/physics/box2d/inc/b2_contact.h"
 #include "engine/physics/box2d/inc/b2_edge_shape.h"
 #include "engine/physics/box2d/inc/b2_fixture.h"
+#include "engine/physics/box2d/inc/b2_grid_shape.h"
 #include "engine/physics/box2d/inc/b2_polygon_shape.h"
 #include "engine/physics/box2d/inc/b2_pulley_joint.h"
 #include "engine/physics/box2d/inc/b2_time_of_impact.h"
 #include "engine/physics/box2d/inc/b2_timer.h"
 #include "engine/renderer/gpu.hpp"
 
+// A range of bodies/contacts/joints in the b2World island buffers.
+struct b2IslandRange {
+    int32 bodyBegin, bodyCount;
+    int32 contactBegin, contactCount;
+    int32 jointBegin, jointCount;
+};
+
+struct b2TaskAllocator {
+    b2StackAllocator allocator;
+    b2TaskAllocator* next;
+};
+
+template <typename T>
+static void b2ReserveBuffer(T*& data, int32& capacity, int32 count) {
+    if (capacity >= count) {
+        return;
+    }
+    b2Free(data);
+    capacity = b2Max(2 * capacity, count);
+    data = (T*)b2Alloc(capacity * sizeof(T));
+}
+
 b2World::b2World(const b2Vec2& gravity) {
     m_destructionListener = nullptr;
     m_debugDraw = nullptr;
@@ -75,6 +98,23 @@ b2World::b2World(const b2Vec2& gravity) {
     m_contactManager.m_allocator = &m_blockAllocator;
 
     memset(&m_profile, 0, sizeof(b2Profile));
+
+    m_parallelFor = nullptr;
+    m_parallelContext = nullptr;
+
+    m_islands = nullptr;
+    m_islandBodies = nullptr;
+    m_islandContacts = nullptr;
+    m_islandJoints = nullptr;
+    m_islandStatics = nullptr;
+    m_islandCount = 0;
+    m_islandStaticCount = 0;
+    m_islandCapacity = 0;
+    m_islandContactCapacity = 0;
+    m_islandJointCapacity = 0;
+    m_islandStep = nullptr;
+
+    m_freeTaskAllocators = nullptr;
 }
 
 b2World::~b2World() {
@@ -101,6 +141,20 @@ b2World::~b2World() {
         DestroyParticleSystem(m_particleSystemList);
     }
 #endif  // ENABLE_LIQUID
+
+    while (m_freeTaskAllocators) {
+        b2TaskAllocator* next = m_freeTaskAllocators->next;
+        m_freeTaskAllocators->~b2TaskAllocator();
+        b2Free(m_freeTaskAllocators);
+        m_freeTaskAllocators = next;
+    }
+
+    // m_islandCapacity sizes the body, static and island buffers.
+    b2Free(m_islandStatics);
+    b2Free(m_islandJoints);
+    b2Free(m_islandContacts);
+    b2Free(m_islandBodies);
+    b2Free(m_islands);
 }
 
 void b2World::SetDestructionListener(b2DestructionListener* listener) { m_destructionListener = listener; }
@@ -109,6 +163,12 @@ void b2World::SetContactFilter(b2ContactFilter* filter) { m_contactManager.m_con
 
 void b2World::SetContactListener(b2ContactListener* listener) { m_contactManager.m_contactListener = listener; }
 
+void b2World::SetParallelFor(b2ParallelForFcn* parallelFor, void* userContext) {
+    b2Assert(IsLocked() == false);
+    m_parallelFor = parallelFor;
+    m_parallelContext = userContext;
+}
+
 void b2World::SetDebugDraw(ME::ME_debugdraw* debugDraw) { m_debugDraw = debugDraw; }
 
 void b2World::RemoveDeadContacts() {
@@ -441,6 +501,11 @@ void b2World::SetAllowSleeping(bool flag) {
 
 // Find islands, integrate and solve constraints, solve position constraints
 void b2World::Solve(const b2TimeStep& step) {
+    if (m_parallelFor) {
+        SolveParallel(step);
+        return;
+    }
+
     // Size the island for the worst case.
     b2Island island(m_bodyCount, m_contactManager.m_contactCount, m_jointCount, &m_stackAllocator, m_contactManager.m_contactListener);
 
@@ -491,7 +556,7 @@ void b2World::Solve(const b2TimeStep& step) {
         }
 
         if (seed->GetContactCount() == 0 && seed->GetJointList() == nullptr) {
-            island.SolveOrphan(seed, step, m_gravity, m_allowSleep);
+            b2Island::SolveOrphan(seed, step, m_gravity, m_allowSleep);
             seed->m_flags |= (b2Body::e_islandFlag | b2Body::e_awakeFlag);
             continue;
         }
@@ -605,6 +670,257 @@ void b2World::Solve(const b2TimeStep& step) {
     }
 }
 
+b2StackAllocator* b2World::AcquireTaskAllocator() {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    b2TaskAllocator* task = m_freeTaskAllocators;
+    if (task) {
+        m_freeTaskAllocators = task->next;
+    } else {
+        task = new (b2Alloc(sizeof(b2TaskAllocator))) b2TaskAllocator();
+    }
+    return &task->allocator;
+}
+
+void b2World::ReleaseTaskAllocator(b2StackAllocator* allocator) {
+    // allocator is the first member of b2TaskAllocator
+    b2TaskAllocator* task = (b2TaskAllocator*)allocator;
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    task->next = m_freeTaskAllocators;
+    m_freeTaskAllocators = task;
+}
+
+void b2World::SolveIslandsTask(void* taskContext, int32 begin, int32 end) {
+    b2World* world = (b2World*)taskContext;
+    b2StackAllocator* allocator = world->AcquireTaskAllocator();
+    const int32 staticCount = world->m_islandStaticCount;
+
+    for (int32 i = begin; i < end; ++i) {
+        const b2IslandRange& range = world->m_islands[i];
+        b2Island island(staticCount + range.bodyCount, range.contactCount, range.jointCount, allocator, world->m_contactManager.m_contactListener);
+        island.m_listenerMutex = &world->m_listenerMutex;
+
+        // Shared static bodies come first so their m_islandIndex is the same in every island.
+        for (int32 j = 0; j < staticCount; ++j) {
+            island.AddShared(world->m_islandStatics[j]);
+        }
+        for (int32 j = 0; j < range.bodyCount; ++j) {
+            island.Add(world->m_islandBodies[range.bodyBegin + j]);
+        }
+        for (int32 j = 0; j < range.contactCount; ++j) {
+            island.Add(world->m_islandContacts[range.contactBegin + j]);
+        }
+        for (int32 j = 0; j < range.jointCount; ++j) {
+            island.Add(world->m_islandJoints[range.jointBegin + j]);
+        }
+
+        island.Solve(*world->m_islandStep, world->m_gravity, world->m_allowSleep);
+    }
+
+    world->ReleaseTaskAllocator(allocator);
+}
+
+// Same as Solve, but first collects all islands and then solves them with m_parallelFor.
+// Static bodies are not propagated through and can touch several islands. Solve gives them a
+// new m_islandIndex in every island, which would race here, so each static body that touches
+// any island gets one index for the whole step and is placed in front of every island.
+void b2World::SolveParallel(const b2TimeStep& step) {
+    // Clear all the island flags.
+    for (b2Body* b = m_bodyListHead; b; b = b->m_next) {
+        b->m_xf0 = b->m_xf;
+
+        // Store positions for continuous collision.
+        b->m_sweep.c0 = b->m_sweep.c;
+        b->m_sweep.a0 = b->m_sweep.a;
+
+        b->m_flags &= ~b2Body::e_islandFlag;
+
+        if (b->GetType() == b2_staticBody) {
+            // Reminder: after the first static body in the body list all subsequent are static as well
+            break;
+        }
+    }
+
+    for (b2Joint* j = m_jointList; j; j = j->m_next) {
+        j->m_islandFlag = false;
+    }
+
+    b2ReserveBuffer(m_islandContacts, m_islandContactCapacity, m_contactManager.m_contactCount);
+    b2ReserveBuffer(m_islandJoints, m_islandJointCapacity, m_jointCount);
+    if (m_islandCapacity < m_bodyCount) {
+        // Bodies, statics and islands are each bounded by the body count.
+        b2Free(m_islandStatics);
+        b2Free(m_islandBodies);
+        b2Free(m_islands);
+        m_islandCapacity = b2Max(2 * m_islandCapacity, m_bodyCount);
+        m_islands = (b2IslandRange*)b2Alloc(m_islandCapacity * sizeof(b2IslandRange));
+        m_islandBodies = (b2Body**)b2Alloc(m_islandCapacity * sizeof(b2Body*));
+        m_islandStatics = (b2Body**)b2Alloc(m_islandCapacity * sizeof(b2Body*));
+    }
+
+    m_islandCount = 0;
+    m_islandStaticCount = 0;
+    int32 bodyCount = 0;
+    int32 contactCount = 0;
+    int32 jointCount = 0;
+
+    // Build all awake islands.
+    // at this point all contacts have the e_islandFlag cleared by b2ContactManager::Collide;
+    int32 stackSize = m_bodyCount;
+    b2Body** stack = (b2Body**)m_stackAllocator.Allocate(stackSize * sizeof(b2Body*));
+    for (b2Body* seed = m_bodyListHead; seed; seed = seed->m_next) {
+        if (seed->m_flags & b2Body::e_islandFlag) {
+            continue;
+        }
+
+        if (seed->IsEnabled() == false) {
+            continue;
+        }
+
+#ifdef ENABLE_SLEEPING
+        if (seed->IsAwake() == false) {
+            continue;
+        }
+#endif  // ENABLE_SLEEPING
+
+        // The seed can be dynamic or kinematic.
+        if (seed->GetType() == b2_staticBody) {
+            // Reminder: after the first static body in the body list all subsequent are static as well
+            break;
+        }
+
+        if (seed->GetContactCount() == 0 && seed->GetJointList() == nullptr) {
+            b2Island::SolveOrphan(seed, step, m_gravity, m_allowSleep);
+            seed->m_flags |= (b2Body::e_islandFlag | b2Body::e_awakeFlag);
+            continue;
+        }
+
+        b2IslandRange& range = m_islands[m_islandCount++];
+        range.bodyBegin = bodyCount;
+        range.contactBegin = contactCount;
+        range.jointBegin = jointCount;
+
+        int32 stackCount = 0;
+        stack[stackCount++] = seed;
+        seed->m_flags |= b2Body::e_islandFlag;
+
+        // Perform a depth first search (DFS) on the constraint graph.
+        // Only dynamic and kinematic bodies are pushed, static ones go to m_islandStatics.
+        while (stackCount > 0) {
+            b2Body* b = stack[--stackCount];
+            b2Assert(b->IsEnabled() == true);
+            m_islandBodies[bodyCount++] = b;
+
+            // Make sure the body is awake (without resetting sleep timer).
+            b->m_flags |= b2Body::e_awakeFlag;
+
+            // Search all contacts connected to this body.
+            for (int32 i = 0; i < b->GetContactCount(); ++i) {
+                b2Contact* contact = b->GetContact(i);
+
+                // Has this contact already been added to an island?
+                if (contact->m_flags & b2Contact::e_islandFlag) {
+                    continue;
+                }
+
+                // Is this contact solid and touching?
+                if (contact->IsEnabled() == false || contact->IsTouching() == false) {
+                    continue;
+                }
+
+                // Skip sensors.
+                bool sensorA = contact->m_fixtureA->m_isSensor;
+                bool sensorB = contact->m_fixtureB->m_isSensor;
+                if (sensorA || sensorB) {
+                    continue;
+                }
+
+                m_islandContacts[contactCount++] = contact;
+                contact->m_flags |= b2Contact::e_islandFlag;
+
+                b2Body* bA = contact->GetFixtureA()->GetBody();
+                b2Body* bB = contact->GetFixtureB()->GetBody();
+                b2Body* other = (bA == b) ? bB : bA;
+
+                // Was the other body already added to this island (or given a static index)?
+                if (other->m_flags & b2Body::e_islandFlag) {
+                    continue;
+                }
+
+                other->m_flags |= b2Body::e_islandFlag;
+                if (other->GetType() == b2_staticBody) {
+                    // To keep islands as small as possible, we don't
+                    // propagate islands across static bodies.
+                    other->m_islandIndex = m_islandStaticCount;
+                    m_islandStatics[m_islandStaticCount++] = other;
+                    continue;
+                }
+
+                b2Assert(stackCount < stackSize);
+                stack[stackCount++] = other;
+            }
+
+            // Search all joints connect to this body.
+            for (b2JointEdge* je = b->m_jointList; je; je = je->next) {
+                if (je->joint->m_islandFlag == true) {
+                    continue;
+                }
+
+                b2Body* other = je->other;
+
+                // Don't simulate joints connected to diabled bodies.
+                if (other->IsEnabled() == false) {
+                    continue;
+                }
+
+                m_islandJoints[jointCount++] = je->joint;
+                je->joint->m_islandFlag = true;
+
+                if (other->m_flags & b2Body::e_islandFlag) {
+                    continue;
+                }
+
+                other->m_flags |= b2Body::e_islandFlag;
+                if (other->GetType() == b2_staticBody) {
+                    other->m_islandIndex = m_islandStaticCount;
+                    m_islandStatics[m_islandStaticCount++] = other;
+                    continue;
+                }
+
+                b2Assert(stackCount < stackSize);
+                stack[stackCount++] = other;
+            }
+        }
+
+        range.bodyCount = bodyCount - range.bodyBegin;
+        range.contactCount = contactCount - range.contactBegin;
+        range.jointCount = jointCount - range.jointBegin;
+    }
+
+    m_stackAllocator.Free(stack);
+
+    // Solve all islands. A single island is solved right here.
+    m_islandStep = &step;
+    if (m_islandCount > 1) {
+        m_parallelFor(m_parallelContext, m_islandCount, 1, &SolveIslandsTask, this);
+    } else if (m_islandCount == 1) {
+        SolveIslandsTask(this, 0, 1);
+    }
+    m_islandStep = nullptr;
+
+    // Allow static bodies to participate in other islands.
+    for (int32 i = 0; i < m_islandStaticCount; ++i) {
+        m_islandStatics[i]->m_flags &= ~b2Body::e_islandFlag;
+    }
+
+    {
+        b2Timer timer;
+        // Look for new contacts.
+        m_contactManager.FindNewContacts();
+        RemoveDeadContacts();
+        m_profile.broadphase = timer.GetMilliseconds();
+    }
+}
+
 struct b2HeapNode {
     float toi;
     int toiCount;
@@ -1059,7 +1375,7 @@ void b2World::Step(float dt, int32 velocityIterations, int32 positionIterations,
     // Update contacts. This is where some contacts are destroyed.
     {
         b2Timer timer;
-        m_contactManager.Collide();
+        m_contactManager.Collide(m_parallelFor, m_parallelContext);
         m_profile.collide = timer.GetMilliseconds();
     }
 
@@ -1199,6 +1515,31 @@ void b2World::DrawShape(b2Fixture* fixture, const b2Transform& xf, const ME::MEc
             m_debugDraw->DrawSolidPolygon(vertices, vertexCount, color);
         } break;
 
+        case b2Shape::e_grid: {
+            // Draw the exposed cell faces
+            b2GridShape* grid = (b2GridShape*)fixture->GetShape();
+            if (grid->m_cells == nullptr) {
+                break;
+            }
+
+            for (int32 y = 0; y < grid->m_height; ++y) {
+                for (int32 x = 0; x < grid->m_width; ++x) {
+                    if (!grid->IsSolid(x, y)) {
+                        continue;
+                    }
+
+                    const b2Vec2 c00 = b2Mul(xf, b2Vec2((float)x, (float)y));
+                    const b2Vec2 c10 = b2Mul(xf, b2Vec2((float)(x + 1), (float)y));
+                    const b2Vec2 c01 = b2Mul(xf, b2Vec2((float)x, (float)(y + 1)));
+                    const b2Vec2 c11 = b2Mul(xf, b2Vec2((float)(x + 1), (float)(y + 1)));
+                    if (!grid->IsSolid(x, y - 1)) m_debugDraw->DrawSegment(c00, c10, color);
+                    if (!grid->IsSolid(x, y + 1)) m_debugDraw->DrawSegment(c01, c11, color);
+                    if (!grid->IsSolid(x - 1, y)) m_debugDraw->DrawSegment(c00, c01, color);
+                    if (!grid->IsSolid(x + 1, y)) m_debugDraw->DrawSegment(c10, c11, color);
+                }
+            }
+        } break;
+
         default:
             break;
     }
@@ -1325,6 +1666,7 @@ void b2World::ShiftOrigin(const b2Vec2& newOrigin) {
         b->m_xf.p -= newOrigin;
         b->m_sweep.c0 -= newOrigin;
         b->m_sweep.c -= newOrigin;
+        b->UpdateAABBs();
     }
 
     for (b2Joint* j = m_jointList; j; j = j->m_next) {
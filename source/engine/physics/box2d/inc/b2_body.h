@@ -632,6 +632,10 @@ inline void b2Body::SetAwake(bool flag) {
         m_flags |= e_awakeFlag;
         m_sleepTime = 0.0f;
     } else {
+        // The broad-phase only refreshes the AABBs of awake bodies, store the final pose.
+        if (m_flags & e_awakeFlag) {
+            UpdateAABBs();
+        }
         m_flags &= ~e_awakeFlag;
         m_sleepTime = 0.0f;
         m_linearVelocity.SetZero();
@@ -187,6 +187,10 @@ private:
     /// Internal recursive function to build the tree with the nodes [start, end) in the links array.
     b2TreeNode* Build(int32 start, int32 end);
 
+    /// Like Build but splits with a binned surface area heuristic. Used for the static subtree,
+    /// which is kept across steps and queried by every moving fixture, so a tighter tree pays off.
+    b2TreeNode* BuildBinned(int32 start, int32 end);
+
     /// Internal recursive function to build the tree with the nodes [start, end) in the links array
     /// and at the same time perform collision detection with the nodes found in the collision array and the tree itself.
     /// This is used to implement b2BroadPhase::UpdateAndQuery
@@ -269,7 +273,11 @@ void b2BroadPhase::UpdateAndQuery(T* callback) {
             b2Swap(m_links[i], m_links[staticGroup]);
             staticGroup++;
         } else {
-            f->UpdateAABB();
+            // Sleeping bodies don't move, their AABBs were refreshed when they fell asleep
+            // (b2Body::SetAwake) or were moved (b2Body::SetTransform).
+            if (f->GetBody()->IsAwake()) {
+                f->UpdateAABB();
+            }
             m_links[i]->aabb = f->GetAABB();
         }
     }
@@ -279,7 +287,7 @@ void b2BroadPhase::UpdateAndQuery(T* callback) {
         m_rootStatic = nullptr;
     } else if (m_rootStatic == nullptr) {
         m_treeAllocator = m_nodes + m_capacity;
-        m_rootStatic = Build(0, staticGroup);
+        m_rootStatic = BuildBinned(0, staticGroup);
     }
 
     if (maxBufferSize == -1) {
@@ -518,7 +526,8 @@ inline void b2BroadPhase::RemoveAll() {
 
 template <typename UnaryPredicate>
 void b2BroadPhase::RemoveAll(UnaryPredicate predicate) {
-    for (int32 i = 0; i < m_count; i++) {
+    // Remove moves the last node into the freed slot, walk backwards so that node was already visited.
+    for (int32 i = m_count - 1; i >= 0; i--) {
         b2Fixture* f = m_nodes[i].fixture;
 
         if (predicate(f)) {
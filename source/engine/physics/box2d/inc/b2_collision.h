@@ -40,6 +40,7 @@
 class b2Shape;
 class b2CircleShape;
 class b2EdgeShape;
+class b2GridShape;
 class b2PolygonShape;
 
 const uint8 b2_nullFeature = UCHAR_MAX;
@@ -216,6 +217,13 @@ B2_API void b2CollideEdgeAndCircle(b2Manifold* manifold, const b2EdgeShape* poly
 /// Compute the collision manifold between an edge and a polygon.
 B2_API void b2CollideEdgeAndPolygon(b2Manifold* manifold, const b2EdgeShape* edgeA, const b2Transform& xfA, const b2PolygonShape* circleB, const b2Transform& xfB);
 
+/// Compute the collision manifold between a grid and a circle. The manifold is the
+/// deepest one against the exposed faces the circle overlaps.
+B2_API void b2CollideGridAndCircle(b2Manifold* manifold, const b2GridShape* gridA, const b2Transform& xfA, const b2CircleShape* circleB, const b2Transform& xfB);
+
+/// Compute the collision manifold between a grid and a polygon.
+B2_API void b2CollideGridAndPolygon(b2Manifold* manifold, const b2GridShape* gridA, const b2Transform& xfA, const b2PolygonShape* polygonB, const b2Transform& xfB);
+
 /// Clipping for contact manifolds.
 B2_API int32 b2ClipSegmentToLine(b2ClipVertex vOut[2], const b2ClipVertex vIn[2], const b2Vec2& normal, float offset, int32 vertexIndexA);
 
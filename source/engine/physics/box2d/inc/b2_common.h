@@ -87,6 +87,10 @@ typedef unsigned long long uint64;
 /// The initial size of particle data buffers.
 #define b2_minParticleSystemBufferCapacity 256
 
+/// The smallest range of particles, pairs or contacts handed to one task
+/// when the world has a parallel-for callback, see b2World::SetParallelFor.
+#define b2_minParallelParticleItems 128
+
 /// The time into the future that collisions against barrier particles will be detected.
 #define b2_barrierCollisionTime 2.5f
 
@@ -118,11 +122,24 @@ typedef unsigned long long uint64;
 /// not change this value.
 #define b2_maxManifoldPoints 2
 
+/// Islands with at least this many contacts solve their velocity constraints
+/// in SIMD batches, see g_wideSolve.
+#define b2_wideMinContacts 32
+
+/// The number of graph colors used to batch contacts for the wide solver. Contacts
+/// that don't fit into any color are solved one at a time after the batches.
+#define b2_wideColorCount 12
+
 /// This is used to fatten AABBs in the dynamic tree. This allows proxies
 /// to move by a small amount without triggering a tree adjustment.
 /// This is in meters.
 #define b2_aabbExtension (0.1f * b2_lengthUnitsPerMeter)
 
+/// The static broad-phase subtree is split with a binned surface area heuristic
+/// using this many bins. Smaller ranges use the median split of the dynamic tree.
+#define b2_staticTreeBins 16
+#define b2_staticTreeMinBinned 8
+
 /// This is used to fatten AABBs in the dynamic tree. This is used to predict
 /// the future position based on the current displacement.
 /// This is a dimensionless multiplier.
@@ -177,6 +177,13 @@ protected:
 
     void Update(b2ContactListener* listener);
 
+    // Update split in two so the narrow phase can run on several threads.
+    // UpdateManifold only touches this contact: it computes the new manifold and touching flag,
+    // stores the previous manifold in oldManifold and returns the previous touching state.
+    // FinishUpdate wakes the bodies and calls the listener and must run on a single thread.
+    bool UpdateManifold(b2Manifold* oldManifold);
+    void FinishUpdate(b2ContactListener* listener, bool wasTouching, const b2Manifold* oldManifold);
+
     float CalculateTOI();
 
     static b2EvaluateFunction* functions[b2Shape::e_typeCount][b2Shape::e_typeCount];
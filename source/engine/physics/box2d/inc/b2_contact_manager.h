@@ -32,6 +32,7 @@
 #include "b2_broad_phase.h"
 #include "b2_contact.h"
 #include "b2_fixture.h"
+#include "b2_world_callbacks.h"
 
 class b2ContactFilter;
 class b2ContactListener;
@@ -58,7 +59,9 @@ public:
     void Destroy(b2Contact* c);
 
     /// Updates the contacts and performs narrow-phase collision detection. May remove some contacts.
-    void Collide();
+    /// With a parallelFor callback the manifolds are computed on several threads, waking bodies
+    /// and contact listener callbacks still happen on the calling thread in list order.
+    void Collide(b2ParallelForFcn* parallelFor = nullptr, void* parallelContext = nullptr);
 
     /// The first contact in this contact manager. Used to iterate the contacts.
     b2Contact* Start() const;
@@ -76,7 +79,16 @@ public:
     b2BlockAllocator* m_allocator;
 
 private:
+    static void UpdateContactsTask(void* taskContext, int32 begin, int32 end);
+
     b2Contact* m_contactList;
+
+    // Scratch buffers for the parallel narrow phase, kept between steps.
+    b2Contact** m_updateContacts;
+    b2Manifold* m_updateManifolds;
+    bool* m_updateWasTouching;
+    bool* m_updateActive;
+    int32 m_updateCapacity;
 };
 
 inline b2Contact* b2ContactManager::Start() const { return m_contactList->m_next; }
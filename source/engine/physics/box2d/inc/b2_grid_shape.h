@@ -0,0 +1,94 @@
+// Metadot physics engine is enhanced based on box2d modification
+// Metadot code Copyright(c) 2022-2023, KaoruXun All rights reserved.
+// Box2d code by Erin Catto licensed under the MIT License
+// https://github.com/erincatto/box2d
+
+// MIT License
+// Copyright (c) 2022-2023 KaoruXun
+// Copyright (c) 2019 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_GRID_SHAPE_H
+#define B2_GRID_SHAPE_H
+
+#include "b2_api.h"
+#include "b2_shape.h"
+
+/// A static occupancy grid of unit cells. Cell (x, y) covers [x, x + 1] x [y, y + 1]
+/// in the shape frame. The cell bitmap is owned by the caller and is read every time
+/// a contact is updated, so cells can be switched on and off without rebuilding the
+/// fixture. Only the exposed faces of solid cells collide, consecutive faces are
+/// merged into one-sided edges with ghost vertices so bodies slide smoothly.
+/// The bitmap has a one cell apron around the grid that is used for neighbor tests
+/// only, this lets adjacent grids meet without seams. A grid should only be attached
+/// to a static body and it does not take part in continuous collision.
+class B2_API b2GridShape : public b2Shape {
+public:
+    b2GridShape();
+
+    /// Set the cell bitmap. The bitmap has (width + 2) * (height + 2) bytes, row by row,
+    /// and cell (x, y) is at (x + 1) + (y + 1) * (width + 2). Non zero bytes are solid.
+    void Set(const uint8* cells, int32 width, int32 height);
+
+    /// Implement b2Shape.
+    b2Shape* Clone(b2BlockAllocator* allocator) const override;
+
+    /// @see b2Shape::TestPoint
+    bool TestPoint(const b2Transform& transform, const b2Vec2& p) const override;
+
+    // @see b2Shape::ComputeDistance
+    void ComputeDistance(const b2Transform& xf, const b2Vec2& p, float32* distance, b2Vec2* normal) const override;
+
+    /// Implement b2Shape.
+    /// @note rays that start inside a solid cell hit the first solid cell they enter
+    /// after leaving it.
+    bool RayCast(b2RayCastOutput* output, const b2RayCastInput& input, const b2Transform& transform) const override;
+
+    /// @see b2Shape::ComputeAABB
+    void ComputeAABB(b2AABB* aabb, const b2Transform& transform) const override;
+
+    /// @see b2Shape::ComputeMass
+    void ComputeMass(b2MassData* massData, float density) const override;
+
+    /// Is the cell solid. The apron cells (-1 and width / height) can be queried too,
+    /// anything further out is empty.
+    bool IsSolid(int32 x, int32 y) const;
+
+    /// The cell bitmap, see Set
+    const uint8* m_cells;
+    int32 m_width, m_height;
+};
+
+inline b2GridShape::b2GridShape() {
+    m_type = e_grid;
+    m_radius = b2_polygonRadius;
+    m_cells = nullptr;
+    m_width = 0;
+    m_height = 0;
+}
+
+inline bool b2GridShape::IsSolid(int32 x, int32 y) const {
+    if (x < -1 || y < -1 || x > m_width || y > m_height) {
+        return false;
+    }
+    return m_cells[(x + 1) + (y + 1) * (m_width + 2)] != 0;
+}
+
+#endif
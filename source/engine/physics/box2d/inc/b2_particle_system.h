@@ -846,6 +846,8 @@ private:
     void UpdatePairsAndTriadsWithParticleList(const b2ParticleGroup* group, const ParticleListNode* nodeBuffer);
 
     void ComputeDepth();
+    static void ComputeDepthTask(void* taskContext, int32 begin, int32 end);
+    static void RelaxDepth(float32* depthBuffer, const b2ParticleContact* contacts, int32 contactCount, int32 iterationCount);
 
     InsideBoundsEnumerator GetInsideBoundsEnumerator(const b2AABB& aabb) const;
 
@@ -868,6 +870,9 @@ private:
 
     void Solve(const b2TimeStep& step);
     void SolveCollision(const b2TimeStep& step);
+    void SolveCollisionParallel(const b2TimeStep& step, const b2AABB& aabb);
+    static void SolveCollisionTask(void* taskContext, int32 begin, int32 end);
+    void CollideFixtureAndParticle(const b2TimeStep& step, b2Fixture* fixture, int32 a);
     void LimitVelocity(const b2TimeStep& step);
     void SolveGravity(const b2TimeStep& step);
     void SolveBarrier(const b2TimeStep& step);
@@ -1006,6 +1011,22 @@ private:
     b2GrowableBuffer<b2ParticlePair> m_pairBuffer;
     b2GrowableBuffer<b2ParticleTriad> m_triadBuffer;
 
+    /// Scratch buffers for the parallel paths of SolveCollision and ComputeDepth.
+    /// m_collisionPairBuffer holds the fixture/particle pairs found by the
+    /// serial broad-phase query, m_runBuffer the start of each independent run.
+    struct FixtureParticlePair {
+        b2Fixture* fixture;
+        int32 index;
+    };
+    b2GrowableBuffer<FixtureParticlePair> m_collisionPairBuffer;
+    b2GrowableBuffer<int32> m_runBuffer;
+    struct ParallelTaskContext {
+        b2ParticleSystem* system;
+        const b2TimeStep* step;
+        const b2ParticleContact* contacts;
+        int32 iterationCount;
+    };
+
     /// Time each particle should be destroyed relative to the last time
     /// m_timeElapsed was initialized.  Each unit of time corresponds to
     /// b2ParticleSystemDef::lifetimeGranularity seconds.
@@ -51,7 +51,7 @@ struct B2_API b2MassData {
 /// is created. Shapes may encapsulate a one or more child shapes.
 class B2_API b2Shape {
 public:
-    enum Type { e_circle = 0, e_edge = 1, e_polygon = 2, e_chain = 3, e_typeCount = 4 };
+    enum Type { e_circle = 0, e_edge = 1, e_polygon = 2, e_chain = 3, e_grid = 4, e_typeCount = 5 };
 
     virtual ~b2Shape() {}
 
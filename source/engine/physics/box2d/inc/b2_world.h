@@ -28,6 +28,8 @@
 #ifndef B2_WORLD_H
 #define B2_WORLD_H
 
+#include <mutex>
+
 #include "b2_api.h"
 #include "b2_block_allocator.h"
 #include "b2_contact_manager.h"
@@ -50,6 +52,8 @@ struct MEcolor;
 }  // namespace ME
 
 class b2ParticleGroup;
+struct b2IslandRange;
+struct b2TaskAllocator;
 
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
@@ -190,6 +194,12 @@ public:
     b2Contact* GetContactListEnd();
     const b2Contact* GetContactListEnd() const;
 
+    /// Solve independent islands and update contact manifolds on an external task scheduler.
+    /// Continuous collision (TOI) stays single threaded. Pass nullptr to step on the calling
+    /// thread only, which is the default. Must not be called during a time step.
+    void SetParallelFor(b2ParallelForFcn* parallelFor, void* userContext);
+    bool IsParallel() const { return m_parallelFor != nullptr; }
+
     /// Enable/disable sleep.
     void SetAllowSleeping(bool flag);
     bool GetAllowSleeping() const { return m_allowSleep; }
@@ -262,6 +272,10 @@ private:
     void RemoveDeadContacts();
 
     void Solve(const b2TimeStep& step);
+    void SolveParallel(const b2TimeStep& step);
+    static void SolveIslandsTask(void* taskContext, int32 begin, int32 end);
+    b2StackAllocator* AcquireTaskAllocator();
+    void ReleaseTaskAllocator(b2StackAllocator* allocator);
     void SolveTOI(const b2TimeStep& step);
     float CalculateTOI(b2Contact* c);
 
@@ -305,6 +319,28 @@ private:
     bool m_stepComplete;
 
     b2Profile m_profile;
+
+    // Parallel stepping, see SetParallelFor.
+    b2ParallelForFcn* m_parallelFor;
+    void* m_parallelContext;
+
+    // Islands found by SolveParallel. Static bodies are shared by all islands of a step.
+    b2IslandRange* m_islands;
+    b2Body** m_islandBodies;
+    b2Contact** m_islandContacts;
+    b2Joint** m_islandJoints;
+    b2Body** m_islandStatics;
+    int32 m_islandCount;
+    int32 m_islandStaticCount;
+    int32 m_islandCapacity;
+    int32 m_islandContactCapacity;
+    int32 m_islandJointCapacity;
+    const b2TimeStep* m_islandStep;
+
+    // Every task solving islands needs its own stack allocator.
+    b2TaskAllocator* m_freeTaskAllocators;
+    std::mutex m_taskMutex;
+    std::mutex m_listenerMutex;
 };
 
 inline b2Body* b2World::GetBodyList() { return m_bodyListHead; }
@@ -45,6 +45,15 @@ class b2ParticleGroup;
 struct b2ParticleBodyContact;
 struct b2ParticleContact;
 
+/// A range of work handed out by b2ParallelForFcn. Processes items [begin, end).
+typedef void b2ParallelTaskFcn(void* taskContext, int32 begin, int32 end);
+
+/// Lets the world run parts of a time step on an external task scheduler.
+/// The implementation must split [0, count) into ranges of at least minRange items,
+/// call task on every range (from any thread) and return only after all of them finished.
+/// Calling task once with [0, count) on the calling thread is a valid implementation.
+typedef void b2ParallelForFcn(void* userContext, int32 count, int32 minRange, b2ParallelTaskFcn* task, void* taskContext);
+
 /// Joints and fixtures are destroyed when their associated
 /// body is destroyed. Implement this listener so that you
 /// may nullify references to these joints and shapes.
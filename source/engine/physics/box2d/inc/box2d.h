@@ -37,6 +37,7 @@
 #include "b2_edge_shape.h"
 #include "b2_fixture.h"
 #include "b2_geometry.h"
+#include "b2_grid_shape.h"
 #include "b2_polygon_shape.h"
 #include "b2_settings.h"
 #include "b2_time_step.h"
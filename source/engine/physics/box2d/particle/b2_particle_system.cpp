@@ -315,7 +315,9 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def, b2World* worl
       m_contactBuffer(world->m_blockAllocator),
       m_bodyContactBuffer(world->m_blockAllocator),
       m_pairBuffer(world->m_blockAllocator),
-      m_triadBuffer(world->m_blockAllocator) {
+      m_triadBuffer(world->m_blockAllocator),
+      m_collisionPairBuffer(world->m_blockAllocator),
+      m_runBuffer(world->m_blockAllocator) {
     b2Assert(def);
     m_paused = false;
     m_timestamp = 0;
@@ -1334,15 +1336,60 @@ void b2ParticleSystem::ComputeDepth() {
     // particle to the nearest surface particle, and in general it is smaller
     // than sqrt of total particle number.
     int32 iterationCount = (int32)b2Sqrt((float)m_count);
+    if (m_world->m_parallelFor && groupsToUpdateCount > 1 && contactGroupsCount >= 2 * b2_minParallelParticleItems) {
+        // Only contacts inside a group take part, so the groups relax
+        // independently. Each group stops once it no longer changes, which is
+        // exactly where the serial loop would have left it.
+        std::stable_sort(contactGroups, contactGroups + contactGroupsCount, [this](const b2ParticleContact& a, const b2ParticleContact& b) {
+            return m_groupBuffer[a.GetIndexA()] < m_groupBuffer[b.GetIndexA()];
+        });
+        m_runBuffer.SetCount(0);
+        for (int32 k = 0; k < contactGroupsCount; k++) {
+            if (k == 0 || m_groupBuffer[contactGroups[k].GetIndexA()] != m_groupBuffer[contactGroups[k - 1].GetIndexA()]) {
+                m_runBuffer.Append() = k;
+            }
+        }
+        int32 runCount = m_runBuffer.GetCount();
+        m_runBuffer.Append() = contactGroupsCount;
+
+        ParallelTaskContext context = {this, NULL, contactGroups, iterationCount};
+        m_world->m_parallelFor(m_world->m_parallelContext, runCount, 1, &ComputeDepthTask, &context);
+    } else {
+        RelaxDepth(m_depthBuffer, contactGroups, contactGroupsCount, iterationCount);
+    }
+    for (int32 i = 0; i < groupsToUpdateCount; i++) {
+        const b2ParticleGroup* group = groupsToUpdate[i];
+        for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++) {
+            float32& p = m_depthBuffer[i];
+            if (p < b2_maxFloat) {
+                p *= m_particleDiameter;
+            } else {
+                p = 0;
+            }
+        }
+    }
+    m_world->m_stackAllocator.Free(groupsToUpdate);
+    m_world->m_stackAllocator.Free(contactGroups);
+}
+
+void b2ParticleSystem::ComputeDepthTask(void* taskContext, int32 begin, int32 end) {
+    const ParallelTaskContext* context = (const ParallelTaskContext*)taskContext;
+    const int32* runs = context->system->m_runBuffer.Data();
+    for (int32 i = begin; i < end; i++) {
+        RelaxDepth(context->system->m_depthBuffer, context->contacts + runs[i], runs[i + 1] - runs[i], context->iterationCount);
+    }
+}
+
+void b2ParticleSystem::RelaxDepth(float32* depthBuffer, const b2ParticleContact* contacts, int32 contactCount, int32 iterationCount) {
     for (int32 t = 0; t < iterationCount; t++) {
         bool updated = false;
-        for (int32 k = 0; k < contactGroupsCount; k++) {
-            const b2ParticleContact& contact = contactGroups[k];
+        for (int32 k = 0; k < contactCount; k++) {
+            const b2ParticleContact& contact = contacts[k];
             int32 a = contact.GetIndexA();
             int32 b = contact.GetIndexB();
             float32 r = 1 - contact.GetWeight();
-            float32& ap0 = m_depthBuffer[a];
-            float32& bp0 = m_depthBuffer[b];
+            float32& ap0 = depthBuffer[a];
+            float32& bp0 = depthBuffer[b];
             float32 ap1 = bp0 + r;
             float32 bp1 = ap0 + r;
             if (ap0 > ap1) {
@@ -1358,19 +1405,6 @@ void b2ParticleSystem::ComputeDepth() {
             break;
         }
     }
-    for (int32 i = 0; i < groupsToUpdateCount; i++) {
-        const b2ParticleGroup* group = groupsToUpdate[i];
-        for (int32 i = group->m_firstIndex; i < group->m_lastIndex; i++) {
-            float32& p = m_depthBuffer[i];
-            if (p < b2_maxFloat) {
-                p *= m_particleDiameter;
-            } else {
-                p = 0;
-            }
-        }
-    }
-    m_world->m_stackAllocator.Free(groupsToUpdate);
-    m_world->m_stackAllocator.Free(contactGroups);
 }
 
 b2ParticleSystem::InsideBoundsEnumerator b2ParticleSystem::GetInsideBoundsEnumerator(const b2AABB& aabb) const {
@@ -1935,6 +1969,48 @@ bool b2ParticleSystem::BodyContactCompare(const b2ParticleBodyContact& lhs, cons
     return lhs.index < rhs.index;
 }
 
+void b2ParticleSystem::CollideFixtureAndParticle(const b2TimeStep& step, b2Fixture* fixture, int32 a) {
+    b2Body* body = fixture->GetBody();
+    b2Vec2 ap = m_positionBuffer.data[a];
+    b2Vec2 av = m_velocityBuffer.data[a];
+    b2RayCastOutput output;
+    b2RayCastInput input;
+    if (m_iterationIndex == 0) {
+        // Put 'ap' in the local space of the previous frame
+
+        b2Vec2 p1 = b2MulT(body->m_xf0, ap);
+
+        if (fixture->GetShape()->GetType() == b2Shape::e_circle) {
+            // Make relative to the center of the circle
+            p1 -= body->GetLocalCenter();
+            // Re-apply rotation about the center of the
+            // circle
+
+            p1 = b2Mul(body->m_xf0.q, p1);
+
+            // Subtract rotation of the current frame
+            p1 = b2MulT(body->m_xf.q, p1);
+            // Return to local space
+            p1 += body->GetLocalCenter();
+        }
+        // Return to global space and apply rotation of current frame
+        input.p1 = b2Mul(body->m_xf, p1);
+    } else {
+        input.p1 = ap;
+    }
+    input.p2 = ap + step.dt * av;
+    input.maxFraction = 1;
+    if (fixture->RayCast(&output, input)) {
+        float32 frac = output.fraction;
+        b2Vec2 n = output.normal;
+        b2Vec2 p = (1 - frac) * input.p1 + frac * input.p2 + b2_linearSlop * n;
+        b2Vec2 v = step.inv_dt * (p - ap);
+        m_velocityBuffer.data[a] = v;
+        b2Vec2 f = step.inv_dt * GetParticleMass() * (av - v);
+        ParticleApplyForce(a, f);
+    }
+}
+
 void b2ParticleSystem::SolveCollision(const b2TimeStep& step) {
     // This function detects particles which are crossing boundary of bodies
     // and modifies velocities of them so that they will move just in front of
@@ -1952,6 +2028,11 @@ void b2ParticleSystem::SolveCollision(const b2TimeStep& step) {
         aabb.lowerBound = b2Min(aabb.lowerBound, b2Min(p1, p2));
         aabb.upperBound = b2Max(aabb.upperBound, b2Max(p1, p2));
     }
+    // The contact filter is user code and may not be thread safe.
+    if (m_world->m_parallelFor && m_count >= 2 * b2_minParallelParticleItems && GetFixtureContactFilter() == NULL) {
+        SolveCollisionParallel(step, aabb);
+        return;
+    }
     class SolveCollisionCallback : public b2FixtureParticleQueryCallback {
         // Call the contact filter if it's set, to determine whether to
         // filter this contact.  Returns true if contact calculations should
@@ -1968,45 +2049,7 @@ void b2ParticleSystem::SolveCollision(const b2TimeStep& step) {
 
         void ReportFixtureAndParticle(b2Fixture* fixture, int32 a) {
             if (ShouldCollide(fixture, a)) {
-                b2Body* body = fixture->GetBody();
-                b2Vec2 ap = m_system->m_positionBuffer.data[a];
-                b2Vec2 av = m_system->m_velocityBuffer.data[a];
-                b2RayCastOutput output;
-                b2RayCastInput input;
-                if (m_system->m_iterationIndex == 0) {
-                    // Put 'ap' in the local space of the previous frame
-
-                    b2Vec2 p1 = b2MulT(body->m_xf0, ap);
-
-                    if (fixture->GetShape()->GetType() == b2Shape::e_circle) {
-                        // Make relative to the center of the circle
-                        p1 -= body->GetLocalCenter();
-                        // Re-apply rotation about the center of the
-                        // circle
-
-                        p1 = b2Mul(body->m_xf0.q, p1);
-
-                        // Subtract rotation of the current frame
-                        p1 = b2MulT(body->m_xf.q, p1);
-                        // Return to local space
-                        p1 += body->GetLocalCenter();
-                    }
-                    // Return to global space and apply rotation of current frame
-                    input.p1 = b2Mul(body->m_xf, p1);
-                } else {
-                    input.p1 = ap;
-                }
-                input.p2 = ap + m_step.dt * av;
-                input.maxFraction = 1;
-                if (fixture->RayCast(&output, input)) {
-                    float32 frac = output.fraction;
-                    b2Vec2 n = output.normal;
-                    b2Vec2 p = (1 - frac) * input.p1 + frac * input.p2 + b2_linearSlop * n;
-                    b2Vec2 v = m_step.inv_dt * (p - ap);
-                    m_system->m_velocityBuffer.data[a] = v;
-                    b2Vec2 f = m_step.inv_dt * m_system->GetParticleMass() * (av - v);
-                    m_system->ParticleApplyForce(a, f);
-                }
+                m_system->CollideFixtureAndParticle(m_step, fixture, a);
             }
         }
 
@@ -2022,6 +2065,58 @@ void b2ParticleSystem::SolveCollision(const b2TimeStep& step) {
     m_world->QueryAABB(&callback, aabb);
 }
 
+// The broad-phase query stays serial and only records the fixture/particle
+// pairs. A particle's pairs are then resolved in the order the serial query
+// reports them, so the result does not depend on how the runs are split.
+// Bodies are only read here and each run writes to its own particle.
+void b2ParticleSystem::SolveCollisionParallel(const b2TimeStep& step, const b2AABB& aabb) {
+    class CollectPairsCallback : public b2FixtureParticleQueryCallback {
+        void ReportFixtureAndParticle(b2Fixture* fixture, int32 a) {
+            FixtureParticlePair& pair = m_system->m_collisionPairBuffer.Append();
+            pair.fixture = fixture;
+            pair.index = a;
+        }
+
+    public:
+        CollectPairsCallback(b2ParticleSystem* system) : b2FixtureParticleQueryCallback(system) {}
+    } callback(this);
+    m_collisionPairBuffer.SetCount(0);
+    m_world->QueryAABB(&callback, aabb);
+
+    const int32 pairCount = m_collisionPairBuffer.GetCount();
+    if (pairCount == 0) {
+        return;
+    }
+    std::stable_sort(m_collisionPairBuffer.Begin(), m_collisionPairBuffer.End(), [](const FixtureParticlePair& a, const FixtureParticlePair& b) { return a.index < b.index; });
+
+    m_runBuffer.SetCount(0);
+    for (int32 k = 0; k < pairCount; k++) {
+        if (k == 0 || m_collisionPairBuffer[k].index != m_collisionPairBuffer[k - 1].index) {
+            m_runBuffer.Append() = k;
+        }
+    }
+    const int32 runCount = m_runBuffer.GetCount();
+    m_runBuffer.Append() = pairCount;
+
+    // ParticleApplyForce clears the force buffer on first use, do it up front.
+    PrepareForceBuffer();
+
+    ParallelTaskContext context = {this, &step, NULL, 0};
+    m_world->m_parallelFor(m_world->m_parallelContext, runCount, b2_minParallelParticleItems, &SolveCollisionTask, &context);
+}
+
+void b2ParticleSystem::SolveCollisionTask(void* taskContext, int32 begin, int32 end) {
+    const ParallelTaskContext* context = (const ParallelTaskContext*)taskContext;
+    b2ParticleSystem* system = context->system;
+    const int32* runs = system->m_runBuffer.Data();
+    for (int32 i = begin; i < end; i++) {
+        for (int32 k = runs[i]; k < runs[i + 1]; k++) {
+            const FixtureParticlePair& pair = system->m_collisionPairBuffer[k];
+            system->CollideFixtureAndParticle(*context->step, pair.fixture, pair.index);
+        }
+    }
+}
+
 void b2ParticleSystem::SolveBarrier(const b2TimeStep& step) {
     // If a particle is passing between paired barrier particles,
     // its velocity will be decelerated to avoid passing.
@@ -0,0 +1,182 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "connected_components.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(ME_SIMD_X86)
+#include <immintrin.h>
+#elif defined(ME_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace ME::ConnectedComponents {
+
+namespace {
+
+// p 开始的 n (不超过 64) 个字节中非零的位
+using row_bits_fn = u64 (*)(const u8 *p, int n);
+
+u64 row_bits_scalar(const u8 *p, int n) {
+    u64 bits = 0;
+    for (int x = 0; x < n; x++) bits |= (u64)(p[x] != 0) << x;
+    return bits;
+}
+
+#if defined(ME_SIMD_X86)
+u64 row_bits_sse2(const u8 *p, int n) {
+    u64 bits = 0;
+    int x = 0;
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= n; x += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + x));
+        bits |= (u64)(~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff) << x;
+    }
+    for (; x < n; x++) bits |= (u64)(p[x] != 0) << x;
+    return bits;
+}
+
+ME_TARGET_AVX2 u64 row_bits_avx2(const u8 *p, int n) {
+    u64 bits = 0;
+    int x = 0;
+    const __m256i zero = _mm256_setzero_si256();
+    for (; x + 32 <= n; x += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + x));
+        bits |= (u64)~(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) << x;
+    }
+    for (; x < n; x++) bits |= (u64)(p[x] != 0) << x;
+    return bits;
+}
+
+// 一次读完整的 64 字节 末尾不足的部分用掩码读取 不会越界
+ME_TARGET_AVX512 u64 row_bits_avx512(const u8 *p, int n) {
+    const __mmask64 valid = n >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << n) - 1);
+    const __m512i v = _mm512_maskz_loadu_epi8(valid, p);
+    return _mm512_test_epi8_mask(v, v);
+}
+#elif defined(ME_SIMD_NEON)
+u64 row_bits_neon(const u8 *p, int n) {
+    u64 bits = 0;
+    int x = 0;
+    static const u8 weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t w = vld1q_u8(weights);
+    for (; x + 16 <= n; x += 16) {
+        const uint8x16_t v = vld1q_u8(p + x);
+        const uint8x16_t m = vandq_u8(vtstq_u8(v, v), w);
+        bits |= (u64)(vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8)) << x;
+    }
+    for (; x < n; x++) bits |= (u64)(p[x] != 0) << x;
+    return bits;
+}
+#endif
+
+row_bits_fn select_row_bits(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+            return row_bits_avx512;
+        case simd_level::avx2:
+            return row_bits_avx2;
+        case simd_level::sse2:
+            return row_bits_sse2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return row_bits_neon;
+#endif
+        default:
+            return row_bits_scalar;
+    }
+}
+
+simd_kernel<row_bits_fn> RowBits{select_row_bits};
+
+u32 find(std::vector<Labels::Run> &runs, u32 i) {
+    while (runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+// 根总是下标小的段 也就是分量在扫描顺序中的第一段
+void unite(std::vector<Labels::Run> &runs, u32 a, u32 b) {
+    a = find(runs, a);
+    b = find(runs, b);
+    if (a == b) return;
+    if (a < b) std::swap(a, b);
+    runs[a].parent = b;
+}
+
+}  // namespace
+
+void label(const u8 *mask, int width, int height, int stride, Labels &out) {
+    out.width = width;
+    out.height = height;
+    out.components.clear();
+    out.runs.clear();
+    out.rowStart.assign((size_t)height + 1, 0);
+    std::vector<Labels::Run> &runs = out.runs;
+    const row_bits_fn row_bits = RowBits.get();
+
+    for (int y = 0; y < height; y++) {
+        const u32 begin = (u32)runs.size();
+        out.rowStart[y] = begin;
+        const u8 *row = mask + (size_t)y * stride;
+
+        // open 为没有结束的段的起点 段可以跨过 64 字节的边界
+        int open = -1;
+        for (int x = 0; x < width; x += 64) {
+            const int n = std::min(64, width - x);
+            const u64 bits = row_bits(row + x, n);
+            int k = 0;
+            while (k < n) {
+                if (open < 0) {
+                    if (!(bits >> k)) break;
+                    k += std::countr_zero(bits >> k);
+                    open = x + k;
+                }
+                k += std::countr_one(bits >> k);
+                if (k >= n) break;
+                runs.push_back({open, x + k, (u32)runs.size()});
+                open = -1;
+            }
+        }
+        if (open >= 0) runs.push_back({open, width, (u32)runs.size()});
+
+        if (y == 0) continue;
+        // 上一行的段按 x 排好序 和当前行一起从左往右走一遍
+        u32 j = out.rowStart[y - 1];
+        for (u32 i = begin; i < (u32)runs.size(); i++) {
+            while (j < begin && runs[j].x1 <= runs[i].x0) j++;
+            for (u32 k = j; k < begin && runs[k].x0 < runs[i].x1; k++) unite(runs, i, k);
+        }
+    }
+    out.rowStart[height] = (u32)runs.size();
+
+    out.labels.assign((size_t)width * height, 0);
+    out.ids.resize(runs.size());
+    for (int y = 0; y < height; y++) {
+        for (u32 i = out.rowStart[y]; i < out.rowStart[y + 1]; i++) {
+            const u32 root = find(runs, i);
+            if (root == i) {
+                out.components.push_back({runs[i].x0, y, runs[i].x1, y + 1, 0});
+                out.ids[i] = (u32)out.components.size();
+            } else {
+                out.ids[i] = out.ids[root];
+            }
+
+            const Labels::Run &r = runs[i];
+            Component &c = out.components[out.ids[i] - 1];
+            c.x0 = std::min(c.x0, r.x0);
+            c.x1 = std::max(c.x1, r.x1);
+            c.y1 = y + 1;
+            c.pixels += (u32)(r.x1 - r.x0);
+            std::fill_n(out.labels.begin() + (size_t)y * width + r.x0, r.x1 - r.x0, out.ids[i]);
+        }
+    }
+}
+
+}  // namespace ME::ConnectedComponents
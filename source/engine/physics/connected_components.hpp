@@ -0,0 +1,51 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_CONNECTED_COMPONENTS_HPP
+#define ME_CONNECTED_COMPONENTS_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 位图的 4 连通分量 两遍扫描
+// 第一遍把每行的非零字节切成连续的段 (SIMD 每次判断 64 个字节) 与上一行重叠的段在并查集中合并
+// 第二遍按段写出标签 同时统计每个分量的包围盒和像素数 不递归 也不追踪轮廓
+namespace ConnectedComponents {
+
+struct Component {
+    // [x0, x1) x [y0, y1)
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    u32 pixels = 0;
+};
+
+// 多次调用之间复用内存
+struct Labels {
+    int width = 0;
+    int height = 0;
+    // width * height 0 为背景 k + 1 为 components[k]
+    std::vector<u32> labels;
+    // 按第一个像素的扫描顺序排列
+    std::vector<Component> components;
+
+    u32 at(int x, int y) const { return labels[x + y * width]; }
+
+    // 内部缓冲
+    struct Run {
+        int x0, x1;
+        u32 parent;
+    };
+    std::vector<Run> runs;
+    std::vector<u32> rowStart;
+    std::vector<u32> ids;
+};
+
+// mask 的非零字节为前景 相邻两行相隔 stride 字节
+void label(const u8 *mask, int width, int height, int stride, Labels &out);
+
+}  // namespace ConnectedComponents
+
+}  // namespace ME
+
+#endif
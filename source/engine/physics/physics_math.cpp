@@ -1,7 +1,17 @@
 
 #include "physics_math.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(ME_SIMD_X86)
+#include <immintrin.h>
+#elif defined(ME_SIMD_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace ME {
 
@@ -1773,17 +1783,9 @@ void simplify_section(const std::vector<MEvec2> &pts, f32 tolerance, size_t i, s
         return;
     }
 
-    f32 max_distance = -1.0f;
-    size_t max_index = i;
-
-    for (size_t k = i + 1; k < j; k++) {
-        f32 distance = pDistance(pts[k].x, pts[k].y, pts[i].x, pts[i].y, pts[j].x, pts[j].y);
-
-        if (distance > max_distance) {
-            max_distance = distance;
-            max_index = k;
-        }
-    }
+    // 与逐点调用 pDistance 相同 取第一个最远的点
+    f32 max_distance;
+    size_t max_index = i + 1 + ME_vec2_furthest_from_segment_batch(pts.data() + i + 1, j - i - 1, pts[i], pts[j], &max_distance);
 
     if (max_distance <= tolerance) {
         for (size_t k = i + 1; k < j; k++) {
@@ -2001,6 +2003,296 @@ Direction FindEdge(int width, int height, unsigned char *data, int lookX, int lo
     return {-1, -1};
 }
 
+// 各个 marching squares 值的走向 与 FindPerimeter 相同 6 和 9 是鞍点 由上一步决定
+static constexpr i8 STEP_X[16] = {0, 0, 1, 1, -1, 0, 0, 1, 0, 0, 0, 0, -1, 0, -1, 0};
+static constexpr i8 STEP_Y[16] = {0, 1, 0, 0, 0, 1, 0, 0, -1, 0, -1, -1, 0, 1, 0, 0};
+// 直线和鞍点以外的格点 每条轮廓在这里只经过一次
+static constexpr u16 CORNERS = (1 << 1) | (1 << 2) | (1 << 4) | (1 << 7) | (1 << 8) | (1 << 11) | (1 << 13) | (1 << 14);
+// 鞍点会被经过两次 两个出口分开记录 普通格点只用第一个
+static constexpr u8 VISITED_A = 0x10;
+static constexpr u8 VISITED_B = 0x20;
+
+// 把 src 的 width 个字节转成 0/1 写到 dst
+using binarize_fn = void (*)(const unsigned char *src, u8 *dst, int width);
+// 由相邻两行计算一行 n 个格点的值 bit0 左上 bit1 右上 bit2 左下 bit3 右下 top 和 bottom 只有 0/1
+using classify_fn = void (*)(const u8 *top, const u8 *bottom, u8 *cases, int n);
+
+static void binarize_scalar(const unsigned char *src, u8 *dst, int width) {
+    for (int x = 0; x < width; x++) dst[x] = src[x] != 0;
+}
+
+static void classify_scalar(const u8 *top, const u8 *bottom, u8 *cases, int n) {
+    for (int x = 0; x < n; x++) cases[x] = top[x] | (top[x + 1] << 1) | (bottom[x] << 2) | (bottom[x + 1] << 3);
+}
+
+#if defined(ME_SIMD_X86)
+static void binarize_sse2(const unsigned char *src, u8 *dst, int width) {
+    int x = 0;
+    const __m128i one = _mm_set1_epi8(1);
+    for (; x + 16 <= width; x += 16) _mm_storeu_si128((__m128i *)(dst + x), _mm_min_epu8(_mm_loadu_si128((const __m128i *)(src + x)), one));
+    binarize_scalar(src + x, dst + x, width - x);
+}
+
+static void classify_sse2(const u8 *top, const u8 *bottom, u8 *cases, int n) {
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i t0 = _mm_loadu_si128((const __m128i *)(top + x));
+        __m128i t1 = _mm_loadu_si128((const __m128i *)(top + x + 1));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(bottom + x));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(bottom + x + 1));
+        // 每个字节只有 0/1 用加法代替移位
+        __m128i t = _mm_add_epi8(t0, _mm_add_epi8(t1, t1));
+        __m128i b = _mm_add_epi8(b0, _mm_add_epi8(b1, b1));
+        b = _mm_add_epi8(b, b);
+        b = _mm_add_epi8(b, b);
+        _mm_storeu_si128((__m128i *)(cases + x), _mm_add_epi8(t, b));
+    }
+    classify_scalar(top + x, bottom + x, cases + x, n - x);
+}
+
+ME_TARGET_AVX2 static void binarize_avx2(const unsigned char *src, u8 *dst, int width) {
+    int x = 0;
+    const __m256i one = _mm256_set1_epi8(1);
+    for (; x + 32 <= width; x += 32) _mm256_storeu_si256((__m256i *)(dst + x), _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(src + x)), one));
+    binarize_scalar(src + x, dst + x, width - x);
+}
+
+ME_TARGET_AVX2 static void classify_avx2(const u8 *top, const u8 *bottom, u8 *cases, int n) {
+    int x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i t0 = _mm256_loadu_si256((const __m256i *)(top + x));
+        __m256i t1 = _mm256_loadu_si256((const __m256i *)(top + x + 1));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(bottom + x));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(bottom + x + 1));
+        __m256i t = _mm256_add_epi8(t0, _mm256_add_epi8(t1, t1));
+        __m256i b = _mm256_add_epi8(b0, _mm256_add_epi8(b1, b1));
+        b = _mm256_add_epi8(b, b);
+        b = _mm256_add_epi8(b, b);
+        _mm256_storeu_si256((__m256i *)(cases + x), _mm256_add_epi8(t, b));
+    }
+    classify_scalar(top + x, bottom + x, cases + x, n - x);
+}
+
+// 末尾不足 64 字节的部分用掩码读写
+ME_TARGET_AVX512 static void binarize_avx512(const unsigned char *src, u8 *dst, int width) {
+    const __m512i one = _mm512_set1_epi8(1);
+    for (int x = 0; x < width; x += 64) {
+        const __mmask64 valid = width - x >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (width - x)) - 1);
+        _mm512_mask_storeu_epi8(dst + x, valid, _mm512_min_epu8(_mm512_maskz_loadu_epi8(valid, src + x), one));
+    }
+}
+
+ME_TARGET_AVX512 static void classify_avx512(const u8 *top, const u8 *bottom, u8 *cases, int n) {
+    for (int x = 0; x < n; x += 64) {
+        const __mmask64 valid = n - x >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (n - x)) - 1);
+        __m512i t0 = _mm512_maskz_loadu_epi8(valid, top + x);
+        __m512i t1 = _mm512_maskz_loadu_epi8(valid, top + x + 1);
+        __m512i b0 = _mm512_maskz_loadu_epi8(valid, bottom + x);
+        __m512i b1 = _mm512_maskz_loadu_epi8(valid, bottom + x + 1);
+        __m512i t = _mm512_add_epi8(t0, _mm512_add_epi8(t1, t1));
+        __m512i b = _mm512_add_epi8(b0, _mm512_add_epi8(b1, b1));
+        b = _mm512_add_epi8(b, b);
+        b = _mm512_add_epi8(b, b);
+        _mm512_mask_storeu_epi8(cases + x, valid, _mm512_add_epi8(t, b));
+    }
+}
+#elif defined(ME_SIMD_NEON)
+static void binarize_neon(const unsigned char *src, u8 *dst, int width) {
+    int x = 0;
+    const uint8x16_t one = vdupq_n_u8(1);
+    for (; x + 16 <= width; x += 16) vst1q_u8(dst + x, vminq_u8(vld1q_u8(src + x), one));
+    binarize_scalar(src + x, dst + x, width - x);
+}
+
+static void classify_neon(const u8 *top, const u8 *bottom, u8 *cases, int n) {
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        uint8x16_t t = vorrq_u8(vld1q_u8(top + x), vshlq_n_u8(vld1q_u8(top + x + 1), 1));
+        uint8x16_t b = vorrq_u8(vshlq_n_u8(vld1q_u8(bottom + x), 2), vshlq_n_u8(vld1q_u8(bottom + x + 1), 3));
+        vst1q_u8(cases + x, vorrq_u8(t, b));
+    }
+    classify_scalar(top + x, bottom + x, cases + x, n - x);
+}
+#endif
+
+static binarize_fn select_binarize(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+            return binarize_avx512;
+        case simd_level::avx2:
+            return binarize_avx2;
+        case simd_level::sse2:
+            return binarize_sse2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return binarize_neon;
+#endif
+        default:
+            return binarize_scalar;
+    }
+}
+
+static classify_fn select_classify(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+            return classify_avx512;
+        case simd_level::avx2:
+            return classify_avx2;
+        case simd_level::sse2:
+            return classify_sse2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return classify_neon;
+#endif
+        default:
+            return classify_scalar;
+    }
+}
+
+static simd_kernel<binarize_fn> Binarize{select_binarize};
+static simd_kernel<classify_fn> Classify{select_classify};
+
+// src 为空时写入全零行 dst 左右各补一个 0 长度 width + 2
+static void load_row(binarize_fn binarize, const unsigned char *src, u8 *dst, int width) {
+    dst[0] = 0;
+    dst[width + 1] = 0;
+    if (!src) {
+        std::memset(dst + 1, 0, width);
+        return;
+    }
+    binarize(src, dst + 1, width);
+}
+
+void ExtractContours(int width, int height, const unsigned char *data, Contours &out, f32 tolerance) {
+    out.clear();
+    if (width <= 0 || height <= 0 || !data) return;
+
+    const int cw = width + 1;
+    const int ch = height + 1;
+    out.cases.resize((size_t)cw * ch);
+    out.rows.resize((size_t)(width + 2) * 2);
+
+    u8 *top = out.rows.data();
+    u8 *bottom = top + width + 2;
+    const binarize_fn binarize = Binarize.get();
+    const classify_fn classify = Classify.get();
+    load_row(binarize, nullptr, top, width);
+    for (int y = 0; y < ch; y++) {
+        load_row(binarize, y < height ? data + (size_t)y * width : nullptr, bottom, width);
+        classify(top, bottom, out.cases.data() + (size_t)y * cw, cw);
+        std::swap(top, bottom);
+    }
+
+    u8 *cases = out.cases.data();
+
+    // 从 (sx, sy) 出发追踪一条轮廓 (pdx, pdy) 为假定的上一步 用来选择鞍点的出口
+    // 只记录拐点 相当于 FindPerimeter 压缩后的每一段的端点
+    auto trace = [&](int sx, int sy, int pdx, int pdy) {
+        out.trace.clear();
+        int x = sx, y = sy;
+        int fdx = 0, fdy = 0;
+        for (size_t steps = 0; steps <= out.cases.size() * 2; steps++) {
+            u8 &cell = cases[x + y * cw];
+            const int v = cell & 0x0f;
+
+            int dx, dy;
+            u8 visit = VISITED_A;
+            if (v == 6) {
+                const bool west = pdx == 0 && pdy == 1;
+                dx = west ? -1 : 1;
+                dy = 0;
+                visit = west ? VISITED_A : VISITED_B;
+            } else if (v == 9) {
+                const bool north = pdx == 1 && pdy == 0;
+                dx = 0;
+                dy = north ? 1 : -1;
+                visit = north ? VISITED_A : VISITED_B;
+            } else {
+                dx = STEP_X[v];
+                dy = STEP_Y[v];
+            }
+            if (dx == 0 && dy == 0) break;
+
+            // 同一条轮廓可能两次经过起点所在的鞍点 出口也相同才算闭合
+            if (steps > 0 && x == sx && y == sy && dx == fdx && dy == fdy) break;
+            if (steps == 0) {
+                fdx = dx;
+                fdy = dy;
+            }
+            cell |= visit;
+
+            if (dx != pdx || dy != pdy) out.trace.emplace_back((f32)x, (f32)y);
+            pdx = dx;
+            pdy = dy;
+            x += dx;
+            y -= dy;  // accommodate change of basis
+        }
+    };
+
+    auto emit = [&]() {
+        if (out.trace.size() < 3) return;
+
+        // 起点放到最后 与 FindPerimeter 之后逐段累加得到的点序相同
+        std::rotate(out.trace.begin(), out.trace.begin() + 1, out.trace.end());
+
+        const size_t n = out.trace.size();
+        if (tolerance > 0) {
+            out.mark.assign(n, true);
+            simplify_section(out.trace, tolerance, 0, n - 1, &out.mark);
+        }
+
+        Contour contour;
+        contour.begin = (u32)out.points.size();
+        for (size_t i = n; i-- > 0;) {
+            if (tolerance <= 0 || out.mark[i]) out.points.push_back(out.trace[i]);
+        }
+        contour.count = (u32)(out.points.size() - contour.begin);
+
+        if (contour.count < 3) {
+            // 1x1 pixel that breaks everything
+            out.points.resize(contour.begin);
+            return;
+        }
+
+        // 反转后按 TPPLPoly::GetOrientation 计算 顺时针的是洞
+        f64 area = 0;
+        const MEvec2 *p = out.points.data() + contour.begin;
+        for (u32 i = 0; i < contour.count; i++) {
+            const MEvec2 &a = p[i];
+            const MEvec2 &b = p[i + 1 == contour.count ? 0 : i + 1];
+            area += (f64)a.x * b.y - (f64)a.y * b.x;
+        }
+        contour.hole = area < 0;
+
+        out.contours.push_back(contour);
+    };
+
+    for (int sy = 0; sy < ch; sy++) {
+        for (int sx = 0; sx < cw; sx++) {
+            const u8 *cell = &cases[sx + sy * cw];
+            const int v = *cell & 0x0f;
+            if ((CORNERS >> v) & 1) {
+                if (!(*cell & VISITED_A)) {
+                    trace(sx, sy, 0, 0);
+                    emit();
+                }
+            } else if (v == 6 || v == 9) {
+                // 四个角都是鞍点的轮廓 (例如斜向相邻的单个像素) 只能从鞍点开始
+                if (!(*cell & VISITED_A)) {
+                    trace(sx, sy, v == 6 ? 0 : 1, v == 6 ? 1 : 0);
+                    emit();
+                }
+                if (!(*cell & VISITED_B)) {
+                    trace(sx, sy, 0, 0);
+                    emit();
+                }
+            }
+        }
+    }
+}
+
 }  // namespace MarchingSquares
 
 }  // namespace ME
\ No newline at end of file
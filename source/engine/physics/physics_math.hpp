@@ -451,6 +451,40 @@ Result FindPerimeter(int initialX, int initialY, int width, int height, unsigned
 Result FindPerimeter(int width, int height, unsigned char *data);
 Result FindPerimeter(int width, int height, unsigned char *data, int lookX, int lookY);
 Direction FindEdge(int width, int height, unsigned char *data, int lookX, int lookY);
+
+struct Contour {
+    u32 begin = 0;  // Contours::points 中的起始下标
+    u32 count = 0;
+    bool hole = false;
+};
+
+// ExtractContours 的输出 多次调用之间复用内存
+struct Contours {
+    std::vector<MEvec2> points;
+    std::vector<Contour> contours;
+
+    // 内部缓冲
+    std::vector<u8> cases;
+    std::vector<u8> rows;
+    std::vector<MEvec2> trace;
+    std::vector<bool> mark;
+
+    void clear() {
+        points.clear();
+        contours.clear();
+    }
+};
+
+/**
+ * 一次扫描提取位图中所有的轮廓 包括洞 代替逐个 FindPerimeter 再 simplify
+ *
+ * 先按行计算 (width + 1) x (height + 1) 个格点的 marching squares 值
+ * 再从每个还没走过的拐角出发追踪 只在方向改变处输出点 坐标与 FindPerimeter 相同
+ * tolerance > 0 时对每条轮廓做 Douglas-Peucker 化简 少于 3 个点的轮廓丢弃
+ *
+ * 外轮廓为 TPPL_CCW 洞为 TPPL_CW 可以直接写入 TPPLPoly
+ */
+void ExtractContours(int width, int height, const unsigned char *data, Contours &out, f32 tolerance = 0);
 }  // namespace MarchingSquares
 
 }  // namespace ME
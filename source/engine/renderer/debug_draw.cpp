@@ -0,0 +1,165 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "debug_draw.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ME {
+
+namespace {
+
+// 与 renderer_opengl 中 CALCULATE_CIRCLE_DT_AND_SEGMENTS 相同
+int circle_segments(f32 radius) {
+    const int n = (int)(2 * M_PI / (0.625f / std::sqrt(std::max(radius, 0.01f)))) + 1;
+    return std::max(n, 16);
+}
+
+}  // namespace
+
+DebugDrawBatch::Group *DebugDrawBatch::group(R_Target *target, size_t vertexCount) {
+    if (!target || vertexCount > MAX_VERTICES) return nullptr;
+    Group *g = nullptr;
+    for (Group &it : groups) {
+        if (it.target == target) {
+            g = &it;
+            break;
+        }
+    }
+    if (!g) {
+        groups.push_back({target, {}, {}});
+        g = &groups.back();
+    }
+    if (g->vertices.size() / STRIDE + vertexCount > MAX_VERTICES) draw(*g);
+    return g;
+}
+
+u16 DebugDrawBatch::vertex(Group &g, f32 x, f32 y, MEcolor color) {
+    const u16 index = (u16)(g.vertices.size() / STRIDE);
+    g.vertices.insert(g.vertices.end(), {x, y, color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f});
+    return index;
+}
+
+void DebugDrawBatch::quad(Group &g, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color) {
+    const u16 base = vertex(g, x1, y1, color);
+    vertex(g, x2, y1, color);
+    vertex(g, x2, y2, color);
+    vertex(g, x1, y2, color);
+    for (u16 k : {0, 1, 2, 0, 2, 3}) g.indices.push_back(base + k);
+}
+
+void DebugDrawBatch::line(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color, f32 thickness) {
+    Group *g = group(target, 4);
+    if (!g) return;
+    const f32 t = thickness / 2;
+    const f32 angle = std::atan2(y2 - y1, x2 - x1);
+    const f32 tc = t * std::cos(angle);
+    const f32 ts = t * std::sin(angle);
+    const u16 base = vertex(*g, x1 + ts, y1 - tc, color);
+    vertex(*g, x1 - ts, y1 + tc, color);
+    vertex(*g, x2 + ts, y2 - tc, color);
+    vertex(*g, x2 - ts, y2 + tc, color);
+    for (u16 k : {0, 1, 2, 1, 2, 3}) g->indices.push_back(base + k);
+}
+
+void DebugDrawBatch::rectangle(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color) {
+    Group *g = group(target, 16);
+    if (!g) return;
+    if (x2 < x1) std::swap(x1, x2);
+    if (y2 < y1) std::swap(y1, y2);
+
+    // 上下左右四个实心条 与 R_Rectangle 覆盖的范围相同
+    const f32 outer = R_GetLineThickness() / 2;
+    f32 ix = outer, iy = outer;
+    if (x1 + ix > x2 - ix) ix = (x2 - x1) / 2;
+    if (y1 + iy > y2 - iy) iy = (y2 - y1) / 2;
+    quad(*g, x1 - outer, y1 - outer, x2 + outer, y1 + iy, color);
+    quad(*g, x1 - outer, y2 - iy, x2 + outer, y2 + outer, color);
+    quad(*g, x1 - outer, y1 + iy, x1 + ix, y2 - iy, color);
+    quad(*g, x2 - ix, y1 + iy, x2 + outer, y2 - iy, color);
+}
+
+void DebugDrawBatch::rectangle_filled(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color) {
+    Group *g = group(target, 4);
+    if (g) quad(*g, x1, y1, x2, y2, color);
+}
+
+void DebugDrawBatch::point(R_Target *target, f32 x, f32 y, f32 size, MEcolor color) {
+    const f32 h = size / 2;
+    rectangle_filled(target, x - h, y - h, x + h, y + h, color);
+}
+
+void DebugDrawBatch::polygon(R_Target *target, u32 count, const f32 *vertices, MEcolor color) {
+    if (count < 2) return;
+    const f32 thickness = R_GetLineThickness();
+    for (u32 i = 0; i < count; i++) {
+        const u32 j = (i + 1) % count;
+        line(target, vertices[i * 2], vertices[i * 2 + 1], vertices[j * 2], vertices[j * 2 + 1], color, thickness);
+    }
+}
+
+void DebugDrawBatch::polygon_filled(R_Target *target, u32 count, const f32 *vertices, MEcolor color) {
+    if (count < 3) return;
+    Group *g = group(target, count);
+    if (!g) return;
+    const u16 base = vertex(*g, vertices[0], vertices[1], color);
+    for (u32 i = 1; i < count; i++) vertex(*g, vertices[i * 2], vertices[i * 2 + 1], color);
+    for (u32 i = 1; i + 1 < count; i++) {
+        g->indices.push_back(base);
+        g->indices.push_back(base + i);
+        g->indices.push_back(base + i + 1);
+    }
+}
+
+void DebugDrawBatch::circle(R_Target *target, f32 x, f32 y, f32 radius, MEcolor color) {
+    const int n = circle_segments(radius);
+    Group *g = group(target, n * 2);
+    if (!g) return;
+    const f32 t = R_GetLineThickness() / 2;
+    const f32 inner = std::max(radius - t, 0.0f), outer = radius + t;
+    const u16 base = (u16)(g->vertices.size() / STRIDE);
+    for (int i = 0; i < n; i++) {
+        const f32 a = (f32)(2 * M_PI * i / n);
+        const f32 dx = std::cos(a), dy = std::sin(a);
+        vertex(*g, x + inner * dx, y + inner * dy, color);
+        vertex(*g, x + outer * dx, y + outer * dy, color);
+    }
+    for (int i = 0; i < n; i++) {
+        const u16 a = base + i * 2, b = base + ((i + 1) % n) * 2;
+        for (u16 k : {a, (u16)(a + 1), b, (u16)(a + 1), b, (u16)(b + 1)}) g->indices.push_back(k);
+    }
+}
+
+void DebugDrawBatch::circle_filled(R_Target *target, f32 x, f32 y, f32 radius, MEcolor color) {
+    const int n = circle_segments(radius);
+    Group *g = group(target, n + 1);
+    if (!g) return;
+    const u16 center = vertex(*g, x, y, color);
+    for (int i = 0; i < n; i++) {
+        const f32 a = (f32)(2 * M_PI * i / n);
+        vertex(*g, x + radius * std::cos(a), y + radius * std::sin(a), color);
+    }
+    for (int i = 0; i < n; i++) {
+        g->indices.push_back(center);
+        g->indices.push_back(center + 1 + i);
+        g->indices.push_back(center + 1 + (i + 1) % n);
+    }
+}
+
+void DebugDrawBatch::draw(Group &g) {
+    if (g.indices.empty()) return;
+    R_TriangleBatch(nullptr, g.target, (unsigned short)(g.vertices.size() / STRIDE), g.vertices.data(), (unsigned int)g.indices.size(), g.indices.data(), R_BATCH_XY_RGBA);
+    g.vertices.clear();
+    g.indices.clear();
+    batches++;
+}
+
+void DebugDrawBatch::flush(R_Target *target) {
+    batches = 0;
+    for (Group &g : groups) {
+        if (!target || g.target == target) draw(g);
+    }
+    if (!target) groups.clear();
+}
+
+}  // namespace ME
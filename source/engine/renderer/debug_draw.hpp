@@ -0,0 +1,67 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_DEBUG_DRAW_HPP
+#define ME_DEBUG_DRAW_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/renderer/renderer_gpu.h"
+
+namespace ME {
+
+// 调试图形的累积器
+// 线 点 边框 多边形和圆都展开成三角形 按目标收集到一个顶点流 flush 时每个目标一次 R_TriangleBatch
+// 逐个调用 R_Line R_Polygon R_Rectangle 会在线和三角形图元之间来回切换 每次切换都要 flush 一次 blit 缓冲
+// 同一目标上保持提交的顺序 线宽取提交时的 R_GetLineThickness 不叠加目标的 color 混合方式取 flush 时的 R_SetShapeBlendMode
+class DebugDrawBatch {
+public:
+    // 与 R_Line 相同
+    void line(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color) { line(target, x1, y1, x2, y2, color, R_GetLineThickness()); }
+    // 指定线宽 不需要 R_SetLineThickness (它会 flush blit 缓冲)
+    void line(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color, f32 thickness);
+    // 与 R_Rectangle 相同
+    void rectangle(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color);
+    void rectangle(R_Target *target, const MErect &rect, MEcolor color) { rectangle(target, rect.x, rect.y, rect.x + rect.w, rect.y + rect.h, color); }
+    // 与 R_RectangleFilled 相同
+    void rectangle_filled(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color);
+    // 以 (x, y) 为中心 边长 size 的实心方块
+    void point(R_Target *target, f32 x, f32 y, f32 size, MEcolor color);
+    // 闭合的折线 vertices 为 x y 交替
+    void polygon(R_Target *target, u32 count, const f32 *vertices, MEcolor color);
+    // 凸多边形 按扇形三角化
+    void polygon_filled(R_Target *target, u32 count, const f32 *vertices, MEcolor color);
+    void circle(R_Target *target, f32 x, f32 y, f32 radius, MEcolor color);
+    void circle_filled(R_Target *target, f32 x, f32 y, f32 radius, MEcolor color);
+
+    // 绘制并清空 target 为 NULL 时绘制全部
+    void flush(R_Target *target = nullptr);
+
+    bool empty() const { return groups.empty(); }
+    // 上一次 flush 的 R_TriangleBatch 次数
+    size_t last_batches() const { return batches; }
+
+private:
+    struct Group {
+        R_Target *target;
+        std::vector<f32> vertices;  // x y r g b a
+        std::vector<u16> indices;
+    };
+
+    // R_TriangleBatch 的顶点数是 u16
+    static constexpr size_t MAX_VERTICES = 65535;
+    static constexpr int STRIDE = 6;
+
+    // 返回能再放下 vertexCount 个顶点的组 放不下时先把它画掉
+    Group *group(R_Target *target, size_t vertexCount);
+    static u16 vertex(Group &g, f32 x, f32 y, MEcolor color);
+    static void quad(Group &g, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color);
+    void draw(Group &g);
+
+    std::vector<Group> groups;
+    size_t batches = 0;
+};
+
+}  // namespace ME
+
+#endif
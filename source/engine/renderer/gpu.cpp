@@ -773,7 +773,7 @@ void ME_debugdraw::DrawPolygon(const b2Vec2 *vertices, i32 vertexCount, const ME
     }
 
     // the "(float*)verts" assumes a b2Vec2 is equal to two floats (which it is)
-    R_Polygon(target, vertexCount, (float *)verts, color);
+    batch.polygon(target, vertexCount, (float *)verts, color);
 
     delete[] verts;
 }
@@ -788,26 +788,26 @@ void ME_debugdraw::DrawSolidPolygon(const b2Vec2 *vertices, i32 vertexCount, con
     // the "(float*)verts" assumes a b2Vec2 is equal to two floats (which it is)
     MEcolor c2 = color;
     c2.a *= 0.25;
-    R_PolygonFilled(target, vertexCount, (float *)verts, c2);
-    R_Polygon(target, vertexCount, (float *)verts, color);
+    batch.polygon_filled(target, vertexCount, (float *)verts, c2);
+    batch.polygon(target, vertexCount, (float *)verts, color);
 
     delete[] verts;
 }
 
 void ME_debugdraw::DrawCircle(const b2Vec2 &center, float radius, const MEcolor &color) {
     b2Vec2 tr = transform(center);
-    R_Circle(target, tr.x, tr.y, radius * scale, color);
+    batch.circle(target, tr.x, tr.y, radius * scale, color);
 }
 
 void ME_debugdraw::DrawSolidCircle(const b2Vec2 &center, float radius, const b2Vec2 &axis, const MEcolor &color) {
     b2Vec2 tr = transform(center);
-    R_CircleFilled(target, tr.x, tr.y, radius * scale, color);
+    batch.circle_filled(target, tr.x, tr.y, radius * scale, color);
 }
 
 void ME_debugdraw::DrawSegment(const b2Vec2 &p1, const b2Vec2 &p2, const MEcolor &color) {
     b2Vec2 tr1 = transform(p1);
     b2Vec2 tr2 = transform(p2);
-    R_Line(target, tr1.x, tr1.y, tr2.x, tr2.y, color);
+    batch.line(target, tr1.x, tr1.y, tr2.x, tr2.y, color);
 }
 
 void ME_debugdraw::DrawTransform(const b2Transform &xf) {
@@ -817,16 +817,16 @@ void ME_debugdraw::DrawTransform(const b2Transform &xf) {
 
     p2 = p1 + k_axisScale * xf.q.GetXAxis();
     tr2 = transform(p2);
-    R_Line(target, tr1.x, tr1.y, tr2.x, tr2.y, {0xff, 0x00, 0x00, 0xcc});
+    batch.line(target, tr1.x, tr1.y, tr2.x, tr2.y, {0xff, 0x00, 0x00, 0xcc});
 
     p2 = p1 + k_axisScale * xf.q.GetYAxis();
     tr2 = transform(p2);
-    R_Line(target, tr1.x, tr1.y, tr2.x, tr2.y, {0x00, 0xff, 0x00, 0xcc});
+    batch.line(target, tr1.x, tr1.y, tr2.x, tr2.y, {0x00, 0xff, 0x00, 0xcc});
 }
 
 void ME_debugdraw::DrawPoint(const b2Vec2 &p, float size, const MEcolor &color) {
     b2Vec2 tr = transform(p);
-    R_CircleFilled(target, tr.x, tr.y, 2, color);
+    batch.circle_filled(target, tr.x, tr.y, 2, color);
 }
 
 void ME_debugdraw::DrawString(int x, int y, const char *string, ...) {}
@@ -836,10 +836,7 @@ void ME_debugdraw::DrawString(const b2Vec2 &p, const char *string, ...) {}
 void ME_debugdraw::DrawAABB(b2AABB *aabb, const MEcolor &color) {
     b2Vec2 tr1 = transform(aabb->lowerBound);
     b2Vec2 tr2 = transform(aabb->upperBound);
-    R_Line(target, tr1.x, tr1.y, tr2.x, tr1.y, color);
-    R_Line(target, tr2.x, tr1.y, tr2.x, tr2.y, color);
-    R_Line(target, tr2.x, tr2.y, tr1.x, tr2.y, color);
-    R_Line(target, tr1.x, tr2.y, tr1.x, tr1.y, color);
+    batch.rectangle(target, tr1.x, tr1.y, tr2.x, tr2.y, color);
 }
 
 void ME_debugdraw::DrawParticles(const b2Vec2 *centers, float32 radius, const b2ParticleColor *colors, int32 count) {}
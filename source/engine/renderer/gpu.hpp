@@ -13,6 +13,7 @@
 #include "engine/core/core.hpp"
 #include "engine/core/sdl_wrapper.h"
 #include "engine/physics/box2d/inc/box2d.h"
+#include "engine/renderer/debug_draw.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/renderer/shaders.hpp"
 #include "engine/utils/utility.hpp"
@@ -310,6 +311,9 @@ public:
     float yOfs = 0;
     float scale = 1;
 
+    // b2World::DebugDraw 的图形都收集在这里 调用者之后 flush 一次
+    DebugDrawBatch batch;
+
     ME_debugdraw(R_Target *target);
     ~ME_debugdraw();
 
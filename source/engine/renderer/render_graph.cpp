@@ -0,0 +1,131 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "render_graph.hpp"
+
+#include <algorithm>
+
+#include "engine/core/profiler.hpp"
+#include "engine/engine.hpp"
+
+namespace ME {
+
+void RenderGraph::Builder::read(Resource r) { graph.passes[pass].reads.push_back(r); }
+
+void RenderGraph::Builder::write(Resource r) { graph.passes[pass].writes.push_back(r); }
+
+void RenderGraph::Builder::side_effect() { graph.passes[pass].sideEffect = true; }
+
+void RenderGraph::begin(R_Target *screenTarget) {
+    reset();
+    screenResource = import("Screen", screenTarget);
+}
+
+RenderGraph::Resource RenderGraph::import(const char *name, R_Image *image) {
+    resources.push_back({name, image, image ? image->target : nullptr, false, 0, 0, R_FORMAT_RGBA, R_FILTER_NEAREST, -1, -1, false});
+    return (Resource)resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::import(const char *name, R_Target *target) {
+    resources.push_back({name, nullptr, target, false, 0, 0, R_FORMAT_RGBA, R_FILTER_NEAREST, -1, -1, false});
+    return (Resource)resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::transient(const char *name, u16 w, u16 h, R_FormatEnum format, R_FilterEnum filter) {
+    resources.push_back({name, nullptr, nullptr, true, w, h, format, filter, -1, -1, false});
+    return (Resource)resources.size() - 1;
+}
+
+void RenderGraph::add_pass(const char *name, const std::function<void(Builder &)> &setup, std::function<void()> execute) {
+    passes.push_back({name, std::move(execute), {}, {}, false, false});
+    Builder builder(*this, (int)passes.size() - 1);
+    setup(builder);
+}
+
+R_Image *RenderGraph::image(Resource r) const { return resources[r].image; }
+
+R_Target *RenderGraph::target(Resource r) const { return resources[r].target; }
+
+void RenderGraph::cull() {
+    // 从后往前 被需要的资源的写入者是活的 它读的资源也被需要
+    // 混合绘制会用到之前的内容 写入者之前的写入者也保留
+    std::vector<bool> needed(resources.size(), false);
+    needed[screenResource] = true;
+    for (int i = (int)passes.size() - 1; i >= 0; i--) {
+        pass &p = passes[i];
+        p.live = p.sideEffect || std::any_of(p.writes.begin(), p.writes.end(), [&](Resource r) { return needed[r]; });
+        if (!p.live) continue;
+        for (Resource r : p.reads) needed[r] = true;
+    }
+
+    for (int i = 0; i < (int)passes.size(); i++) {
+        if (!passes[i].live) continue;
+        for (const std::vector<Resource> *list : {&passes[i].reads, &passes[i].writes}) {
+            for (Resource r : *list) {
+                if (resources[r].first < 0) resources[r].first = i;
+                resources[r].last = i;
+            }
+        }
+    }
+}
+
+void RenderGraph::execute() {
+    Stats stats;
+    cull();
+
+    for (int i = 0; i < (int)passes.size(); i++) {
+        pass &p = passes[i];
+        if (!p.live) {
+            stats.culled++;
+            continue;
+        }
+
+        for (resource &res : resources) {
+            if (res.transient && res.first == i) {
+                res.image = R_AcquirePooledImage(res.w, res.h, res.format, true);
+                R_SetImageFilter(res.image, res.filter);
+                res.target = res.image->target;
+                stats.transients++;
+            }
+        }
+
+        if (std::any_of(p.reads.begin(), p.reads.end(), [&](Resource r) { return resources[r].pending; })) {
+            R_FlushBlitBuffer();
+            for (resource &res : resources) res.pending = false;
+            stats.barriers++;
+        }
+
+        if (!p.writes.empty() && resources[p.writes.front()].target) the<engine>().eng()->target = resources[p.writes.front()].target;
+
+        {
+            ME_profiler_gpu_scope_auto(p.name);
+            p.execute();
+        }
+        stats.passes++;
+
+        for (Resource r : p.writes) resources[r].pending = true;
+
+        for (resource &res : resources) {
+            if (res.transient && res.last == i) {
+                R_ReleasePooledImage(res.image);
+                res.image = nullptr;
+                res.target = nullptr;
+            }
+        }
+    }
+
+    lastStats = stats;
+    ME_profiler_count("render graph passes", stats.passes);
+    ME_profiler_count("render graph culled", stats.culled);
+    reset();
+}
+
+void RenderGraph::reset() {
+    for (resource &res : resources) {
+        if (res.transient && res.image) R_ReleasePooledImage(res.image);
+    }
+    resources.clear();
+    passes.clear();
+    screenResource = -1;
+}
+
+}  // namespace ME
@@ -0,0 +1,109 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_RENDER_GRAPH_HPP
+#define ME_RENDER_GRAPH_HPP
+
+#include <functional>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/renderer/renderer_gpu.h"
+
+namespace ME {
+
+// 一帧的渲染流程 先声明所有 pass 和它们读写的资源 再由 execute 统一执行
+// 引入的资源 (import) 由调用者持有 临时资源 (transient) 从渲染目标池中取出
+// 临时资源在第一个用到它的 pass 之前取出 (目标是清空的) 在最后一个用到它的 pass 之后放回 同样大小的临时资源可以共用一张纹理
+// 裁剪 只有写屏幕 (screen) 或者声明了 side_effect 的 pass 是根 其余 pass 的输出没有被之后执行的 pass 读取时不执行
+// 写持久资源给之后的帧用的 pass 需要声明 side_effect
+// 屏障 pass 读到之前的 pass 写过还没有提交的资源时 先提交批量绘制
+// 每个 pass 在自己的 GPU 计时范围内执行 执行前 eng()->target 设为它写的第一个资源的目标
+// 只能在主线程上使用 每帧从 begin 开始重新声明
+class RenderGraph {
+public:
+    using Resource = int;
+
+    class Builder {
+    public:
+        void read(Resource r);
+        void write(Resource r);
+        // 即使输出没有被读取也要执行
+        void side_effect();
+
+    private:
+        friend class RenderGraph;
+        Builder(RenderGraph &graph, int pass) : graph(graph), pass(pass) {}
+        RenderGraph &graph;
+        int pass;
+    };
+
+    RenderGraph() = default;
+    ~RenderGraph() { reset(); }
+
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    // 开始声明新的一帧 screenTarget 是屏幕资源的目标
+    void begin(R_Target *screenTarget);
+
+    // name 必须在整个帧内有效 一般是字符串字面量
+    Resource import(const char *name, R_Image *image);
+    Resource import(const char *name, R_Target *target);
+    Resource transient(const char *name, u16 w, u16 h, R_FormatEnum format, R_FilterEnum filter = R_FILTER_NEAREST);
+    Resource screen() const { return screenResource; }
+
+    // setup 立即调用 声明读写 execute 在 execute() 中按声明顺序调用
+    void add_pass(const char *name, const std::function<void(Builder &)> &setup, std::function<void()> execute);
+
+    // 只在声明了这个资源的 pass 执行时有效
+    R_Image *image(Resource r) const;
+    R_Target *target(Resource r) const;
+
+    // 裁剪 执行 放回临时资源 然后 reset
+    void execute();
+    // 放弃已经声明的 pass 和资源
+    void reset();
+
+    // 上一次 execute 的统计
+    struct Stats {
+        u32 passes = 0;
+        u32 culled = 0;
+        u32 barriers = 0;
+        u32 transients = 0;
+    };
+    const Stats &stats() const { return lastStats; }
+
+private:
+    struct resource {
+        const char *name;
+        R_Image *image;
+        R_Target *target;
+        bool transient;
+        u16 w, h;
+        R_FormatEnum format;
+        R_FilterEnum filter;
+        // 被执行的 pass 中第一次和最后一次使用
+        int first, last;
+        // 写过还没有提交
+        bool pending;
+    };
+
+    struct pass {
+        const char *name;
+        std::function<void()> execute;
+        std::vector<Resource> reads, writes;
+        bool sideEffect;
+        bool live;
+    };
+
+    void cull();
+
+    std::vector<resource> resources;
+    std::vector<pass> passes;
+    Resource screenResource = -1;
+    Stats lastStats;
+};
+
+}  // namespace ME
+
+#endif
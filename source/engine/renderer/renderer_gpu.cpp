@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
 #include "engine/core/const.h"
 #include "engine/core/core.hpp"
 #include "engine/core/macros.hpp"
@@ -577,6 +579,8 @@ void R_Quit(void) {
 
     if (gpu_current_renderer == NULL) return;
 
+    R_TrimImagePool(0);
+
     Quit(gpu_current_renderer);
     R_FreeRenderer(gpu_current_renderer);
     // FIXME: Free all renderers
@@ -768,6 +772,98 @@ R_Image *R_CreateImage(u16 w, u16 h, R_FormatEnum format) {
     return CreateImage(gpu_current_renderer, w, h, format);
 }
 
+// Render target pool: idle images (released, not freed) grouped by size and format.
+// The most recently released match is handed out first so transient passes alias the same texture.
+typedef struct R_PooledImage {
+    R_Image *image;
+    u64 released;
+} R_PooledImage;
+
+static std::vector<R_PooledImage> gpu_image_pool;
+static u64 gpu_image_pool_clock = 0;
+
+static void gpu_free_pooled_image(R_Image *image) {
+    if (image->target) R_FreeTarget(image->target);
+    R_FreeImage(image);
+}
+
+static size_t gpu_pooled_image_bytes(const R_Image *image) { return (size_t)image->texture_w * image->texture_h * image->bytes_per_pixel; }
+
+R_Image *R_AcquirePooledImage(u16 w, u16 h, R_FormatEnum format, bool with_target) {
+    if (gpu_current_renderer == NULL || gpu_current_renderer->current_context_target == NULL) return NULL;
+
+    int best = -1;
+    for (int i = 0; i < (int)gpu_image_pool.size(); i++) {
+        const R_Image *image = gpu_image_pool[i].image;
+        if (image->base_w != w || image->base_h != h || image->format != format) continue;
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+        // Prefer one that already has a framebuffer when a target is wanted, then the most recently released
+        const bool has = image->target != NULL, best_has = gpu_image_pool[best].image->target != NULL;
+        if (with_target && has != best_has ? has : gpu_image_pool[i].released > gpu_image_pool[best].released) best = i;
+    }
+
+    R_Image *image;
+    if (best >= 0) {
+        image = gpu_image_pool[best].image;
+        gpu_image_pool.erase(gpu_image_pool.begin() + best);
+
+        // Back to the state of a freshly created image, the previous owner may have changed any of it
+        float anchor_x, anchor_y;
+        R_GetDefaultAnchor(&anchor_x, &anchor_y);
+        R_UnsetImageVirtualResolution(image);
+        R_UnsetColor(image);
+        R_SetBlending(image, true);
+        R_SetBlendMode(image, R_BLEND_NORMAL);
+        R_SetImageFilter(image, R_FILTER_LINEAR);
+        R_SetSnapMode(image, R_SNAP_POSITION_AND_DIMENSIONS);
+        R_SetWrapMode(image, R_WRAP_NONE, R_WRAP_NONE);
+        R_SetAnchor(image, anchor_x, anchor_y);
+        if (image->target) {
+            R_UnsetClip(image->target);
+            R_UnsetViewport(image->target);
+            R_UnsetTargetColor(image->target);
+            R_ClearRGBA(image->target, 0, 0, 0, 0);
+        }
+    } else {
+        image = R_CreateImage(w, h, format);
+        if (image == NULL) return NULL;
+    }
+
+    if (with_target && image->target == NULL) R_LoadTarget(image);
+    return image;
+}
+
+void R_ReleasePooledImage(R_Image *image) {
+    if (image == NULL) return;
+    gpu_image_pool.push_back({image, ++gpu_image_pool_clock});
+}
+
+void R_TrimImagePool(size_t max_bytes) {
+    size_t total = 0;
+    for (const R_PooledImage &p : gpu_image_pool) total += gpu_pooled_image_bytes(p.image);
+
+    // Oldest first
+    while (total > max_bytes && !gpu_image_pool.empty()) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < gpu_image_pool.size(); i++) {
+            if (gpu_image_pool[i].released < gpu_image_pool[oldest].released) oldest = i;
+        }
+        R_Image *image = gpu_image_pool[oldest].image;
+        total -= gpu_pooled_image_bytes(image);
+        gpu_image_pool.erase(gpu_image_pool.begin() + oldest);
+        gpu_free_pooled_image(image);
+    }
+}
+
+size_t R_GetImagePoolBytes(void) {
+    size_t total = 0;
+    for (const R_PooledImage &p : gpu_image_pool) total += gpu_pooled_image_bytes(p.image);
+    return total;
+}
+
 R_Image *R_CreateImageUsingTexture(R_TextureHandle handle, bool take_ownership) {
     if (gpu_current_renderer == NULL || gpu_current_renderer->current_context_target == NULL) return NULL;
 
@@ -798,6 +894,20 @@ void R_UpdateImageBytes(R_Image *image, const MErect *image_rect, const unsigned
     UpdateImageBytes(gpu_current_renderer, image, image_rect, bytes, bytes_per_row);
 }
 
+void R_UpdateImageBytesRects(R_Image *image, const MErect *image_rects, int num_rects, const unsigned char *bytes, int bytes_per_row) {
+    if (gpu_current_renderer == NULL || gpu_current_renderer->current_context_target == NULL) return;
+
+    UpdateImageBytesRects(gpu_current_renderer, image, image_rects, num_rects, bytes, bytes_per_row);
+}
+
+void R_SetStreamingUploads(bool enable) {
+    if (gpu_current_renderer == NULL || gpu_current_renderer->current_context_target == NULL) return;
+
+    SetStreamingUploads(gpu_current_renderer, enable);
+}
+
+R_StateStats R_GetStateStats(void) { return GetStateStats(gpu_current_renderer); }
+
 bool R_ReplaceImage(R_Image *image, void *surface, const MErect *surface_rect) {
     if (gpu_current_renderer == NULL || gpu_current_renderer->current_context_target == NULL) return false;
 
@@ -437,6 +437,7 @@ static const R_FeatureEnum R_FEATURE_PIXEL_SHADER = 0x200;
 static const R_FeatureEnum R_FEATURE_GEOMETRY_SHADER = 0x400;
 static const R_FeatureEnum R_FEATURE_WRAP_REPEAT_MIRRORED = 0x800;
 static const R_FeatureEnum R_FEATURE_CORE_FRAMEBUFFER_OBJECTS = 0x1000;
+static const R_FeatureEnum R_FEATURE_PERSISTENT_PIXEL_BUFFERS = 0x2000;
 
 /*! Combined feature flags */
 #define R_FEATURE_ALL_BASE R_FEATURE_RENDER_TARGETS
@@ -978,6 +979,21 @@ R_Image *R_CreateAliasImage(R_Image *image);
 /*! Copy an image to a new image.  Don't forget to R_FreeImage() both. */
 R_Image *R_CopyImage(R_Image *image);
 
+/*! Get a blank image of the given size and format from the render target pool, creating one only when no idle image matches.
+ * A reused image gets the settings of a freshly created one back and its target (if any) is cleared to transparent; contents of images without a target are undefined.
+ * \param with_target Also make sure image->target is loaded.
+ * Give it back with R_ReleasePooledImage() instead of R_FreeImage(). */
+R_Image *R_AcquirePooledImage(u16 w, u16 h, R_FormatEnum format, bool with_target);
+
+/*! Return an image (and its target) to the pool.  Acquiring and releasing within a frame lets transient passes of the same size and format share one texture. */
+void R_ReleasePooledImage(R_Image *image);
+
+/*! Free the least recently released idle images until the pool holds at most max_bytes of textures.  Call after reallocating to drop sizes that are no longer used. */
+void R_TrimImagePool(size_t max_bytes);
+
+/*! Bytes of texture memory held by idle pooled images. */
+size_t R_GetImagePoolBytes(void);
+
 /*! Deletes an image in the proper way for this renderer.  Also deletes the corresponding R_Target if applicable.  Be careful not to use that target afterward! */
 void R_FreeImage(R_Image *image);
 
@@ -993,6 +1009,25 @@ void R_UpdateImage(R_Image *image, const MErect *image_rect, void *surface, cons
 /*! Update an image from an array of pixel data.  Ignores virtual resolution on the image so the number of pixels needed from the surface is known. */
 void R_UpdateImageBytes(R_Image *image, const MErect *image_rect, const unsigned char *bytes, int bytes_per_row);
 
+/*! Update several regions of an image from one array of pixel data covering the whole image.  Nearby rectangles are coalesced so the number of uploads stays small. */
+void R_UpdateImageBytesRects(R_Image *image, const MErect *image_rects, int num_rects, const unsigned char *bytes, int bytes_per_row);
+
+/*! Route R_UpdateImageBytes and R_UpdateImageBytesRects through a persistently mapped, fenced PBO ring when R_FEATURE_PERSISTENT_PIXEL_BUFFERS is available.  Uploads fall back to the synchronous path whenever the ring is still in use by the GPU. */
+void R_SetStreamingUploads(bool enable);
+
+/*! GL state changes made by the OpenGL backend during one frame.  Each field counts calls actually issued to the driver; skipped counts requested changes that matched the shadowed GL state and were dropped. */
+typedef struct R_StateStats {
+    u32 programs;
+    u32 textures;
+    u32 framebuffers;
+    u32 blend;
+    u32 viewports;
+    u32 skipped;
+} R_StateStats;
+
+/*! Returns the state change counts of the last frame finished by R_Flip().  The same counts are reported to the profiler as "gl ..." statistics. */
+R_StateStats R_GetStateStats(void);
+
 /*! Update an image from surface data, replacing its underlying texture to allow for size changes.  Ignores virtual resolution on the image so the number of pixels needed from the surface is known. */
 bool R_ReplaceImage(R_Image *image, void *surface, const MErect *surface_rect);
 
@@ -1791,6 +1826,9 @@ typedef struct R_RendererImpl {
     /*! \see R_UpdateImageBytes */
     void (*UpdateImageBytes)(R_Renderer *renderer, R_Image *image, const MErect *image_rect, const unsigned char *bytes, int bytes_per_row);
 
+    /*! \see R_UpdateImageBytesRects */
+    void (*UpdateImageBytesRects)(R_Renderer *renderer, R_Image *image, const MErect *image_rects, int num_rects, const unsigned char *bytes, int bytes_per_row);
+
     /*! \see R_ReplaceImage */
     bool (*ReplaceImage)(R_Renderer *renderer, R_Image *image, void *surface, const MErect *surface_rect);
 
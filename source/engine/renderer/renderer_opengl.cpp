@@ -4,6 +4,7 @@
 #include "engine/core/base_memory.h"
 #include "engine/core/const.h"
 #include "engine/core/macros.hpp"
+#include "engine/core/profiler.hpp"
 #include "engine/core/sdl_wrapper.h"
 #include "libs/external/stb_image.h"
 #include "libs/glad/glad.h"
@@ -161,6 +162,129 @@ static_inline void upload_new_texture(void *pixels, MErect update_rect, u32 form
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
+// 持久映射的 PBO 环形缓冲 用于异步纹理上传
+// 缓冲区分为 R_STREAM_SEGMENTS 段 每帧写入一段 Flip 时为该段插入 fence
+// 再次轮到某段时若 GPU 仍未读完 本次上传退回同步路径 CPU 不会等待 GPU
+#define R_STREAM_SEGMENTS 3
+#define R_STREAM_MIN_SEGMENT_SIZE (4 * 1024 * 1024)
+
+typedef struct R_PixelStream {
+    GLuint handle;
+    u8 *mapped;
+    unsigned int segment_size;
+    unsigned int used;
+    int segment;
+    bool segment_ready;
+    GLsync fences[R_STREAM_SEGMENTS];
+} R_PixelStream;
+
+static R_PixelStream pixel_stream;
+static bool pixel_stream_enabled = false;
+
+static void free_pixel_stream() {
+    for (int i = 0; i < R_STREAM_SEGMENTS; ++i) {
+        if (pixel_stream.fences[i]) glDeleteSync(pixel_stream.fences[i]);
+    }
+    if (pixel_stream.handle != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_stream.handle);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pixel_stream.handle);
+    }
+    memset(&pixel_stream, 0, sizeof(R_PixelStream));
+}
+
+static bool create_pixel_stream(unsigned int segment_size) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    free_pixel_stream();
+
+    glGenBuffers(1, &pixel_stream.handle);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_stream.handle);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)segment_size * R_STREAM_SEGMENTS, NULL, flags);
+    pixel_stream.mapped = (u8 *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)segment_size * R_STREAM_SEGMENTS, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (pixel_stream.mapped == NULL) {
+        R_PushErrorCode("R_SetStreamingUploads", R_ERROR_BACKEND_ERROR, "Failed to map pixel unpack buffer.");
+        glDeleteBuffers(1, &pixel_stream.handle);
+        pixel_stream.handle = 0;
+        return false;
+    }
+
+    pixel_stream.segment_size = segment_size;
+    return true;
+}
+
+// 在当前段中分配 size 字节 返回 NULL 表示应当使用同步上传
+static u8 *stream_alloc(unsigned int size, GLintptr *offset) {
+    size = (size + 15) & ~15u;
+
+    if (pixel_stream.handle == 0 || (pixel_stream.used == 0 && size > pixel_stream.segment_size)) {
+        // 旧缓冲区由驱动在 GPU 用完后再真正释放
+        unsigned int segment_size = pixel_stream.segment_size ? pixel_stream.segment_size : R_STREAM_MIN_SEGMENT_SIZE;
+        while (segment_size < size) segment_size *= 2;
+        if (!create_pixel_stream(segment_size)) {
+            pixel_stream_enabled = false;
+            return NULL;
+        }
+    }
+
+    if (!pixel_stream.segment_ready) {
+        GLsync fence = pixel_stream.fences[pixel_stream.segment];
+        if (fence) {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) return NULL;
+            glDeleteSync(fence);
+            pixel_stream.fences[pixel_stream.segment] = 0;
+        }
+        pixel_stream.segment_ready = true;
+    }
+
+    if (pixel_stream.used + size > pixel_stream.segment_size) return NULL;
+
+    *offset = (GLintptr)pixel_stream.segment * pixel_stream.segment_size + pixel_stream.used;
+    pixel_stream.used += size;
+    return pixel_stream.mapped + *offset;
+}
+
+static void stream_end_frame() {
+    if (pixel_stream.handle == 0 || pixel_stream.used == 0) return;
+
+    pixel_stream.fences[pixel_stream.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pixel_stream.segment = (pixel_stream.segment + 1) % R_STREAM_SEGMENTS;
+    pixel_stream.used = 0;
+    pixel_stream.segment_ready = false;
+}
+
+// 通过 PBO 上传 pixels 指向矩形左上角 pitch 为源数据每行字节数
+static bool stream_upload_texture(const unsigned char *pixels, MErect update_rect, u32 format, unsigned int pitch, int bytes_per_pixel) {
+    if (!pixel_stream_enabled) return false;
+
+    unsigned int w = (unsigned int)update_rect.w;
+    unsigned int h = (unsigned int)update_rect.h;
+    unsigned int row = w * bytes_per_pixel;
+    if (w == 0 || h == 0) return true;
+
+    GLintptr offset;
+    u8 *dst = stream_alloc(row * h, &offset);
+    if (dst == NULL) return false;
+
+    for (unsigned int i = 0; i < h; ++i) {
+        memcpy(dst, pixels, row);
+        pixels += pitch;
+        dst += row;
+    }
+
+    int alignment = 8;
+    while (row % alignment) alignment >>= 1;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_stream.handle);
+    fast_upload_texture((const void *)offset, update_rect, format, alignment, (int)w);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
 // Define intermediates for FBO functions in case we only have EXT or OES FBO support.
 #if defined(R_ASSUME_CORE_FBO)
 #define glBindFramebufferPROC glBindFramebuffer
@@ -270,10 +394,167 @@ void init_features(R_Renderer *renderer) {
 #ifdef R_ASSUME_SHADERS
     renderer->enabled_features |= R_FEATURE_BASIC_SHADERS;
 #endif
+
+    // Persistent mapped buffers (glBufferStorage)
+    if (GLAD_GL_VERSION_4_4) renderer->enabled_features |= R_FEATURE_PERSISTENT_PIXEL_BUFFERS;
+}
+
+// GL 状态缓存 见 R_GLState
+enum {
+    R_GL_STATE_PROGRAM = 1 << 0,
+    R_GL_STATE_FRAMEBUFFER = 1 << 1,
+    R_GL_STATE_ACTIVE_UNIT = 1 << 2,
+    R_GL_STATE_BLEND = 1 << 3,
+    R_GL_STATE_BLEND_FUNC = 1 << 4,
+    R_GL_STATE_BLEND_EQUATION = 1 << 5,
+    R_GL_STATE_VIEWPORT = 1 << 6,
+};
+
+static R_StateStats state_stats;
+static R_StateStats last_state_stats;
+
+static_inline R_GLState *glState(R_Renderer *renderer) { return &((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->gl_state; }
+
+static void invalidateGLState(R_Context *context) {
+    R_GLState *state = &((R_CONTEXT_DATA *)context->data)->gl_state;
+    state->known = 0;
+    state->texture_known = 0;
+}
+
+static void glStateUseProgram(R_Renderer *renderer, u32 program) {
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_PROGRAM) && state->program == program) {
+        state_stats.skipped++;
+        return;
+    }
+    glUseProgram(program);
+    state->program = program;
+    state->known |= R_GL_STATE_PROGRAM;
+    state_stats.programs++;
+}
+
+static void glStateActiveUnit(R_GLState *state, u32 unit) {
+    if ((state->known & R_GL_STATE_ACTIVE_UNIT) && state->active_unit == unit) return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    state->active_unit = unit;
+    state->known |= R_GL_STATE_ACTIVE_UNIT;
+    state_stats.textures++;
+}
+
+// 绑定后 unit 0 保持为活动单元 上传和纹理参数都作用在 unit 0 上
+static void glStateBindTexture(R_Renderer *renderer, u32 unit, u32 handle) {
+    R_GLState *state = glState(renderer);
+    if (unit < R_GL_STATE_TEXTURE_UNITS && (state->texture_known & (1u << unit)) && state->textures[unit] == handle) {
+        state_stats.skipped++;
+        return;
+    }
+    glStateActiveUnit(state, unit);
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glStateActiveUnit(state, 0);
+    state_stats.textures++;
+    if (unit < R_GL_STATE_TEXTURE_UNITS) {
+        state->textures[unit] = handle;
+        state->texture_known |= 1u << unit;
+    }
+}
+
+// 删除的纹理在所有单元上都变成 0
+static void glStateForgetTexture(R_Renderer *renderer, u32 handle) {
+    if (renderer->current_context_target == NULL) return;
+    R_GLState *state = glState(renderer);
+    for (int i = 0; i < R_GL_STATE_TEXTURE_UNITS; i++) {
+        if (state->textures[i] == handle) state->textures[i] = 0;
+    }
+}
+
+static void glStateForgetFramebuffer(R_Renderer *renderer, u32 handle) {
+    if (renderer->current_context_target == NULL) return;
+    R_GLState *state = glState(renderer);
+    if (state->framebuffer == handle) state->framebuffer = 0;
+}
+
+static void glStateBlend(R_Renderer *renderer, bool enable) {
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_BLEND) && state->blend == enable) {
+        state_stats.skipped++;
+        return;
+    }
+    if (enable)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+    state->blend = enable;
+    state->known |= R_GL_STATE_BLEND;
+    state_stats.blend++;
+}
+
+static void glStateBlendFunc(R_Renderer *renderer, u32 source_color, u32 dest_color, u32 source_alpha, u32 dest_alpha) {
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_BLEND_FUNC) && state->blend_func[0] == source_color && state->blend_func[1] == dest_color && state->blend_func[2] == source_alpha &&
+        state->blend_func[3] == dest_alpha) {
+        state_stats.skipped++;
+        return;
+    }
+    if (source_color == source_alpha && dest_color == dest_alpha)
+        glBlendFunc(source_color, dest_color);
+    else
+        glBlendFuncSeparate(source_color, dest_color, source_alpha, dest_alpha);
+    state->blend_func[0] = source_color;
+    state->blend_func[1] = dest_color;
+    state->blend_func[2] = source_alpha;
+    state->blend_func[3] = dest_alpha;
+    state->known |= R_GL_STATE_BLEND_FUNC;
+    state_stats.blend++;
+}
+
+static void glStateBlendEquation(R_Renderer *renderer, u32 color_equation, u32 alpha_equation) {
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_BLEND_EQUATION) && state->blend_equation[0] == color_equation && state->blend_equation[1] == alpha_equation) {
+        state_stats.skipped++;
+        return;
+    }
+    if (color_equation == alpha_equation)
+        glBlendEquation(color_equation);
+    else
+        glBlendEquationSeparate(color_equation, alpha_equation);
+    state->blend_equation[0] = color_equation;
+    state->blend_equation[1] = alpha_equation;
+    state->known |= R_GL_STATE_BLEND_EQUATION;
+    state_stats.blend++;
+}
+
+static void glStateViewport(R_Renderer *renderer, int x, int y, int w, int h) {
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_VIEWPORT) && state->viewport[0] == x && state->viewport[1] == y && state->viewport[2] == w && state->viewport[3] == h) {
+        state_stats.skipped++;
+        return;
+    }
+    glViewport(x, y, w, h);
+    state->viewport[0] = x;
+    state->viewport[1] = y;
+    state->viewport[2] = w;
+    state->viewport[3] = h;
+    state->known |= R_GL_STATE_VIEWPORT;
+    state_stats.viewports++;
+}
+
+R_StateStats GetStateStats(R_Renderer *renderer) {
+    (void)renderer;
+    return last_state_stats;
 }
 
 void extBindFramebuffer(R_Renderer *renderer, GLuint handle) {
-    if (renderer->enabled_features & R_FEATURE_RENDER_TARGETS) glBindFramebufferPROC(GL_FRAMEBUFFER, handle);
+    if (!(renderer->enabled_features & R_FEATURE_RENDER_TARGETS)) return;
+
+    R_GLState *state = glState(renderer);
+    if ((state->known & R_GL_STATE_FRAMEBUFFER) && state->framebuffer == handle) {
+        state_stats.skipped++;
+        return;
+    }
+    glBindFramebufferPROC(GL_FRAMEBUFFER, handle);
+    state->framebuffer = handle;
+    state->known |= R_GL_STATE_FRAMEBUFFER;
+    state_stats.framebuffers++;
 }
 
 static_inline bool isPowerOfTwo(unsigned int x) { return ((x != 0) && !(x & (x - 1))); }
@@ -292,7 +573,7 @@ void bindTexture(R_Renderer *renderer, R_Image *image) {
         GLuint handle = ((R_IMAGE_DATA *)image->data)->handle;
         FlushBlitBuffer(renderer);
 
-        glBindTexture(GL_TEXTURE_2D, handle);
+        glStateBindTexture(renderer, 0, handle);
         ((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image = image;
     }
 }
@@ -301,7 +582,7 @@ static_inline void flushAndBindTexture(R_Renderer *renderer, GLuint handle) {
     // Bind the texture to which subsequent calls refer
     FlushBlitBuffer(renderer);
 
-    glBindTexture(GL_TEXTURE_2D, handle);
+    glStateBindTexture(renderer, 0, handle);
     ((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image = NULL;
 }
 
@@ -530,10 +811,7 @@ void changeBlending(R_Renderer *renderer, bool enable) {
 
     FlushBlitBuffer(renderer);
 
-    if (enable)
-        glEnable(GL_BLEND);
-    else
-        glDisable(GL_BLEND);
+    glStateBlend(renderer, enable);
 
     cdata->last_use_blending = enable;
 }
@@ -545,10 +823,8 @@ void forceChangeBlendMode(R_Renderer *renderer, R_BlendMode mode) {
 
     cdata->last_blend_mode = mode;
 
-    if (mode.source_color == mode.source_alpha && mode.dest_color == mode.dest_alpha) {
-        glBlendFunc(mode.source_color, mode.dest_color);
-    } else if (renderer->enabled_features & R_FEATURE_BLEND_FUNC_SEPARATE) {
-        glBlendFuncSeparate(mode.source_color, mode.dest_color, mode.source_alpha, mode.dest_alpha);
+    if ((mode.source_color == mode.source_alpha && mode.dest_color == mode.dest_alpha) || (renderer->enabled_features & R_FEATURE_BLEND_FUNC_SEPARATE)) {
+        glStateBlendFunc(renderer, mode.source_color, mode.dest_color, mode.source_alpha, mode.dest_alpha);
     } else {
         R_PushErrorCode("(SDL_gpu internal)", R_ERROR_BACKEND_ERROR,
                         "Could not set blend function because "
@@ -556,10 +832,8 @@ void forceChangeBlendMode(R_Renderer *renderer, R_BlendMode mode) {
     }
 
     if (renderer->enabled_features & R_FEATURE_BLEND_EQUATIONS) {
-        if (mode.color_equation == mode.alpha_equation)
-            glBlendEquation(mode.color_equation);
-        else if (renderer->enabled_features & R_FEATURE_BLEND_EQUATIONS_SEPARATE)
-            glBlendEquationSeparate(mode.color_equation, mode.alpha_equation);
+        if (mode.color_equation == mode.alpha_equation || (renderer->enabled_features & R_FEATURE_BLEND_EQUATIONS_SEPARATE))
+            glStateBlendEquation(renderer, mode.color_equation, mode.alpha_equation);
         else {
             R_PushErrorCode("(SDL_gpu internal)", R_ERROR_BACKEND_ERROR,
                             "Could not set blend equation because "
@@ -708,7 +982,7 @@ void forceChangeViewport(R_Target *target, MErect viewport) {
             y = target->context->drawable_h - viewport.h - viewport.y;
     }
 
-    glViewport((GLint)viewport.x, (GLint)y, (GLsizei)viewport.w, (GLsizei)viewport.h);
+    glStateViewport(R_GetCurrentRenderer(), (GLint)viewport.x, (GLint)y, (GLsizei)viewport.w, (GLsizei)viewport.h);
 }
 
 void changeViewport(R_Target *target) {
@@ -1099,18 +1373,19 @@ R_Target *CreateTargetFromWindow(R_Renderer *renderer, u32 windowID, R_Target *t
         slow_upload_texture = row_upload_texture;
 
 // Set up GL state
+    invalidateGLState(target->context);
 
 // Modes
 #ifndef R_SKIP_ENABLE_TEXTURE_2D
     glEnable(GL_TEXTURE_2D);
 #endif
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glStateBlendFunc(renderer, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glDisable(GL_BLEND);
+    glStateBlend(renderer, false);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
     // Viewport and Framebuffer
-    glViewport(0, 0, (GLsizei)target->viewport.w, (GLsizei)target->viewport.h);
+    glStateViewport(renderer, 0, 0, (GLsizei)target->viewport.w, (GLsizei)target->viewport.h);
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -1206,7 +1481,7 @@ R_Target *CreateTargetFromWindow(R_Renderer *renderer, u32 windowID, R_Target *t
             return NULL;
         }
 
-        glUseProgram(p);
+        glStateUseProgram(renderer, p);
 
         target->context->default_untextured_vertex_shader_id = v;
         target->context->default_untextured_fragment_shader_id = f;
@@ -1329,10 +1604,13 @@ void ResetRendererState(R_Renderer *renderer) {
     target = renderer->current_context_target;
     cdata = (R_CONTEXT_DATA *)target->context->data;
 
-    if (IsFeatureEnabled(renderer, R_FEATURE_BASIC_SHADERS)) glUseProgram(target->context->current_shader_program);
+    // 外部代码可能改过任何状态 全部重发
+    invalidateGLState(target->context);
 
     SDL_GL_MakeCurrent(SDL_GetWindowFromID(target->context->windowID), target->context->context);
 
+    if (IsFeatureEnabled(renderer, R_FEATURE_BASIC_SHADERS)) glStateUseProgram(renderer, target->context->current_shader_program);
+
 #ifndef R_USE_BUFFER_PIPELINE
     glColor4f(cdata->last_color.r / 255.01f, cdata->last_color.g / 255.01f, cdata->last_color.b / 255.01f, GET_ALPHA(cdata->last_color) / 255.01f);
 #endif
@@ -1343,10 +1621,7 @@ void ResetRendererState(R_Renderer *renderer) {
         glDisable(GL_TEXTURE_2D);
 #endif
 
-    if (cdata->last_use_blending)
-        glEnable(GL_BLEND);
-    else
-        glDisable(GL_BLEND);
+    glStateBlend(renderer, cdata->last_use_blending);
 
     forceChangeBlendMode(renderer, cdata->last_blend_mode);
 
@@ -1359,7 +1634,7 @@ void ResetRendererState(R_Renderer *renderer) {
 
     forceChangeViewport(target, target->viewport);
 
-    if (cdata->last_image != NULL) glBindTexture(GL_TEXTURE_2D, ((R_IMAGE_DATA *)(cdata->last_image)->data)->handle);
+    if (cdata->last_image != NULL) glStateBindTexture(renderer, 0, ((R_IMAGE_DATA *)(cdata->last_image)->data)->handle);
 
     if (target->context->active_target != NULL)
         extBindFramebuffer(renderer, ((R_TARGET_DATA *)target->context->active_target->data)->handle);
@@ -1502,6 +1777,9 @@ void Quit(R_Renderer *renderer) {
     // 清理空白缓冲区
     if (zero_buffer) ME_FREE(zero_buffer);
 
+    free_pixel_stream();
+    pixel_stream_enabled = false;
+
     FreeTarget(renderer, renderer->current_context_target);
     renderer->current_context_target = NULL;
 }
@@ -2004,12 +2282,12 @@ bool readImagePixels(R_Renderer *renderer, R_Image *source, GLint format, GLubyt
     if (source == NULL) return false;
 
     // Bind the texture temporarily
-    glBindTexture(GL_TEXTURE_2D, ((R_IMAGE_DATA *)source->data)->handle);
+    glStateBindTexture(renderer, 0, ((R_IMAGE_DATA *)source->data)->handle);
     // Get the data
     glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, pixels);
     // Rebind the last texture
     if (((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image != NULL)
-        glBindTexture(GL_TEXTURE_2D, ((R_IMAGE_DATA *)(((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image)->data)->handle);
+        glStateBindTexture(renderer, 0, ((R_IMAGE_DATA *)(((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image)->data)->handle);
     return true;
 }
 
@@ -2604,12 +2882,107 @@ void UpdateImageBytes(R_Renderer *renderer, R_Image *image, const MErect *image_
     changeTexturing(renderer, 1);
     if (image->target != NULL && isCurrentTarget(renderer, image->target)) FlushBlitBuffer(renderer);
     bindTexture(renderer, image);
+    if (stream_upload_texture(bytes, updateRect, original_format, bytes_per_row, image->bytes_per_pixel)) return;
+
     alignment = 8;
     while (bytes_per_row % alignment) alignment >>= 1;
 
     upload_texture(bytes, updateRect, original_format, alignment, bytes_per_row / image->bytes_per_pixel, bytes_per_row, image->bytes_per_pixel);
 }
 
+void SetStreamingUploads(R_Renderer *renderer, bool enable) {
+    if (enable && !(renderer->enabled_features & R_FEATURE_PERSISTENT_PIXEL_BUFFERS)) enable = false;
+    if (enable == pixel_stream_enabled) return;
+
+    pixel_stream_enabled = enable;
+    if (!enable) free_pixel_stream();
+}
+
+// 把要上传的矩形两两合并 直到任何一次合并多出的面积都超过一次 glTexSubImage2D 的开销
+#define R_UPLOAD_CALL_COST 4096.0f
+#define R_UPLOAD_MAX_RECTS 256
+
+static_inline MErect union_rect(MErect a, MErect b) {
+    MErect r;
+    r.x = fminf(a.x, b.x);
+    r.y = fminf(a.y, b.y);
+    r.w = fmaxf(a.x + a.w, b.x + b.w) - r.x;
+    r.h = fmaxf(a.y + a.h, b.y + b.h) - r.y;
+    return r;
+}
+
+static int coalesce_update_rects(MErect *rects, int num_rects) {
+    if (num_rects > R_UPLOAD_MAX_RECTS) {
+        for (int i = 1; i < num_rects; ++i) rects[0] = union_rect(rects[0], rects[i]);
+        return 1;
+    }
+
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < num_rects; ++i) {
+            for (int j = i + 1; j < num_rects; ++j) {
+                MErect u = union_rect(rects[i], rects[j]);
+                if (u.w * u.h <= rects[i].w * rects[i].h + rects[j].w * rects[j].h + R_UPLOAD_CALL_COST) {
+                    rects[i] = u;
+                    rects[j--] = rects[--num_rects];
+                    merged = true;
+                }
+            }
+        }
+    }
+    return num_rects;
+}
+
+void UpdateImageBytesRects(R_Renderer *renderer, R_Image *image, const MErect *image_rects, int num_rects, const unsigned char *bytes, int bytes_per_row) {
+    R_IMAGE_DATA *data;
+    GLenum original_format;
+    MErect *rects;
+    int count = 0;
+
+    if (image == NULL || image_rects == NULL || bytes == NULL || num_rects <= 0) return;
+
+    data = (R_IMAGE_DATA *)image->data;
+    original_format = data->format;
+
+    rects = (MErect *)ME_MALLOC(sizeof(MErect) * num_rects);
+    for (int i = 0; i < num_rects; ++i) {
+        MErect r = image_rects[i];
+        if (r.x < 0) {
+            r.w += r.x;
+            r.x = 0;
+        }
+        if (r.y < 0) {
+            r.h += r.y;
+            r.y = 0;
+        }
+        if (r.x + r.w > image->base_w) r.w += image->base_w - (r.x + r.w);
+        if (r.y + r.h > image->base_h) r.h += image->base_h - (r.y + r.h);
+        if (r.w <= 0 || r.h <= 0) continue;
+        rects[count++] = r;
+    }
+
+    count = coalesce_update_rects(rects, count);
+
+    if (count > 0) {
+        changeTexturing(renderer, 1);
+        if (image->target != NULL && isCurrentTarget(renderer, image->target)) FlushBlitBuffer(renderer);
+        bindTexture(renderer, image);
+
+        for (int i = 0; i < count; ++i) {
+            int offset = (int)rects[i].y * bytes_per_row + (int)rects[i].x * image->bytes_per_pixel;
+            if (stream_upload_texture(bytes + offset, rects[i], original_format, bytes_per_row, image->bytes_per_pixel)) continue;
+
+            int alignment = 8;
+            while ((bytes_per_row % alignment) || (offset % alignment)) alignment >>= 1;
+
+            upload_texture(bytes + offset, rects[i], original_format, alignment, bytes_per_row / image->bytes_per_pixel, bytes_per_row, image->bytes_per_pixel);
+        }
+    }
+
+    ME_FREE(rects);
+}
+
 bool ReplaceImage(R_Renderer *renderer, R_Image *image, void *surface, const MErect *surface_rect) {
     R_IMAGE_DATA *data;
     MErect sourceRect;
@@ -2642,12 +3015,18 @@ bool ReplaceImage(R_Renderer *renderer, R_Image *image, void *surface, const MEr
     if ((renderer->enabled_features & R_FEATURE_RENDER_TARGETS) && image->target != NULL) {
         R_TARGET_DATA *tdata = (R_TARGET_DATA *)image->target->data;
         if (renderer->current_context_target != NULL) flushAndClearBlitBufferIfCurrentFramebuffer(renderer, image->target);
-        if (tdata->handle != 0) glDeleteFramebuffersPROC(1, &tdata->handle);
+        if (tdata->handle != 0) {
+            glStateForgetFramebuffer(renderer, tdata->handle);
+            glDeleteFramebuffersPROC(1, &tdata->handle);
+        }
         tdata->handle = 0;
     }
 
     // Free the old texture
-    if (data->owns_handle) glDeleteTextures(1, &data->handle);
+    if (data->owns_handle) {
+        glStateForgetTexture(renderer, data->handle);
+        glDeleteTextures(1, &data->handle);
+    }
     data->handle = 0;
 
     // Get the area of the surface we'll use
@@ -2873,6 +3252,7 @@ void FreeImage(R_Renderer *renderer, R_Image *image) {
     } else {
         if (data->owns_handle && image->renderer == R_GetCurrentRenderer()) {
             R_MakeCurrent(image->context_target, image->context_target->context->windowID);
+            glStateForgetTexture(renderer, data->handle);
             glDeleteTextures(1, &data->handle);
         }
         ME_FREE(data);
@@ -2966,6 +3346,7 @@ void FreeTargetData(R_Renderer *renderer, R_TARGET_DATA *data) {
     // Time to actually free this target data
     if (renderer->enabled_features & R_FEATURE_RENDER_TARGETS) {
         // It might be possible to check against the default framebuffer (save that binding in the context data) and avoid deleting that...  Is that desired?
+        glStateForgetFramebuffer(renderer, data->handle);
         glDeleteFramebuffersPROC(1, &data->handle);
     }
 
@@ -4311,6 +4692,17 @@ void FlushBlitBuffer(R_Renderer *renderer) {
 void Flip(R_Renderer *renderer, R_Target *target) {
     FlushBlitBuffer(renderer);
 
+    stream_end_frame();
+
+    last_state_stats = state_stats;
+    ME_profiler_count("gl program changes", state_stats.programs);
+    ME_profiler_count("gl texture binds", state_stats.textures);
+    ME_profiler_count("gl framebuffer binds", state_stats.framebuffers);
+    ME_profiler_count("gl blend changes", state_stats.blend);
+    ME_profiler_count("gl viewport changes", state_stats.viewports);
+    ME_profiler_count("gl state skipped", state_stats.skipped);
+    state_stats = R_StateStats{};
+
     if (target != NULL && target->context != NULL) {
         makeContextCurrent(renderer, target);
 
@@ -4628,8 +5020,9 @@ void ActivateShaderProgram(R_Renderer *renderer, u32 program_object, R_ShaderBlo
             program_object = target->context->default_untextured_shader_program;
         }
 
+        // 同一个程序也要 flush 之前排队的顶点要用旧的 uniform 画
         FlushBlitBuffer(renderer);
-        glUseProgram(program_object);
+        glStateUseProgram(renderer, program_object);
 
         {
             // Set up our shader attribute and uniform locations
@@ -4723,10 +5116,9 @@ void SetShaderImage(R_Renderer *renderer, R_Image *image, int location, int imag
 
     // Set the new image unit
     glUniform1i(location, image_unit);
-    glActiveTexture(GL_TEXTURE0 + image_unit);
-    glBindTexture(GL_TEXTURE_2D, new_texture);
-
-    if (image_unit != 0) glActiveTexture(GL_TEXTURE0);
+    glStateBindTexture(renderer, (u32)image_unit, new_texture);
+    // 单元 0 上换了纹理 下次 bindTexture 不能跳过
+    if (image_unit == 0) ((R_CONTEXT_DATA *)renderer->current_context_target->context->data)->last_image = NULL;
 
     (void)renderer;
     (void)image;
@@ -5064,6 +5456,7 @@ void SetAttributeSource(R_Renderer *renderer, int num_values, R_Attribute source
     impl->CopyImage = &CopyImage;                             \
     impl->UpdateImage = &UpdateImage;                         \
     impl->UpdateImageBytes = &UpdateImageBytes;               \
+    impl->UpdateImageBytesRects = &UpdateImageBytesRects;     \
     impl->ReplaceImage = &ReplaceImage;                       \
     impl->CopyImageFromSurface = &CopyImageFromSurface;       \
     impl->CopyImageFromTarget = &CopyImageFromTarget;         \
@@ -93,6 +93,24 @@ void main(void)\n\
 
 namespace ME {
 
+#define R_GL_STATE_TEXTURE_UNITS 8
+
+// 已经发给驱动的 GL 状态 用来跳过重复的调用
+// last_* 记录的是 R_ 层请求的状态 这里只跟踪真正的 gl 调用 known 为 0 的状态下次一定会重发
+// 外部代码直接修改了 GL 状态之后要调用 R_ResetRendererState
+typedef struct R_GLState {
+    u32 known;          // R_GL_STATE_* 位
+    u32 texture_known;  // 第 i 位为纹理单元 i
+    u32 program;
+    u32 framebuffer;
+    u32 active_unit;
+    u32 textures[R_GL_STATE_TEXTURE_UNITS];
+    bool blend;
+    u32 blend_func[4];
+    u32 blend_equation[2];
+    int viewport[4];
+} R_GLState;
+
 typedef struct ContextData_OpenGL_3 {
     MEcolor last_color;
     bool last_use_texturing;
@@ -123,6 +141,8 @@ typedef struct ContextData_OpenGL_3 {
 
     R_AttributeSource shader_attributes[16];
     unsigned int attribute_VBO[16];
+
+    R_GLState gl_state;
 } ContextData_OpenGL_3;
 
 typedef struct ImageData_OpenGL_3 {
@@ -216,6 +236,9 @@ SDL_Surface *copySurfaceIfNeeded(R_Renderer *renderer, GLenum glFormat, SDL_Surf
 R_Image *CopyImage(R_Renderer *renderer, R_Image *image);
 void UpdateImage(R_Renderer *renderer, R_Image *image, const MErect *image_rect, void *surface, const MErect *surface_rect);
 void UpdateImageBytes(R_Renderer *renderer, R_Image *image, const MErect *image_rect, const unsigned char *bytes, int bytes_per_row);
+void UpdateImageBytesRects(R_Renderer *renderer, R_Image *image, const MErect *image_rects, int num_rects, const unsigned char *bytes, int bytes_per_row);
+void SetStreamingUploads(R_Renderer *renderer, bool enable);
+R_StateStats GetStateStats(R_Renderer *renderer);
 bool ReplaceImage(R_Renderer *renderer, R_Image *image, void *surface, const MErect *surface_rect);
 R_Image *CopyImageFromSurface(R_Renderer *renderer, void *surface, const MErect *surface_rect);
 R_Image *CopyImageFromTarget(R_Renderer *renderer, R_Target *target);
@@ -2,9 +2,180 @@
 
 #include "sdl_surface_utils.h"
 
+#include <algorithm>
 #include <cmath>
 
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ME_SURFACE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ME_SURFACE_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace ME::SurfaceBase {
+
+namespace {
+
+struct SurfaceLock {
+    SDL_Surface *surface;
+    explicit SurfaceLock(SDL_Surface *s) : surface(s != NULL && SDL_MUSTLOCK(s) && SDL_LockSurface(s) == 0 ? s : NULL) {}
+    ~SurfaceLock() {
+        if (surface != NULL) SDL_UnlockSurface(surface);
+    }
+};
+
+Uint32 *row_of(SDL_Surface *surface, int y) { return (Uint32 *)((Uint8 *)surface->pixels + (size_t)y * surface->pitch); }
+
+// 每个通道 8 位的 32 位格式 通道可以直接按移位读写
+bool packed32(const SDL_PixelFormat *f) { return f->BytesPerPixel == 4 && f->Rloss == 0 && f->Gloss == 0 && f->Bloss == 0; }
+
+Uint32 rgb_mask(const SDL_PixelFormat *f) { return f->Rmask | f->Gmask | f->Bmask; }
+
+// 下面的 SSE2/NEON 是编译目标的基线 只在 cpu::set_max_level(scalar) 时走标量 用来对照
+bool vector_rows() { return cpu::level() != simd_level::scalar; }
+
+// (r + g + b) / 3 对 0..765 与 sum * 21846 >> 16 完全相同
+void grayscale_row(const Uint32 *src, Uint32 *dst, int n, const SDL_PixelFormat *f) {
+    int i = 0;
+    const bool simd = vector_rows();
+#if ME_SURFACE_SSE2
+    const __m128i rs = _mm_cvtsi32_si128(f->Rshift), gs = _mm_cvtsi32_si128(f->Gshift), bs = _mm_cvtsi32_si128(f->Bshift);
+    const __m128i ff = _mm_set1_epi32(0xff), third = _mm_set1_epi32(21846), am = _mm_set1_epi32((int)f->Amask);
+    for (; simd && i + 4 <= n; i += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(_mm_srl_epi32(p, rs), ff), _mm_and_si128(_mm_srl_epi32(p, gs), ff)), _mm_and_si128(_mm_srl_epi32(p, bs), ff));
+        const __m128i gray = _mm_mulhi_epu16(sum, third);
+        const __m128i out = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(gray, rs), _mm_sll_epi32(gray, gs)), _mm_or_si128(_mm_sll_epi32(gray, bs), _mm_and_si128(p, am)));
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+#elif ME_SURFACE_NEON
+    const int32x4_t rl = vdupq_n_s32(f->Rshift), gl = vdupq_n_s32(f->Gshift), bl = vdupq_n_s32(f->Bshift);
+    const int32x4_t rr = vnegq_s32(rl), gr = vnegq_s32(gl), br = vnegq_s32(bl);
+    const uint32x4_t ff = vdupq_n_u32(0xff), third = vdupq_n_u32(21846), am = vdupq_n_u32(f->Amask);
+    for (; simd && i + 4 <= n; i += 4) {
+        const uint32x4_t p = vld1q_u32(src + i);
+        const uint32x4_t sum = vaddq_u32(vaddq_u32(vandq_u32(vshlq_u32(p, rr), ff), vandq_u32(vshlq_u32(p, gr), ff)), vandq_u32(vshlq_u32(p, br), ff));
+        const uint32x4_t gray = vshrq_n_u32(vmulq_u32(sum, third), 16);
+        vst1q_u32(dst + i, vorrq_u32(vorrq_u32(vshlq_u32(gray, rl), vshlq_u32(gray, gl)), vorrq_u32(vshlq_u32(gray, bl), vandq_u32(p, am))));
+    }
+#endif
+    (void)simd;
+    for (; i < n; i++) {
+        const Uint32 p = src[i];
+        const Uint32 gray = (((p >> f->Rshift) & 0xff) + ((p >> f->Gshift) & 0xff) + ((p >> f->Bshift) & 0xff)) / 3;
+        dst[i] = (gray << f->Rshift) | (gray << f->Gshift) | (gray << f->Bshift) | (p & f->Amask);
+    }
+}
+
+void xor_row(const Uint32 *src, Uint32 *dst, int n, Uint32 mask) {
+    int i = 0;
+    const bool simd = vector_rows();
+#if ME_SURFACE_SSE2
+    const __m128i m = _mm_set1_epi32((int)mask);
+    for (; simd && i + 4 <= n; i += 4) _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), m));
+#elif ME_SURFACE_NEON
+    const uint32x4_t m = vdupq_n_u32(mask);
+    for (; simd && i + 4 <= n; i += 4) vst1q_u32(dst + i, veorq_u32(vld1q_u32(src + i), m));
+#endif
+    (void)simd;
+    for (; i < n; i++) dst[i] = src[i] ^ mask;
+}
+
+// 与 merge_channel 相同的浮点运算 结果逐位一致 amount 在 [0, 1] 内
+void recolor_row(const Uint32 *src, Uint32 *dst, int n, const SDL_PixelFormat *f, Uint8 r, Uint8 g, Uint8 b, float amount) {
+    int i = 0;
+    const bool simd = vector_rows();
+#if ME_SURFACE_SSE2
+    const __m128i rs = _mm_cvtsi32_si128(f->Rshift), gs = _mm_cvtsi32_si128(f->Gshift), bs = _mm_cvtsi32_si128(f->Bshift);
+    const __m128i ff = _mm_set1_epi32(0xff), am = _mm_set1_epi32((int)f->Amask);
+    const __m128 inv = _mm_set1_ps(1.0f - amount);
+    const __m128 kr = _mm_set1_ps(r * amount), kg = _mm_set1_ps(g * amount), kb = _mm_set1_ps(b * amount);
+    auto channel = [&](__m128i p, __m128i s, __m128 k) {
+        const __m128 v = _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(p, s), ff));
+        return _mm_sll_epi32(_mm_cvttps_epi32(_mm_add_ps(k, _mm_mul_ps(v, inv))), s);
+    };
+    for (; simd && i + 4 <= n; i += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i out = _mm_or_si128(_mm_or_si128(channel(p, rs, kr), channel(p, gs, kg)), _mm_or_si128(channel(p, bs, kb), _mm_and_si128(p, am)));
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+#elif ME_SURFACE_NEON
+    const uint32x4_t ff = vdupq_n_u32(0xff), am = vdupq_n_u32(f->Amask);
+    const float32x4_t inv = vdupq_n_f32(1.0f - amount);
+    const float32x4_t kr = vdupq_n_f32(r * amount), kg = vdupq_n_f32(g * amount), kb = vdupq_n_f32(b * amount);
+    auto channel = [&](uint32x4_t p, int shift, float32x4_t k) {
+        const float32x4_t v = vcvtq_f32_u32(vandq_u32(vshlq_u32(p, vdupq_n_s32(-shift)), ff));
+        return vshlq_u32(vcvtq_u32_f32(vaddq_f32(k, vmulq_f32(v, inv))), vdupq_n_s32(shift));
+    };
+    for (; simd && i + 4 <= n; i += 4) {
+        const uint32x4_t p = vld1q_u32(src + i);
+        vst1q_u32(dst + i, vorrq_u32(vorrq_u32(channel(p, f->Rshift, kr), channel(p, f->Gshift, kg)), vorrq_u32(channel(p, f->Bshift, kb), vandq_u32(p, am))));
+    }
+#endif
+    (void)simd;
+    for (; i < n; i++) {
+        const Uint32 p = src[i];
+        const Uint32 rr = merge_channel((p >> f->Rshift) & 0xff, r, amount);
+        const Uint32 gg = merge_channel((p >> f->Gshift) & 0xff, g, amount);
+        const Uint32 bb = merge_channel((p >> f->Bshift) & 0xff, b, amount);
+        dst[i] = (rr << f->Rshift) | (gg << f->Gshift) | (bb << f->Bshift) | (p & f->Amask);
+    }
+}
+
+// (p & mask) == key 的像素换成 value
+void replace_row(Uint32 *px, int n, Uint32 mask, Uint32 key, Uint32 value) {
+    int i = 0;
+    const bool simd = vector_rows();
+#if ME_SURFACE_SSE2
+    const __m128i m = _mm_set1_epi32((int)mask), k = _mm_set1_epi32((int)key), v = _mm_set1_epi32((int)value);
+    for (; simd && i + 4 <= n; i += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i *)(px + i));
+        const __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(p, m), k);
+        _mm_storeu_si128((__m128i *)(px + i), _mm_or_si128(_mm_and_si128(eq, v), _mm_andnot_si128(eq, p)));
+    }
+#elif ME_SURFACE_NEON
+    const uint32x4_t m = vdupq_n_u32(mask), k = vdupq_n_u32(key), v = vdupq_n_u32(value);
+    for (; simd && i + 4 <= n; i += 4) {
+        const uint32x4_t p = vld1q_u32(px + i);
+        vst1q_u32(px + i, vbslq_u32(vceqq_u32(vandq_u32(p, m), k), v, p));
+    }
+#endif
+    (void)simd;
+    for (; i < n; i++) {
+        if ((px[i] & mask) == key) px[i] = value;
+    }
+}
+
+// 逐行把 surface 的像素交给 row(src, dst, n, format) 写到同样格式的新表面
+// 不是 packed32 的格式先转换成 RGBA8888
+template <class Row>
+SDL_Surface *map_rows(SDL_Surface *surface, Row row) {
+    if (surface == NULL) {
+        return NULL;
+    }
+    SDL_Surface *src = packed32(surface->format) ? surface : SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
+    if (src == NULL) {
+        return NULL;
+    }
+    const SDL_PixelFormat *f = src->format;
+    SDL_Surface *dst = SDL_CreateRGBSurface(0, src->w, src->h, 32, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+    if (dst != NULL) {
+        SurfaceLock lock(src);
+        for (int y = 0; y < src->h; y++) {
+            row(row_of(src, y), row_of(dst, y), src->w, f);
+        }
+    }
+    if (src != surface) {
+        SDL_FreeSurface(src);
+    }
+    return dst;
+}
+
+}  // namespace
+
 Uint32 get_pixel32(SDL_Surface *surface, int x, int y) {
     if (surface != NULL) {
         if (x >= 0 && x < surface->w && y >= 0 && y < surface->h) {
@@ -25,11 +196,8 @@ void put_pixel32(SDL_Surface *surface, int x, int y, Uint32 pixel) {
     if (surface == NULL) {
         return;
     }
-    if (x < surface->w && y < surface->h) {
-
-        Uint32 *pixels = (Uint32 *)surface->pixels;
-
-        pixels[(y * surface->w) + x] = pixel;
+    if (x >= 0 && x < surface->w && y >= 0 && y < surface->h) {
+        row_of(surface, y)[x] = pixel;
     }
 }
 
@@ -66,77 +234,37 @@ SDL_Surface *R_Create_filled_surface_rgba(int w, int h, Uint8 color_key_r, Uint8
     if (newSurface == NULL) {
         return NULL;
     }
-    int x = 0, y = 0;
-    bool surface_is_locked = SDL_MUSTLOCK(newSurface);
-    if (surface_is_locked) {
-        SDL_LockSurface(newSurface);
-    }
-
-    Uint8 rr = 0, bb = 0, gg = 0, aa = 0;
-    Uint32 pixel;
-    for (x = 0; x < newSurface->w; x++) {
-
-        for (y = 0; y < newSurface->h; y++) {
-
-            pixel = SDL_MapRGBA(newSurface->format, color_key_r, color_key_g, color_key_b, alpha);
-            put_pixel32(newSurface, x, y, pixel);
-        }
-    }
-
-    if (surface_is_locked) {
-        SDL_UnlockSurface(newSurface);
+    SurfaceLock lock(newSurface);
+    const Uint32 pixel = SDL_MapRGBA(newSurface->format, color_key_r, color_key_g, color_key_b, alpha);
+    for (int y = 0; y < newSurface->h; y++) {
+        std::fill_n(row_of(newSurface, y), newSurface->w, pixel);
     }
     return newSurface;
 }
 
-void R_Surface_merge_color_rgba(SDL_Surface *surface, int y, int x1, int x2, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    if (surface == NULL) {
-        return;
-    }
-    if (surface->w <= x1 && surface->h <= y) {
-        return;
-    }
-    int temp = std::min(x1, x2);
-    x2 = std::max(x1, x2);
-    x1 = temp;
-    Uint32 pixel;
-    for (int i = x1; i < x2; i++) {
-        pixel = SDL_MapRGBA(surface->format, r, g, b, a);
-        put_pixel32(surface, i, y, pixel);
-    }
-}
-
 void R_Surface_horizontal_line_color_rgba(SDL_Surface *surface, int y, int x1, int x2, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    if (surface == NULL) {
-        return;
-    }
-    if (surface->w <= x1 && surface->h <= y) {
+    if (surface == NULL || y < 0 || y >= surface->h) {
         return;
     }
     int temp = std::min(x1, x2);
-    x2 = std::max(x1, x2);
-    x1 = temp;
-    Uint32 pixel;
-    for (int i = x1; i < x2; i++) {
-        pixel = SDL_MapRGBA(surface->format, r, g, b, a);
-        put_pixel32(surface, i, y, pixel);
+    x2 = std::min(std::max(x1, x2), surface->w);
+    x1 = std::max(temp, 0);
+    if (x1 >= x2) {
+        return;
     }
+    std::fill(row_of(surface, y) + x1, row_of(surface, y) + x2, SDL_MapRGBA(surface->format, r, g, b, a));
 }
 
 void R_Surface_vertical_line_color_rgba(SDL_Surface *surface, int x, int y1, int y2, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    if (surface == NULL) {
-        return;
-    }
-    if (surface->h <= y1 && surface->w <= x) {
+    if (surface == NULL || x < 0 || x >= surface->w) {
         return;
     }
     int temp = std::min(y1, y2);
-    y2 = std::max(y1, y2);
-    y1 = temp;
-    Uint32 pixel;
+    y2 = std::min(std::max(y1, y2), surface->h);
+    y1 = std::max(temp, 0);
+    const Uint32 pixel = SDL_MapRGBA(surface->format, r, g, b, a);
     for (int i = y1; i < y2; i++) {
-        pixel = SDL_MapRGBA(surface->format, r, g, b, a);
-        put_pixel32(surface, x, i, pixel);
+        row_of(surface, i)[x] = pixel;
     }
 }
 
@@ -204,186 +332,70 @@ bool R_Surface_circle_color_rgba(SDL_Surface *surface, Sint16 x, Sint16 y, Sint1
 }
 
 SDL_Surface *R_Surface_grayscale(SDL_Surface *surface) {
-    if (surface == NULL) {
-        return NULL;
-    }
-
-    SDL_Surface *coloredSurface = NULL;
-
-    coloredSurface = SDL_CreateRGBSurface(0, surface->w, surface->h, surface->format->BitsPerPixel, surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
-    if (coloredSurface != NULL) {
-        bool surface_is_locked = SDL_MUSTLOCK(surface);
-        if (surface_is_locked) {
-            SDL_LockSurface(surface);
-        }
-        Uint8 rr = 0, bb = 0, gg = 0, aa = 0;
-        for (int x = 0; x < coloredSurface->w; x++) {
-            for (int y = 0; y < coloredSurface->h; y++) {
-                Uint32 pixel = get_pixel32(surface, x, y);
-                SDL_GetRGBA(pixel, surface->format, &rr, &gg, &bb, &aa);
-                Uint8 grayedColor = (rr + gg + bb) / 3;
-                pixel = SDL_MapRGBA(surface->format, grayedColor, grayedColor, grayedColor, aa);
-                put_pixel32(coloredSurface, x, y, pixel);
-            }
-        }
-        if (surface_is_locked) {
-            SDL_UnlockSurface(surface);
-        }
-        return coloredSurface;
-    }
-    return NULL;
+    return map_rows(surface, [](const Uint32 *src, Uint32 *dst, int n, const SDL_PixelFormat *f) { grayscale_row(src, dst, n, f); });
 }
 
 SDL_Surface *R_Surface_invert(SDL_Surface *surface) {
-    if (surface != NULL) {
-        SDL_Surface *tempSurface = NULL;
-        SDL_Surface *coloredSurface = NULL;
-
-        coloredSurface = SDL_CreateRGBSurface(0, surface->w, surface->h, surface->format->BitsPerPixel, surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
-        if (coloredSurface != NULL) {
-            bool surface_is_locked = SDL_MUSTLOCK(surface);
-            if (surface_is_locked) {
-                SDL_LockSurface(surface);
-            }
-            Uint8 rr = 0, bb = 0, gg = 0, aa = 0;
-            for (int x = 0; x < coloredSurface->w; x++) {
-                for (int y = 0; y < coloredSurface->h; y++) {
-                    Uint32 pixel = get_pixel32(surface, x, y);
-                    SDL_GetRGBA(pixel, surface->format, &rr, &gg, &bb, &aa);
-                    pixel = SDL_MapRGBA(surface->format, 255 - rr, 255 - gg, 255 - bb, aa);
-                    put_pixel32(coloredSurface, x, y, pixel);
-                }
-            }
-            if (surface_is_locked) {
-                SDL_UnlockSurface(surface);
-            }
-            return coloredSurface;
-        } else if (tempSurface != NULL) {
-            SDL_FreeSurface(tempSurface);
-            tempSurface = NULL;
-        }
+    return map_rows(surface, [](const Uint32 *src, Uint32 *dst, int n, const SDL_PixelFormat *f) { xor_row(src, dst, n, rgb_mask(f)); });
+}
+
+SDL_Surface *R_Surface_merge_color_rgba(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b, float amount) {
+    if (surface == NULL || !packed32(surface->format)) {
+        return NULL;
     }
-    return NULL;
+    amount = std::clamp(amount, 0.0f, 1.0f);
+    SurfaceLock lock(surface);
+    for (int y = 0; y < surface->h; y++) {
+        Uint32 *row = row_of(surface, y);
+        recolor_row(row, row, surface->w, surface->format, color_key_r, color_key_g, color_key_b, amount);
+    }
+    return surface;
 }
 
 SDL_Surface *R_Surface_recolor(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b, float amount) {
-    if (surface != NULL) {
-
-        SDL_Surface *tempSurface = NULL;
-        SDL_Surface *coloredSurface = NULL;
-
-        coloredSurface = SDL_CreateRGBSurface(0, surface->w, surface->h, surface->format->BitsPerPixel, surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
-        if (coloredSurface != NULL) {
-
-            bool surface_is_locked = SDL_MUSTLOCK(surface);
-            if (surface_is_locked) {
-                SDL_LockSurface(surface);
-            }
-
-            Uint8 rr = 0, bb = 0, gg = 0, aa = 0;
-
-            for (int x = 0; x < coloredSurface->w; x++) {
-
-                for (int y = 0; y < coloredSurface->h; y++) {
-
-                    Uint32 pixel = get_pixel32(surface, x, y);
-                    SDL_GetRGBA(pixel, surface->format, &rr, &gg, &bb, &aa);
-
-                    rr = merge_channel(rr, color_key_r, amount);
-                    gg = merge_channel(gg, color_key_g, amount);
-                    bb = merge_channel(bb, color_key_b, amount);
-                    pixel = SDL_MapRGBA(surface->format, rr, gg, bb, aa);
-                    put_pixel32(coloredSurface, x, y, pixel);
-                }
-            }
-
-            if (surface_is_locked) {
-                SDL_UnlockSurface(surface);
-            }
-
-            return coloredSurface;
-        }
-    }
-    return NULL;
+    amount = std::clamp(amount, 0.0f, 1.0f);
+    return map_rows(surface, [&](const Uint32 *src, Uint32 *dst, int n, const SDL_PixelFormat *f) { recolor_row(src, dst, n, f, color_key_r, color_key_g, color_key_b, amount); });
 }
 
 SDL_Surface *R_Surface_remove_color_rgba(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b) {
-    if (surface != NULL) {
-
-        SDL_Surface *coloredSurface = NULL;
-
-        coloredSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
-        if (coloredSurface != NULL) {
-
-            bool surface_is_locked = SDL_MUSTLOCK(coloredSurface);
-            if (surface_is_locked) {
-                SDL_LockSurface(coloredSurface);
-            }
-
-            Uint8 rr = 0, bb = 0, gg = 0, aa = 0;
-            int y = 0;
-            Uint32 pixel;
-
-            for (int x = 0; x < coloredSurface->w; x++) {
-
-                for (y = 0; y < coloredSurface->h; y++) {
-
-                    pixel = get_pixel32(coloredSurface, x, y);
-                    SDL_GetRGBA(pixel, coloredSurface->format, &rr, &gg, &bb, &aa);
-
-                    if (rr == color_key_r && gg == color_key_g && bb == color_key_b) {
-                        pixel = SDL_MapRGBA(coloredSurface->format, 255, 0, 255, 0);
-                    }
-                    put_pixel32(coloredSurface, x, y, pixel);
-                }
-            }
-
-            if (surface_is_locked) {
-                SDL_UnlockSurface(coloredSurface);
-            }
-            return coloredSurface;
-        }
+    if (surface == NULL) {
+        return NULL;
+    }
+    SDL_Surface *coloredSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
+    if (coloredSurface == NULL) {
+        return NULL;
     }
-    return NULL;
+    SurfaceLock lock(coloredSurface);
+    const SDL_PixelFormat *f = coloredSurface->format;
+    const Uint32 mask = rgb_mask(f);
+    const Uint32 key = SDL_MapRGBA(f, color_key_r, color_key_g, color_key_b, 0) & mask;
+    const Uint32 value = SDL_MapRGBA(f, 255, 0, 255, 0);
+    for (int y = 0; y < coloredSurface->h; y++) {
+        replace_row(row_of(coloredSurface, y), coloredSurface->w, mask, key, value);
+    }
+    return coloredSurface;
 }
 
 SDL_Surface *R_Surface_flip(SDL_Surface *surface, int flags) {
-    if (surface != NULL) {
-
-        SDL_Surface *flipped = NULL;
-
-        flipped = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
-        if (flipped != NULL) {
-
-            bool surface_is_locked = SDL_MUSTLOCK(flipped);
-            if (surface_is_locked) {
-                SDL_LockSurface(flipped);
-            }
-
-            for (int x = 0, rx = flipped->w - 1; x < flipped->w; x++, rx--) {
-
-                for (int y = 0, ry = flipped->h - 1; y < flipped->h; y++, ry--) {
-
-                    Uint32 pixel = get_pixel32(surface, x, y);
-
-                    if ((flags & SDL_FLIP_VERTICAL) && (flags & SDL_FLIP_HORIZONTAL)) {
-                        put_pixel32(flipped, rx, ry, pixel);
-                    } else if (flags & SDL_FLIP_HORIZONTAL) {
-                        put_pixel32(flipped, rx, y, pixel);
-                    } else if (flags & SDL_FLIP_VERTICAL) {
-                        put_pixel32(flipped, x, ry, pixel);
-                    }
-                }
-            }
-
-            if (surface_is_locked) {
-                SDL_UnlockSurface(flipped);
-            }
-
-            return flipped;
+    if (surface == NULL) {
+        return NULL;
+    }
+    SDL_Surface *flipped = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
+    if (flipped == NULL) {
+        return NULL;
+    }
+    SurfaceLock lock(flipped);
+    if (flags & SDL_FLIP_HORIZONTAL) {
+        for (int y = 0; y < flipped->h; y++) {
+            std::reverse(row_of(flipped, y), row_of(flipped, y) + flipped->w);
+        }
+    }
+    if (flags & SDL_FLIP_VERTICAL) {
+        for (int y = 0, ry = flipped->h - 1; y < ry; y++, ry--) {
+            std::swap_ranges(row_of(flipped, y), row_of(flipped, y) + flipped->w, row_of(flipped, ry));
         }
     }
-    return NULL;
+    return flipped;
 }
 }  // namespace ME::SurfaceBase
 
@@ -19,8 +19,11 @@ void R_Surface_horizontal_line_color_rgba(SDL_Surface *surface, int y, int x1, i
 void R_Surface_vertical_line_color_rgba(SDL_Surface *surface, int x, int y1, int y2, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255);
 bool R_Surface_circle_color_rgba(SDL_Surface *surface, Sint16 x, Sint16 y, Sint16 rad, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255);
 
+// 下面的函数逐行处理 每个通道 8 位的 32 位格式走 SIMD 其它格式先转换成 RGBA8888
+// 除 merge_color 外都返回新的表面 由调用者释放
 SDL_Surface *R_Surface_grayscale(SDL_Surface *surface);
 SDL_Surface *R_Surface_invert(SDL_Surface *surface);
+// 原地与颜色混合 返回 surface 不是每个通道 8 位的 32 位格式时返回 NULL 不做修改
 SDL_Surface *R_Surface_merge_color_rgba(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b, float amount);
 SDL_Surface *R_Surface_recolor(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b, float amount);
 SDL_Surface *R_Surface_remove_color_rgba(SDL_Surface *surface, Uint8 color_key_r, Uint8 color_key_g, Uint8 color_key_b);
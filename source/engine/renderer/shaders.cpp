@@ -2,6 +2,10 @@
 
 #include "shaders.hpp"
 
+#include <cstdio>
+#include <filesystem>
+#include <format>
+
 #include "engine/core/core.hpp"
 #include "engine/utils/name.hpp"
 #include "engine/utils/utility.hpp"
@@ -29,20 +33,151 @@ u32 ME_Shaders_LoadShader(R_ShaderEnum thisype, const char* filename) {
     return shader;
 }
 
-R_ShaderBlock ME_Shaders_LoadShaderProgram(u32* p, const char* vertex_shader_file, const char* fragment_shader_file) {
-    u32 v, f;
-    v = ME_Shaders_LoadShader(R_VERTEX_SHADER, vertex_shader_file);
+namespace {
+
+// 链接好的程序二进制缓存 放在 shadercache 目录
+// 文件名是两份源码和驱动字符串的哈希 改了着色器或者换了显卡驱动就是另一个文件 不用手动清理
+// 驱动拒绝旧的二进制时 (同一驱动的小版本更新) 退回编译 再覆盖写入
+constexpr u32 SHADER_CACHE_MAGIC = 0x4253454d;  // "MESB"
+constexpr u32 SHADER_CACHE_VERSION = 1;
+
+struct shader_cache_header {
+    u32 magic;
+    u32 version;
+    u32 format;
+    u32 length;
+};
+
+u32 g_shader_cache_hits = 0;
+u32 g_shader_cache_misses = 0;
+
+bool shader_cache_supported() {
+    if (!GLAD_GL_VERSION_4_1) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
 
-    if (!v) METADOT_ERROR("Failed to load vertex shader (%s): %s", vertex_shader_file, R_GetShaderMessage());
+std::string shader_cache_path(const char* vertex_source, const char* fragment_source) {
+    std::string key = vertex_source;
+    key += '\0';
+    key += fragment_source;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* str = (const char*)glGetString(name);
+        key += '\0';
+        if (str) key += str;
+    }
+    const u64 hash = metadot_fnv1a(key.data(), (int)key.size());
+    return std::format("{0}/{1:016x}.bin", ME_fs_get_path("shadercache"), hash);
+}
 
-    f = ME_Shaders_LoadShader(R_FRAGMENT_SHADER, fragment_shader_file);
+u32 shader_cache_load(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return 0;
 
+    shader_cache_header header;
+    std::vector<u8> binary;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == SHADER_CACHE_MAGIC && header.version == SHADER_CACHE_VERSION && header.length > 0;
+    if (ok) {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!ok) return 0;
+
+    u32 p = R_CreateShaderProgram();
+    if (!p) return 0;
+    glProgramBinary(p, header.format, binary.data(), (GLsizei)binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(p, GL_LINK_STATUS, &linked);
+    if (linked) return p;
+
+    R_FreeShaderProgram(p);
+    return 0;
+}
+
+void shader_cache_store(const std::string& path, u32 p) {
+    GLint length = 0;
+    glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<u8> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(p, length, &length, &format, binary.data());
+    if (length <= 0) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return;
+    const shader_cache_header header = {SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, format, (u32)length};
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, length, file) == (size_t)length;
+    fclose(file);
+    // 写了一半的文件下次读的时候长度对不上 也会退回编译 这里直接删掉
+    if (!ok) std::filesystem::remove(path, ec);
+}
+
+// 编译两个着色器并链接 链接前要求驱动保留二进制
+u32 shader_compile_program(const char* vertex_shader_file, const char* vertex_source, const char* fragment_shader_file, const char* fragment_source, bool retrievable) {
+    u32 v = R_CompileShader(R_VERTEX_SHADER, vertex_source);
+    if (!v) METADOT_ERROR("Failed to load vertex shader (%s): %s", vertex_shader_file, R_GetShaderMessage());
+
+    u32 f = R_CompileShader(R_FRAGMENT_SHADER, fragment_source);
     if (!f) METADOT_ERROR("Failed to load fragment shader (%s): %s", fragment_shader_file, R_GetShaderMessage());
 
-    *p = R_LinkShaders(v, f);
+    u32 p = R_CreateShaderProgram();
+    if (p) {
+        if (v) R_AttachShader(p, v);
+        if (f) R_AttachShader(p, f);
+        if (retrievable) glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        if (!R_LinkShaderProgram(p)) {
+            R_FreeShaderProgram(p);
+            p = 0;
+        }
+    }
+    // 链接之后程序不再需要着色器对象
+    if (v) R_FreeShader(v);
+    if (f) R_FreeShader(f);
+    return p;
+}
+
+}  // namespace
+
+R_ShaderBlock ME_Shaders_LoadShaderProgram(u32* p, const char* vertex_shader_file, const char* fragment_shader_file) {
+    R_ShaderBlock b = {-1, -1, -1, -1};
+    *p = 0;
+
+    char* vertex_source = ME_fs_readfilestring(vertex_shader_file);
+    char* fragment_source = ME_fs_readfilestring(fragment_shader_file);
+    if (!vertex_source || !fragment_source) {
+        if (!vertex_source) METADOT_ERROR("Failed to load vertex shader (%s): file not found", vertex_shader_file);
+        if (!fragment_source) METADOT_ERROR("Failed to load fragment shader (%s): file not found", fragment_shader_file);
+        ME_fs_freestring(vertex_source);
+        ME_fs_freestring(fragment_source);
+        return b;
+    }
+
+    const bool cached = shader_cache_supported();
+    std::string cache_path;
+    if (cached) {
+        cache_path = shader_cache_path(vertex_source, fragment_source);
+        *p = shader_cache_load(cache_path);
+    }
+
+    if (*p) {
+        g_shader_cache_hits++;
+    } else {
+        *p = shader_compile_program(vertex_shader_file, vertex_source, fragment_shader_file, fragment_source, cached);
+        if (*p && cached) {
+            g_shader_cache_misses++;
+            shader_cache_store(cache_path, *p);
+        }
+    }
+
+    ME_fs_freestring(vertex_source);
+    ME_fs_freestring(fragment_source);
 
     if (!*p) {
-        R_ShaderBlock b = {-1, -1, -1, -1};
         METADOT_ERROR("Failed to link shader program (%s + %s): %s", vertex_shader_file, fragment_shader_file, R_GetShaderMessage());
         return b;
     }
@@ -55,6 +190,11 @@ R_ShaderBlock ME_Shaders_LoadShaderProgram(u32* p, const char* vertex_shader_fil
     }
 }
 
+void ME_Shaders_CacheStats(u32* hits, u32* misses) {
+    *hits = g_shader_cache_hits;
+    *misses = g_shader_cache_misses;
+}
+
 void ME_Shaders_FreeShader(u32 p) { R_FreeShaderProgram(p); }
 
 u32 shader_base::init() {
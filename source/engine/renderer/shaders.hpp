@@ -21,6 +21,8 @@ namespace ME {
 u32 ME_Shaders_LoadShader(R_ShaderEnum shader_type, const char* filename);
 R_ShaderBlock ME_Shaders_LoadShaderProgram(u32* p, const char* vertex_shader_file, const char* fragment_shader_file);
 void ME_Shaders_FreeShader(u32 p);
+// 程序二进制缓存命中和未命中 (重新编译并写入) 的次数 驱动不支持时都是 0
+void ME_Shaders_CacheStats(u32* hits, u32* misses);
 
 class shader_base {
 public:
@@ -0,0 +1,334 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "sprite_atlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "engine/core/const.h"
+
+namespace ME {
+
+int SpriteAtlas::new_slot() {
+    if (!freeSlots.empty()) {
+        int s = freeSlots.back();
+        freeSlots.pop_back();
+        return s;
+    }
+    slots.emplace_back();
+    return (int)slots.size() - 1;
+}
+
+bool SpriteAtlas::pack(Page &page, int w, int h, int &x, int &y, int &capW, int &capH) {
+    // 先找释放过的位置 取面积最小的能放下的
+    int best = -1;
+    for (size_t i = 0; i < page.freed.size(); i++) {
+        const Slot &s = slots[page.freed[i]];
+        if (s.capW < w || s.capH < h) continue;
+        if (best < 0 || s.capW * s.capH < slots[page.freed[best]].capW * slots[page.freed[best]].capH) best = (int)i;
+    }
+    if (best >= 0) {
+        const Slot &s = slots[page.freed[best]];
+        x = s.x;
+        y = s.y;
+        capW = s.capW;
+        capH = s.capH;
+        freeSlots.push_back(page.freed[best]);
+        page.freed.erase(page.freed.begin() + best);
+        return true;
+    }
+
+    const int pw = w + PADDING * 2;
+    const int ph = h + PADDING * 2;
+    for (Shelf &shelf : page.shelves) {
+        // 行高相差太多会浪费空间
+        if (ph > shelf.h || ph * 2 < shelf.h || shelf.x + pw > PAGE_SIZE) continue;
+        x = shelf.x + PADDING;
+        y = shelf.y + PADDING;
+        capW = w;
+        capH = shelf.h - PADDING * 2;
+        shelf.x += pw;
+        return true;
+    }
+
+    if (page.top + ph > PAGE_SIZE) return false;
+    page.shelves.push_back({page.top, ph, pw});
+    x = PADDING;
+    y = page.top + PADDING;
+    capW = w;
+    capH = h;
+    page.top += ph;
+    return true;
+}
+
+SpriteAtlas::Handle SpriteAtlas::alloc(int w, int h) {
+    if (!fits(w, h)) return {};
+
+    int x = 0, y = 0, capW = 0, capH = 0;
+    int p = 0;
+    for (; p < (int)pages.size(); p++) {
+        if (pack(pages[p], w, h, x, y, capW, capH)) break;
+    }
+    if (p == (int)pages.size()) {
+        Page page;
+        page.image = R_CreateImage(PAGE_SIZE, PAGE_SIZE, R_FormatEnum::R_FORMAT_RGBA);
+        if (!page.image) return {};
+        R_SetImageFilter(page.image, R_FILTER_NEAREST);
+        R_SetBlendMode(page.image, R_BLEND_NORMAL);
+        pages.push_back(std::move(page));
+        pack(pages[p], w, h, x, y, capW, capH);
+    }
+
+    int si = new_slot();
+    Slot &s = slots[si];
+    s.page = p;
+    s.x = x;
+    s.y = y;
+    s.w = w;
+    s.h = h;
+    s.capW = capW;
+    s.capH = capH;
+    s.generation++;
+    s.lastUsed = frame;
+    s.live = true;
+
+    pages[p].live++;
+    liveSlots++;
+    return {si, s.generation};
+}
+
+void SpriteAtlas::free(Handle h) {
+    if (!valid(h)) return;
+
+    Slot &s = slots[h.slot];
+    s.live = false;
+    s.generation++;
+    liveSlots--;
+
+    Page &page = pages[s.page];
+    if (--page.live == 0) {
+        // 整页为空 重置分配状态
+        for (int f : page.freed) freeSlots.push_back(f);
+        page.freed.clear();
+        page.shelves.clear();
+        page.top = 0;
+        freeSlots.push_back(h.slot);
+    } else {
+        page.freed.push_back(h.slot);
+    }
+}
+
+void SpriteAtlas::upload(Handle h, C_Surface *surface, const MErect *rect) {
+    if (!valid(h) || !surface) return;
+
+    const Slot &s = slots[h.slot];
+    MErect src = rect ? *rect : MErect{0, 0, (f32)s.w, (f32)s.h};
+    if (src.w <= 0 || src.h <= 0) return;
+    MErect dst = {s.x + src.x, s.y + src.y, src.w, src.h};
+    R_UpdateImage(pages[s.page].image, &dst, surface, &src);
+}
+
+SpriteAtlas::Region SpriteAtlas::touch(Handle h) {
+    Slot &s = slots[h.slot];
+    s.lastUsed = frame;
+
+    R_Image *image = pages[s.page].image;
+    const f32 tw = (f32)image->texture_w;
+    const f32 th = (f32)image->texture_h;
+    return {image, s.x / tw, s.y / th, (s.x + s.w) / tw, (s.y + s.h) / th};
+}
+
+void SpriteAtlas::collect() {
+    frame++;
+    for (int i = 0; i < (int)slots.size(); i++) {
+        const Slot &s = slots[i];
+        if (s.live && frame - s.lastUsed > EVICT_FRAMES) free({i, s.generation});
+    }
+}
+
+void SpriteAtlas::clear() {
+    for (Page &page : pages) {
+        if (page.image) R_FreeImage(page.image);
+    }
+    pages.clear();
+
+    // 保留 generation 旧的 Handle 在之后的分配中仍然无效
+    freeSlots.clear();
+    for (int i = 0; i < (int)slots.size(); i++) {
+        if (slots[i].live) slots[i].generation++;
+        slots[i].live = false;
+        freeSlots.push_back(i);
+    }
+    liveSlots = 0;
+}
+
+void SpriteBatch::add(R_Target *target, const SpriteAtlas::Region &region, const MErect &rect, f32 angle) {
+    Group *g = nullptr;
+    for (Group &it : groups) {
+        if (it.target == target && it.page == region.page) {
+            g = &it;
+            break;
+        }
+    }
+    if (!g) {
+        groups.push_back({target, region.page, {}, {}});
+        g = &groups.back();
+    }
+    if (g->indices.size() / 6 >= MAX_QUADS) draw(*g);
+
+    const f32 c = std::cos(angle);
+    const f32 s = std::sin(angle);
+    const f32 corners[4][4] = {
+            {0, 0, region.s0, region.t0},
+            {rect.w, 0, region.s1, region.t0},
+            {rect.w, rect.h, region.s1, region.t1},
+            {0, rect.h, region.s0, region.t1},
+    };
+
+    const u16 base = (u16)(g->vertices.size() / 4);
+    for (const auto &v : corners) {
+        g->vertices.push_back(rect.x + v[0] * c - v[1] * s);
+        g->vertices.push_back(rect.y + v[0] * s + v[1] * c);
+        g->vertices.push_back(v[2]);
+        g->vertices.push_back(v[3]);
+    }
+    for (u16 i : {0, 1, 2, 0, 2, 3}) g->indices.push_back(base + i);
+}
+
+void SpriteBatch::draw(Group &g) {
+    if (g.indices.empty()) return;
+    R_TriangleBatch(g.page, g.target, (unsigned short)(g.vertices.size() / 4), g.vertices.data(), (unsigned int)g.indices.size(), g.indices.data(), R_BATCH_XY_ST);
+    g.vertices.clear();
+    g.indices.clear();
+}
+
+void SpriteBatch::flush(R_Target *target) {
+    for (Group &g : groups) {
+        if (!target || g.target == target) draw(g);
+    }
+    if (!target) groups.clear();
+}
+
+void EntityRenderQueue::sprite(R_Target *target, R_Image *image, const MErect &rect, f32 degrees, f32 pivotX, f32 pivotY, R_FlipEnum flip) {
+    if (!target || !image) return;
+
+    // 以下与 R_BlitRectX 和 R_BlitTransformX 的计算相同
+    const f32 w = image->w, h = image->h;
+    f32 sx = rect.w / w, sy = rect.h / h;
+    f32 x = rect.x, y = rect.y;
+    if (flip & R_FLIP_HORIZONTAL) {
+        sx = -sx;
+        x += rect.w;
+        pivotX = w - pivotX;
+    }
+    if (flip & R_FLIP_VERTICAL) {
+        sy = -sy;
+        y += rect.h;
+        pivotY = h - pivotY;
+    }
+    x += pivotX * sx;
+    y += pivotY * sy;
+
+    if (image->snap_mode == R_SNAP_POSITION || image->snap_mode == R_SNAP_POSITION_AND_DIMENSIONS) {
+        x = std::floor(x);
+        y = std::floor(y);
+    }
+    f32 dx1 = -pivotX, dy1 = -pivotY;
+    f32 dx2 = w - pivotX, dy2 = h - pivotY;
+    if (image->snap_mode == R_SNAP_DIMENSIONS || image->snap_mode == R_SNAP_POSITION_AND_DIMENSIONS) {
+        const f32 fx = w / 2.0f - std::floor(w / 2.0f);
+        const f32 fy = h / 2.0f - std::floor(h / 2.0f);
+        dx1 += fx;
+        dx2 += fx;
+        dy1 += fy;
+        dy2 += fy;
+    }
+    dx1 *= sx;
+    dx2 *= sx;
+    dy1 *= sy;
+    dy2 *= sy;
+
+    const f32 s1 = w / image->texture_w;
+    const f32 t1 = h / image->texture_h;
+    const f32 c = std::cos(degrees * RAD_PER_DEG);
+    const f32 s = std::sin(degrees * RAD_PER_DEG);
+    const f32 corners[4][4] = {
+            {dx1, dy1, 0, 0},
+            {dx2, dy1, s1, 0},
+            {dx2, dy2, s1, t1},
+            {dx1, dy2, 0, t1},
+    };
+
+    Sprite &q = sprites.emplace_back();
+    q.target = target;
+    q.image = image;
+    f32 *v = q.vertices;
+    for (const auto &p : corners) {
+        *v++ = x + p[0] * c - p[1] * s;
+        *v++ = y + p[0] * s + p[1] * c;
+        *v++ = p[2];
+        *v++ = p[3];
+    }
+}
+
+void EntityRenderQueue::rectangle(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color) {
+    if (!target) return;
+    if (x2 < x1) std::swap(x1, x2);
+    if (y2 < y1) std::swap(y1, y2);
+    outlines.push_back({target, x1, y1, x2, y2, R_GetLineThickness(), color});
+}
+
+void EntityRenderQueue::submit(R_Image *image, R_Target *target, R_BatchFlagEnum flags, int stride) {
+    if (indices.empty()) return;
+    R_TriangleBatch(image, target, (unsigned short)(vertices.size() / stride), vertices.data(), (unsigned int)indices.size(), indices.data(), flags);
+    vertices.clear();
+    indices.clear();
+    batches++;
+}
+
+void EntityRenderQueue::flush() {
+    batches = 0;
+
+    std::stable_sort(sprites.begin(), sprites.end(), [](const Sprite &a, const Sprite &b) {
+        if (a.target != b.target) return std::less<R_Target *>()(a.target, b.target);
+        return std::less<R_Image *>()(a.image, b.image);
+    });
+    for (size_t i = 0; i < sprites.size(); i++) {
+        const Sprite &q = sprites[i];
+        const u16 base = (u16)(vertices.size() / 4);
+        vertices.insert(vertices.end(), q.vertices, q.vertices + 16);
+        for (u16 k : {0, 1, 2, 0, 2, 3}) indices.push_back(base + k);
+        const bool last = i + 1 == sprites.size() || sprites[i + 1].target != q.target || sprites[i + 1].image != q.image;
+        if (last || indices.size() / 6 >= MAX_QUADS) submit(q.image, q.target, R_BATCH_XY_ST, 4);
+    }
+    sprites.clear();
+
+    // 边框拆成上下左右四个实心条 与 R_Rectangle 覆盖的范围相同
+    std::stable_sort(outlines.begin(), outlines.end(), [](const Outline &a, const Outline &b) { return std::less<R_Target *>()(a.target, b.target); });
+    for (size_t i = 0; i < outlines.size(); i++) {
+        const Outline &o = outlines[i];
+        const f32 outer = o.thickness / 2;
+        f32 ix = outer, iy = outer;
+        if (o.x1 + ix > o.x2 - ix) ix = (o.x2 - o.x1) / 2;
+        if (o.y1 + iy > o.y2 - iy) iy = (o.y2 - o.y1) / 2;
+        const f32 bars[4][4] = {
+                {o.x1 - outer, o.y1 - outer, o.x2 + outer, o.y1 + iy},
+                {o.x1 - outer, o.y2 - iy, o.x2 + outer, o.y2 + outer},
+                {o.x1 - outer, o.y1 + iy, o.x1 + ix, o.y2 - iy},
+                {o.x2 - ix, o.y1 + iy, o.x2 + outer, o.y2 - iy},
+        };
+        const f32 r = o.color.r / 255.0f, g = o.color.g / 255.0f, b = o.color.b / 255.0f, a = o.color.a / 255.0f;
+        for (const auto &bar : bars) {
+            const u16 base = (u16)(vertices.size() / 6);
+            const f32 corners[4][2] = {{bar[0], bar[1]}, {bar[2], bar[1]}, {bar[2], bar[3]}, {bar[0], bar[3]}};
+            for (const auto &p : corners) vertices.insert(vertices.end(), {p[0], p[1], r, g, b, a});
+            for (u16 k : {0, 1, 2, 0, 2, 3}) indices.push_back(base + k);
+        }
+        const bool last = i + 1 == outlines.size() || outlines[i + 1].target != o.target;
+        if (last || indices.size() / 6 + 4 > MAX_QUADS) submit(nullptr, o.target, R_BATCH_XY_RGBA, 6);
+    }
+    outlines.clear();
+}
+
+}  // namespace ME
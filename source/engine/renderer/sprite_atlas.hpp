@@ -0,0 +1,168 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_SPRITE_ATLAS_HPP
+#define ME_SPRITE_ATLAS_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/sdl_wrapper.h"
+#include "engine/renderer/renderer_gpu.h"
+
+namespace ME {
+
+// 刚体贴图的图集
+// 每页 PAGE_SIZE x PAGE_SIZE 按行 (shelf) 分配 释放的位置按大小复用 页内全部释放后整页重置
+// 持有者只保存 Handle 位置被回收后 generation 不再匹配 valid() 返回 false 需要重新分配并上传
+// 连续 EVICT_FRAMES 帧没有 touch() 的位置在 collect() 中回收 销毁的刚体不需要显式释放
+class SpriteAtlas {
+public:
+    static constexpr int PAGE_SIZE = 1024;
+    static constexpr int PADDING = 1;
+    static constexpr u32 EVICT_FRAMES = 120;
+
+    struct Handle {
+        int slot = -1;
+        u32 generation = 0;
+    };
+
+    struct Region {
+        R_Image *page;
+        // 纹理坐标 [s0, s1] x [t0, t1]
+        f32 s0, t0, s1, t1;
+    };
+
+    SpriteAtlas() = default;
+    ~SpriteAtlas() { clear(); }
+
+    SpriteAtlas(const SpriteAtlas &) = delete;
+    SpriteAtlas &operator=(const SpriteAtlas &) = delete;
+
+    // 太大的贴图不进入图集 由调用者单独绘制
+    static bool fits(int w, int h) { return w > 0 && h > 0 && w + PADDING * 2 <= PAGE_SIZE && h + PADDING * 2 <= PAGE_SIZE; }
+
+    bool valid(Handle h) const { return h.slot >= 0 && h.slot < (int)slots.size() && slots[h.slot].live && slots[h.slot].generation == h.generation; }
+
+    // 分配 w x h 的位置 fits() 为 false 时返回无效的 Handle
+    Handle alloc(int w, int h);
+    void free(Handle h);
+
+    // 把 surface 的像素上传到 h 的位置 surface 的大小必须与分配时相同
+    // rect 为 surface 中要上传的范围 NULL 时上传整张
+    void upload(Handle h, C_Surface *surface, const MErect *rect = nullptr);
+
+    // 标记这一帧用到了 h 并返回它的页和纹理坐标
+    Region touch(Handle h);
+
+    // 每帧调用一次 回收长时间没有用到的位置
+    void collect();
+
+    void clear();
+
+    size_t page_count() const { return pages.size(); }
+    size_t live_count() const { return liveSlots; }
+
+private:
+    struct Slot {
+        int page;
+        int x, y, w, h;  // 不含边距
+        int capW, capH;  // 位置本身的大小 复用时可能大于 w h
+        u32 generation = 0;
+        u32 lastUsed = 0;
+        bool live = false;
+    };
+
+    struct Shelf {
+        int y, h, x;
+    };
+
+    struct Page {
+        R_Image *image = nullptr;
+        std::vector<Shelf> shelves;
+        int top = 0;  // 下一行的 y
+        int live = 0;
+        // 释放后可以复用的位置
+        std::vector<int> freed;
+    };
+
+    bool pack(Page &page, int w, int h, int &x, int &y, int &capW, int &capH);
+    int new_slot();
+
+    std::vector<Page> pages;
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    size_t liveSlots = 0;
+    u32 frame = 0;
+};
+
+// 按 (目标, 图集页) 收集带旋转的矩形 每组一次 R_TriangleBatch
+class SpriteBatch {
+public:
+    // 与 R_BlitRectX(image, NULL, target, &rect, degrees, 0, 0, R_FLIP_NONE) 相同: 绕矩形左上角旋转 angle (弧度)
+    void add(R_Target *target, const SpriteAtlas::Region &region, const MErect &rect, f32 angle);
+
+    // 绘制并清空 target 为 NULL 时绘制全部
+    void flush(R_Target *target = nullptr);
+
+private:
+    struct Group {
+        R_Target *target;
+        R_Image *page;
+        std::vector<f32> vertices;  // x y s t
+        std::vector<u16> indices;
+    };
+
+    // R_TriangleBatch 的顶点数是 u16
+    static constexpr size_t MAX_QUADS = 65536 / 4 - 1;
+
+    void draw(Group &g);
+
+    std::vector<Group> groups;
+};
+
+// 实体 (Player Bot) 的绘制队列
+// 一帧内收集贴图四边形和矩形边框 flush 时按 (目标, 贴图) 排序 每组一次 R_TriangleBatch
+// 同一目标上的绘制顺序可能与提交顺序不同 只用于叠加混合或互不重叠的绘制
+class EntityRenderQueue {
+public:
+    // 与 R_BlitRectX(image, NULL, target, &rect, degrees, pivotX, pivotY, flip) 相同
+    void sprite(R_Target *target, R_Image *image, const MErect &rect, f32 degrees, f32 pivotX, f32 pivotY, R_FlipEnum flip);
+    // 与 R_Rectangle 相同 线宽取提交时的 R_GetLineThickness
+    void rectangle(R_Target *target, f32 x1, f32 y1, f32 x2, f32 y2, MEcolor color);
+
+    // 绘制并清空
+    void flush();
+
+    size_t size() const { return sprites.size() + outlines.size(); }
+    // 上一次 flush 的 R_TriangleBatch 次数
+    size_t last_batches() const { return batches; }
+
+private:
+    struct Sprite {
+        R_Target *target;
+        R_Image *image;
+        f32 vertices[16];  // 四个角 x y s t
+    };
+
+    struct Outline {
+        R_Target *target;
+        f32 x1, y1, x2, y2;
+        f32 thickness;
+        MEcolor color;
+    };
+
+    static constexpr size_t MAX_QUADS = 65536 / 4 - 1;
+
+    void submit(R_Image *image, R_Target *target, R_BatchFlagEnum flags, int stride);
+
+    std::vector<Sprite> sprites;
+    std::vector<Outline> outlines;
+    // flush 的临时数据 保留容量
+    std::vector<f32> vertices;
+    std::vector<u16> indices;
+    size_t batches = 0;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,254 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "replay.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#include "cvar.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/game_utils/rng.h"
+#include "engine/utils/utility.hpp"
+#include "frame_pacer.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+constexpr char REPLAY_MAGIC[4] = {'M', 'E', 'R', 'P'};
+
+// 只录这些事件 窗口事件和拖放文件等与回放时的窗口有关 不录
+bool recorded_event(u32 type) {
+    switch (type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        case SDL_TEXTINPUT:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEWHEEL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+f32 percentile(std::vector<f32> &v, f32 p) {
+    if (v.empty()) return 0.0f;
+    const size_t n = std::min(v.size() - 1, (size_t)(p * (f32)(v.size() - 1) + 0.5f));
+    std::nth_element(v.begin(), v.begin() + n, v.end());
+    return v[n];
+}
+
+}  // namespace
+
+bool Replay::open(int argc, char *argv[], GlobalDEF &def, int windowWidth, int windowHeight, u32 &maxTps) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            m = RECORD;
+            path = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            m = PLAY;
+            path = argv[++i];
+        } else if (!strcmp(argv[i], "--replay-headless")) {
+            noRender = true;
+        }
+    }
+    if (m == NONE) return false;
+
+    // 录制和回放都逐 tick 计算像素哈希 回放时与录制的逐帧比较
+    def.tick_checksum = true;
+
+    const std::string settingsPath = path + ".settings";
+
+    if (m == RECORD) {
+        out.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+            METADOT_WARN(std::format("Failed to open replay {0} for recording", path).c_str());
+            m = NONE;
+            return false;
+        }
+        memcpy(head.magic, REPLAY_MAGIC, sizeof(head.magic));
+        head.version = VERSION;
+        head.eventSize = (u32)sizeof(C_Event);
+        head.maxTps = maxTps;
+        head.windowWidth = windowWidth;
+        head.windowHeight = windowHeight;
+        // 头部在 seed 中写出
+        SaveGlobalDEF(def, settingsPath);
+        METADOT_INFO(std::format("Recording replay to {0}", path).c_str());
+        return true;
+    }
+
+    if (ME_fs_exists(path)) data = ME_fs_readfile(path);
+    if (data.size() < sizeof(header)) {
+        METADOT_WARN(std::format("Replay {0} not found", path).c_str());
+        m = NONE;
+        return false;
+    }
+    memcpy(&head, data.data(), sizeof(head));
+    if (memcmp(head.magic, REPLAY_MAGIC, sizeof(head.magic)) != 0 || head.version != VERSION || head.eventSize != sizeof(C_Event)) {
+        METADOT_WARN(std::format("Replay {0} is not valid or was recorded by another build", path).c_str());
+        m = NONE;
+        data.clear();
+        return false;
+    }
+    at = sizeof(header);
+
+    if (!LoadGlobalDEF(&def, settingsPath)) METADOT_WARN(std::format("Replay settings {0} not found, using current settings", settingsPath).c_str());
+    maxTps = head.maxTps;
+    // 鼠标坐标按录制时的窗口换算 尺寸不同时点击的位置会偏
+    if (head.windowWidth != windowWidth || head.windowHeight != windowHeight)
+        METADOT_WARN(std::format("Replay was recorded at {0}x{1}, window is {2}x{3}", head.windowWidth, head.windowHeight, windowWidth, windowHeight).c_str());
+
+    METADOT_INFO(std::format("Playing replay {0}{1}", path, noRender ? " (headless)" : "").c_str());
+    return true;
+}
+
+u32 Replay::seed(u32 live) {
+    if (m == PLAY) return head.seed;
+    if (m == RECORD) {
+        head.seed = live;
+        out.write((const char *)&head, sizeof(head));
+    }
+    return live;
+}
+
+i64 Replay::begin_frame(i64 now) {
+    if (m == RECORD) {
+        if (frameIndex == 0 && !frameOpen) firstNow = now;
+        cur = {};
+        cur.now = now - firstNow;
+        cur.latchNow = cur.now;
+        events.clear();
+        frameOpen = true;
+        return now;
+    }
+    if (m != PLAY || done) return now;
+
+    if (frameIndex == 0) liveStart = now;
+    if (sizeof(frame) > data.size() - at) {
+        done = true;
+        return now;
+    }
+    memcpy(&cur, data.data() + at, sizeof(cur));
+    at += sizeof(cur);
+    if ((size_t)cur.events > (data.size() - at) / sizeof(C_Event)) {
+        METADOT_WARN(std::format("Replay {0} is truncated at frame {1}", path, frameIndex).c_str());
+        done = true;
+        return now;
+    }
+    eventsAt = at;
+    at += (size_t)cur.events * sizeof(C_Event);
+    nextEvent = 0;
+    frameOpen = true;
+    return liveStart + cur.now;
+}
+
+bool Replay::poll(C_Event &e) {
+    if (m != PLAY || done) {
+        if (!SDL_PollEvent(&e)) return false;
+        if (m == RECORD && frameOpen && recorded_event(e.type)) events.push_back(e);
+        return true;
+    }
+
+    while (SDL_PollEvent(&e)) {
+        if (e.type == SDL_QUIT || e.type == SDL_WINDOWEVENT) return true;
+    }
+    if (!frameOpen || nextEvent >= cur.events) return false;
+    memcpy(&e, data.data() + eventsAt + (size_t)nextEvent * sizeof(C_Event), sizeof(C_Event));
+    nextEvent++;
+    return true;
+}
+
+void Replay::latch(i64 &now, int &x, int &y) {
+    if (!frameOpen) return;
+    if (m == RECORD) {
+        cur.latchNow = now - firstNow;
+        cur.latchX = x;
+        cur.latchY = y;
+    } else if (m == PLAY) {
+        now = liveStart + cur.latchNow;
+        x = cur.latchX;
+        y = cur.latchY;
+    }
+}
+
+void Replay::end_frame(u32 ticks, f64 tickMs, const world *w) {
+    if (!frameOpen) return;
+    frameOpen = false;
+
+    if (m == RECORD) {
+        cur.ticks = ticks;
+        cur.events = (u32)events.size();
+        cur.state = state_of(w);
+        out.write((const char *)&cur, sizeof(cur));
+        if (!events.empty()) out.write((const char *)events.data(), events.size() * sizeof(C_Event));
+        frameIndex++;
+        return;
+    }
+
+    // tick 次数只取决于帧时间 不同说明 tick 循环改了 签名不同说明模拟结果分叉了
+    if (!diverged && (ticks != cur.ticks || state_of(w) != cur.state)) {
+        diverged = true;
+        divergedAt = frameIndex;
+        METADOT_WARN(std::format("Replay diverged at frame {0} (ticks {1}, recorded {2})", frameIndex, ticks, cur.ticks).c_str());
+    }
+
+    const f64 end = FramePacer::now_ms();
+    if (frameIndex > 0) samples.push_back({(f32)(end - lastFrameEnd), (f32)tickMs, ticks});
+    lastFrameEnd = end;
+    frameIndex++;
+
+    if (sizeof(frame) > data.size() - at) done = true;
+}
+
+void Replay::finish() {
+    if (m == RECORD) {
+        out.close();
+        METADOT_INFO(std::format("Recorded {0} frames to {1}", frameIndex, path).c_str());
+    } else if (m == PLAY) {
+        write_report();
+    }
+    m = NONE;
+}
+
+u64 Replay::state_of(const world *w) {
+    if (!w) return 0;
+    u64 s = RNG_Mix((u64)(u32)w->tickCt, w->stateHash);
+    s = RNG_Mix(s, (u64)w->cells.size());
+    s = RNG_Mix(s, ((u64)w->rigidBodies.size() << 32) | (u64)w->worldRigidBodies.size());
+    return s;
+}
+
+void Replay::write_report() {
+    const std::string csvPath = path + ".csv";
+    std::ofstream csv(csvPath, std::ios::out | std::ios::trunc);
+    csv << "frame,frame_ms,tick_ms,ticks\n";
+    f64 total = 0.0, tickTotal = 0.0;
+    u64 ticks = 0;
+    std::vector<f32> frameMs, tickMs;
+    frameMs.reserve(samples.size());
+    tickMs.reserve(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        const sample &s = samples[i];
+        csv << std::format("{0},{1:.3f},{2:.3f},{3}\n", i + 1, s.frameMs, s.tickMs, s.ticks);
+        total += s.frameMs;
+        tickTotal += s.tickMs;
+        ticks += s.ticks;
+        frameMs.push_back(s.frameMs);
+        if (s.ticks > 0) tickMs.push_back(s.tickMs / (f32)s.ticks);
+    }
+
+    const f64 n = (f64)std::max<size_t>(samples.size(), 1);
+    METADOT_INFO(std::format("Replay finished: {0} frames in {1:.1f} ms, frame avg {2:.2f} p50 {3:.2f} p95 {4:.2f} p99 {5:.2f} ms, tick avg {6:.2f} p99 {7:.2f} ms", samples.size(), total,
+                             total / n, percentile(frameMs, 0.5f), percentile(frameMs, 0.95f), percentile(frameMs, 0.99f),
+                             ticks ? tickTotal / (f64)ticks : 0.0, percentile(tickMs, 0.99f))
+                         .c_str());
+    if (diverged) METADOT_WARN(std::format("Replay diverged from the recording at frame {0}, later frames are not comparable", divergedAt).c_str());
+    METADOT_INFO(std::format("Replay frame times written to {0}", csvPath).c_str());
+}
+
+}  // namespace ME
@@ -0,0 +1,114 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_REPLAY_HPP
+#define ME_REPLAY_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/sdl_wrapper.h"
+
+namespace ME {
+
+class world;
+struct GlobalDEF;
+
+// 输入回放 game::replay 用来在真实的游戏过程上对比优化前后的性能
+// --record <文件> 录下随机数种子 设置 每帧的时间 输入事件和 tick 次数
+// --replay <文件> 按录下的时间和事件重新运行 不限帧 不等垂直同步 结束后把每帧耗时写到 <文件>.csv 并退出
+// --replay-headless 回放时不绘制世界 (renderLate) 只测模拟和界面
+// world::tick 的随机数由 simSeed 按 tick 和区块派生 种子相同 tick 次数相同就得到同样的模拟
+// 区块异步加载完成的时机不在录制中 从新建的世界开始录制最容易复现 回放时不自动存档 退出时不保存世界
+class Replay {
+public:
+    enum mode { NONE = 0, RECORD = 1, PLAY = 2 };
+
+    static constexpr u32 VERSION = 1;
+
+    // 在 InitGlobalDEF 之后 RNG_Create 之前调用 回放时用录制时的设置覆盖 def
+    bool open(int argc, char *argv[], GlobalDEF &def, int windowWidth, int windowHeight, u32 &maxTps);
+
+    // RNG_Create 的种子 回放时返回录制的种子
+    u32 seed(u32 live);
+
+    // update_post 之后调用 返回这一帧使用的时间 (ms) 录制时原样返回
+    i64 begin_frame(i64 now);
+    // 代替 SDL_PollEvent 回放时丢弃真实的输入 只保留退出和窗口事件
+    bool poll(C_Event &e);
+    // 晚锁存时的时间和鼠标位置
+    void latch(i64 &now, int &x, int &y);
+    // 渲染之后调用 tickMs 为这一帧 tick 循环的耗时
+    void end_frame(u32 ticks, f64 tickMs, const world *w);
+    // 写出回放报告 关闭录制文件
+    void finish();
+
+    bool recording() const { return m == RECORD; }
+    bool playing() const { return m == PLAY; }
+    // 回放完最后一帧
+    bool finished() const { return done; }
+    bool headless() const { return m == PLAY && noRender; }
+
+private:
+    struct header {
+        char magic[4];
+        u32 version;
+        u32 eventSize;
+        u32 seed;
+        u32 maxTps;
+        i32 windowWidth;
+        i32 windowHeight;
+    };
+
+    struct frame {
+        // 相对第一帧的时间
+        i64 now;
+        i64 latchNow;
+        i32 latchX;
+        i32 latchY;
+        u32 ticks;
+        u32 events;
+        // tick 次数 world::stateHash 和实体个数的签名 回放时用来发现分叉
+        u64 state;
+    };
+
+    struct sample {
+        f32 frameMs;
+        f32 tickMs;
+        u32 ticks;
+    };
+
+    static u64 state_of(const world *w);
+    void write_report();
+
+    mode m = NONE;
+    std::string path;
+    bool noRender = false;
+    header head{};
+
+    // 录制
+    std::ofstream out;
+    std::vector<C_Event> events;
+
+    // 回放
+    std::string data;
+    size_t at = 0;
+    u32 nextEvent = 0;
+    size_t eventsAt = 0;
+    i64 liveStart = 0;
+    u32 divergedAt = 0;
+    bool diverged = false;
+    std::vector<sample> samples;
+    f64 lastFrameEnd = 0.0;
+
+    bool done = false;
+    bool frameOpen = false;
+    i64 firstNow = 0;
+    u32 frameIndex = 0;
+    frame cur{};
+};
+
+}  // namespace ME
+
+#endif
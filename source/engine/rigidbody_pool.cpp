@@ -0,0 +1,135 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "rigidbody_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "engine/game_datastruct.hpp"
+#include "game/player.hpp"
+
+namespace ME {
+
+int RigidBodyPool::sizeClass(size_t count) {
+    if (count > ((size_t)1 << MAX_SHIFT)) return -1;
+    const int shift = count <= 1 ? 0 : (int)std::bit_width(count - 1);
+    return std::max(shift, MIN_SHIFT);
+}
+
+RigidBody *RigidBodyPool::acquire(b2Body *body, std::string name) {
+    if (bodies.empty()) return new RigidBody(body, std::move(name));
+
+    RigidBody *rb = bodies.back();
+    bodies.pop_back();
+    rb->body = body;
+    rb->name = std::move(name);
+    return rb;
+}
+
+void RigidBodyPool::release(RigidBody *rb) {
+    if (!rb) return;
+
+    // 只有这个刚体引用的贴图才能回收 surface
+    TextureRef tex = rb->takeTexture();
+    C_Surface *surface = tex ? tex->surface() : nullptr;
+    const bool reclaim = tex.use_count() == 1 && owns(surface);
+    tex.reset();
+    if (reclaim) freeSurface(surface);
+
+    freeTiles(rb->tiles, rb->matWidth * rb->matHeight);
+    rb->tiles = nullptr;
+
+    // 拿在手里的刚体 item->image 就是 rb 的 image
+    if (!rb->item) rb->chunk_clean();
+
+    if (bodies.size() >= MAX_FREE_BODIES) {
+        delete rb;
+        return;
+    }
+    rb->recycle();
+    bodies.push_back(rb);
+}
+
+MaterialInstance *RigidBodyPool::allocTiles(int count) {
+    const int c = sizeClass((size_t)count);
+    if (c < 0) return new MaterialInstance[count];
+
+    std::vector<MaterialInstance *> &bucket = tiles[c];
+    if (bucket.empty()) return new MaterialInstance[(size_t)1 << c];
+
+    MaterialInstance *t = bucket.back();
+    bucket.pop_back();
+    return t;
+}
+
+void RigidBodyPool::freeTiles(MaterialInstance *t, int count) {
+    if (!t) return;
+
+    const int c = sizeClass((size_t)count);
+    if (c < 0 || tiles[c].size() >= MAX_FREE_PER_CLASS) {
+        delete[] t;
+        return;
+    }
+    tiles[c].push_back(t);
+}
+
+C_Surface *RigidBodyPool::allocSurface(int w, int h, u32 format) {
+    const int c = sizeClass((size_t)w * h);
+    if (c < 0 || SDL_BITSPERPIXEL(format) != 32) return SDL_CreateRGBSurfaceWithFormat(0, w, h, SDL_BITSPERPIXEL(format), format);
+
+    u32 *buf = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pixelsMutex);
+        if (!pixels[c].empty()) {
+            buf = pixels[c].back();
+            pixels[c].pop_back();
+        }
+    }
+    if (!buf) buf = new u32[(size_t)1 << c];
+    std::memset(buf, 0, (size_t)w * h * sizeof(u32));
+
+    // SDL_PREALLOC: SDL_FreeSurface 不释放像素
+    C_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(buf, w, h, 32, w * (int)sizeof(u32), format);
+    if (!surface) {
+        delete[] buf;
+        return nullptr;
+    }
+    surface->userdata = this;
+    return surface;
+}
+
+void RigidBodyPool::freeSurface(C_Surface *surface) {
+    if (!owns(surface)) return;
+
+    u32 *buf = (u32 *)surface->pixels;
+    const int c = sizeClass((size_t)surface->w * surface->h);
+    SDL_FreeSurface(surface);
+
+    {
+        std::lock_guard<std::mutex> lock(pixelsMutex);
+        if (pixels[c].size() < MAX_FREE_PER_CLASS) {
+            pixels[c].push_back(buf);
+            return;
+        }
+    }
+    delete[] buf;
+}
+
+void RigidBodyPool::clear() {
+    for (RigidBody *rb : bodies) delete rb;
+    bodies.clear();
+
+    for (auto &bucket : tiles) {
+        for (MaterialInstance *t : bucket) delete[] t;
+        bucket.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(pixelsMutex);
+    for (auto &bucket : pixels) {
+        for (u32 *buf : bucket) delete[] buf;
+        bucket.clear();
+    }
+}
+
+}  // namespace ME
@@ -0,0 +1,66 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_RIGIDBODY_POOL_HPP
+#define ME_RIGIDBODY_POOL_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/sdl_wrapper.h"
+#include "engine/physics/box2d/inc/box2d.h"
+
+namespace ME {
+
+class RigidBody;
+class MaterialInstance;
+
+// 爆炸和刚体分裂会在一个 tick 内创建/销毁大量碎片
+// 这里复用 RigidBody 对象 tiles 数组和碎片 surface 的像素缓冲
+// b2Body/b2Fixture 本身已经由 b2World 的 b2BlockAllocator 分配 不需要再池化
+class RigidBodyPool {
+public:
+    // 缓冲按元素个数向上取 2 的幂分级 超过 1 << MAX_SHIFT 的直接分配和释放
+    static constexpr int MIN_SHIFT = 6;
+    static constexpr int MAX_SHIFT = 18;
+    static constexpr size_t MAX_FREE_PER_CLASS = 64;
+    static constexpr size_t MAX_FREE_BODIES = 256;
+
+    RigidBodyPool() = default;
+    RigidBodyPool(const RigidBodyPool &) = delete;
+    RigidBodyPool &operator=(const RigidBodyPool &) = delete;
+    ~RigidBodyPool() { clear(); }
+
+    // 只能在主线程调用 (与 b2world 相同)
+    RigidBody *acquire(b2Body *body, std::string name = "unknown");
+    // body 需要已经从 b2world 销毁 rb 之后不能再被使用
+    // tiles 和池中分配的 surface 被回收 rb->item 存在时 image 归 item 所有 不释放
+    void release(RigidBody *rb);
+
+    // 内容未初始化 调用者需要写满 count 个元素
+    MaterialInstance *allocTiles(int count);
+    void freeTiles(MaterialInstance *tiles, int count);
+
+    // 32 位格式的 surface 像素清零 可以在 worker 上调用
+    // 其它格式直接交给 SDL 分配
+    C_Surface *allocSurface(int w, int h, u32 format);
+    // 不是 allocSurface 分配的 surface 不处理
+    void freeSurface(C_Surface *surface);
+    bool owns(const C_Surface *surface) const { return surface && surface->userdata == this; }
+
+    void clear();
+
+private:
+    static int sizeClass(size_t count);
+
+    std::vector<RigidBody *> bodies;
+    std::vector<MaterialInstance *> tiles[MAX_SHIFT + 1];
+
+    std::mutex pixelsMutex;
+    std::vector<u32 *> pixels[MAX_SHIFT + 1];
+};
+
+}  // namespace ME
+
+#endif
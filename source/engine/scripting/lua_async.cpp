@@ -0,0 +1,247 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_async.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#include "engine/chunk.hpp"
+#include "engine/chunk_codec.hpp"
+#include "engine/core/global.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/core/io/packer.hpp"
+#include "engine/game.hpp"
+#include "engine/scripting/lua_worker.hpp"
+#include "engine/scripting/scripting.hpp"
+#include "engine/world.hpp"
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+// 后台任务专用的资源包读取器 锁只保护第一次打开 查找和解压到调用者的缓冲区可以在多个 worker 上同时进行
+std::mutex g_packLock;
+ME_pack_reader g_packReader = nullptr;
+
+lua_async *Self(lua_State *L) { return static_cast<lua_async *>(lua_touserdata(L, lua_upvalueindex(1))); }
+
+}  // namespace
+
+void lua_async::init(lua_State *state) {
+    L = state;
+    const luaL_Reg fns[] = {
+            {"spawn", l_spawn},
+            {"next_frame", l_next_frame},
+            {"read_file", l_read_file},
+            {"read_pack", l_read_pack},
+            {"stored_chunk_summary", l_stored_chunk_summary},
+            {"worker", l_worker},
+            {NULL, NULL},
+    };
+    lua_newtable(L);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, fns, 1);
+    lua_setglobal(L, "async");
+}
+
+void lua_async::resume(task *t, int nargs) {
+    current = t;
+    int nres = 0;
+    const int status = lua_resume(t->co, L, nargs, &nres);
+    current = nullptr;
+
+    if (status == LUA_YIELD) {
+        // 没有提交任务的让出 等到下一次 poll
+        lua_pop(t->co, nres);
+        return;
+    }
+    if (status != LUA_OK) print_error(t->co, status);
+    t->finished = true;
+    luaL_unref(L, LUA_REGISTRYINDEX, t->ref);
+    t->ref = LUA_NOREF;
+}
+
+void lua_async::poll() {
+    if (tasks.empty()) return;
+
+    // resume 中可能 spawn 新的协程 只处理已有的
+    const size_t n = tasks.size();
+    for (size_t i = 0; i < n; i++) {
+        task *t = tasks[i].get();
+        if (t->finished || (t->hasJob && !t->counter.done())) continue;
+
+        int nargs = 0;
+        if (t->hasJob) {
+            t->hasJob = false;
+            if (t->ok && t->packed) {
+                nargs = lua_unpack(t->co, t->data.data(), t->data.size(), t->error);
+                if (nargs < 0) {
+                    lua_pushnil(t->co);
+                    lua_pushstring(t->co, t->error.c_str());
+                    nargs = 2;
+                }
+            } else if (t->ok) {
+                lua_pushlstring(t->co, t->data.data(), t->data.size());
+                nargs = 1;
+            } else {
+                lua_pushnil(t->co);
+                lua_pushstring(t->co, t->error.c_str());
+                nargs = 2;
+            }
+            t->data.clear();
+            t->data.shrink_to_fit();
+        }
+        resume(t, nargs);
+    }
+    std::erase_if(tasks, [](const std::unique_ptr<task> &t) { return t->finished; });
+}
+
+void lua_async::shutdown() {
+    for (auto &t : tasks) {
+        if (t->hasJob) job::wait(t->counter);
+        if (L && t->ref != LUA_NOREF) luaL_unref(L, LUA_REGISTRYINDEX, t->ref);
+    }
+    tasks.clear();
+    L = nullptr;
+
+    std::lock_guard<std::mutex> guard(g_packLock);
+    if (g_packReader) ME_destroy_pack_reader(g_packReader);
+    g_packReader = nullptr;
+}
+
+int lua_async::l_spawn(lua_State *L) {
+    lua_async *self = Self(L);
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    const int nargs = lua_gettop(L) - 1;
+
+    auto t = std::make_unique<task>();
+    t->co = lua_newthread(L);
+    lua_insert(L, 1);
+    // 函数和参数移到协程上 线程留在栈底 之后存进注册表
+    lua_xmove(L, t->co, nargs + 1);
+    t->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    task *raw = t.get();
+    self->tasks.push_back(std::move(t));
+    // 嵌套 spawn 时先保存外层的当前协程
+    task *outer = self->current;
+    self->resume(raw, nargs);
+    self->current = outer;
+    return 0;
+}
+
+int lua_async::l_next_frame(lua_State *co) {
+    if (!lua_isyieldable(co)) return luaL_error(co, "async.next_frame must be called inside async.spawn");
+    return lua_yield(co, 0);
+}
+
+void lua_async::check_context(lua_State *co, const char *fn) {
+    const task *t = Self(co)->current;
+    if (!t || t->co != co || !lua_isyieldable(co)) luaL_error(co, "async.%s must be called inside async.spawn", fn);
+}
+
+int lua_async::submit(lua_State *co, std::function<void(task &)> work, bool packed) {
+    task *t = Self(co)->current;
+    t->hasJob = true;
+    t->ok = true;
+    t->packed = packed;
+    t->error.clear();
+    job::execute_background(t->counter, [t, work = std::move(work)]() { work(*t); });
+    return lua_yield(co, 0);
+}
+
+int lua_async::l_read_file(lua_State *co) {
+    check_context(co, "read_file");
+    std::string path = ME_fs_get_path(luaL_checkstring(co, 1));
+    return submit(co, [path = std::move(path)](task &t) {
+        ME_fs_mapped_file file;
+        if (!ME_fs_map_file(path.c_str(), file)) {
+            t.ok = false;
+            t.error = "cannot open " + path;
+            return;
+        }
+        if (file.data) t.data.assign(file.data, file.size);
+        ME_fs_unmap_file(file);
+    });
+}
+
+int lua_async::l_read_pack(lua_State *co) {
+    check_context(co, "read_pack");
+    std::string path = luaL_checkstring(co, 1);
+    return submit(co, [path = std::move(path)](task &t) {
+        ME_pack_reader reader;
+        {
+            std::lock_guard<std::mutex> guard(g_packLock);
+            if (!g_packReader) {
+                ME_pack_result result = ME_create_file_pack_reader(METADOT_RESLOC("data/resources.pack"), 0, 0, &g_packReader);
+                if (result != SUCCESS_PACK_RESULT) {
+                    g_packReader = nullptr;
+                    t.ok = false;
+                    t.error = pack_result_to_string(result);
+                    return;
+                }
+            }
+            reader = g_packReader;
+        }
+        u64 index;
+        if (!ME_get_pack_item_index(reader, path.c_str(), &index)) {
+            t.ok = false;
+            t.error = pack_result_to_string(FAILED_TO_GET_ITEM_PACK_RESULT);
+            return;
+        }
+        const u32 size = ME_get_pack_item_data_size(reader, index);
+        t.data.resize(size);
+        ME_pack_result result = ME_decompress_pack_item(reader, index, (u8 *)t.data.data(), size);
+        if (result != SUCCESS_PACK_RESULT) {
+            t.ok = false;
+            t.error = pack_result_to_string(result);
+            t.data.clear();
+        }
+    });
+}
+
+int lua_async::l_stored_chunk_summary(lua_State *co) {
+    check_context(co, "stored_chunk_summary");
+    const int cx = (int)luaL_checkinteger(co, 1);
+    const int cy = (int)luaL_checkinteger(co, 2);
+    const int level = (int)luaL_optinteger(co, 3, 0);
+    luaL_argcheck(co, level >= 0 && level < ChunkCodec::SUMMARY_LEVELS, 3, "invalid summary level");
+
+    // 只读存档 不访问已加载的区块 可以在 worker 上执行 读取器和世界在 shutdown 前一直有效
+    world *w = global.game ? global.game->Iso.world.get() : nullptr;
+    if (!w || w->noSaveLoad) return luaL_error(co, "async.stored_chunk_summary: no saved world");
+    std::string worldName = w->worldName;
+    RegionStore *regions = &w->regions;
+
+    return submit(co, [=](task &t) {
+        Chunk probe;
+        probe.ChunkInit(cx, cy, worldName, regions);
+        std::vector<u32> out(ChunkCodec::summary_size(level));
+        if (!probe.ChunkReadSummary(level, out.data())) {
+            t.ok = false;
+            t.error = "chunk has no stored summary";
+            return;
+        }
+        // 每个像素 4 字节小端 0xAARRGGBB 脚本用 string.unpack("<I4", data, i) 读取
+        t.data.assign((const char *)out.data(), out.size() * sizeof(u32));
+    });
+}
+
+int lua_async::l_worker(lua_State *co) {
+    check_context(co, "worker");
+    const char *name = luaL_checkstring(co, 1);
+    {
+        // 参数在主线程上打包 worker 状态只看到副本
+        std::string args, error;
+        if (lua_pack(co, 2, lua_gettop(co) - 1, args, error)) {
+            lua_worker_pool *pool = &the<scripting>().workers;
+            return submit(
+                    co, [pool, name = std::string(name), args = std::move(args)](task &t) { t.ok = pool->call(name.c_str(), args, t.data, t.error); }, true);
+        }
+        lua_pushfstring(co, "async.worker: %s", error.c_str());
+    }
+    return lua_error(co);
+}
+
+}  // namespace ME
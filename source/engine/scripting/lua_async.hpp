@@ -0,0 +1,70 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_ASYNC_HPP
+#define ME_LUA_ASYNC_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine/core/job.h"
+
+struct lua_State;
+
+namespace ME {
+
+// 脚本协程的异步任务
+// async.spawn(fn, ...) 把 fn 放进协程立即开始执行 协程里调用 async.read_file 等函数时把工作交给 job 的后台任务并让出
+// 主线程在 poll 中发现任务完成后恢复协程 结果作为这次调用的返回值 (data) 或者 (nil, err)
+// 协程里直接 coroutine.yield() 或 async.next_frame() 等到下一次 poll 再继续
+// async.worker(name, ...) 在 lua_worker_pool 的沙盒状态上调用全局函数 name 参数和返回值按 lua_pack 复制
+class lua_async {
+public:
+    lua_async() = default;
+    lua_async(const lua_async &) = delete;
+    lua_async &operator=(const lua_async &) = delete;
+
+    // 注册全局表 async
+    void init(lua_State *L);
+    // 恢复结果已就绪的协程 在主线程上调用
+    void poll();
+    // 等待所有后台任务结束并释放协程 必须在 lua 状态关闭之前调用
+    void shutdown();
+
+    size_t pending() const { return tasks.size(); }
+
+private:
+    struct task {
+        lua_State *co = nullptr;
+        int ref = -2;  // 协程在注册表中的引用 初始为 LUA_NOREF
+        job_counter counter;
+        bool hasJob = false;
+        bool finished = false;
+        bool ok = true;
+        bool packed = false;  // data 是 lua_pack 的数据 恢复时解包成多个返回值
+        std::string data;
+        std::string error;
+    };
+
+    static int l_spawn(lua_State *L);
+    static int l_next_frame(lua_State *co);
+    static int l_read_file(lua_State *co);
+    static int l_read_pack(lua_State *co);
+    static int l_stored_chunk_summary(lua_State *co);
+    static int l_worker(lua_State *co);
+
+    // 不在 async.spawn 的协程里时报错 要在构造任何 C++ 对象之前调用 luaL_error 会跳过析构
+    static void check_context(lua_State *co, const char *fn);
+    // 在当前协程上提交后台工作 work 在 worker 线程上填写 ok/data/error 然后让出协程
+    static int submit(lua_State *co, std::function<void(task &)> work, bool packed = false);
+    void resume(task *t, int nargs);
+
+    lua_State *L = nullptr;
+    std::vector<std::unique_ptr<task>> tasks;
+    task *current = nullptr;
+};
+
+}  // namespace ME
+
+#endif
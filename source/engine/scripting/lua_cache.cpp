@@ -0,0 +1,232 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_cache.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "engine/core/io/filesystem.h"
+#include "engine/core/job.h"
+#include "engine/utils/intern.hpp"
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+constexpr char CACHE_MAGIC[4] = {'M', 'E', 'L', 'C'};
+constexpr u32 CACHE_VERSION = 1;
+
+// 缓存文件头 之后紧跟 lua_dump 的字节码
+struct CacheHeader {
+    char magic[4];
+    u32 version;
+    u64 sourceHash;
+    u32 luaVersion;
+    u32 size;
+};
+
+ME_lua_cache_stats g_stats;
+
+std::string CachePath(std::string_view path) { return std::format("{0}/{1:016x}.luac", ME_fs_get_path("data/cache/luac"), InternHash(path)); }
+
+int DumpWriter(lua_State *, const void *p, size_t sz, void *ud) {
+    static_cast<std::string *>(ud)->append(static_cast<const char *>(p), sz);
+    return 0;
+}
+
+// 与 luaL_loadfile 一样跳过 UTF-8 BOM 和首行的 # 注释 保留换行使行号不变
+std::string_view SkipPrefix(std::string_view src) {
+    if (src.starts_with("\xEF\xBB\xBF")) src.remove_prefix(3);
+    if (src.starts_with("#")) {
+        size_t nl = src.find('\n');
+        src.remove_prefix(nl == std::string_view::npos ? src.size() : nl);
+    }
+    return src;
+}
+
+bool LoadCached(lua_State *L, const std::string &cachePath, u64 sourceHash, const char *chunkname) {
+    ME_fs_mapped_file cache;
+    if (!ME_fs_map_file(cachePath.c_str(), cache)) return false;
+
+    bool ok = false;
+    CacheHeader h;
+    if (cache.size >= sizeof(h)) {
+        memcpy(&h, cache.data, sizeof(h));
+        if (!memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) && h.version == CACHE_VERSION && h.sourceHash == sourceHash && h.luaVersion == LUA_VERSION_NUM &&
+            h.size == cache.size - sizeof(h)) {
+            // 字节码格式不符时 lua_load 会拒绝 按缓存失效处理
+            if (luaL_loadbufferx(L, cache.data + sizeof(h), h.size, chunkname, "b") == LUA_OK) {
+                ok = true;
+            } else {
+                lua_pop(L, 1);
+            }
+        }
+    }
+    ME_fs_unmap_file(cache);
+    return ok;
+}
+
+void StoreCached(lua_State *L, const std::string &cachePath, u64 sourceHash) {
+    std::string bytecode;
+    if (lua_dump(L, DumpWriter, &bytecode, 0) != 0 || bytecode.empty()) return;
+
+    std::error_code ec;
+    const std::filesystem::path target(cachePath);
+    std::filesystem::create_directories(target.parent_path(), ec);
+    if (ec) return;
+
+    CacheHeader h;
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.sourceHash = sourceHash;
+    h.luaVersion = LUA_VERSION_NUM;
+    h.size = (u32)bytecode.size();
+
+    // 先写临时文件再改名 中途退出不会留下半个缓存
+    const std::filesystem::path tmp = target.string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return;
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(bytecode.data(), (std::streamsize)bytecode.size());
+        if (!out) return;
+    }
+    std::filesystem::rename(tmp, target, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+// 缓存存在并且与源码一致 只看缓存文件头
+bool CacheFresh(const std::string &cachePath, u64 sourceHash) {
+    ME_fs_mapped_file cache;
+    if (!ME_fs_map_file(cachePath.c_str(), cache)) return false;
+
+    CacheHeader h;
+    bool fresh = false;
+    if (cache.size >= sizeof(h)) {
+        memcpy(&h, cache.data, sizeof(h));
+        fresh = !memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) && h.version == CACHE_VERSION && h.sourceHash == sourceHash && h.luaVersion == LUA_VERSION_NUM &&
+                h.size == cache.size - sizeof(h);
+    }
+    ME_fs_unmap_file(cache);
+    return fresh;
+}
+
+// 在单独的 lua_State 中编译 path 写入缓存 不执行 缓存已经是最新的时返回 false
+bool Precompile(const std::string &path) {
+    ME_fs_mapped_file source;
+    if (!ME_fs_map_file(path.c_str(), source)) return false;
+
+    const std::string_view src = SkipPrefix(std::string_view(source.data ? source.data : "", source.size));
+    const u64 sourceHash = InternHash(src);
+    const std::string cachePath = CachePath(path);
+    if (CacheFresh(cachePath, sourceHash)) {
+        ME_fs_unmap_file(source);
+        return false;
+    }
+
+    bool compiled = false;
+    if (lua_State *L = luaL_newstate()) {
+        const std::string chunkname = std::string("@") + path;
+        // 语法错误留给真正加载时报告
+        if (luaL_loadbufferx(L, src.data(), src.size(), chunkname.c_str(), "t") == LUA_OK) {
+            StoreCached(L, cachePath, sourceHash);
+            compiled = true;
+        }
+        lua_close(L);
+    }
+    ME_fs_unmap_file(source);
+    return compiled;
+}
+
+// package.searchers 的 Lua 文件搜索器 与默认的一样按 package.path 查找 返回 loader 和文件名
+int CachedSearcher(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, -3, "path");
+    lua_call(L, 2, 2);
+    if (lua_isnil(L, -2)) return 1;  // searchpath 的错误信息
+
+    const char *filename = lua_tostring(L, -2);
+    if (ME_lua_loadfile_cached(L, filename) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);
+    return 2;
+}
+
+}  // namespace
+
+int ME_lua_loadfile_cached(lua_State *L, const char *path) {
+    ME_fs_mapped_file source;
+    if (!ME_fs_map_file(path, source)) return luaL_loadfile(L, path);
+
+    const std::string_view src = SkipPrefix(std::string_view(source.data ? source.data : "", source.size));
+    const u64 sourceHash = InternHash(src);
+    const std::string chunkname = std::string("@") + path;
+    const std::string cachePath = CachePath(path);
+
+    if (LoadCached(L, cachePath, sourceHash, chunkname.c_str())) {
+        ME_fs_unmap_file(source);
+        g_stats.hits++;
+        return LUA_OK;
+    }
+
+    int result = luaL_loadbufferx(L, src.data(), src.size(), chunkname.c_str(), "t");
+    ME_fs_unmap_file(source);
+    if (result != LUA_OK) return result;
+
+    g_stats.misses++;
+    StoreCached(L, cachePath, sourceHash);
+    return LUA_OK;
+}
+
+void ME_lua_install_cache_searcher(lua_State *L) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    if (lua_istable(L, -1)) {
+        // [1] 为 preload [2] 为默认的 Lua 文件搜索器
+        lua_pushcfunction(L, CachedSearcher);
+        lua_rawseti(L, -2, 2);
+    }
+    lua_pop(L, 2);
+}
+
+u32 ME_lua_cache_prewarm(const char *dir) {
+    // 与 package.path 的 "{dir}/?.lua" 和 "{dir}/libs/?.lua" 展开后的路径相同 模块名中的 . 换成 LUA_DIRSEP
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().extension() != ".lua") continue;
+        std::string rel = std::filesystem::relative(it->path(), dir, ec).generic_string();
+        if (ec) continue;
+        std::string_view prefix = rel.starts_with("libs/") ? "libs/" : "";
+        std::string path = std::format("{0}/{1}", dir, prefix);
+        for (char c : std::string_view(rel).substr(prefix.size())) {
+            if (c == '/')
+                path += LUA_DIRSEP;
+            else
+                path += c;
+        }
+        files.push_back(std::move(path));
+    }
+
+    std::atomic<u32> compiled{0};
+    job::parallel_for((u32)files.size(), 1, [&](u32 i) {
+        if (Precompile(files[i])) compiled.fetch_add(1, std::memory_order_relaxed);
+    });
+    return compiled.load(std::memory_order_relaxed);
+}
+
+ME_lua_cache_stats ME_lua_cache_get_stats() { return g_stats; }
+
+}  // namespace ME
@@ -0,0 +1,35 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_CACHE_HPP
+#define ME_LUA_CACHE_HPP
+
+#include "engine/core/core.hpp"
+
+struct lua_State;
+
+namespace ME {
+
+// 按源文件内容哈希缓存的 Lua 字节码 存放在 data/cache/luac 每个源文件一个缓存文件
+// 内容哈希和字节码都相同时直接 luaL_loadbuffer 字节码 否则从源码编译并用 lua_dump 重新写入缓存
+// 字节码保留调试信息 报错的行号与源码一致 缓存目录不可写时只是每次都从源码编译
+
+// 与 luaL_loadfile 相同 成功时把编译好的函数压栈 失败时压入错误信息
+int ME_lua_loadfile_cached(lua_State *L, const char *path);
+
+// 用带缓存的加载替换 package.searchers 中默认的 Lua 文件搜索器 require 的模块也走缓存
+void ME_lua_install_cache_searcher(lua_State *L);
+
+// 把 dir 下所有的 .lua 文件编译进缓存 已经是最新的跳过 用 job::parallel_for 在所有 worker 上编译
+// 缓存按加载时的路径命名 dir 要与 package.path 中的脚本目录相同 返回新编译的文件数
+// 会写缓存文件 不能与 ME_lua_loadfile_cached 同时进行
+u32 ME_lua_cache_prewarm(const char *dir);
+
+struct ME_lua_cache_stats {
+    u32 hits = 0;
+    u32 misses = 0;
+};
+ME_lua_cache_stats ME_lua_cache_get_stats();
+
+}  // namespace ME
+
+#endif
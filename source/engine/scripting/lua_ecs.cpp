@@ -0,0 +1,433 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_ecs.hpp"
+
+#include <bit>
+#include <cstring>
+#include <new>
+
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+constexpr const char *LUA_ECS_CDEF = "typedef struct { uint32_t archetype, count; const uint32_t *entities; void *const *columns; } ME_EcsChunk;";
+constexpr const char *LUA_ECS_STORE = "ME_ecs_store";
+constexpr u32 INDEX_MASK = lua_ecs_store::MAX_ENTITIES - 1;
+constexpr u32 GENERATION_MASK = (1u << (32 - lua_ecs_store::INDEX_BITS)) - 1;
+
+constexpr u32 index_of(u32 entity) { return entity & INDEX_MASK; }
+
+}  // namespace
+
+int lua_ecs_store::define(const std::string &name, u32 size) {
+    auto found = byName.find(name);
+    if (found != byName.end()) {
+        component_info &c = components[found->second];
+        if (c.size == size) return found->second;
+        if (c.size != 0 || c.used) return -1;
+        c.size = size;
+        return found->second;
+    }
+    if (components.size() >= MAX_COMPONENTS) return -1;
+    const int id = (int)components.size();
+    components.push_back({name, size, false});
+    byName.emplace(name, id);
+    return id;
+}
+
+int lua_ecs_store::find(const std::string &name) const {
+    auto found = byName.find(name);
+    return found != byName.end() ? found->second : -1;
+}
+
+lua_ecs_store::record *lua_ecs_store::lookup(u32 entity) {
+    const u32 index = index_of(entity);
+    if (index >= records.size()) return nullptr;
+    record &r = records[index];
+    return r.alive && r.generation == (entity >> INDEX_BITS) ? &r : nullptr;
+}
+
+const lua_ecs_store::record *lua_ecs_store::lookup(u32 entity) const { return const_cast<lua_ecs_store *>(this)->lookup(entity); }
+
+u32 lua_ecs_store::archetype_of(mask m) {
+    auto found = byMask.find(m);
+    if (found != byMask.end()) return found->second;
+    const u32 id = (u32)archetypes.size();
+    archetypes.emplace_back().components = m;
+    byMask.emplace(m, id);
+    for (mask bits = m; bits; bits &= bits - 1) components[std::countr_zero(bits)].used = true;
+    return id;
+}
+
+u32 lua_ecs_store::create(mask m) {
+    u32 index;
+    if (!freeList.empty()) {
+        index = freeList.back();
+        freeList.pop_back();
+    } else {
+        if (records.size() >= MAX_ENTITIES) return 0;
+        index = (u32)records.size();
+        records.emplace_back();
+    }
+    const u32 to = archetype_of(m);
+    archetype &a = archetypes[to];
+    record &r = records[index];
+    const u32 entity = index | (r.generation << INDEX_BITS);
+    r.alive = true;
+    r.archetype = to;
+    r.row = (u32)a.entities.size();
+    a.entities.push_back(entity);
+    for (mask bits = m; bits; bits &= bits - 1) {
+        const int c = std::countr_zero(bits);
+        if (components[c].size) a.columns[c].resize(a.columns[c].size() + components[c].size);
+    }
+    livingCount++;
+    return entity;
+}
+
+void lua_ecs_store::remove_row(u32 id, u32 row) {
+    archetype &a = archetypes[id];
+    const u32 last = (u32)a.entities.size() - 1;
+    // 最后一行填到空出来的位置
+    if (row != last) {
+        a.entities[row] = a.entities[last];
+        records[index_of(a.entities[row])].row = row;
+    }
+    a.entities.pop_back();
+    for (mask bits = a.components; bits; bits &= bits - 1) {
+        const int c = std::countr_zero(bits);
+        const u32 size = components[c].size;
+        if (!size) continue;
+        std::vector<u8> &col = a.columns[c];
+        if (row != last) std::memcpy(col.data() + (size_t)row * size, col.data() + (size_t)last * size, size);
+        col.resize((size_t)last * size);
+    }
+}
+
+void lua_ecs_store::move(u32 index, u32 to) {
+    record &r = records[index];
+    const u32 from = r.archetype;
+    archetype &src = archetypes[from];
+    archetype &dst = archetypes[to];
+    const u32 row = (u32)dst.entities.size();
+    dst.entities.push_back(src.entities[r.row]);
+    for (mask bits = dst.components; bits; bits &= bits - 1) {
+        const int c = std::countr_zero(bits);
+        const u32 size = components[c].size;
+        if (!size) continue;
+        std::vector<u8> &col = dst.columns[c];
+        col.resize(col.size() + size);
+        if (src.components & ((mask)1 << c)) std::memcpy(col.data() + (size_t)row * size, src.columns[c].data() + (size_t)r.row * size, size);
+    }
+    remove_row(from, r.row);
+    r.archetype = to;
+    r.row = row;
+}
+
+bool lua_ecs_store::destroy(u32 entity) {
+    record *r = lookup(entity);
+    if (!r) return false;
+    remove_row(r->archetype, r->row);
+    r->alive = false;
+    // 代数回绕时跳过 0
+    r->generation = (r->generation + 1) & GENERATION_MASK;
+    if (!r->generation) r->generation = 1;
+    freeList.push_back(index_of(entity));
+    livingCount--;
+    return true;
+}
+
+bool lua_ecs_store::alive(u32 entity) const { return lookup(entity) != nullptr; }
+
+bool lua_ecs_store::add(u32 entity, int component) {
+    record *r = lookup(entity);
+    if (!r) return false;
+    const mask m = archetypes[r->archetype].components;
+    const mask bit = (mask)1 << component;
+    if (!(m & bit)) move(index_of(entity), archetype_of(m | bit));
+    return true;
+}
+
+bool lua_ecs_store::remove(u32 entity, int component) {
+    record *r = lookup(entity);
+    if (!r) return false;
+    const mask m = archetypes[r->archetype].components;
+    const mask bit = (mask)1 << component;
+    if (m & bit) move(index_of(entity), archetype_of(m & ~bit));
+    return true;
+}
+
+bool lua_ecs_store::has(u32 entity, int component) const {
+    const record *r = lookup(entity);
+    return r && (archetypes[r->archetype].components & ((mask)1 << component));
+}
+
+void *lua_ecs_store::get(u32 entity, int component) {
+    record *r = lookup(entity);
+    const u32 size = components[component].size;
+    if (!r || !size) return nullptr;
+    archetype &a = archetypes[r->archetype];
+    if (!(a.components & ((mask)1 << component))) return nullptr;
+    return a.columns[component].data() + (size_t)r->row * size;
+}
+
+bool lua_ecs_store::matches(const query &q, u32 node, mask m) const {
+    const filter_node &n = q.nodes[node];
+    switch (n.kind) {
+        case filter_node::ALL:
+            if ((m & n.leaves) != n.leaves) return false;
+            for (u32 c : n.children) {
+                if (!matches(q, c, m)) return false;
+            }
+            return true;
+        case filter_node::ANY:
+            if (m & n.leaves) return true;
+            for (u32 c : n.children) {
+                if (matches(q, c, m)) return true;
+            }
+            return false;
+        case filter_node::NO:
+            if (m & n.leaves) return false;
+            for (u32 c : n.children) {
+                if (matches(q, c, m)) return false;
+            }
+            return true;
+    }
+    return false;
+}
+
+u32 lua_ecs_store::compile(std::vector<filter_node> nodes) {
+    queries.emplace_back().nodes = std::move(nodes);
+    return (u32)queries.size() - 1;
+}
+
+const std::vector<lua_ecs_store::chunk> &lua_ecs_store::chunks(u32 id) {
+    query &q = queries[id];
+    // 原型只增不减 只检查上次之后出现的
+    for (; q.checked < archetypes.size(); q.checked++) {
+        if (matches(q, 0, archetypes[q.checked].components)) q.matched.push_back(q.checked);
+    }
+    q.out.clear();
+    for (u32 i : q.matched) {
+        archetype &a = archetypes[i];
+        if (a.entities.empty()) continue;
+        for (mask bits = a.components; bits; bits &= bits - 1) {
+            const int c = std::countr_zero(bits);
+            a.pointers[c] = a.columns[c].empty() ? nullptr : a.columns[c].data();
+        }
+        q.out.push_back({i, (u32)a.entities.size(), a.entities.data(), a.pointers.data()});
+    }
+    return q.out;
+}
+
+namespace {
+
+lua_ecs_store *check_store(lua_State *L) { return static_cast<lua_ecs_store *>(luaL_checkudata(L, 1, LUA_ECS_STORE)); }
+
+u32 check_entity(lua_State *L, int idx) { return (u32)luaL_checkinteger(L, idx); }
+
+int check_component(lua_State *L, lua_ecs_store *s, int idx) {
+    const lua_Integer c = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, c >= 0 && c < (lua_Integer)s->component_count(), idx, "unknown component");
+    return (int)c;
+}
+
+int l_new(lua_State *L) {
+    new (lua_newuserdata(L, sizeof(lua_ecs_store))) lua_ecs_store();
+    luaL_setmetatable(L, LUA_ECS_STORE);
+    return 1;
+}
+
+int l_gc(lua_State *L) {
+    check_store(L)->~lua_ecs_store();
+    return 0;
+}
+
+int l_define(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    const std::string name = luaL_checkstring(L, 2);
+    const lua_Integer size = luaL_optinteger(L, 3, 0);
+    luaL_argcheck(L, size >= 0, 3, "negative size");
+    const int id = s->define(name, (u32)size);
+    if (id < 0) return luaL_error(L, "ecs: cannot define component '%s' with size %d", name.c_str(), (int)size);
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+int l_component(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    const int id = s->find(luaL_checkstring(L, 2));
+    if (id < 0) return 0;
+    lua_pushinteger(L, id);
+    lua_pushinteger(L, s->size_of(id));
+    return 2;
+}
+
+int l_create(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_ecs_store::mask m = 0;
+    for (int i = 2; i <= lua_gettop(L); i++) m |= (lua_ecs_store::mask)1 << check_component(L, s, i);
+    const u32 e = s->create(m);
+    if (!e) return luaL_error(L, "ecs: too many entities");
+    lua_pushinteger(L, e);
+    return 1;
+}
+
+int l_destroy(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_pushboolean(L, s->destroy(check_entity(L, 2)));
+    return 1;
+}
+
+int l_alive(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_pushboolean(L, s->alive(check_entity(L, 2)));
+    return 1;
+}
+
+int l_add(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_pushboolean(L, s->add(check_entity(L, 2), check_component(L, s, 3)));
+    return 1;
+}
+
+int l_remove(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_pushboolean(L, s->remove(check_entity(L, 2), check_component(L, s, 3)));
+    return 1;
+}
+
+int l_has(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    lua_pushboolean(L, s->has(check_entity(L, 2), check_component(L, s, 3)));
+    return 1;
+}
+
+int l_get(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    void *p = s->get(check_entity(L, 2), check_component(L, s, 3));
+    if (!p) return 0;
+    lua_pushlightuserdata(L, p);
+    return 1;
+}
+
+int l_count(lua_State *L) {
+    lua_pushinteger(L, check_store(L)->living());
+    return 1;
+}
+
+// 组件名 组件 id 或 { type = "all" | "any" | "no", com_name_or_filters = { ... } }
+void parse_filter(lua_State *L, lua_ecs_store *s, int idx, std::vector<lua_ecs_store::filter_node> &nodes, u32 node, int depth) {
+    if (depth > 32) luaL_error(L, "ecs: filter nested too deep");
+    idx = lua_absindex(L, idx);
+    if (lua_type(L, idx) == LUA_TSTRING || lua_type(L, idx) == LUA_TNUMBER) {
+        int c;
+        if (lua_type(L, idx) == LUA_TNUMBER) {
+            c = check_component(L, s, idx);
+        } else {
+            c = s->define(lua_tostring(L, idx), 0);
+            if (c < 0) c = s->find(lua_tostring(L, idx));
+            if (c < 0) luaL_error(L, "ecs: too many components");
+        }
+        nodes[node].leaves |= (lua_ecs_store::mask)1 << c;
+        return;
+    }
+    luaL_checktype(L, idx, LUA_TTABLE);
+
+    lua_getfield(L, idx, "type");
+    const char *type = lua_tostring(L, -1);
+    lua_ecs_store::filter_node::kind_t kind;
+    if (type && std::strcmp(type, "all") == 0) {
+        kind = lua_ecs_store::filter_node::ALL;
+    } else if (type && std::strcmp(type, "any") == 0) {
+        kind = lua_ecs_store::filter_node::ANY;
+    } else if (type && std::strcmp(type, "no") == 0) {
+        kind = lua_ecs_store::filter_node::NO;
+    } else {
+        luaL_error(L, "ecs: unknown filter type '%s'", type ? type : "nil");
+        return;
+    }
+    lua_pop(L, 1);
+
+    // 嵌套在 all 里的 all 直接合并 其余的作为子节点
+    u32 target = node;
+    if (depth == 0) {
+        nodes[node].kind = kind;
+    } else if (kind != lua_ecs_store::filter_node::ALL || nodes[node].kind != lua_ecs_store::filter_node::ALL) {
+        target = (u32)nodes.size();
+        nodes.emplace_back().kind = kind;
+        nodes[node].children.push_back(target);
+    }
+
+    lua_getfield(L, idx, "com_name_or_filters");
+    luaL_checktype(L, -1, LUA_TTABLE);
+    const lua_Integer n = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= n; i++) {
+        lua_rawgeti(L, -1, i);
+        parse_filter(L, s, -1, nodes, target, depth + 1);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+int l_compile(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    luaL_checkany(L, 2);
+    std::vector<lua_ecs_store::filter_node> nodes(1);
+    parse_filter(L, s, 2, nodes, 0, 0);
+    lua_pushinteger(L, s->compile(std::move(nodes)));
+    return 1;
+}
+
+int l_chunks(lua_State *L) {
+    lua_ecs_store *s = check_store(L);
+    const lua_Integer q = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, q >= 0 && q < (lua_Integer)s->query_count(), 2, "unknown query");
+    const std::vector<lua_ecs_store::chunk> &out = s->chunks((u32)q);
+    lua_pushlightuserdata(L, (void *)out.data());
+    lua_pushinteger(L, (lua_Integer)out.size());
+    return 2;
+}
+
+}  // namespace
+
+int luaopen_ecs_store(lua_State *L) {
+    static_assert(sizeof(lua_ecs_store::chunk) == 8 + 2 * sizeof(void *), "ME_EcsChunk layout");
+    luaL_Reg methods[] = {
+            {"define", l_define},
+            {"component", l_component},
+            {"create", l_create},
+            {"destroy", l_destroy},
+            {"alive", l_alive},
+            {"add", l_add},
+            {"remove", l_remove},
+            {"has", l_has},
+            {"get", l_get},
+            {"count", l_count},
+            {"compile", l_compile},
+            {"chunks", l_chunks},
+            {NULL, NULL},
+    };
+    if (luaL_newmetatable(L, LUA_ECS_STORE)) {
+        luaL_newlib(L, methods);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, l_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+
+    luaL_Reg libs[] = {
+            {"new", l_new},
+            {NULL, NULL},
+    };
+    luaL_newlib(L, libs);
+    lua_pushstring(L, LUA_ECS_CDEF);
+    lua_setfield(L, -2, "cdef");
+    lua_pushinteger(L, lua_ecs_store::MAX_COMPONENTS);
+    lua_setfield(L, -2, "MAX_COMPONENTS");
+    return 1;
+}
+
+}  // namespace ME
@@ -0,0 +1,121 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_ECS_HPP
+#define ME_LUA_ECS_HPP
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+struct lua_State;
+
+namespace ME {
+
+// 脚本 ECS (data/scripts/ecs) 的原生存储 按原型分块 每个原型的每个组件是一段连续的 cdata 数组
+// 组件按名字注册 大小不为 0 的组件由脚本的 ffi 类型决定布局 大小为 0 的组件只记录有无 值留在 Lua 表里
+// 过滤条件编译成位掩码 每个查询缓存匹配的原型 新原型出现时只检查新的那部分
+// 增删组件和实体会移动行 指针只在下一次结构变化之前有效
+class lua_ecs_store {
+public:
+    static constexpr u32 MAX_COMPONENTS = 64;
+    // 实体 id 低 20 位为下标 高 12 位为代数 代数从 1 开始 所以 0 不是有效的 id
+    static constexpr u32 INDEX_BITS = 20;
+    static constexpr u32 MAX_ENTITIES = 1u << INDEX_BITS;
+
+    using mask = u64;
+
+    // 与 LUA_ECS_CDEF 中的 ME_EcsChunk 一致
+    struct chunk {
+        u32 archetype;
+        u32 count;
+        const u32 *entities;
+        void *const *columns;
+    };
+
+    struct archetype {
+        mask components = 0;
+        std::vector<u32> entities;
+        // 按组件 id 大小为 0 或不在原型中的组件没有数据
+        std::array<std::vector<u8>, MAX_COMPONENTS> columns;
+        std::array<void *, MAX_COMPONENTS> pointers{};
+    };
+
+    // 名字已存在时大小必须相同 只在过滤条件里出现过的无值组件可以改成有值 失败返回 -1
+    int define(const std::string &name, u32 size);
+    int find(const std::string &name) const;
+    u32 size_of(int component) const { return components[component].size; }
+    u32 component_count() const { return (u32)components.size(); }
+
+    u32 create(mask components);
+    bool destroy(u32 entity);
+    bool alive(u32 entity) const;
+    // 已有时什么也不做 新增的数据清零
+    bool add(u32 entity, int component);
+    bool remove(u32 entity, int component);
+    bool has(u32 entity, int component) const;
+    void *get(u32 entity, int component);
+    u32 living() const { return livingCount; }
+
+    // 过滤条件的节点 all 要求全部满足 any 至少一个 no 一个也没有 叶子合并进 leaves
+    struct filter_node {
+        enum kind_t : u8 { ALL, ANY, NO } kind = ALL;
+        mask leaves = 0;
+        std::vector<u32> children;
+    };
+
+    // nodes[0] 为根 返回查询 id
+    u32 compile(std::vector<filter_node> nodes);
+    // 非空的匹配原型 数组在下一次调用之前有效
+    const std::vector<chunk> &chunks(u32 query);
+    u32 query_count() const { return (u32)queries.size(); }
+
+private:
+    struct component_info {
+        std::string name;
+        u32 size = 0;
+        bool used = false;
+    };
+    struct record {
+        u32 archetype = 0;
+        u32 row = 0;
+        u32 generation = 1;
+        bool alive = false;
+    };
+    struct query {
+        std::vector<filter_node> nodes;
+        std::vector<u32> matched;
+        u32 checked = 0;
+        std::vector<chunk> out;
+    };
+
+    record *lookup(u32 entity);
+    const record *lookup(u32 entity) const;
+    u32 archetype_of(mask components);
+    void move(u32 index, u32 to);
+    void remove_row(u32 archetype, u32 row);
+    bool matches(const query &q, u32 node, mask m) const;
+
+    std::vector<component_info> components;
+    std::unordered_map<std::string, int> byName;
+    std::vector<archetype> archetypes;
+    std::unordered_map<mask, u32> byMask;
+    std::vector<record> records;
+    std::vector<u32> freeList;
+    std::vector<query> queries;
+    u32 livingCount = 0;
+};
+
+// require("_ME_ecs") 的 C 模块 脚本一般通过 data/scripts/ecs/entity_mgr.lua 使用
+// cdef: ME_EcsChunk 的 C 声明
+// new(): 新的存储 方法与 lua_ecs_store 对应
+//   define(name, size) component(name) create(id, ...) destroy(e) alive(e) add(e, id) remove(e, id) has(e, id) get(e, id) count()
+//   compile(filter): filter 为组件名 或 data/scripts/ecs/filter.lua 生成的表 没见过的名字注册为无值组件
+//   chunks(q): ME_EcsChunk 数组和个数
+int luaopen_ecs_store(lua_State *L);
+
+}  // namespace ME
+
+#endif
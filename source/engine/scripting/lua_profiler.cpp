@@ -0,0 +1,183 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#include "engine/core/profiler.hpp"
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+// 每次采样最多读取的栈深度 超出的外层丢弃
+constexpr int LUA_PROFILER_DEPTH = 32;
+
+lua_profiler *g_profiler = nullptr;
+
+}  // namespace
+
+lua_profiler::region::region() {
+    if (g_profiler) g_profiler->enter();
+}
+
+lua_profiler::region::~region() {
+    if (g_profiler) g_profiler->leave();
+}
+
+void lua_profiler::init(lua_State *L) {
+    this->L = L;
+    g_profiler = this;
+}
+
+void lua_profiler::shutdown() {
+    set_enabled(false, interval);
+    if (g_profiler == this) g_profiler = nullptr;
+    L = nullptr;
+}
+
+void lua_profiler::set_enabled(bool enabled, int interval) {
+    interval = std::max(interval, 1);
+    if (!L || (enabled == on && interval == this->interval)) return;
+    on = enabled;
+    this->interval = interval;
+    if (on) {
+        lua_sethook(L, hook, LUA_MASKCOUNT, interval);
+    } else {
+        lua_sethook(L, nullptr, 0, 0);
+    }
+}
+
+void lua_profiler::reset() {
+    for (function_stats &f : functions) {
+        f.samples = f.selfSamples = 0;
+        f.totalMs = f.selfMs = 0;
+    }
+    totalMs = 0;
+    totalSamples = 0;
+}
+
+std::vector<const lua_profiler::function_stats *> lua_profiler::sorted() const {
+    std::vector<const function_stats *> out;
+    for (const function_stats &f : functions) {
+        if (f.samples) out.push_back(&f);
+    }
+    std::sort(out.begin(), out.end(), [](const function_stats *a, const function_stats *b) { return a->selfMs > b->selfMs; });
+    return out;
+}
+
+void lua_profiler::hook(lua_State *L, lua_Debug *ar) {
+    // 关闭之前创建的协程仍然带着 hook
+    if (g_profiler && g_profiler->on && g_profiler->depth > 0) g_profiler->sample(L);
+}
+
+void lua_profiler::enter() {
+    if (depth++ > 0) return;
+    lastClock = ME_profiler_get_clock();
+    stack.clear();
+}
+
+void lua_profiler::leave() {
+    // init 之前进入的 region
+    if (depth == 0 || --depth > 0) return;
+    // 最后一次采样之后的时间记在最后的栈上 不计采样数
+    if (!stack.empty()) {
+        const u64 now = ME_profiler_get_clock();
+        const f64 ms = (f64)(now - lastClock) * 1000.0 / (f64)profiler_get_clock_frequency();
+        ++serial;
+        for (u32 id : stack) {
+            if (seenAt[id] == serial) continue;
+            seenAt[id] = serial;
+            functions[id].totalMs += ms;
+        }
+        functions[stack.back()].selfMs += ms;
+        totalMs += ms;
+    }
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) ME_profiler_end_scope(it->handle);
+    scopes.clear();
+    stack.clear();
+}
+
+u32 lua_profiler::function_id(lua_State *L, lua_Debug &ar) {
+    lua_getinfo(L, "Sf", &ar);
+    const bool c = ar.what[0] == 'C';
+    const void *key = c ? (const void *)lua_tocfunction(L, -1) : (const void *)ar.source;
+    lua_pop(L, 1);
+
+    // source 的字符串被回收后地址可能被别的文件重用 命中时再比较一次文件名
+    auto cached = byPointer.find({key, ar.linedefined});
+    if (cached != byPointer.end() && (c || functions[cached->second].source == ar.short_src)) return cached->second;
+
+    lua_getinfo(L, "n", &ar);
+    std::string name;
+    std::string unique;
+    if (c) {
+        name = std::format("[C] {0}", ar.name ? ar.name : "?");
+        unique = name;
+    } else {
+        unique = std::format("{0}:{1}", ar.short_src, ar.linedefined);
+        if (ar.what[0] == 'm') {
+            name = std::format("main ({0})", ar.short_src);
+        } else {
+            name = ar.name ? std::format("{0} ({1})", ar.name, unique) : unique;
+        }
+    }
+
+    auto found = byName.find(unique);
+    u32 id;
+    if (found != byName.end()) {
+        id = found->second;
+    } else {
+        id = (u32)functions.size();
+        function_stats &f = functions.emplace_back();
+        f.name = std::move(name);
+        f.source = ar.short_src;
+        f.line = ar.linedefined;
+        seenAt.push_back(0);
+        byName.emplace(std::move(unique), id);
+    }
+    byPointer[{key, ar.linedefined}] = id;
+    return id;
+}
+
+void lua_profiler::sample(lua_State *L) {
+    next.clear();
+    lua_Debug ar;
+    for (int level = 0; level < LUA_PROFILER_DEPTH && lua_getstack(L, level, &ar); level++) next.push_back(function_id(L, ar));
+    if (next.empty()) return;
+    std::reverse(next.begin(), next.end());
+
+    // 上一次采样到现在的时间记在这次的栈上
+    const u64 now = ME_profiler_get_clock();
+    const f64 ms = (f64)(now - lastClock) * 1000.0 / (f64)profiler_get_clock_frequency();
+    lastClock = now;
+    ++serial;
+    for (u32 id : next) {
+        if (seenAt[id] == serial) continue;
+        seenAt[id] = serial;
+        functions[id].samples++;
+        functions[id].totalMs += ms;
+    }
+    functions[next.back()].selfSamples++;
+    functions[next.back()].selfMs += ms;
+    totalMs += ms;
+    totalSamples++;
+
+    // 相同的外层保持打开
+    size_t common = 0;
+    while (common < scopes.size() && common < next.size() && scopes[common].function == next[common]) common++;
+    while (scopes.size() > common) {
+        ME_profiler_end_scope(scopes.back().handle);
+        scopes.pop_back();
+    }
+    for (size_t i = common; i < next.size(); i++) {
+        const function_stats &f = functions[next[i]];
+        scopes.push_back({next[i], ME_profiler_begin_scope(f.source.c_str(), f.line, f.name.c_str())});
+    }
+    stack.swap(next);
+}
+
+}  // namespace ME
@@ -0,0 +1,101 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_PROFILER_HPP
+#define ME_LUA_PROFILER_HPP
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+struct lua_State;
+struct lua_Debug;
+
+namespace ME {
+
+// Lua 的采样分析器 用 count hook 每隔 interval 条指令读取一次调用栈
+// 两次采样之间的时间记在前一次采样的栈上 按函数累计自身时间和包含时间
+// 在 region 内 采样的栈同时作为分析器的范围写入当前帧和 trace 与 C++ 的范围在同一条时间线上
+// 栈和上次采样相同的部分保持打开 不同的部分关闭后重新打开 region 结束时全部关闭
+// 只用于主线程的 Lua 状态 在打开之前创建的协程没有 hook 不会被采样
+class lua_profiler {
+public:
+    struct function_stats {
+        // "名字 (文件:行)" C 函数为 "[C] 名字"
+        std::string name;
+        std::string source;
+        int line = 0;
+        u64 samples = 0;
+        u64 selfSamples = 0;
+        f64 totalMs = 0;
+        f64 selfMs = 0;
+    };
+
+    // C++ 调用 Lua 的入口 (lua_callback::pcall scripting::update 中恢复协程) 可以嵌套
+    struct region {
+        region();
+        ~region();
+        region(const region &) = delete;
+        region &operator=(const region &) = delete;
+    };
+
+    void init(lua_State *L);
+    void shutdown();
+
+    // 每帧调用 和当前的设置相同时什么也不做
+    void set_enabled(bool enabled, int interval);
+    bool enabled() const { return on; }
+
+    // 按自身时间从大到小
+    std::vector<const function_stats *> sorted() const;
+    f64 total_ms() const { return totalMs; }
+    u64 total_samples() const { return totalSamples; }
+    void reset();
+
+private:
+    struct cache_key {
+        const void *source;
+        int line;
+        bool operator==(const cache_key &o) const { return source == o.source && line == o.line; }
+    };
+    struct cache_hash {
+        size_t operator()(const cache_key &k) const { return std::hash<const void *>()(k.source) ^ ((size_t)k.line * 0x9e3779b97f4a7c15ull); }
+    };
+    struct open_scope {
+        u32 function;
+        uintptr_t handle;
+    };
+
+    static void hook(lua_State *L, lua_Debug *ar);
+    void sample(lua_State *L);
+    u32 function_id(lua_State *L, lua_Debug &ar);
+    void enter();
+    void leave();
+
+    lua_State *L = nullptr;
+    bool on = false;
+    int interval = 0;
+
+    // function_stats 的地址作为范围的名字 不能移动
+    std::deque<function_stats> functions;
+    std::unordered_map<std::string, u32> byName;
+    std::unordered_map<cache_key, u32, cache_hash> byPointer;
+    std::vector<u64> seenAt;
+
+    // 上一次采样的栈 从外到内
+    std::vector<u32> stack;
+    std::vector<u32> next;
+    std::vector<open_scope> scopes;
+    u64 lastClock = 0;
+    u64 serial = 0;
+    int depth = 0;
+
+    f64 totalMs = 0;
+    u64 totalSamples = 0;
+};
+
+}  // namespace ME
+
+#endif
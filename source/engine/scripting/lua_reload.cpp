@@ -0,0 +1,274 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_reload.hpp"
+
+#include <cstring>
+#include <system_error>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/scripting/lua_cache.hpp"
+#include "engine/scripting/lua_wrapper_base.hpp"
+#include "engine/scripting/scripting.hpp"
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+// visited 记录已经合并过的表和函数 避免环和重复处理
+bool Visit(lua_State *L, int idx, int visited) {
+    lua_pushvalue(L, idx);
+    if (lua_rawget(L, visited) != LUA_TNIL) {
+        lua_pop(L, 1);
+        return false;
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, idx);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, visited);
+    return true;
+}
+
+void PatchTable(lua_State *L, int oldIdx, int newIdx, int visited);
+
+// 新函数的 upvalue 按名字连接到旧函数的同名 upvalue 函数类型的 upvalue 留用新版本 但继续连接它们自己的 upvalue
+void JoinUpvalues(lua_State *L, int newIdx, int oldIdx, int visited) {
+    newIdx = lua_absindex(L, newIdx);
+    oldIdx = lua_absindex(L, oldIdx);
+    if (lua_iscfunction(L, newIdx) || lua_iscfunction(L, oldIdx) || !Visit(L, newIdx, visited)) return;
+    luaL_checkstack(L, 4, "hot reload");
+
+    const char *name;
+    for (int i = 1; (name = lua_getupvalue(L, newIdx, i)) != nullptr; i++) {
+        if (!*name) {
+            lua_pop(L, 1);
+            continue;
+        }
+        int found = 0;
+        const char *oldName;
+        for (int j = 1; (oldName = lua_getupvalue(L, oldIdx, j)) != nullptr; j++) {
+            if (!strcmp(name, oldName)) {
+                found = j;
+                break;
+            }
+            lua_pop(L, 1);
+        }
+        if (!found) {
+            lua_pop(L, 1);
+            continue;
+        }
+        // 栈上 新值 旧值
+        const int newType = lua_type(L, -2);
+        const int oldType = lua_type(L, -1);
+        if (newType == LUA_TFUNCTION && oldType == LUA_TFUNCTION) {
+            JoinUpvalues(L, -2, -1, visited);
+        } else if (oldType != LUA_TFUNCTION) {
+            if (newType == LUA_TTABLE && oldType == LUA_TTABLE) PatchTable(L, -1, -2, visited);
+            lua_upvaluejoin(L, newIdx, i, oldIdx, found);
+        }
+        lua_pop(L, 2);
+    }
+}
+
+// 同一个位置上的旧值和新值 返回 true 表示保留旧值
+bool Merge(lua_State *L, int oldIdx, int newIdx, int visited) {
+    const int newType = lua_type(L, newIdx);
+    const int oldType = lua_type(L, oldIdx);
+    if (newType == LUA_TFUNCTION) {
+        if (oldType == LUA_TFUNCTION) JoinUpvalues(L, newIdx, oldIdx, visited);
+        return false;
+    }
+    if (newType == LUA_TTABLE && oldType == LUA_TTABLE) {
+        PatchTable(L, oldIdx, newIdx, visited);
+        return true;
+    }
+    return oldType != LUA_TNIL;
+}
+
+void PatchTable(lua_State *L, int oldIdx, int newIdx, int visited) {
+    oldIdx = lua_absindex(L, oldIdx);
+    newIdx = lua_absindex(L, newIdx);
+    if (lua_rawequal(L, oldIdx, newIdx) || !Visit(L, oldIdx, visited)) return;
+    luaL_checkstack(L, 6, "hot reload");
+
+    lua_pushnil(L);
+    while (lua_next(L, newIdx)) {
+        // 栈上 键 新值
+        lua_pushvalue(L, -2);
+        lua_rawget(L, oldIdx);
+        if (!Merge(L, -1, -2, visited)) {
+            lua_pushvalue(L, -3);
+            lua_pushvalue(L, -3);
+            lua_rawset(L, oldIdx);
+        }
+        lua_pop(L, 2);
+    }
+
+    if (lua_getmetatable(L, newIdx)) {
+        if (lua_getmetatable(L, oldIdx)) {
+            PatchTable(L, -1, -2, visited);
+            lua_pop(L, 2);
+        } else {
+            lua_setmetatable(L, oldIdx);
+        }
+    }
+}
+
+}  // namespace
+
+void lua_hot_reload::init(lua_State *state) {
+    L = state;
+    lastScan = std::chrono::steady_clock::now();
+}
+
+void lua_hot_reload::shutdown() {
+    modules.clear();
+    L = nullptr;
+}
+
+int lua_hot_reload::poll() {
+    if (!L) return 0;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastScan < interval) return 0;
+    lastScan = now;
+    return scan();
+}
+
+int lua_hot_reload::scan() {
+    std::vector<std::string> names;
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        if (lua_type(L, -2) == LUA_TSTRING) names.emplace_back(lua_tostring(L, -2));
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 2);
+
+    int reloaded = 0;
+    for (const std::string &name : names) {
+        std::error_code ec;
+        auto it = modules.find(name);
+        if (it == modules.end()) {
+            // 第一次看到的模块只记录修改时间 找不到源文件的 (C 模块 preload) 路径为空
+            module_file file{find_path(name.c_str()), {}};
+            if (!file.path.empty()) file.mtime = std::filesystem::last_write_time(file.path, ec);
+            modules.emplace(name, std::move(file));
+            continue;
+        }
+        module_file &file = it->second;
+        if (file.path.empty()) continue;
+        const auto mtime = std::filesystem::last_write_time(file.path, ec);
+        // 编辑器保存时文件可能暂时不存在 下次再检查
+        if (ec || mtime == file.mtime) continue;
+        file.mtime = mtime;
+        if (reload(name.c_str(), file.path)) reloaded++;
+    }
+    return reloaded;
+}
+
+bool lua_hot_reload::reload(const char *name) {
+    if (!L) return false;
+    std::string path = find_path(name);
+    if (path.empty()) {
+        METADOT_WARN("[LUA] hot reload: cannot find module ", name);
+        return false;
+    }
+    std::error_code ec;
+    modules[name] = module_file{path, std::filesystem::last_write_time(path, ec)};
+    return reload(name, path);
+}
+
+std::string lua_hot_reload::find_path(const char *name) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, -3, "path");
+    std::string path;
+    if (lua_pcall(L, 2, 1, 0) == LUA_OK && lua_type(L, -1) == LUA_TSTRING) path = lua_tostring(L, -1);
+    lua_pop(L, 2);
+    return path;
+}
+
+bool lua_hot_reload::reload(const char *name, const std::string &path) {
+    const int top = lua_gettop(L);
+    if (ME_lua_loadfile_cached(L, path.c_str()) != LUA_OK) {
+        print_error(L);
+        lua_settop(L, top);
+        return false;
+    }
+    const int chunk = top + 1;
+
+    // 执行前的全局表快照 执行后据此把全局表上的新值合并回旧值
+    lua_pushglobaltable(L);
+    const int G = top + 2;
+    lua_newtable(L);
+    const int snapshot = top + 3;
+    lua_pushnil(L);
+    while (lua_next(L, G)) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, snapshot);
+    }
+
+    // 与 require 一样传入模块名和文件名
+    lua_pushvalue(L, chunk);
+    lua_pushstring(L, name);
+    lua_pushstring(L, path.c_str());
+    const int result = ME_debug_pcall(L, 2, 1, 0);
+    if (result != LUA_OK) {
+        print_error(L, result);
+        lua_settop(L, snapshot);
+        // 执行到一半失败 恢复被改写的全局变量
+        lua_pushnil(L);
+        while (lua_next(L, snapshot)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, G);
+        }
+        lua_settop(L, top);
+        return false;
+    }
+    const int module = top + 4;
+    lua_newtable(L);
+    const int visited = top + 5;
+
+    lua_pushnil(L);
+    while (lua_next(L, snapshot)) {
+        // 栈上 键 旧值
+        lua_pushvalue(L, -2);
+        lua_rawget(L, G);
+        if (!lua_rawequal(L, -1, -2) && Merge(L, -2, -1, visited)) {
+            lua_pushvalue(L, -3);
+            lua_pushvalue(L, -3);
+            lua_rawset(L, G);
+        }
+        lua_pop(L, 2);
+    }
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    const int loaded = lua_gettop(L);
+    lua_getfield(L, loaded, name);
+    if (lua_istable(L, -1) && lua_istable(L, module)) {
+        PatchTable(L, -1, module, visited);
+    } else if (!lua_isnil(L, module)) {
+        lua_pushvalue(L, module);
+        lua_setfield(L, loaded, name);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, loaded, name);
+    if (lua_istable(L, -1) && lua_getfield(L, -1, "__reload") == LUA_TFUNCTION) {
+        lua_pushvalue(L, -2);
+        const int hook = ME_debug_pcall(L, 1, 0, 0);
+        if (hook != LUA_OK) print_error(L, hook);
+    }
+
+    lua_settop(L, top);
+    METADOT_INFO("[LUA] hot reloaded ", name);
+    return true;
+}
+
+}  // namespace ME
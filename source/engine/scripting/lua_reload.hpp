@@ -0,0 +1,51 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_RELOAD_HPP
+#define ME_LUA_RELOAD_HPP
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+struct lua_State;
+
+namespace ME {
+
+// Lua 模块的热重载
+// 定期检查 package.loaded 中能按 package.path 找到源文件的模块 文件修改时间变化后只重新执行这个模块
+// 重新执行的结果合并到旧的模块表和全局表上 已有的引用继续有效
+//   函数换成新版本 新函数与旧函数同名的非函数 upvalue 连接到旧值 模块内的 local 状态保留
+//   表递归合并 其他已有的值保留旧值 新增的键直接加入
+// 合并之后如果模块表有 __reload 函数 以模块表为参数调用
+class lua_hot_reload {
+public:
+    void init(lua_State *L);
+    void shutdown();
+
+    // 距离上次检查超过 interval 才检查文件 返回这次重载的模块数
+    int poll();
+    // 立即重载 name 不检查修改时间 失败时返回 false 并输出错误
+    bool reload(const char *name);
+
+    std::chrono::milliseconds interval{1000};
+
+private:
+    struct module_file {
+        std::string path;
+        std::filesystem::file_time_type mtime;
+    };
+
+    // 按 package.path 查找 name 的源文件 找不到时返回空串
+    std::string find_path(const char *name);
+    bool reload(const char *name, const std::string &path);
+    int scan();
+
+    lua_State *L = nullptr;
+    std::unordered_map<std::string, module_file> modules;
+    std::chrono::steady_clock::time_point lastScan{};
+};
+
+}  // namespace ME
+
+#endif
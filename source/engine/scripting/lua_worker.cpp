@@ -0,0 +1,325 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "lua_worker.hpp"
+
+#include <cstring>
+
+#include "engine/core/core.hpp"
+#include "engine/core/io/filesystem.h"
+#include "libs/lua/lua.hpp"
+
+namespace ME {
+
+namespace {
+
+enum PackTag : u8 {
+    TAG_NIL,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INTEGER,
+    TAG_NUMBER,
+    TAG_STRING,
+    TAG_POINTER,
+    TAG_TABLE,
+    TAG_END,
+};
+
+// 嵌套层数上限 同时拦住带环的表
+constexpr int MAX_PACK_DEPTH = 32;
+
+template <typename T>
+void Write(std::string &out, const T &v) {
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T>
+bool Read(const char *&p, const char *end, T &v) {
+    if ((size_t)(end - p) < sizeof(v)) return false;
+    memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+bool PackValue(lua_State *L, int idx, int depth, std::string &out, std::string &error) {
+    idx = lua_absindex(L, idx);
+    switch (lua_type(L, idx)) {
+        case LUA_TNIL:
+            out.push_back((char)TAG_NIL);
+            return true;
+        case LUA_TBOOLEAN:
+            out.push_back((char)(lua_toboolean(L, idx) ? TAG_TRUE : TAG_FALSE));
+            return true;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) {
+                out.push_back((char)TAG_INTEGER);
+                Write(out, (i64)lua_tointeger(L, idx));
+            } else {
+                out.push_back((char)TAG_NUMBER);
+                Write(out, (f64)lua_tonumber(L, idx));
+            }
+            return true;
+        case LUA_TSTRING: {
+            size_t len = 0;
+            const char *s = lua_tolstring(L, idx, &len);
+            if (len > UINT32_MAX) {
+                error = "string too large";
+                return false;
+            }
+            out.push_back((char)TAG_STRING);
+            Write(out, (u32)len);
+            out.append(s, len);
+            return true;
+        }
+        case LUA_TLIGHTUSERDATA:
+            out.push_back((char)TAG_POINTER);
+            Write(out, (u64)(uintptr_t)lua_touserdata(L, idx));
+            return true;
+        case LUA_TTABLE:
+            if (depth >= MAX_PACK_DEPTH) {
+                error = "table nested too deep or cyclic";
+                return false;
+            }
+            if (lua_getmetatable(L, idx)) {
+                lua_pop(L, 1);
+                error = "table with metatable";
+                return false;
+            }
+            luaL_checkstack(L, 3, "lua_pack");
+            out.push_back((char)TAG_TABLE);
+            lua_pushnil(L);
+            while (lua_next(L, idx)) {
+                if (!PackValue(L, -2, depth + 1, out, error) || !PackValue(L, -1, depth + 1, out, error)) {
+                    lua_pop(L, 2);
+                    return false;
+                }
+                lua_pop(L, 1);
+            }
+            out.push_back((char)TAG_END);
+            return true;
+        default:
+            error = std::string("cannot pass ") + luaL_typename(L, idx);
+            return false;
+    }
+}
+
+bool UnpackValue(lua_State *L, const char *&p, const char *end, int depth, std::string &error) {
+    u8 tag = 0;
+    if (!Read(p, end, tag)) {
+        error = "truncated data";
+        return false;
+    }
+    switch (tag) {
+        case TAG_NIL:
+            lua_pushnil(L);
+            return true;
+        case TAG_FALSE:
+        case TAG_TRUE:
+            lua_pushboolean(L, tag == TAG_TRUE);
+            return true;
+        case TAG_INTEGER: {
+            i64 v = 0;
+            if (!Read(p, end, v)) break;
+            lua_pushinteger(L, (lua_Integer)v);
+            return true;
+        }
+        case TAG_NUMBER: {
+            f64 v = 0;
+            if (!Read(p, end, v)) break;
+            lua_pushnumber(L, (lua_Number)v);
+            return true;
+        }
+        case TAG_STRING: {
+            u32 len = 0;
+            if (!Read(p, end, len) || (size_t)(end - p) < len) break;
+            lua_pushlstring(L, p, len);
+            p += len;
+            return true;
+        }
+        case TAG_POINTER: {
+            u64 v = 0;
+            if (!Read(p, end, v)) break;
+            lua_pushlightuserdata(L, (void *)(uintptr_t)v);
+            return true;
+        }
+        case TAG_TABLE: {
+            if (depth >= MAX_PACK_DEPTH) {
+                error = "table nested too deep";
+                return false;
+            }
+            luaL_checkstack(L, 3, "lua_unpack");
+            lua_newtable(L);
+            while (true) {
+                if (p < end && (u8)*p == TAG_END) {
+                    p++;
+                    return true;
+                }
+                if (!UnpackValue(L, p, end, depth + 1, error)) return false;
+                if (!UnpackValue(L, p, end, depth + 1, error)) return false;
+                if (lua_isnil(L, -2)) {
+                    error = "nil table key";
+                    return false;
+                }
+                lua_rawset(L, -3);
+            }
+        }
+        default:
+            error = "invalid tag";
+            return false;
+    }
+    error = "truncated data";
+    return false;
+}
+
+}  // namespace
+
+bool lua_pack(lua_State *L, int first, int count, std::string &out, std::string &error) {
+    first = lua_absindex(L, first);
+    out.clear();
+    for (int i = 0; i < count; i++) {
+        if (!PackValue(L, first + i, 0, out, error)) return false;
+    }
+    return true;
+}
+
+int lua_unpack(lua_State *L, const char *data, size_t size, std::string &error) {
+    const int top = lua_gettop(L);
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end) {
+        luaL_checkstack(L, 1, "lua_unpack");
+        if (!UnpackValue(L, p, end, 0, error)) {
+            lua_settop(L, top);
+            return -1;
+        }
+    }
+    return lua_gettop(L) - top;
+}
+
+void lua_worker_pool::init(lua_State *L) {
+    const luaL_Reg fns[] = {
+            {"load", l_load},
+            {NULL, NULL},
+    };
+    lua_newtable(L);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, fns, 1);
+    lua_setglobal(L, "workers");
+}
+
+void lua_worker_pool::shutdown() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (state *s : all) {
+        lua_close(s->L);
+        delete s;
+    }
+    all.clear();
+    idle.clear();
+    scripts.clear();
+}
+
+void lua_worker_pool::load(const std::string &path) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (const std::string &p : scripts) {
+        if (p == path) return;
+    }
+    scripts.push_back(path);
+}
+
+size_t lua_worker_pool::state_count() {
+    std::lock_guard<std::mutex> guard(lock);
+    return all.size();
+}
+
+lua_worker_pool::state *lua_worker_pool::acquire() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!idle.empty()) {
+        state *s = idle.back();
+        idle.pop_back();
+        return s;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) return nullptr;
+    const luaL_Reg libs[] = {
+            {LUA_GNAME, luaopen_base}, {LUA_COLIBNAME, luaopen_coroutine}, {LUA_TABLIBNAME, luaopen_table},
+            {LUA_STRLIBNAME, luaopen_string}, {LUA_MATHLIBNAME, luaopen_math}, {LUA_UTF8LIBNAME, luaopen_utf8},
+    };
+    for (const luaL_Reg &lib : libs) {
+        luaL_requiref(L, lib.name, lib.func, 1);
+        lua_pop(L, 1);
+    }
+    // 只能执行 load 传入的脚本
+    lua_pushnil(L);
+    lua_setglobal(L, "dofile");
+    lua_pushnil(L);
+    lua_setglobal(L, "loadfile");
+
+    state *s = new state;
+    s->L = L;
+    all.push_back(s);
+    return s;
+}
+
+void lua_worker_pool::release(state *s) {
+    std::lock_guard<std::mutex> guard(lock);
+    idle.push_back(s);
+}
+
+bool lua_worker_pool::sync_scripts(state *s, std::string &error) {
+    std::vector<std::string> pending;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (s->loaded >= scripts.size()) return true;
+        pending.assign(scripts.begin() + (std::ptrdiff_t)s->loaded, scripts.end());
+        s->loaded = scripts.size();
+    }
+    // 失败的脚本不再重试 只让这一次调用报错
+    bool ok = true;
+    for (const std::string &path : pending) {
+        if (luaL_loadfile(s->L, path.c_str()) != LUA_OK || lua_pcall(s->L, 0, 0, 0) != LUA_OK) {
+            if (ok) error = lua_tostring(s->L, -1);
+            METADOT_ERROR("[LUA] worker script ", path, ": ", lua_tostring(s->L, -1));
+            lua_pop(s->L, 1);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool lua_worker_pool::call(const char *name, const std::string &args, std::string &result, std::string &error) {
+    state *s = acquire();
+    if (!s) {
+        error = "cannot create worker state";
+        return false;
+    }
+
+    bool ok = sync_scripts(s, error);
+    lua_State *L = s->L;
+    const int top = lua_gettop(L);
+    if (ok) {
+        if (lua_getglobal(L, name) != LUA_TFUNCTION) {
+            error = std::string("worker function '") + name + "' is not defined";
+            ok = false;
+        }
+    }
+    if (ok) {
+        const int nargs = lua_unpack(L, args.data(), args.size(), error);
+        ok = nargs >= 0;
+        if (ok && lua_pcall(L, nargs, LUA_MULTRET, 0) != LUA_OK) {
+            error = lua_tostring(L, -1);
+            ok = false;
+        }
+        if (ok) ok = lua_pack(L, top + 1, lua_gettop(L) - top, result, error);
+    }
+    lua_settop(L, top);
+    release(s);
+    return ok;
+}
+
+int lua_worker_pool::l_load(lua_State *L) {
+    lua_worker_pool *self = static_cast<lua_worker_pool *>(lua_touserdata(L, lua_upvalueindex(1)));
+    self->load(ME_fs_get_path(luaL_checkstring(L, 1)));
+    return 0;
+}
+
+}  // namespace ME
@@ -0,0 +1,65 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_LUA_WORKER_HPP
+#define ME_LUA_WORKER_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct lua_State;
+
+namespace ME {
+
+// 把 L 上从 first 开始的 count 个值打包成纯数据
+// 支持 nil boolean number string lightuserdata 和由它们组成的表 (不支持环和元表) 失败时 error 为原因
+bool lua_pack(lua_State *L, int first, int count, std::string &out, std::string &error);
+// 把 lua_pack 的数据解包压栈 返回压入的值个数 失败时返回 -1 栈不变
+int lua_unpack(lua_State *L, const char *data, size_t size, std::string &error);
+
+// 在 worker 线程上运行纯函数的沙盒 Lua 状态池
+// 每个状态只打开 base coroutine table string math utf8 没有引擎绑定 io os package 和 dofile/loadfile
+// 与主状态之间只通过 lua_pack 的数据传递 字符串可以装二进制缓冲区 lightuserdata 原样传递指针
+// 调用时从空闲列表借一个状态 没有空闲的就新建 并发数受后台任务数限制
+class lua_worker_pool {
+public:
+    lua_worker_pool() = default;
+    lua_worker_pool(const lua_worker_pool &) = delete;
+    lua_worker_pool &operator=(const lua_worker_pool &) = delete;
+    ~lua_worker_pool() { shutdown(); }
+
+    // 注册全局表 workers 到主状态 L
+    void init(lua_State *L);
+    // 必须在没有任务使用状态时调用
+    void shutdown();
+
+    // 让所有 worker 状态执行脚本 path 已有的状态在下一次借出时补上
+    void load(const std::string &path);
+
+    // 借一个状态调用全局函数 name 可以在任意线程上调用
+    // args 和 result 都是 lua_pack 的数据 失败时返回 false error 为原因
+    bool call(const char *name, const std::string &args, std::string &result, std::string &error);
+
+    size_t state_count();
+
+private:
+    struct state {
+        lua_State *L = nullptr;
+        size_t loaded = 0;  // 已经执行过的 scripts 个数
+    };
+
+    state *acquire();
+    void release(state *s);
+    bool sync_scripts(state *s, std::string &error);
+
+    static int l_load(lua_State *L);
+
+    std::mutex lock;
+    std::vector<state *> all;
+    std::vector<state *> idle;
+    std::vector<std::string> scripts;
+};
+
+}  // namespace ME
+
+#endif
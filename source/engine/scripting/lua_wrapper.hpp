@@ -5572,6 +5572,114 @@ struct lua_type_traits<luacfunction> {
     }
 };
 
+namespace detail {
+// fast_function: arguments and results that are read/pushed directly with the lua C API
+template <typename T>
+struct is_fast_arg
+    : traits::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_same<T, const char *>::value ||
+                                              (std::is_pointer<T>::value && !std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value)> {};
+template <typename T>
+struct is_fast_result : traits::integral_constant<bool, std::is_void<T>::value || is_fast_arg<T>::value || std::is_same<T, std::string>::value> {};
+
+template <typename T>
+inline T fast_get(lua_State *state, int index) {
+    if constexpr (std::is_same<T, bool>::value) {
+        return lua_toboolean(state, index) != 0;
+    } else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+        int isnum = 0;
+        lua_Integer v = lua_tointegerx(state, index, &isnum);
+        // same truncation as lua_type_traits for non integral numbers
+        if (!isnum) v = static_cast<lua_Integer>(luaL_checknumber(state, index));
+        return static_cast<T>(v);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return static_cast<T>(luaL_checknumber(state, index));
+    } else if constexpr (std::is_same<T, const char *>::value) {
+        return luaL_checkstring(state, index);
+    } else {
+        // usertype pointer, no copy
+        return lua_type_traits<T>::get(state, index);
+    }
+}
+
+template <typename T>
+inline void fast_push(lua_State *state, const T &v) {
+    if constexpr (std::is_same<T, bool>::value) {
+        lua_pushboolean(state, v);
+    } else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+        lua_pushinteger(state, static_cast<lua_Integer>(v));
+    } else if constexpr (std::is_floating_point<T>::value) {
+        lua_pushnumber(state, static_cast<lua_Number>(v));
+    } else if constexpr (std::is_same<T, const char *>::value) {
+        lua_pushstring(state, v);
+    } else if constexpr (std::is_same<T, std::string>::value) {
+        lua_pushlstring(state, v.data(), v.size());
+    } else {
+        lua_type_traits<T>::push(state, v);
+    }
+}
+
+template <typename Sig>
+struct FastSignature;
+template <typename Ret, typename... Args>
+struct FastSignature<Ret (*)(Args...)> {
+    static_assert(is_fast_result<Ret>::value, "fast_function result must be void, arithmetic, enum, pointer, const char* or std::string");
+    static_assert((is_fast_arg<Args>::value && ...), "fast_function arguments must be arithmetic, enum, pointer or const char* passed by value");
+
+    template <typename Call, std::size_t... I>
+    static int invoke(lua_State *state, Call &call, std::index_sequence<I...>) {
+        if constexpr (std::is_void<Ret>::value) {
+            call(fast_get<Args>(state, int(I) + 1)...);
+            return 0;
+        } else {
+            fast_push<Ret>(state, call(fast_get<Args>(state, int(I) + 1)...));
+            return 1;
+        }
+    }
+    template <typename Call>
+    static int call(lua_State *state, Call call) {
+        try {
+            return invoke(state, call, std::index_sequence_for<Args...>());
+        } catch (std::exception &e) {
+            lua_pushstring(state, e.what());
+        } catch (...) {
+            lua_pushliteral(state, "Unknown exception");
+        }
+        return lua_error(state);
+    }
+};
+
+template <auto F>
+int fast_pointer_thunk(lua_State *state) {
+    return FastSignature<decltype(F)>::call(state, F);
+}
+template <typename F>
+int fast_functor_thunk(lua_State *state) {
+    return FastSignature<typename util::FunctionSignature<F>::type::c_function_type>::call(state, F());
+}
+}  // namespace detail
+
+/// @brief Bind a function with a POD signature as a plain lua_CFunction.
+/// Unlike lua_wrapper::function, nothing is allocated: no userdata, no metatable, no overload resolution.
+/// Arguments are read with lua_tointegerx/luaL_checknumber/luaL_checkstring, missing or wrong arguments raise a regular lua error.
+/// @code
+/// lua["add"] = lua_wrapper::fast_function<&add>();
+/// @endcode
+template <auto F>
+inline luacfunction fast_function() {
+    static_assert(std::is_pointer<decltype(F)>::value && std::is_function<typename std::remove_pointer<decltype(F)>::type>::value, "fast_function needs a function pointer");
+    return luacfunction(&detail::fast_pointer_thunk<F>);
+}
+
+/// @brief Bind a captureless lambda with a POD signature as a plain lua_CFunction.
+/// @code
+/// lua["width"] = lua_wrapper::fast_function([]() { return window_width(); });
+/// @endcode
+template <typename F>
+inline luacfunction fast_function(F) {
+    static_assert(std::is_empty<F>::value && std::is_default_constructible<F>::value, "fast_function needs a captureless lambda");
+    return luacfunction(&detail::fast_functor_thunk<F>);
+}
+
 /// @ingroup lua_type_traits
 /// @brief lua_type_traits for std::function or boost::function
 template <typename T>
@@ -7206,7 +7314,7 @@ void *AllocatorFunction(void *ud, void *ptr, size_t osize, size_t nsize) {
     if (nsize == 0) {
         allocator->deallocate(ptr, osize);
     } else if (ptr) {
-        return allocator->reallocate(ptr, nsize);
+        return allocator->reallocate(ptr, osize, nsize);
     } else {
         return allocator->allocate(nsize);
     }
@@ -7217,7 +7325,10 @@ struct DefaultAllocator {
     typedef void *pointer;
     typedef size_t size_type;
     pointer allocate(size_type n) { return std::malloc(n); }
-    pointer reallocate(pointer p, size_type n) { return std::realloc(p, n); }
+    pointer reallocate(pointer p, size_type osize, size_type n) {
+        ME_LUAWRAPPER_UNUSED(osize);
+        return std::realloc(p, n);
+    }
     void deallocate(pointer p, size_type n) {
         ME_LUAWRAPPER_UNUSED(n);
         std::free(p);
@@ -2,6 +2,8 @@
 
 #include "scripting.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
@@ -16,11 +18,13 @@
 #include "engine/core/core.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
+#include "engine/core/profiler.hpp"
 #include "engine/game.hpp"
 #include "engine/game_datastruct.hpp"
 #include "engine/meta/reflection.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/scripting/ffi/ffi.h"
+#include "engine/scripting/lua_cache.hpp"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/scripting/lua_wrapper_ext.hpp"
 #include "engine/scripting/wrap/wrap_engine.hpp"
@@ -226,6 +230,9 @@ static void InitLua(scripting *lc) {
                                    METADOT_RESLOC("data/scripts"), ME_fs_normalize_path_s(std::filesystem::current_path().string()).c_str(), "dll"),
                        lc->s_lua.globalTable());
 
+    // require 按 package.path 找到的 Lua 文件使用字节码缓存
+    ME_lua_install_cache_searcher(lc->L);
+
     ME_debug_setup(lc->L, "debugger", "dbg", NULL, NULL);
 
     metadot_bind_image(lc->L);
@@ -241,10 +248,11 @@ static void InitLua(scripting *lc) {
     ME_preload_auto(lc->L, ffi_module_open, "ffi");
     ME_preload_auto(lc->L, luaopen_lbind, "lbind");
 
-    lc->s_lua["METADOT_RESLOC"] = lua_wrapper::function([](const char *a) { return METADOT_RESLOC(a); });
+    // UI 脚本每帧频繁调用的绑定用 fast_function 直接生成 lua_CFunction
+    lc->s_lua["METADOT_RESLOC"] = lua_wrapper::fast_function([](const char *a) { return ME_fs_get_path(a); });
     lc->s_lua["GetSurfaceFromTexture"] = lua_wrapper::function([](TextureRef tex) { return tex->surface(); });
-    lc->s_lua["GetWindowH"] = lua_wrapper::function([]() { return the<engine>().eng()->windowHeight; });
-    lc->s_lua["GetWindowW"] = lua_wrapper::function([]() { return the<engine>().eng()->windowWidth; });
+    lc->s_lua["GetWindowH"] = lua_wrapper::fast_function([]() { return the<engine>().eng()->windowHeight; });
+    lc->s_lua["GetWindowW"] = lua_wrapper::fast_function([]() { return the<engine>().eng()->windowWidth; });
 
     lc->s_lua["SDL_FreeSurface"] = lua_wrapper::function(SDL_FreeSurface);
     lc->s_lua["R_SetImageFilter"] = lua_wrapper::function(R_SetImageFilter);
@@ -254,7 +262,7 @@ static void InitLua(scripting *lc) {
     lc->s_lua["LoadTexture"] = lua_wrapper::function(LoadTexture);
     // lc->s_lua["DestroyTexture"] = lua_wrapper::function(DestroyTexture);
     // lc->s_lua["CreateTexture"] = lua_wrapper::function(CreateTexture);
-    lc->s_lua["metadot_buildnum"] = lua_wrapper::function(ME_buildnum);
+    lc->s_lua["metadot_buildnum"] = lua_wrapper::fast_function<&ME_buildnum>();
     lc->s_lua["metadot_metadata"] = lua_wrapper::function(ME_metadata);
     lc->s_lua["add_packagepath"] = lua_wrapper::function(add_packagepath);
 
@@ -273,7 +281,7 @@ void run_script_in_console(scripting *_struct, const char *c) {
 void script_runfile(const char *filePath) {
     FUTIL_ASSERT_EXIST(filePath);
 
-    int result = luaL_loadfile(the<scripting>().L, METADOT_RESLOC(filePath));
+    int result = ME_lua_loadfile_cached(the<scripting>().L, METADOT_RESLOC(filePath));
     if (result != LUA_OK) {
         print_error(the<scripting>().L);
         return;
@@ -285,29 +293,191 @@ void script_runfile(const char *filePath) {
     }
 }
 
+lua_callback &lua_callback::operator=(lua_callback &&other) noexcept {
+    if (this != &other) {
+        release();
+        L = other.L;
+        name = other.name;
+        ref = other.ref;
+        other.ref = LUA_NOREF;
+    }
+    return *this;
+}
+
+void lua_callback::resolve() {
+    release();
+    if (!L || !name) return;
+    lua_getglobal(L, name);
+    if (lua_isfunction(L, -1)) {
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+        lua_pop(L, 1);
+    }
+}
+
+void lua_callback::release() {
+    if (L && ref != LUA_NOREF) luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    ref = LUA_NOREF;
+}
+
+bool lua_callback::operator()() const {
+    if (!push()) return true;
+    return pcall(0);
+}
+
+bool lua_callback::push() const {
+    if (ref == LUA_NOREF) return false;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    return true;
+}
+
+bool lua_callback::pcall(int nargs) const {
+    ME_profiler_scope_auto(name);
+    lua_profiler::region region;
+    int result = ME_debug_pcall(L, nargs, 0, 0);
+    if (result != LUA_OK) {
+        print_error(L, result);
+        return false;
+    }
+    return true;
+}
+
+void scripting::add_hook(script_hook hook, const char *name) {
+    auto &list = hooks[(int)hook];
+    for (const lua_callback &cb : list) {
+        if (!strcmp(cb.get_name(), name)) return;
+    }
+    list.emplace_back(L, name);
+}
+
+void scripting::run_hooks(script_hook hook) {
+    for (const lua_callback &cb : hooks[(int)hook]) cb();
+}
+
+void scripting::resolve_hooks() {
+    for (auto &list : hooks) {
+        for (lua_callback &cb : list) cb.resolve();
+    }
+}
+
 void scripting::init() {
     Timer timer;
     timer.start();
     InitLua(this);
+
+    // 引擎默认的脚本入口 game.lua 加载之后由 fast_load_lua 解析
+    add_hook(script_hook::Update, "OnUpdate");
+    add_hook(script_hook::Render, "OnRender");
+    add_hook(script_hook::Tick, "OnGameTickUpdate");
+    add_hook(script_hook::GUI, "OnGameGUIUpdate");
+    add_hook(script_hook::MaterialBatch, "OnMaterialBatch");
+    async.init(L);
+    workers.init(L);
+    hot_reload.init(L);
+    profiler.init(L);
+    s_lua["hot_reload"] = lua_wrapper::fast_function([](const char *name) { return the<scripting>().reload_module(name); });
     timer.stop();
-    METADOT_INFO(std::format("LuaLayer loading done in {0:.4f} ms", timer.get()).c_str());
+    const ME_lua_cache_stats stats = ME_lua_cache_get_stats();
+    METADOT_INFO(std::format("LuaLayer loading done in {0:.4f} ms ({1} cached {2} compiled)", timer.get(), stats.hits, stats.misses).c_str());
 }
 
-void scripting::end() {}
+void scripting::end() {
+    // 引用属于 L 必须在状态关闭之前释放
+    for (auto &list : hooks) list.clear();
+    async.shutdown();
+    // async 已经等待所有后台任务 worker 状态不再被使用
+    workers.shutdown();
+    hot_reload.shutdown();
+    profiler.shutdown();
+}
+
+bool scripting::fast_load_lua(std::string path) {
+    int result = ME_lua_loadfile_cached(L, path.c_str());
+    if (result == LUA_OK) result = ME_debug_pcall(L, 0, 0, 0);
+    if (result != LUA_OK) print_error(L, result);
+    resolve_hooks();
+    return result == LUA_OK;
+}
 
 void scripting::update() {
-    // luaL_loadstring(_struct->L, s_couroutineFileSrc.c_str());
-    // if (metadot_debug_pcall(_struct->L, 0, LUA_MULTRET, 0) != LUA_OK) {
-    //     print_error(_struct->L);
-    //     return;
-    // }
-    auto &luawrap = this->s_lua;
-    auto OnUpdate = luawrap["OnUpdate"];
-    OnUpdate();
+    {
+        lua_profiler::region region;
+        async.poll();
+    }
+    run_hooks(script_hook::Update);
+}
+
+void scripting::update_hot_reload() {
+    if (hot_reload.poll() > 0) resolve_hooks();
 }
 
-void scripting::update_render() { this->fast_call_func("OnRender")(); }
+bool scripting::reload_module(const char *name) {
+    const bool ok = hot_reload.reload(name);
+    if (ok) resolve_hooks();
+    return ok;
+}
+
+void scripting::update_render() { run_hooks(script_hook::Render); }
+
+void scripting::update_tick() { run_hooks(script_hook::Tick); }
 
-void scripting::update_tick() { this->fast_call_func("OnGameTickUpdate")(); }
+namespace {
+// Lua 默认的 gcpause 为 200 内存翻倍时才自动开始新一轮 空闲时提前在增长 25% 时开始
+constexpr f64 GC_IDLE_GROWTH = 1.25;
+}  // namespace
+
+size_t scripting::memory_bytes() const {
+    if (!L) return 0;
+    return (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+size_t scripting::collect_garbage() {
+    if (!L) return 0;
+    const size_t before = memory_bytes();
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    gcCycleKb = (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+    gcInCycle = false;
+    const size_t after = memory_bytes();
+    return before > after ? before - after : 0;
+}
+
+void scripting::update_gc(bool generational, int budget_us) {
+    if (!L) return;
+
+    if (!gcModeSet || gc.generational != generational) {
+        lua_gc(L, generational ? LUA_GCGEN : LUA_GCINC, 0, 0);
+        gc.generational = generational;
+        gcModeSet = true;
+        gcCycleKb = 0;
+        gcInCycle = false;
+    }
+
+    gc.frameSteps = 0;
+    gc.frameUs = 0;
+    gc.kb = (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+    ME_profiler_gauge("lua gc bytes", (i64)gc.kb * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+    if (budget_us <= 0) return;
+    if (!gcInCycle && (f64)gc.kb < (f64)gcCycleKb * GC_IDLE_GROWTH) return;
+
+    ME_profiler_scope_auto("LuaGC");
+
+    // 每次只做一个基本步 用完预算或者一轮结束就停下
+    const auto start = std::chrono::steady_clock::now();
+    gcInCycle = true;
+    for (;;) {
+        const bool finished = lua_gc(L, LUA_GCSTEP, 0) != 0;
+        gc.frameSteps++;
+        gc.frameUs = std::chrono::duration<f64, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (finished) {
+            gc.cycles++;
+            gcInCycle = false;
+            gcCycleKb = (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+            break;
+        }
+        if (gc.frameUs >= budget_us) break;
+    }
+    gc.kb = (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+    gc.maxFrameUs = std::max(gc.maxFrameUs, gc.frameUs);
+}
 
 }  // namespace ME
\ No newline at end of file
@@ -5,10 +5,17 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "engine/core/base_memory.h"
 #include "engine/core/macros.hpp"
 #include "engine/engine.hpp"
+#include "engine/scripting/lua_async.hpp"
+#include "engine/scripting/lua_profiler.hpp"
+#include "engine/scripting/lua_reload.hpp"
+#include "engine/scripting/lua_worker.hpp"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/utils/module.hpp"
 #include "engine/utils/utility.hpp"
@@ -63,9 +70,66 @@ void SaveLuaConfig(const T &_struct, const char *table_name, std::string &out) {
 void print_error(lua_State *state, int result = 0);
 void script_runfile(const char *filePath);
 
+// 锚定在注册表中的 Lua 全局函数引用 按名字解析一次 调用时直接 pcall 不再查找全局表
+// 全局函数可能被重新加载的脚本替换 scripting 在加载脚本之后对所有回调重新 resolve
+class lua_callback {
+public:
+    lua_callback() = default;
+    lua_callback(lua_State *L, const char *name) : L(L), name(name) { resolve(); }
+    ~lua_callback() { release(); }
+
+    lua_callback(const lua_callback &) = delete;
+    lua_callback &operator=(const lua_callback &) = delete;
+    lua_callback(lua_callback &&other) noexcept : L(other.L), name(other.name), ref(other.ref) { other.ref = LUA_NOREF; }
+    lua_callback &operator=(lua_callback &&other) noexcept;
+
+    // 全局变量不是函数时变为无效 调用什么也不做
+    void resolve();
+    void release();
+    bool valid() const { return ref != LUA_NOREF; }
+    const char *get_name() const { return name; }
+
+    // 出错时打印错误并返回 false
+    bool operator()() const;
+
+    // 带参数调用 先 push 压入函数 再压入 nargs 个参数 然后 pcall
+    // 无效时 push 不压入任何值并返回 false
+    bool push() const;
+    bool pcall(int nargs) const;
+
+private:
+    lua_State *L = nullptr;
+    const char *name = nullptr;  // 必须是字符串常量
+    int ref = LUA_NOREF;
+};
+
+// 引擎按顺序调用的脚本钩子 每个钩子可以挂多个全局函数
+// MaterialBatch 由 world::tick 对每个含有脚本材料的区块调用一次 见 world::tickScriptMaterials
+enum class script_hook { Update, Render, Tick, GUI, MaterialBatch, Count };
+
+// Lua 状态的分配器 小块走 ME_mem_pool 的分级池 不与模拟线程争用 malloc 的锁 计数见 ME_mem_pool_get_stats
+// Lua 只在主线程上运行 使用的是主线程的空闲链表
+struct lua_pool_allocator {
+    typedef void *pointer;
+    typedef size_t size_type;
+    pointer allocate(size_type n) { return ME_mem_pool_alloc(n); }
+    pointer reallocate(pointer p, size_type osize, size_type n) { return ME_mem_pool_realloc(p, osize, n); }
+    void deallocate(pointer p, size_type n) { ME_mem_pool_free(p, n); }
+};
+
+// scripting::update_gc 的统计 frame* 为最近一帧
+struct lua_gc_stats {
+    bool generational = false;
+    u32 frameSteps = 0;
+    f64 frameUs = 0;
+    f64 maxFrameUs = 0;
+    u64 cycles = 0;
+    size_t kb = 0;
+};
+
 class scripting : public module<scripting> {
 public:
-    lua_wrapper::State s_lua;
+    lua_wrapper::State s_lua{std::make_shared<lua_pool_allocator>()};
     lua_State *L = nullptr;
 
     struct {
@@ -81,16 +145,67 @@ public:
     void update_render();
     void update_tick();
 
+    // 渲染提交之后的空闲时间里按 budget_us 分步回收 在自动回收触发之前完成大部分工作 避免某一帧整轮回收
+    // generational 切换分代/增量模式 budget_us 小于等于 0 时完全交给 Lua 自动回收
+    void update_gc(bool generational, int budget_us);
+    const lua_gc_stats &get_gc_stats() const { return gc; }
+    // Lua 堆的当前大小
+    size_t memory_bytes() const;
+    // 立即完整回收一轮 返回释放的字节数
+    size_t collect_garbage();
+
+    // 脚本协程的异步任务 update 中恢复已完成的协程
+    lua_async async;
+    // async.worker 使用的沙盒 Lua 状态 脚本用 workers.load(path) 加载
+    lua_worker_pool workers;
+
+    // 检查 require 过的模块文件 有修改的模块就地重载 之后重新解析钩子
+    void update_hot_reload();
+    // 立即重载模块 name 脚本中为 hot_reload(name)
+    bool reload_module(const char *name);
+    lua_hot_reload hot_reload;
+
+    // 见 GlobalDEF::lua_profiler
+    lua_profiler profiler;
+
+    // 把全局函数 name 挂到钩子上 同名函数只挂一次 name 必须是字符串常量
+    void add_hook(script_hook hook, const char *name);
+    void run_hooks(script_hook hook);
+    // push_args 为每个回调压入 nargs 个参数
+    template <typename F>
+    void run_hooks(script_hook hook, int nargs, F &&push_args) {
+        for (const lua_callback &cb : hooks[(int)hook]) {
+            if (!cb.push()) continue;
+            push_args(L);
+            cb.pcall(nargs);
+        }
+    }
+    bool has_hooks(script_hook hook) const {
+        for (const lua_callback &cb : hooks[(int)hook]) {
+            if (cb.valid()) return true;
+        }
+        return false;
+    }
+    // 脚本重新定义全局函数之后调用
+    void resolve_hooks();
+
     ME_INLINE auto fast_call_func(std::string name) {
         auto &luawrap = this->s_lua;
         auto func = luawrap[name];
         return func;
     }
 
-    ME_INLINE bool fast_load_lua(std::string path) {
-        auto &luawrap = this->s_lua;
-        return luawrap.dofile(path);
-    }
+    // 经过字节码缓存加载并执行 path 为完整路径
+    bool fast_load_lua(std::string path);
+
+private:
+    std::vector<lua_callback> hooks[(int)script_hook::Count];
+
+    lua_gc_stats gc;
+    bool gcModeSet = false;
+    // 上一轮回收结束时的内存 增长超过 GC_IDLE_GROWTH 倍才在空闲时开始下一轮
+    size_t gcCycleKb = 0;
+    bool gcInCycle = false;
 };
 
 }  // namespace ME
@@ -1,4 +1,5 @@
 
+#include "engine/renderer/sdl_surface_utils.h"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/scripting/lua_wrapper_ext.hpp"
 #include "engine/ui/surface.h"
@@ -965,10 +966,75 @@ static int Limage_alpha(lua_State *L) {
     return 0;
 }
 
+/* pixel routines, on w * h * 4 byte RGBA strings as taken by image.rgba and image:update */
+
+static SDL_Surface *check_pixels(lua_State *L, int idx) {
+    int w = (int)luaL_checkinteger(L, idx);
+    int h = (int)luaL_checkinteger(L, idx + 1);
+    size_t len;
+    const char *data = luaL_checklstring(L, idx + 2, &len);
+    if (w <= 0 || h <= 0 || len < (size_t)w * h * 4) lbind_argferror(L, idx + 2, "expected %d bytes of pixels, got %d", w * h * 4, (int)len);
+    /* borrows the string, the result of every routine is a new surface */
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom((void *)data, w, h, 32, w * 4, SDL_PIXELFORMAT_RGBA32);
+    if (surface == NULL) luaL_error(L, "%s", SDL_GetError());
+    return surface;
+}
+
+static int push_pixels(lua_State *L, SDL_Surface *src, SDL_Surface *result) {
+    SDL_FreeSurface(src);
+    if (result != NULL && result->format->format != SDL_PIXELFORMAT_RGBA32) {
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(result, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(result);
+        result = converted;
+    }
+    if (result == NULL) return luaL_error(L, "%s", SDL_GetError());
+    luaL_Buffer b;
+    const size_t row = (size_t)result->w * 4, size = row * result->h;
+    char *out = luaL_buffinitsize(L, &b, size);
+    for (int y = 0; y < result->h; y++) memcpy(out + row * y, (const char *)result->pixels + (size_t)result->pitch * y, row);
+    SDL_FreeSurface(result);
+    luaL_pushresultsize(&b, size);
+    return 1;
+}
+
+static Uint8 color_channel(float c) { return (Uint8)(c < 0.0f ? 0.0f : c > 1.0f ? 255.0f : c * 255.0f + 0.5f); }
+
+static int Limage_grayscale(lua_State *L) {
+    SDL_Surface *src = check_pixels(L, 1);
+    return push_pixels(L, src, SurfaceBase::R_Surface_grayscale(src));
+}
+
+static int Limage_invert(lua_State *L) {
+    SDL_Surface *src = check_pixels(L, 1);
+    return push_pixels(L, src, SurfaceBase::R_Surface_invert(src));
+}
+
+static int Limage_recolor(lua_State *L) {
+    MEsurface_color color = check_color(L, 4);
+    float amount = (float)luaL_checknumber(L, 5);
+    SDL_Surface *src = check_pixels(L, 1);
+    return push_pixels(L, src, SurfaceBase::R_Surface_recolor(src, color_channel(color.r), color_channel(color.g), color_channel(color.b), amount));
+}
+
+static int Limage_removeColor(lua_State *L) {
+    MEsurface_color color = check_color(L, 4);
+    SDL_Surface *src = check_pixels(L, 1);
+    return push_pixels(L, src, SurfaceBase::R_Surface_remove_color_rgba(src, color_channel(color.r), color_channel(color.g), color_channel(color.b)));
+}
+
+static int Limage_flip(lua_State *L) {
+    static const char *opts[] = {"x", "y", "xy", NULL};
+    static const int flags[] = {SDL_FLIP_HORIZONTAL, SDL_FLIP_VERTICAL, SDL_FLIP_HORIZONTAL | SDL_FLIP_VERTICAL};
+    int flip = flags[luaL_checkoption(L, 4, "x", opts)];
+    SDL_Surface *src = check_pixels(L, 1);
+    return push_pixels(L, src, SurfaceBase::R_Surface_flip(src, flip));
+}
+
 static int opentype_image(lua_State *L) {
     luaL_Reg libs[] = {
 #define ENTRY(name) {#name, Limage_##name}
-            ENTRY(__gc), ENTRY(load), ENTRY(data), ENTRY(rgba), ENTRY(update), ENTRY(extent),
+            ENTRY(__gc),       ENTRY(load),   ENTRY(data),       ENTRY(rgba),       ENTRY(update), ENTRY(extent),
+            ENTRY(grayscale), ENTRY(invert), ENTRY(recolor),    ENTRY(removeColor), ENTRY(flip),
 #undef ENTRY
             {NULL, NULL}};
     luaL_Reg attrs[] = {
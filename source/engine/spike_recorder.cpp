@@ -0,0 +1,86 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "spike_recorder.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <format>
+
+#include "engine/core/const.h"
+#include "engine/core/frame_arena.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/core/job.h"
+#include "engine/core/profiler.hpp"
+#include "engine/game_utils/jsonwarp.h"
+#include "engine/utils/utility.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+void SpikeRecorder::update(const world *w, int thresholdMs) {
+    if (!w) {
+        warmup = WARMUP_FRAMES;
+        return;
+    }
+    if (warmup > 0) {
+        warmup--;
+        return;
+    }
+    if (thresholdMs <= 0 || count >= MAX_FILES) return;
+
+    profiler_frame frame;
+    ME_profiler_get_last_frame(&frame);
+    if (frame.m_CPUFrequency == 0 || frame.m_endtime <= frame.m_startTime) return;
+    const f64 frameMs = (f64)frame.m_prevFrameTime * 1000.0 / (f64)frame.m_CPUFrequency;
+    if (frameMs < (f64)thresholdMs) return;
+
+    const i64 now = ME_gettime();
+    if (lastWrite != 0 && now - lastWrite < COOLDOWN_MS) return;
+    lastWrite = now;
+
+    ME_profiler_scope_auto("SpikeRecord");
+    if (write(*w, frame, frameMs, thresholdMs)) {
+        count++;
+        METADOT_INFO(std::format("Frame spike {0:.1f} ms recorded to {1}", frameMs, lastPath).c_str());
+    } else {
+        // 目录不可写时不再尝试
+        count = MAX_FILES;
+        METADOT_WARN(std::format("Failed to record frame spike to {0}", lastPath).c_str());
+    }
+}
+
+bool SpikeRecorder::write(const world &w, const profiler_frame &frame, f64 frameMs, int thresholdMs) {
+    // 同一次运行的文件以启动后第一次记录的时间开头 排序后就是发生的顺序
+    if (session.empty()) session = ME_time_to_string();
+
+    const std::string dir = ME_fs_get_path("spikes");
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    lastPath = std::format("{0}/spike_{1}_{2:02}.json", dir, session, count);
+
+    const int liquid = w.liquidParticles ? w.liquidParticles->GetParticleCount() : 0;
+    const auto rect = [](Json::Writer &out, const MErect &r) { out.beginArray().value(r.x).value(r.y).value(r.w).value(r.h).endArray(); };
+    Json::Writer metadata;
+    metadata.beginObject();
+    metadata.member("version", METADOT_VERSION_TEXT);
+    metadata.member("time", ME_time_to_string());
+    metadata.member("frame_ms", std::round(frameMs * 1000.0) / 1000.0);
+    metadata.member("threshold_ms", thresholdMs);
+    metadata.member("world", w.worldName);
+    metadata.member("tick", w.tickCt);
+    metadata.member("loaded_chunks", (i64)w.chunkCache.size());
+    metadata.member("cells", (i64)w.cells.size());
+    metadata.member("liquid_particles", w.liquidParticles ? w.liquidParticles->GetParticleCount() : 0);
+    metadata.member("rigid_bodies", (i64)w.rigidBodies.size());
+    metadata.member("world_rigid_bodies", (i64)w.worldRigidBodies.size());
+    rect(metadata.key("tick_zone"), w.tickZone);
+    rect(metadata.key("load_zone"), w.loadZone);
+    metadata.member("job_workers", job::worker_count());
+    metadata.member("frame_arena_bytes", (i64)frame_arena::total_reserved());
+    metadata.member("dropped_scopes", (i64)ME_profiler_dropped_scopes());
+    metadata.endObject();
+
+    return ME_profiler_write_frame(&frame, lastPath.c_str(), metadata.str().c_str());
+}
+
+}  // namespace ME
@@ -0,0 +1,46 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_SPIKE_RECORDER_HPP
+#define ME_SPIKE_RECORDER_HPP
+
+#include <string>
+
+#include "engine/core/core.hpp"
+#include "engine/core/profiler.hpp"
+
+namespace ME {
+
+class world;
+
+// 帧时间尖峰记录 game::spikes
+// 每帧在 update_post (ME_profiler_begin_frame) 之后调用 刚合并的一帧超过阈值时
+// 把整帧的分析数据 计数器和世界概况写成 Chrome Trace JSON 放到 spikes 目录 玩家把文件发给我们就能看到卡在哪里
+// 与分析器的阈值和暂停无关 不需要打开分析器窗口
+class SpikeRecorder {
+public:
+    // 两次记录至少间隔的毫秒数 连续卡顿只记第一帧
+    static constexpr i64 COOLDOWN_MS = 5000;
+    // 每次运行最多写的文件数
+    static constexpr u32 MAX_FILES = 20;
+    // 进入游戏后跳过的帧数 刚加载完的几帧总是很慢
+    static constexpr u32 WARMUP_FRAMES = 60;
+
+    // w 为空 (不在游戏中) 时不记录 thresholdMs 小于等于 0 时不记录
+    void update(const world *w, int thresholdMs);
+
+    u32 written() const { return count; }
+    const std::string &last_path() const { return lastPath; }
+
+private:
+    bool write(const world &w, const profiler_frame &frame, f64 frameMs, int thresholdMs);
+
+    u32 count = 0;
+    u32 warmup = WARMUP_FRAMES;
+    i64 lastWrite = 0;
+    std::string session;
+    std::string lastPath;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,112 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "startup.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "engine/utils/utility.hpp"
+
+namespace ME {
+
+namespace {
+
+struct phase {
+    const char *name;
+    bool background;
+    u32 level;
+    f64 start;
+    f64 end;
+    f64 wait;
+    bool timed;
+};
+
+std::mutex g_mutex;
+std::vector<phase> g_phases;
+u32 g_depth = 0;  // 主线程上打开的阶段
+bool g_reported = false;
+
+phase *find_background(const char *name) {
+    for (phase &p : g_phases) {
+        if (p.background && !strcmp(p.name, name)) return &p;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+f64 StartupPhases::now_ms() {
+    using clock = std::chrono::steady_clock;
+    static const clock::time_point origin = clock::now();
+    return std::chrono::duration<f64, std::milli>(clock::now() - origin).count();
+}
+
+StartupPhases::scope::scope(const char *name, bool background) : name(name), background(background), level(background ? 0 : g_depth++), start(now_ms()) {}
+
+StartupPhases::scope::~scope() {
+    const f64 end = now_ms();
+    if (!background) g_depth--;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_reported) return;
+    // 同名的后台阶段 (并行的多个 job) 合并成从最早开始到最晚结束的一段
+    // 主线程可能在它们结束之前就开始等待 等待时间先记在没有计时的占位记录上
+    if (background) {
+        if (phase *p = find_background(name)) {
+            p->start = p->timed ? std::min(p->start, start) : start;
+            p->end = p->timed ? std::max(p->end, end) : end;
+            p->timed = true;
+            return;
+        }
+    }
+    g_phases.push_back({name, background, level, start, end, 0.0, true});
+}
+
+void StartupPhases::add_wait(const char *name, f64 ms) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_reported) return;
+    phase *p = find_background(name);
+    if (!p) {
+        g_phases.push_back({name, true, 0, 0.0, 0.0, 0.0, false});
+        p = &g_phases.back();
+    }
+    p->wait += ms;
+}
+
+void StartupPhases::wait(job_counter &counter, const char *name) {
+    if (counter.done()) return;
+    const f64 start = now_ms();
+    job::wait(counter);
+    add_wait(name, now_ms() - start);
+}
+
+void StartupPhases::report() {
+    const f64 total = now_ms();
+
+    std::vector<phase> phases;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_reported = true;
+        phases.swap(g_phases);
+    }
+
+    // 嵌套的阶段结束得早 按开始时间排回调用顺序
+    std::stable_sort(phases.begin(), phases.end(), [](const phase &a, const phase &b) { return a.start < b.start; });
+
+    METADOT_INFO(std::format("Startup finished in {0:.1f} ms", total).c_str());
+    for (const phase &p : phases) {
+        if (p.background) continue;
+        METADOT_INFO(std::format("  {0}{1:<{2}} {3:>9.1f} ms", std::string(p.level * 2, ' '), p.name, 28 - p.level * 2, p.end - p.start).c_str());
+    }
+    for (const phase &p : phases) {
+        if (!p.background || !p.timed) continue;
+        METADOT_INFO(std::format("  [job] {0:<22} {1:>9.1f} ms  at {2:.1f} ms  main thread waited {3:.1f} ms", p.name, p.end - p.start, p.start, p.wait).c_str());
+    }
+}
+
+}  // namespace ME
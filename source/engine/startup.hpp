@@ -0,0 +1,43 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_STARTUP_HPP
+#define ME_STARTUP_HPP
+
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+
+namespace ME {
+
+// 启动阶段计时 game::init 结束时 report 把各阶段的耗时写进日志
+// 主线程上的阶段可以嵌套 按开始的顺序列出 job 线程上的后台阶段 (解码 编译) 单独列出 并标出主线程等了它多久
+// 时间从第一次调用 now_ms 开始算
+class StartupPhases {
+public:
+    class scope {
+    public:
+        explicit scope(const char *name, bool background = false);
+        ~scope();
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+    private:
+        const char *name;
+        bool background;
+        u32 level;
+        f64 start;
+    };
+
+    static f64 now_ms();
+
+    // 主线程等待后台阶段的时间 计入 name 对应的后台阶段
+    static void add_wait(const char *name, f64 ms);
+    // job::wait 并把等待的时间计入 name
+    static void wait(job_counter &counter, const char *name);
+
+    // 只在主线程上调用 之后的记录不再输出
+    static void report();
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,313 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "stress_scene.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#include "engine/core/global.hpp"
+#include "engine/core/profiler.hpp"
+#include "engine/game_utils/rng.h"
+#include "engine/utils/utility.hpp"
+#include "game.hpp"
+#include "textures.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+const char *const StressNames[StressScene::COUNT] = {"none", "explosions", "flood", "debris", "fire", "traversal"};
+
+// explosions: 石块大小 每隔几个 tick 一批爆炸 每批的个数
+constexpr int BLOCK_W = 320, BLOCK_H = 160;
+constexpr u32 EXPLOSION_INTERVAL = 2;
+constexpr int EXPLOSIONS_PER_BATCH = 3;
+
+// flood: 一开始的水块 之后在前三分之一的 tick 里每 tick 从顶上补的行数
+constexpr int FLOOD_W = 360, FLOOD_H = 80;
+constexpr int FLOOD_ROWS_PER_TICK = 2;
+
+// debris: 刚体个数 每 tick 生成的个数
+constexpr u32 DEBRIS_BODIES = 500;
+constexpr u32 DEBRIS_PER_TICK = 25;
+
+// fire: 林地宽度 每隔多少 tick 在随机的树上重新点火
+constexpr int FOREST_W = 480;
+constexpr u32 REIGNITE_INTERVAL = 90;
+
+// traversal: 每 tick 移动的像素 转向间隔
+constexpr f32 TRAVERSAL_SPEED = 8.0f;
+constexpr u32 TRAVERSAL_TURN = 120;
+
+// 只往空气里填 不破坏地形
+void FillAir(world &w, int x0, int y0, int width, int height, MaterialInstance (*make)()) {
+    for (int y = y0; y < y0 + height; y++) {
+        for (int x = x0; x < x0 + width; x++) {
+            if (w.getTile(x, y).mat()->physicsType == PhysicsType::AIR) w.setTile(x, y, make());
+        }
+    }
+}
+
+MaterialInstance Solid(int x, int y, u32 color) {
+    MaterialInstance m = TilesCreate(GAME()->materials_list.GENERIC_SOLID.id, x, y);
+    m.color = color;
+    return m;
+}
+
+void Ignite(world &w, int x, int y) {
+    for (int yy = -1; yy <= 1; yy++) {
+        for (int xx = -1; xx <= 1; xx++) w.setTile(x + xx, y + yy, TilesCreateFire());
+    }
+}
+
+void SpawnDebris(world &w, FastRNG &rng, int x, int y) {
+    const int sw = 4 + rng.next() % 7, sh = 4 + rng.next() % 7;
+    C_Surface *sfc = SDL_CreateRGBSurfaceWithFormat(0, sw, sh, 32, SDL_PIXELFORMAT_ARGB8888);
+    const u32 base = 0x60 + rng.next() % 0x40;
+    for (int yy = 0; yy < sh; yy++) {
+        for (int xx = 0; xx < sw; xx++) {
+            const u32 c = base + rng.next() % 0x10;
+            ME_get_pixel(sfc, xx, yy) = 0xff000000 | (c << 16) | (c << 8) | (c - 0x10);
+        }
+    }
+
+    b2PolygonShape s;
+    s.SetAsBox(1, 1);
+    RigidBody *rb = w.makeRigidBody(b2_dynamicBody, (f32)x, (f32)y, (f32)(rng.next() % 360), s, 1, (f32)0.3, create_ref<Texture>(sfc));
+    w.rigidBodies.push_back(rb);
+    w.updateRigidBodyHitbox(rb);
+}
+
+}  // namespace
+
+const char *StressScene::name_of(kind k) { return StressNames[(k >= NONE && k < COUNT) ? k : NONE]; }
+
+StressScene::kind StressScene::from_name(const std::string &name) {
+    for (int k = NONE + 1; k < COUNT; k++) {
+        if (name == StressNames[k]) return (kind)k;
+    }
+    return NONE;
+}
+
+std::string StressScene::names() {
+    std::string s;
+    for (int k = NONE + 1; k < COUNT; k++) s += std::format("{0}{1}", k > NONE + 1 ? " " : "", StressNames[k]);
+    return s;
+}
+
+bool StressScene::open(int argc, char *argv[]) {
+    kind k = NONE;
+    u32 n = DEFAULT_TICKS;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--stress") && i + 1 < argc) {
+            k = from_name(argv[++i]);
+            if (k == NONE) METADOT_WARN(std::format("Unknown stress scene {0}, expected one of: {1}", argv[i], names()).c_str());
+        } else if (!strcmp(argv[i], "--stress-seed") && i + 1 < argc) {
+            hasSeed = true;
+            fixedSeed = (u32)strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--stress-ticks") && i + 1 < argc) {
+            n = (u32)std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "--stress-headless")) {
+            noRender = true;
+        }
+    }
+    if (k == NONE) return false;
+    return start(k, n, true);
+}
+
+bool StressScene::start(kind k, u32 n, bool exitWhenDone) {
+    if (k <= NONE || k >= COUNT) return false;
+    cur = k;
+    at = WAITING;
+    ticks = std::max(n, 1u);
+    waited = 0;
+    stepIndex = 0;
+    exitAfter = exitWhenDone;
+    done = false;
+    targets.clear();
+    frames = 0;
+    scopes.clear();
+    METADOT_INFO(std::format("Stress scene {0} queued for {1} ticks", name_of(k), ticks).c_str());
+    return true;
+}
+
+void StressScene::stop() {
+    cur = NONE;
+    targets.clear();
+    scopes.clear();
+}
+
+void StressScene::tick(game &g) {
+    if (cur == NONE) return;
+    world *w = g.Iso.world.get();
+    if (!w || g.state == LOADING) return;
+
+    if (at == WAITING) {
+        // 区块合并完之后再等一会 刚加载的区块还在落沙和流动
+        if (w->mergePending()) {
+            waited = 0;
+            return;
+        }
+        if (++waited < WARMUP_TICKS) return;
+        sceneSeed = RNG_Mix(w->simSeed, (u64)cur);
+        cx = (int)(w->tickZone.x + w->tickZone.w / 2);
+        cy = (int)(w->tickZone.y + w->tickZone.h / 2);
+        {
+            // TilesCreate* 的颜色变化也取自场景的种子
+            RNG_Scope rng(RNG_Mix(sceneSeed, 0x7365747570));
+            setup(*w);
+        }
+        at = RUNNING;
+        g.perfBench.start((int)ticks);
+        METADOT_INFO(std::format("Stress scene {0} started at tick {1} seed {2:#x}", name_of(cur), w->tickCt, sceneSeed).c_str());
+        return;
+    }
+
+    {
+        RNG_Scope rng(RNG_Mix(sceneSeed, (u64)stepIndex + 1));
+        step(*w);
+    }
+    if (++stepIndex >= ticks) {
+        report(*w);
+        if (exitAfter) done = true;
+        stop();
+    }
+}
+
+void StressScene::end_frame() {
+    if (cur == NONE || at != RUNNING) return;
+
+    profiler_frame frame;
+    ME_profiler_get_last_frame(&frame);
+    if (frame.m_CPUFrequency == 0) return;
+    const f64 toMs = 1000.0 / (f64)frame.m_CPUFrequency;
+    for (u32 i = 0; i < frame.m_numScopes; i++) {
+        const profiler_scope &s = frame.m_scopes[i];
+        if (!s.m_name || s.m_end <= s.m_start) continue;
+        scope_total &t = scopes[s.m_name];
+        t.ms += (f64)(s.m_end - s.m_start) * toMs;
+        t.count++;
+    }
+    frames++;
+}
+
+void StressScene::setup(world &w) {
+    FastRNG rng(sceneSeed);
+    switch (cur) {
+        case EXPLOSIONS: {
+            for (int y = cy - BLOCK_H / 2; y < cy + BLOCK_H / 2; y++) {
+                for (int x = cx - BLOCK_W / 2; x < cx + BLOCK_W / 2; x++) w.setTile(x, y, TilesCreateSmoothStone(x, y));
+            }
+            w.updateWorldMesh();
+            break;
+        }
+        case FLOOD:
+            FillAir(w, cx - FLOOD_W / 2, cy - FLOOD_H - BLOCK_H / 2, FLOOD_W, FLOOD_H, TilesCreateWater);
+            break;
+        case DEBRIS:
+            break;
+        case FIRE: {
+            const int ground = cy + BLOCK_H / 2;
+            for (int y = ground; y < ground + 6; y++) {
+                for (int x = cx - FOREST_W / 2; x < cx + FOREST_W / 2; x++) w.setTile(x, y, TilesCreateCobbleDirt(x, y));
+            }
+            for (int tx = cx - FOREST_W / 2 + 8; tx < cx + FOREST_W / 2 - 8; tx += 10 + rng.next() % 8) {
+                const int height = 24 + rng.next() % 24;
+                const int radius = 6 + rng.next() % 5;
+                const int top = ground - height;
+                for (int y = top; y < ground; y++) {
+                    for (int x = tx - 1; x <= tx + 1; x++) w.setTile(x, y, Solid(x, y, 0x6b4a2b));
+                }
+                for (int y = -radius; y <= radius; y++) {
+                    for (int x = -radius; x <= radius; x++) {
+                        if (x * x + y * y <= radius * radius) w.setTile(tx + x, top + y, Solid(tx + x, top + y, 0x2f7a2a + (u32)(rng.next() % 0x20) * 0x100));
+                    }
+                }
+                targets.push_back({tx, top});
+            }
+            w.updateWorldMesh();
+            // 从最左边的几棵树烧起
+            for (size_t i = 0; i < std::min<size_t>(targets.size(), 3); i++) Ignite(w, targets[i].first, targets[i].second);
+            break;
+        }
+        case TRAVERSAL:
+            dirX = rng.next() % 2 ? 1.0f : -1.0f;
+            dirY = 0.0f;
+            break;
+        default:
+            break;
+    }
+}
+
+void StressScene::step(world &w) {
+    FastRNG rng(RNG_Mix(sceneSeed, (u64)stepIndex + 1));
+    switch (cur) {
+        case EXPLOSIONS: {
+            if (stepIndex % EXPLOSION_INTERVAL != 0) break;
+            // 爆炸沿着石块从左往右推进
+            const int front = cx - BLOCK_W / 2 + (int)((u64)stepIndex * BLOCK_W / ticks);
+            world::Explosion batch[EXPLOSIONS_PER_BATCH];
+            for (world::Explosion &e : batch) {
+                e.x = front + rng.next() % 40 - 20;
+                e.y = cy - BLOCK_H / 2 + rng.next() % BLOCK_H;
+                e.radius = 8 + rng.next() % 17;
+            }
+            w.explosions(batch);
+            break;
+        }
+        case FLOOD:
+            if (stepIndex < ticks / 3) FillAir(w, cx - FLOOD_W / 2, cy - FLOOD_H - BLOCK_H / 2 - FLOOD_ROWS_PER_TICK, FLOOD_W, FLOOD_ROWS_PER_TICK, TilesCreateWater);
+            break;
+        case DEBRIS:
+            if (stepIndex * DEBRIS_PER_TICK >= DEBRIS_BODIES) break;
+            for (u32 i = 0; i < DEBRIS_PER_TICK; i++) SpawnDebris(w, rng, cx + rng.next() % 300 - 150, cy - BLOCK_H / 2 - rng.next() % 60);
+            break;
+        case FIRE:
+            if (stepIndex % REIGNITE_INTERVAL == REIGNITE_INTERVAL - 1 && !targets.empty()) {
+                const auto &t = targets[rng.next() % targets.size()];
+                Ignite(w, t.first, t.second);
+            }
+            break;
+        case TRAVERSAL: {
+            if (stepIndex % TRAVERSAL_TURN == TRAVERSAL_TURN - 1) {
+                dirX = -dirX;
+                dirY = (f32)(rng.next() % 61 - 30) / 100.0f;
+            }
+            const f32 dx = dirX * TRAVERSAL_SPEED, dy = dirY * TRAVERSAL_SPEED;
+            if (w.player) {
+                auto [pl_we, pl] = w.getHostPlayer();
+                pl_we->x += dx;
+                pl_we->y += dy;
+                pl_we->vx = pl_we->vy = 0;
+            } else {
+                GAME()->freeCamX += dx;
+                GAME()->freeCamY += dy;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void StressScene::report(const world &w) {
+    std::vector<std::pair<const std::string *, const scope_total *>> sorted;
+    sorted.reserve(scopes.size());
+    for (const auto &[name, t] : scopes) sorted.push_back({&name, &t});
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second->ms > b.second->ms; });
+
+    METADOT_INFO(std::format("Stress scene {0} finished: {1} ticks {2} frames, chunks {3} cells {4} rigid bodies {5}", name_of(cur), ticks, frames, w.chunkCache.size(), w.cells.size(),
+                             w.rigidBodies.size())
+                         .c_str());
+    // 各线程的同名作用域合计 worker 上的作用域可能超过帧时间
+    const f64 n = (f64)std::max(frames, 1u);
+    std::string s = "stress scopes, ms per frame summed over threads:";
+    for (size_t i = 0; i < std::min<size_t>(sorted.size(), REPORT_SCOPES); i++) {
+        s += std::format("\n  {0}: {1:.3f} ({2:.1f} calls)", *sorted[i].first, sorted[i].second->ms / n, sorted[i].second->count / n);
+    }
+    METADOT_INFO(s.c_str());
+}
+
+}  // namespace ME
@@ -0,0 +1,103 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_STRESS_SCENE_HPP
+#define ME_STRESS_SCENE_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+class game;
+class world;
+
+// 可重复的压力场景 game::stress 不用手动把场景玩到卡为止
+// 每个场景在 tickZone 中心附近布置 之后连续若干 tick 按种子施加同样的操作 结束时打印 tick 耗时和分析器各作用域的耗时
+//  explosions  实心石块里的连环爆炸
+//  flood       大片的水从上方灌下
+//  debris      500 个刚体碎块堆在一起
+//  fire        火从一侧烧过一片树林 没有木头材料 树用普通固体搭
+//  traversal   镜头或玩家快速来回移动 不断流式加载区块
+// 命令行 --stress <场景> [--stress-seed N] [--stress-ticks N] [--stress-headless] 在启动后的世界上运行 跑完退出
+// --stress-seed 同时作为世界的随机数种子 种子相同就得到同样的世界和操作
+// --stress-headless 仍然创建窗口和 GL 上下文 只跳过世界的绘制 完全无窗口的运行用 WorldBench --stress <场景> --seed N
+// 控制台 perf_stress <场景> <ticks> 在当前世界上运行 不退出 ticks 为 0 时用 DEFAULT_TICKS
+// tick 耗时交给 game::perfBench 统计 可以与 --record / --replay 同时使用 回放时种子取自录制
+class StressScene {
+public:
+    enum kind { NONE = 0, EXPLOSIONS, FLOOD, DEBRIS, FIRE, TRAVERSAL, COUNT };
+
+    static constexpr u32 DEFAULT_TICKS = 600;
+    // 开始布置之前等待的 tick 数 区块加载完之后再算
+    static constexpr u32 WARMUP_TICKS = 60;
+    // 报告中列出的作用域个数
+    static constexpr u32 REPORT_SCOPES = 16;
+
+    static const char *name_of(kind k);
+    // 不认识的名字返回 NONE
+    static kind from_name(const std::string &name);
+    // 所有场景的名字 以空格分隔
+    static std::string names();
+
+    // 在 Replay::open 之后 RNG_Create 之前调用
+    bool open(int argc, char *argv[]);
+    // RNG_Create 的种子 给了 --stress-seed 时使用它
+    u32 seed(u32 live) const { return hasSeed ? fixedSeed : live; }
+
+    // 在当前世界上开始 已经在运行时换成新的场景 exitWhenDone 时跑完让游戏退出
+    bool start(kind k, u32 ticks, bool exitWhenDone);
+    void stop();
+
+    // 每次 game::tick 之后调用
+    void tick(game &g);
+    // 每帧末调用 累计分析器刚合并的一帧的作用域耗时
+    void end_frame();
+
+    bool running() const { return cur != NONE; }
+    bool headless() const { return noRender && cur != NONE; }
+    // 命令行启动的场景跑完了
+    bool finished() const { return done; }
+
+private:
+    enum phase { WAITING, RUNNING };
+
+    struct scope_total {
+        f64 ms = 0.0;
+        u32 count = 0;
+    };
+
+    void setup(world &w);
+    void step(world &w);
+    void report(const world &w);
+
+    kind cur = NONE;
+    phase at = WAITING;
+    u32 ticks = DEFAULT_TICKS;
+    u32 waited = 0;
+    u32 stepIndex = 0;
+    bool exitAfter = false;
+    bool done = false;
+
+    // 命令行
+    bool hasSeed = false;
+    u32 fixedSeed = 0;
+    bool noRender = false;
+
+    // 场景的随机数 由世界种子和场景派生
+    u64 sceneSeed = 0;
+    // 场景中心 (real_tiles 坐标) 和移动的方向
+    int cx = 0, cy = 0;
+    f32 dirX = 1.0f, dirY = 0.0f;
+    // fire 的树冠中心
+    std::vector<std::pair<int, int>> targets;
+
+    u32 frames = 0;
+    std::unordered_map<std::string, scope_total> scopes;
+};
+
+}  // namespace ME
+
+#endif
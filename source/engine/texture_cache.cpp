@@ -0,0 +1,109 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "texture_cache.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "engine/core/io/filesystem.h"
+#include "engine/utils/intern.hpp"
+#include "libs/lz4/lz4.h"
+
+namespace ME {
+
+namespace {
+
+constexpr char CACHE_MAGIC[4] = {'M', 'E', 'T', 'C'};
+constexpr u32 CACHE_VERSION = 1;
+
+// 缓存文件头 之后紧跟 LZ4 压缩的像素 每行 width * 4 字节 没有填充
+struct CacheHeader {
+    char magic[4];
+    u32 version;
+    u64 sourceHash;
+    u32 pixelFormat;
+    u32 width;
+    u32 height;
+    u32 zipSize;
+};
+
+std::atomic<u32> g_hits{0};
+std::atomic<u32> g_misses{0};
+
+std::string CachePath(std::string_view path) { return std::format("{0}/{1:016x}.tex", ME_fs_get_path("data/cache/textures"), InternHash(path)); }
+
+}  // namespace
+
+C_Surface *ME_texture_cache_load(std::string_view path, u64 sourceHash, u32 pixelFormat) {
+    ME_fs_mapped_file cache;
+    if (!ME_fs_map_file(CachePath(path).c_str(), cache)) {
+        g_misses.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    C_Surface *surface = NULL;
+    CacheHeader h;
+    if (cache.size >= sizeof(h)) {
+        memcpy(&h, cache.data, sizeof(h));
+        if (!memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) && h.version == CACHE_VERSION && h.sourceHash == sourceHash && h.pixelFormat == pixelFormat &&
+            h.zipSize == cache.size - sizeof(h) && h.width > 0 && h.height > 0 && (u64)h.width * h.height * 4 <= INT32_MAX) {
+            surface = SDL_CreateRGBSurfaceWithFormat(0, (int)h.width, (int)h.height, 32, pixelFormat);
+            const int size = (int)(h.width * h.height * 4);
+            // 解压结果不完整时按缓存失效处理
+            if (surface && (surface->pitch != (int)h.width * 4 ||
+                            LZ4_decompress_safe(cache.data + sizeof(h), (char *)surface->pixels, (int)h.zipSize, size) != size)) {
+                SDL_FreeSurface(surface);
+                surface = NULL;
+            }
+        }
+    }
+    ME_fs_unmap_file(cache);
+
+    (surface ? g_hits : g_misses).fetch_add(1, std::memory_order_relaxed);
+    return surface;
+}
+
+void ME_texture_cache_store(std::string_view path, u64 sourceHash, const C_Surface *surface) {
+    if (!surface || surface->format->BytesPerPixel != 4 || surface->pitch != surface->w * 4) return;
+
+    const int size = surface->w * surface->h * 4;
+    std::vector<char> zip((size_t)LZ4_compressBound(size));
+    const int zipSize = LZ4_compress_default((const char *)surface->pixels, zip.data(), size, (int)zip.size());
+    if (zipSize <= 0) return;
+
+    std::error_code ec;
+    const std::filesystem::path target(CachePath(path));
+    std::filesystem::create_directories(target.parent_path(), ec);
+    if (ec) return;
+
+    CacheHeader h;
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.sourceHash = sourceHash;
+    h.pixelFormat = surface->format->format;
+    h.width = (u32)surface->w;
+    h.height = (u32)surface->h;
+    h.zipSize = (u32)zipSize;
+
+    // 先写临时文件再改名 中途退出不会留下半个缓存
+    const std::filesystem::path tmp = target.string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return;
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(zip.data(), zipSize);
+        if (!out) return;
+    }
+    std::filesystem::rename(tmp, target, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+ME_texture_cache_stats ME_texture_cache_get_stats() { return {g_hits.load(std::memory_order_relaxed), g_misses.load(std::memory_order_relaxed)}; }
+
+}  // namespace ME
@@ -0,0 +1,31 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_TEXTURE_CACHE_HPP
+#define ME_TEXTURE_CACHE_HPP
+
+#include <string_view>
+
+#include "engine/core/core.hpp"
+#include "engine/core/sdl_wrapper.h"
+
+namespace ME {
+
+// 按源文件内容哈希缓存解码好的贴图 存放在 data/cache/textures 每张贴图一个缓存文件
+// 缓存里是 LZ4 压缩的目标格式像素 字节序已经换好 命中时直接解压进 surface 不再经过 PNG/Aseprite 解码
+// 内容哈希或像素格式不同时按未命中处理 由调用者重新解码后写入 缓存目录不可写时只是每次都解码
+// 可以在 job 线程上调用 同一张贴图不要同时在两个线程上加载
+
+// 没有缓存或缓存已失效时返回 NULL
+C_Surface *ME_texture_cache_load(std::string_view path, u64 sourceHash, u32 pixelFormat);
+// 只缓存 32 位无填充的 surface
+void ME_texture_cache_store(std::string_view path, u64 sourceHash, const C_Surface *surface);
+
+struct ME_texture_cache_stats {
+    u32 hits = 0;
+    u32 misses = 0;
+};
+ME_texture_cache_stats ME_texture_cache_get_stats();
+
+}  // namespace ME
+
+#endif
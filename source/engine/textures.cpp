@@ -3,14 +3,23 @@
 #include "textures.hpp"
 
 #include <string.h>
+#include <format>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "engine/core/base_memory.h"
 #include "engine/core/core.hpp"
 #include "engine/core/io/filesystem.h"
+#include "engine/core/job.h"
+#include "engine/core/profiler.hpp"
 #include "engine/core/sdl_wrapper.h"
 #include "engine/engine.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "libs/external/stb_image.h"
+#include "engine/utils/intern.hpp"
+#include "startup.hpp"
+#include "texture_cache.hpp"
 
 #define CUTE_ASEPRITE_IMPLEMENTATION
 #include "libs/cute/cute_aseprite.h"
@@ -38,122 +47,227 @@ Texture::Texture(C_Surface *sur, bool init_image) noexcept {
     }
 }
 
+void Texture::update(const MErect *rect) {
+    if (!m_surface) return;
+
+    if (!m_image) {
+        m_image = R_CopyImageFromSurface(m_surface);
+        R_SetImageFilter(m_image, R_FILTER_NEAREST);
+        return;
+    }
+
+    R_UpdateImage(m_image, rect, m_surface, rect);
+}
+
 Texture::~Texture() {
     if (m_image) R_FreeImage(m_image);
     // SDL_FreeSurface(m_surface);
 }
 
+namespace {
+
+struct TextureEntry {
+    TextureRef TexturePack::*member;
+    const char *path;
+    bool aseprite;
+    bool initImage;
+};
+
+// InitTexture 加载的所有贴图 caveBG 和 testAse 只用 surface
+const TextureEntry TEXTURE_LIST[] = {
+        {&TexturePack::testTexture, "data/assets/textures/test.png", false, true},
+        {&TexturePack::dirt1Texture, "data/assets/textures/testDirt.png", false, true},
+        {&TexturePack::stone1Texture, "data/assets/textures/testStone.png", false, true},
+        {&TexturePack::smoothStone, "data/assets/textures/smooth_stone.png", false, true},
+        {&TexturePack::cobbleStone, "data/assets/textures/cobble_stone.png", false, true},
+        {&TexturePack::flatCobbleStone, "data/assets/textures/flat_cobble_stone.png", false, true},
+        {&TexturePack::smoothDirt, "data/assets/textures/smooth_dirt.png", false, true},
+        {&TexturePack::cobbleDirt, "data/assets/textures/cobble_dirt.png", false, true},
+        {&TexturePack::flatCobbleDirt, "data/assets/textures/flat_cobble_dirt.png", false, true},
+        {&TexturePack::softDirt, "data/assets/textures/soft_dirt.png", false, true},
+        {&TexturePack::cloud, "data/assets/textures/cloud.png", false, true},
+        {&TexturePack::gold, "data/assets/textures/gold.png", false, true},
+        {&TexturePack::goldMolten, "data/assets/textures/moltenGold.png", false, true},
+        {&TexturePack::goldSolid, "data/assets/textures/solidGold.png", false, true},
+        {&TexturePack::iron, "data/assets/textures/iron.png", false, true},
+        {&TexturePack::obsidian, "data/assets/textures/obsidian.png", false, true},
+        {&TexturePack::caveBG, "data/assets/backgrounds/testCave.png", false, false},
+        // Test aseprite
+        {&TexturePack::testAse, "data/assets/textures/Sprite-0003.ase", true, false},
+        {&TexturePack::testVacuum, "data/assets/objects/testVacuum.png", false, true},
+        {&TexturePack::testBucket, "data/assets/objects/testBucket.png", false, true},
+        {&TexturePack::testBucketFilled, "data/assets/objects/testBucket_fill.png", false, true},
+        {&TexturePack::testPickaxe, "data/assets/objects/testPickaxe.png", false, true},
+        {&TexturePack::testHammer, "data/assets/objects/testHammer.png", false, true},
+};
+constexpr size_t TEXTURE_COUNT = sizeof(TEXTURE_LIST) / sizeof(TEXTURE_LIST[0]);
+
+// 每张贴图一个 job 只有主线程读写 g_prefetchStarted
+C_Surface *g_prefetched[TEXTURE_COUNT]{};
+job_counter g_prefetchDone;
+bool g_prefetchStarted = false;
+
+// 解码完的贴图在这里排队 主线程在 PollTextureLoads 中按每帧的上限创建 image
+job_inbox g_uploads;
+// CancelTextureLoads 期间排队的结果只释放不创建
+bool g_cancelLoads = false;
+
+void StartTextureLoad(const std::string &path, bool aseprite, bool initImage, TextureReady ready) {
+    auto decode = [path, aseprite]() { return aseprite ? DecodeAsepriteSurface(path) : DecodeTextureSurface(path, SDL_PIXELFORMAT_ARGB8888); };
+    job::async(std::move(decode), nullptr, job_class::render).then_on(g_uploads, [path, initImage, ready = std::move(ready)](C_Surface *surface) {
+        if (g_cancelLoads) {
+            if (surface) SDL_FreeSurface(surface);
+            return;
+        }
+        TextureRef tex;
+        if (surface) {
+            tex = create_ref<Texture>(surface, initImage);
+        } else {
+            METADOT_ERROR("Unable to load texture ", path);
+        }
+        if (ready) ready(tex);
+    });
+}
+
+// stb_image 和 cute_aseprite 输出 R G B A 字节 转成 pixelFormat 的 32 位像素 src 和 dst 可以是同一块内存
+bool ConvertRGBAPixels(const u8 *src, u32 *dst, size_t count, u32 pixelFormat) {
+    if (pixelFormat == SDL_PIXELFORMAT_RGBA32) {
+        if ((const void *)src != (const void *)dst) memcpy(dst, src, count * 4);
+        return true;
+    }
+    if (pixelFormat != SDL_PIXELFORMAT_ARGB8888) return false;
+    for (size_t i = 0; i < count; i++) {
+        const u8 r = src[i * 4 + 0], g = src[i * 4 + 1], b = src[i * 4 + 2], a = src[i * 4 + 3];
+        dst[i] = ((u32)a << 24) | ((u32)r << 16) | ((u32)g << 8) | (u32)b;
+    }
+    return true;
+}
+
+}  // namespace
+
+void LoadTextureAsync(const std::string &path, TextureReady ready, bool init_image) { StartTextureLoad(path, false, init_image, std::move(ready)); }
+
+void LoadAsepriteTextureAsync(const std::string &path, TextureReady ready, bool init_image) { StartTextureLoad(path, true, init_image, std::move(ready)); }
+
+u32 PollTextureLoads(u32 maxUploads) {
+    if (g_uploads.pending() == 0) return 0;
+    ME_profiler_scope_auto("TextureUpload");
+    return g_uploads.run(maxUploads);
+}
+
+u32 PendingTextureLoads() { return g_uploads.pending(); }
+
+void CancelTextureLoads() {
+    g_cancelLoads = true;
+    g_uploads.wait();
+    g_uploads.run();
+    g_cancelLoads = false;
+}
+
+void PrefetchTextures() {
+    if (g_prefetchStarted) return;
+    g_prefetchStarted = true;
+    for (size_t i = 0; i < TEXTURE_COUNT; i++) {
+        job::execute(g_prefetchDone, [i]() {
+            StartupPhases::scope phase("Texture decode", true);
+            const TextureEntry &e = TEXTURE_LIST[i];
+            g_prefetched[i] = e.aseprite ? DecodeAsepriteSurface(e.path) : DecodeTextureSurface(e.path, SDL_PIXELFORMAT_ARGB8888);
+        });
+    }
+}
+
 void InitTexture(TexturePack &tex) {
-    tex.testTexture = LoadTexture("data/assets/textures/test.png");
-    tex.dirt1Texture = LoadTexture("data/assets/textures/testDirt.png");
-    tex.stone1Texture = LoadTexture("data/assets/textures/testStone.png");
-    tex.smoothStone = LoadTexture("data/assets/textures/smooth_stone.png");
-    tex.cobbleStone = LoadTexture("data/assets/textures/cobble_stone.png");
-    tex.flatCobbleStone = LoadTexture("data/assets/textures/flat_cobble_stone.png");
-    tex.smoothDirt = LoadTexture("data/assets/textures/smooth_dirt.png");
-    tex.cobbleDirt = LoadTexture("data/assets/textures/cobble_dirt.png");
-    tex.flatCobbleDirt = LoadTexture("data/assets/textures/flat_cobble_dirt.png");
-    tex.softDirt = LoadTexture("data/assets/textures/soft_dirt.png");
-    tex.cloud = LoadTexture("data/assets/textures/cloud.png");
-    tex.gold = LoadTexture("data/assets/textures/gold.png");
-    tex.goldMolten = LoadTexture("data/assets/textures/moltenGold.png");
-    tex.goldSolid = LoadTexture("data/assets/textures/solidGold.png");
-    tex.iron = LoadTexture("data/assets/textures/iron.png");
-    tex.obsidian = LoadTexture("data/assets/textures/obsidian.png");
-    tex.caveBG = LoadTextureInternal("data/assets/backgrounds/testCave.png", SDL_PIXELFORMAT_ARGB8888, false);
-
-    // Test aseprite
-    tex.testAse = LoadAsepriteTexture("data/assets/textures/Sprite-0003.ase", false);
-
-    tex.testVacuum = LoadTexture("data/assets/objects/testVacuum.png");
-    tex.testBucket = LoadTexture("data/assets/objects/testBucket.png");
-    tex.testBucketFilled = LoadTexture("data/assets/objects/testBucket_fill.png");
-    tex.testPickaxe = LoadTexture("data/assets/objects/testPickaxe.png");
-    tex.testHammer = LoadTexture("data/assets/objects/testHammer.png");
+    PrefetchTextures();
+    StartupPhases::wait(g_prefetchDone, "Texture decode");
+
+    // 创建 image 需要 GL 上下文 留在主线程
+    StartupPhases::scope phase("Texture upload");
+    for (size_t i = 0; i < TEXTURE_COUNT; i++) {
+        const TextureEntry &e = TEXTURE_LIST[i];
+        C_Surface *surface = std::exchange(g_prefetched[i], nullptr);
+        if (!surface) {
+            METADOT_ERROR("Unable to load texture ", e.path);
+            // 与 LoadTexture 和 LoadAsepriteTexture 一样 只有 aseprite 允许加载失败
+            ME_ASSERT(e.aseprite);
+            (tex.*e.member).reset();
+            continue;
+        }
+        tex.*e.member = create_ref<Texture>(surface, e.initImage);
+    }
+    // 重新初始化时再解码一次
+    g_prefetchStarted = false;
+
+    const ME_texture_cache_stats stats = ME_texture_cache_get_stats();
+    METADOT_INFO(std::format("Textures loaded ({0} cached {1} decoded)", stats.hits, stats.misses).c_str());
 }
 
 void EndTexture(TexturePack &tex) {
-    tex.testTexture.reset();
-    tex.dirt1Texture.reset();
-    tex.stone1Texture.reset();
-    tex.smoothStone.reset();
-    tex.cobbleStone.reset();
-    tex.flatCobbleStone.reset();
-    tex.smoothDirt.reset();
-    tex.cobbleDirt.reset();
-    tex.flatCobbleDirt.reset();
-    tex.softDirt.reset();
-    tex.cloud.reset();
-    tex.gold.reset();
-    tex.goldMolten.reset();
-    tex.goldSolid.reset();
-    tex.iron.reset();
-    tex.obsidian.reset();
-    tex.caveBG.reset();
-
-    tex.testAse.reset();
-
-    tex.testVacuum.reset();
-    tex.testBucket.reset();
-    tex.testBucketFilled.reset();
-    tex.testPickaxe.reset();
-    tex.testHammer.reset();
+    CancelTextureLoads();
+    for (const TextureEntry &e : TEXTURE_LIST) (tex.*e.member).reset();
 }
 
 TextureRef LoadTexture(const std::string &path) { return LoadTextureInternal(path, SDL_PIXELFORMAT_ARGB8888); }
 
-TextureRef LoadTextureInternal(const std::string &path, u32 pixelFormat, bool init_image) {
+static C_Surface *DecodeImageMemory(const u8 *bytes, size_t size, u32 pixelFormat) {
 
     // 可以在这里找到SDL相关函数
     // https://wiki.libsdl.org/SDL_CreateRGBSurfaceFrom
 
-    // 设置要求 stb_image 输出的颜色格式
-    // 如果不想/不需要 alpha 通道 则使用 STBI_rgb 而这里默认启用 alpha 通道
-    int req_format = STBI_rgb_alpha;
+    // 总是要求 stb_image 输出 RGBA 字节
     int width, height, orig_format;
-    unsigned char *data = stbi_load(METADOT_RESLOC(path), &width, &height, &orig_format, req_format);
-    if (data == NULL) {
-        METADOT_ERROR("Loading image failed: %s %s", stbi_failure_reason(), METADOT_RESLOC(path));
-    }
-
-    // 设置 RGB(A) 字节数组的像素格式颜色掩码
-    // 这里仅支持 STBI_rgb (3) 和 STBI_rgb_alpha (4)
-    u32 rmask, gmask, bmask, amask;
-
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-    int shift = (req_format == STBI_rgb) ? 8 : 0;
-    rmask = 0xff000000 >> shift;
-    gmask = 0x00ff0000 >> shift;
-    bmask = 0x0000ff00 >> shift;
-    amask = 0x000000ff >> shift;
-#else  // 小端 x86
-    rmask = 0x000000ff;
-    gmask = 0x0000ff00;
-    bmask = 0x00ff0000;
-    amask = (req_format == STBI_rgb) ? 0 : 0xff000000;
-#endif
-
-    int depth, pitch;
-    if (req_format == STBI_rgb) {
-        depth = 24;
-        pitch = 3 * width;  // 3 bytes per pixel * pixels per row
-    } else {                // STBI_rgb_alpha (RGBA)
-        depth = 32;
-        pitch = 4 * width;
+    unsigned char *data = stbi_load_from_memory(bytes, (int)size, &width, &height, &orig_format, STBI_rgb_alpha);
+    if (data == NULL) return NULL;
+
+    // 常用的格式就地换序 把 stb_image 的缓冲区直接交给 surface 不再整张复制一次
+    if (ConvertRGBAPixels(data, (u32 *)data, (size_t)width * height, pixelFormat)) {
+        C_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(data, width, height, 32, 4 * width, pixelFormat);
+        if (!surface) {
+            stbi_image_free(data);
+            return NULL;
+        }
+        // stb_image 用 SDL_malloc 分配 (libs/impl_build.cpp) 去掉 SDL_PREALLOC 后由 SDL_FreeSurface 释放
+        surface->flags &= ~SDL_PREALLOC;
+        return surface;
     }
 
-    C_Surface *loadedSurface = SDL_CreateRGBSurfaceFrom((void *)data, width, height, depth, pitch, rmask, gmask, bmask, amask);
-    C_Surface *loadedSurface_converted = SDL_ConvertSurfaceFormat(loadedSurface, pixelFormat, 0);
+    C_Surface *loadedSurface = SDL_CreateRGBSurfaceWithFormatFrom(data, width, height, 32, 4 * width, SDL_PIXELFORMAT_RGBA32);
+    C_Surface *loadedSurface_converted = loadedSurface ? SDL_ConvertSurfaceFormat(loadedSurface, pixelFormat, 0) : NULL;
 
     SDL_FreeSurface(loadedSurface);
+    stbi_image_free(data);
 
-    ME_ASSERT(loadedSurface_converted);
+    return loadedSurface_converted;
+}
 
-    TextureRef tex = create_ref<Texture>(loadedSurface_converted, init_image);
+static C_Surface *DecodeAsepriteMemory(const u8 *bytes, size_t size, u32 pixelFormat);
 
-    stbi_image_free(data);
+// 映射源文件 解码缓存命中时不经过 decode 未命中时解码后写入缓存
+static C_Surface *DecodeCached(const std::string &path, u32 pixelFormat, C_Surface *(*decode)(const u8 *, size_t, u32)) {
+    ME_fs_mapped_file source;
+    if (!ME_fs_map_file(METADOT_RESLOC(path), source)) return NULL;
+    if (!source.data || source.size > INT32_MAX) {
+        ME_fs_unmap_file(source);
+        return NULL;
+    }
+
+    const u64 sourceHash = InternHash(std::string_view(source.data, source.size));
+    C_Surface *surface = ME_texture_cache_load(path, sourceHash, pixelFormat);
+    if (!surface) {
+        surface = decode((const u8 *)source.data, source.size, pixelFormat);
+        if (surface) ME_texture_cache_store(path, sourceHash, surface);
+    }
+    ME_fs_unmap_file(source);
+    return surface;
+}
+
+C_Surface *DecodeTextureSurface(const std::string &path, u32 pixelFormat) { return DecodeCached(path, pixelFormat, DecodeImageMemory); }
+
+TextureRef LoadTextureInternal(const std::string &path, u32 pixelFormat, bool init_image) {
+    C_Surface *surface = DecodeTextureSurface(path, pixelFormat);
+    if (!surface) METADOT_ERROR("Loading image failed: %s %s", stbi_failure_reason(), METADOT_RESLOC(path));
+    ME_ASSERT(surface);
 
-    return tex;
+    return create_ref<Texture>(surface, init_image);
 }
 
 C_Surface *ScaleSurface(C_Surface *src, f32 x, f32 y) {
@@ -175,47 +289,41 @@ C_Surface *ScaleSurface(C_Surface *src, f32 x, f32 y) {
     return src;
 }
 
-TextureRef LoadAsepriteTexture(const std::string &path, bool init_image) {
-
-    ase_t *ase = cute_aseprite_load_from_file(METADOT_RESLOC(path), NULL);
-    if (NULL == ase) {
-        METADOT_ERROR("Unable to load ase ", path);
-        return nullptr;
-    }
-
-    ase_frame_t *frame = ase->frames;
-
-    SDL_PixelFormatEnum pixel_format;
-    // if (ase->bpp == 1) {
-    //     pixel_format = SDL_PIXELFORMAT_INDEX8;
-    // } else if (ase->bpp == 4) {
-    //     pixel_format = SDL_PIXELFORMAT_RGBA32;
-    // } else {
-    //     METADOT_ERROR("Aseprite %d BPP not supported!", ase->bpp);
-    // }
-    pixel_format = SDL_PIXELFORMAT_RGBA32;
-    int bpp = 4;
+C_Surface *DecodeAsepriteSurface(const std::string &path) { return DecodeCached(path, SDL_PIXELFORMAT_ARGB8888, DecodeAsepriteMemory); }
 
-    METADOT_BUG(std::format("Aseprite {0} {1}", ase->frame_count, ase->palette.entry_count).c_str());
+static C_Surface *DecodeAsepriteMemory(const u8 *bytes, size_t size, u32 pixelFormat) {
 
-    C_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(frame->pixels, ase->w * ase->frame_count, ase->h, bpp * 8, bpp * ase->w * ase->frame_count, pixel_format);
+    ase_t *ase = cute_aseprite_load_from_memory(bytes, (int)size, NULL);
+    if (NULL == ase) return NULL;
 
-    C_Surface *surface_converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    // cute_aseprite 把每一帧合成为单独的 RGBA 缓冲区 横向排成一条 直接写成 ARGB8888
+    // 以前按一整条读第一帧的缓冲区 多于一帧时越界
+    C_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, ase->w * ase->frame_count, ase->h, 32, pixelFormat);
 
-    SDL_FreeSurface(surface);
-
-    if (!surface_converted) METADOT_ERROR("Surface could not be created!, ", SDL_GetError());
-
-    SDL_SetPaletteColors(surface_converted->format->palette, (SDL_Color *)&ase->palette.entries, 0, ase->palette.entry_count);
+    if (surface) {
+        for (int f = 0; f < ase->frame_count; f++) {
+            const u8 *pixels = (const u8 *)ase->frames[f].pixels;
+            for (int y = 0; y < ase->h; y++) {
+                u32 *row = (u32 *)((u8 *)surface->pixels + (size_t)y * surface->pitch) + (size_t)f * ase->w;
+                ConvertRGBAPixels(pixels + (size_t)y * ase->w * 4, row, (size_t)ase->w, pixelFormat);
+            }
+        }
+    }
     // SDL_SetColorKey(surface, SDL_TRUE, ase->color_profile);
 
-    ME_ASSERT(surface_converted);
+    cute_aseprite_free(ase);
 
-    TextureRef tex = create_ref<Texture>(surface_converted, init_image);
+    return surface;
+}
 
-    cute_aseprite_free(ase);
+TextureRef LoadAsepriteTexture(const std::string &path, bool init_image) {
+    C_Surface *surface = DecodeAsepriteSurface(path);
+    if (!surface) {
+        METADOT_ERROR("Unable to load ase ", path);
+        return nullptr;
+    }
 
-    return tex;
+    return create_ref<Texture>(surface, init_image);
 }
 
 void RenderTextureRect(TextureRef tex, R_Target *target, int x, int y, MErect *clip) {
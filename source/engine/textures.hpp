@@ -3,6 +3,8 @@
 #ifndef ME_TEXTURES_HPP
 #define ME_TEXTURES_HPP
 
+#include <functional>
+
 #include "engine/core/core.hpp"
 #include "engine/core/sdl_wrapper.h"
 #include "engine/engine.hpp"
@@ -23,6 +25,9 @@ public:
 
     C_Surface *surface() const { return m_surface; }
     R_Image *image() const { return m_image; }
+
+    // surface 修改后把 rect 范围写回 image rect 为 NULL 时整张更新 还没有 image 时创建
+    void update(const MErect *rect = nullptr);
 };
 
 // 贴图引用
@@ -55,9 +60,30 @@ struct TexturePack {
     TextureRef testBucketFilled;
 };
 
+// 启动时提前在 job 线程上解码 TexturePack 的所有贴图 只解码不创建 image
+// InitTexture 等待解码完成后在主线程上创建 image 没有调用过 PrefetchTextures 时由 InitTexture 自己开始
+void PrefetchTextures();
 void InitTexture(TexturePack &tex);
 void EndTexture(TexturePack &tex);
 
+// Decode 系列只生成 surface 不碰 GL 可以在任意线程上调用 失败时返回 NULL
+// ARGB8888 和 RGBA32 直接解码成目标格式 其他格式多转换一次
+C_Surface *DecodeTextureSurface(const std::string &path, u32 pixelFormat);
+C_Surface *DecodeAsepriteSurface(const std::string &path);
+
+// 异步加载 在 job 线程上解码成 ARGB8888 主线程在 PollTextureLoads 里创建 image 后调用 ready
+// 解码失败时 ready 收到空的 TextureRef 只能在主线程上调用
+using TextureReady = std::function<void(TextureRef)>;
+void LoadTextureAsync(const std::string &path, TextureReady ready, bool init_image = true);
+void LoadAsepriteTextureAsync(const std::string &path, TextureReady ready, bool init_image = true);
+// 每帧最多上传的贴图数 解码好的贴图很多时分几帧上传
+constexpr u32 TEXTURE_UPLOADS_PER_FRAME = 8;
+// 主线程每帧调用 按解码完成的顺序处理 返回本次完成的数量
+u32 PollTextureLoads(u32 maxUploads = TEXTURE_UPLOADS_PER_FRAME);
+u32 PendingTextureLoads();
+// 等待还在解码的 job 丢弃结果 不调用 ready EndTexture 时调用
+void CancelTextureLoads();
+
 TextureRef LoadTexture(const std::string &path);
 TextureRef LoadTextureInternal(const std::string &path, u32 pixelFormat, bool init_image = true);
 C_Surface *ScaleSurface(C_Surface *src, f32 x, f32 y);
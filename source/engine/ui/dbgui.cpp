@@ -18,6 +18,7 @@
 #include "engine/core/const.h"
 #include "engine/core/core.hpp"
 #include "engine/core/dbgtools.h"
+#include "engine/core/frame_arena.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
 #include "engine/core/macros.hpp"
@@ -29,6 +30,7 @@
 #include "engine/meta/reflection.hpp"
 #include "engine/meta/static_relfection.hpp"
 #include "engine/npc.hpp"
+#include "engine/perf_console.hpp"
 #include "engine/reflectionflat.hpp"
 #include "engine/renderer/gpu.hpp"
 #include "engine/renderer/renderer_gpu.h"
@@ -127,8 +129,8 @@ void DrawDebugUI(game *game) {
     if (ImGui::Checkbox("Draw Background", &global.game->Iso.globaldef.draw_background)) {
         for (int x = 0; x < game->Iso.world->width; x++) {
             for (int y = 0; y < game->Iso.world->height; y++) {
-                game->Iso.world->dirty[x + y * game->Iso.world->width] = true;
-                game->Iso.world->layer2Dirty[x + y * game->Iso.world->width] = true;
+                game->Iso.world->dirty.mark(x + y * game->Iso.world->width);
+                game->Iso.world->layer2Dirty.mark(x + y * game->Iso.world->width);
             }
         }
     }
@@ -136,39 +138,30 @@ void DrawDebugUI(game *game) {
     if (ImGui::Checkbox("Draw Background Grid", &global.game->Iso.globaldef.draw_background_grid)) {
         for (int x = 0; x < game->Iso.world->width; x++) {
             for (int y = 0; y < game->Iso.world->height; y++) {
-                game->Iso.world->dirty[x + y * game->Iso.world->width] = true;
-                game->Iso.world->layer2Dirty[x + y * game->Iso.world->width] = true;
+                game->Iso.world->dirty.mark(x + y * game->Iso.world->width);
+                game->Iso.world->layer2Dirty.mark(x + y * game->Iso.world->width);
             }
         }
     }
 
     if (ImGui::Checkbox("HD Objects", &global.game->Iso.globaldef.hd_objects)) {
-        R_FreeTarget(game->TexturePack_.textureObjects->target);
-        R_FreeImage(game->TexturePack_.textureObjects);
-        R_FreeTarget(game->TexturePack_.textureObjectsBack->target);
-        R_FreeImage(game->TexturePack_.textureObjectsBack);
-        R_FreeTarget(game->TexturePack_.textureEntities->target);
-        R_FreeImage(game->TexturePack_.textureEntities);
-
-        game->TexturePack_.textureObjects =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        // 来回切换时两种尺寸都留在池里 不用每次重新分配
+        R_ReleasePooledImage(game->TexturePack_.textureObjects);
+        R_ReleasePooledImage(game->TexturePack_.textureObjectsBack);
+        R_ReleasePooledImage(game->TexturePack_.textureEntities);
+
+        const u16 scale = global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1;
+        const u16 w = game->Iso.world->width * scale;
+        const u16 h = game->Iso.world->height * scale;
+
+        game->TexturePack_.textureObjects = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureObjects, R_FILTER_NEAREST);
 
-        game->TexturePack_.textureObjectsBack =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        game->TexturePack_.textureObjectsBack = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureObjectsBack, R_FILTER_NEAREST);
 
-        R_LoadTarget(game->TexturePack_.textureObjects);
-        R_LoadTarget(game->TexturePack_.textureObjectsBack);
-
-        game->TexturePack_.textureEntities =
-                R_CreateImage(game->Iso.world->width * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1),
-                              game->Iso.world->height * (global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1), R_FormatEnum::R_FORMAT_RGBA);
+        game->TexturePack_.textureEntities = R_AcquirePooledImage(w, h, R_FormatEnum::R_FORMAT_RGBA, true);
         R_SetImageFilter(game->TexturePack_.textureEntities, R_FILTER_NEAREST);
-
-        R_LoadTarget(game->TexturePack_.textureEntities);
     }
 
     if (CollapsingHeader(CC("GLSL"))) {
@@ -547,6 +540,7 @@ void console::init() {
     // });
 
     convar.Value("game_scale", the<engine>().eng()->render_scale);
+    RegisterPerfCommands(convar);
 }
 
 void console::end() {}
@@ -882,6 +876,25 @@ int profiler_draw_frame(profiler_frame *_data, void *_buffer, size_t _bufferSize
 
             ImGui::SameLine();
             if (ImGui::Button("保存帧")) ret = ME_profiler_save(_data, _buffer, _bufferSize);
+
+            // 连续捕获到环形缓冲 导出为 Chrome Trace Event JSON 用 chrome://tracing 或 ui.perfetto.dev 打开
+            bool trace = ME_profiler_trace_is_enabled();
+            ImGui::SameLine();
+            if (ImGui::Checkbox("连续捕获", &trace)) ME_profiler_trace_set_enabled(trace);
+
+            // 线程缓冲或合并的一帧放不下而丢掉的范围
+            if (u64 dropped = ME_profiler_dropped_scopes()) {
+                ImGui::SameLine();
+                ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "丢弃 %llu", (unsigned long long)dropped);
+            }
+
+            ImGui::SameLine();
+            if (ImGui::Button("导出 Trace")) {
+                if (ME_profiler_trace_export("profiler_trace.json"))
+                    METADOT_INFO(std::format("Exported {0} profiler events to profiler_trace.json", ME_profiler_trace_size()).c_str());
+                else
+                    METADOT_WARN("Failed to write profiler_trace.json");
+            }
         } else {
             ImGui::Text("捕获阈值: ");
             ImGui::SameLine();
@@ -1096,14 +1109,58 @@ int profiler_draw_frame(profiler_frame *_data, void *_buffer, size_t _bufferSize
         ImGui::EndTabItem();
     }
 
+    if (ImGui::BeginTabItem("GPU")) {
+
+        if (_data->m_numGPUScopes == 0) {
+            ImGui::TextColored(ImVec4(1.0f, 0.23f, 0.23f, 1.0f), "没有 GPU 数据 (需要 OpenGL 3.3 时间戳查询)");
+        } else {
+            // 各段的开始与结束时间都来自时间戳 最后结束的一段就是这一帧 GPU 的总耗时
+            float gpuFrameTime = 0.0f;
+            for (u32 i = 0; i < _data->m_numGPUScopes; ++i) gpuFrameTime = std::max(gpuFrameTime, _data->m_gpuScopes[i].m_start + _data->m_gpuScopes[i].m_time);
+
+            ImGui::Text("GPU 帧耗时: %.3f ms", gpuFrameTime);
+            ImGui::Separator();
+
+            if (ImGui::BeginTable("ui_profiler_gpu", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY)) {
+                ImGui::TableSetupColumn("名称");
+                ImGui::TableSetupColumn("开始 (ms)", ImGuiTableColumnFlags_WidthFixed, 90.0f);
+                ImGui::TableSetupColumn("耗时 (ms)", ImGuiTableColumnFlags_WidthFixed, 90.0f);
+                ImGui::TableHeadersRow();
+
+                for (u32 i = 0; i < _data->m_numGPUScopes; ++i) {
+                    const profiler_gpu_scope &gs = _data->m_gpuScopes[i];
+                    int level = gs.m_level >= (u32)s_maxLevelColors ? s_maxLevelColors - 1 : (int)gs.m_level;
+
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::Indent(gs.m_level * 12.0f + 1.0f);
+                    ImGui::PushStyleColor(ImGuiCol_Text, s_levelColors[level]);
+                    ImGui::TextUnformatted(gs.m_name);
+                    ImGui::PopStyleColor();
+                    ImGui::Unindent(gs.m_level * 12.0f + 1.0f);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f", gs.m_start);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f", gs.m_time);
+                }
+
+                ImGui::EndTable();
+            }
+        }
+
+        ImGui::EndTabItem();
+    }
+
     if (ImGui::BeginTabItem("内存")) {
 
         static u32 check_timer;
 
+        const allocation_metrics metrics = ME_mem_get_metrics();
         ImGui::Text("MemCurrentUsage: %.2f mb", ME_mem_current_usage_mb());
-        ImGui::Text("MemTotalAllocated: %.2lf mb", (f64)(g_allocation_metrics.total_allocated / 1048576.0));
-        ImGui::Text("MemTotalFree: %.2lf mb", (f64)(g_allocation_metrics.total_free / 1048576.0));
+        ImGui::Text("MemTotalAllocated: %.2lf mb", (f64)(metrics.total_allocated / 1048576.0));
+        ImGui::Text("MemTotalFree: %.2lf mb", (f64)(metrics.total_free / 1048576.0));
         ImGui::Text("GC MemAllocInUsed: %.2lf mb", (f64)(ME_mem_bytes_inuse() / 1048576.0));
+        ImGui::Text("FrameArenaReserved: %.2lf mb", (f64)(frame_arena::total_reserved() / 1048576.0));
 
 #define GL_GPU_MEM_INFO_TOTAL_AVAILABLE_MEM_NVX 0x9048
 #define GL_GPU_MEM_INFO_CURRENT_AVAILABLE_MEM_NVX 0x9049
@@ -1117,19 +1174,20 @@ int profiler_draw_frame(profiler_frame *_data, void *_buffer, size_t _bufferSize
         ImGui::Text("GPU MemTotalAvailable: %.2lf mb", (f64)(cur_avail_mem_kb / 1024.0f));
         ImGui::Text("GPU MemCurrentUsage: %.2lf mb", (f64)((total_mem_kb - cur_avail_mem_kb) / 1024.0f));
 
-        auto L = the<scripting>().L;
-        lua_gc(L, LUA_GCCOLLECT, 0);
-        lua_Integer kb = lua_gc(L, LUA_GCCOUNT, 0);
-        lua_Integer bytes = lua_gc(L, LUA_GCCOUNTB, 0);
-
-        ImGui::Text("Lua MemoryUsage: %.2lf mb", ((f64)kb / 1024.0f));
-        ImGui::Text("Lua Remaining: %.2lf mb", ((f64)bytes / 1024.0f));
+        // 不再每帧强制整轮回收 回收由 scripting::update_gc 调度
+        const lua_gc_stats &gc = the<scripting>().get_gc_stats();
+        ImGui::Text("Lua MemoryUsage: %.2lf mb", ((f64)gc.kb / 1024.0f));
+        ImGui::Text("Lua GC: %s %u steps %.1f us (max %.1f us) %llu cycles", gc.generational ? "generational" : "incremental", gc.frameSteps, gc.frameUs, gc.maxFrameUs,
+                    (unsigned long long)gc.cycles);
+        const ME_mem_pool_stats pool = ME_mem_pool_get_stats();
+        ImGui::Text("Lua Allocs: %llu / Frees: %llu / Large: %llu", (unsigned long long)pool.allocs, (unsigned long long)pool.frees, (unsigned long long)pool.large_allocs);
+        ImGui::Text("Lua Pool: %.2lf mb used %.2lf mb reserved", (f64)pool.bytes_in_use / 1048576.0, (f64)pool.pool_reserved / 1048576.0);
 
         ImGui::Text("ImGui MemoryUsage: %.2lf mb", ((f64)imgui_mem_usage / 1048576.0));
 
-        ImGui::Text("Test: %ld", global.game->Iso.world->real_layer2.capacity());
-        ImGui::Text("Test: %ld", global.game->Iso.world->real_tiles.capacity());
-        ImGui::Text("Test: %ld", global.game->Iso.world->background.capacity());
+        ImGui::Text("Test: %ld", global.game->Iso.world->real_layer2.memory_usage());
+        ImGui::Text("Test: %ld", global.game->Iso.world->real_tiles.memory_usage());
+        ImGui::Text("Test: %ld", global.game->Iso.world->background.size());
 
         static u64 virtualMemoryUsed;
         static u64 physicalMemoryUsed;
@@ -1161,6 +1219,120 @@ int profiler_draw_frame(profiler_frame *_data, void *_buffer, size_t _bufferSize
         ImGui::EndTabItem();
     }
 
+    if (ImGui::BeginTabItem(CC("计数器"))) {
+
+        const profiler_counter *counters = nullptr;
+        const u32 numCounters = ME_profiler_get_counters(&counters);
+
+        static ImGuiTextFilter filter;
+        filter.Draw(CC("过滤"));
+        ImGui::SameLine();
+        if (ImGui::SmallButton(CC("清空"))) ME_profiler_reset_counters();
+
+        if (numCounters == 0) ImGui::TextUnformatted(CC("没有计数器"));
+
+        for (u32 i = 0; i < numCounters; ++i) {
+            const profiler_counter &c = counters[i];
+            if (c.m_count == 0 || !filter.PassFilter(c.m_name)) continue;
+            // 环形缓冲 未写满时从 0 开始 写满后从最旧的值开始
+            const int offset = c.m_count < ME_COUNTER_HISTORY ? 0 : (int)c.m_head;
+            const f32 last = c.m_values[(c.m_head + ME_COUNTER_HISTORY - 1) % ME_COUNTER_HISTORY];
+            char overlay[32];
+            snprintf(overlay, sizeof(overlay), "%.2f", last);
+            ImGui::PlotLines(c.m_name, c.m_values, (int)c.m_count, offset, overlay, FLT_MAX, FLT_MAX, ImVec2(0, 40.0f));
+        }
+
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem("Lua")) {
+
+        lua_profiler &lp = the<scripting>().profiler;
+        ImGui::Checkbox(CC("采样"), &global.game->Iso.globaldef.lua_profiler);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::InputInt(CC("间隔(指令)"), &global.game->Iso.globaldef.lua_profiler_interval, 100, 1000);
+        ImGui::SameLine();
+        if (ImGui::SmallButton(CC("清空"))) lp.reset();
+        ImGui::Text("%.2f ms / %llu samples", lp.total_ms(), (unsigned long long)lp.total_samples());
+
+        static ImGuiTextFilter filter;
+        filter.Draw(CC("过滤"));
+
+        if (ImGui::BeginTable("lua_profiler", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn(CC("函数"), ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn(CC("自身 ms"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("自身 %"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("包含 ms"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("采样"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableHeadersRow();
+            const f64 total = lp.total_ms() > 0 ? lp.total_ms() : 1;
+            for (const lua_profiler::function_stats *f : lp.sorted()) {
+                if (!filter.PassFilter(f->name.c_str())) continue;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(f->name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", f->selfMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", f->selfMs * 100.0 / total);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", f->totalMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)f->samples);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem(CC("区块"))) {
+
+        // tickZone 内开销最大的区块 数值是 Chunk::tickCost 的指数平均
+        constexpr size_t TOP_CHUNKS = 16;
+        ImGui::Checkbox(CC("热力图"), &global.game->Iso.globaldef.draw_chunk_cost);
+
+        world *w = global.game->Iso.world.get();
+        std::vector<Chunk *> hot;
+        if (w) {
+            for (size_t i = 0; i < w->tickActivity.size(); i++) {
+                Chunk *ch = w->tickActivityChunk(i);
+                if (ch && ch->tickCost.ms > 0.001f) hot.push_back(ch);
+            }
+        }
+        const size_t n = std::min(hot.size(), TOP_CHUNKS);
+        std::partial_sort(hot.begin(), hot.begin() + n, hot.end(), [](const Chunk *a, const Chunk *b) { return a->tickCost.ms > b->tickCost.ms; });
+
+        if (ImGui::BeginTable("chunk_costs", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn(CC("区块"), ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn(CC("ms/tick"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("像素/tick"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("粒子/tick"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(CC("重建网格/tick"), ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < n; i++) {
+                const Chunk::TickCost &c = hot[i]->tickCost;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%d, %d", hot[i]->x, hot[i]->y);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", c.ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.0f", c.cells);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", c.particles);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", c.remesh);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::EndTabItem();
+    }
+
     ImGui::EndTabBar();
 
     ImGui::End();
@@ -1517,13 +1689,53 @@ void dbgui::End() {
     ImGui::DestroyContext();
 }
 
-void dbgui::NewFrame() {
+bool dbgui::Wanted() const {
+    const GlobalDEF &def = global.game->Iso.globaldef;
+    if (def.draw_imgui_debug || def.ui_tweak || def.draw_profiler || def.draw_console || def.draw_pack_editor || def.draw_code_editor) return true;
+    if (def.draw_material_info || def.draw_debug_stats || def.draw_load_zones) return true;
+    if (gameUI.visible_mainmenu || gameUI.visible_debugdraw) return true;
+
+    // console::draw_internal_display 显示最近 4 秒的日志
+    auto &logs = logger::message_log();
+    if (!logs.empty() && ME_gettime() - logs.back().time <= 4000) return true;
+
+    // Lua 菜单 (game_ui.lua)
+    auto GetUIState = the<scripting>().s_lua["GetUIState"];
+    if (GetUIState.is_nil_ref()) return false;
+    int ui_state = GetUIState();
+    return ui_state != 0;
+}
+
+void dbgui::NewFrame(bool keep) {
+    const bool active = keep || !global.game->Iso.globaldef.imgui_skip_hidden || Wanted();
+
+    if (!active) {
+        if (frame_active) {
+            // 跳过的帧里没有窗口 不能让上一帧的捕获状态继续挡住游戏输入
+            ImGuiIO &io = ImGui::GetIO();
+            io.WantCaptureMouse = false;
+            io.WantCaptureKeyboard = false;
+            io.WantTextInput = false;
+            io.ClearInputKeys();
+        }
+        frame_active = false;
+        return;
+    }
+
+    if (!frame_active) {
+        // 跳过期间没有处理的事件已经过时
+        ImGui::GetIO().ClearEventsQueue();
+    }
+    frame_active = true;
+
     RendererNewFrameFunction();
     PlatformNewFrameFunction();
     ImGui::NewFrame();
 }
 
 void dbgui::Draw() {
+    if (!frame_active) return;
+
     ImGuiIO &io = ImGui::GetIO();
     (void)io;
 
@@ -1545,6 +1757,7 @@ void dbgui::Draw() {
 }
 
 void dbgui::Update() {
+    if (!frame_active) return;
 
     ImGuiIO &io = ImGui::GetIO();
 
@@ -1825,14 +2038,13 @@ void dbgui::Update() {
                     static Chunk *check_chunk_ptr = nullptr;
 
                     if (ImGui::BeginCombo("ChunkList", CC("选择检视区块..."))) {
-                        for (auto &p1 : global.game->Iso.world->chunkCache)
-                            for (auto &p2 : p1.second) {
-                                if (ImGui::Selectable(ME_fs_get_filename(p2.second->pack_filename.c_str()))) {
-                                    check_chunk.x = p2.second->x;
-                                    check_chunk.y = p2.second->y;
-                                    check_chunk_ptr = p2.second;
-                                }
+                        global.game->Iso.world->chunkCache.for_each([&](Chunk *ch) {
+                            if (ImGui::Selectable(ME_fs_get_filename(ch->pack_filename.c_str()))) {
+                                check_chunk.x = ch->x;
+                                check_chunk.y = ch->y;
+                                check_chunk_ptr = ch;
                             }
+                        });
                         ImGui::EndCombo();
                     }
 
@@ -1926,6 +2138,74 @@ void dbgui::Update() {
 
                 ImGui::EndTabItem();
             }
+
+            if (ImGui::BeginTabItem("ECS")) {
+                ecs::registry &reg = global.game->Iso.world->Reg();
+                const ecs::registry::memory_usage_info usage = reg.memory_usage();
+                ImGui::Text(CC("实体: %llu 实体内存: %.2f kb 组件内存: %.2f kb"), (unsigned long long)reg.entity_count(), (f64)usage.entities / 1024.0, (f64)usage.components / 1024.0);
+
+                if (CollapsingHeader(CC("组件存储"))) {
+                    if (ImGui::BeginTable("ui_ecs_storage_table", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings)) {
+                        ImGui::TableSetupColumn(CC("组件"));
+                        ImGui::TableSetupColumn(CC("个数"), ImGuiTableColumnFlags_WidthFixed, 70.0f);
+                        ImGui::TableSetupColumn(CC("内存 (kb)"), ImGuiTableColumnFlags_WidthFixed, 80.0f);
+                        ImGui::TableSetupColumn(CC("碎片率"), ImGuiTableColumnFlags_WidthFixed, 70.0f);
+                        ImGui::TableSetupColumn(CC("组内"), ImGuiTableColumnFlags_WidthFixed, 70.0f);
+                        ImGui::TableHeadersRow();
+
+                        reg.for_each_storage_info([](const ecs::detail::storage_info &info) {
+                            // 碎片率是已分配但没有被组件使用的比例 包括预留容量和稀疏数组的空洞
+                            const f64 fragmentation = info.memory ? 1.0 - (f64)info.used_memory / (f64)info.memory : 0.0;
+                            ImGui::TableNextRow();
+                            ImGui::TableNextColumn();
+                            ImGui::TextUnformatted(info.name);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%llu", (unsigned long long)info.count);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%.2f", (f64)info.memory / 1024.0);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%.0f%%", fragmentation * 100.0);
+                            ImGui::TableNextColumn();
+                            ImGui::Text("%llu", (unsigned long long)info.grouped);
+                        });
+
+                        ImGui::EndTable();
+                    }
+                }
+
+                if (CollapsingHeader(CC("系统耗时"))) {
+                    if (ImGui::SmallButton(CC("重置"))) reg.for_each_feature([](ecs::feature &f) { f.reset_stats(); });
+
+                    if (ImGui::BeginTable("ui_ecs_system_table", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings)) {
+                        ImGui::TableSetupColumn(CC("系统"));
+                        ImGui::TableSetupColumn(CC("调用"), ImGuiTableColumnFlags_WidthFixed, 70.0f);
+                        ImGui::TableSetupColumn(CC("最近 (us)"), ImGuiTableColumnFlags_WidthFixed, 80.0f);
+                        ImGui::TableSetupColumn(CC("平均 (us)"), ImGuiTableColumnFlags_WidthFixed, 80.0f);
+                        ImGui::TableSetupColumn(CC("最大 (us)"), ImGuiTableColumnFlags_WidthFixed, 80.0f);
+                        ImGui::TableHeadersRow();
+
+                        reg.for_each_feature([](ecs::feature &f) {
+                            for (const ecs::system_stats &st : f.stats()) {
+                                ImGui::TableNextRow();
+                                ImGui::TableNextColumn();
+                                ImGui::TextUnformatted(st.name);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%llu", (unsigned long long)st.calls);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.1f", st.last_us);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.1f", st.calls ? st.total_us / (f64)st.calls : 0.0);
+                                ImGui::TableNextColumn();
+                                ImGui::Text("%.1f", st.max_us);
+                            }
+                        });
+
+                        ImGui::EndTable();
+                    }
+                }
+
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }
         ImGui::End();
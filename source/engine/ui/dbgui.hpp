@@ -277,6 +277,9 @@ private:
     ImGuiContext* m_imgui = nullptr;
     ImGuiID dockspace_id = 0;
 
+    // 这一帧是否调用了 ImGui::NewFrame 为假时 Update Draw 什么都不做
+    bool frame_active = false;
+
     std::vector<dbgui_base*> dbgui_list = {};
 
 private:
@@ -291,10 +294,16 @@ public:
 
     void Init();
     void End();
-    void NewFrame();
+    // imgui_skip_hidden 打开且没有任何可见的 ImGui 窗口时跳过整帧 ImGui
+    // keep 为真时总是开始一帧 (调用方还有自己的窗口要画)
+    void NewFrame(bool keep = false);
     void Draw();
     void Update();
 
+    // 是否有需要 ImGui 绘制的调试窗口 菜单或日志
+    bool Wanted() const;
+    bool FrameActive() const noexcept { return frame_active; }
+
     ImVec2 NextWindows(dbgui_tag tag, ImVec2 pos) const noexcept;
 
     ImGuiID GetMainDockID() const noexcept { return dockspace_id; }
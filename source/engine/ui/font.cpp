@@ -626,6 +626,18 @@ void fontcache::push(const std::string &text, const font_index font, const MEvec
 
 void fontcache::push(const std::string &text, const font_index font, const f32 x, const f32 y) { push(text, font, calc_pos(x, y)); }
 
+// 图集更新排在绘制列表里 下一次 drawcmd 时执行
+int fontcache::warmup(const std::string &text, const font_index font) {
+    ME_profiler_scope_auto("RenderGUI.Font.Warmup");
+    return ve_fontcache_warmup(&cache, font, text);
+}
+
+int fontcache::warmup_ascii(const font_index font) {
+    std::string ascii;
+    for (char c = 0x21; c < 0x7f; c++) ascii += c;
+    return warmup(ascii, font);
+}
+
 void fontcache::resize(MEvec2 size) {
     screen_w = size.x;
     screen_h = size.y;
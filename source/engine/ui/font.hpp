@@ -31,6 +31,10 @@ public:
     void end();
     void push(const std::string& text, const font_index font, const MEvec2 pos);
     void push(const std::string& text, const font_index font, const f32 x, const f32 y);
+    // 预先把 text 里的字形画进图集 返回新缓存的字形数
+    int warmup(const std::string& text, const font_index font);
+    // 可打印的 ASCII 字符
+    int warmup_ascii(const font_index font);
     void resize(MEvec2 size);
     MEvec2 calc_pos(f32 x, f32 y) const;
 
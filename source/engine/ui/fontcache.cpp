@@ -33,6 +33,7 @@ void ve_fontcache_init(ve_fontcache* cache) {
     for (int i = 0; i < VE_FONTCACHE_SHAPECACHE_SIZE; i++) {
         cache->shape_cache.storage[i].glyphs.reserve(VE_FONTCACHE_SHAPECACHE_RESERVE_LENGTH);
         cache->shape_cache.storage[i].pos.reserve(VE_FONTCACHE_SHAPECACHE_RESERVE_LENGTH);
+        cache->shape_cache.storage[i].metrics.reserve(VE_FONTCACHE_SHAPECACHE_RESERVE_LENGTH);
     }
 
     // We can actually go over VE_FONTCACHE_GLYPHDRAW_BUFFER_BATCH batches due to smart packing!
@@ -335,16 +336,8 @@ bool ve_fontcache_cache_glyph(ve_fontcache* cache, ve_font_id font, ve_glyph gly
     return true;
 }
 
-static ve_atlas_region ve_fontcache_decide_codepoint_region(ve_fontcache* cache, ve_fontcache_entry& entry, int glyph_index, ve_fontcache_LRU*& state, uint32_t*& next_idx, float& oversample_x,
-                                                            float& oversample_y) {
-    if (stbtt_IsGlyphEmpty(&entry.info, glyph_index)) return '\0';
-
-    // Get hb_font text metrics. These are unscaled!
-    int bounds_x0, bounds_x1, bounds_y0, bounds_y1;
-    int success = stbtt_GetGlyphBox(&entry.info, glyph_index, &bounds_x0, &bounds_y0, &bounds_x1, &bounds_y1);
-    int bounds_width = bounds_x1 - bounds_x0, bounds_height = bounds_y1 - bounds_y0;
-    STBTT_assert(success);
-
+static ve_atlas_region ve_fontcache_decide_region(ve_fontcache* cache, ve_fontcache_entry& entry, int bounds_width, int bounds_height, ve_fontcache_LRU*& state, uint32_t*& next_idx,
+                                                  float& oversample_x, float& oversample_y) {
     // Decide which atlas to target. This logic should work well for reasonable on-screen text sizes of around 24px.
     // For 4k+ displays, caching hb_font at a lower pt and drawing it upscaled at a higher pt is recommended.
     //
@@ -393,6 +386,38 @@ static ve_atlas_region ve_fontcache_decide_codepoint_region(ve_fontcache* cache,
     return region;
 }
 
+static ve_atlas_region ve_fontcache_decide_codepoint_region(ve_fontcache* cache, ve_fontcache_entry& entry, int glyph_index, ve_fontcache_LRU*& state, uint32_t*& next_idx, float& oversample_x,
+                                                            float& oversample_y) {
+    if (stbtt_IsGlyphEmpty(&entry.info, glyph_index)) return '\0';
+
+    // Get hb_font text metrics. These are unscaled!
+    int bounds_x0, bounds_x1, bounds_y0, bounds_y1;
+    int success = stbtt_GetGlyphBox(&entry.info, glyph_index, &bounds_x0, &bounds_y0, &bounds_x1, &bounds_y1);
+    int bounds_width = bounds_x1 - bounds_x0, bounds_height = bounds_y1 - bounds_y0;
+    STBTT_assert(success);
+
+    return ve_fontcache_decide_region(cache, entry, bounds_width, bounds_height, state, next_idx, oversample_x, oversample_y);
+}
+
+// Same decision from metrics stored with a shaped run.
+static ve_atlas_region ve_fontcache_decide_region(ve_fontcache* cache, ve_fontcache_entry& entry, const ve_fontcache_glyph_metrics& metrics, ve_fontcache_LRU*& state, uint32_t*& next_idx,
+                                                  float& oversample_x, float& oversample_y) {
+    if (metrics.region == '\0') return '\0';
+    return ve_fontcache_decide_region(cache, entry, metrics.bounds_x1 - metrics.bounds_x0, metrics.bounds_y1 - metrics.bounds_y0, state, next_idx, oversample_x, oversample_y);
+}
+
+static ve_fontcache_glyph_metrics ve_fontcache_glyph_metrics_of(ve_fontcache* cache, ve_fontcache_entry& entry, ve_glyph glyph_index) {
+    ve_fontcache_glyph_metrics metrics;
+    if (!glyph_index || stbtt_IsGlyphEmpty(&entry.info, glyph_index)) return metrics;
+    if (!stbtt_GetGlyphBox(&entry.info, glyph_index, &metrics.bounds_x0, &metrics.bounds_y0, &metrics.bounds_x1, &metrics.bounds_y1)) return metrics;
+
+    ve_fontcache_LRU* state = nullptr;
+    uint32_t* next_idx = nullptr;
+    float oversample_x = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_X, oversample_y = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_Y;
+    metrics.region = ve_fontcache_decide_region(cache, entry, metrics.bounds_x1 - metrics.bounds_x0, metrics.bounds_y1 - metrics.bounds_y0, state, next_idx, oversample_x, oversample_y);
+    return metrics;
+}
+
 static void ve_fontcache_flush_glyph_buffer_to_atlas(ve_fontcache* cache) {
     // Flush drawcalls to draw list.
     ve_fontcache_merge_drawlist(cache->drawlist, cache->atlas.glyph_update_batch_clear_drawlist);
@@ -583,6 +608,7 @@ void ve_fontcache_shape_text_uncached(ve_fontcache* cache, ve_font_id font, ve_f
     ve_fontcache_entry& entry = cache->entry[font];
     output.glyphs.clear();
     output.pos.clear();
+    output.metrics.clear();
 
     int ascent = 0, descent = 0, line_gap = 0;
     stbtt_GetFontVMetrics(&entry.info, &ascent, &descent, &line_gap);
@@ -596,6 +622,7 @@ void ve_fontcache_shape_text_uncached(ve_fontcache* cache, ve_font_id font, ve_f
     size_t u32_length = utf8len(text_utf8.data());
     output.glyphs.reserve(u32_length);
     output.pos.reserve(u32_length);
+    output.metrics.reserve(u32_length);
 
     float pos = 0.0f, vpos = 0.0f;
     int advance = 0, to_left_side_glyph = 0;
@@ -619,6 +646,7 @@ void ve_fontcache_shape_text_uncached(ve_fontcache* cache, ve_font_id font, ve_f
         }
 
         output.glyphs.push_back(stbtt_FindGlyphIndex(&entry.info, codepoint));
+        output.metrics.push_back(ve_fontcache_glyph_metrics_of(cache, entry, output.glyphs.back()));
         stbtt_GetCodepointHMetrics(&entry.info, codepoint, &advance, &to_left_side_glyph);
         output.pos.push_back(ve_fontcache_make_vec2(int(pos + 0.5), vpos));
 
@@ -647,13 +675,25 @@ void ve_fontcache_ELFhash64(uint64_t& hash, const T* ptr, size_t count = 1) {
 }
 
 static ve_fontcache_shaped_text& ve_fontcache_shape_text_cached(ve_fontcache* cache, ve_font_id font, const std::string& text_utf8) {
+    const float size = cache->entry[font].size;
     uint64_t hash = 0x9f8e00d51d263c24ULL;
     ve_fontcache_ELFhash64(hash, (const uint8_t*)text_utf8.data(), text_utf8.size());
     ve_fontcache_ELFhash64(hash, &font);
+    ve_fontcache_ELFhash64(hash, &size);
 
     ve_fontcache_LRU& state = cache->shape_cache.state;
     int shape_cache_idx = ve_fontcache_LRU_get(state, hash);
-    if (shape_cache_idx == -1) {
+    if (shape_cache_idx != -1) {
+        ve_fontcache_shaped_text& shaped = cache->shape_cache.storage[shape_cache_idx];
+        if (shaped.font == font && shaped.size == size && shaped.text == text_utf8) return shaped;
+
+        // Hash collision, reshape into the same slot.
+        ve_fontcache_shape_text_uncached(cache, font, shaped, text_utf8);
+        shaped.text = text_utf8;
+        shaped.font = font;
+        shaped.size = size;
+        return shaped;
+    } else {
         if (cache->shape_cache.next_cache_idx < state.capacity) {
             shape_cache_idx = cache->shape_cache.next_cache_idx++;
             ve_fontcache_LRU_put(state, hash, shape_cache_idx);
@@ -664,7 +704,11 @@ static ve_fontcache_shaped_text& ve_fontcache_shape_text_cached(ve_fontcache* ca
             STBTT_assert(shape_cache_idx != -1);
             ve_fontcache_LRU_put(state, hash, shape_cache_idx);
         }
-        ve_fontcache_shape_text_uncached(cache, font, cache->shape_cache.storage[shape_cache_idx], text_utf8);
+        ve_fontcache_shaped_text& shaped = cache->shape_cache.storage[shape_cache_idx];
+        ve_fontcache_shape_text_uncached(cache, font, shaped, text_utf8);
+        shaped.text = text_utf8;
+        shaped.font = font;
+        shaped.size = size;
     }
 
     return cache->shape_cache.storage[shape_cache_idx];
@@ -723,34 +767,21 @@ static void ve_fontcache_directly_draw_massive_glyph(ve_fontcache* cache, ve_fon
     cache->drawlist.dcalls.push_back(dcall);
 }
 
-static bool ve_fontcache_empty(ve_fontcache* cache, ve_fontcache_entry& entry, ve_glyph glyph_index) {
-    if (!glyph_index) {
-        // Glyph not in current hb_font.
-        return true;
-    }
-    if (stbtt_IsGlyphEmpty(&entry.info, glyph_index)) return true;
-    return false;
-}
-
 // This function only draws codepoints that have been drawn. Returns false without drawing anything if uncached.
-bool ve_fontcache_draw_cached_glyph(ve_fontcache* cache, ve_fontcache_entry& entry, ve_glyph glyph_index, float posx = 0.0f, float posy = 0.0f, float scalex = 1.0f, float scaley = 1.0f) {
-    if (!glyph_index) {
-        // Glyph not in current hb_font.
-        return true;
-    }
-    if (stbtt_IsGlyphEmpty(&entry.info, glyph_index)) return true;
+bool ve_fontcache_draw_cached_glyph(ve_fontcache* cache, ve_fontcache_entry& entry, ve_glyph glyph_index, const ve_fontcache_glyph_metrics& metrics, float posx = 0.0f, float posy = 0.0f,
+                                    float scalex = 1.0f, float scaley = 1.0f) {
+    // Empty, missing or too large to draw.
+    if (metrics.region == '\0') return true;
 
-    // Get hb_font text metrics. These are unscaled!
-    int bounds_x0, bounds_x1, bounds_y0, bounds_y1;
-    int success = stbtt_GetGlyphBox(&entry.info, glyph_index, &bounds_x0, &bounds_y0, &bounds_x1, &bounds_y1);
-    int bounds_width = bounds_x1 - bounds_x0, bounds_height = bounds_y1 - bounds_y0;
-    STBTT_assert(success);
+    // Hb_font text metrics from the shaped run. These are unscaled!
+    int bounds_x0 = metrics.bounds_x0, bounds_y0 = metrics.bounds_y0;
+    int bounds_width = metrics.bounds_x1 - metrics.bounds_x0, bounds_height = metrics.bounds_y1 - metrics.bounds_y0;
 
     // Decide which atlas to target.
     ve_fontcache_LRU* state = nullptr;
     uint32_t* next_idx = nullptr;
     float oversample_x = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_X, oversample_y = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_Y;
-    ve_atlas_region region = ve_fontcache_decide_codepoint_region(cache, entry, glyph_index, state, next_idx, oversample_x, oversample_y);
+    ve_atlas_region region = ve_fontcache_decide_region(cache, entry, metrics, state, next_idx, oversample_x, oversample_y);
 
     // E region is special case and not cached to atlas.
     if (region == 'E') {
@@ -802,7 +833,7 @@ static void ve_fontcache_reset_batch_codepoint_state(ve_fontcache* cache) {
     cache->temp_codepoint_seen.reserve(256);
 }
 
-static bool ve_fontcache_can_batch_glyph(ve_fontcache* cache, ve_font_id font, ve_fontcache_entry& entry, ve_glyph glyph_index) {
+static bool ve_fontcache_can_batch_glyph(ve_fontcache* cache, ve_font_id font, ve_fontcache_entry& entry, ve_glyph glyph_index, const ve_fontcache_glyph_metrics& metrics) {
     STBTT_assert(cache);
     STBTT_assert(entry.font_id == font);
 
@@ -811,7 +842,7 @@ static bool ve_fontcache_can_batch_glyph(ve_fontcache* cache, ve_font_id font, v
     ve_fontcache_LRU* state = nullptr;
     uint32_t* next_idx = nullptr;
     float oversample_x = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_X, oversample_y = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_Y;
-    ve_atlas_region region = ve_fontcache_decide_codepoint_region(cache, entry, glyph_index, state, next_idx, oversample_x, oversample_y);
+    ve_atlas_region region = ve_fontcache_decide_region(cache, entry, metrics, state, next_idx, oversample_x, oversample_y);
 
     // E region can't batch.
     if (region == 'E' || region == '\0') return false;
@@ -843,7 +874,7 @@ static void ve_fontcache_draw_text_batch(ve_fontcache* cache, ve_fontcache_entry
     for (int j = batch_start_idx; j < batch_end_idx; j++) {
         ve_glyph glyph_index = shaped.glyphs[j];
         float glyph_translate_x = posx + shaped.pos[j].x * scalex, glyph_translate_y = posy + shaped.pos[j].y * scaley;
-        bool glyph_cached = ve_fontcache_draw_cached_glyph(cache, entry, glyph_index, glyph_translate_x, glyph_translate_y, scalex, scaley);
+        bool glyph_cached = ve_fontcache_draw_cached_glyph(cache, entry, glyph_index, shaped.metrics[j], glyph_translate_x, glyph_translate_y, scalex, scaley);
         STBTT_assert(glyph_cached);
     }
 }
@@ -861,9 +892,10 @@ bool ve_fontcache_draw_text(ve_fontcache* cache, ve_font_id font, const std::str
     int batch_start_idx = 0;
     for (int i = 0; i < shaped.glyphs.size(); i++) {
         ve_glyph glyph_index = shaped.glyphs[i];
-        if (ve_fontcache_empty(cache, entry, glyph_index)) continue;
+        // Empty glyphs and glyphs too large for any region are never drawn.
+        if (shaped.metrics[i].region == '\0') continue;
 
-        if (ve_fontcache_can_batch_glyph(cache, font, entry, glyph_index)) {
+        if (ve_fontcache_can_batch_glyph(cache, font, entry, glyph_index, shaped.metrics[i])) {
             continue;
         }
 
@@ -887,6 +919,36 @@ bool ve_fontcache_draw_text(ve_fontcache* cache, ve_font_id font, const std::str
 
 ve_fontcache_vec2 ve_fontcache_get_cursor_pos(ve_fontcache* cache) { return cache->cursor_pos; }
 
+int ve_fontcache_warmup(ve_fontcache* cache, ve_font_id font, const std::string& text_utf8) {
+    STBTT_assert(cache);
+    STBTT_assert(font >= 0 && font < cache->entry.size());
+    ve_fontcache_entry& entry = cache->entry[font];
+
+    int cached = 0;
+    utf8_int32_t codepoint;
+    for (void* v = utf8codepoint(text_utf8.data(), &codepoint); codepoint; v = utf8codepoint(v, &codepoint)) {
+        ve_glyph glyph_index = stbtt_FindGlyphIndex(&entry.info, codepoint);
+        ve_fontcache_glyph_metrics metrics = ve_fontcache_glyph_metrics_of(cache, entry, glyph_index);
+
+        ve_fontcache_LRU* state = nullptr;
+        uint32_t* next_idx = nullptr;
+        float oversample_x = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_X, oversample_y = VE_FONTCACHE_GLYPHDRAW_OVERSAMPLE_Y;
+        ve_atlas_region region = ve_fontcache_decide_region(cache, entry, metrics, state, next_idx, oversample_x, oversample_y);
+        if (region == '\0' || region == 'E') continue;
+
+        // Already cached, or the region is full and caching would evict something warmed up earlier.
+        uint64_t lru_code = glyph_index + ((0x100000000ULL * font) & 0xFFFFFFFF00000000ULL);
+        if (ve_fontcache_LRU_peek(*state, lru_code) != -1) continue;
+        if (*next_idx >= state->capacity) continue;
+
+        ve_fontcache_cache_glyph_to_atlas(cache, font, glyph_index);
+        cached++;
+    }
+    ve_fontcache_flush_glyph_buffer_to_atlas(cache);
+
+    return cached;
+}
+
 void ve_fontcache_optimise_drawlist(ve_fontcache* cache) {
     STBTT_assert(cache);
 
@@ -212,10 +212,25 @@ struct ve_fontcache_atlas {
     ve_fontcache_drawlist glyph_update_batch_drawlist;
 };
 
+// Unscaled glyph box and atlas region, looked up once when the text is shaped so drawing a cached run never touches the font tables.
+struct ve_fontcache_glyph_metrics {
+    int bounds_x0 = 0;
+    int bounds_y0 = 0;
+    int bounds_x1 = 0;
+    int bounds_y1 = 0;
+    ve_atlas_region region = '\0';  // '\0' for empty or missing glyphs.
+};
+
 struct ve_fontcache_shaped_text {
     std::vector<ve_glyph> glyphs;
     std::vector<ve_fontcache_vec2> pos;
+    std::vector<ve_fontcache_glyph_metrics> metrics;
     ve_fontcache_vec2 end_cursor_pos;
+
+    // Key of the run, compared on lookup so a hash collision reshapes instead of drawing the wrong text.
+    std::string text;
+    ve_font_id font = -1;
+    float size = 0.0f;
 };
 
 struct ve_fontcache_shaped_text_cache {
@@ -293,6 +308,12 @@ ve_fontcache_drawlist* ve_fontcache_get_drawlist(ve_fontcache* cache);
 // Set text colour of subsequent text draws.
 void ve_fontcache_set_colour(ve_fontcache* cache, float c[4]);
 
+// Rasterizes every glyph of text_utf8 into the atlas ahead of time, e.g. ASCII and localized UI strings at load time.
+//     Glyphs already cached are skipped, and warm-up never evicts: once an atlas region is full its remaining glyphs are left to be cached on first draw.
+//     The atlas updates are appended to the drawlist and happen on the next drawlist execution. Returns the number of glyphs newly cached.
+//
+int ve_fontcache_warmup(ve_fontcache* cache, ve_font_id font, const std::string& text_utf8);
+
 inline void ve_fontcache_enable_advanced_text_shaping(ve_fontcache* cache, bool enabled = true) { cache->text_shape_advanced = enabled; }
 
 // --------------------------------------------------------------------- Generic Data Structure Declarations -------------------------------------------------------------
@@ -62,6 +62,15 @@
 #define GL_CALL(_CALL) _CALL  // Call without error check
 #endif
 
+// Persistently mapped stream for vertex/index data (GL 4.4 glBufferStorage), same scheme as the vector renderer ring in surface_gl.cpp.
+// Each frame copies all draw lists into one segment and fences it, the segment is reused IMGUI_IMPL_OPENGL_RING_SEGMENTS frames later.
+// If the GPU still reads it, the frame falls back to glBufferData per draw list instead of waiting.
+#if !defined(IMGUI_IMPL_OPENGL_ES2) && !defined(IMGUI_IMPL_OPENGL_ES3) && defined(GL_VERSION_4_4) && defined(IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET)
+#define IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+#endif
+#define IMGUI_IMPL_OPENGL_RING_SEGMENTS 3
+#define IMGUI_IMPL_OPENGL_RING_MIN_SEGMENT (256 * 1024)
+
 // OpenGL Data
 struct ImGui_ImplOpenGL3_Data {
     GLuint GlVersion;            // Extracted at runtime using GL_MAJOR_VERSION, GL_MINOR_VERSION queries (e.g. 320 for GL 3.2)
@@ -78,6 +87,14 @@ struct ImGui_ImplOpenGL3_Data {
     GLsizeiptr IndexBufferSize;
     bool HasClipOrigin;
     bool UseBufferSubData;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+    bool UseRing;
+    GLuint RingHandle;  // Holds vertices then indices of a frame in each segment
+    unsigned char *RingMapped;
+    GLsizeiptr RingSegmentSize;
+    int RingSegment;
+    GLsync RingFences[IMGUI_IMPL_OPENGL_RING_SEGMENTS];
+#endif
 
     ImGui_ImplOpenGL3_Data() { memset((void *)this, 0, sizeof(*this)); }
 };
@@ -180,6 +197,9 @@ bool ImGui_ImplOpenGL3_Init() {
 
     // Detect extensions we support
     bd->HasClipOrigin = (bd->GlVersion >= 450);
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+    bd->UseRing = GLAD_GL_VERSION_4_4 && bd->GlVersion >= 440;
+#endif
 #ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_EXTENSIONS
     GLint num_extensions = 0;
     glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
@@ -213,7 +233,78 @@ void ImGui_ImplOpenGL3_NewFrame() {
     if (!bd->ShaderHandle) ImGui_ImplOpenGL3_CreateDeviceObjects();
 }
 
-static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData *draw_data, int fb_width, int fb_height, GLuint vertex_array_object) {
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+static void ImGui_ImplOpenGL3_DeleteRing(ImGui_ImplOpenGL3_Data *bd) {
+    for (int i = 0; i < IMGUI_IMPL_OPENGL_RING_SEGMENTS; i++) {
+        if (bd->RingFences[i]) glDeleteSync(bd->RingFences[i]);
+        bd->RingFences[i] = 0;
+    }
+    if (bd->RingHandle != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, bd->RingHandle);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &bd->RingHandle);
+    }
+    bd->RingHandle = 0;
+    bd->RingMapped = nullptr;
+    bd->RingSegmentSize = 0;
+    bd->RingSegment = 0;
+}
+
+static bool ImGui_ImplOpenGL3_CreateRing(ImGui_ImplOpenGL3_Data *bd, GLsizeiptr segment_size) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    // The old buffer is released by the driver once the GPU is done with it
+    ImGui_ImplOpenGL3_DeleteRing(bd);
+
+    glGenBuffers(1, &bd->RingHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, bd->RingHandle);
+    glBufferStorage(GL_ARRAY_BUFFER, segment_size * IMGUI_IMPL_OPENGL_RING_SEGMENTS, nullptr, flags);
+    bd->RingMapped = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, segment_size * IMGUI_IMPL_OPENGL_RING_SEGMENTS, flags);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (bd->RingMapped == nullptr) {
+        glDeleteBuffers(1, &bd->RingHandle);
+        bd->RingHandle = 0;
+        return false;
+    }
+    bd->RingSegmentSize = segment_size;
+    return true;
+}
+
+// Returns the start of the next free segment, or nullptr to upload with glBufferData.
+static unsigned char *ImGui_ImplOpenGL3_RingBegin(ImGui_ImplOpenGL3_Data *bd, GLsizeiptr size, GLintptr *offset) {
+    if (!bd->UseRing) return nullptr;
+
+    if (bd->RingHandle == 0 || size > bd->RingSegmentSize) {
+        GLsizeiptr segment_size = bd->RingSegmentSize ? bd->RingSegmentSize : IMGUI_IMPL_OPENGL_RING_MIN_SEGMENT;
+        while (segment_size < size) segment_size *= 2;
+        if (!ImGui_ImplOpenGL3_CreateRing(bd, segment_size)) {
+            bd->UseRing = false;
+            return nullptr;
+        }
+    }
+
+    GLsync fence = bd->RingFences[bd->RingSegment];
+    if (fence) {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) return nullptr;
+        glDeleteSync(fence);
+        bd->RingFences[bd->RingSegment] = 0;
+    }
+
+    *offset = (GLintptr)bd->RingSegment * bd->RingSegmentSize;
+    return bd->RingMapped + *offset;
+}
+
+static void ImGui_ImplOpenGL3_RingEnd(ImGui_ImplOpenGL3_Data *bd) {
+    bd->RingFences[bd->RingSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    bd->RingSegment = (bd->RingSegment + 1) % IMGUI_IMPL_OPENGL_RING_SEGMENTS;
+}
+#endif
+
+// vbo/ibo are the buffers the draw lists were uploaded to, vtx_offset the byte offset of the first vertex in vbo
+static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData *draw_data, int fb_width, int fb_height, GLuint vertex_array_object, GLuint vbo, GLuint ibo, GLintptr vtx_offset) {
     ImGui_ImplOpenGL3_Data *bd = ImGui_ImplOpenGL3_GetBackendData();
 
     // Setup render state: alpha-blending enabled, no face culling, no depth testing, scissor enabled, polygon fill
@@ -276,14 +367,14 @@ static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData *draw_data, int fb_wid
 #endif
 
     // Bind vertex/index buffers and setup attributes for ImDrawVert
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, bd->VboHandle));
-    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bd->ElementsHandle));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxPos));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxUV));
     GL_CALL(glEnableVertexAttribArray(bd->AttribLocationVtxColor));
-    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxPos, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid *)IM_OFFSETOF(ImDrawVert, pos)));
-    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid *)IM_OFFSETOF(ImDrawVert, uv)));
-    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid *)IM_OFFSETOF(ImDrawVert, col)));
+    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxPos, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid *)(vtx_offset + IM_OFFSETOF(ImDrawVert, pos))));
+    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid *)(vtx_offset + IM_OFFSETOF(ImDrawVert, uv))));
+    GL_CALL(glVertexAttribPointer(bd->AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid *)(vtx_offset + IM_OFFSETOF(ImDrawVert, col))));
 }
 
 // OpenGL3 Render function.
@@ -367,13 +458,41 @@ void ImGui_ImplOpenGL3_RenderDrawData(ImDrawData *draw_data) {
 #ifdef IMGUI_IMPL_OPENGL_USE_VERTEX_ARRAY
     GL_CALL(glGenVertexArrays(1, &vertex_array_object));
 #endif
-    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object);
+    // Copy the whole frame into one ring segment: vertices of all lists, then their indices
+    // Draws then offset into it with the running vertex/index counts instead of re-uploading per list
+    GLuint vbo = bd->VboHandle, ibo = bd->ElementsHandle;
+    GLintptr vtx_offset = 0, idx_offset = 0;
+    bool ring = false;
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+    if (bd->GlVersion >= 320 && draw_data->TotalVtxCount > 0) {
+        const GLsizeiptr vtx_total = (GLsizeiptr)draw_data->TotalVtxCount * (int)sizeof(ImDrawVert);
+        const GLsizeiptr idx_total = (GLsizeiptr)draw_data->TotalIdxCount * (int)sizeof(ImDrawIdx);
+        GLintptr segment = 0;
+        if (unsigned char *dst = ImGui_ImplOpenGL3_RingBegin(bd, vtx_total + idx_total, &segment)) {
+            unsigned char *vtx_dst = dst;
+            unsigned char *idx_dst = dst + vtx_total;
+            for (int n = 0; n < draw_data->CmdListsCount; n++) {
+                const ImDrawList *cmd_list = draw_data->CmdLists[n];
+                memcpy(vtx_dst, cmd_list->VtxBuffer.Data, (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+                memcpy(idx_dst, cmd_list->IdxBuffer.Data, (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+                vtx_dst += (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+                idx_dst += (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+            }
+            vbo = ibo = bd->RingHandle;
+            vtx_offset = segment;
+            idx_offset = segment + vtx_total;
+            ring = true;
+        }
+    }
+#endif
+    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object, vbo, ibo, vtx_offset);
 
     // Will project scissor/clipping rectangles into framebuffer space
     ImVec2 clip_off = draw_data->DisplayPos;          // (0,0) unless using multi-viewports
     ImVec2 clip_scale = draw_data->FramebufferScale;  // (1,1) unless using retina display which are often (2,2)
 
     // Render command lists
+    int list_vtx_base = 0, list_idx_base = 0;
     for (int n = 0; n < draw_data->CmdListsCount; n++) {
         const ImDrawList *cmd_list = draw_data->CmdLists[n];
 
@@ -387,7 +506,9 @@ void ImGui_ImplOpenGL3_RenderDrawData(ImDrawData *draw_data) {
         // - See https://github.com/ocornut/imgui/issues/4468 and please report any corruption issues.
         const GLsizeiptr vtx_buffer_size = (GLsizeiptr)cmd_list->VtxBuffer.Size * (int)sizeof(ImDrawVert);
         const GLsizeiptr idx_buffer_size = (GLsizeiptr)cmd_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx);
-        if (bd->UseBufferSubData) {
+        if (ring) {
+            // Already copied into the ring segment above
+        } else if (bd->UseBufferSubData) {
             if (bd->VertexBufferSize < vtx_buffer_size) {
                 bd->VertexBufferSize = vtx_buffer_size;
                 GL_CALL(glBufferData(GL_ARRAY_BUFFER, bd->VertexBufferSize, nullptr, GL_STREAM_DRAW));
@@ -409,7 +530,7 @@ void ImGui_ImplOpenGL3_RenderDrawData(ImDrawData *draw_data) {
                 // User callback, registered via ImDrawList::AddCallback()
                 // (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
                 if (pcmd->UserCallback == ImDrawCallback_ResetRenderState)
-                    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object);
+                    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object, vbo, ibo, vtx_offset);
                 else
                     pcmd->UserCallback(cmd_list, pcmd);
             } else {
@@ -423,17 +544,24 @@ void ImGui_ImplOpenGL3_RenderDrawData(ImDrawData *draw_data) {
 
                 // Bind texture, Draw
                 GL_CALL(glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->GetTexID()));
+                const GLintptr idx_start = idx_offset + (GLintptr)(list_idx_base + pcmd->IdxOffset) * (GLintptr)sizeof(ImDrawIdx);
 #ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_VTX_OFFSET
                 if (bd->GlVersion >= 320)
-                    GL_CALL(glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
-                                                     (void *)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)), (GLint)pcmd->VtxOffset));
+                    GL_CALL(glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void *)idx_start,
+                                                     (GLint)(list_vtx_base + pcmd->VtxOffset)));
                 else
 #endif
-                    GL_CALL(glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
-                                           (void *)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx))));
+                    GL_CALL(glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void *)idx_start));
             }
         }
+        if (ring) {
+            list_vtx_base += cmd_list->VtxBuffer.Size;
+            list_idx_base += cmd_list->IdxBuffer.Size;
+        }
     }
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+    if (ring) ImGui_ImplOpenGL3_RingEnd(bd);
+#endif
 
     // Destroy the temporary VAO
 #ifdef IMGUI_IMPL_OPENGL_USE_VERTEX_ARRAY
@@ -655,6 +783,9 @@ void ImGui_ImplOpenGL3_DestroyDeviceObjects() {
         glDeleteBuffers(1, &bd->ElementsHandle);
         bd->ElementsHandle = 0;
     }
+#ifdef IMGUI_IMPL_OPENGL_MAY_HAVE_RING
+    ImGui_ImplOpenGL3_DeleteRing(bd);
+#endif
     if (bd->ShaderHandle) {
         glDeleteProgram(bd->ShaderHandle);
         bd->ShaderHandle = 0;
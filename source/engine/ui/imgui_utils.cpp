@@ -7,6 +7,7 @@
 #include <list>
 #include <map>
 #include <set>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
@@ -17,15 +18,15 @@ imgui_md::imgui_md() {
 
     m_md.flags = MD_FLAG_TABLES | MD_FLAG_UNDERLINE | MD_FLAG_STRIKETHROUGH;
 
-    m_md.enter_block = [](MD_BLOCKTYPE t, void* d, void* u) { return ((imgui_md*)u)->block(t, d, true); };
+    m_md.enter_block = [](MD_BLOCKTYPE t, void* d, void* u) { return ((imgui_md*)u)->record_block(t, d, true); };
 
-    m_md.leave_block = [](MD_BLOCKTYPE t, void* d, void* u) { return ((imgui_md*)u)->block(t, d, false); };
+    m_md.leave_block = [](MD_BLOCKTYPE t, void* d, void* u) { return ((imgui_md*)u)->record_block(t, d, false); };
 
-    m_md.enter_span = [](MD_SPANTYPE t, void* d, void* u) { return ((imgui_md*)u)->span(t, d, true); };
+    m_md.enter_span = [](MD_SPANTYPE t, void* d, void* u) { return ((imgui_md*)u)->record_span(t, d, true); };
 
-    m_md.leave_span = [](MD_SPANTYPE t, void* d, void* u) { return ((imgui_md*)u)->span(t, d, false); };
+    m_md.leave_span = [](MD_SPANTYPE t, void* d, void* u) { return ((imgui_md*)u)->record_span(t, d, false); };
 
-    m_md.text = [](MD_TEXTTYPE t, const MD_CHAR* text, MD_SIZE size, void* u) { return ((imgui_md*)u)->text(t, text, text + size); };
+    m_md.text = [](MD_TEXTTYPE t, const MD_CHAR* text, MD_SIZE size, void* u) { return ((imgui_md*)u)->record_text(t, text, size); };
 
     m_md.debug_log = nullptr;
 
@@ -325,6 +326,14 @@ void imgui_md::render_text(const char* str, const char* str_end) {
     const ImGuiStyle& s = ImGui::GetStyle();
     bool is_lf = false;
 
+    const char* run = str;
+    size_t n = 0;
+    if (m_run && (m_run->layout_font != ImGui::GetFont() || m_run->layout_scale != scale)) {
+        m_run->lines.clear();
+        m_run->layout_font = ImGui::GetFont();
+        m_run->layout_scale = scale;
+    }
+
     while (!m_is_image && str < str_end) {
 
         const char* te = str_end;
@@ -338,9 +347,20 @@ void imgui_md::render_text(const char* str, const char* str_end) {
                 wl -= ImGui::GetCursorPosX();
             }
 
-            te = ImGui::GetFont()->CalcWordWrapPositionA(scale, str, str_end, wl);
+            // the previous lines were the same, so this one starts at the same place
+            if (m_run && n < m_run->lines.size() && m_run->lines[n].wrap == wl) {
+                te = run + m_run->lines[n].end;
+            } else {
+                te = ImGui::GetFont()->CalcWordWrapPositionA(scale, str, str_end, wl);
+
+                if (te == str) ++te;
 
-            if (te == str) ++te;
+                if (m_run) {
+                    m_run->lines.resize(n);
+                    m_run->lines.push_back(doc_line{wl, (u32)(te - run)});
+                }
+            }
+            ++n;
         }
 
         ImGui::TextUnformatted(str, te);
@@ -637,7 +657,174 @@ int imgui_md::span(MD_SPANTYPE type, void* d, bool e) {
     return 0;
 }
 
-int imgui_md::print(const std::string& str) { return md_parse(str.c_str(), (MD_SIZE)str.size(), &m_md, this); }
+int imgui_md::record_block(MD_BLOCKTYPE type, void* d, bool e) {
+    doc_event ev;
+    ev.kind = doc_event::BLOCK;
+    ev.enter = e;
+    ev.type = type;
+    ev.detail = d ? record_detail(type, false, d) : -1;
+    m_doc.events.push_back(std::move(ev));
+    return 0;
+}
+
+int imgui_md::record_span(MD_SPANTYPE type, void* d, bool e) {
+    doc_event ev;
+    ev.kind = doc_event::SPAN;
+    ev.enter = e;
+    ev.type = type;
+    ev.detail = d ? record_detail(type, true, d) : -1;
+    m_doc.events.push_back(std::move(ev));
+    return 0;
+}
+
+int imgui_md::record_text(MD_TEXTTYPE type, const char* str, MD_SIZE size) {
+    // md4c may hand out text from its own temporary buffers, keep a copy
+    doc_event ev;
+    ev.kind = doc_event::TEXT;
+    ev.enter = true;
+    ev.type = type;
+    ev.begin = (u32)m_doc.text.size();
+    if (size) m_doc.text.append(str, size);
+    ev.end = (u32)m_doc.text.size();
+    m_doc.events.push_back(std::move(ev));
+    return 0;
+}
+
+int imgui_md::record_detail(int type, bool is_span, const void* d) {
+    doc_detail dd{};
+    const MD_ATTRIBUTE* attrs[2] = {};
+
+    if (is_span) {
+        switch (type) {
+            case MD_SPAN_A:
+                dd.d.a = *(const MD_SPAN_A_DETAIL*)d;
+                attrs[0] = &dd.d.a.href;
+                attrs[1] = &dd.d.a.title;
+                break;
+            case MD_SPAN_IMG:
+                dd.d.img = *(const MD_SPAN_IMG_DETAIL*)d;
+                attrs[0] = &dd.d.img.src;
+                attrs[1] = &dd.d.img.title;
+                break;
+            case MD_SPAN_WIKILINK:
+                dd.d.wikilink = *(const MD_SPAN_WIKILINK_DETAIL*)d;
+                attrs[0] = &dd.d.wikilink.target;
+                break;
+            default:
+                return -1;
+        }
+    } else {
+        switch (type) {
+            case MD_BLOCK_UL:
+                dd.d.ul = *(const MD_BLOCK_UL_DETAIL*)d;
+                break;
+            case MD_BLOCK_OL:
+                dd.d.ol = *(const MD_BLOCK_OL_DETAIL*)d;
+                break;
+            case MD_BLOCK_LI:
+                dd.d.li = *(const MD_BLOCK_LI_DETAIL*)d;
+                break;
+            case MD_BLOCK_H:
+                dd.d.h = *(const MD_BLOCK_H_DETAIL*)d;
+                break;
+            case MD_BLOCK_CODE:
+                dd.d.code = *(const MD_BLOCK_CODE_DETAIL*)d;
+                attrs[0] = &dd.d.code.info;
+                attrs[1] = &dd.d.code.lang;
+                break;
+            case MD_BLOCK_TABLE:
+                dd.d.table = *(const MD_BLOCK_TABLE_DETAIL*)d;
+                break;
+            case MD_BLOCK_TH:
+            case MD_BLOCK_TD:
+                dd.d.td = *(const MD_BLOCK_TD_DETAIL*)d;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    for (const MD_ATTRIBUTE* a : attrs) {
+        if (!a) continue;
+
+        doc_attr& r = dd.attr[dd.attr_count++];
+        r.slot = (u32)((const char*)a - (const char*)&dd);
+        r.text = (u32)m_doc.text.size();
+        r.size = a->size;
+        if (a->size) m_doc.text.append(a->text, a->size);
+
+        // substr_offsets has one entry more than substr_types, the last one equals size
+        u32 n = 0;
+        if (a->substr_offsets) {
+            while (a->substr_offsets[n] < a->size) ++n;
+        }
+        r.substr = (u32)m_doc.substr_offsets.size();
+        r.substr_count = n;
+        for (u32 i = 0; i < n; ++i) {
+            m_doc.substr_types.push_back(a->substr_types[i]);
+            m_doc.substr_offsets.push_back(a->substr_offsets[i]);
+        }
+        m_doc.substr_types.push_back(MD_TEXT_NORMAL);
+        m_doc.substr_offsets.push_back(a->size);
+    }
+
+    m_doc.details.push_back(dd);
+    return (int)m_doc.details.size() - 1;
+}
+
+void imgui_md::parse_document(const std::string& str, size_t hash) {
+    m_doc.text.clear();
+    m_doc.substr_types.clear();
+    m_doc.substr_offsets.clear();
+    m_doc.details.clear();
+    m_doc.events.clear();
+
+    m_doc.result = md_parse(str.c_str(), (MD_SIZE)str.size(), &m_md, this);
+    // a failed parse is tried again on the next print
+    m_doc.valid = m_doc.result == 0;
+    m_doc.hash = hash;
+    m_doc.size = str.size();
+
+    // nothing grows any more, point the attributes at the stored copies
+    for (doc_detail& dd : m_doc.details) {
+        for (int i = 0; i < dd.attr_count; ++i) {
+            const doc_attr& r = dd.attr[i];
+            MD_ATTRIBUTE& a = *(MD_ATTRIBUTE*)((char*)&dd + r.slot);
+            a.text = m_doc.text.data() + r.text;
+            a.size = r.size;
+            a.substr_types = m_doc.substr_types.data() + r.substr;
+            a.substr_offsets = m_doc.substr_offsets.data() + r.substr;
+        }
+    }
+}
+
+void imgui_md::replay_document() {
+    for (doc_event& ev : m_doc.events) {
+        void* d = ev.detail >= 0 ? &m_doc.details[ev.detail].d : nullptr;
+        switch (ev.kind) {
+            case doc_event::BLOCK:
+                block((MD_BLOCKTYPE)ev.type, d, ev.enter);
+                break;
+            case doc_event::SPAN:
+                span((MD_SPANTYPE)ev.type, d, ev.enter);
+                break;
+            case doc_event::TEXT:
+                m_run = &ev;
+                text((MD_TEXTTYPE)ev.type, m_doc.text.data() + ev.begin, m_doc.text.data() + ev.end);
+                m_run = nullptr;
+                break;
+        }
+    }
+}
+
+int imgui_md::print(const std::string& str) {
+    const size_t hash = std::hash<std::string_view>{}(str);
+    if (!m_doc.valid || m_doc.size != str.size() || m_doc.hash != hash) {
+        parse_document(str, hash);
+    }
+    replay_document();
+    return m_doc.result;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -664,6 +664,8 @@ namespace ImGuiHelper {
 struct imgui_md {
     imgui_md();
     virtual ~imgui_md(){};
+    // md_parse runs only when str differs from the last call, otherwise the recorded
+    // document is replayed. Wrap positions are kept per text run until the wrap width changes.
     int print(const std::string &str);
     bool m_table_border = true;
     bool m_table_header_highlight = true;
@@ -751,6 +753,14 @@ private:
 
     void render_text(const char *str, const char *str_end);
 
+    // md4c callbacks while parsing into m_doc
+    int record_block(MD_BLOCKTYPE type, void *d, bool e);
+    int record_span(MD_SPANTYPE type, void *d, bool e);
+    int record_text(MD_TEXTTYPE type, const char *str, MD_SIZE size);
+    int record_detail(int type, bool is_span, const void *d);
+    void parse_document(const std::string &str, size_t hash);
+    void replay_document();
+
     void set_font(bool e);
     void set_color(bool e);
     void set_href(bool e, const MD_ATTRIBUTE &src);
@@ -774,6 +784,67 @@ private:
     std::vector<std::string> m_div_stack;
 
     MD_PARSER m_md;
+
+    // parsed document
+    // attributes are stored as offsets while parsing, the vectors grow and would move the pointers
+    struct doc_attr {
+        // byte offset of the MD_ATTRIBUTE inside doc_detail
+        u32 slot = 0;
+        u32 text = 0;
+        u32 size = 0;
+        u32 substr = 0;
+        u32 substr_count = 0;
+    };
+    struct doc_detail {
+        union {
+            MD_BLOCK_UL_DETAIL ul;
+            MD_BLOCK_OL_DETAIL ol;
+            MD_BLOCK_LI_DETAIL li;
+            MD_BLOCK_H_DETAIL h;
+            MD_BLOCK_CODE_DETAIL code;
+            MD_BLOCK_TABLE_DETAIL table;
+            MD_BLOCK_TD_DETAIL td;
+            MD_SPAN_A_DETAIL a;
+            MD_SPAN_IMG_DETAIL img;
+            MD_SPAN_WIKILINK_DETAIL wikilink;
+        } d;
+        doc_attr attr[2];
+        int attr_count = 0;
+    };
+    // one wrapped line of a text run, end is relative to the run
+    struct doc_line {
+        float wrap;
+        u32 end;
+    };
+    struct doc_event {
+        enum kind_t : u8 { BLOCK, SPAN, TEXT };
+        kind_t kind;
+        bool enter;
+        int type;
+        // TEXT: range in doc.text
+        u32 begin = 0;
+        u32 end = 0;
+        // index in doc.details, -1 without detail
+        int detail = -1;
+        // TEXT: wrap positions from the last replay, valid for layout_font and layout_scale
+        std::vector<doc_line> lines;
+        ImFont *layout_font = nullptr;
+        float layout_scale = 0.0f;
+    };
+    struct document {
+        bool valid = false;
+        size_t hash = 0;
+        size_t size = 0;
+        int result = 0;
+        std::string text;
+        std::vector<MD_TEXTTYPE> substr_types;
+        std::vector<MD_OFFSET> substr_offsets;
+        std::vector<doc_detail> details;
+        std::vector<doc_event> events;
+    };
+    document m_doc;
+    // text run being replayed, render_text caches its wrap positions there
+    doc_event *m_run = nullptr;
 };
 
 struct dbgui_md : public imgui_md {
@@ -49,6 +49,7 @@ enum ME_SURFACE_GLcallType {
     ME_SURFACE_GL_CONVEXFILL,
     ME_SURFACE_GL_STROKE,
     ME_SURFACE_GL_TRIANGLES,
+    ME_SURFACE_GL_INDEXED,
 };
 
 struct ME_SURFACE_GLcall {
@@ -59,6 +60,8 @@ struct ME_SURFACE_GLcall {
     int triangleOffset;
     int triangleCount;
     int uniformOffset;
+    int indexOffset;
+    int indexCount;
     ME_SURFACE_GLblend blendFunc;
 };
 typedef struct ME_SURFACE_GLcall ME_SURFACE_GLcall;
@@ -88,6 +91,21 @@ struct ME_SURFACE_GLfragUniforms {
 };
 typedef struct ME_SURFACE_GLfragUniforms ME_SURFACE_GLfragUniforms;
 
+// Persistently mapped stream for the per frame uniforms, vertices and indices (GL 4.4).
+// Each flush writes one segment and fences it, the segment is reused ME_SURFACE_GL_RING_SEGMENTS flushes later.
+// If the GPU still reads it, the flush falls back to glBufferData instead of waiting.
+#define ME_SURFACE_GL_RING_SEGMENTS 3
+#define ME_SURFACE_GL_RING_MIN_SEGMENT (256 * 1024)
+
+struct ME_SURFACE_GLring {
+    GLuint buf;
+    unsigned char* mapped;
+    GLsizeiptr segmentSize;
+    int segment;
+    GLsync fences[ME_SURFACE_GL_RING_SEGMENTS];
+};
+typedef struct ME_SURFACE_GLring ME_SURFACE_GLring;
+
 struct ME_SURFACE_GLcontext {
     ME_SURFACE_GLshader shader;
     ME_SURFACE_GLtexture* textures;
@@ -98,9 +116,18 @@ struct ME_SURFACE_GLcontext {
     GLuint vertBuf;
     GLuint vertArr;
     GLuint fragBuf;
+    GLuint indexBuf;
     int fragSize;
     int flags;
 
+    ME_SURFACE_GLring ring;
+    int ringEnabled;
+
+    // Where the current flush uploaded its data
+    GLuint drawFragBuf;
+    GLintptr drawFragBase;
+    GLintptr drawIndexBase;
+
     // Per frame buffers
     ME_SURFACE_GLcall* calls;
     int ccalls;
@@ -114,6 +141,9 @@ struct ME_SURFACE_GLcontext {
     unsigned char* uniforms;
     int cuniforms;
     int nuniforms;
+    GLuint* indices;
+    int cindices;
+    int nindices;
 
     // cached state
     GLuint boundTexture;
@@ -470,6 +500,7 @@ static int ME_surface_gl_renderCreate(void* uptr) {
     // Create dynamic vertex array
     glGenVertexArrays(1, &gl->vertArr);
     glGenBuffers(1, &gl->vertBuf);
+    glGenBuffers(1, &gl->indexBuf);
 
     // Create UBOs
     glUniformBlockBinding(gl->shader.prog, gl->shader.loc[ME_SURFACE_GL_LOC_FRAG], ME_SURFACE_GL_FRAG_BINDING);
@@ -477,6 +508,7 @@ static int ME_surface_gl_renderCreate(void* uptr) {
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
 
     gl->fragSize = sizeof(ME_SURFACE_GLfragUniforms) + align - sizeof(ME_SURFACE_GLfragUniforms) % align;
+    gl->ringEnabled = GLAD_GL_VERSION_4_4 && ME_SURFACE_GL_RING_MIN_SEGMENT % align == 0;
 
     // Some platforms does not allow to have samples to unset textures.
     // Create empty one which is bound when there's no texture specified.
@@ -687,7 +719,7 @@ static ME_SURFACE_GLfragUniforms* ME_surface_impl_fragUniformPtr(ME_SURFACE_GLco
 
 static void ME_surface_gl_setUniforms(ME_SURFACE_GLcontext* gl, int uniformOffset, int image) {
     ME_SURFACE_GLtexture* tex = NULL;
-    glBindBufferRange(GL_UNIFORM_BUFFER, ME_SURFACE_GL_FRAG_BINDING, gl->fragBuf, uniformOffset, sizeof(ME_SURFACE_GLfragUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, ME_SURFACE_GL_FRAG_BINDING, gl->drawFragBuf, gl->drawFragBase + uniformOffset, sizeof(ME_SURFACE_GLfragUniforms));
 
     if (image != 0) {
         tex = ME_surface_gl_findTexture(gl, image);
@@ -812,12 +844,142 @@ static void ME_surface_gl_triangles(ME_SURFACE_GLcontext* gl, ME_SURFACE_GLcall*
     glDrawArrays(GL_TRIANGLES, call->triangleOffset, call->triangleCount);
 }
 
+static void ME_surface_gl_indexed(ME_SURFACE_GLcontext* gl, ME_SURFACE_GLcall* call) {
+    ME_surface_gl_setUniforms(gl, call->uniformOffset, call->image);
+    ME_surface_gl_checkError(gl, "indexed fill");
+
+    glDrawElements(GL_TRIANGLES, call->indexCount, GL_UNSIGNED_INT, (const GLvoid*)(gl->drawIndexBase + (GLintptr)call->indexOffset * sizeof(GLuint)));
+}
+
 static void ME_surface_gl_renderCancel(void* uptr) {
     ME_SURFACE_GLcontext* gl = (ME_SURFACE_GLcontext*)uptr;
     gl->nverts = 0;
     gl->npaths = 0;
     gl->ncalls = 0;
     gl->nuniforms = 0;
+    gl->nindices = 0;
+}
+
+static void ME_surface_gl_deleteRing(ME_SURFACE_GLring* ring) {
+    int i;
+    for (i = 0; i < ME_SURFACE_GL_RING_SEGMENTS; i++) {
+        if (ring->fences[i]) glDeleteSync(ring->fences[i]);
+    }
+    if (ring->buf != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, ring->buf);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &ring->buf);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+static int ME_surface_gl_createRing(ME_SURFACE_GLring* ring, GLsizeiptr segmentSize) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    // The old buffer is released by the driver once the GPU is done with it
+    ME_surface_gl_deleteRing(ring);
+
+    glGenBuffers(1, &ring->buf);
+    glBindBuffer(GL_ARRAY_BUFFER, ring->buf);
+    glBufferStorage(GL_ARRAY_BUFFER, segmentSize * ME_SURFACE_GL_RING_SEGMENTS, NULL, flags);
+    ring->mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, segmentSize * ME_SURFACE_GL_RING_SEGMENTS, flags);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (ring->mapped == NULL) {
+        glDeleteBuffers(1, &ring->buf);
+        ring->buf = 0;
+        return 0;
+    }
+
+    ring->segmentSize = segmentSize;
+    return 1;
+}
+
+// Returns the start of the next free segment, or NULL to upload with glBufferData.
+static unsigned char* ME_surface_gl_ringBegin(ME_SURFACE_GLcontext* gl, GLsizeiptr size, GLintptr* offset) {
+    ME_SURFACE_GLring* ring = &gl->ring;
+    GLsync fence;
+
+    if (!gl->ringEnabled) return NULL;
+
+    if (ring->buf == 0 || size > ring->segmentSize) {
+        GLsizeiptr segmentSize = ring->segmentSize ? ring->segmentSize : ME_SURFACE_GL_RING_MIN_SEGMENT;
+        while (segmentSize < size) segmentSize *= 2;
+        if (!ME_surface_gl_createRing(ring, segmentSize)) {
+            gl->ringEnabled = 0;
+            return NULL;
+        }
+    }
+
+    fence = ring->fences[ring->segment];
+    if (fence) {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) return NULL;
+        glDeleteSync(fence);
+        ring->fences[ring->segment] = 0;
+    }
+
+    *offset = (GLintptr)ring->segment * ring->segmentSize;
+    return ring->mapped + *offset;
+}
+
+static void ME_surface_gl_ringEnd(ME_SURFACE_GLcontext* gl) {
+    ME_SURFACE_GLring* ring = &gl->ring;
+    ring->fences[ring->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring->segment = (ring->segment + 1) % ME_SURFACE_GL_RING_SEGMENTS;
+}
+
+// Uploads uniforms, vertices and indices of this flush and points the vertex array at them.
+// Returns 1 if the data went into the ring and the segment has to be fenced after drawing.
+static int ME_surface_gl_uploadFrame(ME_SURFACE_GLcontext* gl) {
+    const GLsizeiptr fragBytes = (GLsizeiptr)gl->nuniforms * gl->fragSize;
+    const GLsizeiptr vertBytes = (GLsizeiptr)gl->nverts * sizeof(MEsurface_vertex);
+    const GLsizeiptr indexBytes = (GLsizeiptr)gl->nindices * sizeof(GLuint);
+    // Segments start aligned for the UBO, fragSize is a multiple of the alignment
+    const GLsizeiptr vertOffset = fragBytes;
+    const GLsizeiptr indexOffset = vertOffset + vertBytes;
+    GLintptr base = 0, vertBase = 0;
+    unsigned char* dst = ME_surface_gl_ringBegin(gl, indexOffset + indexBytes, &base);
+
+    glBindVertexArray(gl->vertArr);
+
+    if (dst != NULL) {
+        memcpy(dst, gl->uniforms, fragBytes);
+        memcpy(dst + vertOffset, gl->verts, vertBytes);
+        if (indexBytes > 0) memcpy(dst + indexOffset, gl->indices, indexBytes);
+
+        gl->drawFragBuf = gl->ring.buf;
+        gl->drawFragBase = base;
+        gl->drawIndexBase = base + indexOffset;
+        vertBase = base + vertOffset;
+
+        glBindBuffer(GL_ARRAY_BUFFER, gl->ring.buf);
+        if (indexBytes > 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl->ring.buf);
+    } else {
+        // Upload ubo for frag shaders
+        glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
+        glBufferData(GL_UNIFORM_BUFFER, fragBytes, gl->uniforms, GL_STREAM_DRAW);
+
+        gl->drawFragBuf = gl->fragBuf;
+        gl->drawFragBase = 0;
+        gl->drawIndexBase = 0;
+
+        // Upload vertex data
+        glBindBuffer(GL_ARRAY_BUFFER, gl->vertBuf);
+        glBufferData(GL_ARRAY_BUFFER, vertBytes, gl->verts, GL_STREAM_DRAW);
+        if (indexBytes > 0) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl->indexBuf);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, gl->indices, GL_STREAM_DRAW);
+        }
+    }
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(MEsurface_vertex), (const GLvoid*)vertBase);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MEsurface_vertex), (const GLvoid*)(vertBase + 2 * sizeof(float)));
+
+    return dst != NULL;
 }
 
 static GLenum ME_surface_gl___convertBlendFuncFactor(int factor) {
@@ -852,7 +1014,7 @@ static ME_SURFACE_GLblend ME_surface_gl_blendCompositeOperation(MEsurface_compos
 
 static void ME_surface_gl_renderFlush(void* uptr) {
     ME_SURFACE_GLcontext* gl = (ME_SURFACE_GLcontext*)uptr;
-    int i;
+    int i, fenced;
 
     if (gl->ncalls > 0) {
 
@@ -882,24 +1044,13 @@ static void ME_surface_gl_renderFlush(void* uptr) {
         gl->blendFunc.dstRGB = GL_INVALID_ENUM;
         gl->blendFunc.dstAlpha = GL_INVALID_ENUM;
 
-        // Upload ubo for frag shaders
-        glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
-        glBufferData(GL_UNIFORM_BUFFER, gl->nuniforms * gl->fragSize, gl->uniforms, GL_STREAM_DRAW);
-
-        // Upload vertex data
-        glBindVertexArray(gl->vertArr);
-        glBindBuffer(GL_ARRAY_BUFFER, gl->vertBuf);
-        glBufferData(GL_ARRAY_BUFFER, gl->nverts * sizeof(MEsurface_vertex), gl->verts, GL_STREAM_DRAW);
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(MEsurface_vertex), (const GLvoid*)(size_t)0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(MEsurface_vertex), (const GLvoid*)(0 + 2 * sizeof(float)));
+        fenced = ME_surface_gl_uploadFrame(gl);
 
         // Set view and texture just once per frame.
         glUniform1i(gl->shader.loc[ME_SURFACE_GL_LOC_TEX], 0);
         glUniform2fv(gl->shader.loc[ME_SURFACE_GL_LOC_VIEWSIZE], 1, gl->view);
 
-        glBindBuffer(GL_UNIFORM_BUFFER, gl->fragBuf);
+        glBindBuffer(GL_UNIFORM_BUFFER, gl->drawFragBuf);
 
         for (i = 0; i < gl->ncalls; i++) {
             ME_SURFACE_GLcall* call = &gl->calls[i];
@@ -912,8 +1063,12 @@ static void ME_surface_gl_renderFlush(void* uptr) {
                 ME_surface_gl_stroke(gl, call);
             else if (call->type == ME_SURFACE_GL_TRIANGLES)
                 ME_surface_gl_triangles(gl, call);
+            else if (call->type == ME_SURFACE_GL_INDEXED)
+                ME_surface_gl_indexed(gl, call);
         }
 
+        if (fenced) ME_surface_gl_ringEnd(gl);
+
         glDisableVertexAttribArray(0);
         glDisableVertexAttribArray(1);
 
@@ -930,6 +1085,7 @@ static void ME_surface_gl_renderFlush(void* uptr) {
     gl->npaths = 0;
     gl->ncalls = 0;
     gl->nuniforms = 0;
+    gl->nindices = 0;
 }
 
 static int ME_surface_gl_maxVertCount(const MEsurface_path* paths, int npaths) {
@@ -1003,6 +1159,106 @@ static int ME_surface_gl_allocFragUniforms(ME_SURFACE_GLcontext* gl, int n) {
 
 static ME_SURFACE_GLfragUniforms* ME_surface_impl_fragUniformPtr(ME_SURFACE_GLcontext* gl, int i) { return (ME_SURFACE_GLfragUniforms*)&gl->uniforms[i]; }
 
+static int ME_surface_gl_allocIndices(ME_SURFACE_GLcontext* gl, int n) {
+    int ret = 0;
+    if (gl->nindices + n > gl->cindices) {
+        GLuint* indices;
+        int cindices = ME_surface_gl_maxi(gl->nindices + n, 4096) + gl->cindices / 2;  // 1.5x Overallocate
+        indices = (GLuint*)realloc(gl->indices, sizeof(GLuint) * cindices);
+        if (indices == NULL) return -1;
+        gl->indices = indices;
+        gl->cindices = cindices;
+    }
+    ret = gl->nindices;
+    gl->nindices += n;
+    return ret;
+}
+
+static int ME_surface_gl_listIndexCount(int nverts) { return nverts >= 3 ? (nverts - 2) * 3 : 0; }
+
+// Fans and strips are unrolled to triangle lists keeping the winding, culling stays the same
+static GLuint* ME_surface_gl_fanIndices(GLuint* dst, int first, int n) {
+    int k;
+    for (k = 1; k + 1 < n; k++) {
+        *dst++ = first;
+        *dst++ = first + k;
+        *dst++ = first + k + 1;
+    }
+    return dst;
+}
+
+static GLuint* ME_surface_gl_stripIndices(GLuint* dst, int first, int n) {
+    int k;
+    for (k = 0; k + 2 < n; k++) {
+        *dst++ = first + k + (k & 1);
+        *dst++ = first + k + 1 - (k & 1);
+        *dst++ = first + k + 2;
+    }
+    return dst;
+}
+
+// Merges the last call into the one before it when they share all state and their indices are contiguous.
+static void ME_surface_gl_mergeLastCall(ME_SURFACE_GLcontext* gl) {
+    ME_SURFACE_GLcall *call, *prev;
+
+    if (gl->ncalls < 2) return;
+    call = &gl->calls[gl->ncalls - 1];
+    prev = &gl->calls[gl->ncalls - 2];
+
+    if (prev->type != ME_SURFACE_GL_INDEXED || prev->image != call->image) return;
+    if (memcmp(&prev->blendFunc, &call->blendFunc, sizeof(ME_SURFACE_GLblend)) != 0) return;
+    if (prev->indexOffset + prev->indexCount != call->indexOffset) return;
+    // Only the most recently allocated uniforms can be given back
+    if (call->uniformOffset != (gl->nuniforms - 1) * gl->fragSize) return;
+    // convertPaint clears the whole struct, so comparing the bytes is exact
+    if (memcmp(ME_surface_impl_fragUniformPtr(gl, prev->uniformOffset), ME_surface_impl_fragUniformPtr(gl, call->uniformOffset), sizeof(ME_SURFACE_GLfragUniforms)) != 0) return;
+
+    prev->indexCount += call->indexCount;
+    gl->nuniforms--;
+    gl->ncalls--;
+}
+
+// Turns the last call (a convex fill, a non-stencil stroke or triangles) into an indexed triangle list.
+// It stays as it is if the index allocation fails.
+static void ME_surface_gl_batchLastCall(ME_SURFACE_GLcontext* gl) {
+    ME_SURFACE_GLcall* call = &gl->calls[gl->ncalls - 1];
+    ME_SURFACE_GLpath* paths = &gl->paths[call->pathOffset];
+    GLuint* dst;
+    int i, count = 0, offset;
+
+    if (call->type == ME_SURFACE_GL_TRIANGLES) {
+        count = call->triangleCount;
+    } else {
+        for (i = 0; i < call->pathCount; i++) {
+            if (call->type == ME_SURFACE_GL_CONVEXFILL) count += ME_surface_gl_listIndexCount(paths[i].fillCount);
+            count += ME_surface_gl_listIndexCount(paths[i].strokeCount);
+        }
+    }
+    if (count == 0) return;
+
+    offset = ME_surface_gl_allocIndices(gl, count);
+    if (offset == -1) return;
+
+    dst = &gl->indices[offset];
+    if (call->type == ME_SURFACE_GL_TRIANGLES) {
+        for (i = 0; i < count; i++) dst[i] = call->triangleOffset + i;
+    } else {
+        for (i = 0; i < call->pathCount; i++) {
+            if (call->type == ME_SURFACE_GL_CONVEXFILL) dst = ME_surface_gl_fanIndices(dst, paths[i].fillOffset, paths[i].fillCount);
+            dst = ME_surface_gl_stripIndices(dst, paths[i].strokeOffset, paths[i].strokeCount);
+        }
+        // The paths are not needed any more
+        if (call->pathOffset + call->pathCount == gl->npaths) gl->npaths = call->pathOffset;
+        call->pathCount = 0;
+    }
+
+    call->type = ME_SURFACE_GL_INDEXED;
+    call->indexOffset = offset;
+    call->indexCount = count;
+
+    ME_surface_gl_mergeLastCall(gl);
+}
+
 static void ME_surface_gl_vset(MEsurface_vertex* vtx, float x, float y, float u, float v) {
     vtx->x = x;
     vtx->y = y;
@@ -1080,6 +1336,8 @@ static void ME_surface_gl_renderFill(void* uptr, MEsurface_paint* paint, MEsurfa
         if (call->uniformOffset == -1) goto error;
         // Fill shader
         ME_surface_gl_convertPaint(gl, ME_surface_impl_fragUniformPtr(gl, call->uniformOffset), paint, scissor, fringe, fringe, -1.0f);
+
+        if (gl->flags & ME_SURFACE_BATCH) ME_surface_gl_batchLastCall(gl);
     }
 
     return;
@@ -1135,6 +1393,8 @@ static void ME_surface_gl_renderStroke(void* uptr, MEsurface_paint* paint, MEsur
         call->uniformOffset = ME_surface_gl_allocFragUniforms(gl, 1);
         if (call->uniformOffset == -1) goto error;
         ME_surface_gl_convertPaint(gl, ME_surface_impl_fragUniformPtr(gl, call->uniformOffset), paint, scissor, strokeWidth, fringe, -1.0f);
+
+        if (gl->flags & ME_SURFACE_BATCH) ME_surface_gl_batchLastCall(gl);
     }
 
     return;
@@ -1171,6 +1431,8 @@ static void ME_surface_gl_renderTriangles(void* uptr, MEsurface_paint* paint, ME
     ME_surface_gl_convertPaint(gl, frag, paint, scissor, 1.0f, fringe, -1.0f);
     frag->type = ME_SURFACE_SVG_SHADER_IMG;
 
+    if (gl->flags & ME_SURFACE_BATCH) ME_surface_gl_batchLastCall(gl);
+
     return;
 
 error:
@@ -1192,6 +1454,10 @@ static void ME_surface_gl_renderDelete(void* uptr) {
 
     if (gl->vertBuf != 0) glDeleteBuffers(1, &gl->vertBuf);
 
+    if (gl->indexBuf != 0) glDeleteBuffers(1, &gl->indexBuf);
+
+    ME_surface_gl_deleteRing(&gl->ring);
+
     for (i = 0; i < gl->ntextures; i++) {
         if (gl->textures[i].tex != 0 && (gl->textures[i].flags & ME_SURFACE_IMAGE_NODELETE) == 0) glDeleteTextures(1, &gl->textures[i].tex);
     }
@@ -1200,6 +1466,7 @@ static void ME_surface_gl_renderDelete(void* uptr) {
     free(gl->paths);
     free(gl->verts);
     free(gl->uniforms);
+    free(gl->indices);
     free(gl->calls);
 
     free(gl);
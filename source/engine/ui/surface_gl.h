@@ -17,6 +17,9 @@ enum MEsurface_createFlags {
     ME_SURFACE_STENCIL_STROKES = 1 << 1,
     // Flag indicating that additional debug checks are done.
     ME_SURFACE_DEBUG = 1 << 2,
+    // Flag indicating that convex fills, triangles and (non-stencil) strokes are drawn as indexed triangle
+    // lists, and consecutive calls sharing paint, scissor, image and blend state are merged into one draw.
+    ME_SURFACE_BATCH = 1 << 3,
 };
 
 MEsurface_context* ME_surface_CreateGL3(int flags);
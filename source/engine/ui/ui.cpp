@@ -2,6 +2,8 @@
 
 #include "engine/ui/ui.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "engine/core/core.hpp"
@@ -24,7 +26,7 @@ f32 box_distence(MErect box, MEvec2 A) {
     return 0;
 }
 
-void gui::render_postupdate() { imgui->NewFrame(); }
+void gui::render_postupdate(bool keep_imgui) { imgui->NewFrame(keep_imgui); }
 
 void gui::render() {
     // GUI边界检测 防止UI窗口移动到视图外
@@ -35,6 +37,8 @@ void gui::render() {
 
     auto* target = the<engine>().eng()->target;
 
+    debugDraw.flush();
+
     debugUI->draw(target, 0, 0);
 
     if (chiselUI != NULL) {
@@ -56,7 +60,8 @@ void gui::render_imgui() {
 void gui::render_update() {
 
     imgui->Update();
-    the<scripting>().fast_call_func("OnGameGUIUpdate")();
+    // 跳过的帧里 Lua 菜单也不画 (Wanted 已经看过 GetUIState)
+    if (imgui->FrameActive()) the<scripting>().run_hooks(script_hook::GUI);
 
     if (global.game->state == LOADING) return;
 
@@ -98,11 +103,11 @@ void gui::DrawPoint(MEvec3 pos, float size, Texture* texture, u8 r, u8 g, u8 b)
     if (texture) {
         // DrawRectangleTextured(min, max, texture, r, g, b);
     } else {
-        // DrawRectangle(min, max, r, g, b);
+        debugDraw.rectangle_filled(the<engine>().eng()->target, min.x, min.y, max.x, max.y, {r, g, b, 255});
     }
 }
 
-void gui::DrawLine(MEvec3 min, MEvec3 max, float thickness, u8 r, u8 g, u8 b) { R_Line(the<engine>().eng()->target, min.x, min.y, max.x, max.y, {r, g, b, 255}); }
+void gui::DrawLine(MEvec3 min, MEvec3 max, float thickness, u8 r, u8 g, u8 b) { debugDraw.line(the<engine>().eng()->target, min.x, min.y, max.x, max.y, {r, g, b, 255}, thickness); }
 
 void gui::chisel_ui(RigidBody* cur) {
 
@@ -148,6 +153,7 @@ void gui::init() {
     debugUI->background = new SolidBackground(0x80000000);
     debugUI->drawBorder = true;
     debugUI->visible = true;
+    debugUI->cached = true;
 
     UILabel* titleLabel = new UILabel(new MErect{1, 20, 1, 30}, "喵喵", global.game->basic_font, 0xffffff, ALIGN_CENTER);
     debugUI->children.push_back(titleLabel);
@@ -174,11 +180,60 @@ void gui::registerLua(lua_wrapper::State* p_lua) {}
 void UI::draw(R_Target* t, int transformX, int transformY) {
     if (!visible) return;
 
-    background->draw(t, bounds);
+    if (!cached) {
+        drawLayer(t, transformX, transformY);
+    } else {
+        if (layerDirty || layer == nullptr || layer->w != (u16)std::ceil(bounds->w) || layer->h != (u16)std::ceil(bounds->h)) rebuildLayer();
+        MErect dst{bounds->x + transformX, bounds->y + transformY, (f32)layer->w, (f32)layer->h};
+        R_BlitRect(layer, NULL, t, &dst);
+    }
+
+    drawOverlay(t, transformX, transformY);
+}
+
+void UI::drawLayer(R_Target* t, int transformX, int transformY) {
+    if (background != nullptr) {
+        MErect rect{bounds->x + transformX, bounds->y + transformY, bounds->w, bounds->h};
+        background->draw(t, &rect);
+    }
 
     UINode::draw(t, transformX, transformY);
 }
 
+void UI::rebuildLayer() {
+    ME_profiler_scope_auto("UILayer");
+
+    const u16 w = (u16)std::max(1.0f, std::ceil(bounds->w));
+    const u16 h = (u16)std::max(1.0f, std::ceil(bounds->h));
+    if (layer != nullptr && (layer->w != w || layer->h != h)) {
+        R_FreeTarget(layer->target);
+        R_FreeImage(layer);
+        layer = nullptr;
+    }
+    if (layer == nullptr) {
+        layer = R_CreateImage(w, h, R_FormatEnum::R_FORMAT_RGBA);
+        R_SetImageFilter(layer, R_FILTER_NEAREST);
+        // 层里存的是预乘过的颜色
+        R_SetBlendMode(layer, R_BLEND_PREMULTIPLIED_ALPHA);
+        R_LoadTarget(layer);
+    }
+
+    // 半透明的背景直接画进透明的层再混合一次会变淡 画形状时颜色预乘 alpha 按 over 累加
+    R_ClearColor(layer->target, {0, 0, 0, 0});
+    R_SetShapeBlendFunction(R_FUNC_SRC_ALPHA, R_FUNC_ONE_MINUS_SRC_ALPHA, R_FUNC_ONE, R_FUNC_ONE_MINUS_SRC_ALPHA);
+    drawLayer(layer->target, -(int)bounds->x, -(int)bounds->y);
+    R_SetShapeBlendMode(R_BLEND_NORMAL);
+
+    layerDirty = false;
+}
+
+UI::~UI() noexcept {
+    if (layer != nullptr) {
+        R_FreeTarget(layer->target);
+        R_FreeImage(layer);
+    }
+}
+
 bool UI::onEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY) {
     if (!visible) return false;
     if (ev.type == SDL_MOUSEMOTION && ev.motion.state & SDL_BUTTON_LMASK) {
@@ -209,6 +264,18 @@ void UINode::draw(R_Target* t, int transformX, int transformY) {
     }
 }
 
+void UINode::drawOverlay(R_Target* t, int transformX, int transformY) {
+    if (!visible) return;
+
+    for (auto& c : children) {
+        c->drawOverlay(t, bounds->x + transformX, bounds->y + transformY);
+    }
+}
+
+void UINode::invalidate() {
+    for (UINode* n = this; n != NULL; n = n->parent) n->layerDirty = true;
+}
+
 bool UINode::checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY) {
 
     if (!visible) return false;
@@ -267,9 +334,16 @@ void UILabel::draw(R_Target* t, int transformX, int transformY) {
 
     // if (NULL != texture) R_Blit(texture, NULL, t, bounds->x + transformX + 1 - align * surface->w / 2 + surface->w * 0.5, bounds->y + transformY + 1 + surface->h * 0.5);
 
+    UINode::draw(t, transformX, transformY);
+}
+
+void UILabel::drawOverlay(R_Target* t, int transformX, int transformY) {
+
+    if (!visible) return;
+
     the<fontcache>().push(text, font, (f32)bounds->x + transformX, (f32)bounds->y + transformY);
 
-    UINode::draw(t, transformX, transformY);
+    UINode::drawOverlay(t, transformX, transformY);
 }
 
 bool UIButton::checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY) {
@@ -293,6 +367,7 @@ bool UIButton::onEvent(C_Event ev, R_Target* t, world* world, int transformX, in
         return true;
     } else if (ev.type == SDL_MOUSEMOTION) {
 
+        const bool wasHovered = hovered;
         hovered = (ev.motion.x >= bounds->x + transformX && ev.button.x <= bounds->x + transformX + bounds->w && ev.button.y >= bounds->y + transformY &&
                    ev.button.y <= bounds->y + transformY + bounds->h) ||
                   (ev.motion.x - ev.motion.xrel >= bounds->x + transformX && ev.button.x - ev.motion.xrel <= bounds->x + transformX + bounds->w &&
@@ -301,6 +376,7 @@ bool UIButton::onEvent(C_Event ev, R_Target* t, world* world, int transformX, in
         // printf("hovering = %s\n", hovering ? "true" : "false");
 
         // hoverCallback();
+        if (hovered != wasHovered) invalidate();
         return hovered;
     }
     return false;
@@ -367,6 +443,7 @@ bool UICheckbox::onEvent(C_Event ev, R_Target* t, world* world, int transformX,
 
     if (ev.type == SDL_MOUSEBUTTONDOWN) {
         checked = !checked;
+        invalidate();
         callback(checked);
         return true;
     } else if (ev.type == SDL_MOUSEMOTION) {
@@ -419,14 +496,25 @@ void UITextArea::draw(R_Target* t, int transformX, int transformY) {
     //    Drawing::drawText(t, textParams, (int)tb.x + 1, (int)tb.y + 2, false, ALIGN_LEFT);
     //}
 
+    UINode::draw(t, transformX, transformY);
+}
+
+void UITextArea::drawOverlay(R_Target* t, int transformX, int transformY) {
+
+    if (!visible) return;
+
+    MErect tb = {(float)(bounds->x + transformX), (float)(bounds->y + transformY), (float)(bounds->w), (float)(bounds->h)};
+
+    int cursorX = 0;
     int font_height = 14;
 
+    // 光标闪烁 不能进缓存层
     if (focused && (ME_gettime() - lastCursorTimer) % 1000 < 500) {
         R_Line(t, tb.x + 3 + cursorX - 1, tb.y + 2 + 2, tb.x + 2 + cursorX - 1, tb.y + 2 + font_height, {0xff, 0xff, 0xff, 0xff});
         R_Line(t, tb.x + 3 + cursorX, tb.y + 2 + 2, tb.x + 2 + cursorX, tb.y + 2 + font_height, {0xaa, 0xaa, 0xaa, 0x80});
     }
 
-    UINode::draw(t, transformX, transformY);
+    UINode::drawOverlay(t, transformX, transformY);
 }
 
 bool UITextArea::checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY) {
@@ -453,6 +541,7 @@ bool UITextArea::onEvent(C_Event ev, R_Target* t, world* world, int transformX,
 
         bool wasFocused = focused;
         focused = hovered;
+        if (focused != wasFocused) invalidate();
 
         if (focused) {
             if (text.size() > 0) {
@@ -600,6 +689,7 @@ bool ChiselNode::onEvent(C_Event ev, R_Target* t, world* world, int transformX,
         R_FreeImage(texture);
         texture = R_CopyImageFromSurface(surface);
         R_SetImageFilter(texture, R_FILTER_NEAREST);
+        invalidate();
         return true;
     } else if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE) {
 
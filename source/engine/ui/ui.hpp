@@ -11,6 +11,7 @@
 #include "engine/core/core.hpp"
 #include "engine/game_basic.hpp"
 #include "engine/meta/reflection.hpp"
+#include "engine/renderer/debug_draw.hpp"
 #include "engine/renderer/renderer_gpu.h"
 #include "engine/renderer/renderer_opengl.h"
 #include "engine/textures.hpp"
@@ -44,7 +45,15 @@ public:
     UINode* parent = NULL;
     std::vector<UINode*> children = {};
 
+    // 所在 UI 的缓存层需要重画
+    bool layerDirty = true;
+
+    // 静态部分 (背景 边框 底色 贴图) 开了缓存的 UI 只在变化后画进缓存层
     virtual void draw(R_Target* t, int transformX, int transformY);
+    // 每帧都要画的部分 (文字 光标) 画在缓存层上面
+    virtual void drawOverlay(R_Target* t, int transformX, int transformY);
+    // 外观变化后调用 标记自己和所有父节点
+    void invalidate();
 
     virtual bool checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
 
@@ -56,11 +65,21 @@ public:
 class UI : public UINode {
 public:
     UIBackground* background = nullptr;
+
+    // 子树画进离屏缓存层 没有变化时每帧只贴一次 拖动窗口不需要重画
+    bool cached = false;
+    R_Image* layer = nullptr;
+
     void draw(R_Target* t, int transformX, int transformY);
 
     bool onEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
 
     UI(MErect* bounds) : UINode(bounds){};
+    ~UI() noexcept;
+
+private:
+    void drawLayer(R_Target* t, int transformX, int transformY);
+    void rebuildLayer();
 };
 
 class UILabel : public UINode {
@@ -71,6 +90,7 @@ public:
     int align;
 
     void draw(R_Target* t, int transformX, int transformY);
+    void drawOverlay(R_Target* t, int transformX, int transformY);
 
     UILabel(MErect* bounds, std::string text, font_index font, u32 textColor, int align) : UINode(bounds) {
         this->text = text;
@@ -92,6 +112,8 @@ public:
     bool checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
     bool onEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
     void draw(R_Target* t, int transformX, int transformY);
+    // 按钮文字在 surface 里 和底色一起进缓存层
+    void drawOverlay(R_Target* t, int transformX, int transformY) { UINode::drawOverlay(t, transformX, transformY); }
 
     C_Surface* surface = NULL;
     R_Image* texture = NULL;
@@ -136,6 +158,7 @@ public:
     long long lastCursorTimer = 0;
 
     void draw(R_Target* t, int transformX, int transformY);
+    void drawOverlay(R_Target* t, int transformX, int transformY);
 
     bool checkEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
     bool onEvent(C_Event ev, R_Target* t, world* world, int transformX, int transformY);
@@ -204,7 +227,7 @@ public:
     void end() override;
     void registerLua(lua_wrapper::State* p_lua) override;
 
-    void render_postupdate();
+    void render_postupdate(bool keep_imgui = false);
     void render_update();
     void render();
     void render_imgui();
@@ -212,9 +235,12 @@ public:
     bool push_input(C_KeyboardEvent event);
     bool push_event(C_Event event);
 
+    // 记录到 debugDraw 在 render 中画在 UI 下面 每帧一次 R_TriangleBatch
     void DrawPoint(MEvec3 pos, float size, Texture* texture, u8 r, u8 g, u8 b);
     void DrawLine(MEvec3 min, MEvec3 max, float thickness, u8 r, u8 g, u8 b);
 
+    DebugDrawBatch debugDraw;
+
     void chisel_ui(RigidBody* cur);
 };
 
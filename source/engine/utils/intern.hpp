@@ -0,0 +1,72 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_INTERN_HPP
+#define ME_INTERN_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 64 位 fnv1a 编译期和运行期结果相同
+constexpr u64 InternHash(std::string_view s) noexcept {
+    u64 h = 0xcbf29ce484222325ull;
+    for (char c : s) h = (h ^ (u8)c) * 0x100000001b3ull;
+    return h;
+}
+
+// 预先哈希的名字 C++ 里写成 constexpr 常量 查找时不再对字符串做哈希
+struct InternedName {
+    u64 hash = 0;
+    std::string_view name;
+
+    constexpr InternedName() = default;
+    constexpr explicit InternedName(std::string_view name) noexcept : hash(InternHash(name)), name(name) {}
+};
+
+// 名字到稠密整数 ID 的登记表 注册时哈希并检查冲突 查询只做一次整数 map 查找
+class NameRegistry {
+public:
+    static constexpr int INVALID = -1;
+
+    // 同名重复注册时覆盖原来的 ID 不同名字哈希冲突时返回 false
+    bool add(std::string_view name, int id) {
+        const InternedName n{name};
+        auto it = byHash.find(n.hash);
+        if (it != byHash.end() && names[it->second] != name) return false;
+
+        if (id >= (int)names.size()) names.resize(id + 1);
+        names[id] = std::string(name);
+        byHash[n.hash] = id;
+        return true;
+    }
+
+    int find(InternedName n) const {
+        auto it = byHash.find(n.hash);
+        return it != byHash.end() ? it->second : INVALID;
+    }
+    int find(std::string_view name) const { return find(InternedName{name}); }
+
+    // 没有注册的 ID 返回空字符串
+    std::string_view name(int id) const { return id >= 0 && id < (int)names.size() ? std::string_view(names[id]) : std::string_view(); }
+
+    size_t size() const { return byHash.size(); }
+    bool empty() const { return byHash.empty(); }
+
+    void clear() {
+        byHash.clear();
+        names.clear();
+    }
+
+private:
+    std::unordered_map<u64, int> byHash;
+    std::vector<std::string> names;
+};
+
+}  // namespace ME
+
+#endif
@@ -1744,4 +1744,298 @@ void writer::output_text_payload(std::ostream& out, data_tag const& tag) {
     }
 }
 
+void stream_writer::header(TAG type, std::string_view name) {
+    if (!inList.empty() && inList.back()) return;
+    store(out, type);
+    store(out, swap_u16((uint16_t)name.length()));
+    store_range(out, name.data(), name.length());
+}
+
+void stream_writer::begin_compound(std::string_view name) {
+    header(TAG::Compound, name);
+    inList.push_back(false);
+}
+
+void stream_writer::end_compound() {
+    store(out, TAG::End);
+    inList.pop_back();
+}
+
+void stream_writer::begin_list(TAG elementType, int32_t count, std::string_view name) {
+    header(TAG::List, name);
+    store(out, count ? elementType : TAG::End);
+    store(out, swap_i32(count));
+    inList.push_back(true);
+}
+
+void stream_writer::end_list() { inList.pop_back(); }
+
+void stream_writer::write_byte(int8_t b, std::string_view name) {
+    header(TAG::Byte, name);
+    store(out, b);
+}
+
+void stream_writer::write_short(int16_t s, std::string_view name) {
+    header(TAG::Short, name);
+    store(out, swap_i16(s));
+}
+
+void stream_writer::write_int(int32_t i, std::string_view name) {
+    header(TAG::Int, name);
+    store(out, swap_i32(i));
+}
+
+void stream_writer::write_long(int64_t l, std::string_view name) {
+    header(TAG::Long, name);
+    store(out, swap_i64(l));
+}
+
+void stream_writer::write_float(float f, std::string_view name) {
+    header(TAG::Float, name);
+    store(out, swap_f32(f));
+}
+
+void stream_writer::write_double(double d, std::string_view name) {
+    header(TAG::Double, name);
+    store(out, swap_f64(d));
+}
+
+void stream_writer::write_byte_array(int8_t const* array, int32_t length, std::string_view name) {
+    header(TAG::Byte_Array, name);
+    store(out, swap_i32(length));
+    store_range(out, array, length);
+}
+
+void stream_writer::write_int_array(int32_t const* array, int32_t count, std::string_view name) {
+    header(TAG::Int_Array, name);
+    store(out, swap_i32(count));
+    out.reserve(out.size() + sizeof(int32_t) * count);
+    for (int32_t i = 0; i < count; i++) store(out, swap_i32(array[i]));
+}
+
+void stream_writer::write_long_array(int64_t const* array, int32_t count, std::string_view name) {
+    header(TAG::Long_Array, name);
+    store(out, swap_i32(count));
+    out.reserve(out.size() + sizeof(int64_t) * count);
+    for (int32_t i = 0; i < count; i++) store(out, swap_i64(array[i]));
+}
+
+void stream_writer::write_string(std::string_view str, std::string_view name) {
+    header(TAG::String, name);
+    store(out, swap_u16((uint16_t)str.length()));
+    store_range(out, str.data(), str.length());
+}
+
+template <typename T>
+bool stream_reader::take(T& value) {
+    if (failed || size - pos < sizeof(T)) {
+        failed = true;
+        return false;
+    }
+    std::memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+bool stream_reader::take_bytes(size_t count, uint8_t const*& ptr) {
+    if (failed || size - pos < count) {
+        failed = true;
+        return false;
+    }
+    ptr = data + pos;
+    pos += count;
+    return true;
+}
+
+bool stream_reader::expect(TAG type) {
+    if (failed || !pending || current != type) {
+        failed = true;
+        return false;
+    }
+    pending = false;
+    return true;
+}
+
+bool stream_reader::enter_root() {
+    TAG type;
+    uint16_t length;
+    uint8_t const* str;
+    if (!take(type) || type != TAG::Compound || !take(length) || !take_bytes(swap_u16(length), str)) {
+        failed = true;
+        return false;
+    }
+    frames.push_back({false, TAG::End, 0, 0});
+    return true;
+}
+
+bool stream_reader::next() {
+    if (pending && !skip_payload(current)) return false;
+    pending = false;
+    if (failed || frames.empty()) return false;
+
+    Frame& frame = frames.back();
+    if (frame.list) {
+        if (frame.remaining == 0) {
+            frames.pop_back();
+            return false;
+        }
+        frame.remaining--;
+        current = frame.elementType;
+        currentName = {};
+    } else {
+        if (!take(current)) return false;
+        if (current == TAG::End) {
+            frames.pop_back();
+            return false;
+        }
+        uint16_t length;
+        uint8_t const* str;
+        if (!take(length) || !take_bytes(swap_u16(length), str)) return false;
+        currentName = {(char const*)str, swap_u16(length)};
+    }
+    pending = true;
+    return true;
+}
+
+int8_t stream_reader::read_byte() {
+    int8_t v = 0;
+    if (expect(TAG::Byte)) take(v);
+    return v;
+}
+
+int16_t stream_reader::read_short() {
+    int16_t v = 0;
+    if (expect(TAG::Short) && take(v)) return swap_i16(v);
+    return 0;
+}
+
+int32_t stream_reader::read_int() {
+    int32_t v = 0;
+    if (expect(TAG::Int) && take(v)) return swap_i32(v);
+    return 0;
+}
+
+int64_t stream_reader::read_long() {
+    int64_t v = 0;
+    if (expect(TAG::Long) && take(v)) return swap_i64(v);
+    return 0;
+}
+
+float stream_reader::read_float() {
+    float v = 0;
+    if (expect(TAG::Float) && take(v)) return swap_f32(v);
+    return 0;
+}
+
+double stream_reader::read_double() {
+    double v = 0;
+    if (expect(TAG::Double) && take(v)) return swap_f64(v);
+    return 0;
+}
+
+std::string_view stream_reader::read_string() {
+    uint16_t length;
+    uint8_t const* str;
+    if (!expect(TAG::String) || !take(length) || !take_bytes(swap_u16(length), str)) return {};
+    return {(char const*)str, swap_u16(length)};
+}
+
+bool stream_reader::read_byte_array(std::vector<int8_t>& out) {
+    int32_t count;
+    uint8_t const* bytes;
+    if (!expect(TAG::Byte_Array) || !take(count) || (count = swap_i32(count)) < 0 || !take_bytes((size_t)count, bytes)) return false;
+    out.assign((int8_t const*)bytes, (int8_t const*)bytes + count);
+    return true;
+}
+
+bool stream_reader::read_int_array(std::vector<int32_t>& out) {
+    int32_t count;
+    uint8_t const* bytes;
+    if (!expect(TAG::Int_Array) || !take(count) || (count = swap_i32(count)) < 0 || !take_bytes((size_t)count * sizeof(int32_t), bytes)) return false;
+    out.resize(count);
+    std::memcpy(out.data(), bytes, (size_t)count * sizeof(int32_t));
+    for (int32_t& v : out) v = swap_i32(v);
+    return true;
+}
+
+bool stream_reader::read_long_array(std::vector<int64_t>& out) {
+    int32_t count;
+    uint8_t const* bytes;
+    if (!expect(TAG::Long_Array) || !take(count) || (count = swap_i32(count)) < 0 || !take_bytes((size_t)count * sizeof(int64_t), bytes)) return false;
+    out.resize(count);
+    std::memcpy(out.data(), bytes, (size_t)count * sizeof(int64_t));
+    for (int64_t& v : out) v = swap_i64(v);
+    return true;
+}
+
+bool stream_reader::enter() {
+    if (failed || !pending) return false;
+    if (current == TAG::Compound) {
+        pending = false;
+        frames.push_back({false, TAG::End, 0, 0});
+        return true;
+    }
+    if (current == TAG::List) {
+        pending = false;
+        TAG elementType;
+        int32_t count;
+        if (!take(elementType) || !take(count)) return false;
+        count = swap_i32(count);
+        if (count < 0) {
+            failed = true;
+            return false;
+        }
+        frames.push_back({true, elementType, count, count});
+        return true;
+    }
+    failed = true;
+    return false;
+}
+
+void stream_reader::leave() {
+    const size_t depth = frames.size();
+    while (!failed && frames.size() >= depth && next()) {
+    }
+}
+
+bool stream_reader::skip_payload(TAG type, int depth) {
+    // 与 reader 相同 嵌套太深的数据当作损坏
+    if (depth > 512) {
+        failed = true;
+        return false;
+    }
+    uint8_t const* ptr;
+    int32_t count;
+    uint16_t length;
+    switch (type) {
+        case TAG::Byte: return take_bytes(1, ptr);
+        case TAG::Short: return take_bytes(2, ptr);
+        case TAG::Int:
+        case TAG::Float: return take_bytes(4, ptr);
+        case TAG::Long:
+        case TAG::Double: return take_bytes(8, ptr);
+        case TAG::String: return take(length) && take_bytes(swap_u16(length), ptr);
+        case TAG::Byte_Array: return take(count) && (count = swap_i32(count)) >= 0 && take_bytes((size_t)count, ptr);
+        case TAG::Int_Array: return take(count) && (count = swap_i32(count)) >= 0 && take_bytes((size_t)count * 4, ptr);
+        case TAG::Long_Array: return take(count) && (count = swap_i32(count)) >= 0 && take_bytes((size_t)count * 8, ptr);
+        case TAG::List: {
+            TAG elementType;
+            if (!take(elementType) || !take(count) || (count = swap_i32(count)) < 0) return false;
+            for (int32_t i = 0; i < count; i++) {
+                if (!skip_payload(elementType, depth + 1)) return false;
+            }
+            return true;
+        }
+        case TAG::Compound: {
+            while (true) {
+                TAG t;
+                if (!take(t)) return false;
+                if (t == TAG::End) return true;
+                if (!take(length) || !take_bytes(swap_u16(length), ptr) || !skip_payload(t, depth + 1)) return false;
+            }
+        }
+        default: failed = true; return false;
+    }
+}
+
 }  // namespace ME::nbt
@@ -479,6 +479,103 @@ private:
     } textOutputState{};
 };
 
+// 直接输出二进制 NBT 不建立 data_store 格式与 writer::export_bin 相同 可以用 reader 导入
+// 列表的元素个数在 begin_list 时给出 列表中的元素不带名字
+class stream_writer {
+public:
+    explicit stream_writer(std::vector<uint8_t>& out) : out(out) {}
+
+    void begin_compound(std::string_view name = "");
+    void end_compound();
+
+    void begin_list(TAG elementType, int32_t count, std::string_view name = "");
+    void end_list();
+
+    void write_byte(int8_t b, std::string_view name = "");
+    void write_short(int16_t s, std::string_view name = "");
+    void write_int(int32_t i, std::string_view name = "");
+    void write_long(int64_t l, std::string_view name = "");
+    void write_float(float f, std::string_view name = "");
+    void write_double(double d, std::string_view name = "");
+    void write_byte_array(int8_t const* array, int32_t length, std::string_view name = "");
+    void write_int_array(int32_t const* array, int32_t count, std::string_view name = "");
+    void write_long_array(int64_t const* array, int32_t count, std::string_view name = "");
+    void write_string(std::string_view str, std::string_view name = "");
+
+private:
+    // 在复合标签中写类型和名字 列表中什么都不写
+    void header(TAG type, std::string_view name);
+
+    std::vector<uint8_t>& out;
+    std::vector<bool> inList;
+};
+
+// 顺序读取二进制 NBT 不建立 data_store 字符串直接指向输入缓冲
+// 数组写进调用者的 vector 复用它的容量
+//   stream_reader in(data, size);
+//   if (in.enter_root()) {
+//       while (in.next()) {
+//           if (in.name() == "x") x = in.read_int();
+//       }
+//   }
+// next 之后没有读取的负载会被跳过 容器读到末尾时 next 返回 false 并回到上一层
+class stream_reader {
+public:
+    stream_reader(uint8_t const* data, size_t size) : data(data), size(size) {}
+
+    // 读取根复合标签的头并进入
+    bool enter_root();
+
+    // 当前容器中的下一个标签 容器结束或者出错时返回 false
+    bool next();
+    TAG type() const { return current; }
+    std::string_view name() const { return currentName; }
+
+    // 类型不符时记为出错 返回 0 或者空
+    int8_t read_byte();
+    int16_t read_short();
+    int32_t read_int();
+    int64_t read_long();
+    float read_float();
+    double read_double();
+    std::string_view read_string();
+    bool read_byte_array(std::vector<int8_t>& out);
+    bool read_int_array(std::vector<int32_t>& out);
+    bool read_long_array(std::vector<int64_t>& out);
+
+    // 进入当前的复合标签或者列表 之后用 next 遍历其中的标签
+    bool enter();
+    // 跳过当前容器剩下的标签 回到上一层
+    void leave();
+    // 刚进入的列表的元素个数
+    int32_t list_size() const { return frames.empty() ? 0 : frames.back().count; }
+
+    bool ok() const { return !failed; }
+
+private:
+    struct Frame {
+        bool list;
+        TAG elementType;
+        int32_t count;
+        int32_t remaining;
+    };
+
+    template <typename T>
+    bool take(T& value);
+    bool take_bytes(size_t count, uint8_t const*& ptr);
+    bool expect(TAG type);
+    bool skip_payload(TAG type, int depth = 0);
+
+    uint8_t const* data;
+    size_t size;
+    size_t pos = 0;
+    bool failed = false;
+    bool pending = false;  // next 之后负载还没有读
+    TAG current = TAG::End;
+    std::string_view currentName;
+    std::vector<Frame> frames;
+};
+
 }  // namespace ME::nbt
 
 #endif
\ No newline at end of file
@@ -274,11 +274,6 @@ struct pointer_sorter {
 //-----------------------------------------------------------------------------
 // thread pool
 
-template <typename R>
-bool future_is_ready(std::future<R> const &f) {
-    return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
-}
-
 template <typename T>
 class thread_pool_queue {
 public:
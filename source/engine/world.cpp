@@ -3,7 +3,11 @@
 #include "world.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
 #include <cstdio>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
@@ -13,17 +17,23 @@
 #include <vector>
 
 #include "chunk.hpp"
+#include "chunk_codec.hpp"
+#include "chunk_extras.hpp"
 #include "engine/core/base_debug.hpp"
 #include "engine/core/base_memory.h"
 #include "engine/core/const.h"
 #include "engine/core/core.hpp"
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/core/frame_arena.hpp"
 #include "engine/core/global.hpp"
 #include "engine/core/io/filesystem.h"
 #include "engine/core/macros.hpp"
 #include "engine/core/mathlib.hpp"
+#include "engine/core/profiler.hpp"
 #include "engine/engine.hpp"
 #include "engine/game_utils/cells.h"
 #include "engine/game_utils/jsonwarp.h"
+#include "engine/game_utils/rng.h"
 #include "engine/scripting/lua_wrapper.hpp"
 #include "engine/scripting/scripting.hpp"
 #include "engine/utils/utility.hpp"
@@ -31,11 +41,18 @@
 #include "npc.hpp"
 #include "reflectionflat.hpp"
 #include "textures.hpp"
+#include "world_archive.hpp"
+#include "world_index.hpp"
 #include "world_generator.h"
 
+#if defined(ME_SIMD_X86)
+#include <immintrin.h>
+#elif defined(ME_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace ME {
 
-std::mutex g_mutex_loadchunk;
 std::mutex g_mutex_updatechunkmesh;
 
 void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *audioEngine) { init(worldPath, w, h, target, audioEngine, new MaterialTestGenerator()); }
@@ -44,10 +61,27 @@ void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *a
 
     this->worldName = worldPath;
 
-    if (!noSaveLoad) {
+    if (!noSaveLoad && WorldArchive::is_archive(worldPath)) {
+        readOnly = true;
+        if (!regions.open_archive(worldPath)) noSaveLoad = true;
+    } else if (!noSaveLoad) {
         std::filesystem::create_directories(worldPath);
-        std::filesystem::create_directories(worldPath + "/chunks");
+        regions.open(worldPath + "/regions");
     }
+    regions.set_cache_budget((size_t)std::max(global.game->Iso.globaldef.chunk_cache_mb, 0) << 20);
+
+    // 在 worker 上完成 见 BusEventType::ChunkLoaded
+    auto loaded = [](Chunk *ch, bool generated) { global.game->events.post({BusEventType::ChunkLoaded, ch->x, ch->y, generated ? 1u : 0u}); };
+    chunkLoader.init(
+            [this, loaded](Chunk *ch) {
+                if (!readChunk(ch)) return false;
+                loaded(ch, false);
+                return true;
+            },
+            [this, loaded](Chunk *ch) {
+                createChunk(ch);
+                loaded(ch, true);
+            });
 
     metadata = WorldMeta::loadWorldMeta(this->worldName, noSaveLoad);
 
@@ -56,11 +90,8 @@ void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *a
 
     METADOT_INFO("World size: {0}x{1}={2}"_f(w, h, w * h).c_str());
 
-    world_sys.tickPool = create_scope<thread_pool>(16);
-    world_sys.tickVisitedPool = create_scope<thread_pool>(16);
-    world_sys.updateRigidBodyHitboxPool = create_scope<thread_pool>(16);
-
     this->audioEngine = audioEngine;
+    if (audioEngine) explodeEvent = audioEngine->ResolveEvent("event:/Explode");
 
     newTemps = new i32[width * height];
 
@@ -68,6 +99,8 @@ void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *a
 
     populators = gen->getPopulators();
 
+    populatorStats = std::make_unique<PopulatorStats[]>(populators.size());
+
     hasPopulator = new bool[6];
     for (int i = 0; i < 6; i++) hasPopulator[i] = false;
     for (int i = 0; i < populators.size(); i++) {
@@ -78,53 +111,47 @@ void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *a
     this->target = target;
     loadZone = {0, 0, (float)w, (float)h};
 
-    noise.SetSeed(RNG_Next(global.game->RNG));
+    simSeed = RNG_Mix(global.game->RNG->root_seed);
+    // 噪声只在这里设置 之后生成时只读
+    noise.SetSeed((int)RNG_Mix(simSeed, 0x6e6f697365));
     noise.SetNoiseType(FastNoise::Perlin);
 
-    auto ha = phmap::flat_hash_map<int, phmap::flat_hash_map<int, Chunk *>>();
-    // ha.set_deleted_key(INT_MAX);
-    // ha.set_empty_key(INT_MIN);
-    chunkCache = ha;
-
-    f32 distributedPointsDistance = 0.05f;
-    for (int i = 0; i < (1 / distributedPointsDistance) * (1 / distributedPointsDistance); i++) {
-        f32 x = rand() % 1000 / 1000.0;
-        f32 y = rand() % 1000 / 1000.0;
+    biomeNoise = noise;
+    biomeNoise.SetCellularDistanceFunction(FastNoise::CellularDistanceFunction::Natural);
+    biomeNoise.SetCellularJitter(0.3);
+    biomeNoise.SetCellularReturnType(FastNoise::CellularReturnType::CellValue);
+
+    // 群系由脚本注册 没有注册的名字按默认群系处理
+    biomeIds.defaultId = Biome::biomeGetID(Biome::NAME_DEFAULT);
+    biomeIds.plains = Biome::biomeGetID(Biome::NAME_PLAINS);
+    biomeIds.mountains = Biome::biomeGetID(Biome::NAME_MOUNTAINS);
+    biomeIds.forest = Biome::biomeGetID(Biome::NAME_FOREST);
+    for (int i = 0; i < 4; i++) {
+        biomeIds.test[i] = Biome::biomeGetID(std::format("TEST_{0}", i + 1));
+        biomeIds.test2[i] = Biome::biomeGetID(std::format("TEST_{0}_2", i + 1));
+    }
 
-        for (int j = 0; j < distributedPoints.size(); j++) {
-            f32 dx = distributedPoints[j].x - x;
-            f32 dy = distributedPoints[j].y - y;
-            if (dx * dx + dy * dy < distributedPointsDistance * distributedPointsDistance) {
-                goto tooClose;
-            }
-        }
+    chunkCache.clear();
 
-        distributedPoints.emplace_back(x, y);
-    tooClose : {}
-    }
+    // 群落和结构位置用的分布点 种子由世界种子决定
+    distributedPoints.generate(0.05f, RNG_Mix(simSeed, 0x706f696e));
 
     rigidBodies.reserve(1);
 
     // 重置为世界大小
 
-    dirty = new bool[width * height];
-    layer2Dirty = new bool[width * height];
-    backgroundDirty = new bool[width * height];
-    lastActive = new bool[width * height];
-    active = new bool[width * height];
-    this->tickVisited1 = new bool[width * height];
-    this->tickVisited2 = new bool[width * height];
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            dirty[x + y * width] = false;
-            layer2Dirty[x + y * width] = false;
-            lastActive[x + y * width] = true;
-            active[x + y * width] = false;
-            backgroundDirty[x + y * width] = false;
-        }
-    }
+    dirty.resize(width, height);
+    layer2Dirty.resize(width, height);
+    activeRegionsX = (width + ACTIVE_REGION_SIZE - 1) >> ACTIVE_REGION_SHIFT;
+    activeRegionsY = (height + ACTIVE_REGION_SIZE - 1) >> ACTIVE_REGION_SHIFT;
+    lastActive = new std::atomic<bool>[activeRegionsX * activeRegionsY];
+    active = new u8[activeRegionsX * activeRegionsY];
+    tickVisited.resize((size_t)width * height);
+    memset(active, 0, (size_t)activeRegionsX * activeRegionsY);
+    wakeAllRegions();
 
     real_tiles.resize(width * height);
+    objectOwner.assign((size_t)width * height, 0);
     flowX = new f32[width * height];
     flowY = new f32[width * height];
     prevFlowX = new f32[width * height];
@@ -148,7 +175,9 @@ void world::init(std::string worldPath, u16 w, u16 h, R_Target *target, Audio *a
     b2world = ME::create_scope<b2World>(gravity);
 
     struct gameplay_feature {};
-    registry.assign_feature<gameplay_feature>().add_system<ControableSystem>().add_system<NpcSystem>().add_system<WorldEntitySystem>();
+    registry.assign_feature<gameplay_feature>().add_system<ControableSystem>().add_system<NpcSystem>().add_system<WorldEntitySystem>().add_system<NpcThinkSystem>();
+    // NpcSystem 每帧联合遍历 WorldEntity 和 Bot
+    registry.group_components<WorldEntity, Bot>();
 
     b2PolygonShape nothingShape;
     nothingShape.SetAsBox(0, 0);
@@ -186,12 +215,12 @@ RigidBody *world::makeRigidBody(b2BodyType type, f32 x, f32 y, f32 angle, b2Poly
 
     body->CreateFixture(&fixtureDef);
 
-    RigidBody *rb = new RigidBody(body);
+    RigidBody *rb = rigidBodyPool.acquire(body);
     rb->setTexture(texture);
     if (texture != NULL) {
         rb->matWidth = rb->get_surface()->w;
         rb->matHeight = rb->get_surface()->h;
-        rb->tiles = new MaterialInstance[rb->matWidth * rb->matHeight];
+        rb->tiles = rigidBodyPool.allocTiles(rb->matWidth * rb->matHeight);
         for (int xx = 0; xx < rb->matWidth; xx++) {
             for (int yy = 0; yy < rb->matHeight; yy++) {
                 u32 pixel = ME_get_pixel(rb->get_surface(), xx, yy);
@@ -219,7 +248,7 @@ RigidBody *world::makeRigidBody(b2BodyType type, f32 x, f32 y, f32 angle, b2Poly
 
         // rb->set_texture(R_CopyImageFromSurface(rb->get_surface()));
         // R_SetImageFilter(rb->get_texture(), R_FILTER_NEAREST);
-        rb->updateImage({});
+        rb->texNeedsUpdate = true;
     }
     // rigidBodies.push_back(rb);
     return rb;
@@ -244,12 +273,12 @@ RigidBody *world::makeRigidBodyMulti(b2BodyType type, f32 x, f32 y, f32 angle, s
         body->CreateFixture(&fixtureDef);
     }
 
-    RigidBody *rb = new RigidBody(body);
+    RigidBody *rb = rigidBodyPool.acquire(body);
     rb->setTexture(texture);
     if (texture != NULL) {
         rb->matWidth = rb->get_surface()->w;
         rb->matHeight = rb->get_surface()->h;
-        rb->tiles = new MaterialInstance[rb->matWidth * rb->matHeight];
+        rb->tiles = rigidBodyPool.allocTiles(rb->matWidth * rb->matHeight);
         for (int xx = 0; xx < rb->matWidth; xx++) {
             for (int yy = 0; yy < rb->matHeight; yy++) {
                 u32 pixel = ME_get_pixel(rb->get_surface(), xx, yy);
@@ -278,399 +307,175 @@ RigidBody *world::makeRigidBodyMulti(b2BodyType type, f32 x, f32 y, f32 angle, s
         // rb->set_texture(R_CopyImageFromSurface(rb->get_surface()));
         // R_SetImageFilter(rb->get_texture(), R_FILTER_NEAREST);
 
-        rb->updateImage({});
+        rb->texNeedsUpdate = true;
     }
     // rigidBodies.push_back(rb);
     return rb;
 #endif
 }
 
-void world::updateRigidBodyHitbox(RigidBody *rb) {
-
-    C_Surface *sfc = rb->get_surface();
-
-    if (static_cast<bool>(sfc)) return;
-
-    for (int x = 0; x < sfc->w; x++) {
-        for (int y = 0; y < sfc->h; y++) {
-            MaterialInstance mat = rb->tiles[x + y * sfc->w];
-            if (mat.mat->id == GAME()->materials_list.GENERIC_AIR.id) {
-                ME_get_pixel(sfc, x, y) = 0x00000000;
-            } else {
-                ME_get_pixel(sfc, x, y) = (mat.mat->alpha << 24) + (mat.color & 0x00ffffff);
-            }
-        }
+// ExtractContours 的结果转为 TPPLPoly 洞已经是顺时针
+// b2World 的并行回调 交给任务系统执行
+static void b2ParallelForJobs(void *userContext, int32 count, int32 minRange, b2ParallelTaskFcn *task, void *taskContext) {
+    const int32 ranges = std::min<int32>((count + minRange - 1) / minRange, (int32)job::worker_count() * 4);
+    if (ranges <= 1) {
+        task(taskContext, 0, count);
+        return;
     }
+    job::parallel_for((uint32_t)ranges, 1, [&](uint32_t r) { task(taskContext, (int32)((i64)count * r / ranges), (int32)((i64)count * (r + 1) / ranges)); });
+}
 
-    int minX = sfc->w;
-    int maxX = 0;
-    int minY = sfc->h;
-    int maxY = 0;
-    for (int x = 0; x < sfc->w; x++) {
-        for (int y = 0; y < sfc->h; y++) {
-            if (((ME_get_pixel(sfc, x, y) >> 24) & 0xff) != 0x00) {
-                if (x < minX) minX = x;
-                if (x > maxX) maxX = x;
-                if (y < minY) minY = y;
-                if (y > maxY) maxY = y;
-            }
-        }
-    }
-    maxX++;
-    maxY++;
-
-    if (static_cast<bool>(sfc)) {
-        // TODO: 23/7/15 修复
-        C_Surface *sf = SDL_CreateRGBSurfaceWithFormat(sfc->flags, maxX - minX, maxY - minY, sfc->format->BitsPerPixel, sfc->format->format);
-        C_Rect src = {minX, minY, maxX - minX, maxY - minY};
-        SDL_SetSurfaceBlendMode(sfc, SDL_BlendMode::SDL_BLENDMODE_NONE);
-        SDL_BlitSurface(sfc, &src, sf, NULL);
-        SDL_FreeSurface(sfc);
-
-        if (static_cast<bool>(rb->get_surface())) {
-            if (rb->get_surface()->w <= 1 || rb->get_surface()->h <= 1) {
-                b2world->DestroyBody(rb->body);
-                rigidBodies.erase(std::remove(rigidBodies.begin(), rigidBodies.end(), rb), rigidBodies.end());
-                return;
-            }
-
-            // rb->set_surface(sf);
-
-            auto tex = create_ref<Texture>(sf);
-            rb->setTexture(tex);
-            sfc = rb->get_surface();
-
-        } else {
-            ME_ASSERT(0);
+static void contoursToPolys(const MarchingSquares::Contours &contours, std::list<TPPLPoly> &shapes, f32 dx = 0, f32 dy = 0) {
+    for (const MarchingSquares::Contour &c : contours.contours) {
+        TPPLPoly poly;
+        poly.Init((long)c.count);
+        for (u32 i = 0; i < c.count; i++) {
+            const MEvec2 &p = contours.points[c.begin + i];
+            poly[(int)i] = {p.x + dx, p.y + dy};
         }
-    } else {
-        return;
+        poly.SetHole(c.hole);
+        shapes.push_back(poly);
     }
+}
 
-    f32 s = sin(rb->body->GetAngle());
-    f32 c = cos(rb->body->GetAngle());
-
-    // translate point back to origin:
-    minX -= 0;
-    minY -= 0;
-
-    // rotate point
-    f32 xnew = minX * c - minY * s;
-    f32 ynew = minX * s + minY * c;
-
-    // translate point back:
-    rb->body->SetTransform(b2Vec2(rb->body->GetPosition().x + xnew, rb->body->GetPosition().y + ynew), rb->body->GetAngle());
-
-    // If it is a single pixel rigid body, it will be deconstructed.
-    if (maxX == 1 || maxY == 1) return;
+// 只读 rb 的 tiles/surface 写入 hb 和 rb 自己的 surface 可以在 worker 上对不同刚体同时执行
+// 每个 4 连通分量成为一个碎片 碎片的像素就是分量的像素
+static void computeRigidBodyHitbox(RigidBodyHitbox &hb, RigidBodyPool &pool, bool parallelPixels) {
+    RigidBody *rb = hb.rb;
+    C_Surface *sfc = rb->get_surface();
 
-    if (!static_cast<bool>(sfc) && !static_cast<bool>(rb->get_surface()) &&
-        // !static_cast<bool>(xnew) &&
-        // !static_cast<bool>(ynew) &&
-        1)
+    if (!static_cast<bool>(sfc)) {
+        hb.keep = true;
         return;
+    }
 
-    bool foundAnything = false;
-    for (int x = 0; x < sfc->w; x++)
-        for (int y = 0; y < sfc->h; y++) {
-            bool f = ((ME_get_pixel(sfc, x, y) >> 24) & 0xff) == 0x00 ? 0 : 1;
-            foundAnything = foundAnything || f;
-        }
-
-    if (!foundAnything) return;
-
-    u8 *data = new u8[sfc->w * sfc->h];
-    bool *edgeSeen = new bool[sfc->w * sfc->h];
+    frame_arena::scope scratch;
+    u8 *solid = frame_arena::local().alloc_array<u8>(sfc->w * sfc->h);
 
-    for (int y = 0; y < sfc->h; y++) {
+    auto fillRow = [&](uint32_t row) {
+        const int y = (int)row;
         for (int x = 0; x < sfc->w; x++) {
-            data[x + y * sfc->w] = ((ME_get_pixel(sfc, x, y) >> 24) & 0xff) == 0x00 ? 0 : 1;
-            edgeSeen[x + y * sfc->w] = false;
+            MaterialInstance mat = rb->tiles[x + y * sfc->w];
+            u32 pixel = 0x00000000;
+            if (mat.mat->id != GAME()->materials_list.GENERIC_AIR.id) pixel = (mat.mat->alpha << 24) + (mat.color & 0x00ffffff);
+            ME_get_pixel(sfc, x, y) = pixel;
+            solid[x + y * sfc->w] = ((pixel >> 24) & 0xff) != 0x00;
         }
+    };
+    if (parallelPixels && sfc->h > 10) {
+        // 按行分给各个 worker
+        job::parallel_for(sfc->h, 4, fillRow);
+    } else {
+        for (int y = 0; y < sfc->h; y++) fillRow(y);
     }
 
-    std::vector<std::vector<MEvec2>> meshes = {};
-
-    std::list<TPPLPoly> shapes;
-    std::list<MarchingSquares::Result> results;
-    int inn = 0;
-    int lookIndex = 0;
-
-    while (true) {
-        inn++;
-
-        int lookX = lookIndex % sfc->w;
-        int lookY = lookIndex / sfc->w;
-        if (inn == 1) {
-            lookX = sfc->w / 2;
-            lookY = sfc->h / 2;
-        }
-
-        int edgeX = -1;
-        int edgeY = -1;
-        int size = sfc->w * sfc->h;
-        for (int i = lookIndex; i < size; i++) {
-            if (data[i] != 0) {
-
-                int numBorders = 0;
-                // if (i % texture->w - 1 >= 0) numBorders += data[(i % texture->w - 1) + i / texture->w * texture->w];
-                // if (i / texture->w - 1 >= 0) numBorders += data[(i % texture->w)+(i / texture->w - 1) * texture->w];
-                if (i % sfc->w + 1 < sfc->w) numBorders += data[(i % sfc->w + 1) + i / sfc->w * sfc->w];
-                if (i / sfc->w + 1 < sfc->h) numBorders += data[(i % sfc->w) + (i / sfc->w + 1) * sfc->w];
-                if (i / sfc->w + 1 < sfc->h && i % sfc->w + 1 < sfc->w) numBorders += data[(i % sfc->w + 1) + (i / sfc->w + 1) * sfc->w];
-
-                // int val = value(i % texture->w, i / texture->w, texture->w, height, data);
-                if (numBorders != 3) {
-                    edgeX = i % sfc->w;
-                    edgeY = i / sfc->w;
-                    break;
-                }
-            }
-        }
-
-        if (edgeX == -1) {
-            break;
-        }
-
-        // MarchingSquares::Direction edge = MarchingSquares::FindEdge(texture->w, texture->h, data, lookX, lookY);
-
-        lookX = edgeX;
-        lookY = edgeY;
-
-        lookIndex = lookX + lookY * sfc->w + 1;
-
-        if (edgeSeen[lookX + lookY * sfc->w]) {
-            inn--;
-            continue;
-        }
-
-        int val = MarchingSquares::value(lookX, lookY, sfc->w, sfc->h, data);
-        if (val == 0 || val == 15) {
-            inn--;
-            continue;
-        }
-
-        MarchingSquares::Result r = MarchingSquares::FindPerimeter(lookX, lookY, sfc->w, sfc->h, data);
-        results.push_back(r);
-
-        std::vector<MEvec2> worldMesh;
-
-        f32 lastX = (f32)r.initialX;
-        f32 lastY = (f32)r.initialY;
-        for (int i = 0; i < r.directions.size(); i++) {
-            // if(r.directions[i].x != 0) r.directions[i].x = r.directions[i].x / abs(r.directions[i].x);
-            // if(r.directions[i].y != 0) r.directions[i].y = r.directions[i].y / abs(r.directions[i].y);
-
-            for (int ix = 0; ix < std::max(abs(r.directions[i].x), 1); ix++) {
-                for (int iy = 0; iy < std::max(abs(r.directions[i].y), 1); iy++) {
-                    int ilx = (int)(lastX + ix * (r.directions[i].x < 0 ? -1 : 1));
-                    int ily = (int)(lastY - iy * (r.directions[i].y < 0 ? -1 : 1));
-
-                    if (ilx < 0) ilx = 0;
-                    if (ilx >= sfc->w) ilx = sfc->w - 1;
-
-                    if (ily < 0) ily = 0;
-                    if (ily >= sfc->h) ily = sfc->h - 1;
-
-                    int ind = ilx + ily * sfc->w;
-                    if (ind >= size) {
-                        continue;
-                    }
-                    edgeSeen[ind] = true;
-                }
-            }
-
-            lastX += (f32)r.directions[i].x;
-            lastY -= (f32)r.directions[i].y;
-            worldMesh.emplace_back(lastX, lastY);
-        }
-
-        worldMesh = simplify(worldMesh, 1);
-
-        if (worldMesh.size() < 3) {
-            // 1x1 that breaks everything
-            continue;
-        }
-
-        meshes.push_back(worldMesh);
-
-        TPPLPoly poly;
-        poly.Init((long)worldMesh.size());
-
-        for (int i = 0; i < worldMesh.size(); i++) {
-            poly[(int)worldMesh.size() - i - 1] = {worldMesh[i].x, worldMesh[i].y};
-        }
+    thread_local ConnectedComponents::Labels labels;
+    ConnectedComponents::label(solid, sfc->w, sfc->h, sfc->w, labels);
 
-        if (poly.GetOrientation() == TPPL_CW) {
-            poly.SetHole(true);
-        }
+    int minX = sfc->w;
+    int maxX = 0;
+    int minY = sfc->h;
+    int maxY = 0;
+    for (const ConnectedComponents::Component &c : labels.components) {
+        minX = std::min(minX, c.x0);
+        maxX = std::max(maxX, c.x1);
+        minY = std::min(minY, c.y0);
+        maxY = std::max(maxY, c.y1);
+    }
 
-        if (poly.GetNumPoints() > 2) shapes.push_back(poly);
+    // 没有像素时 maxX - minX 为负
+    if (maxX - minX <= 1 || maxY - minY <= 1) {
+        hb.destroy = true;
+        return;
     }
 
-    delete[] edgeSeen;
-    delete[] data;
-    std::list<TPPLPoly> result2;
+    // 裁掉透明边缘 碎片的 surface 和多边形都在裁剪后的坐标中
+    hb.minX = minX;
+    hb.minY = minY;
+    const int weldX = rb->weldX + minX, weldY = rb->weldY + minY;
 
+    thread_local MarchingSquares::Contours contours;
     TPPLPartition part;
-    TPPLPartition part2;
-
-    part.RemoveHoles(&shapes, &result2);
-
-    polys2s.clear();
-
-    std::vector<C_Surface *> polys2sSfcs = {};
-    std::vector<bool> polys2sWeld = {};
-    for (auto it = result2.begin(); it != result2.end(); it++) {
-        std::list<TPPLPoly> result;
-
-        std::list<TPPLPoly> l = {*it};
-        part2.Triangulate_EC(&l, &result);
-
-        /*bool* solid = new bool[10 * 10];
-        for (int x = 0; x < 10; x++) {
-            for (int y = 0; y < 10; y++) {
-                solid[x + y * width] = rand() % 2 == 0;
-            }
-        }*/
-
-        // Ps::MarchingSquares ms = Ps::MarchingSquares(solid, texture->w, texture->h);
+    for (size_t k = 0; k < labels.components.size(); k++) {
+        const ConnectedComponents::Component &c = labels.components[k];
+        const u32 id = (u32)k + 1;
+        const int w = c.x1 - c.x0, h = c.y1 - c.y0;
+        // 一个像素宽的碎片三角化后没有面积 和原来一样丢弃
+        if (w <= 1 || h <= 1) continue;
+
+        u8 *data = frame_arena::local().alloc_array<u8>(w * h);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) data[x + y * w] = labels.at(c.x0 + x, c.y0 + y) == id;
+        }
 
-        // Ps::MarchingSquares ms = Ps::MarchingSquares(texture);
-        // worldMesh = ms.extract_simple(2);
+        RigidBodyHitbox::Piece piece;
+        MarchingSquares::ExtractContours(w, h, data, contours, 1);
+        contoursToPolys(contours, piece.outline, (f32)(c.x0 - minX), (f32)(c.y0 - minY));
 
-        std::vector<b2PolygonShape> polys2;
+        std::list<TPPLPoly> noHoles;
+        std::list<TPPLPoly> triangles;
+        std::list<TPPLPoly> outline = piece.outline;
+        part.RemoveHoles(&outline, &noHoles);
+        part.Triangulate_EC(&noHoles, &triangles);
 
-        int n = 0;
-        std::for_each(result.begin(), result.end(), [&](TPPLPoly cur) {
-            if ((cur[0].x == cur[1].x && cur[1].x == cur[2].x) || (cur[0].y == cur[1].y && cur[1].y == cur[2].y)) return;
+        for (TPPLPoly &cur : triangles) {
+            if ((cur[0].x == cur[1].x && cur[1].x == cur[2].x) || (cur[0].y == cur[1].y && cur[1].y == cur[2].y)) continue;
 
             b2Vec2 vec[3] = {{(f32)cur[0].x, (f32)cur[0].y}, {(f32)cur[1].x, (f32)cur[1].y}, {(f32)cur[2].x, (f32)cur[2].y}};
             b2PolygonShape sh;
             sh.Set(vec, 3);
+            piece.polys.push_back(sh);
+        }
+        if (piece.polys.empty()) continue;
 
-            polys2.push_back(sh);
-            n++;
-        });
-
-        if (polys2.size() > 0) {
-            polys2s.push_back(polys2);
-
-            polys2sSfcs.push_back(SDL_CreateRGBSurfaceWithFormat(sfc->flags, sfc->w, sfc->h, sfc->format->BitsPerPixel, sfc->format->format));
-
-            polys2sWeld.push_back(false);
+        piece.surface = pool.allocSurface(maxX - minX, maxY - minY, sfc->format->format);
+        for (int y = c.y0; y < c.y1; y++) {
+            for (int x = c.x0; x < c.x1; x++) {
+                if (labels.at(x, y) == id) ME_get_pixel(piece.surface, x - minX, y - minY) = ME_get_pixel(sfc, x, y);
+            }
         }
+        piece.weld = weldX >= 0 && weldY >= 0 && weldX < sfc->w && weldY < sfc->h && labels.at(weldX, weldY) == id;
+        hb.pieces.push_back(std::move(piece));
     }
+}
 
-    if (polys2s.size() > 0) {
-        std::vector<std::future<void>> poolResults = {};
-
-        if (sfc->w > 10) {
-            int nThreads = world_sys.updateRigidBodyHitboxPool->n_idle();
-            int div = sfc->w / nThreads;
-            int rem = sfc->w % nThreads;
-
-            for (int thr = 0; thr < nThreads; thr++) {
-                poolResults.push_back(world_sys.updateRigidBodyHitboxPool->push([&, thr, div, rem](int id) {
-                    int stx = thr * div;
-                    int enx = stx + div + (thr == nThreads - 1 ? rem : 0);
-
-                    for (int x = stx; x < enx; x++) {
-                        for (int y = 0; y < sfc->h; y++) {
-                            if (((ME_get_pixel(sfc, x, y) >> 24) & 0xff) == 0x00) continue;
-
-                            int nb = 0;
-
-                            int nearestDist = 100000;
-
-                            // for each body
-                            for (int b = 0; b < polys2s.size(); b++) {
-                                // for each triangle in the mesh
-                                for (int i = 0; i < polys2s[b].size(); i++) {
-#if 0
-                                    // 确保是计算对象为三角形
-                                    if (((phy::Polygon *)polys2s[b][i])->vertices().size() != 3) continue;
-
-                                    // 动态质心计算 需要考虑优化方案
-                                    auto centroid = phy::GeometryAlgorithm2D::triangleCentroid(((phy::Polygon *)polys2s[b][i])->vertices()[0], ((phy::Polygon *)polys2s[b][i])->vertices()[1],
-                                                                                               ((phy::Polygon *)polys2s[b][i])->vertices()[2]);
-                                    int dst = abs(x - centroid.x) + abs(y - centroid.y);
-#else
-                                    int dst = abs(x - polys2s[b][i].m_centroid.x) + abs(y - polys2s[b][i].m_centroid.y);
-#endif
+void world::applyRigidBodyHitbox(RigidBodyHitbox &hb) {
+    RigidBody *rb = hb.rb;
 
-                                    if (dst < nearestDist) {
-                                        nearestDist = dst;
-                                        nb = b;
-                                    }
-                                }
-                            }
+    if (hb.keep) return;
 
-                            ME_get_pixel(polys2sSfcs[nb], x, y) = ME_get_pixel(sfc, x, y);
-                            if (x == rb->weldX && y == rb->weldY) polys2sWeld[nb] = true;
-                        }
-                    }
-                }));
-            }
+    if (!hb.destroy) {
+        f32 s = sin(rb->body->GetAngle());
+        f32 c = cos(rb->body->GetAngle());
 
-        } else {
-            for (int x = 0; x < sfc->w; x++) {
-                for (int y = 0; y < sfc->h; y++) {
-                    if (((ME_get_pixel(sfc, x, y) >> 24) & 0xff) == 0x00) continue;
-
-                    int nb = 0;
-
-                    int nearestDist = 100000;
-
-                    // for each body
-                    for (int b = 0; b < polys2s.size(); b++) {
-                        // for each triangle in the mesh
-                        for (int i = 0; i < polys2s[b].size(); i++) {
-#if 0
-                            // 确保是计算对象为三角形
-                            if (((phy::Polygon *)polys2s[b][i])->vertices().size() != 3) continue;
-
-                            // 动态质心计算 需要考虑优化方案
-                            auto centroid = phy::GeometryAlgorithm2D::triangleCentroid(((phy::Polygon *)polys2s[b][i])->vertices()[0], ((phy::Polygon *)polys2s[b][i])->vertices()[1],
-                                                                                       ((phy::Polygon *)polys2s[b][i])->vertices()[2]);
-                            int dst = abs(x - centroid.x) + abs(y - centroid.y);
-#else
-                            int dst = abs(x - polys2s[b][i].m_centroid.x) + abs(y - polys2s[b][i].m_centroid.y);
-#endif
-                            if (dst < nearestDist) {
-                                nearestDist = dst;
-                                nb = b;
-                            }
-                        }
-                    }
+        // 裁剪的偏移旋转到刚体方向
+        f32 xnew = hb.minX * c - hb.minY * s;
+        f32 ynew = hb.minX * s + hb.minY * c;
 
-                    ME_get_pixel(polys2sSfcs[nb], x, y) = ME_get_pixel(sfc, x, y);
-                    if (x == rb->weldX && y == rb->weldY) polys2sWeld[nb] = true;
-                }
-            }
-        }
+        rb->body->SetTransform(b2Vec2(rb->body->GetPosition().x + xnew, rb->body->GetPosition().y + ynew), rb->body->GetAngle());
+        // 原点随贴图裁剪移动 上一步的变换对不上了
+        rb->interpSpan = 0;
 
-        for (int i = 0; i < poolResults.size(); i++) {
-            poolResults[i].get();
+        if (hb.pieces.size() > 1) {
+            const b2Vec2 pos = rb->body->GetPosition();
+            global.game->events.post({BusEventType::BodySplit, (i32)pos.x - (int)loadZone.x, (i32)pos.y - (int)loadZone.y, (u32)hb.pieces.size()});
         }
 
-        for (int b = 0; b < polys2s.size(); b++) {
-            std::vector<b2PolygonShape> polys2 = polys2s[b];
+        for (RigidBodyHitbox::Piece &piece : hb.pieces) {
+            // 绘制使用 rbn 的图集位置或 image 贴图不需要自己的 image
+            auto tex = create_ref<Texture>(piece.surface, false);
 
-            // TODO: 23/7/18 修改 polys2sSfcs 为 Texture
-            auto tex = create_ref<Texture>(polys2sSfcs[b]);
-
-            RigidBody *rbn = makeRigidBodyMulti(b2_dynamicBody, 0, 0, rb->body->GetAngle(), polys2, rb->body->GetFixtureList()[0].GetDensity(), rb->body->GetFixtureList()[0].GetFriction(), tex);
+            RigidBody *rbn = makeRigidBodyMulti(b2_dynamicBody, 0, 0, rb->body->GetAngle(), piece.polys, rb->body->GetFixtureList()[0].GetDensity(), rb->body->GetFixtureList()[0].GetFriction(), tex);
 
             rbn->body->SetTransform(b2Vec2(rb->body->GetPosition().x, rb->body->GetPosition().y), rb->body->GetAngle());
             rbn->body->SetLinearVelocity(rb->body->GetLinearVelocity());
             rbn->body->SetAngularVelocity(rb->body->GetAngularVelocity());
 
-            rbn->outline = shapes;
+            rbn->outline = std::move(piece.outline);
             rbn->texNeedsUpdate = true;
             rbn->hover = rb->hover;
 
-            bool weld = polys2sWeld[b];
+            bool weld = piece.weld;
             rbn->back = weld;
 
             if (weld) {
@@ -695,15 +500,6 @@ void world::updateRigidBodyHitbox(RigidBody *rb) {
 
             rbn->item = rb->item;
             rigidBodies.push_back(rbn);
-
-            if (result2.size() > 1) {
-                if (result2.size() == 2 && (result2.front().GetNumPoints() <= 3 || result2.back().GetNumPoints() <= 3)) {
-                    // weird edge case that causes infinite recursion
-                    // TODO: actually figure out why that happens
-                } else {
-                    updateRigidBodyHitbox(rbn);
-                }
-            }
         }
     }
 
@@ -711,12 +507,25 @@ void world::updateRigidBodyHitbox(RigidBody *rb) {
 
     rigidBodies.erase(std::remove(rigidBodies.begin(), rigidBodies.end(), rb), rigidBodies.end());
 
-    // delete[] rb->tiles;
-    // R_FreeImage(rb->get_texture());
-    // SDL_FreeSurface(rb->get_surface());
-    // delete rb;
-    rb->clean();
-    delete rb;
+    rigidBodyPool.release(rb);
+}
+
+void world::updateRigidBodyHitbox(RigidBody *rb) { updateRigidBodyHitboxes({rb}); }
+
+void world::updateRigidBodyHitboxes(std::vector<RigidBody *> rbs) {
+    // 碎片按连通分量切分 分裂出的刚体已经是连通的 不需要再算一次
+    std::vector<RigidBodyHitbox> hitboxes(rbs.size());
+    for (size_t i = 0; i < rbs.size(); i++) hitboxes[i].rb = rbs[i];
+
+    if (hitboxes.size() > 1) {
+        // 每个刚体一个任务 刚体内部不再拆分
+        job::parallel_for((uint32_t)hitboxes.size(), 1, [&](uint32_t i) { computeRigidBodyHitbox(hitboxes[i], rigidBodyPool, false); });
+    } else if (!hitboxes.empty()) {
+        computeRigidBodyHitbox(hitboxes[0], rigidBodyPool, true);
+    }
+
+    // Box2D 不是线程安全的 刚体的创建和销毁都留在这里
+    for (RigidBodyHitbox &hb : hitboxes) applyRigidBodyHitbox(hb);
 }
 
 void world::updateChunkMesh(Chunk *chunk) {
@@ -732,167 +541,61 @@ void world::updateChunkMesh(Chunk *chunk) {
     int chTy = chunk->y * CHUNK_H + loadZone.y;
 
     if (chTx < 0 || chTy < 0 || chTx + CHUNK_W >= width || chTy + CHUNK_H >= height) {
+        destroyChunkMesh(chunk);
         return;
     }
 
-#pragma region
-
-    bool foundAnything = false;
-    for (int x = 0; x < CHUNK_W; x++) {
-        for (int y = 0; y < CHUNK_H; y++) {
-
-            Material *mat = real_tiles[(x + chTx) + (y + chTy) * width].mat;
-            if (mat != nullptr && mat->physicsType == PhysicsType::SOLID) {
-                foundAnything = true;
-                goto found;
-            }
-
-            // bool f = tiles[(x + meshZone.x) + (y + meshZone.y) * width].mat->physicsType == PhysicsType::SOLID;
-            // foundAnything = foundAnything || f;
-        }
-    }
-found : {};
-
-    if (!foundAnything) {
+    if (global.game->Iso.globaldef.physics_grid_terrain) {
+        updateChunkGrid(chunk, chTx, chTy);
         return;
     }
 
-    unsigned char *data = new unsigned char[CHUNK_W * CHUNK_H];
+#pragma region
 
-    bool *edgeSeen = new bool[CHUNK_W * CHUNK_H];
+    frame_arena::scope scratch;
+    unsigned char *data = frame_arena::local().alloc_array<unsigned char>(CHUNK_W * CHUNK_H);
 
+    // SOLID 掩码的 FNV-1a 哈希 和上次生成 polys 时相同就不需要重新计算
+    bool foundAnything = false;
+    u64 hash = 0xcbf29ce484222325ull;
     for (int y = 0; y < CHUNK_H; y++) {
         for (int x = 0; x < CHUNK_W; x++) {
-            data[x + y * CHUNK_W] = real_tiles[(x + chTx) + (y + chTy) * width].mat->physicsType == PhysicsType::SOLID;
-            edgeSeen[x + y * CHUNK_W] = false;
+            Material *mat = real_tiles[(x + chTx) + (y + chTy) * width].mat();
+            unsigned char solid = mat != nullptr && mat->physicsType == PhysicsType::SOLID;
+            data[x + y * CHUNK_W] = solid;
+            foundAnything |= solid;
+            hash = (hash ^ solid) * 0x100000001b3ull;
         }
     }
 
-    std::vector<std::vector<MEvec2>> worldMeshes = {};
-    std::list<TPPLPoly> shapes;
-    std::list<MarchingSquares::Result> results;
-    int inn = 0;
-    int lookIndex = 0;
-
-    // don't profile children
-    while (true) {
-        // inn++;
-        int lookX = lookIndex % CHUNK_W;
-        int lookY = lookIndex / CHUNK_W;
-        /*if (inn == 1) {
-            lookX = CHUNK_W / 2;
-            lookY = CHUNK_H / 2;
-        }*/
-
-        int edgeX = -1;
-        int edgeY = -1;
-        int size = CHUNK_W * CHUNK_H;
-
-        for (int i = lookIndex; i < size; i++) {
-            if (data[i] != 0) {
-
-                int numBorders = 0;
-                // if (i % CHUNK_W - 1 >= 0) numBorders += data[(i % CHUNK_W - 1) + i / CHUNK_W * CHUNK_W];
-                // if (i / CHUNK_W - 1 >= 0) numBorders += data[(i % CHUNK_W)+(i / CHUNK_W - 1) * CHUNK_W];
-                if (i % CHUNK_W + 1 < CHUNK_W) numBorders += data[(i % CHUNK_W + 1) + i / CHUNK_W * CHUNK_W];
-                if (i / CHUNK_W + 1 < CHUNK_H) numBorders += data[(i % CHUNK_W) + (i / CHUNK_W + 1) * CHUNK_W];
-                if (i / CHUNK_W + 1 < CHUNK_H && i % CHUNK_W + 1 < CHUNK_W) numBorders += data[(i % CHUNK_W + 1) + (i / CHUNK_W + 1) * CHUNK_W];
-
-                // int val = value(i % CHUNK_W, i / CHUNK_W, CHUNK_W, height, data);
-                if (numBorders != 3) {
-                    edgeX = i % CHUNK_W;
-                    edgeY = i / CHUNK_W;
-                    break;
-                }
-            }
-        }
-
-        if (edgeX == -1) {
-            break;
-        }
-
-        // MarchingSquares::Direction edge = MarchingSquares::FindEdge(CHUNK_W, CHUNK_H, data, lookX, lookY);
-
-        lookX = edgeX;
-        lookY = edgeY;
-
-        lookIndex = lookX + lookY * CHUNK_W + 1;
-
-        if (edgeSeen[lookX + lookY * CHUNK_W]) {
-            inn--;
-            continue;
-        }
-
-        int val = MarchingSquares::value(lookX, lookY, CHUNK_W, CHUNK_H, data);
-
-        if (val == 0 || val == 15) {
-            inn--;
-            continue;
-        }
-
-        MarchingSquares::Result r = MarchingSquares::FindPerimeter(lookX, lookY, CHUNK_W, CHUNK_H, data);
-
-        results.push_back(r);
-
-        std::vector<MEvec2> worldMesh;
-
-        f32 lastX = (f32)r.initialX;
-        f32 lastY = (f32)r.initialY;
-
-        for (int i = 0; i < r.directions.size(); i++) {
-            // if(r.directions[i].x != 0) r.directions[i].x = r.directions[i].x / abs(r.directions[i].x);
-            // if(r.directions[i].y != 0) r.directions[i].y = r.directions[i].y / abs(r.directions[i].y);
-
-            for (int ix = 0; ix < std::max(abs(r.directions[i].x), 1); ix++) {
-                for (int iy = 0; iy < std::max(abs(r.directions[i].y), 1); iy++) {
-                    int ilx = (int)(lastX + ix * (r.directions[i].x < 0 ? -1 : 1));
-                    int ily = (int)(lastY - iy * (r.directions[i].y < 0 ? -1 : 1));
-
-                    if (ilx < 0) ilx = 0;
-                    if (ilx >= CHUNK_W) ilx = CHUNK_W - 1;
-
-                    if (ily < 0) ily = 0;
-                    if (ily >= CHUNK_H) ily = CHUNK_H - 1;
-
-                    int ind = ilx + ily * CHUNK_W;
-                    if (ind >= size) {
-                        continue;
-                    }
-                    edgeSeen[ind] = true;
-                }
-            }
-
-            lastX += (f32)r.directions[i].x;
-            lastY -= (f32)r.directions[i].y;
-            worldMesh.emplace_back(lastX, lastY);
-        }
-
-        worldMesh = simplify(worldMesh, 1);
-
-        if (worldMesh.size() < 3) {
-            // 1x1 pixel that breaks everything
-            continue;
+    if (chunk->meshValid && !chunk->meshGrid && chunk->meshHash == hash) {
+        if (chunk->rb) {
+            // loadZone 移动后区块在缓冲中的位置变了 形状不变
+            const b2Vec2 pos((f32)chTx, (f32)chTy);
+            if (chunk->rb->body->GetPosition() != pos) chunk->rb->body->SetTransform(pos, 0);
+            meshChunks.push_back(chunk);
+            worldRigidBodies.push_back(chunk->rb);
         }
+        return;
+    }
 
-        worldMeshes.push_back(worldMesh);
-
-        TPPLPoly poly;
-
-        poly.Init((long)worldMesh.size());
+    chunk->meshHash = hash;
+    chunk->meshValid = true;
+    chunk->meshGrid = false;
+    chunk->remeshes++;
 
-        for (int i = 0; i < worldMesh.size(); i++) {
-            poly[(int)worldMesh.size() - i - 1] = {worldMesh[i].x, worldMesh[i].y};
-        }
+    if (!foundAnything) {
+        destroyChunkMesh(chunk);
+        chunk->meshValid = true;
+        return;
+    }
 
-        if (poly.GetOrientation() == TPPL_CW) {
-            poly.SetHole(true);
-        }
+    thread_local MarchingSquares::Contours contours;
+    MarchingSquares::ExtractContours(CHUNK_W, CHUNK_H, data, contours, 1);
 
-        shapes.push_back(poly);
-    }
+    std::list<TPPLPoly> shapes;
+    contoursToPolys(contours, shapes);
 
-    delete[] edgeSeen;
-    delete[] data;
     std::list<TPPLPoly> result;
     std::list<TPPLPoly> result2;
 
@@ -926,10 +629,10 @@ found : {};
             cur[0].y += 0.01f;
         }
 
-        std::vector<b2Vec2> vec = {{(f32)cur[0].x, (f32)cur[0].y}, {(f32)cur[1].x, (f32)cur[1].y}, {(f32)cur[2].x, (f32)cur[2].y}};
+        const b2Vec2 vec[3] = {{(f32)cur[0].x, (f32)cur[0].y}, {(f32)cur[1].x, (f32)cur[1].y}, {(f32)cur[2].x, (f32)cur[2].y}};
         // worldTris.push_back(vec);
         b2PolygonShape sh;
-        sh.Set(&vec[0], 3);
+        sh.Set(vec, 3);
 
         chunk->polys.push_back(sh);
     });
@@ -938,16 +641,22 @@ found : {};
 
     // TODO: 世界区块的box2d碰撞
 
-    auto texture = LoadTexture("data/assets/objects/testObject3.png");
-
     if (chunk->rb) {
-        delete[] chunk->rb->tiles;
-
-        chunk->rb->chunk_clean();
-
-        delete chunk->rb;
+        // 保留刚体 只替换 fixture
+        b2Body *body = chunk->rb->body;
+        while (b2Fixture *f = body->GetFixtureList()) body->DestroyFixture(f);
+        for (b2PolygonShape &sh : chunk->polys) {
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &sh;
+            fixtureDef.density = 1;
+            fixtureDef.friction = 0.3;
+            body->CreateFixture(&fixtureDef);
+        }
+        body->SetTransform(b2Vec2((f32)chTx, (f32)chTy), 0);
+    } else {
+        auto texture = LoadTexture("data/assets/objects/testObject3.png");
+        chunk->rb = makeRigidBodyMulti(b2_staticBody, chTx, chTy, 0, chunk->polys, 1, 0.3, texture);
     }
-    chunk->rb = makeRigidBodyMulti(b2_staticBody, chunk->x * CHUNK_W + loadZone.x, chunk->y * CHUNK_H + loadZone.y, 0, chunk->polys, 1, 0.3, texture);
 
     for (b2Fixture *f = chunk->rb->body->GetFixtureList(); f; f = f->GetNext()) {
         b2Filter bf = {};
@@ -955,43 +664,161 @@ found : {};
         f->SetFilterData(bf);
     }
 
+    meshChunks.push_back(chunk);
     worldRigidBodies.push_back(chunk->rb);
 }
 
-void world::updateWorldMesh() {
+void world::updateChunkGrid(Chunk *chunk, int chTx, int chTy) {
+    // 位图四周多一格 邻居区块的像素只用来判断边上的面是否露出 区块交界处没有缝
+    constexpr int stride = CHUNK_W + 2;
+    std::vector<u8> &cells = chunk->gridCells;
+    cells.resize(stride * (CHUNK_H + 2));
 
-    if (lastMeshZone.x == meshZone.x && lastMeshZone.y == meshZone.y && lastMeshZone.w == meshZone.w && lastMeshZone.h == meshZone.h) {
-        if (lastMeshLoadZone.x == loadZone.x && lastMeshLoadZone.y == loadZone.y && lastMeshLoadZone.w == loadZone.w && lastMeshLoadZone.h == loadZone.h) {
-            return;
+    bool foundAnything = false;
+    u64 hash = 0xcbf29ce484222325ull;
+    for (int y = -1; y <= CHUNK_H; y++) {
+        for (int x = -1; x <= CHUNK_W; x++) {
+            const int wx = x + chTx, wy = y + chTy;
+            u8 solid = 0;
+            if (wx >= 0 && wy >= 0 && wx < width && wy < height) {
+                Material *mat = real_tiles[wx + wy * width].mat();
+                solid = mat != nullptr && mat->physicsType == PhysicsType::SOLID;
+            }
+            cells[(x + 1) + (y + 1) * stride] = solid;
+            if (x >= 0 && y >= 0 && x < CHUNK_W && y < CHUNK_H) foundAnything |= solid;
+            hash = (hash ^ solid) * 0x100000001b3ull;
         }
     }
 
-    int prevMinChX = (int)std::floor((lastMeshZone.x - lastMeshLoadZone.x) / CHUNK_W);
-    int prevMinChY = (int)std::floor((lastMeshZone.y - lastMeshLoadZone.y) / CHUNK_H);
-    int prevMaxChX = (int)std::ceil((lastMeshZone.x + lastMeshZone.w - lastMeshLoadZone.x) / CHUNK_W);
-    int prevMaxChY = (int)std::ceil((lastMeshZone.y + lastMeshZone.h + lastMeshLoadZone.y) / CHUNK_H);
+    const b2Vec2 pos((f32)chTx, (f32)chTy);
+    if (chunk->meshValid && chunk->meshGrid && chunk->meshHash == hash) {
+        if (chunk->rb) {
+            if (chunk->rb->body->GetPosition() != pos) chunk->rb->body->SetTransform(pos, 0);
+            meshChunks.push_back(chunk);
+            worldRigidBodies.push_back(chunk->rb);
+        }
+        return;
+    }
 
-    int minChX = (int)std::floor((meshZone.x - loadZone.x) / CHUNK_W);
-    int minChY = (int)std::floor((meshZone.y - loadZone.y) / CHUNK_H);
-    int maxChX = (int)std::ceil((meshZone.x + meshZone.w - loadZone.x) / CHUNK_W);
-    int maxChY = (int)std::ceil((meshZone.y + meshZone.h - loadZone.y) / CHUNK_H);
+    chunk->meshHash = hash;
+    chunk->meshValid = true;
+    chunk->meshGrid = true;
+    chunk->remeshes++;
+    chunk->polys.clear();
 
-    for (int i = 0; i < worldRigidBodies.size(); i++) {
-        b2world->DestroyBody(worldRigidBodies[i]->body);
+    if (!foundAnything) {
+        destroyChunkMesh(chunk);
+        chunk->meshValid = true;
+        return;
     }
-    worldRigidBodies.clear();
-
-    if (meshZone.w == 0 || meshZone.h == 0) return;
 
-    // METADOT_BUG(std::format("updateWorldMesh {0}/{1} {2}/{3}", minChX, maxChX, minChY, maxChY).c_str());
+    b2Body *body = chunk->rb ? chunk->rb->body : nullptr;
+    b2Fixture *fixture = body ? body->GetFixtureList() : nullptr;
+    if (fixture && (fixture->GetType() != b2Shape::e_grid || fixture->GetNext())) {
+        // 之前是多边形 fixture 换成一个网格
+        while (b2Fixture *f = body->GetFixtureList()) body->DestroyFixture(f);
+        fixture = nullptr;
+    }
 
-    for (int cx = minChX; cx <= maxChX; cx++) {
-        for (int cy = minChY; cy <= maxChY; cy++) {
-            updateChunkMesh(getChunk(cx, cy));
+    if (fixture) {
+        // 形状每次求接触时直接读位图 不需要重建 fixture 只唤醒接触中的刚体让它们重新检测
+        ((b2GridShape *)fixture->GetShape())->Set(cells.data(), CHUNK_W, CHUNK_H);
+        for (int32 i = 0; i < body->GetContactCount(); i++) {
+            b2Contact *c = body->GetContact(i);
+            if (!c->IsTouching()) continue;
+            b2Body *other = c->GetFixtureA()->GetBody() == body ? c->GetFixtureB()->GetBody() : c->GetFixtureA()->GetBody();
+            other->SetAwake(true);
+        }
+    } else {
+        if (!body) {
+            auto texture = LoadTexture("data/assets/objects/testObject3.png");
+            chunk->rb = makeRigidBodyMulti(b2_staticBody, chTx, chTy, 0, {}, 1, 0.3, texture);
+            body = chunk->rb->body;
         }
+        b2GridShape sh;
+        sh.Set(cells.data(), CHUNK_W, CHUNK_H);
+        b2FixtureDef fixtureDef;
+        fixtureDef.shape = &sh;
+        fixtureDef.density = 1;
+        fixtureDef.friction = 0.3;
+        fixtureDef.filter.categoryBits = 0x0001;
+        body->CreateFixture(&fixtureDef);
     }
 
-    // 更新区块mesh后同步
+    if (body->GetPosition() != pos) body->SetTransform(pos, 0);
+
+    meshChunks.push_back(chunk);
+    worldRigidBodies.push_back(chunk->rb);
+}
+
+void world::destroyChunkMesh(Chunk *chunk) {
+    chunk->meshValid = false;
+    chunk->polys.clear();
+    if (!chunk->rb) return;
+
+    std::erase(worldRigidBodies, chunk->rb);
+    std::erase(meshChunks, chunk);
+
+    if (b2world) b2world->DestroyBody(chunk->rb->body);
+    rigidBodyPool.release(chunk->rb);
+    chunk->rb = nullptr;
+}
+
+void world::updateWorldMesh() {
+
+    if (lastMeshZone.x == meshZone.x && lastMeshZone.y == meshZone.y && lastMeshZone.w == meshZone.w && lastMeshZone.h == meshZone.h) {
+        if (lastMeshLoadZone.x == loadZone.x && lastMeshLoadZone.y == loadZone.y && lastMeshLoadZone.w == loadZone.w && lastMeshLoadZone.h == loadZone.h) {
+            // 范围没变 只重新检查被标记的区块 (见 explosions)
+            // 没有碰撞刚体的区块里没有 SOLID 爆炸也不会产生 不需要处理
+            std::sort(meshRefreshChunks.begin(), meshRefreshChunks.end());
+            meshRefreshChunks.erase(std::unique(meshRefreshChunks.begin(), meshRefreshChunks.end()), meshRefreshChunks.end());
+            // 关注区域里这一 tick 不模拟的区块留到它模拟的 tick
+            size_t kept = 0;
+            for (Chunk *ch : meshRefreshChunks) {
+                if (!interests.due_at(ch->x * CHUNK_W + loadZone.x + CHUNK_W / 2, ch->y * CHUNK_H + loadZone.y + CHUNK_H / 2)) {
+                    meshRefreshChunks[kept++] = ch;
+                    continue;
+                }
+                auto it = std::find(meshChunks.begin(), meshChunks.end(), ch);
+                if (it == meshChunks.end()) continue;
+                meshChunks.erase(it);
+                std::erase(worldRigidBodies, ch->rb);
+                updateChunkMesh(ch);
+            }
+            meshRefreshChunks.resize(kept);
+            return;
+        }
+    }
+
+    // 整体重建会检查范围内的所有区块
+    meshRefreshChunks.clear();
+
+    int minChX = (int)std::floor((meshZone.x - loadZone.x) / CHUNK_W);
+    int minChY = (int)std::floor((meshZone.y - loadZone.y) / CHUNK_H);
+    int maxChX = (int)std::ceil((meshZone.x + meshZone.w - loadZone.x) / CHUNK_W);
+    int maxChY = (int)std::ceil((meshZone.y + meshZone.h - loadZone.y) / CHUNK_H);
+
+    // 只重新生成 SOLID 掩码有变化的区块 其余区块的刚体原样保留
+    std::vector<Chunk *> prevMeshChunks;
+    prevMeshChunks.swap(meshChunks);
+    worldRigidBodies.clear();
+
+    if (meshZone.w != 0 && meshZone.h != 0) {
+        // METADOT_BUG(std::format("updateWorldMesh {0}/{1} {2}/{3}", minChX, maxChX, minChY, maxChY).c_str());
+
+        for (int cx = minChX; cx <= maxChX; cx++) {
+            for (int cy = minChY; cy <= maxChY; cy++) {
+                if (Chunk *ch = peekChunk(cx, cy)) updateChunkMesh(ch);
+            }
+        }
+    }
+
+    // 离开范围的区块
+    for (Chunk *ch : prevMeshChunks) {
+        if (std::find(meshChunks.begin(), meshChunks.end(), ch) == meshChunks.end()) destroyChunkMesh(ch);
+    }
+
+    // 更新区块mesh后同步
     lastMeshZone = meshZone;
     lastMeshLoadZone = loadZone;
 }
@@ -1004,7 +831,7 @@ MaterialInstance world::getTile(int x, int y) {
 void world::setTile(int x, int y, MaterialInstance type) {
     if (x < 0 || x >= width || y < 0 || y >= height) return;
     real_tiles[x + y * width] = type;
-    dirty[x + y * width] = true;
+    dirty.mark(x + y * width);
 }
 
 MaterialInstance world::getTileLayer2(int x, int y) {
@@ -1015,7 +842,47 @@ MaterialInstance world::getTileLayer2(int x, int y) {
 void world::setTileLayer2(int x, int y, MaterialInstance type) {
     if (x < 0 || x >= width || y < 0 || y >= height) return;
     real_layer2[x + y * width] = type;
-    layer2Dirty[x + y * width] = true;
+    layer2Dirty.mark(x + y * width);
+}
+
+void world::commitRawWrites(int x, int y, int w, int h, bool tiles, bool background) {
+    const int x0 = std::max(x, 0), y0 = std::max(y, 0);
+    const int x1 = std::min(x + w, (int)width), y1 = std::min(y + h, (int)height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    if (tiles) {
+        for (int ty = y0; ty < y1; ty++) real_tiles.commit_raw((size_t)x0 + (size_t)ty * width, (size_t)(x1 - x0));
+        dirty.mark_rect(x0, y0, x1 - x0, y1 - y0);
+    }
+    if (background) queueBackgroundRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+void world::queueBackgroundRect(int x, int y, int w, int h) {
+    const int x0 = std::max(x, 0), y0 = std::max(y, 0);
+    const int x1 = std::min(x + w, (int)width), y1 = std::min(y + h, (int)height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    // 像素缓冲坐标到区块坐标 loadZone 不一定是区块对齐的
+    auto chunkOf = [](int v, int size) { return v >= 0 ? v / size : -((-v + size - 1) / size); };
+    const int cx0 = chunkOf(x0 - (int)loadZone.x, CHUNK_W), cx1 = chunkOf(x1 - 1 - (int)loadZone.x, CHUNK_W);
+    const int cy0 = chunkOf(y0 - (int)loadZone.y, CHUNK_H), cy1 = chunkOf(y1 - 1 - (int)loadZone.y, CHUNK_H);
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) backgroundUploads.push_back(ChunkMap::key(cx, cy));
+    }
+}
+
+void world::readChunkBackground(int cx, int cy, u32 *out) const {
+    std::fill_n(out, CHUNK_W * CHUNK_H, 0u);
+    const int ox = cx * CHUNK_W + (int)loadZone.x;
+    const int oy = cy * CHUNK_H + (int)loadZone.y;
+    const int x0 = std::max(ox, 0);
+    const int x1 = std::min(ox + CHUNK_W, (int)width);
+    if (x0 >= x1) return;
+    for (int y = 0; y < CHUNK_H; y++) {
+        const int ty = oy + y;
+        if (ty < 0 || ty >= height) continue;
+        background.read((size_t)x0 + (size_t)ty * width, out + (x0 - ox) + y * CHUNK_W, (size_t)(x1 - x0));
+    }
 }
 
 f32 CalculateVerticalFlowValue(f32 remainingLiquid, f32 destLiquid) {
@@ -1033,890 +900,1115 @@ f32 CalculateVerticalFlowValue(f32 remainingLiquid, f32 destLiquid) {
     return value;
 }
 
-void world::tick() {
-
-// TODO: 如果我们只检查最后标记为dirty的tiles会怎么样
-
-// #define DEBUG_FRICTION
-// #define DO_REVERSE
-#define DO_MULTITHREADING 1
-
-#if DO_MULTITHREADING
-    bool whichTickVisited = false;
-    memset(tickVisited1, false, (size_t)width * height);
-#endif
-
-    // TODO: 尝试找到一种方法来优化这个循环，因为液体需要高迭代次数
-    for (int iter = 0; iter < global.game->Iso.globaldef.cell_iter; iter++) {
-
-#ifdef DO_REVERSE
-        bool reverseX = (tickCt + iter) % 2 == 0;
-#else
-        bool reverseX = false;
-#endif
-        for (int tk = 0; tk < 4; tk++) {
-
-            int chOfsX = tk % 2;              // 0 1 0 1
-            int chOfsY = 1 - ((tk % 4) / 2);  // 1 1 0 0
-
-#if DO_MULTITHREADING
-            std::vector<std::future<std::vector<CellData *>>> results = {};
-#endif
-#if DO_MULTITHREADING
-            bool *tickVisited = whichTickVisited ? tickVisited2 : tickVisited1;
-            std::future<void> tickVisitedDone = world_sys.tickVisitedPool->push([&](int id) { memset(whichTickVisited ? tickVisited1 : tickVisited2, false, (size_t)width * height); });
-#else
-            bool *tickVisited = tickVisited1;
-            memset(tickVisited1, false, width * height);
-#endif
-
-            for (int cx = tickZone.x + chOfsX * CHUNK_W; cx < (tickZone.x + tickZone.w); cx += CHUNK_W * 2) {
-                for (int cy = tickZone.y + chOfsY * CHUNK_H; cy < (tickZone.y + tickZone.h); cy += CHUNK_H * 2) {
-
-#if DO_MULTITHREADING
-                    results.push_back(world_sys.tickPool->push([&, cx, cy](int id) {
-                        std::vector<CellData *> parts = {};
+void world::wakeRegions(int x, int y, int w, int h) {
+    int rx0 = std::max(x, 0) >> ACTIVE_REGION_SHIFT;
+    int ry0 = std::max(y, 0) >> ACTIVE_REGION_SHIFT;
+    int rx1 = std::min(x + w - 1, width - 1) >> ACTIVE_REGION_SHIFT;
+    int ry1 = std::min(y + h - 1, height - 1) >> ACTIVE_REGION_SHIFT;
+    for (int ry = ry0; ry <= ry1; ry++) {
+        for (int rx = rx0; rx <= rx1; rx++) {
+            lastActive[rx + ry * activeRegionsX].store(true, std::memory_order_relaxed);
+        }
+    }
+}
 
-#else
+void world::wakeAllRegions() {
+    for (size_t r = 0, n = (size_t)activeRegionsX * activeRegionsY; r < n; r++) lastActive[r].store(true, std::memory_order_relaxed);
+}
 
-#endif
+void world::collectActiveRegions() {
+    // setTile 爆炸 刚体 区块合并等写入都会标记 dirty 这里统一转换为区域唤醒
+    // 需要在 dirty 清除前调用
+    dirty.mark_regions(ACTIVE_REGION_SHIFT, activeRegionsX, lastActive);
+    nav.invalidate(*this);
+    light.invalidate(*this);
+    replication.invalidate(*this);
+    partition.invalidate(*this);
+}
 
-                        for (int dy = CHUNK_H - 1; dy >= 0; dy--) {
-                            int y = cy + dy;
-                            for (int dxf = 0; dxf < CHUNK_W; dxf++) {
-                                int dx = reverseX ? (CHUNK_W - 1) - dxf : dxf;
-                                int x = cx + dx;
-                                int index = x + y * width;
+void world::updateFluidSummary() {
+    FluidSummary s;
+    const int x0 = std::max((int)tickZone.x, 0);
+    const int y0 = std::max((int)tickZone.y, 0);
+    const int x1 = std::min((int)(tickZone.x + tickZone.w), (int)width);
+    const int y1 = std::min((int)(tickZone.y + tickZone.h), (int)height);
+
+    for (int y = y0; y < y1 && x0 < x1; y++) {
+        size_t first, last;
+        size_t n = real_tiles.find_soup((size_t)x0 + (size_t)y * width, (size_t)(x1 - x0), first, last);
+        if (!n) continue;
+        if (!s.count) {
+            s.x0 = x0 + (int)first;
+            s.x1 = x0 + (int)last;
+            s.y0 = y;
+        }
+        s.x0 = std::min(s.x0, x0 + (int)first);
+        s.x1 = std::max(s.x1, x0 + (int)last);
+        s.y1 = y;
+        s.count += n;
+    }
+    fluidSummary = s;
+}
 
-                                if (tickVisited[index]) continue;
+// world::tick 中单个像素的处理 按遍数 (Pass) 和物理类型 (Type) 分开特化
+// 每个像素先按材料表得到类型再直接调用对应的版本 各个版本可以单独内联和优化
+// 处理顺序仍然是区块内逐行自下而上 不按类型分组 否则沙子落进液体/气体时的结果会改变
 
-                                if (iter >= real_tiles[index].mat->iterations) {
-                                    tickVisited[index] = true;
-                                    continue;
-                                }
-                                MaterialInstance tile = real_tiles[index];
+// #define DEBUG_FRICTION
 
-                                int type = tile.mat->physicsType;
+// 火焰会随机熄灭 点燃周围的 SOLID 并产生火星
+void world::tickFireCell(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    // 火焰即使没有移动也会随机熄灭或点燃周围 保持所在区域唤醒
+    lastActive[(x >> ACTIVE_REGION_SHIFT) + (y >> ACTIVE_REGION_SHIFT) * activeRegionsX].store(true, std::memory_order_relaxed);
 
-                                if (tile.mat->id == GAME()->materials_list.FIRE.id) {
-                                    if (rand() % 10 == 0) {
-                                        u32 rgb = 255;
-                                        rgb = (rgb << 8) + 100 + rand() % 50;
-                                        rgb = (rgb << 8) + 50;
-                                        tile.color = rgb;
-                                    }
+    if (rng.next() % 10 == 0) {
+        u32 rgb = 255;
+        rgb = (rgb << 8) + 100 + rng.next() % 50;
+        rgb = (rgb << 8) + 50;
+        tile.color = rgb;
+    }
 
-                                    if (rand() % 10 == 0) {
-                                        CellData *p = new CellData(tile, x, y - 1, (rand() % 10 - 5) / 20.0f, -((rand() % 10) / 10.0f) / 3.0f + -0.5f, 0, 0.01f);
-                                        p->temporary = true;
-                                        p->lifetime = 30;
-                                        p->fadeTime = 10;
-#if DO_MULTITHREADING
-                                        parts.push_back(p);
-#else
-                                    cells.push_back(p);
-#endif
-                                    }
+    if (rng.next() % 10 == 0) {
+        CellData p(tile, x, y - 1, (rng.next() % 10 - 5) / 20.0f, -((rng.next() % 10) / 10.0f) / 3.0f + -0.5f, 0, 0.01f);
+        p.temporary = true;
+        p.lifetime = 30;
+        p.fadeTime = 10;
+        parts.push_back(p);
+    }
 
-                                    if (rand() % 150 == 0) {
-                                        // tiles[index] = TilesCreateSteam();
-                                        real_tiles[index] = Tiles_NOTHING;
-                                        dirty[index] = true;
-                                        tickVisited[index] = true;
-                                    } else {
-                                        bool foundAny = false;
-                                        for (int xx = -2; xx <= 2; xx++) {
-                                            for (int yy = -2; yy <= 2; yy++) {
-                                                if (real_tiles[(x + xx) + (y + yy) * width].mat->physicsType == PhysicsType::SOLID) {
-                                                    foundAny = true;
-                                                    if (rand() % 500 == 0) {
-                                                        real_tiles[(x + xx) + (y + yy) * width] = TilesCreateFire();
-                                                        dirty[(x + xx) + (y + yy) * width] = true;
-                                                        tickVisited[(x + xx) + (y + yy) * width] = true;
-                                                    }
-                                                }
-                                            }
-                                        }
-                                        if (!foundAny && rand() % 120 == 0) {
-                                            real_tiles[index] = Tiles_NOTHING;
-                                            dirty[index] = true;
-                                            tickVisited[index] = true;
-                                        }
-                                    }
-                                }
+    if (rng.next() % 150 == 0) {
+        // tiles[index] = TilesCreateSteam();
+        real_tiles[index] = Tiles_NOTHING;
+        dirty.mark(index);
+        tickVisited[index] = true;
+    } else {
+        bool foundAny = false;
+        for (int xx = -2; xx <= 2; xx++) {
+            for (int yy = -2; yy <= 2; yy++) {
+                if (real_tiles[(x + xx) + (y + yy) * width].mat()->physicsType == PhysicsType::SOLID) {
+                    foundAny = true;
+                    if (rng.next() % 500 == 0) {
+                        real_tiles[(x + xx) + (y + yy) * width] = TilesCreateFire();
+                        dirty.mark((x + xx) + (y + yy) * width);
+                        tickVisited[(x + xx) + (y + yy) * width] = true;
+                    }
+                }
+            }
+        }
+        if (!foundAny && rng.next() % 120 == 0) {
+            real_tiles[index] = Tiles_NOTHING;
+            dirty.mark(index);
+            tickVisited[index] = true;
+        }
+    }
+}
 
-                                if (type == PhysicsType::SAND) {
-                                    // active[index] = true;
-                                    MaterialInstance belowTile = real_tiles[x + (y + 1) * width];
-                                    int below = belowTile.mat->physicsType;
-
-                                    if (tile.mat->interact && belowTile.mat->id >= 0 && belowTile.mat->id < GAME()->materials_count && tile.mat->nInteractions[belowTile.mat->id] > 0) {
-                                        for (int i = 0; i < tile.mat->nInteractions[belowTile.mat->id]; i++) {
-                                            MaterialInteraction in = tile.mat->interactions[belowTile.mat->id][i];
-                                            if (in.type == INTERACT_TRANSFORM_MATERIAL) {
-                                                for (int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
-                                                    for (int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
-                                                        if (real_tiles[(x + xx) + (y + yy) * width].mat->id == belowTile.mat->id) {
-                                                            real_tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1]->id, x + xx, y + yy);
-                                                            dirty[(x + xx) + (y + yy) * width] = true;
-                                                            tickVisited[(x + xx) + (y + yy) * width] = true;
-                                                        }
-                                                    }
-                                                }
-                                            } else if (in.type == INTERACT_SPAWN_MATERIAL) {
-                                                for (int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
-                                                    for (int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
-                                                        if ((xx == 0 && yy == 0) || real_tiles[(x + xx) + (y + yy) * width].mat->id == Tiles_NOTHING.mat->id) {
-                                                            real_tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1]->id, x + xx, y + yy);
-                                                            dirty[(x + xx) + (y + yy) * width] = true;
-                                                            tickVisited[(x + xx) + (y + yy) * width] = true;
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                        }
-                                        continue;
-                                    }
+// 第一遍: 下落 interaction/reaction
+template <>
+void world::tickCell<0, PhysicsType::SAND>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    const MaterialTable &mt = GAME()->materials_table;
+
+    // active[index] = true;
+    MaterialInstance belowTile = real_tiles[x + (y + 1) * width];
+    int below = mt.physicsType[belowTile.id];
+
+    std::span<const MaterialInteraction> interactions;
+    if (mt.checks[tile.id] & MaterialCheck_Interact) interactions = mt.interactionsOf(tile.id, belowTile.id);
+    if (!interactions.empty()) {
+        for (const MaterialInteraction &in : interactions) {
+            if (in.type == INTERACT_TRANSFORM_MATERIAL) {
+                for (int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
+                    for (int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
+                        if (real_tiles[(x + xx) + (y + yy) * width].id() == belowTile.id) {
+                            real_tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1]->id, x + xx, y + yy);
+                            dirty.mark((x + xx) + (y + yy) * width);
+                            tickVisited[(x + xx) + (y + yy) * width] = true;
+                        }
+                    }
+                }
+            } else if (in.type == INTERACT_SPAWN_MATERIAL) {
+                for (int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
+                    for (int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
+                        if ((xx == 0 && yy == 0) || real_tiles[(x + xx) + (y + yy) * width].id() == Tiles_NOTHING.id) {
+                            real_tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1]->id, x + xx, y + yy);
+                            dirty.mark((x + xx) + (y + yy) * width);
+                            tickVisited[(x + xx) + (y + yy) * width] = true;
+                        }
+                    }
+                }
+            }
+        }
+        return;
+    }
 
-                                    if (tile.mat->react && tile.mat->nReactions > 0) {
-                                        bool react = false;
-                                        for (int i = 0; i < tile.mat->nReactions; i++) {
-                                            MaterialInteraction in = tile.mat->reactions[i];
-                                            if (in.type == REACT_TEMPERATURE_BELOW) {
-                                                if (tile.temperature < in.data1) {
-                                                    real_tiles[index] = TilesCreate(GAME()->materials_container[in.data2]->id, x, y);
-                                                    real_tiles[index].temperature = tile.temperature;
-                                                    dirty[index] = true;
-                                                    tickVisited[index] = true;
-                                                    react = true;
-                                                }
-                                            } else if (in.type == REACT_TEMPERATURE_ABOVE) {
-                                                if (tile.temperature > in.data1) {
-                                                    real_tiles[index] = TilesCreate(GAME()->materials_container[in.data2]->id, x, y);
-                                                    real_tiles[index].temperature = tile.temperature;
-                                                    dirty[index] = true;
-                                                    tickVisited[index] = true;
-                                                    react = true;
-                                                }
-                                            }
-                                        }
-                                        if (react) continue;
-                                    }
+    if (mt.checks[tile.id] & MaterialCheck_React) {
+        const mat_id from = tile.id;
+        bool react = false;
+        for (const MaterialInteraction &in : mt.reactionsOf(tile.id)) {
+            if (in.type == REACT_TEMPERATURE_BELOW) {
+                if (tile.temperature < in.data1) {
+                    real_tiles[index] = TilesCreate(GAME()->materials_container[in.data2]->id, x, y);
+                    real_tiles[index].set_temperature(tile.temperature);
+                    dirty.mark(index);
+                    tickVisited[index] = true;
+                    react = true;
+                }
+            } else if (in.type == REACT_TEMPERATURE_ABOVE) {
+                if (tile.temperature > in.data1) {
+                    real_tiles[index] = TilesCreate(GAME()->materials_container[in.data2]->id, x, y);
+                    real_tiles[index].set_temperature(tile.temperature);
+                    dirty.mark(index);
+                    tickVisited[index] = true;
+                    react = true;
+                }
+            }
+        }
+        if (react) {
+            EventBus &bus = global.game->events;
+            if (bus.wanted(BusEventType::CellReaction)) bus.post({BusEventType::CellReaction, x - (int)loadZone.x, y - (int)loadZone.y, from, real_tiles[index].id()});
+            return;
+        }
+    }
 
-                                    bool canMoveBelow = (below == PhysicsType::AIR || (below != PhysicsType::SOLID && belowTile.mat->density < tile.mat->density));
-                                    if (!canMoveBelow) continue;
+    const f32 density = mt.density[tile.id];
+    bool canMoveBelow = (below == PhysicsType::AIR || (below != PhysicsType::SOLID && mt.density[belowTile.id] < density));
+    if (!canMoveBelow) return;
 
-                                    MaterialInstance belowLTile = real_tiles[(x - 1) + (y + 1) * width];
-                                    int belowL = belowLTile.mat->physicsType;
-                                    MaterialInstance belowRTile = real_tiles[(x + 1) + (y + 1) * width];
-                                    int belowR = belowRTile.mat->physicsType;
+    const mat_id belowLId = real_tiles[(x - 1) + (y + 1) * width].id();
+    int belowL = mt.physicsType[belowLId];
+    const mat_id belowRId = real_tiles[(x + 1) + (y + 1) * width].id();
+    int belowR = mt.physicsType[belowRId];
 
-                                    bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
-                                    bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
+    bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && mt.density[belowLId] < density));
+    bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && mt.density[belowRId] < density));
 
-                                    if (canMoveBelow && !((canMoveBelowL || canMoveBelowR) && rand() % 20 == 0)) {
-                                        if (belowTile.mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR &&
-                                            getTile(x, y + 3).mat->physicsType == PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
-                                            setTile(x, y, belowTile);
-#if DO_MULTITHREADING
-                                            parts.push_back(new CellData(tile, x, y + 1, (rand() % 10 - 5) / 20.0f, -((rand() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
-#else
-                                        cells.push_back(new CellData(tile, x, y + 1, (rand() % 10 - 5) / 20.0f, -((rand() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
-#endif
-                                        } else {
-                                            real_tiles[index] = belowTile;
-                                            dirty[index] = true;
-                                            // setTile(x, y, belowTile);
-                                            // setTile(x, y + 1, tile);
-                                            if (rand() % 2 == 0) {
-                                                tile.moved = true;
+    if (canMoveBelow && !((canMoveBelowL || canMoveBelowR) && rng.next() % 20 == 0)) {
+        if (belowTile.mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR &&
+            getTile(x, y + 3).mat->physicsType == PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
+            setTile(x, y, belowTile);
+            parts.emplace_back(tile, x, y + 1, (rng.next() % 10 - 5) / 20.0f, -((rng.next() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f);
+        } else {
+            real_tiles[index] = belowTile;
+            dirty.mark(index);
+            // setTile(x, y, belowTile);
+            // setTile(x, y + 1, tile);
+            if (rng.next() % 2 == 0) {
+                tile.moved = true;
 #ifdef DEBUG_FRICTION
-                                                tile.color = 0xffffffff;
+                tile.color = 0xffffffff;
 #endif
-                                            }
-                                            real_tiles[(x) + (y + 1) * width] = tile;
-                                            dirty[(x) + (y + 1) * width] = true;
-                                            tickVisited[x + (y + 1) * width] = true;
-                                        }
+            }
+            real_tiles[(x) + (y + 1) * width] = tile;
+            dirty.mark((x) + (y + 1) * width);
+            tickVisited[x + (y + 1) * width] = true;
+        }
 
-                                        int selfTrasmitMovementChance = 2;
+        int selfTrasmitMovementChance = 2;
 
-                                        if (rand() % selfTrasmitMovementChance == 0) {
-                                            if (x > 0 && real_tiles[(x - 1) + (y + 1) * width].mat->physicsType == PhysicsType::SAND) {
-                                                int otherTransmitMovementChance = 2;
-                                                if (rand() % otherTransmitMovementChance == 0) {
-                                                    real_tiles[(x - 1) + (y + 1) * width].moved = true;
+        if (rng.next() % selfTrasmitMovementChance == 0) {
+            if (x > 0 && real_tiles[(x - 1) + (y + 1) * width].mat()->physicsType == PhysicsType::SAND) {
+                int otherTransmitMovementChance = 2;
+                if (rng.next() % otherTransmitMovementChance == 0) {
+                    real_tiles[(x - 1) + (y + 1) * width].set_moved(true);
 #ifdef DEBUG_FRICTION
-                                                    real_tiles[(x - 1) + (y + 1) * width].color = 0xff00ffff;
-                                                    dirty[(x - 1) + (y + 1) * width] = true;
+                    real_tiles[(x - 1) + (y + 1) * width].set_color(0xff00ffff);
+                    dirty.mark((x - 1) + (y + 1) * width);
 #endif
-                                                }
-                                            }
+                }
+            }
 
-                                            if (x < width - 1 && real_tiles[(x + 1) + (y + 1) * width].mat->physicsType == PhysicsType::SAND) {
-                                                int otherTransmitMovementChance = 2;
-                                                if (rand() % otherTransmitMovementChance == 0) {
-                                                    real_tiles[(x + 1) + (y + 1) * width].moved = true;
+            if (x < width - 1 && real_tiles[(x + 1) + (y + 1) * width].mat()->physicsType == PhysicsType::SAND) {
+                int otherTransmitMovementChance = 2;
+                if (rng.next() % otherTransmitMovementChance == 0) {
+                    real_tiles[(x + 1) + (y + 1) * width].set_moved(true);
 #ifdef DEBUG_FRICTION
-                                                    real_tiles[(x + 1) + (y + 1) * width].color = 0xff00ffff;
-                                                    dirty[(x + 1) + (y + 1) * width] = true;
+                    real_tiles[(x + 1) + (y + 1) * width].set_color(0xff00ffff);
+                    dirty.mark((x + 1) + (y + 1) * width);
 #endif
-                                                }
-                                            }
-                                        }
-                                    }
-
-                                } else if (type == PhysicsType::SOUP) {
+                }
+            }
+        }
+    }
 
-                                    // based on https://github.com/jongallant/LiquidSimulator (MIT License)
+}
 
-                                    // NOTE: for liquids, tile.moved is tile.settled in the original algorithm
+// 第一遍: 液体流动 (体积在 fluidAmountDiff 中累计)
+template <>
+void world::tickCell<0, PhysicsType::SOUP>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    // based on https://github.com/jongallant/LiquidSimulator (MIT License)
 
-                                    if (tile.fluidAmount == 0.0f) continue;
+    // NOTE: for liquids, tile.moved is tile.settled in the original algorithm
 
-                                    if (tile.fluidAmount < FLUID_MinValue) {
-                                        tile.fluidAmount = 0.0f;
-                                        real_tiles[index] = tile;
-                                        continue;
-                                    }
+    if (tile.fluidAmount == 0.0f) return;
 
-                                    if (tile.fluidAmount > 0.005 && getTile(x, y + 1).mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR &&
-                                        getTile(x, y + 3).mat->physicsType == PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
-                                        setTile(x, y, Tiles_NOTHING);
+    if (tile.fluidAmount < FLUID_MinValue) {
+        tile.fluidAmount = 0.0f;
+        real_tiles[index] = tile;
+        return;
+    }
 
-                                        int n = tile.fluidAmount / 4;
-                                        if (n < 1) n = 1;
+    if (tile.fluidAmount > 0.005 && getTile(x, y + 1).mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR &&
+        getTile(x, y + 3).mat->physicsType == PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
+        setTile(x, y, Tiles_NOTHING);
 
-                                        for (int i = 0; i < n; i++) {
-                                            f32 amt = tile.fluidAmount / n;
+        int n = tile.fluidAmount / 4;
+        if (n < 1) n = 1;
 
-                                            MaterialInstance nt = MaterialInstance(tile.mat, tile.color, tile.temperature);
-                                            nt.fluidAmount = amt;
-                                            nt.fluidAmountDiff = 0;
-                                            nt.moved = false;
-#if DO_MULTITHREADING
-                                            parts.push_back(new CellData(nt, x, y + 1, (rand() % 10 - 5) / 30.0f, -((rand() % 2) + 3) / 10.0f + 1.0f, 0, 0.1f));
-#else
-                                        cells.push_back(new CellData(nt, x, y + 1, (rand() % 10 - 5) / 20.0f, -((rand() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
-#endif
-                                        }
+        for (int i = 0; i < n; i++) {
+            f32 amt = tile.fluidAmount / n;
 
-                                        continue;
-                                    }
+            MaterialInstance nt = MaterialInstance(tile.mat, tile.color, tile.temperature);
+            nt.fluidAmount = amt;
+            nt.fluidAmountDiff = 0;
+            nt.moved = false;
+            parts.emplace_back(nt, x, y + 1, (rng.next() % 10 - 5) / 30.0f, -((rng.next() % 2) + 3) / 10.0f + 1.0f, 0, 0.1f);
+        }
 
-                                    if (tile.moved) continue;
+        return;
+    }
 
-                                    f32 startValue = tile.fluidAmount;
-                                    f32 remainingValue = tile.fluidAmount;
+    if (tile.moved) return;
 
-                                    MaterialInstance bottom = real_tiles[(x) + (y + 1) * width];
+    f32 startValue = tile.fluidAmount;
+    f32 remainingValue = tile.fluidAmount;
 
-                                    bool airBelow = bottom.mat->physicsType == PhysicsType::AIR;
-                                    if ((airBelow && iter <= 2) || (bottom.mat->id == tile.mat->id)) {
-                                        f32 dstFl = bottom.mat->physicsType == PhysicsType::SOUP ? bottom.fluidAmount : 0.0f;
+    MaterialInstance bottom = real_tiles[(x) + (y + 1) * width];
 
-                                        f32 flow = CalculateVerticalFlowValue(startValue, dstFl) - dstFl;
-                                        if (bottom.fluidAmount > 0 && flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
+    bool airBelow = bottom.mat->physicsType == PhysicsType::AIR;
+    if ((airBelow && iter <= 2) || (bottom.mat->id == tile.mat->id)) {
+        f32 dstFl = bottom.mat->physicsType == PhysicsType::SOUP ? bottom.fluidAmount : 0.0f;
 
-                                        flow = std::max(flow, 0.0f);
-                                        if (flow > std::min(FLUID_MaxFlow, startValue)) flow = std::min(FLUID_MaxFlow, startValue);
+        f32 flow = CalculateVerticalFlowValue(startValue, dstFl) - dstFl;
+        if (bottom.fluidAmount > 0 && flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
 
-                                        if (flow != 0) {
-                                            remainingValue -= flow;
-                                            tile.fluidAmountDiff -= flow;
-                                            if (bottom.mat->physicsType == PhysicsType::AIR) {
-                                                real_tiles[(x) + (y + 1) * width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
-                                                real_tiles[(x) + (y + 1) * width].fluidAmount = 0.0f;
-                                            }
-                                            real_tiles[(x) + (y + 1) * width].fluidAmountDiff += flow;
-                                            // tiles[(x)+(y + 1) * width].moved = true;
-                                        }
-                                        flowY[index] += flow;
-                                    } else if (iter == 0 && bottom.mat->physicsType == PhysicsType::SOUP && (bottom.mat->id != tile.mat->id)) {
-                                        if (rand() % 10 == 0) {
-                                            real_tiles[index] = bottom;
-                                            real_tiles[(x) + (y + 1) * width] = tile;
-                                            continue;
-                                        }
-                                    }
+        flow = std::max(flow, 0.0f);
+        if (flow > std::min(FLUID_MaxFlow, startValue)) flow = std::min(FLUID_MaxFlow, startValue);
 
-                                    if (remainingValue < FLUID_MinValue) {
-                                        tile.fluidAmountDiff -= remainingValue;
-                                        real_tiles[index] = tile;
-                                        continue;
-                                    }
+        if (flow != 0) {
+            remainingValue -= flow;
+            tile.fluidAmountDiff -= flow;
+            if (bottom.mat->physicsType == PhysicsType::AIR) {
+                real_tiles[(x) + (y + 1) * width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
+                real_tiles[(x) + (y + 1) * width].set_fluid_amount(0.0f);
+            }
+            real_tiles[(x) + (y + 1) * width].add_fluid_amount_diff(flow);
+            // tiles[(x)+(y + 1) * width].moved = true;
+        }
+        flowY[index] += flow;
+    } else if (iter == 0 && bottom.mat->physicsType == PhysicsType::SOUP && (bottom.mat->id != tile.mat->id)) {
+        if (rng.next() % 10 == 0) {
+            real_tiles[index] = bottom;
+            real_tiles[(x) + (y + 1) * width] = tile;
+            return;
+        }
+    }
 
-                                    MaterialInstance left = real_tiles[(x - 1) + (y)*width];
-                                    bool canMoveLeft = (left.mat->physicsType == PhysicsType::AIR || (left.mat->id == tile.mat->id)) && !airBelow;
+    if (remainingValue < FLUID_MinValue) {
+        tile.fluidAmountDiff -= remainingValue;
+        real_tiles[index] = tile;
+        return;
+    }
 
-                                    MaterialInstance right = real_tiles[(x + 1) + (y)*width];
-                                    bool canMoveRight = (right.mat->physicsType == PhysicsType::AIR || (right.mat->id == tile.mat->id)) && !airBelow;
+    MaterialInstance left = real_tiles[(x - 1) + (y)*width];
+    bool canMoveLeft = (left.mat->physicsType == PhysicsType::AIR || (left.mat->id == tile.mat->id)) && !airBelow;
 
-                                    if (canMoveLeft) {
-                                        f32 dstFl = left.mat->physicsType == PhysicsType::SOUP ? left.fluidAmount : 0.0f;
+    MaterialInstance right = real_tiles[(x + 1) + (y)*width];
+    bool canMoveRight = (right.mat->physicsType == PhysicsType::AIR || (right.mat->id == tile.mat->id)) && !airBelow;
 
-                                        f32 flow = (remainingValue - dstFl) / (canMoveRight ? 3.0f : 2.0f);
-                                        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
+    if (canMoveLeft) {
+        f32 dstFl = left.mat->physicsType == PhysicsType::SOUP ? left.fluidAmount : 0.0f;
 
-                                        flow = std::max(flow, 0.0f);
-                                        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
+        f32 flow = (remainingValue - dstFl) / (canMoveRight ? 3.0f : 2.0f);
+        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
 
-                                        if (flow != 0) {
-                                            remainingValue -= flow;
-                                            tile.fluidAmountDiff -= flow;
-                                            if (left.mat->physicsType == PhysicsType::AIR) {
-                                                real_tiles[(x - 1) + (y)*width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
-                                                real_tiles[(x - 1) + (y)*width].fluidAmount = 0.0f;
-                                            }
-                                            real_tiles[(x - 1) + (y)*width].fluidAmountDiff += flow;
-                                            // tiles[(x - 1) + (y)*width].moved = true;
-                                        }
-                                        flowX[index] -= flow;
-                                    }
+        flow = std::max(flow, 0.0f);
+        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
 
-                                    if (remainingValue < FLUID_MinValue) {
-                                        tile.fluidAmountDiff -= remainingValue;
-                                        real_tiles[index] = tile;
-                                        continue;
-                                    }
+        if (flow != 0) {
+            remainingValue -= flow;
+            tile.fluidAmountDiff -= flow;
+            if (left.mat->physicsType == PhysicsType::AIR) {
+                real_tiles[(x - 1) + (y)*width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
+                real_tiles[(x - 1) + (y)*width].set_fluid_amount(0.0f);
+            }
+            real_tiles[(x - 1) + (y)*width].add_fluid_amount_diff(flow);
+            // tiles[(x - 1) + (y)*width].moved = true;
+        }
+        flowX[index] -= flow;
+    }
 
-                                    if (canMoveRight) {
-                                        f32 dstFl = right.mat->physicsType == PhysicsType::SOUP ? right.fluidAmount : 0.0f;
+    if (remainingValue < FLUID_MinValue) {
+        tile.fluidAmountDiff -= remainingValue;
+        real_tiles[index] = tile;
+        return;
+    }
 
-                                        f32 flow = (remainingValue - dstFl) / (canMoveLeft ? 2.0f : 2.0f);
-                                        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
+    if (canMoveRight) {
+        f32 dstFl = right.mat->physicsType == PhysicsType::SOUP ? right.fluidAmount : 0.0f;
 
-                                        flow = std::max(flow, 0.0f);
-                                        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
+        f32 flow = (remainingValue - dstFl) / (canMoveLeft ? 2.0f : 2.0f);
+        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
 
-                                        if (flow != 0) {
-                                            remainingValue -= flow;
-                                            tile.fluidAmountDiff -= flow;
-                                            if (right.mat->physicsType == PhysicsType::AIR) {
-                                                real_tiles[(x + 1) + (y)*width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
-                                                real_tiles[(x + 1) + (y)*width].fluidAmount = 0.0f;
-                                            }
-                                            real_tiles[(x + 1) + (y)*width].fluidAmountDiff += flow;
-                                            // tiles[(x + 1) + (y)*width].moved = true;
-                                        }
-                                        flowX[index] += flow;
-                                    }
+        flow = std::max(flow, 0.0f);
+        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
 
-                                    if (remainingValue < FLUID_MinValue) {
-                                        tile.fluidAmountDiff -= remainingValue;
-                                        real_tiles[index] = tile;
-                                        continue;
-                                    }
+        if (flow != 0) {
+            remainingValue -= flow;
+            tile.fluidAmountDiff -= flow;
+            if (right.mat->physicsType == PhysicsType::AIR) {
+                real_tiles[(x + 1) + (y)*width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
+                real_tiles[(x + 1) + (y)*width].set_fluid_amount(0.0f);
+            }
+            real_tiles[(x + 1) + (y)*width].add_fluid_amount_diff(flow);
+            // tiles[(x + 1) + (y)*width].moved = true;
+        }
+        flowX[index] += flow;
+    }
 
-                                    MaterialInstance top = real_tiles[(x) + (y - 1) * width];
+    if (remainingValue < FLUID_MinValue) {
+        tile.fluidAmountDiff -= remainingValue;
+        real_tiles[index] = tile;
+        return;
+    }
 
-                                    if (top.mat->physicsType == PhysicsType::AIR || (top.mat->id == tile.mat->id)) {
-                                        f32 dstFl = top.mat->physicsType == PhysicsType::SOUP ? top.fluidAmount : 0.0f;
+    MaterialInstance top = real_tiles[(x) + (y - 1) * width];
 
-                                        f32 flow = remainingValue - CalculateVerticalFlowValue(remainingValue, dstFl);
-                                        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
+    if (top.mat->physicsType == PhysicsType::AIR || (top.mat->id == tile.mat->id)) {
+        f32 dstFl = top.mat->physicsType == PhysicsType::SOUP ? top.fluidAmount : 0.0f;
 
-                                        flow = std::max(flow, 0.0f);
-                                        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
+        f32 flow = remainingValue - CalculateVerticalFlowValue(remainingValue, dstFl);
+        if (flow > FLUID_MinFlow) flow *= FLUID_FlowSpeed;
 
-                                        if (flow != 0) {
-                                            remainingValue -= flow;
-                                            tile.fluidAmountDiff -= flow;
-                                            if (top.mat->physicsType == PhysicsType::AIR) {
-                                                real_tiles[(x) + (y - 1) * width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
-                                                real_tiles[(x) + (y - 1) * width].fluidAmount = 0.0f;
-                                            }
-                                            real_tiles[(x) + (y - 1) * width].fluidAmountDiff += flow;
-                                            // tiles[(x)+(y - 1) * width].moved = true;
-                                        }
-                                        flowY[index] -= flow;
-                                    } else if (iter == 0 && top.mat->physicsType == PhysicsType::SOUP && (top.mat->id != tile.mat->id)) {
-                                        if (rand() % 10 == 0) {
-                                            real_tiles[index] = top;
-                                            real_tiles[(x) + (y - 1) * width] = tile;
-                                            continue;
-                                        }
-                                    }
+        flow = std::max(flow, 0.0f);
+        if (flow > std::min(FLUID_MaxFlow, remainingValue)) flow = std::min(FLUID_MaxFlow, remainingValue);
 
-                                    if (remainingValue < FLUID_MinValue) {
-                                        tile.fluidAmountDiff -= remainingValue;
-                                        real_tiles[index] = tile;
-                                        continue;
-                                    }
+        if (flow != 0) {
+            remainingValue -= flow;
+            tile.fluidAmountDiff -= flow;
+            if (top.mat->physicsType == PhysicsType::AIR) {
+                real_tiles[(x) + (y - 1) * width] = MaterialInstance(tile.mat, tile.color, tile.temperature);
+                real_tiles[(x) + (y - 1) * width].set_fluid_amount(0.0f);
+            }
+            real_tiles[(x) + (y - 1) * width].add_fluid_amount_diff(flow);
+            // tiles[(x)+(y - 1) * width].moved = true;
+        }
+        flowY[index] -= flow;
+    } else if (iter == 0 && top.mat->physicsType == PhysicsType::SOUP && (top.mat->id != tile.mat->id)) {
+        if (rng.next() % 10 == 0) {
+            real_tiles[index] = top;
+            real_tiles[(x) + (y - 1) * width] = tile;
+            return;
+        }
+    }
 
-                                    if (startValue == remainingValue) {
-                                        tile.settleCount++;
-                                        if (tile.settleCount >= 10) {
-                                            tile.moved = true;
-                                        }
-                                    } else {
-                                        dirty[index] = true;
-                                        if (top.mat->physicsType == PhysicsType::SOUP) real_tiles[(x) + (y - 1) * width].moved = false;
-                                        if (bottom.mat->physicsType == PhysicsType::SOUP) real_tiles[(x) + (y + 1) * width].moved = false;
-                                        if (left.mat->physicsType == PhysicsType::SOUP) real_tiles[(x - 1) + (y)*width].moved = false;
-                                        if (right.mat->physicsType == PhysicsType::SOUP) real_tiles[(x + 1) + (y)*width].moved = false;
-                                    }
+    if (remainingValue < FLUID_MinValue) {
+        tile.fluidAmountDiff -= remainingValue;
+        real_tiles[index] = tile;
+        return;
+    }
 
-                                    real_tiles[index] = tile;
-
-                                    // active[index] = true;
-                                    MaterialInstance belowTile = real_tiles[(x) + (y + 1) * width];
-                                    int below = belowTile.mat->physicsType;
-
-                                    // if(tile.mat->interact && belowTile.mat->id >= 0 && belowTile.mat->id < GAME()->materials_count && tile.mat->nInteractions[belowTile.mat->id] > 0) {
-                                    //     for(int i = 0; i < tile.mat->nInteractions[belowTile.mat->id]; i++) {
-                                    //         MaterialInteraction in = tile.mat->interactions[belowTile.mat->id][i];
-                                    //         if(in.type == INTERACT_TRANSFORM_MATERIAL) {
-                                    //             for(int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
-                                    //                 for(int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
-                                    //                     if(tiles[(x + xx) + (y + yy) * width].mat->id == belowTile.mat->id) {
-                                    //                         tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1], x + xx, y + yy);
-                                    //                         dirty[(x + xx) + (y + yy) * width] = true;
-                                    //                         tickVisited[(x + xx) + (y + yy) * width] = true;
-                                    //                     }
-                                    //                 }
-                                    //             }
-                                    //         } else if(in.type == INTERACT_SPAWN_MATERIAL) {
-                                    //             for(int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
-                                    //                 for(int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
-                                    //                     if((xx == 0 && yy == 0) || tiles[(x + xx) + (y + yy) * width].mat->id == Tiles_NOTHING.mat->id) {
-                                    //                         tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1], x + xx, y + yy);
-                                    //                         dirty[(x + xx) + (y + yy) * width] = true;
-                                    //                         tickVisited[(x + xx) + (y + yy) * width] = true;
-                                    //                     }
-                                    //                 }
-                                    //             }
-                                    //         }
-                                    //     }
-                                    //     continue;
-                                    // }
-
-                                    // if(tile.mat->react && tile.mat->nReactions > 0) {
-                                    //     bool react = false;
-                                    //     for(int i = 0; i < tile.mat->nReactions; i++) {
-                                    //         MaterialInteraction in = tile.mat->reactions[i];
-                                    //         if(in.type == REACT_TEMPERATURE_BELOW) {
-                                    //             if(tile.temperature < in.data1) {
-                                    //                 tiles[index] = TilesCreate(GAME()->materials_container[in.data2], x, y);
-                                    //                 tiles[index].temperature = tile.temperature;
-                                    //                 dirty[index] = true;
-                                    //                 tickVisited[index] = true;
-                                    //                 react = true;
-                                    //             }
-                                    //         } else if(in.type == REACT_TEMPERATURE_ABOVE) {
-                                    //             if(tile.temperature > in.data1) {
-                                    //                 tiles[index] = TilesCreate(GAME()->materials_container[in.data2], x, y);
-                                    //                 tiles[index].temperature = tile.temperature;
-                                    //                 dirty[index] = true;
-                                    //                 tickVisited[index] = true;
-                                    //                 react = true;
-                                    //             }
-                                    //         }
-                                    //     }
-                                    //     if(react) continue;
-                                    // }
-
-                                    if (tile.mat->id == GAME()->materials_list.WATER.id && belowTile.mat->id == GAME()->materials_list.LAVA.id) {
-                                        real_tiles[index] = TilesCreateSteam();
-                                        dirty[index] = true;
-                                        real_tiles[(x) + (y + 1) * width] = TilesCreateObsidian(x, y + 1);
-                                        dirty[(x) + (y + 1) * width] = true;
-                                        tickVisited[(x) + (y + 1) * width] = true;
-
-                                        for (int xx = -1; xx <= 1; xx++) {
-                                            for (int yy = 0; yy <= 2; yy++) {
-                                                if (real_tiles[(x + xx) + (y + yy) * width].mat->id == GAME()->materials_list.LAVA.id) {
-                                                    real_tiles[(x + xx) + (y + yy) * width] = TilesCreateObsidian(x + xx, y + yy);
-                                                    dirty[(x + xx) + (y + yy) * width] = true;
-                                                    tickVisited[(x + xx) + (y + yy) * width] = true;
-                                                }
-                                            }
-                                        }
+    if (startValue == remainingValue) {
+        tile.settleCount++;
+        if (tile.settleCount >= 10) {
+            tile.moved = true;
+        }
+    } else {
+        dirty.mark(index);
+        if (top.mat->physicsType == PhysicsType::SOUP) real_tiles[(x) + (y - 1) * width].set_moved(false);
+        if (bottom.mat->physicsType == PhysicsType::SOUP) real_tiles[(x) + (y + 1) * width].set_moved(false);
+        if (left.mat->physicsType == PhysicsType::SOUP) real_tiles[(x - 1) + (y)*width].set_moved(false);
+        if (right.mat->physicsType == PhysicsType::SOUP) real_tiles[(x + 1) + (y)*width].set_moved(false);
+    }
 
-                                        continue;
-                                    }
+    real_tiles[index] = tile;
+
+    // active[index] = true;
+    MaterialInstance belowTile = real_tiles[(x) + (y + 1) * width];
+    int below = belowTile.mat->physicsType;
+
+    // if(tile.mat->interact && belowTile.mat->id >= 0 && belowTile.mat->id < GAME()->materials_count && tile.mat->nInteractions[belowTile.mat->id] > 0) {
+    //     for(int i = 0; i < tile.mat->nInteractions[belowTile.mat->id]; i++) {
+    //         MaterialInteraction in = tile.mat->interactions[belowTile.mat->id][i];
+    //         if(in.type == INTERACT_TRANSFORM_MATERIAL) {
+    //             for(int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
+    //                 for(int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
+    //                     if(tiles[(x + xx) + (y + yy) * width].mat->id == belowTile.mat->id) {
+    //                         tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1], x + xx, y + yy);
+    //                         dirty[(x + xx) + (y + yy) * width] = true;
+    //                         tickVisited[(x + xx) + (y + yy) * width] = true;
+    //                     }
+    //                 }
+    //             }
+    //         } else if(in.type == INTERACT_SPAWN_MATERIAL) {
+    //             for(int xx = in.ofsX - in.data2; xx <= in.ofsX + in.data2; xx++) {
+    //                 for(int yy = in.ofsY - in.data2; yy <= in.ofsY + in.data2; yy++) {
+    //                     if((xx == 0 && yy == 0) || tiles[(x + xx) + (y + yy) * width].mat->id == Tiles_NOTHING.mat->id) {
+    //                         tiles[(x + xx) + (y + yy) * width] = TilesCreate(GAME()->materials_container[in.data1], x + xx, y + yy);
+    //                         dirty[(x + xx) + (y + yy) * width] = true;
+    //                         tickVisited[(x + xx) + (y + yy) * width] = true;
+    //                     }
+    //                 }
+    //             }
+    //         }
+    //     }
+    //     continue;
+    // }
 
-                                    // bool canMoveBelow = (below == PhysicsType::AIR || (below != PhysicsType::SOLID && belowTile.mat->density < tile.mat->density));
-                                    // if(!canMoveBelow) continue;
-
-                                    // MaterialInstance belowLTile = tiles[(x - 1) + (y + 1) * width];
-                                    // int belowL = belowLTile.mat->physicsType;
-                                    // MaterialInstance belowRTile = tiles[(x + 1) + (y + 1) * width];
-                                    // int belowR = belowRTile.mat->physicsType;
-
-                                    // bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
-                                    // bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
-
-                                    // if(canMoveBelow && !((canMoveBelowL || canMoveBelowR) && rand() % 10 == 0)) {
-                                    //     if(belowTile.mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR && getTile(x, y + 3).mat->physicsType ==
-                                    //     PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
-                                    //         setTile(x, y, belowTile);
-                                    //         #if DO_MULTITHREADING
-                                    //         parts.push_back(new CellData(tile, x, y + 1, (rand() % 10 - 5) / 20.0f, -((rand() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
-                                    //         #else
-                                    //         cells.push_back(new CellData(tile, x, y + 1, (rand() % 10 - 5) / 20.0f, -((rand() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
-                                    //         #endif
-                                    //     } else {
-                                    //         tiles[index] = belowTile;
-                                    //         dirty[index] = true;
-                                    //         //setTile(x, y, belowTile);
-                                    //         //setTile(x, y + 1, tile);
-                                    //         tiles[(x)+(y + 1) * width] = tile;
-                                    //         dirty[(x)+(y + 1) * width] = true;
-                                    //         tickVisited[x + (y + 1) * width] = true;
-                                    //     }
-                                    // }
-                                } else if (type == PhysicsType::GAS) {
-                                    // active[index] = true;
-                                    int above = real_tiles[(x) + (y - 1) * width].mat->physicsType;
-
-                                    int aboveL = real_tiles[(x - 1) + (y - 1) * width].mat->physicsType;
-                                    int aboveR = real_tiles[(x + 1) + (y - 1) * width].mat->physicsType;
-
-                                    if (above == 0 && !((aboveL == 0 || aboveR == 0) && rand() % 2 == 0)) {
-                                        real_tiles[index] = getTile(x, y - 1);
-                                        dirty[index] = true;
-
-                                        real_tiles[(x) + (y - 1) * width] = tile;
-                                        dirty[(x) + (y - 1) * width] = true;
-
-                                        tickVisited[(x) + (y - 1) * width] = true;
-                                    }
-                                }
-                            }
-                        }
+    // if(tile.mat->react && tile.mat->nReactions > 0) {
+    //     bool react = false;
+    //     for(int i = 0; i < tile.mat->nReactions; i++) {
+    //         MaterialInteraction in = tile.mat->reactions[i];
+    //         if(in.type == REACT_TEMPERATURE_BELOW) {
+    //             if(tile.temperature < in.data1) {
+    //                 tiles[index] = TilesCreate(GAME()->materials_container[in.data2], x, y);
+    //                 tiles[index].temperature = tile.temperature;
+    //                 dirty[index] = true;
+    //                 tickVisited[index] = true;
+    //                 react = true;
+    //             }
+    //         } else if(in.type == REACT_TEMPERATURE_ABOVE) {
+    //             if(tile.temperature > in.data1) {
+    //                 tiles[index] = TilesCreate(GAME()->materials_container[in.data2], x, y);
+    //                 tiles[index].temperature = tile.temperature;
+    //                 dirty[index] = true;
+    //                 tickVisited[index] = true;
+    //                 react = true;
+    //             }
+    //         }
+    //     }
+    //     if(react) continue;
+    // }
 
-                        for (int dy = CHUNK_H - 1; dy >= 0; dy--) {
-                            int y = cy + dy;
-                            for (int dxf = 0; dxf < CHUNK_W; dxf++) {
-                                int dx = reverseX ? (CHUNK_W - 1) - dxf : dxf;
-                                int x = cx + dx;
-                                int index = x + y * width;
+    if (tile.mat->id == GAME()->materials_list.WATER.id && belowTile.mat->id == GAME()->materials_list.LAVA.id) {
+        real_tiles[index] = TilesCreateSteam();
+        dirty.mark(index);
+        real_tiles[(x) + (y + 1) * width] = TilesCreateObsidian(x, y + 1);
+        dirty.mark((x) + (y + 1) * width);
+        tickVisited[(x) + (y + 1) * width] = true;
+
+        for (int xx = -1; xx <= 1; xx++) {
+            for (int yy = 0; yy <= 2; yy++) {
+                if (real_tiles[(x + xx) + (y + yy) * width].mat()->id == GAME()->materials_list.LAVA.id) {
+                    real_tiles[(x + xx) + (y + yy) * width] = TilesCreateObsidian(x + xx, y + yy);
+                    dirty.mark((x + xx) + (y + yy) * width);
+                    tickVisited[(x + xx) + (y + yy) * width] = true;
+                }
+            }
+        }
 
-                                if (tickVisited[index]) continue;
+        return;
+    }
 
-                                MaterialInstance tile = real_tiles[index];
+    // bool canMoveBelow = (below == PhysicsType::AIR || (below != PhysicsType::SOLID && belowTile.mat->density < tile.mat->density));
+    // if(!canMoveBelow) continue;
+
+    // MaterialInstance belowLTile = tiles[(x - 1) + (y + 1) * width];
+    // int belowL = belowLTile.mat->physicsType;
+    // MaterialInstance belowRTile = tiles[(x + 1) + (y + 1) * width];
+    // int belowR = belowRTile.mat->physicsType;
+
+    // bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
+    // bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
+
+    // if(canMoveBelow && !((canMoveBelowL || canMoveBelowR) && rng.next() % 10 == 0)) {
+    //     if(belowTile.mat->physicsType == PhysicsType::AIR && getTile(x, y + 2).mat->physicsType == PhysicsType::AIR && getTile(x, y + 3).mat->physicsType ==
+    //     PhysicsType::AIR && getTile(x, y + 4).mat->physicsType == PhysicsType::AIR) {
+    //         setTile(x, y, belowTile);
+    //         #if DO_MULTITHREADING
+    //         parts.push_back(new CellData(tile, x, y + 1, (rng.next() % 10 - 5) / 20.0f, -((rng.next() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
+    //         #else
+    //         cells.push_back(new CellData(tile, x, y + 1, (rng.next() % 10 - 5) / 20.0f, -((rng.next() % 2) + 3) / 10.0f + 1.5f, 0, 0.1f));
+    //         #endif
+    //     } else {
+    //         tiles[index] = belowTile;
+    //         dirty[index] = true;
+    //         //setTile(x, y, belowTile);
+    //         //setTile(x, y + 1, tile);
+    //         tiles[(x)+(y + 1) * width] = tile;
+    //         dirty[(x)+(y + 1) * width] = true;
+    //         tickVisited[x + (y + 1) * width] = true;
+    //     }
+    // }
+}
 
-                                int type = tile.mat->physicsType;
+// 第一遍: 上升
+template <>
+void world::tickCell<0, PhysicsType::GAS>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    const MaterialTable &mt = GAME()->materials_table;
 
-                                if (type == PhysicsType::SAND) {
-                                    // active[index] = true;
-                                    MaterialInstance belowLTile = real_tiles[(x - 1) + (y + 1) * width];
-                                    int belowL = belowLTile.mat->physicsType;
-                                    MaterialInstance belowRTile = real_tiles[(x + 1) + (y + 1) * width];
-                                    int belowR = belowRTile.mat->physicsType;
+    // active[index] = true;
+    int above = real_tiles[(x) + (y - 1) * width].mat()->physicsType;
 
-                                    bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
-                                    bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
+    int aboveL = mt.physicsType[real_tiles[(x - 1) + (y - 1) * width].id()];
+    int aboveR = mt.physicsType[real_tiles[(x + 1) + (y - 1) * width].id()];
 
-                                    bool stoppedByFriction = !tile.moved;
+    if (above == 0 && !((aboveL == 0 || aboveR == 0) && rng.next() % 2 == 0)) {
+        real_tiles[index] = getTile(x, y - 1);
+        dirty.mark(index);
 
-                                    // 1 to ~127
-                                    int slipperyness = tile.mat->slipperyness;
+        real_tiles[(x) + (y - 1) * width] = tile;
+        dirty.mark((x) + (y - 1) * width);
 
-                                    if (stoppedByFriction) {
-                                        int drop = 0;
+        tickVisited[(x) + (y - 1) * width] = true;
+    }
+}
 
-                                        for (int pil = 0; pil < 10; pil++) {
-                                            int pilChL = real_tiles[(x - 1) + (y + 1 + pil) * width].mat->physicsType;
-                                            int pilChR = real_tiles[(x + 1) + (y + 1 + pil) * width].mat->physicsType;
+// 第二遍: 摩擦和斜向滑落
+template <>
+void world::tickCell<1, PhysicsType::SAND>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    const MaterialTable &mt = GAME()->materials_table;
 
-                                            if (pilChL == PhysicsType::AIR || pilChR == PhysicsType::AIR) {
-                                                drop++;
-                                            }
-                                        }
+    // active[index] = true;
+    MaterialInstance belowLTile = real_tiles[(x - 1) + (y + 1) * width];
+    int belowL = mt.physicsType[belowLTile.id];
+    MaterialInstance belowRTile = real_tiles[(x + 1) + (y + 1) * width];
+    int belowR = mt.physicsType[belowRTile.id];
+
+    const f32 density = mt.density[tile.id];
+    bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && mt.density[belowLTile.id] < density));
+    bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && mt.density[belowRTile.id] < density));
+
+    bool stoppedByFriction = !tile.moved;
 
-                                        // max number of pixels tall a pillar can be before being unstable
-                                        int maxStability = 8 / sqrt(slipperyness) + 1;
+    // 1 to ~127
+    int slipperyness = tile.mat->slipperyness;
+
+    if (stoppedByFriction) {
+        int drop = 0;
+
+        for (int pil = 0; pil < 10; pil++) {
+            int pilChL = mt.physicsType[real_tiles[(x - 1) + (y + 1 + pil) * width].id()];
+            int pilChR = mt.physicsType[real_tiles[(x + 1) + (y + 1 + pil) * width].id()];
+
+            if (pilChL == PhysicsType::AIR || pilChR == PhysicsType::AIR) {
+                drop++;
+            }
+        }
 
-                                        if (drop + 1 - maxStability > 0) {
-                                            int chance = 1000 / (drop + 1 - maxStability);
-                                            if (chance < 1000) {
-                                                if (rand() % chance == 0) {
-                                                    stoppedByFriction = false;
-                                                    real_tiles[(x) + (y)*width].moved = true;
+        // max number of pixels tall a pillar can be before being unstable
+        int maxStability = 8 / sqrt(slipperyness) + 1;
+
+        if (drop + 1 - maxStability > 0) {
+            int chance = 1000 / (drop + 1 - maxStability);
+            if (chance < 1000) {
+                if (rng.next() % chance == 0) {
+                    stoppedByFriction = false;
+                    real_tiles[(x) + (y)*width].set_moved(true);
 #ifdef DEBUG_FRICTION
-                                                    real_tiles[(x) + (y)*width].color = 0xff0000ff;
-                                                    dirty[(x) + (y)*width] = true;
+                    real_tiles[(x) + (y)*width].set_color(0xff0000ff);
+                    dirty.mark((x) + (y)*width);
 #endif
-                                                }
-                                            }
-                                        }
-                                    }
+                }
+            }
+        }
+    }
 
-                                    if (stoppedByFriction || !(canMoveBelowL || canMoveBelowR)) {
-                                        real_tiles[(x) + (y)*width].moved = false;
+    if (stoppedByFriction || !(canMoveBelowL || canMoveBelowR)) {
+        real_tiles[(x) + (y)*width].set_moved(false);
 #ifdef DEBUG_FRICTION
-                                        real_tiles[(x) + (y)*width].color = 0xff000000;
-                                        dirty[(x) + (y)*width] = true;
+        real_tiles[(x) + (y)*width].set_color(0xff000000);
+        dirty.mark((x) + (y)*width);
 #endif
-                                        continue;
-                                    }
+        return;
+    }
 
-                                    bool shouldMove = rand() % (2 * slipperyness) != 0;
+    bool shouldMove = rng.next() % (2 * slipperyness) != 0;
 
-                                    if (shouldMove && (canMoveBelowL || canMoveBelowR)) {
-                                        int selfTrasmitMovementChance = 2;
+    if (shouldMove && (canMoveBelowL || canMoveBelowR)) {
+        int selfTrasmitMovementChance = 2;
 
-                                        if (rand() % selfTrasmitMovementChance == 0) {
-                                            if (real_tiles[(x) + (y + 1) * width].mat->physicsType == PhysicsType::SAND) {
-                                                int otherTransmitMovementChance = 2;
-                                                if (rand() % otherTransmitMovementChance == 0) {
-                                                    real_tiles[(x) + (y + 1) * width].moved = true;
+        if (rng.next() % selfTrasmitMovementChance == 0) {
+            if (real_tiles[(x) + (y + 1) * width].mat()->physicsType == PhysicsType::SAND) {
+                int otherTransmitMovementChance = 2;
+                if (rng.next() % otherTransmitMovementChance == 0) {
+                    real_tiles[(x) + (y + 1) * width].set_moved(true);
 #ifdef DEBUG_FRICTION
-                                                    real_tiles[(x) + (y + 1) * width].color = 0xffff00ff;
-                                                    dirty[(x) + (y + 1) * width] = true;
+                    real_tiles[(x) + (y + 1) * width].set_color(0xffff00ff);
+                    dirty.mark((x) + (y + 1) * width);
 #endif
-                                                }
-                                            }
-                                        }
-                                    }
+                }
+            }
+        }
+    }
 
-                                    if (shouldMove && canMoveBelowL && (!canMoveBelowR || rand() % 2 == 0)) {
-                                        if (real_tiles[(x - 1) + y * width].mat->physicsType == PhysicsType::AIR) {
-                                            real_tiles[(x - 1) + y * width] = belowLTile;
-                                            dirty[(x - 1) + y * width] = true;
-                                            tickVisited[(x - 1) + (y)*width] = true;
-                                            real_tiles[index] = Tiles_NOTHING;
-                                            dirty[index] = true;
-                                        } else {
-                                            real_tiles[index] = belowLTile;
-                                            dirty[index] = true;
-                                            tickVisited[index] = true;
-                                        }
+    if (shouldMove && canMoveBelowL && (!canMoveBelowR || rng.next() % 2 == 0)) {
+        if (real_tiles[(x - 1) + y * width].mat()->physicsType == PhysicsType::AIR) {
+            real_tiles[(x - 1) + y * width] = belowLTile;
+            dirty.mark((x - 1) + y * width);
+            tickVisited[(x - 1) + (y)*width] = true;
+            real_tiles[index] = Tiles_NOTHING;
+            dirty.mark(index);
+        } else {
+            real_tiles[index] = belowLTile;
+            dirty.mark(index);
+            tickVisited[index] = true;
+        }
 
-                                        if (rand() % (20 * slipperyness) == 0) {
-                                            tile.moved = false;
+        if (rng.next() % (20 * slipperyness) == 0) {
+            tile.moved = false;
 #ifdef DEBUG_FRICTION
-                                            tile.color = 0xff000000;
+            tile.color = 0xff000000;
 #endif
-                                        }
-                                        real_tiles[(x - 1) + (y + 1) * width] = tile;
-                                        dirty[(x - 1) + (y + 1) * width] = true;
-                                        tickVisited[(x - 1) + (y + 1) * width] = true;
-
-                                    } else if (shouldMove && canMoveBelowR) {
-
-                                        if (real_tiles[(x + 1) + y * width].mat->physicsType == PhysicsType::AIR) {
-                                            real_tiles[(x + 1) + y * width] = belowRTile;
-                                            dirty[(x + 1) + y * width] = true;
-                                            real_tiles[index] = Tiles_NOTHING;
-                                            dirty[index] = true;
-                                        } else {
-                                            real_tiles[index] = belowRTile;
-                                            dirty[index] = true;
-                                            tickVisited[index] = true;
-                                        }
+        }
+        real_tiles[(x - 1) + (y + 1) * width] = tile;
+        dirty.mark((x - 1) + (y + 1) * width);
+        tickVisited[(x - 1) + (y + 1) * width] = true;
+
+    } else if (shouldMove && canMoveBelowR) {
+
+        if (real_tiles[(x + 1) + y * width].mat()->physicsType == PhysicsType::AIR) {
+            real_tiles[(x + 1) + y * width] = belowRTile;
+            dirty.mark((x + 1) + y * width);
+            real_tiles[index] = Tiles_NOTHING;
+            dirty.mark(index);
+        } else {
+            real_tiles[index] = belowRTile;
+            dirty.mark(index);
+            tickVisited[index] = true;
+        }
 
-                                        if (rand() % (20 * slipperyness) == 0) {
-                                            tile.moved = false;
+        if (rng.next() % (20 * slipperyness) == 0) {
+            tile.moved = false;
 #ifdef DEBUG_FRICTION
-                                            tile.color = 0xff000000;
+            tile.color = 0xff000000;
 #endif
-                                        }
-                                        real_tiles[(x + 1) + (y + 1) * width] = tile;
-                                        dirty[(x + 1) + (y + 1) * width] = true;
-                                        tickVisited[(x + 1) + (y + 1) * width] = true;
+        }
+        real_tiles[(x + 1) + (y + 1) * width] = tile;
+        dirty.mark((x + 1) + (y + 1) * width);
+        tickVisited[(x + 1) + (y + 1) * width] = true;
 
-                                    } else {
-                                        real_tiles[(x) + (y)*width].moved = false;
+    } else {
+        real_tiles[(x) + (y)*width].set_moved(false);
 #ifdef DEBUG_FRICTION
-                                        real_tiles[(x) + (y)*width].color = 0xff000000;
-                                        dirty[(x) + (y)*width] = true;
+        real_tiles[(x) + (y)*width].set_color(0xff000000);
+        dirty.mark((x) + (y)*width);
 #endif
-                                    }
-                                } else if (type == PhysicsType::SOUP) {
-
-                                    tile.fluidAmount += tile.fluidAmountDiff;
-                                    tile.fluidAmountDiff = 0.0f;
-                                    if (tile.fluidAmount < FLUID_MinValue) {
-                                        real_tiles[index] = Tiles_NOTHING;
-                                        dirty[index] = true;
-                                        tickVisited[index] = true;
-                                    } else {
-                                        real_tiles[index] = tile;
-                                        /*uint8_t c = (1.0f - tile.fluidAmount / 8.0f) * 255;
-                                    int rgb = c;
-                                    rgb = (rgb << 8) + c;
-                                    rgb = (rgb << 8) + c;
-                                    tiles[index].color = rgb;*/
-                                        dirty[index] = true;
-                                        tickVisited[index] = true;
-                                    }
+    }
+}
 
-                                    // OLD:
-
-                                    // active[index] = true;
-                                    /*MaterialInstance belowLTile = tiles[(x - 1) + (y + 1) * width];
-                                int belowL = belowLTile.mat->physicsType;
-                                MaterialInstance belowRTile = tiles[(x + 1) + (y + 1) * width];
-                                int belowR = belowRTile.mat->physicsType;
-
-                                bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
-                                bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
-
-                                if(!(canMoveBelowL || canMoveBelowR)) continue;
-
-                                MaterialInstance lTile = tiles[(x - 1) + (y)* width];
-                                int l = lTile.mat->physicsType;
-                                MaterialInstance rTile = tiles[(x + 1) + (y)* width];
-                                int r = rTile.mat->physicsType;
-
-                                bool canMoveL = (l == PhysicsType::AIR || (l != PhysicsType::SOLID && lTile.mat->density < tile.mat->density));
-                                bool canMoveR = (r == PhysicsType::AIR || (r != PhysicsType::SOLID && rTile.mat->density < tile.mat->density));
-
-                                if(!((canMoveL || canMoveR) && rand() % 10 == 0)) {
-                                    if(canMoveBelowL && !(canMoveBelowR && rand() % 2 == 0)) {
-                                        if(tiles[(x - 1) + y * width].mat->physicsType == PhysicsType::AIR) {
-                                            tiles[(x - 1) + y * width] = belowLTile;
-                                            dirty[(x - 1) + y * width] = true;
-                                            tiles[index] = Tiles_NOTHING;
-                                            dirty[index] = true;
-                                        } else {
-                                            tiles[index] = belowLTile;
-                                            dirty[index] = true;
-                                        }
+// 第二遍: 结算第一遍累计的液体量
+template <>
+void world::tickCell<1, PhysicsType::SOUP>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    tile.fluidAmount += tile.fluidAmountDiff;
+    tile.fluidAmountDiff = 0.0f;
+    if (tile.fluidAmount < FLUID_MinValue) {
+        real_tiles[index] = Tiles_NOTHING;
+        dirty.mark(index);
+        tickVisited[index] = true;
+    } else {
+        real_tiles[index] = tile;
+        /*uint8_t c = (1.0f - tile.fluidAmount / 8.0f) * 255;
+    int rgb = c;
+    rgb = (rgb << 8) + c;
+    rgb = (rgb << 8) + c;
+    tiles[index].color = rgb;*/
+        dirty.mark(index);
+        tickVisited[index] = true;
+    }
 
-                                        tiles[(x - 1) + (y + 1) * width] = tile;
-                                        dirty[(x - 1) + (y + 1) * width] = true;
-                                        tickVisited[(x - 1) + (y + 1) * width] = true;
-                                    } else if(canMoveBelowR) {
-                                        if(tiles[(x + 1) + y * width].mat->physicsType == PhysicsType::AIR) {
-                                            tiles[(x + 1) + y * width] = belowRTile;
-                                            dirty[(x + 1) + y * width] = true;
-                                            tiles[index] = Tiles_NOTHING;
-                                            dirty[index] = true;
-                                        } else {
-                                            tiles[index] = belowRTile;
-                                            dirty[index] = true;
-                                        }
+    // OLD:
 
-                                        tiles[(x + 1) + (y + 1) * width] = tile;
-                                        dirty[(x + 1) + (y + 1) * width] = true;
-                                        tickVisited[(x + 1) + (y + 1) * width] = true;
-                                    }
-                                }*/
-                                } else if (type == PhysicsType::GAS) {
-                                    // active[index] = true;
-                                    int aboveL = real_tiles[(x - 1) + (y - 1) * width].mat->physicsType;
-                                    int aboveR = real_tiles[(x + 1) + (y - 1) * width].mat->physicsType;
-
-                                    if (aboveL == 0 && !(aboveR == 0 && rand() % 2 == 0)) {
-                                        real_tiles[index] = real_tiles[(x - 1) + (y - 1) * width];
-                                        dirty[index] = true;
-
-                                        real_tiles[(x - 1) + (y - 1) * width] = tile;
-                                        dirty[(x - 1) + (y - 1) * width] = true;
-                                        tickVisited[(x - 1) + (y - 1) * width] = true;
-                                    } else if (aboveR == 0) {
-                                        real_tiles[index] = real_tiles[(x + 1) + (y - 1) * width];
-                                        dirty[index] = true;
-
-                                        real_tiles[(x + 1) + (y - 1) * width] = tile;
-                                        dirty[(x + 1) + (y - 1) * width] = true;
-                                        tickVisited[(x + 1) + (y - 1) * width] = true;
-                                    }
+    // active[index] = true;
+    /*MaterialInstance belowLTile = tiles[(x - 1) + (y + 1) * width];
+int belowL = belowLTile.mat->physicsType;
+MaterialInstance belowRTile = tiles[(x + 1) + (y + 1) * width];
+int belowR = belowRTile.mat->physicsType;
+
+bool canMoveBelowL = (belowL == PhysicsType::AIR || (belowL != PhysicsType::SOLID && belowLTile.mat->density < tile.mat->density));
+bool canMoveBelowR = (belowR == PhysicsType::AIR || (belowR != PhysicsType::SOLID && belowRTile.mat->density < tile.mat->density));
+
+if(!(canMoveBelowL || canMoveBelowR)) continue;
+
+MaterialInstance lTile = tiles[(x - 1) + (y)* width];
+int l = lTile.mat->physicsType;
+MaterialInstance rTile = tiles[(x + 1) + (y)* width];
+int r = rTile.mat->physicsType;
+
+bool canMoveL = (l == PhysicsType::AIR || (l != PhysicsType::SOLID && lTile.mat->density < tile.mat->density));
+bool canMoveR = (r == PhysicsType::AIR || (r != PhysicsType::SOLID && rTile.mat->density < tile.mat->density));
+
+if(!((canMoveL || canMoveR) && rng.next() % 10 == 0)) {
+    if(canMoveBelowL && !(canMoveBelowR && rng.next() % 2 == 0)) {
+        if(tiles[(x - 1) + y * width].mat->physicsType == PhysicsType::AIR) {
+            tiles[(x - 1) + y * width] = belowLTile;
+            dirty.mark((x - 1) + y * width);
+            tiles[index] = Tiles_NOTHING;
+            dirty.mark(index);
+        } else {
+            tiles[index] = belowLTile;
+            dirty.mark(index);
+        }
+
+        tiles[(x - 1) + (y + 1) * width] = tile;
+        dirty.mark((x - 1) + (y + 1) * width);
+        tickVisited[(x - 1) + (y + 1) * width] = true;
+    } else if(canMoveBelowR) {
+        if(tiles[(x + 1) + y * width].mat->physicsType == PhysicsType::AIR) {
+            tiles[(x + 1) + y * width] = belowRTile;
+            dirty.mark((x + 1) + y * width);
+            tiles[index] = Tiles_NOTHING;
+            dirty.mark(index);
+        } else {
+            tiles[index] = belowRTile;
+            dirty.mark(index);
+        }
+
+        tiles[(x + 1) + (y + 1) * width] = tile;
+        dirty.mark((x + 1) + (y + 1) * width);
+        tickVisited[(x + 1) + (y + 1) * width] = true;
+    }
+}*/
+}
+
+// 第二遍: 斜向上升
+template <>
+void world::tickCell<1, PhysicsType::GAS>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    const MaterialTable &mt = GAME()->materials_table;
+
+    // active[index] = true;
+    int aboveL = mt.physicsType[real_tiles[(x - 1) + (y - 1) * width].id()];
+    int aboveR = mt.physicsType[real_tiles[(x + 1) + (y - 1) * width].id()];
+
+    if (aboveL == 0 && !(aboveR == 0 && rng.next() % 2 == 0)) {
+        real_tiles[index] = real_tiles[(x - 1) + (y - 1) * width];
+        dirty.mark(index);
+
+        real_tiles[(x - 1) + (y - 1) * width] = tile;
+        dirty.mark((x - 1) + (y - 1) * width);
+        tickVisited[(x - 1) + (y - 1) * width] = true;
+    } else if (aboveR == 0) {
+        real_tiles[index] = real_tiles[(x + 1) + (y - 1) * width];
+        dirty.mark(index);
+
+        real_tiles[(x + 1) + (y - 1) * width] = tile;
+        dirty.mark((x + 1) + (y - 1) * width);
+        tickVisited[(x + 1) + (y - 1) * width] = true;
+    }
+}
+
+// 第三遍: 横向扩散 水蒸气凝结
+template <>
+void world::tickCell<2, PhysicsType::GAS>(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts) {
+    const MaterialTable &mt = GAME()->materials_table;
+
+    // active[index] = true;
+
+    int l = mt.physicsType[real_tiles[(x - 1) + (y)*width].id()];
+    int r = mt.physicsType[real_tiles[(x + 1) + (y)*width].id()];
+
+    if (l == 0 && !(r == 0 && rng.next() % 2 == 0)) {
+        real_tiles[index] = getTile(x - 1, y);
+        dirty.mark(index);
+
+        real_tiles[(x - 1) + (y)*width] = tile;
+        dirty.mark((x - 1) + (y)*width);
+        tickVisited[(x - 1) + (y)*width] = true;
+    } else if (r == 0) {
+        real_tiles[index] = getTile(x + 1, y);
+        dirty.mark(index);
+
+        real_tiles[(x + 1) + (y)*width] = tile;
+        dirty.mark((x + 1) + (y)*width);
+        tickVisited[(x + 1) + (y)*width] = true;
+    } else {
+        if (tile.mat->id == GAME()->materials_list.STEAM.id) {
+            if (rng.next() % 10 == 0) {
+                real_tiles[index] = TilesCreateWater();
+                dirty.mark(index);
+            }
+        }
+    }
+}
+
+void world::tick() {
+
+    const MaterialTable &mt = GAME()->materials_table;
+
+    // 上一帧排队的爆炸 (连锁爆炸等) 合并成一批处理
+    if (!pendingExplosions.empty()) {
+        explosions(pendingExplosions);
+        pendingExplosions.clear();
+    }
+
+    // 上次清除 dirty 之后的写入
+    collectActiveRegions();
+
+    // 区域自身或八邻域有改变则保持唤醒 否则倒计时进入休眠
+    for (int ry = 0; ry < activeRegionsY; ry++) {
+        for (int rx = 0; rx < activeRegionsX; rx++) {
+            bool changed = false;
+            for (int yy = std::max(ry - 1, 0); yy <= std::min(ry + 1, activeRegionsY - 1) && !changed; yy++) {
+                for (int xx = std::max(rx - 1, 0); xx <= std::min(rx + 1, activeRegionsX - 1); xx++) {
+                    if (lastActive[xx + yy * activeRegionsX].load(std::memory_order_relaxed)) {
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+            u8 &timer = active[rx + ry * activeRegionsX];
+            if (changed) {
+                timer = ACTIVE_REGION_SLEEP_TICKS;
+            } else if (timer > 0) {
+                timer--;
+            }
+        }
+    }
+    for (size_t r = 0, n = (size_t)activeRegionsX * activeRegionsY; r < n; r++) lastActive[r].store(false, std::memory_order_relaxed);
+
+    // 有关注区域时 不在到期区域内的区块这一 tick 不模拟
+    interests.plan(tickZone, (u64)tickCt, (u32)std::max(global.game->Iso.globaldef.interest_background_interval, 0));
+
+    // GPU 模拟的材料 CPU 的各遍直接跳过
+    const bool gpuTick = global.game->Iso.globaldef.gpu_cell_sim && gpuCells.ready();
+    if (gpuTick) gpuCells.update_materials(mt, GAME()->materials_list.FIRE.id);
+
+    // 连通的液体整体整平之后 SOUP 的逐像素规则只需要很少的遍数
+    const bool liquidLevel = global.game->Iso.globaldef.liquid_level_solver;
+    if (liquidLevel && tickCt % LIQUID_LEVEL_TICKS == 0) levelLiquidBodies();
+    auto iterationsOf = [&](mat_id id) {
+        const int n = mt.iterations[id];
+        return liquidLevel && mt.physicsType[id] == PhysicsType::SOUP ? std::min(n, LIQUID_SURFACE_ITERATIONS) : n;
+    };
+
+    auto isChunkAwake = [&](int cx, int cy) {
+        for (int y = cy; y < cy + CHUNK_H; y += ACTIVE_REGION_SIZE) {
+            for (int x = cx; x < cx + CHUNK_W; x += ACTIVE_REGION_SIZE) {
+                if (isRegionAwake(x, y)) return true;
+            }
+        }
+        return false;
+    };
+
+// TODO: 如果我们只检查最后标记为dirty的tiles会怎么样
+
+// #define DO_REVERSE
+#define DO_MULTITHREADING 1
+
+    // 第一遍时记下每个区块中材料 iterations 的最大值 之后的第 iter 遍只调度自身或相邻区块需要这么多遍的区块
+    // 一个 tick 内像素可能移动到相邻区块 所以连同八邻域一起判断
+    const int tickChunksX = ((int)tickZone.w + CHUNK_W - 1) / CHUNK_W;
+    const int tickChunksY = ((int)tickZone.h + CHUNK_H - 1) / CHUNK_H;
+    tickChunkIterations.assign((size_t)tickChunksX * tickChunksY, 0);
+    tickActivity.assign((size_t)tickChunksX * tickChunksY, ChunkActivity{});
+    tickActivityChunksX = tickChunksX;
+    const mat_id waterId = GAME()->materials_list.WATER.id;
+    const mat_id lavaId = GAME()->materials_list.LAVA.id;
+    int tickMaxIterations = 0;
+
+    auto chunkSlot = [&](int cx, int cy) { return (cx - (int)tickZone.x) / CHUNK_W + (cy - (int)tickZone.y) / CHUNK_H * tickChunksX; };
+    auto chunkNeedsIter = [&](int cx, int cy, int iter) {
+        if (iter == 0) return true;
+        const int bx = (cx - (int)tickZone.x) / CHUNK_W;
+        const int by = (cy - (int)tickZone.y) / CHUNK_H;
+        for (int yy = std::max(by - 1, 0); yy <= std::min(by + 1, tickChunksY - 1); yy++) {
+            for (int xx = std::max(bx - 1, 0); xx <= std::min(bx + 1, tickChunksX - 1); xx++) {
+                if (tickChunkIterations[xx + yy * tickChunksX] > iter) return true;
+            }
+        }
+        return false;
+    };
+
+    for (int iter = 0; iter < global.game->Iso.globaldef.cell_iter; iter++) {
+
+        // 所有区块都不需要更多遍数
+        if (iter > 0 && iter >= tickMaxIterations) break;
+
+#ifdef DO_REVERSE
+        bool reverseX = (tickCt + iter) % 2 == 0;
+#else
+        bool reverseX = false;
+#endif
+        for (int tk = 0; tk < 4; tk++) {
+
+            int chOfsX = tk % 2;              // 0 1 0 1
+            int chOfsY = 1 - ((tk % 4) / 2);  // 1 1 0 0
+
+            // 每个阶段的标记互不影响
+            tickVisited.next();
+
+#if DO_MULTITHREADING
+            // 整个区块都在休眠 不用派发任务
+            tickPhaseChunks.clear();
+            for (int cx = tickZone.x + chOfsX * CHUNK_W; cx < (tickZone.x + tickZone.w); cx += CHUNK_W * 2) {
+                for (int cy = tickZone.y + chOfsY * CHUNK_H; cy < (tickZone.y + tickZone.h); cy += CHUNK_H * 2) {
+                    if (chunkNeedsIter(cx, cy, iter) && interests.due_at(cx, cy) && partition.owns_at(*this, cx + CHUNK_W / 2, cy + CHUNK_H / 2) && isChunkAwake(cx, cy)) tickPhaseChunks.emplace_back(cx, cy);
+                }
+            }
+
+            // 一个阶段只派发一批任务 只有一次屏障 整个过程不分配内存
+            // 生成的 CellData 写入各 worker 自己的缓冲区
+            const uint32_t numChunks = (uint32_t)tickPhaseChunks.size();
+            job::parallel_for(numChunks, 1, [&](uint32_t task) {
+                ME_profiler_scope_auto("TickChunk");
+                const int cx = tickPhaseChunks[task].first;
+                const int cy = tickPhaseChunks[task].second;
+                std::vector<CellData> &parts = tickSpawnedCells.local();
+                // 按区块的世界坐标和阶段取种子 结果与任务分到哪个 worker 无关
+                FastRNG rng(RNG_Mix(RNG_Mix(simSeed, ((u64)tickCt << 32) | (u64)(iter * 4 + tk)), ((u64)(u32)(cx - (int)loadZone.x) << 32) | (u32)(cy - (int)loadZone.y)));
+                i32 chunkIterations = 0;
+                u32 cellsTicked = 0;
+                ChunkActivity activity{};
+                const u64 costStart = ME_profiler_get_clock();
+                const size_t partsBefore = parts.size();
+#else
+            std::vector<CellData> &parts = tickSpawnedCells.local();
+
+            for (int cx = tickZone.x + chOfsX * CHUNK_W; cx < (tickZone.x + tickZone.w); cx += CHUNK_W * 2) {
+                for (int cy = tickZone.y + chOfsY * CHUNK_H; cy < (tickZone.y + tickZone.h); cy += CHUNK_H * 2) {
+
+                    if (!chunkNeedsIter(cx, cy, iter) || !interests.due_at(cx, cy) || !partition.owns_at(*this, cx + CHUNK_W / 2, cy + CHUNK_H / 2) || !isChunkAwake(cx, cy)) continue;
+                    FastRNG rng(RNG_Mix(RNG_Mix(simSeed, ((u64)tickCt << 32) | (u64)(iter * 4 + tk)), ((u64)(u32)(cx - (int)loadZone.x) << 32) | (u32)(cy - (int)loadZone.y)));
+                    i32 chunkIterations = 0;
+                    u32 cellsTicked = 0;
+                    ChunkActivity activity{};
+                    const u64 costStart = ME_profiler_get_clock();
+                    const size_t partsBefore = parts.size();
+#endif
+
+                        for (int dy = CHUNK_H - 1; dy >= 0; dy--) {
+                            int y = cy + dy;
+                            bool regionAwake = true;
+                            for (int dxf = 0; dxf < CHUNK_W; dxf++) {
+                                int dx = reverseX ? (CHUNK_W - 1) - dxf : dxf;
+                                int x = cx + dx;
+                                int index = x + y * width;
+
+                                // 跳过休眠区域内的整段像素
+                                if (dxf == 0 || (x & (ACTIVE_REGION_SIZE - 1)) == (reverseX ? ACTIVE_REGION_SIZE - 1 : 0)) regionAwake = isRegionAwake(x, y);
+                                if (!regionAwake) continue;
+
+                                const mat_id id = real_tiles[index].id();
+                                const int iterations = iterationsOf(id);
+                                if (iter == 0) chunkIterations = std::max(chunkIterations, iterations);
+
+                                if (tickVisited[index]) continue;
+                                if (gpuTick && gpuCells.handles(id)) continue;
+
+                                if (iter >= iterations) {
+                                    tickVisited[index] = true;
+                                    continue;
+                                }
+
+                                const int type = mt.physicsType[id];
+                                const bool fire = id == GAME()->materials_list.FIRE.id;
+                                if (!fire && type != PhysicsType::SAND && type != PhysicsType::SOUP && type != PhysicsType::GAS) continue;
+
+                                MaterialInstance tile = real_tiles[index];
+                                cellsTicked++;
+
+                                if (fire) {
+                                    tickFireCell(x, y, index, tile, iter, rng, parts);
+                                    activity.fire++;
+                                }
+
+                                switch (type) {
+                                    case PhysicsType::SAND:
+                                        tickCell<0, PhysicsType::SAND>(x, y, index, tile, iter, rng, parts);
+                                        break;
+                                    case PhysicsType::SOUP:
+                                        tickCell<0, PhysicsType::SOUP>(x, y, index, tile, iter, rng, parts);
+                                        // 原位置换成了别的材料 这个像素流动了
+                                        if (real_tiles[index].id() != id) {
+                                            if (id == waterId) activity.water++;
+                                            else if (id == lavaId) activity.lava++;
+                                        }
+                                        break;
+                                    case PhysicsType::GAS:
+                                        tickCell<0, PhysicsType::GAS>(x, y, index, tile, iter, rng, parts);
+                                        break;
                                 }
                             }
                         }
 
                         for (int dy = CHUNK_H - 1; dy >= 0; dy--) {
                             int y = cy + dy;
+                            bool regionAwake = true;
                             for (int dxf = 0; dxf < CHUNK_W; dxf++) {
                                 int dx = reverseX ? (CHUNK_W - 1) - dxf : dxf;
                                 int x = cx + dx;
                                 int index = x + y * width;
 
+                                // 跳过休眠区域内的整段像素
+                                if (dxf == 0 || (x & (ACTIVE_REGION_SIZE - 1)) == (reverseX ? ACTIVE_REGION_SIZE - 1 : 0)) regionAwake = isRegionAwake(x, y);
+                                if (!regionAwake) continue;
+
                                 if (tickVisited[index]) continue;
 
+                                // 这一遍只处理 SAND/SOUP/GAS 先按 id 查表 其它像素不需要取出整个 MaterialInstance
+                                const mat_id id = real_tiles[index].id();
+                                if (gpuTick && gpuCells.handles(id)) continue;
+                                const int type = mt.physicsType[id];
+                                if (type != PhysicsType::SAND && type != PhysicsType::SOUP && type != PhysicsType::GAS) continue;
+
                                 MaterialInstance tile = real_tiles[index];
+                                cellsTicked++;
 
-                                int type = tile.mat->physicsType;
-
-                                if (type == PhysicsType::SOUP) {
-                                    // active[index] = true;
-
-                                    /*MaterialInstance lTile = tiles[(x - 1) + (y)* width];
-                                int l = lTile.mat->physicsType;
-                                MaterialInstance rTile = tiles[(x + 1) + (y)* width];
-                                int r = rTile.mat->physicsType;
-
-                                bool canMoveL = (l == PhysicsType::AIR || (l != PhysicsType::SOLID && lTile.mat->density < tile.mat->density));
-                                bool canMoveR = (r == PhysicsType::AIR || (r != PhysicsType::SOLID && rTile.mat->density < tile.mat->density));
-
-                                if(canMoveL && !(canMoveR && rand() % 2 == 5)) {
-                                    tiles[index] = lTile;
-                                    dirty[index] = true;
-
-                                    tiles[(x - 1) + (y)* width] = tile;
-                                    dirty[(x - 1) + (y)* width] = true;
-                                    tickVisited[(x - 1) + (y)* width] = true;
-                                } else if(canMoveR) {
-                                    tiles[index] = rTile;
-                                    dirty[index] = true;
-
-                                    tiles[(x + 1) + (y)* width] = tile;
-                                    dirty[(x + 1) + (y)* width] = true;
-                                    tickVisited[(x + 1) + (y)* width] = true;
-                                }*/
-                                } else if (type == PhysicsType::GAS) {
-                                    // active[index] = true;
-
-                                    int l = real_tiles[(x - 1) + (y)*width].mat->physicsType;
-                                    int r = real_tiles[(x + 1) + (y)*width].mat->physicsType;
-
-                                    if (l == 0 && !(r == 0 && rand() % 2 == 0)) {
-                                        real_tiles[index] = getTile(x - 1, y);
-                                        dirty[index] = true;
-
-                                        real_tiles[(x - 1) + (y)*width] = tile;
-                                        dirty[(x - 1) + (y)*width] = true;
-                                        tickVisited[(x - 1) + (y)*width] = true;
-                                    } else if (r == 0) {
-                                        real_tiles[index] = getTile(x + 1, y);
-                                        dirty[index] = true;
-
-                                        real_tiles[(x + 1) + (y)*width] = tile;
-                                        dirty[(x + 1) + (y)*width] = true;
-                                        tickVisited[(x + 1) + (y)*width] = true;
-                                    } else {
-                                        if (tile.mat->id == GAME()->materials_list.STEAM.id) {
-                                            if (rand() % 10 == 0) {
-                                                real_tiles[index] = TilesCreateWater();
-                                                dirty[index] = true;
-                                            }
-                                        }
-                                    }
+                                switch (type) {
+                                    case PhysicsType::SAND:
+                                        tickCell<1, PhysicsType::SAND>(x, y, index, tile, iter, rng, parts);
+                                        break;
+                                    case PhysicsType::SOUP:
+                                        tickCell<1, PhysicsType::SOUP>(x, y, index, tile, iter, rng, parts);
+                                        break;
+                                    case PhysicsType::GAS:
+                                        tickCell<1, PhysicsType::GAS>(x, y, index, tile, iter, rng, parts);
+                                        break;
                                 }
                             }
                         }
 
-#if DO_MULTITHREADING
-                        return parts;
-                    }));
-#endif
-                }
-            }
+                        for (int dy = CHUNK_H - 1; dy >= 0; dy--) {
+                            int y = cy + dy;
+                            bool regionAwake = true;
+                            for (int dxf = 0; dxf < CHUNK_W; dxf++) {
+                                int dx = reverseX ? (CHUNK_W - 1) - dxf : dxf;
+                                int x = cx + dx;
+                                int index = x + y * width;
 
-#if DO_MULTITHREADING
+                                // 跳过休眠区域内的整段像素
+                                if (dxf == 0 || (x & (ACTIVE_REGION_SIZE - 1)) == (reverseX ? ACTIVE_REGION_SIZE - 1 : 0)) regionAwake = isRegionAwake(x, y);
+                                if (!regionAwake) continue;
 
-            for (int i = 0; i < results.size(); i++) {
+                                if (tickVisited[index]) continue;
 
-                std::vector<CellData *> pts = results[i].get();
+                                // 这一遍只有 GAS 会移动
+                                const mat_id id = real_tiles[index].id();
+                                if (mt.physicsType[id] != PhysicsType::GAS || (gpuTick && gpuCells.handles(id))) continue;
 
-                cells.insert(cells.end(), pts.begin(), pts.end());
-            }
-            tickVisitedDone.get();
+                                MaterialInstance tile = real_tiles[index];
+                                cellsTicked++;
+                                tickCell<2, PhysicsType::GAS>(x, y, index, tile, iter, rng, parts);
+                            }
+                        }
 
-            whichTickVisited = !whichTickVisited;
+                        // 每个区块在一个阶段中只出现一次 不会同时写
+                        if (iter == 0) tickChunkIterations[chunkSlot(cx, cy)] = (u8)std::min(chunkIterations, 255);
+                        ChunkActivity &a = tickActivity[chunkSlot(cx, cy)];
+                        a.water += activity.water;
+                        a.lava += activity.lava;
+                        a.fire += activity.fire;
+                        a.cells += cellsTicked;
+                        a.particles += (u32)(parts.size() - partsBefore);
+                        a.clocks += ME_profiler_get_clock() - costStart;
 
+                        ME_profiler_count("cells ticked", cellsTicked);
+                        ME_profiler_count("chunks ticked", 1);
+
+#if DO_MULTITHREADING
+            });
+#else
+                }
+            }
 #endif
 
-            // while (tickPool->n_idle() != tickPool->size()) {
-            //  //printf("%d / %d", tickPool->n_idle(), tickPool->size());
-            //  auto n = tickPool->n_idle();
-            //  auto i = 0;
-            // }
+            tickSpawnedCells.for_each([&](std::vector<CellData> &pts) {
+                for (const CellData &c : pts) cells.push(c);
+                pts.clear();
+            });
+        }
+
+        if (iter == 0) {
+            for (u8 n : tickChunkIterations) tickMaxIterations = std::max(tickMaxIterations, (int)n);
         }
     }
 
@@ -1924,295 +2016,796 @@ void world::tick() {
 #undef DO_MULTITHREADING
 #undef DO_REVERSE
 
+    tickChunkCosts();
+
+    if (gpuTick) {
+        static_assert(GpuCellSim::REGION_SIZE == ACTIVE_REGION_SIZE, "gpuCellRegions uses the sleep regions");
+        const int rx = (int)tickZone.w / ACTIVE_REGION_SIZE;
+        const int ry = (int)tickZone.h / ACTIVE_REGION_SIZE;
+        gpuCellRegions.assign((size_t)rx * ry, 0);
+        for (int ry0 = 0; ry0 < ry; ry0++) {
+            for (int rx0 = 0; rx0 < rx; rx0++) {
+                const int x = (int)tickZone.x + rx0 * ACTIVE_REGION_SIZE;
+                const int y = (int)tickZone.y + ry0 * ACTIVE_REGION_SIZE;
+                gpuCellRegions[rx0 + ry0 * rx] = isRegionAwake(x, y) && interests.due_at(x, y) && partition.owns_at(*this, x + ACTIVE_REGION_SIZE / 2, y + ACTIVE_REGION_SIZE / 2);
+            }
+        }
+        gpuCells.tick(real_tiles, dirty, width, (int)tickZone.x, (int)tickZone.y, (int)tickZone.w, (int)tickZone.h, gpuCellRegions, (u32)RNG_Mix(simSeed, (u64)tickCt));
+    }
+
+    tickScriptMaterials();
+
     tickCt++;
 
-    for (int i = 0; i < 1; i++) {
-        int randX = rand() % (int)tickZone.w;
-        int randY = rand() % (int)tickZone.h;
+    std::vector<std::pair<int, int>> probes;
+    FastRNG probeRng(RNG_Mix(simSeed, (u64)tickCt));
+    for (int i = 0; i < PHYSICS_CHECK_PROBES; i++) {
+        int randX = probeRng.next() % (int)tickZone.w;
+        int randY = probeRng.next() % (int)tickZone.h;
         // setTile(tickZone.x + randX, tickZone.y + randY, MaterialInstance(&Materials::GENERIC_SOLID, 0x00ff00ff));
-        physicsCheck(tickZone.x + randX, tickZone.y + randY);
+        probes.emplace_back(tickZone.x + randX, tickZone.y + randY);
     }
+    physicsCheck(probes);
+
+    if (global.game->Iso.globaldef.tick_checksum) computeTickChecksum();
 
     /*delete lastActive;
 lastActive = active;
 active = new bool[width * height];*/
+}
+
+Chunk *world::tickActivityChunk(size_t i) {
+    const int cx = (int)tickZone.x + (int)(i % tickActivityChunksX) * CHUNK_W;
+    const int cy = (int)tickZone.y + (int)(i / tickActivityChunksX) * CHUNK_H;
+    return peekChunk((int)std::floor((cx - loadZone.x) / CHUNK_W), (int)std::floor((cy - loadZone.y) / CHUNK_H));
+}
+
+void world::tickChunkCosts() {
+    ME_profiler_scope_auto("TickChunkCosts");
+    // 指数平均的权重 大约反映最近 16 个 tick
+    constexpr f32 k = 1.0f / 16;
+    const f32 clockMs = 1000.0f / (f32)profiler_get_clock_frequency();
+    for (size_t i = 0; i < tickActivity.size(); i++) {
+        Chunk *ch = tickActivityChunk(i);
+        if (!ch) continue;
+        // 这一 tick 没有派发任务的区块 (休眠 不归这个分区或不到间隔) 开销记为 0
+        const ChunkActivity &a = tickActivity[i];
+        Chunk::TickCost &c = ch->tickCost;
+        c.ms += (a.clocks * clockMs - c.ms) * k;
+        c.cells += (a.cells - c.cells) * k;
+        c.particles += (a.particles - c.particles) * k;
+        c.remesh += (ch->remeshes - c.remesh) * k;
+        ch->remeshes = 0;
+    }
+}
+
+void world::computeTickChecksum() {
+    ME_profiler_scope_auto("TickChecksum");
+
+    const int chunksX = (width + CHUNK_W - 1) / CHUNK_W;
+    const int chunksY = (height + CHUNK_H - 1) / CHUNK_H;
+    chunkHashes.resize((size_t)chunksX * chunksY);
+
+    job::parallel_for((u32)chunkHashes.size(), 1, [&](u32 t) {
+        const int x0 = (int)(t % chunksX) * CHUNK_W;
+        const int y0 = (int)(t / chunksX) * CHUNK_H;
+        const int w = std::min(CHUNK_W, (int)width - x0);
+        const int h = std::min(CHUNK_H, (int)height - y0);
+
+        // 种子取区块的绝对坐标 加载区移动之后同一个区块的哈希不变
+        u64 hash = RNG_Mix(((u64)(u32)(x0 - (int)loadZone.x) << 32) | (u32)(y0 - (int)loadZone.y));
+        for (int y = y0; y < y0 + h; y++) hash = real_tiles.hash_row((size_t)y * width + x0, (size_t)w, hash);
+        chunkHashes[t] = hash;
+    });
+
+    u64 hash = RNG_Mix((u64)(u32)tickCt);
+    for (u64 c : chunkHashes) hash = RNG_Mix(hash, c);
+    tickHash = hash;
+    stateHash = RNG_Mix(stateHash, hash);
+}
+
+void world::tickScriptMaterials() {
+    const MaterialTable &mt = GAME()->materials_table;
+    if (mt.scriptCount == 0) return;
+    scripting &sc = the<scripting>();
+    if (!sc.has_hooks(script_hook::MaterialBatch)) return;
+
+    ME_profiler_scope_auto("ScriptMaterials");
+
+    // 收集在 worker 上并行 每个区块一个批次 脚本只在主线程调用
+    tickPhaseChunks.clear();
+    for (int cx = tickZone.x; cx < (tickZone.x + tickZone.w); cx += CHUNK_W) {
+        for (int cy = tickZone.y; cy < (tickZone.y + tickZone.h); cy += CHUNK_H) tickPhaseChunks.emplace_back(cx, cy);
+    }
+    if (scriptBatches.size() < tickPhaseChunks.size()) scriptBatches.resize(tickPhaseChunks.size());
+
+    const uint32_t numChunks = (uint32_t)tickPhaseChunks.size();
+    job::parallel_for(numChunks, 1, [&](uint32_t task) {
+        const int cx = tickPhaseChunks[task].first;
+        const int cy = tickPhaseChunks[task].second;
+        ScriptBatch &b = scriptBatches[task];
+        b.cx = (int)std::floor((cx - loadZone.x) / (f32)CHUNK_W);
+        b.cy = (int)std::floor((cy - loadZone.y) / (f32)CHUNK_H);
+        b.cells.clear();
+        b.index.clear();
+
+        for (int y = cy; y < cy + CHUNK_H; y++) {
+            for (int x = cx; x < cx + CHUNK_W; x++) {
+                // 休眠区域整段跳过
+                if (!isRegionAwake(x, y)) {
+                    x |= ACTIVE_REGION_SIZE - 1;
+                    continue;
+                }
+                const u32 index = (u32)(x + y * width);
+                CellStore::Ref tile = real_tiles[index];
+                const mat_id id = tile.id();
+                if (!(mt.checks[id] & MaterialCheck_Script)) continue;
+                b.cells.push_back({x, y, id, tile.color(), tile.temperature()});
+                b.index.push_back(index);
+            }
+        }
+    });
+
+    for (uint32_t task = 0; task < numChunks; task++) {
+        ScriptBatch &b = scriptBatches[task];
+        if (b.cells.empty()) continue;
+
+        // 与收集时的值比较 只写回脚本改过的像素 脚本通过 setTile 等接口做的其它修改不会被覆盖
+        b.original = b.cells;
+        sc.run_hooks(script_hook::MaterialBatch, 4, [&](lua_State *L) {
+            lua_pushlightuserdata(L, b.cells.data());
+            lua_pushinteger(L, (lua_Integer)b.cells.size());
+            lua_pushinteger(L, b.cx);
+            lua_pushinteger(L, b.cy);
+        });
+
+        for (size_t i = 0; i < b.cells.size(); i++) {
+            const ScriptCell &c = b.cells[i];
+            const ScriptCell &o = b.original[i];
+            if (c.material == o.material && c.color == o.color && c.temperature == o.temperature) continue;
+            if (c.material >= mt.count) continue;
 
-    /*std::fill(light, light + width * height, 0);
-for (int x = 0; x < width; x++) {
-    for (int y = 0; y < height; y++) {
-        if (tiles[x + y * width].mat->physicsType == PhysicsType::AIR) {
-            applyLightRec(x, y, 1);
+            const u32 index = b.index[i];
+            const mat_temperature temperature = (mat_temperature)std::clamp(c.temperature, (i32)INT16_MIN, (i32)INT16_MAX);
+            if (c.material != o.material) {
+                real_tiles[index] = MaterialInstance(GAME()->materials_array[c.material], c.color, temperature);
+            } else {
+                CellStore::Ref tile = real_tiles[index];
+                tile.set_color(c.color);
+                tile.set_temperature(temperature);
+            }
+            dirty.mark(index);
         }
     }
-}*/
 }
 
 void world::tickTemperature() {
-    // TODO: multithread
-
-    for (int y = (tickZone.y + tickZone.h) - 1; y >= tickZone.y; y--) {
-        for (int x = tickZone.x; x < (tickZone.x + tickZone.w); x++) {
-            f32 n = 0.01;
-            f32 v = 0;
-            // for (int xx = -1; xx <= 1; xx++) {
-            //  for (int yy = -1; yy <= 1; yy++) {
-            //      f32 factor = abs(tiles[(x + xx) + (y + yy) * width].temperature) / 64 * tiles[(x + xx) + (y + yy) * width].mat->conductionOther;
-            //      //factor = fmax(-1, fmin(factor, 1));
-
-            //      v += tiles[(x + xx) + (y + yy) * width].temperature * factor;
-            //      n += factor;
-
-            //      // ((v1 * f1) + (v2 * f2)) / (f1 + f2)
-            //      //=(v1 * f1) + (v2 * f2)
-            //  }
-            //}
-            f32 factor = 0;
-#define FN(xa, ya)                                                                                                                             \
-    if (real_tiles[(x + xa) + (y + ya) * width].temperature != 0) {                                                                            \
-        factor = abs(real_tiles[(x + xa) + (y + ya) * width].temperature) / 64 * real_tiles[(x + xa) + (y + ya) * width].mat->conductionOther; \
-        v += real_tiles[(x + xa) + (y + ya) * width].temperature * factor;                                                                     \
-        n += factor;                                                                                                                           \
-    }
-            FN(-1, -1);
-            FN(-1, 0);
-            FN(-1, 1);
-            FN(0, -1);
-            FN(0, 0);
-            FN(0, 1);
-            FN(1, -1);
-            FN(1, 0);
-            FN(1, 1);
-
-#undef FN
-
-            if (v != 0) {
-                newTemps[x + y * width] = real_tiles[x + y * width].mat->addTemp + (v / n * real_tiles[x + y * width].mat->conductionSelf) +
-                                          (real_tiles[x + y * width].temperature * (1 - real_tiles[x + y * width].mat->conductionSelf));
-            } else {
-                newTemps[x + y * width] = real_tiles[x + y * width].mat->addTemp + real_tiles[x + y * width].temperature;
+    if (temperatureMaterials.size() != (size_t)GAME()->materials_count) {
+        temperatureMaterials.resize(GAME()->materials_count);
+        for (int id = 0; id < GAME()->materials_count; id++) {
+            Material *mat = GAME()->materials_array[id];
+            temperatureMaterials[id] = {mat->conductionOther, mat->conductionSelf, mat->addTemp};
+        }
+        temperatureTileCold.clear();
+    }
+
+    temperatureChangedRects.clear();
+
+    const int zx0 = tickZone.x, zy0 = tickZone.y;
+    const int zx1 = tickZone.x + tickZone.w, zy1 = tickZone.y + tickZone.h;
+    if (zx1 <= zx0 || zy1 <= zy0) return;
+
+    // 分块与世界坐标对齐
+    const int tx0 = zx0 / TEMPERATURE_TILE, ty0 = zy0 / TEMPERATURE_TILE;
+    const int tilesX = (zx1 - 1) / TEMPERATURE_TILE - tx0 + 1;
+    const int tilesY = (zy1 - 1) / TEMPERATURE_TILE - ty0 + 1;
+    const uint32_t tileCount = (uint32_t)(tilesX * tilesY);
+    if (tx0 != temperatureGridX || ty0 != temperatureGridY || tilesX != temperatureGridW || tilesY != temperatureGridH || temperatureTileCold.size() != tileCount) {
+        temperatureGridX = tx0;
+        temperatureGridY = ty0;
+        temperatureGridW = tilesX;
+        temperatureGridH = tilesY;
+        temperatureTileCold.assign(tileCount, 0);
+        temperatureTileChanged.assign(tileCount, 0);
+    }
+    std::swap(temperatureTileChanged, temperatureTilePrevChanged);
+    temperatureTileChanged.assign(tileCount, 0);
+
+    auto tileRect = [&](uint32_t t, int &x0, int &y0, int &x1, int &y1) {
+        int tx = tx0 + (int)t % tilesX, ty = ty0 + (int)t / tilesX;
+        x0 = std::max(zx0, tx * TEMPERATURE_TILE);
+        y0 = std::max(zy0, ty * TEMPERATURE_TILE);
+        x1 = std::min(zx1, (tx + 1) * TEMPERATURE_TILE);
+        y1 = std::min(zy1, (ty + 1) * TEMPERATURE_TILE);
+    };
+
+    // 冷的分块只有两种方式变热: 分块或一圈邻居中的像素被写入 (所在区域会被唤醒) 或者相邻分块上次写回了新的温度
+    auto tileWoken = [&](uint32_t t) {
+        const int tx = (int)t % tilesX, ty = (int)t / tilesX;
+        for (int ny = std::max(ty - 1, 0); ny <= std::min(ty + 1, tilesY - 1); ny++) {
+            for (int nx = std::max(tx - 1, 0); nx <= std::min(tx + 1, tilesX - 1); nx++) {
+                if (temperatureTilePrevChanged[nx + ny * tilesX]) return true;
             }
         }
+        int x0, y0, x1, y1;
+        tileRect(t, x0, y0, x1, y1);
+        const int rx0 = std::max(x0 - 1, 0) >> ACTIVE_REGION_SHIFT, rx1 = std::min(x1, (int)width - 1) >> ACTIVE_REGION_SHIFT;
+        const int ry0 = std::max(y0 - 1, 0) >> ACTIVE_REGION_SHIFT, ry1 = std::min(y1, (int)height - 1) >> ACTIVE_REGION_SHIFT;
+        for (int ry = ry0; ry <= ry1; ry++) {
+            for (int rx = rx0; rx <= rx1; rx++) {
+                const int r = rx + ry * activeRegionsX;
+                if (active[r] || lastActive[r].load(std::memory_order_relaxed)) return true;
+            }
+        }
+        return false;
+    };
+
+    temperatureTileRun.resize(tileCount);
+    u32 skipped = 0;
+    for (uint32_t t = 0; t < tileCount; t++) {
+        temperatureTileRun[t] = !temperatureTileCold[t] || tileWoken(t);
+        if (temperatureTileRun[t] && partition.enabled()) {
+            int x0, y0, x1, y1;
+            tileRect(t, x0, y0, x1, y1);
+            temperatureTileRun[t] = partition.owns_at(*this, (x0 + x1) / 2, (y0 + y1) / 2);
+        }
+        skipped += !temperatureTileRun[t];
+    }
+    ME_profiler_count("temperature tiles skipped", skipped);
+
+    // 先全部算出 newTemps 再写回 邻居读到的都是上一次的温度
+    job::parallel_for(tileCount, 1, [&](uint32_t t) {
+        if (!temperatureTileRun[t]) return;
+        ME_profiler_scope_auto("TickTemperatureTile");
+        int x0, y0, x1, y1;
+        tileRect(t, x0, y0, x1, y1);
+        bool cold = false;
+        temperatureTileChanged[t] = tickTemperatureTile(x0, y0, x1, y1, cold);
+        temperatureTileCold[t] = cold;
+    });
+
+    for (uint32_t t = 0; t < tileCount; t++) {
+        if (!temperatureTileChanged[t]) continue;
+        int x0, y0, x1, y1;
+        tileRect(t, x0, y0, x1, y1);
+        temperatureChangedRects.push_back({x0, y0, x1 - x0, y1 - y0});
     }
-    // iterate
 
-    for (int y = (tickZone.y + tickZone.h) - 1; y >= tickZone.y; y--) {
-        for (int x = tickZone.x; x < (tickZone.x + tickZone.w); x++) {
-            real_tiles[x + y * width].temperature = newTemps[x + y * width];
+    job::parallel_for(tileCount, 1, [&](uint32_t t) {
+        if (!temperatureTileChanged[t]) return;
+        int x0, y0, x1, y1;
+        tileRect(t, x0, y0, x1, y1);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                auto tile = real_tiles[x + y * width];
+                // 温度变化可能触发休眠区域内的反应
+                if (tile.mat()->react && tile.temperature() != newTemps[x + y * width]) {
+                    lastActive[(x >> ACTIVE_REGION_SHIFT) + (y >> ACTIVE_REGION_SHIFT) * activeRegionsX].store(true, std::memory_order_relaxed);
+                }
+                tile.set_temperature(newTemps[x + y * width]);
+            }
+        }
+    });
+}
+
+// 温度的 3x3 邻域和 x 为 [0, n) 的每个像素 vs 为 weighted 之和 ns 为 0.01 加 factor 之和
+// w/f 指向当前行 stride 为行距 各版本的累加顺序都是 xa 在外 ya 在内 结果逐位相同
+using temperature_sums_fn = void (*)(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns);
+
+static void temperature_sums_scalar(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns) {
+    for (int x = 0; x < n; x++) {
+        f32 sn = 0.01f;
+        f32 sv = 0;
+        for (int xa = -1; xa <= 1; xa++) {
+            for (int ya = -1; ya <= 1; ya++) {
+                const std::ptrdiff_t o = x + xa + ya * stride;
+                sv += w[o];
+                sn += f[o];
+            }
         }
+        vs[x] = sv;
+        ns[x] = sn;
     }
-    // copy
 }
 
-void world::renderCells(unsigned char **texture) {
+#if defined(ME_SIMD_X86)
+static void temperature_sums_sse2(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns) {
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128 sn = _mm_set1_ps(0.01f);
+        __m128 sv = _mm_setzero_ps();
+        for (int xa = -1; xa <= 1; xa++) {
+            for (int ya = -1; ya <= 1; ya++) {
+                const std::ptrdiff_t o = x + xa + ya * stride;
+                sv = _mm_add_ps(sv, _mm_loadu_ps(w + o));
+                sn = _mm_add_ps(sn, _mm_loadu_ps(f + o));
+            }
+        }
+        _mm_storeu_ps(vs + x, sv);
+        _mm_storeu_ps(ns + x, sn);
+    }
+    temperature_sums_scalar(w + x, f + x, stride, n - x, vs + x, ns + x);
+}
 
-    for (auto &cur : cells) {
-        if (cur->x < 0 || cur->x >= width || cur->y < 0 || cur->y >= height) continue;
+ME_TARGET_AVX2 static void temperature_sums_avx2(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns) {
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256 sn = _mm256_set1_ps(0.01f);
+        __m256 sv = _mm256_setzero_ps();
+        for (int xa = -1; xa <= 1; xa++) {
+            for (int ya = -1; ya <= 1; ya++) {
+                const std::ptrdiff_t o = x + xa + ya * stride;
+                sv = _mm256_add_ps(sv, _mm256_loadu_ps(w + o));
+                sn = _mm256_add_ps(sn, _mm256_loadu_ps(f + o));
+            }
+        }
+        _mm256_storeu_ps(vs + x, sv);
+        _mm256_storeu_ps(ns + x, sn);
+    }
+    temperature_sums_scalar(w + x, f + x, stride, n - x, vs + x, ns + x);
+}
 
-        f32 alphaMod = 1;
-        if (cur->temporary) {
-            if (cur->lifetime < cur->fadeTime) {
-                alphaMod = (cur->lifetime / (f32)cur->fadeTime);
+// 不足 16 个的部分用掩码读写
+ME_TARGET_AVX512 static void temperature_sums_avx512(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns) {
+    for (int x = 0; x < n; x += 16) {
+        const __mmask16 valid = n - x >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (n - x)) - 1);
+        __m512 sn = _mm512_set1_ps(0.01f);
+        __m512 sv = _mm512_setzero_ps();
+        for (int xa = -1; xa <= 1; xa++) {
+            for (int ya = -1; ya <= 1; ya++) {
+                const std::ptrdiff_t o = x + xa + ya * stride;
+                sv = _mm512_add_ps(sv, _mm512_maskz_loadu_ps(valid, w + o));
+                sn = _mm512_add_ps(sn, _mm512_maskz_loadu_ps(valid, f + o));
+            }
+        }
+        _mm512_mask_storeu_ps(vs + x, valid, sv);
+        _mm512_mask_storeu_ps(ns + x, valid, sn);
+    }
+}
+#elif defined(ME_SIMD_NEON)
+static void temperature_sums_neon(const f32 *w, const f32 *f, std::ptrdiff_t stride, int n, f32 *vs, f32 *ns) {
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        float32x4_t sn = vdupq_n_f32(0.01f);
+        float32x4_t sv = vdupq_n_f32(0);
+        for (int xa = -1; xa <= 1; xa++) {
+            for (int ya = -1; ya <= 1; ya++) {
+                const std::ptrdiff_t o = x + xa + ya * stride;
+                sv = vaddq_f32(sv, vld1q_f32(w + o));
+                sn = vaddq_f32(sn, vld1q_f32(f + o));
             }
         }
-        // f32 alphaMod = 1;
+        vst1q_f32(vs + x, sv);
+        vst1q_f32(ns + x, sn);
+    }
+    temperature_sums_scalar(w + x, f + x, stride, n - x, vs + x, ns + x);
+}
+#endif
 
-        const unsigned int offset = (width * 4 * (int)cur->y) + (int)cur->x * 4;
-        u32 color = cur->tile.color;
-        (*texture)[offset + 2] = (color >> 0) & 0xff;                    // b
-        (*texture)[offset + 1] = (color >> 8) & 0xff;                    // g
-        (*texture)[offset + 0] = (color >> 16) & 0xff;                   // r
-        (*texture)[offset + 3] = (u8)(cur->tile.mat->alpha * alphaMod);  // a
-        // SDL_SetRenderDrawColor(renderer, (cur->tile.color >> 16) & 0xff, (cur->tile.color >> 8) & 0xff, (cur->tile.color >> 0) & 0xff, (u8)(cur->tile.mat->alpha * alphaMod));
-        // SDL_RenderDrawPoint(renderer, (int)cur->x, (int)cur->y);
+static temperature_sums_fn select_temperature_sums(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+            return temperature_sums_avx512;
+        case simd_level::avx2:
+            return temperature_sums_avx2;
+        case simd_level::sse2:
+            return temperature_sums_sse2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return temperature_sums_neon;
+#endif
+        default:
+            return temperature_sums_scalar;
     }
 }
 
-void world::tickCells() {
+static simd_kernel<temperature_sums_fn> TemperatureSums{select_temperature_sums};
+
+bool world::tickTemperatureTile(int x0, int y0, int x1, int y1, bool &cold) {
+    TemperatureScratch &s = tickTemperatureScratch.local();
+
+    // 含一圈邻居的连续平面 世界之外的邻居当作 0 度 与 0 度像素一样不参与计算
+    const int hw = (x1 - x0) + 2, hh = (y1 - y0) + 2;
+    const size_t count = (size_t)hw * hh;
+    s.ids.resize(count);
+    s.temps.resize(count);
+    s.factor.resize(count);
+    s.weighted.resize(count);
+
+    constexpr int B = TEMPERATURE_BLOCK;
+    const int tw = x1 - x0, th = y1 - y0;
+    const int nbx = (tw + B - 1) / B, nby = (th + B - 1) / B;
+    const int bw = nbx + 2;
+    s.hotBlocks.assign((size_t)bw * (nby + 2), 0);
+
+    for (int hy = 0; hy < hh; hy++) {
+        const int y = y0 - 1 + hy;
+        u16 *ids = s.ids.data() + (size_t)hy * hw;
+        mat_temperature *temps = s.temps.data() + (size_t)hy * hw;
+        if (y < 0 || y >= height) {
+            std::fill(ids, ids + hw, (u16)0);
+            std::fill(temps, temps + hw, (mat_temperature)0);
+            continue;
+        }
+        const int rx0 = std::max(x0 - 1, 0), rx1 = std::min(x1 + 1, (int)width);
+        if (rx0 > x0 - 1) {
+            ids[0] = 0;
+            temps[0] = 0;
+        }
+        if (rx1 < x1 + 1) {
+            ids[hw - 1] = 0;
+            temps[hw - 1] = 0;
+        }
+        real_tiles.read_row((size_t)rx0 + (size_t)y * width, rx1 - rx0, ids + (rx0 - (x0 - 1)), temps + (rx0 - (x0 - 1)));
 
-    auto func = [&](CellData *cur) {
-        if (cur->temporary && cur->lifetime <= 0) {
-            cur->killCallback();
-            delete cur;
-            return true;
+        // 一圈邻居落在边上的小块里 (hx + B - 1) / B 把第 0 列映射到左侧的邻居小块
+        u8 *hot = s.hotBlocks.data() + (size_t)((hy + B - 1) / B) * bw;
+        for (int hx = 0; hx < hw; hx++) {
+            if (temps[hx] != 0 || temperatureMaterials[ids[hx]].addTemp != 0) hot[(hx + B - 1) / B] = 1;
+        }
+    }
+
+    // 全部为 0 度并且没有 addTemp 时温度不会改变
+    s.needBlocks.assign((size_t)nbx * nby, 0);
+    bool anyNeed = false;
+    for (int by = 0; by < nby; by++) {
+        for (int bx = 0; bx < nbx; bx++) {
+            u8 need = 0;
+            for (int ny = by; ny <= by + 2; ny++) need |= s.hotBlocks[bx + ny * bw] | s.hotBlocks[bx + 1 + ny * bw] | s.hotBlocks[bx + 2 + ny * bw];
+            s.needBlocks[bx + by * nbx] = need;
+            anyNeed |= need != 0;
         }
+    }
+    cold = !anyNeed;
+    if (!anyNeed) return false;
+
+    for (size_t i = 0; i < count; i++) {
+        mat_temperature t = s.temps[i];
+        f32 factor = abs(t) / 64 * temperatureMaterials[s.ids[i]].conductionOther;
+        s.factor[i] = factor;
+        s.weighted[i] = t * factor;
+    }
+
+    const temperature_sums_fn sums = TemperatureSums.get();
+    s.sumV.resize(tw);
+    s.sumN.resize(tw);
+
+    bool changed = false;
+    for (int y = y0; y < y1; y++) {
+        const size_t row = (size_t)(y - y0 + 1) * hw + 1;
+        const f32 *f = s.factor.data() + row;
+        const f32 *w = s.weighted.data() + row;
+        const mat_temperature *temps = s.temps.data() + row;
+        const u16 *ids = s.ids.data() + row;
+        const u8 *need = s.needBlocks.data() + (size_t)((y - y0) / B) * nbx;
+        i32 *out = newTemps + (size_t)y * width + x0;
+
+        for (int bx = 0; bx < nbx;) {
+            // 连续的一段需要或不需要计算的小块
+            const u8 run = need[bx];
+            int bx1 = bx + 1;
+            while (bx1 < nbx && need[bx1] == run) bx1++;
+            const int xs = bx * B, xe = std::min(bx1 * B, tw);
+            bx = bx1;
+            if (!run) {
+                // 整个小块都是 0 度 结果不变
+                std::fill(out + xs, out + xe, 0);
+                continue;
+            }
+
+            // 0 度像素的 factor 为 0 累加与跳过它的结果相同 累加顺序与原先的 FN(xa, ya) 展开一致
+            f32 *vs = s.sumV.data(), *ns = s.sumN.data();
+            sums(w + xs, f + xs, hw, xe - xs, vs + xs, ns + xs);
+            for (int x = xs; x < xe; x++) {
+                const TemperatureMaterial &m = temperatureMaterials[ids[x]];
+                const mat_temperature t = temps[x];
+                const f32 v = vs[x], n = ns[x];
+                i32 temp;
+                if (v != 0) {
+                    temp = m.addTemp + (v / n * m.conductionSelf) + (t * (1 - m.conductionSelf));
+                } else {
+                    temp = m.addTemp + t;
+                }
+                out[x] = temp;
+                changed |= temp != t;
+            }
+        }
+    }
+    return changed;
+}
 
-        if (cur->targetForce != 0) {
-            f32 tdx = cur->targetX - cur->x;
-            f32 tdy = cur->targetY - cur->y;
-            f32 normFac = sqrtf(tdx * tdx + tdy * tdy);
+void world::renderCells(unsigned char **texture) {
+
+    // 每个像素按 r g b a 打包成一个 u32 整体写入 两个 cell 在同一像素时哪个留下不确定 但不会写出混合的颜色
+    // pixelsCells 由 std::vector 分配 首地址满足 u32 对齐
+    u32 *pixels = (u32 *)*texture;
+    auto put = [pixels](size_t i, u32 color, u8 alpha) {
+        const u32 rgba = ((color >> 16) & 0xff) | (color & 0xff00) | ((color & 0xff) << 16) | ((u32)alpha << 24);
+        std::atomic_ref<u32>(pixels[i]).store(rgba, std::memory_order_relaxed);
+    };
 
-            cur->vx += tdx / normFac * cur->targetForce;
-            cur->vy += tdy / normFac * cur->targetForce;
+    const CellParticles &c = cells;
+    job::parallel_for((u32)c.size(), 1024, [&](u32 i) {
+        if (c.x[i] < 0 || c.x[i] >= width || c.y[i] < 0 || c.y[i] >= height) return;
 
-            if (normFac < 100) {
-                cur->vx *= 0.95f;
-                cur->vy *= 0.95f;
+        f32 alphaMod = 1;
+        if (c.temporary[i]) {
+            if (c.lifetime[i] < c.fadeTime[i]) {
+                alphaMod = (c.lifetime[i] / (f32)c.fadeTime[i]);
             }
         }
 
-        int lx = cur->x;
-        int ly = cur->y;
+        put((size_t)width * (int)c.y[i] + (int)c.x[i], c.color[i], (u8)(c.alpha[i] * alphaMod));
+    });
 
-        if ((cur->x < 0 || (int)(cur->x) >= width || cur->y < 0 || (int)(cur->y) >= height)) {
-            cur->killCallback();
-            return true;
+    // 液体粒子和 cells 画在同一张纹理上
+    if (liquidParticles && liquidParticles->GetParticleCount() > 0) {
+        const u32 *flags = liquidParticles->GetFlagsBuffer();
+        const b2Vec2 *pos = liquidParticles->GetPositionBuffer();
+        void **userData = liquidParticles->GetUserDataBuffer();
+        job::parallel_for((u32)liquidParticles->GetParticleCount(), 1024, [&](u32 i) {
+            if (flags[i] & b2_zombieParticle) return;
+            const int x = (int)pos[i].x;
+            const int y = (int)pos[i].y;
+            if (x < 0 || x >= width || y < 0 || y >= height) return;
+
+            const MaterialInstance &tile = liquidSlots[(uintptr_t)userData[i]].tile;
+            put((size_t)width * y + x, tile.color, tile.mat->alpha);
+        });
+    }
+}
+
+// 线段 (x0, y0) -> (x0 + dx, y0 + dy) 经过的像素 (Amanatides-Woo) 从起点所在的格开始 到终点所在的格为止
+// fn(cx, cy, t) 返回 true 时停下 t 为进入这一格时在线段上的比例
+template <typename F>
+static void forCellsOnSegment(f32 x0, f32 y0, f32 dx, f32 dy, F &&fn) {
+    int cx = (int)std::floor(x0);
+    int cy = (int)std::floor(y0);
+    if (fn(cx, cy, 0.0f)) return;
+
+    const int ex = (int)std::floor(x0 + dx);
+    const int ey = (int)std::floor(y0 + dy);
+    const int stepX = dx > 0 ? 1 : -1;
+    const int stepY = dy > 0 ? 1 : -1;
+    const f32 tDeltaX = dx != 0 ? std::abs(1.0f / dx) : FLT_MAX;
+    const f32 tDeltaY = dy != 0 ? std::abs(1.0f / dy) : FLT_MAX;
+    f32 tMaxX = dx != 0 ? ((f32)(stepX > 0 ? cx + 1 : cx) - x0) / dx : FLT_MAX;
+    f32 tMaxY = dy != 0 ? ((f32)(stepY > 0 ? cy + 1 : cy) - y0) / dy : FLT_MAX;
+
+    // 步数固定为起点到终点的曼哈顿距离 一个方向走到头后只走另一个方向 舍入误差不会走过头
+    for (int n = std::abs(ex - cx) + std::abs(ey - cy); n > 0; n--) {
+        f32 t;
+        if (cy == ey || (cx != ex && tMaxX < tMaxY)) {
+            cx += stepX;
+            t = tMaxX;
+            tMaxX += tDeltaX;
+        } else {
+            cy += stepY;
+            t = tMaxY;
+            tMaxY += tDeltaY;
         }
+        if (fn(cx, cy, std::min(t, 1.0f))) return;
+    }
+}
 
-        if (!(lx >= tickZone.x && ly >= tickZone.y && lx < tickZone.x + tickZone.w && ly < tickZone.y + tickZone.h)) return false;
+world::CellStep world::integrateCell(size_t p) {
+    CellParticles &c = cells;
+    CellStep step{CellAction_Keep, 0, (i32)c.x[p], (i32)c.y[p]};
 
-        cur->vx += cur->ax;
-        cur->vy += cur->ay;
+    if (c.temporary[p] && c.lifetime[p] <= 0) {
+        step.action = CellAction_Kill;
+        return step;
+    }
 
-        int div = (int)((abs(cur->vx) + abs(cur->vy)) + 1);
+    // 朝 target 的加速度已经由 tickCells 批量算好
 
-        f32 dvx = cur->vx / div;
-        f32 dvy = cur->vy / div;
+    int lx = step.lx;
+    int ly = step.ly;
 
-        for (int i = 0; i < div; i++) {
-            cur->x += dvx;
-            cur->y += dvy;
+    if ((c.x[p] < 0 || (int)(c.x[p]) >= width || c.y[p] < 0 || (int)(c.y[p]) >= height)) {
+        step.action = CellAction_Kill;
+        return step;
+    }
 
-            if ((cur->x < 0 || (int)(cur->x) >= width || cur->y < 0 || (int)(cur->y) >= height)) {
-                cur->killCallback();
-                return true;
+    if (!(lx >= tickZone.x && ly >= tickZone.y && lx < tickZone.x + tickZone.w && ly < tickZone.y + tickZone.h)) return step;
+
+    c.vx[p] += c.ax[p];
+    c.vy[p] += c.ay[p];
+
+    // 只访问这一 tick 经过的像素 不再按 |vx| + |vy| + 1 等分采样
+    // 起点所在的格也检查 原来的第一小步通常还停在这一格
+    const f32 sx = c.x[p];
+    const f32 sy = c.y[p];
+    const f32 mvx = c.vx[p];
+    const f32 mvy = c.vy[p];
+    bool stopped = false;
+    forCellsOnSegment(sx, sy, mvx, mvy, [&](int cx, int cy, f32 t) {
+        if (cx < 0 || cx >= width || cy < 0 || cy >= height) {
+            step.action = CellAction_Kill;
+            stopped = true;
+            return true;
+        }
+
+        if (c.phase[p]) return false;
+        const int type = real_tiles[cx + cy * width].mat()->physicsType;
+        if (type == PhysicsType::AIR) return false;
+        const bool isObject = type == PhysicsType::OBJECT;
+
+        switch (c.inObjectState[p]) {
+            case 0:  // first frame of particle's life
+                if (isObject) {
+                    c.inObjectState[p] = 1;
+                } else {
+                    c.inObjectState[p] = 2;
+                }
+                break;
+            case 1:  // particle spawned in object and was in object last tick
+                if (!isObject) c.inObjectState[p] = 2;
+                break;
+        }
+
+        if (!isObject || c.inObjectState[p] == 2) {
+            if (isObject) step.owner = objectOwner[cx + cy * width];
+
+            // 停在进入这一格的位置 写回世界留给 depositCell
+            if (t > 0) {
+                c.x[p] = std::clamp(sx + t * mvx, (f32)cx, std::nextafter((f32)(cx + 1), (f32)cx));
+                c.y[p] = std::clamp(sy + t * mvy, (f32)cy, std::nextafter((f32)(cy + 1), (f32)cy));
             }
+            step.action = c.temporary[p] ? CellAction_Kill : CellAction_Deposit;
+            stopped = true;
+            return true;
+        }
+        return false;
+    });
+    if (stopped) return step;
 
-            if (!cur->phase && real_tiles[(int)(cur->x) + (int)(cur->y) * width].mat->physicsType != PhysicsType::AIR) {
-                bool allowCollision = true;
-                bool isObject = real_tiles[(int)(cur->x) + (int)(cur->y) * width].mat->physicsType == PhysicsType::OBJECT;
+    c.x[p] = sx + mvx;
+    c.y[p] = sy + mvy;
 
-                switch (cur->inObjectState) {
-                    case 0:  // first frame of particle's life
-                        if (isObject) {
-                            cur->inObjectState = 1;
-                        } else {
-                            cur->inObjectState = 2;
-                        }
-                        break;
-                    case 1:  // particle spawned in object and was in object last tick
-                        if (!isObject) cur->inObjectState = 2;
-                        break;
-                }
+    if (c.lifetime[p] > 0) {
+        c.lifetime[p]--;
+    }
 
-                if (!isObject || cur->inObjectState == 2) {
-                    if (cur->temporary) {
-                        cur->killCallback();
-                        delete cur;
-                        return true;
-                    }
+    if (c.y[p] > height) step.action = CellAction_Kill;
+    return step;
+}
 
-                    if (real_tiles[(int)(lx) + (int)(ly)*width].mat->physicsType != PhysicsType::AIR) {
-                        /*for (int y = 0; y < 40; y++) {
-                            if (tiles[(int)(cur->x) + (int)(cur->y - y) * width].mat->physicsType == PhysicsType::AIR) {
-                                tiles[(int)(cur->x) + (int)(cur->y - y) * width] = cur->tile;
-                                dirty[(int)(cur->x) + (int)(cur->y - y) * width] = true;
-                                break;
-                            }
-                        }*/
-
-                        bool succeeded = false;
-                        {
-                            // printf("=========");
-                            int X = 32;
-                            int Y = 32;
-                            int x = 0, y = 0, dx = 0, dy = -1;
-                            int t = std::max(X, Y);
-                            int maxI = t * t;
-
-                            for (int j = 0; j < maxI; j++) {
-                                if ((-X / 2 <= x) && (x <= X / 2) && (-Y / 2 <= y) && (y <= Y / 2)) {
-                                    // printf("%d, %d", x, y);
-                                    // DO STUFF
-                                    if (real_tiles[(int)(cur->x + x) + (int)(cur->y + y) * width].mat->physicsType == PhysicsType::AIR) {
-                                        real_tiles[(int)(cur->x + x) + (int)(cur->y + y) * width] = cur->tile;
-                                        dirty[(int)(cur->x + x) + (int)(cur->y + y) * width] = true;
-                                        succeeded = true;
-                                        break;
-                                    } else if (cur->tile.mat->physicsType == PhysicsType::SOUP && cur->tile.mat == real_tiles[(int)(cur->x + x) + (int)(cur->y + y) * width].mat) {
+bool world::depositCell(size_t p, i32 lx, i32 ly) {
+    CellParticles &c = cells;
 
-                                        real_tiles[(int)(cur->x + x) + (int)(cur->y + y) * width].fluidAmount += cur->tile.fluidAmount;
-                                        dirty[(int)(cur->x + x) + (int)(cur->y + y) * width] = true;
-                                        succeeded = true;
-                                        break;
-                                    }
-                                }
+    if (real_tiles[(int)(lx) + (int)(ly)*width].mat()->physicsType == PhysicsType::AIR) {
+        real_tiles[(int)(lx) + (int)(ly)*width] = c.tile[p];
+        dirty.mark((int)(lx) + (int)(ly)*width);
+        return true;
+    }
 
-                                if ((x == y) || ((x < 0) && (x == -y)) || ((x > 0) && (x == 1 - y))) {
-                                    t = dx;
-                                    dx = -dy;
-                                    dy = t;
-                                }
-                                x += dx;
-                                y += dy;
-                            }
-                        }
+    /*for (int y = 0; y < 40; y++) {
+        if (tiles[(int)(c.x[p]) + (int)(c.y[p] - y) * width].mat->physicsType == PhysicsType::AIR) {
+            tiles[(int)(c.x[p]) + (int)(c.y[p] - y) * width] = c.tile[p];
+            dirty.mark((int)(c.x[p]) + (int)(c.y[p] - y) * width);
+            break;
+        }
+    }*/
 
-                        if (succeeded) {
-                            cur->killCallback();
-                            delete cur;
-                            return true;
-                        } else {
-                            cur->vy = -4;
-                            cur->y -= 16;
-                            return false;
-                        }
-                    } else {
-                        real_tiles[(int)(lx) + (int)(ly)*width] = cur->tile;
-                        dirty[(int)(lx) + (int)(ly)*width] = true;
-                        cur->killCallback();
-                        delete cur;
-                        return true;
-                    }
-                }
+    // 从碰撞点向外螺旋搜索空位 范围为 CELL_DEPOSIT_REACH
+    int X = CELL_DEPOSIT_REACH * 2;
+    int Y = CELL_DEPOSIT_REACH * 2;
+    int x = 0, y = 0, dx = 0, dy = -1;
+    int t = std::max(X, Y);
+    int maxI = t * t;
+
+    for (int j = 0; j < maxI; j++) {
+        if ((-X / 2 <= x) && (x <= X / 2) && (-Y / 2 <= y) && (y <= Y / 2)) {
+            if (real_tiles[(int)(c.x[p] + x) + (int)(c.y[p] + y) * width].mat()->physicsType == PhysicsType::AIR) {
+                real_tiles[(int)(c.x[p] + x) + (int)(c.y[p] + y) * width] = c.tile[p];
+                dirty.mark((int)(c.x[p] + x) + (int)(c.y[p] + y) * width);
+                return true;
+            } else if (c.tile[p].mat->physicsType == PhysicsType::SOUP && c.tile[p].mat == real_tiles[(int)(c.x[p] + x) + (int)(c.y[p] + y) * width].mat()) {
+                real_tiles[(int)(c.x[p] + x) + (int)(c.y[p] + y) * width].add_fluid_amount(c.tile[p].fluidAmount);
+                dirty.mark((int)(c.x[p] + x) + (int)(c.y[p] + y) * width);
+                return true;
             }
         }
 
-        if (cur->lifetime > 0) {
-            cur->lifetime--;
+        if ((x == y) || ((x < 0) && (x == -y)) || ((x > 0) && (x == 1 - y))) {
+            t = dx;
+            dx = -dy;
+            dy = t;
         }
+        x += dx;
+        y += dy;
+    }
 
-        return false;
-    };
+    // 周围没有空位 弹起来下一 tick 再试
+    c.vy[p] = -4;
+    c.y[p] -= 16;
+    return false;
+}
 
-    // cells.erase(std::remove_if(cells.begin(), cells.end(), func), cells.end());
+void world::tickCells() {
 
-    std::erase_if(cells, func);
+    CellParticles &c = cells;
+    const size_t count = c.size();
+    ME_profiler_gauge("cells alive", count);
+    if (count == 0) return;
+
+    // 积分: 每个 cell 只改自己的数据 real_tiles 只读
+    cellSteps.resize(count);
+    cellDead.assign(count, 0);
+    // 朝 target 的加速度 本来在 integrateCell 开头逐个计算 这里按段批量做
+    // 寿命到了或出界的 cell 也会算 它们这一 tick 都会被删除
+    constexpr u32 steerBlock = 1024;
+    job::parallel_for((u32)((count + steerBlock - 1) / steerBlock), 1, [&](u32 b) {
+        const size_t begin = (size_t)b * steerBlock;
+        const size_t n = std::min<size_t>(steerBlock, count - begin);
+        ME_vec2_steer_soa(c.vx.data() + begin, c.vy.data() + begin, c.x.data() + begin, c.y.data() + begin, c.targetX.data() + begin, c.targetY.data() + begin, c.targetForce.data() + begin, n,
+                          100.0f, 0.95f);
+    });
+    job::parallel_for((u32)count, 256, [&](u32 p) { cellSteps[p] = integrateCell(p); });
+
+    // 分格
+    const int binsX = (width + CHUNK_W - 1) / CHUNK_W;
+    const int binsY = (height + CHUNK_H - 1) / CHUNK_H;
+    cellDepositBins.resize((size_t)binsX * binsY);
+    for (auto &bin : cellDepositBins) bin.clear();
+    for (auto &phase : cellDepositPhases) phase.clear();
+    cellDepositSerial.clear();
+
+    const int reach = CELL_DEPOSIT_REACH;
+    for (size_t p = 0; p < count; p++) {
+        const CellStep &step = cellSteps[p];
+        if (step.owner) objectImpulses.push_back({step.owner, {c.x[p], c.y[p]}, {c.vx[p] * CELL_OBJECT_IMPULSE, c.vy[p] * CELL_OBJECT_IMPULSE}});
+
+        if (step.action == CellAction_Kill) {
+            cellDead[p] = 1;
+            continue;
+        }
+        if (step.action != CellAction_Deposit) continue;
+
+        const int x = (int)c.x[p];
+        const int y = (int)c.y[p];
+        const bool inside = x - reach >= 0 && y - reach >= 0 && x + reach < width && y + reach < height;
+        const bool near = abs(step.lx - x) <= reach && abs(step.ly - y) <= reach;
+        if (!inside || !near) {
+            cellDepositSerial.push_back((u32)p);
+            continue;
+        }
 
-    // // Better cells removal effects
-    // std::for_each(cells.begin(), cells.end(), [](CellData *cur) {
-    //     cur->vx += cur->ax;
-    //     cur->vy += cur->ay;
-    //     cur->x += cur->vx;
-    //     cur->y += cur->vy;
-    //     // return cur->y > height;
-    // });
+        const int bx = x / CHUNK_W;
+        const int by = y / CHUNK_H;
+        std::vector<u32> &bin = cellDepositBins[bx + by * binsX];
+        if (bin.empty()) cellDepositPhases[(bx & 1) + (by & 1) * 2].push_back((u32)(bx + by * binsX));
+        bin.push_back((u32)p);
+    }
 
-    std::erase_if(cells, [&](auto c) { return c->y > height; });
+    // 写回: 同一轮的格之间至少隔一格 每格内按下标顺序处理 后落地的 cell 能看到先落地的
+    for (auto &phase : cellDepositPhases) {
+        job::parallel_for((u32)phase.size(), 1, [&](u32 i) {
+            for (u32 p : cellDepositBins[phase[i]]) cellDead[p] = depositCell(p, cellSteps[p].lx, cellSteps[p].ly);
+        });
+    }
+    for (u32 p : cellDepositSerial) cellDead[p] = depositCell(p, cellSteps[p].lx, cellSteps[p].ly);
 
-    // std::remove_if(cells.begin(), cells.end(), [&](CellData* cur) {
-    //  return cur->y > height;
-    // });
+    c.compact(cellDead);
 }
 
 void world::tickObjectsMesh() {
 
-    std::vector<RigidBody *> *rbs = &rigidBodies;
-    for (int i = 0; i < rbs->size(); i++) {
-        RigidBody *cur = (*rbs)[i];
-        if (!static_cast<bool>(cur->get_surface())) {
-            // rigidBodies.erase(std::remove(rigidBodies.begin(), rigidBodies.end(), cur), rigidBodies.end());
-            std::erase_if(rigidBodies, [&](auto c) { return cur == c; });
-            continue;
-        };
-        if (cur->needsUpdate && cur->body->IsEnabled()) {
-            updateRigidBodyHitbox(cur);
-        }
+    std::erase_if(rigidBodies, [](RigidBody *cur) { return !static_cast<bool>(cur->get_surface()); });
+
+    std::vector<RigidBody *> dirty;
+    for (RigidBody *cur : rigidBodies) {
+        if (cur->needsUpdate && cur->body->IsEnabled()) dirty.push_back(cur);
     }
+    if (!dirty.empty()) updateRigidBodyHitboxes(std::move(dirty));
 }
 
 void world::tickObjectBounds() {
 
-    std::vector<RigidBody *> rbs = rigidBodies;
+    frame_arena::scope scratch;
+    frame_vector<RigidBody *> rbs(rigidBodies.begin(), rigidBodies.end());
 
     // 确定那些物体需要物理运算
     // 这一部分在物理引擎部分计算了 到时候只需要确定chunk就行了
@@ -2228,14 +2821,16 @@ void world::tickObjectBounds() {
     }
 }
 
-void world::tickObjects() {
+void world::tickObjects(f64 dtMs) {
 
     int minX = width;
     int minY = height;
     int maxX = 0;
     int maxY = 0;
 
-    std::vector<RigidBody *> rbs = rigidBodies;
+    frame_arena::scope scratch;
+    frame_vector<RigidBody *> rbs(rigidBodies.begin(), rigidBodies.end());
+    u32 stepped = 0;
     for (int i = 0; i < rbs.size(); i++) {
         RigidBody *cur = rbs[i];
 
@@ -2243,6 +2838,7 @@ void world::tickObjects() {
         f32 y = cur->body->GetWorldCenter().y;
 
         if (cur->body->IsEnabled()) {
+            stepped++;
             if (x - 100 < minX) minX = (int)x - 100;
             if (y - 100 < minY) minY = (int)y - 100;
             if (x + 100 > maxX) maxX = (int)x + 100;
@@ -2255,200 +2851,1130 @@ void world::tickObjects() {
         }
     }
 
+    // 液体粒子只和 b2 的刚体碰撞 世界碰撞网格也要覆盖它们
+    if (liquidParticles && liquidParticles->GetParticleCount() > 0) {
+        const b2Vec2 *pos = liquidParticles->GetPositionBuffer();
+        for (int i = 0; i < liquidParticles->GetParticleCount(); i++) {
+            if (pos[i].x - 16 < minX) minX = (int)pos[i].x - 16;
+            if (pos[i].y - 16 < minY) minY = (int)pos[i].y - 16;
+            if (pos[i].x + 16 > maxX) maxX = (int)pos[i].x + 16;
+            if (pos[i].y + 16 > maxY) maxY = (int)pos[i].y + 16;
+        }
+    }
+
     int meshZoneSnap = 16;
     int mzx = std::max((int)((minX - loadZone.x) / meshZoneSnap) * meshZoneSnap + (int)loadZone.x, 0);
     int mzy = std::max((int)((minY - loadZone.y) / meshZoneSnap) * meshZoneSnap + (int)loadZone.y, 0);
     meshZone = {(float)mzx, (float)mzy, (float)std::min((int)ceil(((f64)maxX - mzx) / (f64)meshZoneSnap) * meshZoneSnap, width - mzx - 1),
                 (float)std::min((int)ceil(((f64)maxY - mzy) / (f64)meshZoneSnap) * meshZoneSnap, height - mzy - 1)};
 
-    f32 timeStep = 33.0 / 1000.0;
+    const GlobalDEF &def = global.game->Iso.globaldef;
+    const f64 stepMs = 1000.0 / std::max(def.physics_step_rate, 1);
+    physicsAccumulator += dtMs;
+    int steps = (int)(physicsAccumulator / stepMs);
+    // 追不上时丢掉积压的时间 物理变慢但不会越积越多
+    if (steps > std::max(def.physics_max_steps, 1)) {
+        steps = std::max(def.physics_max_steps, 1);
+        physicsAccumulator = steps * stepMs;
+    }
+    physicsAccumulator -= steps * stepMs;
+    ME_profiler_count("physics steps", steps);
+    if (steps == 0) return;
+
+    const f32 timeStep = (f32)(stepMs / 1000.0);
 
     i32 velocityIterations = 5;
     i32 positionIterations = 2;
 
-#if 1
+    // 远处运动中的刚体每 farInterval 步求解一次 求解时速度乘 farInterval 重力乘 farInterval 的平方
+    // 相当于用 farInterval 倍的时间步积分 其余的步里休眠 不参与求解
+    const u32 farInterval = (u32)std::max(def.physics_far_interval, 1);
+    frame_vector<RigidBody *> far;
+    if (def.physics_far_dist > 0 && farInterval > 1) {
+        const b2Vec2 focus = physicsFocus();
+        const f32 farDist2 = (f32)def.physics_far_dist * (f32)def.physics_far_dist;
+        for (RigidBody *cur : rbs) {
+            b2Body *body = cur->body;
+            if (body->GetType() != b2_dynamicBody || !body->IsEnabled() || !body->IsAwake() || body->GetJointList()) continue;
+            if ((body->GetWorldCenter() - focus).LengthSquared() > farDist2) far.push_back(cur);
+        }
+    }
+    struct FarState {
+        b2Vec2 v;
+        f32 w;
+        f32 gravityScale;
+        bool solve;
+    };
+    frame_vector<FarState> farStates(far.size());
 
     registry.for_each_component<WorldEntity>([this](ME::ecs::entity, WorldEntity &we) {
         we.rb->body->SetTransform(b2Vec2(we.x + loadZone.x + we.hw / 2 - 0.5, we.y + loadZone.y + we.hh / 2 - 1.5), 0);
         we.rb->body->SetLinearVelocity({(f32)(we.vx * 1.0), (f32)(we.vy * 1.0)});
     });
 
-    b2world->Step(timeStep, velocityIterations, positionIterations);
+    b2world->SetParallelFor(def.tick_box2d_parallel ? &b2ParallelForJobs : nullptr, nullptr);
+    i32 particleIterations = liquidParticles ? b2CalculateParticleIterations(gravity.Length(), liquidParticles->GetRadius(), timeStep) : 1;
+
+    for (int step = 0; step < steps; step++) {
+        const u64 stepIndex = physicsStep + 1;
+
+        for (size_t i = 0; i < far.size(); i++) {
+            b2Body *body = far[i]->body;
+            FarState &st = farStates[i];
+            // 按地址错开 远处的刚体不会挤在同一步求解
+            st.solve = ((stepIndex + ((uintptr_t)far[i] >> 4)) % farInterval) == 0;
+            st.v = body->GetLinearVelocity();
+            st.w = body->GetAngularVelocity();
+            st.gravityScale = body->GetGravityScale();
+            if (st.solve) {
+                body->SetLinearVelocity((f32)farInterval * st.v);
+                body->SetAngularVelocity((f32)farInterval * st.w);
+                body->SetGravityScale(st.gravityScale * (f32)(farInterval * farInterval));
+            } else {
+                body->SetAwake(false);
+            }
+        }
+
+        for (RigidBody *cur : rbs) {
+            b2Body *body = cur->body;
+            if (!body->IsEnabled() || !body->IsAwake()) continue;
+            cur->interpPos = body->GetPosition();
+            cur->interpAngle = body->GetAngle();
+            cur->interpStep = stepIndex;
+            cur->interpSpan = 1;
+        }
+        for (size_t i = 0; i < far.size(); i++) {
+            if (farStates[i].solve) far[i]->interpSpan = farInterval;
+        }
+
+        b2world->Step(timeStep, velocityIterations, positionIterations, particleIterations);
+        physicsStep = stepIndex;
 
-    registry.for_each_component<WorldEntity>([this](ME::ecs::entity, WorldEntity &we) {
-        /*cur->x = cur->rb->body->GetPosition().x + 0.5 - cur->hw / 2 - loadZone.x;
-        cur->y = cur->rb->body->GetPosition().y + 1.5 - cur->hh / 2 - loadZone.y;*/
-        // cur->rb->body->SetTransform(b2Vec2(cur->x + loadZone.x + cur->hw / 2 - 0.5, cur->y + loadZone.y + cur->hh / 2 - 1.5), 0);
-        // cur->rb->body->SetLinearVelocity({ cur->vx * 25, cur->vy * (cur->vy > 0 ? 0 : 25) });
+        for (size_t i = 0; i < far.size(); i++) {
+            b2Body *body = far[i]->body;
+            const FarState &st = farStates[i];
+            if (st.solve) {
+                body->SetLinearVelocity((1.0f / (f32)farInterval) * body->GetLinearVelocity());
+                body->SetAngularVelocity(body->GetAngularVelocity() / (f32)farInterval);
+                body->SetGravityScale(st.gravityScale);
+            } else {
+                body->SetAwake(true);
+                body->SetLinearVelocity(st.v);
+                body->SetAngularVelocity(st.w);
+            }
+        }
+    }
+    ME_profiler_count("rigid bodies stepped", stepped);
+    ME_profiler_count("rigid bodies far", (u32)far.size());
+    ME_profiler_gauge("liquid particles alive", liquidParticles ? liquidParticles->GetParticleCount() : 0);
 
+    registry.for_each_component<WorldEntity>([this](ME::ecs::entity, WorldEntity &we) {
         // 将物理引擎的速度参数同步到对象
         we.vx = we.rb->body->GetLinearVelocity().x / 1.0;
         we.vy = we.rb->body->GetLinearVelocity().y / 1.0;
     });
+}
 
-#endif
+f32 world::physicsAlpha(f32 thruTick, f64 msPerTick) const {
+    const f64 stepMs = 1000.0 / std::max(global.game->Iso.globaldef.physics_step_rate, 1);
+    return (f32)std::clamp((physicsAccumulator + std::clamp(thruTick, 0.0f, 1.0f) * msPerTick) / stepMs, 0.0, 1.0);
 }
 
-void world::addCell(CellData *cell) { cells.push_back(cell); }
+void world::interpolatedTransform(const RigidBody *rb, f32 alpha, b2Vec2 &pos, f32 &angle) const {
+    pos = rb->body->GetPosition();
+    angle = rb->body->GetAngle();
+    if (!global.game->Iso.globaldef.physics_interpolate || rb->interpSpan == 0 || physicsStep - rb->interpStep >= rb->interpSpan) return;
 
-void world::explosion(int cx, int cy, int radius) {
-    audioEngine->PlayEvent("event:/Explode");
-
-    int outerRadius = radius * 2;
-    for (int x = cx - outerRadius; x < cx + outerRadius; x++) {
-        for (int y = cy - outerRadius; y < cy + outerRadius; y++) {
-            MaterialInstance tile = getTile(x, y);
-            if (tile.mat->physicsType == PhysicsType::AIR) continue;
-
-            int dx = x - cx;
-            int dy = y - cy;
-            if (dx * dx + dy * dy < radius * radius) {
-                if (tile.mat->physicsType == PhysicsType::SOLID || rand() % 10 < 6) {
-                    setTile(x, y, Tiles_NOTHING);
-                } else {
+    // 一次求解跨越 interpSpan 步 在接下来的 interpSpan 步里走完 降频的刚体因此多晚 interpSpan - 1 步
+    const f32 t = std::min(((f32)(physicsStep - rb->interpStep) + alpha) / (f32)rb->interpSpan, 1.0f);
+    pos = rb->interpPos + t * (pos - rb->interpPos);
+    angle = rb->interpAngle + t * std::remainder(angle - rb->interpAngle, 2.0f * b2_pi);
+}
+
+b2Vec2 world::physicsFocus() {
+    if (auto [pl_we, pl] = getHostPlayer(); pl_we) return {pl_we->x + loadZone.x + pl_we->hw / 2.0f, pl_we->y + loadZone.y + pl_we->hh / 2.0f};
+    return {width / 2.0f, height / 2.0f};
+}
+
+const std::vector<std::pair<u32, u32>> &world::rasterRigidBody(RigidBody *rb) {
+    const b2Vec2 pos = rb->body->GetPosition();
+    const f32 angle = rb->body->GetAngle();
+    if (rb->rasterValid && rb->rasterPos == pos && rb->rasterAngle == angle) return rb->raster;
+
+    rb->raster.clear();
+    rb->rasterPos = pos;
+    rb->rasterAngle = angle;
+    rb->rasterValid = true;
+
+    // 刚体像素 (tx, ty) 占局部坐标 [tx, tx+1) x [ty+1, ty+2) 局部到世界为 (lx*c - ly*s + x, lx*s + ly*c + y)
+    // 以世界像素中心反算局部坐标 每一行先求出落在旋转矩形内的区间
+    const f32 s = std::sin(angle);
+    const f32 c = std::cos(angle);
+    const f32 w = (f32)rb->matWidth;
+    const f32 h = (f32)rb->matHeight;
+
+    MEvec2 corners[5] = {{0.0f, 1.0f}, {w, 1.0f}, {0.0f, h + 1}, {w, h + 1}, {0.0f, 0.0f}};
+    ME_vec2_transform_batch(corners, corners, 4, {c, s}, {pos.x, pos.y});
+    corners[4] = {pos.x, pos.y};
+    MEvec2 lower, upper;
+    ME_vec2_aabb_batch(corners, 5, &lower, &upper);
+    const int y0 = std::max((int)std::floor(lower.y), 0);
+    const int y1 = std::min((int)std::ceil(upper.y), (int)height);
+
+    // 一行的世界像素中心一起转到局部坐标
+    thread_local std::vector<MEvec2> row;
+
+    for (int wy = y0; wy < y1; wy++) {
+        const f32 dy = wy + 0.5f - pos.y;
+
+        // 求 a * dx + b 落在 [lo, hi) 的 dx 区间 与已有区间相交
+        f32 dx0 = -FLT_MAX, dx1 = FLT_MAX;
+        auto clip = [&](f32 a, f32 b, f32 lo, f32 hi) {
+            if (std::abs(a) < 1e-6f) {
+                if (b < lo || b >= hi) dx1 = -FLT_MAX;
+                return;
+            }
+            f32 t0 = (lo - b) / a, t1 = (hi - b) / a;
+            if (t0 > t1) std::swap(t0, t1);
+            dx0 = std::max(dx0, t0);
+            dx1 = std::min(dx1, t1);
+        };
+        clip(c, s * dy, 0, w);
+        clip(-s, c * dy, 1, h + 1);
+        if (dx0 >= dx1) continue;
+
+        const int wx0 = std::max((int)std::ceil(pos.x + dx0 - 0.5f), 0);
+        const int wx1 = std::min((int)std::floor(pos.x + dx1 - 0.5f), (int)width - 1);
+        if (wx0 > wx1) continue;
+
+        row.resize(wx1 - wx0 + 1);
+        for (int wx = wx0; wx <= wx1; wx++) row[wx - wx0] = {wx + 0.5f - pos.x, dy};
+        ME_vec2_transform_batch(row.data(), row.data(), row.size(), {c, -s}, {0.0f, -1.0f});
+
+        for (int wx = wx0; wx <= wx1; wx++) {
+            // 区间端点的舍入误差 逐像素再检查一次
+            const int tx = (int)std::floor(row[wx - wx0].x);
+            const int ty = (int)std::floor(row[wx - wx0].y);
+            if (tx < 0 || ty < 0 || tx >= rb->matWidth || ty >= rb->matHeight) continue;
+            rb->raster.emplace_back(wx + wy * width, tx + ty * rb->matWidth);
+        }
+    }
+    return rb->raster;
+}
+
+bool world::freezeRigidBody(RigidBody *rb) {
+    C_Surface *surface = rb->get_surface();
+    if (!surface || !rb->tiles) return false;
+
+    // 非固体像素写进世界会按粉末/液体散开 这种刚体不冻结
+    const int n = rb->matWidth * rb->matHeight;
+    for (int i = 0; i < n; i++) {
+        const Material *mat = rb->tiles[i].mat;
+        if (mat->id != GAME()->materials_list.GENERIC_AIR.id && mat->physicsType != PhysicsType::SOLID) return false;
+    }
 
-                    int r = (tile.color >> 16) & 0xFF;
-                    int g = (tile.color >> 8) & 0xFF;
-                    int b = (tile.color >> 0) & 0xFF;
+    // 与 game 中刚体每个 tick 写入世界的位置一致
+    FrozenRigidBody frozen;
+    frozen.rb = rb;
+    for (auto [i, t] : rasterRigidBody(rb)) {
+        if (rb->tiles[t].mat->id == GAME()->materials_list.GENERIC_AIR.id) continue;
+        // 被占用的位置不写 这些像素仍然只在刚体里
+        if (real_tiles[i].mat()->physicsType != PhysicsType::AIR) continue;
+        real_tiles[i] = rb->tiles[t];
+        dirty.mark(i);
+        frozen.baked.emplace_back(i, t);
+    }
+    if (frozen.baked.empty()) return false;
 
-                    u32 rgb = r / 4;
-                    rgb = (rgb << 8) + g / 4;
-                    rgb = (rgb << 8) + b / 4;
+    rb->body->SetEnabled(false);
+    rigidBodies.erase(std::remove(rigidBodies.begin(), rigidBodies.end(), rb), rigidBodies.end());
+    frozenBodies.push_back(std::move(frozen));
+    return true;
+}
 
-                    tile.color = rgb;
+void world::thawRigidBody(FrozenRigidBody &frozen) {
+    RigidBody *rb = frozen.rb;
+    C_Surface *surface = rb->get_surface();
+
+    // 冻结期间被挖掉或者变成其他材料的像素不再属于刚体
+    bool changed = false;
+    for (auto [i, t] : frozen.baked) {
+        if (real_tiles[i].id() == rb->tiles[t].mat->id) {
+            rb->tiles[t] = real_tiles[i];
+            real_tiles[i] = Tiles_NOTHING;
+            dirty.mark(i);
+        } else {
+            rb->tiles[t] = Tiles_NOTHING;
+            changed = true;
+        }
+    }
 
-                    cells.push_back(new CellData(tile, x, y + 1, dx / 10.0f + (rand() % 10 - 5) / 10.0f, dy / 6.0f + (rand() % 10 - 5) / 10.0f, 0, 0.1f));
-                    setTile(x, y, Tiles_NOTHING);
+    if (changed) {
+        bool empty = true;
+        for (int tx = 0; tx < rb->matWidth; tx++) {
+            for (int ty = 0; ty < rb->matHeight; ty++) {
+                MaterialInstance mat = rb->tiles[tx + ty * rb->matWidth];
+                const bool air = mat.mat->id == GAME()->materials_list.GENERIC_AIR.id;
+                if (!air) empty = false;
+                u32 pixel = air ? 0x00000000 : (mat.mat->alpha << 24) + (mat.color & 0x00ffffff);
+                if (ME_get_pixel(surface, tx, ty) != pixel) {
+                    ME_get_pixel(surface, tx, ty) = pixel;
+                    rb->markTexDirty(tx, ty);
                 }
-            } else if (dx * dx + dy * dy < outerRadius * outerRadius && tile.mat->physicsType != PhysicsType::SOLID) {
-                cells.push_back(new CellData(tile, x, y, dx / 10.0f + (rand() % 10 - 5) / 10.0f, dy / 6.0f + (rand() % 10 - 5) / 10.0f, 0, 0.1f));
-                setTile(x, y, Tiles_NOTHING);
             }
         }
+
+        if (empty) {
+            b2world->DestroyBody(rb->body);
+            rigidBodyPool.release(rb);
+            frozen.rb = nullptr;
+            return;
+        }
+
+        // 形状在 tickObjectsMesh 中重新计算 可能分裂成多个刚体
+        rb->needsUpdate = true;
+    }
+
+    rb->body->SetEnabled(true);
+    rb->body->SetAwake(true);
+    rigidBodies.push_back(rb);
+    frozen.rb = nullptr;
+}
+
+void world::tickObjectLOD() {
+    const f32 dist = (f32)global.game->Iso.globaldef.physics_lod_dist;
+
+    if (dist <= 0) {
+        for (FrozenRigidBody &frozen : frozenBodies) thawRigidBody(frozen);
+        frozenBodies.clear();
+        return;
+    }
+
+    const b2Vec2 focus = physicsFocus();
+    auto dist2 = [&](b2Body *body) { return (body->GetWorldCenter() - focus).LengthSquared(); };
+
+    const f32 thaw = dist * PHYSICS_LOD_THAW;
+    std::erase_if(frozenBodies, [&](FrozenRigidBody &frozen) {
+        if (dist2(frozen.rb->body) >= thaw * thaw) return false;
+        thawRigidBody(frozen);
+        return true;
+    });
+
+    // 只冻结已经休眠的刚体 运动中的留给 Box2D 直到停下
+    frame_arena::scope scratch;
+    frame_vector<RigidBody *> rbs(rigidBodies.begin(), rigidBodies.end());
+    for (RigidBody *cur : rbs) {
+        b2Body *body = cur->body;
+        if (cur->is_cleaned || cur->needsUpdate || body->GetType() != b2_dynamicBody) continue;
+        if (!body->IsEnabled() || body->IsAwake() || body->GetJointList()) continue;
+        if (dist2(body) <= dist * dist) continue;
+        freezeRigidBody(cur);
+    }
+}
+
+void world::shiftFrozenBodies(int dx, int dy) {
+    std::erase_if(frozenBodies, [&](FrozenRigidBody &frozen) {
+        RigidBody *rb = frozen.rb;
+        bool inside = true;
+        for (auto &[i, t] : frozen.baked) {
+            int x = (int)(i % width) + dx;
+            int y = (int)(i / width) + dy;
+            if (x < 0 || y < 0 || x >= width || y >= height) {
+                inside = false;
+                break;
+            }
+            i = x + y * width;
+        }
+
+        if (inside) {
+            rb->body->SetTransform(b2Vec2(rb->body->GetPosition().x + dx, rb->body->GetPosition().y + dy), rb->body->GetAngle());
+            return false;
+        }
+
+        // 已经有像素随区块保存 整个刚体留作地形
+        b2world->DestroyBody(rb->body);
+        rigidBodyPool.release(rb);
+        return true;
+    });
+}
+
+u16 world::addObjectOwner(RigidBody *rb) {
+    if (objectOwnerBodies.size() >= UINT16_MAX) return 0;
+    objectOwnerBodies.push_back(rb);
+    return (u16)objectOwnerBodies.size();
+}
+
+void world::applyObjectImpulses() {
+    if (objectImpulses.empty()) return;
+
+    // 写入之后被拿到手里的刚体不在 rigidBodies 中 不施加冲量
+    phmap::flat_hash_set<RigidBody *> live(rigidBodies.begin(), rigidBodies.end());
+    for (const ObjectImpulse &imp : objectImpulses) {
+        RigidBody *rb = objectOwnerBodies[imp.owner - 1];
+        if (!live.contains(rb) || !rb->body->IsEnabled()) continue;
+        rb->body->ApplyLinearImpulse(imp.impulse, imp.point, true);
     }
+    objectImpulses.clear();
+}
 
-    // 预计在下一个世界tick重新计算mesh
-    lastMeshZone = {};
+void world::clearObjectOwners() {
+    for (u32 idx : objectOwnerCells) objectOwner[idx] = 0;
+    objectOwnerCells.clear();
+    objectOwnerBodies.clear();
 }
 
-void world::frame() {
+void world::tickLiquidParticles() {
+    if (!global.game->Iso.globaldef.tick_liquid_particles) {
+        if (liquidParticles && liquidParticles->GetParticleCount() > 0) flushLiquidParticles();
+        return;
+    }
+
+    if (!liquidParticles) {
+        b2ParticleSystemDef def;
+        // 一个粒子对应一个像素
+        def.radius = 0.5f;
+        def.maxCount = LIQUID_PARTICLE_MAX;
+        def.destroyByAge = false;
+        liquidParticles = b2world->CreateParticleSystem(&def);
+    }
+
+    // 写回静止的 碰到像素的和离开 tickZone 的粒子 DestroyParticle 只做标记 下标在这一轮中不变
+    const int count = liquidParticles->GetParticleCount();
+    if (count > 0) {
+        const u32 *flags = liquidParticles->GetFlagsBuffer();
+        const b2Vec2 *pos = liquidParticles->GetPositionBuffer();
+        const b2Vec2 *vel = liquidParticles->GetVelocityBuffer();
+        void **userData = liquidParticles->GetUserDataBuffer();
+        for (int i = 0; i < count; i++) {
+            if (flags[i] & b2_zombieParticle) continue;
+
+            LiquidParticle &lp = liquidSlots[(uintptr_t)userData[i]];
+            if (vel[i].LengthSquared() < LIQUID_SETTLE_SPEED * LIQUID_SETTLE_SPEED) {
+                if (lp.still < LIQUID_SETTLE_TICKS) lp.still++;
+            } else {
+                lp.still = 0;
+            }
+
+            const int x = (int)std::floor(pos[i].x);
+            const int y = (int)std::floor(pos[i].y);
+            const bool inside = x >= tickZone.x && y >= tickZone.y && x < tickZone.x + tickZone.w && y < tickZone.y + tickZone.h && x >= 0 && y >= 0 && x < width && y < height;
+            if (lp.still >= LIQUID_SETTLE_TICKS || !inside || real_tiles[x + y * width].mat()->physicsType != PhysicsType::AIR) depositLiquidParticle(i);
+        }
+    }
+
+    if (tickCt % LIQUID_SCAN_TICKS != 0) return;
+
+    const int minCells = global.game->Iso.globaldef.liquid_particle_min_cells;
+    if (minCells <= 0) return;
+
+    const size_t words = ((size_t)width * height + 63) / 64;
+    if (liquidVisited.size() != words) {
+        liquidVisited.assign(words, 0);
+        liquidBlocked.assign(words, 0);
+    }
+
+    // 只在唤醒的区域中找下方是空气的液体 从这些正在往下流的位置开始填充
+    const int x0 = std::max((int)tickZone.x, 0);
+    const int y0 = std::max((int)tickZone.y, 0);
+    const int x1 = std::min((int)(tickZone.x + tickZone.w), (int)width);
+    const int y1 = std::min((int)(tickZone.y + tickZone.h), (int)height - 1);
+    for (int ry = y0 & ~(ACTIVE_REGION_SIZE - 1); ry < y1; ry += ACTIVE_REGION_SIZE) {
+        for (int rx = x0 & ~(ACTIVE_REGION_SIZE - 1); rx < x1; rx += ACTIVE_REGION_SIZE) {
+            if (!isRegionAwake(rx, ry)) continue;
+            if (liquidParticles->GetParticleCount() + minCells > LIQUID_PARTICLE_MAX) break;
+
+            for (int y = std::max(ry, y0); y < std::min(ry + ACTIVE_REGION_SIZE, y1); y++) {
+                for (int x = std::max(rx, x0); x < std::min(rx + ACTIVE_REGION_SIZE, x1); x++) {
+                    const u32 i = x + y * width;
+                    if ((liquidVisited[i >> 6] >> (i & 63)) & 1) continue;
+                    if (real_tiles[i].mat()->physicsType != PhysicsType::SOUP) continue;
+                    if (real_tiles[i + width].mat()->physicsType != PhysicsType::AIR) continue;
+
+                    liquidFilled.clear();
+                    if (!floodLiquid(i)) {
+                        // 整片太大 这一轮中连到这里的填充也直接放弃
+                        for (u32 j : liquidFilled) liquidBlocked[j >> 6] |= (u64)1 << (j & 63);
+                    } else if ((int)liquidFilled.size() >= minCells && liquidParticles->GetParticleCount() + (int)liquidFilled.size() <= LIQUID_PARTICLE_MAX) {
+                        convertLiquidRegion();
+                    }
+                }
+            }
+        }
+    }
+
+    for (u32 i : liquidVisitedList) {
+        liquidVisited[i >> 6] &= ~((u64)1 << (i & 63));
+        liquidBlocked[i >> 6] &= ~((u64)1 << (i & 63));
+    }
+    liquidVisitedList.clear();
+}
 
-    while (toLoad.size() > 0) {
-        LoadChunkParams para = toLoad[0];
-        toLoadAsyncList.push_back(std::async(static_cast<Chunk *(world::*)(LoadChunkParams)>(&world::loadChunk), this, para));
-        toLoad.erase(toLoad.begin());
+// 从 start 开始的扫描线填充 只走 tickZone 内相同材质的液体 结果写入 liquidFilled
+// 超过 maxCells 或者碰到这一轮已经放弃的区域时返回 false
+bool world::floodLiquid(u32 start, size_t maxCells) {
+    const int x0 = std::max((int)tickZone.x, 0);
+    const int y0 = std::max((int)tickZone.y, 0);
+    const int x1 = std::min((int)(tickZone.x + tickZone.w), (int)width);
+    const int y1 = std::min((int)(tickZone.y + tickZone.h), (int)height);
+    const int id = real_tiles[start].mat()->id;
+
+    auto seen = [&](u32 i) { return (liquidVisited[i >> 6] >> (i & 63)) & 1; };
+    auto match = [&](u32 i) { return real_tiles[i].mat()->id == id; };
+    auto blocked = [&](u32 i) { return (liquidBlocked[i >> 6] >> (i & 63)) & 1; };
+    bool ok = true;
+
+    std::vector<u32> &stack = liquidStack;
+    stack.clear();
+    stack.push_back(start);
+
+    while (!stack.empty()) {
+        u32 i = stack.back();
+        stack.pop_back();
+        if (seen(i)) continue;
+
+        const int cy = (int)(i / width);
+        const u32 row = (u32)cy * width;
+        int l = (int)(i % width);
+        int r = l;
+        while (l > x0 && !seen(row + l - 1) && match(row + l - 1)) l--;
+        while (r + 1 < x1 && !seen(row + r + 1) && match(row + r + 1)) r++;
+        // 连通的液体已经被之前放弃的填充走过 说明整片太大
+        if ((l > x0 && match(row + l - 1) && blocked(row + l - 1)) || (r + 1 < x1 && match(row + r + 1) && blocked(row + r + 1))) ok = false;
+
+        for (int xx = l; xx <= r; xx++) {
+            const u32 j = row + xx;
+            liquidVisited[j >> 6] |= (u64)1 << (j & 63);
+            liquidVisitedList.push_back(j);
+            liquidFilled.push_back(j);
+        }
+        if (!ok || liquidFilled.size() > maxCells) return false;
+
+        for (int ny = cy - 1; ny <= cy + 1; ny += 2) {
+            if (ny < y0 || ny >= y1) continue;
+            const u32 nrow = (u32)ny * width;
+            bool inRun = false;
+            for (int xx = l; xx <= r; xx++) {
+                if (!match(nrow + xx)) {
+                    inRun = false;
+                    continue;
+                }
+                if (blocked(nrow + xx)) return false;
+                if (seen(nrow + xx)) {
+                    inRun = false;
+                    continue;
+                }
+                if (!inRun) stack.push_back(nrow + xx);
+                inRun = true;
+            }
+        }
     }
 
-    for (int i = 0; i < toLoadAsyncList.size(); i++) {
+    return true;
+}
 
-        // 判断区块是否已经生成或加载好了
-        if (future_is_ready(toLoadAsyncList[i])) {
-            Chunk *merge = toLoadAsyncList[i].get();
+// 液面整平 同一片液体中最高的液面像素依次搬到最低的空位 直到最低的空位不低于最高的液面
+// 空位是液体左右和下方有支撑的空气 (下方是空气的位置由逐像素规则和粒子处理下落)
+// 每次只搬动液面 一片液体的开销与液面和边缘的长度成正比 与需要的迭代次数无关
+// 没有需要搬动的液体 内部 (四邻域没有空气) 的像素标记为静止 逐像素规则只处理液面
+void world::levelLiquidBodies() {
+    const MaterialTable &mt = GAME()->materials_table;
+
+    const size_t words = ((size_t)width * height + 63) / 64;
+    if (liquidVisited.size() != words) {
+        liquidVisited.assign(words, 0);
+        liquidBlocked.assign(words, 0);
+    }
 
-            // 保障合并列表的唯一性
-            std::erase(readyToMerge, merge);
+    const int x0 = std::max((int)tickZone.x, 0);
+    const int y0 = std::max((int)tickZone.y, 1);
+    const int x1 = std::min((int)(tickZone.x + tickZone.w), (int)width);
+    const int y1 = std::min((int)(tickZone.y + tickZone.h), (int)height - 1);
+    auto air = [&](u32 i) { return mt.physicsType[real_tiles[i].id()] == PhysicsType::AIR; };
+
+    u32 moves = 0;
+    for (int ry = y0 & ~(ACTIVE_REGION_SIZE - 1); ry < y1; ry += ACTIVE_REGION_SIZE) {
+        for (int rx = x0 & ~(ACTIVE_REGION_SIZE - 1); rx < x1; rx += ACTIVE_REGION_SIZE) {
+            if (!isRegionAwake(rx, ry) || !interests.due_at(rx, ry) || !partition.owns_at(*this, rx + ACTIVE_REGION_SIZE / 2, ry + ACTIVE_REGION_SIZE / 2)) continue;
+
+            for (int y = std::max(ry, y0); y < std::min(ry + ACTIVE_REGION_SIZE, y1); y++) {
+                for (int x = std::max(rx, x0); x < std::min(rx + ACTIVE_REGION_SIZE, x1); x++) {
+                    const u32 i = x + y * width;
+                    if ((liquidVisited[i >> 6] >> (i & 63)) & 1) continue;
+                    // 从液面开始填充
+                    if (mt.physicsType[real_tiles[i].id()] != PhysicsType::SOUP || !air(i - width)) continue;
+
+                    liquidFilled.clear();
+                    if (!floodLiquid(i, LIQUID_BODY_MAX)) {
+                        for (u32 j : liquidFilled) liquidBlocked[j >> 6] |= (u64)1 << (j & 63);
+                        continue;
+                    }
 
-            readyToMerge.push_back(merge);
+                    liquidSurface.clear();
+                    liquidOpenings.clear();
+                    for (u32 j : liquidFilled) {
+                        const int jx = (int)(j % width);
+                        const int jy = (int)(j / width);
+                        if (jy - 1 >= y0 && air(j - width)) liquidSurface.push_back(j);
+                        if (jx > x0 && air(j - 1) && !air(j - 1 + width)) liquidOpenings.push_back(j - 1);
+                        if (jx + 1 < x1 && air(j + 1) && !air(j + 1 + width)) liquidOpenings.push_back(j + 1);
+                        if (jy + 2 < y1 && air(j + width) && !air(j + 2 * width)) liquidOpenings.push_back(j + width);
+                    }
+                    // 液面从高到低 空位从低到高
+                    std::sort(liquidSurface.begin(), liquidSurface.end());
+                    std::sort(liquidOpenings.begin(), liquidOpenings.end(), std::greater<u32>());
+                    liquidOpenings.erase(std::unique(liquidOpenings.begin(), liquidOpenings.end()), liquidOpenings.end());
+
+                    const u32 before = moves;
+                    for (size_t k = 0; k < liquidSurface.size() && k < liquidOpenings.size(); k++) {
+                        const u32 s = liquidSurface[k];
+                        const u32 o = liquidOpenings[k];
+                        if (o / width <= s / width) break;
+
+                        MaterialInstance tile = real_tiles[s];
+                        tile.moved = false;
+                        tile.settleCount = 0;
+                        real_tiles[o] = tile;
+                        real_tiles[s] = Tiles_NOTHING;
+                        dirty.mark(s);
+                        dirty.mark(o);
+                        moves++;
+                    }
 
-            // 初始化 chunkCache 的列
-            if (!chunkCache.count(merge->x)) {
-                auto h = phmap::flat_hash_map<int, Chunk *>();
-                // h.set_deleted_key(INT_MAX);
-                // h.set_empty_key(INT_MIN);
-                chunkCache[merge->x] = h;
+                    if (moves == before) {
+                        for (u32 j : liquidFilled) {
+                            if (!air(j - width) && !air(j - 1) && !air(j + 1) && !air(j + width)) real_tiles[j].set_moved(true);
+                        }
+                    }
+                }
             }
+        }
+    }
+
+    for (u32 i : liquidVisitedList) {
+        liquidVisited[i >> 6] &= ~((u64)1 << (i & 63));
+        liquidBlocked[i >> 6] &= ~((u64)1 << (i & 63));
+    }
+    liquidVisitedList.clear();
 
-            // 将区块合并对象复制到 chunkCache
-            chunkCache[merge->x][merge->y] = merge;
+    ME_profiler_count("liquid level moves", moves);
+}
 
-            needToTickGeneration = true;
+void world::convertLiquidRegion() {
+    // 一片液体一个粒子组 组中的粒子全部写回后 LiquidFun 会自动销毁空的组
+    b2ParticleGroupDef gd;
+    b2ParticleGroup *group = liquidParticles->CreateParticleGroup(gd);
 
-            // 清除区块生成加载异步对象
-            toLoadAsyncList.erase(toLoadAsyncList.begin() + i);
-            i--;
+    for (u32 i : liquidFilled) {
+        u32 slot;
+        if (!liquidFreeSlots.empty()) {
+            slot = liquidFreeSlots.back();
+            liquidFreeSlots.pop_back();
+        } else {
+            slot = (u32)liquidSlots.size();
+            liquidSlots.emplace_back();
         }
+        LiquidParticle &lp = liquidSlots[slot];
+        lp.tile = real_tiles[i];
+        lp.still = 0;
+
+        b2ParticleDef pd;
+        pd.flags = b2_waterParticle;
+        pd.position.Set((f32)(i % width) + 0.5f, (f32)(i / width) + 0.5f);
+        pd.color.Set((lp.tile.color >> 16) & 0xff, (lp.tile.color >> 8) & 0xff, lp.tile.color & 0xff, lp.tile.mat->alpha);
+        pd.userData = (void *)(uintptr_t)slot;
+        pd.group = group;
+        liquidParticles->CreateParticle(pd);
+
+        real_tiles[i] = Tiles_NOTHING;
+        dirty.mark(i);
     }
+}
 
-    int n = 0;
+bool world::depositLiquidParticle(int i) {
+    const b2Vec2 p = liquidParticles->GetPositionBuffer()[i];
+    const u32 slot = (u32)(uintptr_t)liquidParticles->GetUserDataBuffer()[i];
+    const int x = (int)std::floor(p.x);
+    const int y = (int)std::floor(p.y);
+
+    bool placed = false;
+    if (x >= 0 && y >= 0 && x < width && y < height) {
+        // 所在位置被占用时往上找空的像素
+        for (int yy = y; yy >= std::max(y - 8, 0); yy--) {
+            const u32 idx = x + yy * width;
+            if (real_tiles[idx].mat()->physicsType != PhysicsType::AIR) continue;
+            real_tiles[idx] = liquidSlots[slot].tile;
+            dirty.mark(idx);
+            placed = true;
+            break;
+        }
+        // 下一次 tick 再试
+        if (!placed) return false;
+    }
 
-    while (readyToMerge.size() > 0 && n++ < 16) {
-        Chunk *merge = readyToMerge[0];
-        readyToMerge.pop_front();
+    // 离开世界的粒子直接丢弃
+    liquidParticles->DestroyParticle(i);
+    liquidFreeSlots.push_back(slot);
+    return placed;
+}
 
-        for (int x = 0; x < CHUNK_W; x++) {
-            for (int y = 0; y < CHUNK_H; y++) {
-                int tx = merge->x * CHUNK_W + loadZone.x + x;
-                int ty = merge->y * CHUNK_H + loadZone.y + y;
-                if (tx < 0 || tx >= width || ty < 0 || ty >= height) continue;
+void world::flushLiquidParticles() {
+    if (!liquidParticles) return;
+    const u32 *flags = liquidParticles->GetFlagsBuffer();
+    for (int i = 0; i < liquidParticles->GetParticleCount(); i++) {
+        if (flags[i] & b2_zombieParticle) continue;
+        // 附近没有空位的粒子只能丢弃
+        if (!depositLiquidParticle(i)) {
+            liquidFreeSlots.push_back((u32)(uintptr_t)liquidParticles->GetUserDataBuffer()[i]);
+            liquidParticles->DestroyParticle(i);
+        }
+    }
+}
+
+void world::shiftLiquidParticles(int dx, int dy) {
+    if (!liquidParticles || liquidParticles->GetParticleCount() == 0) return;
+    const u32 *flags = liquidParticles->GetFlagsBuffer();
+    b2Vec2 *pos = liquidParticles->GetPositionBuffer();
+    for (int i = 0; i < liquidParticles->GetParticleCount(); i++) {
+        if (flags[i] & b2_zombieParticle) continue;
+        pos[i] += b2Vec2((f32)dx, (f32)dy);
+        if (pos[i].x < 0 || pos[i].y < 0 || pos[i].x >= width || pos[i].y >= height) {
+            liquidFreeSlots.push_back((u32)(uintptr_t)liquidParticles->GetUserDataBuffer()[i]);
+            liquidParticles->DestroyParticle(i);
+        }
+    }
+}
+
+void world::addCell(const CellData &cell) { cells.push(cell); }
+
+void world::stampRect(int x, int y, int w, int h, const MaterialInstance &stamp, f32 vx, f32 vy, FastRNG &rng, std::vector<u32> &stamps) {
+    const int x0 = std::max(x, 0);
+    const int y0 = std::max(y, 0);
+    const int x1 = std::min(x + w, (int)width);
+    const int y1 = std::min(y + h, (int)height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    const MaterialTable &mt = GAME()->materials_table;
+    const u16 *ids = real_tiles.mat_id_data();
+    const size_t total = real_tiles.size();
+    stamps.reserve(stamps.size() + (size_t)(x1 - x0) * (size_t)(y1 - y0));
+
+    for (int wy = y0; wy < y1; wy++) {
+        const u32 row = (u32)wy * width;
+        // 一行在存储中连续 只可能在环形末尾绕回一次
+        size_t p = real_tiles.physical(row + x0);
+        for (int wx = x0; wx < x1; wx++, p++) {
+            if (p == total) p = 0;
+            const int pt = mt.physicsType[ids[p]];
+            if (pt != PhysicsType::AIR && pt != PhysicsType::SAND && pt != PhysicsType::SOUP) continue;
+
+            const u32 idx = row + (u32)wx;
+            displaceCell(idx, stamp, [&](const MaterialInstance &old) {
+                return CellData(old, (f32)(wx + rng.next() % 3 - 1 - vx), (f32)(wy - std::abs(vy)), (f32)(-vx / 4 + (rng.next() % 10 - 5) / 5.0f), (f32)(-vy / 4 + -(rng.next() % 5 + 5) / 5.0f), 0,
+                                (f32)0.1);
+            });
+            stamps.push_back(idx);
+            if (pt != PhysicsType::AIR) dirty.mark(idx);
+        }
+    }
+}
+
+void world::explosion(int cx, int cy, int radius) {
+    const Explosion e{cx, cy, radius};
+    explosions({&e, 1});
+}
+
+void world::explosions(std::span<const Explosion> list) {
+    if (list.empty()) return;
+
+    const MaterialTable &mt = GAME()->materials_table;
+
+    // 无音频 (WorldBench) 时 audioEngine 为空
+    // 连锁爆炸时同一区域的声音由 Audio::UpdateVoices 合并 半径越大越不容易被抢占
+    if (audioEngine) {
+        for (const Explosion &e : list) audioEngine->PlayEventAt(explodeEvent, (f32)e.x, (f32)e.y, (f32)e.radius);
+    }
+
+    // 所有爆炸外圈 (半径 radius * 2) 的包围盒
+    int bx0 = INT_MAX, by0 = INT_MAX, bx1 = INT_MIN, by1 = INT_MIN;
+    for (const Explosion &e : list) {
+        bx0 = std::min(bx0, e.x - e.radius * 2);
+        by0 = std::min(by0, e.y - e.radius * 2);
+        bx1 = std::max(bx1, e.x + e.radius * 2);
+        by1 = std::max(by1, e.y + e.radius * 2);
+    }
+    bx0 = std::max(bx0, 0);
+    by0 = std::max(by0, 0);
+    bx1 = std::min(bx1, (int)width);
+    by1 = std::min(by1, (int)height);
+    if (bx0 >= bx1 || by0 >= by1) return;
+
+    // 按区块网格分块并行 每个像素只属于一个块 块之间没有数据依赖
+    const int lzx = (int)loadZone.x;
+    const int lzy = (int)loadZone.y;
+    const int chX0 = (int)std::floor((f32)(bx0 - lzx) / CHUNK_W);
+    const int chY0 = (int)std::floor((f32)(by0 - lzy) / CHUNK_H);
+    const int chX1 = (int)std::floor((f32)(bx1 - 1 - lzx) / CHUNK_W);
+    const int chY1 = (int)std::floor((f32)(by1 - 1 - lzy) / CHUNK_H);
+    const int chW = chX1 - chX0 + 1;
+    const int chH = chY1 - chY0 + 1;
+    explosionTouched.assign((size_t)chW * chH, 0);
+
+    job::parallel_for((u32)(chW * chH), 1, [&](u32 t) {
+        const int chx = chX0 + (int)t % chW;
+        const int chy = chY0 + (int)t / chW;
+        const int tx0 = std::max(chx * CHUNK_W + lzx, bx0);
+        const int ty0 = std::max(chy * CHUNK_H + lzy, by0);
+        const int tx1 = std::min(chx * CHUNK_W + lzx + CHUNK_W, bx1);
+        const int ty1 = std::min(chy * CHUNK_H + lzy + CHUNK_H, by1);
+
+        FastRNG rng(RNG_Mix(RNG_Mix(simSeed, ((u64)tickCt << 32) | (u64)(u32)explosionSerial), ((u64)(u32)chx << 32) | (u32)chy));
+        std::vector<CellData> &parts = explosionCells.local();
+        bool touched = false;
+
+        // 按列表顺序处理与本块相交的爆炸 每个像素的结果与逐个调用 explosion 相同
+        for (const Explosion &e : list) {
+            const int outer = e.radius * 2;
+            const int r2 = e.radius * e.radius;
+            const int o2 = outer * outer;
+            const int y0 = std::max(ty0, e.y - outer);
+            const int y1 = std::min(ty1, e.y + outer);
+            for (int y = y0; y < y1; y++) {
+                const int dy = y - e.y;
+                const int rem = o2 - dy * dy;
+                if (rem <= 0) continue;
+
+                // 这一行外圈内 dx * dx < rem 的最大 |dx| 内层循环不再逐像素判断外圈
+                int hw = (int)std::sqrt((f32)rem);
+                while (hw * hw >= rem) hw--;
+                while ((hw + 1) * (hw + 1) < rem) hw++;
+
+                const int x0 = std::max({tx0, e.x - hw, e.x - outer});
+                const int x1 = std::min({tx1, e.x + hw + 1, e.x + outer});
+                for (int x = x0; x < x1; x++) {
+                    const int i = x + y * width;
+                    const int type = mt.physicsType[real_tiles[i].id()];
+                    if (type == PhysicsType::AIR) continue;
+
+                    const int dx = x - e.x;
+                    if (dx * dx + dy * dy < r2) {
+                        if (type != PhysicsType::SOLID && rng.next() % 10 >= 6) {
+                            MaterialInstance tile = real_tiles[i];
+
+                            int r = (tile.color >> 16) & 0xFF;
+                            int g = (tile.color >> 8) & 0xFF;
+                            int b = (tile.color >> 0) & 0xFF;
+
+                            u32 rgb = r / 4;
+                            rgb = (rgb << 8) + g / 4;
+                            rgb = (rgb << 8) + b / 4;
+
+                            tile.color = rgb;
+
+                            const f32 vx = dx / 10.0f + (rng.next() % 10 - 5) / 10.0f;
+                            const f32 vy = dy / 6.0f + (rng.next() % 10 - 5) / 10.0f;
+                            parts.emplace_back(tile, x, y + 1, vx, vy, 0, 0.1f);
+                        }
+                    } else if (type == PhysicsType::SOLID) {
+                        continue;
+                    } else {
+                        const f32 vx = dx / 10.0f + (rng.next() % 10 - 5) / 10.0f;
+                        const f32 vy = dy / 6.0f + (rng.next() % 10 - 5) / 10.0f;
+                        parts.emplace_back(real_tiles[i], x, y, vx, vy, 0, 0.1f);
+                    }
+
+                    real_tiles[i] = Tiles_NOTHING;
+                    dirty.mark(i);
+                    touched = true;
+                }
+            }
+        }
+
+        if (touched) explosionTouched[t] = 1;
+    });
+
+    explosionSerial++;
+
+    explosionCells.for_each([&](std::vector<CellData> &pts) {
+        for (const CellData &c : pts) cells.push(c);
+        pts.clear();
+    });
+
+    // 只有被改动的区块需要在下一次 updateWorldMesh 重新生成碰撞网格
+    for (int t = 0; t < chW * chH; t++) {
+        if (!explosionTouched[t]) continue;
+        if (Chunk *ch = peekChunk(chX0 + t % chW, chY0 + t / chW)) meshRefreshChunks.push_back(ch);
+    }
+}
+
+void world::frame() {
+
+    // 焦点为玩家按速度预测的位置 没有玩家时为加载区域中心
+    f32 focusX = (-loadZone.x + loadZone.w / 2) / CHUNK_W;
+    f32 focusY = (-loadZone.y + loadZone.h / 2) / CHUNK_H;
+    if (auto [pl_we, pl] = getHostPlayer(); pl_we) {
+        f32 aheadX = std::clamp(pl_we->vx * CHUNK_LOAD_LOOKAHEAD / CHUNK_W, -CHUNK_LOAD_LOOKAHEAD_MAX, CHUNK_LOAD_LOOKAHEAD_MAX);
+        f32 aheadY = std::clamp(pl_we->vy * CHUNK_LOAD_LOOKAHEAD / CHUNK_H, -CHUNK_LOAD_LOOKAHEAD_MAX, CHUNK_LOAD_LOOKAHEAD_MAX);
+        focusX = (pl_we->x + pl_we->hw / 2.0f) / CHUNK_W + aheadX;
+        focusY = (pl_we->y + pl_we->hh / 2.0f) / CHUNK_H + aheadY;
+    }
+
+    const int keepX0 = (int)floor(-loadZone.x / CHUNK_W) - CHUNK_LOAD_MARGIN;
+    const int keepY0 = (int)floor(-loadZone.y / CHUNK_H) - CHUNK_LOAD_MARGIN;
+    const int keepX1 = (int)floor((-loadZone.x + loadZone.w) / CHUNK_W) + CHUNK_LOAD_MARGIN;
+    const int keepY1 = (int)floor((-loadZone.y + loadZone.h) / CHUNK_H) + CHUNK_LOAD_MARGIN;
+    chunkLoader.set_focus(focusX, focusY, keepX0, keepY0, keepX1, keepY1);
+    chunkLoader.collect(loadedChunks, cancelledChunks);
+
+    for (Chunk *merge : loadedChunks) {
+
+        // 保障合并列表的唯一性
+        std::erase(readyToMerge, merge);
+
+        readyToMerge.push_back(merge);
+
+        // 将区块合并对象复制到 chunkCache
+        chunkCache.insert(merge->x, merge->y, merge);
+
+        needToTickGeneration = true;
+    }
+
+    for (Chunk *ch : cancelledChunks) releaseChunk(ch);
+
+    // 按行复制 时间用完时停在当前行 每帧至少合并一行
+    const int budget = global.game->Iso.globaldef.merge_budget_us;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget);
+    bool merged = false;
+
+    while (true) {
+        if (!mergingChunk) {
+            if (readyToMerge.empty()) break;
+            mergingChunk = readyToMerge.front();
+            mergingRow = 0;
+            readyToMerge.pop_front();
+        }
+
+        Chunk *merge = mergingChunk;
+        if (!merge->tiles || !merge->background) {
+            // 等待合并期间已经卸载
+            mergingChunk = nullptr;
+            continue;
+        }
 
-                real_tiles[tx + ty * width] = merge->tiles[x + y * CHUNK_W];
-                dirty[tx + ty * width] = true;
-                real_layer2[tx + ty * width] = merge->layer2[x + y * CHUNK_W];
-                layer2Dirty[tx + ty * width] = true;
-                background[tx + ty * width] = merge->background[x + y * CHUNK_W];
-                backgroundDirty[tx + ty * width] = true;
+        const int ox = merge->x * CHUNK_W + (int)loadZone.x;
+        const int oy = merge->y * CHUNK_H + (int)loadZone.y;
+        const int x0 = std::max(ox, 0);
+        const int x1 = std::min(ox + CHUNK_W, (int)width);
+        const int firstRow = mergingRow;
+
+        bool outOfTime = false;
+        MaterialInstance layer2Row[CHUNK_W];
+        for (; mergingRow < CHUNK_H; mergingRow++) {
+            if (merged && budget > 0 && std::chrono::steady_clock::now() >= deadline) {
+                outOfTime = true;
+                break;
             }
+            merged = true;
+
+            const int ty = oy + mergingRow;
+            if (ty < 0 || ty >= height || x0 >= x1) continue;
+
+            const size_t dst = (size_t)x0 + (size_t)ty * width;
+            const size_t src = (size_t)(x0 - ox) + (size_t)mergingRow * CHUNK_W;
+            real_tiles.write_row(dst, merge->tiles + src, x1 - x0);
+            // 没有分配的块读出来是空气
+            merge->layer2.read_row(x0 - ox, mergingRow, x1 - x0, layer2Row);
+            real_layer2.write_row(dst, layer2Row, x1 - x0);
+            background.write(dst, merge->background + src, x1 - x0);
+        }
+
+        // 这一帧合并的行整体标记
+        if (x0 < x1) {
+            dirty.mark_rect(x0, oy + firstRow, x1 - x0, mergingRow - firstRow);
+            layer2Dirty.mark_rect(x0, oy + firstRow, x1 - x0, mergingRow - firstRow);
         }
 
-        // delete prop;
+        if (outOfTime) break;
+        // 背景随整个区块上传一次
+        if (x0 < x1 && oy < height && oy + CHUNK_H > 0) backgroundUploads.push_back(ChunkMap::key(merge->x, merge->y));
+        restoreChunkExtras(merge);
+        mergingChunk = nullptr;
     }
 }
 
 void world::tickChunkGeneration() {
 
-    int n = 0;
+    ME_profiler_gauge("chunks loaded", chunkCache.size());
+
     int cenX = (-loadZone.x + loadZone.w / 2) / CHUNK_W;
     int cenY = (-loadZone.y + loadZone.h / 2) / CHUNK_H;
 
-    std::vector<std::future<void>> gen_results;
+    // 先选出可以推进的区块 卸载在遍历结束后才从 chunkCache 中移除
+    std::vector<Chunk *> ready;
+    chunkCache.for_each([&](Chunk *m) {
+        // Check should we unload chunk
+        if (std::abs(m->x - cenX) >= CHUNK_UNLOAD_DIST || std::abs(m->y - cenY) >= CHUNK_UNLOAD_DIST) {
+            unloadChunk(m);
+            return;
+        }
+
+        if (readyToAdvance(m)) ready.push_back(m);
+    });
+
+    // 离中心近的先推进 每帧受 GlobalDEF::populate_budget_us 限制 没推进的留到下一帧
+    // 有关注区域时 离区域近的 (按区域的模拟间隔加权) 也优先
+    auto dist = [&](Chunk *m) {
+        const int d = std::max(std::abs(m->x - cenX), std::abs(m->y - cenY));
+        const int p = interests.priority(m->x * CHUNK_W + loadZone.x + CHUNK_W / 2, m->y * CHUNK_H + loadZone.y + CHUNK_H / 2);
+        return p < 0 ? d : std::min(d, p);
+    };
+    // 距离相同时按坐标 不依赖 chunkCache 的遍历顺序
+    std::sort(ready.begin(), ready.end(), [&](Chunk *a, Chunk *b) {
+        const int da = dist(a), db = dist(b);
+        return da != db ? da < db : a->y != b->y ? a->y < b->y : a->x < b->x;
+    });
+
+    const int budget = global.game->Iso.globaldef.populate_budget_us;
+    const auto deadline = budget > 0 ? std::chrono::steady_clock::now() + std::chrono::microseconds(budget) : std::chrono::steady_clock::time_point::max();
+    advanceGeneration(ready, true, deadline);
 
-    for (auto &p : chunkCache) {
-        if (p.first == INT_MIN) continue;  // Should be change when using phmap::flat_hash_map
-        for (auto &p2 : p.second) {
-            if (p2.first == INT_MIN) continue;  // Should be change when using phmap::flat_hash_map
-            Chunk *m = p2.second;
+    // 推进之后邻居可能满足条件 下一帧再检查一遍 没有可推进的区块时停止
+    if (ready.empty()) needToTickGeneration = false;
+}
+
+bool world::readyToAdvance(Chunk *m) {
+    if (m->generationPhase < 0) return false;
+    if (m->generationPhase >= std::min(highestPopulator, 5)) return false;
+
+    for (int xx = -1; xx <= 1; xx++) {
+        for (int yy = -1; yy <= 1; yy++) {
+            if (xx == 0 && yy == 0) continue;
+            // 没有加载的邻居当作还没生成
+            Chunk *ch = peekChunk(m->x + xx, m->y + yy);
+            if (!ch || ch->generationPhase < m->generationPhase) return false;
+        }
+    }
+    return true;
+}
+
+bool world::advanceGeneration(std::vector<Chunk *> &ready, bool render, std::chrono::steady_clock::time_point deadline) {
+    // 阶段 p 的 Populator 会读写以区块为中心 (2p+1) 见方的区域
+    // 按 x y 各自模 (2R+1) 着色 R 为本批最大阶段 同色区块的区域互不重叠 可以并行
+    // 推进只会提高阶段 选出时满足的邻居条件在本批中一直成立
+    int radius = 0;
+    for (Chunk *m : ready) radius = std::max(radius, m->generationPhase + 1);
+    const int period = 2 * radius + 1;
+    auto color = [period](Chunk *m) {
+        int cx = ((m->x % period) + period) % period;
+        int cy = ((m->y % period) + period) % period;
+        return cx + cy * period;
+    };
+
+    // 颜色按在 ready 中第一次出现的顺序处理 保留调用者给出的优先顺序
+    frame_arena::scope scratch;
+    frame_vector<int> rank(period * period, -1);
+    int ranks = 0;
+    for (Chunk *m : ready) {
+        if (rank[color(m)] < 0) rank[color(m)] = ranks++;
+    }
+    std::stable_sort(ready.begin(), ready.end(), [&](Chunk *a, Chunk *b) { return rank[color(a)] < rank[color(b)]; });
+
+    // 同色区块每次最多并行 worker 数个 之间检查时间
+    const size_t slice = job::worker_count();
+
+    std::vector<PopulateTask> tasks;
+    for (size_t begin = 0; begin < ready.size();) {
+        if (begin > 0 && std::chrono::steady_clock::now() >= deadline) return false;
+
+        size_t end = begin;
+        while (end < ready.size() && end - begin < slice && color(ready[end]) == color(ready[begin])) end++;
+
+        tasks.clear();
+        tasks.reserve(end - begin);
+        for (size_t i = begin; i < end; i++) {
+            Chunk *m = ready[i];
+            m->generationPhase++;
+            // 卸载或保存世界时写盘
+            m->generation++;
+            tasks.emplace_back();
+            if (!preparePopulate(tasks.back(), m, m->generationPhase)) tasks.pop_back();
+        }
 
-            // Check should we unload chunk
-            if (std::abs(m->x - cenX) >= CHUNK_UNLOAD_DIST || std::abs(m->y - cenY) >= CHUNK_UNLOAD_DIST) {
-                unloadChunk(m);
-                continue;
-            }
+        job::parallel_for((u32)tasks.size(), 1, [&](u32 i) { applyPopulate(tasks[i]); });
 
-            if (m->generationPhase < 0) continue;
-            if (m->generationPhase >= std::min(highestPopulator, 5)) continue;
+        for (PopulateTask &task : tasks) finishPopulate(task, render);
+        begin = end;
+    }
+    return true;
+}
 
-            for (int xx = -1; xx <= 1; xx++) {
-                for (int yy = -1; yy <= 1; yy++) {
-                    if (xx == 0 && yy == 0) continue;
-                    Chunk *ch = getChunk(p.first + xx, p2.first + yy);
+void world::pregenerate(int cx, int cy, int radius) {
+    if (radius <= 0) return;
+    if (noSaveLoad || readOnly) {
+        METADOT_WARN("World pregeneration skipped: world is not saved to disk");
+        return;
+    }
 
-                    if (ch->generationPhase < p2.second->generationPhase) {
-                        if (ch->pleaseDelete) {
-                            delete ch;
-                        }
-                        goto nextChunk;
-                    }
-                    if (ch->pleaseDelete) {
-                        delete ch;
+    // 最高阶段的 Populator 会读写 margin 圈以内的区块 窗口外围多加载 margin 圈
+    const int margin = std::min(highestPopulator, 5);
+    const int side = radius * 2 + 1;
+    const int total = side * side;
+    int done = 0;
+
+    METADOT_INFO(std::format("Pregenerating {0}x{1} chunks around {2} {3}...", side, side, cx, cy).c_str());
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<Chunk *> owned, ready;
+    for (int wy = cy - radius; wy <= cy + radius; wy += PREGEN_WINDOW) {
+        for (int wx = cx - radius; wx <= cx + radius; wx += PREGEN_WINDOW) {
+            const int wx1 = std::min(wx + PREGEN_WINDOW, cx + radius + 1);
+            const int wy1 = std::min(wy + PREGEN_WINDOW, cy + radius + 1);
+
+            // 与加载流水线的读取/生成阶段相同 只是所有区块一起在任务系统上执行
+            owned.clear();
+            for (int y = wy - margin; y < wy1 + margin; y++) {
+                for (int x = wx - margin; x < wx1 + margin; x++) {
+                    if (peekChunk(x, y)) continue;
+                    Chunk *ch = getChunk(x, y);
+                    ch->pleaseDelete = false;
+                    owned.push_back(ch);
+                }
+            }
+            job::parallel_for((u32)owned.size(), 1, [&](u32 i) {
+                if (!readChunk(owned[i])) createChunk(owned[i]);
+            });
+            for (Chunk *ch : owned) chunkCache.insert(ch->x, ch->y, ch);
+
+            // 每一轮所有满足邻居条件的区块推进一个阶段 直到没有可以推进的区块
+            while (true) {
+                ready.clear();
+                for (int y = wy - margin; y < wy1 + margin; y++) {
+                    for (int x = wx - margin; x < wx1 + margin; x++) {
+                        Chunk *m = peekChunk(x, y);
+                        if (m && readyToAdvance(m)) ready.push_back(m);
                     }
                 }
+                if (ready.empty()) break;
+                // 预生成的区块不合并到世界像素
+                advanceGeneration(ready, false);
             }
-            m->generationPhase++;
-            populateChunk(m, m->generationPhase, true);
-
-            gen_results.push_back(std::async(std::launch::async, [&]() noexcept { m->ChunkWrite(m->tiles, m->layer2, m->background); }));
 
-            if (n++ > 4) {
-                return;
+            // 外围区块带着当前阶段写盘 下一个窗口读回后继续推进
+            // 这些区块没有合并到世界像素 不经过 unloadChunk 的 chunkSaveCache
+            for (Chunk *ch : owned) {
+                const std::vector<u8> extras = chunkExtras(ch, false);
+                if (ch->ChunkNeedsSave()) writeChunkToDisk(ch, extras);
+                structures.dropChunk(ch->x, ch->y);
+                chunkCache.erase(ch->x, ch->y);
+                ChunkStoragePool::free_chunk(ch);
             }
 
-        nextChunk : {}
+            done += (wx1 - wx) * (wy1 - wy);
+            METADOT_INFO(std::format("Pregenerating world {0}/{1} chunks ({2}%)", done, total, done * 100 / total).c_str());
         }
     }
 
-    for (auto &async : gen_results) async.get();
-
-    needToTickGeneration = false;
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    METADOT_INFO(std::format("Pregenerated {0} chunks in {1} ms", total, ms).c_str());
 }
 
 void world::tickChunks() {
@@ -2461,24 +3987,37 @@ void world::tickChunks() {
 
         if (changeX != 0 || changeY != 0) {
 
-            bool revX = changeX > 0;
-            bool revY = changeY > 0;
-
+            // 环形存储 平移只移动起点 与像素纹理的 std::rotate 一致
+            // 越过左右边界的像素会绕到相邻行的另一端 它们和上下绕回的行一起落在新露出的条带里
+            std::ptrdiff_t delta = (std::ptrdiff_t)changeX + (std::ptrdiff_t)changeY * width;
+            real_tiles.shift(delta);
+            background.shift(delta);
+            real_layer2.shift(delta);
+
+            // 清除新露出的条带 等待区块加载填充
+            auto clearCell = [&](int x, int y) {
+                real_tiles[x + y * width] = Tiles_NOTHING;
+                real_layer2[x + y * width] = Tiles_NOTHING;
+                background[x + y * width] = 0x00000000;
+            };
+            int stripX = std::min(abs(changeX), width);
+            int stripY = std::min(abs(changeY), height);
+            int x0 = changeX > 0 ? 0 : width - stripX;
+            int y0 = changeY > 0 ? 0 : height - stripY;
             for (int y = 0; y < height; y++) {
-                int oldY = (revY ? (height - y - 1) : y);
-                int newY = oldY + changeY;
-                if (newY < 0 || newY >= height) continue;
-                for (int x = 0; x < width; x++) {
-                    int oldX = (revX ? (width - x - 1) : x);
-                    int newX = oldX + changeX;
-                    if (newX >= 0 && newX < width) {
-                        real_tiles[newX + newY * width] = real_tiles[oldX + oldY * width];
-                        background[newX + newY * width] = background[oldX + oldY * width];
-                        real_layer2[newX + newY * width] = real_layer2[oldX + oldY * width];
-                    }
-                }
+                for (int x = x0; x < x0 + stripX; x++) clearCell(x, y);
+            }
+            for (int y = y0; y < y0 + stripY; y++) {
+                for (int x = 0; x < width; x++) clearCell(x, y);
             }
 
+            // 平移后大量液体块可能已经移出 释放掉空的液体块
+            real_tiles.trim_fluid();
+            real_layer2.trim_fluid();
+
+            // 休眠状态不随像素平移 全部唤醒重新判断
+            wakeAllRegions();
+
             if (changeX < 0) {
                 for (int i = 0; i < abs(changeX); i++) {
                     if ((((int)loadZone.x - changeX - i) + (int)loadZone.w) % CHUNK_W == 0) {
@@ -2498,7 +4037,7 @@ void world::tickChunks() {
                             int cy = floor(y / (f32)CHUNK_H);
                             int cx = ceil((-(loadZone.x - changeX + i)) / (f32)CHUNK_W);
                             // unloadChunk(cx, cy);
-                            chunkSaveCache(getChunk(cx, cy));
+                            if (Chunk *ch = peekChunk(cx, cy)) chunkSaveCache(ch);
                         }
                     }
                 }
@@ -2521,7 +4060,7 @@ void world::tickChunks() {
                             int cy = floor(y / (f32)CHUNK_H);
                             int cx = floor((-(loadZone.x - changeX - i) + tickZone.w) / (f32)CHUNK_W) + 1;
                             // unloadChunk(cx, cy);
-                            chunkSaveCache(getChunk(cx, cy));
+                            if (Chunk *ch = peekChunk(cx, cy)) chunkSaveCache(ch);
                         }
                     }
                 }
@@ -2546,7 +4085,7 @@ void world::tickChunks() {
                             int cx = floor(x / (f32)CHUNK_W);
                             int cy = ceil((-(loadZone.y - changeY + i)) / (f32)CHUNK_H);
                             // unloadChunk(cx, cy);
-                            chunkSaveCache(getChunk(cx, cy));
+                            if (Chunk *ch = peekChunk(cx, cy)) chunkSaveCache(ch);
                         }
                     }
                 }
@@ -2569,21 +4108,22 @@ void world::tickChunks() {
                             int cx = floor(x / (f32)CHUNK_W);
                             int cy = floor((-(loadZone.y - changeY - i) + tickZone.h) / (f32)CHUNK_H) + 1;
                             // unloadChunk(cx, cy);
-                            chunkSaveCache(getChunk(cx, cy));
+                            if (Chunk *ch = peekChunk(cx, cy)) chunkSaveCache(ch);
                         }
                     }
                 }
             }
 
-            for (int i = 0; i < cells.size(); i++) {
-                cells[i]->x += changeX;
-                cells[i]->y += changeY;
-            }
+            for (f32 &cx : cells.x) cx += changeX;
+            for (f32 &cy : cells.y) cy += changeY;
 
             for (int i = 0; i < rigidBodies.size(); i++) {
-                RigidBody cur = *rigidBodies[i];
+                RigidBody &cur = *rigidBodies[i];
                 cur.body->SetTransform(b2Vec2(cur.body->GetPosition().x + changeX, cur.body->GetPosition().y + changeY), cur.body->GetAngle());
+                cur.interpPos += b2Vec2((f32)changeX, (f32)changeY);
             }
+            shiftFrozenBodies(changeX, changeY);
+            shiftLiquidParticles(changeX, changeY);
         }
 
         lastLoadZone = loadZone;
@@ -2592,7 +4132,6 @@ void world::tickChunks() {
 
 void world::queueLoadChunk(int cx, int cy, bool populate, bool render) {
 
-    // toLoad.push_back(LoadChunkParams(cx, cy, populate, 0));
     Chunk *ch = getChunk(cx, cy);
     if (ch->hasTileCache) {
 
@@ -2602,14 +4141,7 @@ void world::queueLoadChunk(int cx, int cy, bool populate, bool render) {
             readyToMerge.push_back(ch);
         }
 
-        if (!chunkCache.count(ch->x)) {
-            auto h = phmap::flat_hash_map<int, Chunk *>();
-            // h.set_deleted_key(INT_MAX);
-            // h.set_empty_key(INT_MIN);
-            chunkCache[ch->x] = h;
-        }
-
-        chunkCache[ch->x][ch->y] = ch;
+        chunkCache.insert(ch->x, ch->y, ch);
         needToTickGeneration = true;
 
     } else {
@@ -2647,7 +4179,10 @@ void world::queueLoadChunk(int cx, int cy, bool populate, bool render) {
         needToTickGeneration = true;
         */
 
-        toLoadAsyncList.push_back(std::async(static_cast<Chunk *(world::*)(Chunk *, bool, bool)>(&world::loadChunk), this, ch, populate, render));
+        // 交给流水线之后区块归流水线所有 同一位置已在加载时丢弃新建的区块
+        const bool created = ch->pleaseDelete;
+        ch->pleaseDelete = false;
+        if (!chunkLoader.request(ch) && created) ChunkStoragePool::free_chunk(ch);
     }
 
     for (int x = 0; x < CHUNK_W; x++) {
@@ -2667,35 +4202,34 @@ void world::queueLoadChunk(int cx, int cy, bool populate, bool render) {
     // loadChunk(cx, cy, populate);
 }
 
-Chunk *world::loadChunk(LoadChunkParams para) { return loadChunk(getChunk(para.x, para.y), para.populate, true); }
-
-Chunk *world::loadChunk(Chunk *ch, bool populate, bool render) {
-
-    std::lock_guard<std::mutex> locker(g_mutex_loadchunk);
+bool world::readChunk(Chunk *ch) {
+    if (ch->hasTileCache) return true;
+    if (noSaveLoad || !ch->ChunkHasFile()) return false;
 
-    ch->pleaseDelete = false;
-
-    auto generate_chunk_func = [this](Chunk *chunk) {
-        this->generateChunk(chunk);
-        chunk->generationPhase = 0;
-        chunk->hasTileCache = true;
-        this->populateChunk(chunk, 0, false);
-        if (!noSaveLoad) chunk->ChunkWrite(chunk->tiles, chunk->layer2, chunk->background);
-    };
+    try {
+        ch->ChunkRead();
+        // 更早的存档没有群系 读取时补上 下次写盘时一起保存
+        if (ch->biomes_id.empty()) fillChunkBiomes(ch);
+        return true;
+    } catch (...) {
+        METADOT_BUG(std::format("Failed to read chunk {0} {1} so regenerate it", ch->x, ch->y).c_str());
+        return false;
+    }
+}
 
-    if (ch->hasTileCache) {
-        // prop = ch->tiles;
-    } else if (ch->ChunkHasFile() && !noSaveLoad) {
-        try {
-            ch->ChunkRead();
-        } catch (...) {
-            METADOT_BUG(std::format("Failed to read chunk {0} {1} so regenerate it", ch->x, ch->y).c_str());
-            generate_chunk_func(ch);
-        }
-    } else {
-        // METADOT_BUG(std::format("generate_chunk_func {0} {1}", ch->x, ch->y).c_str());
-        generate_chunk_func(ch);
+void world::createChunk(Chunk *ch) {
+    // 在流水线的生成阶段调用 可能有多个区块同时生成 只能写 ch 自己
+    {
+        RNG_Scope rng(RNG_Chunk(simSeed, ch->x, ch->y, CHUNK_SEED_GENERATE));
+        this->generateChunk(ch);
     }
+    // 生成器没有顺带记录群系时在这里计算
+    if (ch->biomes_id.size() != CHUNK_W * CHUNK_H) fillChunkBiomes(ch);
+    ch->generationPhase = 0;
+    ch->hasTileCache = true;
+    this->populateChunk(ch, 0, false);
+    ch->generation++;
+    if (!noSaveLoad && !readOnly) ch->ChunkWrite(ch->tiles, ch->background);
 
     // if (populate) {
     //  if (!ch.populated) {
@@ -2734,8 +4268,12 @@ Chunk *world::loadChunk(Chunk *ch, bool populate, bool render) {
 
     //  }
     //}
+}
 
-    return ch;
+void world::releaseChunk(Chunk *ch) {
+    // 已经进入 chunkCache 的区块由缓存管理
+    if (chunkCache.find(ch->x, ch->y) == ch) return;
+    ChunkStoragePool::free_chunk(ch);
 }
 
 void world::unloadChunk(Chunk *ch) {
@@ -2764,110 +4302,366 @@ void world::unloadChunk(Chunk *ch) {
     // ch->write(data, layer2);
 
     chunkSaveCache(ch);
-    if (!noSaveLoad) writeChunkToDisk(ch);
-
-    if (chunkCache[ch->x].contains(ch->y)) {
-        chunkCache[ch->x].erase(ch->y);
-    }
-    ch->ChunkDelete();
+    // 实体和刚体随区块存档离开世界 没有存档时留在世界里
+    const std::vector<u8> extras = noSaveLoad ? std::vector<u8>{} : chunkExtras(ch, true);
+    if (!noSaveLoad && (ch->ChunkNeedsSave() || saver.pending(ch->x, ch->y))) writeChunkToDisk(ch, extras);
+    // 在卸载边界来回走动时 重新加载从内存中的缓存解码
+    if (!noSaveLoad) regions.retain(ch->x, ch->y);
+
+    // 区块对象会被复用 刚体不能留在 b2world 里
+    destroyChunkMesh(ch);
+    structures.dropChunk(ch->x, ch->y);
+
+    if (chunkCache.find(ch->x, ch->y) == ch) chunkCache.erase(ch->x, ch->y);
+    backgroundReleases.push_back(ChunkMap::key(ch->x, ch->y));
+    // 区块对象会被复用 不能留在合并列表里
+    std::erase(readyToMerge, ch);
+    if (mergingChunk == ch) mergingChunk = nullptr;
+    ChunkStoragePool::free_chunk(ch);
     /*delete data;
     delete layer2;*/
     // delete data;
 }
 
-void world::writeChunkToDisk(Chunk *ch) { ch->ChunkWrite(ch->tiles, ch->layer2, ch->background); }
+u64 world::planeBytes() const {
+    u64 n = real_tiles.memory_bytes() + real_layer2.memory_bytes() + background.memory_bytes();
+    // flowX flowY prevFlowX prevFlowY newTemps
+    n += (u64)width * height * (sizeof(f32) * 4 + sizeof(i32));
+    n += objectOwner.capacity() * sizeof(u16);
+    return n;
+}
+
+u64 world::chunkBytes() {
+    u64 n = 0;
+    chunkCache.for_each([&](Chunk *ch) { n += ch->get_chunk_size(); });
+    return n;
+}
+
+u64 world::rigidBodyBytes() const {
+    u64 n = 0;
+    for (const std::vector<RigidBody *> *list : {&rigidBodies, &worldRigidBodies}) {
+        for (const RigidBody *rb : *list) {
+            // 像素和贴图各一份
+            n += sizeof(RigidBody) + (u64)rb->matWidth * rb->matHeight * (sizeof(MaterialInstance) + sizeof(u32));
+            n += (rb->raster.capacity() + rb->stamped.capacity()) * sizeof(std::pair<u32, u32>);
+        }
+    }
+    return n;
+}
+
+u64 world::trimDistantChunks(u64 bytes) {
+    const int cenX = (-loadZone.x + loadZone.w / 2) / CHUNK_W;
+    const int cenY = (-loadZone.y + loadZone.h / 2) / CHUNK_H;
+    const int keep = std::max((int)width / CHUNK_W, (int)height / CHUNK_H) / 2 + 2;
+
+    std::vector<std::pair<int, Chunk *>> far;
+    chunkCache.for_each([&](Chunk *ch) {
+        const int d = std::max(std::abs(ch->x - cenX), std::abs(ch->y - cenY));
+        if (d > keep) far.emplace_back(d, ch);
+    });
+    std::stable_sort(far.begin(), far.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    u64 freed = 0;
+    for (auto &[d, ch] : far) {
+        if (freed >= bytes) break;
+        freed += ch->get_chunk_size();
+        unloadChunk(ch);
+    }
+    return freed;
+}
+
+void world::writeChunkToDisk(Chunk *ch, const std::vector<u8> &extras) {
+    // 只读的包 卸载的区块下次从包中重新读取
+    if (readOnly) return;
+    auto guard = saver.claim(ch->x, ch->y);
+    ch->ChunkWrite(ch->tiles, ch->background, &extras);
+}
+
+std::vector<u8> world::chunkExtras(Chunk *ch, bool take) {
+    std::vector<u8> out;
+
+    ChunkExtras extras;
+    if (const auto *list = structures.chunk(ch->x, ch->y)) {
+        for (const StructureIndex::Record &r : *list) extras.structures.push_back({r.x, r.y, r.w, r.h});
+    }
+
+    // 按中心点归属区块 坐标与 loadZone 无关
+    const f32 x0 = (f32)(ch->x * CHUNK_W), y0 = (f32)(ch->y * CHUNK_H);
+    auto inside = [&](f32 x, f32 y) { return x >= x0 && x < x0 + CHUNK_W && y >= y0 && y < y0 + CHUNK_H; };
+
+    std::vector<ecs::entity> taken;
+    registry.for_each_component<WorldEntity>([&](ecs::entity e, WorldEntity &we) {
+        if ((ecs::exists<Player>{})(e) || e.id() == player) return;
+        if (!inside(we.x + we.hw / 2.0f, we.y + we.hh / 2.0f)) return;
+
+        ChunkExtras::Entity &rec = extras.entities.emplace_back();
+        rec.name = we.name;
+        rec.x = we.x;
+        rec.y = we.y;
+        rec.vx = we.vx;
+        rec.vy = we.vy;
+        rec.hw = we.hw;
+        rec.hh = we.hh;
+        if (const Bot *bot = e.find_component<Bot>()) rec.bot = bot->ID;
+        if (take) taken.push_back(e);
+    });
+
+    for (ecs::entity &e : taken) {
+        WorldEntity &we = e.get_component<WorldEntity>();
+        if (we.rb) {
+            b2world->DestroyBody(we.rb->body);
+            rigidBodyPool.release(we.rb);
+            we.rb = nullptr;
+        }
+        entityGrid.remove(e.id());
+        registry.destroy_entity(e);
+    }
+
+    // 手里的物品由 Item 持有贴图 冻结的刚体已经烤进像素 都不单独保存
+    frame_arena::scope scratch;
+    frame_vector<RigidBody *> rbs(rigidBodies.begin(), rigidBodies.end());
+    for (RigidBody *rb : rbs) {
+        if (rb->item || rb->is_cleaned || !rb->tiles || rb->body->GetType() != b2_dynamicBody) continue;
+        const b2Vec2 center = rb->body->GetWorldCenter();
+        if (!inside(center.x - loadZone.x, center.y - loadZone.y)) continue;
+
+        const int n = rb->matWidth * rb->matHeight;
+        if (n <= 0) continue;
+
+        ChunkExtras::Body &rec = extras.bodies.emplace_back();
+        rec.name = rb->name;
+        rec.x = rb->body->GetPosition().x - loadZone.x;
+        rec.y = rb->body->GetPosition().y - loadZone.y;
+        rec.angle = rb->body->GetAngle();
+        rec.vx = rb->body->GetLinearVelocity().x;
+        rec.vy = rb->body->GetLinearVelocity().y;
+        rec.angularVelocity = rb->body->GetAngularVelocity();
+        rec.w = rb->matWidth;
+        rec.h = rb->matHeight;
+        rec.materials.resize(n);
+        rec.colors.resize(n);
+        rec.temperatures.resize(n);
+        for (int i = 0; i < n; i++) {
+            rec.materials[i] = rb->tiles[i].mat->id;
+            rec.colors[i] = (i32)rb->tiles[i].color;
+            rec.temperatures[i] = rb->tiles[i].temperature;
+        }
+
+        if (take) {
+            b2world->DestroyBody(rb->body);
+            std::erase(rigidBodies, rb);
+            rigidBodyPool.release(rb);
+        }
+    }
+
+    // 读出后还没放回世界的记录原样保留
+    if (!ch->extras.empty()) {
+        ChunkExtras pending;
+        pending.decode(ch->extras.data(), ch->extras.size());
+        std::move(pending.structures.begin(), pending.structures.end(), std::back_inserter(extras.structures));
+        std::move(pending.entities.begin(), pending.entities.end(), std::back_inserter(extras.entities));
+        std::move(pending.bodies.begin(), pending.bodies.end(), std::back_inserter(extras.bodies));
+    }
+
+    extras.encode(out);
+    const u64 hash = out.empty() ? 0 : metadot_fnv1a(out.data(), (int)out.size());
+    if (hash != ch->extrasHash) ch->generation++;
+    return out;
+}
+
+void world::restoreChunkExtras(Chunk *ch) {
+    if (ch->extras.empty()) return;
+
+    ChunkExtras extras;
+    if (!extras.decode(ch->extras.data(), ch->extras.size())) METADOT_WARN(std::format("Chunk extras are corrupt @ {0},{1}", ch->x, ch->y).c_str());
+    ch->extras.clear();
+
+    for (const ChunkExtras::Structure &s : extras.structures) structures.add(s.x, s.y, s.w, s.h);
+
+    for (const ChunkExtras::Entity &rec : extras.entities) {
+        // 与调试界面生成 NPC 相同 位置每帧由 tickEntities 同步
+        b2PolygonShape sh;
+        sh.SetAsBox(rec.hw / 2.0f + 1, rec.hh / 2.0f);
+        RigidBody *rb = makeRigidBody(b2BodyType::b2_kinematicBody, rec.x + loadZone.x + rec.hw / 2.0f - 0.5f, rec.y + loadZone.y + rec.hh / 2.0f - 0.5f, 0, sh, 1, 1, NULL);
+        rb->body->SetGravityScale(0);
+        rb->body->SetLinearDamping(0);
+        rb->body->SetAngularDamping(0);
+
+        auto e = registry.create_entity();
+        ecs::entity_filler(e).component<Controlable>().component<WorldEntity>(false, rec.x, rec.y, rec.vx, rec.vy, rec.hw, rec.hh, rb, rec.name);
+        if (rec.bot >= 0) e.assign_component<Bot>(rec.bot);
+    }
+
+    const size_t materialCount = GAME()->materials_container.size();
+    for (const ChunkExtras::Body &rec : extras.bodies) {
+        C_Surface *sfc = SDL_CreateRGBSurfaceWithFormat(0, rec.w, rec.h, 32, SDL_PIXELFORMAT_ARGB8888);
+        for (int ty = 0; ty < rec.h; ty++) {
+            for (int tx = 0; tx < rec.w; tx++) {
+                const int i = tx + ty * rec.w;
+                const bool air = rec.materials[i] < 0 || (size_t)rec.materials[i] >= materialCount || rec.materials[i] == GAME()->materials_list.GENERIC_AIR.id;
+                const u32 alpha = air ? 0 : GAME()->materials_array[rec.materials[i]]->alpha;
+                ME_get_pixel(sfc, tx, ty) = air ? 0x00000000 : (alpha << 24) + ((u32)rec.colors[i] & 0x00ffffff);
+            }
+        }
+
+        b2PolygonShape s;
+        s.SetAsBox(1, 1);
+        RigidBody *rb = makeRigidBody(b2_dynamicBody, rec.x + loadZone.x, rec.y + loadZone.y, rec.angle * 180 / PI, s, 1, (f32)0.3, create_ref<Texture>(sfc));
+        rb->name = rec.name;
+        for (int i = 0; i < rec.w * rec.h; i++) {
+            const i32 id = rec.materials[i];
+            if (id < 0 || (size_t)id >= materialCount) {
+                rb->tiles[i] = Tiles_NOTHING;
+            } else {
+                rb->tiles[i] = MaterialInstance(GAME()->materials_array[id], (u32)rec.colors[i], (mat_temperature)rec.temperatures[i]);
+            }
+        }
+
+        b2Filter bf = {};
+        bf.categoryBits = 0x0001;
+        bf.maskBits = 0xffff;
+        rb->body->GetFixtureList()[0].SetFilterData(bf);
+        rb->body->SetLinearVelocity({rec.vx, rec.vy});
+        rb->body->SetAngularVelocity(rec.angularVelocity);
+        // 形状在 tickObjectsMesh 中按像素重新计算
+        rb->needsUpdate = true;
+        rigidBodies.push_back(rb);
+    }
+}
+
+int world::readChunkSummaries(int cx, int cy, int cw, int chh, int level, std::vector<u32> &out) {
+    if (cw <= 0 || chh <= 0 || level < 0 || level >= ChunkCodec::SUMMARY_LEVELS) {
+        out.clear();
+        return 0;
+    }
+
+    const int sw = ChunkCodec::summary_width(level), sh = ChunkCodec::summary_height(level);
+    const size_t stride = (size_t)cw * sw;
+    out.assign(stride * chh * sh, 0);
+
+    // chunkCache 只能在当前线程访问 先取出已加载的区块
+    std::vector<Chunk *> loaded((size_t)cw * chh);
+    for (int y = 0; y < chh; y++) {
+        for (int x = 0; x < cw; x++) {
+            Chunk *c = peekChunk(cx + x, cy + y);
+            loaded[x + y * cw] = c && c->hasTileCache && c->tiles && c->background ? c : nullptr;
+        }
+    }
+
+    std::atomic<int> found = 0;
+    job::parallel_for((u32)loaded.size(), 4, [&](u32 i) {
+        const int x = (int)i % cw, y = (int)i / cw;
+        u32 all[ChunkCodec::summary_size(0) + ChunkCodec::summary_size(1)];
+        const u32 *summary = all;
+
+        if (Chunk *c = loaded[i]) {
+            ChunkCodec::summarize(c->tiles, c->layer2, c->background, all);
+            for (int l = 0; l < level; l++) summary += ChunkCodec::summary_size(l);
+        } else {
+            Chunk probe;
+            probe.ChunkInit(cx + x, cy + y, worldName, &regions);
+            if (noSaveLoad || !probe.ChunkReadSummary(level, all)) return;
+        }
+
+        for (int row = 0; row < sh; row++) std::copy(summary + row * sw, summary + (row + 1) * sw, out.data() + (size_t)(y * sh + row) * stride + (size_t)x * sw);
+        found++;
+    });
+    return found;
+}
 
 void world::chunkSaveCache(Chunk *ch) {
+    // 区块合并之后世界中这块区域的像素被改过 区块内容随之改变
+    bool modified = false;
+    const int x0 = std::max(ch->x * CHUNK_W + loadZone.x, 0);
+    const int x1 = std::min(ch->x * CHUNK_W + loadZone.x + CHUNK_W, width);
+    for (int y = 0; y < CHUNK_H && x0 < x1; y++) {
+        int ty = ch->y * CHUNK_H + loadZone.y + y;
+        if (ty < 0 || ty >= height) continue;
+        size_t i = (size_t)x0 + (size_t)ty * width;
+        if (real_tiles.any_modified(i, x1 - x0) || real_layer2.any_modified(i, x1 - x0)) {
+            modified = true;
+            real_tiles.clear_modified(i, x1 - x0);
+            real_layer2.clear_modified(i, x1 - x0);
+        }
+    }
+    if (modified) ch->generation++;
+
     for (int x = 0; x < CHUNK_W; x++) {
         for (int y = 0; y < CHUNK_H; y++) {
             int tx = ch->x * CHUNK_W + loadZone.x + x;
             int ty = ch->y * CHUNK_H + loadZone.y + y;
             if (tx < 0 || tx >= width || ty < 0 || ty >= height) continue;
-            if (real_tiles[tx + ty * width].id == Tiles_TEST_SOLID.id) continue;
+            if (real_tiles[tx + ty * width].mat()->id == Tiles_TEST_SOLID.mat->id) continue;
             ch->tiles[x + y * CHUNK_W] = real_tiles[tx + ty * width];
-            ch->layer2[x + y * CHUNK_W] = real_layer2[tx + ty * width];
+            ch->layer2.set(x, y, real_layer2[tx + ty * width]);
             ch->background[x + y * CHUNK_W] = background[tx + ty * width];
         }
     }
+    // 第二层被挖空的块不再保留
+    ch->layer2.compact();
 }
 
 void world::generateChunk(Chunk *ch) { gen->generateChunk(this, ch); }
 
 int world::getBiomeAt(Chunk *ch, int x, int y) {
+    const int lx = x - ch->x * CHUNK_W, ly = y - ch->y * CHUNK_H;
+    if (ch->biomes_id.size() == CHUNK_W * CHUNK_H && lx >= 0 && ly >= 0 && lx < CHUNK_W && ly < CHUNK_H) return ch->biomes_id[lx + ly * CHUNK_W];
+    return getBiomeAt(x, y);
+}
 
-    try {
-        if (ch->biomes_id.at((x - ch->x * CHUNK_W) + (y - ch->y * CHUNK_H) * CHUNK_W) != Biome::biomeGet("DEFAULT").id) {
-            int biome_id = ch->biomes_id[(x - ch->x * CHUNK_W) + (y - ch->y * CHUNK_H) * CHUNK_W];
-            if (ch->pleaseDelete) delete ch;
-            return biome_id;
-        }
-    } catch (const std::out_of_range &ex) {
-        METADOT_ERROR(std::format("[Exception] ch->biomes_id[{0}] {1}", (x - ch->x * CHUNK_W) + (y - ch->y * CHUNK_H) * CHUNK_W, ex.what()).c_str());
-        return Biome::biomeGet("DEFAULT").id;
+void world::fillChunkBiomes(Chunk *ch) {
+    ch->biomes_id.resize(CHUNK_W * CHUNK_H);
+
+    // 地表带的群系只取决于 x 每列算一次
+    int surface[CHUNK_W];
+    for (int x = 0; x < CHUNK_W; x++) surface[x] = getSurfaceBiomeAt(x + ch->x * CHUNK_W);
+
+    for (int y = 0; y < CHUNK_H; y++) {
+        const int py = y + ch->y * CHUNK_H;
+        const bool band = inSurfaceBand(py);
+        for (int x = 0; x < CHUNK_W; x++) ch->biomes_id[x + y * CHUNK_W] = (u8)(band ? surface[x] : getBiomeAt(x + ch->x * CHUNK_W, py));
     }
+}
 
-    int ret = getBiomeAt(x, y);
-    ch->biomes_id[(x - ch->x * CHUNK_W) + (y - ch->y * CHUNK_H) * CHUNK_W] = ret;
-    return ret;
+int world::getSurfaceBiomeAt(int x) {
+    f32 v = noise.GetCellular(x / 20.0, 0, 8592) / 2 + 0.5;
+    int biomeCatNum = 3;
+    int biomeCat = (int)(v * biomeCatNum);
+    if (biomeCat == 0) return biomeIds.plains;
+    if (biomeCat == 1) return biomeIds.mountains;
+    if (biomeCat == 2) return biomeIds.forest;
+
+    // 查找失败 返回默认群系
+    return biomeIds.defaultId;
 }
 
 int world::getBiomeAt(int x, int y) {
 
-    int ret = -1;
-
     // ret = Biome::biomeGet("DEFAULT");
     // return ret;
 
-    if (abs(CHUNK_H * 3 - y) < CHUNK_H * 10) {
-        f32 v = noise.GetCellular(x / 20.0, 0, 8592) / 2 + 0.5;
-        int biomeCatNum = 3;
-        int biomeCat = (int)(v * biomeCatNum);
-        if (biomeCat == 0) {
-            ret = Biome::biomeGetID("PLAINS");
-        } else if (biomeCat == 1) {
-            ret = Biome::biomeGetID("MOUNTAINS");
-        } else if (biomeCat == 2) {
-            ret = Biome::biomeGetID("FOREST");
-        }
-    } else {
-        noise.SetCellularDistanceFunction(FastNoise::CellularDistanceFunction::Natural);
-        noise.SetCellularJitter(0.3);
-        noise.SetCellularReturnType(FastNoise::CellularReturnType::CellValue);
-        f32 v = noise.GetCellular(x / 20.0, y / 20.0, 2039) / 2 + 0.5;
-        f32 v2 = noise.GetCellular(x / 3.0, y / 3.0, 3890) / 2 + 0.5;
-        int biomeCatNum = 4;
-        int biomeCat = (int)(v * biomeCatNum);
+    if (inSurfaceBand(y)) return getSurfaceBiomeAt(x);
 
-        if (biomeCat == 0) {
-            ret = v2 >= 0.5 ? Biome::biomeGetID("TEST_1_2") : Biome::biomeGetID("TEST_1");
-        } else if (biomeCat == 1) {
-            ret = v2 >= 0.5 ? Biome::biomeGetID("TEST_2_2") : Biome::biomeGetID("TEST_2");
-        } else if (biomeCat == 2) {
-            ret = v2 >= 0.5 ? Biome::biomeGetID("TEST_3_2") : Biome::biomeGetID("TEST_3");
-        } else if (biomeCat == 3) {
-            ret = v2 >= 0.5 ? Biome::biomeGetID("TEST_4_2") : Biome::biomeGetID("TEST_4");
-        }
-    }
+    f32 v = biomeNoise.GetCellular(x / 20.0, y / 20.0, 2039) / 2 + 0.5;
+    f32 v2 = biomeNoise.GetCellular(x / 3.0, y / 3.0, 3890) / 2 + 0.5;
+    int biomeCatNum = 4;
+    int biomeCat = (int)(v * biomeCatNum);
+    if (biomeCat >= 0 && biomeCat < 4) return v2 >= 0.5 ? biomeIds.test2[biomeCat] : biomeIds.test[biomeCat];
 
     // 查找失败 返回默认群系
-    if (ret == -1) ret = Biome::biomeGetID("DEFAULT");
-
-    return ret;
+    return biomeIds.defaultId;
 }
 
 void world::addStructure(PlacedStructure str) {
-    structures.push_back(str);
+    structures.add(str.x, str.y, str.base.w, str.base.h);
 
     for (int x = 0; x < str.base.w; x++) {
         for (int y = 0; y < str.base.h; y++) {
             int dx = x + loadZone.x + str.x;
             int dy = y + loadZone.y + str.y;
-            Chunk *ch = new Chunk;
-            ch->ChunkInit(floor(dx / CHUNK_W), floor(dy / CHUNK_H), worldName);
-            // if(ch.e)
             if (dx >= 0 && dy >= 0 && dx < width && dy < height) {
                 real_tiles[dx + dy * width] = str.base.tiles[x + y * str.base.w];
-                dirty[dx + dy * width] = true;
+                dirty.mark(dx + dy * width);
             }
         }
     }
@@ -2876,95 +4670,87 @@ void world::addStructure(PlacedStructure str) {
 MEvec2 world::getNearestPoint(f32 x, f32 y) {
     f32 xm = fmod(1 + fmod(x, 1), 1);
     f32 ym = fmod(1 + fmod(y, 1), 1);
-    f32 closestDist = 100;
-    MEvec2 closest;
-    for (int i = 0; i < distributedPoints.size(); i++) {
-        f32 dx = distributedPoints[i].x - xm;
-        f32 dy = distributedPoints[i].y - ym;
-        f32 d = dx * dx + dy * dy;
-        if (d < closestDist) {
-            closestDist = d;
-            closest = distributedPoints[i];
-        }
-    }
+    MEvec2 closest(0, 0);
+    distributedPoints.nearest(xm, ym, closest);
     return {closest.x + (x - xm), closest.y + (y - ym)};
 }
 
 std::vector<MEvec2> world::getPointsWithin(f32 x, f32 y, f32 w, f32 h) {
-    f32 xm = fmod(1 + fmod(x, 1), 1);
-    f32 ym = fmod(1 + fmod(y, 1), 1);
-
     std::vector<MEvec2> pts;
     for (f32 xo = floor(x) - 1; xo < ceil(x + w); xo++) {
         for (f32 yo = floor(y) - 1; yo < ceil(y + h); yo++) {
-            for (int i = 0; i < distributedPoints.size(); i++) {
-                if (distributedPoints[i].x + xo > x && distributedPoints[i].y + yo > y && distributedPoints[i].x + xo < x + w && distributedPoints[i].y + yo < y + h) {
-                    pts.push_back({distributedPoints[i].x + xo, distributedPoints[i].y + yo});
-                }
-            }
+            // 平铺的每一块只查询与范围相交的网格
+            distributedPoints.forEachIn(x - xo, y - yo, x + w - xo, y + h - yo, [&](const MEvec2 &p) { pts.push_back({p.x + xo, p.y + yo}); });
         }
     }
 
     return pts;
 }
 
+Chunk *world::peekChunk(int cx, int cy) { return chunkCache.find(cx, cy); }
+
 Chunk *world::getChunk(int cx, int cy) {
 
-    auto xx = chunkCache.find(cx);
-    if (xx != chunkCache.end()) {
-        auto yy = xx->second.find(cy);
-        if (yy != xx->second.end()) {
-            return yy->second;
-        }
-    }
+    if (Chunk *ch = chunkCache.find(cx, cy)) return ch;
 
     // METADOT_WARN(std::format("failed to load chunk {0}_{1} in chunkCache, so generate it", cx, cy).c_str());
 
     /*for (int i = 0; i < chunkCache.size(); i++) {
         if (chunkCache[i]->x == cx && chunkCache[i]->y == cy) return chunkCache[i];
     }*/
-    Chunk *c = new Chunk;
-    c->ChunkInit(cx, cy, worldName);
+    Chunk *c = ChunkStoragePool::alloc_chunk();
+    c->ChunkInit(cx, cy, worldName, &regions);
     c->generationPhase = -1;
     c->pleaseDelete = true;
-    int a = Biome::biomeGetID("DEFAULT");
-    if (c->biomes_id.size() != CHUNK_W * CHUNK_H) {
-        // c->biomes_id.clear();
-        // c->biomes_id.resize(CHUNK_W * CHUNK_H);
-    }
-    std::fill(c->biomes_id.begin(), c->biomes_id.end(), a);
     return c;
 }
 
 void world::populateChunk(Chunk *ch, int phase, bool render) {
+    PopulateTask task;
+    if (!preparePopulate(task, ch, phase)) return;
+    applyPopulate(task);
+    finishPopulate(task, render);
+}
 
-    bool has = hasPopulator[phase];
-    if (!hasPopulator[phase]) return;
-
-    int ax = (ch->x - phase);
-    int ay = (ch->y - phase);
-    int aw = 1 + (phase * 2);
-    int ah = 1 + (phase * 2);
-
-    // TODO: 23/7/31 优化
-    Chunk **chs = new Chunk *[aw * ah];
-
-    bool *dirtyChunk = new bool[aw * ah]();
-
-    if (phase == 1) {
-        int a = 0;
-    }
-
-    for (int cx = ax; cx < ax + aw; cx++) {
-        for (int cy = ay; cy < ay + ah; cy++) {
-            chs[(cx - ax) + (cy - ay) * aw] = getChunk(cx, cy);
-            dirtyChunk[(cx - ax) + (cy - ay) * aw] = false;
+bool world::preparePopulate(PopulateTask &task, Chunk *ch, int phase) {
+    if (!hasPopulator[phase]) return false;
+
+    task.ch = ch;
+    task.phase = phase;
+    task.ax = (ch->x - phase);
+    task.ay = (ch->y - phase);
+    task.aw = 1 + (phase * 2);
+    task.ah = 1 + (phase * 2);
+
+    const int aw = task.aw, ah = task.ah;
+    task.chs = std::make_unique<Chunk *[]>(aw * ah);
+    task.dirtyChunk = std::make_unique<bool[]>(aw * ah);
+
+    for (int cx = task.ax; cx < task.ax + aw; cx++) {
+        for (int cy = task.ay; cy < task.ay + ah; cy++) {
+            // 中心就是 ch 本身 阶段 0 在加载线程上执行 不能访问 chunkCache
+            Chunk *c = (cx == ch->x && cy == ch->y) ? ch : getChunk(cx, cy);
+            task.chs[(cx - task.ax) + (cy - task.ay) * aw] = c;
+            task.dirtyChunk[(cx - task.ax) + (cy - task.ay) * aw] = false;
         }
     }
+    return true;
+}
+
+void world::applyPopulate(PopulateTask &task) {
+    Chunk *ch = task.ch;
+    Chunk **chs = task.chs.get();
+    bool *dirtyChunk = task.dirtyChunk.get();
+    const int aw = task.aw;
 
     for (int i = 0; i < populators.size(); i++) {
-        if (populators[i]->getPhase() == phase) {
-            std::vector<PlacedStructure> strs = populators[i]->apply(ch->tiles, ch->layer2, chs, dirtyChunk, ax * CHUNK_W, ay * CHUNK_H, aw * CHUNK_W, ah * CHUNK_H, ch, this);
+        if (populators[i]->getPhase() == task.phase) {
+            ME_profiler_scope_auto(populators[i]->getName());
+            RNG_Scope rng(RNG_Chunk(simSeed, ch->x, ch->y, CHUNK_SEED_POPULATE + i));
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<PlacedStructure> strs =
+                    populators[i]->apply(ch->tiles, &ch->layer2, chs, dirtyChunk, task.ax * CHUNK_W, task.ay * CHUNK_H, task.aw * CHUNK_W, task.ah * CHUNK_H, ch, this);
+            populatorStats[i].add((u64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
             for (int j = 0; j < strs.size(); j++) {
                 for (int tx = 0; tx < strs[j].base.w; tx++) {
                     for (int ty = 0; ty < strs[j].base.h; ty++) {
@@ -2981,12 +4767,18 @@ void world::populateChunk(Chunk *ch, int phase, bool render) {
             }
         }
     }
+}
+
+void world::finishPopulate(PopulateTask &task, bool render) {
+    Chunk *ch = task.ch;
+    Chunk **chs = task.chs.get();
+    const int aw = task.aw, ah = task.ah;
 
     for (int x = 0; x < aw; x++) {
         for (int y = 0; y < ah; y++) {
-            if (dirtyChunk[x + y * aw]) {
+            if (task.dirtyChunk[x + y * aw]) {
                 if (x != aw / 2 && y != ah / 2) {
-                    chs[x + y * aw]->ChunkWrite(chs[x + y * aw]->tiles, chs[x + y * aw]->layer2, chs[x + y * aw]->background);
+                    chs[x + y * aw]->generation++;
                     if (render) {
                         // 保证 chs[x + y * aw] 的唯一性
                         std::erase(readyToMerge, chs[x + y * aw]);
@@ -3005,6 +4797,10 @@ void world::populateChunk(Chunk *ch, int phase, bool render) {
         // 加入合并列表
         readyToMerge.push_back(ch);
     }
+
+    for (int i = 0; i < aw * ah; i++) {
+        if (chs[i]->pleaseDelete) ChunkStoragePool::free_chunk(chs[i]);
+    }
 }
 
 void world::tickEntities(R_Target *t) {
@@ -3019,8 +4815,8 @@ void world::tickEntities(R_Target *t) {
                 int sy = (cur->y + yy) + loadZone.y;
                 if (sx < 0 || sy < 0 || sx >= width || sy >= height) continue;
 
-                if (real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SAND ||
-                    real_tiles[sx + sy * width].mat->physicsType == PhysicsType::OBJECT) {
+                if (real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SAND ||
+                    real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::OBJECT) {
                     nIntersect++;
                     avInX += (xx - cur->hw / 2);
                     avInY += (yy - cur->hh / 2);
@@ -3046,16 +4842,16 @@ void world::tickEntities(R_Target *t) {
                         int sx = (nx + xx) + loadZone.x;
                         int sy = (ny + yy) + loadZone.y;
                         if (sx >= 0 && sy >= 0 && sx < width && sy < height) {
-                            if (real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SAND ||
-                                real_tiles[sx + sy * width].mat->physicsType == PhysicsType::OBJECT) {
+                            if (real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SAND ||
+                                real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::OBJECT) {
                                 if (yy == cur->hh - 1) {
                                     for (int xx1 = 0; xx1 < cur->hw; xx1++) {
                                         for (int yy1 = 0; yy1 < cur->hh; yy1++) {
                                             int sx1 = (nx + xx1) + loadZone.x;
                                             int sy1 = (ny + yy1) + loadZone.y - 1;
                                             if (sx1 >= 0 && sy1 >= 0 && sx1 < width && sy1 < height) {
-                                                if (real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::SAND ||
-                                                    real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::OBJECT) {
+                                                if (real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::SAND ||
+                                                    real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::OBJECT) {
                                                     collide = true;
                                                 }
                                             }
@@ -3067,9 +4863,9 @@ void world::tickEntities(R_Target *t) {
                                 } else {
                                     MaterialInstance tp = real_tiles[sx + sy * width];
                                     if (tp.mat->physicsType == PhysicsType::SAND) {
-                                        addCell(new CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f + 0.5f, (rand() % 10 - 5) / 10.0f, 0, 0.1f));
+                                        addCell(CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f + 0.5f, (rand() % 10 - 5) / 10.0f, 0, 0.1f));
                                         real_tiles[sx + sy * width] = Tiles_NOTHING;
-                                        dirty[sx + sy * width] = true;
+                                        dirty.mark(sx + sy * width);
 
                                         cur->vx *= 0.99;
                                     } else {
@@ -3101,16 +4897,16 @@ void world::tickEntities(R_Target *t) {
                         int sx = (nx + xx) + loadZone.x;
                         int sy = (ny + yy) + loadZone.y;
                         if (sx >= 0 && sy >= 0 && sx < width && sy < height) {
-                            if (real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SAND ||
-                                real_tiles[sx + sy * width].mat->physicsType == PhysicsType::OBJECT) {
+                            if (real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SAND ||
+                                real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::OBJECT) {
                                 if (yy == cur->hh - 1) {
                                     for (int xx1 = 0; xx1 < cur->hw; xx1++) {
                                         for (int yy1 = 0; yy1 < cur->hh; yy1++) {
                                             int sx1 = (nx + xx1) + loadZone.x;
                                             int sy1 = (ny + yy1) + loadZone.y - 1;
                                             if (sx1 >= 0 && sy1 >= 0 && sx1 < width && sy1 < height) {
-                                                if (real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::SAND ||
-                                                    real_tiles[sx1 + sy1 * width].mat->physicsType == PhysicsType::OBJECT) {
+                                                if (real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::SAND ||
+                                                    real_tiles[sx1 + sy1 * width].mat()->physicsType == PhysicsType::OBJECT) {
                                                     collide = true;
                                                 }
                                             }
@@ -3122,9 +4918,9 @@ void world::tickEntities(R_Target *t) {
                                 } else {
                                     MaterialInstance tp = real_tiles[sx + sy * width];
                                     if (tp.mat->physicsType == PhysicsType::SAND) {
-                                        addCell(new CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f - 0.5f, (rand() % 10 - 5) / 10.0f, 0, 0.1f));
+                                        addCell(CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f - 0.5f, (rand() % 10 - 5) / 10.0f, 0, 0.1f));
                                         real_tiles[sx + sy * width] = Tiles_NOTHING;
-                                        dirty[sx + sy * width] = true;
+                                        dirty.mark(sx + sy * width);
 
                                         cur->vx *= 0.99;
                                     } else {
@@ -3160,8 +4956,8 @@ void world::tickEntities(R_Target *t) {
                         int sx = (nx + xx) + loadZone.x;
                         int sy = (ny + yy) + loadZone.y;
                         if (sx >= 0 && sy >= 0 && sx < width && sy < height) {
-                            if (real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SAND ||
-                                real_tiles[sx + sy * width].mat->physicsType == PhysicsType::OBJECT) {
+                            if (real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SAND ||
+                                real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::OBJECT) {
                                 collide = true;
                             }
                         }
@@ -3188,13 +4984,13 @@ void world::tickEntities(R_Target *t) {
                         int sx = (nx + xx) + loadZone.x;
                         int sy = (ny + yy) + loadZone.y;
                         if (sx >= 0 && sy >= 0 && sx < width && sy < height) {
-                            if (real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat->physicsType == PhysicsType::SAND ||
-                                real_tiles[sx + sy * width].mat->physicsType == PhysicsType::OBJECT) {
+                            if (real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SOLID || real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::SAND ||
+                                real_tiles[sx + sy * width].mat()->physicsType == PhysicsType::OBJECT) {
                                 MaterialInstance tp = real_tiles[sx + sy * width];
                                 if (tp.mat->physicsType == PhysicsType::SAND) {
-                                    addCell(new CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f, (rand() % 10 - 5) / 10.0f - 0.5f, 0, 0.1f));
+                                    addCell(CellData(tp, sx, sy, (rand() % 10 - 5) / 10.0f, (rand() % 10 - 5) / 10.0f - 0.5f, 0, 0.1f));
                                     real_tiles[sx + sy * width] = Tiles_NOTHING;
-                                    dirty[sx + sy * width] = true;
+                                    dirty.mark(sx + sy * width);
 
                                     cur->vy *= 0.99;
                                 } else {
@@ -3233,6 +5029,12 @@ void world::tickEntities(R_Target *t) {
     };
 
     // worldEntities.erase(std::remove_if(worldEntities.begin(), worldEntities.end(), func), worldEntities.end());
+    nav.update(*this);
+    light.update(*this);
+    replication.update(*this);
+    partition.update(*this);
+
+    entityGrid.begin_update();
     registry.for_each_component<WorldEntity>([&](ecs::entity e, WorldEntity &we) {
         if (global.game->Iso.globaldef.debug_entities_test) {
             R_Rectangle(this->target, we.x, we.y, we.x + we.hw, we.y + we.hh, {0xff, 0xff, 0xff, 0xff});
@@ -3241,75 +5043,33 @@ void world::tickEntities(R_Target *t) {
         bool destroy = func(&we);
         if (destroy) {
             if ((ecs::exists<Player>{})(e)) this->player = 0;
+            entityGrid.remove(e.id());
             registry.destroy_entity(e);
+        } else {
+            entityGrid.update(e.id(), we.x, we.y, we.hw, we.hh);
         }
     });
+    // 在别处销毁的实体这里移除
+    entityGrid.end_update();
 }
 
-// Adapted from https://stackoverflow.com/a/52859805/8267529
-void world::forLine(int x0, int y0, int x1, int y1, std::function<bool(int)> fn) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-
-    int dLong = abs(dx);
-    int dShort = abs(dy);
-
-    int offsetLong = dx > 0 ? 1 : -1;
-    int offsetShort = dy > 0 ? width : -width;
-
-    if (dLong < dShort) {
-        std::swap(dShort, dLong);
-        std::swap(offsetShort, offsetLong);
-    }
-
-    int error = dLong / 2;
-    int index = y0 * width + x0;
-    const int offset[] = {offsetLong, offsetLong + offsetShort};
-    const int abs_d[] = {dShort, dShort - dLong};
-    for (int i = 0; i <= dLong; ++i) {
-        if (fn(index)) return;
-        const int errorIsTooBig = error >= dLong;
-        index += offset[errorIsTooBig];
-        error += abs_d[errorIsTooBig];
-    }
-}
-
-// Adapted from https://gamedev.stackexchange.com/a/182143
-void world::forLineCornered(int x0, int y0, int x1, int y1, std::function<bool(int)> fn) {
-
-    f32 sx = x0;
-    f32 sy = y0;
-    f32 ex = x1;
-    f32 ey = y1;
-
-    f32 x = floor(sx);
-    f32 y = floor(sy);
-    f32 diffX = ex - sx;
-    f32 diffY = ey - sy;
-    f32 stepX = (diffX > 0) ? 1 : ((diffX < 0) ? -1 : 0);
-    f32 stepY = (diffY > 0) ? 1 : ((diffY < 0) ? -1 : 0);
-
-    f32 xOffset = ex > sx ? (ceil(sx) - sx) : (sx - floor(sx));
-    f32 yOffset = ey > sy ? (ceil(sy) - sy) : (sy - floor(sy));
-    f32 angle = atan2(-diffY, diffX);
-    f32 tMaxX = xOffset / cos(angle);
-    f32 tMaxY = yOffset / sin(angle);
-    f32 tDeltaX = 1.0 / cos(angle);
-    f32 tDeltaY = 1.0 / sin(angle);
-
-    f32 manhattanDistance = abs(floor(ex) - floor(sx)) + abs(floor(ey) - floor(sy));
-    std::vector<int> visited = {};
-    for (int t = 0; t <= manhattanDistance; ++t) {
-        if (std::find(visited.begin(), visited.end(), x + y * width) == visited.end() && fn(x + y * width)) return;
-        visited.push_back(x + y * width);
-        if (abs(tMaxX) < abs(tMaxY) || isnan(tMaxY)) {
-            tMaxX += tDeltaX;
-            x += stepX;
-        } else {
-            tMaxY += tDeltaY;
-            y += stepY;
-        }
-    }
+void world::traceRays(std::span<const LineRay> rays, u32 stopMask, std::span<int> hits) {
+    const u8 *pt = GAME()->materials_table.physicsType.data();
+    const u16 *ids = real_tiles.mat_id_data();
+    const int total = (int)real_tiles.size();
+    job::parallel_for((u32)rays.size(), 8, [&](u32 r) {
+        const LineRay &ray = rays[r];
+        int hit = -1;
+        forLine(ray.x0, ray.y0, ray.x1, ray.y1, [&](int index) {
+            if (index < 0 || index >= total) return true;
+            if (stopMask & physicsBit(pt[ids[real_tiles.physical(index)]])) {
+                hit = index;
+                return true;
+            }
+            return false;
+        });
+        hits[r] = hit;
+    });
 }
 
 bool world::isPlayerInWorld() { return player != 0; }
@@ -3327,171 +5087,211 @@ std::tuple<WorldEntity *, Player *> world::getHostPlayer() {
     return std::make_tuple(pl_we, pl);
 }
 
-RigidBody *world::physicsCheck(int x, int y) {
-
-    if (getTile(x, y).mat->physicsType != PhysicsType::SOLID) return nullptr;
-
-    bool *visited = new bool[width * height];
-
-    memset(visited, false, (size_t)width * height);
-
-    u32 *cols = new u32[width * height];
-
-    memset(cols, 0x00, (size_t)width * height * sizeof(u32));  // init to all 0s
-
-    int count = 0;
-    int minX = width;
-    int maxX = 0;
-    int minY = height;
-    int maxY = 0;
+void world::recordECSCounters() {
+    registry.for_each_storage_info([](const ecs::detail::storage_info &info) {
+        const std::string name = std::string("ecs ") + info.name;
+        ME_profiler_counter((name + " count").c_str(), (f64)info.count);
+        ME_profiler_counter((name + " kb").c_str(), (f64)info.memory / 1024.0);
+    });
+    registry.for_each_feature([](ecs::feature &f) {
+        for (const ecs::system_stats &s : f.stats()) ME_profiler_counter((std::string("ecs ") + s.name + " us").c_str(), s.window_us);
+        f.begin_stats_window();
+    });
+}
 
-    physicsCheck_flood(x, y, visited, &count, cols, &minX, &maxX, &minY, &maxY);
+void world::physicsCheck(const std::vector<std::pair<int, int>> &probes) {
+    std::vector<RigidBody *> created;
+    ConnectedComponents::Labels &labels = physicsCheckLabels;
 
-    if (count > 0 && count <= 1000) {
-        if (count > 10) {
+    for (auto [x, y] : probes) {
+        if (x < 0 || x >= width || y < 0 || y >= height || real_tiles[x + y * width].mat()->physicsType != PhysicsType::SOLID) continue;
 
-            C_Surface *sfc = SDL_CreateRGBSurfaceWithFormat(0, maxX - minX + 1, maxY - minY + 1, 32, SDL_PIXELFORMAT_ARGB8888);
+        // 探测点周围的窗口 碰到窗口内侧边界的区域可能连到窗口外 当作固定的地形
+        const int wx0 = std::max(x - PHYSICS_CHECK_RADIUS, 0), wx1 = std::min(x + PHYSICS_CHECK_RADIUS + 1, width);
+        const int wy0 = std::max(y - PHYSICS_CHECK_RADIUS, 0), wy1 = std::min(y + PHYSICS_CHECK_RADIUS + 1, height);
+        const int ww = wx1 - wx0, wh = wy1 - wy0;
 
-            for (int yy = minY; yy <= maxY; yy++) {
-                for (int xx = minX; xx <= maxX; xx++) {
-                    if (visited[xx + yy * width]) {
-                        ME_get_pixel(sfc, (unsigned long long)(xx)-minX, yy - minY) = cols[xx + yy * width];
-                        real_tiles[xx + yy * width] = Tiles_NOTHING;
-                        dirty[xx + yy * width] = true;
-                    }
-                }
+        frame_arena::scope scratch;
+        u8 *solid = frame_arena::local().alloc_array<u8>(ww * wh);
+        for (int yy = 0; yy < wh; yy++) {
+            for (int xx = 0; xx < ww; xx++) solid[xx + yy * ww] = real_tiles[(wx0 + xx) + (wy0 + yy) * width].mat()->physicsType == PhysicsType::SOLID;
+        }
+        ConnectedComponents::label(solid, ww, wh, ww, labels);
+
+        const u32 id = labels.at(x - wx0, y - wy0);
+        const ConnectedComponents::Component &c = labels.components[id - 1];
+        if ((c.x0 == 0 && wx0 > 0) || (c.y0 == 0 && wy0 > 0) || (c.x1 == ww && wx1 < width) || (c.y1 == wh && wy1 < height)) continue;
+        if (c.pixels > PHYSICS_CHECK_MAX) continue;
+
+        const int minX = wx0 + c.x0, minY = wy0 + c.y0;
+        C_Surface *sfc = c.pixels > 10 ? SDL_CreateRGBSurfaceWithFormat(0, c.x1 - c.x0, c.y1 - c.y0, 32, SDL_PIXELFORMAT_ARGB8888) : nullptr;
+        for (int yy = c.y0; yy < c.y1; yy++) {
+            for (int xx = c.x0; xx < c.x1; xx++) {
+                if (labels.at(xx, yy) != id) continue;
+                const int i = (wx0 + xx) + (wy0 + yy) * width;
+                if (sfc) ME_get_pixel(sfc, (wx0 + xx) - minX, (wy0 + yy) - minY) = real_tiles[i].color();
+                real_tiles[i] = Tiles_NOTHING;
+                dirty.mark(i);
             }
+        }
+        if (!sfc) continue;
 
-            if (static_cast<bool>(visited)) delete[] visited;
-            if (static_cast<bool>(cols)) delete[] cols;
-
-            // audioEngine.PlayEvent("event:/Player/Impact");
-
-            auto tex = create_ref<Texture>(sfc);
-
-            b2PolygonShape s;
-            s.SetAsBox(1, 1);
-            RigidBody *rb = makeRigidBody(b2_dynamicBody, (f32)minX, (f32)minY, 0, s, 1, (f32)0.3, tex);
-            b2Filter bf = {};
-            bf.categoryBits = 0x0001;
-            bf.maskBits = 0xffff;
-            rb->body->GetFixtureList()[0].SetFilterData(bf);
-            rb->body->SetLinearVelocity({(f32)((rand() % 100) / 100.0 - 0.5), (f32)((rand() % 100) / 100.0 - 0.5)});
+        // audioEngine.PlayEvent("event:/Player/Impact");
 
-            rigidBodies.push_back(rb);
-            updateRigidBodyHitbox(rb);
+        auto tex = create_ref<Texture>(sfc);
 
-            lastMeshLoadZone.x--;
-            updateWorldMesh();
+        b2PolygonShape s;
+        s.SetAsBox(1, 1);
+        RigidBody *rb = makeRigidBody(b2_dynamicBody, (f32)minX, (f32)minY, 0, s, 1, (f32)0.3, tex);
+        b2Filter bf = {};
+        bf.categoryBits = 0x0001;
+        bf.maskBits = 0xffff;
+        rb->body->GetFixtureList()[0].SetFilterData(bf);
+        rb->body->SetLinearVelocity({(f32)((rand() % 100) / 100.0 - 0.5), (f32)((rand() % 100) / 100.0 - 0.5)});
 
-            return rb;
-        } else {
+        rigidBodies.push_back(rb);
+        created.push_back(rb);
+    }
 
-            for (int yy = minY; yy <= maxY; yy++) {
-                for (int xx = minX; xx <= maxX; xx++) {
-                    if (visited[xx + yy * width]) {
-                        real_tiles[xx + yy * width] = Tiles_NOTHING;
-                        dirty[xx + yy * width] = true;
-                    }
-                }
-            }
+    if (!created.empty()) {
+        updateRigidBodyHitboxes(std::move(created));
 
-            return nullptr;
-        }
-    } else {
-        delete[] visited;
-        delete[] cols;
+        lastMeshLoadZone.x--;
+        updateWorldMesh();
     }
-
-    return nullptr;
 }
 
-// Helper for World::physicsCheck that does the 4-way recursive flood fill
-void world::physicsCheck_flood(int x, int y, bool *visited, int *count, u32 *cols, int *minX, int *maxX, int *minY, int *maxY) {
-    if (*count > 1000 || x < 0 || x >= width || y < 0 || y >= height) return;
-    if (!visited[x + y * width] && getTile(x, y).mat->physicsType == PhysicsType::SOLID) {
-        if (x < *minX) *minX = x;
-        if (x > *maxX) *maxX = x;
-        if (y < *minY) *minY = y;
-        if (y > *maxY) *maxY = y;
+void world::saveWorld() {
 
-        visited[x + y * width] = true;
-        (*count)++;
-        // setTile(x, y, MaterialInstance(&Materials::GENERIC_SOLID, 0xff00ffff));
+    // 后台存档的快照可能比接下来写的数据旧 先等它结束
+    saver.wait();
 
-        cols[x + y * width] = real_tiles[x + y * width].color;
+    // 粒子中的液体不在区块里 先写回像素
+    flushLiquidParticles();
 
-        physicsCheck_flood(x + 1, y, visited, count, cols, minX, maxX, minY, maxY);
-        physicsCheck_flood(x, y + 1, visited, count, cols, minX, maxX, minY, maxY);
-        physicsCheck_flood(x - 1, y, visited, count, cols, minX, maxX, minY, maxY);
-        physicsCheck_flood(x, y - 1, visited, count, cols, minX, maxX, minY, maxY);
+    std::vector<u32> thumbnail;
+    if (!readOnly) {
+        this->metadata.save(this->worldName);
+        if (!noSaveLoad) thumbnail = indexThumbnail();
     }
-}
 
-void world::saveWorld() {
+    this->chunkCache.for_each([&](Chunk *m) { this->unloadChunk(m); });
+
+    if (!readOnly && !noSaveLoad) WorldIndex::update(this->worldName, this->metadata, std::move(thumbnail));
+}
 
-    this->metadata.save(this->worldName);
+std::vector<u32> world::indexThumbnail() {
+    const int cx = (int)std::floor((tickZone.x + tickZone.w / 2 - loadZone.x) / CHUNK_W);
+    const int cy = (int)std::floor((tickZone.y + tickZone.h / 2 - loadZone.y) / CHUNK_H);
+    std::vector<u32> out;
+    if (readChunkSummaries(cx - WorldIndex::THUMB_CHUNKS_X / 2, cy - WorldIndex::THUMB_CHUNKS_Y / 2, WorldIndex::THUMB_CHUNKS_X, WorldIndex::THUMB_CHUNKS_Y, WorldIndex::THUMB_LEVEL, out) == 0) out.clear();
+    return out;
+}
 
-    // std::vector<std::future<void>> results = {};
+bool world::saveWorldAsync() {
+    if (noSaveLoad || readOnly || saver.busy()) return false;
+
+    ME_profiler_scope_auto("SaveWorldAsync");
+    const auto start = std::chrono::steady_clock::now();
+
+    flushLiquidParticles();
+
+    std::vector<WorldSaver::Snapshot> snapshots;
+    this->chunkCache.for_each([&](Chunk *ch) {
+        chunkSaveCache(ch);
+        std::vector<u8> extras = chunkExtras(ch, false);
+        if (!ch->ChunkNeedsSave() || !ch->tiles || !ch->background) return;
+
+        WorldSaver::Snapshot &s = snapshots.emplace_back();
+        s.x = ch->x;
+        s.y = ch->y;
+        s.generationPhase = ch->generationPhase;
+        s.tiles = ChunkStoragePool::alloc_tiles(false);
+        s.layer2 = ch->layer2;
+        s.background = ChunkStoragePool::alloc_background();
+        std::copy_n(ch->tiles, CHUNK_W * CHUNK_H, s.tiles);
+        std::copy_n(ch->background, CHUNK_W * CHUNK_H, s.background);
+        s.biomes = ch->biomes_id;
+        s.pack_filename = ch->pack_filename;
+        ch->extrasHash = extras.empty() ? 0 : metadot_fnv1a(extras.data(), (int)extras.size());
+        s.extras = std::move(extras);
+        // 快照之后的修改会让 generation 再加一 下次存档照常写出
+        ch->savedGeneration = ch->generation;
+    });
 
-    // TODO: 23/7/31 修复 phmap 相关
-    for (auto &p : this->chunkCache) {
-        if (p.first == INT_MIN) continue;
-        for (auto &p2 : p.second) {
-            if (p2.first == INT_MIN) continue;
+    const size_t n = snapshots.size();
+    saver.begin(snapshots, regions.is_open() ? &regions : nullptr, [this, meta = this->metadata, thumbnail = indexThumbnail()]() mutable {
+        meta.save(this->worldName);
+        WorldIndex::update(this->worldName, meta, std::move(thumbnail));
+        METADOT_INFO(std::format("World saved in background ({0} chunks)", saver.written()).c_str());
+    });
 
-            // results.push_back(global.game->GameIsolate_.updateDirtyPool->push([&](int id) {
-            Chunk *m = p2.second;
-            this->unloadChunk(m);
-            //}));
-        }
-    }
+    const auto ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    METADOT_INFO(std::format("Saving world: {0} chunks captured in {1:.2f} ms", n, ms).c_str());
+    return true;
+}
 
-    // for (int i = 0; i < results.size(); i++) {
-    //     results[i].get();
-    // }
+// world.json 只取 metadata 中的几项 其余的键跳过
+static bool parseWorldMeta(std::string_view text, WorldMeta &meta) {
+    Json::Reader reader(text);
+    const bool ok = reader.object([&](std::string_view key) {
+        if (key != "metadata") return reader.skip();
+        return reader.object([&](std::string_view field) {
+            if (field == "worldName") return reader.string(meta.worldName);
+            if (field == "lastOpenedVersion") return reader.string(meta.lastOpenedVersion);
+            if (field == "lastOpenedTime") {
+                i64 time = 0;
+                if (!reader.number(time)) return false;
+                meta.lastOpenedTime = (time_t)time;
+                return true;
+            }
+            return reader.skip();
+        });
+    }) && reader.finish();
+    if (!ok) METADOT_ERROR(std::format("Bad world.json: {0}", reader.error()).c_str());
+    return ok;
 }
 
 WorldMeta WorldMeta::loadWorldMeta(std::string worldFileName, bool noSaveLoad) {
 
     WorldMeta meta = WorldMeta();
 
-    using json = Json::Json;
+    if (noSaveLoad) return meta;
 
-    if (!noSaveLoad) {
+    frame_arena::scope scratch;
 
-        char *metaFilePath = new char[255];
-        snprintf(metaFilePath, 255, "%s/world.json", worldFileName.c_str());
+    if (WorldArchive::is_archive(worldFileName)) {
 
-        if (!std::filesystem::exists(metaFilePath)) {
-            METADOT_INFO(std::format("New world meta @ {0}", metaFilePath).c_str());
-            meta.save(worldFileName);
+        std::string text;
+        ME_pack_reader reader = nullptr;
+        if (ME_create_file_pack_reader(worldFileName.c_str(), 0, false, &reader) == SUCCESS_PACK_RESULT) {
+            u64 index;
+            if (ME_get_pack_item_index(reader, "world.json", &index)) {
+                text.resize(ME_get_pack_item_data_size(reader, index));
+                if (ME_decompress_pack_item(reader, index, (u8 *)text.data(), (u32)text.size()) != SUCCESS_PACK_RESULT) text.clear();
+            }
+            ME_destroy_pack_reader(reader);
         }
 
-        auto c_metafile = ME_fs_readfile(metaFilePath);
-        json metafile = json::parse(c_metafile.c_str());
+        if (text.empty()) {
+            METADOT_ERROR(std::format("World archive {0} has no world.json", worldFileName).c_str());
+        } else {
+            parseWorldMeta(text, meta);
+        }
 
-        if (!metafile.empty()) {
+    } else {
 
-            json root = metafile["metadata"];
+        const std::string metaFilePath = std::format("{0}/world.json", worldFileName);
 
-            meta.worldName = root["worldName"].to<std::string>();
-            meta.lastOpenedVersion = root["lastOpenedVersion"].to<std::string>();
-            meta.lastOpenedTime = root["lastOpenedTime"].to<int>();
+        if (!std::filesystem::exists(metaFilePath)) {
+            METADOT_INFO(std::format("New world meta @ {0}", metaFilePath).c_str());
+            meta.save(worldFileName);
+        }
 
+        const std::string text = ME_fs_readfile(metaFilePath);
+        if (parseWorldMeta(text, meta)) {
             METADOT_INFO(std::format("Load World ({0} {1} {2})", meta.worldName.c_str(), meta.lastOpenedVersion.c_str(), meta.lastOpenedTime).c_str());
-        } else {
-            METADOT_BUG("FP WAS NULL");
         }
-
-        delete[] metaFilePath;
-    } else {
-        json root;
-        root = root["metadata"];
-
-        meta.worldName = root["worldName"].to<std::string>();
-        meta.lastOpenedVersion = root["lastOpenedVersion"].to<std::string>();
-        meta.lastOpenedTime = root["lastOpenedTime"].to<int>();
     }
 
     return meta;
@@ -3504,33 +5304,39 @@ bool WorldMeta::save(std::string worldFileName) {
     if (this->worldName.empty()) this->worldName = "WorldName";
     if (this->lastOpenedVersion.empty()) this->lastOpenedVersion = std::to_string(ME_buildnum());
 
-    using json = Json::Json;
-
-    json metafile = json::object();
-    json root = json::object();
-
-    // meta::dostruct::for_each(*this, [&](const char *name, const auto &value) { root.add(name, value); });
-
-    // for (auto it = root.begin(); it != root.end(); ++it) {
-    //     std::cout << it.key() << ":" << (*it).dump() << std::endl;
-    // }
-    metafile.add("metadata", root);
-    metafile.add("root_seed", global.game->RNG->root_seed);
-
-    // std::cout << metafile.print() << std::endl;
-    // std::string worldMetaData = "LoadWorldMeta = function()\nsettings_data = {}\n";
-    // SaveLuaConfig(*this, "settings_data", worldMetaData);
-    // worldMetaData += "return settings_data\nend";
-
-    METADOT_INFO(std::format("Saving world ({0})", metafile["metadata"]["worldName"].to<std::string>().c_str()).c_str());
-    std::ofstream o(metaFilePath);
-    o << metafile.print();
+    Json::Writer writer(true);
+    writer.beginObject();
+    writer.key("metadata").beginObject();
+    writer.member("worldName", this->worldName);
+    writer.member("lastOpenedVersion", this->lastOpenedVersion);
+    writer.member("lastOpenedTime", (i64)this->lastOpenedTime);
+    writer.endObject();
+    writer.member("root_seed", global.game->RNG->root_seed);
+    writer.endObject();
+
+    METADOT_INFO(std::format("Saving world ({0})", this->worldName.c_str()).c_str());
+    // 写到一半退出时旧的 world.json 还在
+    const std::string &text = writer.str();
+    if (!ME_fs_write_file_atomic(metaFilePath, text.data(), text.size())) {
+        METADOT_ERROR(std::format("Failed to replace {0}", metaFilePath).c_str());
+        return false;
+    }
 
     return true;
 }
 
 world::~world() {
 
+    // 存档任务还要往 regions 写
+    saver.wait();
+
+    // 加载任务引用了 this 必须先等它们结束
+    chunkLoader.shutdown();
+    chunkLoader.collect(loadedChunks, cancelledChunks);
+    for (Chunk *ch : loadedChunks) releaseChunk(ch);
+    for (Chunk *ch : cancelledChunks) releaseChunk(ch);
+    regions.close();
+
     real_tiles.clear();
     delete[] flowX;
     delete[] flowY;
@@ -3539,31 +5345,17 @@ world::~world() {
     real_layer2.clear();
     background.clear();
 
-    for (auto &v : cells) {
-        delete v;
-    }
     cells.clear();
 
-    world_sys.tickPool->clear_queue();
-    world_sys.tickVisitedPool->clear_queue();
-    world_sys.updateRigidBodyHitboxPool->clear_queue();
-
-    // tickPool->stop(false);
-    // delete tickPool;
-    // tickVisitedPool->stop(false);
-    // delete tickVisitedPool;
-    // updateRigidBodyHitboxPool->stop(false);
-    // delete updateRigidBodyHitboxPool;
-
     delete[] newTemps;
 
-    delete[] dirty;
-    delete[] layer2Dirty;
-    delete[] backgroundDirty;
+    dirty.release();
+    layer2Dirty.release();
+    backgroundUploads.clear();
+    backgroundReleases.clear();
     delete[] lastActive;
     delete[] active;
-    delete[] tickVisited1;
-    delete[] tickVisited2;
+    tickVisited.release();
 
     auto b2world_ptr = b2world.release();
     delete b2world_ptr;
@@ -3572,10 +5364,16 @@ world::~world() {
         delete v;
     }
     rigidBodies.clear();
+    for (auto &v : frozenBodies) {
+        delete v.rb;
+    }
+    frozenBodies.clear();
 
     staticBody->clean();
     delete staticBody;
 
+    rigidBodyPool.clear();
+
     for (auto &v : polys2s) {
         for (auto &v1 : v) {
             // if (static_cast<bool>(v1)) delete v1;
@@ -3592,13 +5390,6 @@ world::~world() {
     }
     worldRigidBodies.clear();
 
-    toLoad.clear();
-
-    for (auto &ch : toLoadAsyncList) {
-        // delete v;
-    }
-    toLoadAsyncList.clear();
-
     for (auto &v : readyToMerge) {
         v->ChunkDelete();
     }
@@ -3610,17 +5401,7 @@ world::~world() {
 
     distributedPoints.clear();
 
-    for (auto &v : chunkCache) {
-        for (auto &v2 : v.second) {
-            if (abs(v2.first) >= 128) {
-                METADOT_ERROR("Abnormal chunk delete %d", v2.first);
-                continue;
-            }
-            v2.second->ChunkDelete();
-            delete v2.second;
-        }
-        v.second.clear();
-    }
+    chunkCache.for_each([](Chunk *ch) { ChunkStoragePool::free_chunk(ch); });
     chunkCache.clear();
 
     for (auto &v : populators) {
@@ -3,44 +3,53 @@
 #ifndef ME_WORLD_HPP
 #define ME_WORLD_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <deque>
 #include <future>
+#include <memory>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
 #include "chunk.hpp"
 #include "engine/audio/audio.h"
 #include "engine/core/const.h"
+#include "engine/core/job.h"
 #include "engine/core/macros.hpp"
 #include "engine/ecs/ecs.hpp"
+#include "engine/game_utils/cells.h"
+#include "engine/game_utils/rng.h"
 #include "engine/physics/box2d/inc/box2d.h"
+#include "engine/physics/connected_components.hpp"
 #include "engine/utils/utility.hpp"
 #include "game/player.hpp"
 #include "game_basic.hpp"
 #include "game_datastruct.hpp"
 #include "libs/fastnoise/fastnoise.h"
 #include "libs/parallel_hashmap/phmap.h"
+#include "rigidbody_pool.hpp"
+#include "world_cells.hpp"
+#include "world_chunkmap.hpp"
+#include "world_dirty.hpp"
+#include "world_entity_grid.hpp"
+#include "world_gpu_cells.hpp"
+#include "world_interest.hpp"
+#include "world_light.hpp"
+#include "world_loader.hpp"
+#include "world_nav.hpp"
+#include "world_partition.hpp"
+#include "world_points.hpp"
+#include "world_replication.hpp"
+#include "world_save.hpp"
+#include "world_visited.hpp"
 
 namespace ME {
 
 class Populator;
 class WorldGenerator;
 class Player;
-struct CellData;
-
-class LoadChunkParams {
-public:
-    int x;
-    int y;
-    bool populate;
-    long long time;
-    LoadChunkParams(int x, int y, bool populate, long long time) {
-        this->x = x;
-        this->y = y;
-        this->populate = populate;
-        this->time = time;
-    }
-};
 
 struct WorldMeta {
     std::string worldName;
@@ -53,11 +62,28 @@ struct WorldMeta {
 };
 // METADOT_STRUCT(WorldMeta, worldName, lastOpenedVersion, lastOpenedTime);
 
-struct WorldSystem {
-    using TPL = scope<thread_pool>;
-    TPL tickPool;
-    TPL tickVisitedPool;
-    TPL updateRigidBodyHitboxPool;
+// updateRigidBodyHitboxes 在 worker 上算出的新形状 只有 surface 和多边形 不涉及 b2world
+struct RigidBodyHitbox {
+    struct Piece {
+        std::vector<b2PolygonShape> polys;
+        std::list<TPPLPoly> outline;
+        C_Surface *surface = nullptr;
+        bool weld = false;
+    };
+
+    RigidBody *rb = nullptr;
+    bool keep = false;     // 没有 surface 不处理
+    bool destroy = false;  // 剩余像素不足以成为刚体
+    int minX = 0, minY = 0;
+    std::vector<Piece> pieces;
+};
+
+// 远离玩家并已经静止的刚体 像素写进 real_tiles 随区块保存 b2Body 停用
+// 玩家靠近时把仍然完好的像素取回 恢复模拟
+struct FrozenRigidBody {
+    RigidBody *rb = nullptr;
+    // 写入世界的像素 first 为 real_tiles 下标 second 为 rb->tiles 下标
+    std::vector<std::pair<u32, u32>> baked;
 };
 
 class world {
@@ -67,13 +93,46 @@ public:
     std::string worldName = "";
     WorldMeta metadata{};
     bool noSaveLoad = false;
+    // 从 WorldArchive 的包中打开 区块照常读取 但不写回 也不保存 world.json
+    bool readOnly = false;
+
+    // 区块存档 noSaveLoad 时不打开
+    RegionStore regions{};
+    // saveWorldAsync 的后台任务 必须在 regions 之后析构
+    WorldSaver saver{};
+
+    // MemoryBudget 的统计 都是估计的字节数
+    u64 planeBytes() const;
+    u64 chunkBytes();
+    u64 rigidBodyBytes() const;
+    u64 particleBytes() const { return cells.memory_bytes(); }
+    // 卸载离中心最远的区块 直到估计释放 bytes 字节 覆盖像素缓冲的区块和它们的邻居保留 返回估计释放的字节数
+    // 卸载的区块在再次靠近时按原来的流程重新加载
+    u64 trimDistantChunks(u64 bytes);
+
+    // 区块读取/生成流水线 frame() 每帧取走完成的区块
+    // 优先加载玩家按当前速度 CHUNK_LOAD_LOOKAHEAD 个tick后所在位置附近的区块 预测最多偏移 CHUNK_LOAD_LOOKAHEAD_MAX 个区块
+    // tickChunks 会预加载 loadZone 之外最多 9 个区块 超出 loadZone CHUNK_LOAD_MARGIN 个区块的请求被取消
+    static constexpr f32 CHUNK_LOAD_LOOKAHEAD = 30.0f;
+    static constexpr f32 CHUNK_LOAD_LOOKAHEAD_MAX = 4.0f;
+    static constexpr int CHUNK_LOAD_MARGIN = 10;
+    // pregenerate 每次处理的窗口边长 (区块) 窗口连同外围一起常驻内存
+    static constexpr int PREGEN_WINDOW = 12;
+    ChunkLoader chunkLoader{};
+    std::vector<Chunk *> loadedChunks{};
+    std::vector<Chunk *> cancelledChunks{};
+
+    // readyToMerge 的区块按行合并 每帧受 GlobalDEF::merge_budget_us 限制 没合并完的区块留到下一帧继续
+    Chunk *mergingChunk = nullptr;
+    int mergingRow = 0;
+    bool mergePending() const { return mergingChunk || !readyToMerge.empty(); }
 
     R_Target *target = nullptr;
 
     ~world();
 
     struct {
-        std::vector<CellData *> cells;
+        CellParticles cells;
         std::vector<RigidBody *> rigidBodies;
         std::vector<RigidBody *> worldRigidBodies;
         std::vector<std::vector<MEvec2>> worldMeshes;
@@ -81,37 +140,77 @@ public:
 
         std::vector<std::vector<b2PolygonShape>> polys2s = {};
 
-        std::vector<LoadChunkParams> toLoad;                // 需要加载的区块的列表
-        std::vector<std::future<Chunk *>> toLoadAsyncList;  // 区块生成加载异步对象列表
-        std::deque<Chunk *> readyToMerge;                   // 区块合并列表
+        std::deque<Chunk *> readyToMerge;  // 区块合并列表
 
-        std::vector<PlacedStructure> structures;
-        std::vector<MEvec2> distributedPoints;
-        phmap::flat_hash_map<int, phmap::flat_hash_map<int, Chunk *>> chunkCache;
+        // 已放置结构的包围盒 和单位正方形上的分布点 都带空间索引
+        StructureIndex structures;
+        DistributedPoints distributedPoints;
+        ChunkMap chunkCache;
         std::vector<Populator *> populators;
 
         ecs::entity_id player;
+        // WorldEntity 的空间网格 tickEntities 中更新
+        EntityGrid entityGrid;
+        // NPC 寻路 区块通行网格在 tickEntities 中更新
+        NavService nav;
+        // 玩法查询用的发光材料光照 同样在 tickEntities 中更新
+        LightField light;
+        // 向客户端同步像素 没有客户端时不做任何事 在 tickEntities 中发送
+        ReplicationServer replication;
+        // 实验性的多进程分区 没有配置时每个区块都由本进程模拟
+        WorldPartition partition;
+        // 旁观镜头等额外的关注区域 决定 tickZone 内各区块的模拟频率 见 InterestZones
+        InterestZones interests;
     };
 
     struct {
         ecs::registry registry;
-
-        WorldSystem world_sys;
     };
 
     ecs::registry &Reg() { return registry; }
+    // 把每个组件存储的大小和每个系统上次记录之后的耗时写入分析器计数器
+    void recordECSCounters();
 
     bool *hasPopulator = nullptr;
     int highestPopulator = 0;
+
+    // 每个 Populator 的累计耗时 下标与 populators 相同 applyPopulate 在任务线程上并行累加
+    struct PopulatorStats {
+        std::atomic<u64> calls{0};
+        std::atomic<u64> totalUs{0};
+        std::atomic<u64> maxUs{0};
+
+        void add(u64 us) {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            totalUs.fetch_add(us, std::memory_order_relaxed);
+            u64 prev = maxUs.load(std::memory_order_relaxed);
+            while (prev < us && !maxUs.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+            }
+        }
+    };
+    std::unique_ptr<PopulatorStats[]> populatorStats;
+    // 地形和群系噪声 init 之后不再修改 生成任务并行读取
+    // noise 使用默认的 cellular 参数 biomeNoise 用于地表带以外的群系
     FastNoise noise;
+    FastNoise biomeNoise;
+
+    // 群系 ID 在 init 时按名字解析一次 查询时不再做字符串查找
+    struct BiomeIds {
+        int defaultId = 0;
+        int plains = 0, mountains = 0, forest = 0;
+        int test[4] = {}, test2[4] = {};
+    } biomeIds;
     Audio *audioEngine = nullptr;
+    // init 时解析 见 AudioEvent
+    AudioEvent explodeEvent = AudioEvent::NONE;
 
     // 这里应该不同于区块类储存的材料实例
     // 这里储存的应该是世界改变的材料实例
-    std::vector<MaterialInstance> real_tiles{};
-    std::vector<MaterialInstance> real_layer2{};
+    CellStore real_tiles{};
+    CellStore real_layer2{};
 
-    std::vector<u32> background{};
+    // 背景的 CPU 副本 供脚本 光照和存档使用 绘制用的是 game 的 BackgroundAtlas
+    RingArray<u32> background{};
 
     f32 *flowX = nullptr;
     f32 *flowY = nullptr;
@@ -121,28 +220,240 @@ public:
     u16 width = 0;
     u16 height = 0;
     int tickCt = 0;
+    // world::tick 和区块生成中随机数的根种子 见 FastRNG RNG_Chunk
+    u64 simSeed = 0;
+    // RNG_Chunk 的阶段 生成器一个 下标为 i 的 Populator 用 CHUNK_SEED_POPULATE + i
+    static constexpr u32 CHUNK_SEED_GENERATE = 0;
+    static constexpr u32 CHUNK_SEED_POPULATE = 1;
+
+    // tick_checksum 打开时每个 tick 结束后计算的像素哈希 (real_tiles) 用来逐位比较并行或向量化的实现与参考实现
+    // chunkHashes 按 width x height 内的区块网格排列 tickHash 为这一 tick 所有区块按顺序合并的结果
+    // stateHash 从世界加载开始逐 tick 滚动合并 tickHash 两次运行只要有一个 tick 不同 之后就一直不同
+    std::vector<u64> chunkHashes;
+    u64 tickHash = 0;
+    u64 stateHash = 0;
 
     R_Image *fireTex = nullptr;
-    bool *tickVisited1 = nullptr;
-    bool *tickVisited2 = nullptr;
+    VisitedMap tickVisited{};
+
+    // world::tick 每个阶段复用的批量任务数据
+    std::vector<std::pair<int, int>> tickPhaseChunks{};
+    job_worker_local<std::vector<CellData>> tickSpawnedCells{};
+
+    struct Explosion {
+        i32 x, y;
+        i32 radius;
+    };
+    std::vector<Explosion> pendingExplosions{};
+    // world::explosions 每个 worker 产生的飞溅粒子 以及这一批改动过的区块
+    job_worker_local<std::vector<CellData>> explosionCells{};
+    std::vector<u8> explosionTouched{};
+    u32 explosionSerial = 0;
+
+    // OnMaterialBatch(cells, count, chunkX, chunkY) 的批量数据 cells 是 ScriptCell 数组的 lightuserdata
+    // 脚本用 ffi.cdef(SCRIPT_CELL_CDEF) 声明后 ffi.cast("ME_ScriptCell *", cells) 按下标 0 到 count - 1 读写
+    // material color temperature 可以修改 x y 只读
+    struct ScriptCell {
+        i32 x, y;
+        u32 material;
+        u32 color;
+        i32 temperature;
+    };
+    static constexpr const char *SCRIPT_CELL_CDEF = "typedef struct { int32_t x, y; uint32_t material; uint32_t color; int32_t temperature; } ME_ScriptCell;";
+    struct ScriptBatch {
+        int cx = 0, cy = 0;
+        std::vector<ScriptCell> cells;
+        std::vector<ScriptCell> original;
+        std::vector<u32> index;
+    };
+    std::vector<ScriptBatch> scriptBatches{};
+
+    // 按 tickZone 内的区块排列 这一 tick 区块需要的遍数 见 world::tick
+    std::vector<u8> tickChunkIterations{};
+    // 同样按 tickZone 内的区块排列 这一 tick 各遍中离开原位置的水和岩浆像素 以及燃烧的火像素 由区块任务顺带统计 驱动环境音
+    // cells particles clocks 是区块任务处理的像素 生成的 CellData 和耗时 (ME_profiler_get_clock) 由 tickChunkCosts 计入 Chunk::tickCost
+    struct ChunkActivity {
+        u32 water = 0;
+        u32 lava = 0;
+        u32 fire = 0;
+        u32 cells = 0;
+        u32 particles = 0;
+        u64 clocks = 0;
+    };
+    std::vector<ChunkActivity> tickActivity{};
+    // tickActivity 一行的区块数 第 i 个区块的左上角是 tickZone.x + (i % tickActivityChunksX) * CHUNK_W
+    int tickActivityChunksX = 0;
+    // tickActivity 第 i 个区块 还没有加载时为 nullptr
+    Chunk *tickActivityChunk(size_t i);
+    // gpu_cell_sim 打开时在 CPU 的各遍之后模拟简单的 SAND/SOUP/GAS 像素
+    // gpuCellRegions 按 tickZone 内 ACTIVE_REGION_SIZE 见方的区域排列 为这一 tick 交给 GPU 的区域
+    GpuCellSim gpuCells{};
+    std::vector<u8> gpuCellRegions{};
     i32 *newTemps = nullptr;
+
+    // tickTemperature 按 TEMPERATURE_TILE 见方分块并行 边长是 ACTIVE_REGION_SIZE 的倍数 唤醒区域时各块互不重叠
+    // 环境温度是 0 度 分三级跳过:
+    //   分块和一圈邻居全是 0 度且没有 addTemp 材料时记为冷 之后只在覆盖的区域唤醒或相邻分块上次有变化时重新读取
+    //   热的分块中 TEMPERATURE_BLOCK 见方的小块和八邻域都没有热量时整块跳过
+    //   其余像素逐个计算 结果与全部逐像素计算相同 邻域求和按 cpu::level() 选择向量版本
+    static constexpr int TEMPERATURE_TILE = 64;
+    static constexpr int TEMPERATURE_BLOCK = 4;
+    struct TemperatureMaterial {
+        f32 conductionOther;
+        f32 conductionSelf;
+        u32 addTemp;
+    };
+    struct TemperatureScratch {
+        std::vector<u16> ids;
+        std::vector<mat_temperature> temps;
+        std::vector<f32> factor;     // |t| / 64 * conductionOther
+        std::vector<f32> weighted;   // t * factor
+        std::vector<u8> hotBlocks;   // 含一圈邻居小块 有非 0 温度或 addTemp
+        std::vector<u8> needBlocks;  // 自身或八邻域有热量 需要逐像素计算
+        std::vector<f32> sumV;       // 一行中 3x3 邻域 weighted 之和
+        std::vector<f32> sumN;       // 一行中 3x3 邻域 factor 之和 加 0.01
+    };
+    std::vector<TemperatureMaterial> temperatureMaterials{};
+    std::vector<u8> temperatureTileChanged{};
+    std::vector<u8> temperatureTilePrevChanged{};
+    std::vector<u8> temperatureTileCold{};
+    std::vector<u8> temperatureTileRun{};
+    // temperatureTileCold 对应的分块网格 tickZone 移动后作废
+    int temperatureGridX = 0, temperatureGridY = 0, temperatureGridW = 0, temperatureGridH = 0;
+    // 上一次 tickTemperature 中温度有变化的分块 (逻辑坐标) 温度图只上传这些部分
+    std::vector<DirtyRect> temperatureChangedRects{};
+    job_worker_local<TemperatureScratch> tickTemperatureScratch{};
     bool needToTickGeneration = false;
 
-    bool *dirty = nullptr;
-    bool *active = nullptr;
-    bool *lastActive = nullptr;
-    bool *layer2Dirty = nullptr;
-    bool *backgroundDirty = nullptr;
+    DirtyMap dirty{};
+
+    // physicsCheck 在探测点周围 (2 * PHYSICS_CHECK_RADIUS + 1) 见方的窗口中标记 SOLID 的连通分量
+    static constexpr int PHYSICS_CHECK_MAX = 1000;
+    static constexpr int PHYSICS_CHECK_RADIUS = 32;
+    // 每个 tick 随机检查的点数
+    static constexpr int PHYSICS_CHECK_PROBES = 4;
+    ConnectedComponents::Labels physicsCheckLabels{};
+
+    // 按 ACTIVE_REGION_SIZE x ACTIVE_REGION_SIZE 分区的休眠状态
+    // lastActive 记录上次 tick 以来区域内是否有像素改变 active 为剩余的唤醒 tick 数
+    // 区域自身或相邻区域有改变才会被 tick 连续 ACTIVE_REGION_SLEEP_TICKS 次没有改变后进入休眠
+    // lastActive 会被火焰和温度的并行任务同时置位 所以是 atomic 只用 relaxed 读写
+    static constexpr int ACTIVE_REGION_SHIFT = 4;
+    static constexpr int ACTIVE_REGION_SIZE = 1 << ACTIVE_REGION_SHIFT;
+    static constexpr u8 ACTIVE_REGION_SLEEP_TICKS = 16;
+    u8 *active = nullptr;
+    std::atomic<bool> *lastActive = nullptr;
+    int activeRegionsX = 0;
+    int activeRegionsY = 0;
+    DirtyMap layer2Dirty{};
+
+    // 背景按区块上传到 game 的 BackgroundAtlas 不再逐像素标记
+    // 合并完成或被脚本改过的区块记入 backgroundUploads 卸载的区块记入 backgroundReleases (ChunkMap::key) 由 game 每帧取走
+    // backgroundReset 表示图集中的内容都已过时 新建的世界从空图集开始
+    std::vector<u64> backgroundUploads{};
+    std::vector<u64> backgroundReleases{};
+    bool backgroundReset = true;
+    // 把与 [x, x + w) x [y, y + h) 重叠的区块记入 backgroundUploads
+    void queueBackgroundRect(int x, int y, int w, int h);
+    // 从 background 读出区块 (cx, cy) 的 CHUNK_W x CHUNK_H 个像素 像素缓冲外的部分为 0
+    void readChunkBackground(int cx, int cy, u32 *out) const;
+
+    // tickZone 内 SOUP 像素的统计 由 updateFluidSummary 更新 没有液体时跳过水面相关的着色器
+    struct FluidSummary {
+        size_t count = 0;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;  // 包围盒 [x0, x1] x [y0, y1]
+    };
+    FluidSummary fluidSummary{};
     MErect loadZone;
     MErect lastLoadZone{};
     MErect tickZone{};
     MErect meshZone{};
     MErect lastMeshZone{};
     MErect lastMeshLoadZone{};
+    // 当前持有世界碰撞刚体的区块 离开 meshZone 的区块在 updateWorldMesh 中销毁刚体
+    std::vector<Chunk *> meshChunks{};
+    // meshZone 不变时 updateWorldMesh 只重新生成这些区块
+    std::vector<Chunk *> meshRefreshChunks{};
+
+    // 物理 LOD 距离见 GlobalDEF::physics_lod_dist 距离小于 PHYSICS_LOD_THAW 倍时恢复 避免在边界反复冻结
+    static constexpr f32 PHYSICS_LOD_THAW = 0.75f;
+    std::vector<FrozenRigidBody> frozenBodies{};
+
+    // 物理时钟 physicsAccumulator 为还没有求解的时间(毫秒) physicsStep 为已经求解的步数
+    f64 physicsAccumulator = 0;
+    u64 physicsStep = 0;
+
+    // 大片流动的液体转换为 b2ParticleSystem 中的粒子 静止或碰到像素后写回 见 GlobalDEF::tick_liquid_particles
+    // 粒子的 userData 是 liquidSlots 的下标 保存原来的像素
+    struct LiquidParticle {
+        MaterialInstance tile;
+        u8 still = 0;
+    };
+    static constexpr int LIQUID_SCAN_TICKS = 8;
+    static constexpr int LIQUID_REGION_MAX = 16384;
+    static constexpr int LIQUID_PARTICLE_MAX = 32768;
+    // 速度低于 LIQUID_SETTLE_SPEED 连续 LIQUID_SETTLE_TICKS 次 tick 后写回像素
+    static constexpr f32 LIQUID_SETTLE_SPEED = 2.0f;
+    static constexpr u8 LIQUID_SETTLE_TICKS = 8;
+    b2ParticleSystem *liquidParticles = nullptr;
+    std::vector<LiquidParticle> liquidSlots{};
+    std::vector<u32> liquidFreeSlots{};
+    // 扫描线填充 liquidBlocked 记录这一轮中因为太大放弃的区域
+    std::vector<u64> liquidVisited{};
+    std::vector<u64> liquidBlocked{};
+    std::vector<u32> liquidFilled{};
+    std::vector<u32> liquidVisitedList{};
+    std::vector<u32> liquidStack{};
+
+    // 连通液体的液面整平 见 GlobalDEF::liquid_level_solver
+    // 每 LIQUID_LEVEL_TICKS 个 tick 把一片液体最高处的液面像素搬到最低的空位 一次就回到同一高度
+    // 打开时 SOUP 的逐像素规则最多跑 LIQUID_SURFACE_ITERATIONS 遍 只负责液面附近的流动
+    static constexpr int LIQUID_LEVEL_TICKS = 4;
+    static constexpr int LIQUID_BODY_MAX = 65536;
+    static constexpr int LIQUID_SURFACE_ITERATIONS = 2;
+    std::vector<u32> liquidSurface{};
+    std::vector<u32> liquidOpenings{};
+
+    // 这一 tick 写进 real_tiles 的刚体像素属于哪个刚体 game::tick 写入刚体时记录 取回时清除
+    // 值为 objectOwnerBodies 下标 + 1 0 表示不是刚体像素 碰到 OBJECT 像素时不需要遍历 rigidBodies
+    std::vector<u16> objectOwner{};
+    std::vector<RigidBody *> objectOwnerBodies{};
+    std::vector<u32> objectOwnerCells{};
+    // tickCells 在 worker 上运行 撞到刚体的 cell 先记下冲量 回到主线程后由 applyObjectImpulses 施加
+    struct ObjectImpulse {
+        u16 owner;
+        b2Vec2 point;
+        b2Vec2 impulse;
+    };
+    // cell 的质量按一个像素 (刚体 density 为 1) 速度从 像素/tick 换算为 像素/秒
+    static constexpr f32 CELL_OBJECT_IMPULSE = 30.0f;
+    std::vector<ObjectImpulse> objectImpulses{};
+
+    // tickCells 分两步: 先并行积分所有 cell 只读 real_tiles 结果写进 cellSteps
+    // 再把要落地的 cell 按 CHUNK_W x CHUNK_H 分格 同奇偶的格互不相邻 分四轮并行写回
+    // 落地时最多写到碰撞点 CELL_DEPOSIT_REACH 以外 (见 depositCell 的螺旋搜索) 所以格边长至少为它的两倍
+    static constexpr int CELL_DEPOSIT_REACH = 16;
+    static_assert(CHUNK_W >= CELL_DEPOSIT_REACH * 2 && CHUNK_H >= CELL_DEPOSIT_REACH * 2);
+    enum CellAction : u8 { CellAction_Keep = 0, CellAction_Kill, CellAction_Deposit };
+    struct CellStep {
+        u8 action;
+        // 碰到的刚体 0 表示没有
+        u16 owner;
+        // 这一 tick 开始时的位置 落地时先尝试写到这里
+        i32 lx, ly;
+    };
+    std::vector<CellStep> cellSteps{};
+    std::vector<u8> cellDead{};
+    std::vector<std::vector<u32>> cellDepositBins{};
+    std::vector<u32> cellDepositPhases[4]{};
+    // 跨越格边界太远或贴近地图边缘的 cell 最后在单线程中写回
+    std::vector<u32> cellDepositSerial{};
 
     b2Vec2 gravity{};
     ME::scope<b2World> b2world = nullptr;
     RigidBody *staticBody = nullptr;
+    // makeRigidBody/makeRigidBodyMulti 从这里取 RigidBody 和 tiles 销毁刚体时交还
+    RigidBodyPool rigidBodyPool;
     WorldGenerator *gen = nullptr;
 
     void init(std::string worldPath, u16 w, u16 h, R_Target *renderer, Audio *audioEngine, WorldGenerator *generator);
@@ -151,46 +462,263 @@ public:
     void setTile(int x, int y, MaterialInstance type);
     MaterialInstance getTileLayer2(int x, int y);
     void setTileLayer2(int x, int y, MaterialInstance type);
+    // 脚本通过 _ME_worldview 直接写入 real_tiles/background 之后调用 检查并标记 [x, x + w) x [y, y + h)
+    void commitRawWrites(int x, int y, int w, int h, bool tiles, bool background);
     void tick();
+    // 在 job 线程上按区块计算 chunkHashes 并更新 tickHash/stateHash tick 结束时调用
+    void computeTickChecksum();
+    // tick 中单个像素的处理 Pass 为 tick 内第几遍扫描 只有用到的组合有特化
+    template <int Pass, PhysicsType Type>
+    void tickCell(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts);
+    void tickFireCell(int x, int y, int index, MaterialInstance &tile, int iter, FastRNG &rng, std::vector<CellData> &parts);
     void tickTemperature();
+    // 把唤醒区域内的脚本材料按区块收集成 ScriptCell 数组 每个区块调用一次 OnMaterialBatch 再写回脚本的修改
+    void tickScriptMaterials();
+    // cold 为分块和一圈邻居全是 0 度并且没有 addTemp 材料
+    bool tickTemperatureTile(int x0, int y0, int x1, int y1, bool &cold);
+    // 把 tickActivity 和区块的 remeshes 计入 tickZone 内各区块的 Chunk::tickCost
+    void tickChunkCosts();
     void frame();
     void tickCells();
+    CellStep integrateCell(size_t p);
+    bool depositCell(size_t p, i32 lx, i32 ly);
     void renderCells(unsigned char **texture);
     void tickObjectBounds();
-    void tickObjects();
+    // dtMs 为这一 tick 经过的时间 累积够 GlobalDEF::physics_step_rate 的步长才求解 一个 tick 可能求解零次或多次
+    void tickObjects(f64 dtMs);
     void tickObjectsMesh();
+    // 帧在两个物理步之间的位置 thruTick 为帧在两个 tick 之间的位置 绘制比物理晚一步 不外推
+    // GlobalDEF::physics_interpolate 关闭时 interpolatedTransform 直接返回当前变换
+    f32 physicsAlpha(f32 thruTick, f64 msPerTick) const;
+    // 绘制刚体用的变换 在 interpPos 和当前变换之间插值
+    void interpolatedTransform(const RigidBody *rb, f32 alpha, b2Vec2 &pos, f32 &angle) const;
+    // 物理 LOD 和降频的中心 玩家的中心 没有玩家时为世界中心
+    b2Vec2 physicsFocus();
+    // 按到玩家的距离冻结/恢复刚体 需要在刚体像素从世界中移除之后调用
+    void tickObjectLOD();
+    bool freezeRigidBody(RigidBody *rb);
+    // 刚体当前变换覆盖的世界像素 每个世界像素只对应一个刚体像素 结果缓存在 rb->raster
+    const std::vector<std::pair<u32, u32>> &rasterRigidBody(RigidBody *rb);
+    void thawRigidBody(FrozenRigidBody &frozen);
+    // 世界像素整体移动后 冻结刚体跟着移动 移出世界的保留为地形
+    void shiftFrozenBodies(int dx, int dy);
+    // 液体粒子 需要在 tickObjects 之前调用
+    void tickLiquidParticles();
+    // 超过 maxCells 个像素时放弃
+    bool floodLiquid(u32 start, size_t maxCells = LIQUID_REGION_MAX);
+    void levelLiquidBodies();
+    void convertLiquidRegion();
+    bool depositLiquidParticle(int i);
+    // 全部写回像素 保存世界或关闭选项时使用
+    void flushLiquidParticles();
+    void shiftLiquidParticles(int dx, int dy);
+    // 刚体像素的所有者 见 objectOwner
+    u16 addObjectOwner(RigidBody *rb);
+    void setObjectOwner(u32 idx, u16 owner) {
+        objectOwner[idx] = owner;
+        objectOwnerCells.push_back(idx);
+    }
+    RigidBody *objectOwnerAt(u32 idx) const {
+        const u16 owner = objectOwner[idx];
+        return owner ? objectOwnerBodies[owner - 1] : nullptr;
+    }
+    // 需要在 clearObjectOwners 之前调用
+    void applyObjectImpulses();
+    void clearObjectOwners();
     void tickChunks();
     void tickChunkGeneration();
-    void addCell(CellData *cell);
+    // 8 个邻居都已加载并且阶段不低于 m 时 m 可以推进一个阶段
+    bool readyToAdvance(Chunk *m);
+    // ready 中的区块各推进一个阶段 按着色分组并行执行 Populator render 时加入合并列表
+    // 超过 deadline 时停在当前分组 剩下的区块保持原来的阶段 返回是否全部推进
+    bool advanceGeneration(std::vector<Chunk *> &ready, bool render, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    // 把以 (cx, cy) 为中心 radius 个区块范围内的区块生成并填充到最高阶段后写盘
+    // 在主线程上同步执行 需要在 queueLoadChunk 之前调用 已经在 chunkCache 中的区块保持不变
+    void pregenerate(int cx, int cy, int radius);
+    void wakeRegions(int x, int y, int w, int h);
+    void wakeAllRegions();
+    void collectActiveRegions();
+    void updateFluidSummary();
+    bool isRegionAwake(int x, int y) const { return active[(x >> ACTIVE_REGION_SHIFT) + (y >> ACTIVE_REGION_SHIFT) * activeRegionsX] != 0; }
+    void addCell(const CellData &cell);
+    // 物体压住格子 idx 刚体和实体共用
+    // 原来是 AIR 时直接写入 stamp 原来是 SAND 或 SOUP 时先把旧格子换成 particle(旧格子) 返回的粒子再写入
+    // 返回旧格子的物理类型 其他类型不改动
+    template <typename F>
+    PhysicsType displaceCell(u32 idx, const MaterialInstance &stamp, F &&particle) {
+        auto tile = real_tiles[idx];
+        const PhysicsType pt = (PhysicsType)tile.mat()->physicsType;
+        if (pt == PhysicsType::SAND || pt == PhysicsType::SOUP) {
+            addCell(particle((MaterialInstance)tile));
+        } else if (pt != PhysicsType::AIR) {
+            return pt;
+        }
+        tile = stamp;
+        return pt;
+    }
+    // 把实体的矩形 (x, y, w, h) 按行写入 stamp 超出世界的部分裁掉 写入的位置追加到 stamps
+    // 按行直接读材料id 只有能被挤开的格子才调用 displaceCell 挤出的粒子向 (vx, vy) 的反方向飞出
+    void stampRect(int x, int y, int w, int h, const MaterialInstance &stamp, f32 vx, f32 vy, FastRNG &rng, std::vector<u32> &stamps);
     void explosion(int x, int y, int radius);
+    // 在下一次 world::tick 开始时与同一帧的其它爆炸一起处理
+    void queueExplosion(int x, int y, int radius) { pendingExplosions.push_back({x, y, radius}); }
+    // 一批爆炸按区块并行光栅化 音效只播放一次 只标记被改动区块的碰撞网格
+    void explosions(std::span<const Explosion> list);
     RigidBody *makeRigidBody(b2BodyType type, f32 x, f32 y, f32 angle, b2PolygonShape shape, f32 density, f32 friction, TextureRef texture);
     RigidBody *makeRigidBodyMulti(b2BodyType type, f32 x, f32 y, f32 angle, std::vector<b2PolygonShape> shape, f32 density, f32 friction, TextureRef texture);
     void updateRigidBodyHitbox(RigidBody *rb);
+    // 并行计算所有刚体的新形状 再在当前线程创建/销毁 Box2D 刚体
+    void updateRigidBodyHitboxes(std::vector<RigidBody *> rbs);
+    void applyRigidBodyHitbox(RigidBodyHitbox &hb);
     void updateChunkMesh(Chunk *chunk);
+    void updateChunkGrid(Chunk *chunk, int chTx, int chTy);
+    void destroyChunkMesh(Chunk *chunk);
     void updateWorldMesh();
     void queueLoadChunk(int cx, int cy, bool populate, bool render);
-    Chunk *loadChunk(LoadChunkParams para);
-    Chunk *loadChunk(Chunk *ch, bool populate, bool render);
+    bool readChunk(Chunk *ch);    // 读取存档 没有存档或者读取失败时返回 false
+    void createChunk(Chunk *ch);  // 生成并执行第0阶段填充
+    void releaseChunk(Chunk *ch);
     void unloadChunk(Chunk *ch);
-    void writeChunkToDisk(Chunk *ch);
+    // extras 为 chunkExtras 的结果
+    void writeChunkToDisk(Chunk *ch, const std::vector<u8> &extras);
+    // 收集区块上的结构 非玩家实体和动态刚体 编码为 ChunkExtras 还没放回世界的 ch->extras 一并写入
+    // take 时把实体和刚体从世界中移除 (卸载) 否则只复制 (存档) 内容变化时 generation 加一
+    std::vector<u8> chunkExtras(Chunk *ch, bool take);
+    // 区块合并进世界之后 把存档里的结构和实体放回世界
+    void restoreChunkExtras(Chunk *ch);
+    // 把 [cx, cx + cw) x [cy, cy + chh) 的区块缩略图 (ChunkCodec 第 level 级) 拼成一张图 用于小地图和远景
+    // out 行宽 cw * ChunkCodec::summary_width(level) 0xAARRGGBB 没有数据的区块填 0
+    // 已加载的区块从内存计算 其余只读取存档末尾的缩略图 返回有数据的区块数
+    int readChunkSummaries(int cx, int cy, int cw, int chh, int level, std::vector<u32> &out);
+    // 存档索引 (WorldIndex) 用的缩略图 以 tickZone 中心为中心 没有任何区块数据时为空
+    std::vector<u32> indexThumbnail();
     void chunkSaveCache(Chunk *ch);
     void generateChunk(Chunk *ch);
     int getBiomeAt(int x, int y);             // 返回群系ID
-    int getBiomeAt(Chunk *ch, int x, int y);  // 返回群系ID
+    int getBiomeAt(Chunk *ch, int x, int y);  // 返回群系ID 优先读取区块保存的群系
+    void fillChunkBiomes(Chunk *ch);          // 计算区块每个像素的群系
+    // 地表带内的群系只取决于 x
+    static bool inSurfaceBand(int y) { return abs(CHUNK_H * 3 - y) < CHUNK_H * 10; }
+    int getSurfaceBiomeAt(int x);
     void addStructure(PlacedStructure str);
     MEvec2 getNearestPoint(f32 x, f32 y);
     std::vector<MEvec2> getPointsWithin(f32 x, f32 y, f32 w, f32 h);
+    // 没有加载时返回一个 pleaseDelete 的临时区块 由调用者归还
     Chunk *getChunk(int cx, int cy);
+    // 只查找已加载的区块 不存在时返回 nullptr
+    Chunk *peekChunk(int cx, int cy);
     void populateChunk(Chunk *ch, int phase, bool render);
+
+    // populateChunk 拆成三步 prepare/finish 访问世界状态 只在调用 populateChunk 的线程执行
+    // apply 只读写 chs 中的区块 区域互不重叠的任务可以在工作线程并行执行
+    struct PopulateTask {
+        Chunk *ch = nullptr;
+        int phase = 0;
+        int ax = 0, ay = 0, aw = 0, ah = 0;
+        std::unique_ptr<Chunk *[]> chs;
+        std::unique_ptr<bool[]> dirtyChunk;
+    };
+    // 该阶段没有 Populator 时返回 false
+    bool preparePopulate(PopulateTask &task, Chunk *ch, int phase);
+    void applyPopulate(PopulateTask &task);
+    void finishPopulate(PopulateTask &task, bool render);
     void tickEntities(R_Target *target);
-    void forLine(int x0, int y0, int x1, int y1, std::function<bool(int)> fn);
-    void forLineCornered(int x0, int y0, int x1, int y1, std::function<bool(int)> fn);
-    RigidBody *physicsCheck(int x, int y);
-    void physicsCheck_flood(int x, int y, bool *visited, int *count, u32 *cols, int *minX, int *maxX, int *minY, int *maxY);
+    // 沿线段依次对每个像素的下标调用 fn fn 返回 true 时停止 不检查边界
+    template <typename F>
+    void forLine(int x0, int y0, int x1, int y1, F &&fn);
+    // 同 forLine 但相邻两个像素总是共边 不会从对角穿过
+    template <typename F>
+    void forLineCornered(int x0, int y0, int x1, int y1, F &&fn);
+
+    struct LineRay {
+        int x0, y0, x1, y1;
+    };
+    static constexpr u32 physicsBit(int type) { return 1u << type; }
+    // 并行追踪一批射线 按 forLine 的路径直接读紧凑的材料层
+    // hits[i] 为 rays[i] 上第一个 physicsType 在 stopMask (physicsBit 的组合) 中的像素下标 没有碰到或走出世界时为 -1
+    void traceRays(std::span<const LineRay> rays, u32 stopMask, std::span<int> hits);
+    void physicsCheck(int x, int y) { physicsCheck({{x, y}}); }
+    // 检查一批点所在的 SOLID 区域 不超过 PHYSICS_CHECK_MAX 个像素的区域变成刚体
+    void physicsCheck(const std::vector<std::pair<int, int>> &probes);
+    // 写出所有区块并卸载 退出世界时调用
     void saveWorld();
+    // 自动存档 只复制快照 编码和写盘在后台完成 区块留在内存里
+    // noSaveLoad readOnly 或者上一次还没完成时返回 false
+    bool saveWorldAsync();
     bool isPlayerInWorld();
     std::tuple<WorldEntity *, Player *> getHostPlayer();
 };
+
+// Adapted from https://stackoverflow.com/a/52859805/8267529
+template <typename F>
+void world::forLine(int x0, int y0, int x1, int y1, F &&fn) {
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+
+    int dLong = abs(dx);
+    int dShort = abs(dy);
+
+    int offsetLong = dx > 0 ? 1 : -1;
+    int offsetShort = dy > 0 ? width : -width;
+
+    if (dLong < dShort) {
+        std::swap(dShort, dLong);
+        std::swap(offsetShort, offsetLong);
+    }
+
+    int error = dLong / 2;
+    int index = y0 * width + x0;
+    const int offset[] = {offsetLong, offsetLong + offsetShort};
+    const int abs_d[] = {dShort, dShort - dLong};
+    for (int i = 0; i <= dLong; ++i) {
+        if (fn(index)) return;
+        const int errorIsTooBig = error >= dLong;
+        index += offset[errorIsTooBig];
+        error += abs_d[errorIsTooBig];
+    }
+}
+
+// Adapted from https://gamedev.stackexchange.com/a/182143
+template <typename F>
+void world::forLineCornered(int x0, int y0, int x1, int y1, F &&fn) {
+
+    f32 sx = x0;
+    f32 sy = y0;
+    f32 ex = x1;
+    f32 ey = y1;
+
+    f32 x = std::floor(sx);
+    f32 y = std::floor(sy);
+    f32 diffX = ex - sx;
+    f32 diffY = ey - sy;
+    f32 stepX = (diffX > 0) ? 1 : ((diffX < 0) ? -1 : 0);
+    f32 stepY = (diffY > 0) ? 1 : ((diffY < 0) ? -1 : 0);
+
+    f32 xOffset = ex > sx ? (std::ceil(sx) - sx) : (sx - std::floor(sx));
+    f32 yOffset = ey > sy ? (std::ceil(sy) - sy) : (sy - std::floor(sy));
+    f32 angle = std::atan2(-diffY, diffX);
+    f32 tMaxX = xOffset / std::cos(angle);
+    f32 tMaxY = yOffset / std::sin(angle);
+    f32 tDeltaX = 1.0 / std::cos(angle);
+    f32 tDeltaY = 1.0 / std::sin(angle);
+
+    f32 manhattanDistance = std::abs(std::floor(ex) - std::floor(sx)) + std::abs(std::floor(ey) - std::floor(sy));
+    // x y 只朝一个方向走 重复的像素只会出现在相邻两步 (水平或竖直线上 step 为 0 的那一步) 记下上一个即可
+    int last = -1;
+    for (int t = 0; t <= manhattanDistance; ++t) {
+        const int index = (int)(x + y * width);
+        if (index != last && fn(index)) return;
+        last = index;
+        if (std::abs(tMaxX) < std::abs(tMaxY) || std::isnan(tMaxY)) {
+            tMaxX += tDeltaX;
+            x += stepX;
+        } else {
+            tMaxY += tDeltaY;
+            y += stepY;
+        }
+    }
+}
+
 }  // namespace ME
 
 #endif
@@ -0,0 +1,80 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_archive.hpp"
+
+#include <filesystem>
+#include <format>
+#include <vector>
+
+#include "engine/core/io/packer.hpp"
+#include "engine/utils/utility.hpp"
+
+namespace ME {
+
+namespace WorldArchive {
+
+bool is_archive(const std::string &path) {
+    const size_t n = sizeof(WORLD_ARCHIVE_EXT) - 1;
+    return path.size() > n && path.compare(path.size() - n, n, WORLD_ARCHIVE_EXT) == 0;
+}
+
+bool export_world(const std::string &worldDir, const std::string &archivePath, bool printProgress) {
+    const std::filesystem::path base(worldDir);
+    std::error_code ec;
+    if (!std::filesystem::is_directory(base, ec)) {
+        METADOT_ERROR(std::format("World {0} is not a directory", worldDir).c_str());
+        return false;
+    }
+
+    std::vector<std::string> paths;
+    for (auto it = std::filesystem::recursive_directory_iterator(base, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file()) continue;
+        // 原子写入的临时文件
+        if (it->path().extension() == ".tmp") continue;
+        paths.push_back(std::filesystem::relative(it->path(), base).generic_string());
+    }
+    if (ec || paths.empty()) {
+        METADOT_ERROR(std::format("Failed to list world {0}", worldDir).c_str());
+        return false;
+    }
+
+    std::vector<const char *> items;
+    items.reserve(paths.size());
+    for (const std::string &p : paths) items.push_back(p.c_str());
+
+    ME_pack_result result = ME_pack_files_in(archivePath.c_str(), worldDir.c_str(), items.size(), items.data(), printProgress);
+    if (result != SUCCESS_PACK_RESULT) {
+        METADOT_ERROR(std::format("Failed to export world {0} to {1}: {2}", worldDir, archivePath, pack_result_to_string(result)).c_str());
+        return false;
+    }
+
+    METADOT_INFO(std::format("Exported world {0} ({1} files) to {2}", worldDir, items.size(), archivePath).c_str());
+    return true;
+}
+
+bool import_world(const std::string &archivePath, const std::string &worldDir, bool printProgress) {
+    const std::string staging = worldDir + ".import";
+    std::error_code ec;
+    std::filesystem::remove_all(staging, ec);
+
+    ME_pack_result result = ME_unpack_files_to(archivePath.c_str(), staging.c_str(), printProgress);
+    if (result != SUCCESS_PACK_RESULT) {
+        METADOT_ERROR(std::format("Failed to import world {0}: {1}", archivePath, pack_result_to_string(result)).c_str());
+        std::filesystem::remove_all(staging, ec);
+        return false;
+    }
+
+    std::filesystem::remove_all(worldDir, ec);
+    std::filesystem::rename(staging, worldDir, ec);
+    if (ec) {
+        METADOT_ERROR(std::format("Failed to replace world {0}: {1}", worldDir, ec.message()).c_str());
+        return false;
+    }
+
+    METADOT_INFO(std::format("Imported world {0} to {1}", archivePath, worldDir).c_str());
+    return true;
+}
+
+}  // namespace WorldArchive
+
+}  // namespace ME
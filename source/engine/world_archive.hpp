@@ -0,0 +1,32 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_ARCHIVE_HPP
+#define ME_WORLD_ARCHIVE_HPP
+
+#include <string>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// 世界存档包的扩展名 放进 saves/ 后可以像世界目录一样打开 (只读)
+#define WORLD_ARCHIVE_EXT ".mepack"
+
+// 把整个世界目录 (world.json regions/ chunks/) 存成一个 ME_pack_files 格式的包 在机器之间复制时只有一个文件
+// 包中的路径相对世界目录 条目在 job 线程上并行压缩和解压
+// world::init 收到以 WORLD_ARCHIVE_EXT 结尾的路径时 RegionStore::open_archive 直接从包的映射读取区块 不解包 不写回
+// 命令行 exportworld <世界目录> <包> / importworld <包> <世界目录> 见 ParseRunArgs
+namespace WorldArchive {
+
+bool is_archive(const std::string &path);
+
+// 世界正在后台存档时先 world::saver.wait() 写到一半的 .tmp 文件不打包
+bool export_world(const std::string &worldDir, const std::string &archivePath, bool printProgress = false);
+// 先解包到 <worldDir>.import 全部成功之后才替换 worldDir 失败时 worldDir 不变
+bool import_world(const std::string &archivePath, const std::string &worldDir, bool printProgress = false);
+
+}  // namespace WorldArchive
+
+}  // namespace ME
+
+#endif
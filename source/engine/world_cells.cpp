@@ -0,0 +1,328 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_cells.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "engine/game_utils/rng.h"
+
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(ME_SIMD_X86)
+#include <immintrin.h>
+#elif defined(ME_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace ME {
+
+namespace {
+
+// 8 路 fnv1a 像素 k 进入第 k % 8 路 每个像素先混入 (id | 温度 << 16) 再混入颜色
+// 向量版本一次处理 8 个像素 与标量版本结果完全相同
+constexpr u32 CELL_HASH_PRIME = 0x01000193u;
+constexpr size_t CELL_HASH_LANES = 8;
+
+// 以 8 个像素为一组更新 lanes 返回处理了的像素数 剩下的由 hash_cells 逐个处理
+using hash_lanes_fn = size_t (*)(const u16 *ids, const u32 *colors, const mat_temperature *temps, size_t n, u32 *lanes);
+
+size_t hash_lanes_scalar(const u16 *, const u32 *, const mat_temperature *, size_t, u32 *) { return 0; }
+
+#if defined(ME_SIMD_X86)
+// 每一路前后相关 更宽的向量帮不上忙 avx512 也用这个版本
+ME_TARGET_AVX2 size_t hash_lanes_avx2(const u16 *ids, const u32 *colors, const mat_temperature *temps, size_t n, u32 *lanes) {
+    size_t k = 0;
+    __m256i h = _mm256_loadu_si256((const __m256i *)lanes);
+    const __m256i prime = _mm256_set1_epi32((int)CELL_HASH_PRIME);
+    for (; k + CELL_HASH_LANES <= n; k += CELL_HASH_LANES) {
+        const __m256i id = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(ids + k)));
+        const __m256i temp = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(temps + k))), 16);
+        h = _mm256_mullo_epi32(_mm256_xor_si256(h, _mm256_or_si256(id, temp)), prime);
+        h = _mm256_mullo_epi32(_mm256_xor_si256(h, _mm256_loadu_si256((const __m256i *)(colors + k))), prime);
+    }
+    _mm256_storeu_si256((__m256i *)lanes, h);
+    return k;
+}
+#elif defined(ME_SIMD_NEON)
+size_t hash_lanes_neon(const u16 *ids, const u32 *colors, const mat_temperature *temps, size_t n, u32 *lanes) {
+    size_t k = 0;
+    uint32x4_t lo = vld1q_u32(lanes), hi = vld1q_u32(lanes + 4);
+    const uint32x4_t prime = vdupq_n_u32(CELL_HASH_PRIME);
+    for (; k + CELL_HASH_LANES <= n; k += CELL_HASH_LANES) {
+        const uint16x8_t id = vld1q_u16(ids + k);
+        const uint16x8_t temp = vld1q_u16((const u16 *)(temps + k));
+        const uint32x4_t wlo = vorrq_u32(vmovl_u16(vget_low_u16(id)), vshlq_n_u32(vmovl_u16(vget_low_u16(temp)), 16));
+        const uint32x4_t whi = vorrq_u32(vmovl_u16(vget_high_u16(id)), vshlq_n_u32(vmovl_u16(vget_high_u16(temp)), 16));
+        lo = vmulq_u32(veorq_u32(lo, wlo), prime);
+        hi = vmulq_u32(veorq_u32(hi, whi), prime);
+        lo = vmulq_u32(veorq_u32(lo, vld1q_u32(colors + k)), prime);
+        hi = vmulq_u32(veorq_u32(hi, vld1q_u32(colors + k + 4)), prime);
+    }
+    vst1q_u32(lanes, lo);
+    vst1q_u32(lanes + 4, hi);
+    return k;
+}
+#endif
+
+// sse2 没有 32 位乘法 (mullo 要 sse4.1) 走标量 编译器通常也能把标量循环向量化
+hash_lanes_fn select_hash_lanes(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+        case simd_level::avx2:
+            return hash_lanes_avx2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return hash_lanes_neon;
+#endif
+        default:
+            return hash_lanes_scalar;
+    }
+}
+
+simd_kernel<hash_lanes_fn> HashLanes{select_hash_lanes};
+
+u64 hash_cells(const u16 *ids, const u32 *colors, const mat_temperature *temps, size_t n, u64 seed) {
+    u32 lanes[CELL_HASH_LANES];
+    for (size_t l = 0; l < CELL_HASH_LANES; l++) lanes[l] = (u32)RNG_Mix(seed, l);
+
+    for (size_t k = HashLanes.get()(ids, colors, temps, n, lanes); k < n; k++) {
+        u32 &h = lanes[k % CELL_HASH_LANES];
+        h = (h ^ ((u32)ids[k] | ((u32)(u16)temps[k] << 16))) * CELL_HASH_PRIME;
+        h = (h ^ colors[k]) * CELL_HASH_PRIME;
+    }
+
+    u64 out = RNG_Mix(seed, (u64)n);
+    for (size_t l = 0; l < CELL_HASH_LANES; l++) out = RNG_Mix(out, lanes[l]);
+    return out;
+}
+
+}  // namespace
+
+void *plane_alloc(size_t bytes) {
+    bytes = std::max<size_t>(bytes, 1);
+    const size_t align = bytes >= PLANE_HUGE_PAGE ? PLANE_HUGE_PAGE : 64;
+    const size_t size = (bytes + align - 1) / align * align;
+#if defined(_WIN32)
+    void *p = _aligned_malloc(size, align);
+#else
+    void *p = std::aligned_alloc(align, size);
+#endif
+    if (!p) throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // 只是提示 内核没有开启透明大页时照常使用 4K 页
+    if (align == PLANE_HUGE_PAGE) madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void plane_free(void *p) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+CellStore::~CellStore() { clear(); }
+
+size_t CellStore::memory_usage() const {
+    size_t bytes = matIds.size() * (sizeof(u16) + sizeof(u32) + sizeof(mat_temperature) + sizeof(u8));
+    for (size_t b = 0; b < fluidBlockCount; b++) {
+        if (fluidBlocks[b].load(std::memory_order_relaxed)) bytes += sizeof(FluidBlock);
+    }
+    return bytes + modifiedWordCount * sizeof(u64);
+}
+
+void CellStore::resize(size_t n) {
+    clear();
+
+    // 与 MaterialInstance() 的默认值保持一致
+    matIds.resize(n, (u16)GAME()->materials_list.GENERIC_AIR.id);
+    colors.resize(n, 0x000000);
+    temperatures.resize(n, 0);
+    flags.resize(n, 0);
+    ring.reset(n);
+
+    fluidBlockCount = (n + FLUID_BLOCK_SIZE - 1) >> FLUID_BLOCK_SHIFT;
+    fluidBlocks = std::make_unique<std::atomic<FluidBlock *>[]>(fluidBlockCount);
+    for (size_t b = 0; b < fluidBlockCount; b++) fluidBlocks[b].store(nullptr, std::memory_order_relaxed);
+
+    modifiedWordCount = (n + 63) >> 6;
+    modified = std::make_unique<std::atomic<u64>[]>(modifiedWordCount);
+    for (size_t w = 0; w < modifiedWordCount; w++) modified[w].store(0, std::memory_order_relaxed);
+}
+
+void CellStore::clear() {
+    for (size_t b = 0; b < fluidBlockCount; b++) {
+        delete fluidBlocks[b].exchange(nullptr);
+    }
+    fluidBlocks.reset();
+    fluidBlockCount = 0;
+    modified.reset();
+    modifiedWordCount = 0;
+
+    matIds.clear();
+    colors.clear();
+    temperatures.clear();
+    flags.clear();
+    ring.reset(0);
+}
+
+void CellStore::trim_fluid() {
+    for (size_t b = 0; b < fluidBlockCount; b++) {
+        FluidBlock *block = fluidBlocks[b].load(std::memory_order_relaxed);
+        if (!block) continue;
+
+        size_t begin = b << FLUID_BLOCK_SHIFT;
+        size_t end = std::min(begin + FLUID_BLOCK_SIZE, matIds.size());
+        bool hasSoup = false;
+        for (size_t i = begin; i < end; i++) {
+            if (mat_at(i)->physicsType == PhysicsType::SOUP) {
+                hasSoup = true;
+                break;
+            }
+        }
+
+        if (!hasSoup) {
+            fluidBlocks[b].store(nullptr, std::memory_order_relaxed);
+            delete block;
+        }
+    }
+}
+
+size_t CellStore::find_soup(size_t i, size_t n, size_t &first, size_t &last) const {
+    size_t count = 0;
+    size_t p = ring(i);
+    // 最多绕回一次 分成两段连续的存储位置
+    for (size_t ofs = 0; ofs < n;) {
+        size_t len = std::min(n - ofs, matIds.size() - p);
+        for (size_t end = p + len; p < end;) {
+            size_t blockEnd = std::min(end, ((p >> FLUID_BLOCK_SHIFT) + 1) << FLUID_BLOCK_SHIFT);
+            if (!peek_fluid_block(p)) {
+                ofs += blockEnd - p;
+                p = blockEnd;
+                continue;
+            }
+            for (; p < blockEnd; p++, ofs++) {
+                if (mat_at(p)->physicsType != PhysicsType::SOUP) continue;
+                if (!count) first = ofs;
+                last = ofs;
+                count++;
+            }
+        }
+        p = 0;
+    }
+    return count;
+}
+
+void CellStore::read_row(size_t i, size_t n, u16 *ids, mat_temperature *temps) const {
+    size_t p = ring(i);
+    size_t first = std::min(n, matIds.size() - p);
+    memcpy(ids, matIds.data() + p, first * sizeof(u16));
+    memcpy(temps, temperatures.data() + p, first * sizeof(mat_temperature));
+    if (first < n) {
+        memcpy(ids + first, matIds.data(), (n - first) * sizeof(u16));
+        memcpy(temps + first, temperatures.data(), (n - first) * sizeof(mat_temperature));
+    }
+}
+
+u64 CellStore::hash_row(size_t i, size_t n, u64 seed) const {
+    size_t p = ring(i);
+    if (n <= matIds.size() - p) return hash_cells(matIds.data() + p, colors.data() + p, temperatures.data() + p, n, seed);
+
+    // 绕回开头的一行 先复制成连续的 只有环形起点落在这一行中间时才会发生
+    thread_local std::vector<u16> ids;
+    thread_local std::vector<u32> cols;
+    thread_local std::vector<mat_temperature> temps;
+    ids.resize(n);
+    cols.resize(n);
+    temps.resize(n);
+    read_row(i, n, ids.data(), temps.data());
+    const size_t first = matIds.size() - p;
+    memcpy(cols.data(), colors.data() + p, first * sizeof(u32));
+    memcpy(cols.data() + first, colors.data(), (n - first) * sizeof(u32));
+    return hash_cells(ids.data(), cols.data(), temps.data(), n, seed);
+}
+
+void CellStore::write_row(size_t i, const MaterialInstance *src, size_t n) {
+    size_t p = ring(i);
+    size_t first = std::min(n, matIds.size() - p);
+    for (size_t k = 0; k < first; k++) store_at(p + k, src[k]);
+    for (size_t k = first; k < n; k++) store_at(k - first, src[k]);
+    clear_modified(i, n);
+}
+
+void CellStore::commit_raw(size_t i, size_t n) {
+    const u16 air = (u16)GAME()->materials_list.GENERIC_AIR.id;
+    const size_t count = (size_t)GAME()->materials_count;
+    size_t p = ring(i);
+    for (size_t k = 0; k < n; k++, p++) {
+        if (p == matIds.size()) p = 0;
+        if (matIds[p] >= count) matIds[p] = air;
+        if (mat_at(p)->physicsType == PhysicsType::SOUP) fluid_block(p);
+        touch(p);
+    }
+}
+
+template <typename F>
+void CellStore::for_each_modified_word(size_t i, size_t n, F &&f) const {
+    auto range = [&](size_t begin, size_t end) {
+        for (size_t w = begin >> 6; w <= (end - 1) >> 6; w++) {
+            u64 mask = ~(u64)0;
+            size_t base = w << 6;
+            if (base < begin) mask &= ~(u64)0 << (begin - base);
+            if (base + 64 > end) mask &= ~(u64)0 >> (base + 64 - end);
+            if (f(modified[w], mask)) return true;
+        }
+        return false;
+    };
+
+    if (n == 0) return;
+    size_t p = ring(i);
+    size_t first = std::min(n, matIds.size() - p);
+    if (range(p, p + first)) return;
+    if (first < n) range(0, n - first);
+}
+
+bool CellStore::any_modified(size_t i, size_t n) const {
+    bool any = false;
+    for_each_modified_word(i, n, [&](std::atomic<u64> &word, u64 mask) {
+        any = word.load(std::memory_order_relaxed) & mask;
+        return any;
+    });
+    return any;
+}
+
+void CellStore::clear_modified(size_t i, size_t n) {
+    for_each_modified_word(i, n, [](std::atomic<u64> &word, u64 mask) {
+        if (word.load(std::memory_order_relaxed) & mask) word.fetch_and(~mask, std::memory_order_relaxed);
+        return false;
+    });
+}
+
+CellStore::FluidBlock *CellStore::fluid_block(size_t i) {
+    std::atomic<FluidBlock *> &slot = fluidBlocks[i >> FLUID_BLOCK_SHIFT];
+    FluidBlock *b = slot.load(std::memory_order_acquire);
+    if (b) return b;
+
+    FluidBlock *fresh = new FluidBlock;
+    std::fill(std::begin(fresh->amount), std::end(fresh->amount), 2.0f);
+    std::fill(std::begin(fresh->diff), std::end(fresh->diff), 0.0f);
+
+    if (slot.compare_exchange_strong(b, fresh, std::memory_order_acq_rel)) return fresh;
+
+    delete fresh;
+    return b;
+}
+
+}  // namespace ME
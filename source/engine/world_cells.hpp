@@ -0,0 +1,354 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_CELLS_HPP
+#define ME_WORLD_CELLS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "game_datastruct.hpp"
+
+namespace ME {
+
+// 世界平面的内存 大于 PLANE_HUGE_PAGE 的分配按它对齐 Linux 上提示内核使用透明大页
+// 区块任务和温度分块的 3x3 5x5 邻域每次跨好几行 4K 页时每行的访问都落在不同的页上 大页下整个区块只占几个 TLB 项
+// 其余平台只按缓存行对齐
+constexpr size_t PLANE_HUGE_PAGE = (size_t)2 << 20;
+void *plane_alloc(size_t bytes);
+void plane_free(void *p);
+
+template <typename T>
+struct plane_allocator {
+    using value_type = T;
+
+    plane_allocator() = default;
+    template <typename U>
+    plane_allocator(const plane_allocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(plane_alloc(n * sizeof(T))); }
+    void deallocate(T *p, size_t) { plane_free(p); }
+
+    template <typename U>
+    bool operator==(const plane_allocator<U> &) const {
+        return true;
+    }
+};
+
+template <typename T>
+using plane_vector = std::vector<T, plane_allocator<T>>;
+
+// 环形下标
+// 逻辑下标 i 对应存储位置 (i + origin) mod n 世界随相机平移时只移动 origin 不复制数据
+// 平移语义与像素纹理的 std::rotate 相同 即按 x + y * width 整体移动 行尾的像素会绕到相邻行
+class RingIndex {
+public:
+    void reset(size_t n) {
+        count = n;
+        origin = 0;
+    }
+
+    size_t operator()(size_t i) const {
+        size_t p = i + origin;
+        return p >= count ? p - count : p;
+    }
+
+    size_t offset() const { return origin; }
+
+    // 原来逻辑下标 i 的数据移动到 i + delta
+    void shift(std::ptrdiff_t delta) {
+        if (!count) return;
+        std::ptrdiff_t n = (std::ptrdiff_t)count;
+        std::ptrdiff_t o = ((std::ptrdiff_t)origin - delta) % n;
+        origin = (size_t)(o < 0 ? o + n : o);
+    }
+
+private:
+    size_t count = 0;
+    size_t origin = 0;
+};
+
+// 使用环形下标的定长数组
+template <typename T>
+class RingArray {
+public:
+    void resize(size_t n) {
+        data.assign(n, T{});
+        ring.reset(n);
+    }
+
+    T &operator[](size_t i) { return data[ring(i)]; }
+    const T &operator[](size_t i) const { return data[ring(i)]; }
+
+    // 把 src 的 n 个元素写到逻辑下标 [i, i + n) 处理环形绕回
+    void write(size_t i, const T *src, size_t n) {
+        size_t p = ring(i);
+        size_t first = std::min(n, data.size() - p);
+        std::copy_n(src, first, data.begin() + p);
+        std::copy_n(src + first, n - first, data.begin());
+    }
+
+    // 把逻辑下标 [i, i + n) 的 n 个元素读到 dst
+    void read(size_t i, T *dst, size_t n) const {
+        size_t p = ring(i);
+        size_t first = std::min(n, data.size() - p);
+        std::copy_n(data.begin() + p, first, dst);
+        std::copy_n(data.begin(), n - first, dst + first);
+    }
+
+    size_t size() const { return data.size(); }
+    void clear() {
+        data.clear();
+        ring.reset(0);
+    }
+    void shift(std::ptrdiff_t delta) { ring.shift(delta); }
+
+    // 按存储位置访问 逻辑下标 i 在 (i + origin()) mod size() 处
+    T *raw() { return data.data(); }
+    size_t origin() const { return ring.offset(); }
+
+    size_t memory_bytes() const { return data.capacity() * sizeof(T); }
+
+private:
+    plane_vector<T> data;
+    RingIndex ring;
+};
+
+// 世界像素的 SoA 存储
+// 每个像素只占 9 字节 (材料id/颜色/温度/标记) 而不是 40 字节的 MaterialInstance
+// 液体量只有 SOUP 像素需要 按 FLUID_BLOCK_SIZE 分块懒分配
+// 对外的下标都是逻辑下标 经 RingIndex 映射到存储位置 Ref 内部保存的是存储位置
+class CellStore {
+public:
+    static constexpr int FLUID_BLOCK_SHIFT = 10;
+    static constexpr size_t FLUID_BLOCK_SIZE = (size_t)1 << FLUID_BLOCK_SHIFT;
+
+    static constexpr u8 FLAG_MOVED = 0x80;
+    static constexpr u8 FLAG_SETTLE_MASK = 0x7f;
+
+    // 对单个像素的代理引用
+    // 可以像 MaterialInstance 一样赋值和转换 字段通过访问函数读写
+    class Ref {
+    public:
+        Ref(CellStore *store, size_t i) : store(store), i(i) {}
+
+        operator MaterialInstance() const { return store->get_at(i); }
+        Ref &operator=(const MaterialInstance &tile) {
+            store->set_at(i, tile);
+            return *this;
+        }
+        Ref &operator=(const Ref &other) {
+            store->copy_at(i, *other.store, other.i);
+            return *this;
+        }
+
+        Material *mat() const { return store->mat_at(i); }
+        mat_id id() const { return store->matIds[i]; }
+
+        u32 color() const { return store->colors[i]; }
+        void set_color(u32 color) {
+            store->colors[i] = color;
+            store->touch(i);
+        }
+
+        mat_temperature temperature() const { return store->temperatures[i]; }
+        void set_temperature(mat_temperature temperature) {
+            if (store->temperatures[i] == temperature) return;
+            store->temperatures[i] = temperature;
+            store->touch(i);
+        }
+
+        bool moved() const { return store->flags[i] & FLAG_MOVED; }
+        void set_moved(bool moved) { store->flags[i] = moved ? (store->flags[i] | FLAG_MOVED) : (store->flags[i] & ~FLAG_MOVED); }
+
+        u8 settle_count() const { return store->flags[i] & FLAG_SETTLE_MASK; }
+
+        f32 fluid_amount() const { return store->fluid_amount_at(i); }
+        void set_fluid_amount(f32 amount) { store->fluid_block(i)->amount[i & (FLUID_BLOCK_SIZE - 1)] = amount; }
+        void add_fluid_amount(f32 amount) { store->fluid_block(i)->amount[i & (FLUID_BLOCK_SIZE - 1)] += amount; }
+
+        f32 fluid_amount_diff() const { return store->fluid_amount_diff_at(i); }
+        void set_fluid_amount_diff(f32 diff) { store->fluid_block(i)->diff[i & (FLUID_BLOCK_SIZE - 1)] = diff; }
+        void add_fluid_amount_diff(f32 diff) { store->fluid_block(i)->diff[i & (FLUID_BLOCK_SIZE - 1)] += diff; }
+
+    private:
+        CellStore *store;
+        size_t i;
+    };
+
+    CellStore() = default;
+    ~CellStore();
+
+    CellStore(const CellStore &) = delete;
+    CellStore &operator=(const CellStore &) = delete;
+
+    Ref operator[](size_t i) { return Ref(this, ring(i)); }
+
+    size_t size() const { return matIds.size(); }
+    bool empty() const { return matIds.empty(); }
+    size_t memory_usage() const;
+
+    void resize(size_t n);
+    void clear();
+
+    // 释放不再包含任何 SOUP 像素的液体块 只能在没有tick任务运行时调用
+    void trim_fluid();
+
+    // 逻辑下标 [i, i + n) 中 SOUP 像素的个数 first/last 为第一个和最后一个相对 i 的偏移
+    // SOUP 像素总是有液体块 没有液体块的部分直接跳过
+    size_t find_soup(size_t i, size_t n, size_t &first, size_t &last) const;
+
+    // 原来逻辑下标 i 的像素移动到 i + delta 只改变环形起点 只能在没有tick任务运行时调用
+    void shift(std::ptrdiff_t delta) { ring.shift(delta); }
+
+    Material *mat(size_t i) const { return mat_at(ring(i)); }
+
+    // 批量转换使用的连续平面 按存储位置访问
+    // 逻辑下标 i 在 physical(i) 处 逻辑上连续的一段在 size() 处可能绕回开头
+    size_t physical(size_t i) const { return ring(i); }
+    size_t origin() const { return ring.offset(); }
+    const u16 *mat_id_data() const { return matIds.data(); }
+    const u32 *color_data() const { return colors.data(); }
+    const mat_temperature *temperature_data() const { return temperatures.data(); }
+
+    // 脚本视图直接写存储位置 写完后对写过的逻辑下标 [i, i + n) 调用 commit_raw
+    // 无效的材料id换成空气 SOUP 像素补上液体块 整段标记为修改
+    u16 *mat_id_data() { return matIds.data(); }
+    u32 *color_data() { return colors.data(); }
+    mat_temperature *temperature_data() { return temperatures.data(); }
+    void commit_raw(size_t i, size_t n);
+
+    // 把逻辑下标 [i, i + n) 的材料id和温度复制到连续数组 处理环形绕回
+    void read_row(size_t i, size_t n, u16 *ids, mat_temperature *temps) const;
+
+    // 逻辑下标 [i, i + n) 的材料id 颜色和温度与 seed 混合的哈希 与环形起点和使用的指令集无关 指令集由 cpu::set_max_level 选择
+    // 运动标记和液体量不参与 用来逐位比较两种实现的模拟结果
+    u64 hash_row(size_t i, size_t n, u64 seed) const;
+
+    // 把 n 个像素写到逻辑下标 [i, i + n) 处理环形绕回 与逐个 set() 结果相同
+    // 写入的是区块存档中的内容 会清除这一段的修改标记
+    void write_row(size_t i, const MaterialInstance *src, size_t n);
+
+    // 修改标记 材料/颜色/温度被写入的像素会被标记 运动标记和液体量不会保存 不算修改
+    // 逻辑下标 [i, i + n) 中是否有被标记的像素
+    bool any_modified(size_t i, size_t n) const;
+    void clear_modified(size_t i, size_t n);
+
+    MaterialInstance get(size_t i) const { return get_at(ring(i)); }
+    void set(size_t i, const MaterialInstance &tile) { set_at(ring(i), tile); }
+    void copy(size_t dst, const CellStore &src, size_t si) { copy_at(ring(dst), src, src.ring(si)); }
+
+    f32 fluid_amount(size_t i) const { return fluid_amount_at(ring(i)); }
+    f32 fluid_amount_diff(size_t i) const { return fluid_amount_diff_at(ring(i)); }
+
+    // 各平面和已分配的液体块 MemoryBudget 用
+    size_t memory_bytes() const {
+        size_t n = matIds.capacity() * sizeof(u16) + colors.capacity() * sizeof(u32) + temperatures.capacity() * sizeof(mat_temperature) + flags.capacity();
+        n += fluidBlockCount * sizeof(std::atomic<FluidBlock *>) + modifiedWordCount * sizeof(std::atomic<u64>);
+        for (size_t b = 0; b < fluidBlockCount; b++) {
+            if (fluidBlocks[b].load(std::memory_order_relaxed)) n += sizeof(FluidBlock);
+        }
+        return n;
+    }
+
+private:
+    struct FluidBlock {
+        f32 amount[FLUID_BLOCK_SIZE];
+        f32 diff[FLUID_BLOCK_SIZE];
+    };
+
+    // 以下 *_at 均按存储位置访问
+    Material *mat_at(size_t i) const { return GAME()->materials_array[matIds[i]]; }
+
+    MaterialInstance get_at(size_t i) const {
+        MaterialInstance tile(mat_at(i), colors[i], temperatures[i]);
+        tile.moved = flags[i] & FLAG_MOVED;
+        tile.settleCount = flags[i] & FLAG_SETTLE_MASK;
+        if (FluidBlock *b = peek_fluid_block(i)) {
+            tile.fluidAmount = b->amount[i & (FLUID_BLOCK_SIZE - 1)];
+            tile.fluidAmountDiff = b->diff[i & (FLUID_BLOCK_SIZE - 1)];
+        }
+        return tile;
+    }
+
+    void set_at(size_t i, const MaterialInstance &tile) {
+        store_at(i, tile);
+        touch(i);
+    }
+
+    void store_at(size_t i, const MaterialInstance &tile) {
+        matIds[i] = (u16)tile.mat->id;
+        colors[i] = tile.color;
+        temperatures[i] = tile.temperature;
+        flags[i] = (tile.moved ? FLAG_MOVED : 0) | (tile.settleCount > FLAG_SETTLE_MASK ? FLAG_SETTLE_MASK : tile.settleCount);
+
+        // 非 SOUP 像素只在块已存在时写回 保证读到的值与原先一致
+        FluidBlock *b = tile.mat->physicsType == PhysicsType::SOUP ? fluid_block(i) : peek_fluid_block(i);
+        if (b) {
+            b->amount[i & (FLUID_BLOCK_SIZE - 1)] = tile.fluidAmount;
+            b->diff[i & (FLUID_BLOCK_SIZE - 1)] = tile.fluidAmountDiff;
+        }
+    }
+
+    void copy_at(size_t dst, const CellStore &src, size_t si) {
+        matIds[dst] = src.matIds[si];
+        colors[dst] = src.colors[si];
+        temperatures[dst] = src.temperatures[si];
+        flags[dst] = src.flags[si];
+        touch(dst);
+
+        FluidBlock *sb = src.peek_fluid_block(si);
+        FluidBlock *db = sb ? fluid_block(dst) : peek_fluid_block(dst);
+        if (db) {
+            db->amount[dst & (FLUID_BLOCK_SIZE - 1)] = sb ? sb->amount[si & (FLUID_BLOCK_SIZE - 1)] : 2.0f;
+            db->diff[dst & (FLUID_BLOCK_SIZE - 1)] = sb ? sb->diff[si & (FLUID_BLOCK_SIZE - 1)] : 0.0f;
+        }
+    }
+
+    f32 fluid_amount_at(size_t i) const {
+        FluidBlock *b = peek_fluid_block(i);
+        return b ? b->amount[i & (FLUID_BLOCK_SIZE - 1)] : 2.0f;
+    }
+
+    f32 fluid_amount_diff_at(size_t i) const {
+        FluidBlock *b = peek_fluid_block(i);
+        return b ? b->diff[i & (FLUID_BLOCK_SIZE - 1)] : 0.0f;
+    }
+
+    // 可以在 tick 线程中并发调用
+    void touch(size_t i) {
+        std::atomic<u64> &word = modified[i >> 6];
+        u64 bit = (u64)1 << (i & 63);
+        if (word.load(std::memory_order_relaxed) & bit) return;
+        word.fetch_or(bit, std::memory_order_relaxed);
+    }
+
+    // 对逻辑下标 [i, i + n) 覆盖的标记字调用 f(word, mask) 处理环形绕回 f 返回 true 时停止
+    template <typename F>
+    void for_each_modified_word(size_t i, size_t n, F &&f) const;
+
+    FluidBlock *peek_fluid_block(size_t i) const { return fluidBlocks[i >> FLUID_BLOCK_SHIFT].load(std::memory_order_acquire); }
+
+    // tick 是多线程的 相邻区块任务可能同时分配同一块 用 CAS 保证只有一个生效
+    FluidBlock *fluid_block(size_t i);
+
+    plane_vector<u16> matIds;
+    plane_vector<u32> colors;
+    plane_vector<mat_temperature> temperatures;
+    plane_vector<u8> flags;
+    RingIndex ring;
+
+    std::unique_ptr<std::atomic<FluidBlock *>[]> fluidBlocks;
+    size_t fluidBlockCount = 0;
+
+    // 按存储位置每个像素一位 平移时不需要移动
+    std::unique_ptr<std::atomic<u64>[]> modified;
+    size_t modifiedWordCount = 0;
+};
+
+}  // namespace ME
+
+#endif
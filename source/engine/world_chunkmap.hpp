@@ -0,0 +1,71 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_CHUNKMAP_HPP
+#define ME_WORLD_CHUNKMAP_HPP
+
+#include "engine/core/core.hpp"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+struct Chunk;
+
+// 已加载区块表
+// 以打包的 (cx, cy) 为键的单层开放寻址表 每次查找只计算一次哈希
+// for_each 遍历期间的 erase 会推迟到遍历结束后执行 回调里可以直接卸载区块 但不能插入
+class ChunkMap {
+public:
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+    Chunk *find(int cx, int cy) const {
+        auto it = map.find(key(cx, cy));
+        if (it == map.end() || erased(it->first)) return nullptr;
+        return it->second;
+    }
+
+    bool contains(int cx, int cy) const { return find(cx, cy) != nullptr; }
+
+    void insert(int cx, int cy, Chunk *ch) { map[key(cx, cy)] = ch; }
+
+    void erase(int cx, int cy) {
+        if (iterating) {
+            if (find(cx, cy)) pendingErase.insert(key(cx, cy));
+        } else {
+            map.erase(key(cx, cy));
+        }
+    }
+
+    // 对每个区块调用 f(Chunk *)
+    template <typename F>
+    void for_each(F &&f) {
+        iterating++;
+        for (auto &p : map) {
+            // 已经被推迟删除的区块不再访问
+            if (!erased(p.first)) f(p.second);
+        }
+        if (--iterating == 0) {
+            for (u64 k : pendingErase) map.erase(k);
+            pendingErase.clear();
+        }
+    }
+
+    size_t size() const { return map.size() - (iterating ? pendingErase.size() : 0); }
+    bool empty() const { return size() == 0; }
+
+    void clear() {
+        map.clear();
+        pendingErase.clear();
+    }
+
+private:
+    // 遍历中每个区块都要查一次 用哈希集合 卸载很多区块时也不会变成平方
+    bool erased(u64 k) const { return !pendingErase.empty() && pendingErase.contains(k); }
+
+    phmap::flat_hash_map<u64, Chunk *> map;
+    phmap::flat_hash_set<u64> pendingErase;
+    int iterating = 0;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,136 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_dirty.hpp"
+
+#include <algorithm>
+
+namespace ME {
+
+void DirtyMap::resize(int width, int height) {
+    release();
+
+    this->width = width;
+    this->height = height;
+    tilesX = (width + CHUNK_W - 1) / CHUNK_W;
+    tilesY = (height + CHUNK_H - 1) / CHUNK_H;
+
+    wordCount = ((size_t)width * height + 63) >> 6;
+    bits = std::make_unique<std::atomic<u64>[]>(wordCount);
+    for (size_t w = 0; w < wordCount; w++) bits[w].store(0, std::memory_order_relaxed);
+
+    boxes = std::make_unique<std::atomic<u32>[]>((size_t)tilesX * tilesY);
+    for (int t = 0; t < tilesX * tilesY; t++) boxes[t].store(EMPTY_BOX, std::memory_order_relaxed);
+}
+
+void DirtyMap::release() {
+    bits.reset();
+    boxes.reset();
+    wordCount = 0;
+    width = height = tilesX = tilesY = 0;
+    dirtyRects.clear();
+}
+
+void DirtyMap::mark_all() {
+    for (size_t w = 0; w < wordCount; w++) bits[w].store(~(u64)0, std::memory_order_relaxed);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            u32 x1 = std::min(CHUNK_W, width - tx * CHUNK_W) - 1;
+            u32 y1 = std::min(CHUNK_H, height - ty * CHUNK_H) - 1;
+            boxes[tx + ty * tilesX].store((x1 << 16) | (y1 << 24), std::memory_order_relaxed);
+        }
+    }
+}
+
+void DirtyMap::mark_rect(int x, int y, int w, int h) {
+    int x0 = std::max(x, 0), y0 = std::max(y, 0);
+    int x1 = std::min(x + w, width), y1 = std::min(y + h, height);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    for (int ry = y0; ry < y1; ry++) {
+        size_t begin = (size_t)x0 + (size_t)ry * width;
+        size_t end = (size_t)x1 + (size_t)ry * width;
+        for (size_t wi = begin >> 6; wi <= (end - 1) >> 6; wi++) {
+            size_t base = wi << 6;
+            u64 mask = ~(u64)0;
+            if (base < begin) mask &= ~(u64)0 << (begin - base);
+            if (base + 64 > end) mask &= ~(u64)0 >> (base + 64 - end);
+            bits[wi].fetch_or(mask, std::memory_order_relaxed);
+        }
+    }
+
+    // 矩形与每格的交集只需要扩展两个角
+    for (int ty = y0 / CHUNK_H; ty <= (y1 - 1) / CHUNK_H; ty++) {
+        for (int tx = x0 / CHUNK_W; tx <= (x1 - 1) / CHUNK_W; tx++) {
+            expand((u32)std::max(x0, tx * CHUNK_W), (u32)std::max(y0, ty * CHUNK_H));
+            expand((u32)std::min(x1, (tx + 1) * CHUNK_W) - 1, (u32)std::min(y1, (ty + 1) * CHUNK_H) - 1);
+        }
+    }
+}
+
+void DirtyMap::update_rects() {
+    dirtyRects.clear();
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            u32 box = boxes[tx + ty * tilesX].load(std::memory_order_relaxed);
+            if (box == EMPTY_BOX) continue;
+            int x0 = box & 0xff, y0 = (box >> 8) & 0xff, x1 = (box >> 16) & 0xff, y1 = box >> 24;
+            dirtyRects.push_back({tx * CHUNK_W + x0, ty * CHUNK_H + y0, x1 - x0 + 1, y1 - y0 + 1});
+        }
+    }
+}
+
+namespace {
+inline void set_flag(bool &f) { f = true; }
+inline void set_flag(std::atomic<bool> &f) { f.store(true, std::memory_order_relaxed); }
+}  // namespace
+
+template <typename Flag>
+void DirtyMap::mark_regions_into(int shift, int regionsX, Flag *out) const {
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            u32 box = boxes[tx + ty * tilesX].load(std::memory_order_relaxed);
+            if (box == EMPTY_BOX) continue;
+            int x0 = tx * CHUNK_W + (box & 0xff), x1 = tx * CHUNK_W + ((box >> 16) & 0xff);
+            int y0 = ty * CHUNK_H + ((box >> 8) & 0xff), y1 = ty * CHUNK_H + (box >> 24);
+            for (int y = y0; y <= y1; y++) {
+                size_t row = (size_t)y * width;
+                size_t begin = row + x0;
+                size_t end = row + x1 + 1;
+                Flag *outRow = out + (size_t)(y >> shift) * regionsX;
+                for (size_t w = begin >> 6; w <= (end - 1) >> 6; w++) {
+                    u64 word = bits[w].load(std::memory_order_relaxed);
+                    if (!word) continue;
+                    size_t base = w << 6;
+                    if (base < begin) word &= ~(u64)0 << (begin - base);
+                    if (base + 64 > end) word &= ~(u64)0 >> (base + 64 - end);
+                    while (word) {
+                        int x = (int)(base + std::countr_zero(word) - row);
+                        set_flag(outRow[x >> shift]);
+                        // 同一区域内剩下的位不用再看
+                        size_t next = row + (size_t)(((x >> shift) + 1) << shift);
+                        if (next >= base + 64) break;
+                        word &= ~(u64)0 << (next - base);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void DirtyMap::mark_regions(int shift, int regionsX, bool *out) const { mark_regions_into(shift, regionsX, out); }
+
+void DirtyMap::mark_regions(int shift, int regionsX, std::atomic<bool> *out) const { mark_regions_into(shift, regionsX, out); }
+
+void DirtyMap::clear() {
+    // 与相邻格共用的首尾字也一并清除 调用时所有格都已经处理完毕
+    for (const DirtyRect &r : dirtyRects) {
+        for (int y = r.y; y < r.y + r.h; y++) {
+            size_t begin = (size_t)r.x + (size_t)y * width;
+            size_t end = begin + r.w;
+            for (size_t w = begin >> 6; w <= (end - 1) >> 6; w++) bits[w].store(0, std::memory_order_relaxed);
+        }
+        boxes[(r.x / CHUNK_W) + (r.y / CHUNK_H) * tilesX].store(EMPTY_BOX, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace ME
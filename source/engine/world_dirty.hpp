@@ -0,0 +1,144 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_DIRTY_HPP
+#define ME_WORLD_DIRTY_HPP
+
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+struct DirtyRect {
+    int x, y;
+    int w, h;
+};
+
+// 脏像素标记
+// 位图记录每个像素 另外按 CHUNK_W x CHUNK_H 分格记录每格的包围盒
+// 这样纹理重建只需要访问包围盒内的像素 而不是每帧扫描整个世界
+class DirtyMap {
+public:
+    DirtyMap() = default;
+
+    DirtyMap(const DirtyMap &) = delete;
+    DirtyMap &operator=(const DirtyMap &) = delete;
+
+    void resize(int width, int height);
+    void release();
+
+    // 可以在 tick 线程中并发调用
+    void mark(size_t i) {
+        std::atomic<u64> &word = bits[i >> 6];
+        u64 bit = (u64)1 << (i & 63);
+        if (word.load(std::memory_order_relaxed) & bit) return;
+        word.fetch_or(bit, std::memory_order_relaxed);
+
+        u32 y = (u32)i / (u32)width;
+        u32 x = (u32)i - y * (u32)width;
+        expand(x, y);
+    }
+
+    void mark(int x, int y) { mark((size_t)x + (size_t)y * width); }
+
+    // 标记整个矩形 按 64 位字写入位图 每格包围盒只扩展一次 会裁剪到地图范围内
+    void mark_rect(int x, int y, int w, int h);
+
+    void mark_all();
+
+    bool operator[](size_t i) const { return bits[i >> 6].load(std::memory_order_relaxed) & ((u64)1 << (i & 63)); }
+
+    // 在单线程中调用 根据各格包围盒生成 rects()
+    void update_rects();
+    const std::vector<DirtyRect> &rects() const { return dirtyRects; }
+    bool any() const { return !dirtyRects.empty(); }
+
+    // 按 rects() 遍历所有脏像素 f(i)
+    template <typename F>
+    void for_each(F &&f) const {
+        for_each_word([&](size_t base, u64 word) {
+            while (word) {
+                f(base + std::countr_zero(word));
+                word &= word - 1;
+            }
+        });
+    }
+
+    // 按 rects() 以 64 像素为单位遍历 f(base, mask) base 为 64 的倍数 mask 只含 rects() 内的位
+    // 相邻格共用的字会分别以各自的部分调用
+    template <typename F>
+    void for_each_word(F &&f) const {
+        for (const DirtyRect &r : dirtyRects) {
+            for (int y = r.y; y < r.y + r.h; y++) {
+                size_t begin = (size_t)r.x + (size_t)y * width;
+                size_t end = begin + r.w;
+                for (size_t w = begin >> 6; w <= (end - 1) >> 6; w++) {
+                    u64 word = bits[w].load(std::memory_order_relaxed);
+                    if (!word) continue;
+                    size_t base = w << 6;
+                    if (base < begin) word &= ~(u64)0 << (begin - base);
+                    if (base + 64 > end) word &= ~(u64)0 >> (base + 64 - end);
+                    if (word) f(base, word);
+                }
+            }
+        }
+    }
+
+    // 把含有脏像素的 (1 << shift) 见方区域标记到 out[rx + ry * regionsX]
+    // 直接读取各格包围盒 不依赖 update_rects() 不能与 mark() 并发调用
+    // atomic 版本给 tick 中会被多个 worker 同时置位的数组 这里用 relaxed 写入
+    void mark_regions(int shift, int regionsX, bool *out) const;
+    void mark_regions(int shift, int regionsX, std::atomic<bool> *out) const;
+
+    // 只清除 rects() 覆盖的部分 rects() 本身保留到下一次 update_rects() 供纹理上传使用
+    void clear();
+
+private:
+    static constexpr u32 EMPTY_BOX = 0x0000ffff;
+
+    template <typename Flag>
+    void mark_regions_into(int shift, int regionsX, Flag *out) const;
+
+    // 包围盒打包为 x0 | y0 << 8 | x1 << 16 | y1 << 24 (格内坐标 闭区间)
+    void expand(u32 x, u32 y) {
+        std::atomic<u32> &box = boxes[(x / CHUNK_W) + (y / CHUNK_H) * tilesX];
+        u32 lx = x % CHUNK_W, ly = y % CHUNK_H;
+        u32 cur = box.load(std::memory_order_relaxed);
+        while (true) {
+            u32 x0 = cur & 0xff, y0 = (cur >> 8) & 0xff, x1 = (cur >> 16) & 0xff, y1 = cur >> 24;
+            if (cur == EMPTY_BOX) {
+                x0 = x1 = lx;
+                y0 = y1 = ly;
+            } else {
+                if (lx >= x0 && lx <= x1 && ly >= y0 && ly <= y1) return;
+                if (lx < x0) x0 = lx;
+                if (lx > x1) x1 = lx;
+                if (ly < y0) y0 = ly;
+                if (ly > y1) y1 = ly;
+            }
+            u32 next = x0 | (y0 << 8) | (x1 << 16) | (y1 << 24);
+            if (box.compare_exchange_weak(cur, next, std::memory_order_relaxed)) return;
+        }
+    }
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+
+    std::unique_ptr<std::atomic<u64>[]> bits;
+    size_t wordCount = 0;
+    std::unique_ptr<std::atomic<u32>[]> boxes;
+
+    std::vector<DirtyRect> dirtyRects;
+};
+
+static_assert(CHUNK_W <= 256 && CHUNK_H <= 256, "DirtyMap packs tile-local coordinates into 8 bits");
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,186 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_ENTITY_GRID_HPP
+#define ME_WORLD_ENTITY_GRID_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/ecs/ecs_fwd.hpp"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+// WorldEntity 的空间网格 坐标与 WorldEntity::x y 相同 (不含 loadZone 偏移)
+// 每个格子 2^CELL_SHIFT 像素见方 实体按包围盒登记到覆盖的所有格子
+// world::tickEntities 每个 tick 更新一次 包围盒仍在原来的格子范围内时只改记录的位置
+// 查询只访问与查询范围相交的格子 结果不按顺序 也不检查实体是否仍然有效
+class EntityGrid {
+public:
+    static constexpr int CELL_SHIFT = 6;
+
+    EntityGrid() = default;
+
+    EntityGrid(const EntityGrid &) = delete;
+    EntityGrid &operator=(const EntityGrid &) = delete;
+
+    // 一轮更新的开始和结束 这一轮里没有 update 的实体 (在别处销毁的) 在 end_update 时移除
+    void begin_update() {
+        gen++;
+        touched = 0;
+    }
+
+    void end_update() {
+        if (touched == entries.size()) return;
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.gen != gen) {
+                unlink(it->first, it->second);
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void update(ecs::entity_id id, f32 x, f32 y, f32 w, f32 h) {
+        const int cx0 = cell(x), cy0 = cell(y);
+        const int cx1 = cell(x + w), cy1 = cell(y + h);
+        auto [it, inserted] = entries.try_emplace(id);
+        entry &e = it->second;
+        if (inserted || e.gen != gen) touched++;
+        if (inserted || e.cx0 != cx0 || e.cy0 != cy0 || e.cx1 != cx1 || e.cy1 != cy1) {
+            if (!inserted) unlink(id, e);
+            e.cx0 = cx0;
+            e.cy0 = cy0;
+            e.cx1 = cx1;
+            e.cy1 = cy1;
+            link(id, e);
+        }
+        e.x = x;
+        e.y = y;
+        e.w = w;
+        e.h = h;
+        e.gen = gen;
+    }
+
+    void remove(ecs::entity_id id) {
+        auto it = entries.find(id);
+        if (it == entries.end()) return;
+        if (it->second.gen == gen && touched > 0) touched--;
+        unlink(id, it->second);
+        entries.erase(it);
+    }
+
+    void clear() {
+        cells.clear();
+        entries.clear();
+        touched = 0;
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t cell_count() const { return cells.size(); }
+
+    // 包围盒与闭区间 [x0, x1] x [y0, y1] 相交的实体 f(ecs::entity_id)
+    template <typename F>
+    void query_rect(f32 x0, f32 y0, f32 x1, f32 y1, F &&f) const {
+        if (x0 > x1) std::swap(x0, x1);
+        if (y0 > y1) std::swap(y0, y1);
+        visit(cell(x0), cell(y0), cell(x1), cell(y1), [&](ecs::entity_id id, const entry &e) {
+            if (e.x <= x1 && e.x + e.w >= x0 && e.y <= y1 && e.y + e.h >= y0) f(id);
+        });
+    }
+
+    // 包围盒与圆相交的实体 f(ecs::entity_id)
+    template <typename F>
+    void query_radius(f32 x, f32 y, f32 r, F &&f) const {
+        if (r < 0) return;
+        visit(cell(x - r), cell(y - r), cell(x + r), cell(y + r), [&](ecs::entity_id id, const entry &e) {
+            const f32 dx = x - std::clamp(x, e.x, e.x + e.w);
+            const f32 dy = y - std::clamp(y, e.y, e.y + e.h);
+            if (dx * dx + dy * dy <= r * r) f(id);
+        });
+    }
+
+    // 登记的包围盒 id 不在网格中时返回 false
+    bool bounds(ecs::entity_id id, f32 &x, f32 &y, f32 &w, f32 &h) const {
+        auto it = entries.find(id);
+        if (it == entries.end()) return false;
+        x = it->second.x;
+        y = it->second.y;
+        w = it->second.w;
+        h = it->second.h;
+        return true;
+    }
+
+private:
+    struct entry {
+        f32 x = 0, y = 0, w = 0, h = 0;
+        int cx0 = 0, cy0 = 0, cx1 = 0, cy1 = 0;
+        u32 gen = 0;
+    };
+
+    static int cell(f32 v) { return (int)std::floor(v) >> CELL_SHIFT; }
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+    void link(ecs::entity_id id, const entry &e) {
+        for (int cy = e.cy0; cy <= e.cy1; cy++) {
+            for (int cx = e.cx0; cx <= e.cx1; cx++) cells[key(cx, cy)].push_back(id);
+        }
+    }
+
+    void unlink(ecs::entity_id id, const entry &e) {
+        for (int cy = e.cy0; cy <= e.cy1; cy++) {
+            for (int cx = e.cx0; cx <= e.cx1; cx++) {
+                auto it = cells.find(key(cx, cy));
+                if (it == cells.end()) continue;
+                std::vector<ecs::entity_id> &ids = it->second;
+                auto pos = std::find(ids.begin(), ids.end(), id);
+                if (pos != ids.end()) {
+                    *pos = ids.back();
+                    ids.pop_back();
+                }
+                if (ids.empty()) cells.erase(it);
+            }
+        }
+    }
+
+    // 跨多个格子的实体只在它与查询范围相交部分的左上角格子里报告一次
+    template <typename F>
+    void visit(int qx0, int qy0, int qx1, int qy1, F &&f) const {
+        // 查询范围比登记的格子还多时直接遍历所有格子
+        if ((u64)(qx1 - qx0 + 1) * (u64)(qy1 - qy0 + 1) > cells.size()) {
+            for (const auto &[k, ids] : cells) {
+                const int cx = (int)(u32)(k >> 32), cy = (int)(u32)k;
+                if (cx < qx0 || cx > qx1 || cy < qy0 || cy > qy1) continue;
+                visit_cell(cx, cy, qx0, qy0, ids, f);
+            }
+            return;
+        }
+        for (int cy = qy0; cy <= qy1; cy++) {
+            for (int cx = qx0; cx <= qx1; cx++) {
+                auto it = cells.find(key(cx, cy));
+                if (it != cells.end()) visit_cell(cx, cy, qx0, qy0, it->second, f);
+            }
+        }
+    }
+
+    template <typename F>
+    void visit_cell(int cx, int cy, int qx0, int qy0, const std::vector<ecs::entity_id> &ids, F &f) const {
+        for (ecs::entity_id id : ids) {
+            const entry &e = entries.find(id)->second;
+            if (std::max(e.cx0, qx0) != cx || std::max(e.cy0, qy0) != cy) continue;
+            f(id, e);
+        }
+    }
+
+    phmap::flat_hash_map<u64, std::vector<ecs::entity_id>> cells;
+    phmap::flat_hash_map<ecs::entity_id, entry> entries;
+    u32 gen = 0;
+    size_t touched = 0;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_ffi.hpp"
+
+#include <vector>
+
+#include "engine/core/global.hpp"
+#include "engine/scripting/lua_wrapper.hpp"
+#include "game.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+#define WORLDVIEW_PLANES(C, NAME)                                                                                                                             \
+    "typedef struct { " C " uint16_t *ids; " C " uint32_t *colors; " C " int16_t *temperatures; " C                                                          \
+    " uint32_t *background; uint32_t count, tilesOrigin, backgroundOrigin; int32_t width, height, loadX, loadY, tickX, tickY, tickW, tickH; } " NAME "; "
+
+constexpr const char *WORLDVIEW_CDEF = WORLDVIEW_PLANES("const", "ME_WorldView") WORLDVIEW_PLANES("", "ME_WorldViewMut")
+        "typedef struct { int32_t x, y; int32_t phase; uint32_t generation; uint8_t hasMeta, hasTileCache, needsSave, pad; } ME_ChunkInfo;";
+
+#undef WORLDVIEW_PLANES
+
+static_assert(sizeof(mat_temperature) == sizeof(i16), "ME_WorldView declares temperatures as int16_t");
+
+// 脚本只在主线程上运行 视图和区块数组在两次调用之间保持有效
+WorldView g_view;
+std::vector<WorldViewChunk> g_chunks;
+bool g_writeOpen = false;
+
+world *CurrentWorld() { return global.game ? global.game->Iso.world.get() : nullptr; }
+
+bool FillView(world *w) {
+    if (!w || w->real_tiles.empty()) return false;
+    g_view.ids = w->real_tiles.mat_id_data();
+    g_view.colors = w->real_tiles.color_data();
+    g_view.temperatures = w->real_tiles.temperature_data();
+    g_view.background = w->background.raw();
+    g_view.count = (u32)w->real_tiles.size();
+    g_view.tilesOrigin = (u32)w->real_tiles.origin();
+    g_view.backgroundOrigin = (u32)w->background.origin();
+    g_view.width = w->width;
+    g_view.height = w->height;
+    g_view.loadX = (i32)w->loadZone.x;
+    g_view.loadY = (i32)w->loadZone.y;
+    g_view.tickX = (i32)w->tickZone.x;
+    g_view.tickY = (i32)w->tickZone.y;
+    g_view.tickW = (i32)w->tickZone.w;
+    g_view.tickH = (i32)w->tickZone.h;
+    return true;
+}
+
+int l_view(lua_State *L) {
+    if (!FillView(CurrentWorld())) return 0;
+    lua_pushlightuserdata(L, &g_view);
+    return 1;
+}
+
+int l_write_view(lua_State *L) {
+    if (!FillView(CurrentWorld())) return 0;
+    g_writeOpen = true;
+    lua_pushlightuserdata(L, &g_view);
+    return 1;
+}
+
+int l_commit(lua_State *L) {
+    if (!g_writeOpen) return luaL_error(L, "worldview.commit called without write_view");
+    const int x = (int)luaL_checkinteger(L, 1);
+    const int y = (int)luaL_checkinteger(L, 2);
+    const int w = (int)luaL_checkinteger(L, 3);
+    const int h = (int)luaL_checkinteger(L, 4);
+    const bool background = lua_toboolean(L, 5);
+    if (world *wd = CurrentWorld()) wd->commitRawWrites(x, y, w, h, true, background);
+    g_writeOpen = false;
+    return 0;
+}
+
+int l_chunks(lua_State *L) {
+    world *w = CurrentWorld();
+    g_chunks.clear();
+    if (w) {
+        w->chunkCache.for_each([&](Chunk *ch) {
+            g_chunks.push_back({ch->x, ch->y, ch->generationPhase, ch->generation, ch->hasMeta, ch->hasTileCache, ch->ChunkNeedsSave(), 0});
+        });
+    }
+    lua_pushlightuserdata(L, g_chunks.data());
+    lua_pushinteger(L, (lua_Integer)g_chunks.size());
+    return 2;
+}
+
+// 网格里的实体可能在上一次 tickEntities 之后被销毁 返回前检查一次
+template <typename Query>
+int PushEntities(lua_State *L, Query &&query) {
+    world *w = CurrentWorld();
+    lua_newtable(L);
+    if (!w) return 1;
+    lua_Integer n = 0;
+    query(w->entityGrid, [&](ecs::entity_id id) {
+        if (!w->registry.valid_entity(id)) return;
+        lua_pushinteger(L, (lua_Integer)id);
+        lua_rawseti(L, -2, ++n);
+    });
+    return 1;
+}
+
+int l_entities_in_radius(lua_State *L) {
+    const f32 x = (f32)luaL_checknumber(L, 1);
+    const f32 y = (f32)luaL_checknumber(L, 2);
+    const f32 r = (f32)luaL_checknumber(L, 3);
+    return PushEntities(L, [&](const EntityGrid &grid, auto &&f) { grid.query_radius(x, y, r, f); });
+}
+
+int l_entities_in_rect(lua_State *L) {
+    const f32 x0 = (f32)luaL_checknumber(L, 1);
+    const f32 y0 = (f32)luaL_checknumber(L, 2);
+    const f32 x1 = (f32)luaL_checknumber(L, 3);
+    const f32 y1 = (f32)luaL_checknumber(L, 4);
+    return PushEntities(L, [&](const EntityGrid &grid, auto &&f) { grid.query_rect(x0, y0, x1, y1, f); });
+}
+
+int l_entity_bounds(lua_State *L) {
+    const ecs::entity_id id = (ecs::entity_id)luaL_checkinteger(L, 1);
+    world *w = CurrentWorld();
+    f32 x, y, bw, bh;
+    if (!w || !w->registry.valid_entity(id) || !w->entityGrid.bounds(id, x, y, bw, bh)) return 0;
+    lua_pushnumber(L, x);
+    lua_pushnumber(L, y);
+    lua_pushnumber(L, bw);
+    lua_pushnumber(L, bh);
+    return 4;
+}
+
+// 关注区域的坐标与视图坐标相同 见 InterestZones
+MErect CheckRect(lua_State *L, int idx) {
+    return {(f32)luaL_checknumber(L, idx), (f32)luaL_checknumber(L, idx + 1), (f32)luaL_checknumber(L, idx + 2), (f32)luaL_checknumber(L, idx + 3)};
+}
+
+int l_add_interest(lua_State *L) {
+    const MErect rect = CheckRect(L, 1);
+    const u32 interval = (u32)luaL_optinteger(L, 5, 1);
+    world *w = CurrentWorld();
+    if (!w) return 0;
+    lua_pushinteger(L, (lua_Integer)w->interests.add(rect, interval));
+    return 1;
+}
+
+int l_set_interest(lua_State *L) {
+    const u32 id = (u32)luaL_checkinteger(L, 1);
+    const MErect rect = CheckRect(L, 2);
+    const u32 interval = (u32)luaL_optinteger(L, 6, 1);
+    world *w = CurrentWorld();
+    lua_pushboolean(L, w && w->interests.set(id, rect, interval));
+    return 1;
+}
+
+int l_remove_interest(lua_State *L) {
+    const u32 id = (u32)luaL_checkinteger(L, 1);
+    if (world *w = CurrentWorld()) w->interests.remove(id);
+    return 0;
+}
+
+}  // namespace
+
+int luaopen_worldview(lua_State *L) {
+    luaL_Reg libs[] = {
+            {"view", l_view},
+            {"write_view", l_write_view},
+            {"commit", l_commit},
+            {"chunks", l_chunks},
+            {"entities_in_radius", l_entities_in_radius},
+            {"entities_in_rect", l_entities_in_rect},
+            {"entity_bounds", l_entity_bounds},
+            {"add_interest", l_add_interest},
+            {"set_interest", l_set_interest},
+            {"remove_interest", l_remove_interest},
+            {NULL, NULL},
+    };
+    luaL_newlib(L, libs);
+    lua_pushstring(L, WORLDVIEW_CDEF);
+    lua_setfield(L, -2, "cdef");
+    lua_pushinteger(L, CHUNK_W);
+    lua_setfield(L, -2, "CHUNK_W");
+    lua_pushinteger(L, CHUNK_H);
+    lua_setfield(L, -2, "CHUNK_H");
+    return 1;
+}
+
+}  // namespace ME
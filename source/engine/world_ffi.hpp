@@ -0,0 +1,52 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_FFI_HPP
+#define ME_WORLD_FFI_HPP
+
+#include "engine/core/core.hpp"
+#include "game_datastruct.hpp"
+
+struct lua_State;
+
+namespace ME {
+
+// 脚本通过 ffi 直接读写的世界平面 布局与 WORLDVIEW_CDEF 中的 ME_WorldView 一致
+// 指针指向存储位置 逻辑下标 i = x + y * width 在 (i + origin) mod count 处
+// 世界平移或重建后指针和 origin 都会变化 每帧重新取一次 不要跨帧保存
+struct WorldView {
+    u16 *ids;
+    u32 *colors;
+    mat_temperature *temperatures;
+    u32 *background;
+    u32 count;
+    u32 tilesOrigin;
+    u32 backgroundOrigin;
+    i32 width, height;
+    i32 loadX, loadY;
+    i32 tickX, tickY, tickW, tickH;
+};
+
+// 已加载区块的元数据 x y 为区块坐标 像素原点为 (x * CHUNK_W + loadX, y * CHUNK_H + loadY)
+struct WorldViewChunk {
+    i32 x, y;
+    i32 phase;
+    u32 generation;
+    u8 hasMeta;
+    u8 hasTileCache;
+    u8 needsSave;
+    u8 pad;
+};
+
+// require("_ME_worldview") 的 C 模块 脚本一般通过 data/scripts/common/worldview.lua 使用
+// cdef: 上面两个结构的 C 声明
+// view(): 只读视图 没有世界时返回 nil
+// write_view(): 可写视图 写完后必须调用 commit(x, y, w, h, background) 否则修改不会保存也不会唤醒模拟
+// chunks(): 区块元数据数组和个数
+// entities_in_radius(x, y, r) entities_in_rect(x0, y0, x1, y1): 包围盒与范围相交的实体 id 数组 坐标与 WorldEntity 相同 加上 loadX loadY 才是视图坐标
+// entity_bounds(id): 实体在上一次 tick 登记的 x y w h 不在网格中时返回 nil
+// add_interest(x, y, w, h, interval) set_interest(id, x, y, w, h, interval) remove_interest(id): world::interests 的关注区域 坐标与视图相同 interval 默认为 1
+int luaopen_worldview(lua_State *L);
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,252 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_gen_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "engine/scripting/lua_wrapper.hpp"
+#include "engine/utils/utility.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+using Op = WorldGenGraph::Op;
+
+constexpr int N = CHUNK_W * CHUNK_H;
+
+int InputCount(Op op) {
+    switch (op) {
+        case Op::Add:
+        case Op::Mul:
+            return 2;
+        case Op::Remap:
+        case Op::Clamp:
+        case Op::Threshold:
+            return 1;
+        case Op::Lerp:
+        case Op::Select:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+std::mutex g_programLock;
+std::shared_ptr<const WorldGenProgram> g_program;
+
+// 脚本在主线程上声明节点图
+WorldGenGraph g_graph;
+
+int AddNode(Op op, int a, int b, int c, f32 p0, f32 p1, f32 p2, f32 p3) {
+    WorldGenGraph::Node n;
+    n.op = op;
+    n.a = a;
+    n.b = b;
+    n.c = c;
+    n.p[0] = p0;
+    n.p[1] = p1;
+    n.p[2] = p2;
+    n.p[3] = p3;
+    const int id = g_graph.add(n);
+    if (id < 0) METADOT_ERROR("[LUA] worldgen node references an undefined input");
+    return id;
+}
+
+}  // namespace
+
+int WorldGenGraph::add(const Node &n) {
+    const int self = (int)graph.size();
+    const int inputs[3] = {n.a, n.b, n.c};
+    for (int i = 0; i < InputCount(n.op); i++) {
+        if (inputs[i] < 0 || inputs[i] >= self) return -1;
+    }
+    graph.push_back(n);
+    return self;
+}
+
+bool WorldGenGraph::setOutput(int node) {
+    if (node < 0 || node >= (int)graph.size()) return false;
+    out = node;
+    return true;
+}
+
+std::shared_ptr<const WorldGenProgram> WorldGenProgram::compile(const WorldGenGraph &graph, std::string &error) {
+    const std::vector<WorldGenGraph::Node> &nodes = graph.nodes();
+    if (graph.output() < 0) {
+        error = "worldgen graph has no output";
+        return nullptr;
+    }
+
+    // 从输出回溯 去掉用不到的节点 同时记下每个节点最后一次被读取的位置
+    std::vector<bool> live(nodes.size(), false);
+    live[graph.output()] = true;
+    for (int i = graph.output(); i >= 0; i--) {
+        if (!live[i]) continue;
+        const WorldGenGraph::Node &n = nodes[i];
+        const int inputs[3] = {n.a, n.b, n.c};
+        for (int k = 0; k < InputCount(n.op); k++) live[inputs[k]] = true;
+    }
+
+    std::vector<int> lastUse(nodes.size(), -1);
+    for (int i = 0; i <= graph.output(); i++) {
+        if (!live[i]) continue;
+        const WorldGenGraph::Node &n = nodes[i];
+        const int inputs[3] = {n.a, n.b, n.c};
+        for (int k = 0; k < InputCount(n.op); k++) lastUse[inputs[k]] = i;
+    }
+
+    auto program = std::make_shared<WorldGenProgram>();
+    std::vector<int> slotOf(nodes.size(), -1);
+    std::vector<int> freeSlots;
+
+    for (int i = 0; i <= graph.output(); i++) {
+        if (!live[i]) continue;
+        const WorldGenGraph::Node &n = nodes[i];
+        const int inputs[3] = {n.a, n.b, n.c};
+
+        Instr ins{n.op, -1, -1, -1, -1, {n.p[0], n.p[1], n.p[2], n.p[3]}};
+        int *srcs[3] = {&ins.a, &ins.b, &ins.c};
+        for (int k = 0; k < InputCount(n.op); k++) *srcs[k] = slotOf[inputs[k]];
+
+        // 逐元素运算先读后写 输入在这里最后一次使用时输出可以直接复用它的槽
+        for (int k = 0; k < InputCount(n.op); k++) {
+            const int s = slotOf[inputs[k]];
+            if (lastUse[inputs[k]] == i && std::find(freeSlots.begin(), freeSlots.end(), s) == freeSlots.end()) freeSlots.push_back(s);
+        }
+        if (freeSlots.empty()) {
+            ins.dst = program->slots++;
+        } else {
+            ins.dst = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slotOf[i] = ins.dst;
+
+        if (n.op == Op::BiomeMask) program->needsBiomes = true;
+        program->code.push_back(ins);
+    }
+
+    program->outSlot = slotOf[graph.output()];
+    return program;
+}
+
+void WorldGenProgram::run(world *world, Chunk *ch, u32 *out) const {
+    thread_local std::vector<f32> buffers;
+    buffers.resize((size_t)slots * N);
+
+    const int ox = ch->x * CHUNK_W;
+    const int oy = ch->y * CHUNK_H;
+
+    // 群系写到区块里 createChunk 不再重复计算
+    if (needsBiomes && ch->biomes_id.size() != N) world->fillChunkBiomes(ch);
+    const u8 *biomes = ch->biomes_id.data();
+
+    for (const Instr &ins : code) {
+        f32 *d = buffers.data() + (size_t)ins.dst * N;
+        const f32 *a = ins.a >= 0 ? buffers.data() + (size_t)ins.a * N : nullptr;
+        const f32 *b = ins.b >= 0 ? buffers.data() + (size_t)ins.b * N : nullptr;
+        const f32 *c = ins.c >= 0 ? buffers.data() + (size_t)ins.c * N : nullptr;
+        const f32 p0 = ins.p[0], p1 = ins.p[1], p2 = ins.p[2], p3 = ins.p[3];
+
+        switch (ins.op) {
+            case Op::Const:
+                std::fill(d, d + N, p0);
+                break;
+            case Op::Noise: {
+                f32 xs[CHUNK_W], ys[CHUNK_H];
+                for (int x = 0; x < CHUNK_W; x++) xs[x] = (x + ox) * p1;
+                for (int y = 0; y < CHUNK_H; y++) ys[y] = (y + oy) * p2;
+                world->noise.GetPerlinGrid(xs, CHUNK_W, ys, CHUNK_H, p0, d);
+                break;
+            }
+            case Op::NoiseX: {
+                f32 xs[CHUNK_W];
+                const f32 zero = 0;
+                for (int x = 0; x < CHUNK_W; x++) xs[x] = (x + ox) * p1;
+                world->noise.GetPerlinGrid(xs, CHUNK_W, &zero, 1, p0, d);
+                for (int y = 1; y < CHUNK_H; y++) std::copy(d, d + CHUNK_W, d + y * CHUNK_W);
+                break;
+            }
+            case Op::GradientY: {
+                const f32 inv = p1 != p0 ? 1.0f / (p1 - p0) : 0.0f;
+                for (int y = 0; y < CHUNK_H; y++) std::fill(d + y * CHUNK_W, d + (y + 1) * CHUNK_W, (y + oy - p0) * inv);
+                break;
+            }
+            case Op::Add:
+                for (int i = 0; i < N; i++) d[i] = a[i] + b[i];
+                break;
+            case Op::Mul:
+                for (int i = 0; i < N; i++) d[i] = a[i] * b[i];
+                break;
+            case Op::Remap: {
+                const f32 scale = p1 != p0 ? (p3 - p2) / (p1 - p0) : 0.0f;
+                for (int i = 0; i < N; i++) d[i] = (a[i] - p0) * scale + p2;
+                break;
+            }
+            case Op::Clamp:
+                for (int i = 0; i < N; i++) d[i] = std::min(std::max(a[i], p0), p1);
+                break;
+            case Op::Lerp:
+                for (int i = 0; i < N; i++) d[i] = a[i] + (b[i] - a[i]) * c[i];
+                break;
+            case Op::Threshold:
+                for (int i = 0; i < N; i++) d[i] = a[i] >= p0 ? 1.0f : 0.0f;
+                break;
+            case Op::Select:
+                for (int i = 0; i < N; i++) d[i] = a[i] < p0 ? b[i] : c[i];
+                break;
+            case Op::BiomeMask: {
+                const int id = (int)p0;
+                for (int i = 0; i < N; i++) d[i] = biomes[i] == id ? 1.0f : 0.0f;
+                break;
+            }
+        }
+    }
+
+    const f32 *result = buffers.data() + (size_t)outSlot * N;
+    for (int i = 0; i < N; i++) out[i] = (u32)std::max(0l, std::lround(result[i]));
+}
+
+void WorldGenProgram::publish(std::shared_ptr<const WorldGenProgram> program) {
+    std::lock_guard<std::mutex> guard(g_programLock);
+    g_program = std::move(program);
+}
+
+std::shared_ptr<const WorldGenProgram> WorldGenProgram::current() {
+    std::lock_guard<std::mutex> guard(g_programLock);
+    return g_program;
+}
+
+void RegisterWorldGenLua(lua_wrapper::State &s_lua) {
+    s_lua["worldgen_clear"] = lua_wrapper::fast_function([]() { g_graph.clear(); });
+    s_lua["worldgen_const"] = lua_wrapper::fast_function([](f32 v) { return AddNode(Op::Const, -1, -1, -1, v, 0, 0, 0); });
+    s_lua["worldgen_noise"] = lua_wrapper::fast_function([](f32 z, f32 fx, f32 fy) { return AddNode(Op::Noise, -1, -1, -1, z, fx, fy, 0); });
+    s_lua["worldgen_noise_x"] = lua_wrapper::fast_function([](f32 z, f32 fx) { return AddNode(Op::NoiseX, -1, -1, -1, z, fx, 0, 0); });
+    s_lua["worldgen_gradient_y"] = lua_wrapper::fast_function([](f32 y0, f32 y1) { return AddNode(Op::GradientY, -1, -1, -1, y0, y1, 0, 0); });
+    s_lua["worldgen_add"] = lua_wrapper::fast_function([](int a, int b) { return AddNode(Op::Add, a, b, -1, 0, 0, 0, 0); });
+    s_lua["worldgen_mul"] = lua_wrapper::fast_function([](int a, int b) { return AddNode(Op::Mul, a, b, -1, 0, 0, 0, 0); });
+    s_lua["worldgen_remap"] = lua_wrapper::fast_function(
+            [](int a, f32 inMin, f32 inMax, f32 outMin, f32 outMax) { return AddNode(Op::Remap, a, -1, -1, inMin, inMax, outMin, outMax); });
+    s_lua["worldgen_clamp"] = lua_wrapper::fast_function([](int a, f32 lo, f32 hi) { return AddNode(Op::Clamp, a, -1, -1, lo, hi, 0, 0); });
+    s_lua["worldgen_lerp"] = lua_wrapper::fast_function([](int a, int b, int t) { return AddNode(Op::Lerp, a, b, t, 0, 0, 0, 0); });
+    s_lua["worldgen_threshold"] = lua_wrapper::fast_function([](int a, f32 t) { return AddNode(Op::Threshold, a, -1, -1, t, 0, 0, 0); });
+    s_lua["worldgen_select"] = lua_wrapper::fast_function([](int a, f32 t, int below, int above) { return AddNode(Op::Select, a, below, above, t, 0, 0, 0); });
+    s_lua["worldgen_biome_mask"] = lua_wrapper::fast_function([](int biome) { return AddNode(Op::BiomeMask, -1, -1, -1, (f32)biome, 0, 0, 0); });
+    s_lua["worldgen_output"] = lua_wrapper::fast_function([](int n) { return g_graph.setOutput(n); });
+    s_lua["worldgen_compile"] = lua_wrapper::function([]() {
+        std::string error;
+        auto program = WorldGenProgram::compile(g_graph, error);
+        if (!program) {
+            METADOT_ERROR("[LUA] worldgen_compile: ", error);
+            return false;
+        }
+        METADOT_INFO("[LUA] worldgen compiled ", program->instructionCount(), " instructions ", program->slotCount(), " buffers");
+        WorldGenProgram::publish(std::move(program));
+        return true;
+    });
+}
+
+}  // namespace ME
@@ -0,0 +1,97 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_GEN_GRAPH_HPP
+#define ME_WORLD_GEN_GRAPH_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+class world;
+struct Chunk;
+
+namespace lua_wrapper {
+class State;
+}
+
+// 脚本声明的地形节点图
+// 每个节点输出一张 CHUNK_W x CHUNK_H 的 f32 场 节点只能引用已经创建的节点 创建顺序就是拓扑序
+// 输出节点的值四舍五入后作为材料 ID
+class WorldGenGraph {
+public:
+    enum class Op : u8 {
+        Const,      // p0
+        Noise,      // Perlin(px * p1, py * p2, p0)
+        NoiseX,     // Perlin(px * p1, 0, p0) 每列一个值 用于地表高度
+        GradientY,  // (py - p0) / (p1 - p0)
+        Add,        // a + b
+        Mul,        // a * b
+        Remap,      // 把 a 从 [p0, p1] 线性映射到 [p2, p3]
+        Clamp,      // clamp(a, p0, p1)
+        Lerp,       // a + (b - a) * c
+        Threshold,  // a >= p0 ? 1 : 0
+        Select,     // a < p0 ? b : c
+        BiomeMask,  // 群系 == p0 ? 1 : 0
+    };
+
+    struct Node {
+        Op op = Op::Const;
+        int a = -1, b = -1, c = -1;
+        f32 p[4] = {};
+    };
+
+    // 输入引用了不存在的节点时返回 -1
+    int add(const Node &n);
+    bool setOutput(int node);
+
+    const std::vector<Node> &nodes() const { return graph; }
+    int output() const { return out; }
+
+    void clear() {
+        graph.clear();
+        out = -1;
+    }
+
+private:
+    std::vector<Node> graph;
+    int out = -1;
+};
+
+// 节点图编译后的求值程序 只读 多个生成任务可以共享
+// 只保留输出依赖的节点 按节点的生命周期复用缓冲槽 每条指令对整个区块做一次连续循环
+class WorldGenProgram {
+public:
+    static std::shared_ptr<const WorldGenProgram> compile(const WorldGenGraph &graph, std::string &error);
+
+    // out 为 CHUNK_W * CHUNK_H 个材料 ID
+    void run(world *world, Chunk *ch, u32 *out) const;
+
+    size_t instructionCount() const { return code.size(); }
+    int slotCount() const { return slots; }
+
+    // 脚本 worldgen_compile 发布的当前程序 生成任务每个区块开始时取一次
+    static void publish(std::shared_ptr<const WorldGenProgram> program);
+    static std::shared_ptr<const WorldGenProgram> current();
+
+private:
+    struct Instr {
+        WorldGenGraph::Op op;
+        int dst, a, b, c;
+        f32 p[4];
+    };
+
+    std::vector<Instr> code;
+    int slots = 0;
+    int outSlot = -1;
+    bool needsBiomes = false;
+};
+
+void RegisterWorldGenLua(lua_wrapper::State &s_lua);
+
+}  // namespace ME
+
+#endif
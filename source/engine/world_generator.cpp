@@ -2,23 +2,27 @@
 
 #include "world_generator.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "engine/core/global.hpp"
 #include "engine/utils/random.hpp"
 #include "game.hpp"
 #include "game_datastruct.hpp"
+#include "world_gen_graph.hpp"
 
 namespace ME {
 
 #pragma region MaterialTestGenerator
 
 void MaterialTestGenerator::generateChunk(world *world, Chunk *ch) {
-    MaterialInstance *prop = new MaterialInstance[CHUNK_W * CHUNK_H];
-    MaterialInstance *layer2 = new MaterialInstance[CHUNK_W * CHUNK_H];
-    u32 *background = new u32[CHUNK_W * CHUNK_H];
+    MaterialInstance *prop = ChunkStoragePool::alloc_tiles();
+    u32 *background = ChunkStoragePool::alloc_background();
     Material *mat;
 
     while (true) {
-        mat = GAME()->materials_container[rand() % GAME()->materials_container.size()];
+        mat = GAME()->materials_container[RNG_Rand() % GAME()->materials_container.size()];
         if (mat->id >= 31 && (mat->physicsType == PhysicsType::SAND || mat->physicsType == PhysicsType::SOUP)) break;
     }
 
@@ -46,13 +50,11 @@ void MaterialTestGenerator::generateChunk(world *world, Chunk *ch) {
             } else {
                 prop[x + y * CHUNK_W] = Tiles_NOTHING;
             }
-
-            layer2[x + y * CHUNK_W] = Tiles_NOTHING;
         }
     }
 
     ch->tiles = prop;
-    ch->layer2 = layer2;
+    ch->layer2.clear();
     ch->background = background;
 }
 
@@ -62,54 +64,104 @@ std::vector<Populator *> MaterialTestGenerator::getPopulators() { return {}; }
 
 #pragma region DefaultGenerator
 
-int DefaultGenerator::getBaseHeight(world *world, int x, Chunk *ch) {
-
-    if (nullptr == ch) {
-        return 0;
-    }
-
-    int b = world->getBiomeAt(ch, x, ch->y * CHUNK_H);
+namespace {
 
-    if (b == Biome::biomeGetID("DEFAULT")) {
+// 地表高度公式 噪声由调用方给出 逐列版本和整列缓存共用
+int BaseHeightFromNoise(world *world, int b, f32 n15) {
+    const auto &ids = world->biomeIds;
+    if (b == ids.defaultId) {
         // return 0;
-        return (int)(world->height / 2 + ((world->noise.GetPerlin((f32)(x / 10.0), 0, 15))) * 100);
-    } else if (b == Biome::biomeGetID("PLAINS")) {
+        return (int)(world->height / 2 + (n15) * 100);
+    } else if (b == ids.plains) {
         // return 10;
-        return (int)(world->height / 2 + ((world->noise.GetPerlin((f32)(x / 10.0), 0, 15))) * 25);
-    } else if (b == Biome::biomeGetID("FOREST")) {
+        return (int)(world->height / 2 + (n15) * 25);
+    } else if (b == ids.forest) {
         // return 20;
-        return (int)(world->height / 2 + ((world->noise.GetPerlin((f32)(x / 10.0), 0, 15))) * 100);
-    } else if (b == Biome::biomeGetID("MOUNTAINS")) {
+        return (int)(world->height / 2 + (n15) * 100);
+    } else if (b == ids.mountains) {
         // return 30;
-        return (int)(world->height / 2 + ((world->noise.GetPerlin((f32)(x / 10.0), 0, 15))) * 250);
+        return (int)(world->height / 2 + (n15) * 250);
     }
 
     return 0;
 }
 
+int HeightOffsetFromNoise(world *world, int b, f32 n1, f32 n5) {
+    const auto &ids = world->biomeIds;
+    if (b == ids.defaultId) {
+        return (int)(((n1 / 2.0) + 0.5) * 15 + (((n5 / 2.0) + 0.5) - 0.5) * 2);
+    } else if (b == ids.plains) {
+        return (int)(((n1 / 2.0) + 0.5) * 6 + ((n5 / 2.0) - 0.5) * 2);
+    } else if (b == ids.forest) {
+        return (int)(((n1 / 2.0) + 0.5) * 15 + ((n5 / 2.0) - 0.5) * 2);
+    } else if (b == ids.mountains) {
+        return (int)(((n1 / 2.0) + 0.5) * 20 + ((n5 / 2.0) - 0.5) * 4);
+    }
+
+    return 0;
+}
+
+}  // namespace
+
+int DefaultGenerator::getBaseHeight(world *world, int x, Chunk *ch) {
+
+    if (nullptr == ch) {
+        return 0;
+    }
+
+    // 与 getColumn 一致 基础高度按默认群系计算
+    return BaseHeightFromNoise(world, world->biomeIds.defaultId, world->noise.GetPerlin((f32)(x / 10.0), 0, 15));
+}
+
 int DefaultGenerator::getHeight(world *world, int x, Chunk *ch) {
 
     int baseH = getBaseHeight(world, x, ch);
 
     int b = world->getBiomeAt(x, 0);
+    baseH += HeightOffsetFromNoise(world, b, world->noise.GetPerlin((f32)(x * 1), 0, 30), world->noise.GetPerlin((f32)(x * 5), 0, 30));
 
-    if (b == Biome::biomeGetID("DEFAULT")) {
-        baseH += (int)(((world->noise.GetPerlin((f32)(x * 1), 0, 30) / 2.0) + 0.5) * 15 + (((world->noise.GetPerlin((f32)(x * 5), 0, 30) / 2.0) + 0.5) - 0.5) * 2);
-    } else if (b == Biome::biomeGetID("PLAINS")) {
-        baseH += (int)(((world->noise.GetPerlin((f32)(x * 1), 0, 30) / 2.0) + 0.5) * 6 + ((world->noise.GetPerlin((f32)(x * 5), 0, 30) / 2.0) - 0.5) * 2);
-    } else if (b == Biome::biomeGetID("FOREST")) {
-        baseH += (int)(((world->noise.GetPerlin((f32)(x * 1), 0, 30) / 2.0) + 0.5) * 15 + ((world->noise.GetPerlin((f32)(x * 5), 0, 30) / 2.0) - 0.5) * 2);
-    } else if (b == Biome::biomeGetID("MOUNTAINS")) {
-        baseH += (int)(((world->noise.GetPerlin((f32)(x * 1), 0, 30) / 2.0) + 0.5) * 20 + ((world->noise.GetPerlin((f32)(x * 5), 0, 30) / 2.0) - 0.5) * 4);
+    return baseH;
+}
+
+std::shared_ptr<const DefaultGenerator::Column> DefaultGenerator::getColumn(world *world, int cx) {
+    {
+        std::lock_guard<std::mutex> guard(columnLock);
+        auto it = columns.find(cx);
+        if (it != columns.end()) return it->second;
     }
 
-    return baseH;
+    // 不持锁计算 两个任务同时算同一列时结果相同 后写入的覆盖
+    auto col = std::make_shared<Column>();
+    f32 xs[3][CHUNK_W];
+    f32 n[3][CHUNK_W];
+    const f32 zero = 0;
+
+    for (int x = 0; x < CHUNK_W; x++) {
+        int px = x + cx * CHUNK_W;
+        xs[0][x] = (f32)(px / 10.0);
+        xs[1][x] = (f32)(px * 1);
+        xs[2][x] = (f32)(px * 5);
+    }
+    world->noise.GetPerlinGrid(xs[0], CHUNK_W, &zero, 1, 15, n[0]);
+    world->noise.GetPerlinGrid(xs[1], CHUNK_W, &zero, 1, 30, n[1]);
+    world->noise.GetPerlinGrid(xs[2], CHUNK_W, &zero, 1, 30, n[2]);
+
+    // 基础高度按默认群系计算 高度只取决于 x
+    for (int x = 0; x < CHUNK_W; x++) {
+        int px = x + cx * CHUNK_W;
+        col->surfaceBiome[x] = world->getSurfaceBiomeAt(px);
+        col->height[x] = BaseHeightFromNoise(world, world->biomeIds.defaultId, n[0][x]) + HeightOffsetFromNoise(world, col->surfaceBiome[x], n[1][x], n[2][x]);
+    }
+
+    std::lock_guard<std::mutex> guard(columnLock);
+    if (columns.size() >= MAX_COLUMNS) columns.clear();
+    columns[cx] = col;
+    return col;
 }
 
 void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
-    MaterialInstance *prop = new MaterialInstance[CHUNK_W * CHUNK_H];
-    MaterialInstance *layer2 = new MaterialInstance[CHUNK_W * CHUNK_H];
-    u32 *background = new u32[CHUNK_W * CHUNK_H];
+    MaterialInstance *prop = ChunkStoragePool::alloc_tiles();
+    u32 *background = ChunkStoragePool::alloc_background();
 
     // METADOT_BUG(std::format("DefaultGenerator generateChunk {0} {1}", ch->x, ch->y).c_str());
 
@@ -133,40 +185,95 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
 
 #if 1
 
+    // 每个区块只计算一次各层噪声 逐像素只读缓冲 地表高度和地表带群系按列缓存
+    const auto column = getColumn(world, ch->x);
+    // 逐像素的群系顺带记到区块里 随存档保存
+    ch->biomes_id.resize(CHUNK_W * CHUNK_H);
+    const int *surfs = column->height;
+
+    int minSurf = surfs[0], maxSurf = surfs[0];
+    for (int x = 1; x < CHUNK_W; x++) {
+        minSurf = std::min(minSurf, surfs[x]);
+        maxSurf = std::max(maxSurf, surfs[x]);
+    }
+
+    // 洞穴层只在 py > surf 的行需要 地表层只在 surf - 64 < py <= surf 的行需要 其余行不计算
+    const int oy = ch->y * CHUNK_W;
+    const int caveY0 = std::clamp(minSurf + 1 - oy, 0, CHUNK_H);
+    const int bandY0 = std::clamp(minSurf - 63 - oy, 0, CHUNK_H);
+    const int bandY1 = std::clamp(maxSurf + 1 - oy, bandY0, CHUNK_H);
+
+    thread_local std::vector<f32> caveN, caveN2, caveN3, surfN;
+    caveN.resize(CHUNK_W * CHUNK_H);
+    caveN2.resize(CHUNK_W * CHUNK_H);
+    caveN3.resize(CHUNK_W * CHUNK_H);
+    surfN.resize(CHUNK_W * CHUNK_H);
+
+    f32 xs2[CHUNK_W], xs4[CHUNK_W], xs8[CHUNK_W];
+    f32 ys2[CHUNK_H], ys4[CHUNK_H], ys8[CHUNK_H];
     for (int x = 0; x < CHUNK_W; x++) {
         int px = x + ch->x * CHUNK_W;
+        xs2[x] = (f32)(px * 2.0);
+        xs4[x] = (f32)(px * 4.0);
+        xs8[x] = (f32)(px * 8.0);
+    }
+    for (int y = 0; y < CHUNK_H; y++) {
+        int py = y + oy;
+        ys2[y] = (f32)(py * 2.0);
+        ys4[y] = (f32)(py * 4.0);
+        ys8[y] = (f32)(py * 8.0);
+    }
 
-        int surf = getHeight(world, px, ch);
+    if (caveY0 < CHUNK_H) {
+        const int rows = CHUNK_H - caveY0;
+        world->noise.GetPerlinGrid(xs4, CHUNK_W, ys4 + caveY0, rows, 2960, caveN.data() + caveY0 * CHUNK_W);
+        world->noise.GetPerlinGrid(xs2, CHUNK_W, ys2 + caveY0, rows, 8923, caveN2.data() + caveY0 * CHUNK_W);
+        world->noise.GetPerlinGrid(xs8, CHUNK_W, ys8 + caveY0, rows, 7526, caveN3.data() + caveY0 * CHUNK_W);
+    }
+    if (bandY0 < bandY1) {
+        world->noise.GetPerlinGrid(xs4, CHUNK_W, ys4 + bandY0, bandY1 - bandY0, 0, surfN.data() + bandY0 * CHUNK_W);
+    }
+
+    const auto &ids = world->biomeIds;
+    const int idTest1 = ids.test[0], idTest2 = ids.test[1], idTest3 = ids.test[2], idTest4 = ids.test[3];
+    const int idTest1_2 = ids.test2[0], idTest2_2 = ids.test2[1], idTest3_2 = ids.test2[2], idTest4_2 = ids.test2[3];
+    const int idDefault = ids.defaultId, idPlains = ids.plains, idMountains = ids.mountains, idForest = ids.forest;
+
+    for (int x = 0; x < CHUNK_W; x++) {
+        int px = x + ch->x * CHUNK_W;
+
+        int surf = surfs[x];
 
         for (int y = 0; y < CHUNK_H; y++) {
             background[x + y * CHUNK_W] = 0x00000000;
             int py = y + ch->y * CHUNK_W;
-            int b = world->getBiomeAt(px, py);
+            int b = world->inSurfaceBand(py) ? column->surfaceBiome[x] : world->getBiomeAt(px, py);
+            ch->biomes_id[x + y * CHUNK_W] = (u8)b;
 
             // std::cout << "DefaultGenerator generate " << ch->x << " " << ch->y << " Biome: " << b->name << std::endl;
 
-            if (b == Biome::biomeGetID("TEST_1")) {
+            if (b == idTest1) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffe00000);
-            } else if (b == Biome::biomeGetID("TEST_2")) {
+            } else if (b == idTest2) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff00ff00);
-            } else if (b == Biome::biomeGetID("TEST_3")) {
+            } else if (b == idTest3) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff0000ff);
-            } else if (b == Biome::biomeGetID("TEST_4")) {
+            } else if (b == idTest4) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffff00ff);
             }
 
-            if (b == Biome::biomeGetID("TEST_1_2")) {
+            if (b == idTest1_2) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffFF6600);
-            } else if (b == Biome::biomeGetID("TEST_2_2")) {
+            } else if (b == idTest2_2) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff00FFBF);
-            } else if (b == Biome::biomeGetID("TEST_3_2")) {
+            } else if (b == idTest3_2) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff005DFF);
-            } else if (b == Biome::biomeGetID("TEST_4_2")) {
+            } else if (b == idTest4_2) {
                 prop[x + y * CHUNK_W] = MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xffC200FF);
             }
             // continue;
 
-            if (b == Biome::biomeGetID("DEFAULT")) {
+            if (b == idDefault) {
                 if (py > surf) {
                     int tx = (global.game->Iso.texturepack.caveBG->surface()->w + (px % global.game->Iso.texturepack.caveBG->surface()->w)) % global.game->Iso.texturepack.caveBG->surface()->w;
                     int ty = (global.game->Iso.texturepack.caveBG->surface()->h + (py % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
@@ -174,20 +281,18 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
                                                                ty % global.game->Iso.texturepack.caveBG->surface()->h);
                     f64 thru = std::fmin(std::fmax(0, abs(surf - py) / 150.0), 1);
 
-                    f64 n = (world->noise.GetPerlin(px * 4.0, py * 4.0, 2960) / 2.0 + 0.5) - 0.1;
-                    f64 n2 = ((world->noise.GetPerlin(px * 2.0, py * 2.0, 8923) / 2.0 + 0.5) * 0.9 + (world->noise.GetPerlin(px * 8.0, py * 8.0, 7526) / 2.0 + 0.5) * 0.1) - 0.1;
+                    f64 n = (caveN[x + y * CHUNK_W] / 2.0 + 0.5) - 0.1;
+                    f64 n2 = ((caveN2[x + y * CHUNK_W] / 2.0 + 0.5) * 0.9 + (caveN3[x + y * CHUNK_W] / 2.0 + 0.5) * 0.1) - 0.1;
                     prop[x + y * CHUNK_W] = (n * (1 - thru) + n2 * thru) < 0.5 ? TilesCreateSmoothStone(px, py) : TilesCreateSmoothDirt(px, py);
                 } else if (py > surf - 64) {
-                    f64 n = ((world->noise.GetPerlin(px * 4.0, py * 4.0, 0) / 2.0 + 0.5) + 0.4) / 2.0;
+                    f64 n = ((surfN[x + y * CHUNK_W] / 2.0 + 0.5) + 0.4) / 2.0;
                     prop[x + y * CHUNK_W] = n < abs((surf - 64) - py) / 64.0 ? TilesCreateSmoothDirt(px, py) : TilesCreateSoftDirt(px, py);
                 } else if (py > surf - 65) {
-                    if (rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
+                    if (RNG_Rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
                 } else {
                     prop[x + y * CHUNK_W] = Tiles_NOTHING;
                 }
-
-                layer2[x + y * CHUNK_W] = Tiles_NOTHING;
-            } else if (b == Biome::biomeGetID("PLAINS")) {
+            } else if (b == idPlains) {
                 if (py > surf) {
                     int tx = (global.game->Iso.texturepack.caveBG->surface()->w + (px % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
                     int ty = (global.game->Iso.texturepack.caveBG->surface()->h + (py % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
@@ -197,20 +302,18 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
                     background[x + y * CHUNK_W] = *((u32 *)pixel);
                     f64 thru = std::fmin(std::fmax(0, abs(surf - py) / 150.0), 1);
 
-                    f64 n = (world->noise.GetPerlin(px * 4.0, py * 4.0, 2960) / 2.0 + 0.5) - 0.1;
-                    f64 n2 = ((world->noise.GetPerlin(px * 2.0, py * 2.0, 8923) / 2.0 + 0.5) * 0.9 + (world->noise.GetPerlin(px * 8.0, py * 8.0, 7526) / 2.0 + 0.5) * 0.1) - 0.1;
+                    f64 n = (caveN[x + y * CHUNK_W] / 2.0 + 0.5) - 0.1;
+                    f64 n2 = ((caveN2[x + y * CHUNK_W] / 2.0 + 0.5) * 0.9 + (caveN3[x + y * CHUNK_W] / 2.0 + 0.5) * 0.1) - 0.1;
                     prop[x + y * CHUNK_W] = (n * (1 - thru) + n2 * thru) < 0.5 ? TilesCreateSmoothStone(px, py) : TilesCreateSmoothDirt(px, py);
                 } else if (py > surf - 64) {
-                    f64 n = ((world->noise.GetPerlin(px * 4.0, py * 4.0, 0) / 2.0 + 0.5) + 0.4) / 2.0;
+                    f64 n = ((surfN[x + y * CHUNK_W] / 2.0 + 0.5) + 0.4) / 2.0;
                     prop[x + y * CHUNK_W] = n < abs((surf - 64) - py) / 64.0 ? TilesCreateSmoothDirt(px, py) : MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0xff0000);
                 } else if (py > surf - 65) {
-                    if (rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
+                    if (RNG_Rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
                 } else {
                     prop[x + y * CHUNK_W] = Tiles_NOTHING;
                 }
-
-                layer2[x + y * CHUNK_W] = Tiles_NOTHING;
-            } else if (b == Biome::biomeGetID("MOUNTAINS")) {
+            } else if (b == idMountains) {
                 if (py > surf) {
                     int tx = (global.game->Iso.texturepack.caveBG->surface()->w + (px % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
                     int ty = (global.game->Iso.texturepack.caveBG->surface()->h + (py % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
@@ -220,20 +323,18 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
                     background[x + y * CHUNK_W] = *((u32 *)pixel);
                     f64 thru = std::fmin(std::fmax(0, abs(surf - py) / 150.0), 1);
 
-                    f64 n = (world->noise.GetPerlin(px * 4.0, py * 4.0, 2960) / 2.0 + 0.5) - 0.1;
-                    f64 n2 = ((world->noise.GetPerlin(px * 2.0, py * 2.0, 8923) / 2.0 + 0.5) * 0.9 + (world->noise.GetPerlin(px * 8.0, py * 8.0, 7526) / 2.0 + 0.5) * 0.1) - 0.1;
+                    f64 n = (caveN[x + y * CHUNK_W] / 2.0 + 0.5) - 0.1;
+                    f64 n2 = ((caveN2[x + y * CHUNK_W] / 2.0 + 0.5) * 0.9 + (caveN3[x + y * CHUNK_W] / 2.0 + 0.5) * 0.1) - 0.1;
                     prop[x + y * CHUNK_W] = (n * (1 - thru) + n2 * thru) < 0.5 ? TilesCreateSmoothStone(px, py) : TilesCreateSmoothDirt(px, py);
                 } else if (py > surf - 64) {
-                    f64 n = ((world->noise.GetPerlin(px * 4.0, py * 4.0, 0) / 2.0 + 0.5) + 0.4) / 2.0;
+                    f64 n = ((surfN[x + y * CHUNK_W] / 2.0 + 0.5) + 0.4) / 2.0;
                     prop[x + y * CHUNK_W] = n < abs((surf - 64) - py) / 64.0 ? TilesCreateSmoothDirt(px, py) : MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0x00ff00);
                 } else if (py > surf - 65) {
-                    if (rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
+                    if (RNG_Rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
                 } else {
                     prop[x + y * CHUNK_W] = Tiles_NOTHING;
                 }
-
-                layer2[x + y * CHUNK_W] = Tiles_NOTHING;
-            } else if (b == Biome::biomeGetID("FOREST")) {
+            } else if (b == idForest) {
                 if (py > surf) {
                     int tx = (global.game->Iso.texturepack.caveBG->surface()->w + (px % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
                     int ty = (global.game->Iso.texturepack.caveBG->surface()->h + (py % global.game->Iso.texturepack.caveBG->surface()->h)) % global.game->Iso.texturepack.caveBG->surface()->h;
@@ -243,19 +344,17 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
                     background[x + y * CHUNK_W] = *((u32 *)pixel);
                     f64 thru = std::fmin(std::fmax(0, abs(surf - py) / 150.0), 1);
 
-                    f64 n = (world->noise.GetPerlin(px * 4.0, py * 4.0, 2960) / 2.0 + 0.5) - 0.1;
-                    f64 n2 = ((world->noise.GetPerlin(px * 2.0, py * 2.0, 8923) / 2.0 + 0.5) * 0.9 + (world->noise.GetPerlin(px * 8.0, py * 8.0, 7526) / 2.0 + 0.5) * 0.1) - 0.1;
+                    f64 n = (caveN[x + y * CHUNK_W] / 2.0 + 0.5) - 0.1;
+                    f64 n2 = ((caveN2[x + y * CHUNK_W] / 2.0 + 0.5) * 0.9 + (caveN3[x + y * CHUNK_W] / 2.0 + 0.5) * 0.1) - 0.1;
                     prop[x + y * CHUNK_W] = (n * (1 - thru) + n2 * thru) < 0.5 ? TilesCreateSmoothStone(px, py) : TilesCreateSmoothDirt(px, py);
                 } else if (py > surf - 64) {
-                    f64 n = ((world->noise.GetPerlin(px * 4.0, py * 4.0, 0) / 2.0 + 0.5) + 0.4) / 2.0;
+                    f64 n = ((surfN[x + y * CHUNK_W] / 2.0 + 0.5) + 0.4) / 2.0;
                     prop[x + y * CHUNK_W] = n < abs((surf - 64) - py) / 64.0 ? TilesCreateSmoothDirt(px, py) : MaterialInstance(&GAME()->materials_list.GENERIC_SOLID, 0x0000ff);
                 } else if (py > surf - 65) {
-                    if (rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
+                    if (RNG_Rand() % 2 == 0) prop[x + y * CHUNK_W] = TilesCreateGrass();
                 } else {
                     prop[x + y * CHUNK_W] = Tiles_NOTHING;
                 }
-
-                layer2[x + y * CHUNK_W] = Tiles_NOTHING;
             }
 
             // prop[x + y * CHUNK_W] = Tiles_NOTHING;
@@ -304,7 +403,7 @@ void DefaultGenerator::generateChunk(world *world, Chunk *ch) {
 #endif
 
     ch->tiles = prop;
-    ch->layer2 = layer2;
+    ch->layer2.clear();
     ch->background = background;
 }
 
@@ -315,7 +414,31 @@ std::vector<Populator *> DefaultGenerator::getPopulators() {
 
 #pragma endregion
 
-void ScriptingWorldGenerator::generateChunk(world *world, Chunk *ch) {}
+void ScriptingWorldGenerator::generateChunk(world *world, Chunk *ch) {
+    MaterialInstance *prop = ChunkStoragePool::alloc_tiles();
+    u32 *background = ChunkStoragePool::alloc_background();
+
+    // 脚本还没有编译节点图时生成空区块
+    const auto program = WorldGenProgram::current();
+    thread_local std::vector<u32> ids;
+    ids.assign(CHUNK_W * CHUNK_H, GAME()->materials_list.GENERIC_AIR.id);
+    if (program) program->run(world, ch, ids.data());
+
+    const u32 count = (u32)GAME()->materials_container.size();
+    for (int y = 0; y < CHUNK_H; y++) {
+        int py = y + ch->y * CHUNK_H;
+        for (int x = 0; x < CHUNK_W; x++) {
+            int px = x + ch->x * CHUNK_W;
+            const u32 id = ids[x + y * CHUNK_W];
+            prop[x + y * CHUNK_W] = (id == GAME()->materials_list.GENERIC_AIR.id || id >= count) ? Tiles_NOTHING : TilesCreate(id, px, py);
+            background[x + y * CHUNK_W] = 0x00000000;
+        }
+    }
+
+    ch->tiles = prop;
+    ch->layer2.clear();
+    ch->background = background;
+}
 
 std::vector<Populator *> ScriptingWorldGenerator::getPopulators() { return {}; }
 
@@ -3,6 +3,10 @@
 #ifndef ME_GENERATOR_WORLD_H
 #define ME_GENERATOR_WORLD_H
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "engine/core/global.hpp"
 #include "game.hpp"
 #include "game_datastruct.hpp"
@@ -25,6 +29,18 @@ class DefaultGenerator : public WorldGenerator {
     int getBaseHeight(world *world, int x, Chunk *ch);
     int getHeight(world *world, int x, Chunk *ch);
 
+    // 同一列 (区块 x 相同) 上下堆叠的区块共用地表高度和地表带群系 生成任务并行访问
+    struct Column {
+        int height[CHUNK_W];
+        int surfaceBiome[CHUNK_W];
+    };
+    static constexpr size_t MAX_COLUMNS = 256;
+
+    std::shared_ptr<const Column> getColumn(world *world, int cx);
+
+    std::mutex columnLock;
+    std::unordered_map<int, std::shared_ptr<const Column>> columns;
+
     void generateChunk(world *world, Chunk *ch) override;
 
     std::vector<Populator *> getPopulators() override;
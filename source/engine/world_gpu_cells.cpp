@@ -0,0 +1,237 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_gpu_cells.hpp"
+
+#include <algorithm>
+
+#include "engine/core/io/filesystem.h"
+#include "engine/core/profiler.hpp"
+#include "engine/renderer/shaders.hpp"
+#include "engine/utils/utility.hpp"
+#include "game_datastruct.hpp"
+#include "libs/glad/glad.h"
+
+namespace ME {
+
+namespace {
+
+// 与 cellMargolus.comp 中的 KIND_* 相同
+enum : u32 { KIND_WALL = 0, KIND_AIR = 1, KIND_SAND = 2, KIND_SOUP = 3, KIND_GAS = 4 };
+
+constexpr int REGION_CELLS = GpuCellSim::REGION_SIZE * GpuCellSim::REGION_SIZE;
+constexpr int GROUP_SIZE = 8;
+
+}  // namespace
+
+GpuCellSim::~GpuCellSim() { free(); }
+
+bool GpuCellSim::ready() {
+    if (program) return true;
+    if (tried) return false;
+    tried = true;
+
+    if (!GLAD_GL_VERSION_4_3) {
+        METADOT_WARN("gpu_cell_sim needs OpenGL 4.3 compute shaders, using the CPU cell tick");
+        return false;
+    }
+    const int p = ME_compute_program_load(ME_fs_get_path("data/shaders/cellMargolus.comp").c_str(), NULL);
+    if (p < 0) {
+        METADOT_WARN("Failed to load cellMargolus.comp, using the CPU cell tick");
+        return false;
+    }
+    program = (u32)p;
+
+    GLuint bufs[5];
+    glGenBuffers(5, bufs);
+    cellsBuf = bufs[0];
+    sourcesBuf = bufs[1];
+    propsBuf = bufs[2];
+    regionsBuf = bufs[3];
+    changedBuf = bufs[4];
+    propsDirty = true;
+    return true;
+}
+
+void GpuCellSim::free() {
+    if (!program) return;
+    const GLuint bufs[5] = {cellsBuf, sourcesBuf, propsBuf, regionsBuf, changedBuf};
+    glDeleteBuffers(5, bufs);
+    ME_program_free(program);
+    program = cellsBuf = sourcesBuf = propsBuf = regionsBuf = changedBuf = 0;
+    regionsX = regionsY = 0;
+    // 重新调用 ready 时再编译
+    tried = false;
+}
+
+void GpuCellSim::update_materials(const MaterialTable &mt, mat_id fireId) {
+    if (eligible.size() == mt.count) return;
+
+    eligible.assign(mt.count, 0);
+    props.assign(mt.count, prop{KIND_WALL, 0.0f});
+    for (u32 id = 0; id < mt.count; id++) {
+        const int type = mt.physicsType[id];
+        props[id].density = mt.density[id];
+        if (type == PhysicsType::AIR) {
+            props[id].kind = KIND_AIR;
+            continue;
+        }
+        // 有 interaction reaction 或脚本的材料 以及火 需要 CPU 上的完整规则
+        if (mt.checks[id] != MaterialCheck_None || id == fireId || mt.iterations[id] <= 0) continue;
+        if (type == PhysicsType::SAND) props[id].kind = KIND_SAND;
+        else if (type == PhysicsType::SOUP) props[id].kind = KIND_SOUP;
+        else if (type == PhysicsType::GAS) props[id].kind = KIND_GAS;
+        eligible[id] = props[id].kind != KIND_WALL;
+    }
+    propsDirty = true;
+}
+
+void GpuCellSim::resize(int rx, int ry) {
+    if (rx == regionsX && ry == regionsY) return;
+    regionsX = rx;
+    regionsY = ry;
+
+    const size_t cells = (size_t)rx * ry * REGION_CELLS;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellsBuf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(cells * sizeof(u32)), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourcesBuf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(cells * sizeof(u32)), NULL, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, regionsBuf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)((size_t)rx * ry * sizeof(u32)), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, changedBuf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)((size_t)rx * ry * sizeof(u32)), NULL, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    staging.resize(cells);
+    sources.resize(cells);
+    regionFlags.resize((size_t)rx * ry);
+    changed.resize((size_t)rx * ry);
+}
+
+u32 GpuCellSim::tick(CellStore &tiles, DirtyMap &dirty, int width, int zoneX, int zoneY, int zoneW, int zoneH, const std::vector<u8> &regionAwake, u32 seed) {
+    if (!program || eligible.empty()) return 0;
+    ME_profiler_scope_auto("GpuCellTick");
+
+    const int rx = zoneW >> REGION_SHIFT;
+    const int ry = zoneH >> REGION_SHIFT;
+    if (rx <= 0 || ry <= 0 || regionAwake.size() < (size_t)rx * ry) return 0;
+    resize(rx, ry);
+
+    if (propsDirty) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, propsBuf);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(props.size() * sizeof(prop)), props.data(), GL_STATIC_DRAW);
+        propsDirty = false;
+    }
+
+    // 唤醒并且含有 GPU 材料的区域才上传 连续的一段区域合并成一次上传
+    const u16 *ids = tiles.mat_id_data();
+    const size_t total = tiles.size();
+    u32 uploaded = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellsBuf);
+    int runBegin = -1;
+    for (int r = 0; r <= rx * ry; r++) {
+        bool up = false;
+        if (r < rx * ry && regionAwake[r]) {
+            const int x0 = zoneX + (r % rx) * REGION_SIZE;
+            const int y0 = zoneY + (r / rx) * REGION_SIZE;
+            u32 *out = staging.data() + (size_t)r * REGION_CELLS;
+            bool any = false;
+            for (int ly = 0; ly < REGION_SIZE; ly++) {
+                // 一行 16 个像素在存储中连续 只可能在环形末尾绕回一次
+                size_t p = tiles.physical((size_t)(x0 + (y0 + ly) * width));
+                for (int lx = 0; lx < REGION_SIZE; lx++, p++) {
+                    if (p == total) p = 0;
+                    const u16 id = ids[p];
+                    out[ly * REGION_SIZE + lx] = id;
+                    any |= handles(id);
+                }
+            }
+            up = any;
+        }
+        if (r < rx * ry) regionFlags[r] = up;
+        if (up && runBegin < 0) runBegin = r;
+        if (!up && runBegin >= 0) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)((size_t)runBegin * REGION_CELLS * sizeof(u32)), (GLsizeiptr)((size_t)(r - runBegin) * REGION_CELLS * sizeof(u32)),
+                            staging.data() + (size_t)runBegin * REGION_CELLS);
+            uploaded += (u32)(r - runBegin);
+            runBegin = -1;
+        }
+    }
+    ME_profiler_count("gpu cell regions", uploaded);
+    if (uploaded == 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return 0;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, regionsBuf);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(regionFlags.size() * sizeof(u32)), regionFlags.data());
+    const u32 zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, changedBuf);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, cellsBuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sourcesBuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, propsBuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, regionsBuf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, changedBuf);
+
+    GLint prevProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgram);
+    ME_program_activate(program);
+    ME_program_uniform_int(program, "regionsX", rx);
+    ME_program_uniform_int(program, "sizeX", zoneW);
+    ME_program_uniform_int(program, "sizeY", zoneH);
+    ME_program_uniform_uint(program, "seed", seed);
+
+    // 一轮 Margolus 分块 四遍依次错开 (0,0) (1,1) (1,0) (0,1) 第一遍覆盖所有像素 顺带初始化来源
+    static constexpr int OFFSETS[4][2] = {{0, 0}, {1, 1}, {1, 0}, {0, 1}};
+    const GLuint groupsX = (GLuint)((zoneW / 2 + GROUP_SIZE - 1) / GROUP_SIZE);
+    const GLuint groupsY = (GLuint)((zoneH / 2 + GROUP_SIZE - 1) / GROUP_SIZE);
+    for (int pass = 0; pass < 4; pass++) {
+        ME_program_uniform_int(program, "offsetX", OFFSETS[pass][0]);
+        ME_program_uniform_int(program, "offsetY", OFFSETS[pass][1]);
+        ME_program_uniform_int(program, "pass", pass);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram((GLuint)prevProgram);
+
+    // 等待 GPU 完成 只回读有像素移动的区域的来源
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, changedBuf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(changed.size() * sizeof(u32)), changed.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourcesBuf);
+    moves.clear();
+    u32 readback = 0;
+    for (int r = 0; r < rx * ry; r++) {
+        if (!changed[r]) continue;
+        readback++;
+        u32 *src = sources.data() + (size_t)r * REGION_CELLS;
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)((size_t)r * REGION_CELLS * sizeof(u32)), (GLsizeiptr)(REGION_CELLS * sizeof(u32)), src);
+
+        const int lx0 = (r % rx) * REGION_SIZE;
+        const int ly0 = (r / rx) * REGION_SIZE;
+        for (int i = 0; i < REGION_CELLS; i++) {
+            const int lx = lx0 + (i & (REGION_SIZE - 1));
+            const int ly = ly0 + (i >> REGION_SHIFT);
+            const u32 s = src[i];
+            const int sx = (int)(s & 0xffff);
+            const int sy = (int)(s >> 16);
+            if (sx == lx && sy == ly) continue;
+            // 先按移动前的内容全部取出再写 来源可能是另一个搬动过的像素
+            moves.push_back({(u32)(zoneX + lx + (zoneY + ly) * width), tiles.get((size_t)(zoneX + sx + (zoneY + sy) * width))});
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    for (const move &m : moves) {
+        tiles.set(m.dst, m.tile);
+        dirty.mark(m.dst);
+    }
+
+    ME_profiler_count("gpu cell readback regions", readback);
+    ME_profiler_count("gpu cells moved", (u32)moves.size());
+    return (u32)moves.size();
+}
+
+}  // namespace ME
@@ -0,0 +1,80 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_GPU_CELLS_HPP
+#define ME_WORLD_GPU_CELLS_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "world_cells.hpp"
+#include "world_dirty.hpp"
+
+namespace ME {
+
+struct MaterialTable;
+
+// 用 GL 4.3 计算着色器模拟简单的 SAND/SOUP/GAS 像素 (gpu_cell_sim)
+// 没有 interaction / reaction / 脚本 的 SAND/SOUP/GAS 材料交给 GPU 其余材料仍由 world::tick 在 CPU 上处理 在 GPU 上视为不动的墙
+// 材料 id 平面常驻显存 按 16x16 的区域分块存放 每个 tick 只上传唤醒区域 跑一轮 (4 遍) Margolus 2x2 分块
+// 每个像素记下内容来自哪个像素 只回读有像素移动的区域 在 CPU 上按来源搬动整个 MaterialInstance (颜色 温度 液体量随之移动)
+// GPU 上的 SOUP 按整像素流动 不使用液体量 结果与 CPU 实现不逐位一致
+class GpuCellSim {
+public:
+    static constexpr int REGION_SHIFT = 4;
+    static constexpr int REGION_SIZE = 1 << REGION_SHIFT;
+
+    GpuCellSim() = default;
+    ~GpuCellSim();
+
+    GpuCellSim(const GpuCellSim &) = delete;
+    GpuCellSim &operator=(const GpuCellSim &) = delete;
+
+    // 第一次调用时编译着色器 需要 GL 4.3 和当前的 GL 上下文 失败后不再尝试
+    bool ready();
+    void free();
+
+    // 材料数量变化时重建 id 是否由 GPU 模拟的表
+    void update_materials(const MaterialTable &mt, mat_id fireId);
+    bool handles(mat_id id) const { return id < eligible.size() && eligible[id]; }
+
+    // zone 为区块对齐的模拟范围 (世界坐标) regionAwake 按 zone 内 REGION_SIZE 见方的区域排列 为 0 的区域不上传不模拟
+    // 移动过的像素写入 tiles 并在 dirty 中标记 返回移动的像素个数
+    u32 tick(CellStore &tiles, DirtyMap &dirty, int width, int zoneX, int zoneY, int zoneW, int zoneH, const std::vector<u8> &regionAwake, u32 seed);
+
+private:
+    void resize(int regionsX, int regionsY);
+
+    struct prop {
+        u32 kind;
+        f32 density;
+    };
+
+    struct move {
+        u32 dst;
+        MaterialInstance tile;
+    };
+
+    bool tried = false;
+    u32 program = 0;
+    u32 cellsBuf = 0;
+    u32 sourcesBuf = 0;
+    u32 propsBuf = 0;
+    u32 regionsBuf = 0;
+    u32 changedBuf = 0;
+    int regionsX = 0;
+    int regionsY = 0;
+
+    std::vector<u8> eligible;
+    std::vector<prop> props;
+    bool propsDirty = false;
+
+    std::vector<u32> staging;
+    std::vector<u32> regionFlags;
+    std::vector<u32> changed;
+    std::vector<u32> sources;
+    std::vector<move> moves;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_index.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <unordered_map>
+
+#include "engine/core/frame_arena.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/game_utils/jsonwarp.h"
+#include "chunk_codec.hpp"
+#include "world_archive.hpp"
+
+namespace ME::WorldIndex {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// 格式变化时加一 旧的索引整个丢弃重建
+constexpr i64 INDEX_VERSION = 1;
+
+std::mutex &g_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+fs::path saves_dir() { return fs::path(METADOT_RESLOC("saves/")); }
+
+i64 stamp_of(const fs::path &p) {
+    std::error_code ec;
+    const auto t = fs::last_write_time(p, ec);
+    return ec ? 0 : (i64)t.time_since_epoch().count();
+}
+
+// 世界目录用 world.json 存档包用它自己
+fs::path stamp_path(const fs::path &world) { return WorldArchive::is_archive(world.string()) ? world : world / "world.json"; }
+
+u64 disk_size(const fs::path &world) {
+    std::error_code ec;
+    if (fs::is_regular_file(world, ec)) return (u64)fs::file_size(world, ec);
+    u64 bytes = 0;
+    for (auto it = fs::recursive_directory_iterator(world, fs::directory_options::skip_permission_denied, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file(ec)) bytes += (u64)it->file_size(ec);
+    }
+    return bytes;
+}
+
+void set_thumbnail(Entry &e, std::vector<u32> pixels) {
+    e.thumbnail = std::move(pixels);
+    e.thumbWidth = e.thumbnail.empty() ? 0 : THUMB_CHUNKS_X * ChunkCodec::summary_width(THUMB_LEVEL);
+    e.thumbHeight = e.thumbnail.empty() ? 0 : THUMB_CHUNKS_Y * ChunkCodec::summary_height(THUMB_LEVEL);
+    e.thumbHash = e.thumbnail.empty() ? 0 : metadot_fnv1a(e.thumbnail.data(), (int)(e.thumbnail.size() * sizeof(u32)));
+}
+
+bool decode_thumbnail(std::string_view hex, std::vector<u32> &out) {
+    if (hex.size() % 8 != 0) return false;
+    out.resize(hex.size() / 8);
+    for (size_t i = 0; i < out.size(); i++) {
+        u32 v = 0;
+        for (char c : hex.substr(i * 8, 8)) {
+            const int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (d < 0) return false;
+            v = (v << 4) | (u32)d;
+        }
+        out[i] = v;
+    }
+    return true;
+}
+
+std::vector<Entry> read_index(const fs::path &path) {
+    std::vector<Entry> entries;
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return entries;
+
+    frame_arena::scope scratch;
+    const std::string text = ME_fs_readfile(path.string());
+    Json::Reader reader(text);
+    i64 version = 0;
+    const bool ok = reader.object([&](std::string_view key) {
+        if (key == "version") return reader.number(version);
+        if (key != "worlds") return reader.skip();
+        return reader.array([&]() {
+            Entry &e = entries.emplace_back();
+            std::string_view thumb;
+            const bool read = reader.object([&](std::string_view field) {
+                i64 n = 0;
+                if (field == "folder") return reader.string(e.folder);
+                if (field == "worldName") return reader.string(e.meta.worldName);
+                if (field == "lastOpenedVersion") return reader.string(e.meta.lastOpenedVersion);
+                if (field == "thumbnail") return reader.string(thumb);
+                if (field != "lastOpenedTime" && field != "bytes" && field != "stamp") return reader.skip();
+                if (!reader.number(n)) return false;
+                if (field == "lastOpenedTime") e.meta.lastOpenedTime = (time_t)n;
+                if (field == "bytes") e.bytes = (u64)n;
+                if (field == "stamp") e.stamp = n;
+                return true;
+            });
+            // 缩略图尺寸与当前设置不同时丢弃 下次存档重新生成
+            std::vector<u32> pixels;
+            if (read && decode_thumbnail(thumb, pixels) && pixels.size() == (size_t)THUMB_CHUNKS_X * THUMB_CHUNKS_Y * ChunkCodec::summary_size(THUMB_LEVEL)) set_thumbnail(e, std::move(pixels));
+            return read;
+        });
+    }) && reader.finish();
+
+    if (!ok || version != INDEX_VERSION) {
+        if (!ok) METADOT_WARN(std::format("Rebuilding world index {0}: {1}", path.string(), reader.error()).c_str());
+        entries.clear();
+    }
+    return entries;
+}
+
+void write_index(const fs::path &path, const std::vector<Entry> &entries) {
+    static const char *digits = "0123456789abcdef";
+    Json::Writer writer;
+    writer.beginObject();
+    writer.member("version", INDEX_VERSION);
+    writer.key("worlds").beginArray();
+    std::string hex;
+    for (const Entry &e : entries) {
+        writer.beginObject();
+        writer.member("folder", e.folder);
+        writer.member("worldName", e.meta.worldName);
+        writer.member("lastOpenedVersion", e.meta.lastOpenedVersion);
+        writer.member("lastOpenedTime", (i64)e.meta.lastOpenedTime);
+        writer.member("bytes", (i64)e.bytes);
+        writer.member("stamp", e.stamp);
+        if (!e.thumbnail.empty()) {
+            hex.clear();
+            for (u32 v : e.thumbnail) {
+                for (int s = 28; s >= 0; s -= 4) hex += digits[(v >> s) & 0xf];
+            }
+            writer.member("thumbnail", hex);
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+
+    const std::string &text = writer.str();
+    if (!ME_fs_write_file_atomic(path.string(), text.data(), text.size())) METADOT_WARN(std::format("Failed to write world index {0}", path.string()).c_str());
+}
+
+}  // namespace
+
+std::vector<Entry> load() {
+    std::lock_guard guard(g_lock());
+
+    const fs::path saves = saves_dir();
+    std::vector<Entry> cached = read_index(saves / WORLD_INDEX_FILE);
+    std::unordered_map<std::string, Entry *> byFolder;
+    for (Entry &e : cached) byFolder.emplace(e.folder, &e);
+
+    std::vector<Entry> worlds;
+    bool changed = false;
+    std::error_code ec;
+    for (auto it = fs::directory_iterator(saves, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        const fs::path &p = it->path();
+        const std::string folder = p.filename().string();
+        if (!it->is_directory(ec) && !WorldArchive::is_archive(folder)) continue;
+
+        auto found = byFolder.find(folder);
+        const i64 stamp = stamp_of(stamp_path(p));
+        if (found != byFolder.end() && found->second->stamp == stamp && stamp != 0) {
+            worlds.push_back(std::move(*found->second));
+            continue;
+        }
+
+        // 新的世界或者 world.json 在别处被改过
+        changed = true;
+        Entry e;
+        if (found != byFolder.end()) {
+            e = std::move(*found->second);
+        } else {
+            e.bytes = disk_size(p);
+        }
+        e.folder = folder;
+        e.meta = WorldMeta::loadWorldMeta(p.string());
+        // 没有 world.json 的目录由 loadWorldMeta 创建
+        e.stamp = stamp_of(stamp_path(p));
+        worlds.push_back(std::move(e));
+    }
+    if (worlds.size() != cached.size()) changed = true;
+
+    std::sort(worlds.begin(), worlds.end(), [](const Entry &a, const Entry &b) { return a.meta.lastOpenedTime > b.meta.lastOpenedTime; });
+
+    if (changed) write_index(saves / WORLD_INDEX_FILE, worlds);
+    return worlds;
+}
+
+void update(const std::string &worldPath, const WorldMeta &meta, std::vector<u32> thumbnail) {
+    fs::path world = fs::path(worldPath).lexically_normal();
+    if (!world.has_filename()) world = world.parent_path();
+
+    const fs::path saves = saves_dir();
+    std::error_code ec;
+    if (!fs::equivalent(world.parent_path(), saves, ec)) return;
+
+    std::lock_guard guard(g_lock());
+
+    std::vector<Entry> entries = read_index(saves / WORLD_INDEX_FILE);
+    const std::string folder = world.filename().string();
+    auto it = std::find_if(entries.begin(), entries.end(), [&](const Entry &e) { return e.folder == folder; });
+    Entry &e = it != entries.end() ? *it : entries.emplace_back();
+
+    e.folder = folder;
+    e.meta = meta;
+    e.bytes = disk_size(world);
+    e.stamp = stamp_of(stamp_path(world));
+    if (!thumbnail.empty()) set_thumbnail(e, std::move(thumbnail));
+
+    write_index(saves / WORLD_INDEX_FILE, entries);
+}
+
+}  // namespace ME::WorldIndex
@@ -0,0 +1,54 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_INDEX_HPP
+#define ME_WORLD_INDEX_HPP
+
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+// saves/ 下所有世界的索引 存在 saves/index.json
+// 主菜单只读这一个文件 列出目录 再逐个比较 world.json (存档包本身) 的修改时间 不再逐个解析 world.json 和统计目录大小
+// 修改时间变了的只重新读取 world.json 新出现的世界第一次列出时统计大小 没有缩略图
+// 存档时由 world 调用 update 刷新大小和缩略图 (区块缩略图 ChunkCodec 第 THUMB_LEVEL 级 以 tickZone 中心为中心)
+// 可以在任意线程调用 同一进程内对索引文件的读写串行执行
+namespace WorldIndex {
+
+#define WORLD_INDEX_FILE "index.json"
+
+constexpr int THUMB_LEVEL = 1;
+constexpr int THUMB_CHUNKS_X = 12;
+constexpr int THUMB_CHUNKS_Y = 6;
+
+struct Entry {
+    // saves/ 下的目录名 或者 WORLD_ARCHIVE_EXT 存档包的文件名
+    std::string folder;
+    WorldMeta meta;
+    // 存档在磁盘上占用的字节数 上次存档时统计
+    u64 bytes = 0;
+    // world.json (存档包本身) 的修改时间
+    i64 stamp = 0;
+    // 0xAARRGGBB 为空时没有缩略图
+    int thumbWidth = 0;
+    int thumbHeight = 0;
+    std::vector<u32> thumbnail;
+    // thumbnail 的哈希 界面按它缓存纹理
+    u64 thumbHash = 0;
+};
+
+// 返回 saves/ 中现有的世界 按最近打开的时间排序 索引与磁盘不一致时写回
+std::vector<Entry> load();
+
+// worldPath 是 saves/ 下的世界目录 (world::worldName) 其他位置的世界不记录
+// 在 world.json 写入之后调用 thumbnail 为空时保留原来的缩略图
+void update(const std::string &worldPath, const WorldMeta &meta, std::vector<u32> thumbnail);
+
+}  // namespace WorldIndex
+
+}  // namespace ME
+
+#endif
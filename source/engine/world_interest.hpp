@@ -0,0 +1,125 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_INTEREST_HPP
+#define ME_WORLD_INTEREST_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/core/mathlib.hpp"
+
+namespace ME {
+
+// 关注区域 (旁观镜头 小地图焦点等) world::interests
+// 坐标与 tickZone 相同 (世界缓冲坐标) 所以只能关注已经加载到世界缓冲里的范围
+// 没有任何区域时 tickZone 内的区块每个 tick 都模拟 与之前相同
+// 有区域时 区块在覆盖它的任一区域到期的 tick 模拟 没有被覆盖的区块按 background 间隔模拟
+// 同一区域内的区块在同一个 tick 模拟 不同区域按 id 错开 被标记的区块重建碰撞网格也等到它模拟的 tick
+class InterestZones {
+public:
+    // 要小于 world::ACTIVE_REGION_SLEEP_TICKS 否则区域会在两次模拟之间进入休眠
+    static constexpr u32 MAX_INTERVAL = 8;
+
+    struct zone {
+        u32 id = 0;
+        MErect rect{};
+        u32 interval = 1;  // 每 interval 个 tick 模拟一次
+    };
+
+    InterestZones() = default;
+    InterestZones(const InterestZones &) = delete;
+    InterestZones &operator=(const InterestZones &) = delete;
+
+    // 返回的 id 不为 0
+    u32 add(const MErect &rect, u32 interval) {
+        zones.push_back({nextId, rect, std::clamp<u32>(interval, 1, MAX_INTERVAL)});
+        return nextId++;
+    }
+
+    bool set(u32 id, const MErect &rect, u32 interval) {
+        for (zone &z : zones) {
+            if (z.id != id) continue;
+            z.rect = rect;
+            z.interval = std::clamp<u32>(interval, 1, MAX_INTERVAL);
+            return true;
+        }
+        return false;
+    }
+
+    void remove(u32 id) {
+        std::erase_if(zones, [id](const zone &z) { return z.id == id; });
+    }
+
+    void clear() {
+        zones.clear();
+        due.clear();
+    }
+
+    bool empty() const { return zones.empty(); }
+    size_t size() const { return zones.size(); }
+    const std::vector<zone> &all() const { return zones; }
+
+    // 在 world::tick 开始时调用 按 tickZone 内的区块计算这一 tick 哪些区块需要模拟
+    // background 为 0 时没有被覆盖的区块不模拟
+    void plan(const MErect &tickZone, u64 tick, u32 background) {
+        zoneX = (int)tickZone.x;
+        zoneY = (int)tickZone.y;
+        chunksX = ((int)tickZone.w + CHUNK_W - 1) / CHUNK_W;
+        chunksY = ((int)tickZone.h + CHUNK_H - 1) / CHUNK_H;
+        if (zones.empty()) return;
+
+        // 0 未覆盖 1 覆盖但这一 tick 不到期 2 到期
+        due.assign((size_t)std::max(chunksX, 0) * std::max(chunksY, 0), 0);
+        for (const zone &z : zones) {
+            const u8 mark = (tick + z.id) % z.interval == 0 ? 2 : 1;
+            const int bx0 = std::max((int)std::floor((z.rect.x - zoneX) / CHUNK_W), 0);
+            const int by0 = std::max((int)std::floor((z.rect.y - zoneY) / CHUNK_H), 0);
+            const int bx1 = std::min((int)std::ceil((z.rect.x + z.rect.w - zoneX) / CHUNK_W), chunksX);
+            const int by1 = std::min((int)std::ceil((z.rect.y + z.rect.h - zoneY) / CHUNK_H), chunksY);
+            for (int by = by0; by < by1; by++) {
+                for (int bx = bx0; bx < bx1; bx++) {
+                    u8 &d = due[bx + by * chunksX];
+                    d = std::max(d, mark);
+                }
+            }
+        }
+        backgroundDue = background > 0 && tick % std::min(background, MAX_INTERVAL) == 0;
+    }
+
+    // 包含 (x, y) 的模拟区块这一 tick 是否模拟 坐标与 tickZone 相同 模拟区块从 tickZone 左上角开始按 CHUNK_W x CHUNK_H 划分
+    bool due_at(f32 x, f32 y) const {
+        if (zones.empty()) return true;
+        const int bx = (int)std::floor((x - zoneX) / CHUNK_W);
+        const int by = (int)std::floor((y - zoneY) / CHUNK_H);
+        if (bx < 0 || by < 0 || bx >= chunksX || by >= chunksY) return backgroundDue;
+        const u8 d = due[bx + by * chunksX];
+        return d == 2 || (d == 0 && backgroundDue);
+    }
+
+    // (x, y) 到各区域的距离 (区块数) 乘以区域的间隔 取最小 区块生成按它排序 没有区域时返回 -1
+    int priority(f32 x, f32 y) const {
+        int best = -1;
+        for (const zone &z : zones) {
+            const f32 dx = std::max({z.rect.x - x, 0.0f, x - (z.rect.x + z.rect.w)});
+            const f32 dy = std::max({z.rect.y - y, 0.0f, y - (z.rect.y + z.rect.h)});
+            const int d = (int)(std::max(dx / CHUNK_W, dy / CHUNK_H) * z.interval);
+            if (best < 0 || d < best) best = d;
+        }
+        return best;
+    }
+
+private:
+    std::vector<zone> zones;
+    u32 nextId = 1;
+
+    int zoneX = 0, zoneY = 0, chunksX = 0, chunksY = 0;
+    std::vector<u8> due;
+    bool backgroundDue = true;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,235 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_light.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "engine/core/global.hpp"
+#include "engine/core/profiler.hpp"
+#include "game.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+constexpr int SIZE_X = LightSample::SIZE_X;
+constexpr int SIZE_Y = LightSample::SIZE_Y;
+constexpr int CELL = LightSample::CELL;
+
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+u64 ChunkKey(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+}  // namespace
+
+std::shared_ptr<const LightChunk> LightField::compute(const sample_ptr around[9]) {
+    // 3x3 个区块拼成一张网格 没有采样的区块不发光也不透光
+    constexpr int W = SIZE_X * 3, H = SIZE_Y * 3;
+    std::vector<u8> cost((size_t)W * H, MAX_COST), light((size_t)W * H, 0);
+    std::vector<int> buckets[MAX_LEVEL + 1];
+    for (int i = 0; i < 9; i++) {
+        const LightSample *s = around[i].get();
+        if (!s) continue;
+        const int ox = (i % 3) * SIZE_X, oy = (i / 3) * SIZE_Y;
+        for (int y = 0; y < SIZE_Y; y++) {
+            for (int x = 0; x < SIZE_X; x++) {
+                const int c = x + y * SIZE_X, g = ox + x + (oy + y) * W;
+                cost[g] = s->cost[c];
+                if (s->emit[c] == 0) continue;
+                light[g] = s->emit[c];
+                buckets[s->emit[c]].push_back(g);
+            }
+        }
+    }
+
+    // 按等级从高到低扩散 cost 至少为 1 处理第 l 层时只会往更低的层里加
+    // 格子被更亮的光覆盖后 留在低层里的旧记录跳过
+    for (int l = MAX_LEVEL; l > 1; l--) {
+        for (const int g : buckets[l]) {
+            if (light[g] != l) continue;
+            const int x = g % W, y = g / W;
+            auto spread = [&](int n) {
+                const int nl = l - cost[n];
+                if (nl <= light[n]) return;
+                light[n] = (u8)nl;
+                buckets[nl].push_back(n);
+            };
+            if (x > 0) spread(g - 1);
+            if (x + 1 < W) spread(g + 1);
+            if (y > 0) spread(g - W);
+            if (y + 1 < H) spread(g + W);
+        }
+    }
+
+    auto out = std::make_shared<LightChunk>();
+    out->cx = around[4]->cx;
+    out->cy = around[4]->cy;
+    for (int y = 0; y < SIZE_Y; y++) std::copy_n(light.data() + SIZE_X + (SIZE_Y + y) * W, SIZE_X, out->level + y * SIZE_X);
+    return out;
+}
+
+void LightField::markAround(int cx, int cy) {
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const u64 k = ChunkKey(cx + dx, cy + dy);
+            if (samples.contains(k)) relight.insert(k);
+        }
+    }
+}
+
+void LightField::invalidate(const world &w) {
+    if (samples.empty() || !w.dirty.any()) return;
+
+    const int rx = (w.width + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    const int ry = (w.height + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    if (rx != regionsX || ry != regionsY) {
+        regionsX = rx;
+        regionsY = ry;
+        dirtyRegions = std::make_unique<bool[]>((size_t)rx * ry);
+    }
+    std::fill_n(dirtyRegions.get(), (size_t)rx * ry, false);
+    w.dirty.mark_regions(DIRTY_SHIFT, regionsX, dirtyRegions.get());
+
+    const int lx = (int)w.loadZone.x, ly = (int)w.loadZone.y;
+    for (int y = 0; y < ry; y++) {
+        for (int x = 0; x < rx; x++) {
+            if (!dirtyRegions[(size_t)x + (size_t)y * rx]) continue;
+            const int px0 = (x << DIRTY_SHIFT) - lx, py0 = (y << DIRTY_SHIFT) - ly;
+            const int px1 = px0 + (1 << DIRTY_SHIFT) - 1, py1 = py0 + (1 << DIRTY_SHIFT) - 1;
+            for (int cy = FloorDiv(py0, CHUNK_H); cy <= FloorDiv(py1, CHUNK_H); cy++) {
+                for (int cx = FloorDiv(px0, CHUNK_W); cx <= FloorDiv(px1, CHUNK_W); cx++) {
+                    const u64 k = ChunkKey(cx, cy);
+                    if (samples.contains(k)) stale.insert(k);
+                }
+            }
+        }
+    }
+}
+
+void LightField::update(world &w) {
+    results.run();
+
+    if (w.real_tiles.empty()) {
+        samples.clear();
+        chunks.clear();
+        stale.clear();
+        relight.clear();
+        return;
+    }
+
+    // 只有完整落在世界缓冲内的区块才能采样
+    const int lx = (int)w.loadZone.x, ly = (int)w.loadZone.y;
+    live.clear();
+    building.clear();
+    w.chunkCache.for_each([&](Chunk *ch) {
+        const int ax = ch->x * CHUNK_W + lx, ay = ch->y * CHUNK_H + ly;
+        if (ax < 0 || ay < 0 || ax + CHUNK_W > w.width || ay + CHUNK_H > w.height) return;
+        const u64 k = ChunkKey(ch->x, ch->y);
+        live.insert(k);
+        if (building.size() < BUILD_PER_UPDATE && (!samples.contains(k) || stale.contains(k))) building.push_back(ch);
+    });
+
+    for (auto it = samples.begin(); it != samples.end();) {
+        if (live.contains(it->first)) {
+            ++it;
+            continue;
+        }
+        const int cx = it->second->cx, cy = it->second->cy;
+        stale.erase(it->first);
+        relight.erase(it->first);
+        chunks.erase(it->first);
+        it = samples.erase(it);
+        markAround(cx, cy);
+    }
+
+    if (!building.empty()) {
+        // 每个材料的发光等级和不透光程度 (空气 0 液体 1 其余 2)
+        const MaterialTable &mt = GAME()->materials_table;
+        std::vector<u8> emitLevel(mt.count), opacity(mt.count);
+        for (u32 i = 0; i < mt.count; i++) {
+            emitLevel[i] = (u8)((mt.emit[i] * MAX_LEVEL + 127) / 255);
+            const u8 t = mt.physicsType[i];
+            opacity[i] = t == PhysicsType::AIR || t == PhysicsType::GAS || t == PhysicsType::PASSABLE ? 0 : t == PhysicsType::SOUP ? 1 : 2;
+        }
+
+        const u16 *ids = w.real_tiles.mat_id_data();
+        const size_t total = w.real_tiles.size();
+        int opaque[SIZE_X];
+        for (Chunk *ch : building) {
+            auto s = std::make_shared<LightSample>();
+            s->cx = ch->x;
+            s->cy = ch->y;
+            const int ax = ch->x * CHUNK_W + lx, ay = ch->y * CHUNK_H + ly;
+            for (int cy = 0; cy < SIZE_Y; cy++) {
+                std::fill_n(opaque, SIZE_X, 0);
+                u8 *emit = s->emit + cy * SIZE_X;
+                for (int y = cy * CELL; y < (cy + 1) * CELL; y++) {
+                    // 一行在存储中连续 只可能在环形末尾绕回一次
+                    size_t p = w.real_tiles.physical((size_t)ax + (size_t)(ay + y) * w.width);
+                    for (int x = 0; x < CHUNK_W; x++, p++) {
+                        if (p == total) p = 0;
+                        emit[x / CELL] = std::max(emit[x / CELL], emitLevel[ids[p]]);
+                        opaque[x / CELL] += opacity[ids[p]];
+                    }
+                }
+                // 全部不透光时为 MAX_COST 按比例四舍五入
+                for (int x = 0; x < SIZE_X; x++) s->cost[x + cy * SIZE_X] = (u8)(1 + ((MAX_COST - 1) * opaque[x] + CELL * CELL) / (2 * CELL * CELL));
+            }
+
+            const u64 k = ChunkKey(ch->x, ch->y);
+            stale.erase(k);
+            auto it = samples.find(k);
+            if (it != samples.end() && !memcmp(it->second->emit, s->emit, sizeof(s->emit)) && !memcmp(it->second->cost, s->cost, sizeof(s->cost))) continue;
+            samples[k] = std::move(s);
+            markAround(ch->x, ch->y);
+        }
+    }
+
+    int submitted = 0;
+    for (auto it = relight.begin(); it != relight.end() && submitted < RELIGHT_PER_UPDATE;) {
+        const u64 k = *it;
+        if (running.contains(k)) {
+            ++it;
+            continue;
+        }
+        const int cx = (int)(u32)(k >> 32), cy = (int)(u32)k;
+        std::array<sample_ptr, 9> around;
+        for (int i = 0; i < 9; i++) {
+            auto s = samples.find(ChunkKey(cx + i % 3 - 1, cy + i / 3 - 1));
+            if (s != samples.end()) around[i] = s->second;
+        }
+        running.insert(k);
+        job::async([around]() { return compute(around.data()); }, nullptr, job_class::render).then_on(results, [this, k](std::shared_ptr<const LightChunk> c) {
+            // 区块已经离开时结果直接丢掉
+            running.erase(k);
+            if (samples.contains(k)) chunks[k] = std::move(c);
+        });
+        it = relight.erase(it);
+        submitted++;
+    }
+    ME_profiler_count("light chunks relit", submitted);
+}
+
+f32 LightField::level(f32 x, f32 y) const {
+    const int gx = (int)std::floor(x / CELL), gy = (int)std::floor(y / CELL);
+    const int cx = FloorDiv(gx, SIZE_X), cy = FloorDiv(gy, SIZE_Y);
+    auto it = chunks.find(ChunkKey(cx, cy));
+    if (it == chunks.end()) return 0.0f;
+    return it->second->level[(gx - cx * SIZE_X) + (gy - cy * SIZE_Y) * SIZE_X] / (f32)MAX_LEVEL;
+}
+
+void LightField::clear() {
+    results.wait();
+    results.run();
+    running.clear();
+    relight.clear();
+    samples.clear();
+    chunks.clear();
+    stale.clear();
+}
+
+}  // namespace ME
@@ -0,0 +1,98 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_LIGHT_HPP
+#define ME_WORLD_LIGHT_HPP
+
+#include <memory>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+class world;
+struct Chunk;
+
+// 光照采样用的区块粗网格 每 CELL 像素见方一格
+struct LightSample {
+    static constexpr int CELL = 4;
+    static constexpr int SIZE_X = CHUNK_W / CELL;
+    static constexpr int SIZE_Y = CHUNK_H / CELL;
+    static constexpr int CELLS = SIZE_X * SIZE_Y;
+
+    int cx = 0, cy = 0;
+    u8 emit[CELLS]{};  // 格内最亮的发光像素 0 到 LightField::MAX_LEVEL
+    u8 cost[CELLS]{};  // 光进入这一格衰减的等级 1 到 LightField::MAX_COST
+};
+
+struct LightChunk {
+    int cx = 0, cy = 0;
+    u8 level[LightSample::CELLS]{};
+};
+
+// 供玩法查询的 CPU 光照 world::light
+// 不从 GPU 读回 只计算发光材料 (emitColor 的 alpha) 的光 不含天空光和环境光 画面上的光照仍由 NewLightingShader 负责
+// 每个完整落在世界缓冲内的区块采样一份 LightSample 像素改写 (dirty) 后重新采样 内容没变时不会重新计算
+// 光从发光格向四周扩散 每进入一格减去该格的 cost 空气和气体为 1 不透光的格子最多为 MAX_COST
+// MAX_LEVEL 小于一个区块的格数 一个区块的光照只取决于它和周围 8 个区块的采样
+// 采样变化的区块和它的邻居在 job 线程上用采样的快照重新计算 计算完成前查询得到旧的结果
+// 所有函数都只能在主线程上调用
+class LightField {
+public:
+    static constexpr int MAX_LEVEL = 15;
+    static constexpr int MAX_COST = 4;
+    static_assert(MAX_LEVEL < LightSample::SIZE_X && MAX_LEVEL < LightSample::SIZE_Y, "light must not reach past the neighbouring chunks");
+    // 每次 update 最多重新采样的区块数和提交的计算数
+    static constexpr int BUILD_PER_UPDATE = 8;
+    static constexpr int RELIGHT_PER_UPDATE = 8;
+
+    LightField() = default;
+    LightField(const LightField &) = delete;
+    LightField &operator=(const LightField &) = delete;
+    ~LightField() { clear(); }
+
+    // 在 world::dirty 清除前调用 记下被改写的区块
+    void invalidate(const world &w);
+    // 采样新进入世界缓冲和被改写的区块 取回完成的计算并提交新的
+    void update(world &w);
+
+    // (x, y) 处的光照 0 到 1 坐标与 WorldEntity 相同 没有结果的区块为 0
+    f32 level(f32 x, f32 y) const;
+
+    // 等待所有计算结束并清空
+    void clear();
+
+    size_t chunk_count() const { return samples.size(); }
+    size_t pending() const { return running.size() + relight.size(); }
+
+private:
+    using sample_ptr = std::shared_ptr<const LightSample>;
+
+    // around[4] 为 cx cy 本身 其余按行排列 没有采样的为 nullptr
+    static std::shared_ptr<const LightChunk> compute(const sample_ptr around[9]);
+    void markAround(int cx, int cy);
+
+    phmap::flat_hash_map<u64, sample_ptr> samples;
+    phmap::flat_hash_map<u64, std::shared_ptr<const LightChunk>> chunks;
+    // 需要重新计算的区块 正在计算的区块完成后再提交
+    phmap::flat_hash_set<u64> relight;
+    phmap::flat_hash_set<u64> running;
+    // 算完的区块 update 开头在主线程上放进 chunks
+    job_inbox results;
+
+    // DIRTY_SHIFT 见方的脏区域 在世界缓冲坐标上
+    static constexpr int DIRTY_SHIFT = 5;
+    phmap::flat_hash_set<u64> stale;
+    std::unique_ptr<bool[]> dirtyRegions;
+    int regionsX = 0, regionsY = 0;
+    // update 的临时数据 保留容量
+    phmap::flat_hash_set<u64> live;
+    std::vector<Chunk *> building;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,214 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_loader.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "chunk.hpp"
+
+namespace ME {
+
+void ChunkLoader::init(ReadFn read, GenerateFn generate) {
+    shutdown();
+
+    std::lock_guard<std::mutex> guard(lock);
+    this->read = std::move(read);
+    this->generate = std::move(generate);
+    stopping = false;
+}
+
+bool ChunkLoader::request(Chunk *ch) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (stopping) return false;
+
+    auto it = requests.find(key(ch->x, ch->y));
+    if (it != requests.end()) {
+        // 取消后又回到加载范围 继续原来的加载
+        it->second.cancelled = false;
+        return false;
+    }
+
+    requests.emplace(key(ch->x, ch->y), Request{ch, Stage::Read});
+    push(Stage::Read, key(ch->x, ch->y));
+    pump();
+    return true;
+}
+
+void ChunkLoader::set_focus(f32 fx, f32 fy, int x0, int y0, int x1, int y1) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (auto it = requests.begin(); it != requests.end();) {
+        Request &r = it->second;
+        if (r.ch->x >= x0 && r.ch->x <= x1 && r.ch->y >= y0 && r.ch->y <= y1) {
+            it++;
+            continue;
+        }
+
+        if (r.running) {
+            // 当前阶段结束后由后台任务丢弃
+            r.cancelled = true;
+            it++;
+            continue;
+        }
+
+        if (r.stage == Stage::Ready) readyCount--;
+        cancelledChunks.push_back(r.ch);
+        it = requests.erase(it);
+    }
+
+    // 去掉失效的键 焦点移动过就按新的距离重建堆
+    const bool moved = fx != focusX || fy != focusY;
+    focusX = fx;
+    focusY = fy;
+    auto cmp = [this](u64 a, u64 b) { return distance(a) > distance(b); };
+    for (int stage = 0; stage < 2; stage++) {
+        std::vector<u64> &q = queues[stage];
+        const size_t n = q.size();
+        std::erase_if(q, [&](u64 k) {
+            auto it = requests.find(k);
+            return it == requests.end() || it->second.stage != (Stage)stage || it->second.running;
+        });
+        if (moved || q.size() != n) std::make_heap(q.begin(), q.end(), cmp);
+    }
+}
+
+void ChunkLoader::collect(std::vector<Chunk *> &loaded, std::vector<Chunk *> &cancelled) {
+    loaded.clear();
+    cancelled.clear();
+
+    // 只有一个线程 (或其他 worker 都停用) 时没有空闲 worker 执行后台任务 在这里把已经派发的跑完
+    if (job::active_workers() <= 1) job::wait(workers);
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = requests.begin(); it != requests.end();) {
+        if (it->second.stage == Stage::Ready) {
+            loaded.push_back(it->second.ch);
+            it = requests.erase(it);
+        } else if (stopping) {
+            // shutdown() 之后已经没有运行中的请求
+            cancelled.push_back(it->second.ch);
+            it = requests.erase(it);
+        } else {
+            it++;
+        }
+    }
+    readyCount = 0;
+    cancelled.insert(cancelled.end(), cancelledChunks.begin(), cancelledChunks.end());
+    cancelledChunks.clear();
+
+    // 取走之后腾出了位置
+    pump();
+}
+
+void ChunkLoader::set_limits(u32 maxReaders, u32 maxGenerators) {
+    std::lock_guard<std::mutex> guard(lock);
+    readerLimit = std::clamp<u32>(maxReaders, 1, MAX_READERS);
+    generatorLimit = std::clamp<u32>(maxGenerators, 1, MAX_GENERATORS);
+    pump();
+}
+
+size_t ChunkLoader::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return requests.size();
+}
+
+void ChunkLoader::shutdown() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    job::wait(workers);
+}
+
+f32 ChunkLoader::distance(u64 k) const {
+    const f32 dx = (f32)(int)(u32)(k >> 32) + 0.5f - focusX;
+    const f32 dy = (f32)(int)(u32)k + 0.5f - focusY;
+    return dx * dx + dy * dy;
+}
+
+void ChunkLoader::push(Stage stage, u64 k) {
+    std::vector<u64> &q = queues[(int)stage];
+    q.push_back(k);
+    std::push_heap(q.begin(), q.end(), [this](u64 a, u64 b) { return distance(a) > distance(b); });
+}
+
+ChunkLoader::Request *ChunkLoader::take(Stage stage) {
+    if (stopping || saturated()) return nullptr;
+
+    std::vector<u64> &q = queues[(int)stage];
+    while (!q.empty()) {
+        std::pop_heap(q.begin(), q.end(), [this](u64 a, u64 b) { return distance(a) > distance(b); });
+        const u64 k = q.back();
+        q.pop_back();
+
+        auto it = requests.find(k);
+        if (it == requests.end()) continue;
+        Request &r = it->second;
+        if (r.stage == stage && !r.running && !r.cancelled) return &r;
+    }
+    return nullptr;
+}
+
+void ChunkLoader::finish(u64 k, Request &r, Stage next) {
+    r.running = false;
+    if (r.cancelled) {
+        cancelledChunks.push_back(r.ch);
+        requests.erase(k);
+        return;
+    }
+
+    r.stage = next;
+    if (next == Stage::Ready) readyCount++;
+    if (next == Stage::Generate) push(next, k);
+}
+
+void ChunkLoader::pump() {
+    if (stopping) return;
+
+    // 堆里可能有失效的键 多派发的任务取不到请求会直接结束
+    const u32 reads = (u32)std::min<size_t>(queues[(int)Stage::Read].size(), readerLimit);
+    const u32 generates = (u32)std::min<size_t>(queues[(int)Stage::Generate].size(), generatorLimit);
+
+    while (readers < reads && !saturated()) {
+        readers++;
+        job::execute_background(workers, [this]() { run(Stage::Read); }, job_class::io);
+    }
+    while (generators < generates && !saturated()) {
+        generators++;
+        job::execute_background(workers, [this]() { run(Stage::Generate); }, job_class::generation);
+    }
+}
+
+void ChunkLoader::run(Stage stage) {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        Request *r = take(stage);
+        if (!r) break;
+
+        r->running = true;
+        Chunk *ch = r->ch;
+        const u64 k = key(ch->x, ch->y);
+        guard.unlock();
+
+        Stage next = Stage::Ready;
+        if (stage == Stage::Read) {
+            if (!read(ch)) next = Stage::Generate;
+        } else {
+            generate(ch);
+        }
+
+        guard.lock();
+        // 持有 running 标记的请求不会被其他线程移除 指针仍然有效
+        finish(k, *r, next);
+        if (next == Stage::Generate) pump();
+    }
+
+    if (stage == Stage::Read) {
+        readers--;
+    } else {
+        generators--;
+    }
+}
+
+}  // namespace ME
@@ -0,0 +1,107 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_LOADER_HPP
+#define ME_WORLD_LOADER_HPP
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+
+namespace ME {
+
+struct Chunk;
+
+// 区块异步加载流水线
+// 读取(映射存档并解压) -> 生成/填充 -> 合并 读取失败或没有存档的区块进入生成阶段
+// 读取阶段最多 MAX_READERS 个后台任务并行 生成阶段最多 MAX_GENERATORS 个 可以用 set_limits 调低
+// 生成函数只能读取初始化后不再改变的世界状态 (噪声 材料 群系表) 和传入的区块
+// 合并阶段由主线程在 world::frame 中通过 collect() 取走完成的区块
+// 读取和生成阶段各有一个按到焦点距离排序的二叉堆 焦点移动时重建 总是先处理最近的区块
+// 离开保留范围的区块被取消 之后的阶段不再执行
+class ChunkLoader {
+public:
+    static constexpr u32 MAX_READERS = 4;
+    static constexpr u32 MAX_GENERATORS = 4;
+    // 已完成但主线程还没取走的区块上限 达到后读取和生成都暂停
+    static constexpr size_t MAX_READY = 32;
+
+    // 返回 false 表示没有存档或者读取失败 需要生成
+    using ReadFn = std::function<bool(Chunk *)>;
+    using GenerateFn = std::function<void(Chunk *)>;
+
+    ChunkLoader() = default;
+    ~ChunkLoader() { shutdown(); }
+
+    ChunkLoader(const ChunkLoader &) = delete;
+    ChunkLoader &operator=(const ChunkLoader &) = delete;
+
+    void init(ReadFn read, GenerateFn generate);
+
+    // 同一位置已经在流水线中时返回 false 传入的区块不会被使用
+    bool request(Chunk *ch);
+
+    // 更新优先级的焦点 (区块坐标 可以带小数) 不在 [x0, x1] x [y0, y1] 内的区块被取消
+    void set_focus(f32 fx, f32 fy, int x0, int y0, int x1, int y1);
+
+    // 取走完成的区块以及被取消的区块 被取消的区块由调用者释放
+    void collect(std::vector<Chunk *> &loaded, std::vector<Chunk *> &cancelled);
+
+    // 读取和生成阶段的并行任务数 限制在 [1, MAX_READERS] 和 [1, MAX_GENERATORS] 内 已经在运行的任务不受影响
+    void set_limits(u32 maxReaders, u32 maxGenerators);
+    u32 reader_limit() const { return readerLimit; }
+    u32 generator_limit() const { return generatorLimit; }
+
+    // 流水线中 (包括完成未取走) 的区块数
+    size_t size();
+
+    // 取消所有区块并等待后台任务结束 之后 collect() 会把剩下的区块全部作为取消返回
+    void shutdown();
+
+private:
+    enum class Stage : u8 { Read, Generate, Ready };
+
+    struct Request {
+        Chunk *ch;
+        Stage stage;
+        bool running = false;
+        bool cancelled = false;
+    };
+
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+    // 以下在持有 lock 时调用
+    bool saturated() const { return readyCount + readers + generators >= MAX_READY; }
+    f32 distance(u64 k) const;
+    void push(Stage stage, u64 k);
+    Request *take(Stage stage);
+    void finish(u64 k, Request &r, Stage next);
+    void pump();
+
+    void run(Stage stage);
+
+    ReadFn read;
+    GenerateFn generate;
+
+    std::mutex lock;
+    std::map<u64, Request> requests;
+    // 读取和生成阶段的堆 可能残留已经失效的键 取出时跳过
+    std::vector<u64> queues[2];
+    std::vector<Chunk *> cancelledChunks;
+    size_t readyCount = 0;
+    u32 readers = 0;
+    u32 generators = 0;
+    u32 readerLimit = MAX_READERS;
+    u32 generatorLimit = MAX_GENERATORS;
+    bool stopping = false;
+    f32 focusX = 0;
+    f32 focusY = 0;
+    job_counter workers;
+};
+
+}  // namespace ME
+
+#endif
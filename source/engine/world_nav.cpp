@@ -0,0 +1,484 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_nav.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+#include "engine/core/global.hpp"
+#include "game.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+using NavChunkMap = phmap::flat_hash_map<u64, std::shared_ptr<const NavChunk>>;
+
+constexpr int SIZE_X = NavChunk::SIZE_X;
+constexpr int SIZE_Y = NavChunk::SIZE_Y;
+constexpr int CELLS = SIZE_X * SIZE_Y;
+// 区块图搜索最多展开的区块数 逐格搜索最多涉及的区块数
+constexpr int MAX_COARSE_NODES = 4096;
+constexpr size_t MAX_FINE_CHUNKS = 256;
+// 起点或终点所在的格子不可通行时 在周围这么多格内找一个可通行的
+constexpr int SNAP_RADIUS = 2;
+
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+u64 ChunkKey(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+u64 RegionKey(const int region[4]) { return ChunkKey(region[0], region[1]) * 0x9e3779b97f4a7c15ull ^ ChunkKey(region[2], region[3]); }
+
+const NavChunk *Find(const NavChunkMap &chunks, int cx, int cy) {
+    auto it = chunks.find(ChunkKey(cx, cy));
+    return it == chunks.end() ? nullptr : it->second.get();
+}
+
+bool CellPassable(const NavChunkMap &chunks, int x, int y) {
+    const NavChunk *c = Find(chunks, FloorDiv(x, SIZE_X), FloorDiv(y, SIZE_Y));
+    return c && c->passable(x - c->cx * SIZE_X, y - c->cy * SIZE_Y);
+}
+
+bool Snap(const NavChunkMap &chunks, int &x, int &y) {
+    if (CellPassable(chunks, x, y)) return true;
+    for (int r = 1; r <= SNAP_RADIUS; r++) {
+        for (int dy = -r; dy <= r; dy++) {
+            for (int dx = -r; dx <= r; dx++) {
+                if (std::max(std::abs(dx), std::abs(dy)) != r || !CellPassable(chunks, x + dx, y + dy)) continue;
+                x += dx;
+                y += dy;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 区块图上的 A* 相邻区块边界上有相对的可通行格才相连 out 为从起点到终点经过的区块
+bool CoarseSearch(const NavChunkMap &chunks, int sx, int sy, int gx, int gy, std::vector<std::pair<int, int>> &out) {
+    struct node {
+        int g;
+        u64 parent;
+    };
+    using item = std::pair<int, u64>;
+    auto h = [&](int cx, int cy) { return std::abs(cx - gx) + std::abs(cy - gy); };
+
+    phmap::flat_hash_map<u64, node> nodes;
+    std::priority_queue<item, std::vector<item>, std::greater<item>> open;
+    const u64 start = ChunkKey(sx, sy);
+    nodes[start] = {0, start};
+    open.push({h(sx, sy), start});
+
+    int expanded = 0;
+    while (!open.empty()) {
+        const auto [f, k] = open.top();
+        open.pop();
+        const int cx = (int)(u32)(k >> 32), cy = (int)(u32)k;
+        const int g = nodes[k].g;
+        if (f > g + h(cx, cy)) continue;
+
+        if (cx == gx && cy == gy) {
+            out.clear();
+            for (u64 cur = k;; cur = nodes[cur].parent) {
+                out.emplace_back((int)(u32)(cur >> 32), (int)(u32)cur);
+                if (cur == start) break;
+            }
+            std::reverse(out.begin(), out.end());
+            return true;
+        }
+        if (++expanded > MAX_COARSE_NODES) return false;
+
+        const NavChunk *c = Find(chunks, cx, cy);
+        const struct {
+            int dx, dy;
+            u64 NavChunk::*from, NavChunk::*to;
+        } sides[] = {
+                {1, 0, &NavChunk::openRight, &NavChunk::openLeft},
+                {-1, 0, &NavChunk::openLeft, &NavChunk::openRight},
+                {0, 1, &NavChunk::openBottom, &NavChunk::openTop},
+                {0, -1, &NavChunk::openTop, &NavChunk::openBottom},
+        };
+        for (const auto &s : sides) {
+            const NavChunk *n = Find(chunks, cx + s.dx, cy + s.dy);
+            if (!n || !(c->*s.from & n->*s.to)) continue;
+            const u64 nk = ChunkKey(cx + s.dx, cy + s.dy);
+            auto it = nodes.find(nk);
+            if (it != nodes.end() && it->second.g <= g + 1) continue;
+            nodes[nk] = {g + 1, k};
+            open.push({g + 1 + h(cx + s.dx, cy + s.dy), nk});
+        }
+    }
+    return false;
+}
+
+// 限定在 add 过的区块内的逐格 A* 八方向 不切角
+class FineSearch {
+public:
+    explicit FineSearch(const NavChunkMap &chunks) : chunks(chunks) {}
+
+    bool add(int cx, int cy) {
+        if (slots.size() >= MAX_FINE_CHUNKS) return false;
+        const NavChunk *c = Find(chunks, cx, cy);
+        if (c && slotOf.try_emplace(ChunkKey(cx, cy), (int)slots.size()).second) slots.push_back(c);
+        return true;
+    }
+
+    bool run(int sx, int sy, int gx, int gy, std::vector<std::pair<int, int>> &cells) {
+        const int start = node(sx, sy), goal = node(gx, gy);
+        if (start < 0 || goal < 0) return false;
+
+        const size_t n = slots.size() * CELLS;
+        g.assign(n, INT_MAX);
+        parent.assign(n, -1);
+        closed.assign(n, 0);
+        auto h = [&](int x, int y) {
+            const int dx = std::abs(x - gx), dy = std::abs(y - gy);
+            return 10 * std::max(dx, dy) + 4 * std::min(dx, dy);
+        };
+
+        using item = std::pair<int, int>;
+        std::priority_queue<item, std::vector<item>, std::greater<item>> open;
+        g[start] = 0;
+        open.push({h(sx, sy), start});
+
+        static constexpr int DX[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+        static constexpr int DY[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+        while (!open.empty()) {
+            const int cur = open.top().second;
+            open.pop();
+            if (closed[cur]) continue;
+            closed[cur] = 1;
+
+            if (cur == goal) {
+                cells.clear();
+                for (int i = cur; i >= 0; i = parent[i]) {
+                    int x, y;
+                    coords(i, x, y);
+                    cells.emplace_back(x, y);
+                }
+                std::reverse(cells.begin(), cells.end());
+                return true;
+            }
+
+            int x, y;
+            coords(cur, x, y);
+            int orth[4];
+            for (int i = 0; i < 8; i++) {
+                int nb;
+                if (i < 4) {
+                    nb = orth[i] = node(x + DX[i], y + DY[i]);
+                } else {
+                    // 对角线两侧的正方向格子都可通行才能走
+                    if (orth[DX[i] > 0 ? 0 : 1] < 0 || orth[DY[i] > 0 ? 2 : 3] < 0) continue;
+                    nb = node(x + DX[i], y + DY[i]);
+                }
+                if (nb < 0 || closed[nb]) continue;
+                const int ng = g[cur] + (i < 4 ? 10 : 14);
+                if (ng >= g[nb]) continue;
+                g[nb] = ng;
+                parent[nb] = cur;
+                open.push({ng + h(x + DX[i], y + DY[i]), nb});
+            }
+        }
+        return false;
+    }
+
+private:
+    // 绝对格坐标对应的节点 不在范围内或不可通行时返回 -1
+    int node(int x, int y) const {
+        const int cx = FloorDiv(x, SIZE_X), cy = FloorDiv(y, SIZE_Y);
+        auto it = slotOf.find(ChunkKey(cx, cy));
+        if (it == slotOf.end()) return -1;
+        const int lx = x - cx * SIZE_X, ly = y - cy * SIZE_Y;
+        if (!slots[it->second]->passable(lx, ly)) return -1;
+        return it->second * CELLS + ly * SIZE_X + lx;
+    }
+
+    void coords(int n, int &x, int &y) const {
+        const NavChunk *c = slots[n / CELLS];
+        const int l = n % CELLS;
+        x = c->cx * SIZE_X + l % SIZE_X;
+        y = c->cy * SIZE_Y + l / SIZE_X;
+    }
+
+    const NavChunkMap &chunks;
+    phmap::flat_hash_map<u64, int> slotOf;
+    std::vector<const NavChunk *> slots;
+    std::vector<int> g, parent;
+    std::vector<u8> closed;
+};
+
+}  // namespace
+
+NavService::result NavService::search(const chunk_map &chunks, int sx, int sy, int gx, int gy) {
+    result r;
+    auto path = std::make_shared<NavPath>();
+    r.path = path;
+
+    std::vector<std::pair<int, int>> cells;
+    const bool snapped = Snap(chunks, sx, sy) && Snap(chunks, gx, gy);
+    const int scx = FloorDiv(sx, SIZE_X), scy = FloorDiv(sy, SIZE_Y);
+    const int gcx = FloorDiv(gx, SIZE_X), gcy = FloorDiv(gy, SIZE_Y);
+    const int bx0 = std::min(scx, gcx) - 2, bx1 = std::max(scx, gcx) + 2;
+    const int by0 = std::min(scy, gcy) - 2, by1 = std::max(scy, gcy) + 2;
+    const bool smallBox = (size_t)(bx1 - bx0 + 1) * (size_t)(by1 - by0 + 1) <= MAX_FINE_CHUNKS;
+
+    std::vector<std::pair<int, int>> corridor;
+    if (snapped && CoarseSearch(chunks, scx, scy, gcx, gcy, corridor)) {
+        FineSearch fine(chunks);
+        for (const auto &[cx, cy] : corridor) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) fine.add(cx + dx, cy + dy);
+            }
+        }
+        path->found = fine.run(sx, sy, gx, gy, cells);
+
+        // 区块图只看边界 内部可能走不通 绕路可能经过更远的区块
+        if (!path->found && smallBox) {
+            FineSearch wide(chunks);
+            for (int cy = by0; cy <= by1; cy++) {
+                for (int cx = bx0; cx <= bx1; cx++) wide.add(cx, cy);
+            }
+            path->found = wide.run(sx, sy, gx, gy, cells);
+        }
+    }
+
+    auto depend = [&](u64 k) {
+        auto it = chunks.find(k);
+        r.deps.emplace_back(k, it == chunks.end() ? 0 : it->second->version);
+    };
+
+    if (path->found) {
+        // 只保留转折点
+        for (size_t i = 0; i < cells.size(); i++) {
+            const bool turn = i == 0 || i + 1 == cells.size() || cells[i + 1].first - cells[i].first != cells[i].first - cells[i - 1].first ||
+                              cells[i + 1].second - cells[i].second != cells[i].second - cells[i - 1].second;
+            if (turn) path->points.emplace_back(cells[i].first * NavChunk::CELL + NavChunk::CELL / 2.0f, cells[i].second * NavChunk::CELL + NavChunk::CELL / 2.0f);
+        }
+        phmap::flat_hash_set<u64> seen;
+        for (const auto &[x, y] : cells) {
+            const u64 k = ChunkKey(FloorDiv(x, SIZE_X), FloorDiv(y, SIZE_Y));
+            if (seen.insert(k).second) depend(k);
+        }
+    } else if (smallBox) {
+        // 没找到时范围内任何区块改变或加载都可能打通
+        for (int cy = by0; cy <= by1; cy++) {
+            for (int cx = bx0; cx <= bx1; cx++) depend(ChunkKey(cx, cy));
+        }
+    } else {
+        r.cacheable = false;
+    }
+    return r;
+}
+
+bool NavService::fresh(const cache_entry &e) const {
+    for (const auto &[k, version] : e.deps) {
+        auto it = chunks.find(k);
+        if ((it == chunks.end() ? 0 : it->second->version) != version) return false;
+    }
+    return true;
+}
+
+void NavService::store(const int region[4], const result &r) {
+    if (!r.cacheable) return;
+    cache_entry &e = cache[RegionKey(region)];
+    std::copy(region, region + 4, e.region);
+    e.path = r.path;
+    e.deps = r.deps;
+    e.lastUsed = ++useClock;
+
+    if (cache.size() <= CACHE_MAX) return;
+    // 丢掉较久没用过的一半
+    std::vector<u64> uses;
+    uses.reserve(cache.size());
+    for (const auto &[k, entry] : cache) uses.push_back(entry.lastUsed);
+    std::nth_element(uses.begin(), uses.begin() + uses.size() / 2, uses.end());
+    const u64 median = uses[uses.size() / 2];
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (it->second.lastUsed < median) {
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void NavService::invalidate(const world &w) {
+    if (chunks.empty() || !w.dirty.any()) return;
+
+    const int rx = (w.width + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    const int ry = (w.height + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    if (rx != regionsX || ry != regionsY) {
+        regionsX = rx;
+        regionsY = ry;
+        dirtyRegions = std::make_unique<bool[]>((size_t)rx * ry);
+    }
+    std::fill_n(dirtyRegions.get(), (size_t)rx * ry, false);
+    w.dirty.mark_regions(DIRTY_SHIFT, regionsX, dirtyRegions.get());
+
+    // 世界缓冲坐标减去 loadZone 得到区块坐标系下的像素
+    const int lx = (int)w.loadZone.x, ly = (int)w.loadZone.y;
+    for (int y = 0; y < ry; y++) {
+        for (int x = 0; x < rx; x++) {
+            if (!dirtyRegions[(size_t)x + (size_t)y * rx]) continue;
+            const int px0 = (x << DIRTY_SHIFT) - lx, py0 = (y << DIRTY_SHIFT) - ly;
+            const int px1 = px0 + (1 << DIRTY_SHIFT) - 1, py1 = py0 + (1 << DIRTY_SHIFT) - 1;
+            for (int cy = FloorDiv(py0, CHUNK_H); cy <= FloorDiv(py1, CHUNK_H); cy++) {
+                for (int cx = FloorDiv(px0, CHUNK_W); cx <= FloorDiv(px1, CHUNK_W); cx++) {
+                    const u64 k = ChunkKey(cx, cy);
+                    if (chunks.contains(k)) stale.insert(k);
+                }
+            }
+        }
+    }
+}
+
+void NavService::update(world &w) {
+    // 取消的请求完成后结果照样放进缓存
+    results.run();
+    for (auto it = requests.begin(); it != requests.end();) {
+        request_state &req = **it;
+        if (++req.age > ABANDON_UPDATES) req.cancelled = true;
+        if (req.cancelled && !req.searching) {
+            it = requests.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (w.real_tiles.empty()) {
+        if (!chunks.empty()) {
+            chunks.clear();
+            stale.clear();
+            snapshotDirty = true;
+        }
+        return;
+    }
+
+    // 只有完整落在世界缓冲内的区块才能采样
+    const int lx = (int)w.loadZone.x, ly = (int)w.loadZone.y;
+    live.clear();
+    building.clear();
+    w.chunkCache.for_each([&](Chunk *ch) {
+        const int ax = ch->x * CHUNK_W + lx, ay = ch->y * CHUNK_H + ly;
+        if (ax < 0 || ay < 0 || ax + CHUNK_W > w.width || ay + CHUNK_H > w.height) return;
+        const u64 k = ChunkKey(ch->x, ch->y);
+        live.insert(k);
+        if (building.size() < BUILD_PER_UPDATE && (!chunks.contains(k) || stale.contains(k))) building.push_back(ch);
+    });
+
+    for (auto it = chunks.begin(); it != chunks.end();) {
+        if (!live.contains(it->first)) {
+            stale.erase(it->first);
+            it = chunks.erase(it);
+            snapshotDirty = true;
+        } else {
+            ++it;
+        }
+    }
+
+    const MaterialTable &mt = GAME()->materials_table;
+    const u16 *ids = w.real_tiles.mat_id_data();
+    const size_t total = w.real_tiles.size();
+    for (Chunk *ch : building) {
+        auto c = std::make_shared<NavChunk>();
+        c->cx = ch->x;
+        c->cy = ch->y;
+        const int ax = ch->x * CHUNK_W + lx, ay = ch->y * CHUNK_H + ly;
+        for (int y = 0; y < CHUNK_H; y++) {
+            u64 &row = c->blocked[y / NavChunk::CELL];
+            // 一行在存储中连续 只可能在环形末尾绕回一次
+            size_t p = w.real_tiles.physical((size_t)ax + (size_t)(ay + y) * w.width);
+            for (int x = 0; x < CHUNK_W; x++, p++) {
+                if (p == total) p = 0;
+                if (mt.physicsType[ids[p]] == PhysicsType::SOLID) row |= (u64)1 << (x / NavChunk::CELL);
+            }
+        }
+        const u64 full = SIZE_X == 64 ? ~(u64)0 : ((u64)1 << SIZE_X) - 1;
+        c->openTop = ~c->blocked[0] & full;
+        c->openBottom = ~c->blocked[SIZE_Y - 1] & full;
+        for (int y = 0; y < SIZE_Y; y++) {
+            if (c->passable(0, y)) c->openLeft |= (u64)1 << y;
+            if (c->passable(SIZE_X - 1, y)) c->openRight |= (u64)1 << y;
+        }
+
+        const u64 k = ChunkKey(ch->x, ch->y);
+        stale.erase(k);
+        auto it = chunks.find(k);
+        if (it != chunks.end() && !memcmp(it->second->blocked, c->blocked, sizeof(c->blocked))) continue;
+        c->version = nextVersion++;
+        if (nextVersion == 0) nextVersion = 1;
+        chunks[k] = std::move(c);
+        snapshotDirty = true;
+    }
+}
+
+u32 NavService::request(f32 x0, f32 y0, f32 x1, f32 y1) {
+    const int sx = (int)std::floor(x0 / NavChunk::CELL), sy = (int)std::floor(y0 / NavChunk::CELL);
+    const int gx = (int)std::floor(x1 / NavChunk::CELL), gy = (int)std::floor(y1 / NavChunk::CELL);
+
+    auto req = std::make_unique<request_state>();
+    req->ticket = nextTicket++;
+    if (nextTicket == 0) nextTicket = 1;
+    const int region[4] = {FloorDiv(sx, REGION), FloorDiv(sy, REGION), FloorDiv(gx, REGION), FloorDiv(gy, REGION)};
+    std::copy(region, region + 4, req->region);
+
+    auto it = cache.find(RegionKey(region));
+    if (it != cache.end() && std::equal(region, region + 4, it->second.region) && fresh(it->second)) {
+        it->second.lastUsed = ++useClock;
+        req->path = it->second.path;
+    } else {
+        if (snapshotDirty || !snapshot) {
+            snapshot = std::make_shared<const chunk_map>(chunks);
+            snapshotDirty = false;
+        }
+        req->searching = true;
+        job::async([snap = snapshot, sx, sy, gx, gy]() { return search(*snap, sx, sy, gx, gy); }).then_on(results, [this, r = req.get()](result res) {
+            store(r->region, res);
+            r->path = res.path;
+            r->searching = false;
+        });
+    }
+
+    const u32 ticket = req->ticket;
+    requests.push_back(std::move(req));
+    return ticket;
+}
+
+bool NavService::poll(u32 ticket, NavPath &out) {
+    results.run();
+    for (auto it = requests.begin(); it != requests.end(); ++it) {
+        request_state &req = **it;
+        if (req.ticket != ticket || req.cancelled) continue;
+        if (req.searching) return false;
+        out = *req.path;
+        requests.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void NavService::cancel(u32 ticket) {
+    for (auto &req : requests) {
+        if (req->ticket == ticket) req->cancelled = true;
+    }
+}
+
+bool NavService::passable(f32 x, f32 y) const { return CellPassable(chunks, (int)std::floor(x / NavChunk::CELL), (int)std::floor(y / NavChunk::CELL)); }
+
+void NavService::clear() {
+    results.wait();
+    results.run();
+    requests.clear();
+    cache.clear();
+    chunks.clear();
+    stale.clear();
+    snapshot.reset();
+    snapshotDirty = true;
+}
+
+}  // namespace ME
@@ -0,0 +1,142 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_NAV_HPP
+#define ME_WORLD_NAV_HPP
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+#include "engine/core/mathlib.hpp"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+class world;
+struct Chunk;
+
+// 寻路用的区块粗网格 每 CELL 像素见方一格 格内有 SOLID 像素就不可通行 (和世界碰撞网格一样只看 SOLID)
+struct NavChunk {
+    static constexpr int CELL = 4;
+    static constexpr int SIZE_X = CHUNK_W / CELL;
+    static constexpr int SIZE_Y = CHUNK_H / CELL;
+    static_assert(CHUNK_W % CELL == 0 && CHUNK_H % CELL == 0 && SIZE_X <= 64 && SIZE_Y <= 64, "NavChunk rows and borders are u64 masks");
+
+    int cx = 0, cy = 0;
+    u32 version = 0;                  // 通行位变化时换成新值 不会重复 缓存的路径据此判断是否过期
+    u64 blocked[SIZE_Y]{};            // 第 y 行 bit x 为 1 表示不可通行
+    u64 openLeft = 0, openRight = 0;  // 最左和最右一列可通行的格 bit y
+    u64 openTop = 0, openBottom = 0;  // 最上和最下一行可通行的格 bit x
+
+    bool passable(int x, int y) const { return !((blocked[y] >> x) & 1); }
+};
+
+struct NavPath {
+    bool found = false;
+    // 转折点 坐标与 WorldEntity 相同 取格子中心 第一个点在起点所在的格子
+    std::vector<MEvec2> points;
+};
+
+// NPC 的寻路服务 world::nav
+// 每个已加载并且完整落在世界缓冲内的区块有一份 NavChunk 像素改写 (dirty) 后重新采样 通行位没变时版本保持不变
+// 搜索分两层 先在区块图上 A* (相邻区块的边界上有相对的可通行格才相连) 再在经过的区块和它们周围一圈里逐格 A*
+// 逐格搜索失败时在起点终点所在区块的包围盒 (外扩两个区块) 内再搜一次
+// 搜索在 job 线程上对 NavChunk 的快照进行 不读取世界
+// 结果按起点和终点所在的区域 (REGION 格见方) 缓存 路径经过的区块版本都没变时直接复用 所以命中时起点终点可能与请求相差几格
+// 所有函数都只能在主线程上调用
+class NavService {
+public:
+    static constexpr int REGION = 8;
+    static constexpr size_t CACHE_MAX = 512;
+    // 每次 update 最多重新采样的区块数
+    static constexpr int BUILD_PER_UPDATE = 8;
+    // 请求方 (比如被销毁的 Bot) 一直不来取的结果在这么多次 update 之后丢掉
+    static constexpr u32 ABANDON_UPDATES = 600;
+
+    NavService() = default;
+    NavService(const NavService &) = delete;
+    NavService &operator=(const NavService &) = delete;
+    ~NavService() { clear(); }
+
+    // 在 world::dirty 清除前调用 记下被改写的区块
+    void invalidate(const world &w);
+    // 采样新进入世界缓冲和被改写的区块 丢掉已经离开的区块
+    void update(world &w);
+
+    // 从 (x0, y0) 到 (x1, y1) 的路径 坐标与 WorldEntity 相同 返回的请求号不为 0
+    u32 request(f32 x0, f32 y0, f32 x1, f32 y1);
+    // 完成时取走结果并返回 true 之后请求号失效
+    bool poll(u32 ticket, NavPath &out);
+    void cancel(u32 ticket);
+
+    // 没有采样的区块视为不可通行
+    bool passable(f32 x, f32 y) const;
+
+    // 等待所有搜索结束并清空
+    void clear();
+
+    size_t chunk_count() const { return chunks.size(); }
+    size_t cache_size() const { return cache.size(); }
+    size_t pending() const { return requests.size(); }
+
+private:
+    using chunk_map = phmap::flat_hash_map<u64, std::shared_ptr<const NavChunk>>;
+    using path_ptr = std::shared_ptr<const NavPath>;
+    // 路径依赖的区块和采样时的版本 区块不存在时版本为 0
+    using deps_list = std::vector<std::pair<u64, u32>>;
+
+    struct result {
+        path_ptr path;
+        deps_list deps;
+        bool cacheable = true;
+    };
+
+    struct request_state {
+        u32 ticket = 0;
+        int region[4]{};
+        path_ptr path;           // 命中缓存时直接有结果 否则在搜索完成时填上
+        bool searching = false;  // 结果还没送到 results
+        bool cancelled = false;  // 搜索完成后在 update 中删除
+        u32 age = 0;             // 经过的 update 次数 超过 ABANDON_UPDATES 还没取走的视为取消
+    };
+
+    struct cache_entry {
+        int region[4]{};
+        path_ptr path;
+        deps_list deps;
+        u64 lastUsed = 0;
+    };
+
+    static result search(const chunk_map &chunks, int sx, int sy, int gx, int gy);
+    bool fresh(const cache_entry &e) const;
+    void store(const int region[4], const result &r);
+
+    chunk_map chunks;
+    // 提交搜索时共享的快照 chunks 改变后在下一次 request 时重新复制
+    std::shared_ptr<const chunk_map> snapshot;
+    bool snapshotDirty = true;
+
+    // DIRTY_SHIFT 见方的脏区域 在世界缓冲坐标上
+    static constexpr int DIRTY_SHIFT = 5;
+    phmap::flat_hash_set<u64> stale;
+    std::unique_ptr<bool[]> dirtyRegions;
+    int regionsX = 0, regionsY = 0;
+    // update 的临时数据 保留容量
+    phmap::flat_hash_set<u64> live;
+    std::vector<Chunk *> building;
+
+    phmap::flat_hash_map<u64, cache_entry> cache;
+    std::vector<std::unique_ptr<request_state>> requests;
+    // 搜索完成后在主线程上填写请求和缓存 update 和 poll 开头处理
+    job_inbox results;
+    u32 nextTicket = 1;
+    u32 nextVersion = 1;
+    u64 useClock = 0;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,266 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_partition.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <iterator>
+
+#include "chunk.hpp"
+#include "chunk_extras.hpp"
+#include "engine/core/profiler.hpp"
+#include "engine/utils/utility.hpp"
+#include "npc.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+int FloorMod(int a, int b) { return a - FloorDiv(a, b) * b; }
+
+int KeyX(u64 k) { return (int)(u32)(k >> 32); }
+int KeyY(u64 k) { return (int)(u32)k; }
+
+// 区块完整落在世界缓冲内
+bool InBuffer(const world &w, int cx, int cy) {
+    const int ax = cx * CHUNK_W + (int)w.loadZone.x, ay = cy * CHUNK_H + (int)w.loadZone.y;
+    return ax >= 0 && ay >= 0 && ax + CHUNK_W <= w.width && ay + CHUNK_H <= w.height;
+}
+
+}  // namespace
+
+void WorldPartition::configure(u32 self, int regionW, int regionH, int nodesX, int nodesY) {
+    clear();
+    this->selfNode = self;
+    this->regionW = std::max(regionW, 2);
+    this->regionH = std::max(regionH, 2);
+    this->nodesX = std::max(nodesX, 1);
+    this->nodesY = std::max(nodesY, 1);
+}
+
+u32 WorldPartition::owner(int cx, int cy) const {
+    const int rx = FloorMod(FloorDiv(cx, regionW), nodesX);
+    const int ry = FloorMod(FloorDiv(cy, regionH), nodesY);
+    return (u32)(rx + ry * nodesX);
+}
+
+bool WorldPartition::owns_at(const world &w, int x, int y) const {
+    if (!enabled()) return true;
+    return owner(FloorDiv(x - (int)w.loadZone.x, CHUNK_W), FloorDiv(y - (int)w.loadZone.y, CHUNK_H)) == selfNode;
+}
+
+WorldPartition::peer *WorldPartition::find(u32 node) {
+    for (peer &p : peers) {
+        if (p.node == node) return &p;
+    }
+    return nullptr;
+}
+
+void WorldPartition::add_peer(u32 node, Send send) {
+    if (node == selfNode || find(node)) return;
+    peers.push_back({node, std::move(send)});
+}
+
+void WorldPartition::remove_peer(u32 node) {
+    std::erase_if(peers, [node](const peer &p) { return p.node == node; });
+}
+
+void WorldPartition::resync(u32 node, int cx, int cy) {
+    if (peer *p = find(node)) p->synced.erase(ChunkMap::key(cx, cy));
+}
+
+void WorldPartition::clear() {
+    for (peer &p : peers) {
+        p.synced.clear();
+        p.halo.clear();
+        p.spill.clear();
+    }
+    dirtyBricks.clear();
+    changed.clear();
+    received.clear();
+}
+
+void WorldPartition::invalidate(const world &w) {
+    if (!enabled() || peers.empty() || w.real_tiles.empty()) return;
+    dirtyBricks.collect(w);
+    changed.clear();
+
+    for (const auto &[k, bricks] : dirtyBricks.chunks()) {
+        const int cx = KeyX(k), cy = KeyY(k);
+        const u32 o = owner(cx, cy);
+        if (o != selfNode) {
+            // 刚从所有者收到的镜像内容不是本节点的改写
+            auto r = received.find(k);
+            const u64 spilled = bricks & ~(r != received.end() ? r->second : 0);
+            if (!spilled) continue;
+            if (peer *p = find(o)) p->spill[k] |= spilled;
+            continue;
+        }
+
+        changed[k] = bricks;
+        for (peer &p : peers) {
+            if (p.synced.contains(k)) p.halo[k] |= bricks;
+        }
+    }
+    received.clear();
+}
+
+void WorldPartition::send(peer &p, Message type, u64 key, const std::vector<char> &data) {
+    const i32 pos[2] = {KeyX(key), KeyY(key)};
+    message.resize(HEADER_SIZE);
+    message[0] = (char)type;
+    memcpy(message.data() + 1, pos, sizeof(pos));
+    message.insert(message.end(), data.begin(), data.end());
+
+    p.send(message.data(), message.size());
+    sentBytes += message.size();
+}
+
+void WorldPartition::update(world &w) {
+    if (!enabled() || peers.empty() || w.real_tiles.empty()) return;
+
+    ME_profiler_scope_auto("WorldPartition");
+    const u64 before = sentBytes;
+
+    // 自己的区块挨着哪个节点的区块 就是那个节点的镜像 第一次整块发送
+    w.chunkCache.for_each([&](Chunk *ch) {
+        if (owner(ch->x, ch->y) != selfNode || !InBuffer(w, ch->x, ch->y)) return;
+        const u64 k = ChunkMap::key(ch->x, ch->y);
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const u32 o = owner(ch->x + dx, ch->y + dy);
+                if (o == selfNode) continue;
+                peer *p = find(o);
+                if (!p || p->synced.contains(k)) continue;
+                p->synced.insert(k);
+                p->halo[k] = ReplicationServer::ALL_BRICKS;
+            }
+        }
+    });
+
+    for (peer &p : peers) {
+        for (const auto &[k, bricks] : p.halo) {
+            if (!w.chunkCache.contains(KeyX(k), KeyY(k)) || !InBuffer(w, KeyX(k), KeyY(k))) continue;
+            EncodeChunkBricks(w, KeyX(k), KeyY(k), bricks, payload);
+            send(p, Message::Halo, k, payload);
+        }
+        p.halo.clear();
+
+        for (const auto &[k, bricks] : p.spill) {
+            if (!w.chunkCache.contains(KeyX(k), KeyY(k)) || !InBuffer(w, KeyX(k), KeyY(k))) continue;
+            EncodeChunkBricks(w, KeyX(k), KeyY(k), bricks, payload);
+            send(p, Message::Spill, k, payload);
+        }
+        p.spill.clear();
+
+        // 离开世界缓冲的区块再次进入时整块重发
+        for (auto it = p.synced.begin(); it != p.synced.end();) {
+            if (InBuffer(w, KeyX(*it), KeyY(*it)) && w.chunkCache.contains(KeyX(*it), KeyY(*it))) {
+                ++it;
+            } else {
+                it = p.synced.erase(it);
+            }
+        }
+    }
+
+    // 中心落在别的节点区块里的实体和刚体 与 chunkExtras 的筛选相同
+    leaving.clear();
+    auto leave = [&](f32 x, f32 y) {
+        const int cx = (int)std::floor(x / CHUNK_W), cy = (int)std::floor(y / CHUNK_H);
+        const u32 o = owner(cx, cy);
+        if (o != selfNode && find(o)) leaving.insert(ChunkMap::key(cx, cy));
+    };
+    w.registry.for_each_component<WorldEntity>([&](ecs::entity e, WorldEntity &we) {
+        if ((ecs::exists<Player>{})(e) || e.id() == w.player) return;
+        leave(we.x + we.hw / 2.0f, we.y + we.hh / 2.0f);
+    });
+    for (RigidBody *rb : w.rigidBodies) {
+        if (rb->item || rb->is_cleaned || !rb->tiles || rb->body->GetType() != b2_dynamicBody) continue;
+        const b2Vec2 center = rb->body->GetWorldCenter();
+        leave(center.x - w.loadZone.x, center.y - w.loadZone.y);
+    }
+
+    for (u64 k : leaving) {
+        Chunk *ch = w.chunkCache.find(KeyX(k), KeyY(k));
+        // 还没放回世界的存档记录随区块留在原处
+        if (!ch || !ch->extras.empty()) continue;
+        const std::vector<u8> bytes = w.chunkExtras(ch, true);
+
+        // 结构属于区块 不随着迁移
+        ChunkExtras extras;
+        extras.decode(bytes.data(), bytes.size());
+        extras.structures.clear();
+        if (extras.empty()) continue;
+        std::vector<u8> out;
+        extras.encode(out);
+        payload.assign(out.begin(), out.end());
+        send(*find(owner(KeyX(k), KeyY(k))), Message::Migrate, k, payload);
+    }
+
+    ME_profiler_count("partition bytes", (u32)(sentBytes - before));
+}
+
+bool WorldPartition::receive(world &w, u32 node, const char *data, size_t size) {
+    if (size < HEADER_SIZE) {
+        METADOT_ERROR("Partition message is truncated");
+        return false;
+    }
+    const auto type = (Message)data[0];
+    i32 pos[2];
+    memcpy(pos, data + 1, sizeof(pos));
+    const int cx = pos[0], cy = pos[1];
+    const u64 k = ChunkMap::key(cx, cy);
+    const char *body = data + HEADER_SIZE;
+    const size_t bodySize = size - HEADER_SIZE;
+
+    // 镜像必须来自所有者 溢出和迁移必须发给所有者
+    const u32 o = owner(cx, cy);
+    if (type == Message::Halo ? o != node : o != selfNode) {
+        METADOT_WARN(std::format("Partition message {0} from node {1} for chunk {2},{3} owned by {4}", (int)data[0], node, cx, cy, o).c_str());
+        return false;
+    }
+
+    switch (type) {
+        case Message::Halo: {
+            u64 bricks = 0;
+            if (!ApplyChunkBricks(w, cx, cy, body, bodySize, ReplicationServer::ALL_BRICKS, bricks)) return false;
+            received[k] |= bricks;
+            return true;
+        }
+        case Message::Spill: {
+            // 所有者自己也改过的块以所有者为准
+            auto it = changed.find(k);
+            const u64 mine = it != changed.end() ? it->second : 0;
+            u64 bricks = 0;
+            if (!ApplyChunkBricks(w, cx, cy, body, bodySize, ~mine, bricks)) return false;
+            conflictCount += std::popcount(bricks & mine);
+            return true;
+        }
+        case Message::Migrate: {
+            Chunk *ch = w.chunkCache.find(cx, cy);
+            if (!ch) return false;
+            if (ch->extras.empty()) {
+                ch->extras.assign((const u8 *)body, (const u8 *)body + bodySize);
+                w.restoreChunkExtras(ch);
+                return true;
+            }
+            // 区块的存档记录还没放回世界 合并后随它一起放回
+            ChunkExtras pending, incoming;
+            pending.decode(ch->extras.data(), ch->extras.size());
+            if (!incoming.decode((const u8 *)body, bodySize)) return false;
+            std::move(incoming.entities.begin(), incoming.entities.end(), std::back_inserter(pending.entities));
+            std::move(incoming.bodies.begin(), incoming.bodies.end(), std::back_inserter(pending.bodies));
+            pending.encode(ch->extras);
+            return true;
+        }
+    }
+    METADOT_ERROR(std::format("Unknown partition message {0}", (int)data[0]).c_str());
+    return false;
+}
+
+}  // namespace ME
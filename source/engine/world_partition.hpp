@@ -0,0 +1,104 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_PARTITION_HPP
+#define ME_WORLD_PARTITION_HPP
+
+#include <functional>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "libs/parallel_hashmap/phmap.h"
+#include "world_replication.hpp"
+
+namespace ME {
+
+class world;
+
+// 实验性的多进程模拟 world::partition
+// 区块按 regionW x regionH 分成区域 区域网格按 nodesX x nodesY 平铺分给各节点 每个节点只模拟自己的区块
+// world::tick 的 2x2 棋盘阶段中一个模拟区块只会写到相邻的区块 所以每个节点保留一圈一个区块宽的镜像 (halo) 就够了
+// 每次 update 与相邻节点交换 (传输由调用者提供 每个节点一个 send 回调 要求可靠且有序):
+//   Halo    自己的区块中挨着对方区域的 第一次整块 之后只发改写的块 对方写进镜像
+//   Spill   对方的区块被本节点改写的块 (像素落过边界 刚体写入等) 对方这段时间自己没改过的块才接受 否则以所有者为准
+//   Migrate 中心落在对方区块里的实体和动态刚体 用 ChunkExtras 编码 本地删除 对方放回世界
+// 镜像里的区块不模拟 不发热 也不参与液体平衡 温度和液体只在所有者上计算
+// 每个节点的世界缓冲要覆盖自己的区域和一圈镜像 各节点的存档只有自己的区块是权威的
+// nodes 为 1 时不起作用 所有函数都只能在主线程上调用
+class WorldPartition {
+public:
+    enum class Message : u8 { Halo, Spill, Migrate };
+    // 与 ReplicationServer 相同 Message + 区块坐标 (i32 x2) + 数据
+    static constexpr size_t HEADER_SIZE = ReplicationServer::HEADER_SIZE;
+
+    using Send = std::function<void(const char *data, size_t size)>;
+
+    WorldPartition() = default;
+    WorldPartition(const WorldPartition &) = delete;
+    WorldPartition &operator=(const WorldPartition &) = delete;
+
+    // regionW regionH 至少为 2 个区块 否则镜像会跨过整个区域
+    void configure(u32 self, int regionW, int regionH, int nodesX, int nodesY);
+    bool enabled() const { return nodesX * nodesY > 1; }
+    u32 self() const { return selfNode; }
+
+    u32 owner(int cx, int cy) const;
+    bool owns(int cx, int cy) const { return !enabled() || owner(cx, cy) == selfNode; }
+    // 世界缓冲坐标 (x, y) 处的区块是否由本节点模拟 tick 的各遍用模拟单元的中心判断
+    bool owns_at(const world &w, int x, int y) const;
+
+    void add_peer(u32 node, Send send);
+    void remove_peer(u32 node);
+    // 对方没能写入某个镜像区块时调用 下次整块重发
+    void resync(u32 node, int cx, int cy);
+
+    // 在 world::dirty 清除前调用 记下被改写的块
+    void invalidate(const world &w);
+    // 发送镜像 溢出和迁移
+    void update(world &w);
+    // 处理 node 发来的一条消息 格式损坏或者区块不在缓冲内时返回 false
+    bool receive(world &w, u32 node, const char *data, size_t size);
+
+    void clear();
+
+    // 累计发送的字节数 和因为双方同时改写而丢弃的溢出块数
+    u64 bytes_sent() const { return sentBytes; }
+    u64 conflicts() const { return conflictCount; }
+
+private:
+    struct peer {
+        u32 node;
+        Send send;
+        // 已经整块发过的镜像区块
+        phmap::flat_hash_set<u64> synced;
+        // 还没发送的改写 key 为区块 值为块掩码
+        phmap::flat_hash_map<u64, u64> halo;
+        phmap::flat_hash_map<u64, u64> spill;
+    };
+
+    peer *find(u32 node);
+    void send(peer &p, Message type, u64 key, const std::vector<char> &payload);
+
+    u32 selfNode = 0;
+    int regionW = 1, regionH = 1;
+    int nodesX = 1, nodesY = 1;
+    std::vector<peer> peers;
+
+    DirtyBricks dirtyBricks;
+    // 上次 invalidate 以来本节点改写的自己的块 用来判断溢出是否冲突
+    phmap::flat_hash_map<u64, u64> changed;
+    // receive 写进镜像的块 下次 invalidate 不当成本节点的改写
+    phmap::flat_hash_map<u64, u64> received;
+
+    u64 sentBytes = 0;
+    u64 conflictCount = 0;
+
+    // update 的临时数据 保留容量
+    std::vector<char> payload;
+    std::vector<char> message;
+    phmap::flat_hash_set<u64> leaving;
+};
+
+}  // namespace ME
+
+#endif
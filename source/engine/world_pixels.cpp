@@ -0,0 +1,348 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_pixels.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include "engine/renderer/renderer_gpu.h"
+#include "game_datastruct.hpp"
+
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(ME_SIMD_X86)
+#include <immintrin.h>
+#elif defined(ME_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace ME {
+
+// 0x00RRGGBB -> 内存中的 r g b (低三个字节)
+static inline u32 swizzle_rgb(u32 c) { return ((c >> 16) & 0xff) | (c & 0xff00) | ((c & 0xff) << 16); }
+
+void CellPixelConverter::update_materials() {
+    size_t n = (size_t)GAME()->materials_count;
+    if (lutFlags.size() == n) return;
+
+    lutColorMask.resize(n);
+    lutAlpha.resize(n);
+    lutEmission.resize(n);
+    lutFlags.resize(n);
+
+    for (size_t id = 0; id < n; id++) {
+        Material *mat = GAME()->materials_array[id];
+        bool air = mat->physicsType == PhysicsType::AIR;
+
+        lutColorMask[id] = air ? 0 : 0x00ffffff;
+        lutAlpha[id] = (u32)(air ? ME_ALPHA_TRANSPARENT : mat->alpha) << 24;
+        lutEmission[id] = air ? (u32)ME_ALPHA_TRANSPARENT << 24 : swizzle_rgb(mat->emitColor) | (mat->emitColor & 0xff000000);
+
+        u32 flags = 0;
+        if (air) flags |= FLAG_AIR;
+        else if (mat->id == GAME()->materials_list.FIRE.id) flags |= FLAG_FIRE;
+        if (mat->physicsType == PhysicsType::SOUP) flags |= FLAG_SOUP;
+        lutFlags[id] = flags;
+    }
+    lutVersion++;
+}
+
+void CellPixelConverter::material_props(std::vector<u8> &out) const {
+    const size_t n = lutFlags.size();
+    out.resize(n * 2 * 4);
+    for (size_t id = 0; id < n; id++) {
+        // 掩码只有全 0 和全 1 两种 存在 r 里
+        u32 props = (lutColorMask[id] ? 0xff : 0) | lutAlpha[id];
+        memcpy(&out[id * 4], &props, 4);
+        memcpy(&out[(n + id) * 4], &lutEmission[id], 4);
+    }
+}
+
+CellPixelConverter::Result CellPixelConverter::convert_packed(const CellStore &cells, size_t base, u64 mask, u8 *packed, u8 *fire) const {
+    Result result{0, 0};
+    const u16 *ids = cells.mat_id_data();
+    const u32 *colors = cells.color_data();
+
+    for (u64 m = mask; m; m &= m - 1) {
+        const int k = std::countr_zero(m);
+        const size_t i = base + k;
+        const size_t p = cells.physical(i);
+        const u16 id = ids[p];
+        const u32 f = lutFlags[id];
+        const u32 rgb = swizzle_rgb(colors[p]);
+
+        u32 px = rgb | ((u32)id << 24);
+        memcpy(packed + i * 4, &px, 4);
+
+        if (f & (FLAG_FIRE | FLAG_AIR)) {
+            px = (rgb & lutColorMask[id]) | lutAlpha[id];
+            memcpy(fire + i * 4, &px, 4);
+        }
+        if (f & FLAG_FIRE) result.fire |= (u64)1 << k;
+        if (f & FLAG_SOUP) result.soup |= (u64)1 << k;
+    }
+    return result;
+}
+
+namespace {
+
+using Result = CellPixelConverter::Result;
+constexpr u32 FLAG_AIR = CellPixelConverter::FLAG_AIR;
+constexpr u32 FLAG_FIRE = CellPixelConverter::FLAG_FIRE;
+constexpr u32 FLAG_SOUP = CellPixelConverter::FLAG_SOUP;
+
+struct pixel_luts {
+    const u32 *colorMask;
+    const u32 *alpha;
+    const u32 *emission;
+    const u32 *flags;
+};
+
+// 转换 base 开始的 64 个像素中 mask 标记的部分
+using convert_fn = Result (*)(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire);
+
+// 逻辑下标 i 的像素 bit 是它在 64 个像素中的位置
+inline void convert_one(const pixel_luts &t, const CellStore &cells, size_t i, int bit, u8 *pixels, u8 *emission, u8 *fire, Result &result) {
+    const size_t p = cells.physical(i);
+    const u16 id = cells.mat_id_data()[p];
+    const u32 f = t.flags[id];
+    const u32 px = (swizzle_rgb(cells.color_data()[p]) & t.colorMask[id]) | t.alpha[id];
+    memcpy(pixels + i * 4, &px, 4);
+    memcpy(emission + i * 4, &t.emission[id], 4);
+    if (f & (FLAG_FIRE | FLAG_AIR)) memcpy(fire + i * 4, &px, 4);
+    if (f & FLAG_FIRE) result.fire |= (u64)1 << bit;
+    if (f & FLAG_SOUP) result.soup |= (u64)1 << bit;
+}
+
+// 世界末尾不足一组 或者在环形存储的末尾绕回的部分逐个转换 返回 true
+inline bool convert_tail(const pixel_luts &t, const CellStore &cells, size_t base, int g, u32 m, int lanes, u8 *pixels, u8 *emission, u8 *fire, Result &result) {
+    if (cells.physical(base + g) + lanes <= cells.size()) return false;
+    for (int k = 0; k < lanes; k++)
+        if (m & (1u << k)) convert_one(t, cells, base + g + k, g + k, pixels, emission, fire, result);
+    return true;
+}
+
+Result convert_scalar(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) {
+    Result result{0, 0};
+    for (u64 m = mask; m; m &= m - 1) {
+        const int k = std::countr_zero(m);
+        convert_one(t, cells, base + k, k, pixels, emission, fire, result);
+    }
+    return result;
+}
+
+#if defined(ME_SIMD_X86) || defined(ME_SIMD_NEON)
+// 没有 gather 查表部分逐个读取 返回是否有要写入 fire 的像素
+inline bool gather4(const pixel_luts &t, const u16 *ids, u32 m, int g, u32 *cmask, u32 *alpha, u32 *emit, u32 *fireSel, Result &result) {
+    bool anyFire = false;
+    for (int k = 0; k < 4; k++) {
+        u16 id = ids[k];
+        u32 f = t.flags[id];
+        cmask[k] = t.colorMask[id];
+        alpha[k] = t.alpha[id];
+        emit[k] = t.emission[id];
+        bool dirty = m & (1u << k);
+        fireSel[k] = dirty && (f & (FLAG_FIRE | FLAG_AIR)) ? 0xffffffff : 0;
+        anyFire |= fireSel[k] != 0;
+        if (dirty && (f & FLAG_FIRE)) result.fire |= (u64)1 << (g + k);
+        if (dirty && (f & FLAG_SOUP)) result.soup |= (u64)1 << (g + k);
+    }
+    return anyFire;
+}
+#endif
+
+#if defined(ME_SIMD_X86)
+inline __m128i blend_sse2(__m128i sel, __m128i a, __m128i b) { return _mm_or_si128(_mm_and_si128(sel, a), _mm_andnot_si128(sel, b)); }
+
+Result convert_sse2(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) {
+    Result result{0, 0};
+    const u16 *ids = cells.mat_id_data();
+    const u32 *colors = cells.color_data();
+    constexpr u32 LANE_MASK = 0xf;
+
+    for (int g = 0; g < 64; g += 4) {
+        u32 m = (u32)(mask >> g) & LANE_MASK;
+        if (!m) continue;
+        if (convert_tail(t, cells, base, g, m, 4, pixels, emission, fire, result)) continue;
+        size_t i = base + g;
+        size_t p = cells.physical(i);
+
+        alignas(16) u32 cmask[4], alpha[4], emit[4], fireSel[4];
+        bool anyFire = gather4(t, ids + p, m, g, cmask, alpha, emit, fireSel, result);
+
+        const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i lm = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)m), bits), bits);
+
+        __m128i col = _mm_loadu_si128((const __m128i *)(colors + p));
+        const __m128i ff = _mm_set1_epi32(0xff);
+        __m128i sw = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(col, 16), ff), _mm_and_si128(col, _mm_set1_epi32(0xff00))), _mm_slli_epi32(_mm_and_si128(col, ff), 16));
+        __m128i px = _mm_or_si128(_mm_and_si128(sw, _mm_load_si128((const __m128i *)cmask)), _mm_load_si128((const __m128i *)alpha));
+        __m128i em = _mm_load_si128((const __m128i *)emit);
+
+        if (m == LANE_MASK) {
+            _mm_storeu_si128((__m128i *)(pixels + i * 4), px);
+            _mm_storeu_si128((__m128i *)(emission + i * 4), em);
+        } else {
+            _mm_storeu_si128((__m128i *)(pixels + i * 4), blend_sse2(lm, px, _mm_loadu_si128((const __m128i *)(pixels + i * 4))));
+            _mm_storeu_si128((__m128i *)(emission + i * 4), blend_sse2(lm, em, _mm_loadu_si128((const __m128i *)(emission + i * 4))));
+        }
+        __m128i fs = _mm_load_si128((const __m128i *)fireSel);
+        if (anyFire) _mm_storeu_si128((__m128i *)(fire + i * 4), blend_sse2(fs, px, _mm_loadu_si128((const __m128i *)(fire + i * 4))));
+    }
+    return result;
+}
+
+ME_TARGET_AVX2 Result convert_avx2(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) {
+    Result result{0, 0};
+    const u16 *ids = cells.mat_id_data();
+    const u32 *colors = cells.color_data();
+    constexpr u32 LANE_MASK = 0xff;
+
+    for (int g = 0; g < 64; g += 8) {
+        u32 m = (u32)(mask >> g) & LANE_MASK;
+        if (!m) continue;
+        if (convert_tail(t, cells, base, g, m, 8, pixels, emission, fire, result)) continue;
+        size_t i = base + g;
+        size_t p = cells.physical(i);
+
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i lm = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)m), bits), bits);
+
+        __m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(ids + p)));
+        __m256i col = _mm256_loadu_si256((const __m256i *)(colors + p));
+        __m256i cmask = _mm256_i32gather_epi32((const int *)t.colorMask, idx, 4);
+        __m256i alpha = _mm256_i32gather_epi32((const int *)t.alpha, idx, 4);
+        __m256i emit = _mm256_i32gather_epi32((const int *)t.emission, idx, 4);
+        __m256i flags = _mm256_i32gather_epi32((const int *)t.flags, idx, 4);
+
+        const __m256i ff = _mm256_set1_epi32(0xff);
+        __m256i sw = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(col, 16), ff), _mm256_and_si256(col, _mm256_set1_epi32(0xff00))),
+                                     _mm256_slli_epi32(_mm256_and_si256(col, ff), 16));
+        __m256i px = _mm256_or_si256(_mm256_and_si256(sw, cmask), alpha);
+
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i isFire = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(flags, _mm256_set1_epi32(FLAG_FIRE)), zero), lm);
+        __m256i isSoup = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(flags, _mm256_set1_epi32(FLAG_SOUP)), zero), lm);
+        __m256i fireStore = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(flags, _mm256_set1_epi32(FLAG_FIRE | FLAG_AIR)), zero), lm);
+
+        if (m == LANE_MASK) {
+            _mm256_storeu_si256((__m256i *)(pixels + i * 4), px);
+            _mm256_storeu_si256((__m256i *)(emission + i * 4), emit);
+        } else {
+            _mm256_maskstore_epi32((int *)(pixels + i * 4), lm, px);
+            _mm256_maskstore_epi32((int *)(emission + i * 4), lm, emit);
+        }
+        _mm256_maskstore_epi32((int *)(fire + i * 4), fireStore, px);
+
+        result.fire |= (u64)_mm256_movemask_ps(_mm256_castsi256_ps(isFire)) << g;
+        result.soup |= (u64)_mm256_movemask_ps(_mm256_castsi256_ps(isSoup)) << g;
+    }
+    return result;
+}
+
+// 16 路 用掩码寄存器选择写入的像素
+ME_TARGET_AVX512 Result convert_avx512(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) {
+    Result result{0, 0};
+    const u16 *ids = cells.mat_id_data();
+    const u32 *colors = cells.color_data();
+
+    for (int g = 0; g < 64; g += 16) {
+        const __mmask16 lm = (__mmask16)(mask >> g);
+        if (!lm) continue;
+        if (convert_tail(t, cells, base, g, lm, 16, pixels, emission, fire, result)) continue;
+        size_t i = base + g;
+        size_t p = cells.physical(i);
+
+        __m512i idx = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)(ids + p)));
+        __m512i col = _mm512_loadu_si512((const void *)(colors + p));
+        __m512i cmask = _mm512_i32gather_epi32(idx, (const void *)t.colorMask, 4);
+        __m512i alpha = _mm512_i32gather_epi32(idx, (const void *)t.alpha, 4);
+        __m512i emit = _mm512_i32gather_epi32(idx, (const void *)t.emission, 4);
+        __m512i flags = _mm512_i32gather_epi32(idx, (const void *)t.flags, 4);
+
+        const __m512i ff = _mm512_set1_epi32(0xff);
+        __m512i sw = _mm512_or_si512(_mm512_or_si512(_mm512_and_si512(_mm512_srli_epi32(col, 16), ff), _mm512_and_si512(col, _mm512_set1_epi32(0xff00))),
+                                     _mm512_slli_epi32(_mm512_and_si512(col, ff), 16));
+        __m512i px = _mm512_or_si512(_mm512_and_si512(sw, cmask), alpha);
+
+        _mm512_mask_storeu_epi32(pixels + i * 4, lm, px);
+        _mm512_mask_storeu_epi32(emission + i * 4, lm, emit);
+        _mm512_mask_storeu_epi32(fire + i * 4, _mm512_mask_test_epi32_mask(lm, flags, _mm512_set1_epi32(FLAG_FIRE | FLAG_AIR)), px);
+
+        result.fire |= (u64)_mm512_mask_test_epi32_mask(lm, flags, _mm512_set1_epi32(FLAG_FIRE)) << g;
+        result.soup |= (u64)_mm512_mask_test_epi32_mask(lm, flags, _mm512_set1_epi32(FLAG_SOUP)) << g;
+    }
+    return result;
+}
+#elif defined(ME_SIMD_NEON)
+Result convert_neon(const pixel_luts &t, const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) {
+    Result result{0, 0};
+    const u16 *ids = cells.mat_id_data();
+    const u32 *colors = cells.color_data();
+    constexpr u32 LANE_MASK = 0xf;
+
+    for (int g = 0; g < 64; g += 4) {
+        u32 m = (u32)(mask >> g) & LANE_MASK;
+        if (!m) continue;
+        if (convert_tail(t, cells, base, g, m, 4, pixels, emission, fire, result)) continue;
+        size_t i = base + g;
+        size_t p = cells.physical(i);
+
+        alignas(16) u32 cmask[4], alpha[4], emit[4], fireSel[4];
+        bool anyFire = gather4(t, ids + p, m, g, cmask, alpha, emit, fireSel, result);
+
+        const uint32x4_t bits = {1, 2, 4, 8};
+        uint32x4_t lm = vtstq_u32(vdupq_n_u32(m), bits);
+
+        uint32x4_t col = vld1q_u32(colors + p);
+        const uint32x4_t ff = vdupq_n_u32(0xff);
+        uint32x4_t sw = vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(col, 16), ff), vandq_u32(col, vdupq_n_u32(0xff00))), vshlq_n_u32(vandq_u32(col, ff), 16));
+        uint32x4_t px = vorrq_u32(vandq_u32(sw, vld1q_u32(cmask)), vld1q_u32(alpha));
+        uint32x4_t em = vld1q_u32(emit);
+
+        u32 *dst = (u32 *)(pixels + i * 4);
+        u32 *dstEmit = (u32 *)(emission + i * 4);
+        u32 *dstFire = (u32 *)(fire + i * 4);
+        if (m == LANE_MASK) {
+            vst1q_u32(dst, px);
+            vst1q_u32(dstEmit, em);
+        } else {
+            vst1q_u32(dst, vbslq_u32(lm, px, vld1q_u32(dst)));
+            vst1q_u32(dstEmit, vbslq_u32(lm, em, vld1q_u32(dstEmit)));
+        }
+        uint32x4_t fs = vld1q_u32(fireSel);
+        if (anyFire) vst1q_u32(dstFire, vbslq_u32(fs, px, vld1q_u32(dstFire)));
+    }
+    return result;
+}
+#endif
+
+convert_fn select_convert(simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86)
+        case simd_level::avx512:
+            return convert_avx512;
+        case simd_level::avx2:
+            return convert_avx2;
+        case simd_level::sse2:
+            return convert_sse2;
+#elif defined(ME_SIMD_NEON)
+        case simd_level::neon:
+            return convert_neon;
+#endif
+        default:
+            return convert_scalar;
+    }
+}
+
+simd_kernel<convert_fn> Convert{select_convert};
+
+}  // namespace
+
+CellPixelConverter::Result CellPixelConverter::convert(const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) const {
+    if (!mask) return Result{0, 0};
+    const pixel_luts t{lutColorMask.data(), lutAlpha.data(), lutEmission.data(), lutFlags.data()};
+    return Convert.get()(t, cells, base, mask, pixels, emission, fire);
+}
+
+}  // namespace ME
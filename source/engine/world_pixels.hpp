@@ -0,0 +1,60 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_PIXELS_HPP
+#define ME_WORLD_PIXELS_HPP
+
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "world_cells.hpp"
+
+namespace ME {
+
+// 世界像素到纹理像素 (字节序 r g b a) 的转换
+// 按材料id查表取得 alpha/发光色/标记 一次转换 16 (AVX-512) 8 (AVX2) 或 4 (SSE2/NEON) 个像素 指令集运行时选择
+// 只写回 mask 中标记的像素
+class CellPixelConverter {
+public:
+    static constexpr u8 FLAG_AIR = 0x1;
+    static constexpr u8 FLAG_FIRE = 0x2;
+    static constexpr u8 FLAG_SOUP = 0x4;
+
+    struct Result {
+        u64 fire;  // mask 中 FIRE 像素的位
+        u64 soup;  // mask 中 SOUP 像素的位
+    };
+
+    // 材料数量变化时重建查找表 只能在没有转换任务运行时调用
+    void update_materials();
+
+    // 转换 base 开始的 64 个像素中 mask 标记的部分 base 必须是 64 的倍数
+    // base 是逻辑下标 输出缓冲按逻辑下标写入
+    // pixels/emission 总是写入 fire 只写入 FIRE 和 AIR 像素
+    Result convert(const CellStore &cells, size_t base, u64 mask, u8 *pixels, u8 *emission, u8 *fire) const;
+
+    // 打包模式: 每个像素只写 r g b + 材料下标 (u8) 颜色和发光色由 WorldPixelsShader 按材料属性纹理推出
+    // 材料超过 PACKED_MAX_MATERIALS 种时不能使用
+    static constexpr size_t PACKED_MAX_MATERIALS = 256;
+    bool packed_supported() const { return !lutFlags.empty() && lutFlags.size() <= PACKED_MAX_MATERIALS; }
+
+    // 与 convert 相同 但输出打包像素 fire 仍然在 CPU 上写入
+    Result convert_packed(const CellStore &cells, size_t base, u64 mask, u8 *packed, u8 *fire) const;
+
+    // 材料属性纹理 (materials x 2, 字节序 r g b a) 第 0 行为 (颜色掩码, alpha) 第 1 行为发光色
+    // version 在查找表重建时增加 用于判断是否需要重新上传
+    void material_props(std::vector<u8> &out) const;
+    u32 version() const { return lutVersion; }
+
+    u8 flags(mat_id id) const { return lutFlags[id]; }
+
+private:
+    std::vector<u32> lutColorMask;  // AIR 为 0 其他为 0x00ffffff
+    std::vector<u32> lutAlpha;      // alpha << 24
+    std::vector<u32> lutEmission;   // 已经转换为纹理字节序的发光色
+    std::vector<u32> lutFlags;      // FLAG_* 使用 u32 方便 gather
+    u32 lutVersion = 0;
+};
+
+}  // namespace ME
+
+#endif
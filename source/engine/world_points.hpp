@@ -0,0 +1,211 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_POINTS_HPP
+#define ME_WORLD_POINTS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "engine/core/mathlib.hpp"
+#include "engine/game_utils/rng.h"
+
+namespace ME {
+
+// 单位正方形上的 Poisson-disk 分布点 (Bridson 算法) 世界按单位正方形平铺使用
+// 采样时按环面计算距离 平铺后相邻两块之间的点也保持最小距离
+// 点存在边长不超过 minDist / sqrt(2) 的均匀网格里 每格最多一个点 查询只看附近的格子
+class DistributedPoints {
+public:
+    void generate(f32 minDist, u64 seed, int attempts = 30) {
+        clear();
+        if (minDist <= 0) return;
+
+        n = std::max(1, (int)std::ceil(std::sqrt(2.0f) / minDist));
+        cell = 1.0f / n;
+        grid.assign((size_t)n * n, -1);
+
+        const int reach = (int)std::ceil(minDist / cell);
+        const f32 r2 = minDist * minDist;
+        FastRNG rng(seed);
+        auto uniform = [&rng]() { return rng.next() / 2147483648.0f; };
+
+        auto fits = [&](f32 x, f32 y) {
+            const int cx = cellOf(x), cy = cellOf(y);
+            for (int oy = -reach; oy <= reach; oy++) {
+                for (int ox = -reach; ox <= reach; ox++) {
+                    const int i = grid[wrap(cx + ox) + wrap(cy + oy) * n];
+                    if (i < 0) continue;
+                    f32 dx = std::abs(pts[i].x - x), dy = std::abs(pts[i].y - y);
+                    dx = std::min(dx, 1 - dx);
+                    dy = std::min(dy, 1 - dy);
+                    if (dx * dx + dy * dy < r2) return false;
+                }
+            }
+            return true;
+        };
+        auto insert = [&](f32 x, f32 y) {
+            grid[cellOf(x) + cellOf(y) * n] = (int)pts.size();
+            pts.emplace_back(x, y);
+        };
+
+        std::vector<int> active;
+        insert(uniform(), uniform());
+        active.push_back(0);
+        while (!active.empty()) {
+            const size_t a = rng.next() % active.size();
+            const MEvec2 p = pts[active[a]];
+            bool placed = false;
+            for (int k = 0; k < attempts && !placed; k++) {
+                // 在 [minDist, 2 * minDist] 的圆环内取候选点
+                const f32 angle = uniform() * 6.2831853f;
+                const f32 radius = minDist * (1 + uniform());
+                f32 x = p.x + std::cos(angle) * radius;
+                f32 y = p.y + std::sin(angle) * radius;
+                x -= std::floor(x);
+                y -= std::floor(y);
+                if (x >= 1) x = 0;
+                if (y >= 1) y = 0;
+                if (fits(x, y)) {
+                    active.push_back((int)pts.size());
+                    insert(x, y);
+                    placed = true;
+                }
+            }
+            if (!placed) {
+                active[a] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+
+    void clear() {
+        pts.clear();
+        grid.clear();
+        n = 0;
+    }
+
+    const std::vector<MEvec2> &points() const { return pts; }
+    size_t size() const { return pts.size(); }
+
+    // 单位正方形内 (不跨越边界) 离 (x, y) 最近的点 没有点时返回 false
+    bool nearest(f32 x, f32 y, MEvec2 &out) const {
+        if (pts.empty()) return false;
+
+        const int cx = std::clamp(cellOf(x), 0, n - 1), cy = std::clamp(cellOf(y), 0, n - 1);
+        f32 best = -1;
+        for (int ring = 0; ring < n; ring++) {
+            // 第 ring 圈的格子离 (x, y) 至少 (ring - 1) * cell 已经找到更近的点时停止
+            if (best >= 0 && ring > 1 && best < ((ring - 1) * cell) * ((ring - 1) * cell)) break;
+            for (int oy = -ring; oy <= ring; oy++) {
+                for (int ox = -ring; ox <= ring; ox++) {
+                    if (std::max(std::abs(ox), std::abs(oy)) != ring) continue;
+                    const int gx = cx + ox, gy = cy + oy;
+                    if (gx < 0 || gy < 0 || gx >= n || gy >= n) continue;
+                    const int i = grid[gx + gy * n];
+                    if (i < 0) continue;
+                    const f32 dx = pts[i].x - x, dy = pts[i].y - y;
+                    const f32 d = dx * dx + dy * dy;
+                    if (best < 0 || d < best) {
+                        best = d;
+                        out = pts[i];
+                    }
+                }
+            }
+        }
+        return best >= 0;
+    }
+
+    // 落在开区间 (x0, x1) x (y0, y1) 内的点 超出单位正方形的部分没有点
+    template <typename F>
+    void forEachIn(f32 x0, f32 y0, f32 x1, f32 y1, F &&f) const {
+        if (pts.empty() || x1 <= 0 || y1 <= 0 || x0 >= 1 || y0 >= 1) return;
+        const int gx0 = std::clamp(cellOf(x0), 0, n - 1), gx1 = std::clamp(cellOf(x1), 0, n - 1);
+        const int gy0 = std::clamp(cellOf(y0), 0, n - 1), gy1 = std::clamp(cellOf(y1), 0, n - 1);
+        for (int gy = gy0; gy <= gy1; gy++) {
+            for (int gx = gx0; gx <= gx1; gx++) {
+                const int i = grid[gx + gy * n];
+                if (i >= 0 && pts[i].x > x0 && pts[i].y > y0 && pts[i].x < x1 && pts[i].y < y1) f(pts[i]);
+            }
+        }
+    }
+
+private:
+    int cellOf(f32 v) const { return (int)std::floor(v / cell); }
+    int wrap(int c) const { return ((c % n) + n) % n; }
+
+    std::vector<MEvec2> pts;
+    std::vector<int> grid;
+    int n = 0;
+    f32 cell = 1;
+};
+
+// 已放置结构的范围 按原点所在的区块分桶 只保存包围盒 不复制结构的像素
+// 区块卸载时丢掉对应的桶 大小随已加载的区块而不是整个会话增长
+class StructureIndex {
+public:
+    struct Record {
+        int x, y, w, h;
+    };
+
+    void add(int x, int y, int w, int h) {
+        buckets[key(floorDiv(x, CHUNK_W), floorDiv(y, CHUNK_H))].push_back({x, y, w, h});
+        maxW = std::max(maxW, w);
+        maxH = std::max(maxH, h);
+        count++;
+    }
+
+    // 与 [x, x + w) x [y, y + h) 相交的结构
+    template <typename F>
+    void forEachWithin(int x, int y, int w, int h, F &&f) const {
+        if (count == 0) return;
+        const int cx0 = floorDiv(x - maxW, CHUNK_W), cx1 = floorDiv(x + w - 1, CHUNK_W);
+        const int cy0 = floorDiv(y - maxH, CHUNK_H), cy1 = floorDiv(y + h - 1, CHUNK_H);
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                auto it = buckets.find(key(cx, cy));
+                if (it == buckets.end()) continue;
+                for (const Record &r : it->second) {
+                    if (r.x < x + w && r.x + r.w > x && r.y < y + h && r.y + r.h > y) f(r);
+                }
+            }
+        }
+    }
+
+    // 起点在区块 (cx, cy) 的结构 没有时为 nullptr
+    const std::vector<Record> *chunk(int cx, int cy) const {
+        auto it = buckets.find(key(cx, cy));
+        return it == buckets.end() ? nullptr : &it->second;
+    }
+
+    void dropChunk(int cx, int cy) {
+        auto it = buckets.find(key(cx, cy));
+        if (it == buckets.end()) return;
+        count -= it->second.size();
+        buckets.erase(it);
+    }
+
+    size_t size() const { return count; }
+
+    void clear() {
+        buckets.clear();
+        count = 0;
+        maxW = maxH = 0;
+    }
+
+private:
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+    static int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+    std::unordered_map<u64, std::vector<Record>> buckets;
+    size_t count = 0;
+    int maxW = 0, maxH = 0;
+};
+
+}  // namespace ME
+
+#endif
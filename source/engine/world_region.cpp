@@ -0,0 +1,443 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_region.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include "engine/core/profiler.hpp"
+#include "engine/utils/utility.hpp"
+
+namespace ME {
+
+void RegionStore::open(const std::string &directory) {
+    close();
+    this->directory = directory;
+    std::filesystem::create_directories(directory);
+    opened = true;
+}
+
+bool RegionStore::open_archive(const std::string &archivePath) {
+    close();
+    ME_pack_result result = ME_create_file_pack_reader(archivePath.c_str(), 0, false, &archive);
+    if (result != SUCCESS_PACK_RESULT) {
+        METADOT_ERROR(std::format("Failed to open world archive {0}: {1}", archivePath, pack_result_to_string(result)).c_str());
+        archive = nullptr;
+        return false;
+    }
+    // 包中的路径相对世界目录
+    this->directory = "regions";
+    opened = true;
+    return true;
+}
+
+void RegionStore::close() {
+    if (!opened) return;
+    flush();
+
+    std::lock_guard<std::mutex> guard(lock);
+    regions.clear();
+    cache.clear();
+    cacheOrder.clear();
+    cacheBytes = 0;
+    opened = false;
+    // 区域借用了包的映射 先释放区域
+    if (archive) {
+        ME_destroy_pack_reader(archive);
+        archive = nullptr;
+    }
+}
+
+void RegionStore::flush() { job::wait(writer); }
+
+bool RegionStore::contains(int cx, int cy) {
+    if (!opened) return false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (pending.count(key(cx, cy)) || cache.count(key(cx, cy))) return true;
+    }
+
+    std::shared_ptr<Region> r = region(cx, cy, false);
+    if (r) {
+        std::shared_lock<std::shared_mutex> guard(r->lock);
+        if (r->table[slot(cx, cy)][0] != 0) return true;
+    }
+    View legacy;
+    return archive && archive_chunk(cx, cy, legacy);
+}
+
+bool RegionStore::view(int cx, int cy, View &out) {
+    out = View{};
+    if (!opened) return false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = pending.find(key(cx, cy));
+        if (it != pending.end()) {
+            out.payload = it->second;
+            out.ptr = out.payload->data();
+            out.len = out.payload->size();
+            return true;
+        }
+        auto ct = cache.find(key(cx, cy));
+        if (ct != cache.end()) {
+            cacheOrder.splice(cacheOrder.begin(), cacheOrder, ct->second.order);
+            out.payload = ct->second.payload;
+            out.ptr = out.payload->data();
+            out.len = out.payload->size();
+            ME_profiler_count("chunk cache hits", 1);
+            return true;
+        }
+    }
+
+    std::shared_ptr<Region> r = region(cx, cy, false);
+    if (!r) return archive && archive_chunk(cx, cy, out);
+
+    std::shared_lock<std::shared_mutex> guard(r->lock);
+    const u32 *entry = r->table[slot(cx, cy)];
+    if (entry[0] == 0) {
+        guard.unlock();
+        return archive && archive_chunk(cx, cy, out);
+    }
+
+    // 文件在上次映射之后变长了 独占地重新映射 包中的区域不会变长 archive_region 已检查过偏移表
+    size_t end = (size_t)entry[0] * SECTOR_SIZE + entry[1];
+    if (end > r->map.size && !r->borrowed) {
+        guard.unlock();
+        {
+            std::unique_lock<std::shared_mutex> remap(r->lock);
+            if (end > r->map.size) {
+                ME_fs_unmap_file(r->map);
+                if (!ME_fs_map_file(r->path.c_str(), r->map)) METADOT_ERROR(std::format("Failed to map region file {0}", r->path).c_str());
+            }
+        }
+        guard.lock();
+
+        entry = r->table[slot(cx, cy)];
+        if (entry[0] == 0) return false;
+        end = (size_t)entry[0] * SECTOR_SIZE + entry[1];
+        if (end > r->map.size) {
+            METADOT_ERROR(std::format("Region slot of chunk {0},{1} is truncated", cx, cy).c_str());
+            return false;
+        }
+    }
+
+    out.ptr = r->map.data + (size_t)entry[0] * SECTOR_SIZE;
+    out.len = entry[1];
+    out.region = std::move(r);
+    out.guard = std::move(guard);
+    return true;
+}
+
+bool RegionStore::read(int cx, int cy, std::vector<char> &out) {
+    View v;
+    if (!view(cx, cy, v)) return false;
+    out.assign(v.data(), v.data() + v.size());
+    return true;
+}
+
+void RegionStore::write(int cx, int cy, std::vector<char> payload) {
+    if (!opened || archive) return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    // 同一区块尚未写盘的旧数据直接被替换
+    Payload data = std::make_shared<const std::vector<char>>(std::move(payload));
+    pending[key(cx, cy)] = data;
+    // 缓存中的旧数据同时换成新的
+    if (cache.count(key(cx, cy))) cache_put(key(cx, cy), data);
+    if (!writerRunning) {
+        writerRunning = true;
+        job::execute_background(writer, [this]() { run_writer(); }, job_class::save);
+    }
+}
+
+void RegionStore::retain(int cx, int cy) {
+    if (!opened) return;
+    const u64 k = key(cx, cy);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (cacheBudget == 0) return;
+        // 刚写入的数据直接共用待写表中的那份
+        auto it = pending.find(k);
+        if (it != pending.end()) {
+            cache_put(k, it->second);
+            return;
+        }
+        auto ct = cache.find(k);
+        if (ct != cache.end()) {
+            cacheOrder.splice(cacheOrder.begin(), cacheOrder, ct->second.order);
+            return;
+        }
+    }
+
+    // 没有改过的区块不会重写 从文件的映射复制一份
+    View v;
+    if (!view(cx, cy, v)) return;
+    Payload data = std::make_shared<const std::vector<char>>(v.data(), v.data() + v.size());
+    v = View{};
+
+    std::lock_guard<std::mutex> guard(lock);
+    // 复制期间写入的更新的数据优先
+    if (!pending.count(k)) cache_put(k, std::move(data));
+}
+
+void RegionStore::set_cache_budget(size_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    cacheBudget = bytes;
+    cache_trim();
+}
+
+size_t RegionStore::cache_bytes() {
+    std::lock_guard<std::mutex> guard(lock);
+    return cacheBytes;
+}
+
+void RegionStore::cache_put(u64 k, Payload data) {
+    auto it = cache.find(k);
+    if (it != cache.end()) {
+        cacheBytes -= it->second.payload->size();
+        it->second.payload = std::move(data);
+        cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second.order);
+    } else {
+        cacheOrder.push_front(k);
+        it = cache.emplace(k, Cached{std::move(data), cacheOrder.begin()}).first;
+    }
+    cacheBytes += it->second.payload->size();
+    cache_trim();
+}
+
+void RegionStore::cache_trim() {
+    while (cacheBytes > cacheBudget && !cacheOrder.empty()) {
+        auto it = cache.find(cacheOrder.back());
+        cacheBytes -= it->second.payload->size();
+        cache.erase(it);
+        cacheOrder.pop_back();
+    }
+}
+
+void RegionStore::run_writer() {
+    while (true) {
+        // 一次取走当前所有待写数据 同一区域的区块一起提交
+        std::map<u64, Payload> batch;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (pending.empty()) {
+                writerRunning = false;
+                return;
+            }
+            batch = pending;
+        }
+
+        std::map<u64, std::vector<std::pair<int, Payload>>> byRegion;
+        for (auto &[k, data] : batch) {
+            int cx = (int)(u32)(k >> 32), cy = (int)(u32)k;
+            byRegion[key(cx >> REGION_SHIFT, cy >> REGION_SHIFT)].emplace_back(slot(cx, cy), data);
+        }
+        for (auto &[rk, writes] : byRegion) {
+            int rx = (int)(u32)(rk >> 32), ry = (int)(u32)rk;
+            std::shared_ptr<Region> r = region(rx << REGION_SHIFT, ry << REGION_SHIFT, true);
+            bool ok = false;
+            if (r) {
+                std::unique_lock<std::shared_mutex> guard(r->lock);
+                ok = commit(*r, writes);
+            }
+            if (!ok) METADOT_ERROR(std::format("Failed to write {0} chunks to region {1},{2}", writes.size(), rx, ry).c_str());
+        }
+
+        // 写盘期间数据一直留在待写表里 读取不会读到旧槽位
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &[k, data] : batch) {
+            auto it = pending.find(k);
+            if (it != pending.end() && it->second == data) pending.erase(it);
+        }
+    }
+}
+
+std::shared_ptr<RegionStore::Region> RegionStore::region(int cx, int cy, bool create) {
+    const int rx = cx >> REGION_SHIFT, ry = cy >> REGION_SHIFT;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = regions.find(key(rx, ry));
+    if (it != regions.end()) {
+        it->second->lastUse = ++useCounter;
+        return it->second;
+    }
+
+    std::shared_ptr<Region> r;
+    if (archive) {
+        if (create) return nullptr;
+        r = archive_region(rx, ry);
+        if (!r) return nullptr;
+    } else {
+        r = file_region(rx, ry, create);
+        if (!r) return nullptr;
+    }
+
+    // 打开的文件过多时关闭最久未用且没有被使用的区域
+    if (regions.size() >= MAX_OPEN_REGIONS) {
+        auto victim = regions.end();
+        for (auto i = regions.begin(); i != regions.end(); i++) {
+            if (i->second.use_count() == 1 && (victim == regions.end() || i->second->lastUse < victim->second->lastUse)) victim = i;
+        }
+        if (victim != regions.end()) regions.erase(victim);
+    }
+
+    r->lastUse = ++useCounter;
+    regions[key(rx, ry)] = r;
+    return r;
+}
+
+std::shared_ptr<RegionStore::Region> RegionStore::file_region(int rx, int ry, bool create) {
+    std::string path = directory + "/r_" + std::to_string(rx) + "_" + std::to_string(ry) + ".region";
+    bool exists = std::filesystem::exists(path);
+    if (!exists && !create) return nullptr;
+
+    auto r = std::make_shared<Region>();
+    r->path = path;
+    if (!exists) {
+        std::ofstream init(path, std::ios::binary | std::ios::trunc);
+        std::vector<char> header(HEADER_SECTORS * SECTOR_SIZE, 0);
+        init.write(header.data(), header.size());
+        if (!init) return nullptr;
+    }
+
+    r->file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!r->file.is_open()) return nullptr;
+
+    r->file.read((char *)r->table, sizeof(r->table));
+    if ((size_t)r->file.gcount() != sizeof(r->table)) {
+        METADOT_ERROR(std::format("Region file {0} has a broken header", path).c_str());
+        return nullptr;
+    }
+
+    // 偏移表指向文件之外的槽位 (追加数据时中断) 当作没有存档 区块会重新生成
+    std::error_code ec;
+    const u64 fileSize = std::filesystem::file_size(path, ec);
+    r->used.assign(HEADER_SECTORS, true);
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        u32 start = r->table[s][0];
+        if (start == 0) continue;
+        if (start < HEADER_SECTORS || ec || (u64)start * SECTOR_SIZE + r->table[s][1] > fileSize) {
+            METADOT_ERROR(std::format("Region file {0} slot {1} points outside of the file", path, s).c_str());
+            r->table[s][0] = r->table[s][1] = 0;
+            continue;
+        }
+        u32 end = start + std::max(1u, (r->table[s][1] + SECTOR_SIZE - 1) / SECTOR_SIZE);
+        if (r->used.size() < end) r->used.resize(end, false);
+        std::fill(r->used.begin() + start, r->used.begin() + end, true);
+    }
+    return r;
+}
+
+std::shared_ptr<RegionStore::Region> RegionStore::archive_region(int rx, int ry) {
+    const std::string path = directory + "/r_" + std::to_string(rx) + "_" + std::to_string(ry) + ".region";
+    u64 index;
+    if (!ME_get_pack_item_index(archive, path.c_str(), &index)) return nullptr;
+
+    auto r = std::make_shared<Region>();
+    r->path = path;
+    r->borrowed = true;
+
+    const u8 *data = nullptr;
+    u32 size = 0;
+    if (ME_get_pack_item_view(archive, index, &data, &size) == SUCCESS_PACK_RESULT) {
+        r->map.data = (const char *)data;
+        r->map.size = size;
+    } else {
+        r->unpacked.resize(ME_get_pack_item_data_size(archive, index));
+        if (ME_decompress_pack_item(archive, index, (u8 *)r->unpacked.data(), (u32)r->unpacked.size()) != SUCCESS_PACK_RESULT) {
+            METADOT_ERROR(std::format("Failed to unpack region {0} from the world archive", path).c_str());
+            return nullptr;
+        }
+        r->map.data = r->unpacked.data();
+        r->map.size = r->unpacked.size();
+    }
+
+    if (r->map.size < sizeof(r->table)) {
+        METADOT_ERROR(std::format("Region file {0} has a broken header", path).c_str());
+        return nullptr;
+    }
+    memcpy(r->table, r->map.data, sizeof(r->table));
+    for (int s = 0; s < SLOT_COUNT; s++) {
+        u32 start = r->table[s][0];
+        if (start != 0 && (start < HEADER_SECTORS || (u64)start * SECTOR_SIZE + r->table[s][1] > r->map.size)) {
+            METADOT_ERROR(std::format("Region file {0} slot {1} points outside of the file", path, s).c_str());
+            r->table[s][0] = r->table[s][1] = 0;
+        }
+    }
+    return r;
+}
+
+bool RegionStore::archive_chunk(int cx, int cy, View &out) {
+    const std::string path = "chunks/c_" + std::to_string(cx) + "_" + std::to_string(cy) + ".pack";
+    u64 index;
+    if (!ME_get_pack_item_index(archive, path.c_str(), &index)) return false;
+
+    const u8 *data = nullptr;
+    u32 size = 0;
+    if (ME_get_pack_item_view(archive, index, &data, &size) == SUCCESS_PACK_RESULT) {
+        out.ptr = (const char *)data;
+        out.len = size;
+        return true;
+    }
+
+    auto payload = std::make_shared<std::vector<char>>(ME_get_pack_item_data_size(archive, index));
+    if (ME_decompress_pack_item(archive, index, (u8 *)payload->data(), (u32)payload->size()) != SUCCESS_PACK_RESULT) return false;
+    out.payload = std::move(payload);
+    out.ptr = out.payload->data();
+    out.len = out.payload->size();
+    return true;
+}
+
+u32 RegionStore::allocate(Region &r, u32 sectors) {
+    // 首次适配 找不到时接在文件末尾 (包括末尾的空闲扇区)
+    u32 start = 0;
+    u32 run = 0;
+    for (u32 s = HEADER_SECTORS; s < r.used.size(); s++) {
+        run = r.used[s] ? 0 : run + 1;
+        if (run == sectors) {
+            start = s + 1 - sectors;
+            break;
+        }
+    }
+    if (!start) start = (u32)r.used.size() - run;
+    if (r.used.size() < start + sectors) r.used.resize(start + sectors, false);
+    std::fill(r.used.begin() + start, r.used.begin() + start + sectors, true);
+    return start;
+}
+
+bool RegionStore::commit(Region &r, const std::vector<std::pair<int, Payload>> &writes) {
+    // 新数据总是写进空闲扇区 不覆盖偏移表仍然指向的旧数据
+    // 数据落盘之后才更新偏移表 最后释放旧扇区 写到一半退出时每个槽位要么是旧数据要么是新数据
+    std::vector<std::pair<u32, u32>> placed(writes.size());
+    for (size_t i = 0; i < writes.size(); i++) {
+        const std::vector<char> &data = *writes[i].second;
+        const u32 start = allocate(r, std::max(1u, (u32)((data.size() + SECTOR_SIZE - 1) / SECTOR_SIZE)));
+        r.file.clear();
+        r.file.seekp((std::streamoff)start * SECTOR_SIZE);
+        r.file.write(data.data(), data.size());
+        placed[i] = {start, (u32)data.size()};
+    }
+    r.file.flush();
+    if (!r.file) {
+        // 偏移表没动 分配的扇区还给空闲表
+        for (auto [start, size] : placed) std::fill(r.used.begin() + start, r.used.begin() + start + std::max(1u, (size + SECTOR_SIZE - 1) / SECTOR_SIZE), false);
+        return false;
+    }
+
+    std::vector<std::pair<u32, u32>> freed;
+    for (size_t i = 0; i < writes.size(); i++) {
+        u32 *entry = r.table[writes[i].first];
+        if (entry[0]) freed.emplace_back(entry[0], std::max(1u, (entry[1] + SECTOR_SIZE - 1) / SECTOR_SIZE));
+        entry[0] = placed[i].first;
+        entry[1] = placed[i].second;
+        r.file.seekp((std::streamoff)writes[i].first * sizeof(r.table[0]));
+        r.file.write((const char *)entry, sizeof(r.table[0]));
+    }
+    r.file.flush();
+
+    for (auto [start, count] : freed) std::fill(r.used.begin() + start, r.used.begin() + start + count, false);
+    return (bool)r.file;
+}
+
+}  // namespace ME
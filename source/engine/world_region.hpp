@@ -0,0 +1,146 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_REGION_HPP
+#define ME_WORLD_REGION_HPP
+
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "engine/core/core.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/core/io/packer.hpp"
+#include "engine/core/job.h"
+
+namespace ME {
+
+// 区域文件 把 REGION_CHUNKS x REGION_CHUNKS 个区块存进同一个 regions/r_<rx>_<ry>.region
+// 文件开头是 SLOT_COUNT 项的偏移表 {起始扇区, 字节数} 之后按 SECTOR_SIZE 分配扇区
+// 每个槽位中的数据与原先单个 c_<x>_<y>.pack 文件的内容完全相同
+// 写入先进入待写表 由后台任务成批写盘 读取时优先返回待写表中的数据
+// 新数据写进空闲扇区 落盘之后再改偏移表 中途退出不会损坏已有的区块 区块数据本身带校验和 (ChunkCodec)
+// 读取直接使用文件的内存映射 不经过中间缓冲
+// open_archive 从 WorldArchive 导出的包中只读地读取 (区域文件和旧版的单区块文件都在包里) 写入被忽略
+// retain 把卸载的区块数据 (ChunkCodec 编码 已经是 LZ4 压缩的) 按 LRU 留在内存里 不超过 set_cache_budget 的字节数
+// 读取依次查待写表 内存中的缓存 文件 在卸载边界来回走动时重新加载只需要解码 不读文件
+class RegionStore {
+    struct Region;
+    using Payload = std::shared_ptr<const std::vector<char>>;
+
+public:
+    // 一个区块数据的只读视图 持有期间数据保持有效 (同时阻止该区域写盘)
+    class View {
+    public:
+        const char *data() const { return ptr; }
+        size_t size() const { return len; }
+
+    private:
+        friend class RegionStore;
+
+        const char *ptr = nullptr;
+        size_t len = 0;
+        Payload payload;
+        std::shared_ptr<Region> region;
+        std::shared_lock<std::shared_mutex> guard;
+    };
+
+    static constexpr int REGION_SHIFT = 5;
+    static constexpr int REGION_CHUNKS = 1 << REGION_SHIFT;
+    static constexpr int SLOT_COUNT = REGION_CHUNKS * REGION_CHUNKS;
+    static constexpr u32 SECTOR_SIZE = 4096;
+    static constexpr u32 HEADER_SECTORS = (SLOT_COUNT * 2 * sizeof(u32) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    static constexpr size_t MAX_OPEN_REGIONS = 32;
+
+    RegionStore() = default;
+    ~RegionStore() { close(); }
+
+    RegionStore(const RegionStore &) = delete;
+    RegionStore &operator=(const RegionStore &) = delete;
+
+    // 未打开时所有读写都被忽略
+    void open(const std::string &directory);
+    // 只读地打开世界存档包 包在关闭前一直映射 原样存储的区域文件直接使用映射 压缩的在第一次用到时解压
+    bool open_archive(const std::string &archivePath);
+    // 等待所有待写数据写盘并关闭文件
+    void close();
+    bool is_open() const { return opened; }
+    bool read_only() const { return archive != nullptr; }
+
+    bool contains(int cx, int cy);
+    bool view(int cx, int cy, View &out);
+    bool read(int cx, int cy, std::vector<char> &out);
+    void write(int cx, int cy, std::vector<char> payload);
+
+    // 区块卸载时调用 把它当前的数据留在缓存里 预算为 0 时不缓存
+    void retain(int cx, int cy);
+    // 超出预算的缓存立即丢弃
+    void set_cache_budget(size_t bytes);
+    size_t cache_bytes();
+
+    // 阻塞直到当前所有待写数据写盘
+    void flush();
+
+private:
+    struct Region {
+        ~Region() {
+            if (!borrowed) ME_fs_unmap_file(map);
+        }
+
+        std::shared_mutex lock;  // 读取共享 写入和重新映射独占
+        std::string path;
+        std::fstream file;
+        ME_fs_mapped_file map;
+        // 来自存档包 map 指向包的映射或 unpacked 不能解除映射也不会变长
+        bool borrowed = false;
+        std::vector<char> unpacked;
+        u32 table[SLOT_COUNT][2];  // {起始扇区, 字节数} 起始扇区为 0 表示空槽
+        std::vector<bool> used;    // 扇区占用
+        u64 lastUse = 0;
+    };
+
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+    static int slot(int cx, int cy) { return (cx & (REGION_CHUNKS - 1)) + (cy & (REGION_CHUNKS - 1)) * REGION_CHUNKS; }
+
+    std::shared_ptr<Region> region(int cx, int cy, bool create);
+    std::shared_ptr<Region> file_region(int rx, int ry, bool create);
+    std::shared_ptr<Region> archive_region(int rx, int ry);
+    // 包中旧版的单区块文件 chunks/c_<x>_<y>.pack
+    bool archive_chunk(int cx, int cy, View &out);
+    u32 allocate(Region &r, u32 sectors);
+    // 一个区域的一批写入 {槽位, 数据}
+    bool commit(Region &r, const std::vector<std::pair<int, Payload>> &writes);
+    void run_writer();
+    // 以下需要持有 lock
+    void cache_put(u64 k, Payload data);
+    void cache_trim();
+
+    std::string directory;
+    bool opened = false;
+    ME_pack_reader archive = nullptr;
+
+    std::mutex lock;
+    std::map<u64, std::shared_ptr<Region>> regions;
+    std::map<u64, Payload> pending;
+
+    struct Cached {
+        Payload payload;
+        std::list<u64>::iterator order;
+    };
+    // 最近卸载的区块 cacheOrder 头部是最近用过的
+    std::map<u64, Cached> cache;
+    std::list<u64> cacheOrder;
+    size_t cacheBytes = 0;
+    size_t cacheBudget = 0;
+    bool writerRunning = false;
+    u64 useCounter = 0;
+    job_counter writer;
+};
+
+}  // namespace ME
+
+#endif
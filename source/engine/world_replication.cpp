@@ -0,0 +1,287 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_replication.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "chunk_codec.hpp"
+#include "engine/core/profiler.hpp"
+#include "engine/utils/utility.hpp"
+#include "world.hpp"
+
+namespace ME {
+
+namespace {
+
+constexpr int N = CHUNK_W * CHUNK_H;
+constexpr int B = Layer2Bricks::BRICK;
+
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+// 区块完整落在世界缓冲内 返回缓冲中的左上角
+bool ChunkOrigin(const world &w, int cx, int cy, int &ax, int &ay) {
+    ax = cx * CHUNK_W + (int)w.loadZone.x;
+    ay = cy * CHUNK_H + (int)w.loadZone.y;
+    return ax >= 0 && ay >= 0 && ax + CHUNK_W <= w.width && ay + CHUNK_H <= w.height;
+}
+
+// 块 b 在区块内的左上角
+void BrickOrigin(int b, int &x, int &y) {
+    x = (b % Layer2Bricks::BRICKS_X) * B;
+    y = (b / Layer2Bricks::BRICKS_X) * B;
+}
+
+}  // namespace
+
+void EncodeChunkBricks(const world &w, int cx, int cy, u64 bricks, std::vector<char> &out) {
+    thread_local std::vector<MaterialInstance> tiles(N);
+    thread_local Layer2Bricks layer2;
+    thread_local std::vector<u32> background(N);
+    layer2.clear();
+
+    int ax, ay;
+    ChunkOrigin(w, cx, cy, ax, ay);
+    for (u64 m = bricks; m; m &= m - 1) {
+        int x, y;
+        BrickOrigin(std::countr_zero(m), x, y);
+        for (int r = 0; r < B; r++) {
+            const size_t i = (size_t)(ax + x) + (size_t)(ay + y + r) * w.width;
+            const int o = x + (y + r) * CHUNK_W;
+            for (int k = 0; k < B; k++) {
+                tiles[o + k] = w.real_tiles.get(i + k);
+                layer2.set(x + k, y + r, w.real_layer2.get(i + k));
+            }
+            w.background.read(i, background.data() + o, B);
+        }
+    }
+    ChunkCodec::encode_delta(bricks, tiles.data(), layer2, background.data(), out);
+}
+
+bool ApplyChunkBricks(world &w, int cx, int cy, const char *data, size_t size, u64 allow, u64 &bricks) {
+    bricks = 0;
+    int ax, ay;
+    if (w.real_tiles.empty() || !ChunkOrigin(w, cx, cy, ax, ay)) return false;
+
+    thread_local std::vector<MaterialInstance> tiles(N);
+    thread_local Layer2Bricks layer2;
+    thread_local std::vector<u32> background(N);
+    layer2.clear();
+
+    try {
+        if (!ChunkCodec::decode_delta(data, size, bricks, tiles.data(), layer2, background.data())) return false;
+    } catch (const std::runtime_error &e) {
+        METADOT_ERROR(std::format("{0} @ {1},{2}", e.what(), cx, cy).c_str());
+        return false;
+    }
+
+    const u64 written = bricks & allow;
+    for (u64 m = written; m; m &= m - 1) {
+        int x, y;
+        BrickOrigin(std::countr_zero(m), x, y);
+        for (int r = 0; r < B; r++) {
+            const size_t i = (size_t)(ax + x) + (size_t)(ay + y + r) * w.width;
+            const int o = x + (y + r) * CHUNK_W;
+            for (int k = 0; k < B; k++) {
+                w.real_tiles.set(i + k, tiles[o + k]);
+                w.real_layer2.set(i + k, layer2.get(x + k, y + r));
+            }
+            w.background.write(i, background.data() + o, B);
+        }
+        w.dirty.mark_rect(ax + x, ay + y, B, B);
+        w.layer2Dirty.mark_rect(ax + x, ay + y, B, B);
+    }
+    if (written) w.queueBackgroundRect(ax, ay, CHUNK_W, CHUNK_H);
+    return true;
+}
+
+void DirtyBricks::collect(const world &w) {
+    dirty.clear();
+    if (w.real_tiles.empty()) return;
+
+    const int rx = (w.width + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    const int ry = (w.height + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+    if (rx != regionsX || ry != regionsY) {
+        regionsX = rx;
+        regionsY = ry;
+        dirtyRegions = std::make_unique<bool[]>((size_t)rx * ry);
+    }
+    std::fill_n(dirtyRegions.get(), (size_t)rx * ry, false);
+    w.dirty.mark_regions(DIRTY_SHIFT, regionsX, dirtyRegions.get());
+    w.layer2Dirty.mark_regions(DIRTY_SHIFT, regionsX, dirtyRegions.get());
+
+    // loadZone 不一定与块对齐 一个脏区域最多落在四个块上
+    const int lx = (int)w.loadZone.x, ly = (int)w.loadZone.y;
+    for (int y = 0; y < ry; y++) {
+        for (int x = 0; x < rx; x++) {
+            if (!dirtyRegions[(size_t)x + (size_t)y * rx]) continue;
+            const int px0 = (x << DIRTY_SHIFT) - lx, py0 = (y << DIRTY_SHIFT) - ly;
+            for (int by = FloorDiv(py0, B); by <= FloorDiv(py0 + B - 1, B); by++) {
+                for (int bx = FloorDiv(px0, B); bx <= FloorDiv(px0 + B - 1, B); bx++) {
+                    const int cx = FloorDiv(bx, Layer2Bricks::BRICKS_X), cy = FloorDiv(by, Layer2Bricks::BRICKS_Y);
+                    const int b = (bx - cx * Layer2Bricks::BRICKS_X) + (by - cy * Layer2Bricks::BRICKS_Y) * Layer2Bricks::BRICKS_X;
+                    dirty[ChunkMap::key(cx, cy)] |= (u64)1 << b;
+                }
+            }
+        }
+    }
+    for (u64 k : w.backgroundUploads) dirty[k] = ~(u64)0;
+}
+
+u32 ReplicationServer::add_client(Send send, u32 budget) {
+    const u32 id = nextId++;
+    if (nextId == 0) nextId = 1;
+    clients.push_back({id, std::move(send), budget});
+    return id;
+}
+
+void ReplicationServer::remove_client(u32 id) {
+    std::erase_if(clients, [id](const client &c) { return c.id == id; });
+}
+
+ReplicationServer::client *ReplicationServer::find(u32 id) {
+    for (client &c : clients) {
+        if (c.id == id) return &c;
+    }
+    return nullptr;
+}
+
+void ReplicationServer::set_interest(u32 id, int cx, int cy, int radius) {
+    client *c = find(id);
+    if (!c) return;
+    c->cx = cx;
+    c->cy = cy;
+    c->radius = radius;
+}
+
+void ReplicationServer::set_budget(u32 id, u32 budget) {
+    if (client *c = find(id)) c->budget = budget;
+}
+
+void ReplicationServer::resync(u32 id, int cx, int cy) {
+    if (client *c = find(id)) c->chunks.erase(ChunkMap::key(cx, cy));
+}
+
+void ReplicationServer::clear() {
+    for (client &c : clients) {
+        c.chunks.clear();
+        c.credit = 0;
+    }
+    dirtyBricks.clear();
+    encoded.clear();
+}
+
+void ReplicationServer::invalidate(const world &w) {
+    if (clients.empty() || w.real_tiles.empty()) return;
+    dirtyBricks.collect(w);
+
+    // 没有发给客户端的区块不用记
+    for (client &c : clients) {
+        for (const auto &[k, bricks] : dirtyBricks.chunks()) {
+            auto it = c.chunks.find(k);
+            if (it != c.chunks.end()) it->second |= bricks;
+        }
+    }
+}
+
+const std::vector<char> &ReplicationServer::encode(const world &w, int cx, int cy, u64 bricks) {
+    auto [it, inserted] = encoded.try_emplace({ChunkMap::key(cx, cy), bricks});
+    if (inserted) EncodeChunkBricks(w, cx, cy, bricks, it->second);
+    return it->second;
+}
+
+void ReplicationServer::send(client &c, Message type, int cx, int cy, const std::vector<char> *payload) {
+    const i32 pos[2] = {cx, cy};
+    message.resize(HEADER_SIZE);
+    message[0] = (char)type;
+    memcpy(message.data() + 1, pos, sizeof(pos));
+    if (payload) message.insert(message.end(), payload->begin(), payload->end());
+
+    c.send(message.data(), message.size());
+    c.credit -= (i64)message.size();
+    sentBytes += message.size();
+}
+
+void ReplicationServer::update(world &w) {
+    if (clients.empty() || w.real_tiles.empty()) return;
+
+    ME_profiler_scope_auto("Replication");
+    const u64 before = sentBytes;
+    encoded.clear();
+
+    auto loaded = [&](int cx, int cy) {
+        int ax, ay;
+        return ChunkOrigin(w, cx, cy, ax, ay) && w.chunkCache.contains(cx, cy);
+    };
+
+    for (client &c : clients) {
+        if (c.radius < 0) continue;
+        c.credit = std::min(c.credit + (i64)c.budget, 2 * (i64)c.budget);
+
+        // 离开范围或者离开世界缓冲的区块不再跟踪
+        auto distance = [&](int cx, int cy) { return std::max(std::abs(cx - c.cx), std::abs(cy - c.cy)); };
+        dropped.clear();
+        for (const auto &[k, bricks] : c.chunks) {
+            const int cx = (int)(u32)(k >> 32), cy = (int)(u32)k;
+            if (distance(cx, cy) > c.radius + 1 || !loaded(cx, cy)) dropped.push_back(k);
+        }
+        for (u64 k : dropped) {
+            c.chunks.erase(k);
+            send(c, Message::Drop, (int)(u32)(k >> 32), (int)(u32)k, nullptr);
+        }
+
+        candidates.clear();
+        for (const auto &[k, bricks] : c.chunks) {
+            if (bricks) candidates.push_back({distance((int)(u32)(k >> 32), (int)(u32)k), k, bricks});
+        }
+        for (int cy = c.cy - c.radius; cy <= c.cy + c.radius; cy++) {
+            for (int cx = c.cx - c.radius; cx <= c.cx + c.radius; cx++) {
+                const u64 k = ChunkMap::key(cx, cy);
+                if (!c.chunks.contains(k) && loaded(cx, cy)) candidates.push_back({distance(cx, cy), k, ALL_BRICKS});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const candidate &a, const candidate &b) { return a.distance != b.distance ? a.distance < b.distance : a.key < b.key; });
+
+        // 额度为正就发送下一个 一条消息可以超出额度 欠下的从下一次扣除
+        for (const candidate &cand : candidates) {
+            if (c.credit <= 0) break;
+            const int cx = (int)(u32)(cand.key >> 32), cy = (int)(u32)cand.key;
+            send(c, Message::Chunk, cx, cy, &encode(w, cx, cy, cand.bricks));
+            c.chunks[cand.key] = 0;
+        }
+    }
+    ME_profiler_count("replication bytes", (u32)(sentBytes - before));
+}
+
+bool ReplicationClient::apply(world &w, const char *data, size_t size) {
+    if (size < ReplicationServer::HEADER_SIZE) {
+        METADOT_ERROR("Replication message is truncated");
+        return false;
+    }
+    const auto type = (ReplicationServer::Message)data[0];
+    i32 pos[2];
+    memcpy(pos, data + 1, sizeof(pos));
+    const u64 k = ChunkMap::key(pos[0], pos[1]);
+
+    if (type == ReplicationServer::Message::Drop) {
+        chunks.erase(k);
+        return true;
+    }
+    if (type != ReplicationServer::Message::Chunk) {
+        METADOT_ERROR(std::format("Unknown replication message {0}", (int)data[0]).c_str());
+        return false;
+    }
+
+    u64 bricks = 0;
+    if (!ApplyChunkBricks(w, pos[0], pos[1], data + ReplicationServer::HEADER_SIZE, size - ReplicationServer::HEADER_SIZE, ReplicationServer::ALL_BRICKS, bricks)) return false;
+    chunks.insert(k);
+    return true;
+}
+
+bool ReplicationClient::has(int cx, int cy) const { return chunks.contains(ChunkMap::key(cx, cy)); }
+
+}  // namespace ME
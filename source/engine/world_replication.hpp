@@ -0,0 +1,140 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_REPLICATION_HPP
+#define ME_WORLD_REPLICATION_HPP
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "engine/core/const.h"
+#include "engine/core/core.hpp"
+#include "layer2_bricks.hpp"
+#include "libs/parallel_hashmap/phmap.h"
+
+namespace ME {
+
+class world;
+
+// 从世界缓冲读出区块 (cx, cy) 中 bricks 的块用 ChunkCodec::encode_delta 编码 区块必须完整落在缓冲内
+void EncodeChunkBricks(const world &w, int cx, int cy, u64 bricks, std::vector<char> &out);
+// 解码 encode_delta 的数据 bricks 返回其中的块 只把 bricks & allow 写入世界缓冲 并标记 dirty layer2Dirty 和背景上传
+// 格式损坏时记录错误并返回 false 区块不在世界缓冲内时返回 false
+bool ApplyChunkBricks(world &w, int cx, int cy, const char *data, size_t size, u64 allow, u64 &bricks);
+
+// world::dirty 和 layer2Dirty 中被改写的 Layer2Bricks::BRICK 见方的块 按区块汇总 值的第 b 位为块 b
+// 背景的改动只有 world::backgroundUploads 记录的区块 按整块计
+// 在 dirty 清除前调用 collect 只访问脏区域的包围盒
+class DirtyBricks {
+public:
+    void collect(const world &w);
+    const phmap::flat_hash_map<u64, u64> &chunks() const { return dirty; }
+    bool empty() const { return dirty.empty(); }
+    void clear() { dirty.clear(); }
+
+private:
+    // DIRTY_SHIFT 见方的脏区域 在世界缓冲坐标上 与块一样大
+    static constexpr int DIRTY_SHIFT = 4;
+    static_assert(1 << DIRTY_SHIFT == Layer2Bricks::BRICK);
+    std::unique_ptr<bool[]> dirtyRegions;
+    int regionsX = 0, regionsY = 0;
+    phmap::flat_hash_map<u64, u64> dirty;
+};
+
+// 权威世界向客户端同步像素 world::replication
+// 只负责决定发什么和编码 传输由调用者提供 每个客户端一个 send 回调 要求可靠且有序
+// 客户端只收到兴趣范围内 (center 周围 radius 个区块的方形) 且完整落在世界缓冲内的区块 离开 radius + 1 后发 Drop 不再跟踪
+// 第一次发送整个区块 之后只发被改写的 Layer2Bricks::BRICK 见方的块 都用 ChunkCodec::encode_delta 编码
+// 按与中心的距离从近到远发送 每个客户端每次 update 增加 budget 字节的额度 最多累积两次 额度不够时留到下一次
+// invalidate 只访问脏区域 (见 DirtyBricks) 没有客户端时直接返回 静止的世界不产生任何数据
+// 所有函数都只能在主线程上调用
+class ReplicationServer {
+public:
+    // 每条消息以 Message 和区块坐标 (i32 x2) 开头 Chunk 之后是增量数据
+    enum class Message : u8 { Chunk, Drop };
+    static constexpr size_t HEADER_SIZE = sizeof(u8) + 2 * sizeof(i32);
+    static constexpr u64 ALL_BRICKS = ~(u64)0;
+    static_assert(Layer2Bricks::BRICK_COUNT == 64);
+
+    using Send = std::function<void(const char *data, size_t size)>;
+
+    ReplicationServer() = default;
+    ReplicationServer(const ReplicationServer &) = delete;
+    ReplicationServer &operator=(const ReplicationServer &) = delete;
+
+    // 返回的编号不为 0 设置兴趣范围之前不发送任何数据
+    u32 add_client(Send send, u32 budget);
+    void remove_client(u32 id);
+    // center 为区块坐标 一般取客户端玩家所在的区块
+    void set_interest(u32 id, int cx, int cy, int radius);
+    void set_budget(u32 id, u32 budget);
+    // 客户端没能应用某个区块时调用 下次整块重发
+    void resync(u32 id, int cx, int cy);
+
+    // 在 world::dirty 清除前调用 记下被改写的块
+    void invalidate(const world &w);
+    // 给每个客户端发送额度内的区块
+    void update(world &w);
+
+    // 新的世界 所有客户端都要重新接收
+    void clear();
+
+    size_t client_count() const { return clients.size(); }
+    u64 bytes_sent() const { return sentBytes; }
+
+private:
+    struct client {
+        u32 id;
+        Send send;
+        u32 budget;
+        i64 credit = 0;
+        int cx = 0, cy = 0, radius = -1;
+        // 已经发送的区块 值为之后被改写还没发送的块
+        phmap::flat_hash_map<u64, u64> chunks;
+    };
+
+    struct candidate {
+        int distance;
+        u64 key;
+        u64 bricks;
+    };
+
+    client *find(u32 id);
+    // 同一次 update 中相同的请求只编码一次
+    const std::vector<char> &encode(const world &w, int cx, int cy, u64 bricks);
+    void send(client &c, Message type, int cx, int cy, const std::vector<char> *payload);
+
+    std::vector<client> clients;
+    u32 nextId = 1;
+    u64 sentBytes = 0;
+
+    DirtyBricks dirtyBricks;
+
+    // update 的临时数据 保留容量
+    std::vector<candidate> candidates;
+    std::vector<u64> dropped;
+    phmap::flat_hash_map<std::pair<u64, u64>, std::vector<char>> encoded;
+    std::vector<char> message;
+};
+
+// 接收 ReplicationServer 的消息写入本地世界
+// 写入后标记 dirty layer2Dirty 和背景上传 与脚本的直接写入一样由原有的流程更新画面和唤醒区域
+class ReplicationClient {
+public:
+    // 格式损坏时记录错误并返回 false
+    // 区块不在本地的世界缓冲内时也返回 false 调用者应当请求服务器 resync 这个区块
+    bool apply(world &w, const char *data, size_t size);
+
+    // 收到 Chunk 之后 Drop 之前的区块
+    bool has(int cx, int cy) const;
+    size_t chunk_count() const { return chunks.size(); }
+    void clear() { chunks.clear(); }
+
+private:
+    phmap::flat_hash_set<u64> chunks;
+};
+
+}  // namespace ME
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#include "world_save.hpp"
+
+#include <filesystem>
+#include <format>
+
+#include "chunk_codec.hpp"
+#include "engine/core/io/filesystem.h"
+#include "engine/utils/utility.hpp"
+
+namespace ME {
+
+bool WorldSaver::begin(std::vector<Snapshot> &list, RegionStore *regions, std::function<void()> finish) {
+    if (busy()) return false;
+
+    this->regions = regions;
+    snapshots.swap(list);
+    list.clear();
+    count = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        inflight.clear();
+        for (const Snapshot &s : snapshots) inflight.insert(key(s.x, s.y));
+    }
+
+    for (size_t i = 0; i < snapshots.size(); i += CHUNKS_PER_JOB) {
+        const size_t end = std::min(i + CHUNKS_PER_JOB, snapshots.size());
+        job::execute_background(
+                chunks,
+                [this, i, end]() {
+                    for (size_t j = i; j < end; j++) encode(snapshots[j]);
+                },
+                job_class::save);
+    }
+
+    job::execute_after(
+            chunks, finished,
+            [this, finish = std::move(finish)]() {
+                // 区域文件的待写数据全部落盘之后再替换 world.json
+                if (this->regions && this->regions->is_open()) this->regions->flush();
+                lastWritten = count.load();
+                snapshots.clear();
+                if (finish) finish();
+            },
+            job_class::save);
+    return true;
+}
+
+bool WorldSaver::pending(int cx, int cy) {
+    std::lock_guard<std::mutex> guard(lock);
+    return inflight.count(key(cx, cy)) != 0;
+}
+
+std::unique_lock<std::mutex> WorldSaver::claim(int cx, int cy) {
+    std::unique_lock<std::mutex> guard(lock);
+    inflight.erase(key(cx, cy));
+    return guard;
+}
+
+void WorldSaver::encode(Snapshot &s) {
+    std::vector<char> payload;
+    bool ok = true;
+    try {
+        ChunkCodec::encode(s.generationPhase, s.tiles, s.layer2, s.background, s.biomes.size() == CHUNK_W * CHUNK_H ? s.biomes.data() : nullptr, payload, s.extras.data(), s.extras.size(),
+                           ChunkCodec::Compression::high);
+    } catch (const std::runtime_error &e) {
+        METADOT_ERROR(std::format("{0} @ {1},{2}", e.what(), s.x, s.y).c_str());
+        ok = false;
+    }
+    ChunkStoragePool::free_tiles(s.tiles);
+    ChunkStoragePool::free_background(s.background);
+    s.tiles = nullptr;
+    s.layer2.clear();
+    s.background = nullptr;
+    if (!ok) return;
+
+    // 检查和写入要在同一把锁里 否则可能覆盖主线程刚写的新数据
+    std::lock_guard<std::mutex> guard(lock);
+    if (!inflight.erase(key(s.x, s.y))) return;
+    if (regions && regions->is_open()) {
+        regions->write(s.x, s.y, std::move(payload));
+    } else {
+        // 旧版单区块文件 chunks 目录要在第一次写入时创建
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(s.pack_filename).parent_path(), ec);
+        if (!ME_fs_write_file_atomic(s.pack_filename, payload.data(), payload.size())) {
+            METADOT_ERROR(std::format("Failed to write chunk {0},{1} to {2}", s.x, s.y, s.pack_filename).c_str());
+            return;
+        }
+    }
+    count++;
+}
+
+}  // namespace ME
@@ -0,0 +1,80 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_SAVE_HPP
+#define ME_WORLD_SAVE_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "chunk.hpp"
+#include "engine/core/core.hpp"
+#include "engine/core/job.h"
+#include "world_region.hpp"
+
+namespace ME {
+
+// 后台存档 world::saveWorldAsync
+// 主线程只把需要保存的区块复制成快照 (缓冲区来自 ChunkStoragePool) 编码压缩和写盘都在后台任务上完成 游戏继续运行
+// 所有区块写盘之后才执行 finish (写 world.json) 中途退出时 world.json 仍是上一次完整存档的
+// 快照写出之前同一区块又被同步写盘 (unloadChunk) 时旧快照作废 见 claim
+class WorldSaver {
+public:
+    struct Snapshot {
+        int x = 0, y = 0;
+        i8 generationPhase = 0;
+        MaterialInstance *tiles = nullptr;
+        Layer2Bricks layer2;
+        u32 *background = nullptr;
+        std::vector<u8> biomes;
+        // ChunkExtras 编码后的结构和实体
+        std::vector<u8> extras;
+        std::string pack_filename;
+    };
+
+    // 每个后台任务编码的区块数
+    static constexpr size_t CHUNKS_PER_JOB = 8;
+
+    WorldSaver() = default;
+    ~WorldSaver() { wait(); }
+
+    WorldSaver(const WorldSaver &) = delete;
+    WorldSaver &operator=(const WorldSaver &) = delete;
+
+    // 接管快照的缓冲区 regions 没有打开时写旧版的单区块文件
+    // 上一次存档还没完成时返回 false 快照原样留给调用者
+    bool begin(std::vector<Snapshot> &snapshots, RegionStore *regions, std::function<void()> finish);
+
+    bool busy() const { return !finished.done(); }
+    // 阻塞直到当前存档完成
+    void wait() { job::wait(finished); }
+
+    // 该区块的快照还没写出 这时卸载区块要同步写盘 否则马上重新加载会读到旧数据
+    bool pending(int cx, int cy);
+    // 同步写盘同一区块期间持有返回的锁 后台还没写出的该区块快照不再写出
+    std::unique_lock<std::mutex> claim(int cx, int cy);
+
+    // 上一次存档写出的区块数
+    u32 written() const { return lastWritten; }
+
+private:
+    static u64 key(int cx, int cy) { return ((u64)(u32)cx << 32) | (u32)cy; }
+
+    void encode(Snapshot &s);
+
+    RegionStore *regions = nullptr;
+    std::vector<Snapshot> snapshots;
+    std::mutex lock;
+    std::set<u64> inflight;
+    std::atomic<u32> count{0};
+    u32 lastWritten = 0;
+    job_counter chunks;
+    job_counter finished;
+};
+
+}  // namespace ME
+
+#endif
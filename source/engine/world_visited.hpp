@@ -0,0 +1,68 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_WORLD_VISITED_HPP
+#define ME_WORLD_VISITED_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "engine/core/core.hpp"
+
+namespace ME {
+
+// world::tick 每个棋盘阶段的已访问标记
+// 每个像素存一个 u16 代数 等于当前代数表示这一阶段已经访问过
+// 进入下一阶段只需要代数加一 不用每个阶段清空整张表 代数绕回时才清零一次
+class VisitedMap {
+public:
+    // 对单个像素标记的代理引用 用法与 bool 相同
+    class Ref {
+    public:
+        Ref(u16 &stamp, u16 gen) : stamp(stamp), gen(gen) {}
+
+        operator bool() const { return stamp == gen; }
+        Ref &operator=(bool visited) {
+            stamp = visited ? gen : 0;
+            return *this;
+        }
+
+    private:
+        u16 &stamp;
+        u16 gen;
+    };
+
+    VisitedMap() = default;
+
+    VisitedMap(const VisitedMap &) = delete;
+    VisitedMap &operator=(const VisitedMap &) = delete;
+
+    void resize(size_t n) {
+        stamps.assign(n, 0);
+        gen = 1;
+    }
+
+    void release() {
+        stamps.clear();
+        stamps.shrink_to_fit();
+    }
+
+    // 开始新的阶段 之前的标记全部失效 只能在没有tick任务运行时调用
+    void next() {
+        if (++gen == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            gen = 1;
+        }
+    }
+
+    Ref operator[](size_t i) { return Ref(stamps[i], gen); }
+    bool operator[](size_t i) const { return stamps[i] == gen; }
+
+private:
+    std::vector<u16> stamps;
+    // 0 保留给未访问
+    u16 gen = 1;
+};
+
+}  // namespace ME
+
+#endif
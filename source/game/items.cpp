@@ -2,6 +2,8 @@
 
 #include "game/items.hpp"
 
+#include <algorithm>
+
 #include "game/player.hpp"
 
 namespace ME {
@@ -21,6 +23,8 @@ Item *Item::makeItem(ItemFlags flags, RigidBody *rb, std::string n) {
     }
 
     // i->surface = rb->get_surface();
+    // 进入图集的刚体没有单独的 image
+    if (!rb->image()) rb->updateImage({});
     i->image = rb->image();
     i->name = n;
 
@@ -35,6 +39,47 @@ void Item::deleteItem(Item *item) {
     }
 }
 
+void Item::updateImageRect(int x, int y, int w, int h) {
+    C_Surface *surface = texture->surface();
+    if (!image || image->w != surface->w || image->h != surface->h) {
+        if (image) R_FreeImage(image);
+        image = R_CopyImageFromSurface(surface);
+        R_SetImageFilter(image, R_FILTER_NEAREST);
+        return;
+    }
+
+    MErect rect = {(f32)x, (f32)y, (f32)w, (f32)h};
+    R_UpdateImage(image, &rect, surface, &rect);
+}
+
+void Item::markTexDirty(int x, int y, int w, int h) {
+    if (!texDirty) {
+        texDirtyX0 = x;
+        texDirtyY0 = y;
+        texDirtyX1 = x + w;
+        texDirtyY1 = y + h;
+        texDirty = true;
+        return;
+    }
+
+    texDirtyX0 = std::min(texDirtyX0, x);
+    texDirtyY0 = std::min(texDirtyY0, y);
+    texDirtyX1 = std::max(texDirtyX1, x + w);
+    texDirtyY1 = std::max(texDirtyY1, y + h);
+}
+
+R_Image *Item::syncImage() {
+    if (!texture || !texture->surface()) return image;
+
+    if (!image) {
+        updateImageRect(0, 0);
+    } else if (texDirty) {
+        updateImageRect(texDirtyX0, texDirtyY0, texDirtyX1 - texDirtyX0, texDirtyY1 - texDirtyY0);
+    }
+    texDirty = false;
+    return image;
+}
+
 u32 getpixel(C_Surface *surface, int x, int y) {
     int bpp = surface->format->BytesPerPixel;
 
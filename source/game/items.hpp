@@ -56,8 +56,6 @@ public:
     std::vector<U16Point> fill;
     u16 capacity = 0;
 
-    std::vector<CellData *> vacuumCells = {};
-
     Item(const Item &p) = default;
 
     Item();
@@ -67,6 +65,19 @@ public:
     static void deleteItem(Item *item);
 
     void loadFillTexture(C_Surface *tex);
+
+    // texture->surface() 中 (x, y, w, h) 被修改后写回 image 不重新分配
+    void updateImageRect(int x, int y, int w = 1, int h = 1);
+
+    // 记录 texture->surface() 中被修改的范围 一帧内的多次修改合并 在 syncImage 时一次写回
+    void markTexDirty(int x, int y, int w = 1, int h = 1);
+    // 写回记录的范围 还没有 image 时创建 每帧绘制前调用
+    R_Image *syncImage();
+
+private:
+    // 记录的范围 [x0, x1) x [y0, y1) texDirty 为 false 时没有改动
+    bool texDirty = false;
+    int texDirtyX0 = 0, texDirtyY0 = 0, texDirtyX1 = 0, texDirtyY1 = 0;
 };
 
 template <>
@@ -1,6 +1,8 @@
 
 #include "game/player.hpp"
 
+#include <algorithm>
+
 #include "engine/core/core.hpp"
 #include "engine/core/global.hpp"
 #include "engine/game.hpp"
@@ -50,6 +52,55 @@ void RigidBody::updateImage(std::optional<C_Surface *> image) {
     R_SetImageFilter(this->m_image, R_FILTER_NEAREST);
 }
 
+void RigidBody::updateImageRect(const MErect &rect) {
+    C_Surface *surface = this->get_surface();
+    if (!this->m_image || !surface || this->m_image->w != surface->w || this->m_image->h != surface->h) {
+        updateImage({});
+        return;
+    }
+    if (rect.w <= 0 || rect.h <= 0) return;
+
+    // 直接写入已有的纹理 不重新分配
+    R_UpdateImage(this->m_image, &rect, surface, &rect);
+}
+
+void RigidBody::markTexDirty(int x, int y, int w, int h) {
+    if (texNeedsUpdate && texDirtyX0 >= texDirtyX1) return;  // 已经需要整张更新
+
+    if (!texNeedsUpdate) {
+        texDirtyX0 = x;
+        texDirtyY0 = y;
+        texDirtyX1 = x + w;
+        texDirtyY1 = y + h;
+        texNeedsUpdate = true;
+        return;
+    }
+
+    texDirtyX0 = std::min(texDirtyX0, x);
+    texDirtyY0 = std::min(texDirtyY0, y);
+    texDirtyX1 = std::max(texDirtyX1, x + w);
+    texDirtyY1 = std::max(texDirtyY1, y + h);
+}
+
+MErect RigidBody::takeTexDirty() {
+    C_Surface *surface = this->get_surface();
+    const int sw = surface ? surface->w : 0;
+    const int sh = surface ? surface->h : 0;
+
+    MErect r = {0, 0, (f32)sw, (f32)sh};
+    if (texDirtyX0 < texDirtyX1) {
+        const int x0 = std::max(texDirtyX0, 0);
+        const int y0 = std::max(texDirtyY0, 0);
+        const int x1 = std::min(texDirtyX1, sw);
+        const int y1 = std::min(texDirtyY1, sh);
+        r = {(f32)x0, (f32)y0, (f32)std::max(x1 - x0, 0), (f32)std::max(y1 - y0, 0)};
+    }
+
+    texDirtyX0 = texDirtyY0 = texDirtyX1 = texDirtyY1 = 0;
+    texNeedsUpdate = false;
+    return r;
+}
+
 void RigidBody::clean() {
     is_cleaned = true;
 
@@ -69,32 +120,43 @@ void RigidBody::chunk_clean() {
     }
 }
 
+void RigidBody::recycle() {
+    std::vector<std::pair<u32, u32>> keepRaster = std::move(this->raster);
+    std::vector<std::pair<u32, u32>> keepStamped = std::move(this->stamped);
+    keepRaster.clear();
+    keepStamped.clear();
+
+    *this = RigidBody(nullptr);
+
+    this->raster = std::move(keepRaster);
+    this->stamped = std::move(keepStamped);
+}
+
 void Player::render(WorldEntity *we, R_Target *target, int ofsX, int ofsY) {
     if (heldItem != NULL) {
         int scaleEnt = global.game->Iso.globaldef.hd_objects ? global.game->Iso.globaldef.hd_objects_size : 1;
 
-        MErect *ir = new MErect{(f32)(int)(ofsX + we->x + we->hw / 2.0 - heldItem->texture->surface()->w), (f32)(int)(ofsY + we->y + we->hh / 2.0 - heldItem->texture->surface()->h / 2),
-                                (f32)heldItem->texture->surface()->w, (f32)heldItem->texture->surface()->h};
-        f32 fx = (f32)(int)(-ir->x + ofsX + we->x + we->hw / 2.0);
-        f32 fy = (f32)(int)(-ir->y + ofsY + we->y + we->hh / 2.0);
+        MErect ir{(f32)(int)(ofsX + we->x + we->hw / 2.0 - heldItem->texture->surface()->w), (f32)(int)(ofsY + we->y + we->hh / 2.0 - heldItem->texture->surface()->h / 2),
+                  (f32)heldItem->texture->surface()->w, (f32)heldItem->texture->surface()->h};
+        f32 fx = (f32)(int)(-ir.x + ofsX + we->x + we->hw / 2.0);
+        f32 fy = (f32)(int)(-ir.y + ofsY + we->y + we->hh / 2.0);
         fx -= heldItem->pivotX;
-        ir->x += heldItem->pivotX;
+        ir.x += heldItem->pivotX;
         fy -= heldItem->pivotY;
-        ir->y += heldItem->pivotY;
+        ir.y += heldItem->pivotY;
         R_SetShapeBlendMode(R_BlendPresetEnum::R_BLEND_ADD);
         // R_BlitTransformX(heldItem->texture, NULL, target, ir->x, ir->y, fp->x, fp->y, holdAngle, 1, 1);
         // SDL_RenderCopyExF(renderer, heldItem->texture, NULL, ir, holdAngle, fp, abs(holdAngle) > 90 ? SDL_FLIP_VERTICAL : SDL_FLIP_NONE);
-        ir->x *= scaleEnt;
-        ir->y *= scaleEnt;
-        ir->w *= scaleEnt;
-        ir->h *= scaleEnt;
-        R_BlitRectX(heldItem->image, NULL, target, ir, holdAngle, fx, fy, abs(holdAngle) > 90 ? R_FLIP_VERTICAL : R_FLIP_NONE);
-        delete ir;
+        ir.x *= scaleEnt;
+        ir.y *= scaleEnt;
+        ir.w *= scaleEnt;
+        ir.h *= scaleEnt;
+        global.game->TexturePack_.entityQueue.sprite(target, heldItem->syncImage(), ir, holdAngle, fx, fy, abs(holdAngle) > 90 ? R_FLIP_VERTICAL : R_FLIP_NONE);
     }
 }
 
 void Player::renderLQ(WorldEntity *we, R_Target *target, int ofsX, int ofsY) {
-    R_Rectangle(target, we->x + ofsX, we->y + ofsY, we->x + ofsX + we->hw, we->y + ofsY + we->hh, {0xff, 0xff, 0xff, 0xff});
+    global.game->TexturePack_.entityQueue.rectangle(target, we->x + ofsX, we->y + ofsY, we->x + ofsX + we->hw, we->y + ofsY + we->hh, {0xff, 0xff, 0xff, 0xff});
 }
 
 MEvec2 rotate_point2(f32 cx, f32 cy, f32 angle, MEvec2 p);
@@ -161,6 +223,9 @@ MEvec2 rotate_point2(f32 cx, f32 cy, f32 angle, MEvec2 p) {
     return MEvec2(xn + cx, yn + cy);
 }
 
+// 渲染到共享的实体纹理 只能在主线程上执行
+void ControableSystem::declare(ecs::system_access &access) const { access.main_thread().read<WorldEntity, Player, Controlable>().write<R_Target>(); }
+
 void ControableSystem::process(ecs::registry &world, const move_player_event &evt) {
     world.for_joined_components<WorldEntity, Player>(
             [&evt](ecs::entity, WorldEntity &we, Player &pl) {
@@ -170,30 +235,17 @@ void ControableSystem::process(ecs::registry &world, const move_player_event &ev
             ecs::exists<Player>{} && ecs::exists<Controlable>{});
 }
 
+// 改写世界格子和 game::objectStamps
+void WorldEntitySystem::declare(ecs::system_access &access) const { access.read<WorldEntity>().write<world, game>(); }
+
 void WorldEntitySystem::process(ecs::registry &world, const entity_update_event &evt) {
+    ME::world &w = *evt.g->Iso.world;
     world.for_joined_components<WorldEntity>(
-            [&evt](ecs::entity, WorldEntity &pl) {
+            [&evt, &w](ecs::entity e, WorldEntity &pl) {
                 // entity fluid displacement & make solid
-
-                for (int tx = 0; tx < pl.hw; tx++) {
-                    for (int ty = 0; ty < pl.hh; ty++) {
-
-                        int wx = (int)(tx + pl.x + evt.g->Iso.world->loadZone.x);
-                        int wy = (int)(ty + pl.y + evt.g->Iso.world->loadZone.y);
-                        if (wx < 0 || wy < 0 || wx >= evt.g->Iso.world->width || wy >= evt.g->Iso.world->height) continue;
-                        if (evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width].mat->physicsType == PhysicsType::AIR) {
-                            evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width] = Tiles_OBJECT;
-                            evt.g->objectDelete[wx + wy * evt.g->Iso.world->width] = true;
-                        } else if (evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width].mat->physicsType == PhysicsType::SAND ||
-                                   evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width].mat->physicsType == PhysicsType::SOUP) {
-                            evt.g->Iso.world->addCell(new CellData(evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width], (f32)(wx + rand() % 3 - 1 - pl.vx), (f32)(wy - abs(pl.vy)),
-                                                                   (f32)(-pl.vx / 4 + (rand() % 10 - 5) / 5.0f), (f32)(-pl.vy / 4 + -(rand() % 5 + 5) / 5.0f), 0, (f32)0.1));
-                            evt.g->Iso.world->real_tiles[wx + wy * evt.g->Iso.world->width] = Tiles_OBJECT;
-                            evt.g->objectDelete[wx + wy * evt.g->Iso.world->width] = true;
-                            evt.g->Iso.world->dirty[wx + wy * evt.g->Iso.world->width] = true;
-                        }
-                    }
-                }
+                // 写入的格子在 tick 结束时清除 所以每个 tick 都要重新写入
+                FastRNG rng(RNG_Mix(RNG_Mix(w.simSeed, (u64)w.tickCt), (u64)e.id()));
+                w.stampRect((int)(pl.x + w.loadZone.x), (int)(pl.y + w.loadZone.y), pl.hw, pl.hh, Tiles_OBJECT, pl.vx, pl.vy, rng, evt.g->objectStamps);
             },
             ecs::exists<WorldEntity>{});
 }
@@ -6,6 +6,7 @@
 #include "engine/game_datastruct.hpp"
 #include "engine/physics/box2d/inc/box2d.h"
 #include "engine/physics/physics_math.hpp"
+#include "engine/renderer/sprite_atlas.hpp"
 #include "game/items.hpp"
 
 namespace ME {
@@ -33,9 +34,28 @@ public:
     // hitbox needs update
     bool needsUpdate = false;
 
+    // world::rasterRigidBody 覆盖的像素 (real_tiles 下标, tiles 下标) 变换不变时直接复用
+    std::vector<std::pair<u32, u32>> raster;
+    b2Vec2 rasterPos{};
+    f32 rasterAngle = 0;
+    bool rasterValid = false;
+    // 这一 tick 写进世界的像素 取回时只处理这些
+    std::vector<std::pair<u32, u32>> stamped;
+
+    // 最近一次求解之前的变换 见 world::interpolatedTransform
+    // 求解发生在第 interpStep 个物理步 跨越 interpSpan 步 interpSpan 为 0 时不插值
+    b2Vec2 interpPos{};
+    f32 interpAngle = 0;
+    u64 interpStep = 0;
+    u32 interpSpan = 0;
+
     // surface needs to be converted to texture
+    // 只设置 texNeedsUpdate 表示整张更新 markTexDirty 只记录改动的范围
     bool texNeedsUpdate = false;
 
+    // 在 TexturePack_.objectAtlas 中的位置 太大的刚体仍然使用单独的 image
+    SpriteAtlas::Handle atlasHandle{};
+
     int weldX = -1;
     int weldY = -1;
     bool back = false;
@@ -45,6 +65,10 @@ public:
 
     Item *item = nullptr;
 
+private:
+    // texNeedsUpdate 时 surface 中改动的范围 [x0, x1) x [y0, y1) 为空表示整张
+    int texDirtyX0 = 0, texDirtyY0 = 0, texDirtyX1 = 0, texDirtyY1 = 0;
+
 public:
     RigidBody(b2Body *body, std::string name = "unknown");
     ~RigidBody() = default;
@@ -59,9 +83,21 @@ public:
 
     void updateSurface(std::optional<C_Surface *> surface);
     void updateImage(std::optional<C_Surface *> image);
+    // 只把 surface 中 rect 范围的像素写入已有的 image 没有 image 或大小不同时整张重建
+    void updateImageRect(const MErect &rect);
+
+    // surface 中 (x, y, w, h) 的像素被修改
+    void markTexDirty(int x, int y, int w = 1, int h = 1);
+    // 取出需要上传的范围并清除 texNeedsUpdate 没有记录范围时返回整张 surface
+    MErect takeTexDirty();
 
     void clean();
     void chunk_clean();
+
+    // RigidBodyPool 回收时使用 取走贴图引用
+    TextureRef takeTexture() { return std::move(m_texture); }
+    // 回到刚构造的状态 不释放 image (由调用者处理) 保留 raster/stamped 的容量
+    void recycle();
 };
 
 template <>
@@ -216,11 +252,13 @@ struct entity_update_event {
 
 class ControableSystem : public ecs::system<move_player_event> {
 public:
+    void declare(ecs::system_access &access) const override;
     void process(ecs::registry &world, const move_player_event &evt) override;
 };
 
 class WorldEntitySystem : public ecs::system<entity_update_event> {
 public:
+    void declare(ecs::system_access &access) const override;
     void process(ecs::registry &world, const entity_update_event &evt) override;
 };
 
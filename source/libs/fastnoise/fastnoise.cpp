@@ -33,6 +33,13 @@
 
 #include <algorithm>
 #include <random>
+#include <vector>
+
+#include "engine/core/cpu_dispatch.hpp"
+
+#if defined(ME_SIMD_X86) && !defined(FN_USE_DOUBLES)
+#include <immintrin.h>
+#endif
 
 const FN_DECIMAL GRAD_X[] = {1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0};
 const FN_DECIMAL GRAD_Y[] = {1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1};
@@ -548,6 +555,12 @@ void FastNoise::SetSeed(int seed) {
         m_perm[k] = l;
         m_perm12[j] = m_perm12[j + 256] = m_perm[j] % 12;
     }
+
+    for (int i = 0; i < 512; i++) {
+        m_grad12X[i] = GRAD_X[m_perm12[i]];
+        m_grad12Y[i] = GRAD_Y[m_perm12[i]];
+        m_grad12Z[i] = GRAD_Z[m_perm12[i]];
+    }
 }
 
 void FastNoise::CalculateFractalBounding() {
@@ -1105,6 +1118,207 @@ FN_DECIMAL FastNoise::SinglePerlin(unsigned char offset, FN_DECIMAL x, FN_DECIMA
     return Lerp(yf0, yf1, zs);
 }
 
+namespace {
+
+// One row of GetPerlinGrid. Columns are stored as arrays so the vector kernels can load them directly
+struct PerlinRow {
+    const int* i0;
+    const int* i1;
+    const FN_DECIMAL* s;
+    const FN_DECIMAL* d0;
+    const FN_DECIMAL* d1;
+    // m_grad12X/Y/Z
+    const FN_DECIMAL* gx;
+    const FN_DECIMAL* gy;
+    const FN_DECIMAL* gz;
+    int p00, p10, p01, p11;
+    FN_DECIMAL ys, yd0, yd1, zs, zd0, zd1;
+};
+
+// Fills out[0, n) for some n <= width and returns n, GetPerlinGrid finishes the rest with the scalar loop.
+// Each lane does the scalar arithmetic in the same order, without FMA, so the results are bit for bit the same
+using perlin_row_fn = int (*)(const PerlinRow& r, int width, FN_DECIMAL* out);
+
+int PerlinRowScalar(const PerlinRow&, int, FN_DECIMAL*) { return 0; }
+
+#if defined(ME_SIMD_X86) && !defined(FN_USE_DOUBLES)
+inline __m128 LerpSSE2(__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a))); }
+
+// SSE2 has no gather, the four gradients are loaded one by one
+inline __m128 GradSSE2(const PerlinRow& r, __m128i lut, __m128 xd, __m128 yd, __m128 zd) {
+    alignas(16) int idx[4];
+    _mm_store_si128((__m128i*)idx, lut);
+    const __m128 gx = _mm_setr_ps(r.gx[idx[0]], r.gx[idx[1]], r.gx[idx[2]], r.gx[idx[3]]);
+    const __m128 gy = _mm_setr_ps(r.gy[idx[0]], r.gy[idx[1]], r.gy[idx[2]], r.gy[idx[3]]);
+    const __m128 gz = _mm_setr_ps(r.gz[idx[0]], r.gz[idx[1]], r.gz[idx[2]], r.gz[idx[3]]);
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(xd, gx), _mm_mul_ps(yd, gy)), _mm_mul_ps(zd, gz));
+}
+
+int PerlinRowSSE2(const PerlinRow& r, int width, FN_DECIMAL* out) {
+    const __m128i p00 = _mm_set1_epi32(r.p00), p10 = _mm_set1_epi32(r.p10), p01 = _mm_set1_epi32(r.p01), p11 = _mm_set1_epi32(r.p11);
+    const __m128 ys = _mm_set1_ps(r.ys), yd0 = _mm_set1_ps(r.yd0), yd1 = _mm_set1_ps(r.yd1);
+    const __m128 zs = _mm_set1_ps(r.zs), zd0 = _mm_set1_ps(r.zd0), zd1 = _mm_set1_ps(r.zd1);
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        const __m128i i0 = _mm_loadu_si128((const __m128i*)(r.i0 + i));
+        const __m128i i1 = _mm_loadu_si128((const __m128i*)(r.i1 + i));
+        const __m128 xs = _mm_loadu_ps(r.s + i), xd0 = _mm_loadu_ps(r.d0 + i), xd1 = _mm_loadu_ps(r.d1 + i);
+
+        const __m128 xf00 = LerpSSE2(GradSSE2(r, _mm_add_epi32(i0, p00), xd0, yd0, zd0), GradSSE2(r, _mm_add_epi32(i1, p00), xd1, yd0, zd0), xs);
+        const __m128 xf10 = LerpSSE2(GradSSE2(r, _mm_add_epi32(i0, p10), xd0, yd1, zd0), GradSSE2(r, _mm_add_epi32(i1, p10), xd1, yd1, zd0), xs);
+        const __m128 xf01 = LerpSSE2(GradSSE2(r, _mm_add_epi32(i0, p01), xd0, yd0, zd1), GradSSE2(r, _mm_add_epi32(i1, p01), xd1, yd0, zd1), xs);
+        const __m128 xf11 = LerpSSE2(GradSSE2(r, _mm_add_epi32(i0, p11), xd0, yd1, zd1), GradSSE2(r, _mm_add_epi32(i1, p11), xd1, yd1, zd1), xs);
+
+        _mm_storeu_ps(out + i, LerpSSE2(LerpSSE2(xf00, xf10, ys), LerpSSE2(xf01, xf11, ys), zs));
+    }
+    return i;
+}
+
+ME_TARGET_AVX2 inline __m256 LerpAVX2(__m256 a, __m256 b, __m256 t) { return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a))); }
+
+ME_TARGET_AVX2 inline __m256 GradAVX2(const PerlinRow& r, __m256i lut, __m256 xd, __m256 yd, __m256 zd) {
+    const __m256 gx = _mm256_i32gather_ps(r.gx, lut, 4);
+    const __m256 gy = _mm256_i32gather_ps(r.gy, lut, 4);
+    const __m256 gz = _mm256_i32gather_ps(r.gz, lut, 4);
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xd, gx), _mm256_mul_ps(yd, gy)), _mm256_mul_ps(zd, gz));
+}
+
+// Nothing here needs AVX-512, avx512 uses this variant too
+ME_TARGET_AVX2 int PerlinRowAVX2(const PerlinRow& r, int width, FN_DECIMAL* out) {
+    const __m256i p00 = _mm256_set1_epi32(r.p00), p10 = _mm256_set1_epi32(r.p10), p01 = _mm256_set1_epi32(r.p01), p11 = _mm256_set1_epi32(r.p11);
+    const __m256 ys = _mm256_set1_ps(r.ys), yd0 = _mm256_set1_ps(r.yd0), yd1 = _mm256_set1_ps(r.yd1);
+    const __m256 zs = _mm256_set1_ps(r.zs), zd0 = _mm256_set1_ps(r.zd0), zd1 = _mm256_set1_ps(r.zd1);
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        const __m256i i0 = _mm256_loadu_si256((const __m256i*)(r.i0 + i));
+        const __m256i i1 = _mm256_loadu_si256((const __m256i*)(r.i1 + i));
+        const __m256 xs = _mm256_loadu_ps(r.s + i), xd0 = _mm256_loadu_ps(r.d0 + i), xd1 = _mm256_loadu_ps(r.d1 + i);
+
+        const __m256 xf00 = LerpAVX2(GradAVX2(r, _mm256_add_epi32(i0, p00), xd0, yd0, zd0), GradAVX2(r, _mm256_add_epi32(i1, p00), xd1, yd0, zd0), xs);
+        const __m256 xf10 = LerpAVX2(GradAVX2(r, _mm256_add_epi32(i0, p10), xd0, yd1, zd0), GradAVX2(r, _mm256_add_epi32(i1, p10), xd1, yd1, zd0), xs);
+        const __m256 xf01 = LerpAVX2(GradAVX2(r, _mm256_add_epi32(i0, p01), xd0, yd0, zd1), GradAVX2(r, _mm256_add_epi32(i1, p01), xd1, yd0, zd1), xs);
+        const __m256 xf11 = LerpAVX2(GradAVX2(r, _mm256_add_epi32(i0, p11), xd0, yd1, zd1), GradAVX2(r, _mm256_add_epi32(i1, p11), xd1, yd1, zd1), xs);
+
+        _mm256_storeu_ps(out + i, LerpAVX2(LerpAVX2(xf00, xf10, ys), LerpAVX2(xf01, xf11, ys), zs));
+    }
+    return i;
+}
+#endif
+
+perlin_row_fn SelectPerlinRow(ME::simd_level l) {
+    switch (l) {
+#if defined(ME_SIMD_X86) && !defined(FN_USE_DOUBLES)
+        case ME::simd_level::avx512:
+        case ME::simd_level::avx2:
+            return PerlinRowAVX2;
+        case ME::simd_level::sse2:
+            return PerlinRowSSE2;
+#endif
+        default:
+            return PerlinRowScalar;
+    }
+}
+
+ME::simd_kernel<perlin_row_fn> PerlinRowKernel{SelectPerlinRow};
+
+}  // namespace
+
+void FastNoise::GetPerlinGrid(const FN_DECIMAL* x, int width, const FN_DECIMAL* y, int height, FN_DECIMAL z, FN_DECIMAL* out) const {
+    if (width <= 0 || height <= 0) return;
+
+    // Every step below repeats SinglePerlin's arithmetic in the same order so the result matches GetPerlin exactly
+    struct Axis {
+        int i0, i1;
+        FN_DECIMAL s, d0, d1;
+    };
+
+    auto makeAxis = [this](FN_DECIMAL v) {
+        v *= m_frequency;
+        int v0 = FastFloor(v);
+
+        Axis a;
+        a.i0 = v0 & 0xff;
+        a.i1 = (v0 + 1) & 0xff;
+        switch (m_interp) {
+            case Linear:
+                a.s = v - (FN_DECIMAL)v0;
+                break;
+            case Hermite:
+                a.s = InterpHermiteFunc(v - (FN_DECIMAL)v0);
+                break;
+            case Quintic:
+            default:
+                a.s = InterpQuinticFunc(v - (FN_DECIMAL)v0);
+                break;
+        }
+        a.d0 = v - (FN_DECIMAL)v0;
+        a.d1 = a.d0 - 1;
+        return a;
+    };
+
+    thread_local std::vector<int> ci0, ci1;
+    thread_local std::vector<FN_DECIMAL> cs, cd0, cd1;
+    ci0.resize(width);
+    ci1.resize(width);
+    cs.resize(width);
+    cd0.resize(width);
+    cd1.resize(width);
+    for (int i = 0; i < width; i++) {
+        const Axis a = makeAxis(x[i]);
+        ci0[i] = a.i0;
+        ci1[i] = a.i1;
+        cs[i] = a.s;
+        cd0[i] = a.d0;
+        cd1[i] = a.d1;
+    }
+
+    const Axis za = makeAxis(z);
+    const int pz0 = m_perm[za.i0];
+    const int pz1 = m_perm[za.i1];
+
+    PerlinRow r;
+    r.i0 = ci0.data();
+    r.i1 = ci1.data();
+    r.s = cs.data();
+    r.d0 = cd0.data();
+    r.d1 = cd1.data();
+    r.gx = m_grad12X;
+    r.gy = m_grad12Y;
+    r.gz = m_grad12Z;
+    r.zs = za.s;
+    r.zd0 = za.d0;
+    r.zd1 = za.d1;
+
+    const perlin_row_fn rowKernel = PerlinRowKernel.get();
+    for (int j = 0; j < height; j++) {
+        const Axis ya = makeAxis(y[j]);
+        r.p00 = m_perm[ya.i0 + pz0];
+        r.p10 = m_perm[ya.i1 + pz0];
+        r.p01 = m_perm[ya.i0 + pz1];
+        r.p11 = m_perm[ya.i1 + pz1];
+        r.ys = ya.s;
+        r.yd0 = ya.d0;
+        r.yd1 = ya.d1;
+
+        FN_DECIMAL* row = out + (size_t)j * width;
+        auto grad = [&](int lut, FN_DECIMAL xd, FN_DECIMAL yd, FN_DECIMAL zd) { return xd * m_grad12X[lut] + yd * m_grad12Y[lut] + zd * m_grad12Z[lut]; };
+        for (int i = rowKernel(r, width, row); i < width; i++) {
+            const int i0 = ci0[i], i1 = ci1[i];
+            const FN_DECIMAL xs = cs[i], xd0 = cd0[i], xd1 = cd1[i];
+
+            FN_DECIMAL xf00 = Lerp(grad(i0 + r.p00, xd0, ya.d0, za.d0), grad(i1 + r.p00, xd1, ya.d0, za.d0), xs);
+            FN_DECIMAL xf10 = Lerp(grad(i0 + r.p10, xd0, ya.d1, za.d0), grad(i1 + r.p10, xd1, ya.d1, za.d0), xs);
+            FN_DECIMAL xf01 = Lerp(grad(i0 + r.p01, xd0, ya.d0, za.d1), grad(i1 + r.p01, xd1, ya.d0, za.d1), xs);
+            FN_DECIMAL xf11 = Lerp(grad(i0 + r.p11, xd0, ya.d1, za.d1), grad(i1 + r.p11, xd1, ya.d1, za.d1), xs);
+
+            FN_DECIMAL yf0 = Lerp(xf00, xf10, ya.s);
+            FN_DECIMAL yf1 = Lerp(xf01, xf11, ya.s);
+
+            row[i] = Lerp(yf0, yf1, za.s);
+        }
+    }
+}
+
 FN_DECIMAL FastNoise::GetPerlinFractal(FN_DECIMAL x, FN_DECIMAL y) const {
     x *= m_frequency;
     y *= m_frequency;
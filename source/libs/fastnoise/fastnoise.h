@@ -198,6 +198,11 @@ public:
     FN_DECIMAL GetPerlin(FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z) const;
     FN_DECIMAL GetPerlinFractal(FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z) const;
 
+    // Batched GetPerlin over a grid: out[i + j * width] == GetPerlin(x[i], y[j], z), bit for bit
+    // Floor, interpolation weights and permutation lookups are computed once per column, row and plane
+    // Rows run through an SSE2 or AVX2 kernel picked by the engine's cpu dispatch (float builds only)
+    void GetPerlinGrid(const FN_DECIMAL* x, int width, const FN_DECIMAL* y, int height, FN_DECIMAL z, FN_DECIMAL* out) const;
+
     FN_DECIMAL GetSimplex(FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z) const;
     FN_DECIMAL GetSimplexFractal(FN_DECIMAL x, FN_DECIMAL y, FN_DECIMAL z) const;
 
@@ -223,6 +228,10 @@ public:
 private:
     unsigned char m_perm[512];
     unsigned char m_perm12[512];
+    // GRAD_X/Y/Z[m_perm12[i]], lets GetPerlinGrid gather gradients with one lookup
+    FN_DECIMAL m_grad12X[512];
+    FN_DECIMAL m_grad12Y[512];
+    FN_DECIMAL m_grad12Z[512];
 
     int m_seed = 1337;
     FN_DECIMAL m_frequency = FN_DECIMAL(0.01);
@@ -1,5 +1,10 @@
 
 
+// 解码出的像素直接交给 SDL_Surface 由 SDL_FreeSurface 释放 见 DecodeTextureSurface
+#include <SDL_stdinc.h>
+#define STBI_MALLOC(sz) SDL_malloc(sz)
+#define STBI_REALLOC(p, newsz) SDL_realloc(p, newsz)
+#define STBI_FREE(p) SDL_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "libs/external/stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -0,0 +1,139 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+#ifndef ME_BENCH_COMMON_HPP
+#define ME_BENCH_COMMON_HPP
+
+// WorldBench 和 HotPathBench 共用的无窗口初始化
+// 只构造 game 对象和内置材料 不调用 game::initialize 不初始化 SDL 视频 GL 渲染器 FMOD 和脚本系统
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "engine/core/base_memory.h"
+#include "engine/core/const.h"
+#include "engine/core/global.hpp"
+#include "engine/core/job.h"
+#include "engine/game.hpp"
+#include "engine/game_datastruct.hpp"
+#include "engine/game_utils/rng.h"
+#include "engine/world.hpp"
+#include "engine/world_generator.h"
+
+namespace ME::bench {
+
+// data/scripts/global.lua 中与模拟有关的默认值
+inline void SetupGlobalDEF(GlobalDEF &def, bool temperature = true, bool box2d = true) {
+    def = GlobalDEF{};
+    def.tick_world = true;
+    def.tick_box2d = box2d;
+    def.tick_box2d_parallel = true;
+    def.physics_lod_dist = 600;
+    def.physics_step_rate = 30;
+    def.physics_max_steps = 4;
+    def.tick_liquid_particles = false;
+    def.liquid_particle_min_cells = 1500;
+    def.tick_temperature = temperature;
+    def.merge_budget_us = 2000;
+    def.populate_budget_us = 4000;
+    def.npc_think_budget_us = 1000;
+    def.npc_sleep_ticks = 30;
+    def.interest_background_interval = 4;
+    def.cell_iter = 3;
+}
+
+// world 通过 global.game 读取 RNG 和 globaldef
+// 只有内置材料 脚本注册的材料需要 lua 不在这里加载
+inline std::unique_ptr<game> CreateGame(int argc, char *argv[], u32 seed) {
+    ME_mem_init(argc, argv);
+    job::init();
+
+    auto g = std::make_unique<game>();
+    global.game = g.get();
+    srand(seed);
+    g->RNG = new RNG{seed};
+    SetupGlobalDEF(g->Iso.globaldef);
+
+    InitMaterials();
+    PushMaterials();
+    return g;
+}
+
+inline void DestroyGame(std::unique_ptr<game> &g) {
+    g->Iso.world.reset();
+    RNG_Delete(g->RNG);
+    g->RNG = nullptr;
+    global.game = nullptr;
+    g.reset();
+
+    job::shutdown();
+    ME_mem_end();
+}
+
+// worldPath 为空时不读写存档
+inline world *CreateWorld(game *g, int size, const std::string &worldPath = {}) {
+    g->Iso.world = create_scope<world>();
+    world *w = g->Iso.world.get();
+    w->noSaveLoad = worldPath.empty();
+    w->init(worldPath.empty() ? "saves/bench" : worldPath, size, size, nullptr, nullptr, new MaterialTestGenerator());
+    w->tickZone = {CHUNK_W, CHUNK_H, (float)w->width - CHUNK_W * 2, (float)w->height - CHUNK_H * 2};
+    return w;
+}
+
+// 在基准的 tick 循环里运行 game::stress 的场景 不创建窗口和 GL 上下文 (--stress-headless 只是不画世界)
+// 场景的种子取自 CreateGame 的 seed 之后每个 tick 调用 g->stress.tick 直到 finished
+// 不认识的场景名返回 false
+inline bool StartStress(game *g, const std::string &name, u32 ticks) {
+    const StressScene::kind k = StressScene::from_name(name);
+    if (k == StressScene::NONE) return false;
+    // LOADING 状态下场景不会布置
+    g->state = INGAME;
+    return g->stress.start(k, ticks, true);
+}
+
+// 底部石头地面 几条石头平台 上方随机的沙 水 熔岩和蒸汽团块
+inline void BuildScene(world *w, u32 seed) {
+    FastRNG rng(RNG_Mix(seed));
+    const int width = w->width;
+    const int height = w->height;
+
+    for (int y = height - CHUNK_H - 48; y < height; y++) {
+        for (int x = 0; x < width; x++) w->setTile(x, y, TilesCreateStone(x, y));
+    }
+
+    const int platforms = width / 192;
+    for (int i = 0; i < platforms; i++) {
+        const int px = CHUNK_W + rng.next() % std::max(width - CHUNK_W * 2 - 96, 1);
+        const int py = CHUNK_H + height / 3 + rng.next() % std::max(height / 3, 1);
+        for (int y = py; y < py + 6; y++) {
+            for (int x = px; x < px + 96; x++) w->setTile(x, y, TilesCreateSmoothStone(x, y));
+        }
+    }
+
+    const int blobs = width * height / 8192;
+    for (int i = 0; i < blobs; i++) {
+        const int r = 6 + rng.next() % 24;
+        const int cx = CHUNK_W + r + rng.next() % std::max(width - CHUNK_W * 2 - r * 2, 1);
+        const int cy = CHUNK_H + r + rng.next() % std::max(height / 2 - r * 2, 1);
+        const int kind = rng.next() % 8;
+        for (int y = cy - r; y <= cy + r; y++) {
+            for (int x = cx - r; x <= cx + r; x++) {
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) > r * r) continue;
+                if (kind < 3) {
+                    w->setTile(x, y, TilesCreateTestSand());
+                } else if (kind < 6) {
+                    w->setTile(x, y, TilesCreateWater());
+                } else if (kind < 7) {
+                    w->setTile(x, y, TilesCreateLava());
+                } else {
+                    w->setTile(x, y, TilesCreateSteam());
+                }
+            }
+        }
+    }
+}
+
+}  // namespace ME::bench
+
+#endif
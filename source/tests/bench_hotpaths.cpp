@@ -0,0 +1,1167 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+// 引擎热点路径的微基准
+// 每项至少运行 --min-time 毫秒 (默认 200) 结果以固定的 JSON 格式输出到标准输出
+// 字段和顺序保持不变 方便按 name 对比前后两次运行
+// 各组同时校验被测代码的结果 (例如序列化的往返) 不一致时输出到 stderr 进程返回 1
+//
+// 用法: HotPathBench [--filter 子串] [--min-time 200] [--seed 1]
+// 需要在仓库根目录运行 (world::init 从 data/ 读取刚体贴图)
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine/chunk.hpp"
+#include "engine/chunk_codec.hpp"
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/ecs/ecs.hpp"
+#include "engine/meta/static_serializer.hpp"
+#include "engine/physics/box2d/inc/box2d.h"
+#include "engine/physics/connected_components.hpp"
+#include "engine/physics/physics_math.hpp"
+#include "engine/scripting/lua_wrapper.hpp"
+#include "engine/ui/fontcache.hpp"
+#include "engine/utils/utility.hpp"
+#include "engine/world_cells.hpp"
+#include "engine/world_chunkmap.hpp"
+#include "engine/world_entity_grid.hpp"
+#include "engine/world_pixels.hpp"
+#include "libs/fastnoise/fastnoise.h"
+#include "tests/bench_common.hpp"
+
+using namespace ME;
+
+namespace {
+
+struct BenchOptions {
+    std::string filter;
+    f64 minTimeMs = 200;
+    u32 seed = 1;
+};
+
+struct BenchResult {
+    std::string name;
+    u64 iterations;
+    f64 nsPerOp;
+    // 每次操作处理的元素数 (像素/区块/实体/调用) 用于计算吞吐
+    f64 itemsPerOp;
+};
+
+// 防止结果被优化掉
+volatile u64 g_sink = 0;
+
+int g_checkFailures = 0;
+
+void Check(const char *name, bool ok) {
+    if (ok) return;
+    fprintf(stderr, "check failed: %s\n", name);
+    g_checkFailures++;
+}
+
+// op(n) 连续执行 n 次操作 次数翻倍直到总时间超过 minTimeMs
+template <typename F>
+BenchResult RunBench(const BenchOptions &opt, const char *name, f64 itemsPerOp, F &&op) {
+    using clock = std::chrono::steady_clock;
+
+    op(1);  // 预热
+
+    u64 n = 1;
+    f64 ms = 0;
+    while (true) {
+        const auto t0 = clock::now();
+        op(n);
+        ms = std::chrono::duration<f64, std::milli>(clock::now() - t0).count();
+        if (ms >= opt.minTimeMs || n >= ((u64)1 << 32)) break;
+        // 按已测时间估算 最多一次放大 10 倍
+        const f64 scale = ms > 0 ? std::min(opt.minTimeMs * 1.2 / ms, 10.0) : 10.0;
+        n = std::max(n + 1, (u64)(n * scale));
+    }
+    return {name, n, ms * 1e6 / (f64)n, itemsPerOp};
+}
+
+// 与存档中的区块相近的内容 石头地面 沙和水 背景为渐变色
+void FillChunk(MaterialInstance *tiles, MaterialInstance *layer2, u32 *background, u32 seed) {
+    FastRNG rng(RNG_Mix(seed));
+    for (int y = 0; y < CHUNK_H; y++) {
+        for (int x = 0; x < CHUNK_W; x++) {
+            const int i = x + y * CHUNK_W;
+            if (y > CHUNK_H * 2 / 3) {
+                tiles[i] = TilesCreateStone(x, y);
+            } else if (y > CHUNK_H / 2 && rng.next() % 4 != 0) {
+                tiles[i] = TilesCreateTestSand();
+            } else if (y > CHUNK_H / 3 && rng.next() % 3 == 0) {
+                tiles[i] = TilesCreateWater();
+            } else {
+                tiles[i] = Tiles_NOTHING;
+            }
+            layer2[i] = y > CHUNK_H / 2 ? TilesCreateSmoothDirt(x, y) : Tiles_NOTHING;
+            background[i] = 0xff000000 | (u32)(y * 2) << 8 | (u32)x;
+        }
+    }
+}
+
+// f 在 cpu::set_max_level(level) 下运行 之后恢复为 best
+// 用来比较向量内核和标量版本的输出
+template <typename F>
+void WithSimdLevel(simd_level level, F &&f) {
+    cpu::set_max_level(level);
+    f();
+    cpu::set_max_level(cpu::best());
+}
+
+// 随机噪声 前景字节取 1..255 用来覆盖二值化 percent 为前景的比例
+void RandomMask(std::vector<u8> &mask, int w, int h, u32 seed, int percent) {
+    FastRNG rng(RNG_Mix(seed));
+    mask.resize((size_t)w * h);
+    for (u8 &m : mask) m = rng.next() % 100 < percent ? (u8)(1 + rng.next() % 255) : 0;
+}
+
+// 几个相交的圆 带一个洞 与碎片刚体的形状相近
+void FillMask(std::vector<u8> &mask, int w, int h) {
+    mask.assign((size_t)w * h, 0);
+    auto disc = [&](int cx, int cy, int r, u8 v) {
+        for (int y = std::max(cy - r, 0); y < std::min(cy + r, h); y++) {
+            for (int x = std::max(cx - r, 0); x < std::min(cx + r, w); x++) {
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r) mask[x + y * w] = v;
+            }
+        }
+    };
+    disc(w / 2, h / 2, w / 3, 1);
+    disc(w / 3, h / 3, w / 5, 1);
+    disc(w * 2 / 3, h * 3 / 5, w / 4, 1);
+    disc(w / 2, h / 2, w / 10, 0);
+}
+
+struct SerializePoint {
+    i32 x;
+    i32 y;
+};
+
+// 覆盖 static_serializer 的各条路径 平凡可复制的 vector 字符串 嵌套对象 按版本增减的字段和指针
+struct SerializeRecord {
+    u32 id = 0;
+    std::string name;
+    std::vector<SerializePoint> points;
+    std::vector<std::string> tags;
+    SerializePoint origin{};
+    f32 scale = 1;
+    bool enabled = false;
+    // 第 2 版起不再写出
+    i32 legacy = 0;
+    // 第 2 版新增
+    i32 added = 0;
+    SerializeRecord *parent = nullptr;
+
+    bool operator==(const SerializeRecord &o) const {
+        auto samePoints = [](const std::vector<SerializePoint> &a, const std::vector<SerializePoint> &b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const SerializePoint &p, const SerializePoint &q) { return p.x == q.x && p.y == q.y; });
+        };
+        return id == o.id && name == o.name && samePoints(points, o.points) && tags == o.tags && origin.x == o.origin.x && origin.y == o.origin.y && scale == o.scale &&
+               enabled == o.enabled && legacy == o.legacy && added == o.added;
+    }
+};
+
+}  // namespace
+
+template <>
+struct ME::meta::static_refl::TypeInfo<SerializePoint> : TypeInfoBase<SerializePoint> {
+    static constexpr AttrList attrs = {};
+    static constexpr FieldList fields = {
+            Field{TSTR("x"), &Type::x},
+            Field{TSTR("y"), &Type::y},
+    };
+};
+
+template <>
+struct ME::meta::static_refl::TypeInfo<SerializeRecord> : TypeInfoBase<SerializeRecord> {
+    static constexpr AttrList attrs = {Attr{TSTR("Serialize::Version"), 2}};
+    static constexpr FieldList fields = {
+            Field{TSTR("id"), &Type::id},
+            Field{TSTR("name"), &Type::name},
+            Field{TSTR("points"), &Type::points},
+            Field{TSTR("tags"), &Type::tags},
+            Field{TSTR("origin"), &Type::origin},
+            Field{TSTR("scale"), &Type::scale},
+            Field{TSTR("enabled"), &Type::enabled},
+            Field{TSTR("legacy"), &Type::legacy, AttrList{Attr{TSTR("Serialize::Until"), 2}}},
+            Field{TSTR("added"), &Type::added, AttrList{Attr{TSTR("Serialize::Since"), 2}}},
+            Field{TSTR("parent"), &Type::parent},
+    };
+};
+
+namespace {
+
+static_assert(meta::static_refl::IsBlittable_v<SerializePoint>);
+static_assert(!meta::static_refl::IsBlittable_v<SerializeRecord>);
+
+struct BenchPosition {
+    BenchPosition(f32 x, f32 y) : x(x), y(y) {}
+    f32 x, y;
+};
+
+struct BenchVelocity {
+    BenchVelocity(f32 vx, f32 vy) : vx(vx), vy(vy) {}
+    f32 vx, vy;
+};
+
+void BenchChunkCodec(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int N = CHUNK_W * CHUNK_H;
+    std::vector<MaterialInstance> tiles(N), denseLayer2(N), decTiles(N);
+    std::vector<u32> background(N), decBackground(N);
+    std::vector<u8> biomes(N), decBiomes;
+    FillChunk(tiles.data(), denseLayer2.data(), background.data(), opt.seed);
+    // 随机温度 覆盖温度差值的正负和回绕
+    FastRNG temperatures(RNG_Mix(opt.seed + 1));
+    for (int i = 0; i < N; i++) {
+        tiles[i].temperature = (mat_temperature)((int)(temperatures.next() % 4001) - 2000);
+        if (!Layer2Bricks::is_empty(denseLayer2[i])) denseLayer2[i].temperature = (mat_temperature)((int)(temperatures.next() % 4001) - 2000);
+    }
+    Layer2Bricks layer2, decLayer2;
+    layer2.assign(denseLayer2.data());
+    // 群系按大块分布
+    for (int i = 0; i < N; i++) biomes[i] = (u8)(((i % CHUNK_W) / 40 + (i / CHUNK_W) / 40) % 12);
+    constexpr i8 PHASE = 5;
+
+    std::vector<char> payload;
+    out.push_back(RunBench(opt, "chunk_encode", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            payload.clear();
+            ChunkCodec::encode(PHASE, tiles.data(), layer2, background.data(), biomes.data(), payload);
+        }
+        g_sink += payload.size();
+    }));
+
+    // 后台存档的压缩级别
+    std::vector<char> payloadHigh;
+    out.push_back(RunBench(opt, "chunk_encode_high", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            payloadHigh.clear();
+            ChunkCodec::encode(PHASE, tiles.data(), layer2, background.data(), biomes.data(), payloadHigh, nullptr, 0, ChunkCodec::Compression::high);
+        }
+        g_sink += payloadHigh.size();
+    }));
+
+    out.push_back(RunBench(opt, "chunk_decode", 1, [&](u64 n) {
+        i8 phase = 0;
+        for (u64 i = 0; i < n; i++) ChunkCodec::decode(payload.data(), payload.size(), phase, decTiles.data(), decLayer2, decBackground.data(), decBiomes);
+        g_sink += decBackground[N - 1];
+    }));
+
+    out.push_back(RunBench(opt, "chunk_summary", 1, [&](u64 n) {
+        u32 summary[ChunkCodec::summary_size(1)];
+        for (u64 i = 0; i < n; i++) ChunkCodec::read_summary(payload.data(), payload.size(), 1, summary);
+        g_sink += summary[0];
+    }));
+
+    // 存档保存的是材料 颜色和温度
+    auto samePixels = [](const MaterialInstance *a, const MaterialInstance *b, int n) {
+        for (int i = 0; i < n; i++) {
+            if (a[i].mat->id != b[i].mat->id || a[i].color != b[i].color || a[i].temperature != b[i].temperature) return false;
+        }
+        return true;
+    };
+    auto sameLayer2 = [&](const Layer2Bricks &a, const Layer2Bricks &b) {
+        if (a.brick_mask() != b.brick_mask()) return false;
+        for (u64 m = a.brick_mask(); m; m &= m - 1) {
+            const int k = std::countr_zero(m);
+            if (!samePixels(a.brick(k), b.brick(k), Layer2Bricks::BRICK_PIXELS)) return false;
+        }
+        return true;
+    };
+
+    // 两种压缩级别都能还原全部平面
+    for (const std::vector<char> *p : {&payload, &payloadHigh}) {
+        i8 phase = 0;
+        const bool ok = ChunkCodec::decode(p->data(), p->size(), phase, decTiles.data(), decLayer2, decBackground.data(), decBiomes);
+        Check(p == &payload ? "chunk_roundtrip" : "chunk_roundtrip_high", ok && phase == PHASE && samePixels(tiles.data(), decTiles.data(), N) && sameLayer2(layer2, decLayer2) &&
+                                                                               decBackground == background && decBiomes == biomes);
+    }
+
+    // 增量只改写掩码中的块 目标的 layer2 是满的 掩码中源区块没有 layer2 的块要清成空气
+    {
+        FastRNG rng(RNG_Mix(opt.seed + 2));
+        u64 bricks = ((u64)rng.next() << 32 | rng.next()) & (Layer2Bricks::BRICK_COUNT == 64 ? ~(u64)0 : ((u64)1 << Layer2Bricks::BRICK_COUNT) - 1);
+        std::vector<MaterialInstance> dstTiles(N), dstDense(N);
+        std::vector<u32> dstBackground(N);
+        FillChunk(dstTiles.data(), dstDense.data(), dstBackground.data(), opt.seed + 3);
+        for (int y = 0; y < CHUNK_H; y++) {
+            for (int x = 0; x < CHUNK_W; x++) dstDense[x + y * CHUNK_W] = TilesCreateSmoothDirt(x, y);
+        }
+        Layer2Bricks dstLayer2;
+        dstLayer2.assign(dstDense.data());
+        const std::vector<MaterialInstance> oldTiles = dstTiles;
+        const std::vector<u32> oldBackground = dstBackground;
+        const Layer2Bricks oldLayer2 = dstLayer2;
+
+        std::vector<char> delta;
+        ChunkCodec::encode_delta(bricks, tiles.data(), layer2, background.data(), delta);
+        u64 decoded = 0;
+        bool same = ChunkCodec::decode_delta(delta.data(), delta.size(), decoded, dstTiles.data(), dstLayer2, dstBackground.data()) && decoded == bricks;
+        for (int y = 0; y < CHUNK_H && same; y++) {
+            for (int x = 0; x < CHUNK_W && same; x++) {
+                const int i = x + y * CHUNK_W;
+                const bool inside = bricks >> Layer2Bricks::brick_of(x, y) & 1;
+                const MaterialInstance t = inside ? tiles[i] : oldTiles[i], l = inside ? layer2.get(x, y) : oldLayer2.get(x, y);
+                const MaterialInstance dl = dstLayer2.get(x, y);
+                same = samePixels(&t, &dstTiles[i], 1) && samePixels(&l, &dl, 1) && dstBackground[i] == (inside ? background[i] : oldBackground[i]);
+            }
+        }
+        Check("chunk_delta_roundtrip", same);
+
+        // 增量没有校验和 只检查截断
+        bool rejected = true;
+        for (size_t size : {(size_t)0, (size_t)8, delta.size() / 2, delta.size() - 1}) {
+            try {
+                rejected = rejected && !ChunkCodec::decode_delta(delta.data(), size, decoded, dstTiles.data(), dstLayer2, dstBackground.data());
+            } catch (const std::runtime_error &) {
+            }
+        }
+        Check("chunk_delta_truncated_rejected", rejected);
+    }
+
+    // 损坏的存档要被拒绝 不能崩溃 decode 返回 false 或者抛出
+    auto decodeFails = [&](const char *data, size_t size) {
+        i8 phase = 0;
+        try {
+            return !ChunkCodec::decode(data, size, phase, decTiles.data(), decLayer2, decBackground.data(), decBiomes);
+        } catch (const std::runtime_error &) {
+            return true;
+        }
+    };
+    bool flipped = true, truncated = true;
+    std::vector<char> corrupt;
+    for (int k = 0; k < 16; k++) {
+        corrupt = payload;
+        const size_t at = k * (corrupt.size() - 1) / 15;
+        corrupt[at] ^= 0x20;
+        flipped = flipped && (!ChunkCodec::verify(corrupt.data(), corrupt.size()) || at < sizeof(ChunkCodec::MAGIC)) && decodeFails(corrupt.data(), corrupt.size());
+    }
+    for (size_t size : {(size_t)0, (size_t)1, (size_t)15, (size_t)16, payload.size() / 2, payload.size() - 1}) truncated = truncated && decodeFails(payload.data(), size);
+    Check("chunk_flipped_rejected", flipped);
+    Check("chunk_truncated_rejected", truncated);
+
+    // 没有区域文件时走旧版单区块 pack 文件 chunks 目录由 ChunkWrite 创建
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "metadot_bench";
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+
+    Chunk writer;
+    writer.ChunkInit(0, 0, dir.string());
+    writer.layer2 = layer2;
+    out.push_back(RunBench(opt, "chunk_write", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) writer.ChunkWrite(tiles.data(), background.data());
+    }));
+    // 数组属于这里的 vector 不能交给 ChunkDelete 归还
+    writer.tiles = nullptr;
+    writer.background = nullptr;
+
+    Chunk reader;
+    reader.ChunkInit(0, 0, dir.string());
+    reader.ChunkRead();
+    Check("chunk_read_match", samePixels(tiles.data(), reader.tiles, N) && sameLayer2(layer2, reader.layer2) && std::equal(background.begin(), background.end(), reader.background));
+    reader.ChunkDelete();
+    out.push_back(RunBench(opt, "chunk_read", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            reader.ChunkRead();
+            g_sink += reader.background[N - 1];
+            reader.ChunkDelete();
+        }
+    }));
+
+    std::filesystem::remove_all(dir, ec);
+}
+
+void BenchPixels(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr size_t N = (size_t)CHUNK_W * CHUNK_H * 16;
+    std::vector<MaterialInstance> tiles(CHUNK_W * CHUNK_H), layer2(CHUNK_W * CHUNK_H);
+    std::vector<u32> background(CHUNK_W * CHUNK_H);
+    FillChunk(tiles.data(), layer2.data(), background.data(), opt.seed);
+
+    CellStore cells;
+    cells.resize(N);
+    for (size_t i = 0; i < N; i++) cells.set(i, tiles[i % tiles.size()]);
+
+    CellPixelConverter converter;
+    converter.update_materials();
+
+    std::vector<u8> pixels(N * 4), emission(N * 4), fire(N * 4), packed(N * 4);
+    out.push_back(RunBench(opt, "pixels_convert", (f64)N, [&](u64 n) {
+        u64 acc = 0;
+        for (u64 it = 0; it < n; it++) {
+            for (size_t base = 0; base < N; base += 64) {
+                CellPixelConverter::Result r = converter.convert(cells, base, ~(u64)0, pixels.data(), emission.data(), fire.data());
+                acc += r.fire | r.soup;
+            }
+        }
+        g_sink += acc + pixels[N * 4 - 1];
+    }));
+
+    if (converter.packed_supported()) {
+        out.push_back(RunBench(opt, "pixels_convert_packed", (f64)N, [&](u64 n) {
+            u64 acc = 0;
+            for (u64 it = 0; it < n; it++) {
+                for (size_t base = 0; base < N; base += 64) {
+                    CellPixelConverter::Result r = converter.convert_packed(cells, base, ~(u64)0, packed.data(), fire.data());
+                    acc += r.fire | r.soup;
+                }
+            }
+            g_sink += acc + packed[N * 4 - 1];
+        }));
+    }
+
+    // 向量内核与标量版本的输出相同 材料随机 其中八分之一是 FIRE 奇数组的 mask 随机
+    // 平移 13 个像素后有一组跨过环形存储的末尾 这一组走标量
+    constexpr size_t M = 64 * 97;
+    CellStore ring;
+    ring.resize(M);
+    FastRNG rng(RNG_Mix(opt.seed + 1));
+    const std::vector<Material *> &mats = GAME()->materials_container;
+    Material *fireMat = GAME()->materials_array[GAME()->materials_list.FIRE.id];
+    for (size_t i = 0; i < M; i++) {
+        Material *m = rng.next() % 8 == 0 ? fireMat : mats[rng.next() % mats.size()];
+        ring.set(i, MaterialInstance(m, rng.next(), 0));
+    }
+    ring.shift(13);
+
+    struct Output {
+        std::vector<u8> pixels, emission, fire;
+        std::vector<u64> masks;
+        bool operator==(const Output &o) const { return pixels == o.pixels && emission == o.emission && fire == o.fire && masks == o.masks; }
+    };
+    auto convertAll = [&](bool packedMode, Output &o) {
+        o.pixels.assign(M * 4, 0xcd);
+        o.emission.assign(M * 4, 0xcd);
+        o.fire.assign(M * 4, 0xcd);
+        o.masks.clear();
+        FastRNG maskRng(RNG_Mix(opt.seed + 2));
+        for (size_t base = 0; base < M; base += 64) {
+            const u64 mask = (base / 64) % 2 ? ((u64)maskRng.next() << 32 | maskRng.next()) : ~(u64)0;
+            const CellPixelConverter::Result r = packedMode ? converter.convert_packed(ring, base, mask, o.pixels.data(), o.fire.data())
+                                                            : converter.convert(ring, base, mask, o.pixels.data(), o.emission.data(), o.fire.data());
+            o.masks.push_back(r.fire);
+            o.masks.push_back(r.soup);
+        }
+    };
+    Output simd, scalar;
+    convertAll(false, simd);
+    WithSimdLevel(simd_level::scalar, [&] { convertAll(false, scalar); });
+    Check("pixels_scalar_match", simd == scalar);
+    if (converter.packed_supported()) {
+        convertAll(true, simd);
+        WithSimdLevel(simd_level::scalar, [&] { convertAll(true, scalar); });
+        Check("pixels_packed_scalar_match", simd == scalar);
+    }
+}
+
+void BenchPerimeter(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int W = CHUNK_W;
+    constexpr int H = CHUNK_H;
+    std::vector<u8> mask;
+    FillMask(mask, W, H);
+
+    out.push_back(RunBench(opt, "perimeter_simplify", 1, [&](u64 n) {
+        size_t acc = 0;
+        std::vector<MEvec2> points;
+        for (u64 i = 0; i < n; i++) {
+            MarchingSquares::Result r = MarchingSquares::FindPerimeter(W, H, mask.data());
+            points.clear();
+            f32 x = (f32)r.initialX;
+            f32 y = (f32)r.initialY;
+            for (const MarchingSquares::Direction &d : r.directions) {
+                points.push_back({x, y});
+                x += d.x;
+                y += d.y;
+            }
+            acc += simplify(points, 1).size();
+        }
+        g_sink += acc;
+    }));
+
+    MarchingSquares::Contours contours;
+    out.push_back(RunBench(opt, "contours_extract", 1, [&](u64 n) {
+        size_t acc = 0;
+        for (u64 i = 0; i < n; i++) {
+            MarchingSquares::ExtractContours(W, H, mask.data(), contours, 1);
+            acc += contours.points.size();
+        }
+        g_sink += acc;
+    }));
+
+    // 标量和向量的二值化/分类内核输出相同的轮廓 宽度不是 16 的倍数 覆盖尾部
+    auto sameContours = [](const MarchingSquares::Contours &a, const MarchingSquares::Contours &b) {
+        if (a.points.size() != b.points.size() || a.contours.size() != b.contours.size()) return false;
+        for (size_t i = 0; i < a.points.size(); i++) {
+            if (a.points[i].x != b.points[i].x || a.points[i].y != b.points[i].y) return false;
+        }
+        for (size_t i = 0; i < a.contours.size(); i++) {
+            if (a.contours[i].begin != b.contours[i].begin || a.contours[i].count != b.contours[i].count || a.contours[i].hole != b.contours[i].hole) return false;
+        }
+        return true;
+    };
+    bool same = true;
+    std::vector<u8> noise;
+    MarchingSquares::Contours scalar;
+    for (int k = 0; k < 16 && same; k++) {
+        const int w = 1 + k * 23, h = 1 + k * 13;
+        RandomMask(noise, w, h, opt.seed + k, 20 + k * 4);
+        for (f32 tolerance : {0.0f, 1.0f}) {
+            WithSimdLevel(simd_level::scalar, [&] { MarchingSquares::ExtractContours(w, h, noise.data(), scalar, tolerance); });
+            MarchingSquares::ExtractContours(w, h, noise.data(), contours, tolerance);
+            same = same && sameContours(scalar, contours);
+        }
+    }
+    Check("contours_scalar_match", same);
+}
+
+// 按扫描顺序逐个像素广度优先填充的 4 连通标签 与 ConnectedComponents::label 的编号规则相同
+void ReferenceLabels(const u8 *mask, int w, int h, int stride, std::vector<u32> &labels, std::vector<ConnectedComponents::Component> &components) {
+    labels.assign((size_t)w * h, 0);
+    components.clear();
+    std::vector<int> queue;
+    for (int start = 0; start < w * h; start++) {
+        if (labels[start] || !mask[start % w + (size_t)(start / w) * stride]) continue;
+        components.push_back({start % w, start / w, start % w + 1, start / w + 1, 0});
+        ConnectedComponents::Component &c = components.back();
+        const u32 id = (u32)components.size();
+        labels[start] = id;
+        queue.assign(1, start);
+        for (size_t q = 0; q < queue.size(); q++) {
+            const int x = queue[q] % w, y = queue[q] / w;
+            c.x0 = std::min(c.x0, x);
+            c.x1 = std::max(c.x1, x + 1);
+            c.y0 = std::min(c.y0, y);
+            c.y1 = std::max(c.y1, y + 1);
+            c.pixels++;
+            const int nx[4] = {x - 1, x + 1, x, x}, ny[4] = {y, y, y - 1, y + 1};
+            for (int k = 0; k < 4; k++) {
+                if (nx[k] < 0 || nx[k] >= w || ny[k] < 0 || ny[k] >= h) continue;
+                const int n = nx[k] + ny[k] * w;
+                if (labels[n] || !mask[nx[k] + (size_t)ny[k] * stride]) continue;
+                labels[n] = id;
+                queue.push_back(n);
+            }
+        }
+    }
+}
+
+void BenchComponents(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    // 与 physicsCheck 的探测窗口相近
+    constexpr int W = 257;
+    constexpr int H = 257;
+    std::vector<u8> mask;
+    FillMask(mask, W, H);
+    ConnectedComponents::Labels labels;
+    out.push_back(RunBench(opt, "components_label", (f64)W * H, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) ConnectedComponents::label(mask.data(), W, H, W, labels);
+        g_sink += labels.components.size();
+    }));
+
+    // 随机位图上与逐像素填充的结果相同 标量和向量的 RowBits 也相同
+    // 行距比宽度多 3 字节 填充为非零 不能被当作前景
+    auto sameComponents = [](const std::vector<ConnectedComponents::Component> &a, const std::vector<ConnectedComponents::Component> &b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const ConnectedComponents::Component &p, const ConnectedComponents::Component &q) {
+                   return p.x0 == q.x0 && p.y0 == q.y0 && p.x1 == q.x1 && p.y1 == q.y1 && p.pixels == q.pixels;
+               });
+    };
+    bool reference = true, scalar = true;
+    std::vector<u8> noise, padded;
+    std::vector<u32> refLabels;
+    std::vector<ConnectedComponents::Component> refComponents;
+    ConnectedComponents::Labels scalarLabels;
+    for (int k = 0; k < 16; k++) {
+        const int w = 1 + k * 23, h = 1 + k * 13, stride = w + 3;
+        RandomMask(noise, w, h, opt.seed + k, 30 + k * 3);
+        padded.assign((size_t)stride * h, 0xff);
+        for (int y = 0; y < h; y++) std::copy_n(noise.begin() + (size_t)y * w, w, padded.begin() + (size_t)y * stride);
+
+        ConnectedComponents::label(padded.data(), w, h, stride, labels);
+        ReferenceLabels(padded.data(), w, h, stride, refLabels, refComponents);
+        reference = reference && labels.labels == refLabels && sameComponents(labels.components, refComponents);
+
+        WithSimdLevel(simd_level::scalar, [&] { ConnectedComponents::label(padded.data(), w, h, stride, scalarLabels); });
+        scalar = scalar && labels.labels == scalarLabels.labels && sameComponents(labels.components, scalarLabels.components);
+    }
+    Check("components_reference_match", reference);
+    Check("components_scalar_match", scalar);
+}
+
+void BenchNoise(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    // 与 DefaultGenerator 的洞穴噪声相近 一个区块宽 按行批量计算
+    constexpr int W = CHUNK_W;
+    constexpr int H = CHUNK_H;
+    FastNoise noise;
+    noise.SetSeed((int)opt.seed);
+    std::vector<FN_DECIMAL> xs(W), ys(H), grid((size_t)W * H);
+    for (int i = 0; i < W; i++) xs[i] = (FN_DECIMAL)i / 4;
+    for (int j = 0; j < H; j++) ys[j] = (FN_DECIMAL)j / 4;
+    out.push_back(RunBench(opt, "noise_perlin_grid", (f64)W * H, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) noise.GetPerlinGrid(xs.data(), W, ys.data(), H, 2960, grid.data());
+        g_sink += (u64)(i64)(grid[W * H - 1] * 1000);
+    }));
+    out.push_back(RunBench(opt, "noise_perlin_points", (f64)W * H, [&](u64 n) {
+        FN_DECIMAL acc = 0;
+        for (u64 i = 0; i < n; i++) {
+            for (int j = 0; j < H; j++) {
+                for (int k = 0; k < W; k++) acc += noise.GetPerlin(xs[k], ys[j], 2960);
+            }
+        }
+        g_sink += (u64)(i64)acc;
+    }));
+
+    // 每种插值和每个内核 GetPerlinGrid 与逐点的 GetPerlin 逐位相同
+    // 宽度不是 4 或 8 的倍数时覆盖标量尾部 坐标包括负数和超过 256 的格子
+    FastRNG rng(RNG_Mix(opt.seed));
+    bool same = true;
+    std::vector<FN_DECIMAL> rx, ry, rgrid;
+    for (FastNoise::Interp interp : {FastNoise::Linear, FastNoise::Hermite, FastNoise::Quintic}) {
+        noise.SetInterp(interp);
+        for (simd_level level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+            for (int width : {1, 3, 4, 7, 8, 13, 17, 31, W}) {
+                const int height = 1 + width % 5;
+                rx.resize(width);
+                ry.resize(height);
+                rgrid.assign((size_t)width * height, 0);
+                for (FN_DECIMAL &v : rx) v = (FN_DECIMAL)((int)(rng.next() % 200000) - 100000) / 7;
+                for (FN_DECIMAL &v : ry) v = (FN_DECIMAL)((int)(rng.next() % 200000) - 100000) / 7;
+                const FN_DECIMAL z = (FN_DECIMAL)(rng.next() % 10000);
+                WithSimdLevel(level, [&] { noise.GetPerlinGrid(rx.data(), width, ry.data(), height, z, rgrid.data()); });
+                for (int j = 0; j < height; j++) {
+                    for (int i = 0; i < width; i++) {
+                        const FN_DECIMAL ref = noise.GetPerlin(rx[i], ry[j], z);
+                        same = same && memcmp(&ref, &rgrid[i + (size_t)j * width], sizeof(FN_DECIMAL)) == 0;
+                    }
+                }
+            }
+        }
+    }
+    Check("noise_perlin_grid_match", same);
+}
+
+// 与 world.cpp 中交给 b2World::SetParallelFor 的实现相同
+void BenchParallelFor(void *, int32 count, int32 minRange, b2ParallelTaskFcn *task, void *taskContext) {
+    const int32 ranges = std::min<int32>((count + minRange - 1) / minRange, (int32)job::worker_count() * 4);
+    if (ranges <= 1) {
+        task(taskContext, 0, count);
+        return;
+    }
+    job::parallel_for((uint32_t)ranges, 1, [&](uint32_t r) { task(taskContext, (int32)((i64)count * r / ranges), (int32)((i64)count * (r + 1) / ranges)); });
+}
+
+// 地面上 6 摞互不接触的箱子 每摞 40 个 每摞是一个岛 大于 b2_wideMinContacts 走宽求解
+std::unique_ptr<b2World> BoxStacks(u32 seed) {
+    auto w = std::make_unique<b2World>(b2Vec2(0, 20));
+    b2BodyDef groundDef;
+    b2Body *ground = w->CreateBody(&groundDef);
+    b2PolygonShape groundShape;
+    groundShape.SetAsBox(200, 1, b2Vec2(0, 1), 0);
+    ground->CreateFixture(&groundShape, 0);
+
+    FastRNG rng(RNG_Mix(seed));
+    b2PolygonShape box;
+    box.SetAsBox(0.5f, 0.5f);
+    for (int stack = 0; stack < 6; stack++) {
+        for (int i = 0; i < 40; i++) {
+            b2BodyDef def;
+            def.type = b2_dynamicBody;
+            // 稍微错开 让箱子在落下的过程中互相推挤
+            def.position.Set(-60 + stack * 20 + (f32)(rng.next() % 21 - 10) * 0.01f, -0.5f - (f32)i * 1.05f);
+            b2Body *b = w->CreateBody(&def);
+            b->CreateFixture(&box, 1)->SetFriction(0.6f);
+        }
+    }
+    return w;
+}
+
+void BenchBox2D(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr f32 TIME_STEP = 1.0f / 30;
+
+    // 串行和并行求解的岛按相同顺序处理 结果逐位相同
+    auto serial = BoxStacks(opt.seed), parallel = BoxStacks(opt.seed);
+    parallel->SetParallelFor(&BenchParallelFor, nullptr);
+    for (int i = 0; i < 400; i++) {
+        serial->Step(TIME_STEP, 5, 2);
+        parallel->Step(TIME_STEP, 5, 2);
+    }
+    bool same = serial->GetBodyCount() == parallel->GetBodyCount();
+    for (b2Body *a = serial->GetBodyList(), *b = parallel->GetBodyList(); same && a && b; a = a->GetNext(), b = b->GetNext()) {
+        same = a->GetPosition() == b->GetPosition() && a->GetAngle() == b->GetAngle() && a->GetLinearVelocity() == b->GetLinearVelocity() && a->GetAngularVelocity() == b->GetAngularVelocity();
+    }
+    Check("box2d_parallel_match", same);
+
+    // 不让箱子休眠 每一步都要求解全部的岛
+    for (auto [name, world] : {std::pair{"box2d_step", serial.get()}, std::pair{"box2d_step_parallel", parallel.get()}}) {
+        world->SetAllowSleeping(false);
+        out.push_back(RunBench(opt, name, world->GetBodyCount(), [&](u64 n) {
+            for (u64 i = 0; i < n; i++) world->Step(TIME_STEP, 5, 2);
+        }));
+    }
+}
+
+// 两堵墙之间一池水 两块弹性固体粒子团和一些箱子落进去 固体团走 ComputeDepth 水走 SolveCollision
+std::unique_ptr<b2World> LiquidPool(u32 seed) {
+    auto w = std::make_unique<b2World>(b2Vec2(0, 20));
+    b2BodyDef groundDef;
+    b2Body *ground = w->CreateBody(&groundDef);
+    b2PolygonShape wall;
+    wall.SetAsBox(20, 1, b2Vec2(0, 1), 0);
+    ground->CreateFixture(&wall, 0);
+    for (f32 x : {-20.0f, 20.0f}) {
+        wall.SetAsBox(1, 15, b2Vec2(x, -14), 0);
+        ground->CreateFixture(&wall, 0);
+    }
+
+    b2ParticleSystemDef systemDef;
+    systemDef.radius = 0.25f;
+    b2ParticleSystem *particles = w->CreateParticleSystem(&systemDef);
+
+    FastRNG rng(RNG_Mix(seed));
+    auto jitter = [&] { return (f32)(rng.next() % 21 - 10) * 0.01f; };
+    b2PolygonShape shape;
+    shape.SetAsBox(8, 4);
+    b2ParticleGroupDef water;
+    water.shape = &shape;
+    water.position.Set(jitter(), -4);
+    particles->CreateParticleGroup(water);
+    shape.SetAsBox(2, 2);
+    for (f32 x : {-8.0f, 8.0f}) {
+        b2ParticleGroupDef solid;
+        solid.shape = &shape;
+        solid.flags = b2_elasticParticle;
+        solid.groupFlags = b2_solidParticleGroup;
+        solid.position.Set(x + jitter(), -14);
+        particles->CreateParticleGroup(solid);
+    }
+
+    b2PolygonShape box;
+    box.SetAsBox(0.5f, 0.5f);
+    for (int i = 0; i < 10; i++) {
+        b2BodyDef def;
+        def.type = b2_dynamicBody;
+        def.position.Set(-15 + (f32)i * 3 + jitter(), -20);
+        w->CreateBody(&def)->CreateFixture(&box, 0.5f);
+    }
+    return w;
+}
+
+void BenchLiquidFun(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr f32 TIME_STEP = 1.0f / 30;
+
+    auto serial = LiquidPool(opt.seed), parallel = LiquidPool(opt.seed);
+    parallel->SetParallelFor(&BenchParallelFor, nullptr);
+    for (int i = 0; i < 120; i++) {
+        serial->Step(TIME_STEP, 5, 2, 3);
+        parallel->Step(TIME_STEP, 5, 2, 3);
+    }
+    const b2ParticleSystem *a = serial->GetParticleSystemList(), *b = parallel->GetParticleSystemList();
+    const int32 count = a->GetParticleCount();
+    bool same = count == b->GetParticleCount() && memcmp(a->GetPositionBuffer(), b->GetPositionBuffer(), count * sizeof(b2Vec2)) == 0 &&
+                memcmp(a->GetVelocityBuffer(), b->GetVelocityBuffer(), count * sizeof(b2Vec2)) == 0;
+    for (b2Body *x = serial->GetBodyList(), *y = parallel->GetBodyList(); same && x && y; x = x->GetNext(), y = y->GetNext()) {
+        same = x->GetPosition() == y->GetPosition() && x->GetAngle() == y->GetAngle();
+    }
+    Check("liquidfun_parallel_match", same);
+
+    for (auto [name, world] : {std::pair{"liquidfun_step", serial.get()}, std::pair{"liquidfun_step_parallel", parallel.get()}}) {
+        out.push_back(RunBench(opt, name, world->GetParticleSystemList()->GetParticleCount(), [&](u64 n) {
+            for (u64 i = 0; i < n; i++) world->Step(TIME_STEP, 5, 2, 3);
+        }));
+    }
+}
+
+// 预热之后第一遍重新排版 第二遍命中排版缓存 两遍画出的 drawlist 必须一样
+void BenchFontCache(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    ve_fontcache cache;
+    ve_fontcache_init(&cache);
+    ve_fontcache_configure_snap(&cache, 1920, 1080);
+    std::vector<uint8_t> fontData;
+    const ve_font_id font = ve_fontcache_loadfile(&cache, "data/assets/fonts/fusion-pixel-12px-monospaced.ttf", fontData, 24.0f);
+    Check("fontcache_font_loaded", font >= 0);
+    if (font < 0) return;
+
+    std::vector<std::string> texts = {"The quick brown fox jumps over the lazy dog 0123456789", "开始游戏 设置 退出", "正在生成世界 请稍候"};
+    FastRNG rng(RNG_Mix(opt.seed));
+    for (int i = 0; i < 32; i++) {
+        std::string s;
+        for (u32 n = 1 + rng.next() % 40; n > 0; n--) s += (char)(' ' + rng.next() % 95);
+        texts.push_back(s);
+    }
+    for (const std::string &s : texts) ve_fontcache_warmup(&cache, font, s);
+
+    auto draw = [&] {
+        ve_fontcache_flush_drawlist(&cache);
+        for (size_t i = 0; i < texts.size(); i++) ve_fontcache_draw_text(&cache, font, texts[i], 0.1f, 0.05f + (f32)i * 0.025f, 1.0f / 1920, 1.0f / 1080);
+    };
+    draw();
+    const ve_fontcache_drawlist fresh = *ve_fontcache_get_drawlist(&cache);
+    draw();
+    const ve_fontcache_drawlist &cached = *ve_fontcache_get_drawlist(&cache);
+    bool same = fresh.vertices.size() == cached.vertices.size() && fresh.indices == cached.indices && fresh.dcalls.size() == cached.dcalls.size() &&
+                memcmp(fresh.vertices.data(), cached.vertices.data(), fresh.vertices.size() * sizeof(ve_fontcache_vertex)) == 0;
+    for (size_t i = 0; same && i < fresh.dcalls.size(); i++) {
+        const ve_fontcache_draw &a = fresh.dcalls[i], &b = cached.dcalls[i];
+        same = a.pass == b.pass && a.start_index == b.start_index && a.end_index == b.end_index && a.clear_before_draw == b.clear_before_draw && a.region == b.region &&
+               memcmp(a.colour, b.colour, sizeof(a.colour)) == 0;
+    }
+    Check("fontcache_cached_run_match", same);
+
+    out.push_back(RunBench(opt, "fontcache_draw_cached", (f64)texts.size(), [&](u64 n) {
+        for (u64 i = 0; i < n; i++) draw();
+    }));
+    ve_fontcache_shutdown(&cache);
+}
+
+void BenchTemperature(const BenchOptions &opt, game *g, std::vector<BenchResult> &out) {
+    world *w = bench::CreateWorld(g, CHUNK_W * 8);
+    bench::BuildScene(w, opt.seed);
+    const f64 pixels = (f64)w->width * w->height;
+
+    // 每次都唤醒全部区域 测的是整张地图的传导
+    out.push_back(RunBench(opt, "tick_temperature", pixels, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            w->wakeAllRegions();
+            w->tickTemperature();
+        }
+    }));
+
+    g->Iso.world.reset();
+}
+
+void BenchThreadPool(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int BATCH = 256;
+    thread_pool pool(4);
+    std::vector<std::future<int>> futures;
+    futures.reserve(BATCH);
+
+    out.push_back(RunBench(opt, "thread_pool_push", BATCH, [&](u64 n) {
+        u64 acc = 0;
+        for (u64 i = 0; i < n; i++) {
+            futures.clear();
+            for (int j = 0; j < BATCH; j++) futures.push_back(pool.push([j](int) { return j; }));
+            for (auto &f : futures) acc += (u64)f.get();
+        }
+        g_sink += acc;
+    }));
+
+    out.push_back(RunBench(opt, "job_parallel_for", BATCH, [&](u64 n) {
+        std::atomic<u64> acc = 0;
+        for (u64 i = 0; i < n; i++) job::parallel_for(BATCH, 1, [&](u32 j) { acc.fetch_add(j, std::memory_order_relaxed); });
+        g_sink += acc.load();
+    }));
+}
+
+void BenchECS(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int ENTITIES = 10000;
+    ecs::registry reg;
+    FastRNG rng(RNG_Mix(opt.seed));
+    for (int i = 0; i < ENTITIES; i++) {
+        auto e = reg.create_entity();
+        ecs::entity_filler(e).component<BenchPosition>((f32)(rng.next() % 1000), (f32)(rng.next() % 1000));
+        // 一半的实体有速度 与 NpcSystem 这类带过滤的遍历相同
+        if (i % 2 == 0) ecs::entity_filler(e).component<BenchVelocity>(1.0f, -1.0f);
+    }
+
+    out.push_back(RunBench(opt, "ecs_iterate_joined", ENTITIES / 2, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            reg.for_joined_components<BenchPosition, BenchVelocity>([](ecs::entity, BenchPosition &p, const BenchVelocity &v) {
+                p.x += v.vx;
+                p.y += v.vy;
+            });
+        }
+    }));
+
+    out.push_back(RunBench(opt, "ecs_iterate_joined_parallel", ENTITIES / 2, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            reg.parallel_for_joined_components<BenchPosition, BenchVelocity>(256, [](ecs::entity, BenchPosition &p, const BenchVelocity &v) {
+                p.x += v.vx;
+                p.y += v.vy;
+            });
+        }
+    }));
+
+    // 分组之后同样的遍历只扫描组内的实体
+    reg.group_components<BenchPosition, BenchVelocity>();
+    out.push_back(RunBench(opt, "ecs_iterate_grouped", ENTITIES / 2, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            reg.for_joined_components<BenchPosition, BenchVelocity>([](ecs::entity, BenchPosition &p, const BenchVelocity &v) {
+                p.x += v.vx;
+                p.y += v.vy;
+            });
+        }
+    }));
+
+    out.push_back(RunBench(opt, "ecs_iterate_single", ENTITIES, [&](u64 n) {
+        f32 acc = 0;
+        for (u64 i = 0; i < n; i++) {
+            reg.for_each_component<BenchPosition>([&acc](ecs::entity, const BenchPosition &p) { acc += p.x; });
+        }
+        g_sink += (u64)acc;
+    }));
+}
+
+void BenchLua(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int CALLS = 1000;
+    lua_wrapper::State lua;
+    lua["bench_add"] = lua_wrapper::function([](int a, int b) { return a + b; });
+    lua["bench_add_fast"] = lua_wrapper::fast_function([](int a, int b) { return a + b; });
+    lua["bench_len"] = lua_wrapper::function([](const char *s) { return (int)strlen(s); });
+    lua["bench_len_fast"] = lua_wrapper::fast_function([](const char *s) { return (int)strlen(s); });
+    lua.dostring(
+            "function bench_loop(n) local s = 0 for i = 1, n do s = s + bench_add(i, 1) end return s end\n"
+            "function bench_loop_fast(n) local s = 0 for i = 1, n do s = s + bench_add_fast(i, 1) end return s end\n"
+            "function bench_loop_str(n) local s = 0 for i = 1, n do s = s + bench_len('data/scripts/game.lua') end return s end\n"
+            "function bench_loop_str_fast(n) local s = 0 for i = 1, n do s = s + bench_len_fast('data/scripts/game.lua') end return s end\n"
+            "function bench_lua_add(a, b) return a + b end\n");
+
+    lua_wrapper::LuaFunction loop = lua["bench_loop"];
+    out.push_back(RunBench(opt, "lua_call_cpp", CALLS, [&](u64 n) {
+        u64 acc = 0;
+        for (u64 i = 0; i < n; i++) acc += (u64)loop.call<int>(CALLS);
+        g_sink += acc;
+    }));
+
+    // 同样的绑定分别走 lua_wrapper::function 和 fast_function 比较每次调用的开销
+    const std::pair<const char *, const char *> loops[] = {
+            {"lua_call_cpp_fast", "bench_loop_fast"},
+            {"lua_call_cpp_str", "bench_loop_str"},
+            {"lua_call_cpp_str_fast", "bench_loop_str_fast"},
+    };
+    for (const auto &[name, fn] : loops) {
+        lua_wrapper::LuaFunction f = lua[fn];
+        out.push_back(RunBench(opt, name, CALLS, [&](u64 n) {
+            u64 acc = 0;
+            for (u64 i = 0; i < n; i++) acc += (u64)f.call<int>(CALLS);
+            g_sink += acc;
+        }));
+    }
+
+    lua_wrapper::LuaFunction add = lua["bench_lua_add"];
+    out.push_back(RunBench(opt, "cpp_call_lua", 1, [&](u64 n) {
+        u64 acc = 0;
+        for (u64 i = 0; i < n; i++) acc += (u64)add.call<int>((int)i, 1);
+        g_sink += acc;
+    }));
+}
+
+void BenchSerializer(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    namespace sr = meta::static_refl;
+
+    FastRNG rng(RNG_Mix(opt.seed));
+    SerializeRecord rec;
+    rec.id = rng.next();
+    rec.name = "bench record";
+    rec.points.resize(1024);
+    for (SerializePoint &p : rec.points) p = {(i32)rng.next(), (i32)rng.next()};
+    for (int i = 0; i < 16; i++) rec.tags.push_back(std::string(1 + rng.next() % 24, (char)('a' + i)));
+    rec.origin = {-3, 7};
+    rec.scale = 0.25f;
+    rec.enabled = true;
+    rec.added = 42;
+    SerializeRecord parent;
+    rec.parent = &parent;
+
+    std::vector<u8> bytes;
+    sr::Serialize(rec, bytes);
+
+    SerializeRecord back;
+    back.legacy = 5;
+    Check("serialize_roundtrip", sr::Deserialize(back, bytes.data(), bytes.size()) && [&] {
+        // 不写出的字段保留读之前的值
+        SerializeRecord expect = rec;
+        expect.legacy = 5;
+        return back == expect && back.parent == nullptr;
+    }());
+    // 版本 + id + 名字 + 点 (个数 元素版本 整段) + 标签 + 原点 (版本 字段) + 缩放 + 开关 + added 不含 legacy 和指针
+    size_t tagBytes = 0;
+    for (const std::string &t : rec.tags) tagBytes += 4 + t.size();
+    Check("serialize_size", bytes.size() == 4 + 4 + (4 + rec.name.size()) + (8 + rec.points.size() * 8) + (4 + tagBytes) + (4 + 8) + 4 + 1 + 4);
+
+    bool truncatedOk = true;
+    for (size_t n : {(size_t)0, (size_t)3, bytes.size() / 2, bytes.size() - 1}) {
+        SerializeRecord cut;
+        truncatedOk &= !sr::Deserialize(cut, bytes.data(), n);
+    }
+    Check("serialize_truncated", truncatedOk);
+
+    // 比当前新的版本不读
+    std::vector<u8> newer = bytes;
+    newer[0] = 3;
+    SerializeRecord future;
+    Check("serialize_newer_version", !sr::Deserialize(future, newer.data(), newer.size()));
+
+    out.push_back(RunBench(opt, "serialize_record", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            bytes.clear();
+            sr::Serialize(rec, bytes);
+        }
+        g_sink += bytes.size();
+    }));
+
+    out.push_back(RunBench(opt, "deserialize_record", 1, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) sr::Deserialize(back, bytes.data(), bytes.size());
+        g_sink += back.points.size();
+    }));
+}
+
+void BenchChunkMap(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int SIDE = 64;
+    constexpr int LOOKUPS = 4096;
+    ChunkMap map;
+    std::vector<Chunk> chunks(SIDE * SIDE);
+    for (int y = 0; y < SIDE; y++) {
+        for (int x = 0; x < SIDE; x++) map.insert(x - SIDE / 2, y - SIDE / 2, &chunks[x + y * SIDE]);
+    }
+
+    // 四分之一的查找落在表外 与加载边缘的 peekChunk 相近
+    std::vector<std::pair<int, int>> keys(LOOKUPS);
+    FastRNG rng(RNG_Mix(opt.seed));
+    for (auto &k : keys) k = {rng.next() % (SIDE * 5 / 4) - SIDE / 2, rng.next() % (SIDE * 5 / 4) - SIDE / 2};
+
+    out.push_back(RunBench(opt, "chunkmap_find", LOOKUPS, [&](u64 n) {
+        u64 hits = 0;
+        for (u64 i = 0; i < n; i++) {
+            for (const auto &[cx, cy] : keys) hits += map.find(cx, cy) != nullptr;
+        }
+        g_sink += hits;
+    }));
+}
+
+void BenchEntityGrid(const BenchOptions &opt, std::vector<BenchResult> &out) {
+    constexpr int ENTITIES = 10000;
+    constexpr int QUERIES = 256;
+    constexpr f32 SIDE = 4096;
+    constexpr f32 RADIUS = 64;
+    ecs::registry reg;
+    EntityGrid grid;
+    FastRNG rng(RNG_Mix(opt.seed));
+    for (int i = 0; i < ENTITIES; i++) {
+        const f32 x = (f32)(rng.next() % (int)SIDE);
+        const f32 y = (f32)(rng.next() % (int)SIDE);
+        auto e = reg.create_entity();
+        ecs::entity_filler(e).component<BenchPosition>(x, y);
+        grid.update(e.id(), x, y, 14, 26);
+    }
+    std::vector<std::pair<f32, f32>> points(QUERIES);
+    for (auto &p : points) p = {(f32)(rng.next() % (int)SIDE), (f32)(rng.next() % (int)SIDE)};
+
+    // 与 query_radius 相同的判断 逐个检查所有实体
+    out.push_back(RunBench(opt, "entity_radius_scan", QUERIES, [&](u64 n) {
+        u64 hits = 0;
+        for (u64 i = 0; i < n; i++) {
+            for (const auto &[qx, qy] : points) {
+                reg.for_each_component<BenchPosition>([&](ecs::entity, const BenchPosition &p) {
+                    const f32 dx = qx - std::clamp(qx, p.x, p.x + 14);
+                    const f32 dy = qy - std::clamp(qy, p.y, p.y + 26);
+                    hits += dx * dx + dy * dy <= RADIUS * RADIUS;
+                });
+            }
+        }
+        g_sink += hits;
+    }));
+
+    out.push_back(RunBench(opt, "entity_radius_grid", QUERIES, [&](u64 n) {
+        u64 hits = 0;
+        for (u64 i = 0; i < n; i++) {
+            for (const auto &[qx, qy] : points) grid.query_radius(qx, qy, RADIUS, [&](ecs::entity_id) { hits++; });
+        }
+        g_sink += hits;
+    }));
+
+    // 每个 tick 所有实体移动一点 大多数不换格子
+    out.push_back(RunBench(opt, "entity_grid_update", ENTITIES, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            grid.begin_update();
+            reg.for_each_component<BenchPosition>([&](ecs::entity e, BenchPosition &p) {
+                p.x += (i & 1) ? -1.0f : 1.0f;
+                grid.update(e.id(), p.x, p.y, 14, 26);
+            });
+            grid.end_update();
+        }
+    }));
+}
+
+bool ParseBenchOptions(int argc, char *argv[], BenchOptions &opt) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(a, "--filter") && hasValue) {
+            opt.filter = argv[++i];
+        } else if (!strcmp(a, "--min-time") && hasValue) {
+            opt.minTimeMs = std::max(atof(argv[++i]), 1.0);
+        } else if (!strcmp(a, "--seed") && hasValue) {
+            opt.seed = (u32)strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--filter NAME] [--min-time MS] [--seed S]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void PrintJson(const BenchOptions &opt, const std::vector<BenchResult> &results) {
+    printf("{\n");
+    printf("  \"seed\": %u,\n", opt.seed);
+    printf("  \"workers\": %u,\n", job::worker_count());
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        const f64 itemsPerSec = r.nsPerOp > 0 ? r.itemsPerOp * 1e9 / r.nsPerOp : 0;
+        printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"items_per_op\": %.0f, \"items_per_sec\": %.0f}%s\n", r.name.c_str(),
+               (unsigned long long)r.iterations, r.nsPerOp, r.itemsPerOp, itemsPerSec, i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    BenchOptions opt;
+    if (!ParseBenchOptions(argc, argv, opt)) return 1;
+
+    auto g = bench::CreateGame(argc, argv, opt.seed);
+
+    // 各组按固定顺序运行 --filter 按组名匹配
+    struct Group {
+        const char *name;
+        std::function<void(std::vector<BenchResult> &)> run;
+    };
+    const Group groups[] = {
+            {"chunk", [&](auto &out) { BenchChunkCodec(opt, out); }},
+            {"pixels", [&](auto &out) { BenchPixels(opt, out); }},
+            {"perimeter", [&](auto &out) { BenchPerimeter(opt, out); }},
+            {"components", [&](auto &out) { BenchComponents(opt, out); }},
+            {"noise", [&](auto &out) { BenchNoise(opt, out); }},
+            {"temperature", [&](auto &out) { BenchTemperature(opt, g.get(), out); }},
+            {"box2d", [&](auto &out) { BenchBox2D(opt, out); }},
+            {"liquidfun", [&](auto &out) { BenchLiquidFun(opt, out); }},
+            {"fontcache", [&](auto &out) { BenchFontCache(opt, out); }},
+            {"thread_pool", [&](auto &out) { BenchThreadPool(opt, out); }},
+            {"ecs", [&](auto &out) { BenchECS(opt, out); }},
+            {"lua", [&](auto &out) { BenchLua(opt, out); }},
+            {"serializer", [&](auto &out) { BenchSerializer(opt, out); }},
+            {"chunkmap", [&](auto &out) { BenchChunkMap(opt, out); }},
+            {"entity_grid", [&](auto &out) { BenchEntityGrid(opt, out); }},
+    };
+
+    std::vector<BenchResult> results;
+    for (const Group &group : groups) {
+        if (!opt.filter.empty() && std::string(group.name).find(opt.filter) == std::string::npos) continue;
+        group.run(results);
+    }
+
+    PrintJson(opt, results);
+
+    bench::DestroyGame(g);
+    return g_checkFailures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+// Copyright(c) 2022-2023, KaoruXun All rights reserved.
+
+// 无窗口的世界模拟基准 不创建窗口 不初始化 GL 渲染器 FMOD 和脚本系统
+// 按固定种子生成测试场景 (或读取存档) 运行 N 个 tick 输出各子系统的 ms/tick 和每秒更新的像素数
+// 最后输出世界像素的校验和 用来比较调整参数前后的模拟结果
+// --checksum 每个 tick 之后计算区块哈希 (tick_checksum) 输出逐 tick 滚动的 stateHash 任何一个 tick 的结果不同都会改变它
+//
+// 用法: WorldBench [--ticks 600] [--seed 1] [--size 1024] [--world saves/xxx] [--pregen R] [--no-temperature] [--no-box2d] [--checksum] [--simd LEVEL] [--stress NAME]
+// --simd scalar|sse2|avx2|avx512|neon|best 限制向量内核的指令集 不同指令集的 tiles hash 应当相同
+// --stress explosions|flood|debris|fire|traversal 在场景上运行 StressScene --ticks 个 tick 种子取 --seed 跑完退出
+// 与游戏的 --stress 相同的布置和操作 但完全不创建窗口 traversal 只移动自由镜头 基准的 tickZone 不跟随
+// --pregen 先把存档中心 R 个区块半径的范围生成并写盘 再按正常流程加载 需要同时指定 --world
+// 需要在仓库根目录运行 (刚体贴图从 data/ 读取)
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "engine/core/cpu_dispatch.hpp"
+#include "engine/utils/utility.hpp"
+#include "tests/bench_common.hpp"
+
+using namespace ME;
+
+namespace {
+
+struct BenchArgs {
+    int ticks = 600;
+    u32 seed = 1;
+    int size = 1024;
+    std::string worldPath;
+    int pregen = 0;
+    bool temperature = true;
+    bool box2d = true;
+    bool checksum = false;
+    simd_level simd = simd_level::avx512;
+    std::string stress;
+};
+
+// 与 game.cpp 游戏循环中的顺序相同 去掉了渲染 纹理上传和玩家
+enum BenchStage { Stage_Tick, Stage_Cells, Stage_Objects, Stage_Temperature, Stage_Count };
+const char *BenchStageNames[Stage_Count] = {"world::tick", "tickCells", "tickObjects", "tickTemperature"};
+
+// 按 engine 默认的 maxTps = 30 推进物理 每 tick 一个 physics_step_rate 步长
+const f64 BenchTickMs = 1000.0 / 30;
+
+bool ParseBenchArgs(int argc, char *argv[], BenchArgs &args) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(a, "--ticks") && hasValue) {
+            args.ticks = std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(a, "--seed") && hasValue) {
+            args.seed = (u32)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(a, "--size") && hasValue) {
+            // 至少留出 tickZone 两侧各一个区块
+            args.size = std::clamp(atoi(argv[++i]) / CHUNK_W * CHUNK_W, CHUNK_W * 4, 4096);
+        } else if (!strcmp(a, "--world") && hasValue) {
+            args.worldPath = argv[++i];
+        } else if (!strcmp(a, "--pregen") && hasValue) {
+            args.pregen = std::max(atoi(argv[++i]), 0);
+        } else if (!strcmp(a, "--no-temperature")) {
+            args.temperature = false;
+        } else if (!strcmp(a, "--no-box2d")) {
+            args.box2d = false;
+        } else if (!strcmp(a, "--checksum")) {
+            args.checksum = true;
+        } else if (!strcmp(a, "--simd") && hasValue && cpu::parse(argv[i + 1], args.simd)) {
+            i++;
+        } else if (!strcmp(a, "--stress") && hasValue && StressScene::from_name(argv[i + 1]) != StressScene::NONE) {
+            args.stress = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--ticks N] [--seed S] [--size N] [--world PATH] [--pregen R] [--no-temperature] [--no-box2d] [--checksum] [--simd LEVEL] [--stress NAME]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 与 game::run 相同的区块加载范围 等待加载流水线清空并全部合并
+void LoadWorldChunks(world *w) {
+    for (int x = -CHUNK_W * 4; x < w->width + CHUNK_W * 4; x += CHUNK_W) {
+        for (int y = -CHUNK_H * 3; y < w->height + CHUNK_H * 8; y += CHUNK_H) {
+            w->queueLoadChunk(x / CHUNK_W, y / CHUNK_H, true, true);
+        }
+    }
+    while (w->chunkLoader.size() > 0 || w->mergePending() || w->needToTickGeneration) {
+        w->frame();
+        if (w->needToTickGeneration) w->tickChunkGeneration();
+    }
+}
+
+u64 HashTiles(world *w) {
+    u64 hash = 0xcbf29ce484222325ull;
+    const size_t n = (size_t)w->width * w->height;
+    for (size_t i = 0; i < n; i++) hash = (hash ^ w->real_tiles[i].id()) * 0x100000001b3ull;
+    return hash;
+}
+
+size_t CountDirty(DirtyMap &dirty) {
+    size_t n = 0;
+    dirty.update_rects();
+    dirty.for_each_word([&](size_t, u64 word) { n += (size_t)std::popcount(word); });
+    return n;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    BenchArgs args;
+    if (!ParseBenchArgs(argc, argv, args)) return 1;
+    cpu::set_max_level(args.simd);
+
+    auto g = bench::CreateGame(argc, argv, args.seed);
+    bench::SetupGlobalDEF(g->Iso.globaldef, args.temperature, args.box2d);
+    g->Iso.globaldef.tick_checksum = args.checksum;
+    world *w = bench::CreateWorld(g.get(), args.size, args.worldPath);
+
+    if (args.worldPath.empty()) {
+        bench::BuildScene(w, args.seed);
+    } else {
+        if (args.pregen > 0) {
+            Timer pregenTimer;
+            pregenTimer.start();
+            w->pregenerate((-w->loadZone.x + w->loadZone.w / 2) / CHUNK_W, (-w->loadZone.y + w->loadZone.h / 2) / CHUNK_H, args.pregen);
+            pregenTimer.stop();
+            printf("pregen radius %d %.1f ms\n", args.pregen, pregenTimer.get());
+        }
+        LoadWorldChunks(w);
+        // 基准不写回存档
+        w->noSaveLoad = true;
+    }
+    w->updateWorldMesh();
+
+    const bool stress = !args.stress.empty() && bench::StartStress(g.get(), args.stress, (u32)args.ticks);
+
+    f64 stageMs[Stage_Count] = {};
+    size_t updated = 0;
+    Timer timer;
+
+    // 压力场景先等待 WARMUP_TICKS 再运行 --ticks 个 tick 等待的 tick 也计入耗时
+    int ticks = 0;
+    for (int t = 0; stress ? !g->stress.finished() : t < args.ticks; t++) {
+        timer.start();
+        w->tick();
+        timer.stop();
+        stageMs[Stage_Tick] += timer.get();
+
+        timer.start();
+        w->tickCells();
+        if (!w->mergePending()) w->tickObjectBounds();
+        w->applyObjectImpulses();
+        w->clearObjectOwners();
+        timer.stop();
+        stageMs[Stage_Cells] += timer.get();
+
+        timer.start();
+        if (args.box2d) {
+            w->tickObjectLOD();
+            w->tickLiquidParticles();
+            w->tickObjects(BenchTickMs);
+        }
+        if (t % 10 == 0) w->tickObjectsMesh();
+        if (args.box2d && t % GameTick == 0) w->updateWorldMesh();
+        timer.stop();
+        stageMs[Stage_Objects] += timer.get();
+
+        w->collectActiveRegions();
+        updated += CountDirty(w->dirty);
+        w->dirty.clear();
+        w->layer2Dirty.update_rects();
+        w->layer2Dirty.clear();
+        w->backgroundUploads.clear();
+        w->backgroundReleases.clear();
+
+        timer.start();
+        if (args.temperature && t % GameTick == 2) w->tickTemperature();
+        timer.stop();
+        stageMs[Stage_Temperature] += timer.get();
+
+        if (stress) {
+            g->stress.tick(*g);
+            g->stress.end_frame();
+        }
+        ticks++;
+    }
+
+    f64 totalMs = 0;
+    for (f64 ms : stageMs) totalMs += ms;
+
+    printf("world %dx%d seed %u ticks %d workers %u simd %s\n", (int)w->width, (int)w->height, args.seed, ticks, job::worker_count(), cpu::describe());
+    for (int s = 0; s < Stage_Count; s++) printf("  %-16s %9.3f ms/tick\n", BenchStageNames[s], stageMs[s] / ticks);
+    printf("  %-16s %9.3f ms/tick\n", "total", totalMs / ticks);
+    printf("  cells updated    %9.0f /tick %12.0f /s\n", (f64)updated / ticks, totalMs > 0 ? updated / (totalMs / 1000.0) : 0.0);
+    printf("  tiles hash       %016llx\n", (unsigned long long)HashTiles(w));
+    if (args.checksum) printf("  state hash       %016llx\n", (unsigned long long)w->stateHash);
+
+    bench::DestroyGame(g);
+    return 0;
+}
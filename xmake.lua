@@ -197,6 +197,38 @@ do
 	add_headerfiles("source/**.hpp")
 end
 
+-- 无窗口的世界模拟基准 见 source/tests/bench_world.cpp
+target("WorldBench")
+do
+	set_kind("binary")
+	set_targetdir("output")
+	add_includedirs(include_dir_list)
+	add_defines(defines_list)
+
+	add_links(link_list)
+	add_deps("MetaDotLibs")
+
+	add_files("source/engine/**.cpp|main.cpp")
+	add_files("source/game/**.cpp")
+	add_files("source/tests/bench_world.cpp")
+end
+
+-- 引擎热点路径的微基准 输出 JSON 见 source/tests/bench_hotpaths.cpp
+target("HotPathBench")
+do
+	set_kind("binary")
+	set_targetdir("output")
+	add_includedirs(include_dir_list)
+	add_defines(defines_list)
+
+	add_links(link_list)
+	add_deps("MetaDotLibs")
+
+	add_files("source/engine/**.cpp|main.cpp")
+	add_files("source/game/**.cpp")
+	add_files("source/tests/bench_hotpaths.cpp")
+end
+
 -- target("TestFFI")
 -- do
 --     set_kind("shared")